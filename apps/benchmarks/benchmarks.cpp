@@ -0,0 +1,379 @@
+// Runs the apps on fixed inputs, and records the times in a JSON file
+// that can be compared against a baseline recorded on the same machine.
+//
+// Usage: ./benchmarks [--output results.json] [--baseline baseline.json]
+//                     [--tolerance 0.1] [--filter name]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "halide_blur.h"
+#include "local_laplacian.h"
+#include "local_laplacian_auto_schedule.h"
+#include "bilateral_grid.h"
+#include "bilateral_grid_auto_schedule.h"
+#include "camera_pipe.h"
+#include "camera_pipe_auto_schedule.h"
+#include "conv_layer.h"
+#include "conv_layer_auto_schedule.h"
+#include "stencil_chain.h"
+#include "stencil_chain_auto_schedule.h"
+#include "nl_means.h"
+#include "nl_means_auto_schedule.h"
+#include "lens_blur.h"
+#include "lens_blur_auto_schedule.h"
+#include "Convolution.h"
+
+#include "halide_benchmark.h"
+#include "HalideBuffer.h"
+
+using namespace Halide::Runtime;
+using namespace Halide::Tools;
+
+namespace {
+
+struct Result {
+    std::string name;
+    std::string input;
+    double time_ms;
+    uint64_t samples, iterations;
+};
+
+// The inputs are pseudo-random, but the same on every run, so that
+// the data-dependent apps do the same work each time.
+template<typename T>
+void fill(Buffer<T> &buf, double lo, double hi, uint32_t seed) {
+    uint32_t state = seed;
+    buf.for_each_value([&](T &v) {
+        state = state * 1664525u + 1013904223u;
+        v = (T)(lo + (hi - lo) * ((state >> 8) / (double)(1 << 24)));
+    });
+}
+
+template<typename T>
+std::string shape(const Buffer<T> &buf) {
+    std::ostringstream s;
+    for (int i = 0; i < buf.dimensions(); i++) {
+        s << (i ? "x" : "") << buf.dim(i).extent();
+    }
+    return s.str();
+}
+
+std::string escape(const std::string &str) {
+    std::string result;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        if (c >= ' ') {
+            result += c;
+        }
+    }
+    return result;
+}
+
+std::string cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                return line.substr(line.find_first_not_of(' ', colon + 1));
+            }
+        }
+    }
+    return "unknown";
+}
+
+std::string gpu_api(const std::string &target) {
+    for (const char *api : {"cuda", "opencl", "metal", "d3d12compute", "openglcompute", "opengl"}) {
+        if (target.find(api) != std::string::npos) {
+            return api;
+        }
+    }
+    return "none";
+}
+
+// The results of a JSON file written by write_results, by name.
+std::map<std::string, double> read_results(const std::string &filename) {
+    std::map<std::string, double> results;
+    std::ifstream in(filename);
+    std::string line;
+    const std::string name_key = "\"name\": \"", time_key = "\"time_ms\": ";
+    while (std::getline(in, line)) {
+        size_t name = line.find(name_key), time = line.find(time_key);
+        if (name == std::string::npos || time == std::string::npos) {
+            continue;
+        }
+        name += name_key.size();
+        results[line.substr(name, line.find('"', name) - name)] =
+            atof(line.c_str() + time + time_key.size());
+    }
+    return results;
+}
+
+void write_results(FILE *f, const std::string &target, const std::vector<Result> &results) {
+    const char *gpu_device = getenv("HL_GPU_DEVICE");
+    const char *num_threads = getenv("HL_NUM_THREADS");
+    fprintf(f, "{\n");
+    fprintf(f, "  \"target\": \"%s\",\n", escape(target).c_str());
+#ifdef HALIDE_COMMIT
+    fprintf(f, "  \"halide_commit\": \"%s\",\n", HALIDE_COMMIT);
+#endif
+    fprintf(f, "  \"cpu\": {\"model\": \"%s\", \"hardware_threads\": %u, \"HL_NUM_THREADS\": \"%s\"},\n",
+            escape(cpu_model()).c_str(), std::thread::hardware_concurrency(),
+            num_threads ? escape(num_threads).c_str() : "");
+    fprintf(f, "  \"gpu\": {\"api\": \"%s\", \"HL_GPU_DEVICE\": \"%s\"},\n",
+            gpu_api(target).c_str(), gpu_device ? escape(gpu_device).c_str() : "");
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        // One benchmark per line, which is what read_results expects.
+        fprintf(f, "    {\"name\": \"%s\", \"input\": \"%s\", \"time_ms\": %.6g, \"samples\": %llu, \"iterations\": %llu}%s\n",
+                r.name.c_str(), r.input.c_str(), r.time_ms,
+                (unsigned long long)r.samples, (unsigned long long)r.iterations,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string output, baseline, filter;
+    double tolerance = 0.1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--output")) {
+            output = argv[i + 1];
+        } else if (!strcmp(argv[i], "--baseline")) {
+            baseline = argv[i + 1];
+        } else if (!strcmp(argv[i], "--tolerance")) {
+            tolerance = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--filter")) {
+            filter = argv[i + 1];
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+
+    // Time one call of the pipeline, including waiting for it on the GPU.
+    auto run = [&](const std::string &name, const std::string &input,
+                   std::function<int()> pipeline, std::function<void()> sync) {
+        if (name.find(filter) == std::string::npos) {
+            return;
+        }
+        printf("Running %s on %s...\n", name.c_str(), input.c_str());
+        fflush(stdout);
+        int error = pipeline();
+        sync();
+        if (error) {
+            fprintf(stderr, "%s failed: %d\n", name.c_str(), error);
+            failed = true;
+            return;
+        }
+        BenchmarkResult r = benchmark([&]() {
+            pipeline();
+            sync();
+        });
+        results.push_back({name, input, r.wall_time * 1e3, r.samples, r.iterations});
+    };
+
+    {
+        Buffer<uint16_t> input(6408, 4802);
+        fill(input, 0, 4096, 1);
+        Buffer<uint16_t> out(input.width() - 8, input.height() - 2);
+        run("halide_blur", shape(input),
+            [&]() { return halide_blur(input, out); },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<uint16_t> input(1536, 2560, 3);
+        fill(input, 0, 65536, 2);
+        Buffer<uint16_t> out(input.width(), input.height(), 3);
+        const int levels = 8;
+        const float alpha = 1.0f / (levels - 1), beta = 1.0f;
+        run("local_laplacian", shape(input),
+            [&]() { return local_laplacian(input, levels, alpha, beta, out); },
+            [&]() { out.device_sync(); });
+        run("local_laplacian_auto_schedule", shape(input),
+            [&]() { return local_laplacian_auto_schedule(input, levels, alpha, beta, out); },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<float> input(1536, 2560);
+        fill(input, 0, 1, 3);
+        Buffer<float> out(input.width(), input.height());
+        const float r_sigma = 0.1f;
+        run("bilateral_grid", shape(input),
+            [&]() { return bilateral_grid(input, r_sigma, out); },
+            [&]() { out.device_sync(); });
+        run("bilateral_grid_auto_schedule", shape(input),
+            [&]() { return bilateral_grid_auto_schedule(input, r_sigma, out); },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<uint16_t> input(2592, 1968);
+        fill(input, 0, 1024, 4);
+        Buffer<uint8_t> out(((input.width() - 32) / 32) * 32, ((input.height() - 24) / 32) * 32, 3);
+        // The color matrices of the Nokia N900 from the camera_pipe app.
+        const float m3200[3][4] = {{1.6697f, -0.2693f, -0.4004f, -42.4346f},
+                                   {-0.3576f, 1.0615f, 1.5949f, -37.1158f},
+                                   {-0.2175f, -1.8751f, 6.9640f, -26.6970f}};
+        const float m7000[3][4] = {{2.2997f, -0.4478f, 0.1706f, -39.0923f},
+                                   {-0.3826f, 1.5906f, -0.2080f, -25.4311f},
+                                   {-0.0888f, -0.7344f, 2.2832f, -20.0826f}};
+        Buffer<float> matrix_3200(4, 3), matrix_7000(4, 3);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                matrix_3200(j, i) = m3200[i][j];
+                matrix_7000(j, i) = m7000[i][j];
+            }
+        }
+        const float color_temp = 3700, gamma = 2.0f, contrast = 50, sharpen = 1.0f;
+        const int black_level = 25, white_level = 1023;
+        run("camera_pipe", shape(input),
+            [&]() {
+                return camera_pipe(input, matrix_3200, matrix_7000, color_temp, gamma,
+                                   contrast, sharpen, black_level, white_level, out);
+            },
+            [&]() { out.device_sync(); });
+        run("camera_pipe_auto_schedule", shape(input),
+            [&]() {
+                return camera_pipe_auto_schedule(input, matrix_3200, matrix_7000, color_temp, gamma,
+                                                 contrast, sharpen, black_level, white_level, out);
+            },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<float> input(67, 67, 32, 4), filter(3, 3, 32, 32), bias(32);
+        fill(input, -1, 1, 5);
+        fill(filter, -1, 1, 6);
+        fill(bias, -1, 1, 7);
+        Buffer<float> out(64, 64, 32, 4);
+        run("conv_layer", shape(input),
+            [&]() { return conv_layer(input, filter, bias, out); },
+            [&]() { out.device_sync(); });
+        run("conv_layer_auto_schedule", shape(input),
+            [&]() { return conv_layer_auto_schedule(input, filter, bias, out); },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<uint16_t> input(1536, 2560);
+        fill(input, 0, 65536, 8);
+        Buffer<uint16_t> out(input.width(), input.height());
+        run("stencil_chain", shape(input),
+            [&]() { return stencil_chain(input, 512, 512, out); },
+            [&]() { out.device_sync(); });
+        run("stencil_chain_auto_schedule", shape(input),
+            [&]() { return stencil_chain_auto_schedule(input, 512, 512, out); },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<float> input(1536, 2560, 3);
+        fill(input, 0, 1, 9);
+        Buffer<float> out(input.width(), input.height(), 3);
+        const int patch_size = 7, search_area = 7;
+        const float sigma = 0.12f;
+        run("nl_means", shape(input),
+            [&]() { return nl_means(input, patch_size, search_area, sigma, out); },
+            [&]() { out.device_sync(); });
+        run("nl_means_auto_schedule", shape(input),
+            [&]() { return nl_means_auto_schedule(input, patch_size, search_area, sigma, out); },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        Buffer<uint8_t> left(384, 640, 3), right(384, 640, 3);
+        fill(left, 0, 256, 10);
+        fill(right, 0, 256, 11);
+        Buffer<float> out(left.width(), left.height(), 3);
+        const int slices = 32, focus_depth = 13, aperture_samples = 32;
+        const float blur_radius_scale = 0.5f;
+        run("lens_blur", shape(left),
+            [&]() {
+                return lens_blur(left, right, slices, focus_depth, blur_radius_scale,
+                                 aperture_samples, out);
+            },
+            [&]() { out.device_sync(); });
+        run("lens_blur_auto_schedule", shape(left),
+            [&]() {
+                return lens_blur_auto_schedule(left, right, slices, focus_depth, blur_radius_scale,
+                                               aperture_samples, out);
+            },
+            [&]() { out.device_sync(); });
+    }
+
+    {
+        // A 3x3 layer of MobileNet, from nn_ops, in 8 bits.
+        const int depth = 32, width = 56, height = 56;
+        Buffer<uint8_t> input(depth, width, height, 1), filter(depth, 3, 3, depth);
+        Buffer<int32_t> bias(depth);
+        fill(input, 0, 256, 12);
+        fill(filter, 0, 256, 13);
+        fill(bias, -1000, 1000, 14);
+        Buffer<uint8_t> out(depth, width, height, 1);
+        run("nn_ops_convolution", shape(input),
+            [&]() {
+                return Convolution(input, filter, bias, -128, -128, depth, 1, 1, 1, 0,
+                                   1 << 30, 8, 128, 0, 255, out);
+            },
+            [&]() { out.device_sync(); });
+    }
+
+    const std::string target = halide_blur_metadata()->target;
+    if (!output.empty()) {
+        FILE *f = fopen(output.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "Can't write %s\n", output.c_str());
+            return -1;
+        }
+        write_results(f, target, results);
+        fclose(f);
+    } else {
+        write_results(stdout, target, results);
+    }
+
+    if (!baseline.empty()) {
+        std::map<std::string, double> expected = read_results(baseline);
+        if (expected.empty()) {
+            printf("No baseline in %s to compare against; run 'make baseline' to record one\n",
+                   baseline.c_str());
+        }
+        for (const Result &r : results) {
+            auto it = expected.find(r.name);
+            if (it == expected.end()) {
+                continue;
+            }
+            double ratio = r.time_ms / it->second;
+            bool regressed = ratio > 1 + tolerance;
+            printf("%-32s %10.3fms %10.3fms %+7.1f%%%s\n", r.name.c_str(), it->second, r.time_ms,
+                   (ratio - 1) * 100, regressed ? "  REGRESSION" : "");
+            failed |= regressed;
+        }
+    }
+
+    if (failed) {
+        return -1;
+    }
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "Halide.h"
+
+namespace {
+
+using namespace Halide;
+
+// High-dimensional bilateral filtering through a sparse permutohedral
+// lattice, built by build_permutohedral_lattice() in lattice.h. The values
+// are splatted onto the occupied vertices of the lattice, blurred along each
+// of its d + 1 directions, and sliced back at the pixels, so the storage is
+// one value per channel and occupied vertex. The adjoint of the values is
+// propagated through the same indices.
+class BilateralLattice : public Halide::Generator<BilateralLattice> {
+public:
+    // The dimensionality of the features the lattice was built from.
+    GeneratorParam<int>     dimensions{"dimensions", 5};
+
+    Input<Buffer<float>>    values{"values", 3};       // x, y, channel
+    Input<Buffer<int32_t>>  offsets{"offsets", 3};     // vertex, x, y
+    Input<Buffer<float>>    weights{"weights", 3};     // vertex, x, y
+    Input<Buffer<int32_t>>  neighbors{"neighbors", 3}; // side, direction, vertex
+    Input<Buffer<float>>    adjoint{"adjoint", 3};     // x, y, channel
+
+    Output<Buffer<float>>   output{"output", 3};       // x, y, channel
+    Output<Buffer<float>>   d_values{"d_values", 3};   // same as values
+
+    void generate() {
+        /* THE ALGORITHM */
+
+        Var x("x"), y("y"), c("c"), v("v");
+
+        const int d = dimensions;
+        // The last vertex is empty, for the missing neighbors.
+        Expr num_vertices = neighbors.dim(2).extent() - 1;
+        Expr channels = values.dim(2).extent();
+
+        Func f_values("f_values");
+        f_values(x, y, c) = values(x, y, c);
+        // Splat a homogeneous channel of ones along with the values, to
+        // normalize by the total weight when slicing.
+        Func homogeneous("homogeneous");
+        homogeneous(x, y, c) = select(c < channels, f_values(x, y, min(c, channels - 1)), 1.0f);
+
+        auto vertex = [&](Expr k, Expr x, Expr y) {
+            return clamp(offsets(k, x, y), 0, num_vertices);
+        };
+
+        RDom r(0, d + 1, values.dim(0).min(), values.dim(0).extent(),
+               values.dim(1).min(), values.dim(1).extent(), "r");
+        Func splat("splat");
+        splat(c, v) = 0.0f;
+        splat(c, vertex(r[0], r[1], r[2])) += weights(r[0], r[1], r[2]) * homogeneous(r[1], r[2], c);
+
+        // Blur with [1 2 1] / 4 along each direction of the lattice.
+        std::vector<Func> blurred{ splat };
+        for (int j = 0; j <= d; j++) {
+            const Func &prev = blurred.back();
+            Func blur("blur_" + std::to_string(j));
+            Expr n0 = clamp(neighbors(0, j, v), 0, num_vertices);
+            Expr n1 = clamp(neighbors(1, j, v), 0, num_vertices);
+            blur(c, v) = select(v < num_vertices,
+                                0.5f * prev(c, v) + 0.25f * (prev(c, n0) + prev(c, n1)),
+                                0.0f);
+            blurred.push_back(blur);
+        }
+
+        Func slice("slice");
+        Expr sliced = 0.0f;
+        for (int k = 0; k <= d; k++) {
+            sliced += weights(k, x, y) * blurred.back()(c, vertex(k, x, y));
+        }
+        slice(x, y, c) = sliced;
+
+        Func f_output("f_output");
+        f_output(x, y, c) = slice(x, y, c) / slice(x, y, channels);
+
+        Derivative deriv = propagate_adjoints(f_output, adjoint,
+                                              {{adjoint.dim(0).min(), adjoint.dim(0).max()},
+                                               {adjoint.dim(1).min(), adjoint.dim(1).max()},
+                                               {adjoint.dim(2).min(), adjoint.dim(2).max()}});
+
+        output(x, y, c) = f_output(x, y, c);
+        d_values(x, y, c) = deriv(f_values)(x, y, c);
+
+        // The lattice has a vertex per occupied cell, plus the empty one.
+        for (const Func &f : blurred) {
+            Func(f).bound(v, 0, num_vertices + 1);
+        }
+
+        /* THE SCHEDULE */
+        if (auto_schedule) {
+            values.dim(0).set_bounds_estimate(0, 512);
+            values.dim(1).set_bounds_estimate(0, 512);
+            values.dim(2).set_bounds_estimate(0, 3);
+            offsets.dim(0).set_bounds_estimate(0, d + 1);
+            offsets.dim(1).set_bounds_estimate(0, 512);
+            offsets.dim(2).set_bounds_estimate(0, 512);
+            weights.dim(0).set_bounds_estimate(0, d + 1);
+            weights.dim(1).set_bounds_estimate(0, 512);
+            weights.dim(2).set_bounds_estimate(0, 512);
+            neighbors.dim(0).set_bounds_estimate(0, 2);
+            neighbors.dim(1).set_bounds_estimate(0, d + 1);
+            neighbors.dim(2).set_bounds_estimate(0, 65536);
+            adjoint.dim(0).set_bounds_estimate(0, 512);
+            adjoint.dim(1).set_bounds_estimate(0, 512);
+            adjoint.dim(2).set_bounds_estimate(0, 3);
+
+            output.estimate(x, 0, 512)
+                  .estimate(y, 0, 512)
+                  .estimate(c, 0, 3);
+            d_values.estimate(x, 0, 512)
+                    .estimate(y, 0, 512)
+                    .estimate(c, 0, 3);
+        } else {
+            // The splats scatter to arbitrary vertices, so they run
+            // serially; the blurs and slices are parallel gathers.
+            Var vo("vo"), vi("vi");
+            for (size_t j = 0; j < blurred.size(); j++) {
+                Func f = blurred[j];
+                f.compute_root();
+                if (j > 0) {
+                    f.split(v, vo, vi, 1024).parallel(vo);
+                }
+            }
+            slice.compute_root().parallel(y).vectorize(x, 8);
+            output.parallel(y).vectorize(x, 8);
+
+            // The adjoints run the same steps in reverse: scatters from
+            // the pixels to the vertices, blurs, and gathers at the pixels.
+            for (const Func &f : blurred) {
+                for (Func d_f : deriv.funcs(f)) {
+                    d_f.compute_root();
+                }
+            }
+            for (Func d_f : deriv.funcs(slice)) {
+                d_f.compute_root();
+            }
+            d_values.parallel(y).vectorize(x, 8);
+        }
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(BilateralLattice, bilateral_lattice)
@@ -0,0 +1,203 @@
+#ifndef BILATERAL_LATTICE_H
+#define BILATERAL_LATTICE_H
+
+// Host-side construction of the permutohedral lattice of Adams, Baek and
+// Davis, "Fast High-Dimensional Filtering Using the Permutohedral Lattice".
+// Each pixel, lifted to its d-dimensional feature vector (e.g. x, y, r, g, b
+// divided by the standard deviations of the filter), lies in a simplex of the
+// lattice, and splats onto its d + 1 vertices with barycentric weights.
+//
+// Only the vertices that some pixel touches are stored, numbered in a hash
+// table, so the memory is proportional to the number of occupied cells
+// instead of the volume of a dense grid. The bilateral_lattice generator
+// then splats, blurs and slices through the indices computed here.
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "HalideBuffer.h"
+
+struct PermutohedralLattice {
+    // The d + 1 vertices enclosing each pixel, offsets(k, x, y).
+    Halide::Runtime::Buffer<int32_t> offsets;
+    // The barycentric weights of these vertices, weights(k, x, y).
+    Halide::Runtime::Buffer<float> weights;
+    // The neighbors of each vertex along each of the d + 1 lattice
+    // directions, neighbors(side, direction, vertex). Missing neighbors,
+    // and the neighbors of the extra vertex num_vertices, are num_vertices,
+    // which always holds zero.
+    Halide::Runtime::Buffer<int32_t> neighbors;
+    int num_vertices;
+};
+
+namespace lattice_internal {
+
+struct KeyHash {
+    size_t operator()(const std::vector<int16_t> &key) const {
+        size_t h = 0;
+        for (int16_t k : key) {
+            h = h * 2531011 + (uint16_t)k;
+        }
+        return h;
+    }
+};
+
+typedef std::unordered_map<std::vector<int16_t>, int32_t, KeyHash> VertexTable;
+
+}  // namespace lattice_internal
+
+// Build the lattice of the features(x, y, i), i in [0, d).
+inline PermutohedralLattice build_permutohedral_lattice(const Halide::Runtime::Buffer<float> &features) {
+    using namespace lattice_internal;
+
+    const int W = features.dim(0).extent(), H = features.dim(1).extent();
+    const int d = features.dim(2).extent();
+
+    PermutohedralLattice lattice;
+    lattice.offsets = Halide::Runtime::Buffer<int32_t>(d + 1, W, H);
+    lattice.weights = Halide::Runtime::Buffer<float>(d + 1, W, H);
+
+    // The expected standard deviation of the blur of the lattice, and the
+    // scale of each axis of the elevated space.
+    const float inv_std_dev = std::sqrt(2.0f / 3.0f) * (d + 1);
+    std::vector<float> scale_factor(d);
+    for (int i = 0; i < d; i++) {
+        scale_factor[i] = inv_std_dev / std::sqrt((float)(i + 1) * (i + 2));
+    }
+
+    // The coordinates of the vertices of the canonical simplex.
+    std::vector<int> canonical((d + 1) * (d + 1));
+    for (int i = 0; i <= d; i++) {
+        for (int j = 0; j <= d - i; j++) {
+            canonical[i * (d + 1) + j] = i;
+        }
+        for (int j = d - i + 1; j <= d; j++) {
+            canonical[i * (d + 1) + j] = i - (d + 1);
+        }
+    }
+
+    VertexTable table;
+    std::vector<std::vector<int16_t>> keys;
+    std::vector<float> elevated(d + 1), barycentric(d + 2);
+    std::vector<int> greedy(d + 1), rank(d + 1);
+    std::vector<int16_t> key(d);
+    const float down_factor = 1.0f / (d + 1);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            // Elevate the features onto the hyperplane of the lattice.
+            float sm = 0;
+            for (int i = d; i > 0; i--) {
+                float cf = features(x, y, features.dim(2).min() + i - 1) * scale_factor[i - 1];
+                elevated[i] = sm - i * cf;
+                sm += cf;
+            }
+            elevated[0] = sm;
+
+            // Find the closest remainder-0 point.
+            int sum = 0;
+            for (int i = 0; i <= d; i++) {
+                float v = down_factor * elevated[i];
+                float up = std::ceil(v) * (d + 1);
+                float down = std::floor(v) * (d + 1);
+                greedy[i] = (int)(up - elevated[i] < elevated[i] - down ? up : down);
+                sum += greedy[i];
+            }
+            sum /= d + 1;
+
+            // Rank the differential to find the permutation between this
+            // simplex and the canonical one.
+            for (int i = 0; i <= d; i++) {
+                rank[i] = 0;
+            }
+            for (int i = 0; i < d; i++) {
+                for (int j = i + 1; j <= d; j++) {
+                    if (elevated[i] - greedy[i] < elevated[j] - greedy[j]) {
+                        rank[i]++;
+                    } else {
+                        rank[j]++;
+                    }
+                }
+            }
+            if (sum > 0) {
+                // Sum too large, the point is off the hyperplane.
+                for (int i = 0; i <= d; i++) {
+                    if (rank[i] >= d + 1 - sum) {
+                        greedy[i] -= d + 1;
+                        rank[i] += sum - (d + 1);
+                    } else {
+                        rank[i] += sum;
+                    }
+                }
+            } else if (sum < 0) {
+                for (int i = 0; i <= d; i++) {
+                    if (rank[i] < -sum) {
+                        greedy[i] += d + 1;
+                        rank[i] += (d + 1) + sum;
+                    } else {
+                        rank[i] += sum;
+                    }
+                }
+            }
+
+            // The barycentric coordinates in the simplex.
+            for (int i = 0; i <= d + 1; i++) {
+                barycentric[i] = 0;
+            }
+            for (int i = 0; i <= d; i++) {
+                float delta = (elevated[i] - greedy[i]) * down_factor;
+                barycentric[d - rank[i]] += delta;
+                barycentric[d + 1 - rank[i]] -= delta;
+            }
+            barycentric[0] += 1.0f + barycentric[d + 1];
+
+            // Look up or insert the vertices of the simplex.
+            for (int remainder = 0; remainder <= d; remainder++) {
+                for (int i = 0; i < d; i++) {
+                    key[i] = (int16_t)(greedy[i] + canonical[remainder * (d + 1) + rank[i]]);
+                }
+                auto it = table.find(key);
+                int32_t index;
+                if (it == table.end()) {
+                    index = (int32_t)keys.size();
+                    table.emplace(key, index);
+                    keys.push_back(key);
+                } else {
+                    index = it->second;
+                }
+                lattice.offsets(remainder, x, y) = index;
+                lattice.weights(remainder, x, y) = barycentric[remainder];
+            }
+        }
+    }
+
+    // Find the neighbors of each vertex along each direction of the lattice.
+    const int V = (int)keys.size();
+    lattice.num_vertices = V;
+    lattice.neighbors = Halide::Runtime::Buffer<int32_t>(2, d + 1, V + 1);
+    std::vector<int16_t> n1(d), n2(d);
+    for (int j = 0; j <= d; j++) {
+        for (int v = 0; v < V; v++) {
+            for (int i = 0; i < d; i++) {
+                n1[i] = keys[v][i] - 1;
+                n2[i] = keys[v][i] + 1;
+            }
+            if (j < d) {
+                n1[j] = keys[v][j] + d;
+                n2[j] = keys[v][j] - d;
+            }
+            auto it1 = table.find(n1);
+            auto it2 = table.find(n2);
+            lattice.neighbors(0, j, v) = it1 == table.end() ? V : it1->second;
+            lattice.neighbors(1, j, v) = it2 == table.end() ? V : it2->second;
+        }
+        lattice.neighbors(0, j, V) = V;
+        lattice.neighbors(1, j, V) = V;
+    }
+
+    return lattice;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include <cmath>
+#include <cstdio>
+
+#include "bilateral_lattice.h"
+#include "lattice.h"
+
+#include "halide_benchmark.h"
+#include "HalideBuffer.h"
+
+using namespace Halide::Tools;
+using namespace Halide::Runtime;
+
+int main(int argc, char **argv) {
+    const int W = 256, H = 256, C = 3;
+    const float sigma_s = 8.0f, sigma_r = 0.125f;
+
+    Buffer<float> image(W, H, C);
+    image.for_each_element([&](int x, int y, int c) {
+        image(x, y, c) = 0.5f + 0.25f * std::sin(x * 0.05f * (c + 1)) * std::cos(y * 0.03f) +
+                         0.1f * ((float)rand() / RAND_MAX);
+    });
+
+    // 5D bilateral filtering: position and color.
+    Buffer<float> features(W, H, 5);
+    features.for_each_element([&](int x, int y, int i) {
+        features(x, y, i) = i == 0 ? x / sigma_s : i == 1 ? y / sigma_s : image(x, y, i - 2) / sigma_r;
+    });
+
+    PermutohedralLattice lattice;
+    double build_t = benchmark(3, 1, [&]() { lattice = build_permutohedral_lattice(features); });
+    printf("Lattice: %d vertices, built in %gms\n", lattice.num_vertices, build_t * 1e3);
+
+    Buffer<float> adjoint(W, H, C);
+    adjoint.for_each_value([](float &v) { v = (float)rand() / RAND_MAX - 0.5f; });
+
+    Buffer<float> output(W, H, C), d_values(W, H, C);
+    auto run = [&](Buffer<float> &values) {
+        bilateral_lattice(values, lattice.offsets, lattice.weights, lattice.neighbors,
+                          adjoint, output, d_values);
+    };
+    run(image);
+
+    double t = benchmark(10, 1, [&]() { run(image); });
+    printf("Filter and adjoint time: %gms\n", t * 1e3);
+
+    // With the normalization weights fixed by the lattice, the filter is
+    // linear in the values, and d_values is its transpose applied to
+    // the adjoint: <filter(values), adjoint> == <values, d_values>.
+    double lhs = 0, rhs = 0;
+    output.for_each_element([&](int x, int y, int c) {
+        lhs += (double)output(x, y, c) * adjoint(x, y, c);
+        rhs += (double)image(x, y, c) * d_values(x, y, c);
+    });
+    if (std::abs(lhs - rhs) > 1e-3 * std::abs(lhs)) {
+        printf("Adjoint mismatch: %g vs %g\n", lhs, rhs);
+        return -1;
+    }
+
+    // A constant image stays constant.
+    Buffer<float> constant(W, H, C);
+    constant.fill(0.75f);
+    run(constant);
+    int mismatches = 0;
+    output.for_each_element([&](int x, int y, int c) {
+        if (std::abs(output(x, y, c) - 0.75f) > 1e-4f && mismatches++ < 10) {
+            printf("output(%d, %d, %d) = %f instead of 0.75\n", x, y, c, output(x, y, c));
+        }
+    });
+    if (mismatches) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
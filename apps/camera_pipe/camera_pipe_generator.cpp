@@ -12,6 +12,14 @@ using namespace Halide::ConciseCasts;
 // Shared variables
 Var x, y, c, yi, yo, yii, xi;
 
+// The callbacks of the streaming mode, implemented by the application:
+// block until the given row of the input has been written by the sensor,
+// and signal that the given row of the output has been written. Both
+// return 0, or non-zero to abandon the frame, in which case the
+// remaining samples read from the input or written to the output are 0.
+HalideExtern_1(int, camera_pipe_wait_for_row, int);
+HalideExtern_1(int, camera_pipe_row_done, int);
+
 // Average two positive values rounding up
 Expr avg(Expr a, Expr b) {
     Type wider = a.type().with_bits(a.type().bits() * 2);
@@ -207,6 +215,15 @@ public:
     // currently allow 8-bit computations
     GeneratorParam<Type> result_type{"result_type", UInt(8)};
 
+    // Stream the frame: process the input in strips of rows as the sensor
+    // writes them, waiting for each row in camera_pipe_wait_for_row, and
+    // report the output rows as they are written with camera_pipe_row_done.
+    // The strips are processed in order, on the calling thread, so the
+    // first output strip is ready a few strips after the sensor starts
+    // instead of after the whole frame. The callbacks run on the host, so
+    // this disables the Hexagon offload.
+    GeneratorParam<bool> streaming{"streaming", false};
+
     Input<Buffer<uint16_t>> input{"input", 2};
     Input<Buffer<float>> matrix_3200{"matrix_3200", 2};
     Input<Buffer<float>> matrix_7000{"matrix_7000", 2};
@@ -396,7 +413,14 @@ void CameraPipe::generate() {
     // shift by 16, 12. We also convert it to be signed, so we can deal
     // with values that fall below 0 during processing.
     Func shifted;
-    shifted(x, y) = cast<int16_t>(input(x+16, y+12));
+    Func sensor_ready("sensor_ready");
+    if (streaming) {
+        sensor_ready(y) = camera_pipe_wait_for_row(y);
+        shifted(x, y) = select(sensor_ready(y+12) == 0,
+                               cast<int16_t>(input(x+16, y+12)), cast<int16_t>(0));
+    } else {
+        shifted(x, y) = cast<int16_t>(input(x+16, y+12));
+    }
 
     Func denoised = hot_pixel_suppression(shifted);
 
@@ -409,7 +433,17 @@ void CameraPipe::generate() {
 
     Func curved = apply_curve(corrected);
 
-    processed(x, y, c) = sharpen(curved)(x, y, c);
+    Func sharpened = sharpen(curved);
+    Func rows_done("rows_done");
+    if (streaming) {
+        // The rows are signaled by the iteration after the one
+        // computing them, once they have been stored. The last rows are
+        // complete when the pipeline returns.
+        rows_done(y) = camera_pipe_row_done(y - 2);
+        processed(x, y, c) = select(rows_done(y) == 0, sharpened(x, y, c), cast<uint8_t>(0));
+    } else {
+        processed(x, y, c) = sharpened(x, y, c);
+    }
 
     // Schedule
     if (auto_schedule) {
@@ -434,7 +468,10 @@ void CameraPipe::generate() {
         //and in HVX 64 we need 4 threads, and on other devices,
         // we might need many threads.
         Expr strip_size;
-        if (get_target().has_feature(Target::HVX_128)) {
+        if (streaming) {
+            // Small strips, to start the output early.
+            strip_size = 32;
+        } else if (get_target().has_feature(Target::HVX_128)) {
             strip_size = processed.dim(1).extent() / 2;
         } else if (get_target().has_feature(Target::HVX_64)) {
             strip_size = processed.dim(1).extent() / 4;
@@ -454,8 +491,15 @@ void CameraPipe::generate() {
             .split(y, yi, yii, 2, TailStrategy::RoundUp)
             .split(yi, yo, yi, strip_size / 2)
             .vectorize(x, 2*vec, TailStrategy::RoundUp)
-            .unroll(c)
-            .parallel(yo);
+            .unroll(c);
+        if (!streaming) {
+            processed.parallel(yo);
+        } else {
+            // Wait for each input row once, as the sliding window first
+            // needs it, and signal each output row once.
+            sensor_ready.compute_at(processed, yi).store_at(processed, yo);
+            rows_done.compute_at(processed, yi);
+        }
 
         denoised.compute_at(processed, yi).store_at(processed, yo)
             .prefetch(input, y, 2)
@@ -485,7 +529,7 @@ void CameraPipe::generate() {
         demosaiced->intermed_store_at.set({processed, yo});
         demosaiced->output_compute_at.set({curved, x});
 
-        if (get_target().features_any_of({Target::HVX_64, Target::HVX_128})) {
+        if (get_target().features_any_of({Target::HVX_64, Target::HVX_128}) && !streaming) {
             processed.hexagon();
             denoised.align_storage(x, vec);
             deinterleaved.align_storage(x, vec);
@@ -4,6 +4,9 @@
 #ifndef NO_AUTO_SCHEDULE
 #include "camera_pipe_auto_schedule.h"
 #endif
+#ifndef NO_STREAMING
+#include "camera_pipe_streaming.h"
+#endif
 
 #include "HalideBuffer.h"
 #include "halide_image_io.h"
@@ -13,10 +16,43 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 using namespace Halide::Runtime;
 using namespace Halide::Tools;
 
+#ifndef NO_STREAMING
+// A simulated sensor, writing the rows of the frame one at a time, and the
+// callbacks of the streaming pipeline waiting on it.
+namespace {
+
+std::mutex sensor_mutex;
+std::condition_variable sensor_cond;
+int rows_written = 0, sensor_rows = 0;
+std::chrono::high_resolution_clock::time_point frame_start, first_row_done;
+bool any_row_done = false;
+
+}  // namespace
+
+extern "C" int camera_pipe_wait_for_row(int row) {
+    std::unique_lock<std::mutex> lock(sensor_mutex);
+    sensor_cond.wait(lock, [=]() { return row < rows_written || row >= sensor_rows; });
+    return 0;
+}
+
+extern "C" int camera_pipe_row_done(int row) {
+    if (row >= 0 && !any_row_done) {
+        first_row_done = std::chrono::high_resolution_clock::now();
+        any_row_done = true;
+    }
+    return 0;
+}
+#endif
+
 int main(int argc, char **argv) {
     if (argc < 8) {
         printf("Usage: ./process raw.png color_temp gamma contrast sharpen timing_iterations output.png\n"
@@ -82,6 +118,53 @@ int main(int argc, char **argv) {
     fprintf(stderr, "Halide (auto):\t%gus\n", best * 1e6);
     #endif
 
+    #ifndef NO_STREAMING
+    {
+        // Stream the frame from the simulated sensor, which takes about
+        // 20us per row, and check that the output matches.
+        Buffer<uint16_t> sensor(input.width(), input.height());
+        sensor.fill(0);
+        Buffer<uint8_t> streamed(output.width(), output.height(), 3);
+        sensor_rows = input.height();
+        rows_written = 0;
+        any_row_done = false;
+        frame_start = std::chrono::high_resolution_clock::now();
+        std::thread sensor_thread([&]() {
+            for (int y = 0; y < input.height(); y++) {
+                memcpy(&sensor(0, y), &input(0, y), input.width() * sizeof(uint16_t));
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+                std::lock_guard<std::mutex> lock(sensor_mutex);
+                rows_written = y + 1;
+                sensor_cond.notify_all();
+            }
+        });
+        camera_pipe_streaming(sensor, matrix_3200, matrix_7000,
+                              color_temp, gamma, contrast, sharpen, blackLevel, whiteLevel,
+                              streamed);
+        auto frame_end = std::chrono::high_resolution_clock::now();
+        sensor_thread.join();
+
+        for (int c = 0; c < 3; c++) {
+            for (int y = 0; y < output.height(); y++) {
+                for (int x = 0; x < output.width(); x++) {
+                    if (streamed(x, y, c) != output(x, y, c)) {
+                        fprintf(stderr, "streamed(%d, %d, %d) = %d instead of %d\n",
+                                x, y, c, streamed(x, y, c), output(x, y, c));
+                        return -1;
+                    }
+                }
+            }
+        }
+        if (!any_row_done) {
+            fprintf(stderr, "The streaming pipeline signaled no output rows\n");
+            return -1;
+        }
+        using ms = std::chrono::duration<double, std::milli>;
+        fprintf(stderr, "Halide (streaming):\tfirst rows after %gms, frame after %gms\n",
+                ms(first_row_done - frame_start).count(), ms(frame_end - frame_start).count());
+    }
+    #endif
+
     fprintf(stderr, "output: %s\n", argv[7]);
     convert_and_save_image(output, argv[7]);
     fprintf(stderr, "        %d %d\n", output.width(), output.height());
@@ -1,4 +1,5 @@
 #include "Halide.h"
+#include "winograd.h"
 
 namespace {
 
@@ -6,6 +7,10 @@ using namespace Halide;
 
 class ConvolutionLayer : public Halide::Generator<ConvolutionLayer> {
 public:
+    // If 2 or 4, compute the convolution with Winograd F(m x m, 3 x 3) for
+    // m = winograd, which requires a 3x3 filter.
+    GeneratorParam<int> winograd{"winograd", 0};
+
     Input<Buffer<float>>  input{"input", 4};
     Input<Buffer<float>>  filter{"filter", 4};
     Input<Buffer<float>>  bias{"bias", 1};
@@ -22,9 +27,18 @@ public:
                filter.dim(1).min(), filter.dim(1).extent(),
                filter.dim(2).min(), filter.dim(2).extent());
 
-        f_conv(x, y, z, n) = bias(z);
-
-        f_conv(x, y, z, n) += filter(r.x, r.y, r.z, z) * input(x + r.x, y + r.y, r.z, n);
+        WinogradConv wino;
+        if (winograd) {
+            filter.dim(0).set_bounds(0, 3);
+            filter.dim(1).set_bounds(0, 3);
+            wino = winograd_conv_3x3(BoundaryConditions::repeat_edge(input), filter,
+                                     filter.dim(2).extent(), winograd);
+            f_conv(x, y, z, n) = bias(z) + wino.output(x, y, z, n);
+        } else {
+            f_conv(x, y, z, n) = bias(z);
+
+            f_conv(x, y, z, n) += filter(r.x, r.y, r.z, z) * input(x + r.x, y + r.y, r.z, n);
+        }
 
         f_ReLU(x, y, z, n) = max(0, f_conv(x, y, z, n));
 
@@ -69,7 +83,10 @@ public:
                 .unroll(r.x, 3)
                 .unroll(r.y, 3)
                 .gpu_threads(x, y, z);
-        }*/ else {
+        }*/ else if (winograd) {
+            schedule_winograd(wino);
+            f_ReLU.reorder(n, z).parallel(z).vectorize(x, 8);
+        } else {
             // Blocking spatially with vectorization
             Var z_t("z_t"), y_t("y_t"), par("par");
             int vec_len = 8;
@@ -89,7 +106,54 @@ public:
                 .parallel(par);
             f_ReLU.reorder(n, z).parallel(z).vectorize(x, 8);
         }
-   }
+    }
+
+    void schedule_winograd(WinogradConv &wino) {
+        // The transforms are unrolled within the tiles so that their
+        // coefficients fold away, and vectorized across the channels or
+        // the filters; the products are a batch of matrix multiplies,
+        // one for each element of the transformed tiles.
+        const int vec_len = 8;
+        Var i = wino.filter_transform.args()[0], j = wino.filter_transform.args()[1];
+        Var c = wino.filter_transform.args()[2], k = wino.filter_transform.args()[3];
+        wino.filter_transform.compute_root()
+            .reorder(c, i, j, k)
+            .vectorize(c, vec_len)
+            .unroll(i)
+            .unroll(j)
+            .parallel(k);
+
+        Var tx = wino.input_transform.args()[3], ty = wino.input_transform.args()[4];
+        Var n = wino.input_transform.args()[5], par("par");
+        wino.input_transform.compute_root()
+            .reorder(c, i, j, tx, ty, n)
+            .vectorize(c, vec_len)
+            .unroll(i)
+            .unroll(j)
+            .fuse(ty, n, par)
+            .parallel(par);
+
+        Var pk = wino.product.args()[2];
+        Var ptx = wino.product.args()[3], pty = wino.product.args()[4], pn = wino.product.args()[5];
+        wino.product.compute_root()
+            .vectorize(pk, vec_len)
+            .fuse(pty, pn, par)
+            .parallel(par);
+        wino.product.update()
+            .reorder(pk, wino.product.rvars(0)[0], ptx, i, j, pty, pn)
+            .vectorize(pk, vec_len)
+            .fuse(pty, pn, par)
+            .parallel(par);
+
+        Var px = wino.output_transform.args()[0], py = wino.output_transform.args()[1];
+        wino.output_transform.compute_root()
+            .reorder(pk, px, py, ptx, pty, pn)
+            .vectorize(pk, vec_len)
+            .unroll(px)
+            .unroll(py)
+            .fuse(pty, pn, par)
+            .parallel(par);
+    }
 };
 
 }  // namespace
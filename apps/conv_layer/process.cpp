@@ -1,8 +1,11 @@
+#include <cmath>
 #include <cstdio>
 #include <chrono>
 
 #include "conv_layer.h"
 #include "conv_layer_auto_schedule.h"
+#include "conv_layer_winograd_2.h"
+#include "conv_layer_winograd_4.h"
 
 #include "halide_benchmark.h"
 #include "HalideBuffer.h"
@@ -19,7 +22,7 @@ int main(int argc, char **argv) {
         for (int z = 0; z < input.channels(); z++) {
             for (int y = 0; y < input.height(); y++) {
                 for (int x = 0; x < input.width(); x++) {
-                    input(x, y) = rand();
+                    input(x, y, z, c) = rand();
                 }
             }
         }
@@ -29,7 +32,7 @@ int main(int argc, char **argv) {
         for (int z = 0; z < filter.channels(); z++) {
             for (int y = 0; y < filter.height(); y++) {
                 for (int x = 0; x < filter.width(); x++) {
-                    filter(x, y) = rand();
+                    filter(x, y, z, c) = rand();
                 }
             }
         }
@@ -57,5 +60,31 @@ int main(int argc, char **argv) {
     });
     printf("Auto-scheduled time: %gms\n", min_t_auto * 1e3);
 
+    // Winograd versions, checked against the direct convolution
+    float max_output = 0.0f;
+    output.for_each_value([&](float v) { max_output = std::max(max_output, std::abs(v)); });
+    Buffer<float> winograd_output(64, 64, 32, 4);
+    for (int m : {2, 4}) {
+        auto winograd = m == 2 ? conv_layer_winograd_2 : conv_layer_winograd_4;
+        winograd(input, filter, bias, winograd_output);
+        int mismatches = 0;
+        winograd_output.for_each_element([&](int x, int y, int z, int n) {
+            // The transforms round differently than the direct sums
+            if (std::abs(winograd_output(x, y, z, n) - output(x, y, z, n)) > 1e-4f * max_output) {
+                if (mismatches++ < 10) {
+                    printf("winograd_%d(%d, %d, %d, %d) = %g instead of %g\n", m, x, y, z, n,
+                           winograd_output(x, y, z, n), output(x, y, z, n));
+                }
+            }
+        });
+        if (mismatches) {
+            return -1;
+        }
+        double min_t_winograd = benchmark(10, 10, [&]() {
+            winograd(input, filter, bias, winograd_output);
+        });
+        printf("Winograd F(%dx%d, 3x3) time: %gms\n", m, m, min_t_winograd * 1e3);
+    }
+
     return 0;
 }
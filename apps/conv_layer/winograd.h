@@ -0,0 +1,175 @@
+#ifndef WINOGRAD_H
+#define WINOGRAD_H
+
+// Winograd minimal filtering F(m x m, 3 x 3) for 3x3 convolution layers,
+// following Lavin and Gray, "Fast Algorithms for Convolutional Neural
+// Networks". Each m x m tile of the output is computed from an
+// (m + 2) x (m + 2) tile of the input as
+//
+//   Y = A^T [(G g G^T) . (B^T d B)] A
+//
+// where . is the elementwise product, summed over the input channels. The
+// elementwise products take (m + 2)^2 multiplies per tile and channel,
+// instead of the 9 m^2 of a direct convolution: 16 instead of 36 for
+// F(2x2, 3x3), 36 instead of 144 for F(4x4, 3x3).
+//
+// The index dimensions of the transformed tiles (the first two dimensions
+// of the Funcs below) should be unrolled, so that the constant transform
+// coefficients fold into the arithmetic.
+
+#include <cassert>
+#include <vector>
+
+#include "Halide.h"
+
+struct WinogradConv {
+    // The transformed filter, U(i, j, c, k) = (G g G^T)(i, j).
+    Halide::Func filter_transform;
+    // The transformed input tiles, V(i, j, c, tx, ty, n) = (B^T d B)(i, j).
+    Halide::Func input_transform;
+    // The elementwise products summed over the input channels,
+    // M(i, j, k, tx, ty, n).
+    Halide::Func product;
+    // The output tiles, Y(px, py, k, tx, ty, n) = (A^T M A)(px, py).
+    Halide::Func output_transform;
+    // The convolution, out(x, y, k, n) = Y(x % m, y % m, k, x / m, y / m, n).
+    Halide::Func output;
+    // The output tile size m.
+    int tile_size;
+};
+
+namespace winograd_internal {
+
+typedef std::vector<std::vector<float>> Matrix;
+
+inline Matrix filter_matrix(int m) {
+    if (m == 2) {
+        return { { 1.0f, 0.0f, 0.0f },
+                 { 0.5f, 0.5f, 0.5f },
+                 { 0.5f, -0.5f, 0.5f },
+                 { 0.0f, 0.0f, 1.0f } };
+    }
+    return { { 1.0f / 4, 0.0f, 0.0f },
+             { -1.0f / 6, -1.0f / 6, -1.0f / 6 },
+             { -1.0f / 6, 1.0f / 6, -1.0f / 6 },
+             { 1.0f / 24, 1.0f / 12, 1.0f / 6 },
+             { 1.0f / 24, -1.0f / 12, 1.0f / 6 },
+             { 0.0f, 0.0f, 1.0f } };
+}
+
+// B^T
+inline Matrix input_matrix(int m) {
+    if (m == 2) {
+        return { { 1, 0, -1, 0 },
+                 { 0, 1, 1, 0 },
+                 { 0, -1, 1, 0 },
+                 { 0, 1, 0, -1 } };
+    }
+    return { { 4, 0, -5, 0, 1, 0 },
+             { 0, -4, -4, 1, 1, 0 },
+             { 0, 4, -4, -1, 1, 0 },
+             { 0, -2, -1, 2, 1, 0 },
+             { 0, 2, -1, -2, 1, 0 },
+             { 0, 4, 0, -5, 0, 1 } };
+}
+
+// A^T
+inline Matrix output_matrix(int m) {
+    if (m == 2) {
+        return { { 1, 1, 1, 0 },
+                 { 0, 1, -1, -1 } };
+    }
+    return { { 1, 1, 1, 1, 1, 0 },
+             { 0, 1, -1, 2, -2, 0 },
+             { 0, 1, 1, 4, 4, 0 },
+             { 0, 1, -1, 8, -8, 1 } };
+}
+
+// Compute row `row` of T times the column vector elem(0), elem(1), ...,
+// as a select on row between the rows, skipping the zero coefficients.
+// Once row is a constant (e.g. unrolled), this folds to a few adds.
+template<typename F>
+Halide::Expr multiply(const Matrix &T, Halide::Expr row, F elem) {
+    Halide::Expr result;
+    for (int r = (int)T.size() - 1; r >= 0; r--) {
+        Halide::Expr sum;
+        for (int a = 0; a < (int)T[r].size(); a++) {
+            float t = T[r][a];
+            if (t == 0.0f) continue;
+            Halide::Expr e = elem(a);
+            Halide::Expr term = t == 1.0f ? e : t == -1.0f ? -e : e * t;
+            sum = sum.defined() ? sum + term : term;
+        }
+        if (!sum.defined()) {
+            sum = 0.0f;
+        }
+        result = result.defined() ? Halide::select(row == r, sum, result) : sum;
+    }
+    return result;
+}
+
+}  // namespace winograd_internal
+
+// Define out(x, y, k, n) = sum of filter(rx, ry, c, k) * input(x + rx, y + ry, c, n)
+// over rx, ry in [0, 3) and c in [0, channels), with F(m x m, 3 x 3) for
+// m = 2 or 4. The input must be defined on the whole tiles covering the
+// output, i.e. up to the output extent rounded up to a multiple of m, plus 2.
+inline WinogradConv winograd_conv_3x3(Halide::Func input, Halide::Func filter,
+                                      Halide::Expr channels, int m) {
+    using namespace Halide;
+    using namespace winograd_internal;
+    assert(m == 2 || m == 4);
+
+    const Matrix G = filter_matrix(m), BT = input_matrix(m), AT = output_matrix(m);
+    const int alpha = m + 2;
+
+    Var i("i"), j("j"), c("c"), k("k"), tx("tx"), ty("ty"), n("n");
+    Var x("x"), y("y"), px("px"), py("py");
+
+    WinogradConv conv;
+    conv.tile_size = m;
+
+    // G g G^T, one dimension at a time.
+    Func filter_rows("filter_rows");
+    filter_rows(i, j, c, k) = multiply(G, i, [&](int a) { return filter(a, j, c, k); });
+    conv.filter_transform = Func("filter_transform");
+    conv.filter_transform(i, j, c, k) =
+        multiply(G, j, [&](int b) { return filter_rows(i, b, c, k); });
+
+    // B^T d B
+    Func input_rows("input_rows");
+    input_rows(i, j, c, tx, ty, n) =
+        multiply(BT, i, [&](int a) { return input(tx * m + a, ty * m + j, c, n); });
+    conv.input_transform = Func("input_transform");
+    conv.input_transform(i, j, c, tx, ty, n) =
+        multiply(BT, j, [&](int b) { return input_rows(i, b, c, tx, ty, n); });
+
+    // The elementwise products, summed over the channels. For each (i, j)
+    // this is a matrix multiply between the filters and the tiles.
+    RDom rc(0, channels, "rc");
+    conv.product = Func("product");
+    conv.product(i, j, k, tx, ty, n) = 0.0f;
+    conv.product(i, j, k, tx, ty, n) +=
+        conv.filter_transform(i, j, rc, k) * conv.input_transform(i, j, rc, tx, ty, n);
+
+    // A^T M A
+    Func output_rows("output_rows");
+    output_rows(px, j, k, tx, ty, n) =
+        multiply(AT, px, [&](int a) { return conv.product(a, j, k, tx, ty, n); });
+    conv.output_transform = Func("output_transform");
+    conv.output_transform(px, py, k, tx, ty, n) =
+        multiply(AT, py, [&](int b) { return output_rows(px, b, k, tx, ty, n); });
+
+    conv.output = Func("winograd_conv");
+    conv.output(x, y, k, n) = conv.output_transform(x % m, y % m, k, x / m, y / m, n);
+
+    // Keep the unrolled dimensions of the transforms within the tiles.
+    conv.filter_transform.bound(i, 0, alpha).bound(j, 0, alpha);
+    conv.input_transform.bound(i, 0, alpha).bound(j, 0, alpha);
+    conv.product.bound(i, 0, alpha).bound(j, 0, alpha);
+    conv.output_transform.bound(px, 0, m).bound(py, 0, m);
+
+    return conv;
+}
+
+#endif
@@ -98,6 +98,51 @@ public:
     }
 };
 
+// The same product of float16 matrices, accumulated in float32. Each
+// thread owns a 16x16 tile of the output and accumulates the product
+// of 16x16 tiles of the inputs into it, which on sm_70 is lowered to
+// the tensor cores (see lower_warp_matrix_multiplies).
+class MatMulF16 : public Halide::Generator<MatMulF16> {
+public:
+
+    GeneratorParam<int>       size {"size", 1024};
+    Input<Buffer<float16_t>>  A{"A", 2};
+    Input<Buffer<float16_t>>  B{"B", 2};
+
+    Output<Buffer<float>>     out{"out", 2};
+
+    void generate() {
+        Var x("x"), y("y");
+
+        const int tile = 16;
+
+        RDom r(0, size);
+        out(x, y) = 0.0f;
+        out(x, y) += cast<float>(A(x, r)) * cast<float>(B(r, y));
+
+        Var xi, yi, xo, yo, xt, yt;
+        RVar rxo, rxi;
+
+        out.bound(x, 0, size)
+            .bound(y, 0, size)
+            .gpu_tile(x, y, xi, yi, 32, 8);
+        out.update()
+            .split(x, xo, xi, tile)
+            .split(y, yo, yi, tile)
+            .split(r.x, rxo, rxi, tile)
+            .split(xo, xo, xt, 8)
+            .split(yo, yo, yt, 4)
+            .reorder(rxi, xi, yi, rxo, xt, yt, xo, yo)
+            .gpu_blocks(xo, yo)
+            .gpu_threads(xt, yt);
+
+        set_alignment_and_bounds(A, size);
+        set_alignment_and_bounds(B, size);
+        set_alignment_and_bounds(out, size);
+    }
+};
+
 }  // namespace
 
 HALIDE_REGISTER_GENERATOR(MatMul, mat_mul)
+HALIDE_REGISTER_GENERATOR(MatMulF16, mat_mul_f16)
@@ -0,0 +1,86 @@
+#include "bin/mat_mul_f16.h"
+#include "halide_benchmark.h"
+#include "HalideBuffer.h"
+#include <cublas_v2.h>
+#include <cuda_runtime.h>
+
+using Halide::Runtime::Buffer;
+using Halide::Tools::benchmark;
+
+int main(int argc, char **argv) {
+    int size = 1024;
+    if (argc > 1) {
+        size = atoi(argv[1]);
+    }
+
+    const halide_type_t float16 = halide_type_t(halide_type_float, 16);
+
+    // Check correctness using small-integer matrices, which float16
+    // represents exactly.
+    if (1) {
+        // The float16 bits of -1, 0, 1 and 2.
+        const uint16_t bits[] = {0xbc00, 0x0000, 0x3c00, 0x4000};
+        Buffer<int> a(size, size), b(size, size);
+        Buffer<> A(float16, size, size), B(float16, size, size);
+        Buffer<float> C(size, size);
+        a.for_each_value([](int &v) {v = rand() & 3;});
+        b.for_each_value([](int &v) {v = rand() & 3;});
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                ((uint16_t *)A.data())[x + y * size] = bits[a(x, y)];
+                ((uint16_t *)B.data())[x + y * size] = bits[b(x, y)];
+            }
+        }
+        A.set_host_dirty();
+        B.set_host_dirty();
+        mat_mul_f16(A, B, C);
+        C.copy_to_host();
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float correct = 0.f;
+                for (int k = 0; k < size; k++) {
+                    correct += (a(x, k) - 1) * (b(k, y) - 1);
+                }
+                float actual = C(x, y);
+                if (correct != actual) {
+                    printf("%d %d: %f vs %f\n", x, y, correct, actual);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Benchmark it
+    {
+        Buffer<> A(float16, size, size), B(float16, size, size);
+        Buffer<float> C(size, size);
+        double t = Halide::Tools::benchmark(3, 3, [&]() {
+                mat_mul_f16(A, B, C);
+                C.device_sync();
+            });
+        printf("Halide time: %f\n", t);
+    }
+
+    // Benchmark cublas, with the same types
+    {
+        void *A, *B, *C;
+        cudaMalloc(&A, size*size*2);
+        cudaMalloc(&B, size*size*2);
+        cudaMalloc(&C, size*size*4);
+        cublasHandle_t handle;
+        cublasCreate(&handle);
+        float alpha = 1.0f, beta = 1.0f;
+        double t = Halide::Tools::benchmark(3, 3, [&]() {
+                cublasGemmEx(handle, CUBLAS_OP_N, CUBLAS_OP_N,
+                             size, size, size, &alpha, A, CUDA_R_16F, size, B, CUDA_R_16F, size,
+                             &beta, C, CUDA_R_32F, size, CUDA_R_32F, CUBLAS_GEMM_DFALT);
+                cudaDeviceSynchronize();
+            });
+        cudaFree(A);
+        cudaFree(B);
+        cudaFree(C);
+        cublasDestroy(handle);
+        printf("cublas time: %f\n", t);
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "Halide.h"
+#include "../conv_layer/winograd.h"
 
 namespace {
 
@@ -6,7 +7,10 @@ using namespace Halide;
 
 class DiffConvolutionLayer : public Halide::Generator<DiffConvolutionLayer> {
 public:
-    GeneratorParam<bool>  auto_schedule{"auto_schedule", false};
+    // If 2 or 4, compute the forward convolution with Winograd
+    // F(m x m, 3 x 3) for m = winograd, and differentiate through the
+    // transforms. Requires a 3x3 filter.
+    GeneratorParam<int>   winograd{"winograd", 0};
 
     Input<Buffer<float>>  input{"input", 4};
     Input<Buffer<float>>  filter{"filter", 4};
@@ -31,12 +35,24 @@ public:
         f_filter(x, y, z, n) = filter(x, y, z, n);
         f_bias(z) = bias(z);
 
-        f_conv(x, y, z, n) = f_bias(z);
-        f_conv(x, y, z, n) += f_filter(r.x, r.y, r.z, z) * input(x + r.x, y + r.y, r.z, n);
+        WinogradConv wino;
+        if (winograd) {
+            filter.dim(0).set_bounds(0, 3);
+            filter.dim(1).set_bounds(0, 3);
+            Func f_input("f_input");
+            f_input(x, y, z, n) = BoundaryConditions::repeat_edge(input)(x, y, z, n);
+            wino = winograd_conv_3x3(f_input, f_filter, filter.dim(2).extent(), winograd);
+            f_conv(x, y, z, n) = f_bias(z) + wino.output(x, y, z, n);
+        } else {
+            f_conv(x, y, z, n) = f_bias(z);
+            f_conv(x, y, z, n) += f_filter(r.x, r.y, r.z, z) * input(x + r.x, y + r.y, r.z, n);
+        }
         f_ReLU(x, y, z, n) = max(0, f_conv(x, y, z, n));
 
         RDom r_target(compare);
-        Expr loss = f_ReLU(r_target.x, r_target.y, r_target.z, r_target.w);
+        Func loss("loss");
+        loss() = 0.f;
+        loss() += f_ReLU(r_target.x, r_target.y, r_target.z, r_target.w);
         Derivative derivative = propagate_adjoints(loss);
         std::map<FuncKey, Func> adjoints = derivative.adjoints;
         d_filter(x, y, z, n) = adjoints[FuncKey{f_filter.name(), -1}](x, y, z, n);
@@ -76,11 +92,24 @@ public:
 
             //d_bias.estimate(z, 0, 32);
 
-            // Auto schedule the pipeline: this calls auto_schedule() for
-            // all of the Outputs in this Generator
-            auto_schedule_outputs();
-
             d_filter.print_loop_nest();
+        } else if (winograd) {
+            // The backward pass runs the transposed transforms in the
+            // opposite order, which are as cheap as the forward ones.
+            f_ReLU.compute_root()
+                  .parallel(n)
+                  .vectorize(x, 8);
+            for (Func f : { wino.filter_transform, wino.input_transform,
+                            wino.product, wino.output_transform }) {
+                f.compute_root();
+                for (Func d_f : derivative.funcs(f)) {
+                    d_f.compute_root();
+                }
+            }
+            for (Func d_f : derivative.funcs(f_ReLU)) {
+                d_f.compute_root();
+            }
+            derivative(f_filter).compute_root();
         } else {
             f_conv.compute_root();
             f_conv
@@ -123,7 +152,7 @@ public:
                   .vectorize(x, 8);
 
             Func &d_filter = adjoints[FuncKey{f_filter.name(), -1}];
-            RDom r_conv = derivative.reductions[{d_filter.name(), 0}];
+            RVar r_conv_x = d_filter.rvars(0)[0];
             d_filter.compute_root();
             d_filter.update(0)
                     .parallel(n)
@@ -132,7 +161,7 @@ public:
                     .parallel(n)
                     .parallel(z);
             Var rx("rx");
-            Func intermediate = d_filter.update(0).rfactor(r_conv.x, rx);
+            Func intermediate = d_filter.update(0).rfactor(r_conv_x, rx);
             intermediate.compute_at(d_filter, x);
             intermediate.update(0)
                         .vectorize(rx, 8);
@@ -1,8 +1,10 @@
+#include <cmath>
 #include <cstdio>
 #include <chrono>
 
 #include "diff_conv_layer.h"
 #include "diff_conv_layer_auto_schedule.h"
+#include "diff_conv_layer_winograd_4.h"
 
 #include "halide_benchmark.h"
 #include "HalideBuffer.h"
@@ -20,7 +22,7 @@ int main(int argc, char **argv) {
         for (int z = 0; z < input.channels(); z++) {
             for (int y = 0; y < input.height(); y++) {
                 for (int x = 0; x < input.width(); x++) {
-                    input(x, y) = rand();
+                    input(x, y, z, c) = rand();
                 }
             }
         }
@@ -30,7 +32,7 @@ int main(int argc, char **argv) {
         for (int z = 0; z < filter.channels(); z++) {
             for (int y = 0; y < filter.height(); y++) {
                 for (int x = 0; x < filter.width(); x++) {
-                    filter(x, y) = rand();
+                    filter(x, y, z, c) = rand();
                 }
             }
         }
@@ -44,7 +46,7 @@ int main(int argc, char **argv) {
         for (int z = 0; z < target.channels(); z++) {
             for (int y = 0; y < target.height(); y++) {
                 for (int x = 0; x < target.width(); x++) {
-                    target(x, y) = rand();
+                    target(x, y, z, c) = rand();
                 }
             }
         }
@@ -70,5 +72,34 @@ int main(int argc, char **argv) {
     });
     printf("Auto-scheduled time: %gms\n", min_t_auto * 1e3);
 
+    // Winograd version, checked against the direct convolution
+    Buffer<float> winograd_output(64, 64, 32, 4);
+    Buffer<float> winograd_d_filter(3, 3, 32, 32);
+    diff_conv_layer_winograd_4(input, filter, bias, target, winograd_output, winograd_d_filter);
+    diff_conv_layer(input, filter, bias, target, output, d_filter);
+    for (auto pair : { std::make_pair(&winograd_output, &output),
+                       std::make_pair(&winograd_d_filter, &d_filter) }) {
+        Buffer<float> &result = *pair.first, &correct = *pair.second;
+        float max_correct = 0.0f;
+        correct.for_each_value([&](float v) { max_correct = std::max(max_correct, std::abs(v)); });
+        int mismatches = 0;
+        result.for_each_element([&](int x, int y, int z, int n) {
+            // The transforms round differently than the direct sums
+            if (std::abs(result(x, y, z, n) - correct(x, y, z, n)) > 1e-4f * max_correct) {
+                if (mismatches++ < 10) {
+                    printf("Winograd result(%d, %d, %d, %d) = %g instead of %g\n", x, y, z, n,
+                           result(x, y, z, n), correct(x, y, z, n));
+                }
+            }
+        });
+        if (mismatches) {
+            return -1;
+        }
+    }
+    double min_t_winograd = benchmark(10, 10, [&]() {
+        diff_conv_layer_winograd_4(input, filter, bias, target, winograd_output, winograd_d_filter);
+    });
+    printf("Winograd F(4x4, 3x3) time: %gms\n", min_t_winograd * 1e3);
+
     return 0;
 }
@@ -0,0 +1,164 @@
+#include "fft_convolve.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+
+#include "funct.h"
+
+using std::vector;
+using std::string;
+
+using namespace Halide;
+
+namespace {
+
+// Concatenate vectors of Expr/Var, as in fft.cpp.
+vector<Expr> A(vector<Expr> l, const vector<Var> &r) {
+    for (const Var &i : r) {
+        l.push_back(i);
+    }
+    return l;
+}
+
+int default_fft_size(int kernel_width, int kernel_height) {
+    int N = 16;
+    while (N < 2 * std::max(kernel_width, kernel_height)) {
+        N *= 2;
+    }
+    return N;
+}
+
+// Compute sum over i, j of kernel(i, j) * input(x - i + c0, y - j + c1).
+Func convolve(Func input, Func kernel, int kernel_width, int kernel_height,
+              int c0, int c1, const Target &target, const FftConvolveDesc &desc,
+              const string &prefix) {
+    int N = desc.fft_size > 0 ? desc.fft_size : default_fft_size(kernel_width, kernel_height);
+    // The size of the tiles of the input convolved by each FFT. The
+    // convolution of a tile and the kernel is B + kernel size - 1 samples
+    // wide, so it fits in the FFT without wrapping around.
+    int B0 = N - kernel_width + 1;
+    int B1 = N - kernel_height + 1;
+    // Each output sample then depends on at most 2 tiles per dimension.
+    if (B0 < kernel_width - 1 || B1 < kernel_height - 1) {
+        std::cerr << "fft_convolve: the FFT size " << N << " is too small for a "
+                  << kernel_width << "x" << kernel_height << " kernel\n";
+        abort();
+    }
+
+    vector<Var> args(input.args());
+    Var x(args[0]), y(args[1]);
+    args.erase(args.begin(), args.begin() + 2);
+
+    Var u("u"), v("v"), tx("tx"), ty("ty");
+
+    // Split the input into zero padded N x N tiles.
+    Func tiles(prefix + "tiles");
+    tiles(A({u, v, tx, ty}, args)) =
+        select(u < B0 && v < B1,
+               cast<float>(input(A({tx * B0 + min(u, B0 - 1), ty * B1 + min(v, B1 - 1)}, args))),
+               0.0f);
+
+    Func kernel_padded(prefix + "kernel_padded");
+    kernel_padded(u, v) =
+        select(u < kernel_width && v < kernel_height,
+               cast<float>(kernel(min(u, kernel_width - 1), min(v, kernel_height - 1))),
+               0.0f);
+
+    Fft2dDesc fwd_desc;
+    fwd_desc.vector_width = desc.vector_width;
+    fwd_desc.name = prefix + "dft_tiles";
+    ComplexFunc dft_tiles = fft2d_r2c(tiles, N, N, target, fwd_desc);
+
+    Fft2dDesc kernel_desc;
+    kernel_desc.vector_width = desc.vector_width;
+    kernel_desc.name = prefix + "dft_kernel";
+    ComplexFunc dft_kernel = fft2d_r2c(kernel_padded, N, N, target, kernel_desc);
+
+    // Multiply the DFTs of the same frequency of every tile by the DFT of
+    // the kernel, the batch dimensions of the transforms being the tiles
+    // and the remaining dimensions of the input.
+    ComplexFunc dft_product(prefix + "dft_product");
+    dft_product(A({u, v, tx, ty}, args)) =
+        dft_tiles(A({u, v, tx, ty}, args)) * dft_kernel(u, v);
+
+    Fft2dDesc inv_desc;
+    inv_desc.vector_width = desc.vector_width;
+    inv_desc.gain = 1.0f / (N * N);
+    inv_desc.name = prefix + "tile_out";
+    Func tile_out = fft2d_c2r(dft_product, N, N, target, inv_desc);
+
+    // Add the overlapping convolved tiles. Away from the edges of a tile,
+    // only that tile contributes.
+    Expr n0 = x + c0, n1 = y + c1;
+    Expr t0 = n0 / B0, t1 = n1 / B1;
+    Expr u0 = n0 - t0 * B0, u1 = n1 - t1 * B1;
+    Expr prev_u0 = min(u0 + B0, N - 1), prev_u1 = min(u1 + B1, N - 1);
+    Expr overlaps0 = u0 < kernel_width - 1, overlaps1 = u1 < kernel_height - 1;
+
+    Func out(prefix + "out");
+    out(A({x, y}, args)) =
+        tile_out(A({u0, u1, t0, t1}, args)) +
+        select(overlaps0, tile_out(A({prev_u0, u1, t0 - 1, t1}, args)), 0.0f) +
+        select(overlaps1, tile_out(A({u0, prev_u1, t0, t1 - 1}, args)), 0.0f) +
+        select(overlaps0 && overlaps1, tile_out(A({prev_u0, prev_u1, t0 - 1, t1 - 1}, args)), 0.0f);
+
+    // The FFT stages are scheduled relative to their outputs, and loop
+    // over the tiles in their outermost dimensions.
+    dft_kernel.compute_root();
+    vector<Var> tile_args = tile_out.args();
+    tile_out.compute_root();
+    if (desc.parallel) {
+        tile_out.parallel(tile_args[3]);
+    }
+    dft_tiles.compute_at(tile_out, tile_args[2]);
+    return out;
+}
+
+}  // namespace
+
+Func fft_convolve(Func input, Func kernel,
+                  int kernel_width, int kernel_height,
+                  const Target &target,
+                  const FftConvolveDesc &desc) {
+    string prefix = desc.name.empty() ? input.name() + "_conv_" : desc.name + "_";
+    return convolve(input, kernel, kernel_width, kernel_height,
+                    kernel_width / 2, kernel_height / 2, target, desc, prefix);
+}
+
+CustomGradient fft_convolve_gradient(Func input, Func kernel,
+                                     int kernel_width, int kernel_height,
+                                     const vector<std::pair<Expr, Expr>> &output_region,
+                                     const Target &target,
+                                     const FftConvolveDesc &desc) {
+    if (input.dimensions() != 2 || output_region.size() != 2) {
+        std::cerr << "fft_convolve_gradient: the input must have 2 dimensions\n";
+        abort();
+    }
+    const int c0 = kernel_width / 2, c1 = kernel_height / 2;
+    return [=](const Func &adjoint) {
+        string prefix = desc.name.empty() ? input.name() + "_conv_d_" : desc.name + "_d_";
+        Var x("x"), y("y"), i("i"), j("j");
+
+        // d_input(x, y) = sum over i, j of kernel(i, j) * adjoint(x + i - c0, y + j - c1),
+        // which is the convolution of the adjoint with the flipped kernel,
+        // centered on (kernel_width - 1 - c0, kernel_height - 1 - c1).
+        Func flipped(prefix + "flipped_kernel");
+        flipped(i, j) = kernel(kernel_width - 1 - i, kernel_height - 1 - j);
+        Func adjoint_2d(prefix + "adjoint");
+        adjoint_2d(x, y) = adjoint(x, y);
+        Func d_input = convolve(adjoint_2d, flipped, kernel_width, kernel_height,
+                                kernel_width - 1 - c0, kernel_height - 1 - c1,
+                                target, desc, prefix + "input_");
+
+        // d_kernel(i, j) = sum over the output of adjoint(x, y) * input(x - i + c0, y - j + c1)
+        RDom r(output_region);
+        Func d_kernel(prefix + "kernel");
+        d_kernel(i, j) = 0.0f;
+        d_kernel(i, j) += adjoint(r.x, r.y) * input(r.x - i + c0, r.y - j + c1);
+        d_kernel.compute_root();
+
+        return std::map<string, Func>{ { input.name(), d_input }, { kernel.name(), d_kernel } };
+    };
+}
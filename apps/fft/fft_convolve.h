@@ -0,0 +1,66 @@
+#ifndef HALIDE_FFT_CONVOLVE_H
+#define HALIDE_FFT_CONVOLVE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Halide.h"
+#include "fft.h"
+
+// Options for computing a convolution with FFTs.
+struct FftConvolveDesc {
+    // The size of the 2D FFTs computing the convolution of each tile. The
+    // input is split into tiles of fft_size - kernel size + 1 samples in
+    // each dimension, so larger FFTs do less redundant work at the edges
+    // of the tiles, but use more memory. 0 picks the smallest power of 2
+    // at least twice the kernel size, and at least 16.
+    int fft_size = 0;
+
+    // Parallelize over the rows of tiles.
+    bool parallel = true;
+
+    // The vector width to use for the FFTs, see Fft2dDesc::vector_width.
+    int vector_width = 0;
+
+    // A name to prepend to the name of the Funcs the convolution defines.
+    std::string name = "";
+};
+
+// Compute the 2D convolution of the first 2 dimensions of input with a
+// kernel_width x kernel_height kernel, centered on the sample
+// (kernel_width / 2, kernel_height / 2):
+//
+//   out(x, y, ...) = sum over i, j of kernel(i, j) *
+//       input(x - i + kernel_width / 2, y - j + kernel_height / 2, ...)
+//
+// kernel should be defined on [0, kernel_width) x [0, kernel_height), and
+// input wherever the sum above reads it, e.g. by applying a boundary
+// condition. The remaining dimensions of input are batched through the same
+// FFTs, against the same kernel.
+//
+// The input is split into tiles, each one is convolved with the kernel by
+// multiplying their real DFTs, and the overlapping results are added
+// (overlap-add). This takes O(log(fft_size)) operations per output sample,
+// instead of the O(kernel_width * kernel_height) of a direct convolution.
+// The DFT of the kernel and the convolved tiles are computed at the root.
+Halide::Func fft_convolve(Halide::Func input, Halide::Func kernel,
+                          int kernel_width, int kernel_height,
+                          const Halide::Target &target,
+                          const FftConvolveDesc &desc = FftConvolveDesc());
+
+// Make the custom gradient of out = fft_convolve(input, kernel, ...), to
+// register in PropagateAdjointsOptions::custom_gradients[out.name()]. The
+// adjoint of input is the correlation of the adjoint of out with the kernel,
+// also computed with FFTs. The adjoint of the kernel is the correlation of the
+// adjoint of out with input over output_region, the {min, extent} of each
+// dimension of out for which the adjoints are propagated, computed directly.
+// The input must have 2 dimensions.
+Halide::CustomGradient fft_convolve_gradient(
+    Halide::Func input, Halide::Func kernel,
+    int kernel_width, int kernel_height,
+    const std::vector<std::pair<Halide::Expr, Halide::Expr>> &output_region,
+    const Halide::Target &target,
+    const FftConvolveDesc &desc = FftConvolveDesc());
+
+#endif
@@ -0,0 +1,95 @@
+// Check fft_convolve and its custom gradient against direct convolutions.
+
+#include "Halide.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fft_convolve.h"
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+Var x("x"), y("y");
+
+bool check(const char *what, const Buffer<float> &result, const Buffer<float> &correct, float tol) {
+    for (int j = correct.dim(1).min(); j <= correct.dim(1).max(); j++) {
+        for (int i = correct.dim(0).min(); i <= correct.dim(0).max(); i++) {
+            if (std::abs(result(i, j) - correct(i, j)) > tol) {
+                printf("%s(%d, %d) = %f instead of %f\n", what, i, j, result(i, j), correct(i, j));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int W = 200, H = 150;
+    const int K = 31;
+
+    Buffer<float> in(W, H, "conv_in");
+    for (int j = 0; j < H; j++) {
+        for (int i = 0; i < W; i++) {
+            in(i, j) = (float)rand() / (float)RAND_MAX;
+        }
+    }
+    Buffer<float> kernel_buf(K, K, "conv_kernel");
+    for (int j = 0; j < K; j++) {
+        for (int i = 0; i < K; i++) {
+            kernel_buf(i, j) = ((float)rand() / (float)RAND_MAX - 0.5f) / (K * K);
+        }
+    }
+
+    Target target = get_jit_target_from_environment();
+
+    Func input("input");
+    input(x, y) = BoundaryConditions::repeat_edge(in)(x, y);
+    Func kernel("kernel");
+    kernel(x, y) = kernel_buf(x, y);
+
+    Func fft_out = fft_convolve(input, kernel, K, K, target);
+
+    RDom k(0, K, 0, K);
+    Func direct("direct");
+    direct(x, y) = sum(kernel(k.x, k.y) * input(x - k.x + K / 2, y - k.y + K / 2));
+
+    Buffer<float> fft_result = fft_out.realize(W, H, target);
+    Buffer<float> direct_result = direct.realize(W, H, target);
+    if (!check("fft_convolve", fft_result, direct_result, 1e-4f)) {
+        return -1;
+    }
+
+    double fft_t = benchmark(10, 1, [&]() { fft_out.realize(fft_result); });
+    double direct_t = benchmark(10, 1, [&]() { direct.realize(direct_result); });
+    printf("%dx%d kernel: fft_convolve %.3f ms, direct %.3f ms\n", K, K, fft_t * 1e3, direct_t * 1e3);
+
+    // Take the gradients of a loss through both, the FFT one with
+    // its custom gradient.
+    RDom r(0, W, 0, H);
+    Func fft_loss("fft_loss");
+    fft_loss() += fft_out(r.x, r.y) * fft_out(r.x, r.y);
+    Func direct_loss("direct_loss");
+    direct_loss() += direct(r.x, r.y) * direct(r.x, r.y);
+
+    PropagateAdjointsOptions options;
+    options.custom_gradients[fft_out.name()] =
+        fft_convolve_gradient(input, kernel, K, K, { { 0, W }, { 0, H } }, target);
+    Derivative d_fft = propagate_adjoints(fft_loss, options);
+    Derivative d_direct = propagate_adjoints(direct_loss);
+
+    Buffer<float> d_in_fft = d_fft(in).realize(W, H, target);
+    Buffer<float> d_in_direct = d_direct(in).realize(W, H, target);
+    if (!check("d_input", d_in_fft, d_in_direct, 1e-3f)) {
+        return -1;
+    }
+    Buffer<float> d_kernel_fft = d_fft(kernel_buf).realize(K, K, target);
+    Buffer<float> d_kernel_direct = d_direct(kernel_buf).realize(K, K, target);
+    if (!check("d_kernel", d_kernel_fft, d_kernel_direct, 1e-2f)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -158,7 +158,122 @@ class GEMMGenerator :
     }
 };
 
+// Generator class for strided batches of small gemm operations. The
+// third dimension of the matrices is the batch, which can have any
+// stride.
+template<class T>
+class BatchedGEMMGenerator :
+        public Generator<BatchedGEMMGenerator<T>> {
+  public:
+    typedef Generator<BatchedGEMMGenerator<T>> Base;
+    using Base::target;
+    using Base::get_target;
+    using Base::natural_vector_size;
+    template<typename T2> using Input = typename Base::template Input<T2>;
+    template<typename T2> using Output = typename Base::template Output<T2>;
+
+    GeneratorParam<bool> transpose_A_ = {"transpose_A", false};
+    GeneratorParam<bool> transpose_B_ = {"transpose_B", false};
+
+    Input<T>         a_ = {"a_", 1};
+    Input<Buffer<T>> A_ = {"A_", 3};
+    Input<Buffer<T>> B_ = {"B_", 3};
+    Input<T>         b_ = {"b_", 1};
+    Input<Buffer<T>> C_ = {"C_", 3};
+
+    Output<Buffer<T>> result_ = {"result", 3};
+
+    void generate() {
+        const bool transpose_A = transpose_A_;
+        const bool transpose_B = transpose_B_;
+        const Expr num_rows = transpose_A ? A_.height() : A_.width();
+        const Expr num_cols = transpose_B ? B_.width() : B_.height();
+        const Expr sum_size = transpose_A ? A_.width() : A_.height();
+        const Expr batch_size = C_.dim(2).extent();
+
+        const int vec = natural_vector_size(a_.type());
+
+        Var i("i"), j("j"), n("n"), k("k");
+        Var ii("ii"), ji("ji"), io("io"), jo("jo"), no("no");
+
+        // The matrices are small enough to stay in cache, so unlike
+        // the single gemm, don't swizzle them. The tiles of the output
+        // may hang off the edge of small matrices that aren't a
+        // multiple of the tile size, so pad the inputs with zeros.
+        Func Apad = BoundaryConditions::constant_exterior(A_, cast<T>(0));
+        Func Bpad = BoundaryConditions::constant_exterior(B_, cast<T>(0));
+
+        Func A("A"), B("B");
+        if (transpose_A) {
+            A(i, k, n) = Apad(k, i, n);
+        } else {
+            A(i, k, n) = Apad(i, k, n);
+        }
+        if (transpose_B) {
+            B(k, j, n) = Bpad(j, k, n);
+        } else {
+            B(k, j, n) = Bpad(k, j, n);
+        }
+
+        Func AB("AB");
+        RDom rv(0, sum_size);
+        AB(i, j, n) += A(i, rv, n) * B(rv, j, n);
+
+        result_(i, j, n) = a_ * AB(i, j, n) + b_ * C_(i, j, n);
+
+        // Each task does a few matrices of the batch, in tiles of one
+        // vector by four columns of the output.
+        result_
+            .tile(i, j, io, jo, ii, ji, vec, 4, TailStrategy::GuardWithIf)
+            .vectorize(ii).unroll(ji)
+            .split(n, no, n, 8, TailStrategy::GuardWithIf)
+            .parallel(no);
+
+        AB.compute_at(result_, io)
+            .vectorize(i, vec, TailStrategy::GuardWithIf);
+        AB.update()
+            .reorder(i, j, rv)
+            .vectorize(i, vec, TailStrategy::GuardWithIf);
+
+        if (transpose_A) {
+            // Transpose each matrix of A once, rather than doing a
+            // strided load for each product.
+            A.compute_at(result_, n)
+                .vectorize(i, vec, TailStrategy::GuardWithIf);
+        }
+
+        // For the usual small square sizes, the tiles fit exactly, and
+        // each tile is an unrolled micro-kernel of vector fused
+        // multiply-adds.
+        for (int size : {8, 16, 32, 64}) {
+            if (size % vec != 0) {
+                continue;
+            }
+            Expr is_size = (num_rows == size && num_cols == size && sum_size == size);
+            result_.specialize(is_size);
+            AB.update().specialize(is_size)
+                .unroll(j, 4)
+                .unroll(rv, std::min(size, 8));
+        }
+
+        A_.dim(0).set_min(0).dim(1).set_min(0).dim(2).set_bounds(0, batch_size);
+        B_.dim(0).set_min(0).dim(1).set_min(0).dim(2).set_bounds(0, batch_size);
+        if (transpose_B) {
+            B_.dim(1).set_bounds(0, sum_size);
+        } else {
+            B_.dim(0).set_bounds(0, sum_size);
+        }
+        C_.dim(0).set_bounds(0, num_rows);
+        C_.dim(1).set_bounds(0, num_cols);
+        C_.dim(2).set_min(0);
+        result_.dim(0).set_bounds(0, num_rows)
+            .dim(1).set_bounds(0, num_cols)
+            .dim(2).set_bounds(0, batch_size);
+    }
+};
+
 }  // namespace
 
 HALIDE_REGISTER_GENERATOR(GEMMGenerator<float>, sgemm)
 HALIDE_REGISTER_GENERATOR(GEMMGenerator<double>, dgemm)
+HALIDE_REGISTER_GENERATOR(BatchedGEMMGenerator<float>, sgemm_batched)
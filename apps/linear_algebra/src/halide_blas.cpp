@@ -29,6 +29,13 @@ Buffer<T> init_matrix_buffer(const int M, const int N, T *A, const int lda) {
     return Buffer<T>(A, 2, shape);
 }
 
+template<typename T>
+Buffer<T> init_batched_matrix_buffer(const int M, const int N, T *A, const int lda,
+                                     const int stride, const int batch_size) {
+    halide_dimension_t shape[] = {{0, M, 1}, {0, N, lda}, {0, batch_size, stride}};
+    return Buffer<T>(A, 3, shape);
+}
+
 }
 
 #ifdef __cplusplus
@@ -279,6 +286,39 @@ void hblas_dgemm(const enum HBLAS_ORDER Order, const enum HBLAS_TRANSPOSE TransA
     assert_no_error(halide_dgemm(tA, tB, alpha, buff_A, buff_B, beta, buff_C));
 }
 
+void hblas_sgemm_strided_batched(const enum HBLAS_ORDER Order, const enum HBLAS_TRANSPOSE TransA,
+                                 const enum HBLAS_TRANSPOSE TransB, const int M, const int N,
+                                 const int K, const float alpha, const float *A,
+                                 const int lda, const int stride_A, const float *B,
+                                 const int ldb, const int stride_B, const float beta,
+                                 float *C, const int ldc, const int stride_C,
+                                 const int batch_size) {
+    bool tA = false, tB = false;
+    switch (TransA) {
+    case HblasNoTrans:
+        tA = false; break;
+    case HblasConjTrans:
+    case HblasTrans:
+        tA = true; break;
+    };
+
+    switch (TransB) {
+    case HblasNoTrans:
+        tB = false; break;
+    case HblasConjTrans:
+    case HblasTrans:
+        tB = true; break;
+    };
+
+    auto buff_A = init_batched_matrix_buffer(tA ? K : M, tA ? M : K, const_cast<float*>(A), lda,
+                                             stride_A, batch_size);
+    auto buff_B = init_batched_matrix_buffer(tB ? N : K, tB ? K : N, const_cast<float*>(B), ldb,
+                                             stride_B, batch_size);
+    auto buff_C = init_batched_matrix_buffer(M, N, C, ldc, stride_C, batch_size);
+
+    assert_no_error(halide_sgemm_batched(tA, tB, alpha, buff_A, buff_B, beta, buff_C));
+}
+
 
 #ifdef __cplusplus
 }
@@ -210,6 +210,7 @@ struct BLASFloatTests : public BLASTestBase<float> {
         RUN_TEST(sgemm_transA);
         RUN_TEST(sgemm_transB);
         RUN_TEST(sgemm_transAB);
+        RUN_TEST(sgemm_batched);
     }
 
     L1_VECTOR_TEST(scopy, scopy(N, x, 1, y, 1))
@@ -241,6 +242,57 @@ struct BLASFloatTests : public BLASTestBase<float> {
     L3_TEST(sgemm_transAB,
             cblas_sgemm(CblasColMajor, CblasTrans, CblasTrans, N, N, N, alpha, A, N, B, N, beta, C, N),
             hblas_sgemm(HblasColMajor, HblasTrans, HblasTrans, N, N, N, alpha, A, N, B, N, beta, C, N));
+
+    // The batched gemm is for small matrices, so test it on a batch of
+    // small matrices of each of the specialized sizes and some others,
+    // rather than at size N. The non-square ones have padding between
+    // their columns and between the matrices, which must be left alone.
+    bool test_sgemm_batched(int) {
+        const int batch_size = 37;
+        const HBLAS_TRANSPOSE htrans[] = {HblasNoTrans, HblasTrans};
+        const CBLAS_TRANSPOSE ctrans[] = {CblasNoTrans, CblasTrans};
+        struct {
+            int M, N, K, padding;
+        } shapes[] = {
+            {3, 3, 3, 0}, {8, 8, 8, 0}, {13, 13, 13, 0}, {16, 16, 16, 0},
+            {32, 32, 32, 0}, {64, 64, 64, 0}, {5, 7, 11, 3}, {16, 9, 33, 1},
+        };
+        for (const auto &s : shapes) {
+            for (int t = 0; t < 4; t++) {
+                const bool tA = t & 1, tB = t >> 1;
+                const int lda = (tA ? s.K : s.M) + s.padding;
+                const int ldb = (tB ? s.N : s.K) + s.padding;
+                const int ldc = s.M + s.padding;
+                const int stride_A = lda * (tA ? s.M : s.K) + s.padding;
+                const int stride_B = ldb * (tB ? s.K : s.N) + s.padding;
+                const int stride_C = ldc * s.N + s.padding;
+                Scalar alpha = random_scalar();
+                Scalar beta = random_scalar();
+                Matrix eA(random_vector(stride_A * batch_size));
+                Matrix eB(random_vector(stride_B * batch_size));
+                Matrix eC(random_vector(stride_C * batch_size));
+                Matrix aC(eC);
+
+                for (int i = 0; i < batch_size; i++) {
+                    cblas_sgemm(CblasColMajor, ctrans[tA], ctrans[tB], s.M, s.N, s.K,
+                                alpha, &eA[i * stride_A], lda, &eB[i * stride_B], ldb,
+                                beta, &eC[i * stride_C], ldc);
+                }
+                hblas_sgemm_strided_batched(HblasColMajor, htrans[tA], htrans[tB],
+                                            s.M, s.N, s.K, alpha, &eA[0], lda, stride_A,
+                                            &eB[0], ldb, stride_B, beta, &aC[0], ldc, stride_C,
+                                            batch_size);
+
+                if (!compareVectors(stride_C * batch_size, eC, aC)) {
+                    std::cerr << "Batch of " << s.M << "x" << s.N << "x" << s.K
+                              << " products with transpose_A=" << tA
+                              << " and transpose_B=" << tB << " differs\n";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
 };
 
 struct BLASDoubleTests : public BLASTestBase<double> {
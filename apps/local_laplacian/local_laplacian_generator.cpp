@@ -1,6 +1,8 @@
 #include "Halide.h"
 #include "halide_trace_config.h"
 
+#include "pyramid.h"
+
 namespace {
 
 constexpr int maxJ = 20;
@@ -37,47 +39,35 @@ public:
         gray(x, y) = 0.299f * floating(x, y, 0) + 0.587f * floating(x, y, 1) + 0.114f * floating(x, y, 2);
 
         // Make the processed Gaussian pyramid.
-        Func gPyramid[maxJ];
+        Func processed("gPyramid_0");
         // Do a lookup into a lut with 256 entires per intensity level
         Expr level = k * (1.0f / (levels - 1));
         Expr idx = gray(x, y)*cast<float>(levels-1)*256.0f;
         idx = clamp(cast<int>(idx), 0, (levels-1)*256);
-        gPyramid[0](x, y, k) = beta*(gray(x, y) - level) + level + remap(idx - 256*k);
-        for (int j = 1; j < J; j++) {
-            gPyramid[j](x, y, k) = downsample(gPyramid[j-1])(x, y, k);
-        }
+        processed(x, y, k) = beta*(gray(x, y) - level) + level + remap(idx - 256*k);
+        std::vector<Func> gPyramid = pyramid::gaussian_pyramid(processed, J, "gPyramid");
 
         // Get its laplacian pyramid
-        Func lPyramid[maxJ];
-        lPyramid[J-1](x, y, k) = gPyramid[J-1](x, y, k);
-        for (int j = J-2; j >= 0; j--) {
-            lPyramid[j](x, y, k) = gPyramid[j](x, y, k) - upsample(gPyramid[j+1])(x, y, k);
-        }
+        std::vector<Func> lPyramid = pyramid::laplacian_pyramid(gPyramid, "lPyramid");
 
         // Make the Gaussian pyramid of the input
-        Func inGPyramid[maxJ];
-        inGPyramid[0](x, y) = gray(x, y);
-        for (int j = 1; j < J; j++) {
-            inGPyramid[j](x, y) = downsample(inGPyramid[j-1])(x, y);
-        }
+        std::vector<Func> inGPyramid = pyramid::gaussian_pyramid(gray, J, "inGPyramid");
 
         // Make the laplacian pyramid of the output
-        Func outLPyramid[maxJ];
+        std::vector<Func> outLPyramid;
         for (int j = 0; j < J; j++) {
             // Split input pyramid value into integer and floating parts
             Expr level = inGPyramid[j](x, y) * cast<float>(levels-1);
             Expr li = clamp(cast<int>(level), 0, levels-2);
             Expr lf = level - cast<float>(li);
             // Linearly interpolate between the nearest processed pyramid levels
-            outLPyramid[j](x, y) = (1.0f - lf) * lPyramid[j](x, y, li) + lf * lPyramid[j](x, y, li+1);
+            Func out_level("outLPyramid_" + std::to_string(j));
+            out_level(x, y) = (1.0f - lf) * lPyramid[j](x, y, li) + lf * lPyramid[j](x, y, li+1);
+            outLPyramid.push_back(out_level);
         }
 
         // Make the Gaussian pyramid of the output
-        Func outGPyramid[maxJ];
-        outGPyramid[J-1](x, y) = outLPyramid[J-1](x, y);
-        for (int j = J-2; j >= 0; j--) {
-            outGPyramid[j](x, y) = upsample(outGPyramid[j+1])(x, y) + outLPyramid[j](x, y);
-        }
+        std::vector<Func> outGPyramid = pyramid::collapse(outLPyramid, "outGPyramid");
 
         // Reintroduce color (Connelly: use eps to avoid scaling up noise w/ apollo3.png input)
         Func color;
@@ -107,17 +97,33 @@ public:
             remap.compute_root();
             Var xi, yi;
             output.compute_root().gpu_tile(x, y, xi, yi, 16, 8);
-            for (int j = 0; j < J; j++) {
-                int blockw = 16, blockh = 8;
-                if (j > 3) {
-                    blockw = 2;
-                    blockh = 2;
-                }
+            // The levels from fused on are too small to fill the GPU, so
+            // they are all computed in the blocks of a single kernel, the
+            // one of outGPyramid[fused], instead of a kernel per level.
+            // gPyramid[fused] is also read by the Laplacian level above,
+            // so it gets its own kernel.
+            const int fused = 4;
+            for (int j = 0; j < J && j <= fused; j++) {
                 if (j > 0) {
-                    inGPyramid[j].compute_root().gpu_tile(x, y, xi, yi, blockw, blockh);
-                    gPyramid[j].compute_root().reorder(k, x, y).gpu_tile(x, y, xi, yi, blockw, blockh);
+                    gPyramid[j].compute_root().reorder(k, x, y).gpu_tile(x, y, xi, yi, 16, 8);
+                }
+                if (j > 0 && j < fused) {
+                    inGPyramid[j].compute_root().gpu_tile(x, y, xi, yi, 16, 8);
+                }
+                if (j < fused) {
+                    outGPyramid[j].compute_root().gpu_tile(x, y, xi, yi, 16, 8);
                 }
-                outGPyramid[j].compute_root().gpu_tile(x, y, xi, yi, blockw, blockh);
+            }
+            if (J > fused) {
+                std::vector<Func> coarse;
+                for (int j = fused; j < J; j++) {
+                    coarse.push_back(inGPyramid[j]);
+                    if (j > fused) {
+                        coarse.push_back(gPyramid[j]);
+                        coarse.push_back(outGPyramid[j]);
+                    }
+                }
+                pyramid::fuse_levels(outGPyramid[fused], coarse, get_target(), 16, 8);
             }
         } else {
             // cpu schedule
@@ -206,26 +212,6 @@ public:
     }
 private:
     Var x, y, c, k;
-
-    // Downsample with a 1 3 3 1 filter
-    Func downsample(Func f) {
-        using Halide::_;
-        Func downx, downy;
-        downx(x, y, _) = (f(2*x-1, y, _) + 3.0f * (f(2*x, y, _) + f(2*x+1, y, _)) + f(2*x+2, y, _)) / 8.0f;
-        downy(x, y, _) = (downx(x, 2*y-1, _) + 3.0f * (downx(x, 2*y, _) + downx(x, 2*y+1, _)) + downx(x, 2*y+2, _)) / 8.0f;
-        return downy;
-    }
-
-    // Upsample using bilinear interpolation
-    Func upsample(Func f) {
-        using Halide::_;
-        Func upx, upy;
-        upx(x, y, _) = 0.25f * f((x/2) - 1 + 2*(x % 2), y, _) + 0.75f * f(x/2, y, _);
-        upy(x, y, _) = 0.25f * upx(x, (y/2) - 1 + 2*(y % 2), _) + 0.75f * upx(x, y/2, _);
-        return upy;
-    }
-
-
 };
 
 }  // namespace
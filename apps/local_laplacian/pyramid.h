@@ -0,0 +1,165 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+// Gaussian and Laplacian pyramids of half-resolution levels, as used by
+// local Laplacian filtering and multi-scale losses. Level j + 1 of a
+// pyramid has half the resolution of level j in its first two dimensions;
+// the remaining dimensions are carried through unchanged. Level 0 is the
+// finest.
+//
+// All the levels are pure Funcs, so they can be differentiated with
+// propagate_adjoints like any other stage. The adjoint of a downsample is
+// the transposed 1 3 3 1 filter, and the adjoint of an upsample is the
+// transposed bilinear interpolation, so the adjoints of a pyramid form a
+// pyramid too, and can be scheduled by fuse_levels below.
+//
+// The coarse levels of a pyramid are too small to fill a machine on their
+// own, and scheduling each of them as its own loop nest (or GPU kernel)
+// mostly costs launch overhead. fuse_levels computes a set of them inside
+// the tiles of a single consumer instead.
+
+#include <string>
+#include <vector>
+
+#include "Halide.h"
+
+namespace pyramid {
+
+namespace pyramid_internal {
+
+// Call f at (x, y, args[2], args[3], ...).
+inline Halide::Expr at(Halide::Func f, const std::vector<Halide::Var> &args,
+                       Halide::Expr x, Halide::Expr y) {
+    std::vector<Halide::Expr> coords(args.begin(), args.end());
+    coords[0] = x;
+    coords[1] = y;
+    return f(coords);
+}
+
+}  // namespace pyramid_internal
+
+// Downsample by 2 with a 1 3 3 1 filter.
+inline Halide::Func downsample(Halide::Func f, const std::string &name = "") {
+    using pyramid_internal::at;
+    std::vector<Halide::Var> args = f.args();
+    Halide::Var x = args[0], y = args[1];
+    std::string prefix = name.empty() ? f.name() + "_down" : name;
+
+    Halide::Func downx(prefix + "_x"), downy(prefix);
+    downx(args) = (at(f, args, 2*x-1, y) +
+                   3.0f * (at(f, args, 2*x, y) + at(f, args, 2*x+1, y)) +
+                   at(f, args, 2*x+2, y)) / 8.0f;
+    downy(args) = (at(downx, args, x, 2*y-1) +
+                   3.0f * (at(downx, args, x, 2*y) + at(downx, args, x, 2*y+1)) +
+                   at(downx, args, x, 2*y+2)) / 8.0f;
+    return downy;
+}
+
+// Upsample by 2 with bilinear interpolation.
+inline Halide::Func upsample(Halide::Func f, const std::string &name = "") {
+    using pyramid_internal::at;
+    std::vector<Halide::Var> args = f.args();
+    Halide::Var x = args[0], y = args[1];
+    std::string prefix = name.empty() ? f.name() + "_up" : name;
+
+    Halide::Func upx(prefix + "_x"), upy(prefix);
+    upx(args) = 0.25f * at(f, args, (x/2) - 1 + 2*(x % 2), y) + 0.75f * at(f, args, x/2, y);
+    upy(args) = 0.25f * at(upx, args, x, (y/2) - 1 + 2*(y % 2)) + 0.75f * at(upx, args, x, y/2);
+    return upy;
+}
+
+// The Gaussian pyramid of base, with the given number of levels. Level 0 is
+// base itself.
+inline std::vector<Halide::Func> gaussian_pyramid(Halide::Func base, int levels,
+                                                  const std::string &name) {
+    std::vector<Halide::Func> pyramid{ base };
+    for (int j = 1; j < levels; j++) {
+        pyramid.push_back(downsample(pyramid.back(), name + "_" + std::to_string(j)));
+    }
+    return pyramid;
+}
+
+// The Laplacian pyramid of a Gaussian pyramid: each level is the
+// difference between the Gaussian level and the upsampled next one, and the
+// coarsest level is the coarsest Gaussian level.
+inline std::vector<Halide::Func> laplacian_pyramid(const std::vector<Halide::Func> &gaussian,
+                                                   const std::string &name) {
+    const int J = (int)gaussian.size();
+    std::vector<Halide::Func> pyramid(J);
+    for (int j = 0; j < J; j++) {
+        pyramid[j] = Halide::Func(name + "_" + std::to_string(j));
+    }
+    std::vector<Halide::Var> args = gaussian[J-1].args();
+    pyramid[J-1](args) = gaussian[J-1](args);
+    for (int j = J-2; j >= 0; j--) {
+        args = gaussian[j].args();
+        pyramid[j](args) = gaussian[j](args) - upsample(gaussian[j+1])(args);
+    }
+    return pyramid;
+}
+
+// Collapse a Laplacian pyramid, returning the Gaussian pyramid of the
+// result: level J - 1 is the coarsest Laplacian level, and each finer level
+// is the upsampled coarser one plus the Laplacian level. Level 0 is the
+// collapsed image. Collapsing the Laplacian pyramid of a Gaussian pyramid
+// gives back that Gaussian pyramid.
+inline std::vector<Halide::Func> collapse(const std::vector<Halide::Func> &laplacian,
+                                          const std::string &name) {
+    const int J = (int)laplacian.size();
+    std::vector<Halide::Func> pyramid(J);
+    for (int j = 0; j < J; j++) {
+        pyramid[j] = Halide::Func(name + "_" + std::to_string(j));
+    }
+    std::vector<Halide::Var> args = laplacian[J-1].args();
+    pyramid[J-1](args) = laplacian[J-1](args);
+    for (int j = J-2; j >= 0; j--) {
+        args = laplacian[j].args();
+        pyramid[j](args) = upsample(pyramid[j+1])(args) + laplacian[j](args);
+    }
+    return pyramid;
+}
+
+// Compute the levels inside the tiles of root, in a single loop nest: on
+// GPU targets, root gets tile_width x tile_height thread blocks and the
+// levels are computed per block, in shared memory, by the threads of the
+// block; on other targets, the tiles of root run in parallel and the levels
+// are computed per tile and vectorized. root must be the only consumer of
+// the levels outside of the levels themselves, e.g. the finest level of a
+// collapse, together with the coarser levels of the pyramids it reads.
+//
+// Each tile recomputes the part of the levels it needs, which overlaps the
+// neighboring tiles by the support of the filters at each level. This is
+// cheap for the small levels, and saves a loop nest (or a kernel launch)
+// and a round trip through memory per level.
+inline void fuse_levels(Halide::Func root, const std::vector<Halide::Func> &levels,
+                        const Halide::Target &target,
+                        int tile_width = 16, int tile_height = 8) {
+    using namespace Halide;
+    std::vector<Var> args = root.args();
+    Var x = args[0], y = args[1];
+    Var xo("fused_xo"), yo("fused_yo"), xi("fused_xi"), yi("fused_yi"), t("fused_tile");
+    if (target.has_gpu_feature()) {
+        root.compute_root().gpu_tile(x, y, xo, yo, xi, yi, tile_width, tile_height);
+        for (Func f : levels) {
+            // Loop over the remaining dimensions within each thread.
+            std::vector<Var> f_args = f.args();
+            std::vector<VarOrRVar> order(f_args.begin() + 2, f_args.end());
+            order.push_back(f_args[0]);
+            order.push_back(f_args[1]);
+            f.compute_at(root, xo).reorder(order).gpu_threads(f_args[0], f_args[1]);
+        }
+    } else {
+        const int vec = target.natural_vector_size<float>();
+        root.compute_root()
+            .tile(x, y, xo, yo, xi, yi, tile_width, tile_height)
+            .fuse(xo, yo, t).parallel(t).vectorize(xi, vec);
+        for (Func f : levels) {
+            std::vector<Var> f_args = f.args();
+            f.compute_at(root, t).vectorize(f_args[0], vec);
+        }
+    }
+}
+
+}  // namespace pyramid
+
+#endif
@@ -36,13 +36,17 @@ public:
         Func d("d");
         d(x, y, dx, dy) = sum(dc(x, y, dx, dy, channels));
 
-        // Find the patch differences by blurring the difference images
+        // Find the patch differences by blurring the difference images. The
+        // blurs are running sums over tiles of the output, so their cost
+        // doesn't depend on the patch size.
         RDom patch_dom(-(patch_size/2), patch_size);
         Func blur_d_y("blur_d_y");
-        blur_d_y(x, y, dx, dy) = sum(d(x, y + patch_dom, dx, dy));
+        SlidingSum blur_d_y_sum = sliding_sum(d(x, y + patch_dom, dx, dy), 8, "blur_d_y_sum");
+        blur_d_y(x, y, dx, dy) = blur_d_y_sum;
 
         Func blur_d("blur_d");
-        blur_d(x, y, dx, dy) = sum(blur_d_y(x + patch_dom, y, dx, dy));
+        SlidingSum blur_d_sum = sliding_sum(blur_d_y(x + patch_dom, y, dx, dy), 16, "blur_d_sum");
+        blur_d(x, y, dx, dy) = blur_d_sum;
 
         // Compute the weights from the patch differences
         Func w("w");
@@ -113,9 +117,13 @@ public:
                 .tile(x, y, tx, ty, x, y, 16, 8)
                 .parallel(ty)
                 .vectorize(x, 8);
-            blur_d_y.compute_at(non_local_means, tx)
-                .reorder(y, x)
-                .vectorize(x, 8);
+            // The running sums are over the 16x8 tiles of the output.
+            blur_d_y_sum.scan.compute_at(non_local_means, tx);
+            blur_d_y_sum.scan.update(0).vectorize(x, 8);
+            blur_d_y_sum.scan.update(1).vectorize(x, 8);
+            blur_d_sum.scan.compute_at(non_local_means, tx);
+            blur_d_sum.scan.update(0).vectorize(y, 8);
+            blur_d_sum.scan.update(1).vectorize(y, 8);
             d.compute_at(non_local_means, tx)
                 .vectorize(x, 8);
             non_local_means_sum.compute_at(non_local_means, x)
@@ -126,8 +134,6 @@ public:
                 .reorder(c, x, y, s_dom.x, s_dom.y)
                 .unroll(c)
                 .vectorize(x, 8);
-            blur_d.compute_at(non_local_means_sum, x)
-                .vectorize(x, 8);
         }
     }
 };
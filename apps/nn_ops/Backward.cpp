@@ -0,0 +1,294 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "halide_benchmark.h"
+
+#include "AveragePoolBackward.h"
+#include "ConvolutionBackward.h"
+#include "DepthwiseConvolutionBackward.h"
+#include "MatrixMultiplyBackward.h"
+#include "MaxPoolBackward.h"
+
+#include "HalideBuffer.h"
+
+using Halide::Runtime::Buffer;
+
+namespace {
+
+// The parameters of the forward layer.
+struct Layer {
+    int C, W, H, N;
+    int filter_width = 1, filter_height = 1, output_depth;
+    int stride = 1, pad_width = 0, pad_height = 0;
+
+    int output_width() const {
+        return (W + 2 * pad_width - filter_width) / stride + 1;
+    }
+    int output_height() const {
+        return (H + 2 * pad_height - filter_height) / stride + 1;
+    }
+    // Whether the input pixel at (x, y) of the window of the output pixel
+    // (ox, oy) at (fx, fy) is inside the input, and where.
+    bool input_pixel(int ox, int oy, int fx, int fy, int *x, int *y) const {
+        *x = ox * stride + fx - pad_width;
+        *y = oy * stride + fy - pad_height;
+        return *x >= 0 && *x < W && *y >= 0 && *y < H;
+    }
+};
+
+Buffer<float> random_buffer(std::vector<int> sizes) {
+    Buffer<float> buf(sizes);
+    buf.for_each_value([](float &x) {
+        x = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    });
+    return buf;
+}
+
+Buffer<float> zeros_like(const Buffer<float> &buf) {
+    Buffer<float> result = Buffer<float>::make_with_shape_of(buf);
+    result.fill(0.0f);
+    return result;
+}
+
+// Compare a gradient to the reference, relative to the magnitude of the
+// reference.
+void check(const char *name, const Buffer<float> &actual, const Buffer<float> &expected) {
+    float scale = 1.0f;
+    expected.for_each_value([&](float x) {
+        scale = std::max(scale, fabsf(x));
+    });
+    actual.for_each_element([&](const int *pos) {
+        float a = actual(pos), e = expected(pos);
+        if (!(fabsf(a - e) <= 1e-4f * scale)) {
+            printf("Mismatch in %s at %d: %f != %f\n", name, pos[0], a, e);
+            abort();
+        }
+    });
+}
+
+// Benchmark the generated pipeline and the hand-written reference, which
+// aren't expected to be close: the reference is a baseline for the
+// generated pipeline to beat.
+template <typename Pipeline, typename Reference>
+void benchmark(Pipeline pipeline, Reference reference) {
+    double time = Halide::Tools::benchmark([&]() {
+        int result = pipeline();
+        if (result != 0) {
+            printf("pipeline failed! %d\n", result);
+        }
+    });
+    double reference_time = Halide::Tools::benchmark(3, 1, reference);
+    printf("Done, time: %g s, reference time: %g s\n", time, reference_time);
+}
+
+void pool_backward(const Layer &l, bool is_max) {
+    Buffer<float> input = random_buffer({ l.C, l.W, l.H, l.N });
+    Buffer<float> output_gradient = random_buffer({ l.C, l.output_width(), l.output_height(), l.N });
+    Buffer<float> input_gradient = zeros_like(input);
+    Buffer<float> expected = zeros_like(input);
+
+    // The reference scatters the gradient of each output to the input
+    // pixels of its window.
+    auto reference = [&]() {
+        expected.fill(0.0f);
+        output_gradient.for_each_element([&](int c, int ox, int oy, int b) {
+            int best_x = -1, best_y = -1, count = 0;
+            for (int fy = 0; fy < l.filter_height; fy++) {
+                for (int fx = 0; fx < l.filter_width; fx++) {
+                    int x, y;
+                    if (!l.input_pixel(ox, oy, fx, fy, &x, &y)) continue;
+                    if (best_x < 0 || input(c, x, y, b) > input(c, best_x, best_y, b)) {
+                        best_x = x;
+                        best_y = y;
+                    }
+                    count++;
+                }
+            }
+            for (int fy = 0; fy < l.filter_height; fy++) {
+                for (int fx = 0; fx < l.filter_width; fx++) {
+                    int x, y;
+                    if (!l.input_pixel(ox, oy, fx, fy, &x, &y)) continue;
+                    if (!is_max) {
+                        expected(c, x, y, b) += output_gradient(c, ox, oy, b) / count;
+                    } else if (x == best_x && y == best_y) {
+                        expected(c, x, y, b) += output_gradient(c, ox, oy, b);
+                    }
+                }
+            }
+        });
+    };
+
+    benchmark([&]() {
+        if (is_max) {
+            return MaxPoolBackward(input, output_gradient, l.stride, l.pad_width, l.pad_height,
+                                   l.filter_width, l.filter_height, input_gradient);
+        }
+        return AveragePoolBackward(input, output_gradient, l.stride, l.pad_width, l.pad_height,
+                                   l.filter_width, l.filter_height, input_gradient);
+    }, reference);
+    check("input_gradient", input_gradient, expected);
+}
+
+void depthwise_convolution_backward(const Layer &l) {
+    Buffer<float> input = random_buffer({ l.C, l.W, l.H, l.N });
+    Buffer<float> filter = random_buffer({ l.C, l.filter_width, l.filter_height });
+    Buffer<float> bias = random_buffer({ l.C });
+    Buffer<float> output_gradient = random_buffer({ l.C, l.output_width(), l.output_height(), l.N });
+    Buffer<float> input_gradient = zeros_like(input), expected_input_gradient = zeros_like(input);
+    Buffer<float> filter_gradient = zeros_like(filter), expected_filter_gradient = zeros_like(filter);
+    Buffer<float> bias_gradient = zeros_like(bias), expected_bias_gradient = zeros_like(bias);
+
+    auto reference = [&]() {
+        expected_input_gradient.fill(0.0f);
+        expected_filter_gradient.fill(0.0f);
+        expected_bias_gradient.fill(0.0f);
+        output_gradient.for_each_element([&](int c, int ox, int oy, int b) {
+            float g = output_gradient(c, ox, oy, b);
+            expected_bias_gradient(c) += g;
+            for (int fy = 0; fy < l.filter_height; fy++) {
+                for (int fx = 0; fx < l.filter_width; fx++) {
+                    int x, y;
+                    if (!l.input_pixel(ox, oy, fx, fy, &x, &y)) continue;
+                    expected_input_gradient(c, x, y, b) += g * filter(c, fx, fy);
+                    expected_filter_gradient(c, fx, fy) += g * input(c, x, y, b);
+                }
+            }
+        });
+    };
+
+    benchmark([&]() {
+        return DepthwiseConvolutionBackward(input, filter, bias, output_gradient,
+                                            l.stride, l.pad_width, l.pad_height,
+                                            input_gradient, filter_gradient, bias_gradient);
+    }, reference);
+    check("input_gradient", input_gradient, expected_input_gradient);
+    check("filter_gradient", filter_gradient, expected_filter_gradient);
+    check("bias_gradient", bias_gradient, expected_bias_gradient);
+}
+
+void convolution_backward(const Layer &l) {
+    Buffer<float> input = random_buffer({ l.C, l.W, l.H, l.N });
+    Buffer<float> filter = random_buffer({ l.C, l.filter_width, l.filter_height, l.output_depth });
+    Buffer<float> bias = random_buffer({ l.output_depth });
+    Buffer<float> output_gradient =
+        random_buffer({ l.output_depth, l.output_width(), l.output_height(), l.N });
+    Buffer<float> input_gradient = zeros_like(input), expected_input_gradient = zeros_like(input);
+    Buffer<float> filter_gradient = zeros_like(filter), expected_filter_gradient = zeros_like(filter);
+    Buffer<float> bias_gradient = zeros_like(bias), expected_bias_gradient = zeros_like(bias);
+
+    auto reference = [&]() {
+        expected_input_gradient.fill(0.0f);
+        expected_filter_gradient.fill(0.0f);
+        expected_bias_gradient.fill(0.0f);
+        output_gradient.for_each_element([&](int k, int ox, int oy, int b) {
+            float g = output_gradient(k, ox, oy, b);
+            expected_bias_gradient(k) += g;
+            for (int fy = 0; fy < l.filter_height; fy++) {
+                for (int fx = 0; fx < l.filter_width; fx++) {
+                    int x, y;
+                    if (!l.input_pixel(ox, oy, fx, fy, &x, &y)) continue;
+                    for (int c = 0; c < l.C; c++) {
+                        expected_input_gradient(c, x, y, b) += g * filter(c, fx, fy, k);
+                        expected_filter_gradient(c, fx, fy, k) += g * input(c, x, y, b);
+                    }
+                }
+            }
+        });
+    };
+
+    benchmark([&]() {
+        return ConvolutionBackward(input, filter, bias, output_gradient,
+                                   l.stride, l.pad_width, l.pad_height,
+                                   input_gradient, filter_gradient, bias_gradient);
+    }, reference);
+    check("input_gradient", input_gradient, expected_input_gradient);
+    check("filter_gradient", filter_gradient, expected_filter_gradient);
+    check("bias_gradient", bias_gradient, expected_bias_gradient);
+}
+
+// The matrix multiply is the 1x1 convolution of the layer, with the pixels
+// flattened into the rows of mat_a.
+void matrix_multiply_backward(const Layer &l) {
+    const int rows = l.W * l.H * l.N;
+    Buffer<float> mat_a = random_buffer({ l.C, rows });
+    Buffer<float> mat_b = random_buffer({ l.output_depth, l.C });
+    Buffer<float> bias = random_buffer({ l.output_depth });
+    Buffer<float> output_gradient = random_buffer({ l.output_depth, rows });
+    Buffer<float> mat_a_gradient = zeros_like(mat_a), expected_mat_a_gradient = zeros_like(mat_a);
+    Buffer<float> mat_b_gradient = zeros_like(mat_b), expected_mat_b_gradient = zeros_like(mat_b);
+    Buffer<float> bias_gradient = zeros_like(bias), expected_bias_gradient = zeros_like(bias);
+
+    auto reference = [&]() {
+        expected_mat_a_gradient.fill(0.0f);
+        expected_mat_b_gradient.fill(0.0f);
+        expected_bias_gradient.fill(0.0f);
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < l.output_depth; x++) {
+                float g = output_gradient(x, y);
+                expected_bias_gradient(x) += g;
+                for (int k = 0; k < l.C; k++) {
+                    expected_mat_a_gradient(k, y) += g * mat_b(x, k);
+                    expected_mat_b_gradient(x, k) += g * mat_a(k, y);
+                }
+            }
+        }
+    };
+
+    benchmark([&]() {
+        return MatrixMultiplyBackward(mat_a, mat_b, bias, output_gradient,
+                                      mat_a_gradient, mat_b_gradient, bias_gradient);
+    }, reference);
+    check("mat_a_gradient", mat_a_gradient, expected_mat_a_gradient);
+    check("mat_b_gradient", mat_b_gradient, expected_mat_b_gradient);
+    check("bias_gradient", bias_gradient, expected_bias_gradient);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 6) {
+        printf("Usage: %s layer C W H N [filter_width filter_height output_depth stride pad_width pad_height]\n"
+               "where layer is one of AveragePool, MaxPool, DepthwiseConvolution, Convolution or MatrixMultiply\n",
+               argv[0]);
+        return 0;
+    }
+
+    const char *layer_name = argv[1];
+    Layer l;
+    l.C = atoi(argv[2]);
+    l.W = atoi(argv[3]);
+    l.H = atoi(argv[4]);
+    l.N = atoi(argv[5]);
+    l.output_depth = l.C;
+
+    if (argc > 6) l.filter_width = atoi(argv[6]);
+    if (argc > 7) l.filter_height = atoi(argv[7]);
+    if (argc > 8) l.output_depth = atoi(argv[8]);
+    if (argc > 9) l.stride = atoi(argv[9]);
+    if (argc > 10) l.pad_width = atoi(argv[10]);
+    if (argc > 11) l.pad_height = atoi(argv[11]);
+
+    printf("Benchmarking %s backward %dx%dx%dx%d\n", layer_name, l.C, l.W, l.H, l.N);
+
+    if (!strcmp(layer_name, "AveragePool")) {
+        pool_backward(l, false);
+    } else if (!strcmp(layer_name, "MaxPool")) {
+        pool_backward(l, true);
+    } else if (!strcmp(layer_name, "DepthwiseConvolution")) {
+        depthwise_convolution_backward(l);
+    } else if (!strcmp(layer_name, "Convolution")) {
+        convolution_backward(l);
+    } else if (!strcmp(layer_name, "MatrixMultiply")) {
+        matrix_multiply_backward(l);
+    } else {
+        printf("Unknown layer %s\n", layer_name);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
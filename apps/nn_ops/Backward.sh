@@ -0,0 +1,22 @@
+BACKWARD=$1
+# Columns are: layer C W H N filter_width filter_height output_depth stride
+# pad_width pad_height
+
+$BACKWARD AveragePool 8 17 17 1 3 3 8 1 1 1
+$BACKWARD AveragePool 32 56 56 1 3 3 32 2 1 1
+$BACKWARD MaxPool 8 17 17 1 3 3 8 1 1 1
+$BACKWARD MaxPool 32 56 56 1 3 3 32 2 1 1
+$BACKWARD DepthwiseConvolution 8 17 17 1 3 3 8 1 1 1
+$BACKWARD DepthwiseConvolution 32 56 56 1 3 3 32 2 1 1
+$BACKWARD Convolution 8 17 17 1 3 3 16 1 1 1
+$BACKWARD Convolution 32 28 28 1 3 3 32 1 1 1
+$BACKWARD Convolution 32 28 28 1 5 5 64 2 2 2
+$BACKWARD MatrixMultiply 16 56 56 1 1 1 32
+$BACKWARD MatrixMultiply 64 14 14 1 1 1 128
+# Uneven shapes: batches, non-square filters, and windows cut by the
+# padding on one side only.
+$BACKWARD AveragePool 3 13 11 2 3 2 3 2 1 0
+$BACKWARD MaxPool 5 9 7 2 2 3 5 2 0 1
+$BACKWARD DepthwiseConvolution 5 10 7 2 3 2 5 2 1 1
+$BACKWARD Convolution 3 11 9 2 3 5 4 2 2 1
+$BACKWARD MatrixMultiply 7 5 3 2 1 1 9
@@ -0,0 +1,384 @@
+// These generators implement the backward passes of the nn_ops layers, for
+// training. Each one defines the forward layer, in floating point, and uses
+// propagate_adjoints to derive the gradients of its inputs and weights from
+// the gradient of its output, so the forward definitions are the only
+// hand-written part. They are a baseline for autodiff-generated gradients,
+// and are checked against hand-written backward kernels by Backward.cpp.
+//
+// The layers match the forward generators, without quantization:
+// AveragePoolBackward and MaxPoolBackward: the gradient of the input.
+// DepthwiseConvolutionBackward and ConvolutionBackward: the gradients of the
+// input, filter and bias.
+// MatrixMultiplyBackward: the gradients of both matrices and the bias.
+// The tensors have the same dimensions as in the forward generators, and the
+// gradients have the dimensions of the tensors they are the gradients of.
+
+#include <Halide.h>
+
+using Halide::Derivative;
+using Halide::Expr;
+using Halide::Func;
+using Halide::Generator;
+using Halide::RDom;
+using Halide::Stage;
+using Halide::TailStrategy;
+using Halide::Var;
+using Halide::BoundaryConditions::constant_exterior;
+
+namespace {
+
+// The bounds of the output gradient, as the {min, max} pairs that
+// propagate_adjoints takes.
+template <typename T>
+std::vector<std::pair<Expr, Expr>> bounds_of(const T &buffer, int dimensions) {
+    std::vector<std::pair<Expr, Expr>> bounds;
+    for (int i = 0; i < dimensions; i++) {
+        bounds.push_back({ buffer.dim(i).min(), buffer.dim(i).max() });
+    }
+    return bounds;
+}
+
+// Whether the arguments of a definition use the pure variable v at
+// position i, i.e. the iterations over v are independent.
+bool is_pure_in(const std::vector<Expr> &args, size_t i, const Var &v) {
+    const Halide::Internal::Variable *var = args[i].as<Halide::Internal::Variable>();
+    return var && var->name == v.name();
+}
+
+// Schedule an adjoint, or any other Func with update definitions, at root.
+// Each definition is vectorized over the innermost dimension and
+// parallelized over the outermost one, when it is pure in them; the
+// adjoints that scatter along a dimension are left serial in it.
+void schedule_root(Func f, const Halide::Target &target) {
+    const int vector_size = target.natural_vector_size<float>();
+    const std::vector<Var> args = f.args();
+    const Var inner = args.front();
+    const Var outer = args.back();
+
+    f.compute_root().vectorize(inner, vector_size, TailStrategy::GuardWithIf);
+    if (args.size() > 1) {
+        f.parallel(outer);
+    }
+    for (int i = 0; i < f.num_update_definitions(); i++) {
+        const std::vector<Expr> &update_args = f.update_args(i);
+        Stage update = f.update(i);
+        if (is_pure_in(update_args, 0, inner)) {
+            update.vectorize(inner, vector_size, TailStrategy::GuardWithIf);
+        }
+        if (args.size() > 1 && is_pure_in(update_args, args.size() - 1, outer)) {
+            update.parallel(outer);
+        }
+    }
+}
+
+// Schedule all the adjoints that have update definitions: the others are
+// inlined into their consumers.
+void schedule_adjoints(const Derivative &d, const Halide::Target &target) {
+    for (const auto &it : d.adjoints) {
+        Func f = it.second;
+        if (f.defined() && f.has_update_definition()) {
+            schedule_root(f, target);
+        }
+    }
+}
+
+// Schedule an output gradient, which copies an adjoint.
+void schedule_output(Func f, const Halide::Target &target) {
+    const std::vector<Var> args = f.args();
+    f.vectorize(args.front(), target.natural_vector_size<float>(), TailStrategy::GuardWithIf);
+    if (args.size() > 1) {
+        f.parallel(args.back());
+    }
+}
+
+}  // namespace
+
+class AveragePoolBackward : public Generator<AveragePoolBackward> {
+public:
+    // The input of the forward pass, indexed by depth, x, y, batch.
+    Input<Buffer<float>> input_{"input", 4};
+
+    // The gradient of the output of the forward pass.
+    Input<Buffer<float>> output_gradient_{"output_gradient", 4};
+
+    // The forward pass parameters, as in AveragePool.
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+    Input<int> filter_width_{ "filter_width" };
+    Input<int> filter_height_{ "filter_height" };
+
+    Output<Buffer<float>> input_gradient_{"input_gradient", 4};
+
+    void generate() {
+        Var x("x"), y("y"), depth("depth"), batch("batch");
+
+        // The forward pass.
+        Func f_input("f_input");
+        f_input(depth, x, y, batch) = input_(depth, x, y, batch);
+        Func input_bounded = constant_exterior(f_input, 0.0f,
+                                               { { Expr(), Expr() },
+                                                 { 0, input_.dim(1).extent() },
+                                                 { 0, input_.dim(2).extent() },
+                                                 { Expr(), Expr() } });
+
+        Func sum("sum");
+        RDom filter_dom(0, filter_width_, 0, filter_height_);
+        sum(depth, x, y, batch) += input_bounded(
+            depth, x * stride_ + filter_dom.x - pad_width_,
+            y * stride_ + filter_dom.y - pad_height_, batch);
+
+        // The average is over the part of the window inside the input.
+        Expr in_x_origin = x * stride_ - pad_width_;
+        Expr x_start = max(0, -in_x_origin);
+        Expr x_end = min(filter_width_, input_.dim(1).extent() - in_x_origin);
+        Expr in_y_origin = y * stride_ - pad_height_;
+        Expr y_start = max(0, -in_y_origin);
+        Expr y_end = min(filter_height_, input_.dim(2).extent() - in_y_origin);
+        Expr filter_count = (x_end - x_start) * (y_end - y_start);
+
+        Func average("average");
+        average(depth, x, y, batch) = sum(depth, x, y, batch) / cast<float>(filter_count);
+
+        // The backward pass.
+        Func adjoint("adjoint");
+        adjoint(depth, x, y, batch) = output_gradient_(depth, x, y, batch);
+        Derivative d = propagate_adjoints(average, adjoint, bounds_of(output_gradient_, 4));
+        input_gradient_(depth, x, y, batch) = d(f_input)(depth, x, y, batch);
+
+        // The schedule.
+        schedule_adjoints(d, get_target());
+        schedule_output(input_gradient_, get_target());
+    }
+};
+
+class MaxPoolBackward : public Generator<MaxPoolBackward> {
+public:
+    // The input of the forward pass, indexed by depth, x, y, batch.
+    Input<Buffer<float>> input_{"input", 4};
+
+    // The gradient of the output of the forward pass.
+    Input<Buffer<float>> output_gradient_{"output_gradient", 4};
+
+    // The forward pass parameters, as in MaxPool.
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+    Input<int> filter_width_{ "filter_width" };
+    Input<int> filter_height_{ "filter_height" };
+
+    Output<Buffer<float>> input_gradient_{"input_gradient", 4};
+
+    void generate() {
+        Var x("x"), y("y"), depth("depth"), batch("batch");
+
+        // The forward pass. The boundary condition is the lowest float, so
+        // only the values inside the input are the maximum of a window.
+        Func f_input("f_input");
+        f_input(depth, x, y, batch) = input_(depth, x, y, batch);
+        Func input_bounded = constant_exterior(f_input, Halide::Float(32).min(),
+                                               { { Expr(), Expr() },
+                                                 { 0, input_.dim(1).extent() },
+                                                 { 0, input_.dim(2).extent() },
+                                                 { Expr(), Expr() } });
+
+        Func local_max("local_max");
+        RDom filter_dom(0, filter_width_, 0, filter_height_);
+        local_max(depth, x, y, batch) = Halide::Float(32).min();
+        local_max(depth, x, y, batch) =
+            max(local_max(depth, x, y, batch),
+                input_bounded(depth, x * stride_ + filter_dom.x - pad_width_,
+                              y * stride_ + filter_dom.y - pad_height_, batch));
+
+        // The backward pass. Only the maximum of each window gets the
+        // gradient, so the adjoint reads the forward maxima.
+        Func adjoint("adjoint");
+        adjoint(depth, x, y, batch) = output_gradient_(depth, x, y, batch);
+        Derivative d = propagate_adjoints(local_max, adjoint, bounds_of(output_gradient_, 4));
+        input_gradient_(depth, x, y, batch) = d(f_input)(depth, x, y, batch);
+
+        // The schedule.
+        schedule_root(local_max, get_target());
+        schedule_adjoints(d, get_target());
+        schedule_output(input_gradient_, get_target());
+    }
+};
+
+class DepthwiseConvolutionBackward : public Generator<DepthwiseConvolutionBackward> {
+public:
+    // The number of output channels per input channel, as in
+    // DepthwiseConvolution.
+    GeneratorParam<int> depth_multiplier_{ "depth_multiplier", 1, 1, 8 };
+
+    // The input of the forward pass, indexed by depth, x, y, batch.
+    Input<Buffer<float>> input_{"input", 4};
+
+    // The filter, indexed by output depth, x, y.
+    Input<Buffer<float>> filter_{"filter", 3};
+
+    // The bias, indexed by output depth.
+    Input<Buffer<float>> bias_{"bias", 1};
+
+    // The gradient of the output of the forward pass.
+    Input<Buffer<float>> output_gradient_{"output_gradient", 4};
+
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+
+    Output<Buffer<float>> input_gradient_{"input_gradient", 4};
+    Output<Buffer<float>> filter_gradient_{"filter_gradient", 3};
+    Output<Buffer<float>> bias_gradient_{"bias_gradient", 1};
+
+    void generate() {
+        Var x("x"), y("y"), depth("depth"), batch("batch");
+
+        // The forward pass.
+        Func f_input("f_input"), f_filter("f_filter"), f_bias("f_bias");
+        f_input(depth, x, y, batch) = input_(depth, x, y, batch);
+        f_filter(depth, x, y) = filter_(depth, x, y);
+        f_bias(depth) = bias_(depth);
+        Func input_bounded = constant_exterior(f_input, 0.0f,
+                                               { { Expr(), Expr() },
+                                                 { 0, input_.dim(1).extent() },
+                                                 { 0, input_.dim(2).extent() },
+                                                 { Expr(), Expr() } });
+
+        Func convolved("convolved");
+        RDom filter_dom(0, filter_.dim(1).extent(), 0, filter_.dim(2).extent());
+        convolved(depth, x, y, batch) = f_bias(depth);
+        convolved(depth, x, y, batch) +=
+            f_filter(depth, filter_dom.x, filter_dom.y) *
+            input_bounded(depth / depth_multiplier_,
+                          x * stride_ + filter_dom.x - pad_width_,
+                          y * stride_ + filter_dom.y - pad_height_, batch);
+
+        // The backward pass.
+        Func adjoint("adjoint");
+        adjoint(depth, x, y, batch) = output_gradient_(depth, x, y, batch);
+        Derivative d = propagate_adjoints(convolved, adjoint, bounds_of(output_gradient_, 4));
+        input_gradient_(depth, x, y, batch) = d(f_input)(depth, x, y, batch);
+        filter_gradient_(depth, x, y) = d(f_filter)(depth, x, y);
+        bias_gradient_(depth) = d(f_bias)(depth);
+
+        // The schedule.
+        schedule_adjoints(d, get_target());
+        schedule_output(input_gradient_, get_target());
+        schedule_output(filter_gradient_, get_target());
+        schedule_output(bias_gradient_, get_target());
+    }
+};
+
+class ConvolutionBackward : public Generator<ConvolutionBackward> {
+public:
+    // The input of the forward pass, indexed by depth, x, y, batch.
+    Input<Buffer<float>> input_{"input", 4};
+
+    // The filter, indexed by input depth, x, y, output depth.
+    Input<Buffer<float>> filter_{"filter", 4};
+
+    // The bias, indexed by output depth.
+    Input<Buffer<float>> bias_{"bias", 1};
+
+    // The gradient of the output of the forward pass.
+    Input<Buffer<float>> output_gradient_{"output_gradient", 4};
+
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+
+    Output<Buffer<float>> input_gradient_{"input_gradient", 4};
+    Output<Buffer<float>> filter_gradient_{"filter_gradient", 4};
+    Output<Buffer<float>> bias_gradient_{"bias_gradient", 1};
+
+    void generate() {
+        Var x("x"), y("y"), depth("depth"), batch("batch");
+
+        // The forward pass.
+        Func f_input("f_input"), f_filter("f_filter"), f_bias("f_bias");
+        f_input(depth, x, y, batch) = input_(depth, x, y, batch);
+        f_filter(depth, x, y, batch) = filter_(depth, x, y, batch);
+        f_bias(depth) = bias_(depth);
+        Func input_bounded = constant_exterior(f_input, 0.0f,
+                                               { { Expr(), Expr() },
+                                                 { 0, input_.dim(1).extent() },
+                                                 { 0, input_.dim(2).extent() },
+                                                 { Expr(), Expr() } });
+
+        Func convolved("convolved");
+        RDom filter_dom(0, filter_.dim(0).extent(), 0, filter_.dim(1).extent(), 0,
+                        filter_.dim(2).extent());
+        convolved(depth, x, y, batch) = f_bias(depth);
+        convolved(depth, x, y, batch) +=
+            f_filter(filter_dom.x, filter_dom.y, filter_dom.z, depth) *
+            input_bounded(filter_dom.x, x * stride_ + filter_dom.y - pad_width_,
+                          y * stride_ + filter_dom.z - pad_height_, batch);
+
+        // The backward pass.
+        Func adjoint("adjoint");
+        adjoint(depth, x, y, batch) = output_gradient_(depth, x, y, batch);
+        Derivative d = propagate_adjoints(convolved, adjoint, bounds_of(output_gradient_, 4));
+        input_gradient_(depth, x, y, batch) = d(f_input)(depth, x, y, batch);
+        filter_gradient_(depth, x, y, batch) = d(f_filter)(depth, x, y, batch);
+        bias_gradient_(depth) = d(f_bias)(depth);
+
+        // The schedule.
+        schedule_adjoints(d, get_target());
+        schedule_output(input_gradient_, get_target());
+        schedule_output(filter_gradient_, get_target());
+        schedule_output(bias_gradient_, get_target());
+    }
+};
+
+class MatrixMultiplyBackward : public Generator<MatrixMultiplyBackward> {
+public:
+    // The matrices of the forward pass, indexed by x, y, as in
+    // MatrixMultiply.
+    Input<Buffer<float>> mat_a_{"mat_a", 2};
+    Input<Buffer<float>> mat_b_{"mat_b", 2};
+
+    // The bias, indexed by x.
+    Input<Buffer<float>> bias_{"bias", 1};
+
+    // The gradient of the output of the forward pass.
+    Input<Buffer<float>> output_gradient_{"output_gradient", 2};
+
+    Output<Buffer<float>> mat_a_gradient_{"mat_a_gradient", 2};
+    Output<Buffer<float>> mat_b_gradient_{"mat_b_gradient", 2};
+    Output<Buffer<float>> bias_gradient_{"bias_gradient", 1};
+
+    void generate() {
+        Var x("x"), y("y");
+
+        // The forward pass.
+        Func f_mat_a("f_mat_a"), f_mat_b("f_mat_b"), f_bias("f_bias");
+        f_mat_a(x, y) = mat_a_(x, y);
+        f_mat_b(x, y) = mat_b_(x, y);
+        f_bias(x) = bias_(x);
+
+        Func multiplied("multiplied");
+        RDom rk(0, mat_a_.dim(0).extent());
+        multiplied(x, y) = f_bias(x);
+        multiplied(x, y) += f_mat_a(rk, y) * f_mat_b(x, rk);
+
+        // The backward pass.
+        Func adjoint("adjoint");
+        adjoint(x, y) = output_gradient_(x, y);
+        Derivative d = propagate_adjoints(multiplied, adjoint, bounds_of(output_gradient_, 2));
+        mat_a_gradient_(x, y) = d(f_mat_a)(x, y);
+        mat_b_gradient_(x, y) = d(f_mat_b)(x, y);
+        bias_gradient_(x) = d(f_bias)(x);
+
+        // The schedule.
+        schedule_adjoints(d, get_target());
+        schedule_output(mat_a_gradient_, get_target());
+        schedule_output(mat_b_gradient_, get_target());
+        schedule_output(bias_gradient_, get_target());
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(AveragePoolBackward, AveragePoolBackward)
+HALIDE_REGISTER_GENERATOR(MaxPoolBackward, MaxPoolBackward)
+HALIDE_REGISTER_GENERATOR(DepthwiseConvolutionBackward, DepthwiseConvolutionBackward)
+HALIDE_REGISTER_GENERATOR(ConvolutionBackward, ConvolutionBackward)
+HALIDE_REGISTER_GENERATOR(MatrixMultiplyBackward, MatrixMultiplyBackward)
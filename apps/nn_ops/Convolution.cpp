@@ -161,10 +161,8 @@ int main(int argc, char **argv) {
             }
         }
 
-        output = multiply_quantized_multiplier_reference(output, output_multiplier, output_shift);
-        output += output_offset;
-        output = std::max(output, (int32_t) output_min);
-        output = std::min(output, (int32_t) output_max);
+        output = requantize_u8_reference(output, output_multiplier, output_shift,
+                                         output_offset, output_min, output_max);
         if (output != output_tensor(c, x, y, b)) {
             printf("Mismatch at %d %d: %d != %d\n", x, y, output, output_tensor(c, x, y, b));
             abort();
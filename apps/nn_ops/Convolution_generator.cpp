@@ -24,8 +24,6 @@ using Halide::Generator;
 using Halide::Var;
 using Halide::BoundaryConditions::constant_exterior;
 using Halide::ConciseCasts::i16;
-using Halide::ConciseCasts::u16_sat;
-using Halide::ConciseCasts::u8_sat;
 
 class Convolution : public Generator<Convolution> {
 public:
@@ -110,18 +108,11 @@ public:
                 filter_dom[0], x * stride_ + filter_dom[1],
                 y * stride_ + filter_dom[2], batch));
 
-        Func scaled_plus_offset("scaled_plus_offset");
-        scaled_plus_offset(depth, x, y, batch) =
-            multiply_quantized_multiplier(
-                convolved(depth, x, y, batch) + bias_(depth), output_multiplier_,
-                output_shift_) +
-            output_offset_;
-
-        // Saturate and narrow the output.
+        // Requantize, saturate and narrow the output.
         output_(depth, x, y, batch) =
-            min(output_max_,
-                max(output_min_,
-                    u8_sat(u16_sat(scaled_plus_offset(depth, x, y, batch)))));
+            requantize_u8(convolved(depth, x, y, batch) + bias_(depth),
+                          output_multiplier_, output_shift_, output_offset_,
+                          output_min_, output_max_);
 
         const bool use_hexagon =
             get_target().features_any_of({ Target::HVX_64, Target::HVX_128 });
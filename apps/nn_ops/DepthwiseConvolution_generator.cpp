@@ -24,8 +24,6 @@ using Halide::TailStrategy;
 using Halide::Type;
 using Halide::Var;
 using Halide::BoundaryConditions::constant_exterior;
-using Halide::ConciseCasts::u16_sat;
-using Halide::ConciseCasts::u8_sat;
 
 // Schedules the resampled input to be computed at the output, considering
 // the natural vector size, the depth multiplier, and the filter dimensions.
@@ -153,17 +151,11 @@ public:
                  resampled_input_with_offset(depth, x * stride_ + filter_dom.x,
                                              y * stride_ + filter_dom.y, batch)));
 
-        Func scaled_plus_offset("scaled_plus_offset");
-        scaled_plus_offset(depth, x, y, batch) =
-            multiply_quantized_multiplier(
-                convolved(depth, x, y, batch) + bias_(depth), output_multiplier_,
-                output_shift_) +
-            output_offset_;
-
-        // Saturate and narrow the output.
+        // Requantize, saturate and narrow the output.
         output_(depth, x, y, batch) =
-            clamp(u8_sat(scaled_plus_offset(depth, x, y, batch)),
-                  output_min_, output_max_);
+            requantize_u8(convolved(depth, x, y, batch) + bias_(depth),
+                          output_multiplier_, output_shift_, output_offset_,
+                          output_min_, output_max_);
 
         // The schedule.
         int vector_size_u8 = get_target().natural_vector_size<uint8_t>();
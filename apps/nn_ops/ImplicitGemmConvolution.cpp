@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "halide_benchmark.h"
+
+#include "common_reference.h"
+#include "ImplicitGemmConvolution.h"
+#include "ImplicitGemmConvolutionFilterGradient.h"
+#include "ImplicitGemmConvolutionInputGradient.h"
+
+#include "HalideBuffer.h"
+
+// Hexagon's device_malloc implementation will also set the host pointer if it
+// is null, giving a zero copy buffer.
+template <typename T>
+void allocate(Halide::Runtime::Buffer<T> &buf) {
+#ifdef HALIDE_RUNTIME_HEXAGON
+    buf.device_malloc(halide_hexagon_device_interface());
+#else
+    buf.allocate();
+#endif
+}
+
+void randomize(Halide::Runtime::Buffer<uint8_t> &buf) {
+    buf.for_each_value([](uint8_t &x) {
+        x = static_cast<uint8_t>(rand());
+    });
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        printf("Usage: %s C W H N [filter_width filter_height output_depth stride pad_width pad_height]\n", argv[0]);
+        return 0;
+    }
+
+    int C = atoi(argv[1]);
+    int W = atoi(argv[2]);
+    int H = atoi(argv[3]);
+    int N = atoi(argv[4]);
+
+    int filter_width = 1;
+    int filter_height = 1;
+    int output_depth = C;
+    int stride = 1;
+    int pad_width = 0;
+    int pad_height = 0;
+
+    if (argc > 5) filter_width = atoi(argv[5]);
+    if (argc > 6) filter_height = atoi(argv[6]);
+    if (argc > 7) output_depth = atoi(argv[7]);
+    if (argc > 8) stride = atoi(argv[8]);
+    if (argc > 9) pad_width = atoi(argv[9]);
+    if (argc > 10) pad_height = atoi(argv[10]);
+
+    const int output_width = (W + 2 * pad_width - filter_width) / stride + 1;
+    const int output_height = (H + 2 * pad_height - filter_height) / stride + 1;
+
+    printf("Benchmarking %dx%dx%dx%d, filter %dx%dx%dx%d, stride %d\n", C, W, H, N,
+           C, filter_width, filter_height, output_depth, stride);
+
+    // These parameters lead to reasonable values for testing in most cases
+    // (the expected value of the offset tensors is ~0).
+    const int16_t input_offset = -128;
+    const int16_t filter_offset = -128;
+    const int16_t output_gradient_offset = -128;
+    const int output_multiplier = 1 << 30;
+    const int output_shift = 8;
+    const int output_offset = 128;
+    const uint8_t output_min = 0;
+    const uint8_t output_max = 255;
+
+    Halide::Runtime::Buffer<uint8_t> input_tensor(nullptr, C, W, H, N);
+    Halide::Runtime::Buffer<uint8_t> filter_tensor(nullptr, C, filter_width, filter_height, output_depth);
+    Halide::Runtime::Buffer<int32_t> bias_tensor(nullptr, output_depth);
+    Halide::Runtime::Buffer<uint8_t> output_tensor(nullptr, output_depth, output_width, output_height, N);
+    Halide::Runtime::Buffer<uint8_t> output_gradient_tensor(nullptr, output_depth, output_width, output_height, N);
+    Halide::Runtime::Buffer<uint8_t> input_gradient_tensor(nullptr, C, W, H, N);
+    Halide::Runtime::Buffer<uint8_t> filter_gradient_tensor(nullptr, C, filter_width, filter_height, output_depth);
+
+    allocate(input_tensor);
+    allocate(filter_tensor);
+    allocate(bias_tensor);
+    allocate(output_tensor);
+    allocate(output_gradient_tensor);
+    allocate(input_gradient_tensor);
+    allocate(filter_gradient_tensor);
+
+    randomize(input_tensor);
+    randomize(filter_tensor);
+    randomize(output_gradient_tensor);
+    bias_tensor.for_each_value([](int32_t &x) {
+        x = static_cast<int32_t>(rand());
+    });
+
+#ifdef HALIDE_RUNTIME_HEXAGON
+    // To avoid the cost of powering HVX on in each call of the
+    // pipeline, power it on once now. Also, set Hexagon performance to turbo.
+    halide_hexagon_set_performance_mode(nullptr, halide_hexagon_power_turbo);
+    halide_hexagon_power_hvx_on(nullptr);
+#endif
+
+    printf("Running pipelines...\n");
+    double time = Halide::Tools::benchmark([&]() {
+        int result = ImplicitGemmConvolution(input_tensor, filter_tensor, bias_tensor,
+                                             input_offset, filter_offset,
+                                             stride, pad_width, pad_height,
+                                             output_multiplier, output_shift, output_offset,
+                                             output_min, output_max, output_tensor);
+        if (result != 0) {
+            printf("pipeline failed! %d\n", result);
+        }
+    });
+    printf("Forward done, time: %g s\n", time);
+
+    time = Halide::Tools::benchmark([&]() {
+        int result = ImplicitGemmConvolutionInputGradient(output_gradient_tensor, filter_tensor,
+                                                          output_gradient_offset, filter_offset,
+                                                          stride, pad_width, pad_height,
+                                                          output_multiplier, output_shift, output_offset,
+                                                          output_min, output_max, input_gradient_tensor);
+        if (result != 0) {
+            printf("pipeline failed! %d\n", result);
+        }
+    });
+    printf("Input gradient done, time: %g s\n", time);
+
+    time = Halide::Tools::benchmark([&]() {
+        int result = ImplicitGemmConvolutionFilterGradient(input_tensor, output_gradient_tensor,
+                                                           input_offset, output_gradient_offset,
+                                                           stride, pad_width, pad_height,
+                                                           output_multiplier, output_shift, output_offset,
+                                                           output_min, output_max, filter_gradient_tensor);
+        if (result != 0) {
+            printf("pipeline failed! %d\n", result);
+        }
+    });
+    printf("Filter gradient done, time: %g s\n", time);
+
+#ifdef HALIDE_RUNTIME_HEXAGON
+    // We're done with HVX, power it off, and reset the performance mode
+    // to default to save power.
+    halide_hexagon_power_hvx_off(nullptr);
+    halide_hexagon_set_performance_mode(nullptr, halide_hexagon_power_default);
+#endif
+
+    // Copy the outputs back to the host. If the buffers are zero-copy (as
+    // they should be on a real device), this will be a no-op.
+    output_tensor.copy_to_host();
+    input_gradient_tensor.copy_to_host();
+    filter_gradient_tensor.copy_to_host();
+
+    // The offset input, or zero in the padding.
+    auto input_value = [&](int c, int x, int y, int b) {
+        if (x < 0 || x >= W || y < 0 || y >= H) {
+            return 0;
+        }
+        return static_cast<int32_t>(input_tensor(c, x, y, b)) + input_offset;
+    };
+    auto filter_value = [&](int c, int fx, int fy, int k) {
+        return static_cast<int32_t>(filter_tensor(c, fx, fy, k)) + filter_offset;
+    };
+    auto output_gradient_value = [&](int k, int x, int y, int b) {
+        return static_cast<int32_t>(output_gradient_tensor(k, x, y, b)) + output_gradient_offset;
+    };
+    auto check = [&](const char *name, int32_t result, uint8_t actual, int i0, int i1, int i2, int i3) {
+        uint8_t expected = requantize_u8_reference(result, output_multiplier, output_shift,
+                                                   output_offset, output_min, output_max);
+        if (expected != actual) {
+            printf("Mismatch in %s at %d %d %d %d: %d != %d\n", name, i0, i1, i2, i3, expected, actual);
+            abort();
+        }
+    };
+
+    // Validate that the algorithms did what we expect.
+    output_tensor.for_each_element([&](int k, int x, int y, int b) {
+        int32_t result = bias_tensor(k);
+        for (int fy = 0; fy < filter_height; fy++) {
+            for (int fx = 0; fx < filter_width; fx++) {
+                for (int c = 0; c < C; c++) {
+                    result += filter_value(c, fx, fy, k) *
+                              input_value(c, x * stride + fx - pad_width, y * stride + fy - pad_height, b);
+                }
+            }
+        }
+        check("output", result, output_tensor(k, x, y, b), k, x, y, b);
+    });
+
+    input_gradient_tensor.for_each_element([&](int c, int x, int y, int b) {
+        int32_t result = 0;
+        for (int fy = 0; fy < filter_height; fy++) {
+            for (int fx = 0; fx < filter_width; fx++) {
+                int ox = x + pad_width - fx;
+                int oy = y + pad_height - fy;
+                if (ox < 0 || oy < 0 || ox % stride != 0 || oy % stride != 0 ||
+                    ox / stride >= output_width || oy / stride >= output_height) {
+                    continue;
+                }
+                for (int k = 0; k < output_depth; k++) {
+                    result += filter_value(c, fx, fy, k) *
+                              output_gradient_value(k, ox / stride, oy / stride, b);
+                }
+            }
+        }
+        check("input gradient", result, input_gradient_tensor(c, x, y, b), c, x, y, b);
+    });
+
+    filter_gradient_tensor.for_each_element([&](int c, int fx, int fy, int k) {
+        int32_t result = 0;
+        for (int b = 0; b < N; b++) {
+            for (int y = 0; y < output_height; y++) {
+                for (int x = 0; x < output_width; x++) {
+                    result += input_value(c, x * stride + fx - pad_width, y * stride + fy - pad_height, b) *
+                              output_gradient_value(k, x, y, b);
+                }
+            }
+        }
+        check("filter gradient", result, filter_gradient_tensor(c, fx, fy, k), c, fx, fy, k);
+    });
+
+    printf("Success!\n");
+    return 0;
+}
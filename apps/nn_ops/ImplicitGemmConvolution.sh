@@ -0,0 +1,17 @@
+IMPLICITGEMMCONVOLUTION=$1
+# Columns are: C W H N filter_width filter_height output_depth stride
+# pad_width pad_height
+# The output width and output_depth must be at least 4.
+
+$IMPLICITGEMMCONVOLUTION 8 17 17 1 1 1 8 1 0 0
+$IMPLICITGEMMCONVOLUTION 8 17 17 1 3 3 8 1 1 1
+$IMPLICITGEMMCONVOLUTION 8 17 17 1 3 3 8 2 1 1
+$IMPLICITGEMMCONVOLUTION 8 17 17 1 3 3 16 1 1 1
+$IMPLICITGEMMCONVOLUTION 12 17 17 2 3 3 16 1 1 1
+$IMPLICITGEMMCONVOLUTION 32 56 56 1 3 3 32 1 1 1
+$IMPLICITGEMMCONVOLUTION 64 28 28 1 5 5 64 2 2 2
+# Depths that aren't a multiple of the vector size, output widths that
+# aren't a multiple of the tile width, and uneven padding.
+$IMPLICITGEMMCONVOLUTION 3 13 11 2 3 5 20 2 1 2
+$IMPLICITGEMMCONVOLUTION 5 9 7 1 2 2 6 3 1 0
+$IMPLICITGEMMCONVOLUTION 8 10 10 1 4 4 4 2 2 2
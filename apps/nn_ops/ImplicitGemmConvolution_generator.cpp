@@ -0,0 +1,351 @@
+// These generators implement convolution as an implicit GEMM, along with the
+// two gradients of convolution needed for training: the gradient with
+// respect to the input, and the gradient with respect to the filter.
+//
+// Im2col followed by MatrixMultiply materializes the whole im2col matrix,
+// which is filter_width * filter_height times larger than the input. Here,
+// the im2col matrix is never materialized: each tile of the output computes
+// the part of it that it needs into a small panel, which the inner loops of
+// the GEMM (the micro-kernel) stream through while holding a tile of 32-bit
+// accumulators.
+//
+// As in the other generators, tensors are 8-bit with 16-bit offsets, the
+// products are accumulated in 32 bits, and the results are requantized to
+// 8 bits with requantize_u8.
+//
+// Tensor dimensions:
+// Input: {input_depth, input_width, input_height, batches}
+// Filter: {input_depth, filter_width, filter_height, output_depth}
+// Output: {output_depth, (input_width + 2 * pad_width - filter_width) /
+// stride + 1, (input_height + 2 * pad_height - filter_height) / stride + 1,
+// batches}
+// The gradient of the output has the dimensions of the output, and the
+// gradients of the input and filter have the dimensions of the input and
+// filter respectively. The input is padded with zeros (after adding the
+// offset) in the x and y dimensions.
+
+#include "common.h"
+#include <Halide.h>
+
+using Halide::Generator;
+using Halide::RDom;
+using Halide::TailStrategy;
+using Halide::Var;
+using Halide::BoundaryConditions::constant_exterior;
+using Halide::ConciseCasts::i16;
+using Halide::ConciseCasts::i32;
+
+namespace {
+
+// The number of columns of the output (pixels for the forward pass and the
+// input gradient, output channels for the filter gradient) computed by one
+// pass of the micro-kernel. The tiles are shifted inwards at the edges, so
+// the output must be at least this wide in that dimension.
+const int kTileWidth = 4;
+
+int vector_size_u8(const Halide::Target &target) {
+    if (target.has_feature(Halide::Target::HVX_64)) {
+        return 64;
+    } else if (target.has_feature(Halide::Target::HVX_128)) {
+        return 128;
+    }
+    return target.natural_vector_size<uint8_t>();
+}
+
+// Offload the pipeline to Hexagon if the target has HVX, unless Hexagon is
+// already the host.
+void maybe_offload_to_hexagon(const Halide::Target &target, Halide::Func output) {
+    if (target.features_any_of({ Halide::Target::HVX_64, Halide::Target::HVX_128 }) &&
+        target.arch != Halide::Target::Hexagon) {
+        output.hexagon();
+    }
+}
+
+// Schedule output(m, x, y, b) = f(gemm(m, x, y, b)), where gemm is a
+// reduction over r, as tiles of all of m by kTileWidth columns of x. The
+// accumulators of a tile are computed together, with the reduction inside
+// the loop over vectors of m and the columns unrolled, so that they stay in
+// registers, and the panel feeding the tile is computed just before it.
+void schedule_gemm_by_columns(const Halide::Target &target, Halide::Func output,
+                              Halide::Func gemm, const RDom &r, Halide::Func panel,
+                              Var m, Var x, Var y) {
+    const int vector_size = vector_size_u8(target);
+    Var xo("xo"), mo("mo");
+
+    output.compute_root()
+        .split(x, xo, x, kTileWidth, TailStrategy::ShiftInwards)
+        .reorder(m, x, xo, y)
+        .vectorize(m, vector_size, TailStrategy::GuardWithIf)
+        .unroll(x)
+        .parallel(y);
+
+    gemm.compute_at(output, xo)
+        .vectorize(m, vector_size, TailStrategy::GuardWithIf)
+        .unroll(x);
+    gemm.update()
+        .split(m, mo, m, vector_size, TailStrategy::GuardWithIf)
+        .reorder(m, x, r.x, r.y, r.z, mo)
+        .vectorize(m)
+        .unroll(x);
+
+    panel.compute_at(output, xo)
+        .vectorize(panel.args()[0], vector_size / 2, TailStrategy::GuardWithIf);
+}
+
+}  // namespace
+
+class ImplicitGemmConvolution : public Generator<ImplicitGemmConvolution> {
+public:
+    // Unsigned 8-bit input tensor, indexed by input_depth, input_x, input_y,
+    // input_batch.
+    Input<Buffer<uint8_t>> input_{"input", 4};
+
+    // A 4D array of 8-bit filter coefficients indexed by filter_depth,
+    // filter_x, filter_y, output_depth.
+    Input<Buffer<uint8_t>> filter_{"filter", 4};
+
+    // A 1D array of 32-bit biases, indexed by output_depth.
+    Input<Buffer<int32_t>> bias_{"bias", 1};
+
+    // Offsets for the input and filter.
+    Input<int16_t> input_offset_{ "input_offset", 0, -255, 0 };
+    Input<int16_t> filter_offset_{ "filter_offset", 0, -255, 0 };
+
+    // The stride and padding of the input, as in Convolution.
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+
+    // Parameters for pointwise operations on the output.
+    Input<int> output_multiplier_{ "output_multiplier" };
+    Input<int> output_shift_{ "output_shift" };
+    Input<int> output_offset_{ "output_offset", 0, 0, 255 };
+    Input<uint8_t> output_min_{ "output_min" };
+    Input<uint8_t> output_max_{ "output_max" };
+
+    Output<Buffer<uint8_t>> output_{"output", 4};
+
+    void generate() {
+        // The algorithm.
+        Var c("c"), x("x"), y("y"), b("b"), k("k"), fx("fx"), fy("fy");
+
+        // Pad the input with the value that becomes zero when the offset is
+        // added.
+        Func input_bounded =
+            constant_exterior(input_, cast<uint8_t>(-input_offset_),
+                              { { Expr(), Expr() },
+                                { 0, input_.dim(1).extent() },
+                                { 0, input_.dim(2).extent() },
+                                { Expr(), Expr() } });
+
+        // The columns of the im2col matrix: the window of the input under
+        // each output pixel, with the offset added and upcast to 16-bit.
+        Func panel("panel");
+        panel(c, fx, fy, x, y, b) =
+            i16(input_bounded(c, x * stride_ + fx - pad_width_,
+                              y * stride_ + fy - pad_height_, b)) +
+            input_offset_;
+
+        // The filter with the offset added, packed with the output depth
+        // innermost so that the micro-kernel loads vectors of it.
+        Func filter_packed("filter_packed");
+        filter_packed(k, c, fx, fy) = i16(filter_(c, fx, fy, k)) + filter_offset_;
+
+        RDom r(0, input_.dim(0).extent(), 0, filter_.dim(1).extent(), 0,
+               filter_.dim(2).extent());
+        Func gemm("gemm");
+        gemm(k, x, y, b) = bias_(k);
+        gemm(k, x, y, b) += i32(filter_packed(k, r.x, r.y, r.z)) *
+                            i32(panel(r.x, r.y, r.z, x, y, b));
+
+        output_(k, x, y, b) =
+            requantize_u8(gemm(k, x, y, b), output_multiplier_, output_shift_,
+                          output_offset_, output_min_, output_max_);
+
+        // The schedule.
+        maybe_offload_to_hexagon(get_target(), output_);
+        schedule_gemm_by_columns(get_target(), output_, gemm, r, panel, k, x, y);
+        filter_packed.compute_at(output_, Var::outermost())
+            .vectorize(k, vector_size_u8(get_target()) / 2, TailStrategy::GuardWithIf);
+    }
+};
+
+class ImplicitGemmConvolutionInputGradient
+    : public Generator<ImplicitGemmConvolutionInputGradient> {
+public:
+    // Unsigned 8-bit gradient of the output, indexed by output_depth,
+    // output_x, output_y, output_batch.
+    Input<Buffer<uint8_t>> output_gradient_{"output_gradient", 4};
+
+    // The 8-bit filter coefficients of the forward pass, indexed by
+    // filter_depth, filter_x, filter_y, output_depth.
+    Input<Buffer<uint8_t>> filter_{"filter", 4};
+
+    // Offsets for the output gradient and filter.
+    Input<int16_t> output_gradient_offset_{ "output_gradient_offset", 0, -255, 0 };
+    Input<int16_t> filter_offset_{ "filter_offset", 0, -255, 0 };
+
+    // The stride and padding of the forward pass.
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+
+    // Parameters for pointwise operations on the input gradient.
+    Input<int> output_multiplier_{ "output_multiplier" };
+    Input<int> output_shift_{ "output_shift" };
+    Input<int> output_offset_{ "output_offset", 0, 0, 255 };
+    Input<uint8_t> output_min_{ "output_min" };
+    Input<uint8_t> output_max_{ "output_max" };
+
+    // The gradient of the input, indexed by input_depth, input_x, input_y,
+    // input_batch.
+    Output<Buffer<uint8_t>> input_gradient_{"input_gradient", 4};
+
+    void generate() {
+        // The algorithm.
+        Var c("c"), x("x"), y("y"), b("b"), k("k"), fx("fx"), fy("fy");
+
+        Func output_gradient_bounded =
+            constant_exterior(output_gradient_, cast<uint8_t>(-output_gradient_offset_),
+                              { { Expr(), Expr() },
+                                { 0, output_gradient_.dim(1).extent() },
+                                { 0, output_gradient_.dim(2).extent() },
+                                { Expr(), Expr() } });
+
+        // The input pixel (x, y) is read through the filter tap (fx, fy) by
+        // the output pixel (ox, oy) / stride, if it divides evenly. The
+        // panel is the transposed im2col matrix of the output gradient,
+        // with zeros where a tap doesn't land on an output pixel.
+        Expr ox = x + pad_width_ - fx;
+        Expr oy = y + pad_height_ - fy;
+        Func panel("panel");
+        panel(k, fx, fy, x, y, b) =
+            select(ox % stride_ == 0 && oy % stride_ == 0,
+                   i16(output_gradient_bounded(k, ox / stride_, oy / stride_, b)) +
+                       output_gradient_offset_,
+                   i16(0));
+
+        // For the filter, add the offset and upcast to 16-bit. The input
+        // depth is already innermost.
+        Func filter_with_offset("filter_with_offset");
+        filter_with_offset(c, k, fx, fy) = i16(filter_(c, fx, fy, k)) + filter_offset_;
+
+        RDom r(0, output_gradient_.dim(0).extent(), 0, filter_.dim(1).extent(), 0,
+               filter_.dim(2).extent());
+        Func gemm("gemm");
+        gemm(c, x, y, b) = 0;
+        gemm(c, x, y, b) += i32(filter_with_offset(c, r.x, r.y, r.z)) *
+                            i32(panel(r.x, r.y, r.z, x, y, b));
+
+        input_gradient_(c, x, y, b) =
+            requantize_u8(gemm(c, x, y, b), output_multiplier_, output_shift_,
+                          output_offset_, output_min_, output_max_);
+
+        // The schedule.
+        maybe_offload_to_hexagon(get_target(), input_gradient_);
+        schedule_gemm_by_columns(get_target(), input_gradient_, gemm, r, panel, c, x, y);
+        filter_with_offset.compute_at(input_gradient_, Var::outermost())
+            .vectorize(c, vector_size_u8(get_target()) / 2, TailStrategy::GuardWithIf);
+    }
+};
+
+class ImplicitGemmConvolutionFilterGradient
+    : public Generator<ImplicitGemmConvolutionFilterGradient> {
+public:
+    // The unsigned 8-bit input tensor of the forward pass, indexed by
+    // input_depth, input_x, input_y, input_batch.
+    Input<Buffer<uint8_t>> input_{"input", 4};
+
+    // Unsigned 8-bit gradient of the output, indexed by output_depth,
+    // output_x, output_y, output_batch.
+    Input<Buffer<uint8_t>> output_gradient_{"output_gradient", 4};
+
+    // Offsets for the input and output gradient.
+    Input<int16_t> input_offset_{ "input_offset", 0, -255, 0 };
+    Input<int16_t> output_gradient_offset_{ "output_gradient_offset", 0, -255, 0 };
+
+    // The stride and padding of the forward pass.
+    Input<int> stride_{ "stride" };
+    Input<int> pad_width_{ "pad_width" };
+    Input<int> pad_height_{ "pad_height" };
+
+    // Parameters for pointwise operations on the filter gradient.
+    Input<int> output_multiplier_{ "output_multiplier" };
+    Input<int> output_shift_{ "output_shift" };
+    Input<int> output_offset_{ "output_offset", 0, 0, 255 };
+    Input<uint8_t> output_min_{ "output_min" };
+    Input<uint8_t> output_max_{ "output_max" };
+
+    // The gradient of the filter, indexed by filter_depth, filter_x,
+    // filter_y, output_depth. Its extents give the filter dimensions.
+    Output<Buffer<uint8_t>> filter_gradient_{"filter_gradient", 4};
+
+    void generate() {
+        // The algorithm.
+        Var c("c"), x("x"), y("y"), b("b"), k("k"), fx("fx"), fy("fy");
+
+        Func input_bounded =
+            constant_exterior(input_, cast<uint8_t>(-input_offset_),
+                              { { Expr(), Expr() },
+                                { 0, input_.dim(1).extent() },
+                                { 0, input_.dim(2).extent() },
+                                { Expr(), Expr() } });
+
+        // The rows of the im2col matrix, as in the forward pass.
+        Func panel("panel");
+        panel(c, fx, fy, x, y, b) =
+            i16(input_bounded(c, x * stride_ + fx - pad_width_,
+                              y * stride_ + fy - pad_height_, b)) +
+            input_offset_;
+
+        Func output_gradient_with_offset("output_gradient_with_offset");
+        output_gradient_with_offset(k, x, y, b) =
+            i16(output_gradient_(k, x, y, b)) + output_gradient_offset_;
+
+        // The reduction is over the pixels of the output gradient.
+        RDom r(0, output_gradient_.dim(1).extent(), 0, output_gradient_.dim(2).extent(),
+               0, output_gradient_.dim(3).extent());
+        Func gemm("gemm");
+        gemm(c, fx, fy, k) = 0;
+        gemm(c, fx, fy, k) += i32(panel(c, fx, fy, r.x, r.y, r.z)) *
+                              i32(output_gradient_with_offset(k, r.x, r.y, r.z));
+
+        filter_gradient_(c, fx, fy, k) =
+            requantize_u8(gemm(c, fx, fy, k), output_multiplier_, output_shift_,
+                          output_offset_, output_min_, output_max_);
+
+        // The schedule. The filter gradient is a GEMM with a very long
+        // reduction, so it is tiled by kTileWidth output depths, and the
+        // tile of accumulators (the whole filter for those output depths)
+        // is updated in place with one row of the panel at a time.
+        maybe_offload_to_hexagon(get_target(), filter_gradient_);
+        const int vector_size = vector_size_u8(get_target());
+        Var ko("ko"), co("co");
+
+        filter_gradient_.compute_root()
+            .split(k, ko, k, kTileWidth, TailStrategy::ShiftInwards)
+            .reorder(c, k, fx, fy, ko)
+            .vectorize(c, vector_size, TailStrategy::GuardWithIf)
+            .unroll(k)
+            .parallel(ko);
+
+        gemm.compute_at(filter_gradient_, ko)
+            .vectorize(c, vector_size, TailStrategy::GuardWithIf);
+        gemm.update()
+            .split(c, co, c, vector_size, TailStrategy::GuardWithIf)
+            .reorder(c, k, co, fx, fy, r.x, r.y, r.z)
+            .vectorize(c)
+            .unroll(k);
+
+        panel.compute_at(gemm, r.y)
+            .vectorize(c, vector_size / 2, TailStrategy::GuardWithIf);
+        output_gradient_with_offset.compute_at(gemm, r.y)
+            .vectorize(k, vector_size / 2, TailStrategy::GuardWithIf);
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(ImplicitGemmConvolution, ImplicitGemmConvolution)
+HALIDE_REGISTER_GENERATOR(ImplicitGemmConvolutionInputGradient,
+                          ImplicitGemmConvolutionInputGradient)
+HALIDE_REGISTER_GENERATOR(ImplicitGemmConvolutionFilterGradient,
+                          ImplicitGemmConvolutionFilterGradient)
@@ -122,10 +122,8 @@ int main(int argc, char **argv) {
             ab_xy += a_ky * b_xk;
         }
 
-        int32_t output = multiply_quantized_multiplier_reference(ab_xy, output_multiplier, output_shift);
-        output += output_offset;
-        output = std::max(output, (int32_t) output_min);
-        output = std::min(output, (int32_t) output_max);
+        int32_t output = requantize_u8_reference(ab_xy, output_multiplier, output_shift,
+                                                 output_offset, output_min, output_max);
         if (output != mat_ab(x, y)) {
             printf("Mismatch at %d %d: %d != %d\n", x, y, output, mat_ab(x, y));
             abort();
@@ -18,7 +18,6 @@ using Halide::RVar;
 using Halide::ConciseCasts::i32;
 using Halide::ConciseCasts::u16;
 using Halide::ConciseCasts::u32;
-using Halide::ConciseCasts::u8_sat;
 
 class MatrixMultiply : public Generator<MatrixMultiply> {
 public:
@@ -136,16 +135,11 @@ public:
             i32(mat_a_offset_) * i32(column_sums_b(x)) +
             i32(mat_b_offset_) * i32(row_sums_a(y)) + offset;
 
-        // Scale the output.
-        Func scaled_plus_offset("scaled_plus_offset");
-        scaled_plus_offset(x, y) =
-            multiply_quantized_multiplier(multiplied(x, y) + bias_(x),
-                                          output_multiplier_, output_shift_) +
-            output_offset_;
-
-        // Saturate and narrow the output.
+        // Requantize, saturate and narrow the output.
         output_(x, y) =
-            clamp(u8_sat(scaled_plus_offset(x, y)), output_min_, output_max_);
+            requantize_u8(multiplied(x, y) + bias_(x),
+                          output_multiplier_, output_shift_, output_offset_,
+                          output_min_, output_max_);
 
         // Specifying .hexagon() on a Func will generate an RPC to run this stage
         // on Hexagon. If Hexagon is the host (that is, the architecture is
@@ -24,3 +24,12 @@ Expr rounding_shift_right(Expr x, Expr shift) {
 Expr multiply_quantized_multiplier(Expr x, Expr q, Expr shift) {
     return rounding_shift_right(saturating_rounding_doubling_high_multiply(x, q), shift);
 }
+
+Expr saturating_narrow_u8(Expr x) {
+    return ConciseCasts::u8_sat(ConciseCasts::i16_sat(x));
+}
+
+Expr requantize_u8(Expr x, Expr q, Expr shift, Expr offset, Expr output_min, Expr output_max) {
+    Expr scaled = multiply_quantized_multiplier(x, q, shift) + offset;
+    return clamp(saturating_narrow_u8(scaled), output_min, output_max);
+}
@@ -16,4 +16,23 @@ Halide::Expr rounding_shift_right(Halide::Expr x, Halide::Expr shift);
 // Performs right shift and multiply by a multiplier.
 Halide::Expr multiply_quantized_multiplier(
     Halide::Expr x, Halide::Expr quantized_multiplier, Halide::Expr shift);
+
+// Saturates and narrows a 32-bit value to 8 bits unsigned, through 16 bits
+// signed, so that each step is a single saturating narrowing instruction on
+// ARM (vqmovn, vqmovun) and Hexagon (vsat, vpackhub.sat).
+Halide::Expr saturating_narrow_u8(Halide::Expr x);
+
+// Requantizes a 32-bit accumulator to the 8-bit output of a layer, and
+// applies its activation: the accumulator is multiplied by the quantized
+// multiplier and shift, offset, saturated and narrowed to 8 bits, and clamped
+// to [output_min, output_max] (e.g. the range of a ReLU6).
+//
+// This is a single expression, so that it is computed in the inner loop of
+// whichever Func consumes it (the output of a layer, or the input stage of the
+// next layer in the same pipeline) instead of being realized to memory. The
+// multiplier and shift may vary with the output channel, e.g. be loads from
+// per-channel buffers indexed by depth.
+Halide::Expr requantize_u8(Halide::Expr x, Halide::Expr quantized_multiplier,
+                           Halide::Expr shift, Halide::Expr output_offset,
+                           Halide::Expr output_min, Halide::Expr output_max);
 #endif
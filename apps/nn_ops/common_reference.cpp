@@ -25,3 +25,11 @@ int32_t rounding_shift_right_reference(int32_t x, int32_t shift) {
 int32_t multiply_quantized_multiplier_reference(int32_t x, int32_t q, int32_t shift) {
     return rounding_shift_right_reference(saturating_rounding_doubling_high_multiply_reference(x, q), shift);
 }
+
+uint8_t requantize_u8_reference(int32_t x, int32_t q, int32_t shift, int32_t offset,
+                                uint8_t output_min, uint8_t output_max) {
+    int32_t output = multiply_quantized_multiplier_reference(x, q, shift) + offset;
+    output = std::max(output, (int32_t) output_min);
+    output = std::min(output, (int32_t) output_max);
+    return (uint8_t) output;
+}
@@ -16,4 +16,9 @@ int32_t rounding_shift_right_reference(int32_t x, int32_t shift);
 // Performs right shift and multiply by a multiplier.
 int32_t multiply_quantized_multiplier_reference(int32_t x, int32_t q, int32_t shift);
 
+// Requantizes a 32-bit accumulator to an 8-bit output in [output_min,
+// output_max].
+uint8_t requantize_u8_reference(int32_t x, int32_t q, int32_t shift, int32_t offset,
+                                uint8_t output_min, uint8_t output_max);
+
 #endif
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <limits>
 
@@ -29,11 +31,20 @@
 #include "resize_cubic_uint16_down.h"
 #include "resize_linear_uint16_down.h"
 #include "resize_lanczos_uint16_down.h"
+#include "resize_box_uint8_up_polyphase.h"
+#include "resize_cubic_uint8_up_polyphase.h"
+#include "resize_linear_uint8_up_polyphase.h"
+#include "resize_lanczos_uint8_up_polyphase.h"
+#include "resize_box_uint8_down_polyphase.h"
+#include "resize_cubic_uint8_down_polyphase.h"
+#include "resize_linear_uint8_down_polyphase.h"
+#include "resize_lanczos_uint8_down_polyphase.h"
 
 std::string infile, outfile, input_type, interpolation_type;
 float scale_factor = 1.0f;
 int benchmark_iters = 10;
 bool packed = true;
+bool polyphase = false;
 
 void show_usage_and_exit() {
     fprintf(stderr,
@@ -41,7 +52,8 @@ void show_usage_and_exit() {
             "\t./resample [-f scalefactor] "
             "[-b benchmark_iterations] "
             "[-i box|linear|cubic|lanczos] "
-            "[-t float32|uint8|uint16] in.png out.png\n");
+            "[-t float32|uint8|uint16] "
+            "[-y 0|1 (polyphase, uint8 only)] in.png out.png\n");
     exit(1);
 }
 
@@ -58,6 +70,8 @@ for (int i = 1; i < argc; i++) {
             benchmark_iters = atoi(argv[++i]);
         } else if (arg == "-p" && i+1 < argc) {
             packed = atoi(argv[++i]) != 0;
+        } else if (arg == "-y" && i+1 < argc) {
+            polyphase = atoi(argv[++i]) != 0;
         } else if (infile.empty()) {
             infile = arg;
         } else if (outfile.empty()) {
@@ -108,6 +122,20 @@ int main(int argc, char **argv) {
           &resize_lanczos_uint16_down}}
     };
 
+    // The polyphase variants are built with 4 phases, so they resize by
+    // 4 / n for an integer n.
+    decltype(&resize_box_float32_up) polyphase_variants[2][4] =
+    {
+        {&resize_box_uint8_up_polyphase,
+         &resize_cubic_uint8_up_polyphase,
+         &resize_linear_uint8_up_polyphase,
+         &resize_lanczos_uint8_up_polyphase},
+        {&resize_box_uint8_down_polyphase,
+         &resize_cubic_uint8_down_polyphase,
+         &resize_linear_uint8_down_polyphase,
+         &resize_lanczos_uint8_down_polyphase}
+    };
+
     int interpolation_idx = 0;
     if (interpolation_type == "box") {
         interpolation_idx = 0;
@@ -142,9 +170,16 @@ int main(int argc, char **argv) {
         show_usage_and_exit();
     }
 
+    if (polyphase && type_idx != 1) {
+        fprintf(stderr, "Polyphase resizing is only built for uint8\n");
+        show_usage_and_exit();
+    }
+
     Halide::Runtime::Buffer<> out(in.type(), out_width, out_height, 3);
 
-    auto resize_fn = variants[type_idx][upsample_idx][interpolation_idx];
+    auto resize_fn = polyphase ?
+        polyphase_variants[upsample_idx][interpolation_idx] :
+        variants[type_idx][upsample_idx][interpolation_idx];
 
     double time = Halide::Tools::benchmark(benchmark_iters, benchmark_iters, [&]() { resize_fn(in, scale_factor, out); });
     printf("planar  %8s  %8s  %1.2f  time: %f ms\n",
@@ -152,6 +187,24 @@ int main(int argc, char **argv) {
 
     Halide::Tools::convert_and_save_image(out, outfile);
 
+    // At a scale factor of 4 / n, the polyphase resize computes the same
+    // weights as the arbitrary-scale one, up to rounding.
+    if (polyphase && scale_factor == 4.0f / std::max(1.0f, std::round(4.0f / scale_factor))) {
+        Halide::Runtime::Buffer<uint8_t> expected(out_width, out_height, 3);
+        variants[type_idx][upsample_idx][interpolation_idx](in, scale_factor, expected);
+        Halide::Runtime::Buffer<uint8_t> actual = out;
+        int mismatches = 0;
+        expected.for_each_element([&](int x, int y, int c) {
+            if (std::abs(actual(x, y, c) - expected(x, y, c)) > 1 && mismatches++ < 10) {
+                fprintf(stderr, "Polyphase out(%d, %d, %d) = %d instead of %d\n",
+                        x, y, c, actual(x, y, c), expected(x, y, c));
+            }
+        });
+        if (mismatches) {
+            return 1;
+        }
+    }
+
     if (packed) {
         // Also benchmark a packed memory layout. Don't bother to copy the
         // actual data over, because we won't save the result. We just
@@ -66,6 +66,14 @@ public:
     // resample in x and in y).
     GeneratorParam<bool> upsample{"upsample", false};
 
+    // If positive, resize in polyphase mode: the output is made of
+    // periods of this many pixels, which each start at a whole pixel of
+    // the input, so the kernel weights are a small table with one row
+    // per phase, computed once at the start of the pipeline. The scale
+    // factor is rounded to phases / n, for the nearest integer n, the
+    // number of input pixels per period.
+    GeneratorParam<int> phases{"phases", 0};
+
     Input<Buffer<>> input{"input", 3};
     Input<float> scale_factor{"scale_factor"};
     Output<Buffer<>> output{"output", 3};
@@ -79,7 +87,16 @@ public:
         kernel_x, kernel_y,
         kernel_sum_x, kernel_sum_y;
 
+    // The polyphase resize in x, indexed by the phase and the period of
+    // the output x.
+    Var p, n;
+    Func resized_x_phases;
+
     void generate() {
+        if (phases > 0) {
+            generate_polyphase();
+            return;
+        }
 
         clamped = BoundaryConditions::repeat_edge(input,
                  {{input.dim(0).min(), input.dim(0).extent()},
@@ -140,7 +157,117 @@ public:
         }
     }
 
+    // The polyphase resize. The output x and y are n * phases + p, for
+    // the phase p, and read the input from n * input_period onwards,
+    // with the weights of the phase.
+    void generate_polyphase() {
+        clamped = BoundaryConditions::repeat_edge(input,
+                 {{input.dim(0).min(), input.dim(0).extent()},
+                  {input.dim(1).min(), input.dim(1).extent()}});
+        as_float(x, y, c) = cast<float>(clamped(x, y, c));
+
+        const int P = phases;
+        Expr input_period = max(1, cast<int>(round(P / scale_factor)));
+        Expr scale = cast<float>(P) / input_period;
+
+        Expr kernel_scaling = upsample ? Expr(1.0f) : scale;
+        Expr kernel_radius = 0.5f * kernel_info[interpolation_type].taps / kernel_scaling;
+        Expr kernel_taps = ceil(kernel_info[interpolation_type].taps / kernel_scaling);
+
+        // The source coordinate and the first tap of each phase, relative
+        // to the start of the period in the input.
+        Expr source = (p + 0.5f) / scale - 0.5f;
+        Expr begin = cast<int>(ceil(source - kernel_radius));
+
+        RDom r(0, kernel_taps);
+        const KernelInfo &info = kernel_info[interpolation_type];
+
+        // The scale is the same in x and y, so both use the same table.
+        unnormalized_kernel_x(p, k) = info.kernel((k + begin - source) * kernel_scaling);
+        kernel_sum_x(p) = sum(unnormalized_kernel_x(p, r), "kernel_sum_x");
+        kernel_x(p, k) = unnormalized_kernel_x(p, k) / kernel_sum_x(p);
+
+        Func begin_x("begin_x");
+        begin_x(p) = begin;
+
+        // The resize in y steps through the table by rows. The resize in
+        // x is computed by phase, so each phase has scalar weights and
+        // reads the input with a constant stride of input_period.
+        Expr phase_y = y % P, period_y = y / P;
+        Func resized;
+        if (upsample) {
+            resized_x_phases(p, n, y, c) =
+                sum(kernel_x(p, r) * as_float(n * input_period + begin_x(p) + r, y, c),
+                    "resized_x_phases");
+            resized_x(x, y, c) = resized_x_phases(x % P, x / P, y, c);
+            resized_y(x, y, c) =
+                sum(kernel_x(phase_y, r) *
+                    resized_x(x, period_y * input_period + begin_x(phase_y) + r, c),
+                    "resized_y");
+            resized = resized_y;
+        } else {
+            resized_y(x, y, c) =
+                sum(kernel_x(phase_y, r) *
+                    as_float(x, period_y * input_period + begin_x(phase_y) + r, c),
+                    "resized_y");
+            resized_x_phases(p, n, y, c) =
+                sum(kernel_x(p, r) * resized_y(n * input_period + begin_x(p) + r, y, c),
+                    "resized_x_phases");
+            resized_x(x, y, c) = resized_x_phases(x % P, x / P, y, c);
+            resized = resized_x;
+        }
+
+        if (input.type().is_float()) {
+            output(x, y, c) = clamp(resized(x, y, c), 0.0f, 1.0f);
+        } else {
+            output(x, y, c) = saturating_cast(input.type(), resized(x, y, c));
+        }
+    }
+
+    void schedule_polyphase() {
+        Var xi, yi;
+        // One table for the whole pipeline.
+        kernel_x.compute_root();
+
+        // Tiles of whole periods, with eight periods per tile in x so
+        // that the resize in x vectorizes over the periods. Storing the
+        // phases innermost makes the output's reads of it dense.
+        const int P = phases;
+        const int tile_width = 8 * P;
+        resized_x_phases
+            .bound(p, 0, P)
+            .unroll(p)
+            .vectorize(n, 8);
+        if (upsample) {
+            output
+                .tile(x, y, xi, yi, tile_width, 64)
+                .parallel(y)
+                .vectorize(xi, 8);
+            resized_x_phases
+                .compute_at(output, x);
+            as_float
+                .compute_at(output, y)
+                .vectorize(x, 8);
+        } else {
+            output
+                .tile(x, y, xi, yi, tile_width, 8)
+                .parallel(y)
+                .vectorize(xi, 8);
+            resized_y
+                .compute_at(output, y)
+                .vectorize(x, 8);
+            resized_x_phases
+                .compute_at(output, x);
+        }
+    }
+
     void schedule() {
+        if (phases > 0) {
+            schedule_polyphase();
+            schedule_layouts();
+            return;
+        }
+
         Var xi, yi;
         unnormalized_kernel_x
             .compute_at(kernel_x, x)
@@ -186,6 +313,12 @@ public:
                 .compute_at(output, xi);
         }
 
+        schedule_layouts();
+    }
+
+    void schedule_layouts() {
+        Var xi, yi;
+
         // Allow the input and output to have arbitrary memory layout,
         // and add some specializations for a few common cases. If
         // your case is not covered (e.g. planar input, packed rgb
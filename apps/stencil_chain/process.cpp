@@ -2,6 +2,7 @@
 #include <chrono>
 
 #include "stencil_chain.h"
+#include "stencil_chain_blocked.h"
 #ifndef NO_AUTO_SCHEDULE
 #include "stencil_chain_auto_schedule.h"
 #endif
@@ -28,20 +29,51 @@ int main(int argc, char **argv) {
     Buffer<uint16_t> output(input.width(), input.height());
     int timing = atoi(argv[2]);
 
-    stencil_chain(input, output);
+    stencil_chain(input, 512, 512, output);
 
     // Timing code
 
     // Manually-tuned version
     double best_manual = benchmark(timing, 1, [&]() {
-        stencil_chain(input, output);
+        stencil_chain(input, 512, 512, output);
     });
     printf("Manually-tuned time: %gms\n", best_manual * 1e3);
 
+    // Temporally-blocked version. Search for the tile size first, with
+    // a few runs of each.
+    int best_width = 0, best_height = 0;
+    double best_tile_time = 0;
+    for (int w = 64; w <= 1024; w *= 2) {
+        for (int h = 32; h <= 512; h *= 2) {
+            double t = benchmark(3, 1, [&]() {
+                stencil_chain_blocked(input, w, h, output);
+            });
+            if (best_width == 0 || t < best_tile_time) {
+                best_width = w;
+                best_height = h;
+                best_tile_time = t;
+            }
+        }
+    }
+    Buffer<uint16_t> blocked_output(input.width(), input.height());
+    double best_blocked = benchmark(timing, 1, [&]() {
+        stencil_chain_blocked(input, best_width, best_height, blocked_output);
+    });
+    printf("Temporally-blocked time (%dx%d tiles): %gms\n", best_width, best_height, best_blocked * 1e3);
+
+    // Both schedules compute the same integer pipeline.
+    blocked_output.for_each_element([&](int x, int y) {
+        if (blocked_output(x, y) != output(x, y)) {
+            printf("Temporally-blocked output(%d, %d) = %d instead of %d\n",
+                   x, y, blocked_output(x, y), output(x, y));
+            exit(-1);
+        }
+    });
+
     #ifndef NO_AUTO_SCHEDULE
     // Auto-scheduled version
     double best_auto = benchmark(timing, 1, [&]() {
-        stencil_chain_auto_schedule(input, output);
+        stencil_chain_auto_schedule(input, 512, 512, output);
     });
     printf("Auto-scheduled time: %gms\n", best_auto * 1e3);
     #endif
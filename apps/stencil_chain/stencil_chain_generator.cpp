@@ -5,8 +5,14 @@ namespace {
 class StencilChain : public Halide::Generator<StencilChain> {
 public:
     GeneratorParam<int>     stencils{"stencils", 32, 1, 100};
+    // The number of consecutive stencils computed together in each tile
+    // of the manual schedule. Zero puts all of them in one block.
+    GeneratorParam<int>     stencils_per_block{"stencils_per_block", 0, 0, 100};
 
     Input<Buffer<uint16_t>> input{"input", 2};
+    // The tile size of the manual schedule.
+    Input<int>              tile_width{"tile_width", 512, 16, 4096};
+    Input<int>              tile_height{"tile_height", 512, 16, 4096};
     Output<Buffer<uint16_t>> output{"output", 2};
 
     void generate() {
@@ -39,21 +45,41 @@ public:
             // Provide estimates on the input image
             input.dim(0).set_bounds_estimate(0, width);
             input.dim(1).set_bounds_estimate(0, height);
+            // Provide estimates on the parameters
+            tile_width.set_estimate(512);
+            tile_height.set_estimate(512);
             // Provide estimates on the pipeline output
             output.estimate(x, 0, width)
                 .estimate(y, 0, height);
         } else {
-            // CPU schedule. No fusion.
+            // CPU schedule. Temporal blocking: the stencils are split
+            // into blocks, and each block is computed in tiles of its
+            // last stencil, so the image goes through memory once per
+            // block instead of once per stencil. Within a tile, the
+            // other stencils of the block slide down the tile by
+            // rows. Each stencil needs a larger region of the one
+            // before it, so the regions computed per tile form a
+            // trapezoid in time, and the overlap between them is
+            // recomputed. Larger blocks make fewer passes over memory
+            // but recompute more, which the tile size trades off.
+            const int n = stencils;
+            const int per_block = stencils_per_block == 0 ? n : std::min((int)stencils_per_block, n);
             Var yi, yo, xo, xi, t;
-            for (size_t i = 1; i < stages.size() - 1; i++) {
-                Func s = stages[i];
-                s.store_at(output, t).compute_at(output, yi).vectorize(s.args()[0], 16);
+            for (int first = 1; first <= n; first += per_block) {
+                const int last = std::min(first + per_block - 1, n);
+                // The last stencil of the final block is computed in
+                // the tiles of the output.
+                Func block = last == n ? output : stages[last];
+                const int inner = last == n ? last : last - 1;
+                for (int i = first; i <= inner; i++) {
+                    stages[i].store_at(block, t).compute_at(block, yi).vectorize(x, 16);
+                }
+                block.compute_root()
+                    .tile(x, y, xo, yo, xi, yi, tile_width, tile_height)
+                    .fuse(xo, yo, t)
+                    .parallel(t)
+                    .vectorize(xi, 16);
             }
-            output.compute_root()
-                .tile(x, y, xo, yo, xi, yi, 512, 512)
-                .fuse(xo, yo, t)
-                .parallel(t)
-                .vectorize(xi, 16);
         }
     }
 };
@@ -0,0 +1,37 @@
+#include "Halide.h"
+
+#include "lifting.h"
+
+namespace {
+
+Halide::Var x("x"), y("y");
+
+class inverse_lifting_wavelet : public Halide::Generator<inverse_lifting_wavelet> {
+public:
+    GeneratorParam<Wavelet> wavelet{"wavelet", Wavelet::CDF53,
+                                    {{"haar", Wavelet::Haar},
+                                     {"cdf53", Wavelet::CDF53}}};
+    GeneratorParam<int> levels{"levels", 3};
+
+    Input<Buffer<float>> in_{"in" , 2};
+    Output<Buffer<float>> out_{"out" , 2};
+
+    void generate() {
+        in_.dim(0).set_min(0);
+        in_.dim(1).set_min(0);
+        Expr width = in_.dim(0).extent();
+        Expr height = in_.dim(1).extent();
+        out_.dim(0).set_bounds(0, width);
+        out_.dim(1).set_bounds(0, height);
+
+        out_(x, y) = in_(x, y);
+        out_.vectorize(x, natural_vector_size<float>()).parallel(y);
+        for (int level = levels - 1; level >= 0; level--) {
+            lifting::inverse(out_, get_target(), wavelet, level, width, height);
+        }
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(inverse_lifting_wavelet, inverse_lifting_wavelet)
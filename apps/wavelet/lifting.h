@@ -0,0 +1,151 @@
+#ifndef LIFTING_H_
+#define LIFTING_H_
+
+#include "Halide.h"
+
+// Wavelet transforms by lifting, done in place on a single Func.
+//
+// Level l of the transform works on the samples at multiples of 2^l in
+// both x and y, which hold the low-pass band of the previous level,
+// and leaves the other samples alone. Along each axis, the samples at
+// odd multiples of 2^l become that level's high-pass band, and the
+// samples at even multiples its low-pass band. Each lifting step is an
+// update definition that adds a weighted sum of the two neighbors, of
+// the other parity, to every sample of one parity, so a transform of
+// any depth needs no storage beyond the Func itself. The neighbors
+// past the edge of the image are mirrored.
+
+enum class Wavelet { Haar, CDF53 };
+
+namespace lifting {
+
+using Halide::Expr;
+using Halide::Func;
+using Halide::RDom;
+using Halide::Target;
+
+struct Step {
+    // Whether the step updates the odd (high-pass) samples.
+    bool odd;
+    // The weights of the neighbors before and after each sample.
+    float before, after;
+};
+
+// The forward lifting steps of each wavelet. The inverse applies the
+// steps in reverse order, with the weights negated.
+inline std::vector<Step> steps(Wavelet w) {
+    switch (w) {
+    case Wavelet::Haar:
+        return {{true, -1.0f, 0.0f}, {false, 0.0f, 0.5f}};
+    case Wavelet::CDF53:
+    default:
+        return {{true, -0.5f, -0.5f}, {false, 0.25f, 0.25f}};
+    }
+}
+
+inline int natural_vector_size(const Target &t) {
+    return t.natural_vector_size<float>();
+}
+
+// Apply one lifting step to the samples at multiples of the given
+// stride of f, along x if along_x is true and along y otherwise. width
+// and height are the extents of f. If they aren't multiples of twice
+// the stride, the samples left over at the end aren't transformed.
+inline void lift(Func f, const Target &t, bool along_x, int stride,
+                 Expr width, Expr height, const Step &s) {
+    using namespace Halide;
+
+    const int vector_size = natural_vector_size(t);
+    Expr pairs = (along_x ? width : height) / (2 * stride);
+    Expr lines = (along_x ? height : width) / stride;
+
+    // The coordinate along the axis of the i'th sample of the step's
+    // parity, and of the line l across it.
+    auto at = [&](Expr i, Expr l, int offset) -> std::vector<Expr> {
+        Expr a = 2 * stride * i + (s.odd ? stride : 0) + offset;
+        Expr b = stride * l;
+        if (along_x) {
+            return {a, b};
+        } else {
+            return {b, a};
+        }
+    };
+
+    // The samples with both neighbors in the image. The odd samples
+    // lose their neighbor after at the end, the even samples their
+    // neighbor before at the start.
+    Expr interior_min = s.odd ? 0 : 1;
+    Expr interior_extent = pairs - 1;
+    bool has_edge = (s.odd ? s.after : s.before) != 0.0f;
+    if (!has_edge) {
+        interior_min = 0;
+        interior_extent = pairs;
+    }
+
+    RDom r = along_x ?
+        RDom(interior_min, interior_extent, 0, lines) :
+        RDom(0, lines, interior_min, interior_extent);
+    RVar i = along_x ? r.x : r.y;
+    RVar l = along_x ? r.y : r.x;
+
+    Expr value = f(at(i, l, 0));
+    if (s.before != 0.0f) {
+        value += s.before * f(at(i, l, -stride));
+    }
+    if (s.after != 0.0f) {
+        value += s.after * f(at(i, l, stride));
+    }
+    f(at(i, l, 0)) = value;
+
+    // The samples of one parity only read the other parity, so the
+    // samples of a step are independent, but Halide can't prove it
+    // through the strided indexing.
+    Stage interior = f.update(f.num_update_definitions() - 1);
+    interior.allow_race_conditions();
+    if (along_x) {
+        interior.vectorize(i, vector_size).parallel(l);
+    } else {
+        interior.vectorize(l, vector_size).parallel(i);
+    }
+
+    if (!has_edge) {
+        return;
+    }
+
+    // The sample at the edge, with its missing neighbor mirrored onto
+    // the one it has.
+    RDom e(0, lines);
+    Expr edge = s.odd ? pairs - 1 : 0;
+    int neighbor = s.odd ? -stride : stride;
+    f(at(edge, e, 0)) = f(at(edge, e, 0)) + (s.before + s.after) * f(at(edge, e, neighbor));
+    if (!along_x) {
+        f.update(f.num_update_definitions() - 1).vectorize(e, vector_size);
+    }
+}
+
+// Apply the given level of the forward transform to f.
+inline void forward(Func f, const Target &t, Wavelet w, int level,
+                    Expr width, Expr height) {
+    const int stride = 1 << level;
+    for (bool along_x : {true, false}) {
+        for (const Step &s : steps(w)) {
+            lift(f, t, along_x, stride, width, height, s);
+        }
+    }
+}
+
+// Undo the given level of the forward transform of f.
+inline void inverse(Func f, const Target &t, Wavelet w, int level,
+                    Expr width, Expr height) {
+    const int stride = 1 << level;
+    std::vector<Step> forward_steps = steps(w);
+    for (bool along_x : {false, true}) {
+        for (auto s = forward_steps.rbegin(); s != forward_steps.rend(); ++s) {
+            lift(f, t, along_x, stride, width, height, {s->odd, -s->before, -s->after});
+        }
+    }
+}
+
+}  // namespace lifting
+
+#endif  // LIFTING_H_
@@ -1,9 +1,15 @@
 #include <stdio.h>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include "haar_x.h"
 #include "inverse_haar_x.h"
 #include "daubechies_x.h"
 #include "inverse_daubechies_x.h"
+#include "lifting_wavelet.h"
+#include "inverse_lifting_wavelet.h"
 
 #include "HalideBuffer.h"
 #include "halide_image_io.h"
@@ -49,6 +55,75 @@ void save_transformed(Buffer<T> t, const std::string& filename) {
     printf("Saved %s\n", filename.c_str());
 }
 
+// The number of levels the lifting wavelet generators are built with.
+const int lifting_levels = 3;
+
+int trailing_zeros(int x, int max) {
+    int n = 0;
+    while (n < max && (x & (1 << n)) == 0) {
+        n++;
+    }
+    return n;
+}
+
+// Save an in-place transform with its bands gathered into the usual
+// layout, with the low-pass band at the top left.
+template<typename T>
+void save_lifted(Buffer<T> t, const std::string& filename) {
+    const int w = t.width(), h = t.height();
+    Buffer<T> rearranged(w, h, 1);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int level = std::min(trailing_zeros(x, lifting_levels),
+                                 trailing_zeros(y, lifting_levels));
+            if (level == lifting_levels) {
+                rearranged(x >> level, y >> level, 0) = clamp(t(x, y), 0.0f, 1.0f);
+            } else {
+                int rx = (x >> (level + 1)) + (((x >> level) & 1) ? w >> (level + 1) : 0);
+                int ry = (y >> (level + 1)) + (((y >> level) & 1) ? h >> (level + 1) : 0);
+                rearranged(rx, ry, 0) = clamp(t(x, y)*4.f + 0.5f, 0.0f, 1.0f);
+            }
+        }
+    }
+    convert_and_save_image(rearranged, filename);
+    printf("Saved %s\n", filename.c_str());
+}
+
+// The lifting wavelet generators are built for CDF 5/3. This is the
+// same transform by convolution with its analysis filters, with the
+// samples mirrored at the edges, each level in place on the samples at
+// multiples of 2^level.
+Buffer<float> cdf53_reference(Buffer<float> in, int levels) {
+    Buffer<float> t(in.width(), in.height());
+    t.for_each_element([&](int x, int y) { t(x, y) = in(x, y); });
+    for (int level = 0; level < levels; level++) {
+        const int stride = 1 << level;
+        for (bool along_x : {true, false}) {
+            const int n = (along_x ? t.width() : t.height()) / stride;
+            const int lines = (along_x ? t.height() : t.width()) / stride;
+            std::vector<float> line(n);
+            for (int l = 0; l < lines; l++) {
+                auto sample = [&](int i) -> float & {
+                    return along_x ? t(i * stride, l * stride) : t(l * stride, i * stride);
+                };
+                for (int i = 0; i < n; i++) {
+                    line[i] = sample(i);
+                }
+                auto at = [&](int i) {
+                    i = std::abs(i);
+                    return line[i < n ? i : 2 * (n - 1) - i];
+                };
+                for (int i = 0; i < n; i++) {
+                    sample(i) = (i % 2) ?
+                        at(i) - 0.5f * (at(i - 1) + at(i + 1)) :
+                        0.75f * at(i) + 0.25f * (at(i - 1) + at(i + 1)) - 0.125f * (at(i - 2) + at(i + 2));
+                }
+            }
+        }
+    }
+    return t;
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
@@ -73,6 +148,37 @@ int main(int argc, char **argv) {
     _assert(inverse_daubechies_x(transformed, inverse_transformed) == 0, "inverse_daubechies_x failed");
     save_untransformed(inverse_transformed, dirname + "/inverse_daubechies_x.png");
 
+    // The lifting wavelets work on the whole image, in place of the
+    // input, so crop it to a multiple of the size of the coarsest level.
+    const int block = 1 << lifting_levels;
+    Buffer<float> cropped = input.cropped(0, 0, input.width() / block * block)
+                                 .cropped(1, 0, input.height() / block * block);
+    Buffer<float> lifted(cropped.width(), cropped.height());
+    Buffer<float> inverse_lifted(cropped.width(), cropped.height());
+
+    _assert(lifting_wavelet(cropped, lifted) == 0, "lifting_wavelet failed");
+    save_lifted(lifted, dirname + "/lifting_wavelet.png");
+
+    Buffer<float> expected_lifted = cdf53_reference(cropped, lifting_levels);
+    for (int y = 0; y < cropped.height(); y++) {
+        for (int x = 0; x < cropped.width(); x++) {
+            float error = std::abs(lifted(x, y) - expected_lifted(x, y));
+            _assert(error < 1e-4f, "lifting_wavelet(%d, %d) = %f instead of %f\n",
+                    x, y, lifted(x, y), expected_lifted(x, y));
+        }
+    }
+
+    _assert(inverse_lifting_wavelet(lifted, inverse_lifted) == 0, "inverse_lifting_wavelet failed");
+    save_untransformed(inverse_lifted, dirname + "/inverse_lifting_wavelet.png");
+
+    for (int y = 0; y < cropped.height(); y++) {
+        for (int x = 0; x < cropped.width(); x++) {
+            float error = std::abs(inverse_lifted(x, y) - cropped(x, y));
+            _assert(error < 1e-4f, "inverse_lifting_wavelet(%d, %d) = %f instead of %f\n",
+                    x, y, inverse_lifted(x, y), cropped(x, y));
+        }
+    }
+
     printf("Done.\n");
     return 0;
 }
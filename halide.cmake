@@ -429,7 +429,7 @@ function(_halide_runtime_target_name HALIDE_TARGET OUTVAR)
   _halide_split_target("${HALIDE_TARGET}" BASE FEATURES)
   # Discard target features which do not affect the contents of the runtime.
   list(REMOVE_DUPLICATES FEATURES)
-  list(REMOVE_ITEM FEATURES "user_context" "no_asserts" "no_bounds_query" "no_runtime" "profile")
+  list(REMOVE_ITEM FEATURES "user_context" "no_asserts" "no_bounds_query" "no_runtime" "minimal_runtime" "plan_memory" "plan_layouts" "profile" "profile_metrics" "async_entry")
   list(SORT FEATURES)
   # Now build up the name
   set(RESULT "halide_rt")
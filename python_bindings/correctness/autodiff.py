@@ -0,0 +1,71 @@
+import halide as hl
+
+def test_propagate_adjoints():
+    x = hl.Var("x")
+    r = hl.RDom([(0, 8)])
+
+    # loss = sum((2 * input(x) + 1)^2)
+    input = hl.Buffer(hl.Float(32), [8], "input")
+    for i in range(8):
+        input[i] = float(i)
+
+    f = hl.Func("f")
+    f[x] = 2 * input[x] + 1
+    loss = hl.Func("loss")
+    loss[()] = 0.0
+    loss[()] += f[r.x] * f[r.x]
+
+    d = hl.propagate_adjoints(loss)
+    d_input = d[input]
+
+    # Schedule and realize the loss and its gradient together, so that f
+    # is computed once for both.
+    outputs = [loss, d_input]
+    hl.simple_autoschedule(outputs, {}, [[], [(0, 7)]])
+    p = hl.Pipeline(outputs)
+    loss_buf = hl.Buffer(hl.Float(32), [])
+    d_input_buf = hl.Buffer(hl.Float(32), [8])
+    p.realize([loss_buf, d_input_buf])
+
+    assert loss_buf[()] == sum((2 * i + 1) ** 2 for i in range(8))
+    for i in range(8):
+        # d loss / d input(i) = 2 * f(i) * 2
+        assert d_input_buf[i] == 4 * (2 * i + 1)
+
+def test_options():
+    x = hl.Var("x")
+    input = hl.Buffer(hl.Float(32), [8], "input2")
+    for i in range(8):
+        input[i] = float(i)
+
+    f = hl.Func("f2")
+    f[x] = input[x] * input[x]
+    out = hl.Func("out2")
+    out[x] = f[x] + 1
+
+    options = hl.PropagateAdjointsOptions()
+    options.checkpoint_policy = hl.CheckpointPolicy.RecomputeMarked
+    options.recompute = {"f2"}
+    adjoint = hl.Func("adjoint2")
+    adjoint[x] = 1.0
+    d = hl.propagate_adjoints(out, adjoint, [(0, 7)], options)
+    assert "f2" in d.recomputed
+
+    schedule_options = hl.SimpleAutoscheduleOptions()
+    schedule_options.cpu_vectorize_width = 4
+    d_input = d[input]
+    hl.simple_autoschedule(d_input, {}, [(0, 7)], schedule_options)
+    result = d_input.realize(8)
+    for i in range(8):
+        assert result[i] == 2 * i
+
+    try:
+        d[hl.Func("not_differentiated")]
+    except KeyError:
+        pass
+    else:
+        assert False, "Expected a KeyError"
+
+if __name__ == "__main__":
+    test_propagate_adjoints()
+    test_options()
@@ -118,10 +118,53 @@ def test_bufferinfo_sharing():
     b0[56, 34] = 12
     assert b0[56, 34] == 12
 
+def test_dlpack():
+    b0 = hl.Buffer(hl.Int(32), [4, 5])
+    b0.fill(0)
+    assert b0.__dlpack_device__() == (1, 0)
+    assert not hasattr(b0, '__cuda_array_interface__')
+
+    # The imported Buffer shares the data of the exported one.
+    capsule = b0.to_dlpack()
+    b1 = hl.Buffer(capsule)
+    assert b1.type() == hl.Int(32)
+    assert b1.dim(0).extent() == 4
+    assert b1.dim(1).extent() == 5
+    assert b1.dim(1).stride() == b0.dim(1).stride()
+    b1[1, 2] = 7
+    assert b0[1, 2] == 7
+
+    # A capsule can only be consumed once.
+    try:
+        hl.Buffer(capsule)
+    except ValueError as e:
+        assert 'unused DLPack capsule' in str(e)
+    else:
+        assert False, 'Did not see expected exception!'
+
+    # The exported data outlives the original Buffer.
+    b0 = None
+    gc.collect()
+    assert b1[1, 2] == 7
+
+def test_large_dimensions():
+    # Views with an extent or a stride beyond 32 bits can't be wrapped.
+    data = np.zeros(1, dtype=np.uint8)
+    views = [np.lib.stride_tricks.as_strided(data, shape=(2**31,), strides=(0,)),
+             np.lib.stride_tricks.as_strided(data, shape=(1,), strides=(2**33,))]
+    for view in views:
+        try:
+            hl.Buffer(view)
+        except ValueError as e:
+            assert 'fit in 32 bits' in str(e)
+        else:
+            assert False, 'Did not see expected exception!'
+
 if __name__ == "__main__":
     test_ndarray_to_buffer()
     test_buffer_to_ndarray()
     test_for_each_element()
     test_fill_all_equal()
     test_bufferinfo_sharing()
-
+    test_dlpack()
+    test_large_dimensions()
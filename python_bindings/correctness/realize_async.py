@@ -0,0 +1,40 @@
+from __future__ import print_function
+import halide as hl
+
+def test_realize_async():
+    x = hl.Var('x')
+    y = hl.Var('y')
+    f = hl.Func('f')
+    f[x, y] = x + y * 10
+
+    # Realize to a new Buffer
+    future = f.realize_async([20, 30])
+    b = future.result()
+    assert future.done()
+    assert b[3, 4] == 43
+
+    # Realize into an existing Buffer
+    buf = hl.Buffer(hl.Int(32), [20, 30])
+    p = hl.Pipeline(f)
+    future = p.realize_async(buf)
+    assert future.result() is None
+    assert buf[5, 6] == 65
+
+def test_realize_async_error():
+    x = hl.Var('x')
+    f = hl.Func('f')
+    f[x] = hl.u8(x)
+    f.bound(x, 0, 1)
+    # Deliberate runtime error, raised from result()
+    buf = hl.Buffer(hl.UInt(8), [10])
+    future = f.realize_async(buf)
+    try:
+        future.result()
+    except RuntimeError as e:
+        assert 'do not cover required region' in str(e)
+    else:
+        assert False, 'Did not see expected exception!'
+
+if __name__ == "__main__":
+    test_realize_async()
+    test_realize_async_error()
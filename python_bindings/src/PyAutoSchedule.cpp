@@ -0,0 +1,58 @@
+#include "PyAutoSchedule.h"
+
+namespace Halide {
+namespace PythonBindings {
+
+void define_auto_schedule(py::module &m) {
+    auto measured_cost_class = py::class_<MeasuredCost>(m, "MeasuredCost")
+        .def(py::init<>())
+        .def_readwrite("time_ms", &MeasuredCost::time_ms)
+        .def_readwrite("threads", &MeasuredCost::threads)
+    ;
+
+    m.def("load_profile", &load_profile, py::arg("filename"));
+
+    auto simple_autoschedule_options_class = py::class_<SimpleAutoscheduleOptions>(m, "SimpleAutoscheduleOptions")
+        .def(py::init<>())
+        .def_readwrite("target", &SimpleAutoscheduleOptions::target)
+        .def_readwrite("gpu", &SimpleAutoscheduleOptions::gpu)
+        .def_readwrite("cpu_tile_width", &SimpleAutoscheduleOptions::cpu_tile_width)
+        .def_readwrite("cpu_tile_height", &SimpleAutoscheduleOptions::cpu_tile_height)
+        .def_readwrite("cpu_vectorize_width", &SimpleAutoscheduleOptions::cpu_vectorize_width)
+        .def_readwrite("machine_params", &SimpleAutoscheduleOptions::machine_params)
+        .def_readwrite("gpu_tile_width", &SimpleAutoscheduleOptions::gpu_tile_width)
+        .def_readwrite("gpu_tile_height", &SimpleAutoscheduleOptions::gpu_tile_height)
+        .def_readwrite("gpu_tile_channel", &SimpleAutoscheduleOptions::gpu_tile_channel)
+        .def_readwrite("gpu_shared_memory_size", &SimpleAutoscheduleOptions::gpu_shared_memory_size)
+        .def_readwrite("gpu_register_size", &SimpleAutoscheduleOptions::gpu_register_size)
+        .def_readwrite("gpu_persistent_kernels", &SimpleAutoscheduleOptions::gpu_persistent_kernels)
+        .def_readwrite("unroll_rvar_size", &SimpleAutoscheduleOptions::unroll_rvar_size)
+        .def_readwrite("cpu_cache_size", &SimpleAutoscheduleOptions::cpu_cache_size)
+        .def_readwrite("max_inline_expr_size", &SimpleAutoscheduleOptions::max_inline_expr_size)
+        .def_readwrite("profile", &SimpleAutoscheduleOptions::profile)
+        .def_readwrite("cpu_min_grain_us", &SimpleAutoscheduleOptions::cpu_min_grain_us)
+    ;
+
+    // Schedule several outputs together (e.g. a loss and its gradients),
+    // so that the producers they share are scheduled once, for all of
+    // them. Realize them with a single Pipeline to compute those
+    // producers once.
+    m.def("simple_autoschedule", [](std::vector<Func> outputs,
+                                    const std::map<std::string, int> &parameters,
+                                    const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                                    const SimpleAutoscheduleOptions &options) -> std::string {
+        return simple_autoschedule(outputs, parameters, output_bounds, options);
+    }, py::arg("outputs"), py::arg("parameters"), py::arg("output_bounds"),
+       py::arg("options") = SimpleAutoscheduleOptions());
+
+    m.def("simple_autoschedule", [](Func output,
+                                    const std::map<std::string, int> &parameters,
+                                    const std::vector<std::pair<int, int>> &output_bounds,
+                                    const SimpleAutoscheduleOptions &options) -> std::string {
+        return simple_autoschedule(output, parameters, output_bounds, options);
+    }, py::arg("output"), py::arg("parameters"), py::arg("output_bounds"),
+       py::arg("options") = SimpleAutoscheduleOptions());
+}
+
+}  // namespace PythonBindings
+}  // namespace Halide
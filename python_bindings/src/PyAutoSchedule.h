@@ -0,0 +1,14 @@
+#ifndef HALIDE_PYTHON_BINDINGS_PYAUTOSCHEDULE_H
+#define HALIDE_PYTHON_BINDINGS_PYAUTOSCHEDULE_H
+
+#include "PyHalide.h"
+
+namespace Halide {
+namespace PythonBindings {
+
+void define_auto_schedule(py::module &m);
+
+}  // namespace PythonBindings
+}  // namespace Halide
+
+#endif  // HALIDE_PYTHON_BINDINGS_PYAUTOSCHEDULE_H
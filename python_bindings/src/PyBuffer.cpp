@@ -3,6 +3,8 @@
 #include "PyFunc.h"
 #include "PyType.h"
 
+#include <limits>
+
 namespace Halide {
 namespace PythonBindings {
 
@@ -186,21 +188,234 @@ py::object buffer_setitem_operator(Buffer<> &buf, const std::vector<int> &pos, p
     return py::object();
 }
 
+// The parts of dlpack.h (https://github.com/dmlc/dlpack) that we need
+// to exchange tensors through DLPack capsules. These must match its ABI.
+enum DLDeviceType {
+    kDLCPU = 1,
+    kDLGPU = 2,
+};
+
+enum DLDataTypeCode {
+    kDLInt = 0,
+    kDLUInt = 1,
+    kDLFloat = 2,
+};
+
+struct DLContext {
+    DLDeviceType device_type;
+    int device_id;
+};
+
+struct DLDataType {
+    uint8_t code;
+    uint8_t bits;
+    uint16_t lanes;
+};
+
+struct DLTensor {
+    void *data;
+    DLContext ctx;
+    int ndim;
+    DLDataType dtype;
+    int64_t *shape;
+    int64_t *strides;
+    uint64_t byte_offset;
+};
+
+struct DLManagedTensor {
+    DLTensor dl_tensor;
+    void *manager_ctx;
+    void (*deleter)(DLManagedTensor *self);
+};
+
+DLDataType type_to_dl_data_type(const Type &type) {
+    if (type.is_bool() || type.is_handle()) {
+        throw py::value_error("DLPack does not support Buffers of type " + halide_type_to_string(type) + ".");
+    }
+    DLDataType t;
+    t.code = type.is_float() ? kDLFloat : type.is_uint() ? kDLUInt : kDLInt;
+    t.bits = (uint8_t) type.bits();
+    t.lanes = 1;
+    return t;
+}
+
+Type dl_data_type_to_type(const DLDataType &t) {
+    if (t.lanes != 1) {
+        throw py::value_error("Halide Buffers do not support DLPack tensors of vectors.");
+    }
+    if (t.code == kDLInt) {
+        return Int(t.bits);
+    } else if (t.code == kDLUInt) {
+        return UInt(t.bits);
+    } else if (t.code == kDLFloat) {
+        return Float(t.bits);
+    }
+    throw py::value_error("Unsupported DLPack data type.");
+}
+
+// The typestr of a type in the __cuda_array_interface__, e.g. "<f4"
+std::string type_to_typestr(const Type &type) {
+    std::string code = type.is_bool() ? "b" : type.is_float() ? "f" : type.is_uint() ? "u" : "i";
+    if (type.is_handle()) {
+        throw py::value_error("Unsupported Buffer<> type.");
+    }
+    return (type.bytes() == 1 ? "|" : "<") + code + std::to_string(type.bytes());
+}
+
+Type typestr_to_type(const std::string &typestr) {
+    if (typestr.size() < 3 || typestr[0] == '>') {
+        throw py::value_error("Unsupported typestr: " + typestr);
+    }
+    const int bits = std::stoi(typestr.substr(2)) * 8;
+    const char code = typestr[1];
+    if (code == 'b' && bits == 8) {
+        return Bool();
+    } else if (code == 'i') {
+        return Int(bits);
+    } else if (code == 'u') {
+        return UInt(bits);
+    } else if (code == 'f') {
+        return Float(bits);
+    }
+    throw py::value_error("Unsupported typestr: " + typestr);
+}
+
+const halide_device_interface_t *cuda_device_interface() {
+    return get_device_interface_for_device_api(DeviceAPI::CUDA,
+                                               get_jit_target_from_environment().with_feature(Target::CUDA));
+}
+
+// The dimensions of a tensor with the given shape and strides (in
+// elements). If there are no strides, the tensor is dense, with the
+// last dimension varying fastest.
+std::vector<halide_dimension_t> make_dim_vec(const std::vector<int64_t> &shape, const int64_t *strides) {
+    std::vector<halide_dimension_t> dims(shape.size());
+    int64_t stride = 1;
+    for (int i = (int) shape.size() - 1; i >= 0; i--) {
+        const int64_t s = strides ? strides[i] : stride;
+        if (shape[i] < 0 || shape[i] > std::numeric_limits<int32_t>::max() ||
+            s < std::numeric_limits<int32_t>::min() || s > std::numeric_limits<int32_t>::max()) {
+            throw py::value_error("Dimension " + std::to_string(i) + " of the tensor has extent " +
+                                  std::to_string(shape[i]) + " and stride " + std::to_string(s) +
+                                  ", which Halide Buffers can't represent: both must fit in 32 bits.");
+        }
+        dims[i] = {0, (int32_t) shape[i], (int32_t) s};
+        stride *= shape[i];
+    }
+    return dims;
+}
+
+// Wrap existing CUDA device memory in a Buffer<> without a host allocation.
+Buffer<> wrap_cuda_device_ptr(const Type &type, uint64_t ptr, const std::vector<halide_dimension_t> &dims,
+                              const std::string &name) {
+    Buffer<> b(type, nullptr, (int) dims.size(), dims.data(), name);
+    if (b.device_wrap_native(DeviceAPI::CUDA, ptr, get_jit_target_from_environment().with_feature(Target::CUDA)) != 0) {
+        throw py::value_error("Could not wrap the CUDA device pointer.");
+    }
+    b.set_device_dirty(true);
+    return b;
+}
+
+// Is the current data of the Buffer<> in CUDA device memory?
+bool data_on_cuda_device(const Buffer<> &b) {
+    const halide_buffer_t *raw = b.raw_buffer();
+    return raw->device &&
+        raw->device_interface &&
+        raw->device_interface == cuda_device_interface() &&
+        !b.host_dirty();
+}
+
+// The state of a Buffer<> exported as a DLPack capsule
+struct DLPackExport {
+    DLManagedTensor tensor;
+    py::object owner;
+    std::vector<int64_t> shape, strides;
+};
+
+void delete_dlpack_export(DLManagedTensor *self) {
+    // Consumers may delete the tensor from any thread.
+    py::gil_scoped_acquire acquire;
+    delete (DLPackExport *) self->manager_ctx;
+}
+
+py::capsule buffer_to_dlpack(py::object self) {
+    Buffer<> &b = self.cast<Buffer<> &>();
+    const bool on_device = data_on_cuda_device(b) && (b.device_dirty() || b.data() == nullptr);
+    if (!on_device && b.data() == nullptr) {
+        throw py::value_error("Cannot export a Buffer<> with null host ptr to DLPack.");
+    }
+    if (!on_device && b.device_dirty()) {
+        throw py::value_error("Cannot export a Buffer<> whose data is on a non-CUDA device to DLPack. Call copy_to_host() first.");
+    }
+
+    DLPackExport *e = new DLPackExport;
+    e->owner = self;
+    for (int i = 0; i < b.dimensions(); i++) {
+        e->shape.push_back(b.dim(i).extent());
+        e->strides.push_back(b.dim(i).stride());
+    }
+
+    DLTensor &t = e->tensor.dl_tensor;
+    if (on_device) {
+        t.data = (void *) b.raw_buffer()->device;
+        t.ctx = {kDLGPU, 0};
+    } else {
+        t.data = b.data();
+        t.ctx = {kDLCPU, 0};
+    }
+    t.ndim = b.dimensions();
+    t.dtype = type_to_dl_data_type(b.type());
+    t.shape = e->shape.data();
+    t.strides = e->strides.data();
+    t.byte_offset = 0;
+    e->tensor.manager_ctx = e;
+    e->tensor.deleter = delete_dlpack_export;
+
+    return py::capsule(&e->tensor, "dltensor", [](PyObject *o) {
+        // Only delete the tensor if no one consumed it.
+        if (PyCapsule_IsValid(o, "dltensor")) {
+            DLManagedTensor *t = (DLManagedTensor *) PyCapsule_GetPointer(o, "dltensor");
+            t->deleter(t);
+        }
+    });
+}
+
+py::dict buffer_to_cuda_array_interface(const Buffer<> &b) {
+    if (!data_on_cuda_device(b)) {
+        // An AttributeError, so that hasattr() reports that there is no interface.
+        PyErr_SetString(PyExc_AttributeError, "Buffer<> has no up-to-date CUDA device allocation.");
+        throw py::error_already_set();
+    }
+    py::list shape, strides;
+    for (int i = 0; i < b.dimensions(); i++) {
+        shape.append(b.dim(i).extent());
+        strides.append((int64_t) b.dim(i).stride() * b.type().bytes());
+    }
+    py::dict d;
+    d["shape"] = py::tuple(shape);
+    d["strides"] = py::tuple(strides);
+    d["typestr"] = type_to_typestr(b.type());
+    d["data"] = py::make_tuple((uint64_t) b.raw_buffer()->device, false);
+    d["version"] = 1;
+    return d;
+}
+
 // Use an alias class so that if we are created via a py::buffer, we can
 // keep the py::buffer_info class alive for the life of the Buffer<>,
-// ensuring the data isn't collected out from under us.
+// ensuring the data isn't collected out from under us. Buffers made
+// from DLPack tensors or CUDA arrays keep their owner alive instead.
 class PyBuffer : public Buffer<> {
     py::buffer_info info;
+    py::object owner;
 
     static std::vector<halide_dimension_t> make_dim_vec(const py::buffer_info &info) {
         const Type t = format_descriptor_to_type(info.format);
-        std::vector<halide_dimension_t> dims;
-        dims.reserve(info.ndim);
-        for (int i = 0; i < info.ndim; i++) {
-            // TODO: check for ssize_t -> int32_t overflow
-            dims.push_back({0, (int32_t) info.shape[i], (int32_t) (info.strides[i] / t.bytes())});
+        std::vector<int64_t> shape(info.shape.begin(), info.shape.end());
+        std::vector<int64_t> strides;
+        for (auto s : info.strides) {
+            strides.push_back(s / t.bytes());
         }
-        return dims;
+        return Halide::PythonBindings::make_dim_vec(shape, strides.data());
     }
 
     PyBuffer(py::buffer_info &&info, const std::string &name)
@@ -223,6 +438,63 @@ public:
     PyBuffer(py::buffer buffer, const std::string &name)
         : PyBuffer(buffer.request(/*writable*/ true), name) {}
 
+    PyBuffer(const Buffer<> &b, py::object owner)
+        : Buffer<>(b), info(), owner(owner) {}
+
+    // Take ownership of the tensor in an unused DLPack capsule.
+    static PyBuffer *from_dlpack(py::capsule capsule, const std::string &name) {
+        if (!PyCapsule_IsValid(capsule.ptr(), "dltensor")) {
+            throw py::value_error("Expected an unused DLPack capsule.");
+        }
+        DLManagedTensor *t = (DLManagedTensor *) PyCapsule_GetPointer(capsule.ptr(), "dltensor");
+        const DLTensor &dl = t->dl_tensor;
+        const Type type = dl_data_type_to_type(dl.dtype);
+        const std::vector<halide_dimension_t> dims =
+            make_dim_vec(std::vector<int64_t>(dl.shape, dl.shape + dl.ndim), dl.strides);
+        if (dl.ctx.device_type != kDLCPU && dl.ctx.device_type != kDLGPU) {
+            throw py::value_error("Only DLPack tensors on the CPU or a CUDA device are supported.");
+        }
+
+        // Mark the capsule as consumed; deleting the tensor is up to us now.
+        PyCapsule_SetName(capsule.ptr(), "used_dltensor");
+        py::capsule owner(t, [](void *p) {
+            DLManagedTensor *t = (DLManagedTensor *) p;
+            if (t->deleter) {
+                t->deleter(t);
+            }
+        });
+
+        uint8_t *data = (uint8_t *) dl.data + dl.byte_offset;
+        if (dl.ctx.device_type == kDLCPU) {
+            return new PyBuffer(Buffer<>(type, data, (int) dims.size(), dims.data(), name), owner);
+        } else {
+            return new PyBuffer(wrap_cuda_device_ptr(type, (uint64_t) data, dims, name), owner);
+        }
+    }
+
+    // Share the device memory of an object with a __cuda_array_interface__
+    static PyBuffer *from_cuda_array_interface(py::object obj, const std::string &name) {
+        if (!py::hasattr(obj, "__cuda_array_interface__")) {
+            throw py::type_error("Buffer() expects a type, a buffer, a DLPack capsule, "
+                                 "or an object with a __cuda_array_interface__.");
+        }
+        py::dict d = obj.attr("__cuda_array_interface__");
+        const Type type = typestr_to_type(d["typestr"].cast<std::string>());
+        py::tuple data = d["data"];
+        if (data[1].cast<bool>()) {
+            throw py::value_error("Cannot make a Buffer<> from a read-only CUDA array.");
+        }
+        const std::vector<int64_t> shape = d["shape"].cast<std::vector<int64_t>>();
+        std::vector<int64_t> strides;
+        if (d.contains("strides") && !d["strides"].is_none()) {
+            for (int64_t s : d["strides"].cast<std::vector<int64_t>>()) {
+                strides.push_back(s / type.bytes());
+            }
+        }
+        const std::vector<halide_dimension_t> dims = make_dim_vec(shape, strides.empty() ? nullptr : strides.data());
+        return new PyBuffer(wrap_cuda_device_ptr(type, data[0].cast<uint64_t>(), dims, name), obj);
+    }
+
     virtual ~PyBuffer() {}
 };
 
@@ -276,6 +548,24 @@ void define_buffer(py::module &m) {
             return Buffer<>(type, sizes, name);
         }), py::arg("type"), py::arg("sizes"), py::arg("name") = "")
 
+        // Zero-copy imports from PyTorch, CuPy, etc. Buffers made from GPU
+        // tensors wrap the device memory, and have no host allocation.
+        .def(py::init(&PyBuffer::from_dlpack), py::arg("dltensor"), py::arg("name") = "")
+        // This must be the last constructor, as it accepts any object.
+        .def(py::init(&PyBuffer::from_cuda_array_interface), py::arg("cuda_array"), py::arg("name") = "")
+
+        // Zero-copy exports. These share the device memory if the data
+        // is on a CUDA device, and the host memory otherwise.
+        .def("to_dlpack", &buffer_to_dlpack)
+        .def("__dlpack__", [](py::object self, py::object stream) -> py::capsule {
+            return buffer_to_dlpack(self);
+        }, py::arg("stream") = py::none())
+        .def("__dlpack_device__", [](const Buffer<> &b) -> py::tuple {
+            const bool on_device = data_on_cuda_device(b) && (b.device_dirty() || b.data() == nullptr);
+            return py::make_tuple((int) (on_device ? kDLGPU : kDLCPU), 0);
+        })
+        .def_property_readonly("__cuda_array_interface__", &buffer_to_cuda_array_interface)
+
         // Note that this exists solely to allow you to create a Buffer with a null host ptr;
         // this is necessary for some bounds-query operations (e.g. Func::infer_input_bounds).
         .def_static("make_bounds_query", [](Type type, const std::vector<int> &sizes, const std::string &name) -> Buffer<> {
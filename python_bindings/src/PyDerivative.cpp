@@ -0,0 +1,119 @@
+#include "PyDerivative.h"
+
+#include <pybind11/functional.h>
+
+namespace Halide {
+namespace PythonBindings {
+
+namespace {
+
+Func get_adjoint(const Derivative &d, const std::string &name, int update_id) {
+    auto it = d.adjoints.find(FuncKey{name, update_id});
+    if (it == d.adjoints.end()) {
+        throw py::key_error("No adjoint for " + name);
+    }
+    return it->second;
+}
+
+Buffer<float> to_float_buffer(const Buffer<> &b) {
+    if (b.type() != Float(32)) {
+        throw py::value_error("The adjoint buffer must be of type float32");
+    }
+    return Buffer<float>(b);
+}
+
+}  // namespace
+
+void define_derivative(py::module &m) {
+    py::enum_<CheckpointPolicy>(m, "CheckpointPolicy")
+        .value("StoreAll", CheckpointPolicy::StoreAll)
+        .value("RecomputeMarked", CheckpointPolicy::RecomputeMarked)
+        .value("MemoryBudget", CheckpointPolicy::MemoryBudget)
+    ;
+
+    py::enum_<ActivationCompression>(m, "ActivationCompression")
+        .value("Float16", ActivationCompression::Float16)
+        .value("BFloat16", ActivationCompression::BFloat16)
+        .value("Int8Block", ActivationCompression::Int8Block)
+        .value("SignMask", ActivationCompression::SignMask)
+    ;
+
+    auto propagate_adjoints_options_class = py::class_<PropagateAdjointsOptions>(m, "PropagateAdjointsOptions")
+        .def(py::init<>())
+        .def_readwrite("checkpoint_policy", &PropagateAdjointsOptions::checkpoint_policy)
+        .def_readwrite("recompute", &PropagateAdjointsOptions::recompute)
+        .def_readwrite("memory_budget", &PropagateAdjointsOptions::memory_budget)
+        .def_readwrite("fuse_adjoints", &PropagateAdjointsOptions::fuse_adjoints)
+        .def_readwrite("transfer_schedules", &PropagateAdjointsOptions::transfer_schedules)
+        .def_readwrite("custom_gradients", &PropagateAdjointsOptions::custom_gradients)
+        .def_readwrite("accumulation_type", &PropagateAdjointsOptions::accumulation_type)
+        .def_readwrite("loss_scale", &PropagateAdjointsOptions::loss_scale)
+        .def_readwrite("invert_scans", &PropagateAdjointsOptions::invert_scans)
+        .def_readwrite("inputs", &PropagateAdjointsOptions::inputs)
+        .def_readwrite("reduction_tile_size", &PropagateAdjointsOptions::reduction_tile_size)
+        .def_readwrite("accumulate_into", &PropagateAdjointsOptions::accumulate_into)
+        .def_readwrite("compressed_activations", &PropagateAdjointsOptions::compressed_activations)
+        .def_readwrite("activation_block_size", &PropagateAdjointsOptions::activation_block_size)
+    ;
+
+    // The adjoints are looked up with d[f] or d[buffer], or with
+    // d(f, update_id, bounded) for the adjoints of the updates of f.
+    auto derivative_class = py::class_<Derivative>(m, "Derivative")
+        .def("__getitem__", [](const Derivative &d, const Func &func) -> Func {
+            return get_adjoint(d, func.name(), -1);
+        })
+        .def("__getitem__", [](const Derivative &d, const Buffer<> &buffer) -> Func {
+            return get_adjoint(d, buffer.name(), -1);
+        })
+        .def("__call__", [](const Derivative &d, const Func &func, int update_id, bool bounded) -> Func {
+            return get_adjoint(d, bounded ? func.name() : func.name() + "_unbounded", update_id);
+        }, py::arg("func"), py::arg("update_id") = -1, py::arg("bounded") = true)
+        .def("__call__", [](const Derivative &d, const Buffer<> &buffer) -> Func {
+            return get_adjoint(d, buffer.name(), -1);
+        }, py::arg("buffer"))
+        .def("funcs", [](const Derivative &d, const Func &func) -> std::vector<Func> {
+            get_adjoint(d, func.name(), -1);
+            return d.funcs(func);
+        }, py::arg("func"))
+        .def("reconstructed", &Derivative::reconstructed, py::arg("func"))
+        .def("partial_sums", &Derivative::partial_sums, py::arg("name"), py::arg("update_id"))
+        .def("compressed", &Derivative::compressed, py::arg("func"))
+        .def("compressed_scales", &Derivative::compressed_scales, py::arg("func"))
+        .def("specialize", &Derivative::specialize)
+        .def_readonly("recomputed", &Derivative::recomputed)
+    ;
+
+    m.def("propagate_adjoints", [](const Func &output, const Func &adjoint,
+                                   const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                                   const PropagateAdjointsOptions &options) -> Derivative {
+        return propagate_adjoints(output, adjoint, output_bounds, options);
+    }, py::arg("output"), py::arg("adjoint"), py::arg("output_bounds"),
+       py::arg("options") = PropagateAdjointsOptions());
+
+    m.def("propagate_adjoints", [](const Func &output, const Buffer<> &adjoint,
+                                   const PropagateAdjointsOptions &options) -> Derivative {
+        return propagate_adjoints(output, to_float_buffer(adjoint), options);
+    }, py::arg("output"), py::arg("adjoint"), py::arg("options") = PropagateAdjointsOptions());
+
+    m.def("propagate_adjoints", [](const Func &output, const std::set<std::string> &inputs,
+                                   const PropagateAdjointsOptions &options) -> Derivative {
+        return propagate_adjoints(output, inputs, options);
+    }, py::arg("output"), py::arg("inputs"), py::arg("options") = PropagateAdjointsOptions());
+
+    m.def("propagate_adjoints", [](const Func &output, const PropagateAdjointsOptions &options) -> Derivative {
+        return propagate_adjoints(output, options);
+    }, py::arg("output"), py::arg("options") = PropagateAdjointsOptions());
+
+    m.def("propagate_batched_adjoints", [](const Func &output, const Buffer<> &adjoints,
+                                           const PropagateAdjointsOptions &options) -> Derivative {
+        return propagate_batched_adjoints(output, to_float_buffer(adjoints), options);
+    }, py::arg("output"), py::arg("adjoints"), py::arg("options") = PropagateAdjointsOptions());
+
+    m.def("propagate_tangents", &propagate_tangents, py::arg("output"), py::arg("tangents"));
+    m.def("propagate_batched_tangents", &propagate_batched_tangents, py::arg("output"), py::arg("tangents"));
+
+    m.def("all_finite", &all_finite, py::arg("gradient"), py::arg("region"));
+}
+
+}  // namespace PythonBindings
+}  // namespace Halide
@@ -26,6 +26,12 @@ void define_enums(py::module &m) {
         .value("Internal", LinkageType::Internal)
     ;
 
+    py::enum_<ParallelPolicy>(m, "ParallelPolicy")
+        .value("Dynamic", ParallelPolicy::Dynamic)
+        .value("Guided", ParallelPolicy::Guided)
+        .value("Static", ParallelPolicy::Static)
+    ;
+
     py::enum_<LoopAlignStrategy>(m, "LoopAlignStrategy")
         .value("AlignStart", LoopAlignStrategy::AlignStart)
         .value("AlignEnd", LoopAlignStrategy::AlignEnd)
@@ -39,6 +45,8 @@ void define_enums(py::module &m) {
         .value("Stack", MemoryType::Stack)
         .value("Register", MemoryType::Register)
         .value("GPUShared", MemoryType::GPUShared)
+        .value("VTCM", MemoryType::VTCM)
+        .value("GPUConstant", MemoryType::GPUConstant)
     ;
 
     py::enum_<NameMangling>(m, "NameMangling")
@@ -72,7 +80,8 @@ void define_enums(py::module &m) {
         .value("Android", Target::OS::Android)
         .value("IOS", Target::OS::IOS)
         .value("QuRT", Target::OS::QuRT)
-        .value("NoOS", Target::OS::NoOS);
+        .value("NoOS", Target::OS::NoOS)
+        .value("WebAssemblyRuntime", Target::OS::WebAssemblyRuntime);
 
     py::enum_<Target::Arch>(m, "TargetArch")
         .value("ArchUnknown", Target::Arch::ArchUnknown)
@@ -80,7 +89,9 @@ void define_enums(py::module &m) {
         .value("ARM", Target::Arch::ARM)
         .value("MIPS", Target::Arch::MIPS)
         .value("Hexagon", Target::Arch::Hexagon)
-        .value("POWERPC", Target::Arch::POWERPC);
+        .value("POWERPC", Target::Arch::POWERPC)
+        .value("WebAssembly", Target::Arch::WebAssembly)
+        .value("RISCV", Target::Arch::RISCV);
 
     py::enum_<Target::Feature>(m, "TargetFeature")
         .value("JIT", Target::Feature::JIT)
@@ -95,6 +106,7 @@ void define_enums(py::module &m) {
         .value("F16C", Target::Feature::F16C)
         .value("ARMv7s", Target::Feature::ARMv7s)
         .value("NoNEON", Target::Feature::NoNEON)
+        .value("ARMDotProd", Target::Feature::ARMDotProd)
         .value("VSX", Target::Feature::VSX)
         .value("POWER_ARCH_2_07", Target::Feature::POWER_ARCH_2_07)
         .value("CUDA", Target::Feature::CUDA)
@@ -103,6 +115,7 @@ void define_enums(py::module &m) {
         .value("CUDACapability35", Target::Feature::CUDACapability35)
         .value("CUDACapability50", Target::Feature::CUDACapability50)
         .value("CUDACapability61", Target::Feature::CUDACapability61)
+        .value("CUDACapability70", Target::Feature::CUDACapability70)
         .value("OpenCL", Target::Feature::OpenCL)
         .value("CLDoubles", Target::Feature::CLDoubles)
         .value("CLHalf", Target::Feature::CLHalf)
@@ -129,6 +142,7 @@ void define_enums(py::module &m) {
         .value("AVX512_KNL", Target::Feature::AVX512_KNL)
         .value("AVX512_Skylake", Target::Feature::AVX512_Skylake)
         .value("AVX512_Cannonlake", Target::Feature::AVX512_Cannonlake)
+        .value("AVX512_VNNI", Target::Feature::AVX512_VNNI)
         .value("TraceLoads", Target::Feature::TraceLoads)
         .value("TraceStores", Target::Feature::TraceStores)
         .value("TraceRealizations", Target::Feature::TraceRealizations)
@@ -136,13 +150,23 @@ void define_enums(py::module &m) {
         .value("LegacyBufferWrappers", Target::Feature::LegacyBufferWrappers)
         .value("TSAN", Target::Feature::TSAN)
         .value("ASAN", Target::Feature::ASAN)
+        .value("MinimalRuntime", Target::Feature::MinimalRuntime)
+        .value("PlanMemory", Target::Feature::PlanMemory)
+        .value("PlanLayouts", Target::Feature::PlanLayouts)
+        .value("ProfileMetrics", Target::Feature::ProfileMetrics)
+        .value("AsyncEntry", Target::Feature::AsyncEntry)
+        .value("NativeFloat16", Target::Feature::NativeFloat16)
+        .value("WasmSimd128", Target::Feature::WasmSimd128)
+        .value("WasmThreads", Target::Feature::WasmThreads)
+        .value("RVV", Target::Feature::RVV)
         .value("FeatureEnd", Target::Feature::FeatureEnd);
 
     py::enum_<halide_type_code_t>(m, "TypeCode")
         .value("Int", Type::Int)
         .value("UInt", Type::UInt)
         .value("Float", Type::Float)
-        .value("Handle", Type::Handle);
+        .value("Handle", Type::Handle)
+        .value("BFloat", Type::BFloat);
 }
 
 }  // namespace PythonBindings
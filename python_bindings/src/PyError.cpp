@@ -10,12 +10,15 @@ void halide_python_error(void *, const char *msg) {
 }
 
 void halide_python_print(void *, const char *msg) {
+    // Pipelines run without the GIL, possibly on threads of their own.
+    py::gil_scoped_acquire acquire;
     py::print(msg, py::arg("end") = "");
 }
 
 class HalidePythonCompileTimeErrorReporter : public CompileTimeErrorReporter {
 public:
     void warning(const char* msg) {
+        py::gil_scoped_acquire acquire;
         py::print(msg, py::arg("end") = "");
     }
 
@@ -5,6 +5,7 @@
 #include "PyExpr.h"
 #include "PyFuncRef.h"
 #include "PyLoopLevel.h"
+#include "PyPipeline.h"
 #include "PyScheduleMethods.h"
 #include "PyStage.h"
 #include "PyTuple.h"
@@ -83,38 +84,73 @@ void define_func(py::module &m) {
         .def(py::init([](const ImageParam &im) -> Func { return im; }))
 
         .def("realize", [](Func &f, Buffer<> buffer, const Target &target, const ParamMap &param_map) -> void {
+            py::gil_scoped_release release;
             f.realize(buffer, target);
         }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // This will actually allow a list-of-buffers as well as a tuple-of-buffers, but that's OK.
         .def("realize", [](Func &f, std::vector<Buffer<>> buffers, const Target &t, const ParamMap &param_map) -> void {
+            py::gil_scoped_release release;
             f.realize(Realization(buffers), t);
         }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         .def("realize", [](Func &f, std::vector<int32_t> sizes, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(f.realize(sizes, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return f.realize(sizes, target, param_map); }));
         }, py::arg("sizes") = std::vector<int32_t>{}, py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Func &f, int x_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(f.realize(x_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return f.realize(x_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Func &f, int x_size, int y_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(f.realize(x_size, y_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return f.realize(x_size, y_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("y_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Func &f, int x_size, int y_size, int z_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(f.realize(x_size, y_size, z_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return f.realize(x_size, y_size, z_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("y_size"), py::arg("z_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Func &f, int x_size, int y_size, int z_size, int w_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(f.realize(x_size, y_size, z_size, w_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return f.realize(x_size, y_size, z_size, w_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("y_size"), py::arg("z_size"), py::arg("w_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
+        // Realize on a thread of its own, returning a RealizeFuture. The
+        // Func must not be used by anything else until it is done.
+        .def("realize_async", [](Func &f, Buffer<> buffer, const Target &target, const ParamMap &param_map) -> RealizeFuture * {
+            Func *func = &f;
+            return new RealizeFuture([func, buffer, target, param_map]() mutable {
+                func->realize(buffer, target, param_map);
+                return std::vector<Buffer<>>();
+            });
+        }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap(),
+           py::keep_alive<0, 1>(), py::keep_alive<0, 2>())
+
+        .def("realize_async", [](Func &f, std::vector<Buffer<>> buffers, const Target &target, const ParamMap &param_map) -> RealizeFuture * {
+            Func *func = &f;
+            return new RealizeFuture([func, buffers, target, param_map]() mutable {
+                func->realize(Realization(buffers), target, param_map);
+                return std::vector<Buffer<>>();
+            });
+        }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap(),
+           py::keep_alive<0, 1>(), py::keep_alive<0, 2>())
+
+        .def("realize_async", [](Func &f, std::vector<int32_t> sizes, const Target &target, const ParamMap &param_map) -> RealizeFuture * {
+            Func *func = &f;
+            return new RealizeFuture([func, sizes, target, param_map]() {
+                Realization r = func->realize(sizes, target, param_map);
+                std::vector<Buffer<>> buffers;
+                for (size_t i = 0; i < r.size(); i++) {
+                    buffers.push_back(r[i]);
+                }
+                return buffers;
+            });
+        }, py::arg("sizes") = std::vector<int32_t>{}, py::arg("target") = Target(), py::arg("param_map") = ParamMap(),
+           py::keep_alive<0, 1>())
+
         .def("defined", &Func::defined)
         .def("name", &Func::name)
         .def("dimensions", &Func::dimensions)
@@ -149,13 +185,20 @@ void define_func(py::module &m) {
         .def("store_at", (Func &(Func::*)(LoopLevel)) &Func::store_at,
             py::arg("loop_level"))
 
-        .def("memoize", &Func::memoize)
+        .def("memoize", &Func::memoize,
+            py::arg("eviction_cost") = 1)
         .def("compute_inline", &Func::compute_inline)
         .def("compute_root", &Func::compute_root)
         .def("store_root", &Func::store_root)
 
         .def("store_in", &Func::store_in,
             py::arg("memory_type"))
+        .def("store_nontemporal", &Func::store_nontemporal)
+        .def("dma", &Func::dma)
+        .def("widen_float16_math", &Func::widen_float16_math)
+        .def("gpu_persistent", &Func::gpu_persistent)
+        .def("distribute", &Func::distribute,
+            py::arg("var"))
 
         .def("compile_to", &Func::compile_to,
             py::arg("outputs"), py::arg("arguments"), py::arg("fn_name"), py::arg("target") = get_target_from_environment())
@@ -195,7 +238,8 @@ void define_func(py::module &m) {
             py::arg("filename"), py::arg("arguments"), py::arg("fn_name") = "", py::arg("target") = get_target_from_environment())
 
         .def("compile_to_lowered_stmt", &Func::compile_to_lowered_stmt,
-            py::arg("filename"), py::arg("arguments"), py::arg("fmt") = Text, py::arg("target") = get_target_from_environment())
+            py::arg("filename"), py::arg("arguments"), py::arg("fmt") = Text, py::arg("target") = get_target_from_environment(),
+            py::arg("profile_filename") = "")
 
         .def("compile_to_file", &Func::compile_to_file,
             py::arg("filename_prefix"), py::arg("arguments"), py::arg("fn_name") = "", py::arg("target") = get_target_from_environment())
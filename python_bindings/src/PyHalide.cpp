@@ -1,9 +1,11 @@
 #include "PyHalide.h"
 
 #include "PyArgument.h"
+#include "PyAutoSchedule.h"
 #include "PyBoundaryConditions.h"
 #include "PyBuffer.h"
 #include "PyConciseCasts.h"
+#include "PyDerivative.h"
 #include "PyEnums.h"
 #include "PyError.h"
 #include "PyExpr.h"
@@ -51,6 +53,8 @@ PYBIND11_MODULE(HALIDE_PYBIND_MODULE_NAME, m) {
     define_module(m);
     define_func(m);
     define_pipeline(m);
+    define_derivative(m);
+    define_auto_schedule(m);
     define_inline_reductions(m);
     define_lambda(m);
     define_operators(m);
@@ -165,6 +165,8 @@ void define_operators(py::module &m) {
     m.def("random_float", (Expr (*)(Expr)) &random_float, py::arg("seed"));
     m.def("random_uint", (Expr (*)(Expr)) &random_uint, py::arg("seed"));
     m.def("random_int", (Expr (*)(Expr)) &random_int, py::arg("seed"));
+    m.def("philox_uint", &philox_uint, py::arg("coords"), py::arg("seed") = Expr(0));
+    m.def("philox_float", &philox_float, py::arg("coords"), py::arg("seed") = Expr(0));
     m.def("undef", (Expr (*)(Type)) &undef);
     m.def("memoize_tag", [](Expr result, py::args cache_key_values) -> Expr {
         return Internal::memoize_tag_helper(result, args_to_vector<Expr>(cache_key_values));
@@ -17,8 +17,55 @@ py::object realization_to_object(const Realization &r) {
     return to_python_tuple(r);
 }
 
+std::vector<Buffer<>> realization_to_vector(const Realization &r) {
+    std::vector<Buffer<>> v;
+    for (size_t i = 0; i < r.size(); i++) {
+        v.push_back(r[i]);
+    }
+    return v;
+}
+
 }  // namespace
 
+RealizeFuture::RealizeFuture(std::function<std::vector<Buffer<>>()> realize) : finished(false) {
+    // The thread must be started last, as it writes the other members.
+    thread = std::thread([this, realize]() {
+        try {
+            buffers = realize();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        finished = true;
+    });
+}
+
+RealizeFuture::~RealizeFuture() {
+    wait();
+}
+
+bool RealizeFuture::done() const {
+    return finished;
+}
+
+void RealizeFuture::wait() {
+    if (thread.joinable()) {
+        // The realization may need the GIL to print.
+        py::gil_scoped_release release;
+        thread.join();
+    }
+}
+
+py::object RealizeFuture::result() {
+    wait();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (buffers.empty()) {
+        return py::none();
+    }
+    return realization_to_object(Realization(buffers));
+}
+
 void define_pipeline(py::module &m) {
 
     // Deliberately not supported, because they don't seem to make sense for Python:
@@ -38,6 +85,11 @@ void define_pipeline(py::module &m) {
     // - set_custom_trace()
     // - set_custom_print()
 
+    py::class_<RealizeFuture>(m, "RealizeFuture")
+        .def("done", &RealizeFuture::done)
+        .def("result", &RealizeFuture::result)
+    ;
+
     auto pipeline_class = py::class_<Pipeline>(m, "Pipeline")
         .def(py::init<>())
         .def(py::init<Func>())
@@ -46,6 +98,7 @@ void define_pipeline(py::module &m) {
         .def("outputs", &Pipeline::outputs)
         .def("auto_schedule", &Pipeline::auto_schedule,
             py::arg("target"), py::arg("machine_params") = MachineParams::generic())
+        .def("algorithm_hash", &Pipeline::algorithm_hash)
         .def("get_func", &Pipeline::get_func,
             py::arg("index"))
         .def("print_loop_nest", &Pipeline::print_loop_nest)
@@ -71,7 +124,8 @@ void define_pipeline(py::module &m) {
             py::arg("filename"), py::arg("arguments"), py::arg("fn_name"), py::arg("target") = get_target_from_environment())
 
         .def("compile_to_lowered_stmt", &Pipeline::compile_to_lowered_stmt,
-            py::arg("filename"), py::arg("arguments"), py::arg("format") = StmtOutputFormat::Text, py::arg("target") = get_target_from_environment())
+            py::arg("filename"), py::arg("arguments"), py::arg("format") = StmtOutputFormat::Text, py::arg("target") = get_target_from_environment(),
+            py::arg("profile_filename") = "")
 
         .def("compile_to_multitarget_static_library", &Pipeline::compile_to_multitarget_static_library,
             py::arg("filename_prefix"), py::arg("arguments"), py::arg("targets") = get_target_from_environment())
@@ -85,38 +139,64 @@ void define_pipeline(py::module &m) {
 
 
         .def("realize", [](Pipeline &p, Buffer<> buffer, const Target &target, const ParamMap &param_map) -> void {
+            py::gil_scoped_release release;
             p.realize(Realization(buffer), target);
         }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // This will actually allow a list-of-buffers as well as a tuple-of-buffers, but that's OK.
         .def("realize", [](Pipeline &p, std::vector<Buffer<>> buffers, const Target &t, const ParamMap &param_map) -> void {
+            py::gil_scoped_release release;
             p.realize(Realization(buffers), t);
         }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         .def("realize", [](Pipeline &p, std::vector<int32_t> sizes, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(p.realize(sizes, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return p.realize(sizes, target, param_map); }));
         }, py::arg("sizes") = std::vector<int32_t>{}, py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Pipeline &p, int x_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(p.realize(x_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return p.realize(x_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Pipeline &p, int x_size, int y_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(p.realize(x_size, y_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return p.realize(x_size, y_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("y_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Pipeline &p, int x_size, int y_size, int z_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(p.realize(x_size, y_size, z_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return p.realize(x_size, y_size, z_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("y_size"), py::arg("z_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
         // TODO: deprecate in favor of std::vector<int32_t> size version?
         .def("realize", [](Pipeline &p, int x_size, int y_size, int z_size, int w_size, const Target &target, const ParamMap &param_map) -> py::object {
-            return realization_to_object(p.realize(x_size, y_size, z_size, w_size, target, param_map));
+            return realization_to_object(realize_without_gil([&]() { return p.realize(x_size, y_size, z_size, w_size, target, param_map); }));
         }, py::arg("x_size"), py::arg("y_size"), py::arg("z_size"), py::arg("w_size"), py::arg("target") = Target(), py::arg("param_map") = ParamMap())
 
+        // Realize on a thread of its own, returning a RealizeFuture. The
+        // Pipeline must not be used by anything else until it is done.
+        .def("realize_async", [](Pipeline &p, Buffer<> buffer, const Target &target, const ParamMap &param_map) -> RealizeFuture * {
+            return new RealizeFuture([p, buffer, target, param_map]() mutable {
+                p.realize(Realization(buffer), target, param_map);
+                return std::vector<Buffer<>>();
+            });
+        }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap(),
+           py::keep_alive<0, 2>())
+
+        .def("realize_async", [](Pipeline &p, std::vector<Buffer<>> buffers, const Target &target, const ParamMap &param_map) -> RealizeFuture * {
+            return new RealizeFuture([p, buffers, target, param_map]() mutable {
+                p.realize(Realization(buffers), target, param_map);
+                return std::vector<Buffer<>>();
+            });
+        }, py::arg("dst"), py::arg("target") = Target(), py::arg("param_map") = ParamMap(),
+           py::keep_alive<0, 2>())
+
+        .def("realize_async", [](Pipeline &p, std::vector<int32_t> sizes, const Target &target, const ParamMap &param_map) -> RealizeFuture * {
+            return new RealizeFuture([p, sizes, target, param_map]() mutable {
+                return realization_to_vector(p.realize(sizes, target, param_map));
+            });
+        }, py::arg("sizes") = std::vector<int32_t>{}, py::arg("target") = Target(), py::arg("param_map") = ParamMap())
+
         .def("infer_input_bounds", [](Pipeline &p, int x_size, int y_size, int z_size, int w_size, const ParamMap &param_map) -> void {
             p.infer_input_bounds(x_size, y_size, z_size, w_size, param_map);
         }, py::arg("x_size") = 0, py::arg("y_size") = 0, py::arg("z_size") = 0, py::arg("w_size") = 0, py::arg("param_map") = ParamMap())
@@ -1,6 +1,11 @@
 #ifndef HALIDE_PYTHON_BINDINGS_PYPIPELINE_H
 #define HALIDE_PYTHON_BINDINGS_PYPIPELINE_H
 
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+
 #include "PyHalide.h"
 
 namespace Halide {
@@ -8,6 +13,39 @@ namespace PythonBindings {
 
 void define_pipeline(py::module &m);
 
+// Run a realization with the GIL released, so that other Python threads
+// can run meanwhile. The realization must not touch any Python objects.
+template<typename F>
+Realization realize_without_gil(F realize) {
+    py::gil_scoped_release release;
+    return realize();
+}
+
+// The result of realize_async(). The realization runs on a thread of
+// its own, without the GIL. realize() returns the buffers it produced,
+// or nothing if it wrote to existing ones.
+class RealizeFuture {
+public:
+    explicit RealizeFuture(std::function<std::vector<Buffer<>>()> realize);
+    ~RealizeFuture();
+
+    // Has the realization finished (successfully or not)?
+    bool done() const;
+
+    // Wait for the realization to finish, and return its buffers (or
+    // None when realizing into existing buffers). Errors raised by the
+    // realization are raised here.
+    py::object result();
+
+private:
+    void wait();
+
+    std::vector<Buffer<>> buffers;
+    std::exception_ptr error;
+    std::atomic<bool> finished;
+    std::thread thread;
+};
+
 }  // namespace PythonBindings
 }  // namespace Halide
 
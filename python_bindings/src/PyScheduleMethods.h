@@ -46,6 +46,8 @@ HALIDE_NEVER_INLINE void add_schedule_methods(PythonClass &class_instance) {
         py::arg("var"))
     .def("parallel", (T &(T::*)(VarOrRVar, Expr, TailStrategy)) &T::parallel,
         py::arg("var"), py::arg("task_size"), py::arg("tail") = TailStrategy::Auto)
+    .def("parallel", (T &(T::*)(VarOrRVar, ParallelPolicy, int)) &T::parallel,
+        py::arg("var"), py::arg("policy"), py::arg("chunk") = 1)
 
     .def("vectorize", (T &(T::*)(VarOrRVar)) &T::vectorize,
         py::arg("var"))
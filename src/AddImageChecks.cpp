@@ -1,5 +1,6 @@
 #include "AddImageChecks.h"
 #include "IRVisitor.h"
+#include "InjectHostDevBufferCopies.h"
 #include "Simplify.h"
 #include "Substitute.h"
 #include "Target.h"
@@ -126,6 +127,31 @@ Stmt add_image_checks(Stmt s,
     Scope<Interval> empty_scope;
     map<string, Box> boxes = boxes_touched(s, empty_scope, fb);
 
+    // Find the dimension along which the outputs are distributed across
+    // ranks, if any. Each rank owns the region of the inputs along that
+    // dimension that its output buffer covers.
+    int distributed_dim = -1;
+    string distributed_output;
+    for (const auto &it : env) {
+        const Function &f = it.second;
+        const string &var = f.schedule().distributed();
+        if (var.empty()) {
+            continue;
+        }
+        bool is_output = false;
+        for (const Function &o : outputs) {
+            is_output = is_output || o.same_as(f);
+        }
+        user_assert(is_output)
+            << "Func " << f.name() << " is distributed, but only the outputs of a pipeline can be distributed\n";
+        int d = (int)(std::find(f.args().begin(), f.args().end(), var) - f.args().begin());
+        user_assert(distributed_dim == -1 || distributed_dim == d)
+            << "All the distributed outputs of a pipeline must be distributed along the same dimension\n";
+        distributed_dim = d;
+        distributed_output = f.outputs() > 1 ? f.name() + ".0" : f.name();
+    }
+    vector<Stmt> distributed_exchanges;
+
     // Now iterate through all the buffers, creating a list of lets
     // and a list of asserts.
     vector<pair<string, Expr>> lets_overflow;
@@ -242,6 +268,21 @@ Stmt add_image_checks(Stmt s,
             }
         }
 
+        // The inputs of a distributed pipeline are exchanged between the
+        // ranks once they have passed the checks.
+        if (distributed_dim >= 0 && distributed_dim < dimensions &&
+            param.defined() && !is_output_buffer && !touched.empty()) {
+            string dim = std::to_string(distributed_dim);
+            Expr buffer_var = Variable::make(type_of<struct halide_buffer_t *>(), name + ".buffer", param);
+            distributed_exchanges.push_back(
+                call_extern_and_assert("halide_distributed_exchange",
+                                       {buffer_var, distributed_dim,
+                                        Variable::make(Int(32), name + ".min." + dim + ".required"),
+                                        Variable::make(Int(32), name + ".extent." + dim + ".required"),
+                                        Variable::make(Int(32), distributed_output + ".min." + dim),
+                                        Variable::make(Int(32), distributed_output + ".extent." + dim)}));
+        }
+
         ReductionDomain rdom;
 
         // An expression returning whether or not we're in inference mode
@@ -570,6 +611,12 @@ Stmt add_image_checks(Stmt s,
         }
     }
 
+    // Inject the code that exchanges the inputs of a distributed
+    // pipeline, just before the pipeline itself.
+    for (size_t i = distributed_exchanges.size(); i > 0; i--) {
+        s = Block::make(distributed_exchanges[i-1], s);
+    }
+
     // Inject the code that checks the host pointers.
     if (!no_asserts) {
         for (size_t i = asserts_host_non_null.size(); i > 0; i--) {
@@ -0,0 +1,404 @@
+#include "AsyncProducers.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRPrinter.h"
+
+// A Func f scheduled async() gets its realization split into two
+// halves, run concurrently by halide_do_concurrent_tasks:
+//
+// realize f {
+//   let f.produced_semaphore = halide_make_semaphore(0)
+//   let f.consumed_semaphore = halide_make_semaphore(2)
+//   parallel<concurrent> (f.__async_fork, 0, 2) {
+//     if (f.__async_fork == 0) {
+//       ... the loops around produce f only ...
+//         acquire(f.consumed_semaphore, 1); produce f {...}; release(f.produced_semaphore, 1)
+//     } else {
+//       ... everything else ...
+//         acquire(f.produced_semaphore, 1); consume f {...}; release(f.consumed_semaphore, 1)
+//     }
+//   }
+// }
+//
+// f.consumed_semaphore counts the iterations the producer may run ahead of the
+// consumer. Storage folding makes the fold big enough to hold two
+// iterations of f, so that the producer can fill the next one while
+// the consumer reads the current one.
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Does some IR read a Func, either directly or by passing its buffer
+// to an extern stage?
+class UsesFunc : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+
+    void visit(const Call *op) override {
+        result = result || op->name == func;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Variable *op) override {
+        result = result || (starts_with(op->name, func + ".") &&
+                            ends_with(op->name, ".buffer"));
+    }
+
+public:
+    bool result = false;
+    UsesFunc(const string &func) : func(func) {}
+};
+
+template<typename StmtOrExpr>
+bool uses_func(const StmtOrExpr &s, const string &func) {
+    UsesFunc u(func);
+    s.accept(&u);
+    return u.result;
+}
+
+// Find the Funcs produced in some IR, not counting those produced
+// within a given Func's own production.
+class FindProductions : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+
+    void visit(const ProducerConsumer *op) override {
+        if (op->is_producer) {
+            if (op->name == func) {
+                return;
+            }
+            result.insert(op->name);
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    set<string> result;
+    FindProductions(const string &func) : func(func) {}
+};
+
+Stmt acquire(const Expr &semaphore, int n) {
+    string name = unique_name('t');
+    Expr result = Variable::make(Int(32), name);
+    Expr call = Call::make(Int(32), "halide_semaphore_acquire", {semaphore, n}, Call::Extern);
+    return LetStmt::make(name, call, AssertStmt::make(result == 0, result));
+}
+
+Stmt release(const Expr &semaphore, int n) {
+    return Evaluate::make(Call::make(Int(32), "halide_semaphore_release", {semaphore, n}, Call::Extern));
+}
+
+// Poison a semaphore when the enclosing task exits, so that the other
+// half doesn't wait forever if this one fails.
+Stmt poison_on_exit(const Expr &semaphore) {
+    return Evaluate::make(Call::make(Int(32), Call::register_destructor,
+                                     {Expr("halide_semaphore_poison"), semaphore}, Call::Intrinsic));
+}
+
+Stmt make_block(const Stmt &first, const Stmt &rest) {
+    if (is_no_op(first)) {
+        return rest;
+    } else if (is_no_op(rest)) {
+        return first;
+    } else {
+        return Block::make(first, rest);
+    }
+}
+
+// Keep only the production of a Func, and the loops and lets around it.
+class GenerateProducerBody : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const string &func;
+    Expr produced, consumed;
+    const set<string> &siblings;
+
+    // Whether we have found the production of func, and whether we
+    // found it inside a loop, in the IR mutated so far.
+    bool found_produce = false, found_in_loop = false;
+
+    // Whether we're in the statement that precedes a consumption of
+    // func, and synchronizes with the consumer half on its behalf.
+    bool in_production = false;
+
+    bool is_consumer(const Stmt &s) {
+        const ProducerConsumer *op = s.as<ProducerConsumer>();
+        return op && !op->is_producer && op->name == func;
+    }
+
+    Stmt visit(const ProducerConsumer *op) override {
+        if (op->name == func) {
+            if (op->is_producer) {
+                for (const string &s : siblings) {
+                    user_assert(!uses_func(op->body, s))
+                        << "Func " << func << " is scheduled async(), but it uses " << s
+                        << ", which is computed at the same loop level or deeper as the consumers of "
+                        << func << ". Compute " << s << " outside the loop nest of "
+                        << func << "'s storage.\n";
+                }
+                found_produce = true;
+                if (in_production) {
+                    return op;
+                }
+                return Block::make({acquire(consumed, 1), op, release(produced, 1)});
+            } else {
+                return Evaluate::make(0);
+            }
+        }
+        // The consumer half produces and consumes everything else.
+        return mutate(op->body);
+    }
+
+    Stmt visit(const For *op) override {
+        bool old_found_produce = found_produce, old_found_in_loop = found_in_loop;
+        found_produce = found_in_loop = false;
+        Stmt body = mutate(op->body);
+        bool contains_produce = found_produce;
+        bool innermost = found_produce && !found_in_loop;
+        found_produce = old_found_produce || contains_produce;
+        found_in_loop = old_found_in_loop || contains_produce;
+
+        if (!contains_produce) {
+            return Evaluate::make(0);
+        }
+
+        user_assert(op->for_type == ForType::Serial || op->for_type == ForType::Unrolled)
+            << "Func " << func << " is scheduled async(), but the loop " << op->name
+            << ", which it is computed within, is " << op->for_type
+            << ". The loops between the storage and the compute level of an async "
+            << "Func must be serial.\n";
+
+        Stmt s = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+        if (innermost) {
+            // The first iteration of this loop may reuse the storage of
+            // the last iteration of the previous run of it, so wait for
+            // the consumer to catch up entirely before starting.
+            s = Block::make({acquire(consumed, 2), release(consumed, 2), s});
+        }
+        return s;
+    }
+
+    Stmt visit(const Block *op) override {
+        if (is_consumer(op->rest)) {
+            // The production may be conditional (e.g. if the stage can
+            // be skipped), but the consumption isn't, so synchronize
+            // outside of any conditions.
+            ScopedValue<bool> old_in_production(in_production, true);
+            Stmt first = mutate(op->first);
+            if (is_no_op(first)) {
+                return first;
+            }
+            return Block::make({acquire(consumed, 1), first, release(produced, 1)});
+        }
+        Stmt first = mutate(op->first);
+        Stmt rest = mutate(op->rest);
+        return make_block(first, rest);
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        Stmt body = mutate(op->body);
+        if (is_no_op(body)) {
+            return body;
+        }
+        return LetStmt::make(op->name, op->value, body);
+    }
+
+    Stmt visit(const IfThenElse *op) override {
+        Stmt then_case = mutate(op->then_case);
+        Stmt else_case = op->else_case.defined() ? mutate(op->else_case) : Stmt();
+        if (is_no_op(then_case) && (!else_case.defined() || is_no_op(else_case))) {
+            return Evaluate::make(0);
+        }
+        return IfThenElse::make(op->condition, then_case, else_case);
+    }
+
+    Stmt visit(const Realize *op) override {
+        Stmt body = mutate(op->body);
+        if (is_no_op(body) || !uses_func(body, op->name)) {
+            // Only Funcs computed within func itself need storage in
+            // this half.
+            return body;
+        }
+        return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body);
+    }
+
+    Stmt visit(const Allocate *op) override {
+        Stmt body = mutate(op->body);
+        if (is_no_op(body)) {
+            return body;
+        }
+        return Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition, body,
+                              op->new_expr, op->free_function);
+    }
+
+    Stmt visit(const Provide *op) override {
+        return Evaluate::make(0);
+    }
+
+    Stmt visit(const Evaluate *op) override {
+        return Evaluate::make(0);
+    }
+
+    Stmt visit(const AssertStmt *op) override {
+        return Evaluate::make(0);
+    }
+
+    Stmt visit(const Prefetch *op) override {
+        return Evaluate::make(0);
+    }
+
+public:
+    GenerateProducerBody(const string &func, Expr produced, Expr consumed, const set<string> &siblings)
+        : func(func), produced(produced), consumed(consumed), siblings(siblings) {}
+};
+
+// Replace the production of a Func with waiting for the producer
+// half, and signal the producer when each consumption is done.
+class GenerateConsumerBody : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const string &func;
+    Expr produced, consumed;
+
+    // Wait for the producer as late as possible: just before the first
+    // statement that uses func.
+    Stmt acquire_before_use(const Stmt &s) {
+        if (!uses_func(s, func)) {
+            return Block::make(s, acquire(produced, 1));
+        } else if (const Block *op = s.as<Block>()) {
+            if (uses_func(op->first, func)) {
+                return Block::make(acquire_before_use(op->first), op->rest);
+            } else {
+                return Block::make(op->first, acquire_before_use(op->rest));
+            }
+        } else if (const LetStmt *op = s.as<LetStmt>()) {
+            if (!uses_func(op->value, func)) {
+                return LetStmt::make(op->name, op->value, acquire_before_use(op->body));
+            }
+        } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+            return ProducerConsumer::make(op->name, op->is_producer, acquire_before_use(op->body));
+        } else if (const Realize *op = s.as<Realize>()) {
+            bool bounds_use_func = uses_func(op->condition, func);
+            for (const Range &r : op->bounds) {
+                bounds_use_func = bounds_use_func || uses_func(r.min, func) || uses_func(r.extent, func);
+            }
+            if (!bounds_use_func) {
+                return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition,
+                                     acquire_before_use(op->body));
+            }
+        }
+        return Block::make(acquire(produced, 1), s);
+    }
+
+    Stmt visit(const ProducerConsumer *op) override {
+        if (op->name == func) {
+            if (op->is_producer) {
+                return acquire(produced, 1);
+            } else {
+                Stmt body = mutate(op->body);
+                return Block::make(ProducerConsumer::make(op->name, false, body), release(consumed, 1));
+            }
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const Block *op) override {
+        const ProducerConsumer *consume = op->rest.as<ProducerConsumer>();
+        if (consume && !consume->is_producer && consume->name == func) {
+            // The producer half runs the production, and any
+            // conditions around it.
+            return acquire_before_use(mutate(op->rest));
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    GenerateConsumerBody(const string &func, Expr produced, Expr consumed)
+        : func(func), produced(produced), consumed(consumed) {}
+};
+
+class ForkAsyncProducers : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, Function> &env;
+
+    Stmt visit(const Realize *op) override {
+        Stmt body = mutate(op->body);
+
+        auto it = env.find(op->name);
+        if (it == env.end() || !it->second.schedule().async()) {
+            if (body.same_as(op->body)) {
+                return op;
+            }
+            return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body);
+        }
+        realized.insert(op->name);
+
+        user_assert(!it->second.schedule().memoized())
+            << "Func " << op->name << " is scheduled both async() and memoize(), "
+            << "which isn't supported.\n";
+
+        debug(3) << "Forking the producer of " << op->name << "\n";
+
+        string produced_name = op->name + ".produced_semaphore";
+        string consumed_name = op->name + ".consumed_semaphore";
+        Expr produced = Variable::make(Handle(), produced_name);
+        Expr consumed = Variable::make(Handle(), consumed_name);
+
+        FindProductions siblings(op->name);
+        body.accept(&siblings);
+
+        Stmt producer = GenerateProducerBody(op->name, produced, consumed, siblings.result).mutate(body);
+        Stmt consumer = GenerateConsumerBody(op->name, produced, consumed).mutate(body);
+        producer = Block::make(poison_on_exit(produced), producer);
+        consumer = Block::make(poison_on_exit(consumed), consumer);
+
+        // CodeGen_LLVM runs the two iterations of this loop on
+        // separate threads, with halide_do_concurrent_tasks.
+        string fork_name = op->name + ".__async_fork";
+        Expr fork = Variable::make(Int(32), fork_name);
+        Stmt s = IfThenElse::make(fork == 0, producer, consumer);
+        s = For::make(fork_name, 0, 2, ForType::Parallel, DeviceAPI::None, s);
+        s = LetStmt::make(consumed_name, Call::make(Handle(), "halide_make_semaphore", {2}, Call::Extern), s);
+        s = LetStmt::make(produced_name, Call::make(Handle(), "halide_make_semaphore", {0}, Call::Extern), s);
+        return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, s);
+    }
+
+public:
+    set<string> realized;
+    ForkAsyncProducers(const map<string, Function> &env) : env(env) {}
+};
+
+}  // namespace
+
+Stmt fork_async_producers(Stmt s, const map<string, Function> &env) {
+    ForkAsyncProducers fork(env);
+    s = fork.mutate(s);
+
+    for (const auto &p : env) {
+        const Function &f = p.second;
+        if (f.schedule().async() && !fork.realized.count(f.name())) {
+            user_assert(!f.schedule().compute_level().is_inlined())
+                << "Func " << f.name() << " is scheduled async(), but it is computed inline. "
+                << "Async Funcs must be scheduled compute_root() or compute_at().\n";
+            user_error << "Func " << f.name() << " is scheduled async(), but it isn't "
+                       << "stored in a buffer allocated by the pipeline. The outputs of a "
+                       << "pipeline can't be async.\n";
+        }
+    }
+
+    return s;
+}
+
+}  // namespace Internal
+}  // namespace Halide
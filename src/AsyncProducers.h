@@ -0,0 +1,29 @@
+#ifndef HALIDE_ASYNC_PRODUCERS_H
+#define HALIDE_ASYNC_PRODUCERS_H
+
+/** \file
+ * Defines the lowering pass that runs the producers of Funcs
+ * scheduled async() concurrently with their consumers.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Split the body of the realization of each Func scheduled async()
+ * into two halves that run at the same time on different threads: one
+ * that only computes the Func, and one that does everything else. The
+ * halves synchronize with a pair of semaphores, so that the producer
+ * runs at most one iteration of the enclosing loops ahead of the
+ * consumer. */
+Stmt fork_async_producers(Stmt s, const std::map<std::string, Function> &env);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <fstream>
+#include <mutex>
 #include <regex>
 
 #include "AutoSchedule.h"
@@ -13,6 +15,7 @@
 #include "RegionCosts.h"
 #include "Scope.h"
 #include "Simplify.h"
+#include "ThreadPool.h"
 #include "Util.h"
 
 namespace Halide {
@@ -28,6 +31,20 @@ using std::vector;
 
 namespace {
 
+// Get the value of a constant expression as a double.
+bool get_const_double(const Expr &e, double *value) {
+    if (!e.defined()) {
+        return false;
+    }
+    Expr simplified = simplify(cast<double>(e));
+    const double *f = as_const_float(simplified);
+    if (f == nullptr) {
+        return false;
+    }
+    *value = *f;
+    return true;
+}
+
 // Substitute parameter estimates into the exprs describing the box bounds.
 void substitute_estimates_box(Box &box) {
     box.used = subsitute_var_estimates(box.used);
@@ -75,19 +92,6 @@ void merge_regions(map<string, Box> &result, const map<string, Box> &partial) {
     }
 }
 
-// Replace all occurrences of non-alphanumeric chars in 'name' with '_'.
-string get_sanitized_name(string name) {
-    if (isdigit(name[0])) {
-        name = "_" + name;
-    }
-    for (size_t i = 0; i < name.size(); ++i) {
-        if (!isalnum(name[i])) {
-            name[i] = '_';
-        }
-    }
-    return name;
-}
-
 // Representation of a function stage in the pipeline.
 struct FStage {
     Function func;
@@ -164,8 +168,10 @@ struct DependenceAnalysis {
             : bounds(b), regions(r) {}
     };
     // Cache for bounds queries (bound queries with the same parameters are
-    // common during the grouping process).
+    // common during the grouping process). The grouping choices are evaluated
+    // concurrently, so the cache is guarded by 'regions_required_mutex'.
     map<RegionsRequiredQuery, vector<RegionsRequired>> regions_required_cache;
+    std::mutex regions_required_mutex;
 
     DependenceAnalysis(const map<string, Function> &env, const vector<string> &order,
                        const FuncValueBounds &func_val_bounds)
@@ -367,13 +373,16 @@ DependenceAnalysis::regions_required(Function f, int stage_num,
 
     // Check the cache if we've already computed this previously.
     RegionsRequiredQuery query(f.name(), stage_num, prods, only_regions_computed);
-    const auto &iter = regions_required_cache.find(query);
-    if (iter != regions_required_cache.end()) {
-        const auto &it = std::find_if(iter->second.begin(), iter->second.end(),
-            [&bounds](const RegionsRequired &r) { return (r.bounds == bounds); });
-        if (it != iter->second.end()) {
-            internal_assert((iter->first == query) && (it->bounds == bounds));
-            return it->regions;
+    {
+        std::lock_guard<std::mutex> lock(regions_required_mutex);
+        const auto &iter = regions_required_cache.find(query);
+        if (iter != regions_required_cache.end()) {
+            const auto &it = std::find_if(iter->second.begin(), iter->second.end(),
+                [&bounds](const RegionsRequired &r) { return (r.bounds == bounds); });
+            if (it != iter->second.end()) {
+                internal_assert((iter->first == query) && (it->bounds == bounds));
+                return it->regions;
+            }
         }
     }
 
@@ -556,6 +565,7 @@ DependenceAnalysis::regions_required(Function f, int stage_num,
         concrete_regions[f_reg.first] = concrete_box;
     }
 
+    std::lock_guard<std::mutex> lock(regions_required_mutex);
     regions_required_cache[query].push_back(RegionsRequired(bounds, concrete_regions));
     return concrete_regions;
 }
@@ -960,6 +970,10 @@ struct Partitioner {
         // Estimate of the parallelism that can be exploited while computing
         // the group.
         Expr parallelism;
+        // Features of the group given to the cost model, if the estimates
+        // are constant.
+        GroupFeatures features;
+        bool has_features = false;
 
         GroupAnalysis() : cost(Cost()) , parallelism(Expr()) {}
         GroupAnalysis(const Cost &c, Expr p) : cost(c), parallelism(std::move(p)) {}
@@ -1001,6 +1015,11 @@ struct Partitioner {
     // re-evaluated and caching them improves performance significantly.
     map<GroupingChoice, GroupConfig> grouping_cache;
 
+    // Threads on which the grouping choices and tile configurations are
+    // evaluated. The evaluations only read the current grouping; the region
+    // and cost queries they share are memoized behind locks.
+    ThreadPool<GroupConfig> thread_pool;
+
     // Each group in the pipeline has a single output stage. A group is comprised
     // of function stages that are computed together in tiles (stages of a function
     // are always grouped together). 'groups' is the mapping from the output stage
@@ -1025,6 +1044,10 @@ struct Partitioner {
     // Parameters of the machine model that is used for estimating the cost of each
     // group in the pipeline.
     const MachineParams &arch_params;
+    // The cost model used instead of the analytical one, if any.
+    std::shared_ptr<const AutoScheduleCostModel> cost_model;
+    // Target the schedule is generated for.
+    const Target &target;
     // Dependency analysis of the pipeline. This support queries on regions
     // accessed and computed for producing some regions of some functions.
     DependenceAnalysis &dep_analysis;
@@ -1036,6 +1059,8 @@ struct Partitioner {
 
     Partitioner(const map<string, Box> &_pipeline_bounds,
                 const MachineParams &_arch_params,
+                std::shared_ptr<const AutoScheduleCostModel> _cost_model,
+                const Target &_target,
                 const vector<Function> &_outputs,
                 DependenceAnalysis &_dep_analysis,
                 RegionCosts &_costs);
@@ -1117,6 +1142,10 @@ struct Partitioner {
     // groups within the pipeline.
     Cost get_pipeline_cost();
 
+    // Append the sum of the featurized groups of the pipeline to a file, for
+    // retraining the linear cost model.
+    void dump_features(const string &filename);
+
     // Return the maximum access stride to allocation of 'func_acc' along any
     // loop variable specified in 'vars'. Access expressions along each dimension
     // of the allocation are specified by 'acc_exprs'. The dimension bounds of the
@@ -1172,6 +1201,44 @@ struct Partitioner {
         Function func, bool is_group_output, const Target &t, set<string> &rvars,
         map<string, Expr> &estimates, AutoSchedule &sched);
 
+    // If function stage 'f_handle' accumulates the products of two inputs
+    // over a reduction domain, as a matrix multiply (or a convolution written
+    // as one) does, block it the way a hand-written GEMM micro-kernel would:
+    // a tile of the output of a few vectors by a few rows is kept in registers
+    // while the reduction runs innermost, so that each vector load of one
+    // input is reused across the rows and each element of the other input
+    // is broadcast across the vectors. Return false if the stage does not
+    // have that form or is too small to block.
+    bool block_matrix_multiply(
+        const Group &g, Stage f_handle, int stage_num, Definition def,
+        Function func, bool is_group_output, const Target &t,
+        map<string, Expr> &estimates, AutoSchedule &sched);
+
+    // On GPU targets, return the pure dimensions among 'vars' (innermost
+    // first) that are mapped to the threads of a block: the innermost ones,
+    // at most three, whose total extent as given by 'extents' fits in a block.
+    vector<string> choose_gpu_thread_dims(const vector<string> &vars,
+                                          const map<string, Expr> &extents);
+
+    // Return true if a tile of group 'g' can be computed by a GPU block: the
+    // output and every member computed in the tile have threads to run on,
+    // and the values of the members fit in shared memory.
+    bool fits_gpu_block(const Group &g, const map<string, Box> &compute_regions,
+                        const map<string, Box> &alloc_regions);
+
+    // Map the tile loops of the output stage 'f_handle' of a group to GPU
+    // blocks and the loops within a tile to GPU threads, updating 'inner_dims'
+    // and 'outer_dims' to the new loop order. Return false if the stage has no
+    // pure dimensions to map.
+    bool gpu_map_tiles(Stage f_handle, int stage_num, const vector<Dim> &dims,
+                       vector<VarOrRVar> &inner_dims, vector<VarOrRVar> &outer_dims,
+                       const map<string, Expr> &estimates, AutoSchedule &sched);
+
+    // Map the loops of a member stage computed at the block level of a group to
+    // the threads of the block.
+    void gpu_map_threads(Stage f_handle, int stage_num, Definition def,
+                         const map<string, Expr> &estimates, AutoSchedule &sched);
+
     // Reorder the dimensions to preserve spatial locality. This function
     // checks the stride of each access. The dimensions of the loop are reordered
     // such that the dimension with the smallest access stride is innermost.
@@ -1221,6 +1288,33 @@ void Partitioner::disp_pipeline_bounds() {
     debug(0) << "===============" << '\n';
 }
 
+void Partitioner::dump_features(const string &filename) {
+    vector<double> total(LinearCostModel::num_features, 0);
+    for (const pair<FStage, Group> &g : groups) {
+        const GroupAnalysis &analysis = get_element(group_costs, g.first);
+        if (!analysis.has_features) {
+            user_warning << "Not dumping the features of the pipeline to " << filename
+                         << ", since the estimates of " << g.first << " aren't constant.\n";
+            return;
+        }
+        vector<double> features = LinearCostModel::featurize(analysis.features);
+        for (int i = 0; i < (int)features.size(); i++) {
+            total[i] += features[i];
+        }
+    }
+    std::ofstream out(filename, std::ios::app);
+    user_assert(out.is_open()) << "Can't write features to " << filename << "\n";
+    out.precision(17);
+    for (const auto &f : outputs) {
+        out << f.name() << " ";
+    }
+    out << ":";
+    for (double f : total) {
+        out << " " << f;
+    }
+    out << "\n";
+}
+
 Cost Partitioner::get_pipeline_cost() {
     internal_assert(!group_costs.empty());
 
@@ -1276,10 +1370,13 @@ void Partitioner::disp_pipeline_costs() {
 // algorithm operates.
 Partitioner::Partitioner(const map<string, Box> &_pipeline_bounds,
                          const MachineParams &_arch_params,
+                         std::shared_ptr<const AutoScheduleCostModel> _cost_model,
+                         const Target &_target,
                          const vector<Function> &_outputs,
                          DependenceAnalysis &_dep_analysis,
                          RegionCosts &_costs)
         : pipeline_bounds(_pipeline_bounds), arch_params(_arch_params),
+          cost_model(std::move(_cost_model)), target(_target),
           dep_analysis(_dep_analysis), costs(_costs), outputs(_outputs) {
     // Place each stage of a function in its own group. Each stage is
     // a node in the pipeline graph.
@@ -1325,10 +1422,19 @@ Partitioner::Partitioner(const map<string, Box> &_pipeline_bounds,
 }
 
 void Partitioner::initialize_groups() {
+    vector<std::future<GroupConfig>> configs;
+    for (const pair<const FStage, Group> &g : groups) {
+        const Group *group = &g.second;
+        configs.push_back(thread_pool.async([this, group]() {
+            pair<map<string, Expr>, GroupAnalysis> best = find_best_tile_config(*group);
+            return GroupConfig(best.first, best.second);
+        }));
+    }
+    size_t i = 0;
     for (pair<const FStage, Group> &g : groups) {
-        pair<map<string, Expr>, GroupAnalysis> best = find_best_tile_config(g.second);
-        g.second.tile_sizes = best.first;
-        group_costs.emplace(g.second.output, best.second);
+        GroupConfig best = configs[i++].get();
+        g.second.tile_sizes = best.tile_sizes;
+        group_costs.emplace(g.second.output, best.analysis);
     }
     grouping_cache.clear();
 }
@@ -1380,6 +1486,31 @@ map<string, Expr> Partitioner::evaluate_reuse(const FStage &stg,
 vector<pair<Partitioner::GroupingChoice, Partitioner::GroupConfig>>
 Partitioner::choose_candidate_grouping(const vector<pair<string, string>> &cands,
                                        Partitioner::Level level) {
+    // Evaluate the choices which have not been evaluated for grouping before
+    // concurrently, and cache the results.
+    vector<GroupingChoice> new_choices;
+    set<GroupingChoice> seen;
+    for (const auto &p : cands) {
+        const Function &prod_f = get_element(dep_analysis.env, p.first);
+        FStage prod(prod_f, prod_f.updates().size());
+        for (const FStage &c : get_element(children, prod)) {
+            GroupingChoice cand_choice(prod_f.name(), c);
+            if ((grouping_cache.find(cand_choice) == grouping_cache.end()) &&
+                seen.insert(cand_choice).second) {
+                new_choices.push_back(cand_choice);
+            }
+        }
+    }
+    vector<std::future<GroupConfig>> new_configs;
+    for (const auto &choice : new_choices) {
+        new_configs.push_back(thread_pool.async([this, choice, level]() {
+            return evaluate_choice(choice, level);
+        }));
+    }
+    for (size_t i = 0; i < new_choices.size(); i++) {
+        grouping_cache.emplace(new_choices[i], new_configs[i].get());
+    }
+
     vector<pair<GroupingChoice, GroupConfig>> best_grouping;
     Expr best_benefit = make_zero(Int(64));
     for (const auto &p : cands) {
@@ -1392,20 +1523,8 @@ Partitioner::choose_candidate_grouping(const vector<pair<string, string>> &cands
         FStage prod(prod_f, final_stage);
 
         for (const FStage &c : get_element(children, prod)) {
-            GroupConfig best_config;
             GroupingChoice cand_choice(prod_f.name(), c);
-
-            // Check if the candidate has been evaluated for grouping before
-            const auto &iter = grouping_cache.find(cand_choice);
-            if (iter != grouping_cache.end()) {
-                best_config = iter->second;
-            } else {
-                best_config = evaluate_choice(cand_choice, level);
-                // Cache the result of the evaluation for the pair
-                grouping_cache.emplace(cand_choice, best_config);
-            }
-
-            grouping.push_back(make_pair(cand_choice, best_config));
+            grouping.push_back(make_pair(cand_choice, get_element(grouping_cache, cand_choice)));
         }
 
         bool no_redundant_work = false;
@@ -1824,6 +1943,11 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
     map<string, Box> compute_regions = dep_analysis.regions_required(
         g.output.func, g.output.stage_num, tile_bounds, group_members, true, &costs.input_estimates);
 
+    if (target.has_gpu_feature() && !g.tile_sizes.empty() &&
+        !fits_gpu_block(g, compute_regions, alloc_regions)) {
+        return GroupAnalysis();
+    }
+
     map<string, Box> group_reg, prod_reg, input_reg;
 
     // Separating into regions that computed within the group and regions that
@@ -1990,11 +2114,65 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
         debug(0) << "Per tile arith cost:" << per_tile_cost.arith << '\n';
     }
 
-    GroupAnalysis g_analysis(
-        Cost(per_tile_cost.arith * estimate_tiles, per_tile_cost.memory * estimate_tiles),
-        parallelism);
+    // Features of the group for the cost model. They are only known if all
+    // the estimates are constant.
+    GroupFeatures features;
+    bool has_features =
+        get_const_double(group_cost.arith * estimate_tiles, &features.arith) &&
+        get_const_double(estimate_tiles, &features.num_tiles) &&
+        get_const_double(min(parallelism, arch_params.parallelism), &features.parallelism);
+    features.bytes_loaded = 0;
+    for (const auto &f_load : group_load_costs) {
+        double bytes;
+        has_features = has_features &&
+            get_const_double(f_load.second * estimate_tiles, &bytes);
+        features.bytes_loaded += has_features ? bytes : 0;
+    }
+    features.footprint = 0;
+    for (const auto &reg : alloc_regions) {
+        if (group_members.find(reg.first) != group_members.end() &&
+                reg.first != g.output.func.name()) {
+            double bytes;
+            has_features = has_features &&
+                get_const_double(costs.region_size(reg.first, reg.second), &bytes);
+            features.footprint += has_features ? bytes : 0;
+        }
+    }
+    double stored;
+    if (!out_tile_extent.empty() &&
+            get_const_double(costs.region_size(g.output.func.name(), out_tile_extent) * estimate_tiles,
+                             &stored)) {
+        features.bytes_stored = stored;
+    }
+    features.vector_width = target.natural_vector_size(g.output.func.output_types()[0]);
+
+    GroupAnalysis g_analysis;
+    if (cost_model) {
+        if (!has_features) {
+            return GroupAnalysis();
+        }
+        double arith_cost, memory_cost;
+        cost_model->evaluate(features, &arith_cost, &memory_cost);
+        g_analysis = GroupAnalysis(Cost(Expr(arith_cost), Expr(memory_cost)), parallelism);
+    } else {
+        g_analysis = GroupAnalysis(
+            Cost(per_tile_cost.arith * estimate_tiles, per_tile_cost.memory * estimate_tiles),
+            parallelism);
+    }
+    g_analysis.features = features;
+    g_analysis.has_features = has_features;
     g_analysis.simplify();
 
+    if (show_analysis && has_features) {
+        debug(0) << "Features: arith " << features.arith
+                 << ", loads " << features.bytes_loaded
+                 << ", stores " << features.bytes_stored
+                 << ", footprint " << features.footprint
+                 << ", tiles " << features.num_tiles
+                 << ", parallelism " << features.parallelism
+                 << ", vector width " << features.vector_width << "\n";
+    }
+
     return g_analysis;
 }
 
@@ -2468,6 +2646,160 @@ void Partitioner::vectorize_stage(const Group &g, Stage f_handle, int stage_num,
     }
 }
 
+// Remove the casts from 'e', such as the widening of the operands of a
+// product accumulated at a higher precision.
+Expr strip_casts(Expr e) {
+    while (const Cast *cast = e.as<Cast>()) {
+        e = cast->value;
+    }
+    return e;
+}
+
+// Return true if the update definition 'def' of 'func' is of the form
+// func(args) = func(args) + a * b (in either order), setting 'a' and 'b'
+// to the operands of the product without their casts.
+bool match_accumulated_product(const Function &func, const Definition &def,
+                               Expr &a, Expr &b) {
+    if (def.values().size() != 1) {
+        return false;
+    }
+    const Add *add = def.values()[0].as<Add>();
+    if (!add) {
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        const Call *self = (i == 0 ? add->a : add->b).as<Call>();
+        const Mul *mul = (i == 0 ? add->b : add->a).as<Mul>();
+        if (!self || !mul || (self->call_type != Call::Halide) ||
+            (self->name != func.name()) || (self->args.size() != def.args().size())) {
+            continue;
+        }
+        bool same_site = true;
+        for (size_t j = 0; j < self->args.size(); j++) {
+            same_site = same_site && equal(self->args[j], def.args()[j]);
+        }
+        if (same_site) {
+            a = strip_casts(mul->a);
+            b = strip_casts(mul->b);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Partitioner::block_matrix_multiply(const Group &g, Stage f_handle, int stage_num,
+                                        Definition def, Function func, bool is_group_output,
+                                        const Target &t, map<string, Expr> &estimates,
+                                        AutoSchedule &sched) {
+    Expr a, b;
+    if ((stage_num == 0) || !match_accumulated_product(func, def, a, b)) {
+        return false;
+    }
+
+    const vector<ReductionVariable> &rvars = def.schedule().rvars();
+    Scope<> rvar_scope;
+    for (const ReductionVariable &rv : rvars) {
+        rvar_scope.push(rv.var);
+    }
+    if (rvars.empty() || !a.as<Call>() || !b.as<Call>() ||
+        !expr_uses_vars(a, rvar_scope) || !expr_uses_vars(b, rvar_scope)) {
+        return false;
+    }
+
+    // The update must be to a single site, at the pure vars, with the
+    // innermost of them vectorized.
+    vector<string> pure_vars;
+    for (const Expr &arg : def.args()) {
+        const Variable *v = arg.as<Variable>();
+        if (!v || v->reduction_domain.defined()) {
+            return false;
+        }
+        pure_vars.push_back(v->name);
+    }
+    if (pure_vars.size() < 2) {
+        return false;
+    }
+    const string &x = pure_vars[0];
+
+    // One operand is loaded as vectors along x, which must be its innermost
+    // dimension. The other does not depend on x and is broadcast.
+    if (expr_uses_var(a, x)) {
+        std::swap(a, b);
+    }
+    const Call *vec_load = b.as<Call>();
+    if (expr_uses_var(a, x) || vec_load->args.empty() ||
+        !expr_uses_var(vec_load->args[0], x)) {
+        return false;
+    }
+    for (size_t i = 1; i < vec_load->args.size(); i++) {
+        if (expr_uses_var(vec_load->args[i], x)) {
+            return false;
+        }
+    }
+
+    // The rows of the block are along a pure var that only the broadcast
+    // operand depends on, so that the vector loads are shared by the rows.
+    string y;
+    for (size_t i = 1; i < pure_vars.size(); i++) {
+        if (expr_uses_var(a, pure_vars[i]) && !expr_uses_var(b, pure_vars[i])) {
+            y = pure_vars[i];
+            break;
+        }
+    }
+    if (y.empty()) {
+        return false;
+    }
+
+    // Each row of the block is two vectors, which is enough independent
+    // multiply-adds to hide their latency, and there are four rows, so that
+    // the accumulators fit in the registers of all targets.
+    int vec_len = t.natural_vector_size(def.values()[0].type());
+    const int block_rows = 4;
+    const auto &x_iter = estimates.find(x);
+    const auto &y_iter = estimates.find(y);
+    if ((x_iter == estimates.end()) || !x_iter->second.defined() ||
+        (y_iter == estimates.end()) || !y_iter->second.defined() ||
+        !can_prove(x_iter->second >= 2 * vec_len) ||
+        !can_prove(y_iter->second >= block_rows)) {
+        return false;
+    }
+
+    pair<VarOrRVar, VarOrRVar> x_vars =
+        split_dim(g, f_handle, stage_num, def, is_group_output, VarOrRVar(x, false),
+                  2 * vec_len, "_vi", "_vo", estimates, sched);
+    pair<VarOrRVar, VarOrRVar> y_vars =
+        split_dim(g, f_handle, stage_num, def, is_group_output, VarOrRVar(y, false),
+                  block_rows, "_ui", "_uo", estimates, sched);
+
+    // The block is innermost, then the reduction, so that the accumulators
+    // are loaded and stored once per block rather than once per product.
+    vector<VarOrRVar> ordering = {x_vars.first, y_vars.first};
+    for (const ReductionVariable &rv : rvars) {
+        ordering.push_back(VarOrRVar(rv.var, true));
+    }
+    ordering.push_back(x_vars.second);
+    ordering.push_back(y_vars.second);
+
+    set<string> var_list;
+    string var_order;
+    for (const VarOrRVar &v : ordering) {
+        var_order += (var_order.empty() ? "" : ", ") + v.name();
+        var_list.insert(v.name());
+    }
+    f_handle.reorder(ordering);
+    sched.push_schedule(f_handle.name(), stage_num, "reorder(" + var_order + ")", var_list);
+
+    f_handle.vectorize(x_vars.first);
+    sched.push_schedule(f_handle.name(), stage_num,
+                        "vectorize(" + x_vars.first.name() + ")",
+                        {x_vars.first.name()});
+    f_handle.unroll(y_vars.first);
+    sched.push_schedule(f_handle.name(), stage_num,
+                        "unroll(" + y_vars.first.name() + ")",
+                        {y_vars.first.name()});
+    return true;
+}
+
 // Return true if the vars/rvars in 'ordering' are in the same order as the
 // dim list.
 inline bool operator==(const vector<Dim> &dims, const vector<VarOrRVar> &ordering) {
@@ -2674,18 +3006,50 @@ void Partitioner::generate_group_cpu_schedule(
         }
     }
 
+    // A group that computes nothing but its output, which accumulates
+    // products over a reduction, is blocked as a matrix multiply instead of
+    // being tiled and vectorized.
+    bool blocked = false;
+    if (!t.has_gpu_feature()) {
+        bool only_output = true;
+        for (const FStage &mem : g.members) {
+            only_output = only_output &&
+                ((g.inlined.find(mem.func.name()) != g.inlined.end()) ||
+                 (mem.func.name() == g_out.name()));
+        }
+        blocked = only_output &&
+            block_matrix_multiply(g, f_handle, g.output.stage_num, def, g_out, true,
+                                  t, stg_estimates, sched);
+    }
+
     vector<string> dim_vars(dims.size() - 1);
     for (int d = 0; d < (int)dims.size() - 1; d++) {
         dim_vars[d] = get_base_name(dims[d].var);
     }
 
+    // On GPU targets, the output of the group is always tiled so that it can
+    // be mapped to blocks and threads. Untiled groups get 16x16 (or 256 wide
+    // if one dimensional) tiles over their innermost pure dimensions.
+    map<string, Expr> tile_sizes = blocked ? map<string, Expr>() : g.tile_sizes;
+    if (t.has_gpu_feature() && tile_sizes.empty()) {
+        vector<string> pure_vars;
+        for (const auto &var : dim_vars) {
+            if (rvars.find(var) == rvars.end()) {
+                pure_vars.push_back(var);
+            }
+        }
+        for (size_t i = 0; i < std::min(pure_vars.size(), (size_t)2); i++) {
+            tile_sizes[pure_vars[i]] = (pure_vars.size() == 1) ? 256 : 16;
+        }
+    }
+
     // Apply tiling to output of the group
     for (const auto &var : dim_vars) {
         bool is_rvar = (rvars.find(var) != rvars.end());
         VarOrRVar v(var, is_rvar);
 
-        const auto &iter = g.tile_sizes.find(var);
-        if ((iter != g.tile_sizes.end()) &&
+        const auto &iter = tile_sizes.find(var);
+        if ((iter != tile_sizes.end()) &&
             get_element(stg_estimates, var).defined() &&
             can_prove(get_element(stg_estimates, var) > iter->second)) {
             const Expr &tile_size = iter->second;
@@ -2735,8 +3099,16 @@ void Partitioner::generate_group_cpu_schedule(
         }
     }
 
-    vectorize_stage(g, f_handle, g.output.stage_num, def, g_out, true, t,
-                    rvars, stg_estimates, sched);
+    // On GPU targets, the tiles are mapped to blocks and threads instead of
+    // being vectorized and parallelized.
+    bool gpu_mapped = false;
+    if (t.has_gpu_feature()) {
+        gpu_mapped = gpu_map_tiles(f_handle, g.output.stage_num, dims, inner_dims,
+                                   outer_dims, stg_estimates, sched);
+    } else if (!blocked) {
+        vectorize_stage(g, f_handle, g.output.stage_num, def, g_out, true, t,
+                        rvars, stg_estimates, sched);
+    }
 
     // Parallelize definition
     Expr def_par = 1;
@@ -2744,15 +3116,16 @@ void Partitioner::generate_group_cpu_schedule(
     // parallelize over it or to generate nested parallelism.
     //
     // Go from the outer to the innermost loop until sufficient parallelism
-    // is achieved. Stop the search once we find a vectorized dimension since
-    // it doesn't make any sense to have a parallelized inner loop within a
-    // vectorized outer loop.
-    bool nested_parallelism = true;
+    // is achieved. Stop the search once we find a vectorized or unrolled
+    // dimension since it doesn't make any sense to have a parallelized inner
+    // loop within a vectorized outer loop, or to undo the unrolling of a block.
+    bool nested_parallelism = !t.has_gpu_feature();
     if (nested_parallelism) {
         int dim_start = dims.size() - 2;
         string seq_var = "";
         for (int d = dim_start; d >= 0; d--) {
-            if (dims[d].for_type == ForType::Vectorized) {
+            if ((dims[d].for_type == ForType::Vectorized) ||
+                (dims[d].for_type == ForType::Unrolled)) {
                 break;
             }
 
@@ -2792,7 +3165,7 @@ void Partitioner::generate_group_cpu_schedule(
         }
     }
 
-    if (can_prove(def_par < arch_params.parallelism)) {
+    if (nested_parallelism && can_prove(def_par < arch_params.parallelism)) {
         user_warning << "Insufficient parallelism for " << f_handle.name() << '\n';
     }
 
@@ -2844,6 +3217,11 @@ void Partitioner::generate_group_cpu_schedule(
                 sched.push_schedule(mem_handle.name(), mem.stage_num,
                                     "compute_at(" + sanitized_g_out + ", " + tile_inner_var.name() + ")",
                                     {sanitized_g_out, tile_inner_var.name()});
+                if (gpu_mapped) {
+                    Func(mem.func).store_in(MemoryType::GPUShared);
+                    sched.push_schedule(mem_handle.name(), mem.stage_num,
+                                        "store_in(MemoryType::GPUShared)", {});
+                }
             } else {
                 user_warning << "Degenerate tiling. No dimensions are tiled" << '\n';
                 user_warning << "Computing \"" <<  mem.func.name() << "\" at root" << '\n';
@@ -2862,8 +3240,216 @@ void Partitioner::generate_group_cpu_schedule(
             }
         }
 
-        vectorize_stage(g, mem_handle, mem.stage_num, mem_def, mem.func, false,
-                        t, mem_rvars, mem_estimates, sched);
+        if (gpu_mapped) {
+            gpu_map_threads(mem_handle, mem.stage_num, mem_def, mem_estimates, sched);
+        } else if (!t.has_gpu_feature() &&
+                   !block_matrix_multiply(g, mem_handle, mem.stage_num, mem_def, mem.func,
+                                          false, t, mem_estimates, sched)) {
+            vectorize_stage(g, mem_handle, mem.stage_num, mem_def, mem.func, false,
+                            t, mem_rvars, mem_estimates, sched);
+        }
+    }
+}
+
+vector<string> Partitioner::choose_gpu_thread_dims(const vector<string> &vars,
+                                                   const map<string, Expr> &extents) {
+    vector<string> threads;
+    Expr num_threads = make_one(Int(64));
+    for (const string &var : vars) {
+        const auto &iter = extents.find(var);
+        if ((threads.size() == 3) || (iter == extents.end()) || !iter->second.defined()) {
+            break;
+        }
+        Expr total = simplify(num_threads * iter->second);
+        if (!can_prove(total <= arch_params.gpu_max_threads_per_block)) {
+            break;
+        }
+        threads.push_back(var);
+        num_threads = total;
+    }
+    return threads;
+}
+
+bool Partitioner::fits_gpu_block(const Group &g, const map<string, Box> &compute_regions,
+                                 const map<string, Box> &alloc_regions) {
+    if (g.output.func.has_extern_definition()) {
+        return true;
+    }
+
+    // The output needs a tiled pure dimension to map to the blocks and pure
+    // dimensions within a tile to map to the threads.
+    const vector<Dim> &dims = get_stage_dims(g.output.func, g.output.stage_num);
+    DimBounds stg_bounds = get_bounds(g.output);
+    vector<string> thread_vars;
+    map<string, Expr> extents;
+    bool has_blocks = false;
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        const string &var = dims[d].var;
+        if (dims[d].is_rvar()) {
+            continue;
+        }
+        Expr extent = get_extent(get_element(stg_bounds, var));
+        const auto &iter = g.tile_sizes.find(var);
+        if ((iter != g.tile_sizes.end()) && extent.defined() &&
+            can_prove(extent > iter->second)) {
+            has_blocks = true;
+            if (can_prove(iter->second == 1)) {
+                continue;
+            }
+            extent = iter->second;
+        }
+        thread_vars.push_back(var);
+        extents[var] = extent;
+    }
+    if (!has_blocks || choose_gpu_thread_dims(thread_vars, extents).empty()) {
+        return false;
+    }
+
+    // The members computed in the tiles are computed by the threads of the
+    // block into shared memory.
+    Expr shared_size = make_zero(Int(64));
+    for (const FStage &mem : g.members) {
+        const string &name = mem.func.name();
+        if ((mem.stage_num > 0) || (name == g.output.func.name()) ||
+            (g.inlined.find(name) != g.inlined.end())) {
+            continue;
+        }
+        const auto &compute_iter = compute_regions.find(name);
+        const auto &alloc_iter = alloc_regions.find(name);
+        if ((compute_iter == compute_regions.end()) || (alloc_iter == alloc_regions.end())) {
+            return false;
+        }
+
+        const vector<string> &args = mem.func.args();
+        map<string, Expr> mem_extents;
+        for (size_t d = 0; d < args.size(); d++) {
+            mem_extents[args[d]] = get_extent(compute_iter->second[d]);
+        }
+        if (choose_gpu_thread_dims(args, mem_extents).empty()) {
+            return false;
+        }
+
+        Expr size = costs.region_size(name, alloc_iter->second);
+        if (!size.defined()) {
+            return false;
+        }
+        shared_size += size;
+    }
+    return can_prove(shared_size <= arch_params.gpu_shared_memory_size);
+}
+
+bool Partitioner::gpu_map_tiles(Stage f_handle, int stage_num, const vector<Dim> &dims,
+                                vector<VarOrRVar> &inner_dims, vector<VarOrRVar> &outer_dims,
+                                const map<string, Expr> &estimates, AutoSchedule &sched) {
+    vector<string> inner_pure;
+    for (const auto &v : inner_dims) {
+        if (!v.is_rvar) {
+            inner_pure.push_back(v.name());
+        }
+    }
+    vector<string> threads = choose_gpu_thread_dims(inner_pure, estimates);
+
+    // The innermost (at most three) pure tile dimensions are the blocks; the
+    // other tile dimensions are serial loops around the kernel.
+    vector<VarOrRVar> blocks, serial_outer;
+    for (const auto &v : outer_dims) {
+        if (!v.is_rvar && (blocks.size() < 3)) {
+            blocks.push_back(v);
+        } else {
+            serial_outer.push_back(v);
+        }
+    }
+
+    if (threads.empty() || blocks.empty()) {
+        user_warning << "Could not map \"" << f_handle.name()
+                     << "\" to GPU blocks and threads\n";
+        return false;
+    }
+
+    vector<VarOrRVar> thread_dims, serial_inner;
+    for (const auto &v : inner_dims) {
+        if (std::find(threads.begin(), threads.end(), v.name()) != threads.end()) {
+            thread_dims.push_back(v);
+        } else {
+            serial_inner.push_back(v);
+        }
+    }
+
+    inner_dims = serial_inner;
+    inner_dims.insert(inner_dims.end(), thread_dims.begin(), thread_dims.end());
+    outer_dims = blocks;
+    outer_dims.insert(outer_dims.end(), serial_outer.begin(), serial_outer.end());
+
+    vector<VarOrRVar> ordering = inner_dims;
+    ordering.insert(ordering.end(), outer_dims.begin(), outer_dims.end());
+    if (dims != ordering) {
+        set<string> var_list;
+        string var_order = ordering[0].name();
+        for (size_t o = 1; o < ordering.size(); o++) {
+            var_order += ", " + ordering[o].name();
+            var_list.insert(ordering[o].name());
+        }
+        f_handle.reorder(ordering);
+        sched.push_schedule(f_handle.name(), stage_num,
+                            "reorder(" + var_order + ")", var_list);
+    }
+
+    for (const auto &v : thread_dims) {
+        f_handle.gpu_threads(v);
+        sched.push_schedule(f_handle.name(), stage_num,
+                            "gpu_threads(" + v.name() + ")", {v.name()});
+    }
+    for (const auto &v : blocks) {
+        f_handle.gpu_blocks(v);
+        sched.push_schedule(f_handle.name(), stage_num,
+                            "gpu_blocks(" + v.name() + ")", {v.name()});
+    }
+    return true;
+}
+
+void Partitioner::gpu_map_threads(Stage f_handle, int stage_num, Definition def,
+                                  const map<string, Expr> &estimates, AutoSchedule &sched) {
+    const vector<Dim> &dims = def.schedule().dims();
+    vector<string> pure_vars;
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        if (!dims[d].is_rvar()) {
+            pure_vars.push_back(get_base_name(dims[d].var));
+        }
+    }
+    vector<string> threads = choose_gpu_thread_dims(pure_vars, estimates);
+    if (threads.empty()) {
+        debug(3) << "No GPU threads for " << f_handle.name() << "\n";
+        return;
+    }
+
+    // The threads are the outermost loops of the stage
+    vector<VarOrRVar> ordering, thread_dims;
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        string var = get_base_name(dims[d].var);
+        VarOrRVar v(var, dims[d].is_rvar());
+        if (std::find(threads.begin(), threads.end(), var) != threads.end()) {
+            thread_dims.push_back(v);
+        } else {
+            ordering.push_back(v);
+        }
+    }
+    ordering.insert(ordering.end(), thread_dims.begin(), thread_dims.end());
+    if (dims != ordering) {
+        set<string> var_list;
+        string var_order = ordering[0].name();
+        for (size_t o = 1; o < ordering.size(); o++) {
+            var_order += ", " + ordering[o].name();
+            var_list.insert(ordering[o].name());
+        }
+        f_handle.reorder(ordering);
+        sched.push_schedule(f_handle.name(), stage_num,
+                            "reorder(" + var_order + ")", var_list);
+    }
+
+    for (const auto &v : thread_dims) {
+        f_handle.gpu_threads(v);
+        sched.push_schedule(f_handle.name(), stage_num,
+                            "gpu_threads(" + v.name() + ")", {v.name()});
     }
 }
 
@@ -3160,6 +3746,72 @@ string is_func_called_element_wise(const vector<string> &order, size_t index,
     return caller;
 }
 
+// Estimate the size of the expression trees of a definition once the calls
+// to a Func are inlined into it, without building them. Shared subexpressions
+// are counted once for each of their uses, as they would be by the simplifier.
+class InlinedTreeSize : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+    using IRGraphVisitor::include;
+
+    map<const IRNode *, int64_t> sizes;
+
+    void include(const Expr &e) override {
+        auto iter = sizes.find(e.get());
+        if (iter != sizes.end()) {
+            size = std::min(size + iter->second, max_size);
+            return;
+        }
+        int64_t outer = size;
+        size = 0;
+        IRGraphVisitor::include(e);
+        size = std::min(size + 1, max_size);
+        sizes[e.get()] = size;
+        size = std::min(outer + size, max_size);
+    }
+
+    void visit(const Call *op) override {
+        IRGraphVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == inlined.name()) {
+            internal_assert(op->value_index < (int)inlined_sizes.size());
+            size = std::min(size + inlined_sizes[op->value_index], max_size);
+        }
+    }
+
+public:
+    // Sizes above this are all equally too large
+    const int64_t max_size = (int64_t)1 << 40;
+    Function inlined;
+    vector<int64_t> inlined_sizes;
+    int64_t size = 0;
+
+    InlinedTreeSize(const Function &inlined) : inlined(inlined) {
+        for (const Expr &e : inlined.values()) {
+            e.accept(this);
+            inlined_sizes.push_back(size);
+            size = 0;
+        }
+    }
+
+    // The largest tree among the values and arguments of the stages of 'f'
+    int64_t max_tree_size(const Function &f) {
+        int64_t result = 0;
+        for (int s = 0; s < (int)f.updates().size() + 1; ++s) {
+            Definition def = get_stage_definition(f, s);
+            vector<Expr> exprs = def.values();
+            if (s > 0) {
+                exprs.insert(exprs.end(), def.args().begin(), def.args().end());
+            }
+            for (const Expr &e : exprs) {
+                size = 0;
+                e.accept(this);
+                result = std::max(result, size);
+            }
+        }
+        size = 0;
+        return result;
+    }
+};
+
 // Return true if 'f' is used by some extern Func.
 bool used_by_extern_func(const map<string, Function> &env, const Function &f) {
     for (const auto &iter : env) {
@@ -3297,8 +3949,13 @@ bool inline_all_trivial_functions(const vector<Function> &outputs,
 // element-wise manner.
 bool inline_all_element_wise_functions(const vector<Function> &outputs,
                                        const vector<string> &order,
-                                       const map<string, Function> &env) {
+                                       const map<string, Function> &env,
+                                       int64_t max_expr_size,
+                                       set<string> *over_budget) {
     bool inlined = false;
+    if (over_budget) {
+        over_budget->clear();
+    }
     // The very last few functions in 'order' are the last to be realized in the
     // pipeline (the final producers) so there is no point in checking it.
     for (int i = 0; i < (int)order.size() - (int)outputs.size(); ++i) {
@@ -3315,6 +3972,22 @@ bool inline_all_element_wise_functions(const vector<Function> &outputs,
             continue;
         }
         string caller = is_func_called_element_wise(order, i, env);
+        if (!caller.empty() && max_expr_size > 0) {
+            // Each call site of the Func gets a copy of its values, so
+            // chains of element-wise Funcs calling their producers several
+            // times (e.g. adjoints) grow exponentially when inlined.
+            InlinedTreeSize tree_size(env.at(order[i]));
+            int64_t size = tree_size.max_tree_size(env.at(caller));
+            if (size > max_expr_size) {
+                debug(4) << "Skip inlining function \"" << order[i] << "\" inside \""
+                         << caller << "\" since it would make expressions of size "
+                         << size << "\n";
+                if (over_budget) {
+                    over_budget->insert(order[i]);
+                }
+                continue;
+            }
+        }
         if (!caller.empty()) {
             inlined = true;
             debug(4) << "Inline function \"" << order[i] << "\" since it is called only by "
@@ -3331,6 +4004,14 @@ bool inline_all_element_wise_functions(const vector<Function> &outputs,
 // the schedules. The target architecture is specified by 'target'.
 string generate_schedules(const vector<Function> &outputs, const Target &target,
                           const MachineParams &arch_params) {
+    BoundsCache bounds_cache;
+
+    // The hash of the algorithm the schedule is generated for, before
+    // any of its Funcs are inlined below.
+    string hash = algorithm_hash(outputs);
+    // And of the estimates it depends on.
+    string inputs_hash = schedule_inputs_hash(outputs, "");
+
     // Make an environment map which is used throughout the auto scheduling process.
     map<string, Function> env;
     for (Function f : outputs) {
@@ -3458,13 +4139,23 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
         debug(2) << "Re-initializing region costs...\n";
         RegionCosts costs(env);
         debug(2) << "Re-initializing dependence analysis...\n";
-        dep_analysis = DependenceAnalysis(env, order, func_val_bounds);
+        dep_analysis.env = env;
+        dep_analysis.order = order;
+        dep_analysis.func_val_bounds = func_val_bounds;
+        dep_analysis.regions_required_cache.clear();
         debug(2) << "Re-computing pipeline bounds...\n";
         pipeline_bounds = get_pipeline_bounds(dep_analysis, outputs, &costs.input_estimates);
     }
 
+    std::shared_ptr<const AutoScheduleCostModel> cost_model = arch_params.cost_model;
+    string cost_model_file = get_env_variable("HL_AUTOSCHEDULE_COST_MODEL");
+    if (!cost_model && !cost_model_file.empty()) {
+        debug(1) << "Loading the auto scheduler cost model from " << cost_model_file << "\n";
+        cost_model = std::make_shared<LinearCostModel>(LinearCostModel::load(cost_model_file));
+    }
+
     debug(2) << "Initializing partitioner...\n";
-    Partitioner part(pipeline_bounds, arch_params, outputs, dep_analysis, costs);
+    Partitioner part(pipeline_bounds, arch_params, cost_model, target, outputs, dep_analysis, costs);
 
     // Compute and display reuse
     /* TODO: Use the reuse estimates to reorder loops
@@ -3513,14 +4204,24 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
         part.disp_pipeline_graph();
     }
 
+    // Dump the features of the chosen grouping, from which the linear cost
+    // model can be retrained with the runtime of the pipeline
+    string features_file = get_env_variable("HL_AUTOSCHEDULE_FEATURES");
+    if (!features_file.empty()) {
+        part.dump_features(features_file);
+    }
+
     debug(2) << "Initializing AutoSchedule...\n";
     AutoSchedule sched(env, top_order);
-    debug(2) << "Generating CPU schedule...\n";
+    debug(2) << (target.has_gpu_feature() ? "Generating GPU schedule...\n"
+                                           : "Generating CPU schedule...\n");
     part.generate_cpu_schedule(target, sched);
 
     std::ostringstream oss;
     oss << "// Target: " << target.to_string() << "\n";
     oss << "// MachineParams: " << arch_params.to_string() << "\n";
+    oss << "// Algorithm: " << hash << "\n";
+    oss << "// Inputs: " << inputs_hash << "\n";
     oss << "\n";
     oss << sched;
     string sched_string = oss.str();
@@ -3529,7 +4230,6 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
              << "*******************************\n" << sched_string << "\n\n";
 
     // TODO: Unify both inlining and grouping for fast mem
-    // TODO: GPU scheduling
     // TODO: Hierarchical tiling
 
     return sched_string;
@@ -3544,18 +4244,23 @@ MachineParams MachineParams::generic() {
 std::string MachineParams::to_string() const {
     internal_assert(parallelism.type().is_int() &&
                     last_level_cache_size.type().is_int() &&
-                    balance.type().is_int());
+                    balance.type().is_int() &&
+                    gpu_shared_memory_size.type().is_int() &&
+                    gpu_max_threads_per_block.type().is_int());
     std::ostringstream o;
-    o << parallelism << "," << last_level_cache_size << "," << balance;
+    o << parallelism << "," << last_level_cache_size << "," << balance << ","
+      << gpu_shared_memory_size << "," << gpu_max_threads_per_block;
     return o.str();
 }
 
 MachineParams::MachineParams(const std::string &s) {
     std::vector<std::string> v = Internal::split_string(s, ",");
-    user_assert(v.size() == 3) << "Unable to parse MachineParams: " << s;
+    user_assert(v.size() == 3 || v.size() == 5) << "Unable to parse MachineParams: " << s;
     parallelism = Internal::string_to_int(v[0]);
     last_level_cache_size = Internal::string_to_int(v[1]);
     balance = Internal::string_to_int(v[2]);
+    gpu_shared_memory_size = v.size() == 5 ? Internal::string_to_int(v[3]) : 48 * 1024;
+    gpu_max_threads_per_block = v.size() == 5 ? Internal::string_to_int(v[4]) : 1024;
 }
 
 }  // namespace Halide
@@ -6,6 +6,10 @@
  * Defines the method that does automatic scheduling of Funcs within a pipeline.
  */
 
+#include <memory>
+#include <set>
+
+#include "AutoScheduleCostModel.h"
 #include "Function.h"
 #include "Target.h"
 
@@ -21,17 +25,36 @@ struct MachineParams {
     /** Indicates how much more expensive is the cost of a load compared to
      * the cost of an arithmetic operation at last level cache. */
     Expr balance;
+    /** Size of the shared memory of a GPU block (in bytes). On GPU targets,
+     * the values computed in a tile of a group live in shared memory, which
+     * bounds the tile sizes. */
+    Expr gpu_shared_memory_size;
+    /** Maximum number of threads in a GPU block. */
+    Expr gpu_max_threads_per_block;
+    /** If defined, the auto scheduler estimates the cost of the groupings
+     * with this model instead of the analytical model based on 'balance'
+     * and 'last_level_cache_size'. Otherwise the model whose weights are in
+     * the file named by the environment variable HL_AUTOSCHEDULE_COST_MODEL
+     * is used, if set. */
+    std::shared_ptr<const AutoScheduleCostModel> cost_model;
 
-    explicit MachineParams(int32_t parallelism, int32_t llc, int32_t balance)
-        : parallelism(parallelism), last_level_cache_size(llc), balance(balance) {}
+    explicit MachineParams(int32_t parallelism, int32_t llc, int32_t balance,
+                           int32_t gpu_shared_memory_size = 48 * 1024,
+                           int32_t gpu_max_threads_per_block = 1024)
+        : parallelism(parallelism), last_level_cache_size(llc), balance(balance),
+          gpu_shared_memory_size(gpu_shared_memory_size),
+          gpu_max_threads_per_block(gpu_max_threads_per_block) {}
 
-    /** Default machine parameters for generic CPU architecture. */
+    /** Default machine parameters for generic CPU architecture. To
+     * measure them for a particular machine instead, run
+     * util/HalideCalibrateMachineParams on it. */
     static MachineParams generic();
 
     /** Convert the MachineParams into canonical string form. */
     std::string to_string() const;
 
-    /** Reconstruct a MachineParams from canonical string form. */
+    /** Reconstruct a MachineParams from canonical string form. The GPU
+     * parameters may be omitted. */
     explicit MachineParams(const std::string &s);
 };
 
@@ -44,10 +67,14 @@ bool inline_all_trivial_functions(const std::vector<Function> &outputs,
                                   const std::map<std::string, Function> &env);
 
 /** Inline a Func if its values are only consumed by another single Func in
- * element-wise manner. */
+ * element-wise manner. If max_expr_size is positive, a Func is not inlined
+ * when the expressions of its consumer would then have more than this many
+ * nodes; the names of these Funcs are returned in over_budget if non-null. */
 bool inline_all_element_wise_functions(const std::vector<Function> &outputs,
                                        const std::vector<std::string> &order,
-                                       const std::map<std::string, Function> &env);
+                                       const std::map<std::string, Function> &env,
+                                       int64_t max_expr_size = 0,
+                                       std::set<std::string> *over_budget = nullptr);
 
 /** Check if all the pipeline outputs have estimates specified
  *  on each of their dimensions; otherwise, throw an assertion. */
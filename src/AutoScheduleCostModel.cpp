@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include "AutoScheduleCostModel.h"
+#include "Error.h"
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Solve the least squares problem min |A x - b| restricted to the columns
+// in 'active', through the normal equations. The other entries of x are 0.
+vector<double> solve_least_squares(const vector<vector<double>> &a,
+                                   const vector<double> &b,
+                                   const vector<bool> &active) {
+    const int n = active.size();
+    vector<int> cols;
+    for (int j = 0; j < n; j++) {
+        if (active[j]) {
+            cols.push_back(j);
+        }
+    }
+    const int m = cols.size();
+    // Normal equations, with a little regularization so that collinear
+    // features don't make them singular
+    vector<vector<double>> ata(m, vector<double>(m + 1, 0));
+    for (size_t s = 0; s < a.size(); s++) {
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < m; j++) {
+                ata[i][j] += a[s][cols[i]] * a[s][cols[j]];
+            }
+            ata[i][m] += a[s][cols[i]] * b[s];
+        }
+    }
+    for (int i = 0; i < m; i++) {
+        ata[i][i] += 1e-9 * (ata[i][i] + 1e-12);
+    }
+    // Gaussian elimination with partial pivoting
+    for (int i = 0; i < m; i++) {
+        int pivot = i;
+        for (int k = i + 1; k < m; k++) {
+            if (std::abs(ata[k][i]) > std::abs(ata[pivot][i])) {
+                pivot = k;
+            }
+        }
+        std::swap(ata[i], ata[pivot]);
+        for (int k = 0; k < m; k++) {
+            if (k != i && ata[i][i] != 0) {
+                double factor = ata[k][i] / ata[i][i];
+                for (int j = i; j <= m; j++) {
+                    ata[k][j] -= factor * ata[i][j];
+                }
+            }
+        }
+    }
+    vector<double> x(n, 0);
+    for (int i = 0; i < m; i++) {
+        x[cols[i]] = ata[i][i] != 0 ? ata[i][m] / ata[i][i] : 0;
+    }
+    return x;
+}
+
+}  // namespace
+
+LinearCostModel::LinearCostModel()
+    // Seconds per vectorized operation, byte loaded, byte stored, byte
+    // allocated and tile, on one core.
+    : weights({1e-9, 2.5e-10, 5e-10, 1e-11, 1e-7}) {}
+
+LinearCostModel::LinearCostModel(const vector<double> &weights) : weights(weights) {
+    user_assert((int)weights.size() == num_features)
+        << "A LinearCostModel needs " << num_features << " weights, but "
+        << weights.size() << " were given.\n";
+}
+
+vector<double> LinearCostModel::featurize(const GroupFeatures &features) {
+    double parallelism = std::max(features.parallelism, 1.0);
+    double vector_width = std::max(features.vector_width, 1.0);
+    return {
+        features.arith / (vector_width * parallelism),
+        features.bytes_loaded / parallelism,
+        features.bytes_stored / parallelism,
+        features.footprint * features.num_tiles / parallelism,
+        features.num_tiles / parallelism
+    };
+}
+
+void LinearCostModel::evaluate(const GroupFeatures &features,
+                               double *arith_cost, double *memory_cost) const {
+    vector<double> f = featurize(features);
+    *arith_cost = weights[0] * f[0];
+    *memory_cost = 0;
+    for (int i = 1; i < num_features; i++) {
+        *memory_cost += weights[i] * f[i];
+    }
+}
+
+LinearCostModel LinearCostModel::load(const string &filename) {
+    std::ifstream in(filename);
+    user_assert(in.is_open()) << "Can't open cost model " << filename << "\n";
+    vector<double> weights;
+    double w;
+    while (in >> w) {
+        weights.push_back(w);
+    }
+    return LinearCostModel(weights);
+}
+
+void LinearCostModel::save(const string &filename) const {
+    std::ofstream out(filename);
+    user_assert(out.is_open()) << "Can't write cost model " << filename << "\n";
+    out.precision(17);
+    for (double w : weights) {
+        out << w << "\n";
+    }
+}
+
+LinearCostModel LinearCostModel::train(const vector<vector<double>> &samples,
+                                       const vector<double> &runtimes) {
+    user_assert(!samples.empty() && samples.size() == runtimes.size())
+        << "Training a LinearCostModel needs as many runtimes as samples.\n";
+    // Normalize the features so that the normal equations are well scaled
+    vector<double> scale(num_features, 0);
+    for (const auto &s : samples) {
+        user_assert((int)s.size() == num_features)
+            << "Each sample needs " << num_features << " features.\n";
+        for (int j = 0; j < num_features; j++) {
+            scale[j] = std::max(scale[j], std::abs(s[j]));
+        }
+    }
+    vector<vector<double>> a(samples.size(), vector<double>(num_features));
+    for (size_t i = 0; i < samples.size(); i++) {
+        for (int j = 0; j < num_features; j++) {
+            a[i][j] = scale[j] > 0 ? samples[i][j] / scale[j] : 0;
+        }
+    }
+    // Non-negative least squares: drop the most negative weight and refit
+    // until all of them are non-negative
+    vector<bool> active(num_features);
+    for (int j = 0; j < num_features; j++) {
+        active[j] = scale[j] > 0;
+    }
+    vector<double> x;
+    while (true) {
+        x = solve_least_squares(a, runtimes, active);
+        int most_negative = -1;
+        for (int j = 0; j < num_features; j++) {
+            if (active[j] && x[j] < 0 &&
+                    (most_negative == -1 || x[j] < x[most_negative])) {
+                most_negative = j;
+            }
+        }
+        if (most_negative == -1) {
+            break;
+        }
+        active[most_negative] = false;
+    }
+    vector<double> weights(num_features, 0);
+    for (int j = 0; j < num_features; j++) {
+        weights[j] = scale[j] > 0 ? x[j] / scale[j] : 0;
+    }
+    return LinearCostModel(weights);
+}
+
+}  // namespace Halide
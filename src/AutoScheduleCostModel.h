@@ -0,0 +1,89 @@
+#ifndef HALIDE_AUTO_SCHEDULE_COST_MODEL_H
+#define HALIDE_AUTO_SCHEDULE_COST_MODEL_H
+
+/** \file
+ *
+ * Defines the interface of the cost models used by the auto scheduler to
+ * compare groupings of stages, and a linear cost model learned from
+ * benchmarks of auto-scheduled pipelines.
+ */
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+/** The features of a group of stages computed together in tiles by the
+ * auto scheduler. The totals are over all the tiles of the group. */
+struct GroupFeatures {
+    /** Arithmetic operations. */
+    double arith = 0;
+    /** Bytes loaded by the members of the group. */
+    double bytes_loaded = 0;
+    /** Bytes stored by the output of the group. */
+    double bytes_stored = 0;
+    /** Bytes allocated for the values computed in one tile. */
+    double footprint = 0;
+    /** Number of tiles. */
+    double num_tiles = 0;
+    /** Number of tiles computed at the same time: the smaller of the number
+     * of parallel tiles and the parallelism of the machine. */
+    double parallelism = 1;
+    /** Natural vector width of the type of the group output. */
+    double vector_width = 1;
+};
+
+/** A cost model for the auto scheduler. The costs of the groups of a
+ * pipeline are added together and compared, so they only need to be
+ * consistent with each other. */
+class AutoScheduleCostModel {
+public:
+    virtual ~AutoScheduleCostModel() {}
+
+    /** Estimate the cost of computing a group, split into the part due to
+     * the arithmetic and the part due to the memory accesses. */
+    virtual void evaluate(const GroupFeatures &features,
+                          double *arith_cost, double *memory_cost) const = 0;
+};
+
+/** A cost model linear in the features of a group, each divided by the
+ * parallelism of the group. Its weights are fitted to the runtimes of
+ * benchmarked pipelines, so the costs are in seconds. */
+class LinearCostModel : public AutoScheduleCostModel {
+    std::vector<double> weights;
+
+public:
+    /** Number of features the cost is linear in. */
+    static const int num_features = 5;
+
+    /** Construct the model with rough weights for a generic CPU. */
+    LinearCostModel();
+    explicit LinearCostModel(const std::vector<double> &weights);
+
+    /** The features of a group the cost is linear in: the vectorized
+     * arithmetic, the bytes loaded and stored, the bytes allocated and the
+     * number of tiles, all per core. The first one is the arithmetic part of
+     * the cost. */
+    static std::vector<double> featurize(const GroupFeatures &features);
+
+    void evaluate(const GroupFeatures &features,
+                  double *arith_cost, double *memory_cost) const override;
+
+    const std::vector<double> &get_weights() const { return weights; }
+
+    /** Load or save the weights, in a text file. */
+    // @{
+    static LinearCostModel load(const std::string &filename);
+    void save(const std::string &filename) const;
+    // @}
+
+    /** Fit non-negative weights to benchmarks. Each sample is the sum of the
+     * featurized groups of a pipeline, as dumped by the auto scheduler when
+     * HL_AUTOSCHEDULE_FEATURES is set, and its runtime in seconds. */
+    static LinearCostModel train(const std::vector<std::vector<double>> &samples,
+                                 const std::vector<double> &runtimes);
+};
+
+}  // namespace Halide
+
+#endif
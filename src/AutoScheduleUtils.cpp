@@ -1,6 +1,8 @@
+#include <iomanip>
 #include <sstream>
 
 #include "AutoScheduleUtils.h"
+#include "FindCalls.h"
 #include "IREquality.h"
 #include "ImageParam.h"
 #include "Inline.h"
@@ -216,6 +218,151 @@ set<string> get_parents(Function f, int stage) {
     return parents;
 }
 
+string get_sanitized_name(string name) {
+    if (isdigit(name[0])) {
+        name = "_" + name;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (!isalnum(name[i])) {
+            name[i] = '_';
+        }
+    }
+    return name;
+}
+
+namespace {
+
+// FNV-1a, rather than std::hash, so that it is the same on every host.
+string fnv1a_hash(const string &s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : s) {
+        h ^= (uint8_t)c;
+        h *= 0x100000001b3ULL;
+    }
+    std::ostringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << h;
+    return hex.str();
+}
+
+// The Params and ImageParams that the definitions of Funcs read.
+class FindParameters : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *op) override {
+        if (op->param.defined()) {
+            params[op->param.name()] = op->param;
+        }
+    }
+
+    void visit(const Call *op) override {
+        IRGraphVisitor::visit(op);
+        if (op->param.defined()) {
+            params[op->param.name()] = op->param;
+        }
+    }
+
+public:
+    map<string, Parameter> params;
+};
+
+}  // namespace
+
+string algorithm_hash(const vector<Function> &outputs) {
+    map<string, Function> env;
+    for (const Function &f : outputs) {
+        map<string, Function> more_funcs = find_transitive_calls(f);
+        env.insert(more_funcs.begin(), more_funcs.end());
+    }
+
+    // Print the definitions in the order of the names, which doesn't
+    // depend on the order the Funcs were defined in.
+    std::ostringstream algorithm;
+    for (const Function &f : outputs) {
+        algorithm << "output " << f.name() << "\n";
+    }
+    for (const auto &iter : env) {
+        const Function &f = iter.second;
+        algorithm << "func " << f.name() << "(";
+        for (const string &arg : f.args()) {
+            algorithm << arg << ",";
+        }
+        algorithm << ")";
+        for (const Type &t : f.output_types()) {
+            algorithm << " " << t;
+        }
+        algorithm << "\n";
+        if (f.has_extern_definition()) {
+            algorithm << "extern " << f.extern_function_name() << "(";
+            for (const ExternFuncArgument &arg : f.extern_arguments()) {
+                if (arg.is_func()) {
+                    algorithm << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    algorithm << arg.expr;
+                } else if (arg.is_buffer()) {
+                    algorithm << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    algorithm << arg.image_param.name();
+                }
+                algorithm << ",";
+            }
+            algorithm << ")\n";
+            continue;
+        }
+        for (size_t stage = 0; stage <= f.updates().size(); stage++) {
+            const Definition &def = get_stage_definition(f, stage);
+            for (const ReductionVariable &rv : def.schedule().rvars()) {
+                algorithm << "rvar " << rv.var << " " << rv.min << " " << rv.extent << "\n";
+            }
+            algorithm << "(";
+            for (const Expr &arg : def.args()) {
+                algorithm << arg << ",";
+            }
+            algorithm << ") = (";
+            for (const Expr &value : def.values()) {
+                algorithm << value << ",";
+            }
+            algorithm << ") if " << def.predicate() << "\n";
+        }
+    }
+
+    return fnv1a_hash(algorithm.str());
+}
+
+string schedule_inputs_hash(const vector<Function> &outputs, const string &options) {
+    map<string, Function> env;
+    for (const Function &f : outputs) {
+        map<string, Function> more_funcs = find_transitive_calls(f);
+        env.insert(more_funcs.begin(), more_funcs.end());
+    }
+
+    std::ostringstream inputs;
+    inputs << "algorithm " << algorithm_hash(outputs) << "\n";
+    FindParameters find;
+    for (const auto &iter : env) {
+        const Function &f = iter.second;
+        f.accept(&find);
+        for (const Bound &b : f.schedule().estimates()) {
+            inputs << "estimate " << f.name() << " " << b.var << " "
+                   << b.min << " " << b.extent << "\n";
+        }
+    }
+    for (const auto &iter : find.params) {
+        const Parameter &p = iter.second;
+        inputs << "param " << p.name();
+        if (p.is_buffer()) {
+            for (int d = 0; d < p.dimensions(); d++) {
+                inputs << " [" << p.min_constraint_estimate(d) << ", "
+                       << p.extent_constraint_estimate(d) << "]";
+            }
+        } else {
+            inputs << " " << p.estimate();
+        }
+        inputs << "\n";
+    }
+    inputs << options;
+    return fnv1a_hash(inputs.str());
+}
+
 void disp_regions(const map<string, Box> &regions) {
     for (const auto &reg : regions) {
         debug(0) << reg.first << " -> ";
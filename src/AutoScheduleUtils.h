@@ -91,6 +91,29 @@ Expr perform_inline(Expr e, const std::map<std::string, Function> &env,
 /** Return all functions that are directly called by a function stage (f, stage). */
 std::set<std::string> get_parents(Function f, int stage);
 
+/** Replace all occurrences of non-alphanumeric chars in 'name' with '_',
+ * to make a C++ identifier of it. */
+std::string get_sanitized_name(std::string name);
+
+/** Return a hash of the algorithm computing the outputs, as 16 hex
+ * digits: of the definitions of all the Funcs they call, but not of
+ * their schedules. The autoschedulers print it in the schedules they
+ * generate, before inlining anything, so that a saved schedule can be
+ * checked against the algorithm it was generated for before being
+ * applied again. The hash depends on the names of the Funcs, Vars and
+ * Params, so it is the same for the same program, but not necessarily
+ * for an equivalent algorithm built differently. */
+std::string algorithm_hash(const std::vector<Function> &outputs);
+
+/** Return a hash of everything a schedule generated for the outputs
+ * depends on besides the target and the machine parameters, as 16 hex
+ * digits: the algorithm_hash, the estimates of the Funcs and of the
+ * Params and ImageParams they read, and the options of the
+ * autoscheduler, as printed by the caller. The autoschedulers print it
+ * in the schedules they generate, so that a build can run them again
+ * only when it changes. */
+std::string schedule_inputs_hash(const std::vector<Function> &outputs, const std::string &options);
+
 /** Return value of element within a map. This will assert if the element is not
  * in the map. */
 // @{
@@ -871,7 +871,8 @@ private:
             Expr full_clamp = clamp(op->args[0], op->args[1], op->args[2]);
             full_clamp.accept(this);
         } else if (op->is_intrinsic(Call::likely) ||
-                   op->is_intrinsic(Call::likely_if_innermost)) {
+                   op->is_intrinsic(Call::likely_if_innermost) ||
+                   op->is_intrinsic(Call::vectorized_reduction)) {
             assert(op->args.size() == 1);
             op->args[0].accept(this);
         } else if (op->is_intrinsic(Call::return_second)) {
@@ -1003,6 +1004,35 @@ private:
         interval = result;
     }
 
+    void visit(const VectorReduce *op) {
+        op->value.accept(this);
+        int factor = op->value.type().lanes() / op->type.lanes();
+        switch (op->op) {
+        case VectorReduce::Add:
+            // Each output lane is the sum of factor lanes of the input.
+            if (interval.has_lower_bound()) {
+                interval.min = interval.min * make_const(interval.min.type(), factor);
+            }
+            if (interval.has_upper_bound()) {
+                interval.max = interval.max * make_const(interval.max.type(), factor);
+            }
+            // Assume no overflow for float, int32, and int64
+            if (!op->type.is_float() && (!op->type.is_int() || op->type.bits() < 32)) {
+                bounds_of_type(op->type);
+            }
+            break;
+        case VectorReduce::Min:
+        case VectorReduce::Max:
+        case VectorReduce::And:
+        case VectorReduce::Or:
+            // The result is one of the lanes, or is a bool.
+            break;
+        case VectorReduce::Mul:
+            bounds_of_type(op->type);
+            break;
+        }
+    }
+
     void visit(const LetStmt *) {
         internal_error << "Bounds of statement\n";
     }
@@ -1040,25 +1070,185 @@ private:
     }
 };
 
-Interval bounds_of_expr_in_scope(Expr expr, const Scope<Interval> &scope, const FuncValueBounds &fb, bool const_bound) {
-    //debug(3) << "computing bounds_of_expr_in_scope " << expr << "\n";
+namespace {
+
+// The facts the bounds of an Expr depend on, besides the Expr itself:
+// the intervals in scope of the variables it uses, and the value bounds
+// of the Funcs it calls. As the bounds of a division look up the
+// variables in the bounds of the divisor too, the variables used by
+// those intervals are included, transitively. The Exprs of the
+// intervals are listed, with a marker for names that aren't bound.
+// Comparing two contexts by the identity of those Exprs is
+// conservative.
+class BoundsContext : public IRGraphVisitor {
+    const Scope<Interval> &scope;
+    const FuncValueBounds &func_bounds;
+
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *op) override {
+        names.insert(op->name);
+    }
+
+    void visit(const Call *op) override {
+        IRGraphVisitor::visit(op);
+        if (op->call_type == Call::Halide) {
+            calls.insert({op->name, op->value_index});
+        }
+    }
+
+    std::set<string> names;
+    std::set<pair<string, int>> calls;
+
+    void include_interval(const Interval &i) {
+        if (i.min.defined()) {
+            include(i.min);
+        }
+        if (i.max.defined()) {
+            include(i.max);
+        }
+    }
+
+public:
+    BoundsContext(const Scope<Interval> &scope, const FuncValueBounds &func_bounds) :
+        scope(scope), func_bounds(func_bounds) {}
+
+    vector<Expr> context(const Expr &e) {
+        e.accept(this);
+        std::set<string> done_names;
+        std::set<pair<string, int>> done_calls;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            // Visiting an interval may add names, so iterate over copies.
+            for (const string &n : std::set<string>(names)) {
+                if (done_names.insert(n).second && scope.contains(n)) {
+                    include_interval(scope.get(n));
+                    changed = true;
+                }
+            }
+            for (const auto &c : std::set<pair<string, int>>(calls)) {
+                auto it = func_bounds.find(c);
+                if (done_calls.insert(c).second && it != func_bounds.end()) {
+                    include_interval(it->second);
+                    changed = true;
+                }
+            }
+        }
+
+        static Expr *unbound = new Expr(Variable::make(Int(32), "<unbound>"));
+        vector<Expr> result;
+        for (const string &n : names) {
+            if (scope.contains(n)) {
+                const Interval &i = scope.get(n);
+                result.push_back(i.min);
+                result.push_back(i.max);
+            } else {
+                result.push_back(*unbound);
+            }
+        }
+        for (const auto &c : calls) {
+            auto it = func_bounds.find(c);
+            if (it != func_bounds.end()) {
+                result.push_back(it->second.min);
+                result.push_back(it->second.max);
+            } else {
+                result.push_back(*unbound);
+            }
+        }
+        return result;
+    }
+};
+
+struct CachedBounds {
+    // Holding the Expr keeps its node, the key of the entry, alive.
+    Expr expr;
+    vector<Expr> context;
+    bool const_bound;
+    Interval result;
+};
+
+bool same_context(const vector<Expr> &a, const vector<Expr> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!a[i].same_as(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Interval uncached_bounds_of_expr_in_scope(Expr expr, const Scope<Interval> &scope, const FuncValueBounds &fb, bool const_bound) {
     Bounds b(&scope, fb, const_bound);
     expr.accept(&b);
-    //debug(3) << "bounds_of_expr_in_scope " << expr << " = " << simplify(b.interval.min) << ", " << simplify(b.interval.max) << "\n";
+    return b.interval;
+}
+
+}  // namespace
+
+struct BoundsCacheContents {
+    std::map<const IRNode *, vector<CachedBounds>> entries;
+    size_t size = 0;
+};
+
+namespace {
+thread_local BoundsCacheContents *current_bounds_cache = nullptr;
+}
+
+BoundsCache::BoundsCache() : contents(new BoundsCacheContents), previous(current_bounds_cache) {
+    current_bounds_cache = contents;
+}
+
+BoundsCache::~BoundsCache() {
+    internal_assert(current_bounds_cache == contents);
+    current_bounds_cache = previous;
+    delete contents;
+}
+
+Interval bounds_of_expr_in_scope(Expr expr, const Scope<Interval> &scope, const FuncValueBounds &fb, bool const_bound) {
+    //debug(3) << "computing bounds_of_expr_in_scope " << expr << "\n";
+    Interval interval;
+    BoundsCacheContents *cache = current_bounds_cache;
+    if (cache && !expr.as<Variable>() && !is_const(expr)) {
+        vector<Expr> context = BoundsContext(scope, fb).context(expr);
+        vector<CachedBounds> &entries = cache->entries[expr.get()];
+        bool found = false;
+        for (const CachedBounds &c : entries) {
+            if (c.const_bound == const_bound && same_context(c.context, context)) {
+                interval = c.result;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            interval = uncached_bounds_of_expr_in_scope(expr, scope, fb, const_bound);
+            if (cache->size >= 64 * 1024) {
+                cache->entries.clear();
+                cache->size = 0;
+            }
+            cache->entries[expr.get()].push_back({expr, std::move(context), const_bound, interval});
+            cache->size++;
+        }
+    } else {
+        interval = uncached_bounds_of_expr_in_scope(expr, scope, fb, const_bound);
+    }
+    //debug(3) << "bounds_of_expr_in_scope " << expr << " = " << simplify(interval.min) << ", " << simplify(interval.max) << "\n";
     Type expected = expr.type().element_of();
-    if (b.interval.has_lower_bound()) {
-        internal_assert(b.interval.min.type() == expected)
+    if (interval.has_lower_bound()) {
+        internal_assert(interval.min.type() == expected)
             << "Min of " << expr
             << " should have been a scalar of type " << expected
-            << ": " << b.interval.min << "\n";
+            << ": " << interval.min << "\n";
     }
-    if (b.interval.has_upper_bound()) {
-        internal_assert(b.interval.max.type() == expected)
+    if (interval.has_upper_bound()) {
+        internal_assert(interval.max.type() == expected)
             << "Max of " << expr
             << " should have been a scalar of type " << expected
-            << ": " << b.interval.max << "\n";
+            << ": " << interval.max << "\n";
     }
-    return b.interval;
+    return interval;
 }
 
 Region region_union(const Region &a, const Region &b) {
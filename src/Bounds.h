@@ -32,6 +32,26 @@ Interval bounds_of_expr_in_scope(Expr expr,
                                  const FuncValueBounds &func_bounds = FuncValueBounds(),
                                  bool const_bound = false);
 
+struct BoundsCacheContents;
+
+/** While an instance of this is alive, bounds_of_expr_in_scope
+ * remembers its results on the current thread, and reuses them for an
+ * Expr node queried again with the same intervals for the variables and
+ * Funcs it depends on. Lowering keeps one for its whole duration, as
+ * passes repeatedly query the bounds of the same Exprs. The results
+ * also depend on the ranges of Params, so a cache must not outlive
+ * changes to those. Instances nest. */
+class BoundsCache {
+    BoundsCacheContents *contents, *previous;
+
+    BoundsCache(const BoundsCache &) = delete;
+    BoundsCache &operator=(const BoundsCache &) = delete;
+
+public:
+    BoundsCache();
+    ~BoundsCache();
+};
+
 /** Given a varying expression, try to find a constant that is either:
  * An upper bound (always greater than or equal to the expression), or
  * A lower bound (always less than or equal to the expression)
@@ -266,6 +266,19 @@ public:
                           name);
     }
 
+#ifdef HALIDE_BUFFER_HAS_MMAP
+    /** Make a Buffer over the contents of a file using mmap. See
+     * Runtime::Buffer::map_file. */
+    static Buffer<T> map_file(const std::string &path, Type t, const std::vector<int> &sizes,
+                              Runtime::MapFileMode mode = Runtime::MapFileMode::Read,
+                              int hints = Runtime::MapFileHint::None,
+                              size_t offset = 0,
+                              const std::string &name = "") {
+        return Buffer<T>(Runtime::Buffer<T>::map_file(path.c_str(), t, sizes, mode, hints, offset),
+                         name);
+    }
+#endif
+
     template<typename T2>
     static Buffer<T> make_with_shape_of(Buffer<T2> src,
                                         void *(*allocate_fn)(size_t) = nullptr,
@@ -399,6 +412,8 @@ public:
     HALIDE_BUFFER_FORWARD(set_device_dirty)
     HALIDE_BUFFER_FORWARD(device_sync)
     HALIDE_BUFFER_FORWARD(device_malloc)
+    HALIDE_BUFFER_FORWARD(device_and_host_malloc)
+    HALIDE_BUFFER_FORWARD(device_and_host_free)
     HALIDE_BUFFER_FORWARD(device_wrap_native)
     HALIDE_BUFFER_FORWARD(device_detach_native)
     HALIDE_BUFFER_FORWARD(allocate)
@@ -517,6 +532,15 @@ public:
         return contents->buf.device_malloc(get_device_interface_for_device_api(d, t, "Buffer::device_malloc"));
     }
 
+    /** Allocate storage on both the host and the GPU, using the given
+     * device API, for a buffer with no host allocation (e.g. one
+     * constructed with a null data pointer). The CUDA and OpenCL
+     * runtimes make the host storage page-locked, so that copies
+     * between the two run at full bandwidth. */
+    int device_and_host_malloc(const DeviceAPI &d, const Target &t = get_jit_target_from_environment()) {
+        return contents->buf.device_and_host_malloc(get_device_interface_for_device_api(d, t, "Buffer::device_and_host_malloc"));
+    }
+
     /** Wrap a native handle, using the given device API.
      * It is a bad idea to pass DeviceAPI::Default_GPU to this routine
      * as the handle argument must match the API that the default
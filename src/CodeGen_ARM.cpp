@@ -464,7 +464,109 @@ void CodeGen_ARM::visit(const Div *op) {
     CodeGen_Posix::visit(op);
 }
 
+namespace {
+
+void collect_summands(Expr e, vector<Expr> &summands) {
+    if (const Add *add = e.as<Add>()) {
+        collect_summands(add->a, summands);
+        collect_summands(add->b, summands);
+    } else {
+        summands.push_back(e);
+    }
+}
+
+// A sum of products of 8-bit values widened to 32 bits can be done
+// four at a time with udot (for u8 * u8) or sdot (for i8 * i8), which
+// also add an accumulator. The factors are returned as consecutive
+// pairs in 'unsigned_factors' and 'signed_factors', and the summands
+// left over in 'rest'.
+bool should_use_dot_product(const Add *op, vector<Expr> &rest,
+                            vector<Expr> &unsigned_factors, vector<Expr> &signed_factors) {
+    Type t = op->type;
+    if (!((t.is_int() || t.is_uint()) && t.bits() == 32 && t.lanes() >= 2)) {
+        return false;
+    }
+
+    vector<Expr> summands;
+    collect_summands(op, summands);
+
+    vector<Expr> unsigned_products, signed_products;
+    for (const Expr &e : summands) {
+        const Mul *mul = e.as<Mul>();
+        if (mul) {
+            Expr ua = lossless_cast(UInt(8, t.lanes()), mul->a);
+            Expr ub = lossless_cast(UInt(8, t.lanes()), mul->b);
+            if (ua.defined() && ub.defined()) {
+                unsigned_factors.push_back(ua);
+                unsigned_factors.push_back(ub);
+                unsigned_products.push_back(e);
+                continue;
+            }
+            Expr sa = lossless_cast(Int(8, t.lanes()), mul->a);
+            Expr sb = lossless_cast(Int(8, t.lanes()), mul->b);
+            if (sa.defined() && sb.defined()) {
+                signed_factors.push_back(sa);
+                signed_factors.push_back(sb);
+                signed_products.push_back(e);
+                continue;
+            }
+        }
+        rest.push_back(e);
+    }
+
+    // Products that don't make a group of four are summed as usual.
+    while (unsigned_products.size() % 4) {
+        rest.push_back(unsigned_products.back());
+        unsigned_products.pop_back();
+        unsigned_factors.resize(unsigned_factors.size() - 2);
+    }
+    while (signed_products.size() % 4) {
+        rest.push_back(signed_products.back());
+        signed_products.pop_back();
+        signed_factors.resize(signed_factors.size() - 2);
+    }
+
+    return !unsigned_products.empty() || !signed_products.empty();
+}
+
+}  // namespace
+
 void CodeGen_ARM::visit(const Add *op) {
+#if LLVM_VERSION >= 60
+    vector<Expr> rest, unsigned_factors, signed_factors;
+    if (target.has_feature(Target::ARMDotProd) &&
+        !neon_intrinsics_disabled() &&
+        should_use_dot_product(op, rest, unsigned_factors, signed_factors)) {
+        Expr acc = make_zero(op->type);
+        if (!rest.empty()) {
+            acc = rest[0];
+            for (size_t i = 1; i < rest.size(); i++) {
+                acc = Add::make(acc, rest[i]);
+            }
+        }
+        value = codegen(acc);
+
+        // The 128-bit versions if there are enough lanes, otherwise the
+        // 64-bit ones.
+        int intrin_lanes = op->type.lanes() >= 4 ? 4 : 2;
+        string prefix = target.bits == 32 ? "llvm.arm.neon." : "llvm.aarch64.neon.";
+        string suffix = intrin_lanes == 4 ? ".v4i32.v16i8" : ".v2i32.v8i8";
+        for (int is_signed = 0; is_signed < 2; is_signed++) {
+            const vector<Expr> &factors = is_signed ? signed_factors : unsigned_factors;
+            string name = prefix + (is_signed ? "sdot" : "udot") + suffix;
+            for (size_t i = 0; i < factors.size(); i += 8) {
+                // Lane j of the result sums the products of bytes 4j
+                // to 4j + 3.
+                Value *a = interleave_vectors({codegen(factors[i]), codegen(factors[i + 2]),
+                                               codegen(factors[i + 4]), codegen(factors[i + 6])});
+                Value *b = interleave_vectors({codegen(factors[i + 1]), codegen(factors[i + 3]),
+                                               codegen(factors[i + 5]), codegen(factors[i + 7])});
+                value = call_intrin(value->getType(), intrin_lanes, name, {value, a, b});
+            }
+        }
+        return;
+    }
+#endif
     CodeGen_Posix::visit(op);
 }
 
@@ -653,6 +755,43 @@ void CodeGen_ARM::visit(const Max *op) {
     CodeGen_Posix::visit(op);
 }
 
+void CodeGen_ARM::visit(const VectorReduce *op) {
+    const int factor = op->value.type().lanes() / op->type.lanes();
+    const Cast *cast = op->value.as<Cast>();
+    Type narrow = cast ? cast->value.type() : Type();
+    if (op->op == VectorReduce::Add && factor % 2 == 0 && cast &&
+        !neon_intrinsics_disabled() &&
+        (narrow.is_int() || narrow.is_uint()) && narrow.bits() <= 32 &&
+        cast->type.bits() == narrow.bits() * 2 &&
+        cast->type.is_int() == narrow.is_int() &&
+        narrow.lanes() >= 4) {
+        // vpaddl sums adjacent pairs of lanes into lanes twice as
+        // wide. The rest of the reduction is done on its result.
+        int intrin_lanes = 64 / narrow.bits();
+        std::ostringstream suffix;
+        suffix << ".v" << intrin_lanes << "i" << narrow.bits() * 2
+               << ".v" << intrin_lanes * 2 << "i" << narrow.bits();
+        string name;
+        if (target.bits == 32) {
+            name = narrow.is_int() ? "llvm.arm.neon.vpaddls" : "llvm.arm.neon.vpaddlu";
+        } else {
+            name = narrow.is_int() ? "llvm.aarch64.neon.saddlp" : "llvm.aarch64.neon.uaddlp";
+        }
+        Type pairs = cast->type.with_lanes(narrow.lanes() / 2);
+        Value *partial = call_intrin(pairs, intrin_lanes, name + suffix.str(), {cast->value});
+        if (factor == 2) {
+            value = partial;
+        } else {
+            string var = unique_name('t');
+            sym_push(var, partial);
+            value = codegen(VectorReduce::make(op->op, Variable::make(pairs, var), op->type.lanes()));
+            sym_pop(var);
+        }
+        return;
+    }
+    CodeGen_Posix::visit(op);
+}
+
 void CodeGen_ARM::visit(const Store *op) {
     // Predicated store
     if (!is_one(op->predicate)) {
@@ -1010,19 +1149,35 @@ string CodeGen_ARM::mcpu() const {
 
 string CodeGen_ARM::mattrs() const {
     if (target.bits == 32) {
-        if (target.has_feature(Target::ARMv7s)) {
-            return "+neon";
-        } if (!target.has_feature(Target::NoNEON)) {
-            return "+neon";
+        string arch_flags;
+        if (target.has_feature(Target::ARMDotProd) && !target.has_feature(Target::NoNEON)) {
+            arch_flags = "+neon,+dotprod";
+        } else if (target.has_feature(Target::ARMv7s)) {
+            arch_flags = "+neon";
+        } else if (!target.has_feature(Target::NoNEON)) {
+            arch_flags = "+neon";
         } else {
-            return "-neon";
+            arch_flags = "-neon";
+        }
+        if (target.has_feature(Target::NativeFloat16)) {
+            arch_flags += ",+fullfp16";
         }
+        return arch_flags;
     } else {
+        string arch_flags;
+        string separator;
         if (target.os == Target::IOS || target.os == Target::OSX) {
-            return "+reserve-x18";
-        } else {
-            return "";
+            arch_flags = "+reserve-x18";
+            separator = ",";
+        }
+        if (target.has_feature(Target::ARMDotProd)) {
+            arch_flags += separator + "+dotprod";
+            separator = ",";
+        }
+        if (target.has_feature(Target::NativeFloat16)) {
+            arch_flags += separator + "+fullfp16";
         }
+        return arch_flags;
     }
 }
 
@@ -6,6 +6,7 @@
 #include "Deinterleave.h"
 #include "IROperator.h"
 #include "Lerp.h"
+#include "ParallelPolicies.h"
 #include "Param.h"
 #include "Simplify.h"
 #include "Substitute.h"
@@ -320,7 +321,13 @@ string type_to_c_type(Type type, bool include_space, bool c_plus_plus = true) {
     bool needs_space = true;
     ostringstream oss;
 
-    if (type.is_float()) {
+    if (type.is_bfloat()) {
+        // Only the bits of bfloats are left after lowering.
+        oss << "uint" << type.bits() << "_t";
+        if (type.is_vector()) {
+            oss << type.lanes();
+        }
+    } else if (type.is_float()) {
         if (type.bits() == 32) {
             oss << "float";
         } else if (type.bits() == 64) {
@@ -832,6 +839,14 @@ private:
 
         const char *native_vector_decl = R"INLINE_CODE(
 #if __has_attribute(ext_vector_type) || __has_attribute(vector_size)
+// The signed integer type of the lanes of the result of a native vector
+// comparison, by lane size.
+template <size_t Bytes> struct NativeVectorLaneMask {};
+template <> struct NativeVectorLaneMask<1> { typedef int8_t type; };
+template <> struct NativeVectorLaneMask<2> { typedef int16_t type; };
+template <> struct NativeVectorLaneMask<4> { typedef int32_t type; };
+template <> struct NativeVectorLaneMask<8> { typedef int64_t type; };
+
 template <typename ElementType_, size_t Lanes_>
 class NativeVector {
 public:
@@ -840,10 +855,16 @@ public:
     typedef NativeVector<ElementType, Lanes> Vec;
     typedef NativeVector<uint8_t, Lanes> Mask;
 
+    // A vector with all the bits of a lane set where a comparison
+    // holds, and cleared where it doesn't.
+    typedef typename NativeVectorLaneMask<sizeof(ElementType)>::type LaneMaskElementType;
+
 #if __has_attribute(ext_vector_type)
     typedef ElementType_ NativeVectorType __attribute__((ext_vector_type(Lanes), aligned(sizeof(ElementType))));
+    typedef LaneMaskElementType LaneMaskType __attribute__((ext_vector_type(Lanes), aligned(sizeof(ElementType))));
 #elif __has_attribute(vector_size) || __GNUC__
     typedef ElementType_ NativeVectorType __attribute__((vector_size(Lanes * sizeof(ElementType)), aligned(sizeof(ElementType))));
+    typedef LaneMaskElementType LaneMaskType __attribute__((vector_size(Lanes * sizeof(ElementType)), aligned(sizeof(ElementType))));
 #endif
 
     NativeVector &operator=(const Vec &src) {
@@ -1026,67 +1047,32 @@ public:
         return Vec(from_native_vector, a | b.native_vector);
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     friend Mask operator<(const Vec &a, const Vec &b) {
-        Mask r;
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = a[i] < b[i] ? 0xff : 0x00;
-        }
-        return r;
+        return to_mask((LaneMaskType)(a.native_vector < b.native_vector));
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     friend Mask operator<=(const Vec &a, const Vec &b) {
-        Mask r;
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = a[i] <= b[i] ? 0xff : 0x00;
-        }
-        return r;
+        return to_mask((LaneMaskType)(a.native_vector <= b.native_vector));
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     friend Mask operator>(const Vec &a, const Vec &b) {
-        Mask r;
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = a[i] > b[i] ? 0xff : 0x00;
-        }
-        return r;
+        return to_mask((LaneMaskType)(a.native_vector > b.native_vector));
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     friend Mask operator>=(const Vec &a, const Vec &b) {
-        Mask r;
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = a[i] >= b[i] ? 0xff : 0x00;
-        }
-        return r;
+        return to_mask((LaneMaskType)(a.native_vector >= b.native_vector));
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     friend Mask operator==(const Vec &a, const Vec &b) {
-        Mask r;
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = a[i] == b[i] ? 0xff : 0x00;
-        }
-        return r;
+        return to_mask((LaneMaskType)(a.native_vector == b.native_vector));
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     friend Mask operator!=(const Vec &a, const Vec &b) {
-        Mask r;
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = a[i] != b[i] ? 0xff : 0x00;
-        }
-        return r;
+        return to_mask((LaneMaskType)(a.native_vector != b.native_vector));
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     static Vec select(const Mask &cond, const Vec &true_value, const Vec &false_value) {
-        Vec r(empty);
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = cond[i] ? true_value[i] : false_value[i];
-        }
-        return r;
+        return blend(from_mask(cond), true_value, false_value);
     }
 
     template <typename OtherVec>
@@ -1109,26 +1095,53 @@ public:
 #endif
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
+    // Same as halide_cpp_max() and halide_cpp_min() on each lane, NaNs included.
     static Vec max(const Vec &a, const Vec &b) {
-        Vec r(empty);
-        for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = ::halide_cpp_max(a[i], b[i]);
-        }
-        return r;
+        return blend((LaneMaskType)(a.native_vector > b.native_vector), a, b);
     }
 
-    // TODO: this should be improved by taking advantage of native operator support.
     static Vec min(const Vec &a, const Vec &b) {
-        Vec r(empty);
+        return blend((LaneMaskType)(a.native_vector < b.native_vector), a, b);
+    }
+
+private:
+    template<typename, size_t> friend class NativeVector;
+
+    // Pick the lanes of a where the mask is set, and of b elsewhere. The
+    // values are blended as bits, so this works for any element type.
+    static Vec blend(const LaneMaskType &m, const Vec &a, const Vec &b) {
+        LaneMaskType bits = ((LaneMaskType)a.native_vector & m) | ((LaneMaskType)b.native_vector & ~m);
+        return Vec(from_native_vector, (NativeVectorType)bits);
+    }
+
+    // The Masks have a uint8_t lane per lane of the vector, so the lanes
+    // of the other masks must be narrowed or widened to match. This is a
+    // single instruction or two where __builtin_convertvector exists (it
+    // is exact between integer types, unlike the float->int conversions
+    // convert_from avoids it for).
+    static Mask to_mask(const LaneMaskType &m) {
+#if __has_builtin(__builtin_convertvector)
+        return Mask(Mask::from_native_vector, __builtin_convertvector(m, typename Mask::NativeVectorType));
+#else
+        Mask r(Mask::empty);
         for (size_t i = 0; i < Lanes; i++) {
-            r.native_vector[i] = ::halide_cpp_min(a[i], b[i]);
+            r.native_vector[i] = m[i] ? 0xff : 0x00;
         }
         return r;
+#endif
     }
 
-private:
-    template<typename, size_t> friend class NativeVector;
+    static LaneMaskType from_mask(const Mask &cond) {
+#if __has_builtin(__builtin_convertvector)
+        return (LaneMaskType)(__builtin_convertvector(cond.native_vector, LaneMaskType) != 0);
+#else
+        LaneMaskType m;
+        for (size_t i = 0; i < Lanes; i++) {
+            m[i] = cond.native_vector[i] ? -1 : 0;
+        }
+        return m;
+#endif
+    }
 
     NativeVectorType native_vector;
 
@@ -1588,6 +1601,13 @@ void CodeGen_C::compile(const LoweredFunc &f) {
         // Emit the argv version
         stream << "int " << simple_name << "_argv(void **args) HALIDE_FUNCTION_ATTRS;\n";
 
+        if (target.has_feature(Target::AsyncEntry)) {
+            // And the version that runs it on the thread pool. See
+            // halide_do_async_call.
+            stream << "int " << simple_name << "_async(void **args, halide_async_callback_t callback, "
+                   << "void *callback_context) HALIDE_FUNCTION_ATTRS;\n";
+        }
+
         // And also the metadata.
         stream << "const struct halide_filter_metadata_t *" << simple_name << "_metadata() HALIDE_FUNCTION_ATTRS;\n";
     }
@@ -1922,6 +1942,11 @@ void CodeGen_C::visit(const Call *op) {
     internal_assert(op->is_extern() || op->is_intrinsic())
         << "Can only codegen extern calls and intrinsics\n";
 
+    // Only the realizations of Funcs scheduled async() make semaphores,
+    // and the loops forking their halves may have been renamed.
+    user_assert(op->name != "halide_make_semaphore")
+        << "Can't emit C: the C backend doesn't support Funcs scheduled async().\n";
+
     ostringstream rhs;
 
     // Handle intrinsics first
@@ -2151,6 +2176,10 @@ void CodeGen_C::visit(const Call *op) {
         user_error << "Signed integer overflow occurred during constant-folding. Signed"
             " integer overflow for int32 and int64 is undefined behavior in"
             " Halide.\n";
+    } else if (op->is_intrinsic(Call::cpu_has_features)) {
+        // The generated C is compiled for a single feature set, so
+        // always take the generic path.
+        rhs << "false";
     } else if (op->is_intrinsic(Call::prefetch)) {
         user_assert((op->args.size() == 4) && is_one(op->args[2]))
             << "Only prefetch of 1 cache line is supported in C backend.\n";
@@ -2159,6 +2188,13 @@ void CodeGen_C::visit(const Call *op) {
         rhs << "__builtin_prefetch("
             << "((" << print_type(op->type) << " *)" << print_name(base->name)
             << " + " << print_expr(op->args[1]) << "), 1)";
+    } else if (op->is_intrinsic(Call::address_of)) {
+        internal_assert(op->args.size() == 1);
+        const Load *load = op->args[0].as<Load>();
+        internal_assert(load && load->type.is_scalar())
+            << "address_of takes a scalar load\n";
+        rhs << "(void *)((" << print_type(load->type) << " *)" << print_name(load->name)
+            << " + " << print_expr(load->index) << ")";
     } else if (op->is_intrinsic(Call::indeterminate_expression)) {
         user_error << "Indeterminate expression occurred during constant-folding.\n";
     } else if (op->is_intrinsic(Call::size_of_halide_buffer_t)) {
@@ -2253,6 +2289,16 @@ void CodeGen_C::visit(const Load *op) {
 
 void CodeGen_C::visit(const Store *op) {
     user_assert(is_one(op->predicate)) << "Predicated store is not supported by C backend.\n";
+    if (const Call *call = op->value.as<Call>()) {
+        if (call->is_intrinsic(Call::nontemporal_store)) {
+            // There's no portable way to write a streaming store in
+            // C, so just store the value.
+            print_stmt(Store::make(op->name, call->args[0], op->index, op->param, op->predicate));
+            return;
+        }
+        user_assert(!call->is_intrinsic(Call::atomic_add))
+            << "Atomic updates of " << op->name << " are not supported by this backend.\n";
+    }
 
     Type t = op->value.type();
     string id_value = print_expr(op->value);
@@ -2403,8 +2449,24 @@ void CodeGen_C::visit(const For *op) {
     string id_extent = print_expr(op->extent);
 
     if (op->for_type == ForType::Parallel) {
+        ParallelPolicy policy;
+        int chunk;
         do_indent();
-        stream << "#pragma omp parallel for\n";
+        stream << "#pragma omp parallel for";
+        if (get_parallel_policy(op->name, &policy, &chunk)) {
+            switch (policy) {
+            case ParallelPolicy::Dynamic:
+                stream << " schedule(dynamic, " << chunk << ")";
+                break;
+            case ParallelPolicy::Guided:
+                stream << " schedule(guided, " << chunk << ")";
+                break;
+            case ParallelPolicy::Static:
+                stream << " schedule(static)";
+                break;
+            }
+        }
+        stream << "\n";
     } else {
         internal_assert(op->for_type == ForType::Serial)
             << "Can only emit serial or parallel for loops to C\n";
@@ -2647,6 +2709,10 @@ void CodeGen_C::visit(const Shuffle *op) {
     print_assignment(op->type, rhs.str());
 }
 
+void CodeGen_C::visit(const VectorReduce *op) {
+    print_expr(lower_vector_reduce(op));
+}
+
 void CodeGen_C::test() {
     LoweredArgument buffer_arg("buf", Argument::OutputBuffer, Int(32), 3);
     LoweredArgument float_arg("alpha", Argument::InputScalar, Float(32), 0);
@@ -201,6 +201,7 @@ protected:
     void visit(const Evaluate *);
     void visit(const Shuffle *);
     void visit(const Prefetch *);
+    void visit(const VectorReduce *);
 
     void visit_binop(Type t, Expr a, Expr b, const char *op);
 
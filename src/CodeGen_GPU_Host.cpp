@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 
 #include "CodeGen_GPU_Host.h"
@@ -36,8 +37,11 @@ public:
     Expr num_threads[4];
     Expr num_blocks[4];
     Expr shared_mem_size;
+    // Whether the blocks of the kernel synchronize with each other, so
+    // that they must all be resident (see FusePersistentGPUKernels).
+    bool grid_barrier;
 
-    ExtractBounds() : shared_mem_size(0), found_shared(false) {
+    ExtractBounds() : shared_mem_size(0), grid_barrier(false), found_shared(false) {
         for (int i = 0; i < 4; i++) {
             num_threads[i] = num_blocks[i] = 1;
         }
@@ -93,6 +97,13 @@ private:
         }
         allocate->body.accept(this);
     }
+
+    void visit(const Call *op) {
+        if (op->name == "halide_gpu_grid_barrier") {
+            grid_barrier = true;
+        }
+        IRVisitor::visit(op);
+    }
 };
 
 template<typename CodeGen_CPU>
@@ -143,6 +154,7 @@ void CodeGen_GPU_Host<CodeGen_CPU>::compile_func(const LoweredFunc &f,
                                                  const std::string &simple_name,
                                                  const std::string &extern_name) {
     function_name = simple_name;
+    cuda_constant_bytes = 0;
 
     // Create a new module for all of the kernels we find in this function.
     for (pair<const DeviceAPI, CodeGen_GPU_Dev *> &i : cgdev) {
@@ -242,6 +254,22 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
                  << bounds.num_blocks[2] << ", "
                  << bounds.num_blocks[3] << ") blocks\n";
 
+        // The rest of the launch limits depend on the device and on the
+        // size of the shared memory, so they are checked at runtime.
+        if (loop->device_api == DeviceAPI::CUDA) {
+            Expr threads = simplify(bounds.num_threads[0] * bounds.num_threads[1] * bounds.num_threads[2]);
+            if (const int64_t *t = as_const_int(threads)) {
+                user_assert(*t <= 1024)
+                    << "The GPU kernel over " << loop->name << " has blocks of " << *t
+                    << " threads, but CUDA devices can't launch more than 1024 threads per block.\n";
+                if (*t > 32 && *t % 32 != 0) {
+                    user_warning << "The GPU kernel over " << loop->name << " has blocks of " << *t
+                                 << " threads, which is not a multiple of the warp size (32), "
+                                 << "so some of its warps run partly idle.\n";
+                }
+            }
+        }
+
         // compile the kernel
         string kernel_name = unique_name("kernel_" + loop->name);
         for (size_t i = 0; i < kernel_name.size(); i++) {
@@ -335,6 +363,34 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
             }
         }
 
+        // Read the buffers scheduled in GPU constant memory from
+        // there. On CUDA, they share the 64 KB of constant memory of the
+        // module. Other buffers are never moved there, as the runtime
+        // copies each of them in before every launch.
+        const int max_constant_bytes = 64 * 1024;
+        for (size_t i = 0; i < closure_args.size(); i++) {
+            DeviceArgument &arg = closure_args[i];
+            if (!arg.is_buffer || !allocations.contains(arg.name)) {
+                continue;
+            }
+            MemoryType memory_type = allocations.get(arg.name).memory_type;
+            if (memory_type == MemoryType::GPUConstant) {
+                user_assert(!arg.write)
+                    << "Buffer " << arg.name << " is stored in GPU constant memory, "
+                    << "but is written to by the kernel " << kernel_name << ".\n";
+                user_assert(arg.size > 0 && (int)arg.size <= max_constant_bytes)
+                    << "Buffer " << arg.name << " is stored in GPU constant memory, "
+                    << "so it must have a constant size of at most " << max_constant_bytes << " bytes.\n";
+                arg.memory_type = MemoryType::GPUConstant;
+                if (loop->device_api == DeviceAPI::CUDA) {
+                    cuda_constant_bytes += (int)arg.size;
+                    user_assert(cuda_constant_bytes <= max_constant_bytes)
+                        << "The buffers stored in GPU constant memory by the CUDA kernels of "
+                        << function_name << " don't fit in its " << max_constant_bytes << " bytes.\n";
+                }
+            }
+        }
+
         CodeGen_GPU_Dev *gpu_codegen = cgdev[loop->device_api];
         user_assert(gpu_codegen != nullptr)
             << "Loop is scheduled on device " << loop->device_api
@@ -441,7 +497,15 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
                                     i));
             }
 
-            builder->CreateStore(ConstantInt::get(i8_t, closure_args[i].is_buffer),
+            // The CUDA runtime copies the buffers in constant memory,
+            // flagged with 2, into the globals the kernel reads them
+            // from.
+            int is_buffer = closure_args[i].is_buffer;
+            if (loop->device_api == DeviceAPI::CUDA &&
+                closure_args[i].memory_type == MemoryType::GPUConstant) {
+                is_buffer = 2;
+            }
+            builder->CreateStore(ConstantInt::get(i8_t, is_buffer),
                                  builder->CreateConstGEP2_32(
                                     gpu_arg_is_buffer_arr_type,
                                     gpu_arg_is_buffer_arr,
@@ -535,6 +599,10 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
             gpu_num_coords_dim1,
         };
         std::string run_fn_name = "halide_" + api_unique_name + "_run";
+        if (bounds.grid_barrier) {
+            internal_assert(loop->device_api == DeviceAPI::CUDA);
+            run_fn_name += "_cooperative";
+        }
         llvm::Function *dev_run_fn = module->getFunction(run_fn_name);
         internal_assert(dev_run_fn) << "Could not find " << run_fn_name << " in module\n";
         Value *result = builder->CreateCall(dev_run_fn, launch_args);
@@ -76,6 +76,10 @@ protected:
 private:
     /** Child code generator for device kernels. */
     std::map<DeviceAPI, CodeGen_GPU_Dev *> cgdev;
+
+    /** The bytes of constant memory used by the CUDA kernels of the
+     * function, which share the 64 KB of their module. */
+    int cuda_constant_bytes = 0;
 };
 
 }  // namespace Internal
@@ -309,6 +309,14 @@ void CodeGen_Hexagon::compile_func(const LoweredFunc &f,
     body = unpredicate_loads_stores(body);
     debug(2) << "Lowering after unpredicating loads/stores:\n" << body << "\n\n";
 
+    if (is_hvx_v65_or_later()) {
+        // Generate vgathers before the gathers get turned into vlut
+        // calls or scalarized.
+        debug(1) << "Generating vgathers from VTCM...\n";
+        body = vgather_generator(body, target, alignment_info);
+        debug(2) << "Lowering after generating vgathers:\n" << body << "\n\n";
+    }
+
     debug(1) << "Optimizing shuffles...\n";
     // vlut always indexes 64 bytes of the LUT at a time, even in 128 byte mode.
     const int lut_alignment = 64;
@@ -1771,6 +1779,29 @@ void CodeGen_Hexagon::visit(const Call *op) {
     internal_assert(op->is_extern() || op->is_intrinsic())
         << "Can only codegen extern calls and intrinsics\n";
 
+    if (op->name == "halide.hexagon.vgather.vh") {
+        // Generated by vgather_generator: (dst, dst index, src,
+        // src region size - 1, 16-bit byte offsets into src).
+        internal_assert(op->args.size() == 5);
+        const StringImm *dst = op->args[0].as<StringImm>();
+        const StringImm *src = op->args[2].as<StringImm>();
+        internal_assert(dst && src);
+        bool is_128B = target.has_feature(Halide::Target::HVX_128);
+        llvm::Function *fn = Intrinsic::getDeclaration(module.get(), IPICK(is_128B, Intrinsic::hexagon_V6_vgathermh));
+        llvm::FunctionType *fn_type = fn->getFunctionType();
+        Value *dst_ptr = codegen_buffer_pointer(dst->value, Int(16), op->args[1]);
+        Value *src_ptr = codegen_buffer_pointer(src->value, Int(16), Expr(0));
+        Value *args[] = {
+            builder->CreatePointerCast(dst_ptr, fn_type->getParamType(0)),
+            builder->CreatePtrToInt(src_ptr, fn_type->getParamType(1)),
+            codegen(op->args[3]),
+            builder->CreateBitCast(codegen(op->args[4]), fn_type->getParamType(3)),
+        };
+        builder->CreateCall(fn, args);
+        value = ConstantInt::get(i32_t, 0);
+        return;
+    }
+
     // Map Halide functions to Hexagon intrinsics, plus a boolean
     // indicating if the intrinsic has signed variants or not.
     static std::map<string, std::pair<string, bool>> functions = {
@@ -1966,6 +1997,28 @@ void CodeGen_Hexagon::visit(const Select *op) {
     }
 }
 
+void CodeGen_Hexagon::visit(const Allocate *alloc) {
+    if (alloc->memory_type == MemoryType::VTCM && !alloc->new_expr.defined()) {
+        // Allocate VTCM with halide_vtcm_malloc, which falls back to
+        // the heap if there is no VTCM to be had. The size has
+        // already been checked for overflow by the time new_expr is
+        // evaluated.
+        Expr size = make_const(Int(32), alloc->type.bytes());
+        for (Expr e : alloc->extents) {
+            size *= e;
+        }
+        size = simplify(size + allocation_padding(alloc->type));
+        Expr new_expr = Call::make(Handle(), "halide_vtcm_malloc",
+                                   {select(alloc->condition, size, 0)}, Call::Extern);
+        Stmt vtcm_alloc = Allocate::make(alloc->name, alloc->type, alloc->memory_type,
+                                         alloc->extents, alloc->condition, alloc->body,
+                                         new_expr, "halide_vtcm_free");
+        CodeGen_Posix::visit(vtcm_alloc.as<Allocate>());
+    } else {
+        CodeGen_Posix::visit(alloc);
+    }
+}
+
 void CodeGen_Hexagon::visit(const GT *op) {
     if (op->type.is_vector()) {
         value = call_intrin(eliminated_bool_type(op->type, op->a.type()),
@@ -112,7 +112,11 @@ void unpack_closure(const Closure& closure,
 
 llvm::Type *llvm_type_of(LLVMContext *c, Halide::Type t) {
     if (t.lanes() == 1) {
-        if (t.is_float()) {
+        if (t.is_bfloat()) {
+            // There is no bfloat math in llvm. It is only stored, as
+            // its bits; see EmulateBFloat16Math.
+            return llvm::Type::getIntNTy(*c, t.bits());
+        } else if (t.is_float()) {
             switch (t.bits()) {
             case 16:
                 return llvm::Type::getHalfTy(*c);
@@ -152,7 +156,9 @@ bool function_takes_user_context(const std::string &name) {
         "halide_device_malloc",
         "halide_device_and_host_malloc",
         "halide_device_sync",
+        "halide_distributed_exchange",
         "halide_do_par_for",
+        "halide_do_par_for_chunked",
         "halide_do_task",
         "halide_error",
         "halide_free",
@@ -160,6 +166,11 @@ bool function_takes_user_context(const std::string &name) {
         "halide_print",
         "halide_profiler_memory_allocate",
         "halide_profiler_memory_free",
+        "halide_profiler_metrics_start",
+        "halide_profiler_metrics_end",
+        "halide_profiler_metrics_func_end",
+        "halide_profiler_metrics_memory_allocate",
+        "halide_profiler_metrics_memory_free",
         "halide_profiler_pipeline_start",
         "halide_profiler_pipeline_end",
         "halide_profiler_stack_peak_update",
@@ -171,7 +182,13 @@ bool function_takes_user_context(const std::string &name) {
         "halide_memoization_cache_lookup",
         "halide_memoization_cache_store",
         "halide_memoization_cache_release",
+        "halide_persistent_storage_acquire",
+        "halide_persistent_storage_first_frame",
+        "halide_persistent_storage_last_frame",
+        "halide_persistent_storage_set_frames",
+        "halide_persistent_storage_release",
         "halide_cuda_run",
+        "halide_cuda_run_cooperative",
         "halide_opencl_run",
         "halide_opengl_run",
         "halide_openglcompute_run",
@@ -191,6 +208,8 @@ bool function_takes_user_context(const std::string &name) {
         "halide_qurt_hvx_lock",
         "halide_qurt_hvx_unlock",
         "halide_qurt_hvx_unlock_as_destructor",
+        "halide_vtcm_malloc",
+        "halide_vtcm_free",
         "halide_cuda_initialize_kernels",
         "halide_opencl_initialize_kernels",
         "halide_opengl_initialize_kernels",
@@ -198,6 +217,7 @@ bool function_takes_user_context(const std::string &name) {
         "halide_metal_initialize_kernels",
         "halide_d3d12compute_initialize_kernels",
         "halide_get_gpu_device",
+        "halide_get_memory_budget",
         "halide_upgrade_buffer_t",
         "halide_downgrade_buffer_t",
         "halide_downgrade_buffer_t_device_fields",
@@ -275,6 +295,63 @@ Expr lower_euclidean_mod(Expr a, Expr b) {
 
 namespace {
 
+Expr combine_lanes(VectorReduce::Operator op, Expr a, Expr b) {
+    switch (op) {
+    case VectorReduce::Add:
+        return Add::make(a, b);
+    case VectorReduce::Mul:
+        return Mul::make(a, b);
+    case VectorReduce::Min:
+        return Min::make(a, b);
+    case VectorReduce::Max:
+        return Max::make(a, b);
+    case VectorReduce::And:
+        // Bool vectors may have become masks by now.
+        return a.type().is_bool() ? And::make(a, b) : (a & b);
+    case VectorReduce::Or:
+        return a.type().is_bool() ? Or::make(a, b) : (a | b);
+    }
+    internal_error << "Unknown VectorReduce operator\n";
+    return Expr();
+}
+
+}  // namespace
+
+Expr lower_vector_reduce(const VectorReduce *op) {
+    const int lanes = op->type.lanes();
+    int factor = op->value.type().lanes() / lanes;
+
+    // Each step reads its input more than once, so bind the input of
+    // each step to a name.
+    vector<pair<string, Expr>> lets;
+    Expr v = op->value;
+    while (factor > 1) {
+        string name = unique_name('t');
+        lets.push_back({name, v});
+        Expr var = Variable::make(v.type(), name);
+        if (factor % 2 == 0) {
+            // Output lane i reduces adjacent input lanes, so combining
+            // the even lanes with the odd ones halves the factor.
+            int half = v.type().lanes() / 2;
+            v = combine_lanes(op->op, Shuffle::make_slice(var, 0, 2, half),
+                              Shuffle::make_slice(var, 1, 2, half));
+            factor /= 2;
+        } else {
+            v = Shuffle::make_slice(var, 0, factor, lanes);
+            for (int i = 1; i < factor; i++) {
+                v = combine_lanes(op->op, v, Shuffle::make_slice(var, i, factor, lanes));
+            }
+            factor = 1;
+        }
+    }
+    for (size_t i = lets.size(); i > 0; i--) {
+        v = Let::make(lets[i - 1].first, lets[i - 1].second, v);
+    }
+    return v;
+}
+
+namespace {
+
 // This mutator rewrites predicated loads and stores as unpredicated
 // loads/stores with explicit conditions, scalarizing if necessary.
 class UnpredicateLoadsStores : public IRMutator2 {
@@ -414,6 +491,16 @@ void get_target_options(const llvm::Module &module, llvm::TargetOptions &options
     options.FloatABIType =
         use_soft_float_abi ? llvm::FloatABI::Soft : llvm::FloatABI::Hard;
     options.RelaxELFRelocations = false;
+
+    // LLVM defaults to the soft-float ABIs on RISC-V, which can't be
+    // linked with code for the Linux ones, which pass floats in the
+    // float registers.
+    llvm::Triple triple(module.getTargetTriple());
+    if (triple.getArch() == llvm::Triple::riscv32) {
+        options.MCOptions.ABIName = "ilp32d";
+    } else if (triple.getArch() == llvm::Triple::riscv64) {
+        options.MCOptions.ABIName = "lp64d";
+    }
 }
 
 
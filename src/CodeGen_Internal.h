@@ -75,6 +75,12 @@ Expr lower_euclidean_div(Expr a, Expr b);
 Expr lower_euclidean_mod(Expr a, Expr b);
 ///@}
 
+/** Define a VectorReduce in terms of shuffles and ordinary vector
+ * arithmetic, for targets without a horizontal instruction that
+ * matches it. Lanes are combined in pairs while the reduction factor is
+ * even, which halves the number of lanes at each step. */
+Expr lower_vector_reduce(const VectorReduce *op);
+
 /** Replace predicated loads/stores with unpredicated equivalents
  * inside branches. */
 Stmt unpredicate_loads_stores(Stmt s);
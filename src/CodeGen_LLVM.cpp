@@ -12,7 +12,10 @@
 #include "CodeGen_LLVM.h"
 #include "CodeGen_MIPS.h"
 #include "CodeGen_PowerPC.h"
+#include "CodeGen_RISCV.h"
+#include "CodeGen_WebAssembly.h"
 #include "CodeGen_X86.h"
+#include "CompileTimer.h"
 #include "Debug.h"
 #include "Deinterleave.h"
 #include "IROperator.h"
@@ -23,6 +26,8 @@
 #include "LLVM_Runtime_Linker.h"
 #include "Lerp.h"
 #include "MatlabWrapper.h"
+#include "MemoryPlanning.h"
+#include "ParallelPolicies.h"
 #include "Simplify.h"
 #include "Util.h"
 
@@ -125,6 +130,18 @@ using std::vector;
 #define InitializePowerPCAsmPrinter()   InitializeAsmPrinter(PowerPC)
 #endif
 
+#ifdef WITH_WEBASSEMBLY
+#define InitializeWebAssemblyTarget()       InitializeTarget(WebAssembly)
+#define InitializeWebAssemblyAsmParser()    InitializeAsmParser(WebAssembly)
+#define InitializeWebAssemblyAsmPrinter()   InitializeAsmPrinter(WebAssembly)
+#endif
+
+#ifdef WITH_RISCV
+#define InitializeRISCVTarget()       InitializeTarget(RISCV)
+#define InitializeRISCVAsmParser()    InitializeAsmParser(RISCV)
+#define InitializeRISCVAsmPrinter()   InitializeAsmPrinter(RISCV)
+#endif
+
 #ifdef WITH_HEXAGON
 #define InitializeHexagonTarget()       InitializeTarget(Hexagon)
 #define InitializeHexagonAsmParser()    InitializeAsmParser(Hexagon)
@@ -149,6 +166,34 @@ llvm::GlobalValue::LinkageTypes llvm_linkage(LinkageType t) {
     }
 }
 
+// The target that a loop nest specialized on the given
+// cpu_has_features call is compiled for.
+Target cpu_features_target(Target t, const Call *op) {
+    for (const Expr &e : op->args) {
+        const int64_t *f = as_const_int(e);
+        internal_assert(f) << "cpu_has_features takes constant features\n";
+        t = t.with_feature((Target::Feature)*f);
+    }
+    return t;
+}
+
+// Find the union of a target and all the feature sets that loop
+// nests are specialized on.
+class FindCPUFeatures : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    void visit(const Call *op) override {
+        if (op->is_intrinsic(Call::cpu_has_features)) {
+            target = cpu_features_target(target, op);
+        }
+        IRGraphVisitor::visit(op);
+    }
+
+public:
+    Target target;
+    FindCPUFeatures(const Target &t) : target(t) {}
+};
+
 }
 
 CodeGen_LLVM::CodeGen_LLVM(Target t) :
@@ -259,7 +304,8 @@ CodeGen_LLVM::CodeGen_LLVM(Target t) :
     min_f64(Float(64).min()),
     max_f64(Float(64).max()),
     destructor_block(nullptr),
-    strict_float(t.has_feature(Target::StrictFloat)) {
+    strict_float(t.has_feature(Target::StrictFloat)),
+    emit_nontemporal_stores(false) {
     initialize_llvm();
 }
 
@@ -321,6 +367,10 @@ CodeGen_LLVM *CodeGen_LLVM::new_for_target(const Target &target,
         return make_codegen<CodeGen_MIPS>(target, context);
     } else if (target.arch == Target::POWERPC) {
         return make_codegen<CodeGen_PowerPC>(target, context);
+    } else if (target.arch == Target::WebAssembly) {
+        return make_codegen<CodeGen_WebAssembly>(target, context);
+    } else if (target.arch == Target::RISCV) {
+        return make_codegen<CodeGen_RISCV>(target, context);
     } else if (target.arch == Target::Hexagon) {
         return make_codegen<CodeGen_Hexagon>(target, context);
     }
@@ -456,6 +506,8 @@ bool CodeGen_LLVM::llvm_AArch64_enabled = false;
 bool CodeGen_LLVM::llvm_NVPTX_enabled = false;
 bool CodeGen_LLVM::llvm_Mips_enabled = false;
 bool CodeGen_LLVM::llvm_PowerPC_enabled = false;
+bool CodeGen_LLVM::llvm_WebAssembly_enabled = false;
+bool CodeGen_LLVM::llvm_RISCV_enabled = false;
 bool CodeGen_LLVM::llvm_AMDGPU_enabled = false;
 
 namespace {
@@ -464,6 +516,7 @@ struct MangledNames {
     string simple_name;
     string extern_name;
     string argv_name;
+    string async_name;
     string metadata_name;
 };
 
@@ -477,12 +530,16 @@ MangledNames get_mangled_names(const std::string &name,
     names.simple_name = extract_namespaces(name, namespaces);
     names.extern_name = names.simple_name;
     names.argv_name = names.simple_name + "_argv";
+    names.async_name = names.simple_name + "_async";
     names.metadata_name = names.simple_name + "_metadata";
 
     if (linkage != LinkageType::Internal &&
         ((mangling == NameMangling::Default &&
           target.has_feature(Target::CPlusPlusMangling)) ||
          mangling == NameMangling::CPlusPlus)) {
+        user_assert(!target.has_feature(Target::AsyncEntry))
+            << "Can't compile " << name << " with both C++ name mangling and "
+            << "the async_entry target feature.\n";
         std::vector<ExternFuncArgument> mangle_args;
         for (const auto &arg : args) {
             if (arg.kind == Argument::InputScalar) {
@@ -509,9 +566,19 @@ MangledNames get_mangled_names(const LoweredFunc &f, const Target &target) {
 }  // namespace
 
 std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
+    CompileTimer timer("LLVM code generation");
     input_module = &input;
 
+    // Loop nests specialized on cpu_has_features may call into the
+    // runtime modules for the extra features, so link those in too.
+    FindCPUFeatures cpu_features(target);
+    for (const auto &f : input.functions()) {
+        f.body.accept(&cpu_features);
+    }
+    Target base_target = target;
+    target = cpu_features.target;
     init_module();
+    target = base_target;
 
     debug(1) << "Target triple of initial module: " << module->getTargetTriple() << "\n";
 
@@ -565,7 +632,11 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
         if (f.linkage == LinkageType::ExternalPlusMetadata) {
             llvm::Function *wrapper = add_argv_wrapper(names.argv_name);
             llvm::Function *metadata_getter = embed_metadata_getter(names.metadata_name,
-                names.simple_name, f.args, input.get_metadata_name_map());
+                names.simple_name, f.args, input.get_metadata_name_map(), memory_arena_size(f.body));
+
+            if (target.has_feature(Target::AsyncEntry)) {
+                add_async_wrapper(names.async_name, wrapper);
+            }
 
             if (target.has_feature(Target::Matlab)) {
                 define_matlab_wrapper(module.get(), wrapper, metadata_getter);
@@ -936,9 +1007,48 @@ llvm::Function *CodeGen_LLVM::add_argv_wrapper(const std::string &name) {
     return wrapper;
 }
 
+// Make a wrapper that queues a call of the argv wrapper on the thread
+// pool and returns without waiting for it. The callback gets the
+// result instead.
+llvm::Function *CodeGen_LLVM::add_async_wrapper(const std::string &name, llvm::Function *argv_wrapper) {
+    llvm::Type *void_star = i8_t->getPointerTo();
+    llvm::Type *callback_args_t[] = {void_star, i32_t};
+    llvm::Type *callback_t = llvm::FunctionType::get(void_t, callback_args_t, false)->getPointerTo();
+    llvm::Type *args_t[] = {void_star->getPointerTo(), callback_t, void_star};
+    llvm::FunctionType *func_t = llvm::FunctionType::get(i32_t, args_t, false);
+    llvm::Function *wrapper = llvm::Function::Create(func_t, llvm::GlobalValue::ExternalLinkage, name, module.get());
+    llvm::BasicBlock *block = llvm::BasicBlock::Create(module->getContext(), "entry", wrapper);
+    builder->SetInsertPoint(block);
+
+    llvm::Function::arg_iterator arg = wrapper->arg_begin();
+    llvm::Value *arg_array = iterator_to_pointer(arg++);
+    llvm::Value *callback = iterator_to_pointer(arg++);
+    llvm::Value *callback_context = iterator_to_pointer(arg++);
+
+    // The user context, if there is one, picks the thread pool.
+    llvm::Value *user_context = ConstantPointerNull::get(cast<PointerType>(void_star));
+    for (size_t i = 0; i < current_function_args.size(); i++) {
+        if (current_function_args[i].name == "__user_context") {
+            llvm::Value *ptr = builder->CreateConstGEP1_32(arg_array, i);
+            ptr = builder->CreateLoad(ptr);
+            ptr = builder->CreatePointerCast(ptr, void_star->getPointerTo());
+            user_context = builder->CreateLoad(ptr);
+        }
+    }
+
+    llvm::Type *call_args_t[] = {void_star, argv_wrapper->getType(), void_star->getPointerTo(),
+                                 callback_t, void_star};
+    llvm::FunctionType *call_t = llvm::FunctionType::get(i32_t, call_args_t, false);
+    llvm::Value *do_async_call = module->getOrInsertFunction("halide_do_async_call", call_t);
+    llvm::Value *call_args[] = {user_context, argv_wrapper, arg_array, callback, callback_context};
+    builder->CreateRet(builder->CreateCall(do_async_call, call_args));
+    internal_assert(!verifyFunction(*wrapper, &llvm::errs()));
+    return wrapper;
+}
+
 llvm::Function *CodeGen_LLVM::embed_metadata_getter(const std::string &metadata_name,
         const std::string &function_name, const std::vector<LoweredArgument> &args,
-        const std::map<std::string, std::string> &metadata_name_map) {
+        const std::map<std::string, std::string> &metadata_name_map, int64_t arena_size) {
     Constant *zero = ConstantInt::get(i32_t, 0);
 
     const int num_args = (int) args.size();
@@ -990,11 +1100,12 @@ llvm::Function *CodeGen_LLVM::embed_metadata_getter(const std::string &metadata_
 
     Value *zeros[] = {zero, zero};
     Constant *metadata_fields[] = {
-        /* version */ zero,
+        /* version */ ConstantInt::get(i32_t, 1),
         /* num_arguments */ ConstantInt::get(i32_t, num_args),
         /* arguments */ ConstantExpr::getInBoundsGetElementPtr(arguments_array, arguments_array_storage, zeros),
         /* target */ create_string_constant(map_string(target.to_string())),
-        /* name */ create_string_constant(map_string(function_name))
+        /* name */ create_string_constant(map_string(function_name)),
+        /* arena_size */ ConstantInt::get(i64_t, arena_size)
     };
 
     GlobalVariable *metadata_storage = new GlobalVariable(
@@ -1020,6 +1131,7 @@ llvm::Type *CodeGen_LLVM::llvm_type_of(Type t) {
 }
 
 void CodeGen_LLVM::optimize_module() {
+    CompileTimer timer("LLVM optimization");
     debug(3) << "Optimizing module\n";
 
     if (debug::debug_level() >= 3) {
@@ -1801,6 +1913,14 @@ void CodeGen_LLVM::visit(const Load *op) {
                 vec = builder->CreateInsertElement(vec, val, ConstantInt::get(i32_t, i));
             }
             value = vec;
+        } else if (use_gather(op->type)) {
+            // Native gathers. A GEP with a vector of indices makes a
+            // vector of pointers, one per lane.
+            Value *base = codegen_buffer_pointer(op->name, op->type.element_of(), ConstantInt::get(i32_t, 0));
+            Value *ptrs = builder->CreateInBoundsGEP(base, codegen(op->index));
+            Instruction *gather = builder->CreateMaskedGather(ptrs, op->type.bytes());
+            add_tbaa_metadata(gather, op->name, op->index);
+            value = gather;
         } else {
             // General gathers
             Value *index = codegen(op->index);
@@ -1944,6 +2064,94 @@ void CodeGen_LLVM::scalarize(Expr e) {
     value = result;
 }
 
+void CodeGen_LLVM::codegen_atomic_store(const Store *op) {
+    const Call *call = op->value.as<Call>();
+    internal_assert(call && call->is_intrinsic(Call::atomic_add) && call->args.size() == 1);
+
+    Halide::Type value_type = op->value.type();
+    Halide::Type elem_type = value_type.element_of();
+    internal_assert(elem_type.is_float() || elem_type.is_int() || elem_type.is_uint())
+        << "Can't do an atomic add on " << value_type << "\n";
+
+    Value *val = codegen(call->args[0]);
+    if (value_type.is_scalar()) {
+        Value *ptr = codegen_buffer_pointer(op->name, elem_type, op->index);
+        if (is_one(op->predicate)) {
+            codegen_atomic_add(elem_type, ptr, val);
+        } else {
+            Value *pred = codegen(op->predicate);
+            BasicBlock *do_bb = BasicBlock::Create(*context, "atomic_add_lane", function);
+            BasicBlock *after_bb = BasicBlock::Create(*context, "atomic_add_lane_after", function);
+            builder->CreateCondBr(pred, do_bb, after_bb);
+            builder->SetInsertPoint(do_bb);
+            codegen_atomic_add(elem_type, ptr, val);
+            builder->CreateBr(after_bb);
+            builder->SetInsertPoint(after_bb);
+        }
+        return;
+    }
+
+    // Vector atomics are done one lane at a time, so that lanes that
+    // hit the same address are still all accumulated.
+    Value *index = codegen(op->index);
+    Value *pred = is_one(op->predicate) ? nullptr : codegen(op->predicate);
+    for (int i = 0; i < value_type.lanes(); i++) {
+        Value *lane = ConstantInt::get(i32_t, i);
+        Value *idx = builder->CreateExtractElement(index, lane);
+        Value *v = builder->CreateExtractElement(val, lane);
+        Value *ptr = codegen_buffer_pointer(op->name, elem_type, idx);
+        if (pred) {
+            Value *p = builder->CreateExtractElement(pred, lane);
+            BasicBlock *do_bb = BasicBlock::Create(*context, "atomic_add_lane", function);
+            BasicBlock *after_bb = BasicBlock::Create(*context, "atomic_add_lane_after", function);
+            builder->CreateCondBr(p, do_bb, after_bb);
+            builder->SetInsertPoint(do_bb);
+            codegen_atomic_add(elem_type, ptr, v);
+            builder->CreateBr(after_bb);
+            builder->SetInsertPoint(after_bb);
+        } else {
+            codegen_atomic_add(elem_type, ptr, v);
+        }
+    }
+}
+
+void CodeGen_LLVM::codegen_atomic_add(Type t, llvm::Value *ptr, llvm::Value *val) {
+    if (!t.is_float()) {
+        builder->CreateAtomicRMW(AtomicRMWInst::Add, ptr, val, AtomicOrdering::Monotonic);
+        return;
+    }
+
+    // There is no floating-point atomicrmw, so we reinterpret the
+    // value as an integer and retry a compare-and-swap until no other
+    // thread has modified it in between.
+    llvm::Type *int_type = llvm::Type::getIntNTy(*context, t.bits());
+    Value *int_ptr = builder->CreatePointerCast(ptr, int_type->getPointerTo());
+    BasicBlock *entry_bb = builder->GetInsertBlock();
+    BasicBlock *loop_bb = BasicBlock::Create(*context, "atomic_add_loop", function);
+    BasicBlock *after_bb = BasicBlock::Create(*context, "atomic_add_after", function);
+    // Other threads may be storing to the address, so even the first
+    // read of it must be atomic; a stale value just costs one more
+    // iteration of the loop.
+    LoadInst *initial = builder->CreateAlignedLoad(int_ptr, t.bytes());
+    initial->setAtomic(AtomicOrdering::Monotonic);
+    builder->CreateBr(loop_bb);
+
+    builder->SetInsertPoint(loop_bb);
+    PHINode *old_bits = builder->CreatePHI(int_type, 2);
+    old_bits->addIncoming(initial, entry_bb);
+    Value *old_val = builder->CreateBitCast(old_bits, val->getType());
+    Value *new_bits = builder->CreateBitCast(builder->CreateFAdd(old_val, val), int_type);
+    Value *result = builder->CreateAtomicCmpXchg(int_ptr, old_bits, new_bits,
+                                                 AtomicOrdering::Monotonic,
+                                                 AtomicOrdering::Monotonic);
+    Value *seen_bits = builder->CreateExtractValue(result, {0});
+    Value *success = builder->CreateExtractValue(result, {1});
+    old_bits->addIncoming(seen_bits, builder->GetInsertBlock());
+    builder->CreateCondBr(success, after_bb, loop_bb);
+
+    builder->SetInsertPoint(after_bb);
+}
+
 void CodeGen_LLVM::codegen_predicated_vector_store(const Store *op) {
     const Ramp *ramp = op->index.as<Ramp>();
     if (ramp && is_one(ramp->stride)) { // Dense vector store
@@ -2704,6 +2912,44 @@ void CodeGen_LLVM::visit(const Call *op) {
 
         value = builder->CreateCall(prefetch_fn, args);
 
+    } else if (op->is_intrinsic(Call::atomic_add)) {
+        internal_error << "atomic_add should only appear as the value of a Store\n";
+    } else if (op->is_intrinsic(Call::cpu_has_features)) {
+        Target t = cpu_features_target(target, op);
+        if (t == target) {
+            value = codegen(const_true());
+        } else if (target.has_feature(Target::JIT)) {
+            // JIT-compiled code runs on the machine it was compiled
+            // on, so the test can be done now.
+            Target host = get_host_target();
+            bool supported = true;
+            for (const Expr &e : op->args) {
+                supported = supported && host.has_feature((Target::Feature)*as_const_int(e));
+            }
+            value = codegen(make_bool(supported));
+        } else {
+            const int word_count = (Target::FeatureEnd + 63) / 64;
+            vector<uint64_t> words(word_count, 0);
+            for (const Expr &e : op->args) {
+                int f = (int)*as_const_int(e);
+                words[f >> 6] |= ((uint64_t)1) << (f & 63);
+            }
+            vector<Expr> words_struct_args;
+            for (uint64_t w : words) {
+                words_struct_args.push_back(UIntImm::make(UInt(64), w));
+            }
+            Expr can_use = Call::make(Int(32), "halide_can_use_target_features",
+                                      {word_count, Call::make(type_of<uint64_t *>(), Call::make_struct, words_struct_args, Call::Intrinsic)},
+                                      Call::Extern);
+            value = codegen(can_use != 0);
+        }
+    } else if (op->is_intrinsic(Call::address_of)) {
+        internal_assert(op->args.size() == 1);
+        const Load *load = op->args[0].as<Load>();
+        internal_assert(load && load->type.is_scalar())
+            << "address_of takes a scalar load\n";
+        llvm::Value *ptr = codegen_buffer_pointer(load->name, load->type, load->index);
+        value = builder->CreatePointerCast(ptr, llvm_type_of(op->type));
     } else if (op->is_intrinsic(Call::signed_integer_overflow)) {
         user_error << "Signed integer overflow occurred during constant-folding. Signed"
             " integer overflow for int32 and int64 is undefined behavior in"
@@ -2736,6 +2982,10 @@ void CodeGen_LLVM::visit(const Call *op) {
         internal_assert(op->args.size() == 1);
         Expr e = Internal::halide_exp(op->args[0]);
         e.accept(this);
+    } else if (op->call_type == Call::PureExtern && op->name == "tanh_f32") {
+        internal_assert(op->args.size() == 1);
+        Expr e = Internal::halide_tanh(op->args[0]);
+        e.accept(this);
     } else if (op->call_type == Call::PureExtern &&
                (op->name == "is_nan_f32" || op->name == "is_nan_f64")) {
         internal_assert(op->args.size() == 1);
@@ -2758,6 +3008,17 @@ void CodeGen_LLVM::visit(const Call *op) {
         builder->setDefaultFPMathTag(strict_fp_math_md);
 
         value = builder->CreateFCmpUNO(a, a);
+    } else if (op->is_extern() && op->name == "halide_make_semaphore") {
+        // The semaphores that async producers and their consumers
+        // use to wait for each other live on the stack.
+        internal_assert(op->args.size() == 1);
+        llvm::Function *init = module->getFunction("halide_semaphore_init");
+        internal_assert(init) << "Could not find halide_semaphore_init in initial module\n";
+        Value *sem = create_alloca_at_entry(i64_t, 4);
+        Value *args[] = {builder->CreatePointerCast(sem, init->getFunctionType()->getParamType(0)),
+                         codegen(op->args[0])};
+        builder->CreateCall(init, args);
+        value = builder->CreatePointerCast(sem, i8_t->getPointerTo());
     } else {
         // It's an extern call.
 
@@ -3146,10 +3407,20 @@ void CodeGen_LLVM::visit(const For *op) {
         // Return success
         return_with_error_code(ConstantInt::get(i32_t, 0));
 
-        // Move the builder back to the main function and call do_par_for
+        // Move the builder back to the main function and call
+        // do_par_for. The two halves of the fork made for an async
+        // Func wait for each other, so they must run concurrently.
         builder->restoreIP(call_site);
-        llvm::Function *do_par_for = module->getFunction("halide_do_par_for");
-        internal_assert(do_par_for) << "Could not find halide_do_par_for in initial module\n";
+        // A loop scheduled with a parallel policy hands out its
+        // iterations in chunks.
+        ParallelPolicy policy;
+        int chunk;
+        bool chunked = get_parallel_policy(op->name, &policy, &chunk);
+        const char *do_par_for_name =
+            ends_with(op->name, ".__async_fork") ? "halide_do_concurrent_tasks" :
+            chunked ? "halide_do_par_for_chunked" : "halide_do_par_for";
+        llvm::Function *do_par_for = module->getFunction(do_par_for_name);
+        internal_assert(do_par_for) << "Could not find " << do_par_for_name << " in initial module\n";
         #if LLVM_VERSION < 50
         do_par_for->setDoesNotAlias(5);
         #else
@@ -3157,7 +3428,11 @@ void CodeGen_LLVM::visit(const For *op) {
         #endif
         //do_par_for->setDoesNotCapture(5);
         ptr = builder->CreatePointerCast(ptr, i8_t->getPointerTo());
-        Value *args[] = {user_context, function, min, extent, ptr};
+        std::vector<Value *> args = {user_context, function, min, extent, ptr};
+        if (chunked) {
+            args.push_back(ConstantInt::get(i32_t, (int)policy));
+            args.push_back(ConstantInt::get(i32_t, chunk));
+        }
         debug(4) << "Creating call to do_par_for\n";
         Value *result = builder->CreateCall(do_par_for, args);
 
@@ -3180,6 +3455,18 @@ void CodeGen_LLVM::visit(const For *op) {
 }
 
 void CodeGen_LLVM::visit(const Store *op) {
+    // Streaming store. Generate the store of the wrapped value, with
+    // the dense stores marked as non-temporal.
+    if (const Call *call = op->value.as<Call>()) {
+        if (call->is_intrinsic(Call::nontemporal_store)) {
+            bool old_emit_nontemporal_stores = emit_nontemporal_stores;
+            emit_nontemporal_stores = true;
+            codegen(Store::make(op->name, call->args[0], op->index, op->param, op->predicate));
+            emit_nontemporal_stores = old_emit_nontemporal_stores;
+            return;
+        }
+    }
+
     // Even on 32-bit systems, Handles are treated as 64-bit in
     // memory, so convert stores of handles to stores of uint64_ts.
     if (op->value.type().is_handle()) {
@@ -3188,6 +3475,14 @@ void CodeGen_LLVM::visit(const Store *op) {
         return;
     }
 
+    // Atomic update
+    if (const Call *call = op->value.as<Call>()) {
+        if (call->is_intrinsic(Call::atomic_add)) {
+            codegen_atomic_store(op);
+            return;
+        }
+    }
+
     // Predicated store
     if (!is_one(op->predicate)) {
         codegen_predicated_vector_store(op);
@@ -3197,11 +3492,18 @@ void CodeGen_LLVM::visit(const Store *op) {
     Halide::Type value_type = op->value.type();
     Value *val = codegen(op->value);
     bool is_external = (external_buffer.find(op->name) != external_buffer.end());
+    MDNode *nontemporal = nullptr;
+    if (emit_nontemporal_stores) {
+        nontemporal = MDNode::get(*context, {ConstantAsMetadata::get(ConstantInt::get(i32_t, 1))});
+    }
     // Scalar
     if (value_type.is_scalar()) {
         Value *ptr = codegen_buffer_pointer(op->name, value_type, op->index);
         StoreInst *store = builder->CreateAlignedStore(val, ptr, value_type.bytes());
         add_tbaa_metadata(store, op->name, op->index);
+        if (nontemporal) {
+            store->setMetadata(LLVMContext::MD_nontemporal, nontemporal);
+        }
     } else if (const Let *let = op->index.as<Let>()) {
         Stmt s = Store::make(op->name, op->value, let->body, op->param, op->predicate);
         codegen(LetStmt::make(let->name, let->value, s));
@@ -3246,6 +3548,9 @@ void CodeGen_LLVM::visit(const Store *op) {
                 Value *vec_ptr = builder->CreatePointerCast(elt_ptr, slice_val->getType()->getPointerTo());
                 StoreInst *store = builder->CreateAlignedStore(slice_val, vec_ptr, alignment);
                 add_tbaa_metadata(store, op->name, slice_index);
+                if (nontemporal) {
+                    store->setMetadata(LLVMContext::MD_nontemporal, nontemporal);
+                }
             }
         } else if (ramp) {
             Type ptr_type = value_type.element_of();
@@ -3272,6 +3577,13 @@ void CodeGen_LLVM::visit(const Store *op) {
                     ptr = builder->CreateInBoundsGEP(ptr, stride);
                 }
             }
+        } else if (use_scatter(value_type)) {
+            // Native scatter. Lanes that store to the same address are
+            // stored in order, as the scalar stores would be.
+            Value *base = codegen_buffer_pointer(op->name, value_type.element_of(), ConstantInt::get(i32_t, 0));
+            Value *ptrs = builder->CreateInBoundsGEP(base, codegen(op->index));
+            Instruction *scatter = builder->CreateMaskedScatter(val, ptrs, value_type.bytes());
+            add_tbaa_metadata(scatter, op->name, op->index);
         } else {
             // Scatter
             Value *index = codegen(op->index);
@@ -3303,13 +3615,26 @@ void CodeGen_LLVM::visit(const Provide *op) {
 }
 
 void CodeGen_LLVM::visit(const IfThenElse *op) {
+    // A loop nest specialized on the features of the cpu gets
+    // compiled for those features in a function of its own.
+    Target then_target = target;
+    if (const Call *c = op->condition.as<Call>()) {
+        if (c->is_intrinsic(Call::cpu_has_features)) {
+            then_target = cpu_features_target(target, c);
+        }
+    }
+
     BasicBlock *true_bb = BasicBlock::Create(*context, "true_bb", function);
     BasicBlock *false_bb = BasicBlock::Create(*context, "false_bb", function);
     BasicBlock *after_bb = BasicBlock::Create(*context, "after_bb", function);
     builder->CreateCondBr(codegen(op->condition), true_bb, false_bb);
 
     builder->SetInsertPoint(true_bb);
-    codegen(op->then_case);
+    if (then_target != target) {
+        codegen_for_cpu_features(op->then_case, then_target);
+    } else {
+        codegen(op->then_case);
+    }
     builder->CreateBr(after_bb);
 
     builder->SetInsertPoint(false_bb);
@@ -3321,6 +3646,72 @@ void CodeGen_LLVM::visit(const IfThenElse *op) {
     builder->SetInsertPoint(after_bb);
 }
 
+void CodeGen_LLVM::codegen_for_cpu_features(Stmt s, const Target &t) {
+    debug(3) << "Outlining a loop nest for target " << t.to_string() << "\n";
+
+    // This looks a lot like the body of a parallel for loop, but
+    // the function is called directly.
+    Closure closure(s);
+    StructType *closure_t = build_closure_type(closure, buffer_t_type, context);
+    Value *ptr = create_alloca_at_entry(closure_t, 1);
+    pack_closure(closure_t, ptr, closure, symbol_table, buffer_t_type, builder);
+
+    Value *user_context = get_user_context();
+
+    llvm::Type *voidPointerType = (llvm::Type *)(i8_t->getPointerTo());
+    llvm::Type *args_t[] = {voidPointerType, voidPointerType};
+    FunctionType *func_t = FunctionType::get(i32_t, args_t, false);
+    llvm::Function *containing_function = function;
+    function = llvm::Function::Create(func_t, llvm::Function::InternalLinkage,
+                                      "cpu_features_" + function->getName(), module.get());
+
+    // Compile the body as if the features were part of the target.
+    Target base_target = target;
+    target = t;
+    string cpu = mcpu(), attrs = mattrs();
+    if (!cpu.empty()) {
+        function->addFnAttr("target-cpu", cpu);
+    }
+    if (!attrs.empty()) {
+        function->addFnAttr("target-features", attrs);
+    }
+    set_function_attributes_for_target(function, target);
+
+    IRBuilderBase::InsertPoint call_site = builder->saveIP();
+    BasicBlock *block = BasicBlock::Create(*context, "entry", function);
+    builder->SetInsertPoint(block);
+
+    BasicBlock *parent_destructor_block = destructor_block;
+    destructor_block = nullptr;
+
+    Scope<Value *> saved_symbol_table;
+    symbol_table.swap(saved_symbol_table);
+
+    llvm::Function::arg_iterator iter = function->arg_begin();
+    sym_push("__user_context", iterator_to_pointer(iter));
+    ++iter;
+    iter->setName("closure");
+    Value *closure_handle = builder->CreatePointerCast(iterator_to_pointer(iter),
+                                                       closure_t->getPointerTo());
+    unpack_closure(closure, symbol_table, closure_t, closure_handle, builder);
+
+    codegen(s);
+    return_with_error_code(ConstantInt::get(i32_t, 0));
+
+    // Call the new function from the original one.
+    builder->restoreIP(call_site);
+    llvm::Function *outlined = function;
+    symbol_table.swap(saved_symbol_table);
+    function = containing_function;
+    destructor_block = parent_destructor_block;
+    target = base_target;
+
+    ptr = builder->CreatePointerCast(ptr, i8_t->getPointerTo());
+    Value *result = builder->CreateCall(outlined, {user_context, ptr});
+    Value *did_succeed = builder->CreateICmpEQ(result, ConstantInt::get(i32_t, 0));
+    create_assertion(did_succeed, Expr(), result);
+}
+
 void CodeGen_LLVM::visit(const Evaluate *op) {
     codegen(op->value);
 
@@ -3355,6 +3746,41 @@ void CodeGen_LLVM::visit(const Shuffle *op) {
     }
 }
 
+void CodeGen_LLVM::visit(const VectorReduce *op) {
+    Type t = op->value.type();
+#if LLVM_VERSION >= 50
+    // LLVM has intrinsics for reducing a whole integer vector, which
+    // the backends turn into their horizontal instructions (e.g. addv
+    // on AArch64), or a log-depth tree of shuffles otherwise. The float
+    // versions give up on ordering the reduction unless fast-math
+    // flags are set, so those go through the generic lowering.
+    if (op->type.is_scalar() && (t.is_int() || t.is_uint())) {
+        Value *v = codegen(op->value);
+        switch (op->op) {
+        case VectorReduce::Add:
+            value = builder->CreateAddReduce(v);
+            return;
+        case VectorReduce::Mul:
+            value = builder->CreateMulReduce(v);
+            return;
+        case VectorReduce::Min:
+            value = builder->CreateIntMinReduce(v, t.is_int());
+            return;
+        case VectorReduce::Max:
+            value = builder->CreateIntMaxReduce(v, t.is_int());
+            return;
+        case VectorReduce::And:
+            value = builder->CreateAndReduce(v);
+            return;
+        case VectorReduce::Or:
+            value = builder->CreateOrReduce(v);
+            return;
+        }
+    }
+#endif
+    value = codegen(lower_vector_reduce(op));
+}
+
 Value *CodeGen_LLVM::create_alloca_at_entry(llvm::Type *t, int n, bool zero_initialize, const string &name) {
     IRBuilderBase::InsertPoint here = builder->saveIP();
     BasicBlock *entry = &builder->GetInsertBlock()->getParent()->getEntryBlock();
@@ -107,6 +107,14 @@ protected:
     /** What's the natural vector bit-width to use for loads, stores, etc. */
     virtual int native_vector_bits() const = 0;
 
+    /** Should vector loads (resp. stores) of the given type, at indices
+     * that aren't a ramp, use the gather (resp. scatter) instructions
+     * of the target instead of a scalar load (resp. store) per lane? */
+    // @{
+    virtual bool use_gather(Type t) const {return false;}
+    virtual bool use_scatter(Type t) const {return false;}
+    // @}
+
     /** State needed by llvm for code generation, including the
      * current module, function, context, builder, and most recently
      * generated llvm value. */
@@ -119,6 +127,8 @@ protected:
     static bool llvm_NVPTX_enabled;
     static bool llvm_Mips_enabled;
     static bool llvm_PowerPC_enabled;
+    static bool llvm_WebAssembly_enabled;
+    static bool llvm_RISCV_enabled;
     static bool llvm_AMDGPU_enabled;
 
     const Module *input_module;
@@ -260,6 +270,12 @@ protected:
      * the destructor block. */
     void return_with_error_code(llvm::Value *error_code);
 
+    /** Outline a statement into its own function compiled for the
+     * given target (which differs from the current one only in its
+     * features), call it, and check the result. Used for the loop
+     * nests specialized on cpu_has_features. */
+    void codegen_for_cpu_features(Stmt s, const Target &t);
+
     /** Put a string constant in the module as a global variable and return a pointer to it. */
     llvm::Constant *create_string_constant(const std::string &str);
 
@@ -347,6 +363,7 @@ protected:
     virtual void visit(const Evaluate *);
     virtual void visit(const Shuffle *);
     virtual void visit(const Prefetch *);
+    virtual void visit(const VectorReduce *);
     // @}
 
     /** Generate code for an allocate node. It has no default
@@ -393,6 +410,15 @@ protected:
      * an arbitrary number of vectors.*/
     virtual llvm::Value *interleave_vectors(const std::vector<llvm::Value *> &);
 
+    /** Generate code for a store of an atomic_add intrinsic, one
+     * read-modify-write per lane. */
+    void codegen_atomic_store(const Store *op);
+
+    /** Atomically add the scalar val of type t to the value at
+     * ptr. Floating-point adds use a compare-and-swap loop; targets
+     * with a native instruction can override this. */
+    virtual void codegen_atomic_add(Type t, llvm::Value *ptr, llvm::Value *val);
+
     /** Generate a call to a vector intrinsic or runtime inlined
      * function. The arguments are sliced up into vectors of the width
      * given by 'intrin_lanes', the intrinsic is called on each
@@ -463,6 +489,9 @@ private:
     /** Turn off all unsafe math flags in scopes while this is set. */
     bool strict_float;
 
+    /** Mark dense stores as non-temporal while this is set. */
+    bool emit_nontemporal_stores;
+
     /** Embed an instance of halide_filter_metadata_t in the code, using
      * the given name (by convention, this should be ${FUNCTIONNAME}_metadata)
      * as extern "C" linkage. Note that the return value is a function-returning-
@@ -470,13 +499,17 @@ private:
      */
     llvm::Function* embed_metadata_getter(const std::string &metadata_getter_name,
         const std::string &function_name, const std::vector<LoweredArgument> &args,
-        const std::map<std::string, std::string> &metadata_name_map);
+        const std::map<std::string, std::string> &metadata_name_map, int64_t arena_size);
 
     /** Embed a constant expression as a global variable. */
     llvm::Constant *embed_constant_expr(Expr e);
 
     llvm::Function *add_argv_wrapper(const std::string &name);
 
+    /** Add an entry point that runs the argv wrapper on the thread pool
+     * without waiting for it, for the async_entry target feature. */
+    llvm::Function *add_async_wrapper(const std::string &name, llvm::Function *argv_wrapper);
+
     llvm::Value *codegen_dense_vector_load(const Load *load, llvm::Value *vpred = nullptr);
 
     virtual void codegen_predicated_vector_load(const Load *op);
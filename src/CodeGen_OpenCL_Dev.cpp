@@ -520,11 +520,17 @@ namespace {
 struct BufferSize {
     string name;
     size_t size;
+    // Whether the buffer was scheduled in constant memory.
+    bool scheduled;
 
-    BufferSize() : size(0) {}
-    BufferSize(string name, size_t size) : name(name), size(size) {}
+    BufferSize() : size(0), scheduled(false) {}
+    BufferSize(string name, size_t size, bool scheduled = false) :
+        name(name), size(size), scheduled(scheduled) {}
 
     bool operator < (const BufferSize &r) const {
+        if (scheduled != r.scheduled) {
+            return scheduled;
+        }
         return size < r.size;
     }
 };
@@ -548,18 +554,22 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::add_kernel(Stmt s,
     // - and all allocations together should be less than the max constant
     //   buffer size given by CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE.
     // The last condition is handled via the preprocessor in the kernel
-    // declaration.
+    // declaration. The buffers scheduled in constant memory are passed
+    // in __constant even if their loads vary across the workgroup.
     vector<BufferSize> constants;
     for (size_t i = 0; i < args.size(); i++) {
-        if (args[i].is_buffer &&
-            CodeGen_GPU_Dev::is_buffer_constant(s, args[i].name) &&
-            args[i].size > 0) {
+        if (args[i].is_buffer && args[i].memory_type == MemoryType::GPUConstant) {
+            constants.push_back(BufferSize(args[i].name, args[i].size, true));
+        } else if (args[i].is_buffer &&
+                   CodeGen_GPU_Dev::is_buffer_constant(s, args[i].name) &&
+                   args[i].size > 0) {
             constants.push_back(BufferSize(args[i].name, args[i].size));
         }
     }
 
-    // Sort the constant candidates from smallest to largest. This will put
-    // as many of the constant allocations in __constant as possible.
+    // Sort the constant candidates from smallest to largest, after the
+    // ones scheduled in constant memory. This will put as many of the
+    // constant allocations in __constant as possible.
     // Ideally, we would prioritize constant buffers by how frequently they
     // are accessed.
     sort(constants.begin(), constants.end());
@@ -10,6 +10,7 @@
 #include "Debug.h"
 #include "Simplify.h"
 #include "Target.h"
+#include "UniquifyVariableNames.h"
 #include "Debug.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Runtime_Linker.h"
@@ -18,6 +19,10 @@
 #include "Target.h"
 
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <iterator>
 
 // This is declared in NVPTX.h, which is not exported. Ugly, but seems better than
 // hardcoding a path to the .h file.
@@ -59,6 +64,18 @@ void CodeGen_PTX_Dev::add_kernel(Stmt stmt,
 
     debug(2) << "In CodeGen_PTX_Dev::add_kernel\n";
 
+    {
+        std::ostringstream key;
+        key << "kernel " << name << "\n";
+        for (const DeviceArgument &a : args) {
+            key << a.name << ": " << a.is_buffer << " " << a.type << " "
+                << a.alignment.modulus << " " << a.alignment.remainder << " "
+                << a.memory_type << "\n";
+        }
+        key << canonicalize_generated_names(stmt);
+        kernels_key += key.str();
+    }
+
     // Now deduce the types of the arguments to our function
     vector<llvm::Type *> arg_types(args.size());
     for (size_t i = 0; i < args.size(); i++) {
@@ -74,13 +91,22 @@ void CodeGen_PTX_Dev::add_kernel(Stmt stmt,
     function = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module.get());
     set_function_attributes_for_target(function, target);
 
-    // Mark the buffer args as no alias
+    // Mark the buffer args as no alias, and the ones the kernel doesn't
+    // write to as read-only. On sm_35 and later, the loads from buffers
+    // that are both go through the read-only data cache (ld.global.nc),
+    // which helps stencils that read the same inputs from many threads.
     for (size_t i = 0; i < args.size(); i++) {
         if (args[i].is_buffer) {
             #if LLVM_VERSION < 50
             function->setDoesNotAlias(i+1);
+            if (!args[i].write) {
+                function->addAttribute(i+1, Attribute::ReadOnly);
+            }
             #else
             function->addParamAttr(i, Attribute::NoAlias);
+            if (!args[i].write) {
+                function->addParamAttr(i, Attribute::ReadOnly);
+            }
             #endif
         }
     }
@@ -111,6 +137,25 @@ void CodeGen_PTX_Dev::add_kernel(Stmt stmt,
         }
     }
 
+    // The buffers in constant memory are read from a global in the
+    // constant address space instead, which the runtime copies them
+    // into before each launch. It is named after the kernel and the
+    // index of the argument.
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_buffer && args[i].memory_type == MemoryType::GPUConstant) {
+            internal_assert(args[i].size > 0);
+            llvm::Type *t = ArrayType::get(i8_t, args[i].size);
+            GlobalVariable *global =
+                new GlobalVariable(*module, t, false, GlobalValue::ExternalLinkage,
+                                   ConstantAggregateZero::get(t), name + "_constant_" + std::to_string(i),
+                                   nullptr, GlobalVariable::NotThreadLocal, 4, true);
+            global->setAlignment(16);
+            Value *ptr = ConstantExpr::getPointerCast(global, i8_t->getPointerTo(4));
+            sym_push(args[i].name, ptr);
+            arg_sym_names.push_back(args[i].name);
+        }
+    }
+
     // We won't end the entry block yet, because we'll want to add
     // some allocas to it later if there are local allocations. Start
     // a new block to put all the code.
@@ -157,6 +202,7 @@ void CodeGen_PTX_Dev::add_kernel(Stmt stmt,
 
 void CodeGen_PTX_Dev::init_module() {
     init_context();
+    kernels_key.clear();
 
     #ifdef WITH_PTX
     module = get_initial_module_for_ptx_device(target, context);
@@ -244,6 +290,14 @@ void CodeGen_PTX_Dev::visit(const AssertStmt *op) {
 }
 
 void CodeGen_PTX_Dev::visit(const Store *op) {
+    // Stages scheduled atomic() already carry their delta
+    if (const Call *call = op->value.as<Call>()) {
+        if (call->is_intrinsic(Call::atomic_add)) {
+            codegen_atomic_store(op);
+            return;
+        }
+    }
+
     // Check for += to global and deploy the house atomics
     if (!internal_allocations.contains(op->name) &&
         expr_uses_var(op->value, op->name) &&
@@ -288,6 +342,16 @@ void CodeGen_PTX_Dev::visit(const Store *op) {
     CodeGen_LLVM::visit(op);
 }
 
+void CodeGen_PTX_Dev::codegen_atomic_add(Type t, llvm::Value *ptr, llvm::Value *val) {
+    if (t.is_float() && t.bits() == 32) {
+        llvm::Function *intrin = module->getFunction("llvm.nvvm.atomic.load.add.f32.p0f32");
+        internal_assert(intrin);
+        builder->CreateCall(intrin, {ptr, val});
+    } else {
+        CodeGen_LLVM::codegen_atomic_add(t, ptr, val);
+    }
+}
+
 void CodeGen_PTX_Dev::visit(const Load *op) {
 
     // Do aligned 4-wide 32-bit loads as a single i128 load.
@@ -308,12 +372,89 @@ void CodeGen_PTX_Dev::visit(const Load *op) {
     CodeGen_LLVM::visit(op);
 }
 
+void CodeGen_PTX_Dev::visit(const Call *op) {
+    #if LLVM_VERSION >= 60
+    // From sm_70 on, the threads of a warp don't run in lock step, and
+    // only the shuffles that name the threads taking part are left. All
+    // the threads of the warp take part in the ones lower_warp_shuffles
+    // makes.
+    const string shfl = "llvm.nvvm.shfl.";
+    if (target.has_feature(Target::CUDACapability70) &&
+        starts_with(op->name, shfl) && !starts_with(op->name, shfl + "sync.")) {
+        vector<Expr> args = op->args;
+        args.insert(args.begin(), make_const(Int(32), -1));
+        string name = shfl + "sync." + op->name.substr(shfl.size());
+        value = codegen(Call::make(op->type, name, args, op->call_type));
+        return;
+    }
+
+    if (op->is_intrinsic(Call::wmma_16x16x16)) {
+        // See lower_warp_matrix_multiplies. The arguments are the
+        // addresses and strides of A, B and C, and whether each is
+        // column major. LLVM has no stable intrinsics for these, so we
+        // use inline ptx.
+        internal_assert(op->args.size() == 9);
+        string layout[3];
+        for (int i = 0; i < 3; i++) {
+            layout[i] = is_one(op->args[6 + i]) ? "col" : "row";
+        }
+        auto fragment = [](const string &name) {
+            std::ostringstream regs;
+            regs << "{";
+            for (int i = 0; i < 8; i++) {
+                regs << (i ? ", " : "") << "%" << name << i;
+            }
+            regs << "}";
+            return regs.str();
+        };
+        std::ostringstream ptx;
+        ptx << "{\n"
+            << ".reg .b32 %wa<8>;\n"
+            << ".reg .b32 %wb<8>;\n"
+            << ".reg .f32 %wc<8>;\n"
+            << "wmma.load.a.sync." << layout[0] << ".m16n16k16.f16 " << fragment("wa") << ", [$0], $1;\n"
+            << "wmma.load.b.sync." << layout[1] << ".m16n16k16.f16 " << fragment("wb") << ", [$2], $3;\n"
+            << "wmma.load.c.sync." << layout[2] << ".m16n16k16.f32 " << fragment("wc") << ", [$4], $5;\n"
+            << "wmma.mma.sync." << layout[0] << "." << layout[1] << ".m16n16k16.f32.f32 "
+            << fragment("wc") << ", " << fragment("wa") << ", " << fragment("wb") << ", " << fragment("wc") << ";\n"
+            << "wmma.store.d.sync." << layout[2] << ".m16n16k16.f32 [$4], " << fragment("wc") << ", $5;\n"
+            << "}";
+
+        vector<llvm::Value *> args;
+        for (int i = 0; i < 6; i++) {
+            llvm::Value *arg = codegen(op->args[i]);
+            if (i % 2 == 0) {
+                arg = builder->CreatePtrToInt(arg, i64_t);
+            }
+            args.push_back(arg);
+        }
+        llvm::FunctionType *fn_type =
+            llvm::FunctionType::get(void_t, {i64_t, i32_t, i64_t, i32_t, i64_t, i32_t}, false);
+        llvm::InlineAsm *wmma =
+            llvm::InlineAsm::get(fn_type, ptx.str(), "l,r,l,r,l,r,~{memory}", true);
+        llvm::CallInst *call = builder->CreateCall(fn_type, wmma, args);
+        // All the lanes of the warp must run it together.
+        call->setConvergent();
+        value = ConstantInt::get(i32_t, 0);
+        return;
+    }
+    #endif
+
+    CodeGen_LLVM::visit(op);
+}
+
 string CodeGen_PTX_Dev::march() const {
     return "nvptx64";
 }
 
 string CodeGen_PTX_Dev::mcpu() const {
-    if (target.has_feature(Target::CUDACapability61)) {
+    if (target.has_feature(Target::CUDACapability70)) {
+        #if LLVM_VERSION >= 60
+        return "sm_70";
+        #else
+        return "sm_61";
+        #endif
+    } else if (target.has_feature(Target::CUDACapability61)) {
         return "sm_61";
     } else if (target.has_feature(Target::CUDACapability50)) {
         return "sm_50";
@@ -329,7 +470,14 @@ string CodeGen_PTX_Dev::mcpu() const {
 }
 
 string CodeGen_PTX_Dev::mattrs() const {
-    if (target.has_feature(Target::CUDACapability61)) {
+    if (target.has_feature(Target::CUDACapability70)) {
+        // sm_70 needs ptx isa 6.0.
+        #if LLVM_VERSION >= 60
+        return "+ptx60";
+        #else
+        return "+ptx50";
+        #endif
+    } else if (target.has_feature(Target::CUDACapability61)) {
         return "+ptx50";
     } else if (target.features_any_of({Target::CUDACapability32,
                                 Target::CUDACapability50})) {
@@ -346,12 +494,109 @@ bool CodeGen_PTX_Dev::use_soft_float_abi() const {
     return false;
 }
 
+#ifdef WITH_PTX
+namespace {
+
+void append_u32(vector<char> &buffer, uint32_t x) {
+    for (int i = 0; i < 4; i++) {
+        buffer.push_back((char)((x >> (8 * i)) & 0xff));
+    }
+}
+
+// Compile the (null-terminated) PTX to cubins for the given architectures
+// with ptxas, and bundle them with the PTX in the format
+// halide_cuda_initialize_kernels expects (see cuda.cpp in the runtime).
+// The architectures ptxas fails on, or if it isn't installed, just use
+// the PTX.
+vector<char> bundle_cubins(const vector<char> &ptx_src, const vector<string> &archs,
+                           const string &kernel_name) {
+    vector<vector<char>> cubins;
+    vector<uint32_t> cubin_archs;
+    TemporaryFile ptx(kernel_name, ".ptx");
+    {
+        std::ofstream f(ptx.pathname());
+        f.write(ptx_src.data(), ptx_src.size() - 1);
+    }
+    for (const string &arch : archs) {
+        if (arch.size() < 5 || arch.substr(0, 3) != "sm_" ||
+            arch.find_first_not_of("0123456789", 3) != string::npos) {
+            user_warning << "Ignoring CUDA architecture " << arch
+                         << " in HL_CUDA_CUBIN_ARCHS, which should be of the form sm_61\n";
+            continue;
+        }
+        TemporaryFile cubin(kernel_name, ".cubin");
+        // The same register limit as the runtime's JIT compilation.
+        string cmd = "ptxas --gpu-name " + arch + " --maxrregcount 64 " +
+            ptx.pathname() + " -o " + cubin.pathname();
+        debug(1) << "Compiling PTX to cubin: " << cmd << "\n";
+        if (system(cmd.c_str()) != 0) {
+            user_warning << "Could not compile PTX for " << arch << " with ptxas. "
+                         << "The PTX will be compiled when the pipeline is first run.\n";
+            continue;
+        }
+        std::ifstream f(cubin.pathname(), std::ios::binary);
+        vector<char> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        cubins.push_back(bytes);
+        cubin_archs.push_back(std::stoi(arch.substr(3)));
+    }
+    if (cubins.empty()) {
+        return ptx_src;
+    }
+
+    const char magic[8] = {'H', 'L', 'C', 'U', 'B', 'I', 'N', 0};
+    vector<char> bundle(magic, magic + 8);
+    append_u32(bundle, cubins.size());
+    append_u32(bundle, 0);
+    for (size_t i = 0; i < cubins.size(); i++) {
+        append_u32(bundle, cubin_archs[i]);
+        append_u32(bundle, cubins[i].size());
+        bundle.insert(bundle.end(), cubins[i].begin(), cubins[i].end());
+        bundle.resize((bundle.size() + 7) & ~7, 0);
+    }
+    bundle.insert(bundle.end(), ptx_src.begin(), ptx_src.end());
+    return bundle;
+}
+
+}  // namespace
+#endif // WITH_PTX
+
+namespace {
+
+// The PTX (and cubins) of the device modules compiled recently, keyed by
+// their kernels and the options used. This avoids running the NVPTX
+// backend and ptxas again when re-jitting a pipeline whose schedule only
+// changed on the host.
+struct PTXCache {
+    std::mutex mutex;
+    std::map<string, vector<char>> entries;
+    static const size_t max_entries = 64;
+};
+
+PTXCache &ptx_cache() {
+    static PTXCache cache;
+    return cache;
+}
+
+}  // namespace
+
 vector<char> CodeGen_PTX_Dev::compile_to_src() {
 
     #ifdef WITH_PTX
 
     debug(2) << "In CodeGen_PTX_Dev::compile_to_src";
 
+    string archs = get_env_variable("HL_CUDA_CUBIN_ARCHS");
+    string cache_key = mcpu() + " " + mattrs() + " " + archs + "\n" + kernels_key;
+    {
+        PTXCache &cache = ptx_cache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.entries.find(cache_key);
+        if (it != cache.entries.end()) {
+            debug(1) << "Reusing the PTX compiled for the same kernels\n";
+            return it->second;
+        }
+    }
+
     // DISABLED - hooked in here to force PrintBeforeAll option - seems to be the only way?
     /*char* argv[] = { "llc", "-print-before-all" };*/
     /*int argc = sizeof(argv)/sizeof(char*);*/
@@ -511,24 +756,26 @@ vector<char> CodeGen_PTX_Dev::compile_to_src() {
             (void)ret; // Don't care if it fails
         }
 
-        // Note: It works to embed the contents of the .sass file in
-        // the buffer instead of the ptx source, and this could help
-        // with app startup times. Expose via the target?
-        /*
-        {
-            std::ifstream f(sass.pathname());
-            buffer.clear();
-            f.seekg(0, std::ios_base::end);
-            std::streampos sz = f.tellg();
-            buffer.resize(sz);
-            f.seekg(0, std::ios_base::beg);
-            f.read(buffer.data(), sz);
-        }
-        */
     }
 
     // Null-terminate the ptx source
     buffer.push_back(0);
+
+    // Embed cubins for the architectures listed in HL_CUDA_CUBIN_ARCHS
+    // (e.g. "sm_61,sm_70"), so that the runtime doesn't have to compile the
+    // PTX on those devices.
+    if (!archs.empty()) {
+        buffer = bundle_cubins(buffer, split_string(archs, ","), get_current_kernel_name());
+    }
+
+    {
+        PTXCache &cache = ptx_cache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.entries.size() >= PTXCache::max_entries) {
+            cache.entries.clear();
+        }
+        cache.entries[cache_key] = buffer;
+    }
     return buffer;
 #else // WITH_PTX
     return vector<char>();
@@ -61,8 +61,12 @@ protected:
     void visit(const AssertStmt *);
     void visit(const Load *);
     void visit(const Store *);
+    void visit(const Call *);
     // @}
 
+    /** Use the native float atomic add of sm_20 and up. */
+    void codegen_atomic_add(Type t, llvm::Value *ptr, llvm::Value *val);
+
     std::string march() const;
     std::string mcpu() const;
     std::string mattrs() const;
@@ -75,6 +79,10 @@ protected:
     std::string simt_intrinsic(const std::string &name);
 
     Scope<> internal_allocations;
+
+    /** The kernels added to the module, as printed IR. The PTX of a
+     * module with the same kernels as one compiled before is reused. */
+    std::string kernels_key;
 };
 
 }  // namespace Internal
@@ -93,11 +93,16 @@ CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &na
             const string str_max_size = target.has_large_buffers() ? "2^63 - 1" : "2^31 - 1";
             user_error << "Total size for allocation " << name << " is constant but exceeds " << str_max_size << ".";
         } else if (memory_type == MemoryType::Heap ||
+                   memory_type == MemoryType::VTCM ||
+                   memory_type == MemoryType::GPUConstant ||
                    (memory_type != MemoryType::Stack &&
                     memory_type != MemoryType::Register &&
                     !can_allocation_fit_on_stack(stack_bytes))) {
             // We should put the allocation on the heap if it's
-            // explicitly placed on the heap, or if it's not
+            // explicitly placed on the heap, in VTCM (which is
+            // allocated via new_expr where supported) or in GPU
+            // constant memory (which is copied from its device
+            // allocation), or if it's not
             // explicitly placed on the stack/register and it's large.
             stack_bytes = 0;
             llvm_size = codegen(Expr(constant_bytes));
@@ -126,10 +131,12 @@ CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &na
     allocation.constant_bytes = constant_bytes;
     allocation.stack_bytes = new_expr.defined() ? 0 : stack_bytes;
     allocation.type = type;
+    allocation.memory_type = memory_type;
     allocation.ptr = nullptr;
     allocation.destructor = nullptr;
     allocation.destructor_function = nullptr;
     allocation.name = name;
+    allocation.padded = !new_expr.defined();
 
     if (!new_expr.defined() && extents.empty()) {
         // If it's a scalar allocation, don't try anything clever. We
@@ -50,6 +50,9 @@ protected:
         /** The (Halide) type of the allocation. */
         Type type;
 
+        /** The memory type the allocation was scheduled in. */
+        MemoryType memory_type;
+
         /** How many bytes this allocation is, or 0 if not
          * constant. */
         int constant_bytes;
@@ -62,6 +65,10 @@ protected:
          * Allocate node name in cases where we detect multiple
          * Allocate nodes can share a single allocation. */
         std::string name;
+
+        /** Whether the allocation has allocation_padding past its
+         * end. Memory from a new_expr is the size it was made. */
+        bool padded;
     };
 
     /** The allocations currently in scope. The stack gets pushed when
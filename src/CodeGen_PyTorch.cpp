@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <limits>
+#include <set>
 
 #include "CodeGen_PyTorch.h"
 #include "CodeGen_Internal.h"
@@ -10,6 +12,7 @@
 #include "Lerp.h"
 #include "Simplify.h"
 #include "Deinterleave.h"
+#include "Util.h"
 
 namespace Halide {
 namespace Internal {
@@ -169,6 +172,16 @@ string type_to_pytorch_tensor(Type type, bool isCuda) {
 }
 
 
+// The element type of the buffer wrapping an ATen tensor
+string type_to_aten_c_type(Type type) {
+    if (type.is_bfloat() && type.bits() == 16) {
+        return "at::BFloat16";
+    } else if (type.is_float() && type.bits() == 16) {
+        return "at::Half";
+    }
+    return type_to_c_type(type, false);
+}
+
 } // ns anon
 
 
@@ -176,7 +189,8 @@ CodeGen_PyTorch::CodeGen_PyTorch(ostream &s, Target t, OutputKind output_kind,
     std::string cpp_header) :
     IRPrinter(s), target(t), output_kind(output_kind), cpp_header(cpp_header)
 {
-  if(!is_header()) {
+  if(output_kind == PyTorchImplementation) {
+    stream << "#include <ATen/ATen.h>\n";
     stream << "#include <TH/TH.h>\n";
     if(target.has_feature(Target::CUDA)) {
       stream << "#include <THC/THC.h>\n";
@@ -199,7 +213,7 @@ CodeGen_PyTorch::CodeGen_PyTorch(ostream &s, Target t, OutputKind output_kind,
 }
 
 CodeGen_PyTorch::~CodeGen_PyTorch() {
-  if(!is_header()) {
+  if(output_kind == PyTorchImplementation) {
     stream << "}  // extern \"C\"\n";
   }
 }
@@ -210,14 +224,163 @@ void CodeGen_PyTorch::compile(const Module &input) {
         debug(1) << "ignoring " << f.name;
         continue;
       }
+      if (output_kind == PyTorchAutograd) {
+        if (f.linkage != LinkageType::Internal && is_gradient_function(f)) {
+          compile_autograd(f);
+        }
+        continue;
+      }
       if(target.has_feature(Target::CUDA)) {
         compile(f, true);
+        compile_aten(f, true);
       } else {
         compile(f, false);
+        compile_aten(f, false);
       }
     }
 }
 
+void CodeGen_PyTorch::compile_aten(const LoweredFunc &f, bool isCuda) {
+  std::vector<std::string> namespaces;
+  std::string simple_name = extract_namespaces(f.name, namespaces);
+
+  if (is_header() && f.linkage == LinkageType::Internal) {
+    return;
+  }
+
+  if (!namespaces.empty()) {
+    for (const auto &ns : namespaces) {
+      stream << "namespace " << ns << " {\n";
+    }
+    stream << "\n";
+  }
+  const std::vector<LoweredArgument> &args = f.args;
+  std::vector<LoweredArgument> buffer_args;
+
+  stream << "int " << simple_name << "_at_(";
+  for (size_t i = 0; i < args.size(); i++) {
+    if (args[i].name == "__user_context") {
+      continue;
+    } else if (args[i].is_buffer()) {
+      buffer_args.push_back(args[i]);
+      stream
+        << "at::Tensor &"
+        << print_name(args[i].name);
+    } else {
+      stream
+        << type_to_c_type(args[i].type, true)
+        << print_name(args[i].name);
+    }
+
+    if (i < args.size()-1) stream << ", ";
+  }
+
+  if (is_header()) {
+    stream << ");\n";
+  } else {
+    stream << ") {\n";
+    indent += 2;
+
+    if (isCuda && !buffer_args.empty()) {
+      do_indent();
+      stream << "// Run on PyTorch's current device, context and stream\n";
+      do_indent();
+      stream << "int device_id = " << print_name(buffer_args[0].name) << ".get_device();\n";
+      for (size_t i = 1; i < buffer_args.size(); i++) {
+        do_indent();
+        stream << "if(device_id != " << print_name(buffer_args[i].name)
+               << ".get_device()) throw Halide::Pytorch::InvalidDeviceException();\n";
+      }
+      do_indent();
+      stream << "CUcontext ctx = 0;\n";
+      do_indent();
+      stream << "CUresult res = cuCtxGetCurrent(&ctx);\n";
+      do_indent();
+      stream << "if(res != 0) throw Halide::Pytorch::CudaContextException();\n";
+      do_indent();
+      stream << "cudaStream_t stream = THCState_getCurrentStreamOnDevice(state, device_id);\n";
+      do_indent();
+      stream << "Halide::Pytorch::UserContext user_ctx(device_id, &ctx, &stream);\n";
+      do_indent();
+      stream << "void* __user_context = (void*) &user_ctx;\n";
+      do_indent();
+      stream << "Halide::Pytorch::ScopedUserContext scoped_user_ctx(&user_ctx);\n\n";
+    }
+
+    do_indent();
+    stream << "// Wrap the tensors in Halide buffers with their strides. Only the\n";
+    do_indent();
+    stream << "// tensors whose innermost dimension is strided are made dense.\n";
+    for (size_t i = 0; i < buffer_args.size(); i++) {
+      string name = print_name(buffer_args[i].name);
+      string tp = type_to_aten_c_type(buffer_args[i].type);
+      do_indent();
+      stream << "at::Tensor " << name << "_dense = Halide::Pytorch::dense_innermost(" << name << ");\n";
+      do_indent();
+      stream
+        << "Buffer<" << tp << "> " << name << "_buffer = Halide::Pytorch::wrap<" << tp << ">("
+        << name << "_dense);\n";
+    }
+    stream << "\n";
+
+    do_indent();
+    stream << "// Run code\n";
+    do_indent();
+    stream << "int err = " << simple_name << "(";
+    for (size_t i = 0; i < args.size(); i++) {
+      if (args[i].is_buffer()) {
+        stream << print_name(args[i].name) << "_buffer";
+      } else {
+        stream << print_name(args[i].name);
+      }
+      if (i < args.size()-1) stream << ", ";
+    }
+    stream << ");\n";
+    do_indent();
+    stream << "if (err != 0) throw Halide::Pytorch::CudaRunException();\n";
+    stream << "\n";
+
+    if (isCuda) {
+      for (size_t i = 0; i < buffer_args.size(); i++) {
+        do_indent();
+        stream
+          << "if ("
+          << print_name(buffer_args[i].name) << "_buffer.host_dirty() )"
+          << " throw Halide::Pytorch::DeviceNotSynchronizedException(\""
+          << print_name(buffer_args[i].name)
+          << "\");\n";
+      }
+      stream << "\n";
+    }
+
+    do_indent();
+    stream << "// Copy the outputs computed in dense copies back\n";
+    for (size_t i = 0; i < buffer_args.size(); i++) {
+      if (buffer_args[i].kind == Argument::OutputBuffer) {
+        string name = print_name(buffer_args[i].name);
+        do_indent();
+        stream << "if (!" << name << "_dense.is_same(" << name << ")) "
+               << name << ".copy_(" << name << "_dense);\n";
+      }
+    }
+    stream << "\n";
+
+    do_indent();
+    stream << "return 0;\n";
+
+    indent -= 2;
+    stream << "}\n";
+  }
+
+  if (!namespaces.empty()) {
+    stream << "\n";
+    for (size_t i = namespaces.size(); i > 0; i--) {
+      stream << "}  // namespace " << namespaces[i-1] << "\n";
+    }
+    stream << "\n";
+  }
+}
+
 void CodeGen_PyTorch::compile(const LoweredFunc &f, bool isCuda) {
   // Don't put non-external function declarations in headers.
   std::vector<std::string> namespaces;
@@ -283,7 +446,11 @@ void CodeGen_PyTorch::compile(const LoweredFunc &f, bool isCuda) {
           do_indent();
           stream << "Halide::Pytorch::UserContext user_ctx(device_id, &ctx, &stream);\n";
           do_indent();
-          stream << "void* __user_context = (void*) &user_ctx;\n\n";
+          stream << "void* __user_context = (void*) &user_ctx;\n";
+          do_indent();
+          stream << "// Run on PyTorch's current stream, even where the runtime gets no user_context\n";
+          do_indent();
+          stream << "Halide::Pytorch::ScopedUserContext scoped_user_ctx(&user_ctx);\n\n";
         } 
         else {
           do_indent();
@@ -454,6 +621,153 @@ void CodeGen_PyTorch::compile(const LoweredFunc &f, bool isCuda) {
   }
 }
 
+bool CodeGen_PyTorch::is_gradient_function(const LoweredFunc &f) {
+  for (const auto &arg : f.args) {
+    if (arg.kind == Argument::OutputBuffer && starts_with(arg.name, "d_")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CodeGen_PyTorch::compile_autograd(const LoweredFunc &f) {
+  std::vector<std::string> namespaces;
+  std::string simple_name = extract_namespaces(f.name, namespaces);
+  std::string forward_name = ends_with(simple_name, "_grad") ?
+    simple_name.substr(0, simple_name.size() - 5) : simple_name + "_forward";
+
+  // Sort the arguments of the gradient pipeline into the parts of the
+  // signature of the forward op: inputs, outputs, and saved
+  // intermediates.
+  std::vector<std::string> inputs, outputs, saved, tensors, scalars;
+  std::set<std::string> output_set, gradients;
+  for (const auto &arg : f.args) {
+    if (arg.kind != Argument::OutputBuffer && arg.is_buffer() && starts_with(arg.name, "d_")) {
+      outputs.push_back(arg.name.substr(2));
+      output_set.insert(arg.name.substr(2));
+    }
+  }
+  for (const auto &arg : f.args) {
+    bool is_adjoint = arg.is_buffer() && starts_with(arg.name, "d_") && output_set.count(arg.name.substr(2));
+    bool is_gradient = arg.kind == Argument::OutputBuffer && starts_with(arg.name, "d_");
+    if (arg.name == "__user_context" || output_set.count(arg.name) || is_adjoint || is_gradient) {
+      continue;
+    } else if (starts_with(arg.name, "saved_")) {
+      user_assert(arg.is_buffer() && arg.kind != Argument::OutputBuffer)
+        << "Saved intermediate " << arg.name << " of " << simple_name << " must be an input buffer.\n";
+      saved.push_back(arg.name);
+    } else {
+      user_assert(arg.kind != Argument::OutputBuffer)
+        << "Output " << arg.name << " of gradient pipeline " << simple_name
+        << " is not named d_<input>.\n";
+      inputs.push_back(arg.name);
+      (arg.is_buffer() ? tensors : scalars).push_back(arg.name);
+    }
+  }
+  for (const auto &arg : f.args) {
+    if (arg.kind == Argument::OutputBuffer) {
+      std::string input = arg.name.substr(2);
+      user_assert(std::find(tensors.begin(), tensors.end(), input) != tensors.end())
+        << "Gradient " << arg.name << " of " << simple_name
+        << " does not match an input buffer named " << input << ".\n";
+      gradients.insert(input);
+    }
+  }
+  tensors.insert(tensors.end(), outputs.begin(), outputs.end());
+  tensors.insert(tensors.end(), saved.begin(), saved.end());
+
+  std::vector<std::string> results = outputs;
+  results.insert(results.end(), saved.begin(), saved.end());
+  auto comma_separated = [](const std::vector<std::string> &names, const std::string &prefix) {
+    std::string s;
+    for (size_t i = 0; i < names.size(); i++) {
+      s += (i > 0 ? ", " : "") + prefix + names[i];
+    }
+    return s;
+  };
+  std::string forward_args = comma_separated(inputs, "");
+  if (!results.empty()) {
+    forward_args += (inputs.empty() ? "" : ", ") + comma_separated(results, "");
+  }
+
+  stream << "# Generated by Halide from the gradient pipeline " << simple_name << ". Do not edit.\n"
+            "\n"
+            "import torch\n"
+            "\n"
+            "\n"
+            "def make_" << forward_name << "_function(forward_op, backward_op):\n"
+            "    \"\"\"Make a torch.autograd.Function that runs forward_op as its forward\n"
+            "    pass, and backward_op (the op of " << simple_name << ") as its backward pass.\n"
+            "\n"
+            "    forward_op is called as forward_op(" << forward_args << ").\n"
+            "    The outputs are allocated by the caller and passed to apply() after the\n"
+            "    inputs, as they are to the op. The forward tensors are saved for the\n"
+            "    backward pass rather than recomputed.\n"
+            "    \"\"\"\n"
+            "\n"
+            "    class Function(torch.autograd.Function):\n"
+            "        @staticmethod\n"
+            "        def forward(ctx, " << forward_args << "):\n"
+            "            forward_op(" << forward_args << ")\n";
+  if (!results.empty()) {
+    stream << "            ctx.mark_dirty(" << comma_separated(results, "") << ")\n";
+  }
+  if (!saved.empty()) {
+    stream << "            ctx.mark_non_differentiable(" << comma_separated(saved, "") << ")\n";
+  }
+  for (const auto &s : scalars) {
+    stream << "            ctx." << s << " = " << s << "\n";
+  }
+  if (!tensors.empty()) {
+    stream << "            ctx.save_for_backward(" << comma_separated(tensors, "") << ")\n";
+  }
+  stream << "            return " << (results.empty() ? "None" : comma_separated(results, "")) << "\n"
+            "\n"
+            "        @staticmethod\n"
+            "        def backward(ctx" << (results.empty() ? "" : ", ") << comma_separated(results, "grad_") << "):\n";
+  if (!tensors.empty()) {
+    stream << "            " << comma_separated(tensors, "") << ", = ctx.saved_tensors\n";
+  }
+  for (const auto &o : outputs) {
+    stream << "            if grad_" << o << " is None:\n"
+              "                grad_" << o << " = torch.zeros_like(" << o << ")\n";
+  }
+  for (const auto &arg : f.args) {
+    if (arg.kind == Argument::OutputBuffer) {
+      stream << "            " << arg.name << " = torch.empty_like(" << arg.name.substr(2) << ")\n";
+    }
+  }
+  stream << "            backward_op(";
+  bool first = true;
+  for (const auto &arg : f.args) {
+    if (arg.name == "__user_context") {
+      continue;
+    }
+    stream << (first ? "" : ", ");
+    first = false;
+    if (arg.kind != Argument::OutputBuffer && starts_with(arg.name, "d_") && output_set.count(arg.name.substr(2))) {
+      stream << "grad_" << arg.name.substr(2);
+    } else if (std::find(scalars.begin(), scalars.end(), arg.name) != scalars.end()) {
+      stream << "ctx." << arg.name;
+    } else {
+      stream << arg.name;
+    }
+  }
+  stream << ")\n";
+
+  // One gradient per argument of forward()
+  std::vector<std::string> returned;
+  for (const auto &i : inputs) {
+    returned.push_back(gradients.count(i) ? "d_" + i : "None");
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    returned.push_back("None");
+  }
+  stream << "            return " << comma_separated(returned, "") << (returned.size() == 1 ? "," : "") << "\n"
+            "\n"
+            "    return Function\n";
+}
+
   // TODO: remove this duplicate
 string CodeGen_PyTorch::print_name(const string &name) {
     ostringstream oss;
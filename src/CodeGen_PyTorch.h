@@ -24,6 +24,7 @@ public:
     enum OutputKind {
         PyTorchHeader,
         PyTorchImplementation,
+        PyTorchAutograd,
     };
 
     CodeGen_PyTorch(
@@ -34,6 +35,10 @@ public:
     /** Emit the declarations contained in the module as C code. */
     void compile(const Module &module);
 
+    /** Is this the lowered function of a gradient pipeline, i.e. does it
+     * have outputs named d_<input>? See compile_autograd. */
+    static bool is_gradient_function(const LoweredFunc &func);
+
     /** The target we're generating code for */
     const Target &get_target() const { return target; }
 
@@ -41,6 +46,17 @@ public:
 
 protected:
     virtual void compile(const LoweredFunc &func, bool isCuda);
+    /** Emit an op taking ATen tensors, which are wrapped with their strides
+     * instead of being made contiguous. */
+    virtual void compile_aten(const LoweredFunc &func, bool isCuda);
+    /** Emit, as Python, a factory for a torch.autograd.Function that
+     * runs a forward op and the op of this gradient pipeline as its
+     * backward pass. The arguments of the gradient pipeline name the
+     * forward ones: d_<X> are the adjoints of the forward outputs X
+     * (which it may also take as inputs), saved_<Y> are intermediates
+     * the forward op outputs for it, and the rest are the forward
+     * inputs. Its outputs d_<Z> are the gradients of the inputs Z. */
+    virtual void compile_autograd(const LoweredFunc &func);
     virtual std::string print_name(const std::string &);
 
     /** The target being generated for. */
@@ -0,0 +1,75 @@
+#include <mutex>
+
+#include "CodeGen_RISCV.h"
+#include "LLVM_Headers.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+
+using namespace llvm;
+
+CodeGen_RISCV::CodeGen_RISCV(Target t) : CodeGen_Posix(t) {
+    #if !(WITH_RISCV)
+    user_error << "llvm build not configured with RISCV target enabled.\n";
+    #endif
+    user_assert(llvm_RISCV_enabled) << "llvm build not configured with RISCV target enabled.\n";
+    user_assert(LLVM_VERSION >= 90) << "The RISCV target requires LLVM 9.0 or later.\n";
+    user_assert(LLVM_VERSION >= 140 || !target.has_feature(Target::RVV))
+        << "The rvv target feature requires LLVM 14.0 or later.\n";
+}
+
+std::unique_ptr<llvm::Module> CodeGen_RISCV::compile(const Module &module) {
+    auto llvm_module = CodeGen_Posix::compile(module);
+
+    // LLVM only lowers the fixed-width vectors Halide emits to RVV
+    // instructions when it is told the smallest VLEN it may assume. The
+    // V extension guarantees 128 bits, so that is what we tell it: each
+    // vector then runs with a vsetvli of its own length, on any hardware
+    // whose vectors are at least that wide, and vectors wider than VLEN
+    // are split across register groups. As for Hexagon, this is a global
+    // option, so it is set once, just before the target-specific
+    // lowering.
+    #if LLVM_VERSION >= 140
+    if (module.target().has_feature(Target::RVV)) {
+        static std::once_flag set_options_once;
+        std::call_once(set_options_once, []() {
+            std::vector<const char *> options = {
+                "halide-riscv-be",
+                "-riscv-v-vector-bits-min=128"
+            };
+            cl::ParseCommandLineOptions(options.size(), options.data());
+        });
+    }
+    #endif
+
+    return llvm_module;
+}
+
+string CodeGen_RISCV::mcpu() const {
+    return "";
+}
+
+string CodeGen_RISCV::mattrs() const {
+    // RV32GC or RV64GC: the integer multiply, atomic, single and
+    // double-precision float and compressed extensions, which the Linux
+    // ABIs assume.
+    string features = "+m,+a,+f,+d,+c";
+    if (target.has_feature(Target::RVV)) {
+        features += ",+v";
+    }
+    return features;
+}
+
+bool CodeGen_RISCV::use_soft_float_abi() const {
+    return false;
+}
+
+int CodeGen_RISCV::native_vector_bits() const {
+    // The minimum VLEN of the V extension.
+    return 128;
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,33 @@
+#ifndef HALIDE_CODEGEN_RISCV_H
+#define HALIDE_CODEGEN_RISCV_H
+
+/** \file
+ * Defines the code-generator for producing RISC-V machine code.
+ */
+
+#include "CodeGen_Posix.h"
+
+namespace Halide {
+namespace Internal {
+
+/** A code generator that emits RISC-V code from a given Halide stmt. */
+class CodeGen_RISCV : public CodeGen_Posix {
+public:
+    /** Create a RISC-V code generator. The vector extension can be
+     * enabled using the appropriate flag in the target struct. */
+    CodeGen_RISCV(Target);
+
+    std::unique_ptr<llvm::Module> compile(const Module &module);
+
+protected:
+
+    std::string mcpu() const;
+    std::string mattrs() const;
+    bool use_soft_float_abi() const;
+    int native_vector_bits() const;
+};
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
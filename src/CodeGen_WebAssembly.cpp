@@ -0,0 +1,106 @@
+#include "CodeGen_WebAssembly.h"
+#include "ConciseCasts.h"
+#include "IRMatch.h"
+#include "IROperator.h"
+#include "LLVM_Headers.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+using namespace Halide::ConciseCasts;
+using namespace llvm;
+
+CodeGen_WebAssembly::CodeGen_WebAssembly(Target t) : CodeGen_Posix(t) {
+    #if !(WITH_WEBASSEMBLY)
+    user_error << "llvm build not configured with WebAssembly target enabled.\n";
+    #endif
+    user_assert(llvm_WebAssembly_enabled) << "llvm build not configured with WebAssembly target enabled.\n";
+    user_assert(LLVM_VERSION >= 80) << "The WebAssembly target requires LLVM 8.0 or later.\n";
+    user_assert(target.bits == 32) << "The WebAssembly target is 32-bit only.\n";
+    user_assert(!target.has_feature(Target::JIT)) << "WebAssembly can't be JIT-compiled.\n";
+}
+
+void CodeGen_WebAssembly::visit(const Cast *op) {
+    if (!op->type.is_vector() || !target.has_feature(Target::WasmSimd128)) {
+        // We only have peephole optimizations for vectors in here.
+        CodeGen_Posix::visit(op);
+        return;
+    }
+
+    vector<Expr> matches;
+
+    struct Pattern {
+        Type type;
+        string intrin;
+        Expr pattern;
+    };
+
+    // The saturating adds and subtracts, which are computed in the
+    // narrow type.
+    static Pattern patterns[] = {
+        {Int(8, 16), "llvm.wasm.add.saturate.signed.v16i8", i8_sat(wild_i16x_ + wild_i16x_)},
+        {Int(8, 16), "llvm.wasm.sub.saturate.signed.v16i8", i8_sat(wild_i16x_ - wild_i16x_)},
+        {UInt(8, 16), "llvm.wasm.add.saturate.unsigned.v16i8", u8_sat(wild_u16x_ + wild_u16x_)},
+        {UInt(8, 16), "llvm.wasm.sub.saturate.unsigned.v16i8", u8(max(wild_i16x_ - wild_i16x_, 0))},
+        {Int(16, 8), "llvm.wasm.add.saturate.signed.v8i16", i16_sat(wild_i32x_ + wild_i32x_)},
+        {Int(16, 8), "llvm.wasm.sub.saturate.signed.v8i16", i16_sat(wild_i32x_ - wild_i32x_)},
+        {UInt(16, 8), "llvm.wasm.add.saturate.unsigned.v8i16", u16_sat(wild_u32x_ + wild_u32x_)},
+        {UInt(16, 8), "llvm.wasm.sub.saturate.unsigned.v8i16", u16(max(wild_i32x_ - wild_i32x_, 0))},
+    };
+
+    for (size_t i = 0; i < sizeof(patterns)/sizeof(patterns[0]); i++) {
+        const Pattern &pattern = patterns[i];
+        if (expr_match(pattern.pattern, op, matches)) {
+            // Try to narrow the matches to the target type.
+            bool match = true;
+            for (size_t i = 0; i < matches.size(); i++) {
+                matches[i] = lossless_cast(op->type, matches[i]);
+                if (!matches[i].defined()) match = false;
+            }
+            if (match) {
+                value = call_intrin(op->type, pattern.type.lanes(), pattern.intrin, matches);
+                return;
+            }
+        }
+    }
+
+    CodeGen_Posix::visit(op);
+}
+
+string CodeGen_WebAssembly::mcpu() const {
+    return "";
+}
+
+string CodeGen_WebAssembly::mattrs() const {
+    std::string features;
+    std::string separator;
+
+    if (target.has_feature(Target::WasmSimd128)) {
+        features += "+simd128";
+        separator = ",";
+    }
+
+    if (target.has_feature(Target::WasmThreads)) {
+        // The thread pool shares the module's memory with the web
+        // workers it runs on, which needs the atomic instructions.
+        features += separator + "+atomics";
+        separator = ",";
+    }
+
+    return features;
+}
+
+bool CodeGen_WebAssembly::use_soft_float_abi() const {
+    return false;
+}
+
+int CodeGen_WebAssembly::native_vector_bits() const {
+    return 128;
+}
+
+}  // namespace Internal
+}  // namespace Halide
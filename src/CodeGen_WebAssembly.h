@@ -0,0 +1,38 @@
+#ifndef HALIDE_CODEGEN_WEBASSEMBLY_H
+#define HALIDE_CODEGEN_WEBASSEMBLY_H
+
+/** \file
+ * Defines the code-generator for producing WebAssembly machine code.
+ */
+
+#include "CodeGen_Posix.h"
+
+namespace Halide {
+namespace Internal {
+
+/** A code generator that emits WebAssembly code from a given Halide stmt. */
+class CodeGen_WebAssembly : public CodeGen_Posix {
+public:
+    /** Create a WebAssembly code generator. SIMD128 and threads can be
+     * enabled using the appropriate flags in the target struct. */
+    CodeGen_WebAssembly(Target);
+
+protected:
+
+    std::string mcpu() const;
+    std::string mattrs() const;
+    bool use_soft_float_abi() const;
+    int native_vector_bits() const;
+
+    using CodeGen_Posix::visit;
+
+    /** Nodes for which we want to emit specific SIMD128 intrinsics */
+    // @{
+    void visit(const Cast *);
+    // @}
+};
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -8,7 +8,9 @@
 #include "IROperator.h"
 #include "JITModule.h"
 #include "LLVM_Headers.h"
+#include "ModulusRemainder.h"
 #include "Param.h"
+#include "Simplify.h"
 #include "Util.h"
 #include "Var.h"
 
@@ -60,11 +62,121 @@ bool should_use_pmaddwd(Expr a, Expr b, vector<Expr> &result) {
     return true;
 }
 
+void collect_summands(Expr e, vector<Expr> &summands) {
+    if (const Add *add = e.as<Add>()) {
+        collect_summands(add->a, summands);
+        collect_summands(add->b, summands);
+    } else {
+        summands.push_back(e);
+    }
+}
+
+// A sum of products of i32(u8) and i32(i8) can be done four at a time
+// with vpdpbusd, and a sum of products of i32(i16) two at a time with
+// vpdpwssd, both of which also add an accumulator. The factors are
+// returned in 'bytes' and 'words' as consecutive pairs, and the
+// summands left over in 'rest'. Each group of factors is interleaved
+// so that a 32-bit lane sums its own bytes or words.
+bool should_use_vnni(const Add *op, vector<Expr> &rest,
+                     vector<Expr> &bytes, vector<Expr> &words) {
+    Type t = op->type;
+    if (!(t.is_int() && t.bits() == 32 && t.lanes() >= 4)) {
+        return false;
+    }
+
+    vector<Expr> summands;
+    collect_summands(op, summands);
+
+    vector<Expr> byte_products, word_products;
+    for (const Expr &e : summands) {
+        const Mul *mul = e.as<Mul>();
+        if (mul) {
+            Expr ua = lossless_cast(t.with_bits(8).with_code(Type::UInt), mul->a);
+            Expr sb = lossless_cast(t.with_bits(8), mul->b);
+            if (!ua.defined() || !sb.defined()) {
+                ua = lossless_cast(t.with_bits(8).with_code(Type::UInt), mul->b);
+                sb = lossless_cast(t.with_bits(8), mul->a);
+            }
+            if (ua.defined() && sb.defined()) {
+                bytes.push_back(ua);
+                bytes.push_back(sb);
+                byte_products.push_back(e);
+                continue;
+            }
+            Expr wa = lossless_cast(t.with_bits(16), mul->a);
+            Expr wb = lossless_cast(t.with_bits(16), mul->b);
+            if (wa.defined() && wb.defined()) {
+                words.push_back(wa);
+                words.push_back(wb);
+                word_products.push_back(e);
+                continue;
+            }
+        }
+        rest.push_back(e);
+    }
+
+    // Products that don't make a whole group are summed as usual.
+    while (byte_products.size() % 4) {
+        rest.push_back(byte_products.back());
+        byte_products.pop_back();
+        bytes.resize(bytes.size() - 2);
+    }
+    while (word_products.size() % 2) {
+        rest.push_back(word_products.back());
+        word_products.pop_back();
+        words.resize(words.size() - 2);
+    }
+
+    // Without anything to accumulate into, two products of words are
+    // better left to pmaddwd.
+    if (byte_products.empty() &&
+        (word_products.empty() || (word_products.size() == 2 && rest.empty()))) {
+        return false;
+    }
+    return true;
+}
+
 }
 
 
 void CodeGen_X86::visit(const Add *op) {
     vector<Expr> matches;
+#if LLVM_VERSION >= 70
+    vector<Expr> rest, bytes, words;
+    if (target.has_feature(Target::AVX512_VNNI) &&
+        should_use_vnni(op, rest, bytes, words)) {
+        Expr acc = make_zero(op->type);
+        if (!rest.empty()) {
+            acc = rest[0];
+            for (size_t i = 1; i < rest.size(); i++) {
+                acc = Add::make(acc, rest[i]);
+            }
+        }
+        value = codegen(acc);
+
+        int lanes = op->type.lanes();
+        int intrin_lanes = lanes >= 16 ? 16 : lanes >= 8 ? 8 : 4;
+        string suffix = intrin_lanes == 16 ? "512" : intrin_lanes == 8 ? "256" : "128";
+        llvm::Type *t = value->getType();
+        for (size_t i = 0; i < bytes.size(); i += 8) {
+            Value *a = interleave_vectors({codegen(bytes[i]), codegen(bytes[i + 2]),
+                                           codegen(bytes[i + 4]), codegen(bytes[i + 6])});
+            Value *b = interleave_vectors({codegen(bytes[i + 1]), codegen(bytes[i + 3]),
+                                           codegen(bytes[i + 5]), codegen(bytes[i + 7])});
+            a = builder->CreateBitCast(a, t);
+            b = builder->CreateBitCast(b, t);
+            value = call_intrin(t, intrin_lanes, "llvm.x86.avx512.vpdpbusd." + suffix, {value, a, b});
+        }
+        for (size_t i = 0; i < words.size(); i += 4) {
+            Value *a = interleave_vectors({codegen(words[i]), codegen(words[i + 2])});
+            Value *b = interleave_vectors({codegen(words[i + 1]), codegen(words[i + 3])});
+            a = builder->CreateBitCast(a, t);
+            b = builder->CreateBitCast(b, t);
+            value = call_intrin(t, intrin_lanes, "llvm.x86.avx512.vpdpwssd." + suffix, {value, a, b});
+        }
+        return;
+    }
+#endif
     if (should_use_pmaddwd(op->a, op->b, matches)) {
         codegen(Call::make(op->type, "pmaddwd", matches, Call::Extern));
     } else {
@@ -199,6 +311,134 @@ void CodeGen_X86::visit(const Select *op) {
     }
 }
 
+void CodeGen_X86::visit(const VectorReduce *op) {
+    const int factor = op->value.type().lanes() / op->type.lanes();
+    const bool avx2 = target.has_feature(Target::AVX2);
+
+    // Some horizontal sums have an instruction that does the first few
+    // steps, and the rest of the reduction is done on its result.
+    Value *partial = nullptr;
+    Type partial_type;
+    int partial_factor = 1;
+    if (op->op == VectorReduce::Add && factor % 2 == 0) {
+        const Mul *mul = op->value.as<Mul>();
+        const Cast *cast = op->value.as<Cast>();
+        if (mul && op->type.element_of() == Int(32) && mul->type.lanes() >= 4) {
+            // pmaddwd sums adjacent pairs of products of int16s. (The
+            // byte version, pmaddubsw, saturates, so it can't be used
+            // for an int16 sum.)
+            Type narrow = mul->type.with_bits(16);
+            Expr a = lossless_cast(narrow, mul->a);
+            Expr b = lossless_cast(narrow, mul->b);
+            if (a.defined() && b.defined()) {
+                partial_type = op->type.with_lanes(mul->type.lanes() / 2);
+                partial = call_intrin(partial_type, avx2 ? 8 : 4,
+                                      avx2 ? "llvm.x86.avx2.pmadd.wd" : "llvm.x86.sse2.pmadd.wd", {a, b});
+                partial_factor = 2;
+            }
+        } else if (cast && factor % 8 == 0 && cast->type.lanes() >= 16 &&
+                   !cast->type.is_float() && cast->type.bits() >= 16) {
+            // psadbw sums groups of eight absolute differences of
+            // uint8s into uint64s. A sum of uint8s is a sum of their
+            // differences from zero.
+            Type u8 = UInt(8, cast->type.lanes());
+            Expr a, b;
+            const Call *c = cast->value.as<Call>();
+            if (c && c->is_intrinsic(Call::absd) && c->args[0].type() == u8) {
+                a = c->args[0];
+                b = c->args[1];
+            } else if (cast->value.type() == u8) {
+                a = cast->value;
+                b = make_zero(u8);
+            }
+            if (a.defined()) {
+                Value *sad = call_intrin(UInt(64, cast->type.lanes() / 8), avx2 ? 4 : 2,
+                                         avx2 ? "llvm.x86.avx2.psad.bw" : "llvm.x86.sse2.psad.bw", {a, b});
+                // Each sum is at most 8 * 255, which fits in any type
+                // at least 16 bits wide.
+                partial_type = op->type.with_lanes(cast->type.lanes() / 8);
+                partial = builder->CreateIntCast(sad, llvm_type_of(partial_type), false);
+                partial_factor = 8;
+            }
+        }
+    }
+
+    if (!partial) {
+        CodeGen_Posix::visit(op);
+    } else if (partial_factor == factor) {
+        value = partial;
+    } else {
+        string name = unique_name('t');
+        sym_push(name, partial);
+        value = codegen(VectorReduce::make(op->op, Variable::make(partial_type, name), op->type.lanes()));
+        sym_pop(name);
+    }
+}
+
+void CodeGen_X86::visit(const Load *op) {
+    // Loads of one channel of interleaved structures of 3 or 4
+    // elements, e.g. RGB(A) pixels. Rather than gathering the lanes one
+    // at a time, load the structures densely and deinterleave them with
+    // a shuffle, which llvm lowers to pshufb/vpermb/vpermt2ps etc.,
+    // depending on the target.
+    const Ramp *ramp = op->index.as<Ramp>();
+    const int64_t *stride = ramp ? as_const_int(ramp->stride) : nullptr;
+    if (!target.has_feature(Target::SSE41) ||
+        !is_one(op->predicate) ||
+        !stride || (*stride != 3 && *stride != 4) ||
+        op->type.is_handle() || op->type.bits() > 32) {
+        CodeGen_Posix::visit(op);
+        return;
+    }
+
+    const int s = (int)*stride;
+    const int lanes = ramp->lanes;
+    Expr base = ramp->base;
+    Expr one = make_one(base.type());
+    int offset = 0;
+    Expr dense_index;
+
+    // Only allocations we made ourselves are padded. Those made by a
+    // new_expr (e.g. a slice of a memory planning arena, or persistent
+    // storage) are exactly the size they were asked for.
+    bool padded = allocations.contains(op->name) && allocations.get(op->name).padded;
+    if (!padded || target.has_feature(Target::ASAN)) {
+        // Don't read beyond the lanes we need.
+        dense_index = Ramp::make(base, one, s * (lanes - 1) + 1);
+    } else {
+        // Load whole structures, starting at the first element of the
+        // structure the base is in, if we can prove where that is. Then
+        // the loads of the other channels are the same load. This
+        // reads up to s - 1 elements past the last lane, which the
+        // allocation padding covers.
+        ModulusRemainder mod_rem = modulus_remainder(base);
+        if ((mod_rem.modulus % s) == 0) {
+            offset = mod_rem.remainder % s;
+        }
+        if (offset) {
+            base = simplify(base - offset);
+        }
+        dense_index = Ramp::make(base, one, s * lanes);
+    }
+
+    int dense_lanes = dense_index.type().lanes();
+    Expr dense_load = Load::make(op->type.with_lanes(dense_lanes), op->name, dense_index,
+                                 op->image, op->param, const_true(dense_lanes));
+    Value *dense = codegen(dense_load);
+
+    vector<int> indices(lanes);
+    for (int i = 0; i < lanes; i++) {
+        indices[i] = offset + s * i;
+    }
+    value = shuffle_vectors(dense, indices);
+}
+
+int CodeGen_X86::allocation_padding(Type type) const {
+    // Structured loads read up to three elements past the end of an
+    // allocation.
+    return CodeGen_Posix::allocation_padding(type) + 2 * type.bytes();
+}
+
 void CodeGen_X86::visit(const Cast *op) {
 
     if (!op->type.is_vector()) {
@@ -373,7 +613,11 @@ Expr CodeGen_X86::mulhi_shr(Expr a, Expr b, int shr) {
 
 string CodeGen_X86::mcpu() const {
     if (target.has_feature(Target::AVX512_Cannonlake)) return "cannonlake";
-    if (target.has_feature(Target::AVX512_Skylake)) return "skylake-avx512";
+#if LLVM_VERSION >= 80
+    if (target.has_feature(Target::AVX512_VNNI)) return "cascadelake";
+#endif
+    if (target.has_feature(Target::AVX512_Skylake) ||
+        target.has_feature(Target::AVX512_VNNI)) return "skylake-avx512";
     if (target.has_feature(Target::AVX512_KNL)) return "knl";
     if (target.has_feature(Target::AVX2)) return "haswell";
     if (target.has_feature(Target::AVX)) return "corei7-avx";
@@ -401,19 +645,24 @@ string CodeGen_X86::mattrs() const {
     if (target.has_feature(Target::AVX512) ||
         target.has_feature(Target::AVX512_KNL) ||
         target.has_feature(Target::AVX512_Skylake) ||
-        target.has_feature(Target::AVX512_Cannonlake)) {
+        target.has_feature(Target::AVX512_Cannonlake) ||
+        target.has_feature(Target::AVX512_VNNI)) {
         features += separator + "+avx512f,+avx512cd";
         separator = ",";
         if (target.has_feature(Target::AVX512_KNL)) {
             features += ",+avx512pf,+avx512er";
         }
         if (target.has_feature(Target::AVX512_Skylake) ||
-            target.has_feature(Target::AVX512_Cannonlake)) {
+            target.has_feature(Target::AVX512_Cannonlake) ||
+            target.has_feature(Target::AVX512_VNNI)) {
             features += ",+avx512vl,+avx512bw,+avx512dq";
         }
         if (target.has_feature(Target::AVX512_Cannonlake)) {
             features += ",+avx512ifma,+avx512vbmi";
         }
+        if (target.has_feature(Target::AVX512_VNNI)) {
+            features += ",+avx512vnni";
+        }
     }
     return features;
 }
@@ -426,7 +675,8 @@ int CodeGen_X86::native_vector_bits() const {
     if (target.has_feature(Target::AVX512) ||
         target.has_feature(Target::AVX512_Skylake) ||
         target.has_feature(Target::AVX512_KNL) ||
-        target.has_feature(Target::AVX512_Cannonlake)) {
+        target.has_feature(Target::AVX512_Cannonlake) ||
+        target.has_feature(Target::AVX512_VNNI)) {
         return 512;
     } else if (target.has_feature(Target::AVX) ||
                target.has_feature(Target::AVX2)) {
@@ -436,5 +686,23 @@ int CodeGen_X86::native_vector_bits() const {
     }
 }
 
+bool CodeGen_X86::use_gather(Type t) const {
+    // AVX2 has gathers of 32 and 64-bit lanes. A gather costs about as
+    // much as a scalar load per lane, but saves the inserts that put the
+    // scalars together, so it is worth it from four lanes on.
+    bool has_avx2 = target.features_any_of({Target::AVX2, Target::AVX512, Target::AVX512_KNL,
+                                            Target::AVX512_Skylake, Target::AVX512_Cannonlake,
+                                            Target::AVX512_VNNI});
+    return has_avx2 && (t.bits() == 32 || t.bits() == 64) && t.lanes() >= 4;
+}
+
+bool CodeGen_X86::use_scatter(Type t) const {
+    // Only AVX-512 has scatters.
+    bool has_avx512 = target.features_any_of({Target::AVX512, Target::AVX512_KNL,
+                                              Target::AVX512_Skylake, Target::AVX512_Cannonlake,
+                                              Target::AVX512_VNNI});
+    return has_avx512 && (t.bits() == 32 || t.bits() == 64) && t.lanes() >= 4;
+}
+
 }  // namespace Internal
 }  // namespace Halide
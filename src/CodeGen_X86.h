@@ -27,9 +27,13 @@ protected:
     std::string mattrs() const;
     bool use_soft_float_abi() const;
     int native_vector_bits() const;
+    bool use_gather(Type t) const;
+    bool use_scatter(Type t) const;
 
     Expr mulhi_shr(Expr a, Expr b, int shr);
 
+    int allocation_padding(Type type) const;
+
     using CodeGen_Posix::visit;
 
     /** Nodes for which we want to emit specific sse/avx intrinsics */
@@ -37,6 +41,7 @@ protected:
     void visit(const Add *);
     void visit(const Sub *);
     void visit(const Cast *);
+    void visit(const Load *);
     void visit(const GT *);
     void visit(const LT *);
     void visit(const LE *);
@@ -44,6 +49,7 @@ protected:
     void visit(const EQ *);
     void visit(const NE *);
     void visit(const Select *);
+    void visit(const VectorReduce *);
     // @}
 };
 
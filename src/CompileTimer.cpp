@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CompileTimer.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct PhaseTotal {
+    double seconds = 0;
+    int64_t count = 0;
+};
+
+struct TraceEvent {
+    string name;
+    double start_us, duration_us;
+    size_t thread;
+};
+
+// Everything timed so far, reported when the process exits.
+class CompileProfile {
+public:
+    std::mutex mutex;
+    std::map<string, PhaseTotal> totals;
+    vector<TraceEvent> events;
+    bool report;
+    string trace_file;
+    Clock::time_point epoch;
+
+    CompileProfile() : epoch(Clock::now()) {
+        report = get_env_variable("HL_COMPILE_TIMING") == "1";
+        trace_file = get_env_variable("HL_COMPILE_TRACE");
+    }
+
+    ~CompileProfile() {
+        if (report && !totals.empty()) {
+            vector<std::pair<string, PhaseTotal>> sorted(totals.begin(), totals.end());
+            std::sort(sorted.begin(), sorted.end(),
+                      [](const std::pair<string, PhaseTotal> &a, const std::pair<string, PhaseTotal> &b) {
+                          return a.second.seconds > b.second.seconds;
+                      });
+            std::cerr << "Compile time by phase (nested phases are included in their parents):\n";
+            for (const auto &p : sorted) {
+                std::cerr << "  " << std::left << std::setw(64) << p.first
+                          << std::right << std::fixed << std::setprecision(3)
+                          << std::setw(10) << p.second.seconds * 1000 << " ms"
+                          << std::setw(10) << p.second.count << " calls\n";
+            }
+        }
+        if (!trace_file.empty()) {
+            std::ofstream out(trace_file);
+            if (!out.is_open()) {
+                std::cerr << "Could not write compile trace " << trace_file << "\n";
+                return;
+            }
+            out << "{\"traceEvents\":[\n";
+            for (size_t i = 0; i < events.size(); i++) {
+                const TraceEvent &e = events[i];
+                out << (i > 0 ? ",\n" : "")
+                    << "{\"name\":\"" << e.name << "\",\"cat\":\"halide\",\"ph\":\"X\""
+                    << ",\"ts\":" << std::fixed << std::setprecision(1) << e.start_us
+                    << ",\"dur\":" << e.duration_us
+                    << ",\"pid\":0,\"tid\":" << e.thread << "}";
+            }
+            out << "\n]}\n";
+        }
+    }
+};
+
+CompileProfile &compile_profile() {
+    static CompileProfile profile;
+    return profile;
+}
+
+// The phases running on this thread, so that nested runs of a phase
+// aren't counted twice.
+thread_local vector<const char *> running_phases;
+
+}  // namespace
+
+bool CompileTimer::enabled() {
+    static bool e = compile_profile().report || !compile_profile().trace_file.empty();
+    return e;
+}
+
+CompileTimer::CompileTimer(const char *name, bool traced)
+    : name(nullptr), traced(traced), running(false) {
+    begin(name);
+}
+
+CompileTimer::~CompileTimer() {
+    end();
+}
+
+void CompileTimer::next(const char *n) {
+    end();
+    begin(n);
+}
+
+void CompileTimer::begin(const char *n) {
+    if (!enabled()) {
+        return;
+    }
+    for (const char *p : running_phases) {
+        if (strcmp(p, n) == 0) {
+            return;
+        }
+    }
+    name = n;
+    running = true;
+    running_phases.push_back(name);
+    start = Clock::now();
+}
+
+void CompileTimer::end() {
+    if (!running) {
+        return;
+    }
+    Clock::time_point stop = Clock::now();
+    running = false;
+    running_phases.erase(std::find(running_phases.begin(), running_phases.end(), name));
+
+    CompileProfile &profile = compile_profile();
+    std::lock_guard<std::mutex> lock(profile.mutex);
+    PhaseTotal &total = profile.totals[name];
+    total.seconds += std::chrono::duration<double>(stop - start).count();
+    total.count++;
+    if (traced && !profile.trace_file.empty()) {
+        TraceEvent e;
+        e.name = name;
+        e.start_us = std::chrono::duration<double, std::micro>(start - profile.epoch).count();
+        e.duration_us = std::chrono::duration<double, std::micro>(stop - start).count();
+        e.thread = std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000;
+        profile.events.push_back(e);
+    }
+}
+
+}  // namespace Internal
+}  // namespace Halide
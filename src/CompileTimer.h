@@ -0,0 +1,45 @@
+#ifndef HALIDE_COMPILE_TIMER_H
+#define HALIDE_COMPILE_TIMER_H
+
+/** \file
+ * Defines a timer for the phases of the compiler, used to find out where
+ * the time taken to compile a pipeline goes.
+ */
+
+#include <chrono>
+
+namespace Halide {
+namespace Internal {
+
+/** Times a phase of compilation, from the construction of the timer to its
+ * destruction, when compile time profiling is enabled. Setting
+ * HL_COMPILE_TIMING=1 prints the total time spent in each phase to stderr
+ * at exit. Setting HL_COMPILE_TRACE=<file> writes each phase to that file
+ * as a trace in the chrome://tracing JSON format.
+ *
+ * A phase entered again while it is running, such as the simplifier
+ * calling itself, is only counted once. Phases that run very often can
+ * be left out of the trace, and only counted in the totals. */
+class CompileTimer {
+    const char *name;
+    bool traced, running;
+    std::chrono::high_resolution_clock::time_point start;
+
+    void begin(const char *n);
+    void end();
+
+public:
+    CompileTimer(const char *name, bool traced = true);
+    ~CompileTimer();
+
+    /** Stop timing the current phase, and start timing another. */
+    void next(const char *name);
+
+    /** Whether compile time profiling is enabled. */
+    static bool enabled();
+};
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
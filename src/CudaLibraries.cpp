@@ -0,0 +1,122 @@
+#include "CudaLibraries.h"
+#include "IROperator.h"
+#include "Param.h"
+
+namespace Halide {
+
+namespace {
+
+void check_input(const Func &f, int dimensions, const char *what, const std::string &name) {
+    user_assert(f.defined() && f.outputs() == 1 && f.output_types()[0].is_float() &&
+                f.dimensions() == dimensions)
+        << "The " << what << " of " << name << " must be a defined, single-valued float Func "
+        << "with " << dimensions << " dimensions.\n";
+}
+
+void check_same_type(const Func &a, const Func &b, const std::string &name) {
+    user_assert(a.output_types()[0] == b.output_types()[0])
+        << "The inputs of " << name << " must have the same type, instead of "
+        << a.output_types()[0] << " and " << b.output_types()[0] << ".\n";
+}
+
+void check_conv_params(int filter_width, int filter_height, int stride, const std::string &name) {
+    user_assert(filter_width > 0 && filter_height > 0 && stride > 0)
+        << "The filter extents and the stride of " << name << " must be positive.\n";
+}
+
+Func gemm(const Func &a, const Func &b, const Expr &k,
+          bool transpose_a, bool transpose_b, const std::string &name) {
+    check_input(a, 2, "matrix a", name);
+    check_input(b, 2, "matrix b", name);
+    check_same_type(a, b, name);
+    Type t = a.output_types()[0];
+    user_assert(t.bits() == 32 || t.bits() == 64)
+        << "cuBLAS can only multiply float or double matrices, not " << t << ".\n";
+    Func output(name);
+    std::vector<ExternFuncArgument> args = {
+        user_context_value(), (int)transpose_a, (int)transpose_b, cast<int>(k), a, b};
+    output.define_extern("halide_cublas_gemm", args, t, 2, NameMangling::C, DeviceAPI::CUDA);
+    return output;
+}
+
+}  // namespace
+
+CudaLibraryStage cublas_gemm(const Func &a, const Func &b, Expr m, Expr n, Expr k,
+                             bool transpose_a, bool transpose_b, const std::string &name) {
+    CudaLibraryStage result;
+    result.output = gemm(a, b, k, transpose_a, transpose_b, name);
+    result.gradient = [=](const Func &dc) {
+        // With op(x) the matrix x, or its transpose if it is transposed,
+        // output = op(a) * op(b), so d(op(a)) = dc * op(b)^T and
+        // d(op(b)) = op(a)^T * dc.
+        Func da = transpose_a ?
+            gemm(b, dc, n, transpose_b, true, name + "_d_a") :
+            gemm(dc, b, n, false, !transpose_b, name + "_d_a");
+        Func db = transpose_b ?
+            gemm(dc, a, m, true, transpose_a, name + "_d_b") :
+            gemm(a, dc, m, !transpose_a, false, name + "_d_b");
+        return std::map<std::string, Func>{{a.name(), da}, {b.name(), db}};
+    };
+    return result;
+}
+
+CudaLibraryStage cudnn_conv(const Func &input, const Func &filter,
+                            Expr width, Expr height, Expr input_channels,
+                            Expr output_channels, Expr batch,
+                            int filter_width, int filter_height, int stride,
+                            const std::string &name) {
+    check_input(input, 4, "input", name);
+    check_input(filter, 4, "filter", name);
+    check_same_type(input, filter, name);
+    check_conv_params(filter_width, filter_height, stride, name);
+    CudaLibraryStage result;
+    result.output = Func(name);
+    std::vector<ExternFuncArgument> args = {
+        user_context_value(), cast<int>(input_channels), filter_width, filter_height, stride,
+        input, filter};
+    result.output.define_extern("halide_cudnn_conv_forward", args, input.output_types()[0], 4,
+                                NameMangling::C, DeviceAPI::CUDA);
+    result.gradient = [=](const Func &d_output) {
+        Func d_input = cudnn_conv_input_gradient(d_output, filter, output_channels,
+                                                 filter_width, filter_height, stride,
+                                                 name + "_d_input");
+        Func d_filter = cudnn_conv_filter_gradient(input, d_output, width, height, batch,
+                                                   stride, name + "_d_filter");
+        return std::map<std::string, Func>{{input.name(), d_input}, {filter.name(), d_filter}};
+    };
+    return result;
+}
+
+Func cudnn_conv_input_gradient(const Func &d_output, const Func &filter, Expr output_channels,
+                               int filter_width, int filter_height, int stride,
+                               const std::string &name) {
+    check_input(d_output, 4, "adjoint of the output", name);
+    check_input(filter, 4, "filter", name);
+    check_same_type(d_output, filter, name);
+    check_conv_params(filter_width, filter_height, stride, name);
+    Func d_input(name);
+    std::vector<ExternFuncArgument> args = {
+        user_context_value(), cast<int>(output_channels), filter_width, filter_height, stride,
+        filter, d_output};
+    d_input.define_extern("halide_cudnn_conv_backward_data", args, d_output.output_types()[0], 4,
+                          NameMangling::C, DeviceAPI::CUDA);
+    return d_input;
+}
+
+Func cudnn_conv_filter_gradient(const Func &input, const Func &d_output,
+                                Expr width, Expr height, Expr batch, int stride,
+                                const std::string &name) {
+    check_input(input, 4, "input", name);
+    check_input(d_output, 4, "adjoint of the output", name);
+    check_same_type(input, d_output, name);
+    check_conv_params(1, 1, stride, name);
+    Func d_filter(name);
+    std::vector<ExternFuncArgument> args = {
+        user_context_value(), cast<int>(width), cast<int>(height), cast<int>(batch), stride,
+        input, d_output};
+    d_filter.define_extern("halide_cudnn_conv_backward_filter", args, input.output_types()[0], 4,
+                           NameMangling::C, DeviceAPI::CUDA);
+    return d_filter;
+}
+
+}  // namespace Halide
@@ -0,0 +1,100 @@
+#ifndef HALIDE_CUDA_LIBRARIES_H
+#define HALIDE_CUDA_LIBRARIES_H
+
+/** \file
+ * Pipeline stages computed by cuBLAS and cuDNN on the CUDA device.
+ */
+
+#include <string>
+
+#include "Derivative.h"
+#include "Func.h"
+
+namespace Halide {
+
+/** A Func computed by one of the library calls below, along with its
+ * gradient. The Func is an extern stage with DeviceAPI::CUDA, so its
+ * inputs are copied to the device only if they were computed on the
+ * host, and its output stays on the device for the Funcs computed on the
+ * GPU that read it. The library is called on the stream and in the
+ * context of the rest of the pipeline (see halide_cuda_get_stream and
+ * halide_cuda_acquire_context), so it runs after the kernels computing
+ * the inputs without blocking the host. The inputs can't be computed
+ * inline, like the inputs of any extern stage: computing them at root
+ * with a GPU schedule keeps the whole pipeline on the device. The
+ * innermost dimension of each input must be dense. Extern stages can't
+ * be differentiated through their definitions; register the gradient
+ * instead:
+ *
+ \code
+ CudaLibraryStage mm = cublas_gemm(a, b, m, n, k);
+ Func loss = ...mm.output...;
+ PropagateAdjointsOptions options;
+ mm.register_gradient(options);
+ Derivative d = propagate_adjoints(loss, options);
+ \endcode
+ */
+struct CudaLibraryStage {
+    /** The result. */
+    Func output;
+
+    /** The adjoints of the inputs given the adjoint of output, also
+     * computed by the library. */
+    CustomGradient gradient;
+
+    /** Use gradient for output when propagating adjoints with these options. */
+    void register_gradient(PropagateAdjointsOptions &options) const {
+        options.custom_gradients[output.name()] = gradient;
+    }
+};
+
+/** The product of the m x k matrix a and the k x n matrix b, computed
+ * by cuBLAS. The matrices are float or double Funcs indexed by (column,
+ * row), from zero, and so is the result, so that the rows are dense:
+ * output(j, i) = sum(a(r, i) * b(j, r)) over r in [0, k). With
+ * transpose_a, a is indexed by (row, column) instead, i.e. it is the
+ * transpose of a k x m matrix, and so is b with transpose_b. The
+ * adjoints of a and b are the products of the adjoint of the output by
+ * the transposes of b and a. */
+CudaLibraryStage cublas_gemm(const Func &a, const Func &b, Expr m, Expr n, Expr k,
+                             bool transpose_a = false, bool transpose_b = false,
+                             const std::string &name = "cublas_gemm");
+
+/** The convolution of input by filter, computed by cuDNN. The input and
+ * the output are indexed by (x, y, channel, batch), and the filter by
+ * (x, y, input channel, output channel), from zero:
+ * output(x, y, c, n) = sum(input(x * stride + rx, y * stride + ry, rc, n) * filter(rx, ry, rc, c))
+ * over rx in [0, filter_width), ry in [0, filter_height), and rc in
+ * [0, input_channels). The convolution isn't padded: use a boundary
+ * condition on the input instead. The filter is read as a whole, and
+ * must be dense. The output is width x height x output_channels x batch,
+ * which only the gradient uses. The types may be float16, float or
+ * double; float16 is computed in float. The adjoints of the input and
+ * the filter are computed by cudnn_conv_input_gradient and
+ * cudnn_conv_filter_gradient below. */
+CudaLibraryStage cudnn_conv(const Func &input, const Func &filter,
+                            Expr width, Expr height, Expr input_channels,
+                            Expr output_channels, Expr batch,
+                            int filter_width, int filter_height, int stride = 1,
+                            const std::string &name = "cudnn_conv");
+
+/** The adjoint of the input of cudnn_conv, given the adjoint of its
+ * output and its filter. cuDNN computes all of the input the
+ * convolution read at once, so the result must be computed over
+ * [0, (width - 1) * stride + filter_width) x
+ * [0, (height - 1) * stride + filter_height) x [0, input_channels),
+ * and any range of the batch. */
+Func cudnn_conv_input_gradient(const Func &d_output, const Func &filter, Expr output_channels,
+                               int filter_width, int filter_height, int stride = 1,
+                               const std::string &name = "cudnn_conv_d_input");
+
+/** The adjoint of the filter of cudnn_conv, given the adjoint of its
+ * output, which is width x height x output_channels x batch, and its
+ * input. Any region of the filter may be computed; it must be dense. */
+Func cudnn_conv_filter_gradient(const Func &input, const Func &d_output,
+                                Expr width, Expr height, Expr batch, int stride = 1,
+                                const std::string &name = "cudnn_conv_d_filter");
+
+}  // namespace Halide
+
+#endif
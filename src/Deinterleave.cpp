@@ -326,6 +326,19 @@ private:
             return Shuffle::make({op}, indices);
         }
     }
+
+    Expr visit(const VectorReduce *op) override {
+        if (op->type.is_scalar()) {
+            return op;
+        }
+        // The lanes of the value that reduce to the lanes we want
+        // aren't a deinterleaving of the value, so let llvm do it.
+        std::vector<int> indices;
+        for (int i = 0; i < new_lanes; i++) {
+            indices.push_back(i * lane_stride + starting_lane);
+        }
+        return Shuffle::make({op}, indices);
+    }
 };
 
 Expr extract_odd_lanes(Expr e, const Scope<> &lets) {
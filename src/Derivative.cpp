@@ -3,15 +3,19 @@
 #include "BoundaryConditions.h"
 #include "DerivativeUtils.h"
 #include "Error.h"
+#include "ExprUsesVar.h"
 #include "FindCalls.h"
 #include "IREquality.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "Inline.h"
 #include "RealizationOrder.h"
 #include "Simplify.h"
 #include "Solve.h"
 #include "Substitute.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 
@@ -25,20 +29,166 @@ bool check_opname(const std::string &op_name,
            op_name == (func_name + "_f64");
 };
 
+/** Measures the time spent in the phases of the derivative
+ * construction, reported at the given debug level */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(int verbosity)
+        : verbosity(verbosity), start(std::chrono::high_resolution_clock::now()) {}
+
+    // Report the time since the previous phase, and start a new one
+    void report(const std::string &phase) {
+        auto now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> diff = now - start;
+        debug(verbosity) << "propagate_adjoints: " << phase << " took "
+                         << diff.count() << " ms\n";
+        start = now;
+    }
+
+private:
+    int verbosity;
+    std::chrono::time_point<std::chrono::high_resolution_clock> start;
+};
+
 /** Compute derivatives through reverse accumulation
  */
+namespace {
+
+// Append the conditions of the specializations of def to conditions, in
+// the order they are checked, as the conjunction of outer with them.
+// The nested specializations come before their parents. Specializations
+// that fail have no fast path to preserve.
+void flatten_specializations(const Definition &def, const Expr &outer,
+                             std::vector<Expr> &conditions) {
+    for (const Specialization &s : def.specializations()) {
+        if (!s.failure_message.empty()) {
+            continue;
+        }
+        Expr c = outer.defined() ? (outer && s.condition) : s.condition;
+        flatten_specializations(s.definition, c, conditions);
+        conditions.push_back(c);
+    }
+}
+
+bool is_scheduled(const StageSchedule &schedule) {
+    if (!schedule.splits().empty()) {
+        return true;
+    }
+    for (const Dim &d : schedule.dims()) {
+        if (d.for_type != ForType::Serial) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The last component of the name of a dimension made by a split, which
+// is qualified by the names of the dimensions it was split from.
+std::string base_name(const std::string &name) {
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(dot + 1);
+}
+
+// Replay the splits, the loop order and the loop types of the pure
+// definition of a forward Func on a stage of its adjoint, which runs
+// over the same pure vars, possibly under other names. The reduction
+// variables of the stage stay innermost, except for a vectorized
+// dimension, which moves inside them.
+void transfer_schedule(const StageSchedule &forward,
+                       const std::map<std::string, std::string> &renaming,
+                       Stage stage, const StageSchedule &schedule, bool is_update) {
+    // The pure vars are the first component of the names of the
+    // dimensions split from them.
+    auto rename = [&](const std::string &name) {
+        size_t dot = name.find('.');
+        auto it = renaming.find(name.substr(0, dot));
+        std::string first = it == renaming.end() ? name.substr(0, dot) : it->second;
+        return dot == std::string::npos ? first : first + name.substr(dot);
+    };
+
+    for (const Split &s : forward.splits()) {
+        if (s.is_split()) {
+            // RoundUp could recompute the points of an update that
+            // isn't split at its outermost level.
+            TailStrategy tail = (is_update && s.tail == TailStrategy::RoundUp) ? TailStrategy::Auto : s.tail;
+            stage.split(Var(rename(s.old_var)), Var(base_name(s.outer)), Var(base_name(s.inner)), s.factor, tail);
+        } else if (s.is_fuse()) {
+            stage.fuse(Var(rename(s.inner)), Var(rename(s.outer)), Var(base_name(s.old_var)));
+        } else if (s.is_rename()) {
+            stage.rename(Var(rename(s.old_var)), Var(base_name(s.outer)));
+        }
+    }
+
+    std::vector<VarOrRVar> order;
+    for (const Dim &d : forward.dims()) {
+        if (d.var != Var::outermost().name()) {
+            order.push_back(Var(rename(d.var)));
+        }
+    }
+    std::vector<VarOrRVar> rvars;
+    for (const Dim &d : schedule.dims()) {
+        if (d.is_rvar()) {
+            rvars.push_back(RVar(d.var));
+        }
+    }
+    if (!rvars.empty() && !order.empty() &&
+        forward.dims()[0].for_type == ForType::Vectorized) {
+        order.insert(order.begin() + 1, rvars.begin(), rvars.end());
+    }
+    if (order.size() > 1) {
+        stage.reorder(order);
+    }
+
+    for (const Dim &d : forward.dims()) {
+        Var v(rename(d.var));
+        switch (d.for_type) {
+        case ForType::Serial:
+            break;
+        case ForType::Parallel:
+            stage.parallel(v, d.parallel_policy, d.parallel_chunk);
+            break;
+        case ForType::Vectorized:
+            stage.vectorize(v);
+            break;
+        case ForType::Unrolled:
+            stage.unroll(v);
+            break;
+        case ForType::GPUBlock:
+            stage.gpu_blocks(v, d.device_api);
+            break;
+        case ForType::GPUThread:
+            stage.gpu_threads(v, d.device_api);
+            break;
+        case ForType::GPULane:
+            stage.gpu_lanes(v, d.device_api);
+            break;
+        }
+    }
+}
+
+}  // namespace
+
 class ReverseAccumulationVisitor : public IRVisitor {
 public:
     using IRVisitor::visit;
 
     void propagate_adjoints(const Func &output,
                             const Func &adjoint,
-                            const std::vector<std::pair<Expr, Expr>> &output_bounds);
+                            const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                            const PropagateAdjointsOptions &options);
 
     std::map<FuncKey, Func> get_adjoint_funcs() const {
         return adjoint_funcs;
     }
 
+    std::set<std::string> get_recomputed_funcs() const {
+        return recomputed_funcs;
+    }
+
+    std::map<FuncKey, std::vector<Expr>> get_specializations() const {
+        return adjoint_specializations;
+    }
+
 protected:
     void visit(const Cast *op);
     void visit(const Variable *op);
@@ -54,6 +204,60 @@ protected:
 
 private:
     void accumulate(const Expr &stub, const Expr &adjoint);
+    // Remember that the last update of an adjoint accumulates the
+    // contributions of the current definition, under the conditions
+    // of its specializations
+    void record_specializations(const Func &adjoint);
+    // The value of a forward expression, for the derivative rules that
+    // are functions of it
+    Expr primal(const BaseExprNode *op) const;
+
+    // The type of the adjoint of a value of the given type
+    Type adjoint_type(const Type &t) const {
+        if (accumulation_type.is_float() && t.is_float() &&
+            accumulation_type.bits() > t.bits()) {
+            return accumulation_type.with_lanes(t.lanes());
+        }
+        return t;
+    }
+
+    /** Accumulate the adjoint of a call whose remaining arguments are
+     * clamped pure variables without scattering over the whole domain.
+     * Returns false if the call doesn't have that form. */
+    bool accumulate_clamped(Func &func_to_update,
+                            int value_index,
+                            const std::vector<Expr> &lhs,
+                            const Expr &adjoint,
+                            const std::vector<bool> &canonicalized,
+                            const std::vector<Var> &current_args,
+                            const Box &current_bounds,
+                            const std::vector<Var> &new_args);
+    // Drop the Funcs and buffers that aren't on a path from the
+    // output to one of the inputs
+    void prune(std::vector<Func> &funcs, const PropagateAdjointsOptions &options);
+    // Replace the forward Funcs selected by the checkpoint policy
+    // with their definitions inside the adjoints
+    void rematerialize(const std::vector<Func> &funcs,
+                       const PropagateAdjointsOptions &options);
+    // Inline the pure adjoint stages into the adjoints reading them
+    void fuse_adjoints();
+    // Schedule the adjoints of the forward Funcs like their forward
+    // definitions
+    void transfer_schedules(const std::vector<Func> &funcs);
+    // Make the adjoints read the forward Funcs selected by the options
+    // from compressed copies
+    void compress_activations(const std::vector<Func> &funcs,
+                              const PropagateAdjointsOptions &options);
+    // Split the adjoint updates that sum a reduction domain into a few
+    // points into per-tile partial sums
+    void tile_reductions(int tile_size);
+    // Make the adjoints read the intermediate states of invertible scans
+    // from a reverse scan that reconstructs them from the final state
+    void invert_scans(const std::vector<Func> &funcs);
+    // Accumulate the adjoints returned by a user-supplied gradient of a Func
+    void propagate_custom_gradient(const std::vector<Func> &funcs,
+                                   const FuncKey &func_key,
+                                   const CustomGradient &gradient);
 
     // For each expression, we store the accumulated adjoints expression
     std::map<const BaseExprNode *, Expr> expr_adjoints;
@@ -62,8 +266,23 @@ private:
     // Let variables and their mapping
     std::map<std::string, Expr> let_var_mapping;
     std::vector<std::string> let_variables;
+    // The forward expressions of the current definition whose values
+    // are already computed, as a read of the forward Func or a Let
+    // variable
+    std::map<const BaseExprNode *, Expr> primal_values;
     // Bounds of functions
     std::map<std::string, Box> func_bounds;
+    // Forward functions recomputed in the adjoints
+    std::set<std::string> recomputed_funcs;
+    // The conditions of the specializations of the current definition,
+    // and of the definitions each update of an adjoint differentiates
+    std::vector<Expr> current_specializations;
+    std::map<FuncKey, std::vector<Expr>> adjoint_specializations;
+    // Funcs and buffers that don't get adjoints
+    std::set<std::string> pruned;
+    // The wider float type to accumulate the adjoints of narrower
+    // float values in, if any
+    Type accumulation_type;
     // Current function that scatters its adjoints to its dependencies
     Func current_func;
     // Current update of the function
@@ -84,7 +303,12 @@ private:
 void ReverseAccumulationVisitor::propagate_adjoints(
     const Func &output,
     const Func &adjoint,
-    const std::vector<std::pair<Expr, Expr>> &output_bounds) {
+    const std::vector<std::pair<Expr, Expr>> &output_bounds,
+    const PropagateAdjointsOptions &options) {
+    PhaseTimer timer(1);
+    user_assert(!options.accumulation_type.bits() || options.accumulation_type.is_float())
+        << "The accumulation type of the adjoints must be a float type\n";
+    accumulation_type = options.accumulation_type;
     // Topologically sort the functions
     std::map<std::string, Function> env = find_transitive_calls(output.function());
     std::vector<std::string> order =
@@ -100,6 +324,14 @@ void ReverseAccumulationVisitor::propagate_adjoints(
         funcs.push_back(Func(env[func_name]));
     }
     internal_assert(funcs.size() > 0);
+    timer.report("sorting " + std::to_string(funcs.size()) + " Funcs");
+
+    // The buffers are read by all the Funcs, including the pruned ones
+    std::vector<Func> all_funcs = funcs;
+    if (!options.inputs.empty() || !options.custom_gradients.empty()) {
+        prune(funcs, options);
+        timer.report("pruning to " + std::to_string(funcs.size()) + " Funcs");
+    }
 
     // If the derivatives depend on an in-place overwrite,
     // and the self reference adjoint is not 0 or 1,
@@ -234,6 +466,7 @@ void ReverseAccumulationVisitor::propagate_adjoints(
             // Gather let variables
             let_var_mapping.clear();
             let_variables.clear();
+            primal_values.clear();
             for (auto it = expr_list.begin(); it != expr_list.end(); it++) {
                 Expr expr = *it;
                 if (expr.get()->node_type == IRNodeType::Let) {
@@ -381,9 +614,12 @@ void ReverseAccumulationVisitor::propagate_adjoints(
         }
     }
     is_forward_overwrite_detection_phase = false;
+    timer.report("overwrite detection");
 
-    // Bounds inference
-    func_bounds = inference_bounds(output, output_bounds);
+    // Bounds inference. Only the regions where the adjoints can be
+    // nonzero need to be computed and stored.
+    func_bounds = inference_bounds(output, output_bounds, true);
+    timer.report("bounds inference");
 
     // Create a stub for each function and each update to accumulate adjoints.
     for (int func_id = 0; func_id < (int) funcs.size(); func_id++) {
@@ -402,15 +638,31 @@ void ReverseAccumulationVisitor::propagate_adjoints(
                 }
             }
             if (is_final_output) {
-                adjoint_func(args) = adjoint(args);
+                if (adjoint.values().size() == 1) {
+                    // Seed with the adjoint of the (scaled) loss, in
+                    // the accumulation type.
+                    Expr seed = adjoint(args);
+                    Type type = adjoint_type(seed.type());
+                    seed = cast(type, seed);
+                    if (options.loss_scale.defined()) {
+                        seed = seed * cast(type, options.loss_scale);
+                    }
+                    adjoint_func(args) = seed;
+                } else {
+                    user_assert(!options.loss_scale.defined())
+                        << "Loss scaling needs a single valued adjoint\n";
+                    adjoint_func(args) = adjoint(args);
+                }
             } else {
-                // Initialize to 0
-                if (func.values().size() == 1) {
-                    adjoint_func(args) = make_const(func.values()[0].type(), 0.0);
+                // Initialize to 0. Use the output types, which are also
+                // known for extern stages.
+                const std::vector<Type> &types = func.output_types();
+                if (types.size() == 1) {
+                    adjoint_func(args) = make_const(adjoint_type(types[0]), 0.0);
                 } else {
-                    std::vector<Expr> init(func.values().size());
+                    std::vector<Expr> init(types.size());
                     for (int i = 0; i < (int) init.size(); i++) {
-                        init[i] = make_const(func.values()[i].type(), 0.0);
+                        init[i] = make_const(adjoint_type(types[i]), 0.0);
                     }
                     adjoint_func(args) = Tuple(init);
                 }
@@ -422,8 +674,7 @@ void ReverseAccumulationVisitor::propagate_adjoints(
     }
     // Also create stubs for buffers referenced by the functions
     std::map<std::string, BufferInfo> called_buffers;
-    for (int func_id = 0; func_id < (int) funcs.size(); func_id++) {
-        const Func &func = funcs[func_id];
+    for (const Func &func : all_funcs) {
         std::map<std::string, BufferInfo> buffers = find_buffer_calls(func);
         called_buffers.insert(buffers.begin(), buffers.end());
     }
@@ -433,19 +684,38 @@ void ReverseAccumulationVisitor::propagate_adjoints(
         for (int i = 0; i < it.second.dimension; i++) {
             args.push_back(Var());
         }
-        adjoint_func(args) = make_const(it.second.type, 0.0);
+        Type type = adjoint_type(it.second.type);
+        auto accumulator = options.accumulate_into.find(it.first);
+        if (accumulator != options.accumulate_into.end()) {
+            // Start from the gradient accumulated so far, instead of
+            // adding it afterwards.
+            const Func &acc = accumulator->second;
+            user_assert(acc.dimensions() == it.second.dimension && acc.values().size() == 1)
+                << "The Func " << acc.name() << " to accumulate the gradient of "
+                << it.first << " into must have " << it.second.dimension
+                << " dimensions and a single value\n";
+            adjoint_func(args) = cast(type, acc(args));
+        } else {
+            adjoint_func(args) = make_const(type, 0.0);
+        }
         FuncKey func_key{ it.first, -1 };
+        if (pruned.find(it.first) != pruned.end()) {
+            continue;
+        }
         if (adjoint_funcs.find(func_key) != adjoint_funcs.end()) {
             user_error << "Naming conflict between buffer and function:" << it.first << "\n";
         }
         adjoint_funcs[func_key] = adjoint_func;
     }
+    timer.report("adjoint stubs");
 
     // Traverse functions from producers to consumers for reverse accumulation
     for (int func_id = funcs.size() - 1; func_id >= 0; func_id--) {
         const Func &func = funcs[func_id];
         current_func = func;
+        PhaseTimer func_timer(2);
 
+        current_specializations.clear();
         FuncKey func_key{ func.name(), func.num_update_definitions() - 1 };
         // Set up boundary condition for the last adjoint, for
         // non overwriting scans, we delay the boundary condition
@@ -456,6 +726,12 @@ void ReverseAccumulationVisitor::propagate_adjoints(
             // Save a pointer to the unbounded def. Useful for scheduling
             FuncKey unbounded_func_key{ func.name() + "_unbounded", func_key.second };
             adjoint_funcs[unbounded_func_key] = adjoint_func;
+            // The bounds of the inputs of extern stages are unknown
+            for (int i = 0; i < (int) bounds.size(); i++) {
+                if (!bounds[i].is_bounded()) {
+                    return;
+                }
+            }
             if (adjoint_func.values().size() == 1) {
                 Type type = adjoint_func.values()[0].type();
                 adjoint_func = BoundaryConditions::constant_exterior(
@@ -475,10 +751,25 @@ void ReverseAccumulationVisitor::propagate_adjoints(
             add_boundary_condition(func_key);
         }
 
+        auto custom_gradient = options.custom_gradients.find(func.name());
+        if (custom_gradient != options.custom_gradients.end()) {
+            // Splice in the user-supplied gradient instead of
+            // differentiating through the definitions of func
+            propagate_custom_gradient(funcs, func_key, custom_gradient->second);
+            func_timer.report("custom gradient of " + func.name());
+            continue;
+        }
+        user_assert(!func.function().has_extern_definition())
+            << "Can't differentiate through the extern stage " << func.name()
+            << ". Register a custom gradient for it in PropagateAdjointsOptions.\n";
+
         // Traverse from the last update to first
         for (int update_id = func.num_update_definitions() - 1;
              update_id >= -1; update_id--) {
             current_update_id = update_id;
+            current_specializations.clear();
+            flatten_specializations(update_id < 0 ? func.function().definition() : func.function().update(update_id),
+                                    Expr(), current_specializations);
             FuncKey func_key{ func.name(), update_id };
             Func adjoint_func = adjoint_funcs[func_key];
             internal_assert(func_bounds.find(func.name()) != func_bounds.end());
@@ -531,12 +822,12 @@ void ReverseAccumulationVisitor::propagate_adjoints(
                         adjoint_funcs[func_key](prev_args);
                 }
                 if (func.values().size() == 1) {
-                    Type type = func.values()[0].type();
+                    Type type = adjoint_type(func.values()[0].type());
                     prev_adjoint_func(update_args) = make_const(type, 0.0);
                 } else {
                     std::vector<Expr> init(func.values().size());
                     for (int i = 0; i < (int) init.size(); i++) {
-                        init[i] = make_const(func.values()[i].type(), 0.0);
+                        init[i] = make_const(adjoint_type(func.values()[i].type()), 0.0);
                     }
                     prev_adjoint_func(update_args) = Tuple(init);
                 }
@@ -566,6 +857,7 @@ void ReverseAccumulationVisitor::propagate_adjoints(
             // Gather let variables
             let_var_mapping.clear();
             let_variables.clear();
+            primal_values.clear();
             for (auto it = expr_list.begin(); it != expr_list.end(); it++) {
                 Expr expr = *it;
                 if (expr.get()->node_type == IRNodeType::Let) {
@@ -574,6 +866,21 @@ void ReverseAccumulationVisitor::propagate_adjoints(
                     assert(let_var_mapping.find(op->name) == let_var_mapping.end());
                     let_var_mapping[op->name] = op->value;
                     let_variables.push_back(op->name);
+                    primal_values[(const BaseExprNode *) op->value.get()] =
+                        Variable::make(op->value.type(), op->name);
+                }
+            }
+            // The values of a pure Func are the ones it stores, which the
+            // adjoints can read back instead of recomputing them. Later
+            // updates would overwrite them.
+            if (update_id < 0 && func.num_update_definitions() == 0) {
+                std::vector<Expr> pure_args;
+                for (const auto &var : func.args()) {
+                    pure_args.push_back(var);
+                }
+                for (int i = 0; i < (int) output_exprs.size(); i++) {
+                    primal_values[output_exprs[i]] =
+                        Call::make(func.function(), pure_args, i);
                 }
             }
 
@@ -655,6 +962,766 @@ void ReverseAccumulationVisitor::propagate_adjoints(
                 }
             }
         }
+        func_timer.report("adjoints of " + func.name());
+    }
+    timer.report("reverse accumulation");
+
+    if (options.invert_scans) {
+        invert_scans(funcs);
+        timer.report("scan inversion");
+    }
+    if (options.checkpoint_policy != CheckpointPolicy::StoreAll) {
+        rematerialize(funcs, options);
+        timer.report("rematerialization");
+    }
+    if (options.reduction_tile_size > 0) {
+        tile_reductions(options.reduction_tile_size);
+        timer.report("reduction tiling");
+    }
+    if (options.fuse_adjoints) {
+        fuse_adjoints();
+        timer.report("adjoint fusion");
+    }
+    if (!options.compressed_activations.empty()) {
+        compress_activations(funcs, options);
+        timer.report("activation compression");
+    }
+    if (options.transfer_schedules) {
+        transfer_schedules(funcs);
+        timer.report("schedule transfer");
+    }
+    // The adjoints of buffers started from their accumulators. Add
+    // the accumulators of Funcs to their final adjoints.
+    for (const auto &it : options.accumulate_into) {
+        auto adjoint = adjoint_funcs.find(FuncKey{ it.first, -1 });
+        user_assert(adjoint != adjoint_funcs.end())
+            << "Can't accumulate the gradient of " << it.first
+            << ", which the output doesn't depend on\n";
+        if (called_buffers.count(it.first)) {
+            continue;
+        }
+        Func gradient = adjoint->second;
+        const Func &acc = it.second;
+        user_assert(acc.dimensions() == gradient.dimensions() &&
+                    acc.values().size() == 1 && gradient.values().size() == 1)
+            << "The Func " << acc.name() << " to accumulate the gradient of "
+            << it.first << " into must have " << gradient.dimensions()
+            << " dimensions and a single value\n";
+        std::vector<Var> args = gradient.args();
+        Func accumulated(gradient.name() + "_accumulated");
+        accumulated(args) = cast(gradient.value().type(), acc(args)) + gradient(args);
+        adjoint->second = accumulated;
+    }
+}
+
+void ReverseAccumulationVisitor::prune(std::vector<Func> &funcs,
+                                       const PropagateAdjointsOptions &options) {
+    // A Func with a custom gradient passes its adjoint straight to the
+    // Funcs and buffers its gradient returns, so the Funcs it reads on
+    // the way to them (e.g. the stages of an FFT) never receive any
+    // adjoint. Find the Funcs and buffers reachable from the output
+    // without going through them, walking from the consumers to the
+    // producers. The custom gradients are called once on a zero
+    // adjoint to learn what they return.
+    std::set<std::string> reachable{ funcs.back().name() };
+    std::set<std::string> buffers;
+    for (auto it = funcs.rbegin(); it != funcs.rend(); it++) {
+        const Func &func = *it;
+        std::map<std::string, BufferInfo> buffer_calls = find_buffer_calls(func);
+        for (const auto &b : buffer_calls) {
+            buffers.insert(b.first);
+        }
+        if (reachable.find(func.name()) == reachable.end()) {
+            continue;
+        }
+        auto custom_gradient = options.custom_gradients.find(func.name());
+        if (custom_gradient != options.custom_gradients.end()) {
+            std::vector<Var> args(func.dimensions());
+            const std::vector<Type> &types = func.output_types();
+            std::vector<Expr> zeros(types.size());
+            for (int i = 0; i < (int) zeros.size(); i++) {
+                zeros[i] = make_const(adjoint_type(types[i]), 0.0);
+            }
+            Func probe(func.name() + "_probe_d__");
+            probe(args) = Tuple(zeros);
+            for (const auto &c : custom_gradient->second(probe)) {
+                reachable.insert(c.first);
+            }
+        } else {
+            for (const auto &c : find_direct_calls(func.function())) {
+                reachable.insert(c.first);
+            }
+            for (const auto &b : buffer_calls) {
+                reachable.insert(b.first);
+            }
+        }
+    }
+
+    // The adjoints of the inputs only depend on the adjoints of the
+    // Funcs that read them, directly or through other Funcs, so these
+    // are the only ones worth differentiating. Walk from the producers
+    // to the consumers to find them.
+    const std::set<std::string> &inputs = options.inputs;
+    std::set<std::string> needed;
+    for (const Func &func : funcs) {
+        if (reachable.find(func.name()) == reachable.end()) {
+            continue;
+        }
+        bool is_needed = inputs.empty() || inputs.find(func.name()) != inputs.end();
+        auto custom_gradient = options.custom_gradients.find(func.name());
+        if (custom_gradient != options.custom_gradients.end()) {
+            // Conservatively, as the probe above didn't record which
+            // Funcs this one sends adjoints to
+            is_needed = true;
+        }
+        for (const auto &it : find_direct_calls(func.function())) {
+            is_needed |= needed.find(it.first) != needed.end();
+        }
+        for (const auto &it : find_buffer_calls(func)) {
+            is_needed |= inputs.find(it.first) != inputs.end();
+        }
+        if (is_needed) {
+            needed.insert(func.name());
+        }
+    }
+    for (const auto &input : inputs) {
+        user_assert(needed.find(input) != needed.end() ||
+                    buffers.find(input) != buffers.end())
+            << "Can't take the gradients with respect to " << input
+            << ", which is not a Func or buffer of the pipeline.\n";
+    }
+    // Keep the output, which holds the seed, even if it doesn't
+    // depend on the inputs
+    needed.insert(funcs.back().name());
+    std::vector<Func> kept;
+    for (const Func &func : funcs) {
+        if (needed.find(func.name()) != needed.end()) {
+            kept.push_back(func);
+        } else {
+            debug(1) << "Pruning " << func.name() << " from the adjoints\n";
+            pruned.insert(func.name());
+        }
+    }
+    for (const auto &buffer : buffers) {
+        if (reachable.find(buffer) == reachable.end() ||
+            (!inputs.empty() && inputs.find(buffer) == inputs.end())) {
+            pruned.insert(buffer);
+        }
+    }
+    funcs.swap(kept);
+}
+
+void ReverseAccumulationVisitor::rematerialize(
+    const std::vector<Func> &funcs,
+    const PropagateAdjointsOptions &options) {
+    // Only pure, unscheduled Funcs can be substituted into the adjoints.
+    // The final output is always realized, so there's no point in
+    // recomputing it.
+    auto can_recompute = [&](const Func &func) {
+        const Function &f = func.function();
+        return f.can_be_inlined() &&
+               f.schedule().compute_level().is_inlined() &&
+               f.schedule().store_level().is_inlined() &&
+               !f.schedule().memoized() &&
+               func.name() != funcs.back().name();
+    };
+
+    std::vector<Func> to_recompute;
+    if (options.checkpoint_policy == CheckpointPolicy::RecomputeMarked) {
+        for (const auto &func : funcs) {
+            if (options.recompute.find(func.name()) == options.recompute.end()) {
+                continue;
+            }
+            if (!can_recompute(func)) {
+                user_warning << "Can't recompute " << func.name()
+                             << " in the adjoints since it is not a pure, "
+                             << "unscheduled Func. Storing it instead.\n";
+                continue;
+            }
+            to_recompute.push_back(func);
+        }
+    } else {
+        internal_assert(options.checkpoint_policy == CheckpointPolicy::MemoryBudget);
+        // Estimate the footprint of the forward Funcs from their bounds.
+        // Funcs with non-constant bounds can't be measured, and are stored.
+        std::vector<std::pair<int64_t, Func>> footprints;
+        int64_t total = 0;
+        for (const auto &func : funcs) {
+            const Box &box = func_bounds[func.name()];
+            int64_t bytes = 0;
+            for (const auto &type : func.output_types()) {
+                bytes += type.bytes();
+            }
+            bool known = true;
+            for (int i = 0; i < (int) box.size() && known; i++) {
+                Expr extent = simplify(box[i].max - box[i].min + 1);
+                const int64_t *extent_int = as_const_int(extent);
+                if (extent_int == nullptr) {
+                    known = false;
+                } else {
+                    bytes *= std::max(*extent_int, (int64_t) 1);
+                }
+            }
+            if (!known) {
+                continue;
+            }
+            total += bytes;
+            if (can_recompute(func)) {
+                footprints.emplace_back(bytes, func);
+            }
+        }
+        // Recompute the largest Funcs first
+        std::stable_sort(footprints.begin(), footprints.end(),
+                         [](const std::pair<int64_t, Func> &a,
+                            const std::pair<int64_t, Func> &b) {
+                             return a.first > b.first;
+                         });
+        for (const auto &it : footprints) {
+            if (total <= options.memory_budget) {
+                break;
+            }
+            total -= it.first;
+            to_recompute.push_back(it.second);
+        }
+        debug(1) << "Estimated footprint of the stored forward Funcs: " << total << " bytes\n";
+    }
+
+    // Inline from consumers to producers, so that a recomputed Func calling
+    // another recomputed Func gets expanded all the way.
+    std::sort(to_recompute.begin(), to_recompute.end(),
+              [&](const Func &a, const Func &b) {
+                  auto index = [&](const Func &f) {
+                      for (int i = 0; i < (int) funcs.size(); i++) {
+                          if (funcs[i].name() == f.name()) {
+                              return i;
+                          }
+                      }
+                      return -1;
+                  };
+                  return index(a) > index(b);
+              });
+    for (const auto &func : to_recompute) {
+        debug(1) << "Recomputing " << func.name() << " in the adjoints\n";
+        for (auto &it : adjoint_funcs) {
+            inline_function(it.second.function(), func.function());
+        }
+        recomputed_funcs.insert(func.name());
+    }
+}
+
+namespace {
+
+// Count the calls to a Func in an Expr
+class CountCalls : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+    void visit(const Call *op) override {
+        IRGraphVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == name) {
+            count++;
+            args = op->args;
+        }
+    }
+
+public:
+    std::string name;
+    int count = 0;
+    std::vector<Expr> args;
+    CountCalls(const std::string &name) : name(name) {}
+};
+
+// Given that y == e, where e uses the variable var once, solve for var,
+// going through the float arithmetic that can be undone exactly enough
+// to replay a scan backwards. Returns an undefined Expr on failure.
+Expr invert_expr(const Expr &e, const std::string &var, const Expr &y) {
+    if (const Variable *v = e.as<Variable>()) {
+        return v->name == var ? y : Expr();
+    }
+    if (!e.type().is_float()) {
+        return Expr();
+    }
+    if (const Add *op = e.as<Add>()) {
+        if (expr_uses_var(op->a, var)) {
+            return expr_uses_var(op->b, var) ? Expr() : invert_expr(op->a, var, y - op->b);
+        }
+        return invert_expr(op->b, var, y - op->a);
+    } else if (const Sub *op = e.as<Sub>()) {
+        if (expr_uses_var(op->a, var)) {
+            return expr_uses_var(op->b, var) ? Expr() : invert_expr(op->a, var, y + op->b);
+        }
+        return invert_expr(op->b, var, op->a - y);
+    } else if (const Mul *op = e.as<Mul>()) {
+        if (expr_uses_var(op->a, var)) {
+            return expr_uses_var(op->b, var) ? Expr() : invert_expr(op->a, var, y / op->b);
+        }
+        return invert_expr(op->b, var, y / op->a);
+    } else if (const Div *op = e.as<Div>()) {
+        if (expr_uses_var(op->a, var)) {
+            return expr_uses_var(op->b, var) ? Expr() : invert_expr(op->a, var, y * op->b);
+        }
+        return invert_expr(op->b, var, op->a / y);
+    } else if (const Call *op = e.as<Call>()) {
+        if (check_opname(op->name, "exp")) {
+            return invert_expr(op->args[0], var, log(y));
+        } else if (check_opname(op->name, "log")) {
+            return invert_expr(op->args[0], var, exp(y));
+        }
+    }
+    return Expr();
+}
+
+}  // namespace
+
+void ReverseAccumulationVisitor::invert_scans(const std::vector<Func> &funcs) {
+    // Look for scans of the form
+    //   f(x, r + k) = g(f(x, r + k - 1), ...)
+    // where g can be inverted in its first argument. Instead of reading
+    // every intermediate state of f, which forces the forward pass to
+    // keep the whole history for the backward pass, the adjoints read
+    //   f_rec(x, t) = f(x, T)
+    //   f_rec(x, t - 1) = g^-1(f_rec(x, t), ...) for t from T down
+    // which only depends on the final state f(x, T), and walks the
+    // scan in the same order as its adjoint does, so the two can be
+    // scheduled together.
+    std::map<FunctionPtr, FunctionPtr> substitutions;
+    for (const Func &func : funcs) {
+        if (func.name() == funcs.back().name() ||
+            func.num_update_definitions() != 1 ||
+            func.values().size() != 1 ||
+            !func.value().type().is_float()) {
+            continue;
+        }
+        const std::vector<Expr> &update_args = func.update_args(0);
+        const std::vector<Var> pure_args = func.args();
+        Expr value = func.update_value(0);
+        ReductionDomain rdom = extract_rdom(func.update_value(0));
+        for (const auto &arg : update_args) {
+            if (!rdom.defined()) {
+                rdom = extract_rdom(arg);
+            }
+        }
+        if (!rdom.defined() || rdom.domain().size() != 1 || !is_one(simplify(rdom.predicate()))) {
+            continue;
+        }
+        const ReductionVariable &rv = rdom.domain()[0];
+        const int64_t *rmin = as_const_int(simplify(rv.min));
+        const int64_t *rextent = as_const_int(simplify(rv.extent));
+        if (!rmin || !rextent || *rextent <= 0) {
+            continue;
+        }
+
+        // All update args but one must be the pure vars, and that one r + k
+        int scan_dim = -1;
+        int64_t offset = 0;
+        bool ok = true;
+        for (int i = 0; i < (int) update_args.size() && ok; i++) {
+            if (equal(update_args[i], pure_args[i])) {
+                continue;
+            }
+            Expr k = simplify(update_args[i] - Variable::make(Int(32), rv.var, rdom));
+            const int64_t *k_int = as_const_int(k);
+            if (scan_dim != -1 || !k_int) {
+                ok = false;
+            } else {
+                scan_dim = i;
+                offset = *k_int;
+            }
+        }
+        if (!ok || scan_dim == -1) {
+            continue;
+        }
+
+        // There must be one self reference, to the previous state
+        CountCalls self_calls(func.name());
+        value.accept(&self_calls);
+        if (self_calls.count != 1) {
+            continue;
+        }
+        for (int i = 0; i < (int) update_args.size() && ok; i++) {
+            Expr expected = (i == scan_dim) ? simplify(update_args[i] - 1) : update_args[i];
+            ok = equal(simplify(self_calls.args[i]), expected);
+        }
+        if (!ok) {
+            continue;
+        }
+
+        // Invert g
+        std::string prev_name = unique_name("scan_prev");
+        std::string next_name = unique_name("scan_next");
+        Type t = func.value().type();
+        Expr prev_var = Variable::make(t, prev_name);
+        Expr next_var = Variable::make(t, next_name);
+        Expr g = substitute(Call::make(func.function(), self_calls.args, 0), prev_var, value);
+        g = substitute_in_all_lets(g);
+        Expr inverse = invert_expr(g, prev_name, next_var);
+        if (!inverse.defined()) {
+            debug(1) << "Can't invert the scan " << func.name() << "\n";
+            continue;
+        }
+
+        // Build the reverse scan
+        int64_t last = *rmin + *rextent - 1 + offset;
+        int64_t first = *rmin + offset - 1;
+        Func rec(func.name() + "_reconstructed");
+        std::vector<Expr> final_args(pure_args.begin(), pure_args.end());
+        final_args[scan_dim] = Expr((int) last);
+        Var t_var = pure_args[scan_dim];
+        Expr outside = t_var < Expr((int) first) || t_var > Expr((int) last);
+        rec(pure_args) = select(outside, func.value(), func(final_args));
+
+        RDom rr(0, (int) *rextent);
+        Expr written = Expr((int) last) - rr;
+        std::vector<Expr> next_args(pure_args.begin(), pure_args.end());
+        next_args[scan_dim] = written;
+        std::vector<Expr> prev_args = next_args;
+        prev_args[scan_dim] = written - 1;
+        Expr r_value = written - Expr((int) offset);
+        Expr step = substitute(next_name, rec(next_args), inverse);
+        step = substitute(rv.var, r_value, step);
+        rec(prev_args) = step;
+
+        debug(1) << "Reconstructing the states of the scan " << func.name()
+                 << " in reverse in the adjoints\n";
+        adjoint_funcs[FuncKey{ rec.name(), -1 }] = rec;
+        substitutions[func.function().get_contents()] = rec.function().get_contents();
+    }
+    if (substitutions.empty()) {
+        return;
+    }
+    for (auto &it : adjoint_funcs) {
+        bool is_reconstruction = false;
+        for (const auto &s : substitutions) {
+            is_reconstruction |= it.second.function().get_contents().same_as(s.second);
+        }
+        if (!is_reconstruction) {
+            it.second.function().substitute_calls(substitutions);
+        }
+    }
+}
+
+void ReverseAccumulationVisitor::propagate_custom_gradient(
+    const std::vector<Func> &funcs,
+    const FuncKey &func_key,
+    const CustomGradient &gradient) {
+    const std::string &func_name = func_key.first;
+    std::map<std::string, Func> contributions = gradient(adjoint_funcs[func_key]);
+    for (const auto &it : contributions) {
+        if (pruned.find(it.first) != pruned.end()) {
+            continue;
+        }
+        // Adjoints of Funcs are accumulated to their last update,
+        // adjoints of buffers to their only stub
+        FuncKey target_key{ it.first, -1 };
+        for (const auto &f : funcs) {
+            if (f.name() == it.first) {
+                target_key.second = f.num_update_definitions() - 1;
+            }
+        }
+        auto target = adjoint_funcs.find(target_key);
+        user_assert(target != adjoint_funcs.end())
+            << "The custom gradient of " << func_name << " returns an adjoint for "
+            << it.first << ", which is not a Func or buffer of the pipeline.\n";
+        Func &adjoint_func = target->second;
+        const Func &contribution = it.second;
+        user_assert(contribution.dimensions() == adjoint_func.dimensions() &&
+                    contribution.output_types() == adjoint_func.output_types())
+            << "The adjoint of " << it.first << " returned by the custom gradient of "
+            << func_name << " has the wrong dimensions or types.\n";
+        std::vector<Var> args = adjoint_func.args();
+        if (adjoint_func.outputs() == 1) {
+            adjoint_func(args) += contribution(args);
+        } else {
+            std::vector<Expr> values(adjoint_func.outputs());
+            for (int i = 0; i < (int) values.size(); i++) {
+                values[i] = adjoint_func(args)[i] + contribution(args)[i];
+            }
+            adjoint_func(args) = Tuple(values);
+        }
+    }
+}
+
+void ReverseAccumulationVisitor::compress_activations(
+    const std::vector<Func> &funcs,
+    const PropagateAdjointsOptions &options) {
+    std::map<FunctionPtr, FunctionPtr> substitutions;
+    std::set<std::string> helpers;
+    for (const auto &it : options.compressed_activations) {
+        const Func *found = nullptr;
+        for (const auto &f : funcs) {
+            if (f.name() == it.first) {
+                found = &f;
+            }
+        }
+        user_assert(found != nullptr)
+            << "Can't compress " << it.first << ", which is not a Func of the pipeline.\n";
+        const Func &func = *found;
+        if (recomputed_funcs.count(func.name())) {
+            user_warning << "Not compressing " << func.name()
+                         << " since the adjoints recompute it.\n";
+            continue;
+        }
+        user_assert(!func.function().has_extern_definition() &&
+                    func.num_update_definitions() == 0 &&
+                    func.outputs() == 1 && func.output_types()[0].is_float())
+            << "Can't compress " << func.name()
+            << ", which is not a pure single-valued float Func.\n";
+        ActivationCompression format = it.second;
+        user_assert(func.dimensions() > 0 ||
+                    format == ActivationCompression::Float16 ||
+                    format == ActivationCompression::BFloat16)
+            << "Can't compress the scalar " << func.name()
+            << " in blocks along its innermost dimension.\n";
+
+        Type t = func.output_types()[0];
+        std::vector<Var> args(func.dimensions());
+        std::vector<Expr> call_args(args.begin(), args.end());
+        Func compressed(func.name() + "_compressed");
+        Func decompressed(func.name() + "_decompressed");
+        // The arguments of the block of the innermost dimension at x
+        auto block_args = [&](const Expr &x) {
+            std::vector<Expr> result = call_args;
+            result[0] = x;
+            return result;
+        };
+        switch (format) {
+        case ActivationCompression::Float16:
+        case ActivationCompression::BFloat16: {
+            Type narrow = format == ActivationCompression::Float16 ? Float(16) : BFloat(16);
+            compressed(args) = cast(narrow, func(args));
+            decompressed(args) = cast(t, compressed(args));
+            break;
+        }
+        case ActivationCompression::Int8Block: {
+            int block = options.activation_block_size;
+            user_assert(block > 0) << "The activation block size must be positive.\n";
+            RDom r(0, block);
+            Func scales(func.name() + "_compressed_scales");
+            scales(args) = make_const(t, 0.0);
+            scales(args) = max(scales(args), abs(func(block_args(args[0] * block + r))));
+            Expr scale = scales(block_args(args[0] / block)) / make_const(t, 127.0);
+            Expr q = select(scale > 0, round(func(args) / scale), make_const(t, 0.0));
+            compressed(args) = cast<int8_t>(clamp(q, -127, 127));
+            decompressed(args) = cast(t, compressed(args)) * scale;
+            adjoint_funcs[FuncKey{ scales.name(), -1 }] = scales;
+            helpers.insert(scales.name());
+            break;
+        }
+        case ActivationCompression::SignMask: {
+            Expr bits = make_const(UInt(8), 0);
+            for (int i = 0; i < 8; i++) {
+                bits = bits | select(func(block_args(args[0] * 8 + i)) > 0,
+                                     make_const(UInt(8), 1 << i),
+                                     make_const(UInt(8), 0));
+            }
+            compressed(args) = bits;
+            Expr bit = (compressed(block_args(args[0] >> 3)) >>
+                        cast<uint8_t>(args[0] & 7)) & make_const(UInt(8), 1);
+            decompressed(args) = select(bit != 0, make_const(t, 1.0), make_const(t, -1.0));
+            break;
+        }
+        }
+        debug(1) << "Compressing " << func.name() << " for the adjoints\n";
+        adjoint_funcs[FuncKey{ compressed.name(), -1 }] = compressed;
+        helpers.insert(compressed.name());
+        helpers.insert(decompressed.name());
+        substitutions[func.function().get_contents()] = decompressed.function().get_contents();
+    }
+    if (substitutions.empty()) {
+        return;
+    }
+
+    // Substitute the calls in every Function of the backward pass,
+    // including the ones the adjoints are wrapped around
+    std::set<std::string> forward;
+    for (const auto &f : funcs) {
+        forward.insert(f.name());
+    }
+    std::map<std::string, Function> env;
+    for (const auto &it : adjoint_funcs) {
+        std::map<std::string, Function> calls = find_transitive_calls(it.second.function());
+        env.insert(calls.begin(), calls.end());
+    }
+    for (auto &it : env) {
+        if (!forward.count(it.first) && !helpers.count(it.first)) {
+            it.second.substitute_calls(substitutions);
+        }
+    }
+}
+
+void ReverseAccumulationVisitor::fuse_adjoints() {
+    // Pure adjoint stages (boundary condition wrappers, copies between
+    // updates, zero adjoints that never receive anything) are inlined into
+    // the adjoints reading them, so a scheduler that realizes every Func in
+    // the backward pipeline doesn't allocate them. Common subexpressions
+    // across the fused definitions are shared by lowering afterwards.
+    std::set<std::string> adjoint_names;
+    for (const auto &it : adjoint_funcs) {
+        adjoint_names.insert(it.second.name());
+    }
+    auto can_fuse = [&](const Function &f) {
+        return adjoint_names.find(f.name()) != adjoint_names.end() &&
+               f.can_be_inlined() &&
+               f.schedule().compute_level().is_inlined() &&
+               f.schedule().store_level().is_inlined();
+    };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // Every Function reachable from the adjoints, including
+        // the helper Funcs introduced during propagation
+        std::map<std::string, Function> env;
+        for (const auto &it : adjoint_funcs) {
+            std::map<std::string, Function> calls =
+                find_transitive_calls(it.second.function());
+            env.insert(calls.begin(), calls.end());
+        }
+        for (auto &it : env) {
+            Function caller = it.second;
+            for (const auto &callee : find_direct_calls(caller)) {
+                if (callee.first != caller.name() && can_fuse(callee.second)) {
+                    debug(1) << "Fusing adjoint " << callee.first
+                             << " into " << caller.name() << "\n";
+                    inline_function(caller, callee.second);
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+void ReverseAccumulationVisitor::transfer_schedules(const std::vector<Func> &funcs) {
+    // The adjoints of a Func are defined over its pure vars, so each of
+    // their stages that writes to a point of them, rather than
+    // scattering, can be split, ordered and mapped to loops like the
+    // Func. The stages already scheduled, e.g. tiled reductions, and the
+    // ones that scatter keep their schedules.
+    std::set<std::string> seen;
+    for (const Func &func : funcs) {
+        const Function &forward = func.function();
+        if (forward.has_extern_definition() || !forward.has_pure_definition() ||
+            !is_scheduled(forward.definition().schedule())) {
+            continue;
+        }
+        for (int update_id = -1; update_id < func.num_update_definitions(); update_id++) {
+            auto it = adjoint_funcs.find(FuncKey{ func.name(), update_id });
+            if (it == adjoint_funcs.end() || !seen.insert(it->second.name()).second) {
+                continue;
+            }
+            Func adjoint = it->second;
+            if (adjoint.function().has_extern_definition() || adjoint.dimensions() != func.dimensions()) {
+                continue;
+            }
+            std::map<std::string, std::string> renaming;
+            std::vector<Var> args = adjoint.args();
+            for (int i = 0; i < (int) args.size(); i++) {
+                renaming[forward.args()[i]] = args[i].name();
+            }
+
+            debug(1) << "Scheduling " << adjoint.name() << " like " << func.name() << "\n";
+            Function function = adjoint.function();
+            if (!is_scheduled(function.definition().schedule())) {
+                transfer_schedule(forward.definition().schedule(), renaming,
+                                  adjoint, function.definition().schedule(), false);
+            }
+            for (int i = 0; i < adjoint.num_update_definitions(); i++) {
+                const Definition &def = function.update(i);
+                bool pure_args = true;
+                for (int j = 0; j < (int) args.size(); j++) {
+                    const Variable *v = def.args()[j].as<Variable>();
+                    pure_args &= (v != nullptr && v->name == args[j].name());
+                }
+                if (pure_args && !is_scheduled(def.schedule())) {
+                    transfer_schedule(forward.definition().schedule(), renaming,
+                                      adjoint.update(i), def.schedule(), true);
+                }
+            }
+        }
+    }
+}
+
+void ReverseAccumulationVisitor::tile_reductions(int tile_size) {
+    // The adjoint of a Func or buffer read at a few points all over a
+    // reduction domain, e.g. a small weight buffer, or a scalar, is a
+    // reduction of the whole domain into these points, which can't be
+    // parallelized. Split the outermost reduction variable of these
+    // updates into tiles, and rfactor them into partial sums over each
+    // tile, computed in parallel, followed by a serial sum of the tiles.
+    std::vector<std::pair<FuncKey, Func>> adjoints;
+    std::set<std::string> seen;
+    for (const auto &it : adjoint_funcs) {
+        if (seen.insert(it.second.name()).second) {
+            adjoints.push_back(it);
+        }
+    }
+    for (auto &it : adjoints) {
+        Func &func = it.second;
+        if (func.values().size() != 1) {
+            continue;
+        }
+        for (int update_id = 0; update_id < func.num_update_definitions(); update_id++) {
+            const Definition &def = func.function().update(update_id);
+            const std::vector<ReductionVariable> &rvars = def.schedule().rvars();
+            if (rvars.empty() || !is_one(def.predicate())) {
+                continue;
+            }
+            // The update must sum into points that don't depend on the
+            // reduction domain.
+            bool scatters = false;
+            for (const auto &arg : def.args()) {
+                for (const auto &rv : rvars) {
+                    scatters |= expr_uses_var(arg, rv.var);
+                }
+            }
+            const Add *add = def.values()[0].as<Add>();
+            const Call *self = nullptr;
+            if (add != nullptr) {
+                self = add->a.as<Call>();
+                if (self == nullptr || self->name != func.name()) {
+                    self = add->b.as<Call>();
+                }
+            }
+            if (scatters || self == nullptr || self->name != func.name()) {
+                continue;
+            }
+            bool accumulates = true;
+            for (int i = 0; i < (int) def.args().size(); i++) {
+                accumulates &= equal(self->args[i], def.args()[i]);
+            }
+            const int64_t *extent = as_const_int(rvars.back().extent);
+            if (!accumulates || (extent != nullptr && *extent <= tile_size)) {
+                continue;
+            }
+
+            debug(1) << "Tiling the reduction of update " << update_id
+                     << " of " << func.name() << "\n";
+            RVar r = func.rvars(update_id).back();
+            RVar r_tile(r.name() + "_tile"), r_inner(r.name() + "_in_tile");
+            Var tile(unique_name("tile"));
+            Func partial = func.update(update_id)
+                               .split(r, r_tile, r_inner, tile_size)
+                               .rfactor(r_tile, tile);
+            partial.compute_root().parallel(tile);
+            partial.update().parallel(tile);
+            adjoint_funcs[FuncKey{ it.first.first + "_partial", update_id }] = partial;
+        }
+    }
+}
+
+void ReverseAccumulationVisitor::record_specializations(const Func &adjoint) {
+    // The pure definitions of the adjoints stay unspecialized, so that
+    // they can still be inlined.
+    if (current_specializations.empty() || adjoint.num_update_definitions() == 0) {
+        return;
+    }
+    std::vector<Expr> &conditions =
+        adjoint_specializations[FuncKey{ adjoint.name(), adjoint.num_update_definitions() - 1 }];
+    for (const Expr &c : current_specializations) {
+        bool found = false;
+        for (const Expr &existing : conditions) {
+            found |= equal(c, existing);
+        }
+        if (!found) {
+            conditions.push_back(c);
+        }
     }
 }
 
@@ -667,15 +1734,26 @@ void ReverseAccumulationVisitor::accumulate(const Expr &stub, const Expr &adjoin
     }
 }
 
+Expr ReverseAccumulationVisitor::primal(const BaseExprNode *op) const {
+    auto it = primal_values.find(op);
+    if (it != primal_values.end()) {
+        return it->second;
+    }
+    return Expr(op);
+}
+
 void ReverseAccumulationVisitor::visit(const Cast *op) {
     assert(expr_adjoints.find(op) != expr_adjoints.end());
     Expr adjoint = expr_adjoints[op];
 
-    // d/dx cast(x) = 1.f if op->type is float otherwise 0
-    if (op->type.is_float()) {
-        accumulate(op->value, make_const(op->type, 1.0));
+    // d/dx cast(x) = 1 between float types, otherwise 0. The adjoint
+    // takes the type of the value, unless it's accumulated in a wider
+    // type, so that the casts in a mixed precision pipeline don't
+    // narrow the adjoints.
+    if (op->type.is_float() && op->value.type().is_float()) {
+        accumulate(op->value, cast(adjoint_type(op->value.type()), adjoint));
     } else {
-        accumulate(op->value, make_const(op->type, 0));
+        accumulate(op->value, make_const(op->value.type(), 0));
     }
 }
 
@@ -727,7 +1805,11 @@ void ReverseAccumulationVisitor::visit(const Div *op) {
     // d/da a / b = 1 / b
     accumulate(op->a, adjoint / op->b);
     // d/db a / b = - a / b^2
-    accumulate(op->b, -adjoint * op->a / (op->b * op->b));
+    if (op->type.is_float()) {
+        accumulate(op->b, -adjoint * primal(op) / op->b);
+    } else {
+        accumulate(op->b, -adjoint * op->a / (op->b * op->b));
+    }
 }
 
 void ReverseAccumulationVisitor::visit(const Min *op) {
@@ -773,6 +1855,218 @@ void ReverseAccumulationVisitor::visit(const Select *op) {
                select(op->condition, make_const(adjoint.type(), 0.0), adjoint));
 }
 
+namespace {
+
+// Match clamp(v, lo, hi), i.e. max(min(v, hi), lo), where v is a pure
+// variable, possibly wrapped in likely() as the boundary conditions do.
+bool match_clamped_var(const Expr &e, std::string &var, Expr &lo, Expr &hi) {
+    const Max *mx = e.as<Max>();
+    const Min *mn = mx ? mx->a.as<Min>() : nullptr;
+    if (mn == nullptr) {
+        return false;
+    }
+    Expr v = mn->a;
+    if (const Call *c = v.as<Call>()) {
+        if (c->is_intrinsic(Call::likely)) {
+            v = c->args[0];
+        }
+    }
+    const Variable *v_op = v.as<Variable>();
+    if (v_op == nullptr || v_op->reduction_domain.defined() || v_op->param.defined()) {
+        return false;
+    }
+    var = v_op->name;
+    lo = mx->b;
+    hi = mn->b;
+    return true;
+}
+
+// Add value to the given Tuple component of the pure definition of func.
+void add_to_pure_definition(Func &func, int value_index, const Expr &value) {
+    std::vector<Expr> &values = func.function().definition().values();
+    values[value_index] = simplify(values[value_index] + value);
+}
+
+// The reduction domain of an update of func, which may only appear on
+// the left hand side, as in a scatter of a constant.
+ReductionDomain extract_update_rdom(const Func &func, int update_id) {
+    ReductionDomain rdom;
+    for (const Expr &e : func.update_args(update_id)) {
+        if (!rdom.defined()) {
+            rdom = extract_rdom(e);
+        }
+    }
+    for (const Expr &e : func.update_values(update_id).as_vector()) {
+        if (!rdom.defined()) {
+            rdom = extract_rdom(e);
+        }
+    }
+    return rdom;
+}
+
+// Refer to the variables of the reduction domain to instead of the ones
+// of from in e.
+Expr rename_rvars(const RDom &from, const ReductionDomain &to, Expr e) {
+    for (int i = 0; i < from.dimensions(); i++) {
+        e = substitute(from[i].name(), RVar(to, i), e);
+    }
+    return e;
+}
+
+}  // namespace
+
+bool ReverseAccumulationVisitor::accumulate_clamped(Func &func_to_update,
+                                                    int value_index,
+                                                    const std::vector<Expr> &lhs,
+                                                    const Expr &adjoint,
+                                                    const std::vector<bool> &canonicalized,
+                                                    const std::vector<Var> &current_args,
+                                                    const Box &current_bounds,
+                                                    const std::vector<Var> &new_args) {
+    // The reads through a clamp, as in a repeat_edge boundary
+    // condition, would otherwise become a scatter over the whole
+    // domain of the consumer:
+    //   d_f(clamp(r, lo, hi)) += d_g(r)
+    // Instead, split the domain of each clamped variable into the part
+    // below lo, the part in [lo, hi], and the part above hi. The middle
+    // is a pure gather that can be vectorized and merged with the
+    // other gathers into d_f, and only the parts beyond the edges are
+    // reductions, each into a single coordinate of d_f:
+    //   d_f(x) += select(lo <= x <= hi, d_g(x), 0)
+    //   d_f(lo) += d_g(r_below)
+    //   d_f(hi) += d_g(r_above)
+    struct ClampedArg {
+        int lhs_id;
+        std::string var;
+        Expr lo, hi;
+        Interval bounds;
+    };
+    std::vector<ClampedArg> clamped;
+    for (int i = 0; i < (int) lhs.size(); i++) {
+        if (canonicalized[i]) {
+            continue;
+        }
+        ClampedArg c;
+        c.lhs_id = i;
+        if (!match_clamped_var(substitute_in_all_lets(lhs[i]), c.var, c.lo, c.hi)) {
+            return false;
+        }
+        int arg_id = -1;
+        for (int j = 0; j < (int) current_args.size(); j++) {
+            if (current_args[j].name() == c.var) {
+                arg_id = j;
+            }
+        }
+        if (arg_id == -1) {
+            return false;
+        }
+        c.bounds = current_bounds[arg_id];
+        // The clamp bounds have to be loop invariant, and the variable
+        // can't be used by any other argument.
+        for (const Var &v : current_args) {
+            if (has_variable(c.lo, v.name()) || has_variable(c.hi, v.name())) {
+                return false;
+            }
+        }
+        for (const Var &v : new_args) {
+            if (has_variable(c.lo, v.name()) || has_variable(c.hi, v.name())) {
+                return false;
+            }
+        }
+        if (extract_rdom(c.lo).defined() || extract_rdom(c.hi).defined()) {
+            return false;
+        }
+        for (int j = 0; j < (int) lhs.size(); j++) {
+            if (j != i && has_variable(lhs[j], c.var)) {
+                return false;
+            }
+        }
+        clamped.push_back(c);
+    }
+    // Each clamped argument triples the number of updates.
+    if (clamped.empty() || clamped.size() > 2 || extract_rdom(adjoint).defined()) {
+        return false;
+    }
+    // Any other variable of the consumer left in the adjoint would need
+    // a reduction over it, which the general path takes care of.
+    for (const Var &v : current_args) {
+        bool is_clamped = false;
+        for (const ClampedArg &c : clamped) {
+            is_clamped |= (c.var == v.name());
+        }
+        if (!is_clamped && has_variable(adjoint, v.name())) {
+            return false;
+        }
+    }
+
+    std::vector<Var> func_to_update_args = func_to_update.args();
+    Expr zero = make_const(adjoint.type(), 0.0);
+    int num_pieces = 1;
+    for (size_t i = 0; i < clamped.size(); i++) {
+        num_pieces *= 3;
+    }
+    for (int piece = 0; piece < num_pieces; piece++) {
+        std::vector<Expr> piece_lhs = lhs;
+        Expr piece_adjoint = adjoint;
+        Expr inside = const_true();
+        FuncBounds edge_bounds;
+        std::vector<std::pair<std::string, int>> edge_vars;
+        for (int i = 0, p = piece; i < (int) clamped.size(); i++, p /= 3) {
+            const ClampedArg &c = clamped[i];
+            Var u = new_args[c.lhs_id];
+            if (p % 3 == 0) {
+                // In [lo, hi]
+                piece_lhs[c.lhs_id] = u;
+                piece_adjoint = substitute(c.var, u, piece_adjoint);
+                inside = inside && u >= c.lo && u <= c.hi;
+            } else if (p % 3 == 1) {
+                // Below lo
+                piece_lhs[c.lhs_id] = c.lo;
+                edge_vars.emplace_back(c.var, (int) edge_bounds.size());
+                edge_bounds.emplace_back(c.bounds.min, max(c.lo - c.bounds.min, 0));
+            } else {
+                // Above hi
+                piece_lhs[c.lhs_id] = c.hi;
+                edge_vars.emplace_back(c.var, (int) edge_bounds.size());
+                edge_bounds.emplace_back(c.hi + 1, max(c.bounds.max - c.hi, 0));
+            }
+        }
+        if (!edge_bounds.empty()) {
+            RDom r(edge_bounds);
+            for (const auto &it : edge_vars) {
+                piece_adjoint = substitute(it.first, r[it.second], piece_adjoint);
+            }
+        }
+        if (!is_one(inside)) {
+            piece_adjoint = select(inside, piece_adjoint, zero);
+        }
+        for (int arg_id = 0; arg_id < (int) func_to_update_args.size(); arg_id++) {
+            for (auto &lhs_arg : piece_lhs) {
+                lhs_arg = substitute(new_args[arg_id].name(),
+                                     func_to_update_args[arg_id], lhs_arg);
+            }
+            piece_adjoint = substitute(new_args[arg_id].name(),
+                                       func_to_update_args[arg_id], piece_adjoint);
+        }
+        piece_adjoint = simplify(piece_adjoint);
+
+        bool pure_lhs = true;
+        for (int i = 0; i < (int) piece_lhs.size(); i++) {
+            pure_lhs &= equal(piece_lhs[i], func_to_update_args[i]);
+        }
+        if (edge_bounds.empty() && pure_lhs && func_to_update.num_update_definitions() == 0) {
+            add_to_pure_definition(func_to_update, value_index, piece_adjoint);
+        } else if (func_to_update.values().size() == 1) {
+            func_to_update(piece_lhs) += piece_adjoint;
+            record_specializations(func_to_update);
+        } else {
+            func_to_update(piece_lhs)[value_index] += piece_adjoint;
+            record_specializations(func_to_update);
+        }
+    }
+    return true;
+}
+
 void ReverseAccumulationVisitor::visit(const Call *op) {
     assert(expr_adjoints.find(op) != expr_adjoints.end());
     Expr adjoint = expr_adjoints[op];
@@ -780,7 +2074,7 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
         // Math functions
         if (check_opname(op->name, "exp")) {
             // d/dx exp(x) = exp(x)
-            accumulate(op->args[0], adjoint * exp(op->args[0]));
+            accumulate(op->args[0], adjoint * primal(op));
         } else if (check_opname(op->name, "log")) {
             // d/dx log(x) = 1 / x
             accumulate(op->args[0], adjoint / op->args[0]);
@@ -828,9 +2122,10 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
             accumulate(op->args[0],
                        adjoint / (sqrt(op->args[0] - one) * sqrt(op->args[0] + one)));
         } else if (check_opname(op->name, "tanh")) {
-            // d/dx tanh(x) = 1 / cosh(x)^2
-            Expr c = cosh(op->args[0]);
-            accumulate(op->args[0], adjoint / (c * c));
+            // d/dx tanh(x) = 1 / cosh(x)^2 = 1 - tanh(x)^2
+            Expr one = make_const(op->type, 1.0);
+            Expr t = primal(op);
+            accumulate(op->args[0], adjoint * (one - t * t));
         } else if (check_opname(op->name, "atanh")) {
             // d/dx atanh(x) = 1 / (1 - x^2)
             Expr one = make_const(op->type, 1.0);
@@ -847,20 +2142,20 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
             accumulate(op->args[0], make_const(op->type, 0.0));
         } else if (check_opname(op->name, "sqrt")) {
             Expr half = make_const(op->type, 0.5);
-            accumulate(op->args[0], adjoint * half / sqrt(op->args[0]));
+            accumulate(op->args[0], adjoint * half / primal(op));
         } else if (check_opname(op->name, "pow")) {
             Expr one = make_const(op->type, 1.0);
             accumulate(op->args[0],
                        adjoint * op->args[1] * pow(op->args[0], op->args[1] - one));
             accumulate(op->args[1],
-                       adjoint * pow(op->args[0], op->args[1]) * log(op->args[0]));
+                       adjoint * primal(op) * log(op->args[0]));
         } else if (check_opname(op->name, "fast_inverse")) {
             // d/dx 1/x = -1/x^2
-            Expr inv_x = fast_inverse(op->args[0]);
+            Expr inv_x = primal(op);
             accumulate(op->args[0], -adjoint * inv_x * inv_x);
         } else if (check_opname(op->name, "fast_inverse_sqrt")) {
             // d/dx x^(-0.5) = -0.5*x^(-1.5)
-            Expr inv_sqrt_x = fast_inverse_sqrt(op->args[0]);
+            Expr inv_sqrt_x = primal(op);
             Expr neg_half = make_const(op->type, -0.5);
             accumulate(op->args[0],
                        neg_half * adjoint * inv_sqrt_x * inv_sqrt_x * inv_sqrt_x);
@@ -935,6 +2230,10 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
             }
         }
 
+        if (pruned.find(op->name) != pruned.end()) {
+            return;
+        }
+
         // We create different functions for the initial condition and each update
         // When update i uses value from update i-1, we accumulate the
         // adjoints to update i-1
@@ -1043,9 +2342,10 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
         // We then substitute the original variable names back to get
         // f'(x, y, z) += g'(x, x + 1, z - 1)
         //
-        // Currently we don't want to mess with system solving yet,
-        // So we gather all arguments that contains multiple pure variables,
-        // and invalidate all of them.
+        // Currently we don't want to mess with system solving yet.
+        // An argument with multiple pure variables is inverted for one of
+        // them (the rest loop over g's bounds), as long as the variables
+        // don't appear in the other arguments.
         // Inter-dependencies like:
         // g(x, y) = f(x * y, x + y)
         // can't be simplified.
@@ -1070,26 +2370,81 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
         for (int arg_id = 0; arg_id < (int) lhs.size(); arg_id++) {
             // Gather all pure variables at op->args[arg_id],
             // substitute them with new_args
-            // For now only support single pure variable
             std::vector<std::string> variables =
                 gather_variables(lhs[arg_id], vars_to_strings(current_args));
-            if (variables.size() != 1) {
+            if (variables.empty()) {
                 continue;
             }
 
-            bool solved;
+            bool solved = false;
             Expr result_rhs;
-            std::tie(solved, result_rhs) =
-                solve_inverse(new_args[arg_id] == lhs[arg_id],
-                              new_args[arg_id].name(),
-                              variables[0]);
+            std::string solved_var;
+            if (variables.size() == 1) {
+                solved_var = variables[0];
+                std::tie(solved, result_rhs) =
+                    solve_inverse(new_args[arg_id] == lhs[arg_id],
+                                  new_args[arg_id].name(),
+                                  solved_var);
+            } else {
+                // Several pure variables in one argument, e.g.
+                // g(x, y) = f(x + 2 * y)
+                // We solve for one of them and leave the others free:
+                // d_f(u) += d_g(u - 2 * y, y)
+                // The free variables are turned into reduction variables over
+                // the bounds of g below, so the update gathers from d_g instead
+                // of scattering into d_f. Out of bounds reads of d_g are zero
+                // because of its boundary condition.
+                // To keep the substitutions consistent, the solved variable
+                // can't appear in other arguments, and none of the variables
+                // can have been solved for already.
+                std::set<std::string> unique_vars(variables.begin(), variables.end());
+                bool can_solve = unique_vars.size() == variables.size();
+                for (const auto &var : variables) {
+                    if (canonicalized_vars.find(var) != canonicalized_vars.end()) {
+                        can_solve = false;
+                    }
+                }
+                for (int i = 0; i < (int) variables.size() && can_solve; i++) {
+                    bool used_elsewhere = false;
+                    for (int other_id = 0; other_id < (int) lhs.size(); other_id++) {
+                        if (other_id != arg_id &&
+                            has_variable(lhs[other_id], variables[i])) {
+                            used_elsewhere = true;
+                            break;
+                        }
+                    }
+                    if (used_elsewhere) {
+                        continue;
+                    }
+                    bool var_solved;
+                    Expr var_rhs;
+                    std::tie(var_solved, var_rhs) =
+                        solve_inverse(new_args[arg_id] == lhs[arg_id],
+                                      new_args[arg_id].name(),
+                                      variables[i]);
+                    if (!var_solved) {
+                        continue;
+                    }
+                    // Prefer the variables that invert without introducing
+                    // a new reduction
+                    bool exact = !extract_rdom(var_rhs).defined();
+                    if (!solved || exact) {
+                        solved = true;
+                        solved_var = variables[i];
+                        result_rhs = var_rhs;
+                    }
+                    if (exact) {
+                        break;
+                    }
+                }
+            }
             if (!solved) {
                 continue;
             }
 
             // Replace pure variable with the reverse.
             // Make sure to also substitute predicates
-            adjoint = substitute_rdom_predicate(variables[0], result_rhs, adjoint);
+            adjoint = substitute_rdom_predicate(solved_var, result_rhs, adjoint);
 
             // Since we successfully invert, the left hand side becomes
             // new_args
@@ -1097,8 +2452,10 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
             // Record that we sucessfully invert, for those we fail
             // we need to perform general scattering.
             canonicalized[arg_id] = true;
-            canonicalized_vars.insert(variables[0]);
-            lhs_substitute_map[variables[0]] = new_args[arg_id];
+            canonicalized_vars.insert(solved_var);
+            if (variables.size() == 1) {
+                lhs_substitute_map[solved_var] = new_args[arg_id];
+            }
         }
 
         // Sometimes we have this kind of pathelogical case:
@@ -1113,6 +2470,12 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
             }
         }
 
+        if (!is_current_non_overwriting_scan && current_update_id == -1 &&
+            accumulate_clamped(func_to_update, op->value_index, lhs, adjoint,
+                               canonicalized, current_args, current_bounds, new_args)) {
+            return;
+        }
+
         // Sometimes the canonicalization above fails.
         // We replace the pure variables inside lhs with RDoms for general scattering
         std::vector<std::pair<Expr, Expr>> bounds;
@@ -1215,10 +2578,8 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
                 ReductionVariable rvar = rdom.domain()[rvar_id];
                 // Check if the min/max of the rvariable equal to
                 // the target function
-                const Box &target_bounds = func_bounds[op->name];
-                Interval t_interval = target_bounds[i];
-                t_interval.min = simplify(t_interval.min);
-                t_interval.max = simplify(t_interval.max);
+                // The bounds are already simplified by inference_bounds
+                const Interval &t_interval = func_bounds[op->name][i];
                 Interval r_interval(simplify(rvar.min),
                                     simplify(rvar.min + rvar.extent - 1));
                 if (can_prove(r_interval.min <= t_interval.min &&
@@ -1412,6 +2773,38 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
         }
         adjoint = simplify(adjoint);
 
+        // If we're scattering, and the adjoint is zero except where some
+        // condition holds, e.g. behind the max of a max pool, move the
+        // condition into the predicate of the reduction domain, so that
+        // the update only visits the elements it changes instead of
+        // adding zeros everywhere else. The predicate can't depend on
+        // the pure variables of the update.
+        bool gated = false;
+        if (merged_r.defined()) {
+            while (const Select *sel = adjoint.as<Select>()) {
+                Expr condition, value;
+                if (is_zero(sel->false_value)) {
+                    condition = sel->condition;
+                    value = sel->true_value;
+                } else if (is_zero(sel->true_value)) {
+                    condition = !sel->condition;
+                    value = sel->false_value;
+                } else {
+                    break;
+                }
+                bool uses_pure_var = false;
+                for (const auto &arg : func_to_update_args) {
+                    uses_pure_var |= has_variable(condition, arg.name());
+                }
+                if (uses_pure_var) {
+                    break;
+                }
+                merged_r.where(condition);
+                adjoint = value;
+                gated = true;
+            }
+        }
+
         if (debug_flag) {
             debug(0) << "func_to_update.name():" << func_to_update.name() << "\n";
             debug(0) << "lhs after canonicalization:";
@@ -1435,23 +2828,23 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
                 }
                 ReductionDomain rdom = extract_rdom(adjoint);
                 // If there are rdoms in adjoint we can't merge
-                return !rdom.defined();
+                return !gated && !rdom.defined();
             }
             int update_id = func_to_update.num_update_definitions() - 1;
             std::vector<Expr> prev_lhs =
                 func_to_update.update_args(update_id);
             assert(prev_lhs.size() == lhs.size());
-            // If previous update has different left hand side, don't merge
-            for (int i = 0; i < (int) prev_lhs.size(); i++) {
-                if (!equal(lhs[i], prev_lhs[i])) {
-                    return false;
-                }
-            }
             // If previous update has a different set of reduction variables,
             // don't merge
             const std::vector<ReductionVariable> &rvars =
                 func_to_update.update(update_id).get_schedule().rvars();
             if (!merged_r.defined()) {
+                // If previous update has different left hand side, don't merge
+                for (int i = 0; i < (int) prev_lhs.size(); i++) {
+                    if (!equal(lhs[i], prev_lhs[i])) {
+                        return false;
+                    }
+                }
                 return rvars.size() == 0;
             }
             if ((int) rvars.size() != merged_r.dimensions()) {
@@ -1466,7 +2859,22 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
                     return false;
                 }
             }
-            return true;
+            // Nor if it has a different left hand side or predicate, in
+            // terms of its own reduction variables. The scatters into the
+            // components of a Tuple from the same call site match, gated
+            // or not, so they merge into one update that writes all of
+            // them in a single loop nest.
+            ReductionDomain prev_rdom = extract_update_rdom(func_to_update, update_id);
+            if (!prev_rdom.defined()) {
+                return false;
+            }
+            for (int i = 0; i < (int) prev_lhs.size(); i++) {
+                if (!equal(rename_rvars(merged_r, prev_rdom, lhs[i]), prev_lhs[i])) {
+                    return false;
+                }
+            }
+            Expr predicate = rename_rvars(merged_r, prev_rdom, merged_r.domain().predicate());
+            return equal(simplify(predicate), simplify(prev_rdom.predicate()));
         };
 
         // TODO: maybe do some analysis on lhs to avoid applying boundary conditions to
@@ -1480,19 +2888,11 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
         } else {
             Definition &def = func_to_update.num_update_definitions() == 0 ? func_to_update.function().definition() : func_to_update.function().update(func_to_update.num_update_definitions() - 1);
             std::vector<Expr> &values = def.values();
-            ReductionDomain rdom;
-            for (const auto &val : values) {
-                rdom = extract_rdom(val);
-                if (rdom.defined()) {
-                    break;
-                }
-            }
-            if (rdom.defined()) {
-                assert(func_to_update.num_update_definitions() > 0);
+            if (merged_r.defined() && func_to_update.num_update_definitions() > 0) {
                 // Make sure we're using the same set of reduction variables
-                for (int i = 0; i < merged_r.dimensions(); i++) {
-                    adjoint = substitute(merged_r[i].name(), RVar(rdom, i), adjoint);
-                }
+                ReductionDomain rdom = extract_update_rdom(
+                    func_to_update, func_to_update.num_update_definitions() - 1);
+                adjoint = rename_rvars(merged_r, rdom, adjoint);
             }
 
             if (values.size() == 1) {
@@ -1511,6 +2911,7 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
                 }
             }
         }
+        record_specializations(func_to_update);
     } else {
         // TODO: let user provide derivatives for external functions
         internal_error << "Unknown call type of operation: " << op->name << "\n";
@@ -1736,23 +3137,207 @@ Expr forward_accumulation(const Expr &expr,
     return forward_accumulation(expr, tangents, scope);
 }
 
+namespace {
+
+// Add the batch index as the innermost argument of the batched Functions,
+// replacing the scalar placeholder
+class AddBatchDimension : public IRMutator2 {
+public:
+    AddBatchDimension(const std::string &placeholder,
+                      const Var &batch,
+                      const std::map<std::string, Function> &batched)
+        : placeholder(placeholder), batch(batch), batched(batched) {}
+
+    using IRMutator2::visit;
+
+    Expr visit(const Variable *op) override {
+        if (op->name == placeholder) {
+            return batch;
+        }
+        return op;
+    }
+
+    Expr visit(const Call *op) override {
+        Expr expr = IRMutator2::visit(op);
+        op = expr.as<Call>();
+        internal_assert(op);
+        auto it = batched.find(op->name);
+        if (op->call_type == Call::Halide && it != batched.end()) {
+            std::vector<Expr> args{ batch };
+            args.insert(args.end(), op->args.begin(), op->args.end());
+            return Call::make(it->second, args, op->value_index);
+        }
+        return expr;
+    }
+
+private:
+    const std::string &placeholder;
+    Var batch;
+    const std::map<std::string, Function> &batched;
+};
+
+// Rewrite the derivatives computed for a single seed indexed by the scalar
+// placeholder into Funcs with a new innermost batch dimension. Only the
+// outputs and the Functions depending on the seed are rewritten, the
+// primal Funcs are shared by the whole batch. Returns the batched
+// Functions by name.
+std::map<std::string, Function> add_batch_dimension(const std::vector<Function> &outputs,
+                                                    const std::string &placeholder) {
+    std::map<std::string, Function> env;
+    std::set<std::string> output_names;
+    for (const auto &f : outputs) {
+        output_names.insert(f.name());
+        std::map<std::string, Function> calls = find_transitive_calls(f);
+        env.insert(calls.begin(), calls.end());
+    }
+    std::vector<std::string> order = realization_order(outputs, env).first;
+
+    std::map<std::string, Function> batched;
+    Var batch;
+    AddBatchDimension mutator(placeholder, batch, batched);
+    for (const auto &name : order) {
+        const Function &f = env[name];
+        auto depends_on_seed = [&](const Expr &e) {
+            if (has_variable(e, placeholder)) {
+                return true;
+            }
+            for (const auto &it : batched) {
+                if (is_calling_function(it.first, e, {})) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        std::vector<const Definition *> defs{ &f.definition() };
+        for (const auto &def : f.updates()) {
+            defs.push_back(&def);
+        }
+        bool depends = output_names.find(name) != output_names.end();
+        for (const Definition *def : defs) {
+            for (const auto &arg : def->args()) {
+                depends = depends || depends_on_seed(arg);
+            }
+            for (const auto &value : def->values()) {
+                depends = depends || depends_on_seed(value);
+            }
+        }
+        if (!depends) {
+            continue;
+        }
+        user_assert(!f.has_extern_definition())
+            << "Can't batch the derivative " << f.name()
+            << " since it has an extern definition.\n";
+        for (const Definition *def : defs) {
+            user_assert(!def->predicate().defined() || !depends_on_seed(def->predicate()))
+                << "Can't batch the derivative " << f.name()
+                << " since one of its predicates depends on the seed.\n";
+        }
+
+        Function batched_f(f.name());
+        std::vector<std::string> args{ batch.name() };
+        args.insert(args.end(), f.args().begin(), f.args().end());
+        std::vector<Expr> values;
+        for (const auto &value : f.values()) {
+            values.push_back(mutator.mutate(value));
+        }
+        batched_f.define(args, values);
+        // Self references in the updates go to the batched Function as well
+        batched[f.name()] = batched_f;
+        for (const auto &def : f.updates()) {
+            std::vector<Expr> update_args{ batch };
+            for (const auto &arg : def.args()) {
+                update_args.push_back(mutator.mutate(arg));
+            }
+            std::vector<Expr> update_values;
+            for (const auto &value : def.values()) {
+                update_values.push_back(mutator.mutate(value));
+            }
+            batched_f.define_update(update_args, update_values);
+        }
+    }
+
+    return batched;
+}
+
+// Redirect the calls to the primal Funcs and to the tangent placeholders
+// to the corresponding values of the dual Funcs
+class RedirectToDual : public IRMutator2 {
+public:
+    using IRMutator2::visit;
+
+    Expr visit(const Call *op) override {
+        Expr expr = IRMutator2::visit(op);
+        op = expr.as<Call>();
+        internal_assert(op);
+        auto it = redirections.find(op->name);
+        if (op->call_type == Call::Halide && it != redirections.end()) {
+            return Call::make(it->second.first, op->args, it->second.second);
+        }
+        return expr;
+    }
+
+    std::map<std::string, std::pair<Function, int>> redirections;
+};
+
+std::map<FuncKey, Func> batch_adjoints(const std::map<FuncKey, Func> &adjoints,
+                                       const std::string &placeholder) {
+    std::vector<Function> outputs;
+    for (const auto &it : adjoints) {
+        outputs.push_back(it.second.function());
+    }
+    std::map<std::string, Function> batched = add_batch_dimension(outputs, placeholder);
+    std::map<FuncKey, Func> result;
+    for (const auto &it : adjoints) {
+        auto batched_it = batched.find(it.second.name());
+        internal_assert(batched_it != batched.end());
+        result[it.first] = Func(batched_it->second);
+    }
+    return result;
+}
+
+}  // namespace
+
 }  // namespace Internal
 
+std::vector<Stage> Derivative::specialize() const {
+    std::map<std::string, Func> by_name;
+    for (const auto &it : adjoints) {
+        by_name[it.second.name()] = it.second;
+    }
+    std::vector<Stage> result;
+    for (const auto &it : specializations) {
+        auto adjoint = by_name.find(it.first.first);
+        // Skip the updates that aren't part of the derivative any more.
+        if (adjoint == by_name.end() ||
+            it.first.second >= adjoint->second.num_update_definitions()) {
+            continue;
+        }
+        Func func = adjoint->second;
+        for (const Expr &c : it.second) {
+            result.push_back(func.update(it.first.second).specialize(c));
+        }
+    }
+    return result;
+}
+
 Derivative propagate_adjoints(const Func &output,
                               const Func &adjoint,
-                              const std::vector<std::pair<Expr, Expr>> &output_bounds) {
+                              const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                              const PropagateAdjointsOptions &options) {
     user_assert(output.dimensions() == adjoint.dimensions())
         << "output dimensions and adjoint dimensions must match\n";
     user_assert((int) output_bounds.size() == adjoint.dimensions())
         << "output_bounds and adjoint dimensions must match\n";
 
     Internal::ReverseAccumulationVisitor visitor;
-    visitor.propagate_adjoints(output, adjoint, output_bounds);
-    return Derivative{ visitor.get_adjoint_funcs() };
+    visitor.propagate_adjoints(output, adjoint, output_bounds, options);
+    return Derivative{ visitor.get_adjoint_funcs(), visitor.get_recomputed_funcs(),
+                       visitor.get_specializations() };
 }
 
 Derivative propagate_adjoints(const Func &output,
-                              const Buffer<float> &adjoint) {
+                              const Buffer<float> &adjoint,
+                              const PropagateAdjointsOptions &options) {
     user_assert(output.dimensions() == adjoint.dimensions());
     std::vector<std::pair<Expr, Expr>> bounds;
     for (int dim = 0; dim < adjoint.dimensions(); dim++) {
@@ -1761,10 +3346,11 @@ Derivative propagate_adjoints(const Func &output,
     }
     Func adjoint_func("adjoint_func");
     adjoint_func(_) = adjoint(_);
-    return propagate_adjoints(output, adjoint_func, bounds);
+    return propagate_adjoints(output, adjoint_func, bounds, options);
 }
 
-Derivative propagate_adjoints(const Func &output) {
+Derivative propagate_adjoints(const Func &output,
+                              const PropagateAdjointsOptions &options) {
     Func adjoint("adjoint");
     adjoint(output.args()) = Internal::make_const(output.value().type(), 1.0);
     std::vector<std::pair<Expr, Expr>> output_bounds;
@@ -1772,7 +3358,47 @@ Derivative propagate_adjoints(const Func &output) {
     for (int i = 0; i < output.dimensions(); i++) {
         output_bounds.push_back({ 0, 0 });
     }
-    return propagate_adjoints(output, adjoint, output_bounds);
+    return propagate_adjoints(output, adjoint, output_bounds, options);
+}
+
+Derivative propagate_adjoints(const Func &output,
+                              const std::set<std::string> &inputs,
+                              const PropagateAdjointsOptions &options) {
+    user_assert(!inputs.empty())
+        << "propagate_adjoints needs at least one input to differentiate with respect to\n";
+    PropagateAdjointsOptions pruned_options = options;
+    pruned_options.inputs = inputs;
+    return propagate_adjoints(output, pruned_options);
+}
+
+Derivative propagate_batched_adjoints(const Func &output,
+                                      const Buffer<float> &adjoints,
+                                      const PropagateAdjointsOptions &options) {
+    user_assert(output.dimensions() + 1 == adjoints.dimensions())
+        << "The batched adjoints should have one more dimension than the output\n";
+    // Propagate a single seed, selected by a scalar placeholder, then
+    // replace the placeholder with a new innermost dimension.
+    Internal::Parameter batch_index(Int(32), false, 0, Internal::unique_name("batch_index"));
+    Expr batch_expr = Internal::Variable::make(Int(32), batch_index.name(), batch_index);
+    std::vector<Expr> args{ batch_expr };
+    std::vector<std::pair<Expr, Expr>> bounds;
+    for (int dim = 0; dim < output.dimensions(); dim++) {
+        Var arg;
+        args.push_back(arg);
+        bounds.push_back(std::make_pair(Expr(adjoints.min(dim + 1)),
+                                        Expr(adjoints.min(dim + 1) + adjoints.extent(dim + 1) - 1)));
+    }
+    std::vector<Var> adjoint_args;
+    for (int dim = 1; dim < (int) args.size(); dim++) {
+        adjoint_args.push_back(Var(args[dim].as<Internal::Variable>()->name));
+    }
+    Func adjoint_func("adjoint_func");
+    adjoint_func(adjoint_args) = adjoints(args);
+
+    Internal::ReverseAccumulationVisitor visitor;
+    visitor.propagate_adjoints(output, adjoint_func, bounds, options);
+    return Derivative{ Internal::batch_adjoints(visitor.get_adjoint_funcs(), batch_index.name()),
+                       visitor.get_recomputed_funcs(), visitor.get_specializations() };
 }
 
 Func propagate_tangents(const Func &output,
@@ -1820,6 +3446,164 @@ Func propagate_tangents(const Func &output,
     return transformed_funcs.back();
 }
 
+Func propagate_batched_tangents(const Func &output,
+                                const std::map<std::string, Func> &tangents) {
+    // Propagate a single direction, selected by a scalar placeholder, then
+    // replace the placeholder with a new innermost dimension.
+    Internal::Parameter batch_index(Int(32), false, 0, Internal::unique_name("batch_index"));
+    Expr batch_expr = Internal::Variable::make(Int(32), batch_index.name(), batch_index);
+    std::map<std::string, Func> single_tangents;
+    for (const auto &it : tangents) {
+        const Func &tangent = it.second;
+        user_assert(tangent.dimensions() >= 1)
+            << "The batched tangent " << tangent.name()
+            << " should have the batch index as its first dimension\n";
+        std::vector<Var> args;
+        std::vector<Expr> call_args{ batch_expr };
+        for (int dim = 1; dim < tangent.dimensions(); dim++) {
+            Var arg;
+            args.push_back(arg);
+            call_args.push_back(arg);
+        }
+        Func single_tangent(tangent.name() + "_single");
+        single_tangent(args) = tangent(call_args);
+        single_tangents[it.first] = single_tangent;
+    }
+    Func single_output = propagate_tangents(output, single_tangents);
+    std::map<std::string, Internal::Function> batched =
+        Internal::add_batch_dimension({ single_output.function() }, batch_index.name());
+    return Func(batched[single_output.name()]);
+}
+
+Derivative propagate_hessian_vector_products(const Func &output,
+                                             const std::map<std::string, Func> &directions,
+                                             const PropagateAdjointsOptions &options) {
+    user_assert(output.values().size() == 1)
+        << "Hessian-vector products need a single valued output\n";
+    std::map<std::string, Internal::Function> env =
+        Internal::find_transitive_calls(output.function());
+    std::vector<std::string> order =
+        Internal::realization_order({ output.function() }, env).first;
+
+    // Build a dual Func (primal, tangent) for each forward Func, so that
+    // the adjoint pass reads a single realization of both. The tangents
+    // are first expressed with placeholders, which are then redirected to
+    // the dual values along with the primal calls.
+    std::map<std::string, Func> tangents = directions;
+    Internal::RedirectToDual redirect;
+    Func dual_output;
+    for (const auto &func_name : order) {
+        Func func(env[func_name]);
+        user_assert(func.values().size() == 1)
+            << "Hessian-vector products don't support the Tuple valued Func "
+            << func.name() << "\n";
+        Type type = func.value().type();
+        Func placeholder(func.name() + "_tangent");
+        placeholder(func.args()) = Internal::make_const(type, 0.0);
+        tangents[func.name()] = placeholder;
+
+        Func dual(func.name() + "_dual");
+        Expr tangent = Internal::forward_accumulation(func.value(), tangents);
+        dual(func.args()) = Tuple(redirect.mutate(func.value()), redirect.mutate(tangent));
+        redirect.redirections[func.name()] = { dual.function(), 0 };
+        redirect.redirections[placeholder.name()] = { dual.function(), 1 };
+        for (int update_id = 0; update_id < func.num_update_definitions(); update_id++) {
+            Expr value = func.update_value(update_id);
+            Expr tangent = Internal::forward_accumulation(value, tangents);
+            std::vector<Expr> args;
+            for (const auto &arg : func.update_args(update_id)) {
+                args.push_back(redirect.mutate(arg));
+            }
+            dual(args) = Tuple(redirect.mutate(value), redirect.mutate(tangent));
+        }
+        dual_output = dual;
+    }
+
+    // The Hessian-vector products are the gradients of the directional derivative
+    Func jvp(output.name() + "_jvp");
+    jvp(output.args()) = dual_output(output.args())[1];
+    return propagate_adjoints(jvp, options);
+}
+
+Func all_finite(const Func &gradient, const std::vector<std::pair<Expr, Expr>> &region) {
+    user_assert(gradient.defined() && gradient.values().size() == 1)
+        << "all_finite needs a single valued Func\n";
+    user_assert(gradient.dimensions() == (int) region.size())
+        << "The region passed to all_finite for " << gradient.name() << " has "
+        << region.size() << " dimensions instead of " << gradient.dimensions() << "\n";
+    Type t = gradient.value().type();
+    Func result(gradient.name() + "_all_finite");
+    result() = Internal::const_true();
+    if (!t.is_float()) {
+        return result;
+    }
+    std::vector<Expr> args;
+    RDom r;
+    if (!region.empty()) {
+        r = RDom(region);
+        for (int i = 0; i < r.dimensions(); i++) {
+            args.push_back(r[i]);
+        }
+    }
+    // NaNs fail the comparison too.
+    Expr g = gradient(args);
+    result() = result() && (abs(g) <= t.max());
+    return result;
+}
+
+Func optimizer_step(const Derivative &d,
+                    const Func &param,
+                    const std::vector<Func> &state,
+                    const OptimizerOptions &options) {
+    user_assert(param.defined() && param.values().size() == 1 && param.num_update_definitions() == 0)
+        << "optimizer_step needs a pure, single valued Func to optimize\n";
+    size_t expected_state = 0;
+    if (options.optimizer == Optimizer::Momentum) {
+        expected_state = 1;
+    } else if (options.optimizer == Optimizer::Adam) {
+        expected_state = 2;
+    }
+    user_assert(state.size() == expected_state)
+        << "optimizer_step for " << param.name() << " was passed " << state.size()
+        << " state Funcs instead of " << expected_state << "\n";
+    for (const Func &f : state) {
+        user_assert(f.dimensions() == param.dimensions() && f.values().size() == 1)
+            << "The optimizer state " << f.name() << " must have the same shape as "
+            << param.name() << "\n";
+    }
+
+    std::vector<Var> args = param.args();
+    Type t = param.value().type();
+    Expr p = param(args);
+    Expr g = cast(t, d(param)(args));
+    Expr lr = cast(t, options.learning_rate);
+
+    Func step(param.name() + "_optimizer_step");
+    switch (options.optimizer) {
+    case Optimizer::SGD:
+        step(args) = p - lr * g;
+        break;
+    case Optimizer::Momentum: {
+        Expr v = cast(t, options.momentum) * state[0](args) + g;
+        step(args) = Tuple(p - lr * v, v);
+        break;
+    }
+    case Optimizer::Adam: {
+        Expr b1 = Internal::make_const(t, options.momentum);
+        Expr b2 = Internal::make_const(t, options.beta2);
+        Expr m = b1 * state[0](args) + (1 - b1) * g;
+        Expr v = b2 * state[1](args) + (1 - b2) * g * g;
+        Expr k = cast(t, options.step);
+        Expr m_hat = m / (1 - pow(b1, k));
+        Expr v_hat = v / (1 - pow(b2, k));
+        Expr update = lr * m_hat / (sqrt(v_hat) + Internal::make_const(t, options.epsilon));
+        step(args) = Tuple(p - update, m, v);
+        break;
+    }
+    }
+    return step;
+}
+
 void print_func(const Func &func, const PrintFuncOptions &options) {
     Internal::debug(0) << "Printing function:" << func.name() << "\n";
     // Topologically sort the functions
@@ -1984,9 +3768,45 @@ void test_simple_bounds_inference_update() {
         << "Expected 2 instead of " << bounds[input.name()][0].max << "\n";
 }
 
+void test_adjoint_bounds_inference() {
+    Var x("x");
+    Func input("input");
+    input(x) = 0.0f;
+    Func g("g");
+    g(x) = select(x > 0, input(x - 1), 0.0f);
+    Func h("h");
+    RDom r(0, 100);
+    h(x) = 0.0f;
+    h(r.x) = g(r.x);
+    RDom r_loss(0, 10);
+    Func f_loss("f_loss");
+    f_loss(x) += h(r_loss.x);
+
+    // The forward pass computes all of h's update, but only the
+    // points of h that are read have a nonzero adjoint.
+    std::map<std::string, Box> bounds = inference_bounds(f_loss, { { 0, 0 } });
+    internal_assert(equal(bounds[g.name()][0].max, 99))
+        << "Expected 99 instead of " << bounds[g.name()][0].max << "\n";
+    internal_assert(equal(bounds[input.name()][0].min, -1))
+        << "Expected -1 instead of " << bounds[input.name()][0].min << "\n";
+
+    bounds = inference_bounds(f_loss, { { 0, 0 } }, true);
+    internal_assert(equal(bounds[h.name()][0].max, 9))
+        << "Expected 9 instead of " << bounds[h.name()][0].max << "\n";
+    internal_assert(equal(bounds[g.name()][0].min, 0))
+        << "Expected 0 instead of " << bounds[g.name()][0].min << "\n";
+    internal_assert(equal(bounds[g.name()][0].max, 9))
+        << "Expected 9 instead of " << bounds[g.name()][0].max << "\n";
+    internal_assert(equal(bounds[input.name()][0].min, 0))
+        << "Expected 0 instead of " << bounds[input.name()][0].min << "\n";
+    internal_assert(equal(bounds[input.name()][0].max, 8))
+        << "Expected 8 instead of " << bounds[input.name()][0].max << "\n";
+}
+
 void derivative_test() {
     test_simple_bounds_inference();
     test_simple_bounds_inference_update();
+    test_adjoint_bounds_inference();
 }
 
 }  // namespace Internal
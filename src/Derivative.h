@@ -10,6 +10,7 @@
 #include "Module.h"
 
 #include <array>
+#include <functional>
 #include <set>
 #include <vector>
 
@@ -24,6 +25,16 @@ using FuncKey = std::pair<std::string, int>;
  */
 struct Derivative {
     std::map<FuncKey, Func> adjoints;
+    /** Forward Funcs that the adjoints recompute instead of reading,
+     * as chosen by the CheckpointPolicy. */
+    std::set<std::string> recomputed;
+    /** The conditions of the specializations of the forward
+     * definitions, for each update of an adjoint that accumulates their
+     * contributions, keyed by the name of the adjoint and the index of
+     * the update. Nested specializations are flattened into the
+     * conjunction of their conditions, innermost first. See
+     * specialize. */
+    std::map<FuncKey, std::vector<Expr>> specializations;
 
     Func operator()(const Func &func, int update_id = -1, bool bounded = true) const {
         std::string name = func.name();
@@ -41,6 +52,52 @@ struct Derivative {
         return it->second;
     }
 
+    /** Get the reverse scan that rebuilds the states of func for its
+     * adjoints, made by PropagateAdjointsOptions::invert_scans, or an
+     * undefined Func if func wasn't inverted. */
+    Func reconstructed(const Func &func) const {
+        auto it = adjoints.find(FuncKey{ func.name() + "_reconstructed", -1 });
+        return it == adjoints.end() ? Func() : it->second;
+    }
+
+    /** Get the partial sums of an update of the adjoint of the Func or
+     * buffer with the given name, made by
+     * PropagateAdjointsOptions::reduction_tile_size, or an undefined
+     * Func if the update wasn't tiled. */
+    Func partial_sums(const std::string &name, int update_id) const {
+        auto it = adjoints.find(FuncKey{ name + "_partial", update_id });
+        return it == adjoints.end() ? Func() : it->second;
+    }
+
+    /** Get the Func storing the compressed values of func that the
+     * adjoints read instead of func, made by
+     * PropagateAdjointsOptions::compressed_activations, or an undefined
+     * Func if func isn't compressed. It has to be realized by the
+     * forward pass, e.g. by computing it at root, while func itself
+     * can then be discarded once its forward consumers are done. */
+    Func compressed(const Func &func) const {
+        auto it = adjoints.find(FuncKey{ func.name() + "_compressed", -1 });
+        return it == adjoints.end() ? Func() : it->second;
+    }
+
+    /** Get the scales of the blocks of the compressed values of func,
+     * stored along with them with ActivationCompression::Int8Block, or
+     * an undefined Func otherwise. */
+    Func compressed_scales(const Func &func) const {
+        auto it = adjoints.find(FuncKey{ func.name() + "_compressed_scales", -1 });
+        return it == adjoints.end() ? Func() : it->second;
+    }
+
+    /** Specialize the updates of the adjoints under the same
+     * conditions as the forward definitions they differentiate, so that
+     * the fast paths of the forward pass, e.g. for unit strides or a
+     * constant number of channels, are simplified into the backward pass
+     * as well. Like Func::specialize, each specialization inherits the
+     * schedule of its update so far, so this should usually come after
+     * scheduling the adjoints. Returns the handles to the new specialized
+     * schedules. */
+    std::vector<Stage> specialize() const;
+
     /** Get the entire chain of new synthesized Funcs that compute the
      * derivative of a given user-written Func for the purpose of
      * scheduling. */
@@ -63,6 +120,136 @@ struct Derivative {
     }
 };
 
+/**
+ *  How the backward pass obtains the forward values it depends on.
+ */
+enum class CheckpointPolicy {
+    /** Adjoints read the forward Funcs directly, so every forward
+     * intermediate they touch has to be kept alive. */
+    StoreAll,
+    /** The forward Funcs listed in PropagateAdjointsOptions::recompute
+     * are recomputed inside the adjoints instead of being read. */
+    RecomputeMarked,
+    /** Recompute the largest pure forward Funcs until the estimated
+     * footprint of the remaining ones fits in
+     * PropagateAdjointsOptions::memory_budget. */
+    MemoryBudget
+};
+
+/**
+ *  A compact format to store a forward Func read by the adjoints in.
+ *  The adjoints read the values back through a decompression inlined
+ *  into their loads.
+ */
+enum class ActivationCompression {
+    /** Half precision floats. */
+    Float16,
+    /** Floats with the range of float and 8 bits of mantissa. */
+    BFloat16,
+    /** 8-bit integers, scaled by the largest magnitude of each block of
+     * PropagateAdjointsOptions::activation_block_size values along the
+     * innermost dimension, which is stored as a float. */
+    Int8Block,
+    /** One bit per value, set where the value is positive, packed by 8
+     * along the innermost dimension. The adjoints see 1 where the
+     * value was positive and -1 elsewhere, which is exact when they
+     * only compare it to zero, e.g. for the input or the output of a
+     * ReLU, up to the ties at zero. */
+    SignMask
+};
+
+/**
+ *  A user-supplied gradient of a forward Func. Given the adjoint of the
+ *  Func, returns the adjoints it contributes to the Funcs and buffers it
+ *  reads, keyed by their names. The returned Funcs can use define_extern
+ *  to call a hand-written backward kernel.
+ */
+using CustomGradient = std::function<std::map<std::string, Func>(const Func &adjoint)>;
+
+struct PropagateAdjointsOptions {
+    CheckpointPolicy checkpoint_policy = CheckpointPolicy::StoreAll;
+    /** Names of the forward Funcs to recompute with RecomputeMarked. */
+    std::set<std::string> recompute;
+    /** Budget in bytes for the stored forward Funcs with MemoryBudget. */
+    int64_t memory_budget = 0;
+    /** Fuse the pure adjoint stages (boundary conditions, copies between
+     * updates, zero adjoints) into the adjoints reading them, which
+     * reduces the number of realizations in the backward pipeline. The
+     * fused Funcs remain valid, but scheduling them no longer affects
+     * their consumers. */
+    bool fuse_adjoints = false;
+    /** Schedule the adjoints of each forward Func like the pure
+     * definition of the Func: its splits, tiles and fusions, its loop
+     * order, and its parallel, vectorized, unrolled and GPU loops are
+     * applied to the definition of each adjoint, which runs over the
+     * same pure vars, and to the updates that write to a point of them
+     * rather than scattering. The reduction variables of the updates
+     * stay inside the pure loops, except for a vectorized one. Where
+     * the adjoints are computed isn't transferred, since they have
+     * other consumers than the forward Funcs. Schedule the adjoints
+     * afterwards to override any of it. */
+    bool transfer_schedules = false;
+    /** Gradients used instead of differentiating through the definitions
+     * of a Func, keyed by its name. Required for extern stages. The
+     * adjoints of the intermediate updates of these Funcs are left to
+     * zero. The Funcs that are only read through these Funcs aren't
+     * differentiated, unless a custom gradient returns their adjoints:
+     * each custom gradient is called once on a zero adjoint first, to
+     * find which ones it returns. */
+    std::map<std::string, CustomGradient> custom_gradients;
+    /** A float type to accumulate the adjoints of narrower float Funcs
+     * and buffers in, e.g. Float(32) for a Float(16) pipeline. The
+     * forward Funcs keep their types, so the stored activations stay
+     * narrow, and only the adjoints take the wider type. Undefined
+     * means the adjoints have the same types as the forward values. */
+    Type accumulation_type;
+    /** If defined, the adjoints are computed for the output multiplied
+     * by this, so that small gradients don't flush to zero in half
+     * precision. The adjoints are left scaled; divide them by the loss
+     * scale when applying them, e.g. by folding it into the learning
+     * rate. For dynamic loss scaling, make this a Param, and adjust it
+     * between steps according to all_finite. */
+    Expr loss_scale;
+    /** Make the adjoints of scans like f(x, r + 1) = g(f(x, r), ...),
+     * where g can be inverted in f, read the intermediate states of f
+     * from a reverse scan that rebuilds them from the final state,
+     * instead of reading the history stored by the forward pass. The
+     * reverse scan is d.reconstructed(f). It trades exactness for
+     * memory: rounding errors grow as the states are replayed. */
+    bool invert_scans = false;
+    /** The names of the Funcs and buffers to take the gradients with
+     * respect to. If not empty, only the Funcs on a path from the
+     * output to one of them are differentiated, and d(f) is only
+     * defined for them and these Funcs. */
+    std::set<std::string> inputs;
+    /** If positive, the adjoints that sum a whole reduction domain into
+     * a few points, e.g. the gradients of small weight buffers or of
+     * scalars used over a whole image, are split into partial sums over
+     * tiles of this many iterations of their outermost reduction
+     * variable, computed in parallel, followed by a sum of the
+     * tiles. The partial sums are d.partial_sums(name, update), and are
+     * compute_root and parallel over the tiles by default. */
+    int reduction_tile_size = 0;
+    /** Gradients to accumulate into the gradients computed so far, e.g.
+     * over the micro-batches of a training step, keyed by the name of
+     * the Func or buffer. d(name) then computes the Func given here
+     * plus the gradient. The adjoints of buffers start from it instead
+     * of zero, so no separate pass adds them. The Func only needs to be
+     * read where d(name) is written, so it can wrap the buffer that
+     * d(name) is realized into, to accumulate in place. */
+    std::map<std::string, Func> accumulate_into;
+    /** Forward Funcs for the adjoints to read in a compressed form
+     * instead of in full precision, keyed by their names. This trades
+     * the accuracy of the gradients for the memory of the activations
+     * kept for the backward pass. Only pure single-valued float Funcs
+     * that aren't recomputed can be compressed. See
+     * Derivative::compressed. */
+    std::map<std::string, ActivationCompression> compressed_activations;
+    /** The number of values sharing a scale with
+     * ActivationCompression::Int8Block. */
+    int activation_block_size = 32;
+};
+
 /**
  *  Given a Func and a corresponding adjoint, (back)propagate the
  *  adjoint to all dependent Funcs, buffers, and parameters.
@@ -70,24 +257,124 @@ struct Derivative {
  */
 Derivative propagate_adjoints(const Func &output,
                               const Func &adjoint,
-                              const std::vector<std::pair<Expr, Expr>> &output_bounds);
+                              const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                              const PropagateAdjointsOptions &options = PropagateAdjointsOptions());
 /**
  *  Given a Func and a corresponding adjoint buffer, (back)propagate the
  *  adjoint to all dependent Funcs, buffers, and parameters.
  */
 Derivative propagate_adjoints(const Func &output,
-                              const Buffer<float> &adjoint);
+                              const Buffer<float> &adjoint,
+                              const PropagateAdjointsOptions &options = PropagateAdjointsOptions());
+/**
+ *  Given a Func and K adjoint buffers stacked along a new innermost
+ *  dimension, i.e. adjoints(k, x, y, ...), (back)propagate all of them
+ *  in a single pipeline. The resulting adjoints have the batch index as
+ *  their first (innermost) argument, and read the forward Funcs once for
+ *  the whole batch, so the batch dimension can be vectorized.
+ */
+Derivative propagate_batched_adjoints(const Func &output,
+                                      const Buffer<float> &adjoints,
+                                      const PropagateAdjointsOptions &options = PropagateAdjointsOptions());
 /**
  *  Given a scalar Func with size 1, (back)propagate the gradient
  *  to all dependent Funcs, buffers, and parameters.
  */
-Derivative propagate_adjoints(const Func &output);
+Derivative propagate_adjoints(const Func &output,
+                              const PropagateAdjointsOptions &options = PropagateAdjointsOptions());
+/**
+ *  Same as above, but only build the adjoints needed for the gradients
+ *  with respect to the named Funcs and buffers. See
+ *  PropagateAdjointsOptions::inputs.
+ */
+Derivative propagate_adjoints(const Func &output,
+                              const std::set<std::string> &inputs,
+                              const PropagateAdjointsOptions &options = PropagateAdjointsOptions());
 /**
  *  Given a Func and the tangents of inputs, (forward-)propagate the derivatives
  *  to the output.
  */
 Func propagate_tangents(const Func &output,
                         const std::map<std::string, Func> &tangents);
+/**
+ *  Same as propagate_tangents, but each tangent carries K directions along
+ *  a new innermost dimension, i.e. tangent(k, x, y, ...). The returned Func
+ *  computes the K Jacobian-vector products in a single pipeline, with the
+ *  batch index as its first argument.
+ */
+Func propagate_batched_tangents(const Func &output,
+                                const std::map<std::string, Func> &tangents);
+
+/**
+ *  Given a scalar Func with size 1 and the directions of the inputs,
+ *  compute the Hessian-vector products by reverse-over-forward
+ *  differentiation. Each forward Func f becomes a single dual Func
+ *  f_dual computing both its value and its tangent, which the adjoint
+ *  pass reads without recomputing the primal, so the graph grows
+ *  linearly with the forward pipeline. d(buffer) of the result gives
+ *  the Hessian-vector product with respect to that buffer.
+ */
+Derivative propagate_hessian_vector_products(const Func &output,
+                                             const std::map<std::string, Func> &directions,
+                                             const PropagateAdjointsOptions &options = PropagateAdjointsOptions());
+
+/**
+ *  Make a scalar Func that is true if every value of the single valued
+ *  Func gradient over the given region, as (min, extent) pairs, is finite. This is the overflow
+ *  check for dynamic loss scaling: realize it along with the gradients,
+ *  and if it's false, skip the step and reduce the loss scale, then
+ *  grow the loss scale again after a run of good steps.
+ */
+Func all_finite(const Func &gradient, const std::vector<std::pair<Expr, Expr>> &region);
+
+/**
+ *  The update rule used by optimizer_step.
+ */
+enum class Optimizer {
+    /** param -= learning_rate * gradient */
+    SGD,
+    /** velocity = momentum * velocity + gradient
+     *  param -= learning_rate * velocity */
+    Momentum,
+    /** The update from Kingma and Ba, "Adam: A Method for Stochastic
+     * Optimization", with bias correction. */
+    Adam
+};
+
+struct OptimizerOptions {
+    Optimizer optimizer = Optimizer::SGD;
+    /** The step size. Can depend on Params, so that it can change
+     * between steps without recompiling. */
+    Expr learning_rate = 0.01f;
+    /** The decay of the velocity with Momentum, or of the first
+     * moment estimate with Adam. */
+    float momentum = 0.9f;
+    /** The decay of the second moment estimate with Adam. */
+    float beta2 = 0.999f;
+    /** Added to the denominator of the Adam update to avoid division
+     * by zero. */
+    float epsilon = 1e-8f;
+    /** The index of this step, starting from one, which the Adam bias
+     * correction depends on. Usually a Param<int>. */
+    Expr step = 1;
+};
+
+/**
+ *  Make a Func that applies one step of the given optimizer to the
+ *  pure, single-valued Func param, using its gradient from d. The
+ *  state holds the optimizer state for param, in the same form as
+ *  param: none for SGD, the velocity for Momentum, and the first and
+ *  second moment estimates for Adam. The result is a Tuple with the
+ *  new value of param followed by the new state, all computed in one
+ *  pass, so it can be realized in place into the Buffers that param
+ *  and state read from, in the same pipeline as the gradient. This
+ *  is safe as long as the gradient and everything else that reads
+ *  those Buffers is compute_root.
+ */
+Func optimizer_step(const Derivative &d,
+                    const Func &param,
+                    const std::vector<Func> &state = std::vector<Func>(),
+                    const OptimizerOptions &options = OptimizerOptions());
 
 struct PrintFuncOptions {
     bool ignore_non_adjoints = false;
@@ -266,8 +266,172 @@ std::vector<Expr> sort_expressions(const Expr &expr) {
     return sorter.sort(expr);
 }
 
+// Like boxes_required, but the branches of a select are only bounded
+// over the points where they are selected: the adjoint of a call in the
+// branch that isn't taken is zero.
+class AdjointBoxes : public IRVisitor {
+public:
+    using IRVisitor::visit;
+
+    AdjointBoxes(Scope<Interval> &scope) : scope(scope) {}
+
+    std::map<std::string, Box> boxes;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type != Call::Halide && op->call_type != Call::Image) {
+            return;
+        }
+        Box box;
+        for (const auto &arg : op->args) {
+            box.push_back(bounds_of_expr_in_scope(arg, scope));
+        }
+        auto it = boxes.find(op->name);
+        if (it == boxes.end()) {
+            boxes[op->name] = box;
+        } else {
+            it->second = box_union(it->second, box);
+        }
+    }
+
+    void visit(const Let *op) {
+        op->value.accept(this);
+        scope.push(op->name, bounds_of_expr_in_scope(op->value, scope));
+        op->body.accept(this);
+        scope.pop(op->name);
+    }
+
+    void visit(const Select *op) {
+        op->condition.accept(this);
+        visit_where(op->true_value, op->condition);
+        visit_where(op->false_value, simplify(!op->condition));
+    }
+
+private:
+    Scope<Interval> &scope;
+
+    // Visit an expression with the integer variables compared in a
+    // conjunction of conditions narrowed to the points where it holds.
+    void visit_where(const Expr &expr, const Expr &condition) {
+        std::vector<Expr> conditions;
+        std::vector<Expr> pending{ condition };
+        while (!pending.empty()) {
+            Expr c = pending.back();
+            pending.pop_back();
+            if (const And *a = c.as<And>()) {
+                pending.push_back(a->a);
+                pending.push_back(a->b);
+            } else {
+                conditions.push_back(c);
+            }
+        }
+        std::vector<std::string> pushed;
+        for (const auto &c : conditions) {
+            narrow(c, pushed);
+        }
+        expr.accept(this);
+        for (const auto &name : pushed) {
+            scope.pop(name);
+        }
+    }
+
+    void narrow(const Expr &c, std::vector<std::string> &pushed) {
+        Expr a, b;
+        bool lower = false, upper = false;
+        int offset = 0;
+        // Put the comparison in the form a <= b (upper), a >= b (lower),
+        // or both, with a strict comparison moving b by one.
+        if (const LT *op = c.as<LT>()) {
+            a = op->a, b = op->b, upper = true, offset = -1;
+        } else if (const LE *op = c.as<LE>()) {
+            a = op->a, b = op->b, upper = true;
+        } else if (const GT *op = c.as<GT>()) {
+            a = op->a, b = op->b, lower = true, offset = 1;
+        } else if (const GE *op = c.as<GE>()) {
+            a = op->a, b = op->b, lower = true;
+        } else if (const EQ *op = c.as<EQ>()) {
+            a = op->a, b = op->b, lower = upper = true;
+        } else {
+            return;
+        }
+        const Variable *var = a.as<Variable>();
+        if (var == nullptr) {
+            // b op a, with the comparison flipped.
+            var = b.as<Variable>();
+            std::swap(a, b);
+            std::swap(lower, upper);
+            offset = -offset;
+        }
+        if (var == nullptr || !var->type.is_int() ||
+            !scope.contains(var->name) || has_variable(b, var->name)) {
+            return;
+        }
+        Interval bound = bounds_of_expr_in_scope(b, scope);
+        Interval interval = scope.get(var->name);
+        if (upper && bound.has_upper_bound()) {
+            interval.max = interval.has_upper_bound() ?
+                simplify(min(interval.max, bound.max + offset)) : bound.max + offset;
+        }
+        if (lower && bound.has_lower_bound()) {
+            interval.min = interval.has_lower_bound() ?
+                simplify(max(interval.min, bound.min + offset)) : bound.min + offset;
+        }
+        scope.push(var->name, interval);
+        pushed.push_back(var->name);
+    }
+};
+
+std::map<std::string, Box> adjoint_boxes(const Expr &expr, Scope<Interval> &scope) {
+    AdjointBoxes boxes(scope);
+    expr.accept(&boxes);
+    return boxes.boxes;
+}
+
+// Does an expression call a Func at a point other than the given one?
+class CallsElsewhere : public IRVisitor {
+public:
+    using IRVisitor::visit;
+
+    CallsElsewhere(const std::string &name, const std::vector<Expr> &args)
+        : name(name), args(args) {}
+
+    bool result = false;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == name) {
+            for (int i = 0; i < (int) args.size(); i++) {
+                result = result || !equal(op->args[i], args[i]);
+            }
+        }
+    }
+
+private:
+    const std::string &name;
+    const std::vector<Expr> &args;
+};
+
+// Do the update definitions of a Func only read it at the point they
+// update?
+bool reads_only_updated_point(const Func &func) {
+    for (int update_id = 0; update_id < func.num_update_definitions(); update_id++) {
+        std::vector<Expr> update_args = func.update_args(update_id);
+        std::vector<Expr> exprs = func.update_values(update_id).as_vector();
+        exprs.insert(exprs.end(), update_args.begin(), update_args.end());
+        for (const auto &expr : exprs) {
+            CallsElsewhere calls(func.name(), update_args);
+            expr.accept(&calls);
+            if (calls.result) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 std::map<std::string, Box> inference_bounds(const std::vector<Func> &funcs,
-                                            const std::vector<FuncBounds> &output_bounds) {
+                                            const std::vector<FuncBounds> &output_bounds,
+                                            bool adjoint_support) {
     assert(funcs.size() == output_bounds.size());
     // Obtain all dependencies
     std::vector<Function> functions;
@@ -308,27 +472,75 @@ std::map<std::string, Box> inference_bounds(const std::vector<Func> &funcs,
         Box func_bounds_box(func_bounds_interval);
         bounds[func.name()] = func_bounds_box;
     }
+    auto simplify_box = [](Box &box) {
+        for (int i = 0; i < (int) box.size(); i++) {
+            box[i].min = simplify(box[i].min);
+            box[i].max = simplify(box[i].max);
+        }
+    };
     // Traverse from the consumers to the producers
     for (auto it = order.rbegin(); it != order.rend(); it++) {
         Func func = Func(env[*it]);
         // We should already have the bounds of this function
         assert(bounds.find(*it) != bounds.end());
-        const Box &current_bounds = bounds[*it];
+        // All the consumers have been visited, so the bounds are final.
+        // Simplify them before they get propagated to the producers,
+        // otherwise the unions of the bounds grow with the depth of the
+        // pipeline.
+        Box &current_bounds = bounds[*it];
+        simplify_box(current_bounds);
         assert(func.args().size() == current_bounds.size());
         // We know the range for each argument of this function
         for (int i = 0; i < (int) current_bounds.size(); i++) {
             std::string arg = func.args()[i].name();
             scope.push(arg, current_bounds[i]);
         }
+        if (func.function().has_extern_definition()) {
+            // We can't tell which regions of its inputs an extern stage reads
+            for (const auto &arg : func.function().extern_arguments()) {
+                if (arg.is_func()) {
+                    Function f(arg.func);
+                    Box box;
+                    for (int i = 0; i < f.dimensions(); i++) {
+                        box.push_back(Interval::everything());
+                    }
+                    bounds[f.name()] = box;
+                }
+            }
+            for (int i = 0; i < (int) current_bounds.size(); i++) {
+                scope.pop(func.args()[i].name());
+            }
+            continue;
+        }
+        // The adjoint of this function is zero outside its bounds, so
+        // the points an update writes outside them don't propagate any
+        // adjoint to the producers. Unless another update reads them back.
+        bool narrow_rvars = adjoint_support && reads_only_updated_point(func);
         // Propagate the bounds
         for (int update_id = -1; update_id < func.num_update_definitions(); update_id++) {
+            std::vector<std::string> narrowed;
+            if (narrow_rvars && update_id >= 0) {
+                std::vector<Expr> update_args = func.update_args(update_id);
+                for (int i = 0; i < (int) update_args.size(); i++) {
+                    const Variable *var = update_args[i].as<Variable>();
+                    if (var != nullptr && var->reduction_domain.defined() &&
+                        scope.contains(var->name)) {
+                        Interval interval = Interval::make_intersection(
+                            scope.get(var->name), current_bounds[i]);
+                        interval.min = simplify(interval.min);
+                        interval.max = simplify(interval.max);
+                        scope.push(var->name, interval);
+                        narrowed.push_back(var->name);
+                    }
+                }
+            }
             // For each rhs expression
             Tuple tuple = update_id == -1 ? func.values() : func.update_values(update_id);
             for (const auto &expr : tuple.as_vector()) {
                 // For all the immediate dependencies of this expression,
                 // find the required ranges
-                std::map<std::string, Box> update_bounds =
-                    boxes_required(expr, scope);
+                std::map<std::string, Box> update_bounds = adjoint_support ?
+                    adjoint_boxes(expr, scope) : boxes_required(expr, scope);
                 // Loop over the dependencies
                 for (const auto &it : update_bounds) {
                     // Update the bounds, if not exists then create a new one
@@ -341,25 +553,29 @@ std::map<std::string, Box> inference_bounds(const std::vector<Func> &funcs,
                     }
                 }
             }
+            for (const auto &name : narrowed) {
+                scope.pop(name);
+            }
         }
         for (int i = 0; i < (int) current_bounds.size(); i++) {
             scope.pop(func.args()[i].name());
         }
     }
+    // The bounds of the buffers haven't been simplified yet
     for (auto &it : bounds) {
-        auto &bound = it.second;
-        for (int i = 0; i < (int) bound.size(); i++) {
-            bound[i].min = simplify(bound[i].min);
-            bound[i].max = simplify(bound[i].max);
+        if (env.find(it.first) == env.end()) {
+            simplify_box(it.second);
         }
     }
     return bounds;
 }
 
 std::map<std::string, Box> inference_bounds(const Func &func,
-                                            const FuncBounds &output_bounds) {
+                                            const FuncBounds &output_bounds,
+                                            bool adjoint_support) {
     return inference_bounds(std::vector<Func>{ func },
-                            std::vector<FuncBounds>{ output_bounds });
+                            std::vector<FuncBounds>{ output_bounds },
+                            adjoint_support);
 }
 
 std::vector<std::pair<Expr, Expr>> box_to_vector(const Box &bounds) {
@@ -451,6 +667,22 @@ public:
     using IRGraphVisitor::visit;
     std::map<std::string, BufferInfo> find(const Func &func) {
         buffer_calls.clear();
+        if (func.function().has_extern_definition()) {
+            for (const auto &arg : func.function().extern_arguments()) {
+                if (arg.is_buffer()) {
+                    buffer_calls[arg.buffer.name()] = BufferInfo{
+                        arg.buffer.dimensions(),
+                        arg.buffer.type()
+                    };
+                } else if (arg.is_image_param()) {
+                    buffer_calls[arg.image_param.name()] = BufferInfo{
+                        arg.image_param.dimensions(),
+                        arg.image_param.type()
+                    };
+                }
+            }
+            return buffer_calls;
+        }
         std::vector<Expr> vals = func.values().as_vector();
         for (Expr val : vals) {
             val.accept(this);
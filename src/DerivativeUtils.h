@@ -55,12 +55,17 @@ Expr add_let_expression(const Expr &expr,
  */
 std::vector<Expr> sort_expressions(const Expr &expr);
 /**
- * Compute the bounds of funcs
+ * Compute the bounds of funcs. With adjoint_support, compute the regions
+ * over which their adjoints can be nonzero instead: the branches of a
+ * select are only bounded where they are selected, and the points an
+ * update writes outside the bounds of its Func are left out.
  */
 std::map<std::string, Box> inference_bounds(const std::vector<Func> &funcs,
-                                            const std::vector<FuncBounds> &output_bounds);
+                                            const std::vector<FuncBounds> &output_bounds,
+                                            bool adjoint_support = false);
 std::map<std::string, Box> inference_bounds(const Func &func,
-                                            const FuncBounds &output_bounds);
+                                            const FuncBounds &output_bounds,
+                                            bool adjoint_support = false);
 /**
  * Convert Box to vector of (min, extent)
  */
@@ -63,13 +63,19 @@ struct DeviceArgument {
     /** Alignment information for integer parameters. */
     ModulusRemainder alignment;
 
+    /** For buffers, GPUConstant if the kernel reads the buffer from
+     * constant memory, which it was either scheduled in or selected
+     * for, and Auto otherwise. */
+    MemoryType memory_type;
+
     DeviceArgument() :
         is_buffer(false),
         dimensions(0),
         size(0),
         packed_index(0),
         read(false),
-        write(false) {}
+        write(false),
+        memory_type(MemoryType::Auto) {}
 
     DeviceArgument(const std::string &_name,
                    bool _is_buffer,
@@ -83,7 +89,8 @@ struct DeviceArgument {
         size(_size),
         packed_index(0),
         read(_is_buffer),
-        write(_is_buffer) {}
+        write(_is_buffer),
+        memory_type(MemoryType::Auto) {}
 };
 
 /** A Closure modified to inspect GPU-specific memory accesses, and
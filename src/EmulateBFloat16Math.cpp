@@ -0,0 +1,174 @@
+#include "EmulateBFloat16Math.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+// A bfloat16 is the upper half of a float, so widening its bits is exact.
+Expr bfloat_to_float(const Expr &bits) {
+    Type u32 = UInt(32, bits.type().lanes());
+    Expr wide = Cast::make(u32, bits) << make_const(u32, 16);
+    return Call::make(Float(32, u32.lanes()), Call::reinterpret, {wide}, Call::PureIntrinsic);
+}
+
+// Round a float to the bits of the nearest bfloat16, with ties going
+// to even. NaNs are kept quiet, rather than rounded to infinity.
+Expr float_to_bfloat(const Expr &f) {
+    Type u32 = UInt(32, f.type().lanes());
+    Expr bits = Call::make(u32, Call::reinterpret, {f}, Call::PureIntrinsic);
+    Expr upper = bits >> make_const(u32, 16);
+    Expr rounded = (bits + make_const(u32, 0x7fff) + (upper & make_const(u32, 1))) >> make_const(u32, 16);
+    Expr nan = upper | make_const(u32, 0x40);
+    Expr is_nan = (bits & make_const(u32, 0x7fffffff)) > make_const(u32, 0x7f800000);
+    return Cast::make(UInt(16, u32.lanes()), Select::make(is_nan, nan, rounded));
+}
+
+Type bits_of(Type t) {
+    return t.is_bfloat() ? t.with_code(Type::UInt) : t;
+}
+
+class EmulateBFloat16Math : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // The value of a bfloat16 expression as a float
+    Expr widen(const Expr &e) {
+        return bfloat_to_float(mutate(e));
+    }
+
+    template<typename T>
+    Expr visit_arithmetic(const T *op) {
+        if (op->type.is_bfloat()) {
+            return float_to_bfloat(T::make(widen(op->a), widen(op->b)));
+        }
+        return IRMutator2::visit(op);
+    }
+
+    template<typename T>
+    Expr visit_comparison(const T *op) {
+        if (op->a.type().is_bfloat()) {
+            return T::make(widen(op->a), widen(op->b));
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Add *op) override { return visit_arithmetic(op); }
+    Expr visit(const Sub *op) override { return visit_arithmetic(op); }
+    Expr visit(const Mul *op) override { return visit_arithmetic(op); }
+    Expr visit(const Div *op) override { return visit_arithmetic(op); }
+    Expr visit(const Mod *op) override { return visit_arithmetic(op); }
+    Expr visit(const Min *op) override { return visit_arithmetic(op); }
+    Expr visit(const Max *op) override { return visit_arithmetic(op); }
+    Expr visit(const EQ *op) override { return visit_comparison(op); }
+    Expr visit(const NE *op) override { return visit_comparison(op); }
+    Expr visit(const LT *op) override { return visit_comparison(op); }
+    Expr visit(const LE *op) override { return visit_comparison(op); }
+    Expr visit(const GT *op) override { return visit_comparison(op); }
+    Expr visit(const GE *op) override { return visit_comparison(op); }
+
+    Expr visit(const FloatImm *op) override {
+        if (op->type.is_bfloat()) {
+            return make_const(UInt(16), bfloat16_t(op->value).to_bits());
+        }
+        return op;
+    }
+
+    Expr visit(const Cast *op) override {
+        Type from = op->value.type();
+        if (from.is_bfloat() && op->type.is_bfloat()) {
+            return mutate(op->value);
+        } else if (from.is_bfloat()) {
+            Expr f = widen(op->value);
+            return f.type() == op->type ? f : Cast::make(op->type, f);
+        } else if (op->type.is_bfloat()) {
+            Expr value = mutate(op->value);
+            Type f32 = Float(32, op->type.lanes());
+            if (value.type() != f32) {
+                value = Cast::make(f32, value);
+            }
+            return float_to_bfloat(value);
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Ramp *op) override {
+        if (op->type.is_bfloat()) {
+            return float_to_bfloat(Ramp::make(widen(op->base), widen(op->stride), op->lanes));
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Variable *op) override {
+        if (op->type.is_bfloat()) {
+            return Variable::make(bits_of(op->type), op->name, op->image, op->param, op->reduction_domain);
+        }
+        return op;
+    }
+
+    Expr visit(const Load *op) override {
+        if (op->type.is_bfloat()) {
+            return Load::make(bits_of(op->type), op->name, mutate(op->index),
+                              op->image, op->param, mutate(op->predicate));
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Call *op) override {
+        bool bfloat_args = false;
+        for (const Expr &e : op->args) {
+            bfloat_args = bfloat_args || e.type().is_bfloat();
+        }
+        if (!bfloat_args && !op->type.is_bfloat()) {
+            return IRMutator2::visit(op);
+        }
+
+        if (op->is_intrinsic(Call::abs)) {
+            // Clear the sign bit
+            return mutate(op->args[0]) & make_const(UInt(16, op->type.lanes()), 0x7fff);
+        } else if (op->is_intrinsic(Call::absd) || op->is_intrinsic(Call::lerp)) {
+            // These do arithmetic on their arguments, so do it in float.
+            std::vector<Expr> args;
+            for (const Expr &e : op->args) {
+                args.push_back(e.type().is_bfloat() ? widen(e) : mutate(e));
+            }
+            Type t = op->type.is_bfloat() ? Float(32, op->type.lanes()) : op->type;
+            Expr result = Call::make(t, op->name, args, op->call_type,
+                                     op->func, op->value_index, op->image, op->param);
+            return op->type.is_bfloat() ? float_to_bfloat(result) : result;
+        }
+
+        // Everything else, including reinterpret and extern calls, only
+        // moves the bits around.
+        std::vector<Expr> args;
+        for (const Expr &e : op->args) {
+            args.push_back(mutate(e));
+        }
+        return Call::make(bits_of(op->type), op->name, args, op->call_type,
+                          op->func, op->value_index, op->image, op->param);
+    }
+
+    Stmt visit(const Allocate *op) override {
+        if (op->type.is_bfloat()) {
+            std::vector<Expr> extents;
+            for (const Expr &e : op->extents) {
+                extents.push_back(mutate(e));
+            }
+            Expr new_expr = op->new_expr.defined() ? mutate(op->new_expr) : Expr();
+            return Allocate::make(op->name, bits_of(op->type), op->memory_type, extents,
+                                  mutate(op->condition), mutate(op->body),
+                                  new_expr, op->free_function);
+        }
+        return IRMutator2::visit(op);
+    }
+};
+
+}  // namespace
+
+Stmt emulate_bfloat16_math(Stmt s) {
+    return EmulateBFloat16Math().mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
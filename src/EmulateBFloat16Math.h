@@ -0,0 +1,23 @@
+#ifndef HALIDE_EMULATE_BFLOAT16_MATH_H
+#define HALIDE_EMULATE_BFLOAT16_MATH_H
+
+/** \file
+ * Defines the lowering pass that implements bfloat16 math with float math
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Replace all bfloat16 values by their bits, as uint16. Arithmetic
+ * and comparisons on them are widened to float, and the results are
+ * rounded back to the nearest bfloat16. Loads, stores and allocations
+ * keep their size, so bfloat16 buffers are half the size of float
+ * ones. */
+Stmt emulate_bfloat16_math(Stmt s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -65,6 +65,7 @@ enum class IRNodeType {
     Evaluate,
     Shuffle,
     Prefetch,
+    VectorReduce,
 };
 
 /** The abstract base classes for a node in the Halide IR. */
@@ -78,6 +79,15 @@ struct IRNode {
     IRNode(IRNodeType t) : node_type(t) {}
     virtual ~IRNode() {}
 
+    /** Lowering creates and frees millions of short-lived IR nodes,
+     * so their memory is recycled through per-thread free lists of
+     * blocks of a few sizes, instead of going back to the system
+     * allocator every time. Nodes may be freed from any thread. */
+    // @{
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+    // @}
+
     /** These classes are all managed with intrusive reference
      * counting, so we also track a reference count. It's mutable
      * so that we can do reference counting even through const
@@ -239,7 +249,11 @@ struct FloatImm : public ExprNode<FloatImm> {
         node->type = t;
         switch (t.bits()) {
         case 16:
-            node->value = (double)((float16_t)value);
+            if (t.is_bfloat()) {
+                node->value = (double)((bfloat16_t)value);
+            } else {
+                node->value = (double)((float16_t)value);
+            }
             break;
         case 32:
             node->value = (float)value;
@@ -294,6 +308,7 @@ struct Expr : public Internal::IRHandle {
     explicit Expr(uint32_t x)  : IRHandle(Internal::UIntImm::make(UInt(32), x)) {}
     explicit Expr(uint64_t x)  : IRHandle(Internal::UIntImm::make(UInt(64), x)) {}
              Expr(float16_t x) : IRHandle(Internal::FloatImm::make(Float(16), (double)x)) {}
+             Expr(bfloat16_t x) : IRHandle(Internal::FloatImm::make(BFloat(16), (double)x)) {}
              Expr(float x)     : IRHandle(Internal::FloatImm::make(Float(32), x)) {}
     explicit Expr(double x)    : IRHandle(Internal::FloatImm::make(Float(64), x)) {}
     // @}
@@ -368,6 +383,25 @@ enum class MemoryType {
      * "local" in OpenCL, and "threadgroup" in metal. Can be shared
      * across GPU threads within the same block. */
     GPUShared,
+
+    /** Vector Tightly Coupled Memory. HVX (Hexagon) local memory
+     * available on v65+. Allocated using halide_vtcm_malloc, which
+     * falls back to ordinary heap memory if VTCM is unavailable or
+     * exhausted. Gathers from one VTCM allocation into another may be
+     * lowered to vgather instructions. */
+    VTCM,
+
+    /** Read-only GPU constant memory, for small buffers that the
+     * threads of a block read at the same coordinates, such as filter
+     * taps or lookup tables: these reads are broadcast to the threads
+     * from a dedicated cache. The buffer is computed like a buffer in
+     * Heap memory, outside of the kernels reading it, and must have a
+     * constant size of at most 64 KB. Kernels may not write to it. On
+     * CUDA, it is copied into the constant memory of the kernel before
+     * each launch; on OpenCL, it is passed in the __constant address
+     * space if the device has room for it. Read from global memory on
+     * other devices. */
+    GPUConstant,
 };
 
 namespace Internal {
@@ -336,6 +336,22 @@ float half_to_float(const uint16_t& value) {
     uint32_t bits = (mantissa_table[offset] + exponent_table[sign_and_exponent]);
     return reinterpret_bits<float>(bits);
 }
+
+uint16_t float_to_bfloat(float value) {
+    uint32_t bits = reinterpret_bits<uint32_t>(value);
+    if (std::isnan(value)) {
+        // Keep NaNs quiet, rather than letting them round to infinity
+        return (bits >> 16) | 0x0040;
+    }
+    // Round to nearest with ties going to even
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+float bfloat_to_float(uint16_t value) {
+    return reinterpret_bits<float>((uint32_t)value << 16);
+}
+
 }  // namespace Internal
 
 using namespace Halide::Internal;
@@ -429,4 +445,90 @@ uint16_t float16_t::to_bits() const {
     return data;
 }
 
+bfloat16_t::bfloat16_t(float value) : data(float_to_bfloat(value)) {}
+
+bfloat16_t::bfloat16_t(double value) : data(float_to_bfloat(value)) {}
+
+bfloat16_t::bfloat16_t(int value) : data(float_to_bfloat(value)) {}
+
+bfloat16_t::bfloat16_t() : data(0) {}
+
+bfloat16_t::operator float() const {
+    return bfloat_to_float(data);
+}
+
+bfloat16_t::operator double() const {
+    return bfloat_to_float(data);
+}
+
+bfloat16_t bfloat16_t::make_from_bits(uint16_t bits) {
+    bfloat16_t f;
+    f.data = bits;
+    return f;
+}
+
+bfloat16_t bfloat16_t::make_zero(bool positive) {
+    return bfloat16_t::make_from_bits(positive ? 0 : 0x8000);
+}
+
+bfloat16_t bfloat16_t::make_infinity(bool positive) {
+    return bfloat16_t::make_from_bits(positive ? 0x7f80 : 0xff80);
+}
+
+bfloat16_t bfloat16_t::make_nan() {
+    return bfloat16_t::make_from_bits(0x7fc0);
+}
+
+bfloat16_t bfloat16_t::operator-() const {
+    return bfloat16_t::make_from_bits(data ^ 0x8000);
+}
+
+bfloat16_t bfloat16_t::operator+(bfloat16_t rhs) const {
+    return bfloat16_t(bfloat_to_float(data) + bfloat_to_float(rhs.data));
+}
+
+bfloat16_t bfloat16_t::operator-(bfloat16_t rhs) const {
+    return bfloat16_t(bfloat_to_float(data) - bfloat_to_float(rhs.data));
+}
+
+bfloat16_t bfloat16_t::operator*(bfloat16_t rhs) const {
+    return bfloat16_t(bfloat_to_float(data) * bfloat_to_float(rhs.data));
+}
+
+bfloat16_t bfloat16_t::operator/(bfloat16_t rhs) const {
+    return bfloat16_t(bfloat_to_float(data) / bfloat_to_float(rhs.data));
+}
+
+bool bfloat16_t::operator==(bfloat16_t rhs) const {
+    return bfloat_to_float(data) == bfloat_to_float(rhs.data);
+}
+
+bool bfloat16_t::operator>(bfloat16_t rhs) const {
+    return bfloat_to_float(data) > bfloat_to_float(rhs.data);
+}
+
+bool bfloat16_t::operator<(bfloat16_t rhs) const {
+    return bfloat_to_float(data) < bfloat_to_float(rhs.data);
+}
+
+bool bfloat16_t::is_nan() const {
+    return ((data & 0x7f80) == 0x7f80) && (data & 0x007f);
+}
+
+bool bfloat16_t::is_infinity() const {
+    return ((data & 0x7f80) == 0x7f80) && !(data & 0x007f);
+}
+
+bool bfloat16_t::is_negative() const {
+    return data & 0x8000;
+}
+
+bool bfloat16_t::is_zero() const {
+    return !(data & 0x7fff);
+}
+
+uint16_t bfloat16_t::to_bits() const {
+    return data;
+}
+
 }  // namespace Halide
@@ -24,6 +24,7 @@
 #include "LLVM_Output.h"
 #include "Lower.h"
 #include "Outputs.h"
+#include "ParallelRVar.h"
 #include "Param.h"
 #include "PrintLoopNest.h"
 #include "Simplify.h"
@@ -280,6 +281,103 @@ bool var_name_match(string candidate, string var) {
     if (candidate == var) return true;
     return Internal::ends_with(candidate, "." + var);
 }
+
+class CallsFunc : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    const string &func;
+
+    void visit(const Call *op) {
+        result = result || (op->call_type == Call::Halide && op->name == func);
+        IRGraphVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+    CallsFunc(const string &func) : func(func) {}
+};
+
+// Is an update a combination of the value at the point it writes with
+// something else, by one of the operators of VectorReduce, at a point
+// that doesn't depend on the RDom? E.g. f(x) = f(x) + g(x, r). The lanes
+// of a loop over an RVar of such an update can be vectorized and then
+// reduced, as long as the other operand varies with every RVar the loop
+// was made from. (If it doesn't, e.g. f(x) = f(x) + 1, the lanes are
+// one value and there is nothing to reduce.)
+bool is_vectorizable_reduction(const Definition &def, const string &func, const string &var) {
+    if (def.values().size() != 1 || def.values()[0].type().is_bool()) {
+        return false;
+    }
+
+    // Find the RVars the loop over var is made from, by walking the
+    // splits backwards.
+    std::set<string> sources = {var};
+    const vector<Split> &splits = def.schedule().splits();
+    for (size_t i = splits.size(); i > 0; i--) {
+        const Split &s = splits[i-1];
+        if (s.is_fuse()) {
+            if (sources.count(s.old_var)) {
+                sources.insert(s.outer);
+                sources.insert(s.inner);
+            }
+        } else if (sources.count(s.outer) || (s.is_split() && sources.count(s.inner))) {
+            sources.insert(s.old_var);
+        }
+    }
+    vector<string> vectorized_rvars;
+    for (const ReductionVariable &rv : def.schedule().rvars()) {
+        if (sources.count(rv.var)) {
+            vectorized_rvars.push_back(rv.var);
+        }
+    }
+    if (vectorized_rvars.empty()) {
+        return false;
+    }
+
+    for (const Expr &arg : def.args()) {
+        for (const ReductionVariable &rv : def.schedule().rvars()) {
+            if (expr_uses_var(arg, rv.var)) {
+                return false;
+            }
+        }
+    }
+
+    Expr value = def.values()[0], a, b;
+    if (const Add *op = value.as<Add>()) {
+        a = op->a, b = op->b;
+    } else if (const Mul *op = value.as<Mul>()) {
+        a = op->a, b = op->b;
+    } else if (const Min *op = value.as<Min>()) {
+        a = op->a, b = op->b;
+    } else if (const Max *op = value.as<Max>()) {
+        a = op->a, b = op->b;
+    } else {
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++, std::swap(a, b)) {
+        const Call *self = a.as<Call>();
+        if (!self || self->call_type != Call::Halide || self->name != func ||
+            self->args.size() != def.args().size()) {
+            continue;
+        }
+        bool same_point = true;
+        for (size_t j = 0; j < self->args.size(); j++) {
+            same_point = same_point && equal(self->args[j], def.args()[j]);
+        }
+        CallsFunc calls(func);
+        b.accept(&calls);
+        if (!same_point || calls.result) {
+            continue;
+        }
+        bool varies = true;
+        for (const string &rv : vectorized_rvars) {
+            varies = varies && expr_uses_var(b, rv);
+        }
+        return varies;
+    }
+    return false;
+}
 }
 
 std::string Stage::name() const {
@@ -297,8 +395,11 @@ void Stage::set_dim_type(VarOrRVar var, ForType t) {
             dims[i].for_type = t;
 
             // If it's an rvar and the for type is parallel, we need to
-            // validate that this doesn't introduce a race condition.
+            // validate that this doesn't introduce a race condition. A
+            // vectorized reduction into one point reduces its lanes
+            // instead (see VectorReduce).
             if (!dims[i].is_pure() && var.is_rvar &&
+                !(t == ForType::Vectorized && is_vectorizable_reduction(definition, function.name(), dims[i].var)) &&
                 (t == ForType::Vectorized || t == ForType::Parallel ||
                  t == ForType::GPUBlock || t == ForType::GPUThread ||
                  t == ForType::GPULane)) {
@@ -899,6 +1000,144 @@ Func Stage::rfactor(vector<pair<RVar, Var>> preserved) {
     return intm;
 }
 
+Func Stage::parallel_scan(RVar r, Var u, Expr block_size) {
+    user_assert(stage_index == 1)
+        << "parallel_scan() must be called on the first update definition of a Func, "
+        << "not on " << name() << "\n";
+
+    const string &func_name = function.name();
+    vector<Expr> &args = definition.args();
+    vector<Expr> &values = definition.values();
+    const vector<ReductionVariable> &rvars = definition.schedule().rvars();
+
+    user_assert(values.size() == 1)
+        << "In schedule for " << name() << ", can't perform parallel_scan() on a Tuple\n";
+    user_assert(rvars.size() == 1 && var_name_match(rvars[0].var, r.name()))
+        << "In schedule for " << name() << ", can't perform parallel_scan() on " << r.name()
+        << " since it is not the only dimension of the reduction domain\n";
+    user_assert(definition.schedule().splits().empty() && definition.split_predicate().empty())
+        << "In schedule for " << name() << ", parallel_scan() must be called before "
+        << "any other scheduling of the update, and on a reduction domain without a where clause\n";
+    for (const Var &v : dim_vars) {
+        user_assert(v.name() != u.name())
+            << "In schedule for " << name() << ", can't use " << u.name()
+            << " for the blocks of parallel_scan(), since it is a Var of " << func_name << "\n";
+    }
+
+    const ReductionVariable rv = rvars[0];
+
+    // The scan must store to f(..., r, ...), where the other args are
+    // the pure Vars.
+    int d = -1;
+    for (size_t i = 0; i < args.size(); i++) {
+        const Variable *v = args[i].as<Variable>();
+        if (v && v->name == rv.var && d < 0) {
+            d = (int)i;
+        } else {
+            user_assert(v && v->name == dim_vars[i].name())
+                << "In schedule for " << name() << ", can't perform parallel_scan(), "
+                << "since argument " << i << " of the update is neither " << r.name()
+                << " nor the pure Var " << dim_vars[i].name() << "\n";
+        }
+    }
+    user_assert(d >= 0)
+        << "In schedule for " << name() << ", can't perform parallel_scan() on " << r.name()
+        << " since the update doesn't store to f(..., " << r.name() << ", ...)\n";
+
+    // Prove that the update combines the value at the previous point
+    // of the scan, f(..., r - 1, ...), with something else by an
+    // associative operator.
+    vector<Expr> prev_args = args;
+    prev_args[d] = args[d] - 1;
+    const auto &prover_result = prove_associativity(func_name, prev_args, values);
+    user_assert(prover_result.associative() &&
+                !prover_result.xs[0].var.empty() &&
+                !prover_result.ys[0].var.empty())
+        << "Failed to call parallel_scan() on " << name()
+        << " since it can't prove that it's an associative scan along " << r.name() << "\n";
+
+    const string &x_name = prover_result.xs[0].var;
+    const string &y_name = prover_result.ys[0].var;
+    auto combine = [&](Expr a, Expr b) {
+        return substitute({{x_name, a}, {y_name, b}}, prover_result.pattern.ops[0]);
+    };
+
+    // The scans of each block, starting from the identity:
+    //   f_scan_blocks(..., i, ..., u) = identity
+    //   f_scan_blocks(..., ri, ..., u) = f_scan_blocks(..., ri - 1, ..., u) op g(min + u*block_size + ri)
+    // The part of the last block past the end of the scan stays at the
+    // identity.
+    Func blocks(func_name + "_scan_blocks");
+    vector<Var> blocks_vars = dim_vars;
+    blocks_vars.push_back(u);
+    blocks(blocks_vars) = prover_result.pattern.identities[0];
+
+    RDom ri(0, block_size, func_name + "_scan_ri");
+    Expr pos = rv.min + u * block_size + ri;
+    ri.where(pos < rv.min + rv.extent);
+    vector<Expr> blocks_args(dim_vars.begin(), dim_vars.end());
+    blocks_args[d] = ri;
+    blocks_args.push_back(u);
+    vector<Expr> blocks_prev = blocks_args;
+    blocks_prev[d] = ri - 1;
+    blocks(blocks_args) = combine(blocks(blocks_prev), substitute(rv.var, pos, prover_result.ys[0].expr));
+    blocks.compute_root();
+
+    // The value of the scan before each block. This is the first
+    // update, so before the first block it's the pure definition.
+    //   f_scan_carry(..., 0) = f(..., min - 1, ...)
+    //   f_scan_carry(..., rb) = f_scan_carry(..., rb - 1) op f_scan_blocks(..., block_size - 1, ..., rb - 1)
+    Func carry(func_name + "_scan_carry");
+    vector<Var> carry_vars;
+    for (int i = 0; i < (int)dim_vars.size(); i++) {
+        if (i != d) {
+            carry_vars.push_back(dim_vars[i]);
+        }
+    }
+    carry_vars.push_back(u);
+    carry(carry_vars) = substitute(dim_vars[d].name(), rv.min - 1, function.definition().values()[0]);
+
+    Expr num_blocks = (rv.extent + block_size - 1) / block_size;
+    RDom rb(1, num_blocks - 1, func_name + "_scan_rb");
+    vector<Expr> carry_args(carry_vars.begin(), carry_vars.end());
+    carry_args.back() = rb;
+    vector<Expr> carry_prev = carry_args;
+    carry_prev.back() = rb - 1;
+    vector<Expr> block_total(dim_vars.begin(), dim_vars.end());
+    block_total[d] = block_size - 1;
+    block_total.push_back(rb - 1);
+    carry(carry_args) = combine(carry(carry_prev), blocks(block_total));
+    carry.compute_root();
+
+    // Replace the update with one that doesn't depend on the previous
+    // point:
+    //   f(..., r, ...) = f_scan_carry(..., b) op f_scan_blocks(..., i, ..., b)
+    // where b and i are the block and the position in it of r.
+    Expr offset = args[d] - rv.min;
+    Expr block = offset / block_size;
+    vector<Expr> carry_at;
+    for (int i = 0; i < (int)dim_vars.size(); i++) {
+        if (i != d) {
+            carry_at.push_back(dim_vars[i]);
+        }
+    }
+    carry_at.push_back(block);
+    vector<Expr> blocks_at(dim_vars.begin(), dim_vars.end());
+    blocks_at[d] = offset % block_size;
+    blocks_at.push_back(block);
+    values[0] = combine(carry(carry_at), blocks(blocks_at));
+
+    // Each point of the new update is independent of the others.
+    for (Dim &dim : definition.schedule().dims()) {
+        if (dim.var == rv.var) {
+            dim.dim_type = can_parallelize_rvar(rv.var, func_name, definition) ?
+                Dim::Type::PureRVar : Dim::Type::ImpureRVar;
+        }
+    }
+
+    return blocks;
+}
+
 void Stage::split(const string &old, const string &outer, const string &inner, Expr factor, bool exact, TailStrategy tail) {
     debug(4) << "In schedule for " << name() << ", split " << old << " into "
              << outer << " and " << inner << " with factor of " << factor << "\n";
@@ -1413,6 +1652,15 @@ Stage &Stage::allow_race_conditions() {
     return *this;
 }
 
+Stage &Stage::atomic() {
+    user_assert(!definition.is_init())
+        << "In schedule for " << name()
+        << ", atomic() can only be applied to update definitions.\n";
+    definition.schedule().atomic() = true;
+    definition.schedule().allow_race_conditions() = true;
+    return *this;
+}
+
 Stage &Stage::serial(VarOrRVar var) {
     set_dim_type(var, ForType::Serial);
     return *this;
@@ -1445,6 +1693,21 @@ Stage &Stage::parallel(VarOrRVar var, Expr factor, TailStrategy tail) {
     return *this;
 }
 
+Stage &Stage::parallel(VarOrRVar var, ParallelPolicy policy, int chunk) {
+    user_assert(chunk > 0)
+        << "In schedule for " << name()
+        << ", the chunk size of the parallel loop over " << var.name()
+        << " must be positive.\n";
+    set_dim_type(var, ForType::Parallel);
+    for (Dim &dim : definition.schedule().dims()) {
+        if (var_name_match(dim.var, var.name())) {
+            dim.parallel_policy = policy;
+            dim.parallel_chunk = chunk;
+        }
+    }
+    return *this;
+}
+
 Stage &Stage::vectorize(VarOrRVar var, Expr factor, TailStrategy tail) {
     if (var.is_rvar) {
         RVar tmp;
@@ -1992,9 +2255,42 @@ Func &Func::allow_race_conditions() {
     return *this;
 }
 
-Func &Func::memoize() {
+Func &Func::memoize(int eviction_cost) {
+    user_assert(eviction_cost > 0)
+        << "The eviction cost of memoized Func " << name() << " must be positive.\n";
     invalidate_cache();
     func.schedule().memoized() = true;
+    func.schedule().memoize_eviction_cost() = eviction_cost;
+    return *this;
+}
+
+Func &Func::persist(Var t, int frames) {
+    user_assert(frames > 0)
+        << "The number of frames of persistent Func " << name() << " must be positive.\n";
+    user_assert(outputs() == 1)
+        << "Func " << name() << " has multiple values, so it can't be persistent.\n";
+    const vector<string> func_args = func.args();
+    auto dim = std::find(func_args.begin(), func_args.end(), t.name());
+    user_assert(dim != func_args.end())
+        << "Can't make Func " << name() << " persistent along " << t.name()
+        << ", which isn't one of its pure vars.\n";
+    // Only the new frames are computed, so an update over a reduction
+    // domain along t would apply twice to the frames held.
+    for (size_t i = 0; i < func.updates().size(); i++) {
+        const Variable *v = func.update(i).args()[dim - func_args.begin()].as<Variable>();
+        user_assert(v && v->name == t.name())
+            << "Can't make Func " << name() << " persistent along " << t.name()
+            << ", because update definition " << i << " isn't pure in " << t.name() << ".\n";
+    }
+    invalidate_cache();
+    func.schedule().persist_var() = t.name();
+    func.schedule().persist_frames() = frames;
+    return *this;
+}
+
+Func &Func::async() {
+    invalidate_cache();
+    func.schedule().async() = true;
     return *this;
 }
 
@@ -2004,6 +2300,34 @@ Func &Func::store_in(MemoryType t) {
     return *this;
 }
 
+Func &Func::store_nontemporal() {
+    invalidate_cache();
+    func.schedule().nontemporal() = true;
+    return *this;
+}
+
+Func &Func::dma() {
+    invalidate_cache();
+    func.schedule().dma() = true;
+    return *this;
+}
+
+Func &Func::widen_float16_math() {
+    invalidate_cache();
+    func.schedule().widen_float16_math() = true;
+    return *this;
+}
+
+Func &Func::distribute(Var var) {
+    invalidate_cache();
+    const vector<string> pure_args = func.args();
+    user_assert(std::find(pure_args.begin(), pure_args.end(), var.name()) != pure_args.end())
+        << "Can't distribute " << name() << " along " << var.name()
+        << " because it is not one of its pure vars\n";
+    func.schedule().distributed() = var.name();
+    return *this;
+}
+
 Stage Func::specialize(Expr c) {
     invalidate_cache();
     return Stage(func, func.definition(), 0, args()).specialize(c);
@@ -2014,6 +2338,88 @@ void Func::specialize_fail(const std::string &message) {
     (void) Stage(func, func.definition(), 0, args()).specialize_fail(message);
 }
 
+Stage Func::specialize_low_memory(Expr budget) {
+    if (!budget.defined()) {
+        budget = Call::make(Int(64), "halide_get_memory_budget", {}, Call::Extern);
+    }
+    user_assert(budget.type().is_int() || budget.type().is_uint())
+        << "The memory budget for Func " << name() << " must be an integer number of bytes\n";
+    budget = cast<int64_t>(budget);
+    // The footprint is computed by lower_memory_footprint, over the
+    // whole pipeline. The intrinsic isn't pure, so the condition isn't
+    // simplified away or moved before then.
+    Expr footprint = Call::make(Int(64), Call::memory_footprint, {}, Call::Intrinsic);
+    return specialize(budget > 0 && footprint > budget);
+}
+
+vector<Stage> Func::specialize_for_shapes(const vector<ExpectedShape> &shapes,
+                                          int max_specializations) {
+    user_assert(defined() && func.has_pure_definition())
+        << "Can't specialize Func " << name() << " for shapes before it has been defined\n";
+    user_assert(max_specializations >= 0)
+        << "The maximum number of specializations for Func " << name() << " must not be negative\n";
+    invalidate_cache();
+
+    // Merge duplicate shapes, and drop the ones that don't constrain
+    // any extent, because they're handled by the generic case.
+    vector<ExpectedShape> merged;
+    for (const ExpectedShape &shape : shapes) {
+        user_assert((int)shape.extents.size() <= dimensions())
+            << "Expected shape for Func " << name() << " has " << shape.extents.size()
+            << " extents, but " << name() << " only has " << dimensions() << " dimensions\n";
+        bool constrained = false;
+        for (int e : shape.extents) {
+            user_assert(e >= 0) << "Expected shape for Func " << name() << " has a negative extent\n";
+            constrained |= (e > 0);
+        }
+        if (!constrained || shape.weight <= 0) {
+            continue;
+        }
+        vector<int> extents = shape.extents;
+        while (!extents.empty() && extents.back() == 0) {
+            extents.pop_back();
+        }
+        bool found = false;
+        for (ExpectedShape &m : merged) {
+            if (m.extents == extents) {
+                m.weight += shape.weight;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            merged.emplace_back(extents, shape.weight);
+        }
+    }
+
+    std::stable_sort(merged.begin(), merged.end(),
+                     [](const ExpectedShape &a, const ExpectedShape &b) {
+                         return a.weight > b.weight;
+                     });
+    if ((int)merged.size() > max_specializations) {
+        debug(1) << "Dropping " << merged.size() - max_specializations
+                 << " of the expected shapes for " << name() << "\n";
+        merged.erase(merged.begin() + max_specializations, merged.end());
+    }
+
+    // All of the output buffers of a Tuple-valued Func have the same
+    // shape, so the first one will do.
+    OutputImageParam out(func.output_buffers()[0], Argument::OutputBuffer, *this);
+    vector<Stage> result;
+    for (const ExpectedShape &shape : merged) {
+        Expr condition;
+        for (size_t d = 0; d < shape.extents.size(); d++) {
+            if (shape.extents[d] == 0) {
+                continue;
+            }
+            Expr c = (out.dim((int)d).extent() == shape.extents[d]);
+            condition = condition.defined() ? (condition && c) : c;
+        }
+        result.push_back(specialize(condition));
+    }
+    return result;
+}
+
 Func &Func::serial(VarOrRVar var) {
     invalidate_cache();
     Stage(func, func.definition(), 0, args()).serial(var);
@@ -2044,6 +2450,12 @@ Func &Func::parallel(VarOrRVar var, Expr factor, TailStrategy tail) {
     return *this;
 }
 
+Func &Func::parallel(VarOrRVar var, ParallelPolicy policy, int chunk) {
+    invalidate_cache();
+    Stage(func, func.definition(), 0, args()).parallel(var, policy, chunk);
+    return *this;
+}
+
 Func &Func::vectorize(VarOrRVar var, Expr factor, TailStrategy tail) {
     invalidate_cache();
     Stage(func, func.definition(), 0, args()).vectorize(var, factor, tail);
@@ -2272,6 +2684,12 @@ Func &Func::gpu_tile(VarOrRVar x, VarOrRVar y, VarOrRVar z,
     return *this;
 }
 
+Func &Func::gpu_persistent() {
+    invalidate_cache();
+    func.schedule().gpu_persistent() = true;
+    return *this;
+}
+
 Func &Func::shader(Var x, Var y, Var c, DeviceAPI device_api) {
     invalidate_cache();
 
@@ -2995,8 +3413,9 @@ void Func::compile_to_c(const string &filename, const vector<Argument> &args,
 void Func::compile_to_lowered_stmt(const string &filename,
                                    const vector<Argument> &args,
                                    StmtOutputFormat fmt,
-                                   const Target &target) {
-    pipeline().compile_to_lowered_stmt(filename, args, fmt, target);
+                                   const Target &target,
+                                   const string &profile_filename) {
+    pipeline().compile_to_lowered_stmt(filename, args, fmt, target, profile_filename);
 }
 
 void Func::compile_to_python_extension(const string &filename_prefix,
@@ -180,6 +180,51 @@ public:
     Func rfactor(RVar r, Var v);
     // @}
 
+    /** Calling parallel_scan() on the first update definition of a Func,
+     * which is a scan along a one-dimensional RDom with an associative
+     * operator, splits the scan into blocks of block_size, which can
+     * be computed in parallel. The blocks are scanned separately into
+     * an intermediate Func, which is returned, with the index of each
+     * block in the new pure Var u. The value of the scan before each
+     * block is then carried across the blocks serially, and the update
+     * is replaced by one that combines the two, which no longer
+     * depends on the previous point, so its RVar can be parallelized
+     * too. It throws an error if it can't prove that the update is
+     * an associative scan.
+     *
+     * For example, f.update(0).parallel_scan(r, u, 1024) would rewrite a
+     * pipeline like this:
+     \code
+     f(x) = 0;
+     f(r) = f(r - 1) + g(r);
+     \endcode
+     * into a pipeline like this:
+     \code
+     f_scan_blocks(x, u) = 0;
+     RDom ri(0, 1024);
+     ri.where(r.x.min + u*1024 + ri < r.x.min + r.x.extent);
+     f_scan_blocks(ri, u) = f_scan_blocks(ri - 1, u) + g(r.x.min + u*1024 + ri);
+
+     f_scan_carry(u) = f(r.x.min - 1);
+     f_scan_carry(rb) = f_scan_carry(rb - 1) + f_scan_blocks(1023, rb - 1);
+
+     f(x) = 0;
+     f(r) = f_scan_carry((r - r.x.min) / 1024) + f_scan_blocks((r - r.x.min) % 1024, (r - r.x.min) / 1024);
+     \endcode
+     *
+     * which is typically scheduled like this:
+     \code
+     f.update(0).parallel_scan(r, u, 1024).update(0).parallel(u);
+     f.update(0).parallel(r, 1024);
+     \endcode
+     *
+     * Other dimensions of f stay pure Vars in both intermediate Funcs, so
+     * a summed-area table can scan each row this way. The carry trades
+     * a second pass over the scan for parallelism: each point is written
+     * twice, so it only pays for scans long enough to split across
+     * cores. The intermediate Funcs are computed at root by default. */
+    Func parallel_scan(RVar r, Var u, Expr block_size);
+
     /** Schedule the iteration over this stage to be fused with another
      * stage 's' from outermost loop to a given LoopLevel. 'this' stage will
      * be computed AFTER 's' in the innermost fused dimension. There should not
@@ -317,6 +362,7 @@ public:
     Stage &vectorize(VarOrRVar var);
     Stage &unroll(VarOrRVar var);
     Stage &parallel(VarOrRVar var, Expr task_size, TailStrategy tail = TailStrategy::Auto);
+    Stage &parallel(VarOrRVar var, ParallelPolicy policy, int chunk = 1);
     Stage &vectorize(VarOrRVar var, Expr factor, TailStrategy tail = TailStrategy::Auto);
     Stage &unroll(VarOrRVar var, Expr factor, TailStrategy tail = TailStrategy::Auto);
     Stage &tile(VarOrRVar x, VarOrRVar y,
@@ -395,6 +441,15 @@ public:
 
     Stage &allow_race_conditions();
 
+    /** Perform the updates of this stage with atomic read-modify-write
+     * operations. The update must have the form f(args) += e, where e
+     * does not read f. This makes it safe to parallelize or vectorize
+     * the reduction variables of histogram-like scatters, at the cost
+     * of an atomic operation per update. Floating-point sums are still
+     * non-deterministic in their order of evaluation. Implies
+     * allow_race_conditions(). */
+    Stage &atomic();
+
     Stage &hexagon(VarOrRVar x = Var::outermost());
     Stage &prefetch(const Func &f, VarOrRVar var, Expr offset = 1,
                            PrefetchBoundStrategy strategy = PrefetchBoundStrategy::GuardWithIf);
@@ -609,6 +664,22 @@ struct ErrorBuffer;
 class IRMutator2;
 }  // namespace Internal
 
+/** A shape that the output of a Func is expected to be realized
+ * at, for use with Func::specialize_for_shapes. */
+struct ExpectedShape {
+    /** The extent of each dimension of the output, starting from the
+     * innermost. Zero means the extent of that dimension varies, and
+     * dimensions beyond the end of the list are also unconstrained. */
+    std::vector<int> extents;
+
+    /** How often this shape occurs relative to the others, e.g. a
+     * count from a histogram of production traffic. */
+    float weight;
+
+    ExpectedShape(const std::vector<int> &extents, float weight = 1.0f)
+        : extents(extents), weight(weight) {}
+};
+
 /** A halide function. This class represents one stage in a Halide
  * pipeline, and is the unit by which we schedule things. By default
  * they are aggressively inlined, so you are encouraged to make lots
@@ -855,11 +926,14 @@ public:
 
     /** Write out an internal representation of lowered code. Useful
      * for analyzing and debugging scheduling. Can emit html or plain
-     * text. */
+     * text. The html can be annotated with the measurements in a report
+     * of the profiler (see Target::Profile) for runs of the same pipeline,
+     * saved in profile_filename: see Internal::print_to_html. */
     void compile_to_lowered_stmt(const std::string &filename,
                                  const std::vector<Argument> &args,
                                  StmtOutputFormat fmt = Text,
-                                 const Target &target = get_target_from_environment());
+                                 const Target &target = get_target_from_environment(),
+                                 const std::string &profile_filename = "");
 
     /** Emit a Python Extension glue .c file. */
     void compile_to_python_extension(const std::string &filename_prefix,
@@ -1438,6 +1512,16 @@ public:
      * manually. */
     Func &parallel(VarOrRVar var, Expr task_size, TailStrategy tail = TailStrategy::Auto);
 
+    /** Mark a dimension to be traversed in parallel, with its
+     * iterations handed out to the threads by the given policy, in
+     * chunks of at least chunk iterations. E.g. a loop over rows of
+     * very uneven cost balances better with
+     * parallel(y, ParallelPolicy::Guided), and a loop over many tiny
+     * iterations pays less per iteration with
+     * parallel(y, ParallelPolicy::Dynamic, 16), without changing the
+     * split. On CPU only; GPU and Hexagon loops ignore the policy. */
+    Func &parallel(VarOrRVar var, ParallelPolicy policy, int chunk = 1);
+
     /** Mark a dimension to be computed all-at-once as a single
      * vector. The dimension should have constant extent -
      * e.g. because it is the inner dimension following a split by a
@@ -1748,6 +1832,50 @@ public:
      */
     void specialize_fail(const std::string &message);
 
+    /** Specialize this output Func for the most frequent of a list of
+     * expected output shapes. Each shape turns into a specialization
+     * on the extents of the output buffer, so within it the loop
+     * extents and any expressions of them become constants. This
+     * helps most when an extent is small, like three color
+     * channels, or a multiple of the vector width. At most
+     * max_specializations are added, so that the code size stays
+     * bounded. They are picked by weight, after merging duplicate
+     * shapes, and checked in order of decreasing weight at runtime.
+     * The unspecialized schedule is the fallback for every other
+     * shape. Like specialize, each specialization inherits the
+     * schedule so far, so this should usually come after the
+     * schedule for the generic case. Returns the handles to the new
+     * specialized schedules, hottest first.
+     */
+    std::vector<Stage> specialize_for_shapes(const std::vector<ExpectedShape> &shapes,
+                                             int max_specializations = 4);
+
+    /** Specialize this Func for when the pipeline would need more
+     * heap and device memory than a budget. Before the pipeline runs,
+     * it computes an upper bound of the memory its intermediate
+     * buffers take with the default schedules of the Funcs specialized
+     * this way, from the bounds-inferred sizes of their allocations.
+     * If that's more than the budget, these Funcs use the returned
+     * schedule instead, which should need less memory, e.g. with
+     * smaller tiles, so that the pipeline runs in the budget rather
+     * than failing or evicting its neighbors. The budget defaults to
+     * the value returned by halide_get_memory_budget, which may be
+     * overridden to use a budget per user_context; with the JIT, pass
+     * a Param instead. A budget of zero or less means there is no
+     * budget. Like specialize, the specialization inherits the
+     * schedule so far, so the default schedule should come after
+     * it. Producers compute_at this Func are computed at the loop of
+     * the same name in either schedule:
+     *
+     \code
+     Param<int64_t> budget;
+     f.specialize_low_memory(budget).tile(x, y, xo, yo, xi, yi, 16, 16);
+     f.tile(x, y, xo, yo, xi, yi, 256, 256);
+     g.compute_at(f, xo);
+     \endcode
+     */
+    Stage specialize_low_memory(Expr budget = Expr());
+
     /** Tell Halide that the following dimensions correspond to GPU
      * thread indices. This is useful if you compute a producer
      * function within the block indices of a consumer function, and
@@ -1834,6 +1962,22 @@ public:
                    DeviceAPI device_api = DeviceAPI::Default_GPU);
     // @}
 
+    /** Fuse the CUDA kernels computing this Func with those of the
+     * gpu_persistent Funcs computed right before and after it into a
+     * single persistent kernel. The Func must be computed at root, and
+     * each of its stages must be a single kernel over its GPU blocks,
+     * as with gpu_tile. The persistent kernel is launched with as many
+     * blocks as the device can keep resident at once (as a cooperative
+     * launch where the device supports it), and loops over the blocks of
+     * each stage in turn, with a barrier across the grid between them.
+     * This replaces a launch per stage with a barrier, which is much
+     * cheaper for the short kernels of small images, such as the many
+     * stages of a gradient. A stage whose threads or shared memory
+     * depend on its block is left out of the fusion. All the threads of
+     * the kernel wait at every barrier, so pipelines used concurrently
+     * from several streams shouldn't use this. */
+    Func &gpu_persistent();
+
     /** Schedule for execution using coordinate-based hardware api.
      * GLSL is an example of this. Conceptually, this is
      * similar to parallelization over 'x' and 'y' (since GLSL shaders compute
@@ -1877,6 +2021,12 @@ public:
      *   for x = ...
      *     prefetch(&f[x + 2, y], 1, 16);
      *     g(x, y) = 2 * f(x, y)
+     *
+     * If the offset is an undefined Expr, it is chosen during lowering:
+     * the prefetch runs far enough ahead that the data the iterations in
+     * between touch for the first time covers the latency of memory on
+     * the target. This needs the extents of the region touched by an
+     * iteration of 'var' to be constant; otherwise the offset is 1.
      */
     // @{
     Func &prefetch(const Func &f, VarOrRVar var, Expr offset = 1,
@@ -2089,8 +2239,65 @@ public:
     /** Use the halide_memoization_cache_... interface to store a
      *  computed version of this function across invocations of the
      *  Func.
+     *
+     *  The eviction cost is a hint of how expensive the Func is to
+     *  recompute, relative to the other memoized Funcs. When the cache
+     *  is full, the default cache evicts the entries with the lowest
+     *  cost per byte first, so that expensive results (e.g. ones that
+     *  stay resident on a GPU) survive cheap ones.
      */
-    Func &memoize();
+    Func &memoize(int eviction_cost = 1);
+
+    /** Keep the last frames realizations of this Func along its
+     * dimension t, the frames, across calls of the pipeline, in a ring
+     * buffer, and compute each call only the frames the last calls
+     * didn't. This makes the per-frame work of temporal filters over a
+     * video, which read a few of the previous frames of their
+     * intermediates, incremental:
+     *
+     \code
+     Param<int> frame;
+     Func denoised;
+     denoised(x, y, t) = ...;
+     denoised.compute_root().persist(t, 3);
+     out(x, y) = (denoised(x, y, frame) + denoised(x, y, frame - 1) +
+                  denoised(x, y, frame - 2)) / 3;
+     \endcode
+     *
+     * Called on consecutive frames, each call computes denoised for
+     * the new frame only. Frames are only kept while the region of
+     * the other dimensions stays the same; the first call, and any
+     * call that needs frames the last ones didn't compute, computes
+     * all the frames it needs. The frames each call needs must fit in
+     * the ring buffer. The updates of the Func must be pure in t, as
+     * they only run over the new frames too. The Func must be computed at
+     * root on the host, must have a single value, and can't be an
+     * output. The frames are dropped when the definitions of the Func,
+     * or of the Funcs it calls, change. The storage is shared by all
+     * the calls of the pipeline, so they must not run concurrently;
+     * halide_persistent_storage_cleanup frees it. */
+    Func &persist(Var t, int frames);
+
+    /** Produce this Func asynchronously, on a thread of its own,
+     * while the calling thread runs its consumers. The producer and
+     * consumer synchronize with semaphores at each iteration of the
+     * loop at which the Func is computed, and the producer may run one
+     * iteration ahead. This lets pipelines whose stages are each
+     * serial, such as scanline decoders or recursive filters, use
+     * more than one core: e.g.
+     *
+     \code
+     g.store_root().compute_at(f, y).async();
+     \endcode
+     *
+     * computes the rows of g needed by row y + 1 of f while row y of f
+     * is being computed. If g's storage is folded, the fold is made
+     * large enough for both rows. The loops between the storage and
+     * the computation of an async Func must be serial, and its
+     * producer may not use Funcs that are computed outside of it in
+     * those loops. Not supported by the C backend, and not compatible
+     * with memoize. */
+    Func &async();
 
 
     /** Allocate storage for this function within f's loop over
@@ -2239,6 +2446,68 @@ public:
      * on MemoryType for more detail. */
     Func &store_in(MemoryType memory_type);
 
+    /** Write this Func with non-temporal (streaming) stores, which
+     * bypass the cache. This is worthwhile for large outputs that are
+     * written once and not read again by the pipeline, because it
+     * avoids reading each cache line before overwriting it, and
+     * leaves the cache to the inputs. It is a loss if the values are
+     * read again soon after, so it may only be used on Funcs with no
+     * update definitions. Only dense, unpredicated stores on the CPU
+     * are affected; the others are emitted as usual. */
+    Func &store_nontemporal();
+
+    /** Copy this Func in whole tiles with the Hexagon DMA runtime,
+     * instead of with loads and stores on the HVX threads. The Func
+     * must be a copy of another Func or buffer, such as a wrapper made
+     * with in(), whose loops are not split: each realization is then
+     * copied with a single call to halide_hexagon_dma_copy_2d, which
+     * streams the source through L2. Combined with VTCM storage and
+     * async(), tiles are double buffered, and the copy of the next tile
+     * overlaps the computation on the current one:
+     *
+     \code
+     Func in_tile = input.in(f);
+     in_tile.compute_at(f, xo).store_at(f, yo)
+         .store_in(MemoryType::VTCM).async().dma();
+     \endcode
+     *
+     * Has no effect outside of Hexagon code, or on copies it can't
+     * lower to 2D copies, which are left alone with a warning. */
+    Func &dma();
+
+    /** Compute the float16 arithmetic of this Func in float, rounding
+     * each value to float16 only once it is stored, even on targets
+     * with Target::NativeFloat16. Native float16 math is up to twice as
+     * fast, but rounds after every operation, which may lose too much
+     * precision in long chains of operations such as sums. Funcs
+     * inlined into this one are computed in float too. */
+    Func &widen_float16_math();
+
+    /** Distribute the computation of this output Func across the ranks
+     * of a multi-node job along one of its pure vars, e.g. the outer
+     * dimension y of an image. Each rank calls the pipeline with the
+     * slice of the output it owns along that dimension, and with input
+     * buffers covering the region its slice requires, which bounds
+     * inference computes per rank as usual. The rank only needs to fill
+     * the part of each input that lies in its own slice of the output
+     * along the same dimension: at the start of the pipeline, the ranks
+     * exchange the rest (the halos) with halide_distributed_exchange,
+     * over the transport set with halide_set_distributed_transport
+     * (e.g. MPI), and every rank must call the pipeline. The inputs with
+     * fewer dimensions are expected to be the same on every rank. The
+     * rest of the schedule applies within each rank as usual, so the
+     * other dimensions can still be parallel.
+     *
+     * To use several GPUs from one process, run one rank per thread,
+     * with a transport that tells them apart by user_context: the CUDA
+     * runtime gives each rank its own context, on device
+     * (halide_get_gpu_device() + rank) modulo the number of devices, so
+     * each rank allocates its buffers on and launches the gpu_blocks of
+     * its slice to its own device. The halos are staged through the
+     * host. Passing each rank a crop of one output buffer, and copying
+     * each crop back to the host afterwards, gathers the output. */
+    Func &distribute(Var var);
+
     /** Trace all loads from this Func by emitting calls to
      * halide_trace. If the Func is inlined, this has no
      * effect. */
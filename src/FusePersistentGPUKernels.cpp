@@ -0,0 +1,326 @@
+#include "FusePersistentGPUKernels.h"
+#include "CodeGen_GPU_Dev.h"
+#include "ExprUsesVar.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+#include "Simplify.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+// One of the kernels fused into a persistent kernel: its loops over
+// blocks, from the outermost to the innermost, and the body of the
+// innermost one.
+struct Kernel {
+    vector<const For *> blocks;
+    Stmt body;
+};
+
+// Checks that the extents of the loops over threads and of the
+// allocations of a kernel don't depend on its blocks, or on anything
+// else computed inside it. The launch parameters and the shared memory
+// of a kernel are bounded over its loops over blocks, which the
+// persistent kernel doesn't have.
+class IndependentOfBlocks : public IRVisitor {
+    using IRVisitor::visit;
+
+    Scope<> defined;
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_thread_var(op->name) &&
+            expr_uses_vars(op->extent, defined)) {
+            result = false;
+        }
+        op->min.accept(this);
+        op->extent.accept(this);
+        ScopedBinding<> bind(defined, op->name);
+        op->body.accept(this);
+    }
+
+    void visit(const LetStmt *op) {
+        op->value.accept(this);
+        ScopedBinding<> bind(defined, op->name);
+        op->body.accept(this);
+    }
+
+    void visit(const Let *op) {
+        op->value.accept(this);
+        ScopedBinding<> bind(defined, op->name);
+        op->body.accept(this);
+    }
+
+    void visit(const Allocate *op) {
+        for (const Expr &e : op->extents) {
+            if (expr_uses_vars(e, defined)) {
+                result = false;
+            }
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = true;
+
+    IndependentOfBlocks(const vector<const For *> &blocks) {
+        for (const For *b : blocks) {
+            defined.push(b->name);
+        }
+    }
+};
+
+class ContainsLoad : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Load *op) {
+        result = true;
+    }
+
+public:
+    bool result = false;
+};
+
+bool contains_load(Expr e) {
+    ContainsLoad c;
+    e.accept(&c);
+    return c.result;
+}
+
+Stmt rewrap(const Stmt &wrapper, Stmt body) {
+    if (const LetStmt *let = wrapper.as<LetStmt>()) {
+        return LetStmt::make(let->name, let->value, body);
+    } else if (const Allocate *alloc = wrapper.as<Allocate>()) {
+        return Allocate::make(alloc->name, alloc->type, alloc->memory_type, alloc->extents,
+                              alloc->condition, body, alloc->new_expr, alloc->free_function);
+    } else {
+        const ProducerConsumer *pc = wrapper.as<ProducerConsumer>();
+        internal_assert(pc);
+        return ProducerConsumer::make(pc->name, pc->is_producer, body);
+    }
+}
+
+Stmt rewrap(const vector<Stmt> &wrappers, Stmt body) {
+    for (size_t i = wrappers.size(); i > 0; i--) {
+        body = rewrap(wrappers[i - 1], body);
+    }
+    return body;
+}
+
+class FusePersistentGPUKernels : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, Function> &env;
+
+    // Split the production of a Func into the lets computed on the host
+    // and the kernels computing its stages. Fails if anything else is
+    // computed on the host, or a kernel can't be fused.
+    bool find_kernels(Stmt s, vector<Stmt> &lets, vector<Kernel> &kernels) {
+        if (const LetStmt *let = s.as<LetStmt>()) {
+            if (contains_load(let->value)) {
+                return false;
+            }
+            lets.push_back(let);
+            return find_kernels(let->body, lets, kernels);
+        } else if (const Block *block = s.as<Block>()) {
+            return (find_kernels(block->first, lets, kernels) &&
+                    find_kernels(block->rest, lets, kernels));
+        }
+
+        Kernel k;
+        const For *loop = s.as<For>();
+        while (loop && CodeGen_GPU_Dev::is_gpu_block_var(loop->name)) {
+            if (loop->device_api != DeviceAPI::CUDA) {
+                return false;
+            }
+            k.blocks.push_back(loop);
+            k.body = loop->body;
+            loop = k.body.as<For>();
+        }
+        if (k.blocks.empty()) {
+            return false;
+        }
+        IndependentOfBlocks independent(k.blocks);
+        k.body.accept(&independent);
+        if (!independent.result) {
+            debug(2) << "Not fusing the kernel over " << k.blocks.back()->name
+                     << ", whose threads depend on its blocks\n";
+            return false;
+        }
+        kernels.push_back(k);
+        return true;
+    }
+
+    bool is_persistent(const string &name) const {
+        auto it = env.find(name);
+        return it != env.end() && it->second.schedule().gpu_persistent();
+    }
+
+    // Find the production of the next Func computed in s, in the
+    // consumers of the Funcs before it, after lets and allocations that
+    // can be moved before them. The rest is the consumer of the Func,
+    // which outputs don't have.
+    bool find_next_producer(Stmt s, vector<Stmt> &hoisted, vector<Stmt> &consumers,
+                            const ProducerConsumer *&producer, Stmt &rest) {
+        while (s.defined()) {
+            if (const LetStmt *let = s.as<LetStmt>()) {
+                if (contains_load(let->value)) {
+                    return false;
+                }
+                hoisted.push_back(s);
+                s = let->body;
+            } else if (const Allocate *alloc = s.as<Allocate>()) {
+                hoisted.push_back(s);
+                s = alloc->body;
+            } else if (const ProducerConsumer *pc = s.as<ProducerConsumer>()) {
+                if (pc->is_producer) {
+                    producer = pc;
+                    rest = Stmt();
+                    return true;
+                }
+                consumers.push_back(s);
+                s = pc->body;
+            } else if (const Block *block = s.as<Block>()) {
+                const ProducerConsumer *produce = block->first.as<ProducerConsumer>();
+                const ProducerConsumer *consume = block->rest.as<ProducerConsumer>();
+                if (!produce || !produce->is_producer ||
+                    !consume || consume->is_producer ||
+                    produce->name != consume->name) {
+                    return false;
+                }
+                producer = produce;
+                rest = block->rest;
+                return true;
+            } else {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // The persistent kernel running the given kernels in turn.
+    Stmt make_persistent_kernel(const string &name, const vector<Kernel> &kernels) {
+        Expr num_blocks;
+        Expr block_id = Variable::make(Int(32), name + ".__block_id_x");
+        Expr grid_blocks = Call::make(Int(32), "halide_gpu_grid_blocks", {}, Call::Extern);
+        Stmt grid_barrier = Evaluate::make(Call::make(Int(32), "halide_gpu_grid_barrier", {}, Call::Extern));
+
+        vector<Stmt> stages;
+        for (const Kernel &k : kernels) {
+            const string &prefix = k.blocks.back()->name;
+            Expr blocks = 1;
+            for (const For *b : k.blocks) {
+                blocks *= b->extent;
+            }
+            blocks = simplify(blocks);
+            num_blocks = num_blocks.defined() ? max(num_blocks, blocks) : blocks;
+
+            // The index of the block of this kernel the block of the
+            // persistent kernel computes in this iteration, and its
+            // indices in each dimension, the innermost fastest.
+            string iteration = prefix + ".persistent_iteration";
+            string index = prefix + ".persistent_index";
+            Expr index_var = Variable::make(Int(32), index);
+            Stmt body = k.body;
+            for (size_t i = 0; i < k.blocks.size(); i++) {
+                const For *b = k.blocks[i];
+                Expr e = index_var;
+                for (size_t j = k.blocks.size() - 1; j > i; j--) {
+                    e = e / k.blocks[j]->extent;
+                }
+                if (i > 0) {
+                    e = e % b->extent;
+                }
+                body = LetStmt::make(b->name, simplify(b->min + e), body);
+            }
+            body = LetStmt::make(index, block_id + Variable::make(Int(32), iteration) * grid_blocks, body);
+
+            // Each block of the persistent kernel computes every
+            // grid_blocks-th block of this kernel.
+            Expr iterations = (blocks - block_id + grid_blocks - 1) / grid_blocks;
+            body = For::make(iteration, 0, iterations, ForType::Serial, DeviceAPI::None, body);
+
+            if (!stages.empty()) {
+                stages.push_back(grid_barrier);
+            }
+            stages.push_back(body);
+        }
+
+        // Blocks beyond the most any of the kernels needs would only wait
+        // at the barriers.
+        return For::make(name + ".__block_id_x", 0, simplify(num_blocks),
+                         ForType::GPUBlock, DeviceAPI::CUDA, Block::make(stages));
+    }
+
+    Stmt visit(const Block *op) override {
+        const ProducerConsumer *produce = op->first.as<ProducerConsumer>();
+        const ProducerConsumer *consume = op->rest.as<ProducerConsumer>();
+        vector<Stmt> lets;
+        vector<Kernel> kernels;
+        if (!produce || !produce->is_producer ||
+            !consume || consume->is_producer ||
+            produce->name != consume->name ||
+            !is_persistent(produce->name) ||
+            !find_kernels(produce->body, lets, kernels)) {
+            return IRMutator2::visit(op);
+        }
+
+        // Pull in the kernels of the persistent Funcs computed next. The
+        // lets and allocations between them move before the first one;
+        // none of them read memory, so they don't depend on it.
+        vector<Stmt> producers = {op->first};
+        vector<Stmt> hoisted, consumers;
+        Stmt rest = op->rest;
+        while (true) {
+            vector<Stmt> next_hoisted, next_consumers, next_lets;
+            vector<Kernel> next_kernels;
+            const ProducerConsumer *next = nullptr;
+            Stmt next_rest;
+            if (!find_next_producer(rest, next_hoisted, next_consumers, next, next_rest) ||
+                !is_persistent(next->name) ||
+                !find_kernels(next->body, next_lets, next_kernels)) {
+                break;
+            }
+            hoisted.insert(hoisted.end(), next_hoisted.begin(), next_hoisted.end());
+            consumers.insert(consumers.end(), next_consumers.begin(), next_consumers.end());
+            lets.insert(lets.end(), next_lets.begin(), next_lets.end());
+            kernels.insert(kernels.end(), next_kernels.begin(), next_kernels.end());
+            producers.push_back(next);
+            rest = next_rest;
+        }
+
+        if (kernels.size() < 2) {
+            return IRMutator2::visit(op);
+        }
+
+        debug(2) << "Fusing " << kernels.size() << " kernels computing "
+                 << produce->name << " and the " << producers.size() - 1
+                 << " Funcs after it into a persistent kernel\n";
+
+        Stmt kernel = make_persistent_kernel(produce->name + ".persistent", kernels);
+        kernel = rewrap(lets, kernel);
+        kernel = rewrap(producers, kernel);
+        if (rest.defined()) {
+            kernel = Block::make(kernel, rewrap(consumers, mutate(rest)));
+        }
+        return rewrap(hoisted, kernel);
+    }
+
+public:
+    FusePersistentGPUKernels(const map<string, Function> &env) : env(env) {}
+};
+
+}  // namespace
+
+Stmt fuse_persistent_gpu_kernels(Stmt s, const map<string, Function> &env) {
+    return FusePersistentGPUKernels(env).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
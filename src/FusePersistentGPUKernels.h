@@ -0,0 +1,31 @@
+#ifndef HALIDE_FUSE_PERSISTENT_GPU_KERNELS_H
+#define HALIDE_FUSE_PERSISTENT_GPU_KERNELS_H
+
+/** \file
+ * Defines the lowering pass that fuses consecutive GPU kernels into
+ * persistent kernels
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Fuse the CUDA kernels computing consecutive Funcs scheduled with
+ * Func::gpu_persistent into a single kernel. The fused kernel is
+ * launched with as many blocks as the device can keep resident at
+ * once, and loops over the blocks of each of the original kernels in
+ * turn, with a barrier across the whole grid between them, so that a
+ * chain of small stages costs a single launch. Must be run after the
+ * GPU API of the loops has been selected, and before the buffer copies
+ * and the per-block synchronization are injected. */
+Stmt fuse_persistent_gpu_kernels(Stmt s, const std::map<std::string, Function> &env);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -1,8 +1,15 @@
+#include <atomic>
 #include <cmath>
 #include <fstream>
+#include <mutex>
+#include <random>
 #include <set>
+#include <sstream>
+#include <thread>
 
+#include "FindCalls.h"
 #include "Generator.h"
+#include "IRPrinter.h"
 #include "Outputs.h"
 #include "Simplify.h"
 
@@ -507,6 +514,12 @@ void StubEmitter::emit() {
     stream << indent() << "// The Target used\n";
     stream << indent() << "Target target;\n";
 
+    stream << "\n";
+    stream << indent() << "// All the Funcs the outputs depend on, by name, including the\n";
+    stream << indent() << "// Generator's internal Funcs, so that they can be scheduled by the\n";
+    stream << indent() << "// caller (e.g. computed at tiles of the caller's Funcs)\n";
+    stream << indent() << "std::map<std::string, Halide::Func> funcs;\n";
+
     if (out_info.size() == 1) {
         stream << "\n";
         if (all_outputs_are_func) {
@@ -637,7 +650,8 @@ void StubEmitter::emit() {
     for (const auto &out : out_info) {
         stream << indent() << "stub." << out.getter << ",\n";
     }
-    stream << indent() << "stub.generator->get_target()\n";
+    stream << indent() << "stub.generator->get_target(),\n";
+    stream << indent() << "stub.get_funcs()\n";
     indent_level--;
     stream << indent() << "};\n";
     indent_level--;
@@ -730,6 +744,16 @@ std::vector<std::vector<Func>> GeneratorStub::generate(const GeneratorParamsMap
     return v;
 }
 
+std::map<std::string, Func> GeneratorStub::get_funcs() const {
+    std::map<std::string, Func> funcs;
+    for (const Func &output : generator->get_pipeline().outputs()) {
+        for (const auto &it : find_transitive_calls(output.function())) {
+            funcs.emplace(it.first, Func(it.second));
+        }
+    }
+    return funcs;
+}
+
 GeneratorStub::Names GeneratorStub::get_names() const {
     auto &pi = generator->param_info();
     Names names;
@@ -758,7 +782,8 @@ const std::map<std::string, Type> &get_halide_type_enum_map() {
         {"uint16", UInt(16)},
         {"uint32", UInt(32)},
         {"float32", Float(32)},
-        {"float64", Float(64)}
+        {"float64", Float(64)},
+        {"bfloat16", BFloat(16)}
     };
     return halide_type_enum_map;
 }
@@ -769,6 +794,7 @@ std::string halide_type_to_c_source(const Type &t) {
         { halide_type_uint, "UInt" },
         { halide_type_float, "Float" },
         { halide_type_handle, "Handle" },
+        { halide_type_bfloat, "BFloat" },
     };
     std::ostringstream oss;
     oss << "Halide::" << m.at(t.code()) << "(" << t.bits() << + ")";
@@ -795,21 +821,241 @@ std::string halide_type_to_c_type(const Type &t) {
     return m.at(encode(t));
 }
 
-int generate_filter_main(int argc, char **argv, std::ostream &cerr) {
-    const char kUsage[] = "gengen [-g GENERATOR_NAME] [-f FUNCTION_NAME] [-o OUTPUT_DIR] [-r RUNTIME_NAME] [-e EMIT_OPTIONS] [-x EXTENSION_OPTIONS] [-n FILE_BASE_NAME] "
-                          "target=target-string[,target-string...] [generator_arg=value [...]]\n\n"
+namespace {
+
+// The compile cache of GenGen (-c CACHE_DIR) keys the outputs of a Module
+// on everything they are generated from: the lowered IR, the target, the
+// names of the outputs and the build of Halide doing the compiling. The
+// human-readable IRPrinter leaves out some of the IR (e.g. the types of
+// Variables, and all but a few digits of floats), so the key is printed
+// with a variant that doesn't.
+class CacheKeyPrinter : public IRPrinter {
+public:
+    CacheKeyPrinter(std::ostream &s) : IRPrinter(s) {}
+
+    using IRPrinter::print;
+
+    void print(const Module &m) {
+        for (const Module &sub : m.submodules()) {
+            print(sub);
+        }
+        stream << "module " << m.name() << " " << m.target().to_string() << "\n";
+        stream << "auto_schedule " << m.auto_schedule().size() << "\n" << m.auto_schedule() << "\n";
+        for (const Buffer<> &b : m.buffers()) {
+            stream << "buffer " << b.name() << " " << b.type() << " " << b.dimensions();
+            for (int d = 0; d < b.dimensions(); d++) {
+                stream << " " << b.dim(d).min() << " " << b.dim(d).extent() << " " << b.dim(d).stride();
+            }
+            stream << " " << b.size_in_bytes() << "\n";
+            stream.write((const char *)b.data(), b.size_in_bytes());
+            stream << "\n";
+        }
+        for (const ExternalCode &e : m.external_code()) {
+            stream << "external_code " << e.name() << " " << e.is_c_plus_plus_source()
+                   << " " << e.contents().size() << "\n";
+            stream.write((const char *)e.contents().data(), e.contents().size());
+            stream << "\n";
+        }
+        for (const LoweredFunc &f : m.functions()) {
+            stream << "func " << f.name << " " << f.linkage << " " << f.name_mangling << "\n";
+            for (const LoweredArgument &a : f.args) {
+                stream << "arg " << a.name << " " << (int)a.kind << " " << (int)a.dimensions << " " << a.type
+                       << " " << a.alignment.modulus << " " << a.alignment.remainder;
+                for (const Expr &e : {a.def, a.min, a.max}) {
+                    stream << " ";
+                    if (e.defined()) {
+                        print(e);
+                    }
+                }
+                stream << "\n";
+            }
+            print(f.body);
+        }
+    }
+
+protected:
+    using IRPrinter::visit;
+
+    void visit(const FloatImm *op) {
+        stream << "(" << op->type << ")" << reinterpret_bits<uint64_t>(op->value);
+    }
+
+    void visit(const Variable *op) {
+        stream << "(" << op->type << ")" << op->name;
+    }
+
+    void visit(const Load *op) {
+        stream << "(" << op->type << ")";
+        IRPrinter::visit(op);
+    }
+
+    void visit(const Call *op) {
+        stream << "(" << op->type << " " << (int)op->call_type << ")";
+        IRPrinter::visit(op);
+    }
+};
+
+// Changes to the code generators don't show in the lowered IR, so the
+// build of Halide is part of the key too. The Makefile and CMake build
+// define HALIDE_BUILD_ID to a checksum of the Halide sources; other
+// builds have nothing reliable to key on, so they don't cache.
+const char *halide_build_id() {
+#ifdef HALIDE_BUILD_ID
+    return HALIDE_BUILD_ID;
+#else
+    return "";
+#endif
+}
+
+std::vector<std::pair<std::string, std::string>> output_file_names(const Outputs &o) {
+    return {{".o", o.object_name},
+            {".s", o.assembly_name},
+            {".bc", o.bitcode_name},
+            {".ll", o.llvm_assembly_name},
+            {".h", o.c_header_name},
+            {".cpp", o.c_source_name},
+            {".stmt", o.stmt_name},
+            {".html", o.stmt_html_name},
+            {".a", o.static_library_name},
+            {".py.c", o.python_extension_name},
+            {".schedule", o.schedule_name},
+            {".pytorch", o.pytorch_wrapper_name}};
+}
+
+bool read_file(const std::string &name, std::string &contents) {
+    std::ifstream f(name, std::ios::binary);
+    if (!f) {
+        return false;
+    }
+    std::ostringstream s;
+    s << f.rdbuf();
+    contents = s.str();
+    return true;
+}
+
+bool copy_file(const std::string &from, const std::string &to) {
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    if (!in || !out) {
+        return false;
+    }
+    out << in.rdbuf();
+    return (bool)out;
+}
+
+// A file is only ever put in the cache under its final name by a rename,
+// from a temporary file next to it (which makes it unique to this writer),
+// so readers never see one half-written. The key file is renamed last,
+// so the outputs are all there once it is.
+bool publish_file(const std::string &contents_from, const std::string &contents, const std::string &to) {
+    static std::mutex random_mutex;
+    static std::mt19937_64 random{std::random_device()()};
+    std::string tmp;
+    {
+        std::lock_guard<std::mutex> lock(random_mutex);
+        tmp = to + "." + std::to_string(random()) + ".tmp";
+    }
+    bool ok;
+    if (contents_from.empty()) {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        f << contents;
+        ok = (bool)f;
+    } else {
+        ok = copy_file(contents_from, tmp);
+    }
+    ok = ok && std::rename(tmp.c_str(), to.c_str()) == 0;
+    if (!ok && file_exists(tmp)) {
+        file_unlink(tmp);
+    }
+    return ok;
+}
+
+// Compile the module to the outputs, or copy them from the cache in
+// cache_dir if the same outputs were compiled before.
+void compile_with_cache(const Module &m, const Outputs &output_files, const std::string &cache_dir) {
+    if (!*halide_build_id()) {
+        user_warning << "Ignoring the compile cache " << cache_dir
+                     << ": this build of Halide doesn't define HALIDE_BUILD_ID.\n";
+        m.compile(output_files);
+        return;
+    }
+
+    std::ostringstream key;
+    key << "halide " << halide_build_id() << "\n";
+    for (const auto &o : output_file_names(output_files)) {
+        if (!o.second.empty()) {
+            // Only the base names: the outputs refer to each other by those.
+            size_t slash = o.second.find_last_of("/\\");
+            key << "output " << o.first << " " << o.second.substr(slash == std::string::npos ? 0 : slash + 1) << "\n";
+        }
+    }
+    CacheKeyPrinter(key).print(m);
+    const std::string key_str = key.str();
+
+    // FNV-1a. A collision just means a cache miss, as the whole key is
+    // compared on a hit.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : key_str) {
+        h ^= (uint8_t)c;
+        h *= 0x100000001b3ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+    const std::string entry = cache_dir + "/" + hex;
+
+    std::string cached_key;
+    if (read_file(entry + ".key", cached_key) && cached_key == key_str) {
+        bool hit = true;
+        for (const auto &o : output_file_names(output_files)) {
+            if (!o.second.empty() && !copy_file(entry + o.first, o.second)) {
+                hit = false;
+                break;
+            }
+        }
+        if (hit) {
+            debug(1) << "Generator compile cache hit: " << entry << "\n";
+            return;
+        }
+    }
+
+    debug(1) << "Generator compile cache miss: " << entry << "\n";
+    m.compile(output_files);
+
+    // The cache is best-effort: failing to fill it isn't an error.
+    bool ok = true;
+    for (const auto &o : output_file_names(output_files)) {
+        if (ok && !o.second.empty()) {
+            ok = publish_file(o.second, "", entry + o.first);
+        }
+    }
+    if (ok) {
+        publish_file("", key_str, entry + ".key");
+    }
+}
+
+const char kUsage[] = "gengen [-g GENERATOR_NAME] [-f FUNCTION_NAME] [-o OUTPUT_DIR] [-r RUNTIME_NAME] [-e EMIT_OPTIONS] [-x EXTENSION_OPTIONS] [-n FILE_BASE_NAME] [-c CACHE_DIR] "
+                          "target=target-string[,target-string...] [generator_arg=value [...]]\n"
+                          "gengen -b BATCH_FILE [-j NUM_THREADS] [common arguments...]\n\n"
                           "  -e  A comma separated list of files to emit. Accepted values are "
                           "[assembly, bitcode, cpp, h, html, o, static_library, stmt, cpp_stub, schedule, pytorch_wrapper]. If omitted, default value is [static_library, h].\n"
                           "  -x  A comma separated list of file extension pairs to substitute during file naming, "
-                          "in the form [.old=.new[,.old2=.new2]]\n";
-
+                          "in the form [.old=.new[,.old2=.new2]]\n"
+                          "  -b  Compile every request in BATCH_FILE (or stdin, if it is \"-\") in this process. "
+                          "Each line holds the arguments of one request, which are appended to the common arguments; "
+                          "empty lines and lines starting with # are ignored.\n"
+                          "  -j  The number of requests of a batch to compile in parallel. If omitted, one per hardware thread.\n"
+                          "  -c  Reuse the outputs of a previous compile of the same lowered pipeline, target and outputs "
+                          "from CACHE_DIR, which must exist, and store new outputs there. Only applies to single-target compiles.\n";
+
+int generate_filter_main_inner(int argc, char **argv, std::ostream &cerr) {
     std::map<std::string, std::string> flags_info = { { "-f", "" },
                                                       { "-g", "" },
                                                       { "-o", "" },
                                                       { "-e", "" },
                                                       { "-n", "" },
                                                       { "-x", "" },
-                                                      { "-r", "" }};
+                                                      { "-r", "" },
+                                                      { "-c", "" }};
     GeneratorParamsMap generator_args;
     for (int i = 1; i < argc; ++i) {
         if (argv[i][0] != '-') {
@@ -984,7 +1230,13 @@ int generate_filter_main(int argc, char **argv, std::ostream &cerr) {
                 user_assert(emit_options.substitutions.empty()) << "substitutions not supported for single-target";
                 // compile_multitarget() will fail if we request anything but library and/or header,
                 // so defer directly to Module::compile if there is a single target.
-                module_producer(function_name, targets[0]).compile(output_files);
+                Module m = module_producer(function_name, targets[0]);
+                const std::string &cache_dir = flags_info["-c"];
+                if (cache_dir.empty()) {
+                    m.compile(output_files);
+                } else {
+                    compile_with_cache(m, output_files, cache_dir);
+                }
             }
         }
     }
@@ -992,6 +1244,116 @@ int generate_filter_main(int argc, char **argv, std::ostream &cerr) {
     return 0;
 }
 
+// Run all the requests in a batch file, with num_threads workers
+// sharing this process (and its LLVM initialization). The output of
+// each request is gathered and printed as a whole, so that the output
+// of concurrent requests doesn't interleave.
+int generate_filter_batch(const std::string &batch_file, int num_threads,
+                          const std::vector<std::string> &common_args, std::ostream &cerr) {
+    std::ifstream file;
+    if (batch_file != "-") {
+        file.open(batch_file);
+        if (!file) {
+            cerr << "Unable to open batch file: " << batch_file << "\n";
+            return 1;
+        }
+    }
+    std::istream &in = batch_file == "-" ? std::cin : file;
+
+    std::vector<std::vector<std::string>> requests;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::vector<std::string> args = common_args;
+        std::string word;
+        while (words >> word) {
+            args.push_back(word);
+        }
+        if (args.size() == common_args.size() || args[common_args.size()][0] == '#') {
+            continue;
+        }
+        requests.push_back(args);
+    }
+
+    if (num_threads <= 0) {
+        num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    num_threads = std::min(num_threads, (int)requests.size());
+
+    std::mutex cerr_mutex;
+    std::atomic<size_t> next{0};
+    std::atomic<int> failures{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < requests.size(); i = next++) {
+            std::vector<char *> argv{const_cast<char *>("gengen")};
+            for (std::string &a : requests[i]) {
+                argv.push_back(const_cast<char *>(a.c_str()));
+            }
+            std::ostringstream out;
+            int result = 1;
+#ifdef WITH_EXCEPTIONS
+            try {
+                result = generate_filter_main_inner((int)argv.size(), argv.data(), out);
+            } catch (const Halide::Error &e) {
+                out << e.what();
+            }
+#else
+            result = generate_filter_main_inner((int)argv.size(), argv.data(), out);
+#endif
+            if (result != 0) {
+                failures++;
+            }
+            if (result != 0 || !out.str().empty()) {
+                std::lock_guard<std::mutex> lock(cerr_mutex);
+                cerr << out.str();
+                if (result != 0) {
+                    cerr << "Request " << i + 1 << " of the batch failed:";
+                    for (const std::string &a : requests[i]) {
+                        cerr << " " << a;
+                    }
+                    cerr << "\n";
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+}  // namespace
+
+int generate_filter_main(int argc, char **argv, std::ostream &cerr) {
+    std::string batch_file;
+    int num_threads = 0;
+    std::vector<std::string> common_args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-b" || arg == "-j") && i + 1 >= argc) {
+            cerr << kUsage;
+            return 1;
+        }
+        if (arg == "-b") {
+            batch_file = argv[++i];
+        } else if (arg == "-j") {
+            num_threads = std::atoi(argv[++i]);
+        } else {
+            common_args.push_back(arg);
+        }
+    }
+    if (batch_file.empty()) {
+        return generate_filter_main_inner(argc, argv, cerr);
+    }
+    return generate_filter_batch(batch_file, num_threads, common_args, cerr);
+}
+
 GeneratorParamBase::GeneratorParamBase(const std::string &name) : name(name) {
     ObjectInstanceRegistry::register_instance(this, 0, ObjectInstanceRegistry::GeneratorParam,
                                               this, nullptr);
@@ -1900,6 +1900,7 @@ public:
     HALIDE_FORWARD_METHOD(Func, compute_root)
     HALIDE_FORWARD_METHOD(Func, compute_with)
     HALIDE_FORWARD_METHOD(Func, define_extern)
+    HALIDE_FORWARD_METHOD(Func, distribute)
     HALIDE_FORWARD_METHOD_CONST(Func, defined)
     HALIDE_FORWARD_METHOD(Func, estimate)
     HALIDE_FORWARD_METHOD(Func, fold_storage)
@@ -3235,6 +3236,13 @@ public:
         return generator->get_array_output(n);
     }
 
+    /** Get all the Funcs that the outputs depend on, including the
+     * outputs themselves and the Funcs defined inside the Generator,
+     * by name. The Generator has already scheduled them, but the
+     * caller can schedule them again, e.g. to compute a producer
+     * inside the Generator at tiles of a consumer outside of it. */
+    std::map<std::string, Func> get_funcs() const;
+
     static std::vector<StubInput> to_stub_input_vector(const Expr &e) {
         return { StubInput(e) };
     }
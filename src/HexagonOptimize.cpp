@@ -2001,6 +2001,90 @@ private:
     }
 };
 
+// Rewrite dense stores of 16-bit values gathered from one VTCM
+// allocation into another as vgather instructions. VTCM allocations
+// may fall back to ordinary memory at runtime, so the original store
+// is kept for when either allocation isn't actually in VTCM.
+class VgatherGenerator : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const Target &target;
+    const Scope<ModulusRemainder> &alignment_info;
+
+    // The size in bytes of the enclosing constant-sized VTCM
+    // allocations.
+    Scope<int> vtcm_allocs;
+
+    Stmt visit(const Allocate *op) override {
+        int32_t size = op->constant_allocation_size();
+        if (op->memory_type != MemoryType::VTCM || op->new_expr.defined() || size <= 0) {
+            return IRMutator2::visit(op);
+        }
+
+        Stmt body;
+        {
+            ScopedBinding<int> bind(vtcm_allocs, op->name, size * op->type.bytes());
+            body = mutate(op->body);
+        }
+        if (body.same_as(op->body)) {
+            return op;
+        }
+
+        // Check once whether the allocation really landed in VTCM.
+        Expr in_vtcm = Call::make(Int(32), "halide_vtcm_contains",
+                                  {Variable::make(Handle(), op->name)}, Call::Extern);
+        body = LetStmt::make(op->name + ".in_vtcm", in_vtcm != 0, body);
+        return Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition,
+                              body, op->new_expr, op->free_function);
+    }
+
+    Stmt visit(const Store *op) override {
+        const Load *load = op->value.as<Load>();
+        const Ramp *ramp = op->index.as<Ramp>();
+        const int native_lanes = target.natural_vector_size(Int(16));
+        const int lanes = op->value.type().lanes();
+        if (!load || !ramp || !is_one(ramp->stride) || load->index.as<Ramp>() ||
+            op->value.type().bits() != 16 || lanes % native_lanes != 0 ||
+            !is_one(op->predicate) || !is_one(load->predicate) ||
+            !vtcm_allocs.contains(op->name) || !vtcm_allocs.contains(load->name)) {
+            return IRMutator2::visit(op);
+        }
+
+        // vgather takes 16-bit byte offsets into the region it
+        // gathers from.
+        int region_size = vtcm_allocs.get(load->name);
+        if (region_size > 65536) {
+            return IRMutator2::visit(op);
+        }
+
+        // vgather writes whole aligned vectors.
+        ModulusRemainder align = modulus_remainder(ramp->base, alignment_info);
+        if (align.modulus % native_lanes != 0 || align.remainder % native_lanes != 0) {
+            return IRMutator2::visit(op);
+        }
+
+        string offsets_name = unique_name('t');
+        Expr offsets = Variable::make(UInt(16, lanes), offsets_name);
+        vector<Stmt> gathers;
+        for (int i = 0; i < lanes; i += native_lanes) {
+            Expr offsets_i = lanes == native_lanes ? offsets : Shuffle::make_slice(offsets, i, 1, native_lanes);
+            Expr gather = Call::make(Int(32), "halide.hexagon.vgather.vh",
+                                     {op->name, simplify(ramp->base + i), load->name, region_size - 1, offsets_i},
+                                     Call::Extern);
+            gathers.push_back(Evaluate::make(gather));
+        }
+        Stmt gather = LetStmt::make(offsets_name, cast(UInt(16, lanes), load->index * 2), Block::make(gathers));
+
+        Expr use_vgather = (Variable::make(Bool(), op->name + ".in_vtcm") &&
+                            Variable::make(Bool(), load->name + ".in_vtcm"));
+        return IfThenElse::make(use_vgather, gather, op);
+    }
+
+public:
+    VgatherGenerator(const Target &t, const Scope<ModulusRemainder> &alignment_info)
+        : target(t), alignment_info(alignment_info) {}
+};
+
 }  // namespace
 
 Stmt optimize_hexagon_shuffles(Stmt s, int lut_alignment) {
@@ -2017,6 +2101,10 @@ Stmt vtmpy_generator(Stmt s) {
     return s;
 }
 
+Stmt vgather_generator(Stmt s, const Target &t, const Scope<ModulusRemainder> &alignment_info) {
+    return VgatherGenerator(t, alignment_info).mutate(s);
+}
+
 Stmt optimize_hexagon_instructions(Stmt s, Target t, Scope<ModulusRemainder> &alignment_info) {
     // Convert some expressions to an equivalent form which get better
     // optimized in later stages for hexagon
@@ -18,6 +18,11 @@ Stmt optimize_hexagon_shuffles(Stmt s, int lut_alignment);
 /** Generate vtmpy instruction if possible */
 Stmt vtmpy_generator(Stmt s);
 
+/** Replace dense stores of 16-bit values gathered from a VTCM
+ * allocation into another VTCM allocation with vgather
+ * instructions. Requires HVX v65 or later. */
+Stmt vgather_generator(Stmt s, const Target &t, const Scope<ModulusRemainder> &alignment_info);
+
 /** Hexagon deinterleaves when performing widening operations, and
  * interleaves when performing narrowing operations. This pass
  * rewrites widenings/narrowings to be explicit in the IR, and
@@ -0,0 +1,219 @@
+#include "HoistInvariantDivisors.h"
+#include "CodeGen_GPU_Dev.h"
+#include "ExprUsesVar.h"
+#include "IREquality.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The values needed to divide by a divisor, which are computed
+// outside the loop.
+struct Divisor {
+    Expr value;
+    // The multiplier and shifts of the division by the magnitude of
+    // the divisor, and for signed types, its sign as a mask.
+    Expr multiplier, shift1, shift2, sign;
+    vector<pair<string, Expr>> lets;
+};
+
+Divisor make_divisor(Expr b) {
+    Type t = b.type();
+    Type u = t.with_code(Type::UInt);
+    Type wide = u.with_bits(t.bits() * 2);
+    const int bits = t.bits();
+
+    Divisor d;
+    d.value = b;
+    string prefix = unique_name('d');
+
+    auto bind = [&](const string &suffix, Expr e) {
+        string name = prefix + "." + suffix;
+        d.lets.push_back({name, e});
+        return Variable::make(e.type(), name);
+    };
+
+    Expr magnitude;
+    if (t.is_int()) {
+        d.sign = bind("sign", b >> (bits - 1));
+        magnitude = cast(u, abs(b));
+    } else {
+        magnitude = b;
+    }
+    // Division by zero is undefined, but computing the multiplier
+    // outside the loop mustn't trap where the loop didn't.
+    magnitude = bind("magnitude", max(magnitude, make_one(u)));
+
+    // l = ceil(log2(magnitude))
+    Expr l = bind("log2", make_const(u, bits) - count_leading_zeros(magnitude - make_one(u)));
+    // multiplier = floor(2^bits * (2^l - magnitude) / magnitude) + 1,
+    // which fits in the type.
+    Expr w = cast(wide, magnitude);
+    Expr m = (((make_one(wide) << cast(wide, l)) - w) << bits) / w + make_one(wide);
+    d.multiplier = bind("multiplier", cast(u, m));
+    d.shift1 = bind("shift1", min(l, make_one(u)));
+    d.shift2 = bind("shift2", max(l, make_one(u)) - make_one(u));
+    return d;
+}
+
+// a / b, for a numerator of the type of the divisor, or its lanes.
+Expr divide(Expr a, const Divisor &d) {
+    Type t = a.type();
+    Type u = t.with_code(Type::UInt);
+    Type wide = u.with_bits(t.bits() * 2);
+    const int lanes = t.lanes();
+
+    auto broadcast = [&](Expr e) {
+        return lanes > 1 ? Broadcast::make(e, lanes) : e;
+    };
+
+    // Fold a negative numerator onto the positive half, where the
+    // quotient rounds down: floor(a / m) = ~(~a / m) for a < 0.
+    Expr a_sign;
+    Expr n = a;
+    if (t.is_int()) {
+        a_sign = a >> (t.bits() - 1);
+        n = a ^ a_sign;
+    }
+    n = cast(u, n);
+
+    Expr hi = cast(u, (cast(wide, n) * cast(wide, broadcast(d.multiplier))) >> t.bits());
+    Expr q = (hi + ((n - hi) >> broadcast(d.shift1))) >> broadcast(d.shift2);
+
+    if (t.is_int()) {
+        q = cast(t, q) ^ a_sign;
+        // Euclidean division by a negative number rounds the other way.
+        Expr b_sign = broadcast(d.sign);
+        q = (q ^ b_sign) - b_sign;
+    }
+    return q;
+}
+
+class HoistInvariantDivisors : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // The divisors of the innermost loop to compute outside of it.
+    vector<Divisor> divisors;
+
+    // The loop variable of the innermost loop, and the names defined
+    // inside it.
+    Scope<> varying;
+    bool in_loop = false;
+
+    // Returns the Divisor for a scalar divisor if it is invariant in
+    // the innermost loop.
+    const Divisor *invariant_divisor(const Expr &b) {
+        Type t = b.type();
+        if (!in_loop ||
+            !(t.is_int() || t.is_uint()) ||
+            (t.bits() != 8 && t.bits() != 16 && t.bits() != 32) ||
+            is_const(b) ||
+            !is_pure(b) ||
+            expr_uses_vars(b, varying)) {
+            return nullptr;
+        }
+        for (const Divisor &d : divisors) {
+            if (equal(d.value, b)) {
+                return &d;
+            }
+        }
+        divisors.push_back(make_divisor(b));
+        return &divisors.back();
+    }
+
+    Expr scalar_divisor(const Expr &b) {
+        if (const Broadcast *bc = b.as<Broadcast>()) {
+            return bc->value;
+        }
+        return b.type().is_scalar() ? b : Expr();
+    }
+
+    Expr visit(const Div *op) override {
+        Expr a = mutate(op->a);
+        Expr b = scalar_divisor(op->b);
+        const Divisor *d = b.defined() ? invariant_divisor(b) : nullptr;
+        if (d) {
+            return divide(a, *d);
+        }
+        return Div::make(a, mutate(op->b));
+    }
+
+    Expr visit(const Mod *op) override {
+        Expr a = mutate(op->a);
+        Expr b = scalar_divisor(op->b);
+        const Divisor *d = b.defined() ? invariant_divisor(b) : nullptr;
+        if (d) {
+            // The Euclidean remainder is a - (a / b) * b.
+            return a - divide(a, *d) * op->b;
+        }
+        return Mod::make(a, mutate(op->b));
+    }
+
+    Expr visit(const Let *op) override {
+        Expr value = mutate(op->value);
+        varying.push(op->name);
+        Expr body = mutate(op->body);
+        varying.pop(op->name);
+        return Let::make(op->name, value, body);
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        Expr value = mutate(op->value);
+        varying.push(op->name);
+        Stmt body = mutate(op->body);
+        varying.pop(op->name);
+        return LetStmt::make(op->name, value, body);
+    }
+
+    Stmt visit(const For *op) override {
+        // Leave GPU kernels and other devices alone. They have their
+        // own blocks of code, which the values can't be computed
+        // outside of.
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name) ||
+            (op->device_api != DeviceAPI::None && op->device_api != DeviceAPI::Host)) {
+            return op;
+        }
+
+        Expr min = mutate(op->min);
+        Expr extent = mutate(op->extent);
+
+        vector<Divisor> outer_divisors;
+        Scope<> outer_varying;
+        outer_divisors.swap(divisors);
+        outer_varying.swap(varying);
+        bool outer_in_loop = in_loop;
+
+        in_loop = true;
+        varying.push(op->name);
+        Stmt body = mutate(op->body);
+        Stmt s = For::make(op->name, min, extent, op->for_type, op->device_api, body);
+        for (size_t i = divisors.size(); i > 0; i--) {
+            const vector<pair<string, Expr>> &lets = divisors[i - 1].lets;
+            for (size_t j = lets.size(); j > 0; j--) {
+                s = LetStmt::make(lets[j - 1].first, lets[j - 1].second, s);
+            }
+        }
+
+        divisors.swap(outer_divisors);
+        varying.swap(outer_varying);
+        in_loop = outer_in_loop;
+        return s;
+    }
+};
+
+}  // namespace
+
+Stmt hoist_invariant_divisors(const Stmt &s) {
+    return HoistInvariantDivisors().mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,26 @@
+#ifndef HALIDE_HOIST_INVARIANT_DIVISORS_H
+#define HALIDE_HOIST_INVARIANT_DIVISORS_H
+
+/** \file
+ * Defines the lowering pass that replaces integer division by
+ * loop-invariant values with multiplies and shifts.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Division by a value that isn't known at compile time, but doesn't
+ * change within a loop (e.g. a param, or the extent of a buffer), is
+ * a hardware divide per iteration, or per lane for vectors, which
+ * most targets can't divide. Rewrite 8, 16, and 32-bit integer
+ * divisions and modulos by such values as a multiply-high, an add and
+ * two shifts, by a multiplier and shifts computed once, outside the
+ * loop (Granlund and Montgomery's round-up method, as in libdivide). */
+Stmt hoist_invariant_divisors(const Stmt &s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
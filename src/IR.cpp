@@ -6,6 +6,80 @@
 namespace Halide {
 namespace Internal {
 
+namespace {
+
+// The IR nodes are at most a few hundred bytes. Blocks are recycled in
+// multiples of 16 bytes up to 256, and larger nodes use the system
+// allocator directly.
+const size_t node_block_granularity = 16;
+const int node_block_sizes = 16;
+// The number of free blocks each thread keeps of each size, so
+// that a thread freeing a large IR tree doesn't hold its memory forever.
+const int max_free_node_blocks = 4096;
+
+struct FreeNodeBlock {
+    FreeNodeBlock *next;
+};
+
+struct FreeNodeBlocks {
+    FreeNodeBlock *head[node_block_sizes] = {};
+    int count[node_block_sizes] = {};
+    ~FreeNodeBlocks();
+};
+
+thread_local FreeNodeBlocks free_node_blocks;
+// IR nodes may be freed by the destructors of other thread-local
+// objects after free_node_blocks is gone. This flag is trivially
+// destructible, so it stays valid until the thread is gone.
+thread_local bool free_node_blocks_released = false;
+
+FreeNodeBlocks::~FreeNodeBlocks() {
+    for (int c = 0; c < node_block_sizes; c++) {
+        while (head[c]) {
+            FreeNodeBlock *next = head[c]->next;
+            ::operator delete(head[c]);
+            head[c] = next;
+        }
+        count[c] = 0;
+    }
+    free_node_blocks_released = true;
+}
+
+int node_block_size_class(size_t size) {
+    return (int)((size + node_block_granularity - 1) / node_block_granularity) - 1;
+}
+
+}  // namespace
+
+void *IRNode::operator new(size_t size) {
+    int c = node_block_size_class(size);
+    if (c >= node_block_sizes || free_node_blocks_released) {
+        return ::operator new(size);
+    }
+    FreeNodeBlocks &blocks = free_node_blocks;
+    FreeNodeBlock *b = blocks.head[c];
+    if (b) {
+        blocks.head[c] = b->next;
+        blocks.count[c]--;
+        return b;
+    }
+    return ::operator new((c + 1) * node_block_granularity);
+}
+
+void IRNode::operator delete(void *ptr, size_t size) {
+    int c = node_block_size_class(size);
+    if (c >= node_block_sizes || free_node_blocks_released ||
+        free_node_blocks.count[c] >= max_free_node_blocks) {
+        ::operator delete(ptr);
+        return;
+    }
+    FreeNodeBlocks &blocks = free_node_blocks;
+    FreeNodeBlock *b = (FreeNodeBlock *)ptr;
+    b->next = blocks.head[c];
+    blocks.head[c] = b;
+    blocks.count[c]++;
+}
+
 Expr Cast::make(Type t, Expr v) {
     internal_assert(v.defined()) << "Cast of undefined\n";
     internal_assert(t.lanes() == v.type().lanes()) << "Cast may not change vector widths\n";
@@ -745,6 +819,20 @@ bool Shuffle::is_extract_element() const {
 }
 
 
+Expr VectorReduce::make(VectorReduce::Operator op, Expr vec, int lanes) {
+    internal_assert(vec.defined()) << "VectorReduce of undefined\n";
+    internal_assert(lanes > 0 && vec.type().lanes() % lanes == 0)
+        << "VectorReduce of " << vec.type().lanes() << " lanes to " << lanes << " lanes\n";
+    internal_assert(!vec.type().is_bool() || op == And || op == Or)
+        << "VectorReduce of a boolean vector with an arithmetic operator\n";
+
+    VectorReduce *node = new VectorReduce;
+    node->type = vec.type().with_lanes(lanes);
+    node->op = op;
+    node->value = std::move(vec);
+    return node;
+}
+
 template<> void ExprNode<IntImm>::accept(IRVisitor *v) const { v->visit((const IntImm *)this); }
 template<> void ExprNode<UIntImm>::accept(IRVisitor *v) const { v->visit((const UIntImm *)this); }
 template<> void ExprNode<FloatImm>::accept(IRVisitor *v) const { v->visit((const FloatImm *)this); }
@@ -774,6 +862,7 @@ template<> void ExprNode<Broadcast>::accept(IRVisitor *v) const { v->visit((cons
 template<> void ExprNode<Call>::accept(IRVisitor *v) const { v->visit((const Call *)this); }
 template<> void ExprNode<Shuffle>::accept(IRVisitor *v) const { v->visit((const Shuffle *)this); }
 template<> void ExprNode<Let>::accept(IRVisitor *v) const { v->visit((const Let *)this); }
+template<> void ExprNode<VectorReduce>::accept(IRVisitor *v) const { v->visit((const VectorReduce *)this); }
 template<> void StmtNode<LetStmt>::accept(IRVisitor *v) const { v->visit((const LetStmt *)this); }
 template<> void StmtNode<AssertStmt>::accept(IRVisitor *v) const { v->visit((const AssertStmt *)this); }
 template<> void StmtNode<ProducerConsumer>::accept(IRVisitor *v) const { v->visit((const ProducerConsumer *)this); }
@@ -817,6 +906,7 @@ template<> Expr ExprNode<Broadcast>::mutate_expr(IRMutator2 *v) const { return v
 template<> Expr ExprNode<Call>::mutate_expr(IRMutator2 *v) const { return v->visit((const Call *)this); }
 template<> Expr ExprNode<Shuffle>::mutate_expr(IRMutator2 *v) const { return v->visit((const Shuffle *)this); }
 template<> Expr ExprNode<Let>::mutate_expr(IRMutator2 *v) const { return v->visit((const Let *)this); }
+template<> Expr ExprNode<VectorReduce>::mutate_expr(IRMutator2 *v) const { return v->visit((const VectorReduce *)this); }
 
 template<> Stmt StmtNode<LetStmt>::mutate_stmt(IRMutator2 *v) const { return v->visit((const LetStmt *)this); }
 template<> Stmt StmtNode<AssertStmt>::mutate_stmt(IRMutator2 *v) const { return v->visit((const AssertStmt *)this); }
@@ -845,6 +935,7 @@ Call::ConstString Call::abs = "abs";
 Call::ConstString Call::absd = "absd";
 Call::ConstString Call::lerp = "lerp";
 Call::ConstString Call::random = "random";
+Call::ConstString Call::philox = "philox";
 Call::ConstString Call::popcount = "popcount";
 Call::ConstString Call::count_leading_zeros = "count_leading_zeros";
 Call::ConstString Call::count_trailing_zeros = "count_trailing_zeros";
@@ -877,6 +968,13 @@ Call::ConstString Call::require = "require";
 Call::ConstString Call::size_of_halide_buffer_t = "size_of_halide_buffer_t";
 Call::ConstString Call::strict_float = "strict_float";
 Call::ConstString Call::unsafe_promise_clamped = "unsafe_promise_clamped";
+Call::ConstString Call::atomic_add = "atomic_add";
+Call::ConstString Call::vectorized_reduction = "vectorized_reduction";
+Call::ConstString Call::wmma_16x16x16 = "wmma_16x16x16";
+Call::ConstString Call::nontemporal_store = "nontemporal_store";
+Call::ConstString Call::address_of = "address_of";
+Call::ConstString Call::cpu_has_features = "cpu_has_features";
+Call::ConstString Call::memory_footprint = "memory_footprint";
 
 Call::ConstString Call::buffer_get_dimensions = "_halide_buffer_get_dimensions";
 Call::ConstString Call::buffer_get_min = "_halide_buffer_get_min";
@@ -486,6 +486,7 @@ struct Call : public ExprNode<Call> {
         absd,
         rewrite_buffer,
         random,
+        philox,
         lerp,
         popcount,
         count_leading_zeros,
@@ -518,7 +519,14 @@ struct Call : public ExprNode<Call> {
         require,
         size_of_halide_buffer_t,
         strict_float,
-        unsafe_promise_clamped;
+        unsafe_promise_clamped,
+        atomic_add,
+        vectorized_reduction,
+        wmma_16x16x16,
+        nontemporal_store,
+        address_of,
+        cpu_has_features,
+        memory_footprint;
 
     // We also declare some symbolic names for some of the runtime
     // functions that we want to construct Call nodes to here to avoid
@@ -750,6 +758,30 @@ struct Prefetch : public StmtNode<Prefetch> {
     static const IRNodeType _node_type = IRNodeType::Prefetch;
 };
 
+/** Horizontally reduce a vector to a vector with fewer lanes,
+ * combining each group of adjacent lanes with an associative and
+ * commutative operator. If the input has N lanes and the output M
+ * lanes, lane i of the output is the reduction of lanes [i * N / M,
+ * (i + 1) * N / M) of the input, so with one output lane the whole
+ * vector is reduced. */
+struct VectorReduce : public ExprNode<VectorReduce> {
+    typedef enum {
+        Add,
+        Mul,
+        Min,
+        Max,
+        And,
+        Or,
+    } Operator;
+
+    Expr value;
+    Operator op;
+
+    static Expr make(Operator op, Expr vec, int lanes);
+
+    static const IRNodeType _node_type = IRNodeType::VectorReduce;
+};
+
 }  // namespace Internal
 }  // namespace Halide
 
@@ -89,6 +89,7 @@ private:
     void visit(const IfThenElse *);
     void visit(const Evaluate *);
     void visit(const Shuffle *);
+    void visit(const VectorReduce *);
     void visit(const Prefetch *);
 };
 
@@ -510,6 +511,13 @@ void IRComparer::visit(const Shuffle *op) {
     }
 }
 
+void IRComparer::visit(const VectorReduce *op) {
+    const VectorReduce *e = expr.as<VectorReduce>();
+
+    compare_scalar(e->op, op->op);
+    compare_expr(e->value, op->value);
+}
+
 void IRComparer::visit(const Prefetch *op) {
     const Prefetch *s = stmt.as<Prefetch>();
 
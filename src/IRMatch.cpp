@@ -46,6 +46,19 @@ void expr_match_test() {
 
     internal_assert(expr_match(vec_wild * 3, Ramp::make(x, y, 4) * 3, matches));
 
+    {
+        IRMatcher::Wild<0> a;
+        IRMatcher::Wild<1> b;
+        IRMatcher::Wild<2> c;
+        Expr lhs = x <= y, rhs = x <= 3;
+        auto rewrite = IRMatcher::rewriter<And>(lhs, rhs, Bool());
+        internal_assert(!rewrite((a < b) && (a < c), a < min(b, c)));
+        internal_assert(!rewrite((a <= b) && (b <= c), b <= min(a, c)));
+        internal_assert(rewrite((a <= b) && (a <= c), a <= min(b, c)) &&
+                        equal(rewrite.result, x <= min(y, 3)));
+        internal_assert(rewrite(a && a, IRMatcher::BoolConst<false>()) == false);
+    }
+
     std::cout << "expr_match test passed" << std::endl;
 }
 
@@ -5,7 +5,11 @@
  * Defines a method to match a fragment of IR against a pattern containing wildcards
  */
 
+#include <type_traits>
+
 #include "IR.h"
+#include "IREquality.h"
+#include "IROperator.h"
 
 namespace Halide {
 namespace Internal {
@@ -45,6 +49,174 @@ bool expr_match(Expr pattern, Expr expr, std::map<std::string, Expr> &result);
 
 void expr_match_test();
 
+/** A compile-time pattern matcher and rewriter, used by the simplifier
+ * to state its rewrite rules as a table. Patterns are built with the
+ * usual operators from wildcards, and are matched structurally without
+ * constructing any IR:
+ \code
+ IRMatcher::Wild<0> x;
+ IRMatcher::Wild<1> y;
+ IRMatcher::Wild<2> z;
+ auto rewrite = IRMatcher::rewriter<And>(a, b, op->type);
+ if (rewrite((x <= y) && (x <= z), x <= min(y, z)) ||
+     rewrite((x < y) && (x < z), x < min(y, z))) {
+     return mutate(rewrite.result);
+ }
+ \endcode
+ * The rules are tried in order, and the first one to match builds its
+ * replacement from the Exprs bound to the wildcards.
+ */
+namespace IRMatcher {
+
+constexpr int max_wild = 6;
+
+/** The Exprs bound to the wildcards while matching a rule, and the type
+ * of the Expr being rewritten. */
+struct MatcherState {
+    Expr bindings[max_wild];
+    Type type;
+
+    void reset() {
+        for (int i = 0; i < max_wild; i++) {
+            bindings[i] = Expr();
+        }
+    }
+};
+
+/** All patterns derive from this, so that the operators below only
+ * apply to patterns. */
+struct Pattern {};
+
+template<typename T>
+using enable_if_pattern = typename std::enable_if<std::is_base_of<Pattern, T>::value>::type;
+
+/** Matches any Expr. A wildcard used more than once in a pattern only
+ * matches equal Exprs. */
+template<int i>
+struct Wild : Pattern {
+    static_assert(i >= 0 && i < max_wild, "Wildcard index out of range");
+
+    bool match(const Expr &e, MatcherState &state) const {
+        if (state.bindings[i].defined()) {
+            return equal(state.bindings[i], e);
+        }
+        state.bindings[i] = e;
+        return true;
+    }
+
+    Expr make(const MatcherState &state) const {
+        return state.bindings[i];
+    }
+};
+
+/** A replacement by a constant true or false, of the type of the Expr
+ * being rewritten. */
+template<bool value>
+struct BoolConst : Pattern {
+    Expr make(const MatcherState &state) const {
+        return value ? const_true(state.type.lanes()) : const_false(state.type.lanes());
+    }
+};
+
+template<typename Op, typename A, typename B>
+struct BinOp : Pattern {
+    A a;
+    B b;
+
+    BinOp(const A &a, const B &b) : a(a), b(b) {}
+
+    bool match(const Expr &e, MatcherState &state) const {
+        const Op *op = e.as<Op>();
+        return op && match_children(op->a, op->b, state);
+    }
+
+    bool match_children(const Expr &ea, const Expr &eb, MatcherState &state) const {
+        return a.match(ea, state) && b.match(eb, state);
+    }
+
+    Expr make(const MatcherState &state) const {
+        return Op::make(a.make(state), b.make(state));
+    }
+};
+
+template<typename A>
+struct NotOp : Pattern {
+    A a;
+
+    NotOp(const A &a) : a(a) {}
+
+    bool match(const Expr &e, MatcherState &state) const {
+        const Not *op = e.as<Not>();
+        return op && a.match(op->a, state);
+    }
+
+    Expr make(const MatcherState &state) const {
+        return Not::make(a.make(state));
+    }
+};
+
+#define HALIDE_MATCHER_BINOP(op, Op)                                          \
+    template<typename A, typename B, typename = enable_if_pattern<A>,         \
+             typename = enable_if_pattern<B>>                                 \
+    BinOp<Op, A, B> op(const A &a, const B &b) {                             \
+        return BinOp<Op, A, B>(a, b);                                         \
+    }
+
+HALIDE_MATCHER_BINOP(operator+, Add)
+HALIDE_MATCHER_BINOP(operator-, Sub)
+HALIDE_MATCHER_BINOP(operator*, Mul)
+HALIDE_MATCHER_BINOP(operator/, Div)
+HALIDE_MATCHER_BINOP(operator%, Mod)
+HALIDE_MATCHER_BINOP(min, Min)
+HALIDE_MATCHER_BINOP(max, Max)
+HALIDE_MATCHER_BINOP(operator==, EQ)
+HALIDE_MATCHER_BINOP(operator!=, NE)
+HALIDE_MATCHER_BINOP(operator<, LT)
+HALIDE_MATCHER_BINOP(operator<=, LE)
+HALIDE_MATCHER_BINOP(operator>, GT)
+HALIDE_MATCHER_BINOP(operator>=, GE)
+HALIDE_MATCHER_BINOP(operator&&, And)
+HALIDE_MATCHER_BINOP(operator||, Or)
+
+#undef HALIDE_MATCHER_BINOP
+
+template<typename A, typename = enable_if_pattern<A>>
+NotOp<A> operator!(const A &a) {
+    return NotOp<A>(a);
+}
+
+/** Rewrites a binary operator node of type Op, given its (already
+ * simplified) operands. The operands are held by reference, so they
+ * must outlive the rewriter. */
+template<typename Op>
+struct Rewriter {
+    const Expr &a, &b;
+    MatcherState state;
+    /** The replacement built by the last rule that matched. */
+    Expr result;
+
+    Rewriter(const Expr &a, const Expr &b, Type type) : a(a), b(b) {
+        state.type = type;
+    }
+
+    template<typename A, typename B, typename After>
+    bool operator()(const BinOp<Op, A, B> &before, const After &after) {
+        state.reset();
+        if (!before.match_children(a, b, state)) {
+            return false;
+        }
+        result = after.make(state);
+        return true;
+    }
+};
+
+template<typename Op>
+Rewriter<Op> rewriter(const Expr &a, const Expr &b, Type type) {
+    return Rewriter<Op>(a, b, type);
+}
+
+}  // namespace IRMatcher
+
 }  // namespace Internal
 }  // namespace Halide
 
@@ -384,6 +384,18 @@ void IRMutator::visit(const Shuffle *op) {
     }
 }
 
+void IRMutator::visit(const VectorReduce *op) {
+    Expr value = mutate(op->value);
+    if (value.same_as(op->value)) {
+        expr = op;
+    } else {
+        // Keep the number of lanes reduced into each output lane.
+        int factor = op->value.type().lanes() / op->type.lanes();
+        int lanes = value.type().lanes() / factor;
+        expr = VectorReduce::make(op->op, std::move(value), lanes);
+    }
+}
+
 
 IRMutator2::IRMutator2() {
 }
@@ -707,6 +719,17 @@ Expr IRMutator2::visit(const Shuffle *op) {
     return Shuffle::make(new_vectors, op->indices);
 }
 
+Expr IRMutator2::visit(const VectorReduce *op) {
+    Expr value = mutate(op->value);
+    if (value.same_as(op->value)) {
+        return op;
+    }
+    // Keep the number of lanes reduced into each output lane.
+    int factor = op->value.type().lanes() / op->type.lanes();
+    int lanes = value.type().lanes() / factor;
+    return VectorReduce::make(op->op, std::move(value), lanes);
+}
+
 Stmt IRGraphMutator2::mutate(const Stmt &s) {
     auto iter = stmt_replacements.find(s);
     if (iter != stmt_replacements.end()) {
@@ -436,7 +436,12 @@ void match_types(Expr &a, Expr &b) {
     } else if (ta.is_float() && tb.is_float()) {
         // float(a) * float(b) -> float(max(a, b))
         if (ta.bits() > tb.bits()) b = cast(ta, std::move(b));
-        else a = cast(tb, std::move(a));
+        else if (ta.bits() < tb.bits()) a = cast(tb, std::move(a));
+        else {
+            // bfloat16(a) * float16(b) -> float32
+            a = cast(Float(32, ta.lanes()), std::move(a));
+            b = cast(Float(32, tb.lanes()), std::move(b));
+        }
     } else if (ta.is_uint() && tb.is_uint()) {
         // uint(a) * uint(b) -> uint(max(a, b))
         if (ta.bits() > tb.bits()) b = cast(ta, std::move(b));
@@ -575,6 +580,37 @@ Expr halide_exp(Expr x_full) {
     return result;
 }
 
+Expr halide_tanh(Expr x_full) {
+    Type type = x_full.type();
+    internal_assert(type.element_of() == Float(32));
+
+    Expr x = abs(x_full);
+
+    // Near zero, 1 - 2 / (e^2x + 1) loses all of its bits to
+    // cancellation, so use an odd polynomial there instead (the one
+    // from Cephes, which has a relative error of about 2^-23).
+    float coeff[] = {
+        -5.70498872745e-3f,
+        2.06390887954e-2f,
+        -5.37397155531e-2f,
+        1.33314422036e-1f,
+        -3.33332819422e-1f};
+    Expr x2 = x_full * x_full;
+    Expr small = x_full + x_full * x2 * evaluate_polynomial(x2, coeff, sizeof(coeff)/sizeof(coeff[0]));
+
+    // e^2x overflows to infinity for large x, which correctly gives 1.
+    Expr large = 1.0f - 2.0f / (halide_exp(x * 2.0f) + 1.0f);
+    large = select(x_full < 0.0f, -large, large);
+
+    Expr result = select(x < 0.625f, small, large);
+    result = select(is_nan(x_full), x_full, result);
+
+    // This introduces lots of common subexpressions
+    result = common_subexpression_elimination(result);
+
+    return result;
+}
+
 Expr halide_erf(Expr x_full) {
     user_assert(x_full.type() == Float(32)) << "halide_erf only works for Float(32)";
 
@@ -887,6 +923,31 @@ Expr memoize_tag_helper(Expr result, const std::vector<Expr> &cache_key_values)
 
 }  // namespace Internal
 
+namespace {
+
+Expr philox(Type t, const std::vector<Expr> &coords, Expr seed) {
+    user_assert(!coords.empty() && coords.size() <= 4)
+        << "Philox random numbers take one to four coordinates, not " << coords.size() << "\n";
+    std::vector<Expr> args = coords;
+    args.push_back(std::move(seed));
+    for (const Expr &arg : args) {
+        user_assert(arg.defined() && (arg.type() == Int(32) || arg.type() == UInt(32)))
+            << "The coordinates and seed of Philox random numbers must have type Int(32) or UInt(32), but "
+            << arg << " has type " << arg.type() << "\n";
+    }
+    return Internal::Call::make(t, Internal::Call::philox, args, Internal::Call::PureIntrinsic);
+}
+
+}  // namespace
+
+Expr philox_uint(const std::vector<Expr> &coords, Expr seed) {
+    return philox(UInt(32), coords, std::move(seed));
+}
+
+Expr philox_float(const std::vector<Expr> &coords, Expr seed) {
+    return philox(Float(32), coords, std::move(seed));
+}
+
 Expr saturating_cast(Type t, Expr e) {
     // For float to float, guarantee infinities are always pinned to range.
     if (t.is_float() && e.type().is_float()) {
@@ -984,4 +1045,15 @@ Expr unsafe_promise_clamped(Expr value, Expr min, Expr max) {
                                 Internal::Call::Intrinsic);
 }
 
+Expr cpu_has_features(const std::vector<Target::Feature> &features) {
+    user_assert(!features.empty()) << "cpu_has_features requires at least one feature.\n";
+    std::vector<Expr> args;
+    for (Target::Feature f : features) {
+        user_assert(f >= 0 && f < Target::FeatureEnd) << "Invalid feature passed to cpu_has_features.\n";
+        args.push_back(Internal::IntImm::make(Int(32), (int)f));
+    }
+    return Internal::Call::make(Bool(), Internal::Call::cpu_has_features,
+                                args, Internal::Call::Intrinsic);
+}
+
 }  // namespace Halide
@@ -10,6 +10,7 @@
 #include <atomic>
 
 #include "IR.h"
+#include "Target.h"
 #include "Tuple.h"
 #include "Util.h"
 
@@ -97,6 +98,7 @@ inline Expr make_const(Type t, uint8_t val)   {return make_const(t, (uint64_t)va
 inline Expr make_const(Type t, bool val)      {return make_const(t, (uint64_t)val);}
 inline Expr make_const(Type t, float val)     {return make_const(t, (double)val);}
 inline Expr make_const(Type t, float16_t val) {return make_const(t, (double)val);}
+inline Expr make_const(Type t, bfloat16_t val) {return make_const(t, (double)val);}
 // @}
 
 /** Check if a constant value can be correctly represented as the given type. */
@@ -164,6 +166,7 @@ void match_types(Expr &a, Expr &b);
 // @{
 Expr halide_log(Expr a);
 Expr halide_exp(Expr a);
+Expr halide_tanh(Expr a);
 Expr halide_erf(Expr a);
 // @}
 
@@ -1066,9 +1069,12 @@ inline Expr acosh(Expr x) {
     }
 }
 
-/** Return the hyperbolic tangent of a floating-point expression.  If
- * the argument is not floating-point, it is cast to Float(32). Does
- * not vectorize well. */
+/** Return the hyperbolic tangent of a floating-point expression. If
+ * the argument is not floating-point, it is cast to Float(32). For
+ * Float(64) arguments, this calls the system tanh function, and does
+ * not vectorize well. For Float(32) arguments, this function is
+ * accurate up to the last two bits of the mantissa, and vectorizes
+ * cleanly. */
 inline Expr tanh(Expr x) {
     user_assert(x.defined()) << "tanh of undefined Expr\n";
     if (x.type() == Float(64)) {
@@ -1719,6 +1725,21 @@ inline Expr random_int(Expr seed = Expr()) {
     return cast<int32_t>(random_uint(std::move(seed)));
 }
 
+/** Return a uniformly distributed unsigned 32-bit integer that is a
+ * fixed function of one to four Int(32) or UInt(32) coordinates and a
+ * seed: the first word of the Philox-4x32-10 counter-based generator,
+ * with the coordinates as the counter and the seed as the key. Unlike
+ * random_uint, it only depends on its arguments, and is made of exact
+ * integer arithmetic, so the same coordinates give the same value on
+ * every target and in every pipeline, e.g. the dropout mask of a layer
+ * in the forward pass and in its backward pass, without storing it. It
+ * costs ten rounds of two 32-bit multiplies. Vectorizes cleanly. */
+Expr philox_uint(const std::vector<Expr> &coords, Expr seed = 0);
+
+/** Return a uniformly distributed float with 24 random bits in the
+ * half-open interval [0.0f, 1.0f), from \ref philox_uint. */
+Expr philox_float(const std::vector<Expr> &coords, Expr seed = 0);
+
 // Secondary args to print can be Exprs or const char *
 namespace Internal {
 inline HALIDE_NO_USER_CODE_INLINE void collect_print_args(std::vector<Expr> &args) {
@@ -1936,6 +1957,22 @@ inline Expr strict_float(Expr e) {
  */
 Expr unsafe_promise_clamped(Expr value, Expr min, Expr max);
 
+/** Create a boolean Expr that is true iff the CPU the pipeline
+ * runs on supports all of the given target features. It is meant to
+ * be used as the condition of a specialization:
+ \code
+ f.specialize(cpu_has_features({Target::AVX2, Target::FMA})).vectorize(x, 16);
+ \endcode
+ * The specialized loop nest is outlined into its own function which
+ * is compiled as if the given features were added to the target, so
+ * only that loop nest is duplicated per feature set (in contrast to
+ * compile_to_multitarget_static_library, which duplicates the entire
+ * pipeline). The test is a single call to the runtime's cached
+ * halide_can_use_target_features per realization of the Func. When
+ * JIT-compiling, the test is resolved at compile time against the
+ * host. The C backend conservatively treats it as false. */
+Expr cpu_has_features(const std::vector<Target::Feature> &features);
+
 }  // namespace Halide
 
 #endif
@@ -27,6 +27,9 @@ ostream &operator<<(ostream &out, const Type &type) {
     case Type::Float:
         out << "float";
         break;
+    case Type::BFloat:
+        out << "bfloat";
+        break;
     case Type::Handle:
         if (type.handle_type) {
             out << "(" << type.handle_type->inner_name.name << " *)";
@@ -121,6 +124,12 @@ std::ostream &operator<<(std::ostream &out, const MemoryType &t) {
     case MemoryType::GPUShared:
         out << "GPUShared";
         break;
+    case MemoryType::VTCM:
+        out << "VTCM";
+        break;
+    case MemoryType::GPUConstant:
+        out << "GPUConstant";
+        break;
     }
     return out;
 }
@@ -210,6 +219,30 @@ ostream& operator<<(ostream &stream, const AssociativeOp &op) {
     return stream;
 }
 
+ostream &operator<<(ostream &out, const VectorReduce::Operator &op) {
+    switch (op) {
+    case VectorReduce::Add:
+        out << "add";
+        break;
+    case VectorReduce::Mul:
+        out << "mul";
+        break;
+    case VectorReduce::Min:
+        out << "min";
+        break;
+    case VectorReduce::Max:
+        out << "max";
+        break;
+    case VectorReduce::And:
+        out << "and";
+        break;
+    case VectorReduce::Or:
+        out << "or";
+        break;
+    }
+    return out;
+}
+
 ostream &operator<<(ostream &out, const ForType &type) {
     switch (type) {
     case ForType::Serial:
@@ -821,5 +854,11 @@ void IRPrinter::visit(const Shuffle *op) {
     }
 }
 
+void IRPrinter::visit(const VectorReduce *op) {
+    stream << "vector_reduce_" << op->op << "(";
+    print(op->value);
+    stream << ", " << op->type.lanes() << ")";
+}
+
 }  // namespace Internal
 }  // namespace Halide
@@ -70,6 +70,7 @@ protected:
     virtual void visit(const Evaluate *);
     virtual void visit(const Shuffle *);
     virtual void visit(const Prefetch *);
+    virtual void visit(const VectorReduce *);
 };
 
 /** A base class for algorithms that walk recursively over the IR
@@ -136,6 +137,7 @@ protected:
     void visit(const Evaluate *) override;
     void visit(const Shuffle *) override;
     void visit(const Prefetch *) override;
+    void visit(const VectorReduce *) override;
     // @}
 };
 
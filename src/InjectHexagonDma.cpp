@@ -0,0 +1,222 @@
+#include <set>
+
+#include "InjectHexagonDma.h"
+#include "ExprUsesVar.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Simplify.h"
+#include "Substitute.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Remove the modulo of storage folding from an index, so that we can
+// check that it is otherwise linear in the loop variables.
+class StripFolds : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr visit(const Mod *op) override {
+        if (is_const(op->b)) {
+            return mutate(op->a);
+        }
+        return IRMutator2::visit(op);
+    }
+};
+
+class InjectHexagonDma : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // The names of the Funcs to copy with DMA
+    const set<string> &funcs;
+
+    bool in_hexagon;
+
+    Stmt visit(const For *op) override {
+        bool old_in_hexagon = in_hexagon;
+        if (op->device_api == DeviceAPI::Hexagon) {
+            in_hexagon = true;
+        }
+        Stmt s = IRMutator2::visit(op);
+        in_hexagon = old_in_hexagon;
+        return s;
+    }
+
+    Stmt visit(const ProducerConsumer *op) override {
+        if (!op->is_producer || !in_hexagon || !funcs.count(op->name)) {
+            return IRMutator2::visit(op);
+        }
+        Stmt copy = make_copy(op->name, op->body);
+        if (!copy.defined()) {
+            user_warning << "Func " << op->name << " is scheduled dma(), but its loops aren't "
+                         << "a 1D or 2D copy of another buffer, so it is copied as usual.\n";
+            return IRMutator2::visit(op);
+        }
+        return ProducerConsumer::make_produce(op->name, copy);
+    }
+
+    // Turn the loops producing a Func into a call to
+    // halide_hexagon_dma_copy_2d, or return an undefined Stmt if they
+    // aren't a copy with a contiguous inner dimension.
+    Stmt make_copy(const string &name, const Stmt &body) {
+        vector<const LetStmt *> outer_lets;
+        vector<pair<string, Expr>> inner_lets;
+        vector<const For *> loops;
+        Stmt loop_nest, s = body;
+        while (true) {
+            if (const LetStmt *let = s.as<LetStmt>()) {
+                if (loops.empty()) {
+                    outer_lets.push_back(let);
+                } else {
+                    inner_lets.push_back({let->name, let->value});
+                }
+                s = let->body;
+            } else if (const For *loop = s.as<For>()) {
+                if (loop->for_type != ForType::Serial &&
+                    loop->for_type != ForType::Vectorized &&
+                    loop->for_type != ForType::Unrolled) {
+                    return Stmt();
+                }
+                if (loops.empty()) {
+                    loop_nest = s;
+                }
+                loops.push_back(loop);
+                s = loop->body;
+            } else {
+                break;
+            }
+        }
+
+        const Store *store = s.as<Store>();
+        if (loops.empty() || loops.size() > 2 ||
+            !store || store->name != name || !is_one(store->predicate)) {
+            return Stmt();
+        }
+        const Load *load = store->value.as<Load>();
+        if (!load || load->name == name || !is_one(load->predicate) ||
+            !load->type.is_scalar()) {
+            return Stmt();
+        }
+
+        // The inner loop runs along the rows, and the outer one (if
+        // any) across them.
+        const For *inner = loops.back();
+        const For *outer = loops.size() == 2 ? loops[0] : nullptr;
+        Expr x = Variable::make(Int(32), inner->name);
+        Expr x_min = inner->min, x_extent = inner->extent;
+        vector<Expr> index = {store->index, load->index};
+        for (auto it = inner_lets.rbegin(); it != inner_lets.rend(); it++) {
+            x_min = substitute(it->first, it->second, x_min);
+            x_extent = substitute(it->first, it->second, x_extent);
+            for (Expr &i : index) {
+                i = substitute(it->first, it->second, i);
+            }
+        }
+        Expr y, y_min = 0, y_extent = 1;
+        if (outer) {
+            y = Variable::make(Int(32), outer->name);
+            y_min = outer->min;
+            y_extent = outer->extent;
+            if (expr_uses_var(x_min, outer->name) || expr_uses_var(x_extent, outer->name)) {
+                return Stmt();
+            }
+        }
+
+        // Both sides must be dense along the rows, and have a constant
+        // stride across them, up to storage folding.
+        for (const Expr &i : index) {
+            Expr linear = StripFolds().mutate(i);
+            Expr dx = simplify(substitute(inner->name, x + 1, linear) - linear);
+            if (!is_one(dx)) {
+                return Stmt();
+            }
+            if (outer) {
+                Expr dy = simplify(substitute(outer->name, y + 1, linear) - linear);
+                if (expr_uses_var(dy, inner->name) || expr_uses_var(dy, outer->name)) {
+                    return Stmt();
+                }
+            }
+        }
+
+        auto at = [&](Expr i, Expr x_value, Expr y_value) {
+            i = substitute(inner->name, x_value, i);
+            if (outer) {
+                i = substitute(outer->name, y_value, i);
+            }
+            return i;
+        };
+
+        // The folds mustn't wrap around within the region; if they
+        // do, the last element of a row or column isn't where the
+        // linear index would put it.
+        Expr x_max = x_min + x_extent - 1, y_max = y_min + y_extent - 1;
+        Expr no_wrap = const_true();
+        vector<Expr> base(2), stride(2);
+        for (int i = 0; i < 2; i++) {
+            base[i] = at(index[i], x_min, y_min);
+            no_wrap = no_wrap && (at(index[i], x_max, y_min) - base[i] == x_extent - 1);
+            if (outer) {
+                stride[i] = at(index[i], x_min, y_min + 1) - base[i];
+                no_wrap = no_wrap && (at(index[i], x_min, y_max) - base[i] == (y_extent - 1) * stride[i]);
+            } else {
+                stride[i] = x_extent;
+            }
+        }
+        no_wrap = simplify(no_wrap);
+
+        int bytes = load->type.bytes();
+        Expr dst = Call::make(Handle(), Call::address_of,
+                              {Load::make(load->type, name, base[0], Buffer<>(), store->param, const_true())},
+                              Call::Intrinsic);
+        Expr src = Call::make(Handle(), Call::address_of,
+                              {Load::make(load->type, load->name, base[1], load->image, load->param, const_true())},
+                              Call::Intrinsic);
+        Expr copy = Call::make(Int(32), "halide_hexagon_dma_copy_2d",
+                               {dst, stride[0] * bytes, src, stride[1] * bytes, x_extent * bytes, y_extent},
+                               Call::Extern);
+        Stmt result = Evaluate::make(copy);
+        if (!is_one(no_wrap)) {
+            result = IfThenElse::make(no_wrap, result, loop_nest);
+        }
+        for (auto it = outer_lets.rbegin(); it != outer_lets.rend(); it++) {
+            result = LetStmt::make((*it)->name, (*it)->value, result);
+        }
+        return result;
+    }
+
+public:
+    InjectHexagonDma(const set<string> &funcs, bool in_hexagon)
+        : funcs(funcs), in_hexagon(in_hexagon) {}
+};
+
+}  // namespace
+
+Stmt inject_hexagon_dma(Stmt s, const map<string, Function> &env, const Target &t) {
+    set<string> funcs;
+    for (const auto &p : env) {
+        const Function &f = p.second;
+        if (!f.schedule().dma()) {
+            continue;
+        }
+        user_assert(!f.has_update_definition() && !f.has_extern_definition() && f.outputs() == 1)
+            << "Func " << f.name() << " is scheduled dma(), but it isn't a copy: "
+            << "it must have a single pure definition with one value.\n";
+        funcs.insert(f.name());
+    }
+
+    if (funcs.empty()) {
+        return s;
+    }
+    return InjectHexagonDma(funcs, t.arch == Target::Hexagon).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,30 @@
+#ifndef HALIDE_INJECT_HEXAGON_DMA_H
+#define HALIDE_INJECT_HEXAGON_DMA_H
+
+/** \file
+ * Defines the lowering pass that replaces the loops of Funcs scheduled
+ * with Func::dma by calls to the Hexagon DMA runtime
+ */
+
+#include <map>
+
+#include "IR.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Replace the production of each Func scheduled with dma() in
+ * Hexagon code, which must be a copy of a 1D or 2D region of another
+ * buffer, with a call to halide_hexagon_dma_copy_2d. If the storage of
+ * either side is folded, the call is guarded by a check that the
+ * region doesn't wrap around the fold, and the loops are kept for the
+ * case that it does. Runs after storage flattening. */
+Stmt inject_hexagon_dma(Stmt s, const std::map<std::string, Function> &env, const Target &t);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -457,7 +457,7 @@ class InjectBufferCopies : public IRMutator2 {
 
                 // The allocate node is innermost
                 Expr host = Call::make(Handle(), Call::buffer_get_host, {buf}, Call::Extern);
-                body = Allocate::make(buffer, type, MemoryType::Heap, extents, condition, body,
+                body = Allocate::make(buffer, type, memory_type, extents, condition, body,
                                       host, "halide_device_host_nop_free");
 
                 // Then the destructor
@@ -488,12 +488,13 @@ class InjectBufferCopies : public IRMutator2 {
 
         string buffer;
         Type type;
+        MemoryType memory_type;
         vector<Expr> extents;
         Expr condition;
         DeviceAPI device_api;
     public:
-        InjectCombinedAllocation(string b, Type t, vector<Expr> e, Expr c, DeviceAPI d) :
-            buffer(b), type(t), extents(e), condition(c), device_api(d) {}
+        InjectCombinedAllocation(string b, Type t, MemoryType m, vector<Expr> e, Expr c, DeviceAPI d) :
+            buffer(b), type(t), memory_type(m), extents(e), condition(c), device_api(d) {}
     };
 
     class FreeAfterLastUse : public IRMutator2 {
@@ -550,7 +551,11 @@ class InjectBufferCopies : public IRMutator2 {
                 body = FreeAfterLastUse(injector.last_use, device_free).mutate(body);
             }
 
-            return InjectCombinedAllocation(op->name, op->type, op->extents,
+            // The host allocation is in the heap, but the kernels still
+            // need to know which buffers are in constant memory.
+            MemoryType memory_type =
+                op->memory_type == MemoryType::GPUConstant ? op->memory_type : MemoryType::Heap;
+            return InjectCombinedAllocation(op->name, op->type, memory_type, op->extents,
                                             op->condition, touching_device).mutate(body);
         } else {
             // Only touched on host but passed to an extern stage, or
@@ -1,10 +1,13 @@
 #include "InlineReductions.h"
 #include "CSE.h"
 #include "Debug.h"
+#include "ExprUsesVar.h"
 #include "Func.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "Scope.h"
+#include "Simplify.h"
+#include "Substitute.h"
 
 namespace Halide {
 
@@ -222,4 +225,87 @@ Tuple argmin(RDom r, Expr e, const std::string &name) {
     return f(v.call_args);
 }
 
+SlidingSum sliding_sum(Expr e, int tile_size, const std::string &name) {
+    return sliding_sum(RDom(), e, tile_size, name);
+}
+
+SlidingSum sliding_sum(RDom r, Expr e, int tile_size, const std::string &name) {
+    user_assert(tile_size > 0) << "sliding_sum \"" << name << "\" must have a positive tile size\n";
+
+    Expr original = e;
+    Internal::FindFreeVars v(r, name);
+    e = v.mutate(common_subexpression_elimination(e));
+
+    user_assert(v.rdom.defined()) << "Expression passed to sliding_sum must reference a reduction domain";
+
+    // Find the free variable the box slides along: replacing the
+    // reduction variable with t - v must leave an expression of t that
+    // doesn't depend on v.
+    Var t(Internal::unique_name('t'));
+    int slide = -1;
+    Expr at_t;
+    if (v.rdom.dimensions() == 1) {
+        for (size_t i = 0; i < v.free_vars.size() && slide < 0; i++) {
+            Expr g = Internal::substitute(v.rdom.x.name(), t - v.free_vars[i], e);
+            g = Internal::simplify(g);
+            if (!Internal::expr_uses_var(g, v.free_vars[i].name())) {
+                slide = (int)i;
+                at_t = g;
+            }
+        }
+    }
+
+    SlidingSum result;
+    if (slide < 0) {
+        user_warning << "sliding_sum \"" << name << "\" isn't a sum over a box sliding "
+                     << "along one of its variables, so it is computed as a sum.\n";
+        result.value = sum(r, original, name);
+        return result;
+    }
+
+    // The summed value at position p along the sliding variable.
+    auto at = [&](Expr p) {
+        return Internal::substitute(t.name(), p, at_t);
+    };
+
+    Var index(Internal::unique_name(name + "_index"));
+    Var tile(Internal::unique_name(name + "_tile"));
+    vector<Var> scan_vars = v.free_vars;
+    scan_vars[slide] = index;
+    scan_vars.insert(scan_vars.begin() + slide + 1, tile);
+
+    Expr min = v.rdom.x.min(), extent = v.rdom.x.extent();
+    Expr origin = tile * tile_size;
+
+    Func scan(name + "_scan");
+    scan(scan_vars) = undef(e.type());
+
+    // The first output of each tile sums its box.
+    vector<Expr> first_args(scan_vars.begin(), scan_vars.end());
+    first_args[slide] = 0;
+    RDom box(min, extent, name + "_box");
+    scan(first_args) = sum(box, at(origin + box.x), name + "_first");
+
+    // The others update the sum of the previous one.
+    if (tile_size > 1) {
+        RDom running(1, tile_size - 1, name + "_running");
+        vector<Expr> args(scan_vars.begin(), scan_vars.end());
+        vector<Expr> prev_args = args;
+        args[slide] = running.x;
+        prev_args[slide] = running.x - 1;
+        Expr p = origin + running.x;
+        scan(args) = scan(prev_args) + at(p + min + extent - 1) - at(p + min - 1);
+    }
+    scan.compute_root();
+
+    vector<Expr> call_args = v.call_args;
+    Expr p = call_args[slide];
+    call_args[slide] = p % tile_size;
+    call_args.insert(call_args.begin() + slide + 1, p / tile_size);
+
+    result.value = scan(call_args);
+    result.scan = scan;
+    return result;
+}
+
 }  // namespace Halide
@@ -1,12 +1,14 @@
 #ifndef HALIDE_INLINE_REDUCTIONS_H
 #define HALIDE_INLINE_REDUCTIONS_H
 
+#include "Func.h"
 #include "IR.h"
 #include "RDom.h"
 #include "Tuple.h"
 
 /** \file
- * Defines some inline reductions: sum, product, minimum, maximum.
+ * Defines some inline reductions: sum, product, minimum, maximum, and
+ * sliding_sum.
  */
 namespace Halide {
 
@@ -66,6 +68,53 @@ Tuple argmax(RDom, Expr, const std::string &s = "argmax");
 Tuple argmin(RDom, Expr, const std::string &s = "argmin");
 // @}
 
+/** The result of sliding_sum. Converts to the Expr of the sum, so it
+ * can be used wherever sum could. */
+struct SlidingSum {
+    /** The sum, in terms of the free variables of the summed
+     * expression. */
+    Expr value;
+
+    /** The Func that computes the running sums, or an undefined Func
+     * if the sum isn't a sliding box sum. Its arguments are the free
+     * variables of the summed expression, with the variable the box
+     * slides along replaced by the position in a tile and the index of
+     * the tile. Its first update sums the box of the first output of
+     * each tile, and its second update computes the others. It is
+     * compute_root by default. */
+    Func scan;
+
+    operator Expr() const {
+        return value;
+    }
+};
+
+/** Sum an expression over a one-dimensional reduction domain r, where
+ * the expression depends on r and on one of its free variables v only
+ * through v + r, i.e. a box filter sliding along v. For example:
+ *
+ \code
+ RDom r(-2, 5);
+ blur(x, y) = sliding_sum(f(x, y + r));
+ \endcode
+ *
+ * The result is the same as sum's, but is computed as a running sum
+ * along v, in tiles of tile_size outputs: the first output of each
+ * tile sums its box, and each of the others adds the value entering
+ * the box to the previous sum and subtracts the value leaving it. The
+ * work per output is then independent of the size of the box. Schedule
+ * the returned scan, e.g. compute it at a tile loop of the consumer
+ * that covers whole tiles of tile_size along v, and vectorize it along
+ * another of its variables. Float sums round differently from sum, and
+ * the differences grow along each tile.
+ *
+ * If the expression isn't a sliding box sum, this is the same as sum,
+ * with a warning. */
+// @{
+SlidingSum sliding_sum(Expr e, int tile_size = 16, const std::string &name = "sliding_sum");
+SlidingSum sliding_sum(RDom r, Expr e, int tile_size = 16, const std::string &name = "sliding_sum");
+// @}
+
 }  // namespace Halide
 
 #endif
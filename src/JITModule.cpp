@@ -1,3 +1,7 @@
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <stdint.h>
 #include <mutex>
@@ -14,7 +18,9 @@
 #include "Debug.h"
 #include "LLVM_Output.h"
 #include "CodeGen_LLVM.h"
+#include "CompileTimer.h"
 #include "Pipeline.h"
+#include "Util.h"
 
 
 #if defined(_MSC_VER) && !defined(NOMINMAX)
@@ -235,6 +241,76 @@ public:
 
 }
 
+namespace {
+
+// The file in HL_JIT_CACHE_DIR holding the optimized bitcode of a
+// module, or an empty string if the module shouldn't be cached. The
+// name is a hash of the lowered module, which includes the target, and
+// of the versions of LLVM and of this build of Halide. Modules with
+// embedded buffers or external code aren't cached, as those aren't
+// fully described by the printed IR. Nothing is cached by builds of
+// Halide that don't define HALIDE_BUILD_ID (see the Makefile), as
+// they can't tell one version of the code generators from another.
+string jit_cache_file_name(const Module &m) {
+#ifdef HALIDE_BUILD_ID
+    string dir = get_env_variable("HL_JIT_CACHE_DIR");
+    if (dir.empty() || !m.buffers().empty() || !m.external_code().empty()) {
+        return "";
+    }
+    std::ostringstream key;
+    // Print constants exactly, so that modules differing only in the
+    // low bits of a constant don't share an entry.
+    key << std::setprecision(17)
+        << "LLVM " << LLVM_VERSION << ", Halide " << HALIDE_BUILD_ID << "\n"
+        << m;
+    string k = key.str();
+    // Two different 64-bit FNV-1a hashes.
+    uint64_t h1 = 0xcbf29ce484222325ULL, h2 = 0x84222325cbf29ce4ULL;
+    for (char c : k) {
+        h1 = (h1 ^ (uint8_t)c) * 0x100000001b3ULL;
+        h2 = (h2 ^ (uint8_t)c) * 0x100000001b3ULL;
+        h2 ^= h2 >> 29;
+    }
+    std::ostringstream name;
+    name << dir << "/" << m.name() << "_" << std::hex << std::setfill('0')
+         << std::setw(16) << h1 << std::setw(16) << h2 << ".bc";
+    return name.str();
+#else
+    return "";
+#endif
+}
+
+std::unique_ptr<llvm::Module> load_cached_module(const string &file_name, llvm::LLVMContext &context) {
+    std::ifstream in(file_name, std::ios::binary);
+    if (!in.is_open()) {
+        return nullptr;
+    }
+    std::string bitcode((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), file_name);
+    auto module = llvm::parseBitcodeFile(buffer, context);
+    if (!module) {
+        debug(1) << "Ignoring unreadable JIT cache entry " << file_name << "\n";
+        llvm::consumeError(module.takeError());
+        return nullptr;
+    }
+    return std::move(module.get());
+}
+
+void save_cached_module(const string &file_name, llvm::Module &module) {
+    // Write to a temporary file and rename it, so that concurrent
+    // processes never see a partial entry.
+    string temp_name = file_name + "." + unique_name('t');
+    {
+        auto out = make_raw_fd_ostream(temp_name);
+        compile_llvm_module_to_llvm_bitcode(module, *out);
+    }
+    if (std::rename(temp_name.c_str(), file_name.c_str()) != 0) {
+        file_unlink(temp_name);
+    }
+}
+
+}  // namespace
+
 JITModule::JITModule() {
     jit_module = new JITModuleContents();
 }
@@ -242,7 +318,18 @@ JITModule::JITModule() {
 JITModule::JITModule(const Module &m, const LoweredFunc &fn,
                      const std::vector<JITModule> &dependencies) {
     jit_module = new JITModuleContents();
-    std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(m, jit_module->context));
+    string cache_file = jit_cache_file_name(m);
+    std::unique_ptr<llvm::Module> llvm_module;
+    if (!cache_file.empty()) {
+        llvm_module = load_cached_module(cache_file, jit_module->context);
+        debug(1) << "JIT cache " << (llvm_module ? "hit: " : "miss: ") << cache_file << "\n";
+    }
+    if (!llvm_module) {
+        llvm_module = compile_module_to_llvm_module(m, jit_module->context);
+        if (!cache_file.empty()) {
+            save_cached_module(cache_file, *llvm_module);
+        }
+    }
     std::vector<JITModule> deps_with_runtime = dependencies;
     std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), m.target());
     deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
@@ -330,6 +417,7 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     }
 
     debug(2) << "Finalizing object\n";
+    CompileTimer timer("LLVM JIT compilation");
     ee->finalizeObject();
     memory_manager->work_around_llvm_bugs();
 
@@ -426,11 +426,317 @@ class GroupLoopInvariants : public IRMutator2 {
     }
 };
 
+// Find the buffers a statement writes, and whether it has other side
+// effects that loads must not be moved across: impure calls, which
+// may write to any buffer, and assertions, which may guard the loads.
+class FindWrites : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Store *op) {
+        written.insert(op->name);
+        if (op->param.defined()) {
+            writes_external = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Allocate *op) {
+        written.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Free *op) {
+        written.insert(op->name);
+    }
+
+    void visit(const Call *op) {
+        if (!op->is_pure()) {
+            side_effects = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const AssertStmt *op) {
+        side_effects = true;
+        IRVisitor::visit(op);
+    }
+
+public:
+    set<string> written;
+    bool side_effects = false;
+    // Whether any output buffer is written. These may alias the input
+    // buffers, so loads from the inputs can't be moved across them.
+    bool writes_external = false;
+};
+
+// Find the Exprs of a statement that could instead be computed once
+// before it: the scalar ones that don't depend on names bound within it,
+// and whose loads are evaluated unconditionally, from buffers not written
+// by the enclosing block. The buffers Halide allocates don't alias
+// anything, so only stores to the same buffer, or to an output buffer
+// for the input buffers, can change what a load returns. This is a mutator only to hook every Expr, and never changes
+// anything.
+class FindSharableExprs : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // Whether each Expr being visited, innermost last, depends on
+    // something that keeps it from being computed before the statement.
+    vector<bool> pinned;
+    Scope<> inner;
+    int conditional = 0;
+    const FindWrites &writes;
+
+    void pin() {
+        internal_assert(!pinned.empty());
+        pinned.back() = true;
+    }
+
+    bool worth_sharing(const Expr &e) {
+        return !(e.type().is_vector() ||
+                 e.as<Variable>() ||
+                 e.as<Broadcast>() ||
+                 is_const(e));
+    }
+
+    Expr visit(const Variable *op) override {
+        if (inner.contains(op->name)) {
+            pin();
+        }
+        return op;
+    }
+
+    Expr visit(const Load *op) override {
+        if (conditional > 0 ||
+            writes.side_effects ||
+            writes.written.count(op->name) ||
+            (writes.writes_external && (op->image.defined() || op->param.defined())) ||
+            !is_one(op->predicate)) {
+            pin();
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Call *op) override {
+        if (!op->is_pure() || writes.side_effects) {
+            // Even pure calls may rely on the assertions before them,
+            // e.g. to check the buffers they read are defined.
+            pin();
+        }
+        if (op->is_intrinsic(Call::if_then_else)) {
+            mutate(op->args[0]);
+            conditional++;
+            for (size_t i = 1; i < op->args.size(); i++) {
+                mutate(op->args[i]);
+            }
+            conditional--;
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Let *op) override {
+        pin();
+        mutate(op->value);
+        ScopedBinding<> bind(inner, op->name);
+        mutate(op->body);
+        return op;
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        mutate(op->value);
+        ScopedBinding<> bind(inner, op->name);
+        mutate(op->body);
+        return op;
+    }
+
+    Stmt visit(const For *op) override {
+        if (op->device_api == DeviceAPI::GLSL ||
+            op->device_api == DeviceAPI::OpenGLCompute) {
+            // Don't lift anything out of OpenGL loops
+            return op;
+        }
+        mutate(op->min);
+        mutate(op->extent);
+        ScopedBinding<> bind(inner, op->name);
+        conditional++;
+        mutate(op->body);
+        conditional--;
+        return op;
+    }
+
+    Stmt visit(const IfThenElse *op) override {
+        mutate(op->condition);
+        conditional++;
+        mutate(op->then_case);
+        if (op->else_case.defined()) {
+            mutate(op->else_case);
+        }
+        conditional--;
+        return op;
+    }
+
+public:
+    using IRMutator2::mutate;
+
+    Expr mutate(const Expr &e) override {
+        pinned.push_back(false);
+        IRMutator2::mutate(e);
+        bool p = pinned.back();
+        pinned.pop_back();
+        if (!p && worth_sharing(e)) {
+            found.insert(e);
+        } else if (p && !pinned.empty()) {
+            pin();
+        }
+        return e;
+    }
+
+    set<Expr, IRDeepCompare> found;
+
+    FindSharableExprs(const FindWrites &w) : writes(w) {}
+};
+
+// Replace the shared Exprs with the Variables holding their values,
+// except where one of their names is shadowed.
+class ReplaceSharedExprs : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<Expr, string, IRDeepCompare> &shared;
+    Scope<> inner;
+
+    Expr visit(const Let *op) override {
+        Expr value = mutate(op->value);
+        ScopedBinding<> bind(inner, op->name);
+        Expr body = mutate(op->body);
+        return Let::make(op->name, value, body);
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        Expr value = mutate(op->value);
+        ScopedBinding<> bind(inner, op->name);
+        Stmt body = mutate(op->body);
+        return LetStmt::make(op->name, value, body);
+    }
+
+    Stmt visit(const For *op) override {
+        Expr min = mutate(op->min);
+        Expr extent = mutate(op->extent);
+        ScopedBinding<> bind(inner, op->name);
+        Stmt body = mutate(op->body);
+        return For::make(op->name, min, extent, op->for_type, op->device_api, body);
+    }
+
+public:
+    using IRMutator2::mutate;
+
+    Expr mutate(const Expr &e) override {
+        auto it = shared.find(e);
+        if (it != shared.end() && !expr_uses_vars(e, inner)) {
+            return Variable::make(e.type(), it->second);
+        }
+        return IRMutator2::mutate(e);
+    }
+
+    ReplaceSharedExprs(const map<Expr, string, IRDeepCompare> &s) : shared(s) {}
+};
+
+// CSE only looks within a single Expr, and LICM only lifts values out of
+// loops, so values used by several statements of a block, such as the
+// index computations of the stores of the values of a Tuple, or the
+// loads of an input read by the stages computed at the same loop level
+// are recomputed by each one. This pass computes them once, in a
+// LetStmt wrapping the block. LLVM can rarely do this for loads, as it
+// can't tell the stores in between don't alias them.
+class ShareValuesAcrossStatements : public IRMutator2 {
+    using IRMutator2::visit;
+
+    bool in_gpu_blocks{false};
+
+    Stmt visit(const For *op) override {
+        if (op->device_api == DeviceAPI::GLSL ||
+            op->device_api == DeviceAPI::OpenGLCompute) {
+            // Don't lift anything out of OpenGL loops
+            return op;
+        }
+        // Don't lift lets to in-between gpu blocks/threads
+        ScopedValue<bool> old_in_gpu_blocks(in_gpu_blocks,
+                                            op->for_type == ForType::GPUBlock ||
+                                            (in_gpu_blocks && op->for_type != ForType::GPUThread));
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const Block *op) override {
+        vector<Stmt> stmts;
+        Stmt rest = op;
+        while (const Block *b = rest.as<Block>()) {
+            stmts.push_back(mutate(b->first));
+            rest = b->rest;
+        }
+        stmts.push_back(mutate(rest));
+
+        if (in_gpu_blocks) {
+            return Block::make(stmts);
+        }
+
+        FindWrites writes;
+        for (const Stmt &s : stmts) {
+            s.accept(&writes);
+        }
+
+        // Find the Exprs shared by more than one of the statements.
+        map<Expr, int, IRDeepCompare> uses;
+        for (const Stmt &s : stmts) {
+            FindSharableExprs finder(writes);
+            finder.mutate(s);
+            for (const Expr &e : finder.found) {
+                uses[e]++;
+            }
+        }
+        map<Expr, string, IRDeepCompare> shared;
+        for (const auto &p : uses) {
+            if (p.second > 1) {
+                shared[p.first] = unique_name('t');
+            }
+        }
+        if (shared.empty()) {
+            return Block::make(stmts);
+        }
+
+        ReplaceSharedExprs replacer(shared);
+        for (Stmt &s : stmts) {
+            s = replacer.mutate(s);
+        }
+        Stmt result = Block::make(stmts);
+
+        // The larger shared Exprs contain the smaller ones, so define
+        // each value after the values it uses.
+        vector<pair<string, Expr>> pending;
+        for (const auto &p : shared) {
+            pending.push_back({p.second, replacer.IRMutator2::mutate(p.first)});
+        }
+        while (!pending.empty()) {
+            size_t i = 0;
+            for (; i < pending.size(); i++) {
+                bool used = false;
+                for (size_t j = 0; j < pending.size() && !used; j++) {
+                    used = (j != i) && expr_uses_var(pending[j].second, pending[i].first);
+                }
+                if (!used) break;
+            }
+            internal_assert(i < pending.size()) << "Cycle in the shared values of a block\n";
+            result = LetStmt::make(pending[i].first, pending[i].second, result);
+            pending.erase(pending.begin() + i);
+        }
+        return result;
+    }
+};
+
 // Turn for loops of size one into let statements
 Stmt loop_invariant_code_motion(Stmt s) {
     s = GroupLoopInvariants().mutate(s);
     s = common_subexpression_elimination(s);
     s = LICM().mutate(s);
+    s = ShareValuesAcrossStatements().mutate(s);
     s = simplify_exprs(s);
     return s;
 }
@@ -5,6 +5,10 @@
 #error "Compiling Halide requires LLVM 4.0 or newer"
 #endif
 
+#if WITH_RISCV && LLVM_VERSION < 90
+#error "The RISCV target requires LLVM 9.0 or newer"
+#endif
+
 // This seems to be required by some LLVM header, which is likely an LLVM bug.
 #include <stddef.h>
 
@@ -63,6 +67,7 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/Analysis/TargetTransformInfo.h>
 #include <llvm/IR/MDBuilder.h>
@@ -85,7 +85,11 @@ DECLARE_NO_INITMOD(d3d12compute)
 #endif
 DECLARE_CPP_INITMOD(destructors)
 DECLARE_CPP_INITMOD(device_interface)
+DECLARE_CPP_INITMOD(distributed)
 DECLARE_CPP_INITMOD(errors)
+DECLARE_CPP_INITMOD(fake_huge_pages)
+DECLARE_CPP_INITMOD(fake_perf_counters)
+DECLARE_CPP_INITMOD(fake_shared_memory)
 DECLARE_CPP_INITMOD(fake_thread_pool)
 DECLARE_CPP_INITMOD(float16_t)
 DECLARE_CPP_INITMOD(gpu_device_selection)
@@ -93,9 +97,13 @@ DECLARE_CPP_INITMOD(hexagon_host)
 DECLARE_CPP_INITMOD(ios_io)
 DECLARE_CPP_INITMOD(linux_clock)
 DECLARE_CPP_INITMOD(linux_host_cpu_count)
+DECLARE_CPP_INITMOD(linux_huge_pages)
 DECLARE_CPP_INITMOD(linux_opengl_context)
+DECLARE_CPP_INITMOD(linux_perf_counters)
+DECLARE_CPP_INITMOD(linux_shared_memory)
 DECLARE_CPP_INITMOD(linux_yield)
 DECLARE_CPP_INITMOD(matlab)
+DECLARE_CPP_INITMOD(memory_budget)
 DECLARE_CPP_INITMOD(metadata)
 DECLARE_CPP_INITMOD(mingw_math)
 DECLARE_CPP_INITMOD(module_aot_ref_count)
@@ -111,6 +119,7 @@ DECLARE_CPP_INITMOD(osx_get_symbol)
 DECLARE_CPP_INITMOD(osx_host_cpu_count)
 DECLARE_CPP_INITMOD(osx_opengl_context)
 DECLARE_CPP_INITMOD(osx_yield)
+DECLARE_CPP_INITMOD(persistent_storage)
 DECLARE_CPP_INITMOD(posix_allocator)
 DECLARE_CPP_INITMOD(posix_clock)
 DECLARE_CPP_INITMOD(posix_error_handler)
@@ -223,6 +232,18 @@ DECLARE_NO_INITMOD(powerpc)
 DECLARE_NO_INITMOD(powerpc_cpu_features)
 #endif  // WITH_POWERPC
 
+#ifdef WITH_WEBASSEMBLY
+DECLARE_CPP_INITMOD(wasm_cpu_features)
+#else
+DECLARE_NO_INITMOD(wasm_cpu_features)
+#endif  // WITH_WEBASSEMBLY
+
+#ifdef WITH_RISCV
+DECLARE_CPP_INITMOD(riscv_cpu_features)
+#else
+DECLARE_NO_INITMOD(riscv_cpu_features)
+#endif  // WITH_RISCV
+
 #ifdef WITH_HEXAGON
 DECLARE_LL_INITMOD(hvx_64)
 DECLARE_LL_INITMOD(hvx_128)
@@ -289,6 +310,14 @@ llvm::DataLayout get_data_layout_for_target(Target target) {
         } else {
             return llvm::DataLayout("e-m:e-i64:64-n32:64");
         }
+    } else if (target.arch == Target::WebAssembly) {
+        return llvm::DataLayout("e-m:e-p:32:32-i64:64-n32:64-S128");
+    } else if (target.arch == Target::RISCV) {
+        if (target.bits == 32) {
+            return llvm::DataLayout("e-m:e-p:32:32-i64:64-n32-S128");
+        } else {
+            return llvm::DataLayout("e-m:e-p:64:64-i64:64-i128:128-n64-S128");
+        }
     } else if (target.arch == Target::Hexagon) {
         return llvm::DataLayout(
             "e-m:e-p:32:32:32-a:0-n16:32-i64:64:64-i32:32:32-i16:16:16-i1:8:8"
@@ -400,6 +429,34 @@ llvm::Triple get_triple_for_target(const Target &target) {
         #else
         user_error << "PowerPC llvm target not enabled in this build of Halide\n";
         #endif
+    } else if (target.arch == Target::WebAssembly) {
+        #if (WITH_WEBASSEMBLY)
+        user_assert(target.bits == 32) << "WebAssembly target is 32-bit only.\n";
+        user_assert(target.os == Target::WebAssemblyRuntime)
+            << "WebAssembly target needs the wasmrt os.\n";
+        triple.setArch(llvm::Triple::wasm32);
+        triple.setVendor(llvm::Triple::UnknownVendor);
+        triple.setOS(llvm::Triple::UnknownOS);
+        triple.setObjectFormat(llvm::Triple::Wasm);
+        #else
+        user_error << "WebAssembly llvm target not enabled in this build of Halide\n";
+        #endif
+    } else if (target.arch == Target::RISCV) {
+        #if (WITH_RISCV)
+        // Only riscv*-unknown-linux-gnu are supported for the time being.
+        user_assert(target.os == Target::Linux) << "RISCV target is Linux-only.\n";
+        triple.setVendor(llvm::Triple::UnknownVendor);
+        triple.setOS(llvm::Triple::Linux);
+        triple.setEnvironment(llvm::Triple::GNU);
+        if (target.bits == 32) {
+            triple.setArch(llvm::Triple::riscv32);
+        } else {
+            user_assert(target.bits == 64) << "Target must be 32- or 64-bit.\n";
+            triple.setArch(llvm::Triple::riscv64);
+        }
+        #else
+        user_error << "RISCV llvm target not enabled in this build of Halide\n";
+        #endif
     } else if (target.arch == Target::Hexagon) {
         triple.setVendor(llvm::Triple::UnknownVendor);
         triple.setArch(llvm::Triple::hexagon);
@@ -417,8 +474,11 @@ namespace {
 
 // Link all modules together and with the result in modules[0], all
 // other input modules are destroyed. Sets the datalayout and target
-// triple appropriately for the target.
-void link_modules(std::vector<std::unique_ptr<llvm::Module>> &modules, Target t) {
+// triple appropriately for the target. If strip_public_api is set, the
+// "halide_" functions can be stripped like the rest of the runtime, so
+// only the ones reachable from the code linked in later are kept.
+void link_modules(std::vector<std::unique_ptr<llvm::Module>> &modules, Target t,
+                  bool strip_public_api = false) {
 
     llvm::DataLayout data_layout = get_data_layout_for_target(t);
     llvm::Triple triple = Internal::get_triple_for_target(t);
@@ -483,7 +543,7 @@ void link_modules(std::vector<std::unique_ptr<llvm::Module>> &modules, Target t)
         bool is_halide_extern_c_sym = Internal::starts_with(f.getName(), "halide_");
         internal_assert(!is_halide_extern_c_sym || f.isWeakForLinker() || f.isDeclaration())
             << " for function " << (std::string)f.getName() << "\n";
-        can_strip = can_strip && !is_halide_extern_c_sym;
+        can_strip = can_strip && (strip_public_api || !is_halide_extern_c_sym);
 
         llvm::GlobalValue::LinkageTypes linkage = f.getLinkage();
         if (can_strip) {
@@ -738,6 +798,35 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                     modules.push_back(get_initmod_qurt_allocator(c, bits_64, debug));
                 }
                 modules.push_back(get_initmod_fake_thread_pool(c, bits_64, debug));
+            } else if (t.os == Target::WebAssemblyRuntime) {
+                // The browser (or Emscripten, or a WASI host) provides
+                // the C library, but there's no dynamic loading, temporary
+                // files or shared memory to use.
+                modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
+                modules.push_back(get_initmod_posix_print(c, bits_64, debug));
+                modules.push_back(get_initmod_posix_clock(c, bits_64, debug));
+                modules.push_back(get_initmod_posix_io(c, bits_64, debug));
+                if (t.has_feature(Target::WasmThreads)) {
+                    // pthreads on web workers, as provided by Emscripten.
+                    modules.push_back(get_initmod_linux_host_cpu_count(c, bits_64, debug));
+                    modules.push_back(get_initmod_linux_yield(c, bits_64, debug));
+                    modules.push_back(get_initmod_posix_threads(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_fake_thread_pool(c, bits_64, debug));
+                }
+            }
+
+            // Huge pages for the posix allocator's huge page mode.
+            if (t.os == Target::Linux || t.os == Target::Android) {
+                if (t.arch == Target::MIPS) {
+                    modules.push_back(get_initmod_fake_huge_pages(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_linux_huge_pages(c, bits_64, debug));
+                }
+            } else if (t.os == Target::OSX || t.os == Target::IOS || t.os == Target::Windows ||
+                       t.os == Target::WebAssemblyRuntime) {
+                modules.push_back(get_initmod_fake_huge_pages(c, bits_64, debug));
             }
         }
 
@@ -762,6 +851,8 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
         if (module_type != ModuleJITInlined && module_type != ModuleAOTNoRuntime) {
             // These modules are always used and shared
             modules.push_back(get_initmod_gpu_device_selection(c, bits_64, debug));
+            modules.push_back(get_initmod_memory_budget(c, bits_64, debug));
+            modules.push_back(get_initmod_persistent_storage(c, bits_64, debug));
             if (t.arch != Target::Hexagon) {
                 // These modules don't behave correctly on a real
                 // Hexagon device (they do work in the simulator
@@ -772,6 +863,12 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 // TODO: Support this module in the Hexagon backend,
                 // currently generates assert at src/HexagonOffload.cpp:279
                 modules.push_back(get_initmod_cache(c, bits_64, debug));
+                // The backing store of the cache shared across processes.
+                if ((t.os == Target::Linux || t.os == Target::Android) && t.arch != Target::MIPS) {
+                    modules.push_back(get_initmod_linux_shared_memory(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_fake_shared_memory(c, bits_64, debug));
+                }
             }
             modules.push_back(get_initmod_to_string(c, bits_64, debug));
 
@@ -784,6 +881,7 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             }
 
             modules.push_back(get_initmod_device_interface(c, bits_64, debug));
+            modules.push_back(get_initmod_distributed(c, bits_64, debug));
             modules.push_back(get_initmod_metadata(c, bits_64, debug));
             modules.push_back(get_initmod_float16_t(c, bits_64, debug));
             modules.push_back(get_initmod_errors(c, bits_64, debug));
@@ -795,14 +893,22 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             // built without.
             modules.push_back(get_initmod_old_buffer_t(c, bits_64, debug));
 
-            // MIPS doesn't support the atomics the profiler requires.
+            // MIPS doesn't support the atomics the profiler requires,
+            // and WebAssembly only has them with threads, which the
+            // profiler's sampling thread needs anyway.
             if (t.arch != Target::MIPS && t.os != Target::NoOS &&
-                t.os != Target::QuRT) {
+                t.os != Target::QuRT &&
+                (t.arch != Target::WebAssembly || t.has_feature(Target::WasmThreads))) {
                 if (t.os == Target::Windows) {
                     modules.push_back(get_initmod_windows_profiler(c, bits_64, debug));
                 } else {
                     modules.push_back(get_initmod_profiler(c, bits_64, debug));
                 }
+                if (t.os == Target::Linux && t.arch == Target::X86) {
+                    modules.push_back(get_initmod_linux_perf_counters(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
+                }
             }
 
             if (t.has_feature(Target::MSAN)) {
@@ -877,6 +983,12 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             if (t.arch == Target::POWERPC) {
                 modules.push_back(get_initmod_powerpc_cpu_features(c, bits_64, debug));
             }
+            if (t.arch == Target::WebAssembly) {
+                modules.push_back(get_initmod_wasm_cpu_features(c, bits_64, debug));
+            }
+            if (t.arch == Target::RISCV) {
+                modules.push_back(get_initmod_riscv_cpu_features(c, bits_64, debug));
+            }
             if (t.arch == Target::Hexagon) {
                 modules.push_back(get_initmod_hexagon_cpu_features(c, bits_64, debug));
             }
@@ -963,7 +1075,12 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
         modules.push_back(get_initmod_runtime_api(c, bits_64, debug));
     }
 
-    link_modules(modules, t);
+    // With MinimalRuntime, the runtime functions the pipeline doesn't
+    // reach are dropped along with the rest of the unused runtime when
+    // the module is optimized. Only applies to AOT compilation: the JIT
+    // looks up the runtime functions by name.
+    bool strip_public_api = (module_type == ModuleAOT && t.has_feature(Target::MinimalRuntime));
+    link_modules(modules, t, strip_public_api);
 
     if (t.os == Target::Windows &&
         t.bits == 32 &&
@@ -1022,8 +1139,9 @@ std::unique_ptr<llvm::Module> get_initial_module_for_ptx_device(Target target, l
             f.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
         }
 
-        // Also mark the halide_gpu_thread_barrier as noduplicate.
-        if (f.getName() == "halide_gpu_thread_barrier") {
+        // Also mark the barriers as noduplicate.
+        if (f.getName() == "halide_gpu_thread_barrier" ||
+            f.getName() == "halide_gpu_grid_barrier") {
             f.addFnAttr(llvm::Attribute::NoDuplicate);
         }
     }
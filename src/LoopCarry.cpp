@@ -105,6 +105,19 @@ public:
     vector<const Load *> result;
 };
 
+/** The names of the buffers stored to by a Stmt. */
+class FindStores : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Store *op) {
+        result.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+public:
+    set<string> result;
+};
+
 /** A helper for block_to_vector below. */
 void block_to_vector(Stmt s, vector<Stmt> &v) {
     const Block *b = s.as<Block>();
@@ -191,8 +204,23 @@ class LoopCarryOverLoop : public IRMutator2 {
     // to lift out.
     const Scope<> &in_consume;
 
+    // The buffers stored to in the loop, whose loads might not load
+    // the same values on the next iteration.
+    const set<string> &stored;
+
     int max_carried_values;
 
+    // Only carry the vectors of the windows of shifted vector loads,
+    // not the values reused as is.
+    bool shifted_vectors_only;
+
+    // A group of dense vector loads of a buffer (indices into the
+    // groups of equal loads), and their offsets from the first one.
+    struct ShiftedVectors {
+        vector<int> loads;
+        vector<int> offsets;
+    };
+
     using IRMutator2::visit;
 
     Stmt visit(const LetStmt *op) override {
@@ -262,9 +290,10 @@ class LoopCarryOverLoop : public IRMutator2 {
         vector<vector<const Load *>> loads;
         for (const Load *load : find_loads.result) {
             // Check if it's safe to lift out.
-            bool safe = (load->image.defined() ||
-                         load->param.defined() ||
-                         in_consume.contains(load->name));
+            bool safe = ((load->image.defined() ||
+                          load->param.defined() ||
+                          in_consume.contains(load->name)) &&
+                         !stored.count(load->name));
             if (!safe) continue;
 
             bool represented = false;
@@ -291,7 +320,7 @@ class LoopCarryOverLoop : public IRMutator2 {
         // Find loads done on this loop iteration that will be
         // reusable as some other Expr on the next loop iteration.
         vector<vector<int>> chains;
-        for (int i = 0; i < (int)indices.size(); i++) {
+        for (int i = 0; !shifted_vectors_only && i < (int)indices.size(); i++) {
             for (int j = 0; j < (int)indices.size(); j++) {
                 // Don't catch loop invariants here.
                 if (i == j) continue;
@@ -308,10 +337,6 @@ class LoopCarryOverLoop : public IRMutator2 {
             }
         }
 
-        if (chains.empty()) {
-            return orig_stmt;
-        }
-
         // Agglomerate chains of carries
         bool done = false;
         while (!done) {
@@ -370,6 +395,83 @@ class LoopCarryOverLoop : public IRMutator2 {
         }
         chains.swap(trimmed);
 
+        // Find groups of dense vector loads from the same buffer at
+        // constant offsets from each other, whose indices move forwards
+        // by a whole vector per loop iteration, as in a vectorized
+        // stencil. None of them are reusable as is on the next
+        // iteration, but they are all slices of the vectors of the
+        // window they span, which moves one vector forwards per
+        // iteration.
+        set<int> in_chains;
+        for (const vector<int> &c : chains) {
+            in_chains.insert(c.begin(), c.end());
+        }
+        vector<ShiftedVectors> groups;
+        for (int i = 0; i < (int)loads.size(); i++) {
+            const Load *load = loads[i][0];
+            const Ramp *ramp = load->index.as<Ramp>();
+            if (in_chains.count(i) || !ramp || !is_one(ramp->stride) || !is_one(load->predicate)) {
+                continue;
+            }
+            Expr next_base = step_forwards(ramp->base, linear);
+            if (!next_base.defined()) {
+                continue;
+            }
+            const int64_t *step = as_const_int(simplify(common_subexpression_elimination(next_base - ramp->base)));
+            if (!step || *step != load->type.lanes()) {
+                continue;
+            }
+            bool represented = false;
+            for (ShiftedVectors &g : groups) {
+                const Load *first = loads[g.loads[0]][0];
+                if (first->name != load->name || first->type != load->type) {
+                    continue;
+                }
+                Expr delta = ramp->base - first->index.as<Ramp>()->base;
+                const int64_t *offset = as_const_int(simplify(common_subexpression_elimination(delta)));
+                if (offset) {
+                    g.loads.push_back(i);
+                    g.offsets.push_back((int)*offset);
+                    represented = true;
+                    break;
+                }
+            }
+            if (!represented) {
+                groups.push_back({{i}, {0}});
+            }
+        }
+
+        // Keep the groups where more than one load is replaced, and
+        // the loads cover the window without gaps, so that the vectors
+        // of the window are all in bounds. Each costs a carried value
+        // per vector of the window but the last.
+        vector<ShiftedVectors> kept_groups;
+        for (ShiftedVectors &g : groups) {
+            if (g.loads.size() < 2) {
+                continue;
+            }
+            const int lanes = loads[g.loads[0]][0]->type.lanes();
+            vector<int> offsets = g.offsets;
+            std::sort(offsets.begin(), offsets.end());
+            bool contiguous = true;
+            for (size_t i = 1; i < offsets.size(); i++) {
+                contiguous &= offsets[i] - offsets[i-1] <= lanes;
+            }
+            int carried = (offsets.back() - offsets.front() + lanes - 1) / lanes;
+            if (!contiguous || sz + carried > (size_t)max_carried_values) {
+                continue;
+            }
+            sz += carried;
+            debug(3) << "Found " << g.loads.size() << " shifted vector loads of "
+                     << loads[g.loads[0]][0]->name << " spanning " << carried + 1 << " vectors\n";
+            kept_groups.push_back(g);
+        }
+        groups.swap(kept_groups);
+
+        if (chains.empty() && groups.empty()) {
+            return orig_stmt;
+        }
+
         // We now have chains of the form:
         // f[x] <- f[x+1] <- ... <- f[x+N-1]
 
@@ -417,52 +519,84 @@ class LoopCarryOverLoop : public IRMutator2 {
 
             }
 
-            // Do joint CSE on the initial scratch values instead of
-            // cse'ing each independently. They'll shared common
-            // values and they originated from the same Expr.
-            vector<pair<string, Expr>> initial_lets;
-            // Group them into a single expression with a call node
-            Expr call = Call::make(Int(32), unique_name('b'), initial_scratch_values, Call::PureIntrinsic);
-            // Run CSE
-            call = simplify(common_subexpression_elimination(call));
-            // Peel off lets
-            while (const Let *l = call.as<Let>()) {
-                initial_lets.push_back({ l->name, l->value });
-                call = l->body;
-            }
-            internal_assert(call.as<Call>());
-            initial_scratch_values = call.as<Call>()->args;
-
-            // Create the initial stores to scratch
-            vector<Stmt> initial_scratch_stores;
-            for (size_t i = 0; i < c.size() - 1; i++) {
-                Expr scratch_idx = scratch_index(i, initial_scratch_values[i].type());
-                Stmt store_to_scratch = Store::make(scratch, initial_scratch_values[i],
-                                                    scratch_idx, Parameter(),
-                                                    const_true(scratch_idx.type().lanes()));
-                initial_scratch_stores.push_back(store_to_scratch);
+            add_scratch_allocation(scratch, loads[c.front()][0]->type,
+                                   (int)c.size(), initial_scratch_values);
+        }
+
+        // For each group of shifted vectors, the window is N + 1
+        // vectors, the last of which is the load at the greatest
+        // offset. That one is loaded on each loop iteration, and the
+        // other N are carried over from the previous one. The loads
+        // are replaced with slices of the concatenations of adjacent
+        // vectors of the window, which are single instructions on
+        // targets with vector extracts (vext, palignr). On the first
+        // iteration, the first vector of the window is the load at
+        // the least offset, shifted into place, so that nothing is
+        // loaded from outside of the original loads.
+        for (const ShiftedVectors &g : groups) {
+            string scratch = unique_name('c');
+            const Type t = loads[g.loads[0]][0]->type;
+            const int lanes = t.lanes();
+            const int min_offset = *std::min_element(g.offsets.begin(), g.offsets.end());
+            const int max_offset = *std::max_element(g.offsets.begin(), g.offsets.end());
+            const int n = (max_offset - min_offset + lanes - 1) / lanes;
+            // The offset of the first vector of the window.
+            const int window_offset = max_offset - n * lanes;
+
+            vector<Expr> window;
+            for (int i = 0; i <= n; i++) {
+                window.push_back(Load::make(t, scratch, scratch_index(i, t),
+                                            Buffer<>(), Parameter(), const_true(lanes)));
             }
 
-            Stmt initial_stores = Block::make(initial_scratch_stores);
+            const Load *first_load = nullptr;
+            const Load *last_load = nullptr;
+            for (size_t k = 0; k < g.loads.size(); k++) {
+                const Load *orig_load = loads[g.loads[k]][0];
+                int start = g.offsets[k] - window_offset;
+                int i = start / lanes, shift = start % lanes;
+                Expr replacement = window[i];
+                if (shift != 0) {
+                    replacement = Shuffle::make_slice(Shuffle::make_concat({window[i], window[i + 1]}),
+                                                      shift, 1, lanes);
+                }
+                for (const Load *l : loads[g.loads[k]]) {
+                    core = graph_substitute(l, replacement, core);
+                }
+                if (g.offsets[k] == min_offset) {
+                    first_load = orig_load;
+                }
+                if (g.offsets[k] == max_offset) {
+                    last_load = orig_load;
+                }
+            }
 
-            // Wrap them in the appropriate lets
-            for (size_t i = initial_lets.size(); i > 0; i--) {
-                auto l = initial_lets[i-1];
-                initial_stores = LetStmt::make(l.first, l.second, initial_stores);
+            not_first_iteration_scratch_stores.push_back(
+                Store::make(scratch, last_load, scratch_index(n, t), Parameter(), const_true(lanes)));
+            for (int i = 1; i <= n; i++) {
+                scratch_shuffles.push_back(
+                    Store::make(scratch, window[i], scratch_index(i - 1, t), Parameter(), const_true(lanes)));
             }
-            // We may be lifting the initial stores out of let stmts,
-            // so rewrap them in the necessary ones.
-            for (size_t i = containing_lets.size(); i > 0; i--) {
-                auto l = containing_lets[i-1];
-                if (stmt_uses_var(initial_stores, l.first)) {
-                    initial_stores = LetStmt::make(l.first, l.second, initial_stores);
+
+            vector<Expr> initial_scratch_values;
+            const int first_shift = min_offset - window_offset;
+            if (first_shift == 0) {
+                initial_scratch_values.push_back(first_load);
+            } else {
+                // The lanes before the first load are never used.
+                vector<int> indices;
+                for (int i = 0; i < lanes; i++) {
+                    indices.push_back(std::max(i - first_shift, 0));
                 }
+                initial_scratch_values.push_back(Shuffle::make({first_load}, indices));
             }
-
-            allocs.push_back({scratch,
-                        loads[c.front()][0]->type.element_of(),
-                        (int)c.size() * loads[c.front()][0]->type.lanes(),
-                        initial_stores});
+            Expr base = first_load->index.as<Ramp>()->base;
+            for (int i = 1; i < n; i++) {
+                Expr index = Ramp::make(base + (window_offset + i * lanes - min_offset), 1, lanes);
+                initial_scratch_values.push_back(Load::make(t, first_load->name, index, first_load->image,
+                                                            first_load->param, first_load->predicate));
+            }
+            add_scratch_allocation(scratch, t, n + 1, initial_scratch_values);
         }
 
         Stmt s = Block::make(not_first_iteration_scratch_stores);
@@ -472,6 +606,55 @@ class LoopCarryOverLoop : public IRMutator2 {
         return s;
     }
 
+    // Make a scratch buffer of size values of type t, of which the
+    // first few are initialized before the loop.
+    void add_scratch_allocation(const string &scratch, Type t, int size,
+                                vector<Expr> initial_scratch_values) {
+        // Do joint CSE on the initial scratch values instead of
+        // cse'ing each independently. They'll shared common
+        // values and they originated from the same Expr.
+        vector<pair<string, Expr>> initial_lets;
+        // Group them into a single expression with a call node
+        Expr call = Call::make(Int(32), unique_name('b'), initial_scratch_values, Call::PureIntrinsic);
+        // Run CSE
+        call = simplify(common_subexpression_elimination(call));
+        // Peel off lets
+        while (const Let *l = call.as<Let>()) {
+            initial_lets.push_back({ l->name, l->value });
+            call = l->body;
+        }
+        internal_assert(call.as<Call>());
+        initial_scratch_values = call.as<Call>()->args;
+
+        // Create the initial stores to scratch
+        vector<Stmt> initial_scratch_stores;
+        for (size_t i = 0; i < initial_scratch_values.size(); i++) {
+            Expr scratch_idx = scratch_index(i, initial_scratch_values[i].type());
+            Stmt store_to_scratch = Store::make(scratch, initial_scratch_values[i],
+                                                scratch_idx, Parameter(),
+                                                const_true(scratch_idx.type().lanes()));
+            initial_scratch_stores.push_back(store_to_scratch);
+        }
+
+        Stmt initial_stores = Block::make(initial_scratch_stores);
+
+        // Wrap them in the appropriate lets
+        for (size_t i = initial_lets.size(); i > 0; i--) {
+            auto l = initial_lets[i-1];
+            initial_stores = LetStmt::make(l.first, l.second, initial_stores);
+        }
+        // We may be lifting the initial stores out of let stmts,
+        // so rewrap them in the necessary ones.
+        for (size_t i = containing_lets.size(); i > 0; i--) {
+            auto l = containing_lets[i-1];
+            if (stmt_uses_var(initial_stores, l.first)) {
+                initial_stores = LetStmt::make(l.first, l.second, initial_stores);
+            }
+        }
+
+        allocs.push_back({scratch, t.element_of(), size * t.lanes(), initial_stores});
+    }
+
     Stmt visit(const For *op) override {
         // Don't lift loads out of code that might not run. Besides,
         // stashing things in registers while we run an inner loop
@@ -485,8 +668,10 @@ class LoopCarryOverLoop : public IRMutator2 {
     }
 
 public:
-    LoopCarryOverLoop(const string &var, const Scope<> &s, int max_carried_values)
-        : in_consume(s), max_carried_values(max_carried_values) {
+    LoopCarryOverLoop(const string &var, const Scope<> &s, const set<string> &stored,
+                      int max_carried_values, bool shifted_vectors_only)
+        : in_consume(s), stored(stored), max_carried_values(max_carried_values),
+          shifted_vectors_only(shifted_vectors_only) {
         linear.push(var, 1);
     }
 
@@ -504,6 +689,7 @@ class LoopCarry : public IRMutator2 {
     using IRMutator2::visit;
 
     int max_carried_values;
+    bool shifted_vectors_only;
     Scope<> in_consume;
 
     Stmt visit(const ProducerConsumer *op) override {
@@ -517,10 +703,16 @@ class LoopCarry : public IRMutator2 {
     }
 
     Stmt visit(const For *op) override {
-        if (op->for_type == ForType::Serial && !is_one(op->extent)) {
+        if (shifted_vectors_only &&
+            op->device_api != DeviceAPI::None && op->device_api != DeviceAPI::Host) {
+            // Leave the loops run on devices to their own backends.
+            return op;
+        } else if (op->for_type == ForType::Serial && !is_one(op->extent)) {
             Stmt stmt;
             Stmt body = mutate(op->body);
-            LoopCarryOverLoop carry(op->name, in_consume, max_carried_values);
+            FindStores stores;
+            body.accept(&stores);
+            LoopCarryOverLoop carry(op->name, in_consume, stores.result, max_carried_values, shifted_vectors_only);
             body = carry.mutate(body);
             if (body.same_as(op->body)) {
                 stmt = op;
@@ -543,13 +735,14 @@ class LoopCarry : public IRMutator2 {
     }
 
 public:
-    LoopCarry(int max_carried_values) : max_carried_values(max_carried_values) {}
+    LoopCarry(int max_carried_values, bool shifted_vectors_only)
+        : max_carried_values(max_carried_values), shifted_vectors_only(shifted_vectors_only) {}
 };
 
 }  // namespace
 
-Stmt loop_carry(Stmt s, int max_carried_values) {
-    s = LoopCarry(max_carried_values).mutate(s);
+Stmt loop_carry(Stmt s, int max_carried_values, bool shifted_vectors_only) {
+    s = LoopCarry(max_carried_values, shifted_vectors_only).mutate(s);
     return s;
 }
 
@@ -11,8 +11,17 @@ namespace Internal {
  * predicated, the predicates need to match. Can be an optimization or
  * pessimization depending on how good the L1 cache is on the architecture
  * and how many memory issue slots there are. Currently only intended
- * for Hexagon. */
-Stmt loop_carry(Stmt, int max_carried_values = 8);
+ * for Hexagon.
+ *
+ * Dense vector loads at constant offsets from each other, whose
+ * indices move forwards by a vector per iteration (the loads of a
+ * vectorized stencil), are also carried: the window of vectors they
+ * span is kept from one iteration to the next, so that only its last
+ * vector is loaded, and the loads are replaced with slices of the
+ * window. With shifted_vectors_only, only these are carried, and loops
+ * run on a device API other than the host are left alone; this is
+ * what the CPU backends use. */
+Stmt loop_carry(Stmt, int max_carried_values = 8, bool shifted_vectors_only = false);
 
 }  // namespace Internal
 }  // namespace Halide
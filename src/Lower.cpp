@@ -8,38 +8,52 @@
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "AsyncProducers.h"
 #include "BoundSmallAllocations.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "CSE.h"
+#include "CompileTimer.h"
 #include "CanonicalizeGPUVars.h"
 #include "Debug.h"
 #include "DebugArguments.h"
 #include "DebugToFile.h"
 #include "Deinterleave.h"
 #include "EarlyFree.h"
+#include "EmulateBFloat16Math.h"
 #include "FindCalls.h"
 #include "Func.h"
 #include "Function.h"
 #include "FuseGPUThreadLoops.h"
+#include "FusePersistentGPUKernels.h"
 #include "FuzzFloatStores.h"
 #include "HexagonOffload.h"
+#include "HoistInvariantDivisors.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "IRPrinter.h"
 #include "InferArguments.h"
+#include "InjectHexagonDma.h"
 #include "InjectHostDevBufferCopies.h"
 #include "InjectOpenGLIntrinsics.h"
 #include "Inline.h"
 #include "LICM.h"
 #include "LoopCarry.h"
+#include "LowerMemoryFootprint.h"
+#include "LowerWarpReductions.h"
 #include "LowerWarpShuffles.h"
 #include "Memoization.h"
+#include "MemoryPlanning.h"
+#include "NontemporalStores.h"
+#include "ParallelPolicies.h"
 #include "PartitionLoops.h"
+#include "PersistentStorage.h"
+#include "PlanStorageLayouts.h"
 #include "Prefetch.h"
 #include "Profiling.h"
 #include "Qualify.h"
 #include "RealizationOrder.h"
+#include "RealizeInPlace.h"
 #include "RemoveDeadAllocations.h"
 #include "RemoveTrivialForLoops.h"
 #include "RemoveUndef.h"
@@ -63,6 +77,7 @@
 #include "UnrollLoops.h"
 #include "VaryingAttributes.h"
 #include "VectorizeLoops.h"
+#include "WidenFloat16Math.h"
 #include "WrapCalls.h"
 #include "WrapExternStages.h"
 
@@ -83,6 +98,11 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
 
     Module result_module(simple_pipeline_name, t);
 
+    CompileTimer lowering("Lowering");
+    BoundsCache bounds_cache;
+    SimplifyMemoScope simplify_memo;
+    CompileTimer timer("Lowering: Preparing the environment");
+
     // Compute an environment
     map<string, Function> env;
     for (Function f : output_funcs) {
@@ -119,17 +139,26 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // specializations' conditions
     simplify_specializations(env);
 
+    if (t.has_feature(Target::PlanLayouts)) {
+        debug(1) << "Planning storage layouts...\n";
+        timer.next("Lowering: Planning storage layouts");
+        plan_storage_layouts(outputs, env);
+    }
+
     debug(1) << "Creating initial loop nests...\n";
+    timer.next("Lowering: Creating initial loop nests");
     bool any_memoized = false;
     Stmt s = schedule_functions(outputs, fused_groups, env, t, any_memoized);
     debug(2) << "Lowering after creating initial loop nests:\n" << s << '\n';
 
     debug(1) << "Canonicalizing GPU var names...\n";
+    timer.next("Lowering: Canonicalizing GPU var names");
     s = canonicalize_gpu_vars(s);
     debug(2) << "Lowering after canonicalizing GPU var names:\n" << s << '\n';
 
     if (any_memoized) {
         debug(1) << "Injecting memoization...\n";
+        timer.next("Lowering: Injecting memoization");
         s = inject_memoization(s, env, pipeline_name, outputs);
         debug(2) << "Lowering after injecting memoization:\n" << s << '\n';
     } else {
@@ -137,21 +166,25 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     }
 
     debug(1) << "Injecting tracing...\n";
+    timer.next("Lowering: Injecting tracing");
     s = inject_tracing(s, pipeline_name, env, outputs, t);
     debug(2) << "Lowering after injecting tracing:\n" << s << '\n';
 
     debug(1) << "Adding checks for parameters\n";
+    timer.next("Lowering: Adding checks for parameters");
     s = add_parameter_checks(s, t);
     debug(2) << "Lowering after injecting parameter checks:\n" << s << '\n';
 
     // Compute the maximum and minimum possible value of each
     // function. Used in later bounds inference passes.
     debug(1) << "Computing bounds of each function's value\n";
+    timer.next("Lowering: Computing bounds of each function's value");
     FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
 
     // The checks will be in terms of the symbols defined by bounds
     // inference.
     debug(1) << "Adding checks for images\n";
+    timer.next("Lowering: Adding checks for images");
     s = add_image_checks(s, outputs, t, order, env, func_bounds);
     debug(2) << "Lowering after injecting image checks:\n" << s << '\n';
 
@@ -159,18 +192,27 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // can't simplify statements from here until we fix them up. (We
     // can still simplify Exprs).
     debug(1) << "Performing computation bounds inference...\n";
+    timer.next("Lowering: Performing computation bounds inference");
     s = bounds_inference(s, outputs, order, fused_groups, env, func_bounds, t);
     debug(2) << "Lowering after computation bounds inference:\n" << s << '\n';
 
     debug(1) << "Performing sliding window optimization...\n";
+    timer.next("Lowering: Performing sliding window optimization");
     s = sliding_window(s, env);
     debug(2) << "Lowering after sliding window:\n" << s << '\n';
 
     debug(1) << "Performing allocation bounds inference...\n";
+    timer.next("Lowering: Performing allocation bounds inference");
     s = allocation_bounds_inference(s, env, func_bounds);
     debug(2) << "Lowering after allocation bounds inference:\n" << s << '\n';
 
+    debug(1) << "Injecting persistent storage...\n";
+    timer.next("Lowering: Injecting persistent storage");
+    s = inject_persistent_storage(s, env, pipeline_name);
+    debug(2) << "Lowering after injecting persistent storage:\n" << s << '\n';
+
     debug(1) << "Removing code that depends on undef values...\n";
+    timer.next("Lowering: Removing code that depends on undef values");
     s = remove_undef(s);
     debug(2) << "Lowering after removing code that depends on undef values:\n" << s << "\n\n";
 
@@ -178,43 +220,76 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     // after this point. This lets later passes assume syntactic
     // equivalence means semantic equivalence.
     debug(1) << "Uniquifying variable names...\n";
+    timer.next("Lowering: Uniquifying variable names");
     s = uniquify_variable_names(s);
     debug(2) << "Lowering after uniquifying variable names:\n" << s << "\n\n";
 
     debug(1) << "Simplifying...\n";
+    timer.next("Lowering: Simplifying");
     s = simplify(s, false); // Keep dead lets. Storage flattening needs them.
     debug(2) << "Lowering after first simplification:\n" << s << "\n\n";
 
     debug(1) << "Performing storage folding optimization...\n";
+    timer.next("Lowering: Performing storage folding optimization");
     s = storage_folding(s, env);
     debug(2) << "Lowering after storage folding:\n" << s << '\n';
 
     debug(1) << "Injecting debug_to_file calls...\n";
+    timer.next("Lowering: Injecting debug_to_file calls");
     s = debug_to_file(s, outputs, env);
     debug(2) << "Lowering after injecting debug_to_file calls:\n" << s << '\n';
 
     debug(1) << "Injecting prefetches...\n";
-    s = inject_prefetch(s, env);
+    timer.next("Lowering: Injecting prefetches");
+    s = inject_prefetch(s, env, t);
     debug(2) << "Lowering after injecting prefetches:\n" << s << "\n\n";
 
     debug(1) << "Dynamically skipping stages...\n";
+    timer.next("Lowering: Dynamically skipping stages");
     s = skip_stages(s, order);
     debug(2) << "Lowering after dynamically skipping stages:\n" << s << "\n\n";
 
+    debug(1) << "Forking asynchronous producers...\n";
+    timer.next("Lowering: Forking asynchronous producers");
+    s = fork_async_producers(s, env);
+    debug(2) << "Lowering after forking asynchronous producers:\n" << s << "\n\n";
+
+    debug(1) << "Realizing elementwise chains in place...\n";
+    timer.next("Lowering: Realizing elementwise chains in place");
+    s = realize_in_place(s, env, t);
+    debug(2) << "Lowering after realizing elementwise chains in place:\n" << s << "\n\n";
+
     debug(1) << "Destructuring tuple-valued realizations...\n";
+    timer.next("Lowering: Destructuring tuple-valued realizations");
     s = split_tuples(s, env);
     debug(2) << "Lowering after destructuring tuple-valued realizations:\n" << s << "\n\n";
 
     debug(1) << "Performing storage flattening...\n";
+    timer.next("Lowering: Performing storage flattening");
     s = storage_flattening(s, outputs, env, t);
     debug(2) << "Lowering after storage flattening:\n" << s << "\n\n";
 
+    debug(1) << "Rewriting persistent allocations...\n";
+    timer.next("Lowering: Rewriting persistent allocations");
+    s = rewrite_persistent_allocations(s, env, pipeline_name);
+    debug(2) << "Lowering after rewriting persistent allocations:\n" << s << "\n\n";
+
+    // The low-memory specializations check the footprint of the
+    // flattened allocations, in terms of the fields of the buffer
+    // arguments that are unpacked next.
+    debug(1) << "Computing the memory footprint...\n";
+    timer.next("Lowering: Computing the memory footprint");
+    s = lower_memory_footprint(s);
+    debug(2) << "Lowering after computing the memory footprint:\n" << s << "\n\n";
+
     debug(1) << "Unpacking buffer arguments...\n";
+    timer.next("Lowering: Unpacking buffer arguments");
     s = unpack_buffers(s);
     debug(2) << "Lowering after unpacking buffer arguments...\n" << s << "\n\n";
 
     if (any_memoized) {
         debug(1) << "Rewriting memoized allocations...\n";
+        timer.next("Lowering: Rewriting memoized allocations");
         s = rewrite_memoized_allocations(s, env);
         debug(2) << "Lowering after rewriting memoized allocations:\n" << s << "\n\n";
     } else {
@@ -226,105 +301,174 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         t.has_feature(Target::OpenGL) ||
         (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128})))) {
         debug(1) << "Selecting a GPU API for GPU loops...\n";
+        timer.next("Lowering: Selecting a GPU API for GPU loops");
         s = select_gpu_api(s, t);
         debug(2) << "Lowering after selecting a GPU API:\n" << s << "\n\n";
 
+        if (t.has_feature(Target::CUDA)) {
+            debug(1) << "Fusing persistent GPU kernels...\n";
+            timer.next("Lowering: Fusing persistent GPU kernels");
+            s = fuse_persistent_gpu_kernels(s, env);
+            debug(2) << "Lowering after fusing persistent GPU kernels:\n" << s << "\n\n";
+        }
+
         debug(1) << "Injecting host <-> dev buffer copies...\n";
+        timer.next("Lowering: Injecting host <-> dev buffer copies");
         s = inject_host_dev_buffer_copies(s, t);
         debug(2) << "Lowering after injecting host <-> dev buffer copies:\n" << s << "\n\n";
 
         debug(1) << "Selecting a GPU API for extern stages...\n";
+        timer.next("Lowering: Selecting a GPU API for extern stages");
         s = select_gpu_api(s, t);
         debug(2) << "Lowering after selecting a GPU API for extern stages:\n" << s << "\n\n";
     }
 
+    if (t.arch == Target::Hexagon || t.features_any_of({Target::HVX_64, Target::HVX_128})) {
+        debug(1) << "Injecting Hexagon DMA copies...\n";
+        timer.next("Lowering: Injecting Hexagon DMA copies");
+        s = inject_hexagon_dma(s, env, t);
+        debug(2) << "Lowering after injecting Hexagon DMA copies:\n" << s << "\n\n";
+    }
+
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting OpenGL texture intrinsics...\n";
+        timer.next("Lowering: Injecting OpenGL texture intrinsics");
         s = inject_opengl_intrinsics(s);
         debug(2) << "Lowering after OpenGL intrinsics:\n" << s << "\n\n";
     }
 
+    if (t.has_feature(Target::CUDA)) {
+        debug(1) << "Reducing across warps...\n";
+        timer.next("Lowering: Reducing across warps");
+        s = lower_warp_reductions(s);
+        debug(2) << "Lowering after reducing across warps:\n" << s << "\n\n";
+    }
+
+#if LLVM_VERSION >= 60
+    // Older LLVMs can't target sm_70, which has the tensor cores.
+    if (t.has_feature(Target::CUDACapability70)) {
+        debug(1) << "Multiplying tiles across warps...\n";
+        timer.next("Lowering: Multiplying tiles across warps");
+        s = lower_warp_matrix_multiplies(s);
+        debug(2) << "Lowering after multiplying tiles across warps:\n" << s << "\n\n";
+    }
+#endif
+
     if (t.has_gpu_feature() ||
         t.has_feature(Target::OpenGLCompute)) {
         debug(1) << "Injecting per-block gpu synchronization...\n";
+        timer.next("Lowering: Injecting per-block gpu synchronization");
         s = fuse_gpu_thread_loops(s);
         debug(2) << "Lowering after injecting per-block gpu synchronization:\n" << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
+    timer.next("Lowering: Simplifying");
     s = simplify(s);
     s = unify_duplicate_lets(s);
     s = remove_trivial_for_loops(s);
     debug(2) << "Lowering after second simplifcation:\n" << s << "\n\n";
 
     debug(1) << "Reduce prefetch dimension...\n";
+    timer.next("Lowering: Reduce prefetch dimension");
     s = reduce_prefetch_dimension(s, t);
     debug(2) << "Lowering after reduce prefetch dimension:\n" << s << "\n";
 
     debug(1) << "Unrolling...\n";
+    timer.next("Lowering: Unrolling");
     s = unroll_loops(s);
     s = simplify(s);
     debug(2) << "Lowering after unrolling:\n" << s << "\n\n";
 
     debug(1) << "Vectorizing...\n";
+    timer.next("Lowering: Vectorizing");
     s = vectorize_loops(s, t);
     s = simplify(s);
     debug(2) << "Lowering after vectorizing:\n" << s << "\n\n";
 
     debug(1) << "Detecting vector interleavings...\n";
+    timer.next("Lowering: Detecting vector interleavings");
     s = rewrite_interleavings(s);
     s = simplify(s);
     debug(2) << "Lowering after rewriting vector interleavings:\n" << s << "\n\n";
 
     debug(1) << "Partitioning loops to simplify boundary conditions...\n";
+    timer.next("Lowering: Partitioning loops to simplify boundary conditions");
     s = partition_loops(s);
     s = simplify(s);
     debug(2) << "Lowering after partitioning loops:\n" << s << "\n\n";
 
     debug(1) << "Trimming loops to the region over which they do something...\n";
+    timer.next("Lowering: Trimming loops to the region over which they do something");
     s = trim_no_ops(s);
     debug(2) << "Lowering after loop trimming:\n" << s << "\n\n";
 
     debug(1) << "Injecting early frees...\n";
+    timer.next("Lowering: Injecting early frees");
     s = inject_early_frees(s);
     debug(2) << "Lowering after injecting early frees:\n" << s << "\n\n";
 
-    if (t.has_feature(Target::Profile)) {
+    if (t.has_feature(Target::Profile) || t.has_feature(Target::ProfileMetrics)) {
         debug(1) << "Injecting profiling...\n";
-        s = inject_profiling(s, pipeline_name);
+        timer.next("Lowering: Injecting profiling");
+        s = inject_profiling(s, pipeline_name,
+                             t.has_feature(Target::Profile),
+                             t.has_feature(Target::ProfileMetrics));
         debug(2) << "Lowering after injecting profiling:\n" << s << "\n\n";
     }
 
     if (t.has_feature(Target::FuzzFloatStores)) {
         debug(1) << "Fuzzing floating point stores...\n";
+        timer.next("Lowering: Fuzzing floating point stores");
         s = fuzz_float_stores(s);
         debug(2) << "Lowering after fuzzing floating point stores:\n" << s << "\n\n";
     }
 
     debug(1) << "Bounding small allocations...\n";
+    timer.next("Lowering: Bounding small allocations");
     s = bound_small_allocations(s);
     debug(2) << "Lowering after bounding small allocations:\n" << s << "\n\n";
 
     if (t.has_feature(Target::CUDA)) {
         debug(1) << "Injecting warp shuffles...\n";
+        timer.next("Lowering: Injecting warp shuffles");
         s = lower_warp_shuffles(s);
         debug(2) << "Lowering after injecting warp shuffles:\n" << s << "\n\n";
     }
 
+    debug(1) << "Emulating bfloat16 math...\n";
+    timer.next("Lowering: Emulating bfloat16 math");
+    s = emulate_bfloat16_math(s);
+    debug(2) << "Lowering after emulating bfloat16 math:\n" << s << "\n\n";
+
+    debug(1) << "Widening float16 math...\n";
+    timer.next("Lowering: Widening float16 math");
+    s = widen_float16_math(s, env, t);
+    debug(2) << "Lowering after widening float16 math:\n" << s << "\n\n";
+
+    debug(1) << "Hoisting loop-invariant divisors...\n";
+    timer.next("Lowering: Hoisting loop-invariant divisors");
+    s = hoist_invariant_divisors(s);
+    debug(2) << "Lowering after hoisting loop-invariant divisors:\n" << s << "\n\n";
+
     debug(1) << "Simplifying...\n";
+    timer.next("Lowering: Simplifying");
     s = common_subexpression_elimination(s);
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Detecting varying attributes...\n";
+        timer.next("Lowering: Detecting varying attributes");
         s = find_linear_expressions(s);
         debug(2) << "Lowering after detecting varying attributes:\n" << s << "\n\n";
 
         debug(1) << "Moving varying attribute expressions out of the shader...\n";
+        timer.next("Lowering: Moving varying attribute expressions out of the shader");
         s = setup_gpu_vertex_buffer(s);
         debug(2) << "Lowering after removing varying attributes:\n" << s << "\n\n";
     }
 
     debug(1) << "Lowering unsafe promises...\n";
+    timer.next("Lowering: Lowering unsafe promises");
     s = lower_unsafe_promises(s, t);
     debug(2) << "Lowering after lowering unsafe promises:\n" << s << "\n\n";
 
@@ -334,8 +478,36 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     s = loop_invariant_code_motion(s);
     debug(1) << "Lowering after final simplification:\n" << s << "\n\n";
 
+    if (t.arch != Target::Hexagon) {
+        // Hexagon carries its aligned loads itself. Not simplified
+        // afterwards, as that would merge the slices of the carried
+        // vectors back into unaligned loads.
+        debug(1) << "Carrying shifted vector loads across loop iterations...\n";
+        timer.next("Lowering: Carrying shifted vector loads");
+        s = loop_carry(s, 8, true);
+        debug(2) << "Lowering after carrying shifted vector loads:\n" << s << "\n\n";
+    }
+
+    if (t.has_feature(Target::PlanMemory)) {
+        debug(1) << "Planning memory...\n";
+        timer.next("Lowering: Planning memory");
+        s = plan_memory(s, t);
+        debug(2) << "Lowering after planning memory:\n" << s << "\n\n";
+    }
+
+    debug(1) << "Marking non-temporal stores...\n";
+    timer.next("Lowering: Marking non-temporal stores");
+    s = mark_nontemporal_stores(s, env);
+    debug(2) << "Lowering after marking non-temporal stores:\n" << s << "\n\n";
+
+    debug(1) << "Marking parallel loop policies...\n";
+    timer.next("Lowering: Marking parallel loop policies");
+    s = mark_parallel_policies(s, env);
+    debug(2) << "Lowering after marking parallel loop policies:\n" << s << "\n\n";
+
     if (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128}))) {
         debug(1) << "Splitting off Hexagon offload...\n";
+        timer.next("Lowering: Splitting off Hexagon offload");
         s = inject_hexagon_rpc(s, t, result_module);
         debug(2) << "Lowering after splitting off Hexagon offload:\n" << s << '\n';
     } else {
@@ -343,6 +515,7 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     }
 
     if (!custom_passes.empty()) {
+        timer.next("Lowering: Running custom lowering passes");
         for (size_t i = 0; i < custom_passes.size(); i++) {
             debug(1) << "Running custom lowering pass " << i << "...\n";
             s = custom_passes[i]->mutate(s);
@@ -350,6 +523,7 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         }
     }
 
+    timer.next("Lowering: Inferring arguments");
     vector<Argument> public_args = args;
     for (const auto &out : outputs) {
         for (Parameter buf : out.output_buffers()) {
@@ -0,0 +1,220 @@
+#include "LowerMemoryFootprint.h"
+#include "Bounds.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "Scope.h"
+#include "Simplify.h"
+
+#include <set>
+
+namespace Halide {
+namespace Internal {
+
+using std::set;
+using std::string;
+
+namespace {
+
+bool is_device_loop(const For *op) {
+    return (op->for_type == ForType::GPUBlock ||
+            op->for_type == ForType::GPUThread ||
+            op->for_type == ForType::GPULane ||
+            (op->device_api != DeviceAPI::None &&
+             op->device_api != DeviceAPI::Host));
+}
+
+class UsesMemoryFootprint : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (op->is_intrinsic(Call::memory_footprint)) {
+            result = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+};
+
+bool uses_memory_footprint(const Expr &e) {
+    UsesMemoryFootprint u;
+    e.accept(&u);
+    return u.result;
+}
+
+bool uses_memory_footprint(const Stmt &s) {
+    UsesMemoryFootprint u;
+    s.accept(&u);
+    return u.result;
+}
+
+// The buffers read or written inside the loops that run on a device,
+// which have a device allocation as well as a host one.
+class FindDeviceBuffers : public IRVisitor {
+    using IRVisitor::visit;
+
+    int device_loops = 0;
+
+    void visit(const For *op) {
+        bool device = is_device_loop(op);
+        device_loops += device;
+        IRVisitor::visit(op);
+        device_loops -= device;
+    }
+
+    void visit(const Load *op) {
+        if (device_loops) {
+            buffers.insert(op->name);
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Store *op) {
+        if (device_loops) {
+            buffers.insert(op->name);
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    set<string> buffers;
+};
+
+class ComputeFootprint : public IRVisitor {
+    using IRVisitor::visit;
+
+    const set<string> &device_buffers;
+    Scope<Interval> scope;
+    int device_loops = 0;
+
+public:
+    Expr result;
+
+    ComputeFootprint(const set<string> &device_buffers) : device_buffers(device_buffers) {}
+
+    Expr footprint(const Stmt &s) {
+        result = make_zero(Int(64));
+        if (s.defined()) {
+            s.accept(this);
+        }
+        return result;
+    }
+
+private:
+    void visit(const LetStmt *op) {
+        ScopedBinding<Interval> bind(scope, op->name, bounds_of_expr_in_scope(op->value, scope));
+        result = footprint(op->body);
+    }
+
+    void visit(const For *op) {
+        Interval first = bounds_of_expr_in_scope(op->min, scope);
+        Interval last = bounds_of_expr_in_scope(op->min + op->extent - 1, scope);
+        bool device = is_device_loop(op);
+        device_loops += device;
+        Expr body;
+        {
+            ScopedBinding<Interval> bind(scope, op->name, Interval(first.min, last.max));
+            body = footprint(op->body);
+        }
+        device_loops -= device;
+
+        if (op->for_type == ForType::Parallel && !is_zero(body)) {
+            // Every iteration may run at once.
+            Interval extent = bounds_of_expr_in_scope(op->extent, scope);
+            if (extent.has_upper_bound()) {
+                body *= cast<int64_t>(max(extent.max, 1));
+            } else {
+                debug(2) << "Counting the allocations in the parallel loop " << op->name
+                         << " once, because its extent is unbounded\n";
+            }
+        }
+        result = body;
+    }
+
+    void visit(const Allocate *op) {
+        Expr body = footprint(op->body);
+        if (device_loops ||
+            op->new_expr.defined() ||
+            (op->memory_type != MemoryType::Auto &&
+             op->memory_type != MemoryType::Heap)) {
+            // Not on the heap, or not allocated by the pipeline.
+            result = body;
+            return;
+        }
+
+        Expr size = make_const(Int(64), op->type.bytes());
+        for (const Expr &e : op->extents) {
+            size *= cast<int64_t>(e);
+        }
+        Interval bounds = bounds_of_expr_in_scope(size, scope);
+        if (!bounds.has_upper_bound()) {
+            debug(2) << "Leaving the allocation of " << op->name
+                     << " out of the memory footprint, because its size is unbounded\n";
+            result = body;
+            return;
+        }
+        size = bounds.max;
+        if (device_buffers.count(op->name)) {
+            size *= 2;
+        }
+        result = size + body;
+    }
+
+    void visit(const IfThenElse *op) {
+        if (uses_memory_footprint(op->condition)) {
+            // The footprint is checked against the default schedule.
+            result = footprint(op->else_case);
+        } else {
+            Expr then_case = footprint(op->then_case);
+            Expr else_case = footprint(op->else_case);
+            result = max(then_case, else_case);
+        }
+    }
+
+    void visit(const Block *op) {
+        // The allocations in the first statement are freed before the
+        // rest runs.
+        Expr first = footprint(op->first);
+        Expr rest = footprint(op->rest);
+        result = max(first, rest);
+    }
+};
+
+class ReplaceMemoryFootprint : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr footprint;
+
+    Expr visit(const Call *op) override {
+        if (op->is_intrinsic(Call::memory_footprint)) {
+            return footprint;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    ReplaceMemoryFootprint(Expr footprint) : footprint(footprint) {}
+};
+
+}  // namespace
+
+Stmt lower_memory_footprint(Stmt s) {
+    if (!uses_memory_footprint(s)) {
+        return s;
+    }
+
+    FindDeviceBuffers device_buffers;
+    s.accept(&device_buffers);
+    Expr footprint = simplify(ComputeFootprint(device_buffers.buffers).footprint(s));
+    debug(2) << "Memory footprint: " << footprint << "\n";
+
+    // Computed once, so that every specialization checks the same value.
+    string name = unique_name("memory_footprint");
+    s = ReplaceMemoryFootprint(Variable::make(Int(64), name)).mutate(s);
+    return LetStmt::make(name, footprint, s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,30 @@
+#ifndef HALIDE_LOWER_MEMORY_FOOTPRINT_H
+#define HALIDE_LOWER_MEMORY_FOOTPRINT_H
+
+/** \file
+ * Defines the lowering pass that computes the memory footprint checked
+ * by Func::specialize_low_memory
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Replace the memory_footprint intrinsics in the conditions of the
+ * low-memory specializations with an upper bound of the number of bytes
+ * of heap and device memory the pipeline allocates, computed once
+ * before it runs. The bound is the peak over the allocations whose
+ * lifetimes overlap, each bounded over the loops around it, times the
+ * number of iterations of the parallel loops around it, and twice as
+ * much for the buffers also used on a device. The default schedules of
+ * the Funcs specialized for low memory are counted, not their
+ * low-memory ones. Allocations whose size can't be bounded are left
+ * out. Must be run after storage flattening, and before the buffer
+ * arguments are unpacked. */
+Stmt lower_memory_footprint(Stmt s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
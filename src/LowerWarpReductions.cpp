@@ -0,0 +1,570 @@
+#include "LowerWarpReductions.h"
+#include "ExprUsesVar.h"
+#include "IREquality.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+#include "Simplify.h"
+#include "Substitute.h"
+
+// A reduction scheduled with an RVar as the innermost GPU thread
+// dimension, e.g. the weight gradients simple_autoschedule makes,
+// has every thread along that dimension do a read-modify-write of the
+// same location, which codegen turns into one atomic per thread. The
+// atomics on a single address serialize. Instead, we sum the
+// contributions of the threads of a warp with shfl.down, in log2(32)
+// steps, and have only the first lane of each warp do the atomic.
+//
+// Warp shuffles return undefined values if the source lane is
+// inactive, so we only do this when all the lanes of a warp reach the
+// store together: the loops over threads must span whole warps, and
+// no loop or condition between them and the store may depend on the
+// thread.
+//
+// From sm_70 on, the tensor cores compute a 16x16x16 float16 matrix
+// multiply with float32 accumulation for a whole warp at once, with
+// wmma.mma.sync. The fragments the warp holds have no layout a Halide
+// schedule can describe, so we instead recognize the loops of a single
+// thread accumulating the product of two 16x16 float16 tiles into a
+// 16x16 float32 tile, and have the warp do the tile of each of its
+// lanes in turn. The same conditions on the lanes apply.
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+const int warp_size = 32;
+
+const char *thread_names[] = {".__thread_id_x", ".__thread_id_y", ".__thread_id_z", ".__thread_id_w"};
+
+// Find the extent of the loops over each thread dimension of a
+// kernel: 0 if there are none, and -1 if they don't all have the
+// same constant extent.
+class ThreadExtents : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) override {
+        for (int i = 0; i < 4; i++) {
+            if (ends_with(op->name, thread_names[i])) {
+                const int64_t *e = as_const_int(op->extent);
+                if (!e || (extent[i] != 0 && extent[i] != *e)) {
+                    extent[i] = -1;
+                } else {
+                    extent[i] = *e;
+                }
+            }
+        }
+        has_lane_loop = has_lane_loop || op->for_type == ForType::GPULane;
+        IRVisitor::visit(op);
+    }
+
+public:
+    int64_t extent[4] = {0, 0, 0, 0};
+    bool has_lane_loop = false;
+
+    // The number of consecutive threads along x that are in the same
+    // warp, or 0 if warps may be partially filled.
+    int warp_width() const {
+        if (extent[0] <= 0 || has_lane_loop) {
+            return 0;
+        } else if (extent[0] % warp_size == 0) {
+            return warp_size;
+        } else if (extent[0] < warp_size && (extent[0] & (extent[0] - 1)) == 0) {
+            // Rows of the block share warps, so the block as a whole
+            // has to be made of full warps.
+            int64_t threads = 1;
+            for (int i = 0; i < 4; i++) {
+                if (extent[i] < 0) {
+                    return 0;
+                }
+                threads *= std::max(extent[i], (int64_t)1);
+            }
+            return threads % warp_size == 0 ? (int)extent[0] : 0;
+        }
+        return 0;
+    }
+};
+
+class LoadsFrom : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &name;
+
+    void visit(const Load *op) override {
+        result = result || op->name == name;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+    LoadsFrom(const string &name) : name(name) {}
+};
+
+bool loads_from(const Expr &e, const string &name) {
+    LoadsFrom l(name);
+    e.accept(&l);
+    return l.result;
+}
+
+class ReduceAcrossWarps : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const int width;
+
+    // The first lane of each group of width threads along x, if we
+    // are inside the loop over x.
+    Expr first_lane;
+
+    // Variables that differ between the lanes that are reduced
+    // together, and between the lanes of a warp.
+    Scope<> lane_varying, warp_varying;
+
+    // Allocations made inside the kernel. Their stores have no
+    // atomics to save.
+    Scope<> allocated;
+
+    Stmt visit(const For *op) override {
+        if (stmt_or_expr_uses_vars(op->min, warp_varying) ||
+            stmt_or_expr_uses_vars(op->extent, warp_varying)) {
+            // The lanes of a warp may not all run this loop.
+            return op;
+        }
+        if (ends_with(op->name, thread_names[0])) {
+            ScopedValue<Expr> old_first_lane(first_lane, (Variable::make(Int(32), op->name) - op->min) % width == 0);
+            lane_varying.push(op->name);
+            warp_varying.push(op->name);
+            Stmt s = IRMutator2::visit(op);
+            lane_varying.pop(op->name);
+            warp_varying.pop(op->name);
+            return s;
+        } else if (ends_with(op->name, ".__thread_id_y") ||
+                   ends_with(op->name, ".__thread_id_z") ||
+                   ends_with(op->name, ".__thread_id_w")) {
+            // These only differ within a warp when rows share warps.
+            if (width < warp_size) {
+                warp_varying.push(op->name);
+                Stmt s = IRMutator2::visit(op);
+                warp_varying.pop(op->name);
+                return s;
+            }
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        bool lane = stmt_or_expr_uses_vars(op->value, lane_varying);
+        bool warp = stmt_or_expr_uses_vars(op->value, warp_varying);
+        if (lane) {
+            lane_varying.push(op->name);
+        }
+        if (warp) {
+            warp_varying.push(op->name);
+        }
+        Stmt s = IRMutator2::visit(op);
+        if (lane) {
+            lane_varying.pop(op->name);
+        }
+        if (warp) {
+            warp_varying.pop(op->name);
+        }
+        return s;
+    }
+
+    Stmt visit(const IfThenElse *op) override {
+        if (stmt_or_expr_uses_vars(op->condition, warp_varying)) {
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const Allocate *op) override {
+        allocated.push(op->name);
+        Stmt s = IRMutator2::visit(op);
+        allocated.pop(op->name);
+        return s;
+    }
+
+    Stmt visit(const Store *op) override {
+        Type t = op->value.type();
+        if (!first_lane.defined() ||
+            !t.is_scalar() || t.bits() != 32 || t.is_handle() ||
+            !is_one(op->predicate) ||
+            allocated.contains(op->name) ||
+            stmt_or_expr_uses_vars(op->index, lane_varying)) {
+            return op;
+        }
+
+        // Find the contribution of this thread: either the argument
+        // of an atomic add, or the delta of a racy +=.
+        Expr delta;
+        if (const Call *call = op->value.as<Call>()) {
+            if (call->is_intrinsic(Call::atomic_add)) {
+                delta = call->args[0];
+            }
+        } else if (const Add *add = op->value.as<Add>()) {
+            for (const Expr &e : {add->a, add->b}) {
+                const Load *load = e.as<Load>();
+                if (load && load->name == op->name &&
+                    is_one(load->predicate) && equal(load->index, op->index)) {
+                    delta = e.same_as(add->a) ? add->b : add->a;
+                    break;
+                }
+            }
+        }
+        if (!delta.defined() || loads_from(delta, op->name)) {
+            return op;
+        }
+
+        debug(3) << "Reducing across warps: " << Stmt(op);
+
+        // The segment mask in the high bits keeps the shuffles within
+        // groups of width lanes.
+        string suffix = t.is_float() ? ".f32" : ".i32";
+        Expr mask = make_const(Int(32), ((warp_size - width) << 8) | 31);
+        vector<std::pair<string, Expr>> lets;
+        string name = unique_name('t');
+        lets.push_back({name, delta});
+        for (int offset = width / 2; offset > 0; offset /= 2) {
+            Expr partial = Variable::make(t, name);
+            Expr down = Call::make(t, "llvm.nvvm.shfl.down" + suffix,
+                                   {partial, make_const(Int(32), offset), mask}, Call::PureExtern);
+            name = unique_name('t');
+            lets.push_back({name, partial + down});
+        }
+
+        Expr sum = Call::make(t, Call::atomic_add, {Variable::make(t, name)}, Call::Intrinsic);
+        Stmt s = Store::make(op->name, sum, op->index, op->param, op->predicate);
+        s = IfThenElse::make(first_lane, s);
+        while (!lets.empty()) {
+            s = LetStmt::make(lets.back().first, lets.back().second, s);
+            lets.pop_back();
+        }
+        return s;
+    }
+
+public:
+    ReduceAcrossWarps(int width) : width(width) {}
+};
+
+class LowerWarpReductions : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Stmt visit(const For *op) override {
+        if (op->device_api == DeviceAPI::CUDA && ends_with(op->name, ".__block_id_x")) {
+            // The innermost loop over blocks: its body is one block.
+            ThreadExtents extents;
+            op->body.accept(&extents);
+            int width = extents.warp_width();
+            if (width > 1) {
+                Stmt body = ReduceAcrossWarps(width).mutate(op->body);
+                return For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+            }
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+};
+
+// The lowering of the 16x16x16 matrix multiplies inside one kernel.
+class MultiplyTilesAcrossWarps : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const ThreadExtents &extents;
+
+    // The loop over each thread dimension we are inside, if any.
+    const For *thread_loop[4] = {nullptr, nullptr, nullptr, nullptr};
+
+    // Variables that differ between the lanes of a warp.
+    Scope<> warp_varying;
+
+    // Allocations made inside the kernel. wmma only reads and writes
+    // global memory here.
+    Scope<> allocated;
+
+    Stmt visit(const For *op) override {
+        if (stmt_or_expr_uses_vars(op->min, warp_varying) ||
+            stmt_or_expr_uses_vars(op->extent, warp_varying)) {
+            return op;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (ends_with(op->name, thread_names[i])) {
+                ScopedValue<const For *> old_thread_loop(thread_loop[i], op);
+                warp_varying.push(op->name);
+                Stmt s = IRMutator2::visit(op);
+                warp_varying.pop(op->name);
+                return s;
+            }
+        }
+        Stmt s = multiply_tiles(op);
+        if (s.defined()) {
+            return s;
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        bool warp = stmt_or_expr_uses_vars(op->value, warp_varying);
+        if (warp) {
+            warp_varying.push(op->name);
+        }
+        Stmt s = IRMutator2::visit(op);
+        if (warp) {
+            warp_varying.pop(op->name);
+        }
+        return s;
+    }
+
+    Stmt visit(const IfThenElse *op) override {
+        if (stmt_or_expr_uses_vars(op->condition, warp_varying)) {
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const Allocate *op) override {
+        allocated.push(op->name);
+        Stmt s = IRMutator2::visit(op);
+        allocated.pop(op->name);
+        return s;
+    }
+
+    // Turn the loop nest
+    //   for m, n, k (in any order, each of extent 16):
+    //     C[c] = C[c] + float32(A[a]) * float32(B[b])
+    // with float16 A and B, where each index is linear in the loops,
+    // c doesn't depend on k, a not on n and b not on m, into one
+    // warp-wide matrix multiply per lane, or return an undefined Stmt
+    // if it isn't such a nest.
+    Stmt multiply_tiles(const For *op) {
+        // Every thread of the block must be inside the loops over
+        // them, so that the warps are full.
+        Expr linear_id = 0;
+        for (int i = 3; i >= 0; i--) {
+            if (extents.extent[i] < 0 || (extents.extent[i] > 0) != (thread_loop[i] != nullptr)) {
+                return Stmt();
+            }
+            if (thread_loop[i]) {
+                Expr id = Variable::make(Int(32), thread_loop[i]->name) - thread_loop[i]->min;
+                linear_id = linear_id * (int)extents.extent[i] + id;
+            }
+        }
+        if (!thread_loop[0]) {
+            return Stmt();
+        }
+
+        vector<pair<string, Expr>> inner_lets;
+        vector<const For *> loops;
+        Stmt s = op;
+        while (true) {
+            if (const LetStmt *let = s.as<LetStmt>()) {
+                inner_lets.push_back({let->name, let->value});
+                s = let->body;
+            } else if (const For *loop = s.as<For>()) {
+                if (loops.size() == 3 ||
+                    (loop->for_type != ForType::Serial && loop->for_type != ForType::Unrolled) ||
+                    !is_const(loop->extent, 16)) {
+                    return Stmt();
+                }
+                for (const For *l : loops) {
+                    if (expr_uses_var(loop->min, l->name)) {
+                        return Stmt();
+                    }
+                }
+                for (const auto &let : inner_lets) {
+                    if (expr_uses_var(loop->min, let.first)) {
+                        return Stmt();
+                    }
+                }
+                loops.push_back(loop);
+                s = loop->body;
+            } else {
+                break;
+            }
+        }
+
+        const Store *store = s.as<Store>();
+        if (loops.size() != 3 || !store || store->value.type() != Float(32) ||
+            !is_one(store->predicate) || allocated.contains(store->name)) {
+            return Stmt();
+        }
+        const Add *add = store->value.as<Add>();
+        const Load *acc = nullptr;
+        const Mul *mul = nullptr;
+        for (int i = 0; add && i < 2; i++) {
+            const Load *load = (i == 0 ? add->a : add->b).as<Load>();
+            if (load && load->name == store->name &&
+                is_one(load->predicate) && equal(load->index, store->index)) {
+                acc = load;
+                mul = (i == 0 ? add->b : add->a).as<Mul>();
+                break;
+            }
+        }
+        if (!acc || !mul) {
+            return Stmt();
+        }
+        // The tiles of C, A and B.
+        const Load *tile[3] = {acc, nullptr, nullptr};
+        for (int i = 0; i < 2; i++) {
+            const Cast *cast = (i == 0 ? mul->a : mul->b).as<Cast>();
+            const Load *load = cast ? cast->value.as<Load>() : nullptr;
+            if (!load || load->type != Float(16) || !is_one(load->predicate) ||
+                load->name == store->name || allocated.contains(load->name)) {
+                return Stmt();
+            }
+            tile[i + 1] = load;
+        }
+
+        vector<Expr> index = {store->index, tile[1]->index, tile[2]->index};
+        for (auto it = inner_lets.rbegin(); it != inner_lets.rend(); it++) {
+            for (Expr &i : index) {
+                i = substitute(it->first, it->second, i);
+            }
+        }
+
+        // Find the index of the first element of each tile, and how
+        // far apart its elements are along each loop.
+        map<string, Expr> at_min;
+        for (const For *l : loops) {
+            at_min[l->name] = l->min;
+        }
+        Expr base[3], coeff[3][3];
+        for (int i = 0; i < 3; i++) {
+            base[i] = simplify(substitute(at_min, index[i]));
+            Expr linear = base[i];
+            for (int j = 0; j < 3; j++) {
+                map<string, Expr> next = at_min;
+                next[loops[j]->name] = loops[j]->min + 1;
+                coeff[i][j] = simplify(substitute(next, index[i]) - base[i]);
+                for (const For *l : loops) {
+                    if (expr_uses_var(coeff[i][j], l->name)) {
+                        return Stmt();
+                    }
+                }
+                linear += coeff[i][j] * (Variable::make(Int(32), loops[j]->name) - loops[j]->min);
+            }
+            if (!is_zero(simplify(index[i] - linear))) {
+                return Stmt();
+            }
+        }
+
+        int m = -1, n = -1, k = -1;
+        for (int j = 0; j < 3; j++) {
+            bool c = !is_zero(coeff[0][j]), a = !is_zero(coeff[1][j]), b = !is_zero(coeff[2][j]);
+            if (!c && a && b) {
+                k = j;
+            } else if (c && a && !b) {
+                m = j;
+            } else if (c && !a && b) {
+                n = j;
+            }
+        }
+        if (m < 0 || n < 0 || k < 0) {
+            return Stmt();
+        }
+
+        // Each tile is either dense along its rows or down its columns.
+        const int rows[3] = {m, m, k}, cols[3] = {n, k, n};
+        bool col_major[3];
+        Expr stride[3];
+        for (int i = 0; i < 3; i++) {
+            if (is_one(coeff[i][cols[i]])) {
+                col_major[i] = false;
+                stride[i] = coeff[i][rows[i]];
+            } else if (is_one(coeff[i][rows[i]])) {
+                col_major[i] = true;
+                stride[i] = coeff[i][cols[i]];
+            } else {
+                return Stmt();
+            }
+        }
+
+        debug(3) << "Multiplying tiles across warps: " << Stmt(op);
+
+        // Loop over the lanes of the warp, getting the tiles of each
+        // one in turn with shuffles. wmma.load and wmma.store need the
+        // tiles and the strides between their rows to be 256-bit
+        // aligned; when they aren't, the lane does its tile itself.
+        string lane_name = unique_name('t');
+        Expr lane = Variable::make(Int(32), lane_name);
+        vector<pair<string, Expr>> lets, lane_lets;
+        auto from_lane = [&](const Expr &e) {
+            string name = unique_name('t');
+            lets.push_back({name, e});
+            Expr shuffled = Call::make(Int(32), "llvm.nvvm.shfl.idx.i32",
+                                       {Variable::make(Int(32), name), lane, make_const(Int(32), warp_size - 1)},
+                                       Call::PureExtern);
+            name = unique_name('t');
+            lane_lets.push_back({name, shuffled});
+            return Variable::make(Int(32), name);
+        };
+
+        vector<Expr> args;
+        Expr aligned = const_true();
+        for (int i : {1, 2, 0}) {
+            Expr address = Call::make(Handle(), Call::address_of,
+                                      {Load::make(tile[i]->type, tile[i]->name, from_lane(base[i]),
+                                                  tile[i]->image, tile[i]->param, const_true())},
+                                      Call::Intrinsic);
+            Expr s = from_lane(stride[i]);
+            aligned = aligned && reinterpret(UInt(64), address) % 32 == 0 && s % (32 / tile[i]->type.bytes()) == 0;
+            args.push_back(address);
+            args.push_back(s);
+        }
+        for (int i : {1, 2, 0}) {
+            args.push_back(col_major[i] ? const_true() : const_false());
+        }
+
+        Expr mma = Call::make(Int(32), Call::wmma_16x16x16, args, Call::Intrinsic);
+        Stmt result = IfThenElse::make(aligned, Evaluate::make(mma),
+                                       IfThenElse::make(linear_id % warp_size == lane, op));
+        while (!lane_lets.empty()) {
+            result = LetStmt::make(lane_lets.back().first, lane_lets.back().second, result);
+            lane_lets.pop_back();
+        }
+        result = For::make(lane_name, 0, warp_size, ForType::Serial, op->device_api, result);
+        while (!lets.empty()) {
+            result = LetStmt::make(lets.back().first, lets.back().second, result);
+            lets.pop_back();
+        }
+        return result;
+    }
+
+public:
+    MultiplyTilesAcrossWarps(const ThreadExtents &extents) : extents(extents) {}
+};
+
+class LowerWarpMatrixMultiplies : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Stmt visit(const For *op) override {
+        if (op->device_api == DeviceAPI::CUDA && ends_with(op->name, ".__block_id_x")) {
+            ThreadExtents extents;
+            op->body.accept(&extents);
+            if (extents.warp_width() > 0) {
+                Stmt body = MultiplyTilesAcrossWarps(extents).mutate(op->body);
+                return For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+            }
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+};
+
+}  // namespace
+
+Stmt lower_warp_reductions(Stmt s) {
+    return LowerWarpReductions().mutate(s);
+}
+
+Stmt lower_warp_matrix_multiplies(Stmt s) {
+    return LowerWarpMatrixMultiplies().mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
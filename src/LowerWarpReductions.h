@@ -0,0 +1,35 @@
+#ifndef HALIDE_LOWER_WARP_REDUCTIONS_H
+#define HALIDE_LOWER_WARP_REDUCTIONS_H
+
+/** \file
+ * Defines the lowering passes that reduce the contributions of the
+ * threads of a CUDA warp to the same location with warp shuffles, and
+ * that multiply float16 tiles with the tensor cores of sm_70.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find += updates inside loops over GPU threads (atomic or racy)
+ * that store to a location that doesn't depend on the innermost
+ * thread variable, so that all the threads along it accumulate into
+ * the same place. Sum their contributions within each warp with a
+ * tree of shuffles, and only have the first lane of each warp do an
+ * atomic add of the result. Must run before fuse_gpu_thread_loops. */
+Stmt lower_warp_reductions(Stmt s);
+
+/** Find loop nests inside loops over GPU threads in which each thread
+ * accumulates the product of two 16x16 tiles of float16 buffers into a
+ * 16x16 tile of a float32 buffer, with all three tiles in global
+ * memory and all the lanes of its warp running the nest together, and
+ * have the warp compute the tile of each of its lanes in turn with a
+ * Call::wmma_16x16x16. Only valid for sm_70 or newer. Must run before
+ * fuse_gpu_thread_loops. */
+Stmt lower_warp_matrix_multiplies(Stmt s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
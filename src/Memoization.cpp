@@ -149,6 +149,7 @@ class KeyInfo {
     const std::string &top_level_name;
     const std::string &function_name;
     int memoize_instance;
+    int eviction_cost;
 
     size_t parameters_alignment() {
         int32_t max_alignment = 0;
@@ -167,29 +168,33 @@ class KeyInfo {
         return size_t(1) << i;
     }
 
-// TODO: Using the full names in the key results in a (hopefully incredibly
-// slight) performance difference based on how one names filters and
-// functions. It is arguably a little easier to debug if something
-// goes wrong as one doesn't need to destructure the cache key by hand
-// in the debugger. Also, if a pointer is used, a counter must also be
-// put in the cache key to avoid aliasing on reuse of the address in
-// JIT situations where code is regenerated into the same region of
-// memory.
-//
-// There is a plan to change the hash function used in the cache and
-// after that happens, we'll measure performance again and maybe decide
-// to choose one path or the other (see Git history for the implementation.
-// It was deleted as part of the address_of intrinsic cleanup).
+    // The key starts with a 64-bit hash of the function name, computed
+    // here, instead of the name itself. The name is constant, so this
+    // saves storing and hashing its bytes on every lookup, which matters
+    // for memoized Funcs computed within inner loops. Unlike a pointer to
+    // the function, the hash is the same across pipelines, so the
+    // memoized Funcs of forward and backwards pipelines can share their
+    // entries, and it doesn't alias when JIT code is regenerated into the
+    // same memory. (FNV-1a, rather than std::hash, so that it is the same
+    // on every host.)
+    static uint64_t name_hash(const std::string &name) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (char c : name) {
+            h ^= (uint8_t)c;
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
 
 public:
     KeyInfo(const Function &function, const std::string &name, int memoize_instance)
         : top_level_name(name),
           function_name(function.origin_name()),
-          memoize_instance(memoize_instance)
+          memoize_instance(memoize_instance),
+          eviction_cost(function.schedule().memoize_eviction_cost())
     {
         dependencies.visit_function(function);
-        size_t size_so_far = 4;
-        size_so_far += (function_name.size() + 3) & (~3);
+        size_t size_so_far = 8;
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -213,34 +218,18 @@ public:
         std::vector<Stmt> writes;
         Expr index = Expr(0);
 
-        // Make a jumble of bytes including the function name and the
-        // values of the scalar parameters. Omits the pipeline name
-        // and the unique counter so that we can reuse memoized Funcs
-        // across forward and backwards pipelines.
+        // Make a jumble of bytes including the hash of the function
+        // name and the values of the scalar parameters. Omits the
+        // pipeline name and the unique counter so that we can reuse
+        // memoized Funcs across forward and backwards pipelines.
 
         (void)top_level_name;
         (void)memoize_instance;
 
-        std::vector<uint32_t> key;
-        key.push_back((uint32_t)function_name.size());
-        for (size_t i = 0; i < function_name.size(); i++) {
-            if (i % 4 == 0) {
-                key.push_back(function_name[i]);
-            } else {
-                key.back() *= 256;
-                key.back() += function_name[i];
-            }
-        }
-
-        size_t alignment = 0;
-        for (int k : key) {
-            writes.push_back(Store::make(key_name, k,
-                                         index / Int(32).bytes(),
-                                         Parameter(),
-                                         const_true()));
-            index += 4;
-            alignment += 4;
-        }
+        writes.push_back(Store::make(key_name, make_const(UInt(64), name_hash(function_name)),
+                                     0, Parameter(), const_true()));
+        index += 8;
+        size_t alignment = 8;
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -305,6 +294,7 @@ public:
             }
         }
         args.push_back(Call::make(type_of<halide_buffer_t **>(), Call::make_struct, buffers, Call::Intrinsic));
+        args.push_back(eviction_cost);
 
         // This is actually a void call. How to indicate that? Look at Extern_ stuff.
         return Evaluate::make(Call::make(Int(32), "halide_memoization_cache_store", args, Call::Extern));
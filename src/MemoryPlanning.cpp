@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <map>
+
+#include "CodeGen_Internal.h"
+#include "Debug.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "MemoryPlanning.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char *const arena_name = "memory_arena$";
+
+// The alignment of each allocation in the arena. This is at least the
+// alignment of halide_malloc on every target.
+const int64_t arena_alignment = 128;
+
+int64_t align_up(int64_t x) {
+    return (x + arena_alignment - 1) & ~(arena_alignment - 1);
+}
+
+struct PlannedAllocation {
+    const Allocate *op;
+    int64_t size;
+    // The allocation is live from the event start to the event end.
+    int start, end;
+    int64_t offset;
+    // The statements enclosing the Allocate node, from the root down,
+    // and the Allocate node itself.
+    vector<const IRNode *> path;
+};
+
+// Find the lifetimes of the allocations made once per call of the
+// pipeline. The Allocate and Free nodes are numbered in the order they
+// run.
+class FindLifetimes : public IRVisitor {
+    using IRVisitor::visit;
+
+    int time = 0;
+    vector<const IRNode *> path;
+    map<string, size_t> live;
+
+    bool should_plan(const Allocate *op, int64_t bytes) {
+        if (op->new_expr.defined() || op->extents.empty() || bytes <= 0) {
+            return false;
+        }
+        // Leave the allocations that will be placed on the stack alone.
+        return (op->memory_type == MemoryType::Heap ||
+                (op->memory_type == MemoryType::Auto &&
+                 !can_allocation_fit_on_stack(bytes)));
+    }
+
+    void visit(const Allocate *op) {
+        time++;
+        int64_t bytes = (int64_t)Allocate::constant_allocation_size(op->extents, op->name) * op->type.bytes();
+        path.push_back(op);
+        bool plan = should_plan(op, bytes);
+        size_t idx = allocations.size();
+        if (plan) {
+            // Pad the allocation as codegen does for heap allocations.
+            allocations.push_back({op, bytes + op->type.bytes(), time, -1, 0, path});
+            live[op->name] = idx;
+        }
+        op->body.accept(this);
+        path.pop_back();
+        if (plan) {
+            if (allocations[idx].end < 0) {
+                allocations[idx].end = ++time;
+            }
+            live.erase(op->name);
+        }
+    }
+
+    void visit(const Free *op) {
+        time++;
+        auto it = live.find(op->name);
+        if (it != live.end() && allocations[it->second].end < 0) {
+            allocations[it->second].end = time;
+        }
+    }
+
+    void visit(const Block *op) {
+        path.push_back(op);
+        op->first.accept(this);
+        op->rest.accept(this);
+        path.pop_back();
+    }
+
+    void visit(const LetStmt *op) {
+        path.push_back(op);
+        op->body.accept(this);
+        path.pop_back();
+    }
+
+    void visit(const ProducerConsumer *op) {
+        path.push_back(op);
+        op->body.accept(this);
+        path.pop_back();
+    }
+
+    void visit(const IfThenElse *op) {
+        // Only one of the branches runs, so it's fine for the
+        // allocations in them to overlap.
+        path.push_back(op);
+        op->then_case.accept(this);
+        if (op->else_case.defined()) {
+            op->else_case.accept(this);
+        }
+        path.pop_back();
+    }
+
+    // Loops run their allocations more than once, or (for the
+    // asynchronous producers) at the same time as other statements.
+    void visit(const For *op) {}
+
+public:
+    vector<PlannedAllocation> allocations;
+};
+
+class UseArena : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<const Allocate *, int64_t> &offsets;
+    const IRNode *wrap;
+    int64_t arena_size;
+
+    Stmt visit(const Allocate *op) override {
+        auto it = offsets.find(op);
+        if (it == offsets.end()) {
+            return IRMutator2::visit(op);
+        }
+        Stmt body = mutate(op->body);
+        Expr base = reinterpret(UInt(64), Variable::make(Handle(), arena_name));
+        Expr host = reinterpret(Handle(), base + make_const(UInt(64), it->second));
+        return Allocate::make(op->name, op->type, MemoryType::Heap, op->extents, op->condition,
+                              body, host, "halide_device_host_nop_free");
+    }
+
+public:
+    Stmt mutate(const Stmt &s) override {
+        Stmt result = IRMutator2::mutate(s);
+        if (s.get() == wrap) {
+            result = Allocate::make(arena_name, UInt(8), MemoryType::Heap,
+                                    {make_const(Int(32), arena_size)}, const_true(), result);
+        }
+        return result;
+    }
+
+    using IRMutator2::mutate;
+
+    UseArena(const map<const Allocate *, int64_t> &offsets, const IRNode *wrap, int64_t arena_size)
+        : offsets(offsets), wrap(wrap), arena_size(arena_size) {}
+};
+
+class FindArena : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Allocate *op) {
+        if (op->name == arena_name) {
+            size = Allocate::constant_allocation_size(op->extents, op->name);
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    int64_t size = 0;
+};
+
+}  // namespace
+
+Stmt plan_memory(Stmt s, const Target &t) {
+    FindLifetimes lifetimes;
+    s.accept(&lifetimes);
+    vector<PlannedAllocation> &allocs = lifetimes.allocations;
+    if (allocs.empty()) {
+        return s;
+    }
+
+    // Place the largest allocations first, each at the lowest offset
+    // that doesn't overlap an allocation already placed with an
+    // overlapping lifetime.
+    vector<size_t> order(allocs.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return allocs[a].size > allocs[b].size;
+    });
+
+    int64_t arena_size = 0;
+    vector<const PlannedAllocation *> placed;
+    for (size_t i : order) {
+        PlannedAllocation &a = allocs[i];
+        vector<const PlannedAllocation *> conflicts;
+        for (const PlannedAllocation *b : placed) {
+            if (a.start <= b->end && b->start <= a.end) {
+                conflicts.push_back(b);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end(),
+                  [](const PlannedAllocation *a, const PlannedAllocation *b) {
+                      return a->offset < b->offset;
+                  });
+        int64_t offset = 0;
+        for (const PlannedAllocation *b : conflicts) {
+            if (offset + a.size <= b->offset) {
+                break;
+            }
+            offset = std::max(offset, align_up(b->offset + b->size));
+        }
+        a.offset = offset;
+        arena_size = std::max(arena_size, offset + a.size);
+        placed.push_back(&a);
+    }
+
+    if (arena_size > std::min(t.maximum_buffer_size(), (int64_t)0x7fffffff)) {
+        debug(1) << "Not planning memory: arena of " << arena_size << " bytes is too large\n";
+        return s;
+    }
+
+    // Allocate the arena around the innermost statement that contains
+    // all of the allocations placed in it.
+    vector<const IRNode *> common = allocs[0].path;
+    map<const Allocate *, int64_t> offsets;
+    for (const PlannedAllocation &a : allocs) {
+        size_t n = 0;
+        while (n < common.size() && n < a.path.size() && common[n] == a.path[n]) {
+            n++;
+        }
+        common.resize(n);
+        offsets[a.op] = a.offset;
+        debug(3) << "Placing " << a.op->name << " at offset " << a.offset
+                 << " of the arena, live from " << a.start << " to " << a.end << "\n";
+    }
+    const IRNode *wrap = common.empty() ? s.get() : common.back();
+
+    int64_t total = 0;
+    for (const PlannedAllocation &a : allocs) {
+        total += a.size;
+    }
+    debug(1) << "Packed " << allocs.size() << " allocations of " << total
+             << " bytes into an arena of " << arena_size << " bytes\n";
+
+    return UseArena(offsets, wrap, arena_size).mutate(s);
+}
+
+int64_t memory_arena_size(const Stmt &s) {
+    FindArena f;
+    s.accept(&f);
+    return f.size;
+}
+
+}  // namespace Internal
+}  // namespace Halide
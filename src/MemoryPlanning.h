@@ -0,0 +1,29 @@
+#ifndef HALIDE_MEMORY_PLANNING_H
+#define HALIDE_MEMORY_PLANNING_H
+
+/** \file
+ * Defines the lowering pass that packs the heap allocations of a
+ * pipeline into a single arena.
+ */
+
+#include "IR.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Place the constant-size heap allocations made once per call of the
+ * pipeline (i.e. outside of any loop) at fixed offsets in one arena,
+ * allocated with a single halide_malloc. Allocations whose lifetimes
+ * (from the Allocate node to its Free, or to the end of its body) don't
+ * overlap share the same bytes of the arena. */
+Stmt plan_memory(Stmt s, const Target &t);
+
+/** The size in bytes of the arena made by plan_memory in a lowered
+ * pipeline, or zero if there isn't one. */
+int64_t memory_arena_size(const Stmt &s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
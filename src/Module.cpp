@@ -1,6 +1,8 @@
 #include "Module.h"
 
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <fstream>
 #include <future>
 
@@ -16,6 +18,7 @@
 #include "Outputs.h"
 #include "PythonExtensionGen.h"
 #include "StmtToHtml.h"
+#include "ThreadPool.h"
 #include "WrapExternStages.h"
 
 using Halide::Internal::debug;
@@ -463,11 +466,26 @@ void Module::compile(const Outputs &output_files_arg) const {
           file_header, target(), Internal::CodeGen_PyTorch::PyTorchHeader,
           output_files.c_header_name);
       cg_header.compile(*this);
+
+      bool any_gradients = false;
+      for (const auto &f : functions()) {
+        any_gradients = any_gradients || Internal::CodeGen_PyTorch::is_gradient_function(f);
+      }
+      if (any_gradients) {
+        std::ofstream file_autograd(output_files.pytorch_wrapper_name+"_autograd.py");
+        Internal::CodeGen_PyTorch cg_autograd(
+            file_autograd, target(), Internal::CodeGen_PyTorch::PyTorchAutograd,
+            output_files.c_header_name);
+        cg_autograd.compile(*this);
+      }
     }
 }
 
 Outputs compile_standalone_runtime(const Outputs &output_files, Target t) {
-    Module empty("standalone_runtime", t.without_feature(Target::NoRuntime).without_feature(Target::JIT));
+    // A minimal runtime would be empty, as there is no pipeline to call it.
+    Module empty("standalone_runtime", t.without_feature(Target::NoRuntime)
+                                        .without_feature(Target::MinimalRuntime)
+                                        .without_feature(Target::JIT));
     // For runtime, it only makes sense to output object files or static_library, so ignore
     // everything else.
     Outputs actual_outputs = Outputs().object(output_files.object_name).static_library(output_files.static_library_name);
@@ -526,6 +544,22 @@ void compile_multitarget(const std::string &fn_name,
     uint64_t runtime_features[kFeaturesWordCount] = {(uint64_t)-1LL};
 
     TemporaryObjectFileDir temp_dir;
+
+    // The sub-targets are lowered one after the other, as the module
+    // producer need not be thread-safe, but each one is compiled to an
+    // object on the thread pool while the next one is lowered. Every
+    // compilation uses an LLVMContext of its own. HL_COMPILE_THREADS
+    // limits the number of threads used; it defaults to the number of
+    // cores. The pool is declared after temp_dir so that it finishes
+    // before the temporary files are removed.
+    size_t num_threads = std::min(targets.size() + 2, ThreadPool<void>::num_processors_online());
+    std::string compile_threads = get_env_variable("HL_COMPILE_THREADS");
+    if (!compile_threads.empty()) {
+        num_threads = (size_t)std::max(1, std::atoi(compile_threads.c_str()));
+    }
+    ThreadPool<void> thread_pool(num_threads);
+    std::vector<std::future<void>> compilations;
+
     std::vector<Expr> wrapper_args;
     std::vector<LoweredArgument> base_target_args;
     for (const Target &target : targets) {
@@ -579,7 +613,9 @@ void compile_multitarget(const std::string &fn_name,
         internal_assert(sub_out.object_name.empty());
         sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
         debug(1) << "compile_multitarget: compile_sub_target " << sub_out.object_name << "\n";
-        sub_module.compile(sub_out);
+        compilations.push_back(thread_pool.async([sub_module, sub_out]() {
+            sub_module.compile(sub_out);
+        }));
 
         uint64_t cur_target_features[kFeaturesWordCount] = {0};
         for (int i = 0; i < Target::FeatureEnd; ++i) {
@@ -615,8 +651,8 @@ void compile_multitarget(const std::string &fn_name,
         // Start with a bare Target, set only the features we know are common to all.
         Target runtime_target(base_target.os, base_target.arch, base_target.bits);
         for (int i = 0; i < Target::FeatureEnd; ++i) {
-            // We never want NoRuntime set here.
-            if (i == Target::NoRuntime) {
+            // We never want NoRuntime or MinimalRuntime set here.
+            if (i == Target::NoRuntime || i == Target::MinimalRuntime) {
                 continue;
             }
             const int word = i >> 6;
@@ -628,7 +664,9 @@ void compile_multitarget(const std::string &fn_name,
         Outputs runtime_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
         debug(1) << "compile_multitarget: compile_standalone_runtime " << runtime_out.static_library_name << "\n";
-        compile_standalone_runtime(runtime_out, runtime_target);
+        compilations.push_back(thread_pool.async([runtime_out, runtime_target]() {
+            compile_standalone_runtime(runtime_out, runtime_target);
+        }));
     }
 
     if (needs_wrapper) {
@@ -667,7 +705,9 @@ void compile_multitarget(const std::string &fn_name,
         Outputs wrapper_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
         debug(1) << "compile_multitarget: wrapper " << wrapper_out.object_name << "\n";
-        wrapper_module.compile(wrapper_out);
+        compilations.push_back(thread_pool.async([wrapper_module, wrapper_out]() {
+            wrapper_module.compile(wrapper_out);
+        }));
     }
 
     if (!output_files.c_header_name.empty()) {
@@ -680,6 +720,11 @@ void compile_multitarget(const std::string &fn_name,
         header_module.compile(header_out);
     }
 
+    // Wait for the objects, rethrowing the first error, if any.
+    for (auto &c : compilations) {
+        c.get();
+    }
+
     if (!output_files.static_library_name.empty()) {
         debug(1) << "compile_multitarget: static_library_name " << output_files.static_library_name << "\n";
         create_static_library(temp_dir.files(), base_target, output_files.static_library_name);
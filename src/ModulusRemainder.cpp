@@ -60,6 +60,7 @@ public:
     void visit(const Free *);
     void visit(const Evaluate *);
     void visit(const Shuffle *);
+    void visit(const VectorReduce *);
     void visit(const Prefetch *);
 };
 
@@ -394,6 +395,12 @@ void ComputeModulusRemainder::visit(const Shuffle *op) {
     remainder = 0;
 }
 
+void ComputeModulusRemainder::visit(const VectorReduce *op) {
+    internal_assert(op->type.is_scalar()) << "modulus_remainder of vector\n";
+    modulus = 1;
+    remainder = 0;
+}
+
 void ComputeModulusRemainder::visit(const LetStmt *) {
     internal_assert(false) << "modulus_remainder of statement\n";
 }
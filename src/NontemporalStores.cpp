@@ -0,0 +1,81 @@
+#include <set>
+
+#include "NontemporalStores.h"
+#include "Function.h"
+#include "IRMutator.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+
+namespace {
+
+class MarkNontemporalStores : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // The names of the buffers to stream to
+    const set<string> &buffers;
+
+    bool in_device_loop = false;
+
+    Stmt visit(const For *op) override {
+        bool old_in_device_loop = in_device_loop;
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            in_device_loop = true;
+        }
+        Stmt s = IRMutator2::visit(op);
+        in_device_loop = old_in_device_loop;
+        return s;
+    }
+
+    Stmt visit(const Store *op) override {
+        if (in_device_loop || !buffers.count(op->name)) {
+            return op;
+        }
+        if (const Call *call = op->value.as<Call>()) {
+            if (call->is_intrinsic(Call::atomic_add)) {
+                return op;
+            }
+        }
+        Expr value = Call::make(op->value.type(), Call::nontemporal_store,
+                                {op->value}, Call::Intrinsic);
+        return Store::make(op->name, value, op->index, op->param, op->predicate);
+    }
+
+public:
+    MarkNontemporalStores(const set<string> &b) : buffers(b) {}
+};
+
+}  // namespace
+
+Stmt mark_nontemporal_stores(Stmt s, const map<string, Function> &env) {
+    set<string> buffers;
+    for (const auto &p : env) {
+        const Function &f = p.second;
+        if (!f.schedule().nontemporal()) {
+            continue;
+        }
+        user_assert(!f.has_update_definition())
+            << "Func " << f.name() << " has update definitions, so it reads the values it stores, "
+            << "and can't be scheduled with store_nontemporal().\n";
+        if (f.outputs() == 1) {
+            buffers.insert(f.name());
+        } else {
+            for (int i = 0; i < f.outputs(); i++) {
+                buffers.insert(f.name() + "." + std::to_string(i));
+            }
+        }
+    }
+
+    if (buffers.empty()) {
+        return s;
+    }
+    return MarkNontemporalStores(buffers).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
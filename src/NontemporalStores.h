@@ -0,0 +1,28 @@
+#ifndef HALIDE_NONTEMPORAL_STORES_H
+#define HALIDE_NONTEMPORAL_STORES_H
+
+/** \file
+ * Defines the lowering pass that marks the stores of Funcs scheduled
+ * with Func::store_nontemporal
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Wrap the values stored to Funcs scheduled with store_nontemporal
+ * in the nontemporal_store intrinsic, so that the backend emits
+ * streaming stores for them. Stores in device loops are left
+ * alone. Runs after all other mutations of the stores, because the
+ * intrinsic is not pure. */
+Stmt mark_nontemporal_stores(Stmt s, const std::map<std::string, Function> &env);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -0,0 +1,364 @@
+#include "ParallelAlgorithms.h"
+#include "IROperator.h"
+#include "RDom.h"
+
+namespace Halide {
+
+namespace {
+
+// The Vars of a Func of the given dimensions, and the ones other than
+// dim, which the sorts and selections are independent along.
+struct AlgorithmArgs {
+    std::vector<Var> args;
+    std::vector<Var> outer;
+
+    AlgorithmArgs(int dimensions, int dim) : args(dimensions) {
+        for (int i = 0; i < dimensions; i++) {
+            if (i != dim) {
+                outer.push_back(args[i]);
+            }
+        }
+    }
+
+    // The args with the one at dim replaced by e
+    std::vector<Expr> at(int dim, const Expr &e) const {
+        std::vector<Expr> result(args.begin(), args.end());
+        result[dim] = e;
+        return result;
+    }
+};
+
+void check_input(const Func &f, int dim, int extent, const std::string &name) {
+    user_assert(f.defined() && f.outputs() == 1)
+        << "The input of " << name << " must be a defined, single-valued Func.\n";
+    user_assert(dim >= 0 && dim < f.dimensions())
+        << "Can't compute " << name << " along dimension " << dim
+        << " of " << f.name() << ", which has " << f.dimensions() << " dimensions.\n";
+    user_assert(extent > 0)
+        << "The extent of " << name << " must be positive, not " << extent << ".\n";
+}
+
+int round_up_to_power_of_two(int n) {
+    int p = 1;
+    while (p < n) {
+        p *= 2;
+    }
+    return p;
+}
+
+// A value being sorted, and its index in the input if the index is
+// kept.
+struct Element {
+    Expr value;
+    Expr index;
+};
+
+Element element_at(const Func &f, const std::vector<Expr> &args) {
+    if (f.outputs() == 2) {
+        return {f(args)[0], f(args)[1]};
+    }
+    return {f(args), Expr()};
+}
+
+void define(Func &f, const std::vector<Var> &args, const Element &e) {
+    if (e.index.defined()) {
+        f(args) = Tuple(e.value, e.index);
+    } else {
+        f(args) = e.value;
+    }
+}
+
+// select(c, t, f), folded when c is a constant
+Expr pick(const Expr &c, const Expr &t, const Expr &f) {
+    if (is_one(c)) {
+        return t;
+    } else if (is_zero(c)) {
+        return f;
+    }
+    return select(c, t, f);
+}
+
+Element pick(const Expr &c, const Element &t, const Element &f) {
+    Element result;
+    result.value = pick(c, t.value, f.value);
+    if (t.index.defined()) {
+        result.index = pick(c, t.index, f.index);
+    }
+    return result;
+}
+
+// The first (or, if not first, the second) of a and b in descending
+// order if descending is true, and ascending order otherwise. Equal
+// values are ordered by ascending index in descending order, and the
+// reverse in ascending order, so that the networks sort by a total
+// order.
+Element order(const Element &a, const Element &b, const Expr &descending, bool first) {
+    if (!a.index.defined()) {
+        if (first) {
+            return {pick(descending, max(a.value, b.value), min(a.value, b.value)), Expr()};
+        }
+        return {pick(descending, min(a.value, b.value), max(a.value, b.value)), Expr()};
+    }
+    Expr a_first = (pick(descending, a.value > b.value, a.value < b.value) ||
+                    (a.value == b.value && pick(descending, a.index < b.index, a.index > b.index)));
+    return first ? pick(a_first, a, b) : pick(a_first, b, a);
+}
+
+// One compare-exchange stage of a bitonic network along dim, over
+// [0, size): each element is compared with the one distance away, in
+// blocks of 2 * distance. With block zero, the stage orders every pair
+// in the given direction; otherwise, the direction alternates between
+// blocks of block elements, starting with the given one.
+Func bitonic_step(const Func &prev, const AlgorithmArgs &a, int dim, int distance, int size,
+                  int block, bool descending, const std::string &name) {
+    Var x = a.args[dim];
+    Expr dir = descending;
+    if (block != 0) {
+        Expr even = (x / block) % 2 == 0;
+        dir = descending ? even : !even;
+    }
+    Expr lower = (x / distance) % 2 == 0;
+    Expr partner = clamp(select(lower, x + distance, x - distance), 0, size - 1);
+    Element e = element_at(prev, a.at(dim, x));
+    Element p = element_at(prev, a.at(dim, partner));
+    Func result(name);
+    define(result, a.args, pick(lower, order(e, p, dir, true), order(e, p, dir, false)));
+    return result;
+}
+
+// Splits off the dimension being sorted of each stage into blocks of
+// threads on GPUs, and computes the stages per row on the CPU.
+void schedule_network(Func output, const std::vector<Func> &stages, int dim, const Target &target) {
+    std::vector<Func> funcs = stages;
+    funcs.push_back(output);
+    auto is_stage = [&](const Func &f) { return f.name() != output.name(); };
+    const int dims = output.dimensions();
+    if (target.has_gpu_feature()) {
+        for (Func f : funcs) {
+            std::vector<Var> args = f.args();
+            Var x = args[dim], xi(x.name() + "_i");
+            // The output of top_k may be narrower than a block.
+            TailStrategy tail = is_stage(f) ? TailStrategy::Auto : TailStrategy::GuardWithIf;
+            if (dims == 1) {
+                f.gpu_tile(x, xi, 64, tail);
+            } else {
+                // Fuse the other dimensions into one, in which each
+                // point is a row of blocks.
+                Var rows;
+                bool first = true;
+                for (int i = 0; i < dims; i++) {
+                    if (i == dim) {
+                        continue;
+                    }
+                    if (first) {
+                        rows = args[i];
+                        first = false;
+                    } else {
+                        Var fused(rows.name() + "_" + args[i].name());
+                        f.fuse(rows, args[i], fused);
+                        rows = fused;
+                    }
+                }
+                Var rows_i(rows.name() + "_i");
+                f.gpu_tile(x, rows, xi, rows_i, 64, 1, tail);
+            }
+            if (is_stage(f)) {
+                f.compute_root();
+            }
+        }
+        return;
+    }
+
+    const int vector_size = target.natural_vector_size(output.output_types()[0]);
+    std::vector<Var> args = output.args();
+    if (dims == 1) {
+        for (Func f : funcs) {
+            Var x = f.args()[0];
+            TailStrategy tail = TailStrategy::Auto;
+            if (is_stage(f)) {
+                f.compute_root();
+            } else {
+                tail = TailStrategy::GuardWithIf;
+            }
+            f.vectorize(x, vector_size, tail).parallel(x, 64 * vector_size, tail);
+        }
+        return;
+    }
+    Var row = args[dim == dims - 1 ? dims - 2 : dims - 1];
+    output.vectorize(args[dim], vector_size, TailStrategy::GuardWithIf).parallel(row);
+    for (Func f : stages) {
+        f.compute_at(output, row).vectorize(f.args()[dim], vector_size);
+    }
+}
+
+}  // namespace
+
+ParallelAlgorithm sort(const Func &f, int dim, int extent, const std::string &name) {
+    check_input(f, dim, extent, "sort");
+    AlgorithmArgs a(f.dimensions(), dim);
+    Var x = a.args[dim];
+    const int size = round_up_to_power_of_two(extent);
+    Type t = f.output_types()[0];
+
+    // The input, padded to size with values that sort last.
+    ParallelAlgorithm result;
+    Func padded(name + "_padded");
+    padded(a.args) = select(x < extent, f(a.at(dim, clamp(x, 0, extent - 1))), t.max());
+    result.stages.push_back(padded);
+
+    Func prev = padded;
+    for (int block = 2; block <= size; block *= 2) {
+        for (int distance = block / 2; distance > 0; distance /= 2) {
+            prev = bitonic_step(prev, a, dim, distance, size, block, false, name + "_step");
+            result.stages.push_back(prev);
+        }
+    }
+
+    result.output = Func(name);
+    result.output(a.args) = prev(a.args);
+    for (Func s : result.stages) {
+        s.compute_root();
+    }
+    Func output = result.output;
+    std::vector<Func> stages = result.stages;
+    result.schedule = [=](const Target &target) {
+        schedule_network(output, stages, dim, target);
+    };
+    return result;
+}
+
+ParallelAlgorithm top_k(const Func &f, int dim, int extent, int k, const std::string &name) {
+    check_input(f, dim, extent, "top_k");
+    user_assert(k > 0 && k <= extent)
+        << "Can't select the " << k << " largest of " << extent << " values.\n";
+    AlgorithmArgs a(f.dimensions(), dim);
+    Var x = a.args[dim];
+    const int chunk = round_up_to_power_of_two(k);
+    const int size = std::max(round_up_to_power_of_two(extent), chunk);
+    Type t = f.output_types()[0];
+
+    // The input and its indices, padded to size with values that are
+    // never selected.
+    ParallelAlgorithm result;
+    Func padded(name + "_padded");
+    padded(a.args) = Tuple(select(x < extent, f(a.at(dim, clamp(x, 0, extent - 1))), t.min()), x);
+    result.stages.push_back(padded);
+
+    // Sort each chunk in descending order.
+    Func prev = padded;
+    for (int block = 2; block <= chunk; block *= 2) {
+        for (int distance = block / 2; distance > 0; distance /= 2) {
+            prev = bitonic_step(prev, a, dim, distance, size, block == chunk ? 0 : block, true,
+                                name + "_sort_step");
+            result.stages.push_back(prev);
+        }
+    }
+
+    // Merge the chunks pairwise: the larger halves of the pairs of a
+    // chunk and the reverse of the next one form bitonic sequences, which
+    // are sorted by the second half of a bitonic network.
+    for (int n = size; n > chunk; n /= 2) {
+        Expr c = x / chunk, i = x % chunk;
+        Expr lhs = clamp(2 * c * chunk + i, 0, n - 1);
+        Expr rhs = clamp((2 * c + 2) * chunk - 1 - i, 0, n - 1);
+        Func merged(name + "_merge");
+        define(merged, a.args, order(element_at(prev, a.at(dim, lhs)),
+                                     element_at(prev, a.at(dim, rhs)), true, true));
+        prev = merged;
+        result.stages.push_back(prev);
+        for (int distance = chunk / 2; distance > 0; distance /= 2) {
+            prev = bitonic_step(prev, a, dim, distance, n / 2, 0, true, name + "_merge_step");
+            result.stages.push_back(prev);
+        }
+    }
+
+    result.output = Func(name);
+    result.output(a.args) = Tuple(prev(a.args)[0], prev(a.args)[1]);
+    for (Func s : result.stages) {
+        s.compute_root();
+    }
+    Func output = result.output;
+    std::vector<Func> stages = result.stages;
+    result.schedule = [=](const Target &target) {
+        schedule_network(output, stages, dim, target);
+    };
+    return result;
+}
+
+ParallelAlgorithm histogram(const Func &f, const std::vector<std::pair<Expr, Expr>> &region, Expr bins,
+                            int chunk_size, const std::string &name) {
+    user_assert(f.defined() && f.outputs() == 1 &&
+                (f.output_types()[0].is_int() || f.output_types()[0].is_uint()))
+        << "The input of histogram must be a defined, single-valued integer Func.\n";
+    user_assert(f.dimensions() > 0 && (int)region.size() == f.dimensions())
+        << "The region of the histogram of " << f.name() << " must have "
+        << f.dimensions() << " dimensions.\n";
+    user_assert(bins.defined() && chunk_size > 0)
+        << "The histogram of " << f.name() << " needs a number of bins and a positive chunk size.\n";
+    bins = cast<int>(bins);
+    const int d = f.dimensions();
+    Expr rows_min = region[d - 1].first, rows_extent = region[d - 1].second;
+    Expr chunks = (rows_extent + chunk_size - 1) / chunk_size;
+
+    // The histograms of the chunks of the outermost dimension. The rows
+    // past the end of the region in the last chunk are counted in an
+    // extra bin, which isn't summed.
+    std::vector<std::pair<Expr, Expr>> chunk_region = region;
+    chunk_region[d - 1] = {0, chunk_size};
+    RDom r(chunk_region, name + "_r");
+    Var b("b"), c("c");
+    Func partial(name + "_partial");
+    partial(b, c) = 0;
+    std::vector<Expr> coords;
+    for (int i = 0; i < d - 1; i++) {
+        coords.push_back(r[i]);
+    }
+    Expr row = c * chunk_size + r[d - 1];
+    coords.push_back(rows_min + min(row, rows_extent - 1));
+    Expr bin = select(row < rows_extent, clamp(cast<int>(f(coords)), 0, bins - 1), bins);
+    partial(bin, c) += 1;
+    partial.compute_root();
+
+    ParallelAlgorithm result;
+    result.stages.push_back(partial);
+    RDom rc(0, chunks, name + "_rc");
+    result.output = Func(name);
+    result.output(b) = 0;
+    result.output(b) += partial(b, rc);
+
+    Func output = result.output;
+    result.schedule = [=](const Target &target) {
+        Func p = partial;
+        Func h = output;
+        Var bi("bi"), ci("ci");
+        if (target.has_gpu_feature()) {
+            // A block per chunk, whose threads add to its histogram
+            // atomically.
+            RVar ro, ri;
+            std::vector<VarOrRVar> order = {ro};
+            for (int i = 1; i < d; i++) {
+                order.push_back(r[i]);
+            }
+            order.push_back(ri);
+            order.push_back(c);
+            p.compute_root().gpu_tile(b, c, bi, ci, 64, 1);
+            p.update()
+                .atomic()
+                .split(r[0], ro, ri, 64)
+                .reorder(order)
+                .gpu_blocks(c)
+                .gpu_threads(ri);
+            h.gpu_tile(b, bi, 64, TailStrategy::GuardWithIf);
+            h.update().gpu_tile(b, bi, 64, TailStrategy::GuardWithIf);
+        } else {
+            const int vector_size = target.natural_vector_size<int>();
+            p.compute_root().vectorize(b, vector_size);
+            p.update().parallel(c);
+            h.vectorize(b, vector_size, TailStrategy::GuardWithIf);
+            h.update().vectorize(b, vector_size, TailStrategy::GuardWithIf);
+        }
+    };
+    return result;
+}
+
+}  // namespace Halide
@@ -0,0 +1,80 @@
+#ifndef HALIDE_PARALLEL_ALGORITHMS_H
+#define HALIDE_PARALLEL_ALGORITHMS_H
+
+/** \file
+ * Sorting, top-k selection and histograms built from data-parallel
+ * Funcs, with schedules for the CPU and for GPUs.
+ */
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Func.h"
+#include "Target.h"
+
+namespace Halide {
+
+/** A Func made by one of the functions below, along with the
+ * intermediate Funcs it reads. The intermediate Funcs are compute_root
+ * by default, and output is left to be scheduled like any other Func;
+ * schedule() replaces both with a schedule for the target:
+ *
+ \code
+ ParallelAlgorithm s = sort(f, 0, 1024);
+ s.schedule(get_target_from_environment());
+ Buffer<float> sorted = s.output.realize(1024, rows);
+ \endcode
+ */
+struct ParallelAlgorithm {
+    /** The result. */
+    Func output;
+
+    /** The intermediate Funcs, in the order they are computed. */
+    std::vector<Func> stages;
+
+    /** Schedule output and the stages for a target. On the CPU, the
+     * stages of sort and top_k are computed per row, for each point of
+     * the dimensions other than the sorted one, in parallel over the
+     * outermost of them, and vectorized along the sorted dimension; with
+     * no other dimension, each stage is parallelized along the sorted
+     * one. On GPUs, each stage is a kernel with a thread per element. The
+     * partial histograms are counted in parallel on the CPU, and by a GPU
+     * block each, with atomic adds, on GPUs. */
+    std::function<void(const Target &)> schedule;
+};
+
+/** The values of the single-valued Func f sorted in ascending order
+ * along its dimension dim, over [0, extent), for each point of its other
+ * dimensions. The sort is a bitonic network over extent rounded up to a
+ * power of two, of log2(extent) * (log2(extent) + 1) / 2 stages, each of
+ * which compares every element with one other, so the stages vectorize
+ * and parallelize along the sorted dimension. NaNs aren't ordered. */
+ParallelAlgorithm sort(const Func &f, int dim, int extent, const std::string &name = "sort");
+
+/** The k largest values of the single-valued Func f along its
+ * dimension dim, over [0, extent), for each point of its other
+ * dimensions, as a Tuple of the value and its index along dim, in
+ * descending order of value and ascending order of index for equal
+ * values. The result is indexed like f, over [0, k) along dim. The
+ * values are sorted in chunks of k rounded up to a power of two, and the
+ * chunks are merged pairwise, keeping the largest half of each merge, so
+ * the work is O(extent * log(k)^2) rather than the O(extent *
+ * log(extent)^2) of a sort. */
+ParallelAlgorithm top_k(const Func &f, int dim, int extent, int k, const std::string &name = "top_k");
+
+/** The histogram of the integer Func f over the given region of it,
+ * as a (min, extent) pair per dimension, like the ranges of an RDom: the
+ * number of times each bin in [0, bins) occurs, as an Int(32) Func of
+ * one dimension. The values of f are clamped to the bins. The outermost
+ * dimension of the region is split into chunks of chunk_size, each
+ * counted into its own histogram by a thread or a GPU block, and the
+ * partial histograms are summed, so that threads don't contend for the
+ * bins. */
+ParallelAlgorithm histogram(const Func &f, const std::vector<std::pair<Expr, Expr>> &region, Expr bins,
+                            int chunk_size = 16, const std::string &name = "histogram");
+
+}  // namespace Halide
+
+#endif
@@ -0,0 +1,89 @@
+#include "ParallelPolicies.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "Substitute.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::pair;
+using std::string;
+
+namespace {
+
+// The suffix of the names of the marked loops, followed by the policy
+// and the chunk size, e.g. f.s0.y.__par_for_1_4
+const string marker = ".__par_for_";
+
+class MarkParallelPolicies : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, pair<ParallelPolicy, int>> &policies;
+
+    Stmt visit(const For *op) override {
+        Stmt s = IRMutator2::visit(op);
+        auto it = policies.find(op->name);
+        if (op->for_type != ForType::Parallel || it == policies.end()) {
+            return s;
+        }
+        op = s.as<For>();
+        string name = op->name + marker + std::to_string((int)it->second.first) +
+            "_" + std::to_string(it->second.second);
+        Stmt body = substitute(op->name, Variable::make(Int(32), name), op->body);
+        return For::make(name, op->min, op->extent, op->for_type, op->device_api, body);
+    }
+
+public:
+    MarkParallelPolicies(const map<string, pair<ParallelPolicy, int>> &p) : policies(p) {}
+};
+
+void find_policies(const string &prefix, const Definition &def,
+                   map<string, pair<ParallelPolicy, int>> &policies) {
+    for (const Dim &dim : def.schedule().dims()) {
+        if (dim.for_type != ForType::Parallel) {
+            continue;
+        }
+        int chunk = std::max(dim.parallel_chunk, 1);
+        if (dim.parallel_policy != ParallelPolicy::Dynamic || chunk > 1) {
+            policies[prefix + dim.var] = {dim.parallel_policy, chunk};
+        }
+    }
+    for (const Specialization &s : def.specializations()) {
+        find_policies(prefix, s.definition, policies);
+    }
+}
+
+}  // namespace
+
+Stmt mark_parallel_policies(Stmt s, const map<string, Function> &env) {
+    map<string, pair<ParallelPolicy, int>> policies;
+    for (const auto &p : env) {
+        const Function &f = p.second;
+        find_policies(f.name() + ".s0.", f.definition(), policies);
+        for (size_t i = 0; i < f.updates().size(); i++) {
+            find_policies(f.name() + ".s" + std::to_string(i + 1) + ".", f.updates()[i], policies);
+        }
+    }
+
+    if (policies.empty()) {
+        return s;
+    }
+    return MarkParallelPolicies(policies).mutate(s);
+}
+
+bool get_parallel_policy(const string &loop_name, ParallelPolicy *policy, int *chunk) {
+    size_t pos = loop_name.rfind(marker);
+    if (pos == string::npos) {
+        return false;
+    }
+    string rest = loop_name.substr(pos + marker.size());
+    size_t sep = rest.find('_');
+    internal_assert(sep != string::npos) << "Bad parallel policy in loop name " << loop_name << "\n";
+    *policy = (ParallelPolicy)std::atoi(rest.substr(0, sep).c_str());
+    *chunk = std::atoi(rest.substr(sep + 1).c_str());
+    return true;
+}
+
+}  // namespace Internal
+}  // namespace Halide
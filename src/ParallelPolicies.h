@@ -0,0 +1,33 @@
+#ifndef HALIDE_PARALLEL_POLICIES_H
+#define HALIDE_PARALLEL_POLICIES_H
+
+/** \file
+ * Defines the lowering pass that marks the parallel loops scheduled with
+ * a policy other than the default one, and the function the backends use
+ * to read the marks back.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Rename the parallel loops scheduled with Func::parallel(var, policy,
+ * chunk) to carry their policy and chunk size, so that the backend
+ * hands out their iterations accordingly. Runs after all other
+ * lowering passes, because the loops are matched by name. */
+Stmt mark_parallel_policies(Stmt s, const std::map<std::string, Function> &env);
+
+/** Get the policy and the chunk size marked on a parallel loop by
+ * mark_parallel_policies. Returns false for a loop left alone, which
+ * hands out one iteration at a time. */
+bool get_parallel_policy(const std::string &loop_name, ParallelPolicy *policy, int *chunk);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -108,7 +108,11 @@ bool Parameter::is_buffer() const {
 Expr Parameter::scalar_expr() const {
     check_is_scalar();
     const Type t = type();
-    if (t.is_float()) {
+    if (t.is_bfloat()) {
+        switch (t.bits()) {
+        case 16: return Expr(scalar<bfloat16_t>());
+        }
+    } else if (t.is_float()) {
         switch (t.bits()) {
         case 16: return Expr(scalar<float16_t>());
         case 32: return Expr(scalar<float>());
@@ -411,7 +411,8 @@ public:
 protected:
     using IRVisitor::visit;
     void visit(const Call *op) {
-        if (op->name == "halide_gpu_thread_barrier") {
+        if (op->name == "halide_gpu_thread_barrier" ||
+            op->name == "halide_gpu_grid_barrier") {
             result = true;
         } else {
             IRVisitor::visit(op);
@@ -0,0 +1,243 @@
+#include "PersistentStorage.h"
+#include "AutoScheduleUtils.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "InjectHostDevBufferCopies.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The name of the storage of a Func kept by the runtime. The frames
+// held only stay valid while the definitions computing them do, so the
+// name includes a hash of those; the storage of an earlier definition
+// is left for halide_persistent_storage_cleanup.
+string storage_name(const string &pipeline_name, const Function &func) {
+    return pipeline_name + "." + func.name() + "." + algorithm_hash({func});
+}
+
+const Function *persistent_function(const map<string, Function> &env, const string &name) {
+    auto it = env.find(name);
+    if (it == env.end() || it->second.schedule().persist_frames() <= 0) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+class InjectPersistentStorage : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, Function> &env;
+    const string &pipeline_name;
+
+    // The index of the frame dimension of the persistent Funcs being
+    // realized, and the number of frames they keep.
+    map<string, std::pair<int, int>> realizing;
+
+    bool in_loop = false;
+    string producing;
+
+    Stmt visit(const For *op) override {
+        user_assert(producing.empty() ||
+                    op->device_api == DeviceAPI::None ||
+                    op->device_api == DeviceAPI::Host)
+            << "Persistent Func " << producing << " must be computed on the host.\n";
+        ScopedValue<bool> old_in_loop(in_loop, true);
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const Realize *op) override {
+        const Function *f = persistent_function(env, op->name);
+        if (!f) {
+            return IRMutator2::visit(op);
+        }
+        user_assert(!in_loop)
+            << "Persistent Func " << op->name << " must be computed at root.\n";
+        internal_assert(op->types.size() == 1);
+
+        const vector<string> args = f->args();
+        int dim = 0;
+        while (args[dim] != f->schedule().persist_var()) {
+            dim++;
+        }
+        int frames = f->schedule().persist_frames();
+
+        realizing[op->name] = {dim, frames};
+        Stmt body = mutate(op->body);
+        realizing.erase(op->name);
+        found.insert(op->name);
+
+        // The frames are stored modulo the number kept.
+        Region bounds = op->bounds;
+        Expr extent = bounds[dim].extent;
+        bounds[dim] = Range(0, frames);
+        Stmt s = Realize::make(op->name, op->types, op->memory_type, bounds, op->condition, body);
+
+        std::ostringstream condition, message;
+        condition << op->name << "." << args[dim] << ".extent <= " << frames;
+        message << "The frames of " << op->name << " needed by a call of the pipeline "
+                << "don't fit in the " << frames << " it keeps.";
+        Expr error = Call::make(Int(32), "halide_error_requirement_failed",
+                                {condition.str(), message.str()}, Call::Extern);
+        s = Block::make(AssertStmt::make(extent <= frames, error), s);
+
+        // The runtime only keeps the frames while the storage has the
+        // same shape.
+        vector<Expr> shape;
+        for (const Range &r : bounds) {
+            shape.push_back(r.min);
+        }
+        for (const Range &r : bounds) {
+            shape.push_back(r.extent);
+        }
+        Expr shape_struct = Call::make(Handle(), Call::make_struct, shape, Call::Intrinsic);
+        return LetStmt::make(op->name + ".persist_shape", shape_struct, s);
+    }
+
+    Stmt visit(const Provide *op) override {
+        Stmt s = IRMutator2::visit(op);
+        auto it = realizing.find(op->name);
+        if (it != realizing.end()) {
+            op = s.as<Provide>();
+            vector<Expr> args = op->args;
+            args[it->second.first] = args[it->second.first] % it->second.second;
+            return Provide::make(op->name, op->values, args);
+        }
+        return s;
+    }
+
+    Expr visit(const Call *op) override {
+        Expr e = IRMutator2::visit(op);
+        auto it = realizing.find(op->name);
+        if (op->call_type == Call::Halide && it != realizing.end()) {
+            op = e.as<Call>();
+            vector<Expr> args = op->args;
+            args[it->second.first] = args[it->second.first] % it->second.second;
+            return Call::make(op->type, op->name, args, op->call_type,
+                              op->func, op->value_index, op->image, op->param);
+        }
+        return e;
+    }
+
+    Stmt visit(const ProducerConsumer *op) override {
+        auto it = realizing.find(op->name);
+        if (!op->is_producer || it == realizing.end()) {
+            return IRMutator2::visit(op);
+        }
+        const Function &func = env.find(op->name)->second;
+        const int dim = it->second.first;
+        const int frames = it->second.second;
+
+        Stmt body;
+        {
+            ScopedValue<string> old_producing(producing, op->name);
+            body = mutate(op->body);
+        }
+
+        const string &name = func.name();
+        const string &t = func.schedule().persist_var();
+        Expr key = storage_name(pipeline_name, func);
+        Expr prev_first = Variable::make(Int(32), name + ".persist_first");
+        Expr prev_last = Variable::make(Int(32), name + ".persist_last");
+        Expr reuse = Variable::make(Bool(), name + ".persist_reuse");
+
+        // The frames the consumers need, as the region required of the
+        // last stage.
+        string prefix = name + ".s" + std::to_string(func.updates().size()) + "." + t;
+        Expr min_required = Variable::make(Int(32), prefix + ".min");
+        Expr max_required = Variable::make(Int(32), prefix + ".max");
+
+        // Start the stages after the frames held from the last calls,
+        // if they hold the first frame needed or the one before it. An
+        // update that isn't pure in t would run again over the frames
+        // held, and apply twice there.
+        for (int i = 0; i <= (int)func.updates().size(); i++) {
+            if (i > 0) {
+                const Variable *v = func.update(i - 1).args()[dim].as<Variable>();
+                user_assert(v && v->name == t)
+                    << "Update definition " << i - 1 << " of persistent Func " << name
+                    << " must be pure in " << t << ".\n";
+            }
+            string n = name + ".s" + std::to_string(i) + "." + t + ".min";
+            Expr stage_min = Variable::make(Int(32), n);
+            body = LetStmt::make(n, select(reuse, max(stage_min, prev_last + 1), stage_min), body);
+        }
+        Stmt s = ProducerConsumer::make(op->name, op->is_producer, body);
+
+        // The ring buffer now holds the frames needed, and the ones
+        // held before that weren't overwritten.
+        Expr last = select(reuse, max(max_required, prev_last), max_required);
+        Expr first = max(select(reuse, prev_first, min_required), last - (frames - 1));
+        s = Block::make(s, call_extern_and_assert("halide_persistent_storage_set_frames", {key, first, last}));
+
+        s = LetStmt::make(name + ".persist_reuse",
+                          prev_first <= prev_last && prev_first <= min_required && min_required <= prev_last + 1, s);
+        s = LetStmt::make(name + ".persist_last",
+                          Call::make(Int(32), "halide_persistent_storage_last_frame", {key}, Call::Extern), s);
+        s = LetStmt::make(name + ".persist_first",
+                          Call::make(Int(32), "halide_persistent_storage_first_frame", {key}, Call::Extern), s);
+        return s;
+    }
+
+public:
+    set<string> found;
+
+    InjectPersistentStorage(const map<string, Function> &env, const string &pipeline_name) :
+        env(env), pipeline_name(pipeline_name) {}
+};
+
+class RewritePersistentAllocations : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, Function> &env;
+    const string &pipeline_name;
+
+    Stmt visit(const Allocate *op) override {
+        const Function *f = persistent_function(env, op->name);
+        if (!f) {
+            return IRMutator2::visit(op);
+        }
+        internal_assert(!op->new_expr.defined());
+        Expr bytes = make_const(UInt(64), op->type.bytes());
+        for (const Expr &e : op->extents) {
+            bytes *= cast<uint64_t>(e);
+        }
+        Expr shape = Variable::make(Handle(), op->name + ".persist_shape");
+        Expr host = Call::make(Handle(), "halide_persistent_storage_acquire",
+                               {storage_name(pipeline_name, *f), bytes, shape,
+                                (int)op->extents.size() * 2},
+                               Call::Extern);
+        return Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition,
+                              mutate(op->body), host, "halide_persistent_storage_release");
+    }
+
+public:
+    RewritePersistentAllocations(const map<string, Function> &env, const string &pipeline_name) :
+        env(env), pipeline_name(pipeline_name) {}
+};
+
+}  // namespace
+
+Stmt inject_persistent_storage(Stmt s, const map<string, Function> &env, const string &pipeline_name) {
+    InjectPersistentStorage injector(env, pipeline_name);
+    s = injector.mutate(s);
+    for (const auto &it : env) {
+        user_assert(it.second.schedule().persist_frames() <= 0 || injector.found.count(it.first))
+            << "Persistent Func " << it.first << " must be computed at root, and can't be an output.\n";
+    }
+    return s;
+}
+
+Stmt rewrite_persistent_allocations(Stmt s, const map<string, Function> &env, const string &pipeline_name) {
+    return RewritePersistentAllocations(env, pipeline_name).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
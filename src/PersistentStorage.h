@@ -0,0 +1,35 @@
+#ifndef HALIDE_PERSISTENT_STORAGE_H
+#define HALIDE_PERSISTENT_STORAGE_H
+
+/** \file
+ * Defines the lowering passes that keep the last frames of the Funcs
+ * scheduled with Func::persist across calls of the pipeline.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Store the Funcs scheduled with Func::persist in a ring buffer along
+ * their frame dimension, and compute each of their pure stages only at
+ * the frames the storage doesn't hold from the last calls of the
+ * pipeline. Must be run after allocation bounds inference, while the
+ * bounds of the stages are still lets, and before storage flattening. */
+Stmt inject_persistent_storage(Stmt s, const std::map<std::string, Function> &env,
+                               const std::string &pipeline_name);
+
+/** Make the flattened allocations of the Funcs scheduled with
+ * Func::persist use the storage the runtime keeps across calls of the
+ * pipeline. Must be run after storage flattening. */
+Stmt rewrite_persistent_allocations(Stmt s, const std::map<std::string, Function> &env,
+                                    const std::string &pipeline_name);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
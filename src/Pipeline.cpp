@@ -1,9 +1,15 @@
 #include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 #include "Argument.h"
+#include "AutoScheduleUtils.h"
 #include "FindCalls.h"
 #include "Func.h"
+#include "IRMutator.h"
+#include "IROperator.h"
 #include "IRVisitor.h"
+#include "ImageParam.h"
 #include "InferArguments.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Output.h"
@@ -13,6 +19,9 @@
 #include "Pipeline.h"
 #include "PrintLoopNest.h"
 #include "RealizationOrder.h"
+#include "Simplify.h"
+#include "StmtToHtml.h"
+#include "UniquifyVariableNames.h"
 
 using namespace Halide::Internal;
 
@@ -42,6 +51,112 @@ Outputs static_library_outputs(const string &filename_prefix, const Target &targ
     return outputs;
 }
 
+// Call f on every specialization of the Functions in env, in order of
+// the names of the Functions, and then of their definitions, with each
+// specialization before the ones nested in it.
+void for_each_specialization(Definition &def, const std::function<void(Specialization &)> &f) {
+    for (Specialization &s : def.specializations()) {
+        f(s);
+        for_each_specialization(s.definition, f);
+    }
+}
+
+void for_each_specialization(const std::map<string, Function> &env,
+                             const std::function<void(Specialization &)> &f) {
+    for (const auto &it : env) {
+        Function func = it.second;
+        if (!func.has_pure_definition()) {
+            continue;
+        }
+        for_each_specialization(func.definition(), f);
+        for (size_t i = 0; i < func.updates().size(); i++) {
+            for_each_specialization(func.update((int)i), f);
+        }
+    }
+}
+
+std::map<string, Function> pipeline_env(const vector<Function> &outputs) {
+    std::map<string, Function> env;
+    for (const Function &f : outputs) {
+        std::map<string, Function> more = find_transitive_calls(f);
+        env.insert(more.begin(), more.end());
+    }
+    return env;
+}
+
+// Replace the scalar Params and the fields of the buffers in a
+// specialization condition with their values for a call.
+class SubstituteCallValues : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const ParamMap &param_map;
+    const std::map<string, const halide_buffer_t *> &outputs;
+
+    Expr buffer_field(const Variable *op, const halide_buffer_t *buf) {
+        // The name is <buffer>.<field>.<dimension>
+        size_t last = op->name.rfind('.');
+        size_t prev = last == string::npos || last == 0 ? string::npos : op->name.rfind('.', last - 1);
+        if (buf == nullptr || prev == string::npos) {
+            known = false;
+            return op;
+        }
+        string field = op->name.substr(prev + 1, last - prev - 1);
+        int d = atoi(op->name.c_str() + last + 1);
+        if (d < 0 || d >= buf->dimensions) {
+            known = false;
+            return op;
+        }
+        if (field == "min") {
+            return make_const(op->type, buf->dim[d].min);
+        } else if (field == "extent") {
+            return make_const(op->type, buf->dim[d].extent);
+        } else if (field == "stride") {
+            return make_const(op->type, buf->dim[d].stride);
+        }
+        known = false;
+        return op;
+    }
+
+    Expr visit(const Variable *op) override {
+        if (!op->param.defined()) {
+            known = false;
+            return op;
+        }
+        Buffer<> *unused;
+        const Parameter &p = param_map.map(op->param, unused);
+        if (!p.is_buffer()) {
+            return p.scalar_expr();
+        }
+        auto out = outputs.find(p.name());
+        if (out != outputs.end()) {
+            return buffer_field(op, out->second);
+        }
+        return buffer_field(op, p.buffer().defined() ? p.raw_buffer() : nullptr);
+    }
+
+public:
+    bool known = true;
+
+    SubstituteCallValues(const ParamMap &param_map,
+                         const std::map<string, const halide_buffer_t *> &outputs)
+        : param_map(param_map), outputs(outputs) {}
+};
+
+// Deep copy a pipeline, with its specialization conditions replaced by
+// the given values.
+vector<Function> fix_specializations(const vector<Function> &outputs, const vector<bool> &values) {
+    vector<Function> copies;
+    std::map<string, Function> env;
+    std::tie(copies, env) = deep_copy(outputs, pipeline_env(outputs));
+    size_t i = 0;
+    for_each_specialization(env, [&](Specialization &s) {
+        internal_assert(i < values.size());
+        s.condition = values[i++] ? const_true() : const_false();
+    });
+    internal_assert(i == values.size());
+    return copies;
+}
+
 }  // namespace
 
 struct PipelineContents {
@@ -57,12 +172,38 @@ struct PipelineContents {
     JITModule jit_module;
     Target jit_target;
 
+    // The code jit-compiled recently, keyed by the lowered module it was
+    // compiled from. Unlike jit_module, this survives invalidate_cache(),
+    // so that going back to a schedule tried before, or changing the
+    // schedule in a way that lowers to the same code, doesn't compile
+    // again. It depends on the jit externs, though.
+    std::map<string, JITModule> recent_jit_modules;
+    static const size_t max_recent_jit_modules = 8;
+
+    /** With lazy specializations, realize only compiles the
+     * specialization branches taken by its arguments. These are the
+     * values of the specialization conditions that jit_module was
+     * compiled for (empty if it was compiled for all of them), the
+     * values that the next compilation is for, and the code compiled
+     * for the ones seen since the cache was last cleared. */
+    bool lazy_specializations = false;
+    vector<bool> jit_specializations, requested_specializations;
+    std::map<vector<bool>, JITModule> specialized_jit_modules;
+    // The specialization conditions of the pipeline, in the order of
+    // for_each_specialization, and whether they have been found.
+    vector<Expr> specialization_conditions;
+    bool found_specialization_conditions = false;
+
     /** Clear all cached state */
     void invalidate_cache() {
         module = Module("", Target());
         jit_module = JITModule();
         jit_target = Target();
         inferred_args.clear();
+        jit_specializations.clear();
+        specialized_jit_modules.clear();
+        specialization_conditions.clear();
+        found_specialization_conditions = false;
     }
 
     // The outputs
@@ -153,11 +294,16 @@ vector<Func> Pipeline::outputs() const {
 
 string Pipeline::auto_schedule(const Target &target, const MachineParams &arch_params) {
     user_assert(target.arch == Target::X86 || target.arch == Target::ARM ||
-                target.arch == Target::POWERPC || target.arch == Target::MIPS)
+                target.arch == Target::POWERPC || target.arch == Target::MIPS ||
+                target.arch == Target::WebAssembly || target.arch == Target::RISCV)
         << "Automatic scheduling is currently supported only on these architectures.";
     return generate_schedules(contents->outputs, target, arch_params);
 }
 
+string Pipeline::algorithm_hash() const {
+    return Internal::algorithm_hash(contents->outputs);
+}
+
 Func Pipeline::get_func(size_t index) {
     // Compute an environment
     std::map<string, Function> env;
@@ -248,10 +394,14 @@ void Pipeline::print_loop_nest() {
 void Pipeline::compile_to_lowered_stmt(const string &filename,
                                        const vector<Argument> &args,
                                        StmtOutputFormat fmt,
-                                       const Target &target) {
+                                       const Target &target,
+                                       const string &profile_filename) {
     Module m = compile_to_module(args, "", target);
     Outputs outputs;
-    if (fmt == HTML) {
+    if (fmt == HTML && !profile_filename.empty()) {
+        print_to_html(output_name(filename, m, ".html"), m, profile_filename);
+        return;
+    } else if (fmt == HTML) {
         outputs = Outputs().stmt_html(output_name(filename, m, ".html"));
     } else {
         outputs = Outputs().stmt(output_name(filename, m, ".stmt"));
@@ -391,7 +541,11 @@ Module Pipeline::compile_to_module(const vector<Argument> &args,
             custom_passes.push_back(p.pass);
         }
 
-        contents->module = lower(contents->outputs, new_fn_name, target, lowering_args, linkage_type, custom_passes);
+        vector<Function> outputs = contents->outputs;
+        if (!contents->requested_specializations.empty()) {
+            outputs = fix_specializations(outputs, contents->requested_specializations);
+        }
+        contents->module = lower(outputs, new_fn_name, target, lowering_args, linkage_type, custom_passes);
     }
 
     return contents->module;
@@ -418,15 +572,39 @@ void *Pipeline::compile_jit(const Target &target_arg) {
 
     debug(2) << "jit-compiling for: " << target_arg << "\n";
 
+    // The specialization values requested by realize only apply to
+    // this compilation.
+    const vector<bool> requested = contents->requested_specializations;
+    struct ClearRequest {
+        PipelineContents *contents;
+        ~ClearRequest() {
+            contents->requested_specializations.clear();
+        }
+    } clear_request{contents.get()};
+
     // If we're re-jitting for the same target, we can just keep the
-    // old jit module.
+    // old jit module, if it has all the branches, or the ones wanted.
     if (contents->jit_target == target &&
-        contents->jit_module.compiled()) {
+        contents->jit_module.compiled() &&
+        (contents->jit_specializations.empty() ||
+         contents->jit_specializations == requested)) {
         debug(2) << "Reusing old jit module compiled for :\n" << contents->jit_target << "\n";
         return contents->jit_module.main_function();
     }
+    std::map<vector<bool>, JITModule> specialized;
+    if (contents->jit_target == target) {
+        auto it = contents->specialized_jit_modules.find(requested);
+        if (!requested.empty() && it != contents->specialized_jit_modules.end()) {
+            debug(2) << "Reusing jit module compiled for the same specializations\n";
+            contents->jit_module = it->second;
+            contents->jit_specializations = requested;
+            return contents->jit_module.main_function();
+        }
+        specialized.swap(contents->specialized_jit_modules);
+    }
     // Clear all cached info in case there is an error.
     contents->invalidate_cache();
+    contents->specialized_jit_modules.swap(specialized);
 
     contents->jit_target = target;
 
@@ -451,26 +629,126 @@ void *Pipeline::compile_jit(const Target &target_arg) {
 
     std::map<std::string, JITExtern> lowered_externs = contents->jit_externs;
 
-    // Compile to jit module
-    JITModule jit_module(module, f, make_externs_jit_module(target_arg, lowered_externs));
+    // Reuse the code compiled from the same lowered module, and for the
+    // same specialization branches, if any. The names of the
+    // temporaries made while lowering differ every time, so they are
+    // canonicalized in the key. Modules with embedded buffers aren't
+    // reused, as their contents may have changed.
+    string key;
+    JITModule jit_module;
+    if (module.buffers().empty()) {
+        std::ostringstream k;
+        k << std::setprecision(17) << target << "\n";
+        k << "specializations:";
+        for (bool b : requested) {
+            k << " " << b;
+        }
+        k << "\n";
+        for (const LoweredFunc &lf : module.functions()) {
+            k << (int)lf.linkage << " " << lf.name << "\n";
+            for (const Argument &a : lf.args) {
+                k << a.name << ": " << a.type << " " << (int)a.kind << " " << (int)a.dimensions << "\n";
+            }
+            k << canonicalize_generated_names(lf.body);
+        }
+        key = k.str();
+        auto recent = contents->recent_jit_modules.find(key);
+        if (recent != contents->recent_jit_modules.end()) {
+            debug(2) << "Reusing jit module compiled from the same lowered code\n";
+            jit_module = recent->second;
+        }
+    }
+
+    if (!jit_module.compiled()) {
+        // Compile to jit module
+        jit_module = JITModule(module, f, make_externs_jit_module(target_arg, lowered_externs));
+        if (!key.empty()) {
+            if (contents->recent_jit_modules.size() >= PipelineContents::max_recent_jit_modules) {
+                contents->recent_jit_modules.clear();
+            }
+            contents->recent_jit_modules[key] = jit_module;
+        }
 
-    // Dump bitcode to a file if the environment variable
-    // HL_GENBITCODE is defined to a nonzero value.
-    if (atoi(get_env_variable("HL_GENBITCODE").c_str())) {
-        string program_name = running_program_name();
-        if (program_name.empty()) {
-            program_name = "unknown" + unique_name('_').substr(1);
+        // Dump bitcode to a file if the environment variable
+        // HL_GENBITCODE is defined to a nonzero value.
+        if (atoi(get_env_variable("HL_GENBITCODE").c_str())) {
+            string program_name = running_program_name();
+            if (program_name.empty()) {
+                program_name = "unknown" + unique_name('_').substr(1);
+            }
+            string file_name = program_name + "_" + name + "_" + unique_name('g').substr(1) + ".bc";
+            debug(4) << "Saving bitcode to: " << file_name << "\n";
+            module.compile(Outputs().bitcode(file_name));
         }
-        string file_name = program_name + "_" + name + "_" + unique_name('g').substr(1) + ".bc";
-        debug(4) << "Saving bitcode to: " << file_name << "\n";
-        module.compile(Outputs().bitcode(file_name));
     }
 
     contents->jit_module = jit_module;
+    contents->jit_specializations = requested;
+    if (!requested.empty()) {
+        contents->specialized_jit_modules[requested] = jit_module;
+        // The module was lowered with some of the branches only.
+        contents->module = Module("", Target());
+    }
 
     return jit_module.main_function();
 }
 
+void Pipeline::set_lazy_specializations(bool lazy) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    contents->lazy_specializations = lazy;
+}
+
+void Pipeline::request_specializations(RealizationArg &outputs, const ParamMap &param_map) {
+    contents->requested_specializations.clear();
+    if (!contents->lazy_specializations) {
+        return;
+    }
+    if (!contents->found_specialization_conditions) {
+        for_each_specialization(pipeline_env(contents->outputs), [&](Specialization &s) {
+            contents->specialization_conditions.push_back(s.condition);
+        });
+        contents->found_specialization_conditions = true;
+    }
+    if (contents->specialization_conditions.empty()) {
+        return;
+    }
+
+    // The output buffers, in the order of the outputs and their values.
+    vector<const halide_buffer_t *> buffers;
+    if (outputs.r) {
+        for (size_t i = 0; i < outputs.r->size(); i++) {
+            buffers.push_back((*outputs.r)[i].raw_buffer());
+        }
+    } else if (outputs.buffer_list) {
+        for (const Buffer<> &buf : *outputs.buffer_list) {
+            buffers.push_back(buf.raw_buffer());
+        }
+    } else {
+        buffers.push_back(outputs.buf);
+    }
+    std::map<string, const halide_buffer_t *> output_buffers;
+    size_t i = 0;
+    for (const Function &f : contents->outputs) {
+        for (const Parameter &p : f.output_buffers()) {
+            if (i < buffers.size()) {
+                output_buffers[p.name()] = buffers[i++];
+            }
+        }
+    }
+
+    vector<bool> values;
+    for (const Expr &c : contents->specialization_conditions) {
+        SubstituteCallValues substitute(param_map, output_buffers);
+        Expr value = simplify(substitute.mutate(c));
+        if (!substitute.known || !is_const(value)) {
+            debug(2) << "Compiling all the specializations, as " << c << " isn't known before the call\n";
+            return;
+        }
+        values.push_back(is_one(value));
+    }
+    contents->requested_specializations = values;
+}
+
 
 void Pipeline::set_error_handler(void (*handler)(void *, const char *)) {
     user_assert(defined()) << "Pipeline is undefined\n";
@@ -507,6 +785,7 @@ void Pipeline::set_custom_print(void (*cust_print)(void *, const char *)) {
 void Pipeline::set_jit_externs(const std::map<std::string, JITExtern> &externs) {
     user_assert(defined()) << "Pipeline is undefined\n";
     contents->jit_externs = externs;
+    contents->recent_jit_modules.clear();
     invalidate_cache();
 }
 
@@ -683,6 +962,32 @@ struct JITFuncCallContext {
 
 }  // namespace
 
+namespace {
+
+// Print the profiler report for the last run of a jitted pipeline, and
+// save it to the file named by HL_PROFILER_FILE if set, then reset the
+// profiler state for the next one.
+void report_and_reset_jit_profiler(const JITModule &module, void *user_context) {
+    JITModule::Symbol report_sym = module.find_symbol_by_name("halide_profiler_report");
+    JITModule::Symbol reset_sym = module.find_symbol_by_name("halide_profiler_reset");
+    if (report_sym.address && reset_sym.address) {
+        void (*report_fn_ptr)(void *) = (void (*)(void *))(report_sym.address);
+        report_fn_ptr(user_context);
+
+        std::string profile_file = get_env_variable("HL_PROFILER_FILE");
+        JITModule::Symbol save_sym = module.find_symbol_by_name("halide_profiler_save");
+        if (!profile_file.empty() && save_sym.address) {
+            int (*save_fn_ptr)(void *, const char *) = (int (*)(void *, const char *))(save_sym.address);
+            save_fn_ptr(user_context, profile_file.c_str());
+        }
+
+        void (*reset_fn_ptr)() = (void (*)())(reset_sym.address);
+        reset_fn_ptr();
+    }
+}
+
+}  // namespace
+
 struct Pipeline::JITCallArgs {
     size_t size{0};
     const void **store;
@@ -827,6 +1132,20 @@ Pipeline::make_externs_jit_module(const Target &target,
     return result;
 }
 
+Target Pipeline::resolve_jit_target(const Target &target) const {
+    // If target is unspecified...
+    if (target.os == Target::OSUnknown) {
+        // If we've already jit-compiled for a specific target, use that.
+        if (contents->jit_module.compiled()) {
+            return contents->jit_target;
+        } else {
+            // Otherwise get the target from the environment
+            return get_jit_target_from_environment();
+        }
+    }
+    return target;
+}
+
 void Pipeline::realize(RealizationArg outputs, const Target &t,
                        const ParamMap &param_map) {
     Target target = t;
@@ -852,16 +1171,7 @@ void Pipeline::realize(RealizationArg outputs, const Target &t,
             << "The Buffers passed to realize must all be allocated\n";
     }
 
-    // If target is unspecified...
-    if (target.os == Target::OSUnknown) {
-        // If we've already jit-compiled for a specific target, use that.
-        if (contents->jit_module.compiled()) {
-            target = contents->jit_target;
-        } else {
-            // Otherwise get the target from the environment
-            target = get_jit_target_from_environment();
-        }
-    }
+    target = resolve_jit_target(target);
 
     // We need to make a context for calling the jitted function to
     // carry the the set of custom handlers. Here's how handlers get
@@ -886,6 +1196,7 @@ void Pipeline::realize(RealizationArg outputs, const Target &t,
     // member of the JITFuncCallContext which we will declare now:
 
     // Ensure the module is compiled.
+    request_specializations(outputs, param_map);
     compile_jit(target);
 
     // This has to happen after a runtime has been compiled in compile_jit.
@@ -940,23 +1251,266 @@ void Pipeline::realize(RealizationArg outputs, const Target &t,
 
     // If we're profiling, report runtimes and reset profiler stats.
     if (target.has_feature(Target::Profile)) {
-        JITModule::Symbol report_sym =
-            contents->jit_module.find_symbol_by_name("halide_profiler_report");
-        JITModule::Symbol reset_sym =
-            contents->jit_module.find_symbol_by_name("halide_profiler_reset");
-        if (report_sym.address && reset_sym.address) {
-            void *uc = &jit_context.jit_context;
-            void (*report_fn_ptr)(void *) = (void (*)(void *))(report_sym.address);
-            report_fn_ptr(uc);
-
-            void (*reset_fn_ptr)() = (void (*)())(reset_sym.address);
-            reset_fn_ptr();
+        report_and_reset_jit_profiler(contents->jit_module, &jit_context.jit_context);
+    }
+
+    jit_context.finalize(exit_status);
+}
+
+namespace {
+
+// The closure passed to halide_do_par_for by realize_batch. Each task
+// runs one invocation of the pipeline.
+struct BatchClosure {
+    JITModule::argv_wrapper argv_function;
+    const std::vector<const void **> *args;
+};
+
+int realize_batch_task(void *user_context, int idx, uint8_t *closure) {
+    const BatchClosure *c = (const BatchClosure *)closure;
+    return c->argv_function((*c->args)[idx]);
+}
+
+}  // namespace
+
+void Pipeline::realize_batch(std::vector<Realization> &outputs,
+                             const std::vector<ParamMap> &param_maps,
+                             const Target &t) {
+    Target target = t;
+    user_assert(defined()) << "Can't realize an undefined Pipeline\n";
+    user_assert(param_maps.empty() || param_maps.size() == outputs.size())
+        << "realize_batch was passed " << param_maps.size() << " ParamMaps for "
+        << outputs.size() << " Realizations. Pass either one ParamMap per Realization, or none.\n";
+
+    if (outputs.empty()) {
+        return;
+    }
+
+    debug(2) << "Realizing Pipeline for a batch of " << outputs.size() << " on " << target << "\n";
+
+    for (const Realization &r : outputs) {
+        user_assert(r.size() == contents->outputs.size())
+            << "Each Realization passed to realize_batch must contain one Buffer per Pipeline output\n";
+        for (size_t i = 0; i < r.size(); i++) {
+            user_assert(r[i].data() != nullptr || r[i].has_device_allocation())
+                << "Buffer at " << &r[i] << " is unallocated. "
+                << "The Buffers in a Realization passed to realize_batch must all be allocated\n";
+        }
+    }
+
+    target = resolve_jit_target(target);
+
+    compile_jit(target);
+
+    // All of the invocations share one context, so they share the
+    // custom handlers, and an error in any of them is reported once,
+    // by finalize.
+    JITFuncCallContext jit_context(jit_handlers());
+    void *user_context_storage = &jit_context.jit_context;
+
+    std::vector<std::unique_ptr<JITCallArgs>> args;
+    std::vector<const void **> arg_stores;
+    args.reserve(outputs.size());
+    arg_stores.reserve(outputs.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+        RealizationArg output(outputs[i]);
+        const ParamMap &param_map = param_maps.empty() ? ParamMap::empty_map() : param_maps[i];
+        args.emplace_back(new JITCallArgs(contents->inferred_args.size() + output.size()));
+        prepare_jit_call_arguments(output, target, param_map,
+                                   &user_context_storage, false, *args.back());
+        arg_stores.push_back(args.back()->store);
+    }
+
+    // Hand the invocations to the thread pool of the shared runtime as
+    // a single parallel job, so that threads are woken once for the
+    // whole batch. Any parallel loops inside the pipeline share the
+    // same pool.
+    BatchClosure closure;
+    closure.argv_function = contents->jit_module.argv_function();
+    closure.args = &arg_stores;
+
+    typedef int (*do_par_for_fn)(void *, int (*)(void *, int, uint8_t *), int, int, uint8_t *);
+    JITModule::Symbol par_for_sym = contents->jit_module.find_symbol_by_name("halide_do_par_for");
+
+    debug(2) << "Calling jitted function for a batch of " << outputs.size() << "\n";
+    int exit_status = 0;
+    if (par_for_sym.address && outputs.size() > 1) {
+        do_par_for_fn par_for = (do_par_for_fn)(par_for_sym.address);
+        exit_status = par_for(&jit_context.jit_context, realize_batch_task, 0,
+                              (int)outputs.size(), (uint8_t *)&closure);
+    } else {
+        for (size_t i = 0; i < outputs.size() && exit_status == 0; i++) {
+            exit_status = realize_batch_task(&jit_context.jit_context, (int)i, (uint8_t *)&closure);
         }
     }
+    debug(2) << "Back from jitted function. Exit status was " << exit_status << "\n";
+
+    if (target.has_feature(Target::Profile)) {
+        report_and_reset_jit_profiler(contents->jit_module, &jit_context.jit_context);
+    }
 
     jit_context.finalize(exit_status);
 }
 
+struct Pipeline::PreparedCall::Contents {
+    // Holds a reference to the compiled code, in case the Pipeline
+    // is recompiled while this call is still around.
+    JITModule jit_module;
+    Target target;
+    JITFuncCallContext jit_context;
+    void *user_context_storage;
+
+    // The arguments to the argv function, followed by the outputs.
+    std::vector<const void *> args;
+
+    // For each argument, the Parameter it came from (if any), and
+    // the storage for its value. Scalar values are copied, so that
+    // changing them doesn't touch the Params, and Buffers are held
+    // here to keep them alive.
+    std::vector<Parameter> params;
+    std::vector<halide_scalar_value_t> scalars;
+    std::vector<Buffer<>> buffers;
+    size_t first_output;
+
+    Contents(const JITHandlers &handlers) : jit_context(handlers) {}
+
+    size_t find_param(const Parameter &p) const {
+        for (size_t i = 0; i < first_output; i++) {
+            if (params[i].defined() && params[i].same_as(p)) {
+                return i;
+            }
+        }
+        user_error << "Parameter " << p.name() << " is not an argument to this PreparedCall\n";
+        return 0;
+    }
+};
+
+Pipeline::PreparedCall Pipeline::prepare_call(RealizationArg outputs, const Target &t,
+                                              const ParamMap &param_map) {
+    user_assert(defined()) << "Can't prepare a call to an undefined Pipeline\n";
+
+    Target target = resolve_jit_target(t);
+    compile_jit(target);
+
+    PreparedCall call;
+    call.contents = std::make_shared<PreparedCall::Contents>(jit_handlers());
+    PreparedCall::Contents &c = *call.contents;
+    c.jit_module = contents->jit_module;
+    c.target = target;
+    c.user_context_storage = &c.jit_context.jit_context;
+
+    const size_t num_args = contents->inferred_args.size();
+    const size_t num_outputs = outputs.size();
+    c.args.resize(num_args + num_outputs);
+    c.params.resize(num_args + num_outputs);
+    c.scalars.resize(num_args + num_outputs);
+    c.buffers.resize(num_args + num_outputs);
+    c.first_output = num_args;
+
+    const bool no_param_map = &param_map == &ParamMap::empty_map();
+    for (size_t i = 0; i < num_args; i++) {
+        const InferredArgument &arg = contents->inferred_args[i];
+        if (!arg.param.defined()) {
+            internal_assert(arg.buffer.defined());
+            c.buffers[i] = arg.buffer;
+            c.args[i] = c.buffers[i].raw_buffer();
+        } else if (arg.param.same_as(contents->user_context_arg.param)) {
+            c.args[i] = &c.user_context_storage;
+        } else {
+            Buffer<> *buf_out_param = nullptr;
+            const Parameter &p = no_param_map ? arg.param : param_map.map(arg.param, buf_out_param);
+            user_assert(!buf_out_param)
+                << "Cannot pass Buffer<> pointers in parameters map to a prepared call.\n";
+            c.params[i] = arg.param;
+            if (p.is_buffer()) {
+                user_assert(p.buffer().defined())
+                    << "ImageParam " << arg.arg.name << " must be bound before preparing a call. "
+                    << "Prepared calls do not do bounds inference.\n";
+                c.buffers[i] = p.buffer();
+                c.args[i] = c.buffers[i].raw_buffer();
+            } else {
+                memcpy(&c.scalars[i], p.scalar_address(), p.type().bytes());
+                c.args[i] = &c.scalars[i];
+            }
+        }
+    }
+
+    auto add_output = [&](size_t i, const Buffer<> &buf) {
+        user_assert(buf.data() != nullptr || buf.has_device_allocation())
+            << "Buffer at " << &buf << " is unallocated. "
+            << "The Buffers passed to prepare_call must all be allocated\n";
+        c.buffers[num_args + i] = buf;
+        c.args[num_args + i] = c.buffers[num_args + i].raw_buffer();
+    };
+    if (outputs.r) {
+        for (size_t i = 0; i < outputs.r->size(); i++) {
+            add_output(i, (*outputs.r)[i]);
+        }
+    } else if (outputs.buffer_list) {
+        for (size_t i = 0; i < outputs.buffer_list->size(); i++) {
+            add_output(i, (*outputs.buffer_list)[i]);
+        }
+    } else {
+        user_assert(outputs.buf && (outputs.buf->host || outputs.buf->device))
+            << "Buffer at " << (void *)outputs.buf << " is unallocated. "
+            << "The Buffers passed to prepare_call must all be allocated\n";
+        c.args[num_args] = outputs.buf;
+    }
+
+    return call;
+}
+
+void Pipeline::PreparedCall::set_scalar(const Parameter &p, Type t, const void *value) {
+    user_assert(defined()) << "Can't set an argument of an undefined PreparedCall\n";
+    size_t i = contents->find_param(p);
+    user_assert(!p.is_buffer() && p.type() == t)
+        << "Can't set Param " << p.name() << " of type " << p.type()
+        << " to a value of type " << t << "\n";
+    memcpy(&contents->scalars[i], value, t.bytes());
+}
+
+void Pipeline::PreparedCall::set(const ImageParam &p, const Buffer<> &buf) {
+    user_assert(defined()) << "Can't set an argument of an undefined PreparedCall\n";
+    size_t i = contents->find_param(p.parameter());
+    user_assert(buf.defined() && buf.type() == p.type() && buf.dimensions() == p.dimensions())
+        << "Can't set ImageParam " << p.name() << " of type " << p.type()
+        << " and dimensionality " << p.dimensions()
+        << " to a Buffer of type " << (buf.defined() ? buf.type() : Type())
+        << " and dimensionality " << (buf.defined() ? buf.dimensions() : 0) << "\n";
+    contents->buffers[i] = buf;
+    contents->args[i] = contents->buffers[i].raw_buffer();
+}
+
+void Pipeline::PreparedCall::set_output(size_t i, const Buffer<> &buf) {
+    user_assert(defined()) << "Can't set an output of an undefined PreparedCall\n";
+    size_t idx = contents->first_output + i;
+    user_assert(idx < contents->args.size())
+        << "PreparedCall has no output " << i << "\n";
+    const halide_buffer_t *old_buf = (const halide_buffer_t *)contents->args[idx];
+    user_assert(buf.defined() && (buf.data() != nullptr || buf.has_device_allocation()))
+        << "The Buffers passed to set_output must be allocated\n";
+    user_assert(buf.type() == old_buf->type && buf.dimensions() == old_buf->dimensions)
+        << "Can't set output " << i << " of a PreparedCall to a Buffer of type " << buf.type()
+        << " and dimensionality " << buf.dimensions()
+        << ", because it was prepared with a Buffer of type " << Type(old_buf->type)
+        << " and dimensionality " << old_buf->dimensions << "\n";
+    contents->buffers[idx] = buf;
+    contents->args[idx] = contents->buffers[idx].raw_buffer();
+}
+
+void Pipeline::PreparedCall::realize() {
+    user_assert(defined()) << "Can't realize an undefined PreparedCall\n";
+    Contents &c = *contents;
+
+    int exit_status = c.jit_module.argv_function()(c.args.data());
+
+    if (c.target.has_feature(Target::Profile)) {
+        report_and_reset_jit_profiler(c.jit_module, &c.jit_context.jit_context);
+    }
+
+    c.jit_context.finalize(exit_status);
+}
+
 void Pipeline::infer_input_bounds(RealizationArg outputs, const ParamMap &param_map) {
     Target target = get_jit_target_from_environment();
 
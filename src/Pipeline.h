@@ -7,6 +7,7 @@
  * pipeline.
  */
 
+#include <memory>
 #include <vector>
 
 #include "AutoSchedule.h"
@@ -98,6 +99,14 @@ public:
     void prepare_jit_call_arguments(RealizationArg &output, const Target &target, const ParamMap &param_map,
                                     void *user_context, bool is_bounds_inference, JITCallArgs &args_result);
 
+    // With lazy specializations, find the values of the specialization
+    // conditions for a call, to compile only the branches it takes.
+    void request_specializations(RealizationArg &outputs, const ParamMap &param_map);
+
+    // Resolve an unspecified target to the one the pipeline was last
+    // jit-compiled for, or failing that, the one from the environment.
+    Target resolve_jit_target(const Target &target) const;
+
     static std::vector<Internal::JITModule> make_externs_jit_module(const Target &target,
                                                                     std::map<std::string, JITExtern> &externs_in_out);
 
@@ -122,6 +131,19 @@ public:
                               const MachineParams &arch_params = MachineParams::generic());
     //@}
 
+    /** Return a hash of the algorithm of the pipeline, as 16 hex
+     * digits: of the definitions of all the Funcs it computes, but not
+     * of their schedules. The schedules generated by auto_schedule and
+     * simple_autoschedule begin with the hash of the algorithm they were
+     * generated for, taken before scheduling it (which may inline some
+     * of its Funcs into others), so compare it with the hash of the
+     * pipeline before it is scheduled to tell whether a saved schedule
+     * still applies to it. The schedules also give the target, the
+     * machine parameters, and on an "Inputs" line a hash of the
+     * estimates and options they were generated with; run the
+     * autoscheduler again only if one of these changes. */
+    std::string algorithm_hash() const;
+
     /** Return handle to the index-th Func within the pipeline based on the
      * topological order. */
     Func get_func(size_t index);
@@ -201,11 +223,14 @@ public:
 
     /** Write out an internal representation of lowered code. Useful
      * for analyzing and debugging scheduling. Can emit html or plain
-     * text. */
+     * text. The html can be annotated with the measurements in a report
+     * of the profiler (see Target::Profile) for runs of the same pipeline,
+     * saved in profile_filename: see Internal::print_to_html. */
     void compile_to_lowered_stmt(const std::string &filename,
                                  const std::vector<Argument> &args,
                                  StmtOutputFormat fmt = Text,
-                                 const Target &target = get_target_from_environment());
+                                 const Target &target = get_target_from_environment(),
+                                 const std::string &profile_filename = "");
 
     /** Write out the loop nests specified by the schedule for this
      * Pipeline's Funcs. Helpful for understanding what a schedule is
@@ -251,6 +276,15 @@ public:
      * then you can call this ahead of time. Returns the raw function
      * pointer to the compiled pipeline. Default is to use the Target
      * returned from Halide::get_jit_target_from_environment()
+     *
+     * If the environment variable HL_JIT_CACHE_DIR names a directory,
+     * the optimized LLVM bitcode of the lowered pipeline is stored
+     * there, keyed by a hash of its IR and target, and reused by later
+     * processes that lower to the same IR. Only lowering still runs
+     * on a hit. Entries never go stale, since any change to the
+     * pipeline or to the sources of Halide changes the key. Builds of
+     * Halide that don't define HALIDE_BUILD_ID (as the Makefile and
+     * CMake build do) ignore HL_JIT_CACHE_DIR.
      */
      void *compile_jit(const Target &target = get_jit_target_from_environment());
 
@@ -356,6 +390,18 @@ public:
      * infer_bounds, and compile_jit. */
     void set_jit_externs(const std::map<std::string, JITExtern> &externs);
 
+    /** Compile only the specialization branches a call to realize
+     * takes, instead of all of them. Each call evaluates the conditions
+     * of the specializations for its arguments, and compiles the
+     * pipeline with these conditions fixed to their values the first
+     * time it sees them, which reuses the code compiled for them
+     * after. This cuts the compile time and the size of the code of
+     * pipelines with many specializations which only take a few of
+     * them. If a condition depends on anything other than scalar
+     * Params and the fields of the input and output buffers, all the
+     * branches are compiled, as usual. Off by default. */
+    void set_lazy_specializations(bool lazy);
+
     /** Return the map of previously installed externs. Is an empty
      * map unless set otherwise. */
     const std::map<std::string, JITExtern> &get_jit_externs();
@@ -418,6 +464,82 @@ public:
     void realize(RealizationArg output, const Target &target = Target(),
                  const ParamMap &param_map = ParamMap::empty_map());
 
+    /** Evaluate this Pipeline once for each Realization in outputs,
+     * all as one parallel job. This is for running the same
+     * pipeline over many small independent inputs: the pipeline is
+     * compiled and the handlers are set up once for the whole batch,
+     * and the invocations are spread over the thread pool instead of
+     * waking it once per call. If param_maps is non-empty it must
+     * contain one ParamMap per Realization, which is used to bind
+     * the Params and ImageParams for that invocation. The invocations
+     * may run concurrently, so the output Buffers must not alias each
+     * other or any of the inputs. As with realize, the Buffers must
+     * already be allocated, and data is not copied back from the
+     * GPU. */
+    void realize_batch(std::vector<Realization> &outputs,
+                       const std::vector<ParamMap> &param_maps = std::vector<ParamMap>(),
+                       const Target &target = Target());
+
+    /** A call to a jit-compiled Pipeline with its arguments already
+     * validated and marshalled, made by Pipeline::prepare_call. Each
+     * call to realize() on it goes straight to the compiled
+     * function, skipping the target resolution, ParamMap lookups and
+     * argument marshalling done by Pipeline::realize, which for tiny
+     * pipelines can cost more than the pipeline itself. The values of
+     * the scalar Params and the ImageParam and output Buffers are
+     * captured when the call is prepared. Changing them afterwards
+     * must be done with the set methods below, which just swap the
+     * corresponding entry of the argument array. The custom handlers
+     * are also captured when the call is prepared. Copies of a
+     * PreparedCall refer to the same call, which should not be
+     * realized from more than one thread at a time. Compile with
+     * no_bounds_query and no_asserts in the target to get closest to
+     * the cost of calling an ahead-of-time compiled pipeline. */
+    class PreparedCall {
+        struct Contents;
+        std::shared_ptr<Contents> contents;
+        friend class Pipeline;
+
+        void set_scalar(const Internal::Parameter &p, Type t, const void *value);
+
+    public:
+        /** Make an undefined PreparedCall. */
+        PreparedCall() = default;
+
+        bool defined() const {
+            return contents != nullptr;
+        }
+
+        /** Change the value passed for a scalar Param. */
+        template<typename T>
+        void set(const Param<T> &p, T value) {
+            set_scalar(p.parameter(), type_of<T>(), &value);
+        }
+
+        /** Change the Buffer passed for an ImageParam. It must have the
+         * type and dimensionality of the ImageParam. */
+        void set(const ImageParam &p, const Buffer<> &buf);
+
+        /** Change the Buffer passed for the i'th output. It must be
+         * allocated, and have the same type and dimensionality as the
+         * Buffer it replaces. */
+        void set_output(size_t i, const Buffer<> &buf);
+
+        /** Run the pipeline. */
+        void realize();
+    };
+
+    /** Validate and marshal the arguments for calling this Pipeline
+     * on the given outputs, using the values currently bound to all
+     * Params and ImageParams (or the ones in param_map), and return
+     * them as a PreparedCall. The outputs must be allocated and
+     * every ImageParam must be bound, as prepared calls never do
+     * bounds inference. If outputs is a raw halide_buffer_t, the
+     * caller must keep it alive for as long as the PreparedCall is
+     * used. */
+    PreparedCall prepare_call(RealizationArg outputs, const Target &target = Target(),
+                              const ParamMap &param_map = ParamMap::empty_map());
+
     /** For a given size of output, or a given set of output buffers,
      * determine the bounds required of all unbound ImageParams
      * referenced. Communicates the result by allocating new buffers
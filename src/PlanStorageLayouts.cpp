@@ -0,0 +1,182 @@
+#include "PlanStorageLayouts.h"
+#include "Debug.h"
+#include "ExprUsesVar.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "Simplify.h"
+#include "Substitute.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The pure Var that a stage's vectorized (or innermost GPU thread)
+// loop steps along one at a time, or the empty string.
+string dense_var(const Definition &def) {
+    const vector<Dim> &dims = def.schedule().dims();
+    string v;
+    for (const Dim &d : dims) {
+        if (d.for_type == ForType::Vectorized) {
+            v = d.var;
+            break;
+        }
+    }
+    if (v.empty()) {
+        for (const Dim &d : dims) {
+            if (d.for_type == ForType::GPUThread || d.for_type == ForType::GPULane) {
+                v = d.var;
+                break;
+            }
+        }
+    }
+    if (v.empty()) {
+        return v;
+    }
+
+    // Follow the splits back to a Var of the definition.
+    const vector<Split> &splits = def.schedule().splits();
+    for (size_t i = splits.size(); i > 0; i--) {
+        const Split &s = splits[i - 1];
+        if (s.is_split() && s.inner == v) {
+            v = s.old_var;
+        } else if (s.is_split() && s.outer == v) {
+            // The outer var of a split steps by the split factor.
+            return "";
+        } else if (s.is_fuse() && s.old_var == v) {
+            // A fused var steps along its inner var first.
+            v = s.inner;
+        } else if ((s.is_rename() || s.is_purify()) && s.outer == v) {
+            v = s.old_var;
+        }
+    }
+    return v;
+}
+
+// Count the calls to a Func that are dense along each of its
+// dimensions, i.e. one argument steps by one along with a Var and the
+// others don't depend on it.
+class CountDenseAccesses : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+    const string &var;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type != Call::Halide || op->name != func) {
+            return;
+        }
+        int dense = -1;
+        for (size_t i = 0; i < op->args.size(); i++) {
+            if (!expr_uses_var(op->args[i], var)) {
+                continue;
+            }
+            Expr step = simplify(substitute(var, Variable::make(Int(32), var) + 1, op->args[i]) - op->args[i]);
+            if (dense < 0 && (is_one(step) || is_const(step, -1))) {
+                dense = (int)i;
+            } else {
+                return;
+            }
+        }
+        if (dense >= 0) {
+            votes[dense]++;
+        }
+    }
+
+public:
+    vector<int> &votes;
+    CountDenseAccesses(const string &func, const string &var, vector<int> &votes)
+        : func(func), var(var), votes(votes) {}
+};
+
+void count_dense_accesses(const Definition &def, const string &func, vector<int> &votes) {
+    string v = dense_var(def);
+    if (v.empty()) {
+        return;
+    }
+    CountDenseAccesses counter(func, v, votes);
+    for (const Expr &e : def.values()) {
+        e.accept(&counter);
+    }
+    for (const Expr &e : def.args()) {
+        e.accept(&counter);
+    }
+}
+
+}  // namespace
+
+void plan_storage_layouts(const vector<Function> &outputs,
+                          const map<string, Function> &env) {
+    set<string> fixed;
+    for (const Function &f : outputs) {
+        fixed.insert(f.name());
+    }
+    for (const auto &iter : env) {
+        for (const ExternFuncArgument &arg : iter.second.extern_arguments()) {
+            if (arg.is_func()) {
+                fixed.insert(Function(arg.func).name());
+            }
+        }
+    }
+
+    for (const auto &iter : env) {
+        Function f = iter.second;
+        if (fixed.count(f.name()) || f.has_extern_definition() ||
+            f.dimensions() < 2 || f.schedule().compute_level().is_inlined()) {
+            continue;
+        }
+        vector<StorageDim> &storage = f.schedule().storage_dims();
+        bool is_default = true;
+        for (size_t i = 0; i < storage.size(); i++) {
+            is_default = (is_default &&
+                          storage[i].var == f.args()[i] &&
+                          !storage[i].alignment.defined() &&
+                          !storage[i].fold_factor.defined());
+        }
+        if (!is_default) {
+            continue;
+        }
+
+        // Stores by the Func's own stages, and loads by the others.
+        vector<int> votes(f.dimensions(), 0);
+        for (const auto &c : env) {
+            const Function &g = c.second;
+            if (g.has_extern_definition()) {
+                continue;
+            }
+            count_dense_accesses(g.definition(), f.name(), votes);
+            for (const Definition &u : g.updates()) {
+                count_dense_accesses(u, f.name(), votes);
+            }
+        }
+        if (!f.definition().defined()) {
+            continue;
+        }
+        string v = dense_var(f.definition());
+        for (int i = 0; i < f.dimensions(); i++) {
+            votes[i] += (f.args()[i] == v);
+        }
+
+        int best = 0;
+        for (int i = 1; i < f.dimensions(); i++) {
+            if (votes[i] > votes[best]) {
+                best = i;
+            }
+        }
+        if (best != 0) {
+            debug(3) << "Storing dimension " << f.args()[best] << " of " << f.name() << " innermost\n";
+            StorageDim d = storage[best];
+            storage.erase(storage.begin() + best);
+            storage.insert(storage.begin(), d);
+        }
+    }
+}
+
+}  // namespace Internal
+}  // namespace Halide
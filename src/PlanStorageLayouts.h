@@ -0,0 +1,36 @@
+#ifndef HALIDE_PLAN_STORAGE_LAYOUTS_H
+#define HALIDE_PLAN_STORAGE_LAYOUTS_H
+
+/** \file
+ * Defines the pass that picks the storage order of intermediate Funcs
+ * from the way they are accessed.
+ */
+
+#include <map>
+#include <vector>
+
+#include "Function.h"
+
+namespace Halide {
+namespace Internal {
+
+/** For each intermediate Func that has the default storage order, find
+ * the dimension along which its consumers vectorize their loads of it
+ * (or which GPU threads step along), and its own stages their stores,
+ * and store that dimension innermost if it's used densely more often
+ * than the current innermost one. E.g. an intermediate indexed (c, x, y)
+ * that is vectorized across channels is stored channel-interleaved.
+ * Each Func picks its own order, so a transpose happens only in the
+ * consumers whose access pattern disagrees with the producer's.
+ *
+ * Funcs with an explicit storage order, alignment or folding, outputs,
+ * extern Funcs and the buffers passed to extern stages are left
+ * alone. This modifies the schedules of the Functions in env, so it
+ * should be called on the copies made for lowering. */
+void plan_storage_layouts(const std::vector<Function> &outputs,
+                          const std::map<std::string, Function> &env);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -8,6 +8,7 @@
 #include "Prefetch.h"
 #include "Scope.h"
 #include "Simplify.h"
+#include "Substitute.h"
 #include "Util.h"
 
 namespace Halide {
@@ -60,15 +61,34 @@ public:
     }
 };
 
+// The number of bytes that should be in flight ahead of the loads that use
+// them to hide the latency of memory, which is about the latency of DRAM
+// times the bandwidth available to a core. Zero means that the prefetches
+// of the target cover a whole region at a time, so the next iteration is
+// far enough.
+int prefetch_bytes_in_flight(const Target &t) {
+    if (t.features_any_of({Target::HVX_64, Target::HVX_128})) {
+        return 0;
+    } else if (t.arch == Target::X86) {
+        return 2048;
+    } else {
+        return 1024;
+    }
+}
+
 class InjectPrefetch : public IRMutator2 {
 public:
-    InjectPrefetch(const map<string, Function> &e, const map<string, Box> &buffers)
-        : env(e), external_buffers(buffers) {}
+    InjectPrefetch(const map<string, Function> &e, const map<string, Box> &buffers,
+                   const Target &t)
+        : env(e), external_buffers(buffers), bytes_in_flight(prefetch_bytes_in_flight(t)) {}
 
 private:
     const map<string, Function> &env;
     const map<string, Box> &external_buffers;
+    int bytes_in_flight;
     Scope<Box> buffer_bounds;
+    // The enclosing LetStmts, outermost first.
+    vector<std::pair<string, Expr>> lets;
 
 private:
     using IRMutator2::visit;
@@ -89,6 +109,58 @@ private:
         return iter->second;
     }
 
+    // Choose how many iterations of the loop over 'p.var' ahead to prefetch,
+    // so that the data that the iterations in between newly touch is about
+    // 'bytes_in_flight'. Along the dimensions of the box touched by an
+    // iteration that move with the loop, only the step of the box is new
+    // data. Fall back to the next iteration if the footprint is not known
+    // at compile time.
+    Expr choose_prefetch_offset(const PrefetchDirective &p, const vector<Type> &types,
+                                const Stmt &body) {
+        if (bytes_in_flight == 0) {
+            return 1;
+        }
+        map<string, Box> boxes = boxes_touched(body);
+        const auto &b = boxes.find(p.name);
+        if (b == boxes.end()) {
+            return 1;
+        }
+
+        int elem_bytes = 0;
+        for (const Type &t : types) {
+            elem_bytes += t.bytes();
+        }
+        Expr loop_var = Variable::make(Int(32), p.var);
+        Expr footprint = elem_bytes;
+        for (size_t i = 0; i < b->second.size(); i++) {
+            const Interval &interval = b->second[i];
+            Expr extent = simplify(interval.max - interval.min + 1);
+            if (expr_uses_var(interval.min, p.var)) {
+                Expr step = simplify(substitute(p.var, loop_var + 1, interval.min) - interval.min);
+                extent = simplify(min(max(step, -step), extent));
+            }
+            footprint *= extent;
+        }
+        // The extents of the loops are defined outside of the loop nest.
+        for (auto it = lets.rbegin(); it != lets.rend(); ++it) {
+            footprint = substitute(it->first, it->second, footprint);
+        }
+        footprint = simplify(footprint);
+
+        const int64_t *bytes = as_const_int(footprint);
+        if (!bytes || *bytes <= 0) {
+            return 1;
+        }
+        return (int)std::max<int64_t>(1, (bytes_in_flight + *bytes - 1) / *bytes);
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        lets.push_back({op->name, op->value});
+        Stmt stmt = IRMutator2::visit(op);
+        lets.pop_back();
+        return stmt;
+    }
+
     Stmt visit(const Realize *op) override {
         Box b;
         b.used = op->condition;
@@ -102,7 +174,12 @@ private:
     Stmt visit(const Prefetch *op) override {
         Stmt body = mutate(op->body);
 
-        const PrefetchDirective &p = op->prefetch;
+        PrefetchDirective p = op->prefetch;
+        if (!p.offset.defined()) {
+            p.offset = choose_prefetch_offset(p, op->types, body);
+            debug(3) << "Prefetching " << p.name << " " << p.offset
+                     << " iterations of " << p.var << " ahead\n";
+        }
         Expr loop_var = Variable::make(Int(32), p.var);
 
         // Add loop variable + prefetch offset to interval scope for box computation
@@ -149,7 +226,7 @@ private:
                 condition = simplify(prefetch_box.used && condition);
             }
             internal_assert(!new_bounds.empty());
-            return Prefetch::make(op->name, op->types, new_bounds, op->prefetch, condition, std::move(body));
+            return Prefetch::make(op->name, op->types, new_bounds, p, condition, std::move(body));
         }
 
         if (!body.same_as(op->body)) {
@@ -345,10 +422,10 @@ Stmt inject_placeholder_prefetch(Stmt s, const map<string, Function> &env,
     return stmt;
 }
 
-Stmt inject_prefetch(Stmt s, const map<string, Function> &env) {
+Stmt inject_prefetch(Stmt s, const map<string, Function> &env, const Target &t) {
     CollectExternalBufferBounds finder;
     s.accept(&finder);
-    return InjectPrefetch(env, finder.buffers).mutate(s);
+    return InjectPrefetch(env, finder.buffers, t).mutate(s);
 }
 
 Stmt reduce_prefetch_dimension(Stmt stmt, const Target &t) {
@@ -23,8 +23,10 @@ Stmt inject_placeholder_prefetch(Stmt s, const std::map<std::string, Function> &
                                  const std::vector<PrefetchDirective> &prefetches);
 /** Compute the actual region to be prefetched and place it to the
   * placholder prefetch. Wrap the prefetch call with condition when
-  * applicable. */
-Stmt inject_prefetch(Stmt s, const std::map<std::string, Function> &env);
+  * applicable. Prefetches with an undefined offset get one chosen from
+  * the footprint of an iteration and the memory latency of the target. */
+Stmt inject_prefetch(Stmt s, const std::map<std::string, Function> &env,
+                     const Target &t);
 
 /** Reduce a multi-dimensional prefetch into a prefetch of lower dimension
  * (max dimension of the prefetch is specified by target architecture).
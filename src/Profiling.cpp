@@ -27,7 +27,12 @@ public:
 
     string pipeline_name;
 
-    InjectProfiling(const string &pipeline_name) : pipeline_name(pipeline_name) {
+    // Whether to instrument for the sampling profiler thread, and
+    // whether to record the histograms of profile_metrics.
+    bool sampling, metrics;
+
+    InjectProfiling(const string &pipeline_name, bool sampling, bool metrics)
+        : pipeline_name(pipeline_name), sampling(sampling), metrics(metrics) {
         indices["overhead"] = 0;
         stack.push_back(0);
     }
@@ -45,6 +50,8 @@ private:
 
     Scope<AllocSize> func_alloc_sizes;
 
+    // False inside code offloaded to a device, which can't call the
+    // host's profiler functions.
     bool profiling_memory = true;
 
     // Strip down the tuple name, e.g. f.0 into f
@@ -145,11 +152,19 @@ private:
         }
 
         if (!is_zero(size) && !on_stack && profiling_memory) {
-            Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
             debug(3) << "  Allocation on heap: " << op->name << "(" << size << ") in pipeline " << pipeline_name << "\n";
-            Expr set_task = Call::make(Int(32), "halide_profiler_memory_allocate",
-                                       {profiler_pipeline_state, idx, size}, Call::Extern);
-            stmt = Block::make(Evaluate::make(set_task), stmt);
+            if (metrics) {
+                Expr instance = Variable::make(Handle(), "profiler_metrics_instance");
+                Expr record = Call::make(Int(32), "halide_profiler_metrics_memory_allocate",
+                                         {instance, size}, Call::Extern);
+                stmt = Block::make(Evaluate::make(record), stmt);
+            }
+            if (sampling) {
+                Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+                Expr set_task = Call::make(Int(32), "halide_profiler_memory_allocate",
+                                           {profiler_pipeline_state, idx, size}, Call::Extern);
+                stmt = Block::make(Evaluate::make(set_task), stmt);
+            }
         }
         return stmt;
     }
@@ -169,9 +184,17 @@ private:
             if (!alloc.on_stack) {
                 if (profiling_memory) {
                     debug(3) << "  Free on heap: " << op->name << "(" << alloc.size << ") in pipeline " << pipeline_name << "\n";
-                    Expr set_task = Call::make(Int(32), "halide_profiler_memory_free",
-                                               {profiler_pipeline_state, idx, alloc.size}, Call::Extern);
-                    stmt = Block::make(Evaluate::make(set_task), stmt);
+                    if (metrics) {
+                        Expr instance = Variable::make(Handle(), "profiler_metrics_instance");
+                        Expr record = Call::make(Int(32), "halide_profiler_metrics_memory_free",
+                                                 {instance, alloc.size}, Call::Extern);
+                        stmt = Block::make(Evaluate::make(record), stmt);
+                    }
+                    if (sampling) {
+                        Expr set_task = Call::make(Int(32), "halide_profiler_memory_free",
+                                                   {profiler_pipeline_state, idx, alloc.size}, Call::Extern);
+                        stmt = Block::make(Evaluate::make(set_task), stmt);
+                    }
                 }
             } else {
                 const uint64_t *int_size = as_const_uint(alloc.size);
@@ -200,14 +223,27 @@ private:
             idx = stack.back();
         }
 
-        Expr profiler_token = Variable::make(Int(32), "profiler_token");
-        Expr profiler_state = Variable::make(Handle(), "profiler_state");
+        if (metrics && profiling_memory && op->is_producer) {
+            // Time this realization of the Func.
+            string start_name = unique_name("profiler_metrics_start");
+            Expr start = Variable::make(Int(64), start_name);
+            Expr instance = Variable::make(Handle(), "profiler_metrics_instance");
+            Expr record = Call::make(Int(32), "halide_profiler_metrics_func_end",
+                                     {instance, idx, cast<uint64_t>(start)}, Call::Extern);
+            body = Block::make(body, Evaluate::make(record));
+            body = LetStmt::make(start_name, Call::make(Int(64), "halide_current_time_ns", {}, Call::Extern), body);
+        }
+
+        if (sampling) {
+            Expr profiler_token = Variable::make(Int(32), "profiler_token");
+            Expr profiler_state = Variable::make(Handle(), "profiler_state");
 
-        // This call gets inlined and becomes a single store instruction.
-        Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
-                                   {profiler_state, profiler_token, idx}, Call::Extern);
+            // This call gets inlined and becomes a single store instruction.
+            Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
+                                       {profiler_state, profiler_token, idx}, Call::Extern);
 
-        body = Block::make(Evaluate::make(set_task), body);
+            body = Block::make(Evaluate::make(set_task), body);
+        }
 
         return ProducerConsumer::make(op->name, op->is_producer, body);
     }
@@ -219,8 +255,8 @@ private:
         // parallel job launch. Decrement the number of active
         // threads outside the loop, and increment it inside the
         // body.
-        bool update_active_threads = (op->device_api == DeviceAPI::Hexagon ||
-                                      op->is_parallel());
+        bool update_active_threads = sampling && (op->device_api == DeviceAPI::Hexagon ||
+                                                  op->is_parallel());
 
         Expr state = Variable::make(Handle(), "profiler_state");
         Stmt incr_active_threads =
@@ -267,62 +303,79 @@ private:
     }
 };
 
-Stmt inject_profiling(Stmt s, string pipeline_name) {
-    InjectProfiling profiling(pipeline_name);
+Stmt inject_profiling(Stmt s, string pipeline_name, bool sampling, bool metrics) {
+    InjectProfiling profiling(pipeline_name, sampling, metrics);
     s = profiling.mutate(s);
 
     int num_funcs = (int)(profiling.indices.size());
 
     Expr func_names_buf = Variable::make(Handle(), "profiling_func_names");
 
-    Expr start_profiler = Call::make(Int(32), "halide_profiler_pipeline_start",
-                                     {pipeline_name, num_funcs, func_names_buf}, Call::Extern);
+    if (metrics) {
+        // Each run keeps its start time and heap usage in a small
+        // buffer on the stack, which is billed to the pipeline's
+        // histograms at the end of the run.
+        Expr instance = Variable::make(Handle(), "profiler_metrics_instance");
+        Expr start_metrics = Call::make(Int(32), "halide_profiler_metrics_start",
+                                        {pipeline_name, num_funcs, func_names_buf, instance}, Call::Extern);
+        Expr end_metrics = Call::make(Int(32), "halide_profiler_metrics_end",
+                                      {instance}, Call::Extern);
+        Expr result = Variable::make(Int(32), "profiler_metrics_result");
+        s = Block::make(s, Evaluate::make(end_metrics));
+        s = Block::make(AssertStmt::make(result == 0, result), s);
+        s = LetStmt::make("profiler_metrics_result", start_metrics, s);
+        s = Block::make(s, Free::make("profiler_metrics_instance"));
+        s = Allocate::make("profiler_metrics_instance", UInt(64),
+                           MemoryType::Stack, {4}, const_true(), s);
+    }
 
-    Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
+    if (sampling) {
+        Expr start_profiler = Call::make(Int(32), "halide_profiler_pipeline_start",
+                                         {pipeline_name, num_funcs, func_names_buf}, Call::Extern);
 
-    Expr get_pipeline_state = Call::make(Handle(), "halide_profiler_get_pipeline_state", {pipeline_name}, Call::Extern);
+        Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
 
-    Expr profiler_token = Variable::make(Int(32), "profiler_token");
+        Expr get_pipeline_state = Call::make(Handle(), "halide_profiler_get_pipeline_state", {pipeline_name}, Call::Extern);
 
-    Expr stop_profiler = Call::make(Int(32), Call::register_destructor,
-                                    {Expr("halide_profiler_pipeline_end"), get_state}, Call::Intrinsic);
+        Expr profiler_token = Variable::make(Int(32), "profiler_token");
 
-    bool no_stack_alloc = profiling.func_stack_peak.empty();
-    if (!no_stack_alloc) {
-        Expr func_stack_peak_buf = Variable::make(Handle(), "profiling_func_stack_peak_buf");
+        bool no_stack_alloc = profiling.func_stack_peak.empty();
+        if (!no_stack_alloc) {
+            Expr func_stack_peak_buf = Variable::make(Handle(), "profiling_func_stack_peak_buf");
 
-        Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
-        Stmt update_stack = Evaluate::make(Call::make(Int(32), "halide_profiler_stack_peak_update",
-                                           {profiler_pipeline_state, func_stack_peak_buf}, Call::Extern));
-        s = Block::make(update_stack, s);
-    }
+            Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+            Stmt update_stack = Evaluate::make(Call::make(Int(32), "halide_profiler_stack_peak_update",
+                                               {profiler_pipeline_state, func_stack_peak_buf}, Call::Extern));
+            s = Block::make(update_stack, s);
+        }
 
-    Expr profiler_state = Variable::make(Handle(), "profiler_state");
-    Stmt incr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_incr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    Stmt decr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    s = Block::make({incr_active_threads, s, decr_active_threads});
-
-    s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
-    s = LetStmt::make("profiler_state", get_state, s);
-    // If there was a problem starting the profiler, it will call an
-    // appropriate halide error function and then return the
-    // (negative) error code as the token.
-    s = Block::make(AssertStmt::make(profiler_token >= 0, profiler_token), s);
-    s = LetStmt::make("profiler_token", start_profiler, s);
-
-    if (!no_stack_alloc) {
-        for (int i = num_funcs-1; i >= 0; --i) {
-            s = Block::make(Store::make("profiling_func_stack_peak_buf",
-                                        make_const(UInt(64), profiling.func_stack_peak[i]),
-                                        i, Parameter(), const_true()), s);
+        Expr profiler_state = Variable::make(Handle(), "profiler_state");
+        Stmt incr_active_threads =
+            Evaluate::make(Call::make(Int(32), "halide_profiler_incr_active_threads",
+                                      {profiler_state}, Call::Extern));
+        Stmt decr_active_threads =
+            Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
+                                      {profiler_state}, Call::Extern));
+        s = Block::make({incr_active_threads, s, decr_active_threads});
+
+        s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
+        s = LetStmt::make("profiler_state", get_state, s);
+        // If there was a problem starting the profiler, it will call an
+        // appropriate halide error function and then return the
+        // (negative) error code as the token.
+        s = Block::make(AssertStmt::make(profiler_token >= 0, profiler_token), s);
+        s = LetStmt::make("profiler_token", start_profiler, s);
+
+        if (!no_stack_alloc) {
+            for (int i = num_funcs-1; i >= 0; --i) {
+                s = Block::make(Store::make("profiling_func_stack_peak_buf",
+                                            make_const(UInt(64), profiling.func_stack_peak[i]),
+                                            i, Parameter(), const_true()), s);
+            }
+            s = Block::make(s, Free::make("profiling_func_stack_peak_buf"));
+            s = Allocate::make("profiling_func_stack_peak_buf", UInt(64),
+                               MemoryType::Auto, {num_funcs}, const_true(), s);
         }
-        s = Block::make(s, Free::make("profiling_func_stack_peak_buf"));
-        s = Allocate::make("profiling_func_stack_peak_buf", UInt(64),
-                           MemoryType::Auto, {num_funcs}, const_true(), s);
     }
 
     for (std::pair<string, int> p : profiling.indices) {
@@ -332,7 +385,13 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
     s = Block::make(s, Free::make("profiling_func_names"));
     s = Allocate::make("profiling_func_names", Handle(),
                        MemoryType::Auto, {num_funcs}, const_true(), s);
-    s = Block::make(Evaluate::make(stop_profiler), s);
+
+    if (sampling) {
+        Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
+        Expr stop_profiler = Call::make(Int(32), Call::register_destructor,
+                                        {Expr("halide_profiler_pipeline_end"), get_state}, Call::Intrinsic);
+        s = Block::make(Evaluate::make(stop_profiler), s);
+    }
 
     return s;
 }
@@ -35,8 +35,13 @@ namespace Internal {
  * times and counts will be logged at the end. Should be done before
  * storage flattening, but after all bounds inference.
  *
+ * If metrics is true, also record the latency and peak heap usage of
+ * each run, and the time taken by each realization of each Func, in
+ * the histograms of the pipeline's halide_profiler_pipeline_stats
+ * (the profile_metrics target feature). This doesn't need the
+ * sampling thread, so sampling may be false.
  */
-Stmt inject_profiling(Stmt, std::string);
+Stmt inject_profiling(Stmt, std::string, bool sampling = true, bool metrics = false);
 
 }  // namespace Internal
 }  // namespace Halide
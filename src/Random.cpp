@@ -1,6 +1,7 @@
 #include "Random.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "Simplify.h"
 
 namespace Halide {
 namespace Internal {
@@ -92,6 +93,59 @@ Expr random_float(const vector<Expr> &e) {
     return clamp(reinterpret(Float(32), result) - 1.0f, 0.0f, 1.0f);
 }
 
+Expr philox4x32(const vector<Expr> &counter, const vector<Expr> &key, int word) {
+    internal_assert(counter.size() == 4 && key.size() == 2 && word >= 0 && word < 4);
+    // The multipliers and the Weyl sequence that bumps the key between
+    // rounds, from Salmon et al., "Parallel Random Numbers: As Easy as
+    // 1, 2, 3".
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+    // Each word of a round is used several times by the next one, so
+    // bind them all to lets to keep the expression linear in the
+    // number of rounds.
+    vector<std::pair<string, Expr>> lets;
+    auto bind = [&](Expr e) {
+        e = simplify(e);
+        if (is_const(e) || e.as<Variable>()) {
+            return e;
+        }
+        string name = unique_name('P');
+        lets.push_back({name, e});
+        return Variable::make(e.type(), name);
+    };
+    auto mulhi = [](Expr a, uint32_t b) {
+        return cast(UInt(32), (cast(UInt(64), a) * make_const(UInt(64), b)) >> 32);
+    };
+
+    Expr c[4], k[2];
+    for (int i = 0; i < 4; i++) {
+        c[i] = bind(cast(UInt(32), counter[i]));
+    }
+    for (int i = 0; i < 2; i++) {
+        k[i] = bind(cast(UInt(32), key[i]));
+    }
+    for (int round = 0; round < 10; round++) {
+        if (round > 0) {
+            k[0] = bind(k[0] + make_const(UInt(32), W0));
+            k[1] = bind(k[1] + make_const(UInt(32), W1));
+        }
+        Expr hi0 = mulhi(c[0], M0), lo0 = c[0] * make_const(UInt(32), M0);
+        Expr hi1 = mulhi(c[2], M1), lo1 = c[2] * make_const(UInt(32), M1);
+        Expr c1 = c[1], c3 = c[3];
+        c[0] = bind(hi1 ^ c1 ^ k[0]);
+        c[1] = bind(lo1);
+        c[2] = bind(hi0 ^ c3 ^ k[1]);
+        c[3] = bind(lo0);
+    }
+
+    Expr result = c[word];
+    for (auto it = lets.rbegin(); it != lets.rend(); it++) {
+        result = Let::make(it->first, it->second, result);
+    }
+    return result;
+}
+
 class LowerRandom : public IRMutator2 {
     using IRMutator2::visit;
 
@@ -109,6 +163,24 @@ class LowerRandom : public IRMutator2 {
                 internal_error << "The intrinsic random() returns an Int(32), UInt(32) or a Float(32).\n";
                 return Expr();
             }
+        } else if (op->is_intrinsic(Call::philox)) {
+            // The counter is the coordinates, and the key is the seed.
+            vector<Expr> counter;
+            for (size_t i = 0; i + 1 < op->args.size(); i++) {
+                counter.push_back(mutate(op->args[i]));
+            }
+            while (counter.size() < 4) {
+                counter.push_back(make_zero(UInt(32)));
+            }
+            Expr bits = philox4x32(counter, {mutate(op->args.back()), make_zero(UInt(32))}, 0);
+            if (op->type == Float(32)) {
+                // The top 24 bits convert to a float exactly, so this
+                // is the same on every target.
+                return cast(Float(32), bits >> 8) * (1.0f / (1 << 24));
+            } else {
+                internal_assert(op->type == UInt(32)) << "The intrinsic philox() returns a UInt(32) or a Float(32).\n";
+                return bits;
+            }
         } else {
             return IRMutator2::visit(op);
         }
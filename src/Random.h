@@ -20,6 +20,11 @@ Expr random_float(const std::vector<Expr> &);
  * be integers or unsigned integers). */
 Expr random_int(const std::vector<Expr> &);
 
+/** Return one of the four words (0 to 3) of the Philox-4x32-10
+ * counter-based generator, for a counter of four and a key of two
+ * unsigned 32-bit integers. */
+Expr philox4x32(const std::vector<Expr> &counter, const std::vector<Expr> &key, int word);
+
 /** Convert calls to random() to IR generated by random_float and
  * random_int. Tags all calls with the variables in free_vars, and the
  * integer given as the last argument. */
@@ -0,0 +1,295 @@
+#include "RealizeInPlace.h"
+#include "Debug.h"
+#include "Function.h"
+#include "IREquality.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+
+namespace {
+
+// Does a statement read or write a Func, or pass its buffer to an extern stage?
+class UsesFunc : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Halide && op->name == func) {
+            result = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Provide *op) {
+        if (op->name == func) {
+            result = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Prefetch *op) {
+        if (op->name == func) {
+            result = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Variable *op) {
+        if (starts_with(op->name, func + ".") && ends_with(op->name, ".buffer")) {
+            result = true;
+        }
+    }
+
+public:
+    bool result = false;
+    UsesFunc(const string &func) : func(func) {}
+};
+
+bool uses_func(const Stmt &s, const string &func) {
+    UsesFunc uses(func);
+    s.accept(&uses);
+    return uses.result;
+}
+
+class ContainsMin : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Min *op) {
+        result = true;
+    }
+
+public:
+    bool result = false;
+};
+
+// Check that the realization of a consumer can be stored in the buffer of
+// its producer: the consumer has a single Provide, which only reads the
+// producer at the point it writes, and nothing else in the realization
+// reads the producer or takes either buffer.
+class CheckElementwise : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &producer, &consumer;
+    const Provide *provide = nullptr;
+
+    void visit(const Provide *op) {
+        if (op->name == producer || (op->name == consumer && provides++ > 0)) {
+            ok = false;
+        } else if (op->name == consumer) {
+            for (const Expr &arg : op->args) {
+                arg.accept(this);
+            }
+            provide = op;
+            for (const Expr &value : op->values) {
+                value.accept(this);
+            }
+            provide = nullptr;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Halide && op->name == producer) {
+            if (!provide || op->args.size() != provide->args.size()) {
+                ok = false;
+            } else {
+                for (size_t i = 0; i < op->args.size(); i++) {
+                    ok = ok && equal(op->args[i], provide->args[i]);
+                }
+            }
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Prefetch *op) {
+        if (op->name == producer || op->name == consumer) {
+            ok = false;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Variable *op) {
+        if ((starts_with(op->name, producer + ".") || starts_with(op->name, consumer + ".")) &&
+            ends_with(op->name, ".buffer")) {
+            ok = false;
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        // A ShiftInwards split shifts the last iteration back over
+        // points already computed, which would then read the
+        // consumer's values instead of the producer's. (It's a min
+        // in the base of the split.)
+        if (ends_with(op->name, ".base")) {
+            ContainsMin m;
+            op->value.accept(&m);
+            ok = ok && !m.result;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool ok = true;
+    int provides = 0;
+
+    CheckElementwise(const string &producer, const string &consumer)
+        : producer(producer), consumer(consumer) {}
+};
+
+// Rename the Provides and Calls of one Func to another.
+class RenameFunc : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const string &from;
+    const Function &to;
+
+    Stmt visit(const Provide *op) override {
+        Stmt s = IRMutator2::visit(op);
+        if (op->name == from) {
+            op = s.as<Provide>();
+            s = Provide::make(to.name(), op->values, op->args);
+        }
+        return s;
+    }
+
+    Expr visit(const Call *op) override {
+        Expr e = IRMutator2::visit(op);
+        if (op->call_type == Call::Halide && op->name == from) {
+            op = e.as<Call>();
+            e = Call::make(to, op->args, op->value_index);
+        }
+        return e;
+    }
+
+public:
+    RenameFunc(const string &from, const Function &to) : from(from), to(to) {}
+};
+
+class RealizeInPlace : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, Function> &env;
+
+    // Can this Func take part in a chain at all?
+    bool can_share_storage(const string &name) {
+        auto it = env.find(name);
+        if (it == env.end()) {
+            return false;
+        }
+        const Function &f = it->second;
+        return (f.outputs() == 1 &&
+                !f.schedule().memoized() &&
+                !f.schedule().async() &&
+                f.debug_file().empty() &&
+                !f.is_tracing_loads() &&
+                !f.is_tracing_stores() &&
+                !f.is_tracing_realizations());
+    }
+
+    bool can_alias(const Realize *producer, const Realize *consumer) {
+        if (!can_share_storage(consumer->name)) {
+            return false;
+        }
+        const Function &g = env.at(consumer->name);
+        if (g.has_extern_definition() || !g.updates().empty()) {
+            return false;
+        }
+        if (consumer->types != producer->types ||
+            consumer->memory_type != producer->memory_type ||
+            consumer->bounds.size() != producer->bounds.size() ||
+            !is_one(consumer->condition) ||
+            !is_one(producer->condition)) {
+            return false;
+        }
+        for (size_t i = 0; i < consumer->bounds.size(); i++) {
+            if (!equal(consumer->bounds[i].min, producer->bounds[i].min) ||
+                !equal(consumer->bounds[i].extent, producer->bounds[i].extent)) {
+                return false;
+            }
+        }
+        CheckElementwise check(producer->name, consumer->name);
+        consumer->body.accept(&check);
+        return check.ok && check.provides == 1;
+    }
+
+    // Walk the statements that run once, unconditionally, after the
+    // producer, without entering loops or the productions of other Funcs,
+    // and store the first Realize that can be stored in the producer's
+    // buffer there. The producer must not be used after it.
+    Stmt alias_next_consumer(const Stmt &s, const Realize *producer, bool &found) {
+        if (const Block *op = s.as<Block>()) {
+            Stmt first = alias_next_consumer(op->first, producer, found);
+            if (found) {
+                if (op->rest.defined() && uses_func(op->rest, producer->name)) {
+                    found = false;
+                    return s;
+                }
+                return Block::make(first, op->rest);
+            }
+            if (!op->rest.defined()) {
+                return s;
+            }
+            Stmt rest = alias_next_consumer(op->rest, producer, found);
+            return found ? Block::make(op->first, rest) : s;
+        } else if (const LetStmt *op = s.as<LetStmt>()) {
+            Stmt body = alias_next_consumer(op->body, producer, found);
+            return found ? LetStmt::make(op->name, op->value, body) : s;
+        } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+            if (op->is_producer) {
+                return s;
+            }
+            Stmt body = alias_next_consumer(op->body, producer, found);
+            return found ? ProducerConsumer::make(op->name, false, body) : s;
+        } else if (const Realize *op = s.as<Realize>()) {
+            if (can_alias(producer, op)) {
+                debug(3) << "Storing " << op->name << " in the buffer of " << producer->name << "\n";
+                found = true;
+                return RenameFunc(op->name, env.at(producer->name)).mutate(op->body);
+            }
+            Stmt body = alias_next_consumer(op->body, producer, found);
+            return found ? Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body) : s;
+        }
+        return s;
+    }
+
+    Stmt visit(const Realize *op) override {
+        Stmt s = op;
+        if (can_share_storage(op->name)) {
+            // Each consumer stored in place becomes the producer of
+            // the rest of the chain.
+            bool found = true;
+            while (found) {
+                found = false;
+                const Realize *r = s.as<Realize>();
+                Stmt body = alias_next_consumer(r->body, r, found);
+                if (found) {
+                    s = Realize::make(r->name, r->types, r->memory_type, r->bounds, r->condition, body);
+                }
+            }
+        }
+        return IRMutator2::visit(s.as<Realize>());
+    }
+
+public:
+    RealizeInPlace(const map<string, Function> &env) : env(env) {}
+};
+
+}  // namespace
+
+Stmt realize_in_place(Stmt s, const map<string, Function> &env, const Target &t) {
+    // Tracing reports the realizations of each Func.
+    if (t.features_any_of({Target::TraceLoads, Target::TraceStores, Target::TraceRealizations})) {
+        return s;
+    }
+    return RealizeInPlace(env).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
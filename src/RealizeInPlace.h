@@ -0,0 +1,43 @@
+#ifndef HALIDE_REALIZE_IN_PLACE_H
+#define HALIDE_REALIZE_IN_PLACE_H
+
+/** \file
+ * Defines the lowering pass that stores elementwise consumers in the
+ * buffers of their producers.
+ */
+
+#include <map>
+
+#include "IR.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Reuse the storage of a Func for the next stage of an elementwise
+ * chain, when the Func is dead once the chain has read it. E.g. in
+ *
+ \code
+ f(x, y) = ...
+ g(x, y) = f(x, y) * 2
+ h(x, y) = g(x+1, y) + g(x-1, y)
+ f.compute_root();
+ g.compute_root();
+ \endcode
+ *
+ * g is realized over the same region as f, each point of g only reads
+ * f at the same point, and nothing reads f after g, so g is stored in
+ * the buffer of f, and only one of the two buffers is allocated.
+ *
+ * This is conservative: g must be a pure, single-valued Func of the
+ * same type and bounds as f, realized at the same loop level, with no
+ * split tail strategy that computes some points of g twice
+ * (i.e. ShiftInwards, unless the split divides the extent). */
+Stmt realize_in_place(Stmt s, const std::map<std::string, Function> &env, const Target &t);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
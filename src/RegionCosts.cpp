@@ -432,6 +432,15 @@ Cost RegionCosts::region_cost(const map<string, Box> &regions, const set<string>
 map<string, Expr>
 RegionCosts::stage_detailed_load_costs(string func, int stage,
                                        const set<string> &inlines) {
+    StageQuery query(func, stage, inlines);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        const auto &iter = stage_load_costs_cache.find(query);
+        if (iter != stage_load_costs_cache.end()) {
+            return iter->second;
+        }
+    }
+
     map<string, Expr> load_costs;
     Function curr_f = get_element(env, func);
 
@@ -458,6 +467,8 @@ RegionCosts::stage_detailed_load_costs(string func, int stage,
         }
     }
 
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    stage_load_costs_cache.emplace(query, load_costs);
     return load_costs;
 }
 
@@ -558,6 +569,15 @@ Cost RegionCosts::get_func_stage_cost(const Function &f, int stage, const set<st
         return Cost();
     }
 
+    StageQuery query(f.name(), stage, inlines);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        const auto &iter = stage_cost_cache.find(query);
+        if (iter != stage_cost_cache.end()) {
+            return iter->second;
+        }
+    }
+
     Definition def = get_stage_definition(f, stage);
 
     Cost cost(0, 0);
@@ -589,6 +609,9 @@ Cost RegionCosts::get_func_stage_cost(const Function &f, int stage, const set<st
     }
 
     cost.simplify();
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    stage_cost_cache.emplace(query, cost);
     return cost;
 }
 
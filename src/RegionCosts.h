@@ -8,7 +8,9 @@
  */
 
 #include <limits>
+#include <mutex>
 #include <set>
+#include <tuple>
 
 #include "AutoScheduleUtils.h"
 #include "Interval.h"
@@ -132,6 +134,18 @@ struct RegionCosts {
     /** Construct a region cost object for the pipeline. 'env' is a map of all
      * functions in the pipeline.*/
     RegionCosts(const std::map<std::string, Function> &env);
+
+private:
+    typedef std::tuple<std::string, int, std::set<std::string>> StageQuery;
+
+    /** Memo tables of the per-value costs of function stages with some
+     * functions inlined. The auto scheduler queries them over and over while
+     * grouping, from several threads, so they are guarded by 'cache_mutex'. */
+    // @{
+    std::map<StageQuery, Cost> stage_cost_cache;
+    std::map<StageQuery, std::map<std::string, Expr>> stage_load_costs_cache;
+    std::mutex cache_mutex;
+    // @}
 };
 
 /** Return true if the cost of inlining a function is equivalent to the
@@ -213,11 +213,22 @@ struct FuncScheduleContents {
     std::vector<Bound> estimates;
     std::map<std::string, Internal::FunctionPtr> wrappers;
     bool memoized;
+    int memoize_eviction_cost;
     MemoryType memory_type;
+    bool nontemporal;
+    bool dma;
+    bool async;
+    bool widen_float16_math;
+    bool gpu_persistent;
+    std::string distributed;
+    std::string persist_var;
+    int persist_frames;
 
     FuncScheduleContents() :
         store_level(LoopLevel::inlined()), compute_level(LoopLevel::inlined()),
-        memoized(false), memory_type(MemoryType::Auto) {};
+        memoized(false), memoize_eviction_cost(1), memory_type(MemoryType::Auto),
+        nontemporal(false), dma(false), async(false), widen_float16_math(false),
+        gpu_persistent(false), persist_frames(0) {};
 
     // Pass an IRMutator2 through to all Exprs referenced in the FuncScheduleContents
     void mutate(IRMutator2 *mutator) {
@@ -276,9 +287,10 @@ struct StageScheduleContents {
     std::vector<FusedPair> fused_pairs;
     bool touched;
     bool allow_race_conditions;
+    bool atomic;
 
     StageScheduleContents() : fuse_level(FuseLoopLevel()), touched(false),
-                              allow_race_conditions(false) {};
+                              allow_race_conditions(false), atomic(false) {};
 
     // Pass an IRMutator2 through to all Exprs referenced in the StageScheduleContents
     void mutate(IRMutator2 *mutator) {
@@ -327,7 +339,16 @@ FuncSchedule FuncSchedule::deep_copy(
     copy.contents->bounds = contents->bounds;
     copy.contents->estimates = contents->estimates;
     copy.contents->memoized = contents->memoized;
+    copy.contents->memoize_eviction_cost = contents->memoize_eviction_cost;
     copy.contents->memory_type = contents->memory_type;
+    copy.contents->nontemporal = contents->nontemporal;
+    copy.contents->dma = contents->dma;
+    copy.contents->async = contents->async;
+    copy.contents->widen_float16_math = contents->widen_float16_math;
+    copy.contents->gpu_persistent = contents->gpu_persistent;
+    copy.contents->distributed = contents->distributed;
+    copy.contents->persist_var = contents->persist_var;
+    copy.contents->persist_frames = contents->persist_frames;
 
     // Deep-copy wrapper functions.
     for (const auto &iter : contents->wrappers) {
@@ -347,6 +368,78 @@ bool FuncSchedule::memoized() const {
     return contents->memoized;
 }
 
+int &FuncSchedule::memoize_eviction_cost() {
+    return contents->memoize_eviction_cost;
+}
+
+int FuncSchedule::memoize_eviction_cost() const {
+    return contents->memoize_eviction_cost;
+}
+
+bool &FuncSchedule::async() {
+    return contents->async;
+}
+
+bool FuncSchedule::async() const {
+    return contents->async;
+}
+
+bool &FuncSchedule::nontemporal() {
+    return contents->nontemporal;
+}
+
+bool FuncSchedule::nontemporal() const {
+    return contents->nontemporal;
+}
+
+bool &FuncSchedule::dma() {
+    return contents->dma;
+}
+
+bool FuncSchedule::dma() const {
+    return contents->dma;
+}
+
+bool &FuncSchedule::widen_float16_math() {
+    return contents->widen_float16_math;
+}
+
+bool FuncSchedule::widen_float16_math() const {
+    return contents->widen_float16_math;
+}
+
+bool &FuncSchedule::gpu_persistent() {
+    return contents->gpu_persistent;
+}
+
+bool FuncSchedule::gpu_persistent() const {
+    return contents->gpu_persistent;
+}
+
+std::string &FuncSchedule::distributed() {
+    return contents->distributed;
+}
+
+const std::string &FuncSchedule::distributed() const {
+    return contents->distributed;
+}
+
+std::string &FuncSchedule::persist_var() {
+    return contents->persist_var;
+}
+
+const std::string &FuncSchedule::persist_var() const {
+    return contents->persist_var;
+}
+
+int &FuncSchedule::persist_frames() {
+    return contents->persist_frames;
+}
+
+int FuncSchedule::persist_frames() const {
+    return contents->persist_frames;
+}
+
 MemoryType FuncSchedule::memory_type() const {
     return contents->memory_type;
 }
@@ -467,6 +560,7 @@ StageSchedule StageSchedule::get_copy() const {
     copy.contents->fused_pairs = contents->fused_pairs;
     copy.contents->touched = contents->touched;
     copy.contents->allow_race_conditions = contents->allow_race_conditions;
+    copy.contents->atomic = contents->atomic;
     return copy;
 }
 
@@ -534,6 +628,14 @@ bool StageSchedule::allow_race_conditions() const {
     return contents->allow_race_conditions;
 }
 
+bool &StageSchedule::atomic() {
+    return contents->atomic;
+}
+
+bool StageSchedule::atomic() const {
+    return contents->atomic;
+}
+
 void StageSchedule::accept(IRVisitor *visitor) const {
     for (const ReductionVariable &r : rvars()) {
         if (r.min.defined()) {
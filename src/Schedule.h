@@ -67,6 +67,26 @@ enum class TailStrategy {
     Auto
 };
 
+/** Different ways to hand out the iterations of a parallel loop to
+ * the threads. See Func::parallel(VarOrRVar, ParallelPolicy, int). */
+enum class ParallelPolicy {
+    /** The threads claim chunks of iterations one after the other. This
+     * is the default, with chunks of one iteration. Larger chunks
+     * amortize the cost of claiming very small iterations. */
+    Dynamic,
+
+    /** Like Dynamic, but each chunk is a share of the iterations left
+     * (and at least the chunk size), so the chunks shrink towards the
+     * end of the loop. Balances iterations of uneven cost (e.g. of
+     * variable depth reductions) with few claims. */
+    Guided,
+
+    /** Each thread does one contiguous block of about
+     * extent / num_threads iterations. Good for iterations of even
+     * cost. The chunk size is ignored. */
+    Static
+};
+
 /** Different ways to handle the case when the start/end of the loops of stages
  * computed with (fused) are not aligned. */
 enum class LoopAlignStrategy {
@@ -291,6 +311,11 @@ struct Dim {
     enum Type {PureVar = 0, PureRVar, ImpureRVar};
     Type dim_type;
 
+    /** For a parallel loop, how its iterations are handed out to the
+     * threads, and how many at once. A chunk of 0 means 1. */
+    ParallelPolicy parallel_policy;
+    int parallel_chunk;
+
     bool is_pure() const {return (dim_type == PureVar) || (dim_type == PureRVar);}
     bool is_rvar() const {return (dim_type == PureRVar) || (dim_type == ImpureRVar);}
     bool is_parallel() const {
@@ -393,6 +418,67 @@ public:
     bool memoized() const;
     // @}
 
+    /** The relative cost of recomputing a memoized function, passed to
+     * halide_memoization_cache_store. See Func::memoize. */
+    // @{
+    int &memoize_eviction_cost();
+    int memoize_eviction_cost() const;
+    // @}
+
+    /** This flag is set to true if the function should be produced
+     * concurrently with its consumers. See Func::async. */
+    // @{
+    bool &async();
+    bool async() const;
+    // @}
+
+    /** This flag is set to true if stores to this function should
+     * bypass the cache. See Func::store_nontemporal. */
+    // @{
+    bool &nontemporal();
+    bool nontemporal() const;
+    // @}
+
+    /** This flag is set to true if the function is a copy to be made
+     * by the Hexagon DMA runtime. See Func::dma. */
+    // @{
+    bool &dma();
+    bool dma() const;
+    // @}
+
+    /** This flag is set to true if the float16 math of the function
+     * should be computed in float even where the target has native
+     * float16 math. See Func::widen_float16_math. */
+    // @{
+    bool &widen_float16_math();
+    bool widen_float16_math() const;
+    // @}
+
+    /** This flag is set to true if the GPU kernels of the function
+     * may be fused with those of the functions computed before and
+     * after it into a persistent kernel. See Func::gpu_persistent. */
+    // @{
+    bool &gpu_persistent();
+    bool gpu_persistent() const;
+    // @}
+
+    /** The pure var of this function distributed across ranks, or
+     * empty if it isn't distributed. See Func::distribute. */
+    // @{
+    std::string &distributed();
+    const std::string &distributed() const;
+    // @}
+
+    /** The pure var along which the last persist_frames frames of this
+     * function are kept across calls of the pipeline, or empty if they
+     * aren't. See Func::persist. */
+    // @{
+    std::string &persist_var();
+    const std::string &persist_var() const;
+    int &persist_frames();
+    int persist_frames() const;
+    // @}
+
     /** The list and order of dimensions used to store this
      * function. The first dimension in the vector corresponds to the
      * innermost dimension for storage (i.e. which dimension is
@@ -538,6 +624,13 @@ public:
     bool &allow_race_conditions();
     // @}
 
+    /** Should the += updates of this stage be performed with atomic
+     * read-modify-write operations? */
+    // @{
+    bool atomic() const;
+    bool &atomic();
+    // @}
+
     /** Pass an IRVisitor through to all Exprs referenced in the
      * Schedule. */
     void accept(IRVisitor *) const;
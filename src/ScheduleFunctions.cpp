@@ -72,6 +72,30 @@ bool contains_impure_call(const Expr &expr) {
     return is_not_pure.result;
 }
 
+class CallsFunc : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+
+    void visit(const Call *op) {
+        if (op->name == func) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    bool result = false;
+    CallsFunc(const string &f) : func(f) {}
+};
+
+bool expr_calls_func(const Expr &expr, const string &func) {
+    CallsFunc calls(func);
+    expr.accept(&calls);
+    return calls.result;
+}
+
 // Build a loop nest about a provide node using a schedule
 Stmt build_provide_loop_nest_helper(string func_name,
                                     string prefix,
@@ -351,6 +375,55 @@ Stmt build_provide_loop_nest(const map<string, Function> &env,
         debug(3) << "Site " << i << " = " << s << "\n";
     }
 
+    // Atomic updates store atomic_add(e) instead of f(site) + e, so
+    // that codegen can emit a read-modify-write instruction.
+    if (def.schedule().atomic()) {
+        for (size_t i = 0; i < values.size(); i++) {
+            Expr delta;
+            if (const Add *add = values[i].as<Add>()) {
+                for (const Expr &e : {add->a, add->b}) {
+                    const Call *call = e.as<Call>();
+                    if (call == nullptr || call->call_type != Call::Halide ||
+                        call->name != func_name || call->value_index != (int)i ||
+                        call->args.size() != site.size()) {
+                        continue;
+                    }
+                    bool same_site = true;
+                    for (size_t j = 0; j < site.size(); j++) {
+                        same_site = same_site && equal(call->args[j], site[j]);
+                    }
+                    if (same_site) {
+                        delta = e.same_as(add->a) ? add->b : add->a;
+                        break;
+                    }
+                }
+            }
+            user_assert(delta.defined() && !expr_calls_func(delta, func_name))
+                << "Update definition of " << func_name << " is scheduled atomic(),"
+                << " but value " << i << " (" << values[i] << ") is not of the form "
+                << func_name << "(...) += e, where e does not depend on " << func_name << ".\n";
+            values[i] = Call::make(values[i].type(), Call::atomic_add, {delta}, Call::Intrinsic);
+        }
+    }
+
+    // An update vectorized over an RVar without allow_race_conditions()
+    // was let through as a reduction of the lanes (see
+    // is_vectorizable_reduction in Func.cpp). Mark its values, so that
+    // vectorize_loops knows the lanes must be reduced rather than
+    // stored to one place. The mark names the loop.
+    if (!def.schedule().allow_race_conditions() && !def.schedule().atomic()) {
+        for (const Dim &d : def.schedule().dims()) {
+            if (d.is_pure() || d.for_type != ForType::Vectorized) {
+                continue;
+            }
+            Expr loop = StringImm::make(prefix + d.var);
+            for (size_t i = 0; i < values.size(); i++) {
+                values[i] = Call::make(values[i].type(), Call::vectorized_reduction,
+                                       {values[i], loop}, Call::PureIntrinsic);
+            }
+        }
+    }
+
     // Default schedule/values if there is no specialization
     Stmt stmt = build_provide_loop_nest_helper(
         func_name, prefix, start_fuse, dims, site, values,
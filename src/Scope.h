@@ -5,6 +5,7 @@
 #include <map>
 #include <stack>
 #include <string>
+#include <unordered_map>
 #include <utility>
 
 #include "Debug.h"
@@ -89,7 +90,12 @@ public:
 template<typename T = void>
 class Scope {
 private:
-    std::map<std::string, SmallStack<T>> table;
+    // Nearly every pass looks up the names of the Variables it visits,
+    // so this is a hash table rather than a std::map, to hash each name
+    // once instead of comparing it against O(log n) others. Iteration
+    // order is therefore unspecified.
+    typedef std::unordered_map<std::string, SmallStack<T>> Table;
+    Table table;
 
     // Copying a scope object copies a large table full of strings and
     // stacks. Bad idea.
@@ -120,7 +126,7 @@ public:
     template<typename T2 = T,
              typename = typename std::enable_if<!std::is_same<T2, void>::value>::type>
     T2 get(const std::string &name) const {
-        typename std::map<std::string, SmallStack<T>>::const_iterator iter = table.find(name);
+        typename Table::const_iterator iter = table.find(name);
         if (iter == table.end() || iter->second.empty()) {
             if (containing_scope) {
                 return containing_scope->get(name);
@@ -135,7 +141,7 @@ public:
     template<typename T2 = T,
              typename = typename std::enable_if<!std::is_same<T2, void>::value>::type>
     T2 &ref(const std::string &name) {
-        typename std::map<std::string, SmallStack<T>>::iterator iter = table.find(name);
+        typename Table::iterator iter = table.find(name);
         if (iter == table.end() || iter->second.empty()) {
             internal_error << "Name not in Scope: " << name << "\n";
         }
@@ -144,7 +150,7 @@ public:
 
     /** Tests if a name is in scope */
     bool contains(const std::string &name) const {
-        typename std::map<std::string, SmallStack<T>>::const_iterator iter = table.find(name);
+        typename Table::const_iterator iter = table.find(name);
         if (iter == table.end() || iter->second.empty()) {
             if (containing_scope) {
                 return containing_scope->contains(name);
@@ -174,7 +180,7 @@ public:
      * was (or remove it entirely if there was nothing else of the
      * same name in an outer scope) */
     void pop(const std::string &name) {
-        typename std::map<std::string, SmallStack<T>>::iterator iter = table.find(name);
+        typename Table::iterator iter = table.find(name);
         internal_assert(iter != table.end()) << "Name not in Scope: " << name << "\n";
         iter->second.pop();
         if (iter->second.empty()) {
@@ -182,11 +188,12 @@ public:
         }
     }
 
-    /** Iterate through the scope. Does not capture any containing scope. */
+    /** Iterate through the scope, in no particular order. Does not
+     * capture any containing scope. */
     class const_iterator {
-        typename std::map<std::string, SmallStack<T>>::const_iterator iter;
+        typename Table::const_iterator iter;
     public:
-        explicit const_iterator(const typename std::map<std::string, SmallStack<T>>::const_iterator &i) :
+        explicit const_iterator(const typename Table::const_iterator &i) :
             iter(i) {
         }
 
@@ -222,9 +229,9 @@ public:
     }
 
     class iterator {
-        typename std::map<std::string, SmallStack<T>>::iterator iter;
+        typename Table::iterator iter;
     public:
-        explicit iterator(typename std::map<std::string, SmallStack<T>>::iterator i) :
+        explicit iterator(typename Table::iterator i) :
             iter(i) {
         }
 
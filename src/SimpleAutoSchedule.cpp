@@ -1,19 +1,552 @@
 #include "SimpleAutoSchedule.h"
+#include "AutoScheduleUtils.h"
 #include "DerivativeUtils.h"
 #include "FindCalls.h"
+#include "IREquality.h"
+#include "ImageParam.h"
 #include "RealizationOrder.h"
 #include "Simplify.h"
 #include "Substitute.h"
 #include "IRVisitor.h"
 #include "RegionCosts.h"
 #include "AutoSchedule.h"
+#include "Bounds.h"
 
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <numeric>
+#include <sstream>
 
 namespace Halide {
 
 using namespace Internal;
 
+namespace {
+
+// Is this Func one of the adjoints synthesized by propagate_adjoints?
+bool is_adjoint(const std::string &name) {
+    return name.find("_d_def__") != std::string::npos ||
+           ends_with(name, "_d__");
+}
+
+// Choose the CPU tile of a stage with num_points values, given the
+// estimated cost of computing one of them. This is the largest square
+// tile whose working set fits in the share of the last level cache of one
+// core, while leaving at least one tile per core (or a few per core for
+// arithmetic-heavy stages, so that the load can be balanced).
+//
+// If the stage was measured by the profiler, a few tiles per core are
+// left when the measured run kept fewer than most of the cores busy
+// instead, and the tiles are then grown until each takes at least
+// min_grain_us (while leaving one tile per core).
+std::pair<int, int> choose_tile_size(const Cost &cost,
+                                     int64_t num_points,
+                                     const MachineParams &params,
+                                     const MeasuredCost *measured,
+                                     double min_grain_us) {
+    const int64_t *arith = cost.defined() ? as_const_int(cost.arith) : nullptr;
+    const int64_t *memory = cost.defined() ? as_const_int(cost.memory) : nullptr;
+    const int64_t *parallelism = as_const_int(params.parallelism);
+    const int64_t *cache_size = as_const_int(params.last_level_cache_size);
+    if (parallelism == nullptr || cache_size == nullptr ||
+            (measured == nullptr && (arith == nullptr || memory == nullptr))) {
+        return {16, 16};
+    }
+    int64_t bytes_per_point = memory ? std::max(*memory, int64_t(1)) : 1;
+    int64_t min_tiles;
+    if (measured) {
+        min_tiles = *parallelism * (measured->threads < 0.75 * *parallelism ? 4 : 1);
+    } else {
+        min_tiles = *parallelism * (*arith > *memory ? 4 : 1);
+    }
+    int size = 8;
+    for (int s = 16; s <= 256; s *= 2) {
+        if (s * s * bytes_per_point > *cache_size / *parallelism ||
+                num_points / (s * s) < min_tiles) {
+            break;
+        }
+        size = s;
+    }
+    if (measured && num_points > 0) {
+        double us_per_point = measured->time_ms * 1000 / num_points;
+        while (size < 256 && size * size * us_per_point < min_grain_us &&
+               num_points / (4 * size * size) >= *parallelism) {
+            size *= 2;
+        }
+    }
+    return {size, size};
+}
+
+std::string tail_strategy_source(TailStrategy tail) {
+    switch (tail) {
+    case TailStrategy::RoundUp:
+        return "TailStrategy::RoundUp";
+    case TailStrategy::GuardWithIf:
+        return "TailStrategy::GuardWithIf";
+    case TailStrategy::ShiftInwards:
+        return "TailStrategy::ShiftInwards";
+    default:
+        return "TailStrategy::Auto";
+    }
+}
+
+std::string memory_type_source(MemoryType memory_type) {
+    switch (memory_type) {
+    case MemoryType::Heap:
+        return "MemoryType::Heap";
+    case MemoryType::Stack:
+        return "MemoryType::Stack";
+    case MemoryType::Register:
+        return "MemoryType::Register";
+    case MemoryType::GPUShared:
+        return "MemoryType::GPUShared";
+    case MemoryType::VTCM:
+        return "MemoryType::VTCM";
+    case MemoryType::GPUConstant:
+        return "MemoryType::GPUConstant";
+    default:
+        return "MemoryType::Auto";
+    }
+}
+
+// The C++ source of the directives applied by simple_autoschedule, which
+// applies them again to the same algorithm. It is printed like the
+// schedules generated by AutoSchedule: the Funcs are taken from the
+// pipeline by their index in its topological order before anything was
+// inlined, and the directives applied to a stage in a row are chained.
+class ScheduleSource {
+    std::map<std::string, size_t> topological_order;
+    // The identifiers of the Funcs, Vars and RVars used by the
+    // directives, by name
+    std::map<std::string, std::string> funcs, vars;
+    std::set<std::string> identifiers;
+    std::ostringstream func_decls, var_decls, directives;
+    // The stage the statement being printed schedules, if any
+    std::string stage;
+
+    std::string identifier(const std::string &name) {
+        std::string id = get_sanitized_name(name);
+        std::string unique = id;
+        for (int i = 1; identifiers.count(unique); i++) {
+            unique = id + "_" + std::to_string(i);
+        }
+        identifiers.insert(unique);
+        return unique;
+    }
+
+    void end_statement() {
+        if (!stage.empty()) {
+            directives << ";\n";
+            stage.clear();
+        }
+    }
+
+public:
+    ScheduleSource(const std::vector<std::string> &order) {
+        for (size_t i = 0; i < order.size(); i++) {
+            topological_order[order[i]] = i;
+        }
+    }
+
+    // The identifier of a Func, declared when first used
+    std::string func(const std::string &name) {
+        auto it = funcs.find(name);
+        if (it != funcs.end()) {
+            return it->second;
+        }
+        std::string id = identifier(name);
+        funcs[name] = id;
+        func_decls << "Func " << id << " = pipeline.get_func("
+                   << get_element(topological_order, name) << ");\n";
+        return id;
+    }
+
+    // The identifier of a Var or RVar, declared when first used
+    std::string var(const VarOrRVar &v) {
+        auto it = vars.find(v.name());
+        if (it != vars.end()) {
+            return it->second;
+        }
+        std::string id = identifier(v.name());
+        vars[v.name()] = id;
+        var_decls << (v.is_rvar ? "RVar " : "Var ") << id << "(\"" << v.name() << "\");\n";
+        return id;
+    }
+
+    // Print a directive applied to a stage, given as the source of the stage
+    void print(const std::string &stage_source, const std::string &directive) {
+        if (stage_source != stage) {
+            end_statement();
+            directives << stage_source;
+            stage = stage_source;
+        }
+        directives << "\n    ." << directive;
+    }
+
+    // Print the declaration of the Func made by rfactor() on a stage
+    void print_rfactor(const std::string &stage_source, const std::string &name,
+                       const std::string &preserved) {
+        end_statement();
+        // Each rfactor() of a Func makes a Func of the same name
+        std::string id = identifier(name);
+        funcs[name] = id;
+        directives << "Func " << id << " = " << stage_source << ".rfactor(" << preserved << ");\n";
+    }
+
+    std::string str() {
+        end_statement();
+        std::ostringstream stream;
+        stream << "// Delete this line if not using Generator\n";
+        stream << "Pipeline pipeline = get_pipeline();\n\n";
+        stream << var_decls.str() << "\n";
+        stream << func_decls.str() << "\n";
+        stream << directives.str();
+        return stream.str();
+    }
+};
+
+// A stage of a Func scheduled by simple_autoschedule, which applies the
+// directives to the stage and prints them to the source of the schedule.
+class ScheduledStage {
+    Func func;
+    int stage_index;
+    ScheduleSource *source;
+
+    Stage stage() {
+        return stage_index == 0 ? Stage(func) : func.update(stage_index - 1);
+    }
+
+    std::string stage_source() const {
+        std::string f = source->func(func.name());
+        return stage_index == 0 ? f : f + ".update(" + std::to_string(stage_index - 1) + ")";
+    }
+
+    ScheduledStage &print(const std::string &directive) {
+        source->print(stage_source(), directive);
+        return *this;
+    }
+
+    std::string vars(const std::vector<VarOrRVar> &vs) const {
+        std::string s;
+        for (const auto &v : vs) {
+            s += (s.empty() ? "" : ", ") + source->var(v);
+        }
+        return s;
+    }
+
+    static std::string exprs(const std::vector<Expr> &es) {
+        std::ostringstream s;
+        for (size_t i = 0; i < es.size(); i++) {
+            s << (i > 0 ? ", " : "") << es[i];
+        }
+        return s.str();
+    }
+
+    static std::string tail(TailStrategy t) {
+        return t == TailStrategy::Auto ? "" : ", " + tail_strategy_source(t);
+    }
+
+public:
+    ScheduledStage(ScheduleSource &source, const Func &func, int stage_index = 0)
+        : func(func), stage_index(stage_index), source(&source) {}
+
+    // The directives of the Func, on its initial definition
+    ScheduledStage &compute_root() {
+        func.compute_root();
+        return print("compute_root()");
+    }
+    ScheduledStage &compute_at(const Func &f, const VarOrRVar &var, int stage) {
+        func.compute_at(LoopLevel(f, var, stage));
+        return print("compute_at(LoopLevel(" + source->func(f.name()) + ", " +
+                     source->var(var) + ", " + std::to_string(stage) + "))");
+    }
+    ScheduledStage &store_in(MemoryType memory_type) {
+        func.store_in(memory_type);
+        return print("store_in(" + memory_type_source(memory_type) + ")");
+    }
+    ScheduledStage &memoize() {
+        func.memoize();
+        return print("memoize()");
+    }
+    ScheduledStage &gpu_persistent() {
+        func.gpu_persistent();
+        return print("gpu_persistent()");
+    }
+    ScheduledStage &compute_inline() {
+        func.compute_inline();
+        return print("compute_inline()");
+    }
+
+    // The directives of the stage
+    ScheduledStage &compute_with(const Func &f, const VarOrRVar &var) {
+        stage().compute_with(f, var);
+        return print("compute_with(" + source->func(f.name()) + ", " + source->var(var) + ")");
+    }
+    ScheduledStage &split(const VarOrRVar &old, const VarOrRVar &outer, const VarOrRVar &inner,
+                          Expr factor, TailStrategy t = TailStrategy::Auto) {
+        stage().split(old, outer, inner, factor, t);
+        return print("split(" + vars({old, outer, inner}) + ", " + exprs({factor}) + tail(t) + ")");
+    }
+    ScheduledStage &fuse(const VarOrRVar &inner, const VarOrRVar &outer, const VarOrRVar &fused) {
+        stage().fuse(inner, outer, fused);
+        return print("fuse(" + vars({inner, outer, fused}) + ")");
+    }
+    ScheduledStage &tile(const VarOrRVar &x, const VarOrRVar &y,
+                         const VarOrRVar &xo, const VarOrRVar &yo,
+                         const VarOrRVar &xi, const VarOrRVar &yi,
+                         Expr xfactor, Expr yfactor, TailStrategy t = TailStrategy::Auto) {
+        stage().tile(x, y, xo, yo, xi, yi, xfactor, yfactor, t);
+        return print("tile(" + vars({x, y, xo, yo, xi, yi}) + ", " +
+                     exprs({xfactor, yfactor}) + tail(t) + ")");
+    }
+    ScheduledStage &reorder(const std::vector<VarOrRVar> &order) {
+        stage().reorder(order);
+        return print("reorder(" + vars(order) + ")");
+    }
+    template<typename... Args>
+    ScheduledStage &reorder(const VarOrRVar &x, Args&&... args) {
+        return reorder(std::vector<VarOrRVar>{x, args...});
+    }
+    ScheduledStage &parallel(const VarOrRVar &var) {
+        stage().parallel(var);
+        return print("parallel(" + source->var(var) + ")");
+    }
+    ScheduledStage &vectorize(const VarOrRVar &var) {
+        stage().vectorize(var);
+        return print("vectorize(" + source->var(var) + ")");
+    }
+    ScheduledStage &vectorize(const VarOrRVar &var, Expr factor) {
+        stage().vectorize(var, factor);
+        return print("vectorize(" + source->var(var) + ", " + exprs({factor}) + ")");
+    }
+    ScheduledStage &unroll(const VarOrRVar &var) {
+        stage().unroll(var);
+        return print("unroll(" + source->var(var) + ")");
+    }
+    ScheduledStage &gpu_blocks(const VarOrRVar &x) {
+        stage().gpu_blocks(x);
+        return print("gpu_blocks(" + vars({x}) + ")");
+    }
+    ScheduledStage &gpu_blocks(const VarOrRVar &x, const VarOrRVar &y) {
+        stage().gpu_blocks(x, y);
+        return print("gpu_blocks(" + vars({x, y}) + ")");
+    }
+    ScheduledStage &gpu_blocks(const VarOrRVar &x, const VarOrRVar &y, const VarOrRVar &z) {
+        stage().gpu_blocks(x, y, z);
+        return print("gpu_blocks(" + vars({x, y, z}) + ")");
+    }
+    ScheduledStage &gpu_threads(const VarOrRVar &x) {
+        stage().gpu_threads(x);
+        return print("gpu_threads(" + vars({x}) + ")");
+    }
+    ScheduledStage &gpu_threads(const VarOrRVar &x, const VarOrRVar &y) {
+        stage().gpu_threads(x, y);
+        return print("gpu_threads(" + vars({x, y}) + ")");
+    }
+    ScheduledStage &gpu_threads(const VarOrRVar &x, const VarOrRVar &y, const VarOrRVar &z) {
+        stage().gpu_threads(x, y, z);
+        return print("gpu_threads(" + vars({x, y, z}) + ")");
+    }
+    ScheduledStage &gpu_tile(const VarOrRVar &x, const VarOrRVar &bx, const VarOrRVar &tx,
+                             Expr x_size) {
+        stage().gpu_tile(x, bx, tx, x_size);
+        return print("gpu_tile(" + vars({x, bx, tx}) + ", " + exprs({x_size}) + ")");
+    }
+    ScheduledStage &gpu_tile(const VarOrRVar &x, const VarOrRVar &y,
+                             const VarOrRVar &bx, const VarOrRVar &by,
+                             const VarOrRVar &tx, const VarOrRVar &ty,
+                             Expr x_size, Expr y_size) {
+        stage().gpu_tile(x, y, bx, by, tx, ty, x_size, y_size);
+        return print("gpu_tile(" + vars({x, y, bx, by, tx, ty}) + ", " +
+                     exprs({x_size, y_size}) + ")");
+    }
+    ScheduledStage &gpu_tile(const VarOrRVar &x, const VarOrRVar &y, const VarOrRVar &z,
+                             const VarOrRVar &bx, const VarOrRVar &by, const VarOrRVar &bz,
+                             const VarOrRVar &tx, const VarOrRVar &ty, const VarOrRVar &tz,
+                             Expr x_size, Expr y_size, Expr z_size) {
+        stage().gpu_tile(x, y, z, bx, by, bz, tx, ty, tz, x_size, y_size, z_size);
+        return print("gpu_tile(" + vars({x, y, z, bx, by, bz, tx, ty, tz}) + ", " +
+                     exprs({x_size, y_size, z_size}) + ")");
+    }
+    ScheduledStage &gpu_single_thread() {
+        stage().gpu_single_thread();
+        return print("gpu_single_thread()");
+    }
+    ScheduledStage &allow_race_conditions() {
+        stage().allow_race_conditions();
+        return print("allow_race_conditions()");
+    }
+    ScheduledStage &atomic() {
+        stage().atomic();
+        return print("atomic()");
+    }
+    Func rfactor(const std::vector<std::pair<RVar, Var>> &preserved) {
+        Func intm = stage().rfactor(preserved);
+        std::string pairs;
+        for (const auto &p : preserved) {
+            pairs += (pairs.empty() ? "" : ", ") +
+                ("{" + source->var(p.first) + ", " + source->var(p.second) + "}");
+        }
+        source->print_rfactor(stage_source(), intm.name(), "{" + pairs + "}");
+        return intm;
+    }
+};
+
+}  // namespace
+
+// A stage tiled on GPU
+struct GPUTile {
+    // The tiled dimensions and the tile sizes
+    std::string x, y;
+    int width, height;
+    // The innermost block and thread loops
+    Var block, thread;
+};
+
+// The first output of a group of outputs computed in the same loop nest
+struct FusionLeader {
+    Func func;
+    // The outermost loop of the tiles
+    Var loop;
+    // Apply the same tiling to another output
+    std::function<void(Func)> tiling;
+};
+
+// The extents of the region of Func fn read by a definition when its
+// variables range over the given scope, or an empty vector if they are
+// not constant.
+std::vector<int> region_extents(const Definition &def,
+                                const std::string &fn,
+                                const Scope<Interval> &scope) {
+    Box box;
+    for (const auto &e : def.args()) {
+        merge_boxes(box, box_required(e, fn, scope));
+    }
+    for (const auto &e : def.values()) {
+        merge_boxes(box, box_required(e, fn, scope));
+    }
+    std::vector<int> extents;
+    for (const auto &interval : box.bounds) {
+        if (!interval.is_bounded()) {
+            return {};
+        }
+        Expr extent = simplify(interval.max - interval.min + 1);
+        const int64_t *extent_int = as_const_int(extent);
+        if (extent_int == nullptr) {
+            return {};
+        }
+        extents.push_back(*extent_int);
+    }
+    return extents;
+}
+
+// Parallelize a large associative reduction on CPU with rfactor. The RVars
+// are factored out from the outermost one, whole or split when larger than
+// needed, until there are enough partial results to occupy every core, and
+// the innermost RVar is split by the vector width to accumulate vectors of
+// partial results.
+void parallel_rfactor(Func func,
+                      int update_id,
+                      const std::vector<ReductionVariable> &rvars,
+                      const std::vector<int> &extents,
+                      int parallelism,
+                      int vector_width,
+                      ScheduleSource &source) {
+    ScheduledStage update(source, func, update_id + 1);
+    std::vector<std::pair<RVar, Var>> preserved;
+    // The pure Vars of the parallel partial results, from inner to outer
+    std::vector<Var> parallel_vars;
+    int64_t needed = parallelism;
+    // The innermost RVar is kept for vectorization unless it's the only one
+    RVar innermost(rvars[0].var);
+    int innermost_extent = extents[0];
+    int innermost_parallel = rvars.size() > 1 ? 1 : 0;
+    for (int i = (int)rvars.size() - 1; i >= innermost_parallel && needed > 1; i--) {
+        Var v;
+        if (extents[i] <= needed) {
+            preserved.push_back({RVar(rvars[i].var), v});
+            needed = (needed + extents[i] - 1) / extents[i];
+            if (i == 0) {
+                innermost_extent = 1;
+            }
+        } else {
+            int factor = (extents[i] + needed - 1) / needed;
+            RVar ro, ri;
+            update.split(RVar(rvars[i].var), ro, ri, factor);
+            preserved.push_back({ro, v});
+            needed = 1;
+            if (i == 0) {
+                innermost = ri;
+                innermost_extent = factor;
+            }
+        }
+        parallel_vars.insert(parallel_vars.begin(), v);
+    }
+    debug(1) << "[simple_autoschedule] rfactor " << parallel_vars.size() <<
+        " RVars for parallelism\n";
+    Var lane;
+    bool vectorized = innermost_extent >= 2 * vector_width;
+    if (vectorized) {
+        RVar rlo, rli;
+        update.split(innermost, rlo, rli, vector_width);
+        preserved.push_back({rli, lane});
+    }
+    if (preserved.empty()) {
+        return;
+    }
+    Func interm = update.rfactor(preserved);
+
+    // Compute the vectors of partial results innermost and the parallel
+    // ones outermost, in a single fused loop
+    auto is_preserved = [&](const std::string &name) {
+        for (const auto &p : preserved) {
+            if (p.second.name() == name) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto schedule = [&](ScheduledStage stage, const std::vector<VarOrRVar> &inner_loops,
+                        const std::vector<Expr> &args) {
+        std::vector<VarOrRVar> order;
+        if (vectorized) {
+            order.push_back(lane);
+        }
+        order.insert(order.end(), inner_loops.begin(), inner_loops.end());
+        for (const auto &arg : args) {
+            const Variable *var = arg.as<Variable>();
+            if (var != nullptr && !var->reduction_domain.defined() &&
+                    !is_preserved(var->name)) {
+                order.push_back(Var(var->name));
+            }
+        }
+        order.insert(order.end(), parallel_vars.begin(), parallel_vars.end());
+        stage.reorder(order);
+        if (!parallel_vars.empty()) {
+            Var fused = parallel_vars[0];
+            for (int i = 1; i < (int)parallel_vars.size(); i++) {
+                stage.fuse(fused, parallel_vars[i], fused);
+            }
+            stage.parallel(fused);
+        }
+        if (vectorized) {
+            stage.vectorize(lane);
+        }
+    };
+    std::vector<Expr> pure_args;
+    for (const auto &arg : interm.args()) {
+        pure_args.push_back(arg);
+    }
+    ScheduledStage(source, interm).compute_root();
+    schedule(ScheduledStage(source, interm), {}, pure_args);
+    std::vector<VarOrRVar> rvar_loops;
+    for (const auto &rv : interm.update().get_schedule().rvars()) {
+        rvar_loops.push_back(RVar(rv.var));
+    }
+    schedule(ScheduledStage(source, interm, 1), rvar_loops, interm.update_args());
+}
+
 template <typename T>
 std::vector<int> sort_indices(const std::vector<T> &v) {
     std::vector<int> idx(v.size());
@@ -23,10 +556,29 @@ std::vector<int> sort_indices(const std::vector<T> &v) {
     return idx;
 }
 
-void simple_autoschedule(std::vector<Func> &outputs,
-                         const std::map<std::string, int> &parameters,
-                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
-                         const SimpleAutoscheduleOptions &options) {
+std::map<std::string, MeasuredCost> load_profile(const std::string &filename) {
+    std::ifstream file(filename);
+    user_assert(file) << "[load_profile] Can't open " << filename << "\n";
+    std::map<std::string, MeasuredCost> profile;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string pipeline, func;
+        MeasuredCost cost;
+        if (fields >> pipeline >> func >> cost.time_ms >> cost.threads) {
+            profile[func] = cost;
+        }
+    }
+    return profile;
+}
+
+std::string simple_autoschedule(std::vector<Func> &outputs,
+                                const std::map<std::string, int> &parameters,
+                                const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                                const SimpleAutoscheduleOptions &options) {
     user_assert(outputs.size() == output_bounds.size()) <<
         "[simple_autoschedule] outputs size and output_bounds size don't match \n";
     for (int i = 0; i < (int)output_bounds.size(); i++) {
@@ -50,6 +602,48 @@ void simple_autoschedule(std::vector<Func> &outputs,
     }
     // Compute the topological order
     std::vector<std::string> top_order = topological_order(output_functions, env);
+    // The Funcs and the hash of the algorithm, before any of its Funcs
+    // are inlined
+    const std::map<std::string, Function> top_env = env;
+    std::string hash = algorithm_hash(output_functions);
+    // The hash of the rest of what the schedule depends on: the estimates
+    // and the arguments of the autoscheduler
+    std::string inputs_hash;
+    {
+        std::ostringstream inputs;
+        for (const auto &p : parameters) {
+            inputs << "parameter " << p.first << " " << p.second << "\n";
+        }
+        for (const auto &bounds : output_bounds) {
+            inputs << "output bounds";
+            for (const auto &b : bounds) {
+                inputs << " [" << b.first << ", " << b.second << "]";
+            }
+            inputs << "\n";
+        }
+        inputs << "options " << options.gpu << " "
+               << options.cpu_tile_width << " " << options.cpu_tile_height << " "
+               << options.cpu_vectorize_width << " "
+               << options.gpu_tile_width << " " << options.gpu_tile_height << " "
+               << options.gpu_tile_channel << " "
+               << options.gpu_shared_memory_size << " " << options.gpu_register_size << " "
+               << options.gpu_persistent_kernels << " " << options.unroll_rvar_size << " "
+               << options.cpu_cache_size << " " << options.max_inline_expr_size << " "
+               << std::setprecision(17) << options.cpu_min_grain_us << "\n";
+        for (const auto &m : options.profile) {
+            inputs << "profile " << m.first << " " << m.second.time_ms << " " << m.second.threads << "\n";
+        }
+        inputs_hash = schedule_inputs_hash(output_functions, inputs.str());
+    }
+    // The directives are applied through these, which print them to the
+    // source of the schedule
+    ScheduleSource source(top_order);
+    auto scheduled = [&](const Func &f) {
+        return ScheduledStage(source, f);
+    };
+    auto scheduled_update = [&](const Func &f, int update_id) {
+        return ScheduledStage(source, f, update_id + 1);
+    };
     // Run a pre-pass that inline all trivial Funcs (i.e. the cost of
     // computing a Func <= calling that Func).
     // XXX: Note that the cost is estimated using heuristics based on CPU statistics
@@ -64,8 +658,12 @@ void simple_autoschedule(std::vector<Func> &outputs,
     }
     std::vector<std::string> order =
         realization_order(output_functions, env).first;
-    // Repeatedly inline the functions that are only used by another function
-    while (inline_all_element_wise_functions(output_functions, order, env)) {
+    // Repeatedly inline the functions that are only used by another function,
+    // as long as their consumers don't get too large to simplify and compile
+    std::set<std::string> over_budget;
+    while (inline_all_element_wise_functions(output_functions, order, env,
+                                             options.max_inline_expr_size,
+                                             &over_budget)) {
         // Recompute env map since some functions are inlined.
         env.clear();
         for (Function f : output_functions) {
@@ -97,6 +695,63 @@ void simple_autoschedule(std::vector<Func> &outputs,
         debug(1) << *it << "\n";
     }
 
+    // The Funcs calling each Func
+    std::map<std::string, std::set<std::string>> callers;
+    for (const auto &it : env) {
+        for (const auto &callee : find_direct_calls(it.second)) {
+            if (callee.first != it.first) {
+                callers[callee.first].insert(it.first);
+            }
+        }
+    }
+    // Estimated per-value costs of each stage, used to size the CPU tiles
+    RegionCosts costs(env);
+    const Target &target = options.target;
+    // The outer loop over the tiles of the stages tiled on CPU,
+    // keyed by Func name and stage index
+    std::map<std::pair<std::string, int>, Var> tile_loops;
+    // The stages tiled on GPU, keyed by Func name and stage index
+    std::map<std::pair<std::string, int>, GPUTile> gpu_tiles;
+
+    // Group the sibling outputs that can be computed in the same loop nest
+    // on CPU (e.g. the gradients of several inputs of the same shape): the
+    // pure outputs with the same arguments and bounds that don't depend on
+    // each other. The first of each group to be scheduled leads it.
+    std::map<std::string, int> fusion_group;
+    std::map<int, FusionLeader> fusion_leaders;
+    if (!options.gpu) {
+        std::vector<std::vector<int>> groups;
+        for (int i = 0; i < (int)output_functions.size(); i++) {
+            const Function &f = output_functions[i];
+            if (f.has_extern_definition() || !f.updates().empty() ||
+                    fusion_group.find(f.name()) != fusion_group.end()) {
+                continue;
+            }
+            std::map<std::string, Function> f_calls = find_transitive_calls(f);
+            bool grouped = false;
+            for (int group_id = 0; group_id < (int)groups.size() && !grouped; group_id++) {
+                bool fusable = true;
+                for (int j : groups[group_id]) {
+                    const Function &g = output_functions[j];
+                    fusable = fusable &&
+                        g.args() == f.args() &&
+                        output_bounds[j] == output_bounds[i] &&
+                        f_calls.find(g.name()) == f_calls.end() &&
+                        find_transitive_calls(g).count(f.name()) == 0;
+                }
+                if (fusable) {
+                    groups[group_id].push_back(i);
+                    fusion_group[f.name()] = group_id;
+                    grouped = true;
+                }
+            }
+            if (!grouped) {
+                fusion_group[f.name()] = (int)groups.size();
+                groups.push_back({i});
+            }
+        }
+    }
+
     // Traverse from the consumers to the producers
     for (auto it = order.rbegin(); it != order.rend(); it++) {
         Func func(env[*it]);
@@ -135,24 +790,214 @@ void simple_autoschedule(std::vector<Func> &outputs,
         }
         debug(1) << "[simple_autoschedule] largest_dim:" << largest_dim << "\n";
 
-        if (output_set.find(func.name()) == output_set.end()) {
-            // Always memoize the function if it's not output
-            func.memoize();
+        // If this Func is only read by a single stage of another Func, find them
+        Function consumer;
+        int consumer_stage = -1;
+        if (output_set.find(func.name()) == output_set.end() &&
+                func.num_update_definitions() == 0 &&
+                !func.function().has_extern_definition() &&
+                callers[func.name()].size() == 1) {
+            consumer = env[*callers[func.name()].begin()];
+            std::vector<int> stages;
+            for (int stage = 0; stage <= (int)consumer.updates().size(); stage++) {
+                const Definition &def =
+                    stage == 0 ? consumer.definition() : consumer.updates()[stage - 1];
+                bool calls = false;
+                for (const auto &e : def.args()) {
+                    calls = calls || is_calling_function(func.name(), e, {});
+                }
+                for (const auto &e : def.values()) {
+                    calls = calls || is_calling_function(func.name(), e, {});
+                }
+                if (calls) {
+                    stages.push_back(stage);
+                }
+            }
+            if (stages.size() == 1) {
+                consumer_stage = stages[0];
+            }
+        }
+        int value_bytes = 0;
+        for (const auto &type : func.output_types()) {
+            value_bytes += type.bytes();
         }
 
-        func.compute_root();
+        // Forward values read by a single tiled stage of an adjoint are
+        // computed at its tiles if they don't fit in the cache. This keeps
+        // the working set of the backward pass in cache and avoids the
+        // root allocation, at the cost of recomputing the tile borders.
+        if (!options.gpu && consumer_stage != -1 &&
+                !is_adjoint(func.name()) && is_adjoint(consumer.name())) {
+            int64_t footprint = value_bytes;
+            for (int extent : int_bounds) {
+                footprint *= extent;
+            }
+            auto tile_loop = tile_loops.find({consumer.name(), consumer_stage});
+            if (tile_loop != tile_loops.end() && footprint > options.cpu_cache_size) {
+                debug(1) << "[simple_autoschedule] compute at the tiles of " <<
+                    consumer.name() << " stage " << consumer_stage << "\n";
+                scheduled(func).compute_at(Func(consumer), tile_loop->second, consumer_stage);
+                if (int_bounds.size() > 0 && int_bounds[0] >= 8) {
+                    scheduled(func).vectorize(func.args()[0], 8);
+                }
+                continue;
+            }
+        }
+
+        // The element-wise producers too large to inline are computed at
+        // the tiles of their consumer, where their values are still in cache.
+        if (!options.gpu && consumer_stage != -1 && over_budget.count(func.name())) {
+            auto tile_loop = tile_loops.find({consumer.name(), consumer_stage});
+            if (tile_loop != tile_loops.end()) {
+                debug(1) << "[simple_autoschedule] over the inline budget, compute at the tiles of " <<
+                    consumer.name() << " stage " << consumer_stage << "\n";
+                scheduled(func).compute_at(Func(consumer), tile_loop->second, consumer_stage);
+                if (int_bounds.size() > 0 && int_bounds[0] >= 8) {
+                    scheduled(func).vectorize(func.args()[0], 8);
+                }
+                continue;
+            }
+        }
+
+        // On GPU, the values read by a stencil or a reduction are staged
+        // closer to the threads consuming them: in shared memory when the
+        // threads of a block read overlapping regions, otherwise in the
+        // registers of each thread when the regions are small.
+        if (options.gpu && consumer_stage != -1) {
+            auto tile = gpu_tiles.find({consumer.name(), consumer_stage});
+            if (tile != gpu_tiles.end()) {
+                const Definition &def = consumer_stage == 0 ?
+                    consumer.definition() : consumer.updates()[consumer_stage - 1];
+                // The region of this Func read by one thread and by one block
+                Scope<Interval> thread_scope, block_scope;
+                for (const auto &rv : def.schedule().rvars()) {
+                    Interval interval(rv.min, simplify(rv.min + rv.extent - 1));
+                    thread_scope.push(rv.var, interval);
+                    block_scope.push(rv.var, interval);
+                }
+                for (const auto &arg : consumer.args()) {
+                    Expr var = Variable::make(Int(32), arg);
+                    thread_scope.push(arg, Interval::single_point(var));
+                    if (arg == tile->second.x) {
+                        block_scope.push(arg, Interval(var, var + tile->second.width - 1));
+                    } else if (arg == tile->second.y) {
+                        block_scope.push(arg, Interval(var, var + tile->second.height - 1));
+                    } else {
+                        block_scope.push(arg, Interval::single_point(var));
+                    }
+                }
+                std::vector<int> thread_region = region_extents(def, func.name(), thread_scope);
+                std::vector<int> block_region = region_extents(def, func.name(), block_scope);
+                int64_t thread_size = 1, block_size = 1;
+                for (int extent : thread_region) {
+                    thread_size *= extent;
+                }
+                for (int extent : block_region) {
+                    block_size *= extent;
+                }
+                int64_t num_threads = tile->second.width * tile->second.height;
+                int64_t block_threads = 1;
+                for (int i = 0; i < std::min((int)block_region.size(), 2); i++) {
+                    block_threads *= block_region[i];
+                }
+                if (!thread_region.empty() && !block_region.empty() && thread_size > 1) {
+                    if (block_size < thread_size * num_threads &&
+                            block_size * value_bytes <= options.gpu_shared_memory_size &&
+                            block_threads <= 1024) {
+                        debug(1) << "[simple_autoschedule] stage in shared memory of " <<
+                            consumer.name() << " stage " << consumer_stage << "\n";
+                        scheduled(func).compute_at(Func(consumer), tile->second.block, consumer_stage)
+                            .store_in(MemoryType::GPUShared);
+                        if (func.args().size() >= 2) {
+                            scheduled(func).gpu_threads(func.args()[0], func.args()[1]);
+                        } else if (func.args().size() == 1) {
+                            scheduled(func).gpu_threads(func.args()[0]);
+                        }
+                        continue;
+                    } else if (thread_size * value_bytes <= options.gpu_register_size) {
+                        debug(1) << "[simple_autoschedule] stage in registers of " <<
+                            consumer.name() << " stage " << consumer_stage << "\n";
+                        scheduled(func).compute_at(Func(consumer), tile->second.thread, consumer_stage);
+                        for (int i = 0; i < (int)func.args().size(); i++) {
+                            scheduled(func).unroll(func.args()[i]);
+                        }
+                        continue;
+                    }
+                }
+            }
+        }
+
+        bool persistent = options.gpu && options.gpu_persistent_kernels;
+        if (output_set.find(func.name()) == output_set.end() && !persistent) {
+            // Always memoize the function if it's not output, unless its
+            // kernels are fused, which a cache lookup would prevent
+            scheduled(func).memoize();
+        }
+
+        scheduled(func).compute_root();
+        if (persistent) {
+            scheduled(func).gpu_persistent();
+        }
+        // Compute the outputs in the loop nest of their group's leader
+        auto group = fusion_group.find(func.name());
+        if (group != fusion_group.end()) {
+            auto leader = fusion_leaders.find(group->second);
+            if (leader != fusion_leaders.end()) {
+                debug(1) << "[simple_autoschedule] compute with " <<
+                    leader->second.func.name() << "\n";
+                leader->second.tiling(func);
+                scheduled(func).compute_with(leader->second.func, leader->second.loop);
+                continue;
+            }
+        }
         // Initial definition is easy: everything is pure variables.
         // Just parallelize and vectorize if there are enough entries to launch threads.
         debug(1) << "[simple_autoschedule] scheduling initial definition" << "\n";
-        int tile_width =
-            options.gpu ? options.gpu_tile_width : options.cpu_tile_width;
-        int tile_height =
-            options.gpu ? options.gpu_tile_height : options.cpu_tile_height;
+        int tile_width = 0;
+        int tile_height = 0;
+        int vectorize_width = 0;
+        // Pick the tile sizes and the vector width of one stage with
+        // num_points values, unless given in the options
+        auto choose_tiling = [&](int stage, int64_t num_points) {
+            if (options.gpu) {
+                tile_width = options.gpu_tile_width;
+                tile_height = options.gpu_tile_height;
+                return;
+            }
+            if (options.cpu_tile_width > 0 && options.cpu_tile_height > 0) {
+                tile_width = options.cpu_tile_width;
+                tile_height = options.cpu_tile_height;
+            } else {
+                auto measured = options.profile.find(func.name());
+                std::pair<int, int> tile = choose_tile_size(
+                    costs.func_cost[func.name()][stage], num_points, options.machine_params,
+                    measured != options.profile.end() ? &measured->second : nullptr,
+                    options.cpu_min_grain_us);
+                tile_width = tile.first;
+                tile_height = tile.second;
+            }
+            if (options.cpu_vectorize_width > 0) {
+                vectorize_width = options.cpu_vectorize_width;
+            } else {
+                vectorize_width = std::min(
+                    target.natural_vector_size(func.output_types()[0]), tile_width);
+            }
+            debug(1) << "[simple_autoschedule] stage " << stage << " tile:" <<
+                tile_width << "x" << tile_height << ", vector width:" << vectorize_width << "\n";
+        };
+        const int64_t *machine_parallelism = as_const_int(options.machine_params.parallelism);
+        int parallelism = machine_parallelism != nullptr ? *machine_parallelism : 16;
+        int64_t num_points = 1;
+        for (int extent : int_bounds) {
+            num_points *= extent;
+        }
+        choose_tiling(0, num_points);
+        // The tiling of the initial definition on CPU
+        std::function<void(Func)> pure_tiling;
         int tile_channel = options.gpu_tile_channel;
         int min_gpu_threads = 1;
         int min_cpu_threads = 8;
         int min_threads = options.gpu ? min_gpu_threads : min_cpu_threads;
-        int vectorize_width = 8;
         bool tilable = false;
         // If there's enough tiles
         if ((int)int_bounds.size() >= 2 &&
@@ -185,7 +1030,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                                 fused_var = func.args()[i];
                                 first = false;
                             } else {
-                                func.fuse(fused_var, func.args()[i], fused_var);
+                                scheduled(func).fuse(fused_var, func.args()[i], fused_var);
                             }
                         }
                     } else {
@@ -196,22 +1041,30 @@ void simple_autoschedule(std::vector<Func> &outputs,
                     has_extra_dimensions << "\n";
                 if (!has_extra_dimensions) {
                     // No fused_vars
-                    func.reorder(func.args()[dim_width], func.args()[dim_height])
+                    scheduled(func).reorder(func.args()[dim_width], func.args()[dim_height])
                         .gpu_tile(func.args()[dim_width], func.args()[dim_height],
                             xo, yo, xi, yi, tile_width, tile_height);
+                    gpu_tiles[{func.name(), 0}] =
+                        GPUTile{func.args()[dim_width].name(), func.args()[dim_height].name(),
+                                tile_width, tile_height, xo, xi};
                 } else {
-                    func.reorder(func.args()[dim_width], func.args()[dim_height], fused_var)
+                    scheduled(func).reorder(func.args()[dim_width], func.args()[dim_height], fused_var)
                         .gpu_tile(func.args()[dim_width], func.args()[dim_height], fused_var,
                             xo, yo, zo, xi, yi, zi, tile_width, tile_height, tile_channel);
                 }
             } else {
                 // CPU
                 Var tile_index;
-                func.tile(func.args()[dim_width], func.args()[dim_height],
-                        xo, yo, xi, yi, tile_width, tile_height)
-                    .fuse(xo, yo, tile_index)
-                    .parallel(tile_index)
-                    .vectorize(xi, vectorize_width);
+                int width = tile_width, height = tile_height, vector_width = vectorize_width;
+                pure_tiling = [=](Func f) {
+                    scheduled(f).tile(f.args()[dim_width], f.args()[dim_height],
+                           xo, yo, xi, yi, width, height)
+                     .fuse(xo, yo, tile_index)
+                     .parallel(tile_index)
+                     .vectorize(xi, vector_width);
+                };
+                pure_tiling(func);
+                tile_loops[{func.name(), 0}] = tile_index;
             }
             tilable = true;
         } else if ((int)int_bounds.size() >= 1 &&
@@ -243,7 +1096,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                                 fused_var = func.args()[i];
                                 first = false;
                             } else {
-                                func.fuse(fused_var, func.args()[i], fused_var);
+                                scheduled(func).fuse(fused_var, func.args()[i], fused_var);
                             }
                         }
                     } else {
@@ -254,19 +1107,23 @@ void simple_autoschedule(std::vector<Func> &outputs,
                     has_extra_dimensions << "\n";
                 if (!has_extra_dimensions) {
                     // No fused_vars
-                    func.gpu_tile(func.args()[largest_dim],
+                    scheduled(func).gpu_tile(func.args()[largest_dim],
                         xo, xi, tile_width * tile_height);
                 } else {
-                    func.reorder(func.args()[largest_dim], fused_var)
+                    scheduled(func).reorder(func.args()[largest_dim], fused_var)
                         .gpu_tile(func.args()[largest_dim], fused_var,
                             xo, yo, xi, yi, tile_width * tile_height, tile_channel);
                 }
             } else {
                 // CPU
-                func.split(func.args()[largest_dim],
-                           xo, xi, tile_width * tile_height)
-                    .parallel(xo)
-                    .vectorize(xi, vectorize_width);
+                int size = tile_width * tile_height, vector_width = vectorize_width;
+                pure_tiling = [=](Func f) {
+                    scheduled(f).split(f.args()[largest_dim], xo, xi, size)
+                     .parallel(xo)
+                     .vectorize(xi, vector_width);
+                };
+                pure_tiling(func);
+                tile_loops[{func.name(), 0}] = xo;
             }
             tilable = true;
         } else if (options.gpu) {
@@ -274,22 +1131,26 @@ void simple_autoschedule(std::vector<Func> &outputs,
             // Even if there's not enough parallelism it's still a good idea to launch
             // gpu tiles to avoid memory copy
             if (func.args().size() == 0) {
-                func.gpu_single_thread();
+                scheduled(func).gpu_single_thread();
             } else {
                 // Fuse variables
                 Var fused_var = func.args()[0];
                 int var_size = int_bounds[0];
                 for (int i = 1; i < (int)func.args().size(); i++) {
-                    func.fuse(fused_var, func.args()[i], fused_var);
+                    scheduled(func).fuse(fused_var, func.args()[i], fused_var);
                     var_size *= int_bounds[i];
                 }
                 // Launch GPU threads
                 Var block, thread;
-                func.gpu_tile(fused_var, block, thread, std::min(var_size, 32));
+                scheduled(func).gpu_tile(fused_var, block, thread, std::min(var_size, 32));
             }
         } else {
             debug(1) << "[simple_autoschedule] Not enough parallelism, serialize on CPU.\n";
         }
+        if (group != fusion_group.end() && pure_tiling) {
+            fusion_leaders[group->second] =
+                FusionLeader{func, tile_loops[{func.name(), 0}], pure_tiling};
+        }
 
         // Scheduling the updates
         for (int update_id = 0;
@@ -297,13 +1158,34 @@ void simple_autoschedule(std::vector<Func> &outputs,
             std::vector<ReductionVariable> rvars =
                 func.update(update_id).get_schedule().rvars();
             debug(1) << "[simple_autoschedule] Scheduling update " << update_id << ".\n";
+            // The number of values computed by the update
+            int64_t update_points = 1;
+            for (const auto &rvar : rvars) {
+                Expr extent = rvar.extent;
+                for (const auto &param : parameters) {
+                    extent = substitute(param.first, Expr(param.second), extent);
+                }
+                extent = simplify(extent);
+                const int64_t *extent_int = as_const_int(extent);
+                if (extent_int != nullptr) {
+                    update_points *= *extent_int;
+                }
+            }
+            const std::vector<Expr> &update_lhs = func.update_args(update_id);
+            for (int arg_id = 0; arg_id < (int)update_lhs.size(); arg_id++) {
+                const Variable *var = update_lhs[arg_id].as<Variable>();
+                if (var != nullptr && !var->reduction_domain.defined()) {
+                    update_points *= int_bounds[arg_id];
+                }
+            }
+            choose_tiling(update_id + 1, update_points);
             // Compute the largest two dimensions of the reduction variables.
             int rdim_width = -1;
             int rdim_height = -1;
             int largest_rdim = -1;
             bool rvar_tilable = false;
+            std::vector<int> rvar_extents;
             if (rvars.size() > 0) {
-                std::vector<int> rvar_extents;
                 rvar_extents.reserve(rvars.size());
                 Expr extent = rvars[0].extent;
                 for (const auto &param : parameters) {
@@ -357,7 +1239,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                     const int64_t *extent_int = as_const_int(extent);
                     if (extent_int != nullptr && *extent_int <= options.unroll_rvar_size) {
                         debug(1) << "[simple_autoschedule] unroll rvars[" << rvar_id << "]\n";
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .unroll(RVar(rvars[rvar_id].var));
                     }
                 }
@@ -366,160 +1248,154 @@ void simple_autoschedule(std::vector<Func> &outputs,
                 largest_rdim != -1;
             debug(1) << "[simple_autoschedule] rvar_tilable:" << rvar_tilable << "\n";
 
+            // Does the left hand side depend on the reduction variables?
+            // (e.g. a histogram h(im(r)) += 1) If so, rfactor is not
+            // applicable.
+            bool is_scatter = false;
+            for (const auto &arg : func.update_args(update_id)) {
+                if (extract_rdom(arg).defined()) {
+                    is_scatter = true;
+                }
+            }
+            // Can the update be performed atomically? It needs to be
+            // f(args) = f(args) + e or f(args) = e + f(args), where e
+            // doesn't read f.
+            auto is_atomic_update = [&]() -> bool {
+                const std::vector<Expr> &update_args = func.update_args(update_id);
+                auto is_self_call = [&](const Expr &e, int value_index) {
+                    const Call *call = e.as<Call>();
+                    if (call == nullptr || call->call_type != Call::Halide ||
+                            call->name != func.name() || call->value_index != value_index ||
+                            call->args.size() != update_args.size()) {
+                        return false;
+                    }
+                    for (int arg_id = 0; arg_id < (int)update_args.size(); arg_id++) {
+                        if (!equal(call->args[arg_id], update_args[arg_id])) {
+                            return false;
+                        }
+                    }
+                    return true;
+                };
+                const std::vector<Expr> values = func.update_values(update_id).as_vector();
+                for (int i = 0; i < (int)values.size(); i++) {
+                    const Add *add = values[i].as<Add>();
+                    if (add == nullptr) {
+                        return false;
+                    }
+                    Expr delta;
+                    if (is_self_call(add->a, i)) {
+                        delta = add->b;
+                    } else if (is_self_call(add->b, i)) {
+                        delta = add->a;
+                    } else {
+                        return false;
+                    }
+                    if (is_calling_function(func.name(), delta, {})) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
             // If the domain of the image is small and the reduction is large,
             // use rfactor
             // TODO: gracefully fallback if factorization is impossible
-            if (!tilable && rvar_tilable) {
+            if (!tilable && rvar_tilable && !is_scatter) {
                 debug(1) << "[simple_autoschedule] Perform parallel reduction\n";
-                if (rdim_width != -1 && rdim_height != -1) {
+                if (!options.gpu) {
+                    parallel_rfactor(func, update_id, rvars, rvar_extents,
+                                     parallelism, vectorize_width, source);
+                } else if (rdim_width != -1 && rdim_height != -1) {
                     debug(1) << "[simple_autoschedule] 2D parallel reduction\n";
-                    // 2D tiling
-                    if (options.gpu) {
-                        // GPU
-                        assert(rdim_width != rdim_height);
-                        RVar rx(rvars[rdim_width].var);
-                        RVar ry(rvars[rdim_height].var);
-                        // Change < 1 to something else for multi-level reduction
-                        for (int level = 0; level < 1; level++) {
-                            RVar rxo, rxi, ryo, ryi;
-                            int size = 32;
-                            func.update(update_id)
-                                .split(rx, rxo, rxi, size)
-                                .split(ry, ryo, ryi, size);
-                            Var xi, xo, yo;
-                            Func interm = func.update(update_id)
-                                              .rfactor({{rxi, xi},
-                                                        {rxo, xo},
-                                                        {ryo, yo}});
-                            std::vector<VarOrRVar> new_order;
-                            new_order.push_back(ryi);
-                            for (const auto &arg : interm.update_args()) {
-                                const Variable *var = arg.as<Variable>();
-                                if (var != nullptr &&
-                                        !var->reduction_domain.defined() &&
-                                        var->name != xi.name() &&
-                                        var->name != xo.name() &&
-                                        var->name != yo.name()) {
-                                    new_order.push_back(Var(var->name));
-                                }
-                            }
-                            new_order.push_back(xi);
-                            new_order.push_back(xo);
-                            new_order.push_back(yo);
-                            Var txo, txi, tyo, tyi;
-                            interm.compute_root()
-                                  .reorder(xi, xo, yo)
-                                  .gpu_blocks(xo, yo)
-                                  .gpu_threads(xi);
-                            interm.update()
-                                  .reorder(new_order)
-                                  .gpu_blocks(xo, yo)
-                                  .gpu_threads(xi);
-                        }
-                    } else {
-                        // CPU
-                        // Parallelize on rxo, ryo, vectorize on rxi
-                        RVar rxo, ryo, rxi, ryi;
-                        func.update(update_id)
-                            .split(RVar(rvars[rdim_width].var), rxo, rxi, tile_width)
-                            .split(RVar(rvars[rdim_height].var), ryo, ryi, tile_height);
-                        Var xo, yo, xi;
-                        Func interm = func.update(update_id)
-                                          .rfactor({{rxo, xo},
-                                                    {ryo, yo},
-                                                    {rxi, xi}});
-                        Var tile_index;
+                    // GPU
+                    assert(rdim_width != rdim_height);
+                    RVar rx(rvars[rdim_width].var);
+                    RVar ry(rvars[rdim_height].var);
+                    // Change < 1 to something else for multi-level reduction
+                    for (int level = 0; level < 1; level++) {
+                        RVar rxo, rxi, ryo, ryi;
+                        int size = 32;
+                        scheduled_update(func, update_id)
+                            .split(rx, rxo, rxi, size)
+                            .split(ry, ryo, ryi, size);
+                        Var xi, xo, yo;
+                        Func interm = scheduled_update(func, update_id)
+                                          .rfactor({{rxi, xi},
+                                                    {rxo, xo},
+                                                    {ryo, yo}});
                         std::vector<VarOrRVar> new_order;
                         new_order.push_back(ryi);
-                        new_order.push_back(xi);
                         for (const auto &arg : interm.update_args()) {
                             const Variable *var = arg.as<Variable>();
-                            if (var != nullptr && !var->reduction_domain.defined() &&
-                                    var->name != xi.name() && var->name != xo.name() &&
+                            if (var != nullptr &&
+                                    !var->reduction_domain.defined() &&
+                                    var->name != xi.name() &&
+                                    var->name != xo.name() &&
                                     var->name != yo.name()) {
                                 new_order.push_back(Var(var->name));
                             }
                         }
-                        new_order.push_back(tile_index);
-                        interm.compute_root()
-                              .fuse(xo, yo, tile_index)
-                              .parallel(tile_index)
-                              .vectorize(xi);
-                        interm.update()
-                              .fuse(xo, yo, tile_index)
+                        new_order.push_back(xi);
+                        new_order.push_back(xo);
+                        new_order.push_back(yo);
+                        Var txo, txi, tyo, tyi;
+                        scheduled(interm).compute_root()
+                              .reorder(xi, xo, yo)
+                              .gpu_blocks(xo, yo)
+                              .gpu_threads(xi);
+                        scheduled_update(interm, 0)
                               .reorder(new_order)
-                              .parallel(tile_index)
-                              .vectorize(xi);
+                              .gpu_blocks(xo, yo)
+                              .gpu_threads(xi);
+                        if (persistent) {
+                            scheduled(interm).gpu_persistent();
+                        }
                     }
                 } else if (largest_rdim != -1) {
                     debug(1) << "[simple_autoschedule] 1D parallel reduction\n";
-                    // 1D tiling
-                    if (options.gpu) {
-                        RVar rx(rvars[largest_rdim].var);
-                        // Change < 1 to something else for multi-level reduction
-                        for (int level = 0; level < 1; level++) {
-                            RVar rxo, rxi, ryo, ryi;
-                            int size = tile_width * tile_height;
-                            func.update(update_id)
-                                .split(rx, rxo, rxi, size)
-                                .split(rxi, ryi, rxi, tile_width);
-                            Var xi, xo;
-                            Func interm = func.update(update_id)
-                                              .rfactor({{rxi, xi},
-                                                        {rxo, xo}});
-                            std::vector<VarOrRVar> new_order;
-                            new_order.push_back(ryi);
-                            for (const auto &arg : interm.update_args()) {
-                                const Variable *var = arg.as<Variable>();
-                                if (var != nullptr &&
-                                        !var->reduction_domain.defined() &&
-                                        var->name != xi.name() &&
-                                        var->name != xo.name()) {
-                                    new_order.push_back(Var(var->name));
-                                }
-                            }
-                            new_order.push_back(xi);
-                            new_order.push_back(xo);
-                            Var txo, txi, tyo, tyi;
-                            interm.compute_root()
-                                  .reorder(xi, xo)
-                                  .gpu_blocks(xo)
-                                  .gpu_threads(xi);
-                            interm.update()
-                                  .reorder(new_order)
-                                  .gpu_blocks(xo)
-                                  .gpu_threads(xi);
-                        }
-                    } else {
-                        // CPU
-                        // Parallel on tiles and vectorize inside tile
-                        RVar rx(rvars[largest_rdim].var);
-                        RVar rxo, rxi, ryi;
-                        int size = tile_width * tile_height;
-                        func.update(update_id)
+                    RVar rx(rvars[largest_rdim].var);
+                    // Reduce in a tree: each level leaves a partial result per
+                    // thread. Add a second level while more blocks are left
+                    // than the threads of a block can reduce.
+                    int size = tile_width * tile_height;
+                    int64_t num_blocks = rvar_extents[largest_rdim];
+                    for (int level = 0; level == 0 || (level < 2 && num_blocks > size); level++) {
+                        RVar rxo, rxi, ryo, ryi;
+                        scheduled_update(func, update_id)
                             .split(rx, rxo, rxi, size)
                             .split(rxi, ryi, rxi, tile_width);
-                        Var xo, yo, xi;
-                        Func interm = func.update(update_id)
-                                          .rfactor({{rxo, xo},
-                                                    {rxi, xi}});
+                        Var xi, xo;
+                        Func interm = scheduled_update(func, update_id)
+                                          .rfactor({{rxi, xi},
+                                                    {rxo, xo}});
                         std::vector<VarOrRVar> new_order;
                         new_order.push_back(ryi);
-                        new_order.push_back(xi);
                         for (const auto &arg : interm.update_args()) {
                             const Variable *var = arg.as<Variable>();
-                            if (var != nullptr && !var->reduction_domain.defined() &&
-                                    var->name != xi.name() && var->name != xo.name()) {
+                            if (var != nullptr &&
+                                    !var->reduction_domain.defined() &&
+                                    var->name != xi.name() &&
+                                    var->name != xo.name()) {
                                 new_order.push_back(Var(var->name));
                             }
                         }
-                        interm.compute_root()
-                              .parallel(xo)
-                              .vectorize(xi);
-                        interm.update()
+                        new_order.push_back(xi);
+                        new_order.push_back(xo);
+                        Var txo, txi, tyo, tyi;
+                        scheduled(interm).compute_root()
+                              .reorder(xi, xo)
+                              .gpu_blocks(xo)
+                              .gpu_threads(xi);
+                        scheduled_update(interm, 0)
                               .reorder(new_order)
-                              .parallel(xo)
-                              .vectorize(xi);
+                              .gpu_blocks(xo)
+                              .gpu_threads(xi);
+                        if (persistent) {
+                            scheduled(interm).gpu_persistent();
+                        }
+                        // The next level reduces over the blocks of this one
+                        num_blocks = (num_blocks + size - 1) / size;
+                        rx = rxo;
                     }
                 }
             }
@@ -576,19 +1452,22 @@ void simple_autoschedule(std::vector<Func> &outputs,
                             fused_var = pure_args[i];
                             first = false;
                         } else {
-                            func.update(update_id)
+                            scheduled_update(func, update_id)
                                 .fuse(fused_var, pure_args[i], fused_var);
                         }
                     }
                     if (first) {
                         // no fused_var
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .reorder(pure_args[pdim_width], pure_args[pdim_height])
                             .gpu_tile(pure_args[pdim_width], pure_args[pdim_height],
                                       xo, yo, xi, yi, tile_width, tile_height);
+                        gpu_tiles[{func.name(), update_id + 1}] =
+                            GPUTile{pure_args[pdim_width].name(), pure_args[pdim_height].name(),
+                                    tile_width, tile_height, xo, xi};
 
                     } else {
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .reorder(pure_args[pdim_width], pure_args[pdim_height], fused_var)
                             .gpu_tile(pure_args[pdim_width], pure_args[pdim_height], fused_var,
                                       xo, yo, zo, xi, yi, zi, tile_width, tile_height, tile_channel);
@@ -596,13 +1475,14 @@ void simple_autoschedule(std::vector<Func> &outputs,
                 } else {
                     // CPU
                     Var tile_index;
-                    func.update(update_id)
+                    scheduled_update(func, update_id)
                         .tile(pure_args[pdim_width], pure_args[pdim_height],
                               xo, yo, xi, yi, tile_width, tile_height,
                               TailStrategy::GuardWithIf)
                         .fuse(xo, yo, tile_index)
                         .parallel(tile_index)
                         .vectorize(xi, vectorize_width);
+                    tile_loops[{func.name(), update_id + 1}] = tile_index;
                 }
             } else if ((int)pure_arg_bounds.size() >= 1 &&
                             pure_arg_bounds[largest_pdim] >= (tile_width * tile_height) &&
@@ -622,18 +1502,18 @@ void simple_autoschedule(std::vector<Func> &outputs,
                             fused_var = pure_args[i];
                             first = false;
                         } else {
-                            func.update(update_id)
+                            scheduled_update(func, update_id)
                                 .fuse(fused_var, pure_args[i], fused_var);
                         }
                     }
                     if (first) {
                         // no fused_var
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .gpu_tile(pure_args[largest_pdim],
                                       xo, xi, tile_width * tile_height);
 
                     } else {
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .reorder(pure_args[largest_pdim], fused_var)
                             .gpu_tile(pure_args[largest_pdim], fused_var,
                                       xo, yo, xi, yi, tile_width * tile_height, tile_channel);
@@ -641,12 +1521,13 @@ void simple_autoschedule(std::vector<Func> &outputs,
                 } else {
                     // CPU
                     Var tile_index;
-                    func.update(update_id)
+                    scheduled_update(func, update_id)
                         .split(pure_args[largest_dim],
                                xo, xi, tile_width * tile_height,
                                TailStrategy::GuardWithIf)
                         .parallel(xo)
                         .vectorize(xi, vectorize_width);
+                    tile_loops[{func.name(), update_id + 1}] = xo;
                 }
             } else if (!options.gpu && pure_args.size() > 0) {
                 debug(1) << "[simple_autoschedule] \n" << 
@@ -654,11 +1535,20 @@ void simple_autoschedule(std::vector<Func> &outputs,
                 // On CPU, merge all pure variables and parallelize them
                 Var fused_var = pure_args[0];
                 for (int i = 1; i < (int)pure_args.size(); i++) {
-                    func.update(update_id)
+                    scheduled_update(func, update_id)
                         .fuse(fused_var, pure_args[i], fused_var);
                 }
-                func.update(update_id)
+                scheduled_update(func, update_id)
                     .parallel(fused_var);
+            } else if (!options.gpu && pure_args.empty() && is_scatter &&
+                    largest_rdim != -1 && is_atomic_update()) {
+                debug(1) << "[simple_autoschedule] Parallelizing scatter" <<
+                    " using atomics on CPU.\n";
+                RVar rxo, rxi;
+                scheduled_update(func, update_id)
+                    .atomic()
+                    .split(RVar(rvars[largest_rdim].var), rxo, rxi, tile_width * tile_height)
+                    .parallel(rxo);
             } else if (options.gpu) {
                 debug(1) << "[simple_autoschedule] Parallelizing reduction" <<
                     " using atomics.\n";
@@ -670,10 +1560,10 @@ void simple_autoschedule(std::vector<Func> &outputs,
                         Var fused_var;
                         fused_var = pure_args[0];
                         for (int i = 1; i < (int)pure_args.size(); i++) {
-                            func.update(update_id)
+                            scheduled_update(func, update_id)
                                 .fuse(fused_var, pure_args[i], fused_var);
                         }
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .allow_race_conditions()
                             .split(RVar(rvars[rdim_width].var), xo, xi, tile_width)
                             .split(RVar(rvars[rdim_height].var), yo, yi, tile_height)
@@ -682,7 +1572,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                             .gpu_blocks(xo, yo, zo)
                             .gpu_threads(xi, yi, zi);
                     } else {
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .allow_race_conditions()
                             .split(RVar(rvars[rdim_width].var), xo, xi, tile_width)
                             .split(RVar(rvars[rdim_height].var), yo, yi, tile_height)
@@ -694,7 +1584,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                     // Even if there's not enough parallelism it's still a good idea to launch
                     // gpu tiles to avoid memory copy
                     if (pure_args.size() == 0) {
-                        func.update(update_id).gpu_single_thread();
+                        scheduled_update(func, update_id).gpu_single_thread();
                     } else {
                         // Fuse variables
                         std::vector<Var> fused_vars;
@@ -702,14 +1592,14 @@ void simple_autoschedule(std::vector<Func> &outputs,
                         int var_size = pure_arg_bounds[0];
                         for (int i = 1; i < (int)pure_args.size(); i++) {
                             Var new_var;
-                            func.update(update_id).fuse(fused_vars.back(), pure_args[i], new_var);
+                            scheduled_update(func, update_id).fuse(fused_vars.back(), pure_args[i], new_var);
                             fused_vars.push_back(new_var);
                             var_size *= pure_arg_bounds[i];
                         }
                         // Launch GPU threads
                         // TODO: don't fuse when var_size is > 128
                         Var block, thread;
-                        func.update(update_id)
+                        scheduled_update(func, update_id)
                             .gpu_tile(fused_vars.back(), block, thread, std::min(var_size, 128));
                     }
                 }
@@ -806,7 +1696,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                         (rvar_arg_bounds[rdim_height] / tile_height) >= min_threads) {
                     RVar xo, yo, xi, yi;
                     RVar tile_index;
-                    func.update(update_id)
+                    scheduled_update(func, update_id)
                         .allow_race_conditions()
                         .tile(rvar_args[rdim_width], rvar_args[rdim_height],
                               xo, yo, xi, yi, tile_width, tile_height)
@@ -817,12 +1707,30 @@ void simple_autoschedule(std::vector<Func> &outputs,
             }
         }
     }
+
+    // The Funcs inlined into their consumers are inlined by default when
+    // the schedule is applied again; say so anyway.
+    for (const auto &name : top_order) {
+        if (env.find(name) == env.end()) {
+            scheduled(Func(top_env.at(name))).compute_inline();
+        }
+    }
+
+    std::ostringstream stream;
+    stream << "// Target: " << target.to_string() << "\n";
+    stream << "// MachineParams: " << options.machine_params.to_string() << "\n";
+    stream << "// Algorithm: " << hash << "\n";
+    stream << "// Inputs: " << inputs_hash << "\n";
+    stream << "\n";
+    stream << source.str();
+    debug(1) << "[simple_autoschedule] schedule:\n" << stream.str() << "\n";
+    return stream.str();
 }
 
-void simple_autoschedule(Func &output,
-                         const std::map<std::string, int> &parameters,
-                         const std::vector<std::pair<int, int>> &output_bounds,
-                         const SimpleAutoscheduleOptions &options) {
+std::string simple_autoschedule(Func &output,
+                                const std::map<std::string, int> &parameters,
+                                const std::vector<std::pair<int, int>> &output_bounds,
+                                const SimpleAutoscheduleOptions &options) {
     std::vector<Func> outputs{output};
     std::vector<std::vector<std::pair<int, int>>> vector_output_bounds{output_bounds};
     return simple_autoschedule(outputs,
@@ -855,6 +1763,25 @@ void simple_autoschedule_test() {
 
         Buffer<float> output = f2.realize(128, 128);
     }
+    { // Pointwise operations doubling in size when inlined. Should stop
+      // inlining past the budget.
+        Func in("in");
+        in(x, y) = cast<float>(x + y);
+        std::vector<Func> fs(8);
+        fs[0](x, y) = in(x, y) + 1.f;
+        for (int i = 1; i < (int)fs.size(); i++) {
+            fs[i](x, y) = fs[i - 1](x, y) * fs[i - 1](x, y) + sin(fs[i - 1](x, y));
+        }
+        SimpleAutoscheduleOptions options = cpu_options;
+        options.max_inline_expr_size = 64;
+        simple_autoschedule(fs.back(),
+                            {}, // parameters map
+                            {{0, 127},
+                             {0, 127}}, // output bounds (min, max)
+                            options);
+
+        Buffer<float> output = fs.back().realize(128, 128);
+    }
     { // 1D convolution. Should just parallize.
         Buffer<float> buf(16384);
         Buffer<float> k(5);
@@ -947,6 +1874,109 @@ void simple_autoschedule_test() {
 
         Buffer<float> output = sum.realize();
     }
+    { // 3D reduction onto a small kernel, as in the gradient of a weight.
+      // Should rfactor the batch and part of the spatial dimensions.
+        Buffer<float> buf(66, 66, 32);
+        Func d_k("d_k");
+        RDom r(0, 64, 0, 64, 0, 32);
+        d_k(x, y) = 0.f;
+        d_k(x, y) += buf(r.x + x, r.y + y, r.z);
+
+        simple_autoschedule(d_k,
+                            {}, // parameters map
+                            {{0, 2},
+                             {0, 2}}, // output bounds (min, max)
+                            cpu_options);
+
+        Buffer<float> output = d_k.realize(3, 3);
+    }
+    { // 2D convolution with fixed tile sizes.
+        Buffer<float> buf(1024, 1024);
+        Buffer<float> k(3, 3);
+        Func conv("conv");
+        RDom r(k);
+        conv(x, y) = 0.f;
+        conv(x, y) += buf(x + r.x, y + r.y) * k(r.x, r.y);
+
+        SimpleAutoscheduleOptions fixed_options;
+        fixed_options.cpu_tile_width = 32;
+        fixed_options.cpu_tile_height = 8;
+        fixed_options.cpu_vectorize_width = 4;
+        simple_autoschedule(conv,
+                            {}, // parameters map
+                            {{0, 1021},
+                             {0, 1021}}, // output bounds (min, max)
+                            fixed_options);
+
+        Buffer<float> output = conv.realize(1022, 1022);
+    }
+    { // Sibling outputs with the same domain. Should be computed together.
+        Buffer<float> buf(1024, 1024);
+        Func g0("g0"), g1("g1");
+        g0(x, y) = buf(x, y) + buf(x + 1, y);
+        g1(x, y) = buf(x, y) * buf(x + 1, y);
+
+        std::vector<Func> outputs{g0, g1};
+        simple_autoschedule(outputs,
+                            {}, // parameters map
+                            {{{0, 1022}, {0, 1023}},
+                             {{0, 1022}, {0, 1023}}}, // output bounds (min, max)
+                            cpu_options);
+
+        Realization output = Pipeline(outputs).realize(1023, 1024);
+    }
+    { // Large forward stencil read by a single adjoint.
+      // Should be computed at the tiles of the adjoint.
+        Buffer<float> buf(1024, 1024);
+        Func blur("blur");
+        blur(x, y) = buf(x, y) + buf(x + 1, y) + buf(x, y + 1);
+        Func d_blur("blur_0_d_def__");
+        d_blur(x, y) = blur(x - 1, y) + blur(x, y - 1);
+
+        simple_autoschedule(d_blur,
+                            {}, // parameters map
+                            {{1, 1022},
+                             {1, 1022}}, // output bounds (min, max)
+                            cpu_options);
+
+        Buffer<float> output(1022, 1022);
+        output.set_min(1, 1);
+        d_blur.realize(output);
+    }
+    { // The schedule is returned as C++ source, after the hash of the
+      // algorithm it was generated for.
+        ImageParam in(Float(32), 2, "in");
+        auto conv = [&](int radius) {
+            Func f("hashed_conv");
+            RDom r(-radius, 2 * radius + 1, "r");
+            f(x, y) = 0.f;
+            f(x, y) += in(x + r, y);
+            return f;
+        };
+        std::string hash = Pipeline(conv(1)).algorithm_hash();
+        internal_assert(Pipeline(conv(1)).algorithm_hash() == hash);
+        internal_assert(Pipeline(conv(2)).algorithm_hash() != hash);
+
+        Func f = conv(1);
+        std::string source = simple_autoschedule(f,
+                                                 {}, // parameters map
+                                                 {{0, 1023},
+                                                  {0, 1023}}, // output bounds (min, max)
+                                                 cpu_options);
+        internal_assert(source.find("// Algorithm: " + hash + "\n") != std::string::npos) << source;
+        internal_assert(source.find("Func hashed_conv = pipeline.get_func(") != std::string::npos) << source;
+        internal_assert(source.find("hashed_conv.update(0)\n    .tile(") != std::string::npos) << source;
+
+        Func sum("hashed_sum");
+        RDom r(0, 16384, "r");
+        sum() += in(r, 0);
+        source = simple_autoschedule(sum,
+                                     {}, // parameters map
+                                     {}, // output bounds (min, max)
+                                     cpu_options);
+        internal_assert(source.find("Func hashed_sum_intm = hashed_sum.update(0).rfactor(") !=
+                        std::string::npos) << source;
+    }
 
     debug(0) << "Simple autoschedule test passed\n";
 }
@@ -9,6 +9,7 @@
  *  In addition it supports GPU scheduling.
  */
 
+#include "AutoSchedule.h"
 #include "Func.h"
 
 #include <string>
@@ -18,14 +19,67 @@
 
 namespace Halide {
 
+/** The cost of a Func measured by the profiler in a previous run. */
+struct MeasuredCost {
+    /** The time spent computing the Func per run, in milliseconds. */
+    double time_ms = 0;
+    /** The average number of threads active while computing it. */
+    double threads = 0;
+};
+
+/** Read the costs of the Funcs saved by halide_profiler_save (or by a
+ * pipeline compiled with the profile feature and run with
+ * HL_PROFILER_FILE set), keyed by Func name. If a Func appears in
+ * several pipelines, the last one wins. */
+std::map<std::string, MeasuredCost> load_profile(const std::string &filename);
+
 struct SimpleAutoscheduleOptions {
+    /** The target the schedule is generated for. Defaults to the JIT
+     * target; set it to the target of the Generator or of the AOT
+     * compilation the schedule is for. */
+    Target target = get_jit_target_from_environment();
     bool gpu = false;
-    int cpu_tile_width = 16;
-    int cpu_tile_height = 16;
+    /** CPU tile sizes and vector width. When left at 0 they are chosen for
+     * each stage from its estimated arithmetic and memory costs and
+     * the machine parameters below. */
+    int cpu_tile_width = 0;
+    int cpu_tile_height = 0;
+    int cpu_vectorize_width = 0;
+    MachineParams machine_params = MachineParams::generic();
     int gpu_tile_width = 16;
     int gpu_tile_height = 16;
     int gpu_tile_channel = 4;
+    /** On GPU, the producers read by a stencil or a reduction are staged in
+     * shared memory when their region read by a block fits in this many
+     * bytes, otherwise in registers when their region read by a thread
+     * fits in gpu_register_size bytes. */
+    int gpu_shared_memory_size = 48 * 1024;
+    int gpu_register_size = 128;
+    /** On GPU, fuse the kernels of consecutive stages into persistent
+     * kernels, with a barrier across the grid instead of a launch
+     * between them (see Func::gpu_persistent). This pays off for
+     * pipelines of many small stages, such as the gradients of small
+     * images. The Funcs are then not memoized. Needs CUDA. */
+    bool gpu_persistent_kernels = false;
     int unroll_rvar_size = 0;
+    /** On CPU, a forward Func read by a single tiled stage of an adjoint
+     * Func is computed at the tiles of that stage instead of at root
+     * when its footprint is larger than this many bytes. */
+    int cpu_cache_size = 256 * 1024;
+    /** A Func only read element-wise by another Func is inlined into it
+     * unless the expressions of the consumer would then have more than
+     * this many nodes, counting each use of a shared subexpression. On
+     * CPU, the Funcs over this budget are computed at the tiles of their
+     * consumer instead. 0 inlines them regardless of their size. */
+    int max_inline_expr_size = 1024;
+    /** The costs measured by the profiler when running a previous
+     * schedule of the same pipeline (see load_profile). On CPU, the
+     * stages of a measured Func are tiled from these instead of the
+     * estimated costs: a Func that kept few threads busy is split into
+     * more tiles to balance the load, and the tiles of a cheap Func are
+     * grown until each takes at least cpu_min_grain_us microseconds. */
+    std::map<std::string, MeasuredCost> profile;
+    double cpu_min_grain_us = 20;
 };
 
 /**
@@ -33,15 +87,24 @@ struct SimpleAutoscheduleOptions {
  *  and an estimation of the values of the variable parameters (e.g. bounds
  *  of the inputs if you're compiling in a generator) and
  *  function bounds (in {min, max}), automatically schedule all the dependencies.
+ *
+ *  Returns the schedule as C++ source applying it again, like
+ *  Pipeline::auto_schedule: the directives applied, with the names of the
+ *  Vars, RVars and of the Funcs made by rfactor() they use, after a
+ *  header giving the target, the machine parameters, the hash of the
+ *  algorithm before it was scheduled (see Pipeline::algorithm_hash) and
+ *  the hash of the parameters, output bounds, estimates and options it
+ *  was scheduled with. A build can save it and apply it instead of
+ *  running the autoscheduler while none of these lines change.
  */
-void simple_autoschedule(std::vector<Func> &outputs,
-                         const std::map<std::string, int> &parameters,
-                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
-                         const SimpleAutoscheduleOptions &options = SimpleAutoscheduleOptions());
-void simple_autoschedule(Func &output,
-                         const std::map<std::string, int> &parameters,
-                         const std::vector<std::pair<int, int>> &output_bounds,
-                         const SimpleAutoscheduleOptions &options = SimpleAutoscheduleOptions());
+std::string simple_autoschedule(std::vector<Func> &outputs,
+                                const std::map<std::string, int> &parameters,
+                                const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                                const SimpleAutoscheduleOptions &options = SimpleAutoscheduleOptions());
+std::string simple_autoschedule(Func &output,
+                                const std::map<std::string, int> &parameters,
+                                const std::vector<std::pair<int, int>> &output_bounds,
+                                const SimpleAutoscheduleOptions &options = SimpleAutoscheduleOptions());
 
 namespace Internal {
 
@@ -3,12 +3,15 @@
 #include <iostream>
 #include <limits>
 #include <stdio.h>
+#include <unordered_map>
 
 #include "Bounds.h"
+#include "CompileTimer.h"
 #include "Debug.h"
 #include "Deinterleave.h"
 #include "ExprUsesVar.h"
 #include "IREquality.h"
+#include "IRMatch.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "IRPrinter.h"
@@ -4151,8 +4154,6 @@ private:
         const EQ *eq_b = b.as<EQ>();
         const NE *neq_a = a.as<NE>();
         const NE *neq_b = b.as<NE>();
-        const Not *not_a = a.as<Not>();
-        const Not *not_b = b.as<Not>();
         const Variable *var_a = a.as<Variable>();
         const Variable *var_b = b.as<Variable>();
         int64_t ia = 0, ib = 0;
@@ -4165,63 +4166,39 @@ private:
             return a;
         } else if (is_zero(b)) {
             return b;
-        } else if (equal(a, b)) {
-            // a && a -> a
-            return a;
-        } else if (le_a &&
-                   le_b &&
-                   equal(le_a->a, le_b->a)) {
-            // (x <= foo && x <= bar) -> x <= min(foo, bar)
-            return mutate(le_a->a <= min(le_a->b, le_b->b));
-        } else if (le_a &&
-                   le_b &&
-                   equal(le_a->b, le_b->b)) {
-            // (foo <= x && bar <= x) -> max(foo, bar) <= x
-            return mutate(max(le_a->a, le_b->a) <= le_a->b);
-        } else if (lt_a &&
-                   lt_b &&
-                   equal(lt_a->a, lt_b->a)) {
-            // (x < foo && x < bar) -> x < min(foo, bar)
-            return mutate(lt_a->a < min(lt_a->b, lt_b->b));
-        } else if (lt_a &&
-                   lt_b &&
-                   equal(lt_a->b, lt_b->b)) {
-            // (foo < x && bar < x) -> max(foo, bar) < x
-            return mutate(max(lt_a->a, lt_b->a) < lt_a->b);
-        } else if (eq_a &&
-                   neq_b &&
-                   ((equal(eq_a->a, neq_b->a) && equal(eq_a->b, neq_b->b)) ||
-                    (equal(eq_a->a, neq_b->b) && equal(eq_a->b, neq_b->a)))) {
-            // a == b && a != b
-            return const_false(op->type.lanes());
-        } else if (eq_b &&
-                   neq_a &&
-                   ((equal(eq_b->a, neq_a->a) && equal(eq_b->b, neq_a->b)) ||
-                    (equal(eq_b->a, neq_a->b) && equal(eq_b->b, neq_a->a)))) {
-            // a != b && a == b
-            return const_false(op->type.lanes());
-        } else if ((not_a && equal(not_a->a, b)) ||
-                   (not_b && equal(not_b->a, a))) {
-            // a && !a
-            return const_false(op->type.lanes());
-        } else if (le_a &&
-                   lt_b &&
-                   equal(le_a->a, lt_b->b) &&
-                   equal(le_a->b, lt_b->a)) {
-            // a <= b && b < a
-            return const_false(op->type.lanes());
-        } else if (lt_a &&
-                   le_b &&
-                   equal(lt_a->a, le_b->b) &&
-                   equal(lt_a->b, le_b->a)) {
-            // a < b && b <= a
-            return const_false(op->type.lanes());
-        } else if (lt_a &&
-                   lt_b &&
-                   equal(lt_a->a, lt_b->b) &&
-                   const_int(lt_a->b, &ia) &&
-                   const_int(lt_b->a, &ib) &&
-                   ib + 1 >= ia) {
+        }
+
+        IRMatcher::Wild<0> x;
+        IRMatcher::Wild<1> y;
+        IRMatcher::Wild<2> z;
+        IRMatcher::BoolConst<false> false_;
+        auto rewrite = IRMatcher::rewriter<And>(a, b, op->type);
+        if (rewrite(x && x, x)) {
+            return rewrite.result;
+        }
+        if (rewrite((x <= y) && (x <= z), x <= min(y, z)) ||
+            rewrite((y <= x) && (z <= x), max(y, z) <= x) ||
+            rewrite((x < y) && (x < z), x < min(y, z)) ||
+            rewrite((y < x) && (z < x), max(y, z) < x)) {
+            return mutate(rewrite.result);
+        }
+        if (rewrite((x == y) && (x != y), false_) ||
+            rewrite((x == y) && (y != x), false_) ||
+            rewrite((x != y) && (x == y), false_) ||
+            rewrite((x != y) && (y == x), false_) ||
+            rewrite(!x && x, false_) ||
+            rewrite(x && !x, false_) ||
+            rewrite((x <= y) && (y < x), false_) ||
+            rewrite((x < y) && (y <= x), false_)) {
+            return rewrite.result;
+        }
+
+        if (lt_a &&
+            lt_b &&
+            equal(lt_a->a, lt_b->b) &&
+            const_int(lt_a->b, &ia) &&
+            const_int(lt_b->a, &ib) &&
+            ib + 1 >= ia) {
             // (a < ia && ib < a) where there is no integer a s.t. ib < a < ia
             return const_false(op->type.lanes());
         } else if (lt_a &&
@@ -5286,6 +5263,28 @@ private:
         }
     }
 
+    Expr visit(const VectorReduce *op) override {
+        Expr value = mutate(op->value);
+        const int lanes = op->type.lanes();
+        const int factor = op->value.type().lanes() / lanes;
+        if (factor == 1) {
+            return value;
+        }
+        const Broadcast *b = value.as<Broadcast>();
+        if (b && b->value.type().is_scalar() && op->op != VectorReduce::Mul) {
+            // All the lanes reduced are the same.
+            Expr v = b->value;
+            if (op->op == VectorReduce::Add) {
+                v = mutate(v * make_const(v.type(), factor));
+            }
+            return lanes == 1 ? v : Broadcast::make(v, lanes);
+        }
+        if (value.same_as(op->value)) {
+            return op;
+        }
+        return VectorReduce::make(op->op, value, lanes);
+    }
+
     Expr visit(const Shuffle *op) override {
         if (op->is_extract_element() &&
             (op->vectors[0].as<Ramp>() ||
@@ -5973,15 +5972,77 @@ private:
     }
 };
 
+// Lowering passes simplify the same Exprs many times over, e.g. the
+// bounds of a Func queried by several passes. Without any bounds or
+// alignment facts, the result only depends on the Expr itself, so the
+// results of those calls are remembered here, keyed by the node. An
+// entry holds a reference to its key, so the node can't be freed and its
+// address reused while the entry is alive.
+struct SimplifyMemo {
+    struct Entry {
+        Expr key, result;
+    };
+    std::unordered_map<const IRNode *, Entry> entries[2];
+    static const size_t max_entries = 16 * 1024;
+
+    static bool enabled() {
+        static bool e = get_env_variable("HL_SIMPLIFY_MEMO") != "0";
+        return e;
+    }
+};
+
+namespace {
+// The codegen of several targets may run in parallel, so the memo is per
+// thread.
+thread_local SimplifyMemo *current_simplify_memo = nullptr;
+}  // namespace
+
+SimplifyMemoScope::SimplifyMemoScope() :
+    memo(SimplifyMemo::enabled() ? new SimplifyMemo : nullptr), previous(current_simplify_memo) {
+    if (memo) {
+        current_simplify_memo = memo;
+    }
+}
+
+SimplifyMemoScope::~SimplifyMemoScope() {
+    if (memo) {
+        internal_assert(current_simplify_memo == memo);
+        current_simplify_memo = previous;
+        delete memo;
+    }
+}
+
 Expr simplify(Expr e, bool remove_dead_lets,
               const Scope<Interval> &bounds,
               const Scope<ModulusRemainder> &alignment) {
-    return Simplify(remove_dead_lets, &bounds, &alignment).mutate(e);
+    // The simplifier runs far too often to trace each run.
+    CompileTimer timer("Simplify", false);
+    // Leaves aren't worth remembering.
+    SimplifyMemo *memo = current_simplify_memo;
+    bool memoize = (memo &&
+                    &bounds == &Scope<Interval>::empty_scope() &&
+                    &alignment == &Scope<ModulusRemainder>::empty_scope() &&
+                    e.defined() && !is_const(e) && !e.as<Variable>());
+    if (!memoize) {
+        return Simplify(remove_dead_lets, &bounds, &alignment).mutate(e);
+    }
+    auto &entries = memo->entries[remove_dead_lets ? 1 : 0];
+    auto it = entries.find(e.get());
+    if (it != entries.end()) {
+        return it->second.result;
+    }
+    Expr result = Simplify(remove_dead_lets, &bounds, &alignment).mutate(e);
+    if (entries.size() >= SimplifyMemo::max_entries) {
+        entries.clear();
+    }
+    entries[e.get()] = {e, result};
+    return result;
 }
 
 Stmt simplify(Stmt s, bool remove_dead_lets,
               const Scope<Interval> &bounds,
               const Scope<ModulusRemainder> &alignment) {
+    CompileTimer timer("Simplify", false);
     return Simplify(remove_dead_lets, &bounds, &alignment).mutate(s);
 }
 
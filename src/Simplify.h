@@ -29,6 +29,26 @@ Expr simplify(Expr, bool remove_dead_lets = true,
               const Scope<ModulusRemainder> &alignment = Scope<ModulusRemainder>::empty_scope());
 // @}
 
+struct SimplifyMemo;
+
+/** While an instance of this is alive, simplify(Expr) remembers its
+ * results on the current thread when called without bounds or
+ * alignment facts, and reuses them for an Expr node simplified again.
+ * Lowering keeps one for its whole duration, as passes simplify the
+ * same shared Exprs over and over. The remembered results, and the
+ * nodes they hold on to, are freed with it. Setting HL_SIMPLIFY_MEMO=0
+ * turns this off. Instances nest. */
+class SimplifyMemoScope {
+    SimplifyMemo *memo, *previous;
+
+    SimplifyMemoScope(const SimplifyMemoScope &) = delete;
+    SimplifyMemoScope &operator=(const SimplifyMemoScope &) = delete;
+
+public:
+    SimplifyMemoScope();
+    ~SimplifyMemoScope();
+};
+
 /** A common use of the simplifier is to prove boolean expressions are
  * true at compile time. Equivalent to is_one(simplify(e)) */
 bool can_prove(Expr e);
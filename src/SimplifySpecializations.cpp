@@ -126,7 +126,33 @@ vector<Definition> propagate_specialization_in_definition(Definition &def, const
 
         vector<Definition> s_result = propagate_specialization_in_definition(s_def, name);
 
-        if (var && eq) {
+        if (c.as<And>()) {
+            // A conjunction, e.g. from specializing on several
+            // extents at once. Every term holds in the then case, so
+            // substitute in the ones that bind a var to a value. We
+            // can't say anything about any one term in the else case.
+            vector<Expr> terms;
+            terms.push_back(c);
+            while (!terms.empty()) {
+                Expr t = terms.back();
+                terms.pop_back();
+                if (const And *a = t.as<And>()) {
+                    terms.push_back(a->b);
+                    terms.push_back(a->a);
+                    continue;
+                }
+                const EQ *t_eq = t.as<EQ>();
+                const Variable *t_var = t_eq ? t_eq->a.as<Variable>() : t.as<Variable>();
+                if (t_var && t_eq) {
+                    substitute_value_in_var(t_var->name, t_eq->b, s_result);
+                } else if (t_var) {
+                    substitute_value_in_var(t_var->name, const_true(), s_result);
+                } else {
+                    simplify_using_fact(t, s_result);
+                }
+            }
+            simplify_using_fact(!c, result);
+        } else if (var && eq) {
             // Then case
             substitute_value_in_var(var->name, eq->b, s_result);
 
@@ -0,0 +1,144 @@
+#include "Softmax.h"
+#include "IROperator.h"
+#include "RDom.h"
+
+namespace Halide {
+
+namespace {
+
+// The Vars of a Func of the given dimensions, and the ones other
+// than dim, which index the reductions along dim.
+struct SoftmaxArgs {
+    std::vector<Var> args;
+    std::vector<Var> outer;
+
+    SoftmaxArgs(int dimensions, int dim) : args(dimensions) {
+        for (int i = 0; i < dimensions; i++) {
+            if (i != dim) {
+                outer.push_back(args[i]);
+            }
+        }
+    }
+
+    // The args with the one at dim replaced by e
+    std::vector<Expr> at(int dim, const Expr &e) const {
+        std::vector<Expr> result(args.begin(), args.end());
+        result[dim] = e;
+        return result;
+    }
+};
+
+void check_input(const Func &f, int dim, const Expr &extent, const std::string &name) {
+    user_assert(f.defined() && f.outputs() == 1 && f.output_types()[0].is_float())
+        << "The input of " << name << " must be a defined, single-valued float Func.\n";
+    user_assert(dim >= 0 && dim < f.dimensions())
+        << "Can't compute " << name << " along dimension " << dim
+        << " of " << f.name() << ", which has " << f.dimensions() << " dimensions.\n";
+    user_assert(extent.defined())
+        << "The extent of " << name << " must be defined.\n";
+}
+
+// The running maximum of f along dim, and the sum of exp(f - max). When
+// the maximum grows, the sum so far is rescaled to the new maximum. The
+// exponentials of equal values are 1, so that masked (-inf) inputs
+// before the first finite one don't make the sum NaN.
+Func softmax_stats(const Func &f, int dim, const Expr &extent, const std::string &name) {
+    SoftmaxArgs a(f.dimensions(), dim);
+    Type t = f.output_types()[0];
+    RDom r(0, extent, name + "_r");
+    Func stats(name + "_stats");
+    stats(a.outer) = Tuple(t.min(), Internal::make_zero(t));
+    Expr m = stats(a.outer)[0];
+    Expr s = stats(a.outer)[1];
+    Expr v = f(a.at(dim, r));
+    Expr new_m = max(m, v);
+    Expr one = Internal::make_one(t);
+    stats(a.outer) = Tuple(new_m, s * select(m == new_m, one, exp(m - new_m)) +
+                                      select(v == new_m, one, exp(v - new_m)));
+    stats.compute_root();
+    return stats;
+}
+
+// The sum along dim of g, which has the dimensions of the input.
+Func sum_along(const Func &g, int dim, const Expr &extent, const std::string &name) {
+    SoftmaxArgs a(g.dimensions(), dim);
+    RDom r(0, extent, name + "_r");
+    Func result(name);
+    result(a.outer) = Internal::make_zero(g.output_types()[0]);
+    result(a.outer) += g(a.at(dim, r));
+    result.compute_root();
+    return result;
+}
+
+}  // namespace
+
+FusedSoftmax softmax(const Func &f, int dim, Expr extent, const std::string &name) {
+    check_input(f, dim, extent, "softmax");
+    SoftmaxArgs a(f.dimensions(), dim);
+    FusedSoftmax result;
+    result.stats = softmax_stats(f, dim, extent, name);
+    result.output = Func(name);
+    result.output(a.args) = exp(f(a.args) - result.stats(a.outer)[0]) / result.stats(a.outer)[1];
+
+    Func y = result.output;
+    result.gradient = [=](const Func &dy) {
+        SoftmaxArgs a(f.dimensions(), dim);
+        Func dy_y(name + "_dy_y");
+        dy_y(a.args) = dy(a.args) * y(a.args);
+        Func dot = sum_along(dy_y, dim, extent, name + "_dot");
+        Func df(name + "_d_input");
+        df(a.args) = y(a.args) * (dy(a.args) - dot(a.outer));
+        return std::map<std::string, Func>{{f.name(), df}};
+    };
+    return result;
+}
+
+FusedSoftmax log_softmax(const Func &f, int dim, Expr extent, const std::string &name) {
+    check_input(f, dim, extent, "log_softmax");
+    SoftmaxArgs a(f.dimensions(), dim);
+    FusedSoftmax result;
+    result.stats = softmax_stats(f, dim, extent, name);
+    result.output = Func(name);
+    result.output(a.args) = f(a.args) - result.stats(a.outer)[0] - log(result.stats(a.outer)[1]);
+
+    Func y = result.output;
+    result.gradient = [=](const Func &dy) {
+        SoftmaxArgs a(f.dimensions(), dim);
+        Func dy_sum = sum_along(dy, dim, extent, name + "_dy_sum");
+        Func df(name + "_d_input");
+        df(a.args) = dy(a.args) - exp(y(a.args)) * dy_sum(a.outer);
+        return std::map<std::string, Func>{{f.name(), df}};
+    };
+    return result;
+}
+
+FusedSoftmax log_softmax_cross_entropy(const Func &logits, const Func &labels,
+                                       int dim, Expr extent, const std::string &name) {
+    check_input(logits, dim, extent, "log_softmax_cross_entropy");
+    user_assert(labels.defined() && labels.outputs() == 1 &&
+                (labels.output_types()[0].is_int() || labels.output_types()[0].is_uint()) &&
+                labels.dimensions() == logits.dimensions() - 1)
+        << "The labels of log_softmax_cross_entropy must be a single-valued integer Func "
+        << "with one dimension less than the logits.\n";
+    SoftmaxArgs a(logits.dimensions(), dim);
+    FusedSoftmax result;
+    result.stats = softmax_stats(logits, dim, extent, name);
+    Func stats = result.stats;
+    Expr label = clamp(cast<int>(labels(a.outer)), 0, extent - 1);
+    result.output = Func(name);
+    result.output(a.outer) = stats(a.outer)[0] + log(stats(a.outer)[1]) - logits(a.at(dim, label));
+
+    result.gradient = [=](const Func &dloss) {
+        SoftmaxArgs a(logits.dimensions(), dim);
+        Type t = logits.output_types()[0];
+        Expr label = clamp(cast<int>(labels(a.outer)), 0, extent - 1);
+        Expr p = exp(logits(a.args) - stats(a.outer)[0]) / stats(a.outer)[1];
+        Expr onehot = select(a.args[dim] == label, Internal::make_one(t), Internal::make_zero(t));
+        Func dlogits(name + "_d_logits");
+        dlogits(a.args) = dloss(a.outer) * (p - onehot);
+        return std::map<std::string, Func>{{logits.name(), dlogits}};
+    };
+    return result;
+}
+
+}  // namespace Halide
@@ -0,0 +1,77 @@
+#ifndef HALIDE_SOFTMAX_H
+#define HALIDE_SOFTMAX_H
+
+/** \file
+ * Softmax and cross-entropy losses computed in a single pass over the
+ * reduced dimension, with closed-form gradients.
+ */
+
+#include <string>
+
+#include "Derivative.h"
+#include "Func.h"
+
+namespace Halide {
+
+/** A Func made by one of the functions below, along with the Funcs it
+ * reads and its gradient. Differentiating through the definitions of
+ * these Funcs gives a backward pipeline with a stage for each of the
+ * reductions and pointwise operations of the forward pass; register
+ * the gradient in PropagateAdjointsOptions::custom_gradients to
+ * compute the adjoint of the input in a single pass instead:
+ *
+ \code
+ FusedSoftmax p = softmax(logits, 0, classes);
+ Func loss = ...p.output...;
+ PropagateAdjointsOptions options;
+ p.register_gradient(options);
+ Derivative d = propagate_adjoints(loss, options);
+ \endcode
+ */
+struct FusedSoftmax {
+    /** The result. */
+    Func output;
+
+    /** The running maximum and the sum of the exponentials of the input
+     * minus it along the reduced dimension, as a Tuple, for each point
+     * of the other dimensions. Both are computed in the same pass: the
+     * sum is rescaled whenever the maximum grows, so none of the
+     * exponentials overflow. It is compute_root by default, and can be
+     * computed at a loop of the consumers of output instead. */
+    Func stats;
+
+    /** The adjoint of the input given the adjoint of output. */
+    CustomGradient gradient;
+
+    /** Use gradient for output when propagating adjoints with these options. */
+    void register_gradient(PropagateAdjointsOptions &options) const {
+        options.custom_gradients[output.name()] = gradient;
+    }
+};
+
+/** The softmax of the single-valued float Func f along its dimension dim,
+ * over [0, extent): exp(f) divided by the sum of exp(f) along dim. The
+ * adjoint of f is y * (dy - sum(dy * y)), for output y and its
+ * adjoint dy, with the sum along dim. */
+FusedSoftmax softmax(const Func &f, int dim, Expr extent,
+                     const std::string &name = "softmax");
+
+/** The log of the softmax of f above, f - log(sum(exp(f))). The adjoint
+ * of f is dy - exp(y) * sum(dy). */
+FusedSoftmax log_softmax(const Func &f, int dim, Expr extent,
+                         const std::string &name = "log_softmax");
+
+/** The cross-entropy loss of the classes predicted by the logits along
+ * their dimension dim, over [0, extent), with respect to the integer
+ * class labels: -log(softmax(logits)) at the label, for each point of
+ * the other dimensions. labels is indexed by the dimensions of logits
+ * other than dim, in order, and so is the result. The adjoint of the
+ * logits is dloss * (softmax(logits) - onehot(labels)), which reads no
+ * reduction but stats. The labels aren't differentiated. */
+FusedSoftmax log_softmax_cross_entropy(const Func &logits, const Func &labels,
+                                       int dim, Expr extent,
+                                       const std::string &name = "cross_entropy");
+
+}  // namespace Halide
+
+#endif
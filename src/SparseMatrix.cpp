@@ -0,0 +1,76 @@
+#include "SparseMatrix.h"
+#include "IROperator.h"
+
+namespace Halide {
+
+SparseMatrix::SparseMatrix(Func row_ptr, Func col_idx, Func values,
+                           Expr rows, Expr cols, Expr nonzeros)
+    : row_ptr_(row_ptr), col_idx_(col_idx), values_(values),
+      rows_(rows), cols_(cols), nonzeros_(nonzeros) {
+    user_assert(row_ptr.defined() && col_idx.defined() && values.defined())
+        << "The Funcs of a SparseMatrix must be defined.\n";
+    user_assert(row_ptr.dimensions() == 1 &&
+                col_idx.dimensions() == 1 &&
+                values.dimensions() == 1)
+        << "The row pointers, column indices and values of a SparseMatrix "
+        << "must be one-dimensional.\n";
+    Type row_ptr_type = row_ptr.output_types()[0];
+    Type col_idx_type = col_idx.output_types()[0];
+    user_assert((row_ptr_type.is_int() || row_ptr_type.is_uint()) &&
+                (col_idx_type.is_int() || col_idx_type.is_uint()))
+        << "The row pointers and column indices of a SparseMatrix must be integers.\n";
+    user_assert(rows.defined() && cols.defined() && nonzeros.defined())
+        << "The size of a SparseMatrix must be defined.\n";
+}
+
+SparseMatrix SparseMatrix::from_coo(Func row_idx, Func col_idx, Func values,
+                                    Expr rows, Expr cols, Expr nonzeros) {
+    user_assert(row_idx.defined() && row_idx.dimensions() == 1 &&
+                (row_idx.output_types()[0].is_int() || row_idx.output_types()[0].is_uint()))
+        << "The row indices of a SparseMatrix must be a one-dimensional "
+        << "Func of integers.\n";
+
+    // Count the nonzeros of each row, then take the prefix sum of the
+    // counts.
+    Var i("i");
+    RDom k(0, nonzeros, "coo_k");
+    Func counts("coo_row_counts");
+    counts(i) = 0;
+    counts(clamp(cast<int>(row_idx(k)), 0, rows - 1)) += 1;
+
+    RDom r(0, rows, "coo_r");
+    Func row_ptr("coo_row_ptr");
+    row_ptr(i) = 0;
+    row_ptr(r + 1) = row_ptr(r) + counts(r);
+
+    counts.compute_root();
+    row_ptr.compute_root();
+
+    return SparseMatrix(row_ptr, col_idx, values, rows, cols, nonzeros);
+}
+
+Expr SparseMatrix::row_begin(Expr row) const {
+    return cast<int>(row_ptr_(row));
+}
+
+Expr SparseMatrix::row_end(Expr row) const {
+    return cast<int>(row_ptr_(row + 1));
+}
+
+RDom SparseMatrix::row_nonzeros(Expr row, const std::string &name) const {
+    RDom k(0, nonzeros_, name);
+    // The predicate is a range of the RDom's variable in terms of
+    // outer loops, so it becomes the bounds of the loop over k.
+    k.where(row_begin(row) <= Expr(k) && Expr(k) < row_end(row));
+    return k;
+}
+
+Expr SparseMatrix::column(Expr k) const {
+    return clamp(cast<int>(col_idx_(k)), 0, cols_ - 1);
+}
+
+Expr SparseMatrix::value(Expr k) const {
+    return values_(k);
+}
+
+}  // namespace Halide
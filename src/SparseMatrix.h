@@ -0,0 +1,91 @@
+#ifndef HALIDE_SPARSE_MATRIX_H
+#define HALIDE_SPARSE_MATRIX_H
+
+/** \file
+ * Support for sparse matrices in compressed sparse row (CSR) and
+ * coordinate (COO) form.
+ */
+
+#include <string>
+
+#include "Func.h"
+#include "IR.h"
+#include "RDom.h"
+
+namespace Halide {
+
+/** A sparse matrix with some number of rows and columns, of which
+ * only the nonzeros are stored, ordered by row. row_ptr(i) is the
+ * index of the first nonzero of row i, and row_ptr(rows) is the
+ * number of nonzeros. col_idx(k) and values(k) are the column and
+ * value of the k'th nonzero.
+ *
+ * The nonzeros of a row are iterated over with \ref row_nonzeros,
+ * which returns an RDom over all the nonzeros with a predicate that
+ * selects those of the row. Halide trims the loop over the RDom to
+ * the range of nonzeros of the row, so the work done for each row is
+ * proportional to its nonzeros. For example, a sparse-dense matrix
+ * product is:
+ *
+ \code
+ SparseMatrix A(row_ptr, col_idx, values, rows, cols, nonzeros);
+ RDom k = A.row_nonzeros(y);
+ f(x, y) = 0.0f;
+ f(x, y) += A.value(k) * B(x, A.column(k));
+ f.update().parallel(y).vectorize(x, 8);
+ \endcode
+ *
+ * The loop over the RDom must be inside the loop over the row for the
+ * trimming to apply, which is the case unless the update definition
+ * is reordered. The rows are independent, so they can be parallelized
+ * over. The column is clamped to the columns of the matrix, so
+ * bounds inference knows the region of the dense operand that is
+ * read.
+ */
+class SparseMatrix {
+    Func row_ptr_, col_idx_, values_;
+    Expr rows_, cols_, nonzeros_;
+
+public:
+    SparseMatrix() {}
+
+    /** Construct a sparse matrix in CSR form. The number
+     * of nonzeros must be given, because the bounds of an RDom may not
+     * depend on a call to a Func. */
+    SparseMatrix(Func row_ptr, Func col_idx, Func values,
+                 Expr rows, Expr cols, Expr nonzeros);
+
+    /** Construct a sparse matrix from COO form, in which row_idx(k)
+     * is the row of the k'th nonzero. The nonzeros must be ordered by
+     * row. The row pointers are computed at root from the row
+     * indices. */
+    static SparseMatrix from_coo(Func row_idx, Func col_idx, Func values,
+                                 Expr rows, Expr cols, Expr nonzeros);
+
+    /** An RDom over the nonzeros of the given row, usually a pure Var
+     * of the update definition the RDom is used in. */
+    RDom row_nonzeros(Expr row, const std::string &name = "") const;
+
+    /** The column and value of the k'th nonzero. */
+    // @{
+    Expr column(Expr k) const;
+    Expr value(Expr k) const;
+    // @}
+
+    /** The range of the nonzeros of the given row. */
+    // @{
+    Expr row_begin(Expr row) const;
+    Expr row_end(Expr row) const;
+    // @}
+
+    const Func &row_ptr() const { return row_ptr_; }
+    const Func &col_idx() const { return col_idx_; }
+    const Func &values() const { return values_; }
+    Expr rows() const { return rows_; }
+    Expr cols() const { return cols_; }
+    Expr nonzeros() const { return nonzeros_; }
+};
+
+}  // namespace Halide
+
+#endif
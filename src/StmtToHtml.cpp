@@ -6,8 +6,11 @@
 #include <iterator>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace Halide {
 namespace Internal {
@@ -22,6 +25,108 @@ std::string to_string(T value) {
     return os.str() ;
 }
 
+// The measurements of a Func in a report of the profiler.
+struct FuncProfile {
+    double time_ms = 0;
+    int percent = 0;
+    double threads = 0;
+    uint64_t memory_peak = 0;
+    uint64_t stack_peak = 0;
+};
+
+// Parse the lines printed for each Func by halide_profiler_report, e.g.
+//   "  f: 1.23ms   (45%)   threads: 3.2   peak: 1024  num: 1  avg: 1024"
+// The names of the pipelines and their totals are indented by at most one
+// space. The Funcs of all the pipelines in the report are merged.
+std::map<string, FuncProfile> parse_profile(const string &filename) {
+    std::map<string, FuncProfile> profile;
+    std::ifstream stream(filename.c_str());
+    user_assert(stream.good()) << "Could not open profiler report " << filename << "\n";
+    string line;
+    while (std::getline(stream, line)) {
+        if (line.size() < 3 || line[0] != ' ' || line[1] != ' ' || line[2] == ' ') {
+            continue;
+        }
+        size_t colon = line.find(": ", 2);
+        if (colon == string::npos) {
+            continue;
+        }
+        FuncProfile p;
+        string name = line.substr(2, colon - 2);
+        const char *rest = line.c_str() + colon + 2;
+        char *end = nullptr;
+        p.time_ms = strtod(rest, &end);
+        if (end == rest || strncmp(end, "ms", 2) != 0) {
+            continue;
+        }
+        auto field = [&](const char *key) -> const char * {
+            size_t pos = line.find(key, colon);
+            return pos == string::npos ? nullptr : line.c_str() + pos + strlen(key);
+        };
+        if (const char *f = field("(")) {
+            p.percent = atoi(f);
+        }
+        if (const char *f = field("threads: ")) {
+            p.threads = strtod(f, nullptr);
+        }
+        if (const char *f = field(" peak: ")) {
+            p.memory_peak = strtoull(f, nullptr, 10);
+        }
+        if (const char *f = field(" stack: ")) {
+            p.stack_peak = strtoull(f, nullptr, 10);
+        }
+        profile[name] = p;
+    }
+    return profile;
+}
+
+// Static estimates of the work in a Stmt: the number of vector lanes of
+// arithmetic, the number of bytes loaded and stored, and the widest
+// store. These don't account for the trip counts of the loops, but their
+// ratio is a rough arithmetic intensity of the loop body.
+class WorkEstimate : public IRVisitor {
+    using IRVisitor::visit;
+
+    template<typename T>
+    void visit_op(const T *op) {
+        ops += op->type.lanes();
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Add *op) { visit_op(op); }
+    void visit(const Sub *op) { visit_op(op); }
+    void visit(const Mul *op) { visit_op(op); }
+    void visit(const Div *op) { visit_op(op); }
+    void visit(const Mod *op) { visit_op(op); }
+    void visit(const Min *op) { visit_op(op); }
+    void visit(const Max *op) { visit_op(op); }
+    void visit(const EQ *op) { visit_op(op); }
+    void visit(const NE *op) { visit_op(op); }
+    void visit(const LT *op) { visit_op(op); }
+    void visit(const LE *op) { visit_op(op); }
+    void visit(const GT *op) { visit_op(op); }
+    void visit(const GE *op) { visit_op(op); }
+    void visit(const And *op) { visit_op(op); }
+    void visit(const Or *op) { visit_op(op); }
+    void visit(const Not *op) { visit_op(op); }
+    void visit(const Select *op) { visit_op(op); }
+
+    void visit(const Load *op) {
+        bytes += op->type.bytes() * op->type.lanes();
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Store *op) {
+        bytes += op->value.type().bytes() * op->value.type().lanes();
+        vector_width = std::max(vector_width, op->value.type().lanes());
+        IRVisitor::visit(op);
+    }
+
+public:
+    int64_t ops = 0, bytes = 0;
+    int vector_width = 0;
+};
+
 class StmtToHtml : public IRVisitor {
 
     static const std::string css, js;
@@ -324,6 +429,63 @@ private:
         print_list(symbol("assert") + "(", args, ")");
         stream << close_div();
     }
+    // The measurements of the Funcs, if we were given a profile.
+    std::map<string, FuncProfile> profile;
+
+    string work_estimate(const Stmt &s) {
+        WorkEstimate work;
+        s.accept(&work);
+        std::stringstream str;
+        if (work.vector_width > 0) {
+            str << " vector width: " << work.vector_width;
+        }
+        if (work.bytes > 0) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.2f", (double)work.ops / work.bytes);
+            str << " ops/byte: " << buf;
+        }
+        return str.str();
+    }
+
+    // The measured cost of a producer, with a background as red as its
+    // share of the time.
+    string profile_annotation(const ProducerConsumer *op) {
+        auto it = profile.find(op->name);
+        if (!op->is_producer || it == profile.end()) {
+            return "";
+        }
+        const FuncProfile &p = it->second;
+        std::stringstream str;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", p.time_ms);
+        str << "<span class='Profile' style='background-color: rgba(255, 0, 0, "
+            << std::min(p.percent, 100) / 100.0 << ");'>";
+        str << "// " << buf << "ms (" << p.percent << "%)";
+        if (p.threads > 0) {
+            str << " threads: " << p.threads;
+        }
+        if (p.memory_peak > 0) {
+            str << " peak: " << p.memory_peak << " bytes";
+        }
+        if (p.stack_peak > 0) {
+            str << " stack: " << p.stack_peak << " bytes";
+        }
+        str << work_estimate(op->body);
+        str << "</span>";
+        return str.str();
+    }
+
+    string loop_annotation(const For *op) {
+        if (profile.empty()) {
+            return "";
+        }
+        string work = work_estimate(op->body);
+        if (work.empty()) {
+            return "";
+        }
+        return "<span class='Profile'>//" + work + "</span>";
+    }
+
     void visit(const ProducerConsumer *op) {
         scope.push(op->name, unique_id());
         stream << open_div(op->is_producer ? "Produce" : "Consumer");
@@ -334,6 +496,7 @@ private:
         stream << var(op->name);
         stream << close_expand_button() << " {";
         stream << close_span();;
+        stream << " " << profile_annotation(op);
         stream << open_div(op->is_producer ? "ProduceBody Indent" : "ConsumeBody Indent", produce_id);
         print(op->body);
         stream << close_div();
@@ -371,6 +534,7 @@ private:
         stream << matched(")");
         stream << close_expand_button();
         stream << " " << matched("{");
+        stream << " " << loop_annotation(op);
         stream << open_div("ForBody Indent", id);
         print(op->body);
         stream << close_div();
@@ -599,6 +763,14 @@ private:
         stream << close_span();
     }
 
+    void visit(const VectorReduce *op) {
+        stream << open_span("VectorReduce");
+        std::ostringstream name;
+        name << "vector_reduce_" << op->op << "(";
+        print_list(symbol(name.str()), {op->value, op->type.lanes()}, ")");
+        stream << close_span();
+    }
+
 public:
     void print(Expr ir) {
         ir.accept(this);
@@ -672,7 +844,10 @@ public:
         scope.pop(m.name());
     }
 
-    StmtToHtml(string filename) : id_count(0), context_stack(1, 0) {
+    StmtToHtml(string filename, const string &profile_filename = "") : id_count(0), context_stack(1, 0) {
+        if (!profile_filename.empty()) {
+            profile = parse_profile(profile_filename);
+        }
         stream.open(filename.c_str());
         stream << "<head>";
         stream << "<style type='text/css'>" << css << "</style>\n";
@@ -704,6 +879,7 @@ div.WrapLine { margin-left: 30px; text-indent:-30px; } \n \
 div.Indent { padding-left: 15px; }\n \
 div.ShowHide { position:absolute; left:-12px; width:12px; height:12px; } \n \
 span.Comment { color: #998; font-style: italic; }\n \
+span.Profile { color: #666; font-style: italic; }\n \
 span.Keyword { color: #333; font-weight: bold; }\n \
 span.Assign { color: #d14; font-weight: bold; }\n \
 span.Symbol { color: #990073; }\n \
@@ -738,8 +914,8 @@ void print_to_html(string filename, Stmt s) {
     sth.print(s);
 }
 
-void print_to_html(string filename, const Module &m) {
-    StmtToHtml sth(filename);
+void print_to_html(string filename, const Module &m, const string &profile_filename) {
+    StmtToHtml sth(filename, profile_filename);
     sth.print(m);
 }
 
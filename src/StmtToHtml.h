@@ -15,8 +15,15 @@ namespace Internal {
  */
 void print_to_html(std::string filename, Stmt s);
 
-/** Dump an HTML-formatted print of a Module to filename. */
-void print_to_html(std::string filename, const Module &m);
+/** Dump an HTML-formatted print of a Module to filename. If
+ * profile_filename is not empty, it is a file holding the report of the
+ * profiler (see Target::Profile) for runs of the same pipeline, and each
+ * producer is annotated with its measured time and memory, on a
+ * background as red as its share of the time. The producers and loops
+ * are then also annotated with the widest vector they store, and the
+ * ratio of the arithmetic to the bytes loaded and stored in their body. */
+void print_to_html(std::string filename, const Module &m,
+                   const std::string &profile_filename = "");
 
 }  // namespace Internal
 }  // namespace Halide
@@ -22,6 +22,7 @@ int64_t next_power_of_two(int64_t x) {
 }  // namespace
 
 using std::map;
+using std::set;
 using std::string;
 using std::vector;
 
@@ -334,9 +335,17 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
             Expr min = simplify(box[dim].min);
             Expr max = simplify(box[dim].max);
 
+            Expr loop_var = Variable::make(Int(32), op->name);
+            if (func.schedule().async()) {
+                // The producer runs up to one iteration ahead of the
+                // consumer, so the storage must hold the footprints
+                // of two consecutive iterations.
+                min = simplify(Min::make(min, substitute(op->name, loop_var + 1, min)));
+                max = simplify(Max::make(max, substitute(op->name, loop_var + 1, max)));
+            }
+
             // Consider the initial iteration and steady state
             // separately for all these proofs.
-            Expr loop_var = Variable::make(Int(32), op->name);
             Expr steady_state = (op->min < loop_var);
 
             Expr min_steady = simplify(substitute(steady_state, const_true(), min));
@@ -383,6 +392,12 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
                     ((min_monotonic_increasing || max_monotonic_decreasing) &&
                      can_prove(extent <= explicit_factor));
                 if (!can_skip_dynamic_checks) {
+                    user_assert(!func.schedule().async())
+                        << "Can't prove that the fold factor (" << explicit_factor
+                        << ") of dimension " << storage_dim.var << " of " << func.name()
+                        << " is large enough to hold two iterations of the loop over " << op->name
+                        << ", which " << func.name() << " needs because it is scheduled async(). "
+                        << "The storage required is " << extent << "\n";
                     // If we didn't find a monotonic dimension, or
                     // couldn't prove the extent was small enough, and we
                     // have an explicit fold factor, we need to
@@ -501,20 +516,214 @@ public:
         : func(f), explicit_only(explicit_only) {}
 };
 
+// Does some IR refer to a func, its buffer, or any of the symbols
+// derived from its name?
+class MentionsFunc : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    bool mentions(const string &name) {
+        return name == func || starts_with(name, func + ".");
+    }
+
+    void visit(const Variable *op) {
+        result = result || mentions(op->name);
+    }
+
+    void visit(const Call *op) {
+        result = result || mentions(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Provide *op) {
+        result = result || mentions(op->name);
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+    MentionsFunc(const string &f) : func(f) {}
+};
+
+template<typename StmtOrExpr>
+bool mentions_func(const StmtOrExpr &s, const string &func) {
+    if (!s.defined()) {
+        return false;
+    }
+    MentionsFunc m(func);
+    s.accept(&m);
+    return m.result;
+}
+
+// Does some IR pass the buffer of a func to an extern stage?
+class UsesFuncBuffer : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        result = result || (starts_with(op->name, func + ".") && ends_with(op->name, ".buffer"));
+    }
+
+public:
+    bool result = false;
+    UsesFuncBuffer(const string &f) : func(f) {}
+};
+
+// The storage of a func realized outside a parallel loop is shared by
+// its iterations, so it can't be folded along a serial loop inside
+// the parallel one (e.g. when the func slides down each of the strips
+// of a parallel stencil). If the func is only used within the
+// parallel loop, and each iteration touches a different part of it,
+// move the realization inside the loop and shrink it to that part, so
+// that each thread gets storage of its own that can be folded. Every
+// iteration already computes everything it uses, because sliding
+// window doesn't slide across parallel loops.
+class SinkRealizeIntoParallelLoop : public IRMutator {
+    const Realize *realize;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        stmt = op;
+        if (op->for_type != ForType::Parallel ||
+            mentions_func(op->min, realize->name) ||
+            mentions_func(op->extent, realize->name)) {
+            // Iterations of serial loops may communicate through the
+            // storage.
+            return;
+        }
+
+        Box b = box_touched(op->body, realize->name);
+        if (b.size() != realize->bounds.size()) {
+            return;
+        }
+        Region bounds;
+        bool varies = false;
+        for (size_t i = 0; i < b.size(); i++) {
+            if (!b[i].is_bounded()) {
+                return;
+            }
+            varies = varies || expr_uses_var(b[i].min, op->name) || expr_uses_var(b[i].max, op->name);
+            bounds.push_back(Range(b[i].min, simplify(b[i].max - b[i].min + 1)));
+        }
+        if (!varies) {
+            // Every iteration touches the same region.
+            return;
+        }
+
+        debug(3) << "Moving the realization of " << realize->name
+                 << " inside the parallel loop over " << op->name << "\n";
+        sunk = true;
+        Stmt body = Realize::make(realize->name, realize->types, realize->memory_type,
+                                  bounds, realize->condition, op->body);
+        stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+    }
+
+    void visit(const LetStmt *op) {
+        if (mentions_func(op->value, realize->name)) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name == realize->name) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Realize *op) {
+        bool bounds_mention_func = mentions_func(op->condition, realize->name);
+        for (const Range &r : op->bounds) {
+            bounds_mention_func = (bounds_mention_func ||
+                                   mentions_func(r.min, realize->name) ||
+                                   mentions_func(r.extent, realize->name));
+        }
+        if (bounds_mention_func) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Block *op) {
+        // Only one side of the block may use the func.
+        bool first = mentions_func(op->first, realize->name);
+        bool rest = mentions_func(op->rest, realize->name);
+        if (first && !rest) {
+            stmt = Block::make(mutate(op->first), op->rest);
+        } else if (rest && !first) {
+            stmt = Block::make(op->first, mutate(op->rest));
+        } else {
+            stmt = op;
+        }
+    }
+
+    void visit(const IfThenElse *op) {
+        stmt = op;
+    }
+
+    void visit(const Allocate *op) {
+        stmt = op;
+    }
+
+public:
+    bool sunk = false;
+    SinkRealizeIntoParallelLoop(const Realize *r) : realize(r) {}
+};
+
 // Look for opportunities for storage folding in a statement
 class StorageFolding : public IRMutator {
     const map<string, Function> &env;
 
+    // The realizations that had storage folded.
+    set<string> folded;
+
     using IRMutator::visit;
 
-    void visit(const Realize *op) {
-        Stmt body = mutate(op->body);
+    bool can_sink_into_parallel_loop(const Realize *op, const Function &func) {
+        if (!func.get_contents().defined() ||
+            func.schedule().async() ||
+            func.schedule().memoized() ||
+            func.has_extern_definition()) {
+            return false;
+        }
+        // Bounds inference doesn't see the region of a buffer read by
+        // an extern stage.
+        UsesFuncBuffer uses(op->name);
+        op->body.accept(&uses);
+        return !uses.result;
+    }
 
+    void visit(const Realize *op) {
         // Get the function associated with this realization, which
         // contains the explicit fold directives from the schedule.
         auto func_it = env.find(op->name);
         Function func = func_it != env.end() ? func_it->second : Function();
 
+        if (can_sink_into_parallel_loop(op, func)) {
+            SinkRealizeIntoParallelLoop sinker(op);
+            Stmt body = sinker.mutate(op->body);
+            if (sinker.sunk) {
+                // Only keep the smaller realizations if we could fold
+                // them; otherwise they just cost an allocation per
+                // iteration.
+                folded.erase(op->name);
+                body = mutate(body);
+                if (folded.count(op->name)) {
+                    stmt = body;
+                    return;
+                }
+            }
+        }
+
+        Stmt body = mutate(op->body);
+
         // Don't attempt automatic storage folding if there is
         // more than one produce node for this func.
         bool explicit_only = count_producers(body, op->name) != 1;
@@ -527,6 +736,7 @@ class StorageFolding : public IRMutator {
         } else if (folder.dims_folded.empty()) {
             stmt = Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body);
         } else {
+            folded.insert(op->name);
             Region bounds = op->bounds;
 
             for (size_t i = 0; i < folder.dims_folded.size(); i++) {
@@ -9,7 +9,7 @@
 #include "LLVM_Headers.h"
 #include "Util.h"
 
-#if defined(__powerpc__) && defined(__linux__)
+#if (defined(__powerpc__) || defined(__riscv)) && defined(__linux__)
 // This uses elf.h and must be included after "LLVM_Headers.h", which
 // uses llvm/support/Elf.h.
 #include <sys/auxv.h>
@@ -90,6 +90,15 @@ Target calculate_host_target() {
     std::vector<Target::Feature> initial_features;
     if (have_vsx)     initial_features.push_back(Target::VSX);
     if (arch_2_07)    initial_features.push_back(Target::POWER_ARCH_2_07);
+#else
+#if defined(__riscv) && defined(__linux__)
+    Target::Arch arch = Target::RISCV;
+
+    // The single-letter extensions, one bit per letter.
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    if (hwcap & (1UL << ('V' - 'A'))) {
+        initial_features.push_back(Target::RVV);
+    }
 #else
     Target::Arch arch = Target::X86;
 
@@ -130,6 +139,7 @@ Target calculate_host_target() {
         const uint32_t avx512bw = 1U << 30;
         const uint32_t avx512vl = 1U << 31;
         const uint32_t avx512ifma = 1U << 21;
+        const uint32_t avx512vnni = 1U << 11; // In ecx
         const uint32_t avx512 = avx512f | avx512cd;
         const uint32_t avx512_knl = avx512 | avx512pf | avx512er;
         const uint32_t avx512_skylake = avx512 | avx512vl | avx512bw | avx512dq;
@@ -148,6 +158,10 @@ Target calculate_host_target() {
             if ((info2[1] & avx512_cannonlake) == avx512_cannonlake) {
                 initial_features.push_back(Target::AVX512_Cannonlake);
             }
+            if ((info2[1] & avx512_skylake) == avx512_skylake &&
+                (info2[2] & avx512vnni) == avx512vnni) {
+                initial_features.push_back(Target::AVX512_VNNI);
+            }
         }
     }
 #ifdef _WIN32
@@ -158,6 +172,7 @@ Target calculate_host_target() {
 
 #endif
 #endif
+#endif
 #endif
 
     return Target(os, arch, bits, initial_features);
@@ -185,6 +200,7 @@ const std::map<std::string, Target::OS> os_name_map = {
     {"ios", Target::IOS},
     {"qurt", Target::QuRT},
     {"noos", Target::NoOS},
+    {"wasmrt", Target::WebAssemblyRuntime},
 };
 
 bool lookup_os(const std::string &tok, Target::OS &result) {
@@ -203,6 +219,8 @@ const std::map<std::string, Target::Arch> arch_name_map = {
     {"mips", Target::MIPS},
     {"powerpc", Target::POWERPC},
     {"hexagon", Target::Hexagon},
+    {"wasm", Target::WebAssembly},
+    {"riscv", Target::RISCV},
 };
 
 bool lookup_arch(const std::string &tok, Target::Arch &result) {
@@ -227,6 +245,7 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"f16c", Target::F16C},
     {"armv7s", Target::ARMv7s},
     {"no_neon", Target::NoNEON},
+    {"arm_dot_prod", Target::ARMDotProd},
     {"vsx", Target::VSX},
     {"power_arch_2_07", Target::POWER_ARCH_2_07},
     {"cuda", Target::CUDA},
@@ -235,6 +254,7 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"cuda_capability_35", Target::CUDACapability35},
     {"cuda_capability_50", Target::CUDACapability50},
     {"cuda_capability_61", Target::CUDACapability61},
+    {"cuda_capability_70", Target::CUDACapability70},
     {"opencl", Target::OpenCL},
     {"cl_doubles", Target::CLDoubles},
     {"cl_half", Target::CLHalf},
@@ -261,6 +281,7 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"avx512_knl", Target::AVX512_KNL},
     {"avx512_skylake", Target::AVX512_Skylake},
     {"avx512_cannonlake", Target::AVX512_Cannonlake},
+    {"avx512_vnni", Target::AVX512_VNNI},
     {"trace_loads", Target::TraceLoads},
     {"trace_stores", Target::TraceStores},
     {"trace_realizations", Target::TraceRealizations},
@@ -270,6 +291,15 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"tsan", Target::TSAN},
     {"asan", Target::ASAN},
     {"check_unsafe_promises", Target::CheckUnsafePromises},
+    {"minimal_runtime", Target::MinimalRuntime},
+    {"plan_memory", Target::PlanMemory},
+    {"plan_layouts", Target::PlanLayouts},
+    {"profile_metrics", Target::ProfileMetrics},
+    {"async_entry", Target::AsyncEntry},
+    {"native_float16", Target::NativeFloat16},
+    {"wasm_simd128", Target::WasmSimd128},
+    {"wasm_threads", Target::WasmThreads},
+    {"rvv", Target::RVV},
     // NOTE: When adding features to this map, be sure to update
     // PyEnums.cpp and halide.cmake as well.
 };
@@ -515,6 +545,12 @@ bool Target::supported() const {
 #if !defined(WITH_HEXAGON)
     bad |= arch == Target::Hexagon;
 #endif
+#if !defined(WITH_WEBASSEMBLY)
+    bad |= arch == Target::WebAssembly;
+#endif
+#if !defined(WITH_RISCV)
+    bad |= arch == Target::RISCV;
+#endif
 #if !defined(WITH_PTX)
     bad |= has_feature(Target::CUDA);
 #endif
@@ -673,13 +709,15 @@ int Target::natural_vector_size(const Halide::Type &t) const {
         }
     } else if (arch == Target::X86) {
         if (is_integer && (has_feature(Halide::Target::AVX512_Skylake) ||
-                           has_feature(Halide::Target::AVX512_Cannonlake))) {
-            // AVX512BW exists on Skylake and Cannonlake
+                           has_feature(Halide::Target::AVX512_Cannonlake) ||
+                           has_feature(Halide::Target::AVX512_VNNI))) {
+            // AVX512BW exists on Skylake, Cannonlake and Cascade Lake
             return 64 / data_size;
         } else if (t.is_float() && (has_feature(Halide::Target::AVX512) ||
                                     has_feature(Halide::Target::AVX512_KNL) ||
                                     has_feature(Halide::Target::AVX512_Skylake) ||
-                                    has_feature(Halide::Target::AVX512_Cannonlake))) {
+                                    has_feature(Halide::Target::AVX512_Cannonlake) ||
+                                    has_feature(Halide::Target::AVX512_VNNI))) {
             // AVX512F is on all AVX512 architectures
             return 64 / data_size;
         } else if (has_feature(Halide::Target::AVX2)) {
@@ -693,6 +731,13 @@ int Target::natural_vector_size(const Halide::Type &t) const {
             // SSE was all 128-bit. We ignore MMX.
             return 16 / data_size;
         }
+    } else if (arch == Target::WebAssembly) {
+        // Without SIMD128, WebAssembly has no vector registers.
+        return has_feature(Halide::Target::WasmSimd128) ? 16 / data_size : 1;
+    } else if (arch == Target::RISCV) {
+        // The V extension guarantees vectors of at least 128 bits, and
+        // without it there are no vector registers.
+        return has_feature(Halide::Target::RVV) ? 16 / data_size : 1;
     } else {
         // Assume 128-bit vectors on other targets.
         return 16 / data_size;
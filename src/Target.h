@@ -22,7 +22,7 @@ struct Target {
     /** The operating system used by the target. Determines which
      * system calls to generate.
      * Corresponds to os_name_map in Target.cpp. */
-    enum OS {OSUnknown = 0, Linux, Windows, OSX, Android, IOS, QuRT, NoOS} os;
+    enum OS {OSUnknown = 0, Linux, Windows, OSX, Android, IOS, QuRT, NoOS, WebAssemblyRuntime} os;
 
     /** The architecture used by the target. Determines the
      * instruction set to use.
@@ -34,6 +34,8 @@ struct Target {
         MIPS,
         Hexagon,
         POWERPC,
+        WebAssembly,
+        RISCV,
     } arch;
 
     /** The bit-width of the target machine. Must be 0 for unknown, or 32 or 64. */
@@ -56,6 +58,7 @@ struct Target {
         F16C = halide_target_feature_f16c,
         ARMv7s = halide_target_feature_armv7s,
         NoNEON = halide_target_feature_no_neon,
+        ARMDotProd = halide_target_feature_arm_dot_prod,
         VSX = halide_target_feature_vsx,
         POWER_ARCH_2_07 = halide_target_feature_power_arch_2_07,
         CUDA = halide_target_feature_cuda,
@@ -64,6 +67,7 @@ struct Target {
         CUDACapability35 = halide_target_feature_cuda_capability35,
         CUDACapability50 = halide_target_feature_cuda_capability50,
         CUDACapability61 = halide_target_feature_cuda_capability61,
+        CUDACapability70 = halide_target_feature_cuda_capability70,
         OpenCL = halide_target_feature_opencl,
         CLDoubles = halide_target_feature_cl_doubles,
         CLHalf = halide_target_feature_cl_half,
@@ -90,6 +94,7 @@ struct Target {
         AVX512_KNL = halide_target_feature_avx512_knl,
         AVX512_Skylake = halide_target_feature_avx512_skylake,
         AVX512_Cannonlake = halide_target_feature_avx512_cannonlake,
+        AVX512_VNNI = halide_target_feature_avx512_vnni,
         TraceLoads = halide_target_feature_trace_loads,
         TraceStores = halide_target_feature_trace_stores,
         TraceRealizations = halide_target_feature_trace_realizations,
@@ -99,6 +104,15 @@ struct Target {
         TSAN = halide_target_feature_tsan,
         ASAN = halide_target_feature_asan,
         CheckUnsafePromises = halide_target_feature_check_unsafe_promises,
+        MinimalRuntime = halide_target_feature_minimal_runtime,
+        PlanMemory = halide_target_feature_plan_memory,
+        PlanLayouts = halide_target_feature_plan_layouts,
+        ProfileMetrics = halide_target_feature_profile_metrics,
+        AsyncEntry = halide_target_feature_async_entry,
+        NativeFloat16 = halide_target_feature_native_float16,
+        WasmSimd128 = halide_target_feature_wasm_simd128,
+        WasmThreads = halide_target_feature_wasm_threads,
+        RVV = halide_target_feature_rvv,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
@@ -136,20 +136,32 @@ public:
     }
 };
 
+// Exceptions thrown by a job are rethrown by the get() of its future rather
+// than terminating the worker thread.
 template<typename T>
 inline void ThreadPool<T>::Job::run_unlocked(std::unique_lock<std::mutex> &unique_lock) {
     unique_lock.unlock();
-    T r = func();
-    unique_lock.lock();
-    result.set_value(std::move(r));
+    try {
+        T r = func();
+        unique_lock.lock();
+        result.set_value(std::move(r));
+    } catch (...) {
+        unique_lock.lock();
+        result.set_exception(std::current_exception());
+    }
 }
 
 template<>
 inline void ThreadPool<void>::Job::run_unlocked(std::unique_lock<std::mutex> &unique_lock) {
     unique_lock.unlock();
-    func();
-    unique_lock.lock();
-    result.set_value();
+    try {
+        func();
+        unique_lock.lock();
+        result.set_value();
+    } catch (...) {
+        unique_lock.lock();
+        result.set_exception(std::current_exception());
+    }
 }
 
 
@@ -164,6 +164,7 @@ HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(uint32_t);
 HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(int64_t);
 HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(uint64_t);
 HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(Halide::float16_t);
+HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(Halide::bfloat16_t);
 HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(float);
 HALIDE_DECLARE_EXTERN_SIMPLE_TYPE(double);
 HALIDE_DECLARE_EXTERN_STRUCT_TYPE(buffer_t);
@@ -275,6 +276,7 @@ struct Type {
     static const halide_type_code_t UInt = halide_type_uint;
     static const halide_type_code_t Float = halide_type_float;
     static const halide_type_code_t Handle = halide_type_handle;
+    static const halide_type_code_t BFloat = halide_type_bfloat;
     // @}
 
     /** The number of bytes required to store a single scalar value of this type. Ignores vector lanes. */
@@ -346,8 +348,11 @@ struct Type {
      * TODO(abadams): Decide what to do for lanes() == 0. */
     bool is_scalar() const {return lanes() == 1;}
 
-    /** Is this type a floating point type (float or double). */
-    bool is_float() const {return code() == Float;}
+    /** Is this type a floating point type (float, double, or bfloat). */
+    bool is_float() const {return code() == Float || code() == BFloat;}
+
+    /** Is this type a bfloat? (the upper half of a float) */
+    bool is_bfloat() const {return code() == BFloat;}
 
     /** Is this type a signed integer type? */
     bool is_int() const {return code() == Int;}
@@ -429,6 +434,12 @@ inline Type Float(int bits, int lanes = 1) {
     return Type(Type::Float, bits, lanes);
 }
 
+/** Construct a bfloat type. Only bfloat16 exists: it is stored as the
+ * upper 16 bits of a float, and arithmetic on it is done in float. */
+inline Type BFloat(int bits, int lanes = 1) {
+    return Type(Type::BFloat, bits, lanes);
+}
+
 /** Construct a boolean type */
 inline Type Bool(int lanes = 1) {
     return UInt(1, lanes);
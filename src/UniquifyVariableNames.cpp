@@ -1,5 +1,6 @@
 #include "UniquifyVariableNames.h"
 #include "IRMutator.h"
+#include "Scope.h"
 #include <sstream>
 
 namespace Halide {
@@ -103,5 +104,64 @@ Stmt uniquify_variable_names(Stmt s) {
     return u.mutate(s);
 }
 
+namespace {
+
+// Is this a name made by unique_name, e.g. t123 or foo$4?
+bool is_generated_name(const string &name) {
+    size_t dollar = name.rfind('$');
+    size_t digits = (dollar != string::npos) ? dollar + 1 : 1;
+    if (name.size() <= digits || (dollar == string::npos && isdigit(name[0]))) {
+        return false;
+    }
+    for (size_t i = digits; i < name.size(); i++) {
+        if (!isdigit(name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class CanonicalizeGeneratedNames : public IRMutator2 {
+
+    using IRMutator2::visit;
+
+    Scope<string> renamed;
+    int count = 0;
+
+    string rename(const string &name) {
+        return is_generated_name(name) ? "$" + std::to_string(count++) : name;
+    }
+
+    Stmt visit(const LetStmt *op) override {
+        Expr value = mutate(op->value);
+        string new_name = rename(op->name);
+        ScopedBinding<string> bind(renamed, op->name, new_name);
+        Stmt body = mutate(op->body);
+        return LetStmt::make(new_name, value, body);
+    }
+
+    Expr visit(const Let *op) override {
+        Expr value = mutate(op->value);
+        string new_name = rename(op->name);
+        ScopedBinding<string> bind(renamed, op->name, new_name);
+        Expr body = mutate(op->body);
+        return Let::make(new_name, value, body);
+    }
+
+    Expr visit(const Variable *op) override {
+        if (renamed.contains(op->name)) {
+            return Variable::make(op->type, renamed.get(op->name));
+        } else {
+            return op;
+        }
+    }
+};
+
+}  // namespace
+
+Stmt canonicalize_generated_names(Stmt s) {
+    return CanonicalizeGeneratedNames().mutate(s);
+}
+
 }  // namespace Internal
 }  // namespace Halide
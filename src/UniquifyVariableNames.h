@@ -15,6 +15,13 @@ namespace Internal {
  * semantic equivalence. */
 Stmt uniquify_variable_names(Stmt s);
 
+/** Rename the variables defined by lets whose names were made by
+ * unique_name to names numbered in order of definition. The same
+ * pipeline lowered twice then gives equal IR, even though unique_name
+ * returns new names every time. The result is only meant to be
+ * compared, not compiled. */
+Stmt canonicalize_generated_names(Stmt s);
+
 }  // namespace Internal
 }  // namespace Halide
 
@@ -231,6 +231,27 @@ bool uses_gpu_vars(Expr s) {
     return uses.uses_gpu;
 }
 
+class LoadsFrom : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &buffer;
+
+    void visit(const Load *op) {
+        result = result || op->name == buffer;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+    LoadsFrom(const string &buffer) : buffer(buffer) {}
+};
+
+bool loads_from(Expr e, const string &buffer) {
+    LoadsFrom loads(buffer);
+    e.accept(&loads);
+    return loads.result;
+}
+
 // Wrap a vectorized predicate around a Load/Store node.
 class PredicateLoadStore : public IRMutator2 {
     string var;
@@ -249,8 +270,22 @@ class PredicateLoadStore : public IRMutator2 {
                 << "We are inside a hexagon loop, but the target doesn't have hexagon's features\n";
             return true;
         } else if (target.arch == Target::X86) {
-            // Should only attempt to predicate store/load if the lane size is
-            // no less than 4
+            // Only predicate the loads and stores that have masked
+            // instructions, so that the tails of vectorized loops stay
+            // vectorized. AVX-512 has masks for all lane sizes with
+            // AVX512BW (skylake and later), and for 32 and 64-bit lanes
+            // without. AVX has vmaskmov for 32 and 64-bit lanes.
+            if (target.features_any_of({Target::AVX512_Skylake,
+                                        Target::AVX512_Cannonlake,
+                                        Target::AVX512_VNNI})) {
+                return true;
+            } else if (target.features_any_of({Target::AVX512, Target::AVX512_KNL})) {
+                return bit_size >= 32;
+            } else if (target.has_feature(Target::AVX)) {
+                return (bit_size >= 32) && (bit_size * lanes >= 128);
+            }
+            // Otherwise, should only attempt to predicate store/load if
+            // the lane size is 32 bits and there are no less than 4 lanes.
             return (bit_size == 32) && (lanes >= 4);
         }
         // For other architecture, do not predicate vector load/store
@@ -331,6 +366,13 @@ class PredicateLoadStore : public IRMutator2 {
         return IRMutator2::visit(op);
     }
 
+    Expr visit(const VectorReduce *op) override {
+        // Masked-off lanes of a predicated load are undefined, and
+        // would be reduced along with the others.
+        valid = false;
+        return op;
+    }
+
 public:
     PredicateLoadStore(string v, Expr vpred, bool in_hexagon, const Target &t) :
             var(v), vector_predicate(vpred), in_hexagon(in_hexagon), target(t),
@@ -683,18 +725,179 @@ class VectorSubs : public IRMutator2 {
         }
     }
 
+    bool is_self_load(const Store *op, const Expr &e) {
+        const Load *load = e.as<Load>();
+        return (load && load->name == op->name &&
+                equal(load->index, op->index) &&
+                equal(load->predicate, op->predicate));
+    }
+
+    // If e combines the Load of op's location with other terms by
+    // reduce_op, return the combination of the other terms, e.g. g[r] + 3
+    // for (f[x] + g[r]) + 3. Otherwise return an undefined Expr.
+    Expr without_self_load(const Store *op, VectorReduce::Operator reduce_op, const Expr &e, Expr &self) {
+        Expr a, b;
+        bool is_sub = false;
+        if (const Add *add = e.as<Add>()) {
+            if (reduce_op != VectorReduce::Add) return Expr();
+            a = add->a, b = add->b;
+        } else if (const Sub *sub = e.as<Sub>()) {
+            if (reduce_op != VectorReduce::Add) return Expr();
+            a = sub->a, b = sub->b, is_sub = true;
+        } else if (const Mul *mul = e.as<Mul>()) {
+            if (reduce_op != VectorReduce::Mul) return Expr();
+            a = mul->a, b = mul->b;
+        } else if (const Min *min = e.as<Min>()) {
+            if (reduce_op != VectorReduce::Min) return Expr();
+            a = min->a, b = min->b;
+        } else if (const Max *max = e.as<Max>()) {
+            if (reduce_op != VectorReduce::Max) return Expr();
+            a = max->a, b = max->b;
+        } else {
+            return Expr();
+        }
+
+        auto combine = [&](Expr x, Expr y) -> Expr {
+            switch (reduce_op) {
+            case VectorReduce::Add:
+                return is_sub ? Sub::make(x, y) : Add::make(x, y);
+            case VectorReduce::Mul:
+                return Mul::make(x, y);
+            case VectorReduce::Min:
+                return Min::make(x, y);
+            default:
+                return Max::make(x, y);
+            }
+        };
+
+        if (is_self_load(op, a)) {
+            self = a;
+            return is_sub ? Sub::make(make_zero(b.type()), b) : b;
+        } else if (!is_sub && is_self_load(op, b)) {
+            self = b;
+            return a;
+        }
+        Expr rest = without_self_load(op, reduce_op, a, self);
+        if (rest.defined()) {
+            return combine(rest, b);
+        }
+        if (!is_sub) {
+            rest = without_self_load(op, reduce_op, b, self);
+            if (rest.defined()) {
+                return combine(a, rest);
+            }
+        }
+        return Expr();
+    }
+
+    // Match a Store of a combination of the value at the same location
+    // with something else, by one of the operators of VectorReduce,
+    // e.g. f[x] = f[x] + g[r]. Sets the Load of the location and the
+    // other operand. Subtraction is matched as the addition of the
+    // negation, and the other operand may be spread over a chain of the
+    // operator, as the simplifier leaves e.g. f[x] - g[r] for
+    // f[x] + g[r]*-1 and (f[x] + g[r]) + 3 for f[x] + (g[r] + 3).
+    bool is_reduction(const Store *op, VectorReduce::Operator &reduce_op, Expr &self, Expr &operand) {
+        if (op->value.as<Add>() || op->value.as<Sub>()) {
+            reduce_op = VectorReduce::Add;
+        } else if (op->value.as<Mul>()) {
+            reduce_op = VectorReduce::Mul;
+        } else if (op->value.as<Min>()) {
+            reduce_op = VectorReduce::Min;
+        } else if (op->value.as<Max>()) {
+            reduce_op = VectorReduce::Max;
+        } else {
+            return false;
+        }
+        operand = without_self_load(op, reduce_op, op->value, self);
+        return operand.defined() && !loads_from(operand, op->name);
+    }
+
+    // Update the location once with the reduction of the lanes of the
+    // operand.
+    Stmt reduce_lanes(const Store *op, VectorReduce::Operator reduce_op, Expr self, Expr operand,
+                      Expr index, Expr predicate) {
+        operand = VectorReduce::make(reduce_op, operand, 1);
+        Expr value;
+        switch (reduce_op) {
+        case VectorReduce::Add:
+            value = Add::make(self, operand);
+            break;
+        case VectorReduce::Mul:
+            value = Mul::make(self, operand);
+            break;
+        case VectorReduce::Min:
+            value = Min::make(self, operand);
+            break;
+        default:
+            value = Max::make(self, operand);
+            break;
+        }
+        return Store::make(op->name, value, index, op->param, predicate);
+    }
+
+    // A Store of an update vectorized over one of its RVars without
+    // allow_race_conditions(). Func.cpp only allows that when every
+    // lane updates the same location (see is_vectorizable_reduction),
+    // so the lanes have to be reduced; storing them would have them all
+    // race for the one location.
+    Stmt visit_vectorized_reduction(const Store *op, const Call *mark) {
+        const StringImm *loop = mark->args[1].as<StringImm>();
+        internal_assert(loop);
+        Stmt unmarked = Store::make(op->name, mark->args[0], op->index, op->param, op->predicate);
+        if (loop->value != var) {
+            // The loop was made serial, as it is inside another
+            // vectorized loop.
+            return mutate(unmarked);
+        }
+        op = unmarked.as<Store>();
+
+        Expr predicate = mutate(op->predicate);
+        Expr index = mutate(op->index);
+        VectorReduce::Operator reduce_op;
+        Expr self, operand;
+        internal_assert(index.type().is_scalar() && predicate.type().is_scalar() &&
+                        is_reduction(op, reduce_op, self, operand))
+            << "Vectorized update over " << var << " is not a reduction into one location:\n"
+            << unmarked << "\n";
+
+        // If simplification left the operand the same in every lane,
+        // there are still that many lanes to reduce.
+        operand = widen(mutate(operand), replacement.type().lanes());
+        return reduce_lanes(op, reduce_op, mutate(self), operand, index, predicate);
+    }
+
     Stmt visit(const Store *op) override {
+        if (const Call *c = op->value.as<Call>()) {
+            if (c->is_intrinsic(Call::vectorized_reduction)) {
+                return visit_vectorized_reduction(op, c);
+            }
+        }
+
         Expr predicate = mutate(op->predicate);
         Expr value = mutate(op->value);
         Expr index = mutate(op->index);
 
         if (predicate.same_as(op->predicate) && value.same_as(op->value) && index.same_as(op->index)) {
             return op;
-        } else {
-            int lanes = std::max(predicate.type().lanes(), std::max(value.type().lanes(), index.type().lanes()));
-            return Store::make(op->name, widen(value, lanes), widen(index, lanes),
-                               op->param, widen(predicate, lanes));
         }
+
+        VectorReduce::Operator reduce_op;
+        Expr self, operand;
+        if (index.type().is_scalar() && predicate.type().is_scalar() &&
+            is_reduction(op, reduce_op, self, operand)) {
+            // Every lane updates the same location, e.g. in a sum over
+            // a vectorized RVar. Reduce the lanes of the other operand,
+            // and then update the location once.
+            operand = mutate(operand);
+            if (operand.type().is_vector()) {
+                return reduce_lanes(op, reduce_op, mutate(self), operand, index, predicate);
+            }
+        }
+
+        int lanes = std::max(predicate.type().lanes(), std::max(value.type().lanes(), index.type().lanes()));
+        return Store::make(op->name, widen(value, lanes), widen(index, lanes),
+                           op->param, widen(predicate, lanes));
     }
 
     Stmt visit(const AssertStmt *op) override {
@@ -983,10 +1186,24 @@ public:
     VectorizeLoops(const Target &t) : target(t), in_hexagon(false) {}
 };
 
+// Remove the marks left on vectorized reductions that were scalarized
+// instead, or whose loop was removed for having an extent of one.
+class RemoveVectorizedReductionMarks : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr visit(const Call *op) override {
+        if (op->is_intrinsic(Call::vectorized_reduction)) {
+            return mutate(op->args[0]);
+        }
+        return IRMutator2::visit(op);
+    }
+};
+
 }  // Anonymous namespace
 
 Stmt vectorize_loops(Stmt s, const Target &t) {
-    return VectorizeLoops(t).mutate(s);
+    s = VectorizeLoops(t).mutate(s);
+    return RemoveVectorizedReductionMarks().mutate(s);
 }
 
 }  // namespace Internal
@@ -0,0 +1,193 @@
+#include "WidenFloat16Math.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+bool is_float16(const Type &t) {
+    return t.code() == Type::Float && t.bits() == 16;
+}
+
+class WidenFloat16Math : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const map<string, Function> &env;
+    const Target &target;
+
+    // The device of the loop being computed, and whether the Func
+    // being computed allows native float16 math.
+    DeviceAPI device = DeviceAPI::Host;
+    bool func_allows_native = true;
+
+    bool native_float16() const {
+        if (!func_allows_native || !target.has_feature(Target::NativeFloat16)) {
+            return false;
+        }
+        switch (device) {
+        case DeviceAPI::Host:
+            return target.arch == Target::ARM;
+        case DeviceAPI::CUDA:
+            return (target.has_feature(Target::CUDACapability61) ||
+                    target.has_feature(Target::CUDACapability70));
+        case DeviceAPI::Metal:
+        case DeviceAPI::OpenCL:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // The float version of a float16 math function, or the empty
+    // string if op isn't one.
+    static string float_math_function(const Call *op) {
+        if (op->call_type != Call::PureExtern || !ends_with(op->name, "_f16")) {
+            return "";
+        }
+        for (const Expr &e : op->args) {
+            if (!is_float16(e.type())) {
+                return "";
+            }
+        }
+        return op->name.substr(0, op->name.size() - 4) + "_f32";
+    }
+
+    Expr widen_math_function(const Call *op, const string &name) {
+        vector<Expr> args;
+        for (const Expr &e : op->args) {
+            args.push_back(widen(e));
+        }
+        Type t = is_float16(op->type) ? op->type.with_bits(32) : op->type;
+        return Call::make(t, name, args, Call::PureExtern);
+    }
+
+    // The value of a float16 expression, computed in float.
+    Expr widen(const Expr &e) {
+        Type f32 = e.type().with_bits(32);
+        if (const Add *op = e.as<Add>()) {
+            return Add::make(widen(op->a), widen(op->b));
+        } else if (const Sub *op = e.as<Sub>()) {
+            return Sub::make(widen(op->a), widen(op->b));
+        } else if (const Mul *op = e.as<Mul>()) {
+            return Mul::make(widen(op->a), widen(op->b));
+        } else if (const Div *op = e.as<Div>()) {
+            return Div::make(widen(op->a), widen(op->b));
+        } else if (const Mod *op = e.as<Mod>()) {
+            return Mod::make(widen(op->a), widen(op->b));
+        } else if (const Min *op = e.as<Min>()) {
+            return Min::make(widen(op->a), widen(op->b));
+        } else if (const Max *op = e.as<Max>()) {
+            return Max::make(widen(op->a), widen(op->b));
+        } else if (const Select *op = e.as<Select>()) {
+            return Select::make(mutate(op->condition), widen(op->true_value), widen(op->false_value));
+        } else if (const FloatImm *op = e.as<FloatImm>()) {
+            // Every float16 is exactly a float.
+            return FloatImm::make(f32, op->value);
+        } else if (const Broadcast *op = e.as<Broadcast>()) {
+            return Broadcast::make(widen(op->value), op->lanes);
+        } else if (const Ramp *op = e.as<Ramp>()) {
+            return Ramp::make(widen(op->base), widen(op->stride), op->lanes);
+        } else if (const Call *op = e.as<Call>()) {
+            if (op->is_intrinsic(Call::abs)) {
+                return Call::make(f32, Call::abs, {widen(op->args[0])}, Call::PureIntrinsic);
+            }
+            string name = float_math_function(op);
+            if (!name.empty()) {
+                return widen_math_function(op, name);
+            }
+        }
+        // Loads, variables, explicit casts to float16 and other calls
+        // are rounded already.
+        return Cast::make(f32, mutate(e));
+    }
+
+    template<typename T>
+    Expr visit_arithmetic(const T *op) {
+        if (is_float16(op->type) && !native_float16()) {
+            return Cast::make(op->type, widen(op));
+        }
+        return IRMutator2::visit(op);
+    }
+
+    template<typename T>
+    Expr visit_comparison(const T *op) {
+        if (is_float16(op->a.type()) && !native_float16()) {
+            return T::make(widen(op->a), widen(op->b));
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Add *op) override { return visit_arithmetic(op); }
+    Expr visit(const Sub *op) override { return visit_arithmetic(op); }
+    Expr visit(const Mul *op) override { return visit_arithmetic(op); }
+    Expr visit(const Div *op) override { return visit_arithmetic(op); }
+    Expr visit(const Mod *op) override { return visit_arithmetic(op); }
+    Expr visit(const Min *op) override { return visit_arithmetic(op); }
+    Expr visit(const Max *op) override { return visit_arithmetic(op); }
+    Expr visit(const Select *op) override { return visit_arithmetic(op); }
+    Expr visit(const EQ *op) override { return visit_comparison(op); }
+    Expr visit(const NE *op) override { return visit_comparison(op); }
+    Expr visit(const LT *op) override { return visit_comparison(op); }
+    Expr visit(const LE *op) override { return visit_comparison(op); }
+    Expr visit(const GT *op) override { return visit_comparison(op); }
+    Expr visit(const GE *op) override { return visit_comparison(op); }
+
+    Expr visit(const Cast *op) override {
+        if (is_float16(op->value.type()) && !is_float16(op->type) && !native_float16()) {
+            Expr f = widen(op->value);
+            return f.type() == op->type ? f : Cast::make(op->type, f);
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Call *op) override {
+        string name = float_math_function(op);
+        if (!name.empty() && (device == DeviceAPI::Host || !native_float16())) {
+            Expr result = widen_math_function(op, name);
+            return result.type() == op->type ? result : Cast::make(op->type, result);
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const For *op) override {
+        DeviceAPI old_device = device;
+        if (op->device_api != DeviceAPI::None) {
+            device = op->device_api;
+        }
+        Stmt s = IRMutator2::visit(op);
+        device = old_device;
+        return s;
+    }
+
+    Stmt visit(const ProducerConsumer *op) override {
+        auto it = env.find(op->name);
+        if (!op->is_producer || it == env.end()) {
+            return IRMutator2::visit(op);
+        }
+        bool old_func_allows_native = func_allows_native;
+        func_allows_native = !it->second.schedule().widen_float16_math();
+        Stmt s = IRMutator2::visit(op);
+        func_allows_native = old_func_allows_native;
+        return s;
+    }
+
+public:
+    WidenFloat16Math(const map<string, Function> &env, const Target &t) : env(env), target(t) {}
+};
+
+}  // namespace
+
+Stmt widen_float16_math(Stmt s, const map<string, Function> &env, const Target &t) {
+    return WidenFloat16Math(env, t).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
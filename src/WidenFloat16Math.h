@@ -0,0 +1,34 @@
+#ifndef HALIDE_WIDEN_FLOAT16_MATH_H
+#define HALIDE_WIDEN_FLOAT16_MATH_H
+
+/** \file
+ * Defines the lowering pass that computes float16 math in float
+ */
+
+#include <map>
+
+#include "IR.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Compute the float16 arithmetic, comparisons and math functions in
+ * float, except where the target has native float16 math and the Func
+ * being computed allows it. Each float16 expression is computed in
+ * float as a whole, and only rounded to float16 where its value is
+ * stored, bound to a name, or passed to a call, so chains of
+ * operations don't round at every step. Float16 math is native with
+ * Target::NativeFloat16 on ARM, in CUDA kernels of compute capability
+ * 6.1 or higher, and in Metal and OpenCL kernels; Funcs scheduled
+ * with Func::widen_float16_math compute in float everywhere. The math
+ * functions are always computed in float on the CPU, which has no
+ * float16 versions of them. */
+Stmt widen_float16_math(Stmt s, const std::map<std::string, Function> &env, const Target &t);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
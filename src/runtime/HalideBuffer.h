@@ -17,6 +17,16 @@
 
 #include "HalideRuntime.h"
 
+// Buffer::map_file requires POSIX mmap.
+#if !defined(HALIDE_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define HALIDE_BUFFER_HAS_MMAP 1
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifdef _MSC_VER
 #define HALIDE_ALLOCA _alloca
 #else
@@ -66,6 +76,37 @@ struct AllocationHeader {
     AllocationHeader(void (*deallocate_fn)(void *)) : deallocate_fn(deallocate_fn), ref_count(1) {}
 };
 
+/** How Buffer::map_file should map a file. */
+enum struct MapFileMode : int {
+    /** Map an existing file read-only. Writing to the Buffer will fault. */
+    Read,
+    /** Map an existing file. Writes to the Buffer go to the file. */
+    ReadWrite,
+    /** Create the file, or truncate it if it exists, resize it to fit
+     * the Buffer, and map it read-write. The Buffer starts out zero. */
+    Create,
+};
+
+/** Hints to the OS about how a Buffer made by Buffer::map_file will
+ * be accessed. May be or'd together. */
+struct MapFileHint {
+    enum {
+        None = 0,
+        /** The Buffer will be accessed in memory order, so read ahead
+         * aggressively and drop pages soon after they're used. */
+        Sequential = 1 << 0,
+        /** The Buffer will be accessed in no particular order, so
+         * don't read ahead. */
+        Random = 1 << 1,
+        /** Read the whole file in up front, rather than on first
+         * touch. */
+        Populate = 1 << 2,
+        /** Back the mapping with transparent huge pages where the OS
+         * and filesystem support it. */
+        HugePages = 1 << 3,
+    };
+};
+
 /** This indicates how to deallocate the device for a Halide::Runtime::Buffer. */
 enum struct BufferDeviceOwnership : int {
     Allocated,     ///> halide_device_free will be called when device ref count goes to zero
@@ -1141,18 +1182,18 @@ public:
         Buffer<const T, D> src(other);
         Buffer<T, D> dst(*this);
 
-        assert(src.dimensions() == dst.dimensions());
+        if (!crop_to_intersection(dst, src)) {
+            return;
+        }
 
-        // Trim the copy to the region in common
-        for (int i = 0; i < dimensions(); i++) {
-            int min_coord = std::max(dst.dim(i).min(), src.dim(i).min());
-            int max_coord = std::min(dst.dim(i).max(), src.dim(i).max());
-            if (max_coord < min_coord) {
-                // The buffers do not overlap.
-                return;
-            }
-            dst.crop(i, min_coord, max_coord - min_coord + 1);
-            src.crop(i, min_coord, max_coord - min_coord + 1);
+        // If both buffers are dense in the innermost dimension of the
+        // traversal, copy whole runs of values at a time.
+        for_each_value_task_dim<2> *t =
+            (for_each_value_task_dim<2> *)HALIDE_ALLOCA((dimensions()+1) * sizeof(for_each_value_task_dim<2>));
+        if (dst.for_each_value_prep(t, src)) {
+            copy_runs(dimensions() - 1, t, (uint8_t *)dst.begin(), (const uint8_t *)src.begin(), type().bytes());
+            set_host_dirty();
+            return;
         }
 
         // If T is void, we need to do runtime dispatch to an
@@ -1184,6 +1225,30 @@ public:
         set_host_dirty();
     }
 
+    /** Like copy_from, but split the copy into tasks along the
+     * outermost dimension, and run them with halide_do_par_for (see
+     * par_for_each_value). */
+    template<typename T2, int D2>
+    void par_copy_from(const Buffer<T2, D2> &other) {
+        assert(!device_dirty() && "Cannot call Halide::Runtime::Buffer::par_copy_from on a device dirty destination.");
+        assert(!other.device_dirty() && "Cannot call Halide::Runtime::Buffer::par_copy_from on a device dirty source.");
+
+        Buffer<const T, D> src(other);
+        Buffer<T, D> dst(*this);
+
+        if (!crop_to_intersection(dst, src)) {
+            return;
+        }
+
+        bool parallel = dst.par_for_each_slice([&](int d, int min, int extent) {
+            dst.host_view_cropped(d, min, extent).copy_from(src.host_view_cropped(d, min, extent));
+        });
+        if (!parallel) {
+            dst.copy_from(src);
+        }
+        set_host_dirty();
+    }
+
     /** Make an image that refers to a sub-range of this image along
      * the given dimension. Asserts that the crop region is within
      * the existing bounds: you cannot "crop outwards", even if you know there
@@ -1536,7 +1601,15 @@ public:
     }
 
     int device_and_host_malloc(const struct halide_device_interface_t *device_interface, void *ctx = nullptr) {
-        return device_interface->device_and_host_malloc(ctx, &buf, device_interface);
+        assert(device_interface);
+        int ret = device_interface->device_and_host_malloc(ctx, &buf, device_interface);
+        if (ret == 0) {
+            // Free both allocations together when the last reference goes
+            // away.
+            dev_ref_count = new DeviceRefCount;
+            dev_ref_count->ownership = BufferDeviceOwnership::AllocatedDeviceAndHost;
+        }
+        return ret;
     }
 
     int device_and_host_free(const struct halide_device_interface_t *device_interface, void *ctx = nullptr) {
@@ -1693,8 +1766,116 @@ public:
         return dst;
     }
 
+#ifdef HALIDE_BUFFER_HAS_MMAP
+    /** Make a Buffer over the contents of a file using mmap, rather
+     * than copying the file in with read() and out with write(). The
+     * data starts offset bytes into the file, densely packed in the
+     * same planar layout as the Buffer(halide_type_t, sizes)
+     * constructor uses. Pages are read in as they are touched (unless
+     * MapFileHint::Populate is given), and writes to a writable
+     * mapping go back to the file, so a Buffer much larger than RAM
+     * can be used as a pipeline input or realized into as an output.
+     *
+     * The Buffer owns the mapping, which is released when the last
+     * Buffer sharing it is destroyed. If the file can't be opened, is
+     * too small, or can't be mapped, returns a Buffer of the
+     * requested shape with no host memory (data() is null), and errno
+     * says why. */
+    static Buffer<T, D> map_file(const char *path, halide_type_t t, const std::vector<int> &sizes,
+                                 MapFileMode mode = MapFileMode::Read,
+                                 int hints = MapFileHint::None,
+                                 size_t offset = 0) {
+        Buffer<T, D> im(t, nullptr, sizes);
+        if (any_zero(sizes)) {
+            return im;
+        }
+        im.check_overflow();
+        const size_t length = offset + im.size_in_bytes();
+
+        int flags = mode == MapFileMode::Read ? O_RDONLY : O_RDWR;
+        if (mode == MapFileMode::Create) {
+            flags |= O_CREAT | O_TRUNC;
+        }
+        int fd = open(path, flags, 0644);
+        if (fd < 0) {
+            return im;
+        }
+
+        bool ok;
+        if (mode == MapFileMode::Create) {
+            ok = ftruncate(fd, (off_t)length) == 0;
+        } else {
+            struct stat st;
+            ok = fstat(fd, &st) == 0;
+            if (ok && (size_t)st.st_size < length) {
+                errno = EINVAL;
+                ok = false;
+            }
+        }
+
+        void *addr = MAP_FAILED;
+        if (ok) {
+            int prot = PROT_READ | (mode == MapFileMode::Read ? 0 : PROT_WRITE);
+            int map_flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+            if (hints & MapFileHint::Populate) {
+                map_flags |= MAP_POPULATE;
+            }
+#endif
+            addr = mmap(nullptr, length, prot, map_flags, fd, 0);
+        }
+        // The mapping holds its own reference to the file.
+        close(fd);
+        if (addr == MAP_FAILED) {
+            return im;
+        }
+
+        // The hints are only advice, so ignore failures.
+        if (hints & MapFileHint::Sequential) {
+            (void)madvise(addr, length, MADV_SEQUENTIAL);
+        }
+        if (hints & MapFileHint::Random) {
+            (void)madvise(addr, length, MADV_RANDOM);
+        }
+#ifndef MAP_POPULATE
+        if (hints & MapFileHint::Populate) {
+            (void)madvise(addr, length, MADV_WILLNEED);
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        if (hints & MapFileHint::HugePages) {
+            (void)madvise(addr, length, MADV_HUGEPAGE);
+        }
+#endif
+
+        void *header_storage = malloc(sizeof(MappedFileHeader));
+        im.alloc = new (header_storage) MappedFileHeader(addr, length);
+        im.buf.host = (uint8_t *)addr + offset;
+        return im;
+    }
+#endif
+
 private:
 
+#ifdef HALIDE_BUFFER_HAS_MMAP
+    /** The allocation header for Buffers made by map_file. The
+     * mapping lives elsewhere, so the header is allocated on its
+     * own. */
+    struct MappedFileHeader : AllocationHeader {
+        void *addr;
+        size_t length;
+
+        MappedFileHeader(void *addr, size_t length) :
+            AllocationHeader(unmap_file), addr(addr), length(length) {}
+
+        static void unmap_file(void *header) {
+            MappedFileHeader *h = (MappedFileHeader *)header;
+            munmap(h->addr, h->length);
+            free(h);
+        }
+    };
+#endif
+
     template<typename ...Args>
     HALIDE_ALWAYS_INLINE
     ptrdiff_t offset_of(int d, int first, Args... rest) const {
@@ -1820,10 +2001,105 @@ public:
 
     void fill(not_void_T val) {
         set_host_dirty();
+        // If all the bytes of the value are the same (e.g. zero), and
+        // the buffer is dense, memset whole runs of values at a time.
+        const uint8_t *bytes = (const uint8_t *)&val;
+        bool same_bytes = true;
+        for (size_t i = 1; i < sizeof(val); i++) {
+            same_bytes = same_bytes && bytes[i] == bytes[0];
+        }
+        if (same_bytes) {
+            for_each_value_task_dim<1> *t =
+                (for_each_value_task_dim<1> *)HALIDE_ALLOCA((dimensions()+1) * sizeof(for_each_value_task_dim<1>));
+            if (for_each_value_prep(t)) {
+                fill_runs(dimensions() - 1, t, (uint8_t *)begin(), bytes[0], sizeof(val));
+                return;
+            }
+        }
         for_each_value([=](T &v) {v = val;});
     }
 
+    /** Like fill, but split the traversal into tasks along the
+     * outermost dimension, and run them with halide_do_par_for (see
+     * par_for_each_value). */
+    void par_fill(not_void_T val) {
+        set_host_dirty();
+        bool parallel = par_for_each_slice([&](int d, int min, int extent) {
+            host_view_cropped(d, min, extent).fill(val);
+        });
+        if (!parallel) {
+            fill(val);
+        }
+    }
+
 private:
+    // Crop two buffers to the region they have in common. Returns false
+    // if they don't overlap.
+    template<typename T2, int D2>
+    static bool crop_to_intersection(Buffer<T2, D2> &dst, Buffer<const T2, D2> &src) {
+        assert(src.dimensions() == dst.dimensions());
+        for (int i = 0; i < dst.dimensions(); i++) {
+            int min_coord = std::max(dst.dim(i).min(), src.dim(i).min());
+            int max_coord = std::min(dst.dim(i).max(), src.dim(i).max());
+            if (max_coord < min_coord) {
+                return false;
+            }
+            dst.crop(i, min_coord, max_coord - min_coord + 1);
+            src.crop(i, min_coord, max_coord - min_coord + 1);
+        }
+        return true;
+    }
+
+    // An unmanaged Buffer referring to a sub-range of the host memory of
+    // this one along dimension d, with no device allocation.
+    Buffer<T, D> host_view_cropped(int d, int min, int extent) const {
+        halide_buffer_t b = buf;
+        b.device = 0;
+        b.device_interface = nullptr;
+        b.flags = 0;
+        Buffer<T, D> view(b);
+        view.crop_host(d, min, extent);
+        return view;
+    }
+
+    template<typename Fn>
+    static int par_for_each_slice_task(void *user_context, int i, uint8_t *closure) {
+        (*(Fn *)closure)(i);
+        return 0;
+    }
+
+    // Split this buffer along its outermost dimension (the one with the
+    // largest stride) into slices of at least 2^16 values, and call
+    // f(d, min, extent) on each slice with halide_do_par_for. Returns
+    // false, without calling f, if the buffer is too small to split.
+    template<typename Fn>
+    bool par_for_each_slice(Fn &&f) const {
+        const size_t grain = (size_t)1 << 16;
+        const size_t n = number_of_elements();
+        int d = -1;
+        int64_t largest_stride = 0;
+        for (int i = 0; i < dimensions(); i++) {
+            int64_t stride = dim(i).stride();
+            stride = stride < 0 ? -stride : stride;
+            if (dim(i).extent() > 1 && (d == -1 || stride > largest_stride)) {
+                d = i;
+                largest_stride = stride;
+            }
+        }
+        if (d == -1 || n < 2 * grain) {
+            return false;
+        }
+        const int min = dim(d).min(), extent = dim(d).extent();
+        const int tasks = (int)std::min((size_t)extent, n / grain);
+        auto task = [&](int i) {
+            int lo = min + (int)((int64_t)extent * i / tasks);
+            int hi = min + (int)((int64_t)extent * (i + 1) / tasks);
+            f(d, lo, hi - lo);
+        };
+        halide_do_par_for(nullptr, par_for_each_slice_task<decltype(task)>, 0, tasks, (uint8_t *)&task);
+        return true;
+    }
+
     /** Helper functions for for_each_value. */
     // @{
     template<int N>
@@ -1832,6 +2108,85 @@ private:
         int stride[N];
     };
 
+    // Set up the loop nest of for_each_value over this buffer and the
+    // other buffers: order the dimensions by the strides of this
+    // buffer, flatten the dimensions that are contiguous in all the
+    // buffers, and pad the rest with dimensions of extent 1. Returns
+    // whether the innermost strides are all one.
+    template<int N, typename ...Args>
+    bool for_each_value_prep(for_each_value_task_dim<N> *t, Args&&... other_buffers) const {
+        for (int i = 0; i <= dimensions(); i++) {
+            for (int j = 0; j < N; j++) {
+                t[i].stride[j] = 0;
+            }
+            t[i].extent = 1;
+        }
+
+        for (int i = 0; i < dimensions(); i++) {
+            extract_strides(i, t[i].stride, *this, std::forward<Args>(other_buffers)...);
+            t[i].extent = dim(i).extent();
+            // Order the dimensions by stride, so that the traversal is cache-coherent.
+            for (int j = i; j > 0 && t[j].stride[0] < t[j-1].stride[0]; j--) {
+                std::swap(t[j], t[j-1]);
+            }
+        }
+
+        // flatten dimensions where possible to make a larger inner
+        // loop for autovectorization.
+        int d = dimensions();
+        for (int i = 1; i < d; i++) {
+            bool flat = true;
+            for (int j = 0; j < N; j++) {
+                flat = flat && t[i-1].stride[j] * t[i-1].extent == t[i].stride[j];
+            }
+            if (flat) {
+                t[i-1].extent *= t[i].extent;
+                for (int j = i; j < dimensions(); j++) {
+                    t[j] = t[j+1];
+                }
+                i--;
+                d--;
+            }
+        }
+
+        bool innermost_strides_are_one = false;
+        if (dimensions() > 0) {
+            innermost_strides_are_one = true;
+            for (int j = 0; j < N; j++) {
+                innermost_strides_are_one &= t[0].stride[j] == 1;
+            }
+        }
+        return innermost_strides_are_one;
+    }
+
+    // Copy the values of a loop nest set up by for_each_value_prep
+    // with unit innermost strides, one innermost run at a time.
+    static void copy_runs(int d, const for_each_value_task_dim<2> *t,
+                          uint8_t *dst, const uint8_t *src, size_t elem_size) {
+        if (d <= 0) {
+            memcpy(dst, src, t[0].extent * elem_size);
+        } else {
+            for (int i = t[d].extent; i != 0; i--) {
+                copy_runs(d - 1, t, dst, src, elem_size);
+                dst += (ptrdiff_t)t[d].stride[0] * elem_size;
+                src += (ptrdiff_t)t[d].stride[1] * elem_size;
+            }
+        }
+    }
+
+    // Ditto for filling with a repeated byte.
+    static void fill_runs(int d, const for_each_value_task_dim<1> *t,
+                          uint8_t *dst, uint8_t byte, size_t elem_size) {
+        if (d <= 0) {
+            memset(dst, byte, t[0].extent * elem_size);
+        } else {
+            for (int i = t[d].extent; i != 0; i--) {
+                fill_runs(d - 1, t, dst, byte, elem_size);
+                dst += (ptrdiff_t)t[d].stride[0] * elem_size;
+            }
+        }
+    }
+
     // Given an array of strides, and a bunch of pointers to pointers
     // (all of different types), advance the pointers using the
     // strides.
@@ -1925,47 +2280,7 @@ public:
     void for_each_value(Fn &&f, Args&&... other_buffers) const {
         for_each_value_task_dim<N> *t =
             (for_each_value_task_dim<N> *)HALIDE_ALLOCA((dimensions()+1) * sizeof(for_each_value_task_dim<N>));
-        for (int i = 0; i <= dimensions(); i++) {
-            for (int j = 0; j < N; j++) {
-                t[i].stride[j] = 0;
-            }
-            t[i].extent = 1;
-        }
-
-        for (int i = 0; i < dimensions(); i++) {
-            extract_strides(i, t[i].stride, *this, std::forward<Args>(other_buffers)...);
-            t[i].extent = dim(i).extent();
-            // Order the dimensions by stride, so that the traversal is cache-coherent.
-            for (int j = i; j > 0 && t[j].stride[0] < t[j-1].stride[0]; j--) {
-                std::swap(t[j], t[j-1]);
-            }
-        }
-
-        // flatten dimensions where possible to make a larger inner
-        // loop for autovectorization.
-        int d = dimensions();
-        for (int i = 1; i < d; i++) {
-            bool flat = true;
-            for (int j = 0; j < N; j++) {
-                flat = flat && t[i-1].stride[j] * t[i-1].extent == t[i].stride[j];
-            }
-            if (flat) {
-                t[i-1].extent *= t[i].extent;
-                for (int j = i; j < dimensions(); j++) {
-                    t[j] = t[j+1];
-                }
-                i--;
-                d--;
-            }
-        }
-
-        bool innermost_strides_are_one = false;
-        if (dimensions() > 0) {
-            innermost_strides_are_one = true;
-            for (int j = 0; j < N; j++) {
-                innermost_strides_are_one &= t[0].stride[j] == 1;
-            }
-        }
+        bool innermost_strides_are_one = for_each_value_prep(t, std::forward<Args>(other_buffers)...);
 
         if (innermost_strides_are_one) {
             for_each_value_helper<true>(f, dimensions() - 1, t, begin(), (other_buffers.begin())...);
@@ -1974,6 +2289,24 @@ public:
         }
     }
 
+    /** Like for_each_value, but split the traversal into tasks along
+     * the outermost dimension of this buffer, and run them with
+     * halide_do_par_for, i.e. on the Halide thread pool, or with the
+     * executor set with halide_set_custom_do_par_for. Buffers of fewer
+     * than 2^17 values are traversed serially. f must be safe to call
+     * concurrently. This calls into the Halide runtime, so it is only
+     * available in programs linked with one, e.g. with an AOT-compiled
+     * pipeline. */
+    template<typename Fn, typename ...Args>
+    void par_for_each_value(Fn &&f, Args&&... other_buffers) const {
+        bool parallel = par_for_each_slice([&](int d, int min, int extent) {
+            host_view_cropped(d, min, extent).for_each_value(f, other_buffers.host_view_cropped(d, min, extent)...);
+        });
+        if (!parallel) {
+            for_each_value(f, std::forward<Args>(other_buffers)...);
+        }
+    }
+
 private:
 
     // Helper functions for for_each_element
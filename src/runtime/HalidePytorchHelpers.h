@@ -9,6 +9,7 @@
 #include <sstream>
 #include <exception>
 
+#include "ATen/ATen.h"
 #include "TH/TH.h"
 #include "THC/THC.h"
 
@@ -18,6 +19,26 @@ extern THCState *state;
 
 using Halide::Runtime::Buffer;
 
+// Half precision tensors are wrapped in float16 buffers.
+template<>
+HALIDE_ALWAYS_INLINE halide_type_t halide_type_of<at::Half>() {
+    return halide_type_t(halide_type_float, 16);
+}
+
+// Versions of PyTorch with bfloat16 tensors wrap them in bfloat16 buffers.
+#if defined(__has_include)
+#if __has_include(<c10/util/BFloat16.h>)
+#define HL_PYTORCH_HAS_BFLOAT16 1
+#endif
+#endif
+
+#ifdef HL_PYTORCH_HAS_BFLOAT16
+template<>
+HALIDE_ALWAYS_INLINE halide_type_t halide_type_of<at::BFloat16>() {
+    return halide_type_t(halide_type_bfloat, 16);
+}
+#endif
+
 namespace Halide {
 namespace Pytorch {
 
@@ -52,6 +73,12 @@ struct CudaRunException : public std::exception {
   }
 };
 
+struct InvalidTypeException : public std::exception {
+  const char* what() const throw() {
+    return "Halide operator got a tensor of the wrong type";
+  }
+};
+
 template <typename T>
 inline int get_ndims(const THTensor* tensor);
 
@@ -179,6 +206,75 @@ inline Buffer<T> wrap(THCudaTensor* tensor) {
   return buffer;
 }
 
+// ATen tensors -----------------------------------
+
+template <typename T>
+inline at::ScalarType scalar_type();
+
+template <>
+inline at::ScalarType scalar_type<float>() { return at::ScalarType::Float; }
+
+template <>
+inline at::ScalarType scalar_type<double>() { return at::ScalarType::Double; }
+
+template <>
+inline at::ScalarType scalar_type<at::Half>() { return at::ScalarType::Half; }
+
+#ifdef HL_PYTORCH_HAS_BFLOAT16
+template <>
+inline at::ScalarType scalar_type<at::BFloat16>() { return at::ScalarType::BFloat16; }
+#endif
+
+template <>
+inline at::ScalarType scalar_type<int32_t>() { return at::ScalarType::Int; }
+
+template <>
+inline at::ScalarType scalar_type<int64_t>() { return at::ScalarType::Long; }
+
+// Halide pipelines require a unit stride in the innermost dimension by
+// default. Return the tensor itself if it has one (this covers dense
+// tensors and most slices), or a dense copy of it otherwise.
+inline at::Tensor dense_innermost(const at::Tensor &tensor) {
+  int ndims = tensor.dim();
+  if (ndims == 0 || tensor.size(ndims-1) == 1 || tensor.stride(ndims-1) == 1) {
+    return tensor;
+  }
+  return tensor.contiguous();
+}
+
+// Wrap a CPU or CUDA tensor in a Halide buffer without copying it, with its
+// actual strides. The dimensions are reversed: dimension 0 of the buffer is
+// the innermost dimension of the tensor.
+template <typename T>
+inline Buffer<T> wrap(const at::Tensor &tensor) {
+  if (tensor.scalar_type() != scalar_type<T>()) {
+    throw InvalidTypeException();
+  }
+
+  int ndims = tensor.dim();
+  std::vector<halide_dimension_t> shape(ndims);
+  for(int dim = 0; dim < ndims; ++dim) {
+    shape[dim].min = 0;
+    shape[dim].extent = tensor.size(ndims-1-dim);
+    // The stride of a dimension of size 1 is never used
+    shape[dim].stride = shape[dim].extent == 1 ? 1 : tensor.stride(ndims-1-dim);
+  }
+
+  T* pData = (T*) tensor.data_ptr();
+  if (!tensor.is_cuda()) {
+    return Buffer<T>(pData, ndims, shape.data());
+  }
+
+  const halide_device_interface_t* cuda_interface = halide_cuda_device_interface();
+  Buffer<T> buffer(NULL, ndims, shape.data());
+  int err = buffer.device_wrap_native(cuda_interface, (uint64_t)pData);
+  if (err != 0) {
+    throw "halide_device_wrap failed";
+  }
+  buffer.set_device_dirty();
+  return buffer;
+}
+
 typedef struct UserContext {
   UserContext(int id, CUcontext *ctx, cudaStream_t* stream) :
     device_id(id), cuda_context(ctx), stream(stream) {};
@@ -188,6 +284,34 @@ typedef struct UserContext {
   cudaStream_t *stream;
 } UserContext;
 
+// The context of the op running on this thread. The runtime is also called
+// with a NULL user_context (e.g. when the pipeline was compiled without the
+// user_context feature, or from the destructors of the buffers), and should
+// use PyTorch's context and stream then too.
+inline UserContext *&current_user_context() {
+  static thread_local UserContext *user_ctx = NULL;
+  return user_ctx;
+}
+
+// Make 'user_ctx' the context of the op running on this thread while in
+// scope.
+struct ScopedUserContext {
+  UserContext *previous;
+  ScopedUserContext(UserContext *user_ctx) : previous(current_user_context()) {
+    current_user_context() = user_ctx;
+  }
+  ~ScopedUserContext() {
+    current_user_context() = previous;
+  }
+};
+
+inline UserContext *get_user_context(void *user_context) {
+  if (user_context != NULL) {
+    return (UserContext*) user_context;
+  }
+  return current_user_context();
+}
+
 } // namespace Pytorch
 } // namespace Halide
 
@@ -196,36 +320,49 @@ typedef struct UserContext {
 extern "C" {
 
 WEAK int halide_cuda_acquire_context(void *user_context, CUcontext *ctx, bool create = true) {
-  if(user_context != NULL) {
-    Halide::Pytorch::UserContext *user_ctx = (Halide::Pytorch::UserContext*) user_context;
-    // std::cerr << "PyWrap get ctx " << *user_ctx->cuda_context << "\n";
+  Halide::Pytorch::UserContext *user_ctx = Halide::Pytorch::get_user_context(user_context);
+  if(user_ctx != NULL) {
     *ctx = *user_ctx->cuda_context;
   } else {
-    // std::cerr << "no user context\n";
     *ctx = NULL;
   }
   return 0;
 }
 
 WEAK int halide_cuda_get_stream(void *user_context, CUcontext ctx, CUstream *stream) {
-  if(user_context != NULL) {
-    Halide::Pytorch::UserContext *user_ctx = (Halide::Pytorch::UserContext*) user_context;
-    // std::cerr << "PyWrap's get stream " <<  *user_ctx->stream << "\n";
+  Halide::Pytorch::UserContext *user_ctx = Halide::Pytorch::get_user_context(user_context);
+  if(user_ctx != NULL) {
     *stream = *user_ctx->stream;
   } else {
-    // printf("no user context, using default stream \n");
+    // No op is running, use the default stream
     *stream = 0;
   }
   return 0;
 }
 
+// Device buffers of the ops come from PyTorch's caching allocator, on the
+// stream of the op, so that they share a pool with the tensors.
+WEAK int halide_cuda_allocate(void *user_context, CUcontext ctx, CUstream stream,
+                              size_t size, CUdeviceptr *ptr) {
+  try {
+    *ptr = (CUdeviceptr)THCudaMalloc(state, size);
+  } catch (...) {
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+  return *ptr ? CUDA_SUCCESS : CUDA_ERROR_OUT_OF_MEMORY;
+}
+
+WEAK int halide_cuda_deallocate(void *user_context, CUcontext ctx, CUstream stream,
+                                CUdeviceptr ptr, size_t size) {
+  THCudaFree(state, (void *)ptr);
+  return CUDA_SUCCESS;
+}
+
 WEAK int halide_get_gpu_device(void *user_context) {
-  if(user_context != NULL) {
-    Halide::Pytorch::UserContext *user_ctx = (Halide::Pytorch::UserContext*) user_context;
-    // std::cerr << "PyWrap's get gpu device " <<  user_ctx->device_id << "\n";
+  Halide::Pytorch::UserContext *user_ctx = Halide::Pytorch::get_user_context(user_context);
+  if(user_ctx != NULL) {
     return user_ctx->device_id;
   } else {
-    // std::cerr << "no user context, using default device \n";
     return 0;
   }
 }
@@ -159,6 +159,79 @@ extern struct halide_thread *halide_spawn_thread(void (*f)(void *), void *closur
 /** Join a thread. */
 extern void halide_join_thread(struct halide_thread *);
 
+/** Run the tasks f(min) to f(min + size - 1) concurrently, each on a
+ * thread of its own (the calling thread runs the last one), and wait
+ * for all of them. Unlike the tasks of halide_do_par_for, these may
+ * block waiting for each other. Used to run the producers of Funcs
+ * scheduled async() alongside their consumers. Returns zero if all the
+ * tasks returned zero, otherwise the return value of one of the
+ * failing tasks. */
+extern int halide_do_concurrent_tasks(void *user_context, halide_task_t f,
+                                      int min, int size, uint8_t *closure);
+
+/** Called with the result of a call started by halide_do_async_call. */
+typedef void (*halide_async_callback_t)(void *callback_context, int result);
+
+/** Call f(args) on a worker of the thread pool of user_context,
+ * without waiting for it, and then callback(callback_context, result)
+ * from that worker, with the return value of f. Used by the _async
+ * entry points of pipelines compiled with the async_entry target
+ * feature, where f is the _argv entry point. args, and everything
+ * they point to, must stay valid until the callback. The parallel
+ * loops of the call run on the same pool, so many calls can be in
+ * flight with a fixed number of threads. Calls still queued when the
+ * thread pool is shut down are dropped without calling back, so wait
+ * for all callbacks first. Returns zero if the call was queued, in
+ * which case the callback will report its result. Without a thread
+ * pool, f runs on the calling thread before this returns. */
+extern int halide_do_async_call(void *user_context, int (*f)(void **), void **args,
+                                halide_async_callback_t callback, void *callback_context);
+
+/** The ways halide_do_par_for_chunked hands out the tasks of a
+ * parallel loop to the threads:
+ * - dynamic: the threads claim chunks of 'chunk' tasks one after the
+ *   other, like halide_do_par_for does for a chunk of one. Larger
+ *   chunks amortize the cost of claiming very small tasks.
+ * - guided: like dynamic, but each chunk is a share of the tasks left
+ *   (and at least 'chunk' tasks), so the chunks shrink towards the end
+ *   of the loop, which balances tasks of uneven cost with few claims.
+ * - static: each thread claims one contiguous block of about
+ *   size / num_threads tasks, for tasks of even cost.
+ */
+typedef enum halide_par_for_policy_t {
+    halide_par_for_dynamic = 0,
+    halide_par_for_guided = 1,
+    halide_par_for_static = 2
+} halide_par_for_policy_t;
+
+/** Do a parallel for loop like halide_do_par_for, with the tasks handed
+ * out according to the given policy. Used by the loops scheduled with
+ * Func::parallel(var, policy, chunk). If a custom do_par_for is set, it
+ * is called instead, and the policy is ignored. */
+extern int halide_do_par_for_chunked(void *user_context, halide_task_t task,
+                                     int min, int size, uint8_t *closure,
+                                     int policy, int chunk);
+
+/** A counting semaphore, used by the producers and consumers of Funcs
+ * scheduled async() to wait for each other. */
+struct halide_semaphore_t {
+    uint64_t _private[4];
+};
+
+/** Initialize a semaphore with a count of n, increase its count by n,
+ * or block until its count is at least n and then decrease it by
+ * n. halide_semaphore_acquire returns non-zero instead if the
+ * semaphore is poisoned while it waits: the task that should have
+ * released it has failed, so waiting would never end. A semaphore is
+ * poisoned with halide_semaphore_poison, which has the signature of a
+ * destructor so that tasks can register it to run when they exit. */
+// @{
+extern int halide_semaphore_init(struct halide_semaphore_t *, int n);
+extern int halide_semaphore_release(struct halide_semaphore_t *, int n);
+extern int halide_semaphore_acquire(struct halide_semaphore_t *, int n);
+extern void halide_semaphore_poison(void *user_context, void *semaphore);
+// @}
+
 /** Set the number of threads used by Halide's thread pool. Returns
  * the old number.
  *
@@ -177,6 +250,51 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** An isolated thread pool, with its own worker threads, size and
+ * priority. Pipelines using different pools don't compete for the same
+ * workers, and halide_set_num_threads only sizes the global pool. */
+struct halide_thread_pool;
+
+/** Create a thread pool of num_threads threads, counting the thread that
+ * calls halide_do_par_for (0 means the same default as
+ * halide_set_num_threads). If priority is positive, the workers ask for
+ * that real-time priority (SCHED_FIFO on posix systems, which usually
+ * needs extra privileges; it is ignored if refused). Threads are spawned
+ * the first time the pool is used. Returns NULL on failure. */
+extern struct halide_thread_pool *halide_create_thread_pool(void *user_context,
+                                                            int num_threads,
+                                                            int priority);
+
+/** Join the threads of a pool and free it. No pipeline may be using it. */
+extern void halide_destroy_thread_pool(void *user_context, struct halide_thread_pool *pool);
+
+/** The thread pool halide_default_do_par_for uses for a user_context. The
+ * default implementation returns NULL, which selects the global pool. To
+ * bind pools to pipelines, define this yourself (on platforms that support
+ * weak linking) and map the user_context passed to them to their pool. */
+extern struct halide_thread_pool *halide_get_thread_pool(void *user_context);
+
+/** Record a timeline of what the threads of the thread pools do: each
+ * task they run, each wait for work, and each time they take the lock
+ * of the work queue, with its start and end time and its thread. Tasks
+ * are tagged with the id of the Func of their parallel loop when the
+ * pipeline is compiled with the profile target feature. Each worker
+ * index keeps the last events_per_thread events (rounded up to a power
+ * of two) in a ring buffer of its own, written without taking a lock;
+ * threads calling halide_do_par_for share one more buffer. Starting
+ * again discards the events recorded so far, so no pipeline may be
+ * running. Returns non-zero on failure. */
+extern int halide_thread_pool_timeline_start(void *user_context, int events_per_thread);
+
+/** Stop recording the timeline. The events recorded so far are kept. */
+extern void halide_thread_pool_timeline_stop();
+
+/** Write the events recorded since halide_thread_pool_timeline_start to
+ * the file in the Chrome trace event format, which chrome://tracing and
+ * Perfetto display as a track of events per thread. Stop recording
+ * first. Returns non-zero on failure. */
+extern int halide_thread_pool_timeline_save(void *user_context, const char *filename);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -203,6 +321,55 @@ typedef void *(*halide_malloc_t)(void *, size_t);
 typedef void (*halide_free_t)(void *, void *);
 extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
+
+/** An optional allocator for the host, which keeps freed blocks in caches
+ * of power-of-two size classes (up to 16 MB) and reuses them, instead of
+ * returning them to the system. It suits pipelines that allocate the same
+ * buffers on every invocation or in every iteration of a parallel loop.
+ * Install it with halide_set_custom_malloc(halide_pool_malloc) and
+ * halide_set_custom_free(halide_pool_free), before any allocation is
+ * made. Only available where the runtime uses the posix allocator. */
+// @{
+extern void *halide_pool_malloc(void *user_context, size_t x);
+extern void halide_pool_free(void *user_context, void *ptr);
+// @}
+
+/** Return all the blocks cached by the pool allocator to the system. */
+extern void halide_pool_allocator_trim(void *user_context);
+
+/** Counters of the pool allocator, since the process started. */
+struct halide_pool_allocator_stats {
+    /** Allocations served from, or missing, the caches. */
+    uint64_t num_hits, num_misses;
+    /** Allocations too large to be pooled. */
+    uint64_t num_unpooled;
+    /** Bytes held in the caches. */
+    uint64_t bytes_cached;
+};
+
+extern void halide_pool_allocator_get_stats(void *user_context, struct halide_pool_allocator_stats *stats);
+
+/** An optional allocator for the host, which puts allocations of at
+ * least a threshold size (2 MB by default) in mappings of their own
+ * backed by 2 MB huge pages, to cut TLB misses on large buffers, and
+ * passes smaller ones to the pool allocator above. Freed mappings are
+ * cached and reused, and count towards the pool allocator's stats and
+ * are released by halide_pool_allocator_trim. Install it with
+ * halide_set_custom_malloc(halide_huge_page_malloc) and
+ * halide_set_custom_free(halide_huge_page_free), before any allocation
+ * is made. Huge pages are only used on Linux and Android; elsewhere
+ * large allocations fall back to malloc. */
+// @{
+extern void *halide_huge_page_malloc(void *user_context, size_t x);
+extern void halide_huge_page_free(void *user_context, void *ptr);
+// @}
+
+/** Set the size from which halide_huge_page_malloc uses huge pages. If
+ * use_reserved is true, huge pages come from the pool reserved with
+ * /proc/sys/vm/nr_hugepages (MAP_HUGETLB), falling back to transparent
+ * huge pages once it is exhausted; otherwise only transparent huge
+ * pages are used. */
+extern void halide_huge_page_allocator_configure(size_t min_bytes, bool use_reserved);
 //@}
 
 /** Halide calls these functions to interact with the underlying
@@ -251,8 +418,9 @@ typedef enum halide_type_code_t
 {
     halide_type_int = 0,   //!< signed integers
     halide_type_uint = 1,  //!< unsigned integers
-    halide_type_float = 2, //!< floating point numbers
-    halide_type_handle = 3 //!< opaque pointer type (void *)
+    halide_type_float = 2, //!< IEEE floating point numbers
+    halide_type_handle = 3, //!< opaque pointer type (void *)
+    halide_type_bfloat = 4 //!< floating point numbers in the bfloat format
 } halide_type_code_t;
 
 // Note that while __attribute__ can go before or after the declaration,
@@ -383,7 +551,10 @@ struct halide_trace_event_t {
  * HL_TRACE_FILE is defined, dumps the trace to that file in a
  * sequence of trace packets. The header for a trace packet is defined
  * below. If the trace is going to be large, you may want to make the
- * file a named pipe, and then read from that pipe into gzip.
+ * file a named pipe, and then read from that pipe into gzip. Setting
+ * HL_TRACE_SAMPLE=N makes the default implementation keep only one in
+ * N of the loads and one in N of the stores of each Func; all other
+ * events are kept.
  *
  * halide_trace returns a unique ID which will be passed to future
  * events that "belong" to the earlier event as the parent id. The
@@ -698,6 +869,21 @@ extern void halide_set_gpu_device(int n);
  * HL_GPU_DEVICE. */
 extern int halide_get_gpu_device(void *user_context);
 
+/** Set the number of bytes of heap and device memory that the
+ * intermediate buffers of a pipeline may use before the Funcs
+ * scheduled with Func::specialize_low_memory switch to their
+ * low-memory schedules. Zero, the default, means there is no
+ * budget. */
+extern void halide_set_memory_budget(int64_t bytes);
+
+/** Halide calls this to get the memory budget of a pipeline before
+ * running it. Implement this yourself to use a different budget per
+ * user_context, e.g. per tenant. The default implementation returns
+ * the value set by halide_set_memory_budget, or the environment
+ * variable HL_MEMORY_BUDGET, in bytes with an optional k, m or g
+ * suffix. */
+extern int64_t halide_get_memory_budget(void *user_context);
+
 /** Set the soft maximum amount of memory, in bytes, that the LRU
  *  cache will use to memoize Func results.  This is not a strict
  *  maximum in that concurrency and simultaneous use of memoized
@@ -736,7 +922,11 @@ extern int halide_memoization_cache_lookup(void *user_context, const uint8_t *ca
  *  list if halide_buffer_t pointers which represents the outputs of the
  *  memoized Func. If the Func does not return a Tuple, there will
  *  only be one halide_buffer_t in the list. The tuple_count parameters
- *  determines the length of the list.
+ *  determines the length of the list. Buffers computed on a device
+ *  keep their device allocation in the cache, so later lookups return
+ *  them without a copy back to the host. The eviction cost is the hint
+ *  given to Func::memoize; when the cache is full, entries with the
+ *  lowest eviction cost per byte are evicted first.
  *
  * If there is a memory allocation failure, the store does not store
  * the data into the cache.
@@ -744,7 +934,8 @@ extern int halide_memoization_cache_lookup(void *user_context, const uint8_t *ca
 extern int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
                                           struct halide_buffer_t *realized_bounds,
                                           int32_t tuple_count,
-                                          struct halide_buffer_t **tuple_buffers);
+                                          struct halide_buffer_t **tuple_buffers,
+                                          int32_t eviction_cost);
 
 /** If halide_memoization_cache_lookup succeeds,
  * halide_memoization_cache_release must be called to signal the
@@ -768,6 +959,99 @@ extern void halide_memoization_cache_release(void *user_context, void *host);
  */
 extern void halide_memoization_cache_cleanup(void *user_context);
 
+/** Back the memoization cache with a table in the file at path, mapped
+ * into the memory of every process that opens the same file, such as
+ * the workers of a prefork server, and kept across restarts. Lookups
+ * that miss in the cache of this process fall back to the table, and
+ * results stored in the cache are also written to it, if they are on
+ * the host and fit in one of its slots. An empty or new file is
+ * extended to size bytes, split into slot_count slots of equal size;
+ * an existing file keeps its own layout. Neither lookups nor stores in
+ * the table take locks: entries are checked against a checksum of
+ * their contents, and a result that is being overwritten is a miss.
+ * Entries are keyed on the memoization cache key only, so all the
+ * processes sharing a file must run the same pipelines. A NULL path
+ * detaches the current table, as does
+ * halide_memoization_cache_cleanup. Must be called at a time when no
+ * other threads are accessing the cache. Only supported on Linux;
+ * elsewhere, mapping the file fails. Returns 0 on success.
+ */
+extern int halide_memoization_cache_set_backing_store(void *user_context, const char *path,
+                                                      int64_t size, int32_t slot_count);
+
+/** The functions below here are relevant for pipelines with Funcs
+ * scheduled with Func::persist, which keep the last frames they
+ * computed across calls of the pipeline. The storage of each Func is
+ * named after the pipeline and the Func. These functions are called by
+ * the pipeline; only halide_persistent_storage_cleanup is meant to be
+ * called directly. */
+
+/** Get the storage of size bytes of a Func with the given shape, as
+ * the mins and extents of its dimensions. Storage of another size or
+ * shape is reallocated, and holds no frames. Returns NULL if the
+ * allocation fails. */
+extern void *halide_persistent_storage_acquire(void *user_context, const char *name, uint64_t size,
+                                               const int32_t *shape, int32_t shape_size);
+
+/** The range of frames the storage of a Func holds from the previous
+ * calls of the pipeline. The range is empty if first > last. */
+// @{
+extern int32_t halide_persistent_storage_first_frame(void *user_context, const char *name);
+extern int32_t halide_persistent_storage_last_frame(void *user_context, const char *name);
+// @}
+
+/** Set the range of frames the storage of a Func holds after a call of
+ * the pipeline computed it. */
+extern int halide_persistent_storage_set_frames(void *user_context, const char *name,
+                                                int32_t first_frame, int32_t last_frame);
+
+/** Called when a call of the pipeline is done with the storage of a
+ * Func. The default implementation does nothing, as the storage outlives
+ * the call. */
+extern void halide_persistent_storage_release(void *user_context, void *host);
+
+/** Free the storage of all the persistent Funcs, e.g. at the end of a
+ * video stream. The next call of each pipeline computes all the frames
+ * it needs again. Must be called at a time when no pipeline with
+ * persistent Funcs is running. */
+extern void halide_persistent_storage_cleanup(void *user_context);
+
+/** The functions below here are relevant for pipelines with a dimension
+ * distributed across the ranks of a multi-node job. See
+ * Func::distribute. */
+
+/** How the ranks of a distributed pipeline communicate, e.g. over
+ * MPI. send and recv move size bytes to or from another rank, and
+ * return zero on success. recv must block until the data has
+ * arrived; send may block until it is received. */
+struct halide_distributed_transport_t {
+    int (*rank)(void *user_context);
+    int (*num_ranks)(void *user_context);
+    int (*send)(void *user_context, int dst_rank, const void *data, size_t size);
+    int (*recv)(void *user_context, int src_rank, void *data, size_t size);
+};
+
+/** Set the transport used by distributed pipelines, and return the
+ * previous one. The default transport has a single rank, which never
+ * exchanges anything. While the transport reports more than one rank,
+ * the CUDA runtime uses a separate context for each rank, and deals
+ * the ranks out to the available devices. */
+extern const struct halide_distributed_transport_t *
+halide_set_distributed_transport(const struct halide_distributed_transport_t *transport);
+
+/** Exchange the halos of an input buffer between the ranks. This rank
+ * owns the part of the buffer in [owned_min, owned_min + owned_extent)
+ * along dimension dim, and requires the part in [required_min,
+ * required_min + required_extent). It receives the part of the latter
+ * owned by each other rank from that rank, and sends each other rank
+ * the part of the former that the other rank requires. All the ranks
+ * must call this together for the same buffers, in the same order;
+ * distributed pipelines do so at their start. Returns zero on
+ * success. */
+extern int halide_distributed_exchange(void *user_context, struct halide_buffer_t *buf, int dim,
+                                       int required_min, int required_extent,
+                                       int owned_min, int owned_extent);
+
 /** Create a unique file with a name of the form prefixXXXXXsuffix in an arbitrary
  * (but writable) directory; this is typically $TMP or /tmp, but the specific
  * location is not guaranteed. (Note that the exact form of the file name
@@ -1138,7 +1422,19 @@ typedef enum halide_target_feature_t {
     halide_target_feature_asan = 53, ///< Enable hooks for ASAN support.
     halide_target_feature_d3d12compute = 54, ///< Enable Direct3D 12 Compute runtime.
     halide_target_feature_check_unsafe_promises = 55, ///< Insert assertions for promises.
-    halide_target_feature_end = 56 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_avx512_vnni = 56, ///< Enable the AVX512 VNNI dot product instructions, on top of those of avx512_skylake (Cascade Lake).
+    halide_target_feature_arm_dot_prod = 57, ///< Enable the ARMv8.2 udot/sdot dot product instructions.
+    halide_target_feature_cuda_capability70 = 58,  ///< Enable CUDA compute capability 7.0 (Volta)
+    halide_target_feature_minimal_runtime = 59, ///< Only include the parts of the Halide runtime that the pipeline calls in the generated object file. Other runtime functions, such as halide_set_error_handler, are left out.
+    halide_target_feature_plan_memory = 60, ///< Pack the heap allocations made once per call of the pipeline into a single arena, whose size is reported in the filter metadata.
+    halide_target_feature_plan_layouts = 61, ///< Store each intermediate Func with the dimension its consumers vectorize across innermost, unless its storage order is given by the schedule.
+    halide_target_feature_profile_metrics = 62, ///< Record histograms of the latency and peak heap usage of each run of the pipeline, and of the time taken by each realization of each Func, without the sampling profiler thread. See halide_profiler_pipeline_stats.
+    halide_target_feature_async_entry = 63, ///< Also emit an _async entry point for each pipeline, which runs it on the thread pool and reports its result to a callback. See halide_do_async_call.
+    halide_target_feature_native_float16 = 64, ///< Keep float16 arithmetic in float16 where the hardware supports it: the ARMv8.2-A FP16 instructions, CUDA compute capability 6.1 or higher, Metal and OpenCL. Without it, float16 arithmetic is computed in float. See Func::widen_float16_math.
+    halide_target_feature_wasm_simd128 = 65, ///< Use the WebAssembly SIMD128 instructions. Only relevant on WebAssembly.
+    halide_target_feature_wasm_threads = 66, ///< Run parallel loops on a thread pool of WebAssembly threads (web workers sharing the module's memory). Without it, parallel loops are run serially. Only relevant on WebAssembly.
+    halide_target_feature_rvv = 67, ///< Use the RISC-V vector extension (RVV 1.0), assuming vectors of at least 128 bits. Only relevant on RISC-V.
+    halide_target_feature_end = 68 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -1460,7 +1756,7 @@ struct halide_filter_argument_t {
 };
 
 struct halide_filter_metadata_t {
-    /** version of this metadata; currently always 0. */
+    /** version of this metadata; currently always 1. */
     int32_t version;
 
     /** The number of entries in the arguments field. This is always >= 1. */
@@ -1478,12 +1774,36 @@ struct halide_filter_metadata_t {
 
     /** The function name of the filter. */
     const char* name;
+
+    /** The size in bytes of the arena that holds the internal heap
+     * allocations of the filter when it is compiled with the plan_memory
+     * target feature, or zero. The filter makes one halide_malloc of
+     * this size per call, so a custom allocator can hand out the same
+     * preallocated block every time. Present if version >= 1. */
+    int64_t arena_size;
 };
 
 /** The functions below here are relevant for pipelines compiled with
  * the -profile target flag, which runs a sampling profiler thread
  * alongside the pipeline. */
 
+/** The number of buckets in a halide_profiler_histogram. */
+#define HALIDE_PROFILER_HISTOGRAM_BUCKETS 256
+
+/** A histogram of values recorded with the profile_metrics target
+ * feature: latencies in nanoseconds or sizes in bytes. Bucket 0 holds
+ * zero, buckets 1-3 hold the values 1-3, and above that each power of
+ * two is split into four buckets, so percentiles read from it are
+ * within 25% of the true value. Updated with atomic operations
+ * without locking, so it may be read while pipelines are running. */
+struct halide_profiler_histogram {
+    /** The number of values recorded, their sum, and the largest one. */
+    uint64_t count, sum, max;
+
+    /** The number of values in each bucket. */
+    uint64_t buckets[HALIDE_PROFILER_HISTOGRAM_BUCKETS];
+};
+
 /** Per-Func state tracked by the sampling profiler. */
 struct halide_profiler_func_stats {
     /** Total time taken evaluating this Func (in nanoseconds). */
@@ -1504,6 +1824,28 @@ struct halide_profiler_func_stats {
     /** The average number of thread pool worker threads active while computing this Func. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** Total time the kernels launched while computing this Func ran on a
+     * device (in nanoseconds), and the number of kernels. */
+    uint64_t device_time, device_kernels;
+
+    /** The sum over these kernels of their theoretical occupancy of the
+     * device, in thousandths: the fraction of the threads the device can
+     * hold at once that the kernel keeps resident. */
+    uint64_t device_occupancy;
+
+    /** Bytes copied to and from a device while computing this Func. */
+    uint64_t bytes_copied_to_device, bytes_copied_to_host;
+
+    /** Hardware counters sampled while computing this Func, over all
+     * threads, if HL_PROFILER_COUNTERS=1 is set on x86 Linux: CPU cycles,
+     * instructions retired, last level cache misses and packed vector
+     * arithmetic instructions. */
+    uint64_t cycles, instructions, llc_misses, vector_instructions;
+
+    /** With profile_metrics, the time taken computing each realization
+     * of this Func (in nanoseconds). */
+    struct halide_profiler_histogram latency;
+
     /** The name of this Func. A global constant string. */
     const char *name;
 
@@ -1530,6 +1872,11 @@ struct halide_profiler_pipeline_stats {
      * work while computing this pipeline. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** With profile_metrics, the time taken by each run of this
+     * pipeline (in nanoseconds), and the peak heap usage of each run
+     * (in bytes). Runs that fail are not recorded. */
+    struct halide_profiler_histogram latency, memory;
+
     /** The name of this pipeline. A global constant string. */
     const char *name;
 
@@ -1604,10 +1951,33 @@ enum {
  * inspection. Lock it before using to pause the profiler. */
 extern struct halide_profiler_state *halide_profiler_get_state();
 
-/** Get a pointer to the pipeline state associated with pipeline_name.
- * This function grabs the global profiler state's lock on entry. */
+/** Get a pointer to the pipeline state associated with pipeline_name,
+ * or NULL if it has not run since the last reset. This function grabs
+ * the global profiler state's lock on entry. */
 extern struct halide_profiler_pipeline_stats *halide_profiler_get_pipeline_state(const char *pipeline_name);
 
+/** Estimate the given percentile (between 0 and 100) of the values
+ * recorded in a histogram, e.g. 99 for the p99 latency of a
+ * pipeline. Returns the upper bound of the bucket it falls in, or
+ * zero if the histogram is empty. */
+extern uint64_t halide_profiler_histogram_percentile(const struct halide_profiler_histogram *histogram, float percentile);
+
+/** Clear the histograms recorded with profile_metrics for all
+ * pipelines, e.g. after scraping them, without touching the other
+ * profiler state. Pipelines running concurrently may leave a few
+ * values in the cleared histograms. */
+extern void halide_profiler_reset_metrics();
+
+/** Bill work done on a device to the Func currently running according to
+ * the profiler, if any: a kernel that ran for 'time' nanoseconds with the
+ * given theoretical occupancy (in thousandths, see
+ * halide_profiler_func_stats), or a copy of 'bytes' to or from the
+ * device. Called by the device runtimes when profiling. */
+// @{
+extern void halide_profiler_device_kernel(void *user_context, uint64_t time, int occupancy);
+extern void halide_profiler_device_copy(void *user_context, uint64_t bytes, bool to_host);
+// @}
+
 /** Reset profiler state cheaply. May leave threads running or some
  * memory allocated but all accumluated statistics are reset.
  * WARNING: Do NOT call this method while any halide pipeline is
@@ -1627,6 +1997,13 @@ void halide_profiler_shutdown();
  * reset. Also happens at process exit. */
 extern void halide_profiler_report(void *user_context);
 
+/** Write the time per run and the average number of threads of each
+ * Func run since the last reset to a text file, one Func per line, e.g.
+ * for simple_autoschedule to read back (see load_profile). Also happens
+ * at process exit if the environment variable HL_PROFILER_FILE names a
+ * file. Returns zero on success. */
+extern int halide_profiler_save(void *user_context, const char *filename);
+
 /// \name "Float16" functions
 /// These functions operate of bits (``uint16_t``) representing a half
 /// precision floating point number (IEEE-754 2008 binary16).
@@ -33,6 +33,19 @@ extern int halide_cuda_run(void *user_context,
                            float* vertex_buffer,
                            int num_coords_dim0,
                            int num_coords_dim1);
+extern int halide_cuda_run_cooperative(void *user_context,
+                                       void *state_ptr,
+                                       const char *entry_name,
+                                       int blocksX, int blocksY, int blocksZ,
+                                       int threadsX, int threadsY, int threadsZ,
+                                       int shared_mem_bytes,
+                                       size_t arg_sizes[],
+                                       void *args[],
+                                       int8_t arg_is_buffer[],
+                                       int num_attributes,
+                                       float* vertex_buffer,
+                                       int num_coords_dim0,
+                                       int num_coords_dim1);
 // @}
 
 /** Set the underlying cuda device pointer for a buffer. The device
@@ -59,6 +72,114 @@ extern int halide_cuda_detach_device_ptr(void *user_context, struct halide_buffe
  */
 extern uintptr_t halide_cuda_get_device_ptr(void *user_context, struct halide_buffer_t *buf);
 
+/** Device memory freed by halide_cuda_device_free is kept by the runtime
+ * and reused by later allocations of a similar size, on the same stream or
+ * (after waiting on an event) another one, so that training and streaming
+ * loops don't pay for cuMemAlloc and the synchronization of cuMemFree at
+ * every step. This returns the cached memory of the current context to
+ * the driver, along with the pinned staging buffers of asynchronous copies.
+ * It also happens when an allocation fails, and in halide_device_release. */
+extern int halide_cuda_release_unused_device_allocations(void *user_context);
+
+/** Counters of the caching device allocator, since the process started. */
+struct halide_cuda_allocator_stats {
+    /** Allocations served from, or missing, the cache. */
+    uint64_t num_hits, num_misses;
+    /** Bytes of device memory held in the cache. */
+    uint64_t bytes_cached;
+};
+
+extern int halide_cuda_get_allocator_stats(void *user_context, struct halide_cuda_allocator_stats *stats);
+
+/** Turn asynchronous copies on or off (the default). Copies between the
+ * host and the device are then queued on the stream of
+ * halide_cuda_get_stream, like the kernels, instead of blocking the host.
+ * Copies to the device are packed into pinned staging buffers, so the host
+ * buffer may change as soon as the copy returns. Copies to the host wait
+ * for the stream, since the host is about to read the data: the host only
+ * waits for the device when it reads a device buffer (e.g. at the outputs
+ * of a pipeline) or in halide_device_sync. Independent pipelines can run
+ * concurrently on the device by giving them user_contexts for which
+ * halide_cuda_get_stream returns different streams. This has no effect if
+ * the driver doesn't support streams. */
+extern void halide_cuda_set_async_copies(bool async);
+
+/** The host memory of buffers allocated with
+ * halide_device_and_host_malloc on the CUDA device interface (e.g.
+ * Buffer::device_and_host_malloc, or the internal Funcs used on both the
+ * host and the device) is page-locked, so that copies between it and the
+ * device run at full bandwidth. Pinned memory freed by
+ * halide_device_and_host_free is kept for reuse, up to this many bytes;
+ * the rest is returned to the driver, as is the whole pool by
+ * halide_cuda_release_unused_device_allocations. A negative size (the
+ * default) sizes the pool by the transfers seen by the profiler: the
+ * bytes copied per run by the profiled pipeline that copies the most, or
+ * 32MB if nothing has been profiled. */
+extern void halide_cuda_set_pinned_host_pool_size(int64_t bytes);
+
+/** Turn managed memory mode on or off (the default). Device allocations
+ * are then made with cuMemAllocManaged, so that pipelines whose working
+ * set exceeds the memory of the device run, more slowly, as the driver
+ * migrates pages on demand, instead of failing to allocate. Before each
+ * kernel launch, the managed buffers it uses are prefetched to the
+ * device. On devices that allow concurrent managed access (Pascal and
+ * later), buffers allocated with halide_device_and_host_malloc share a
+ * single managed allocation between the host and the device, and copies
+ * between the two only synchronize with the device; these must be
+ * freed with halide_device_and_host_free. This affects allocations made
+ * after the call. */
+extern void halide_cuda_set_managed_memory(bool managed);
+
+/** Capture the kernel launches of a region of code, typically a call to a
+ * pipeline, into a CUDA graph, to save the launch overhead of pipelines
+ * made of many small kernels. The first time a region with a given key
+ * runs, its launches run as usual and are recorded. The following times,
+ * the launches of the region are deferred while they match the recorded
+ * ones, and halide_cuda_graph_end launches the whole graph at once. The
+ * key typically identifies the pipeline and the shapes of its buffers,
+ * but the launches are checked anyway: if a kernel, its launch
+ * configuration, or an argument (including the device pointer of a
+ * buffer) differs, the deferred kernels are launched and the rest of the
+ * region runs as usual, and the graph is recorded again the next time.
+ * The same happens at a copy, a device free or a halide_device_sync in the
+ * region, so regions work best around pipelines whose buffers are already
+ * on the device. Regions can't be nested, and are tracked per user_context.
+ * These are no-ops if the driver doesn't support graphs. */
+// @{
+extern int halide_cuda_graph_begin(void *user_context, uint64_t key);
+extern int halide_cuda_graph_end(void *user_context);
+// @}
+
+/** Extern stages that call cuBLAS and cuDNN on the device buffers they
+ * are passed, on the stream and in the context of the rest of the
+ * pipeline, so that they need no copies or synchronization. They are
+ * meant to be called through the Funcs made by Halide::cublas_gemm and
+ * Halide::cudnn_conv (see CudaLibraries.h), which define them with
+ * DeviceAPI::CUDA. The libraries are loaded the first time they are
+ * used, and their handles are destroyed by halide_device_release. The
+ * innermost dimension of each buffer must be dense, and the filters
+ * too. Graph regions (see halide_cuda_graph_begin) launch the kernels
+ * they defer before these stages, which they don't capture. */
+// @{
+extern int halide_cublas_gemm(void *user_context, int transpose_a, int transpose_b, int k,
+                              struct halide_buffer_t *a, struct halide_buffer_t *b,
+                              struct halide_buffer_t *c);
+extern int halide_cudnn_conv_forward(void *user_context, int channels,
+                                     int filter_width, int filter_height, int stride,
+                                     struct halide_buffer_t *input, struct halide_buffer_t *filter,
+                                     struct halide_buffer_t *output);
+extern int halide_cudnn_conv_backward_data(void *user_context, int output_channels,
+                                           int filter_width, int filter_height, int stride,
+                                           struct halide_buffer_t *filter,
+                                           struct halide_buffer_t *d_output,
+                                           struct halide_buffer_t *d_input);
+extern int halide_cudnn_conv_backward_filter(void *user_context, int width, int height,
+                                             int batch, int stride,
+                                             struct halide_buffer_t *input,
+                                             struct halide_buffer_t *d_output,
+                                             struct halide_buffer_t *d_filter);
+// @}
+
 #ifdef __cplusplus
 } // End extern "C"
 #endif
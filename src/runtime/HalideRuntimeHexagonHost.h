@@ -45,12 +45,19 @@ extern int halide_hexagon_detach_device_handle(void *user_context, struct halide
 extern void *halide_hexagon_get_device_handle(void *user_context, struct halide_buffer_t *buf);
 extern uint64_t halide_hexagon_get_device_size(void *user_context, struct halide_buffer_t *buf);
 
+/** Freed ION buffers are kept for reuse by later device allocations of
+ * similar sizes, until halide_device_release. Call this to give them
+ * back to the system sooner. */
+extern int halide_hexagon_release_unused_device_allocations(void *user_context);
+
 /** Power HVX on and off. Calling a Halide pipeline will do this
  * automatically on each pipeline invocation; however, it costs a
  * small but possibly significant amount of time for short running
  * pipelines. To avoid this cost, HVX can be powered on prior to
  * running several pipelines, and powered off afterwards. If HVX is
- * powered on, subsequent calls to power HVX on will be cheap. */
+ * powered on, subsequent calls to power HVX on will be cheap: the
+ * host counts the calls, and only the first power on and the last
+ * power off call the DSP. */
 // @{
 extern int halide_hexagon_power_hvx_on(void *user_context);
 extern int halide_hexagon_power_hvx_off(void *user_context);
@@ -107,7 +114,8 @@ typedef halide_hexagon_power_t halide_hvx_power_perf_t;
  * Hexagon in a high power state for too long. These functions can
  * significantly increase standby power consumption. Use
  * halide_hexagon_power_default to reset performance to the default
- * power state. */
+ * power state. Voting again for the current settings doesn't call the
+ * DSP, so it is cheap to vote once per frame. */
 // @{
 extern int halide_hexagon_set_performance_mode(void *user_context, halide_hexagon_power_mode_t mode);
 extern int halide_hexagon_set_performance(void *user_context, halide_hexagon_power_t *perf);
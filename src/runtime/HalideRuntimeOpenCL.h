@@ -13,6 +13,12 @@ extern "C" {
 
 #define HALIDE_RUNTIME_OPENCL
 
+/** On devices that share memory with the host (CL_DEVICE_HOST_UNIFIED_MEMORY,
+ * e.g. integrated GPUs), the device allocation of a buffer that has host
+ * memory wraps it (CL_MEM_USE_HOST_PTR), and copies between the two
+ * only map and unmap the buffer. The host memory must then outlive the
+ * device allocation, as it does for Halide::Runtime::Buffer. Drivers
+ * typically only avoid copying for host memory aligned to a page. */
 extern const struct halide_device_interface_t *halide_opencl_device_interface();
 
 /** These are forward declared here to allow clients to override the
@@ -63,6 +69,17 @@ extern void halide_opencl_set_device_type(const char *n);
  * halide_set_ocl_device_type. */
 extern const char *halide_opencl_get_device_type(void *user_context);
 
+/** Building OpenCL programs from source can take seconds. If the
+ * environment variable HL_OCL_PROGRAM_CACHE names a directory, the
+ * program binaries built are stored there, keyed by the source, the
+ * build options, the device name and the driver version, and later
+ * processes load them with clCreateProgramWithBinary instead.
+ *
+ * The programs of a pipeline are built at the start of each call to
+ * it, before the bounds query is answered. To have all the kernels of a
+ * pipeline ready before it is first needed, call it in bounds query
+ * mode on a background thread at startup. */
+
 /** Set the underlying cl_mem for a halide_buffer_t. This memory should be
  * allocated using clCreateBuffer or similar and must have an extent
  * large enough to cover that specified by the halide_buffer_t extent
@@ -20,6 +20,30 @@ extern int halide_qurt_hvx_unlock(void *user_context);
 extern void halide_qurt_hvx_unlock_as_destructor(void *user_context, void * /*obj*/);
 // @}
 
+/** Allocate and free memory in VTCM, the vector tightly coupled
+ * memory available on Hexagon v65 and later. If VTCM is unavailable
+ * or exhausted, halide_vtcm_malloc falls back to halide_malloc, and
+ * halide_vtcm_free releases the memory accordingly. Allocations of
+ * zero bytes return NULL. */
+// @{
+extern void *halide_vtcm_malloc(void *user_context, int size);
+extern void halide_vtcm_free(void *user_context, void *ptr);
+// @}
+
+/** Returns non-zero if ptr points into a live allocation made in VTCM
+ * by halide_vtcm_malloc, and zero if it points elsewhere (including
+ * allocations from halide_vtcm_malloc that fell back to DDR). */
+extern int halide_vtcm_contains(const void *ptr);
+
+/** Copy height rows of width_bytes bytes from src to dst, whose rows
+ * start stride bytes apart, for Funcs scheduled with Func::dma. The
+ * source is streamed into L2 by the hardware prefetcher a block of
+ * rows ahead of the copy, so that the copy doesn't stall on each load
+ * from DDR. Returns zero. */
+extern int halide_hexagon_dma_copy_2d(void *dst, int dst_stride_bytes,
+                                      const void *src, int src_stride_bytes,
+                                      int width_bytes, int height);
+
 #ifdef __cplusplus
 } // End extern "C"
 #endif
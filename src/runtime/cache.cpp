@@ -2,6 +2,7 @@
 #include "device_buffer_utils.h"
 #include "printer.h"
 #include "scoped_mutex_lock.h"
+#include "shared_memory.h"
 
 namespace Halide { namespace Runtime { namespace Internal {
 
@@ -53,8 +54,25 @@ WEAK void debug_print_key(void *user_context, const char *msg, const uint8_t *ca
 }
 #endif
 
+// Keys are short, and usually differ (if at all) in their first 8 bytes,
+// the hash of the function name, so compare them 8 bytes at a time inline
+// rather than calling memcmp.
 WEAK bool keys_equal(const uint8_t *key1, const uint8_t *key2, size_t key_size) {
-    return memcmp(key1, key2, key_size) == 0;
+    size_t i = 0;
+    for (; i + 8 <= key_size; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, key1 + i, 8);
+        memcpy(&b, key2 + i, 8);
+        if (a != b) {
+            return false;
+        }
+    }
+    for (; i < key_size; i++) {
+        if (key1[i] != key2[i]) {
+            return false;
+        }
+    }
+    return true;
 }
 
 
@@ -75,6 +93,9 @@ struct CacheEntry {
     uint32_t hash;
     uint32_t in_use_count; // 0 if none returned from halide_cache_lookup
     uint32_t tuple_count;
+    // The hint given to Func::memoize of how expensive the result is to
+    // recompute.
+    int32_t eviction_cost;
     // The shape of the computed data. There may be more data allocated than this.
     int32_t dimensions;
     halide_dimension_t *computed_bounds;
@@ -84,9 +105,11 @@ struct CacheEntry {
     bool init(const uint8_t *cache_key, size_t cache_key_size,
               uint32_t key_hash,
               const halide_buffer_t *computed_bounds_buf,
-              int32_t tuples, halide_buffer_t **tuple_buffers);
+              int32_t tuples, halide_buffer_t **tuple_buffers,
+              int32_t cost);
     void destroy(void *user_context);
     halide_buffer_t &buffer(int32_t i);
+    uint64_t size_in_bytes() const;
 
 };
 
@@ -112,7 +135,8 @@ WEAK CacheBlockHeader *get_pointer_to_header(uint8_t * host) {
 
 WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
                            uint32_t key_hash, const halide_buffer_t *computed_bounds_buf,
-                           int32_t tuples, halide_buffer_t **tuple_buffers) {
+                           int32_t tuples, halide_buffer_t **tuple_buffers,
+                           int32_t cost) {
     next = NULL;
     more_recent = NULL;
     less_recent = NULL;
@@ -120,6 +144,7 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     hash = key_hash;
     in_use_count = 0;
     tuple_count = tuples;
+    eviction_cost = cost;
     dimensions = computed_bounds_buf->dimensions;
 
     // Allocate all the necessary space (or die)
@@ -169,6 +194,9 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     return true;
 }
 
+// The entry owns the device allocations of the buffers it was stored
+// with, so results computed on a device stay resident there until the
+// entry is evicted.
 WEAK void CacheEntry::destroy(void *user_context) {
     for (uint32_t i = 0; i < tuple_count; i++) {
         halide_device_free(user_context, &buf[i]);
@@ -177,43 +205,101 @@ WEAK void CacheEntry::destroy(void *user_context) {
     halide_free(user_context, metadata_storage);
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-        h = (h << 5) + h + key[i];
+WEAK uint64_t CacheEntry::size_in_bytes() const {
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < tuple_count; i++) {
+        bytes += buf[i].size_in_bytes();
+    }
+    return bytes;
+}
+
+// MurmurHash64A, on 8 bytes at a time.
+WEAK uint64_t hash_bytes(const uint8_t *bytes, size_t size, uint64_t seed = 0) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    uint64_t h = seed ^ (size * m);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t k;
+        memcpy(&k, bytes + i, 8);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (i < size) {
+        uint64_t k = 0;
+        memcpy(&k, bytes + i, size - i);
+        h ^= k;
+        h *= m;
     }
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
     return h;
 }
 
-WEAK halide_mutex memoization_lock = { { 0 } };
+// The hash of a key, folded to 32 bits. Keys are the concatenated values
+// of the arguments of the memoized Func and can be long.
+WEAK uint32_t hash_key(const uint8_t *key, size_t key_size) {
+    uint64_t h = hash_bytes(key, key_size);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// The cache is split into shards, each with its own lock, hash table and
+// LRU list, so that concurrent lookups of different keys rarely contend.
+// The low bits of the hash pick the shard, the next ones the bucket.
+// Evictions take the unused entry with the lowest eviction cost per byte
+// among the least recently used ones of each shard, so the cache as a
+// whole is approximately LRU among entries of equal cost.
+const size_t kNumShards = 16;
+const size_t kHashTableSize = 64;
+
+struct CacheShard {
+    halide_mutex lock;
+    CacheEntry *entries[kHashTableSize];
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+};
 
-const size_t kHashTableSize = 256;
+WEAK CacheShard cache_shards[kNumShards];
 
-WEAK CacheEntry *cache_entries[kHashTableSize];
+WEAK __attribute((always_inline)) CacheShard &shard_for_hash(uint32_t h) {
+    return cache_shards[h % kNumShards];
+}
 
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK __attribute((always_inline)) uint32_t bucket_for_hash(uint32_t h) {
+    return (h / kNumShards) % kHashTableSize;
+}
 
 // HACK for siggraph paper: default cache size is huge so we don't have to think about it
 const uint64_t kDefaultCacheSize = 1LL << 32LL;
+// The sizes are shared by all the shards, so they are only accessed
+// atomically.
 WEAK int64_t max_cache_size = kDefaultCacheSize;
 WEAK int64_t current_cache_size = 0;
 
+WEAK bool cache_over_budget() {
+    return __atomic_load_n(&current_cache_size, __ATOMIC_RELAXED) >
+        __atomic_load_n(&max_cache_size, __ATOMIC_RELAXED);
+}
+
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
+// Must be called with the shard locked.
+WEAK void validate_cache(CacheShard *shard) {
+    print(NULL) << "validating cache shard, "
                 << "current size " << current_cache_size
                 << " of maximum " << max_cache_size << "\n";
     int entries_in_hash_table = 0;
     for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+        CacheEntry *entry = shard->entries[i];
         while (entry != NULL) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->more_recent == NULL && entry != shard->most_recently_used) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
+            if (entry->less_recent == NULL && entry != shard->least_recently_used) {
                 halide_print(NULL, "cache invalid case 2\n");
                 __builtin_trap();
             }
@@ -221,13 +307,13 @@ WEAK void validate_cache() {
         }
     }
     int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
+    CacheEntry *mru_chain = shard->most_recently_used;
     while (mru_chain != NULL) {
         entries_from_mru++;
         mru_chain = mru_chain->less_recent;
     }
     int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
+    CacheEntry *lru_chain = shard->least_recently_used;
     while (lru_chain != NULL) {
         entries_from_lru++;
         lru_chain = lru_chain->more_recent;
@@ -250,62 +336,352 @@ WEAK void validate_cache() {
 }
 #endif
 
-WEAK void prune_cache(void *user_context) {
+// Remove an unused entry from its shard and free it. Must be called with
+// the shard locked.
+WEAK void evict_entry(void *user_context, CacheShard *shard, CacheEntry *entry) {
+    uint32_t index = bucket_for_hash(entry->hash);
+    CacheEntry *more_recent = entry->more_recent;
+
+    // Remove from hash table
+    CacheEntry *prev_hash_entry = shard->entries[index];
+    if (prev_hash_entry == entry) {
+        shard->entries[index] = entry->next;
+    } else {
+        while (prev_hash_entry != NULL && prev_hash_entry->next != entry) {
+            prev_hash_entry = prev_hash_entry->next;
+        }
+        halide_assert(NULL, prev_hash_entry != NULL);
+        prev_hash_entry->next = entry->next;
+    }
+
+    // Remove from less recent chain.
+    if (shard->least_recently_used == entry) {
+        shard->least_recently_used = more_recent;
+    }
+    if (more_recent != NULL) {
+        more_recent->less_recent = entry->less_recent;
+    }
+
+    // Remove from more recent chain.
+    if (shard->most_recently_used == entry) {
+        shard->most_recently_used = entry->less_recent;
+    }
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = more_recent;
+    }
+
+    // Decrease cache used amount.
+    __atomic_fetch_sub(&current_cache_size, (int64_t)entry->size_in_bytes(), __ATOMIC_RELAXED);
+
+    // Deallocate the entry.
+    entry->destroy(user_context);
+    halide_free(user_context, entry);
+}
+
+// Evictions pick, among this many of the least recently used unused
+// entries of a shard, the one that is cheapest to recompute per byte.
+const int kEvictionCandidates = 8;
+
+// The next entry of a shard to evict, or NULL if all its entries are in
+// use. Must be called with the shard locked.
+WEAK CacheEntry *eviction_candidate(CacheShard *shard, double *cost_per_byte) {
+    CacheEntry *victim = NULL;
+    int candidates = 0;
+    for (CacheEntry *entry = shard->least_recently_used;
+         entry != NULL && candidates < kEvictionCandidates;
+         entry = entry->more_recent) {
+        if (__atomic_load_n(&entry->in_use_count, __ATOMIC_ACQUIRE) != 0) {
+            continue;
+        }
+        candidates++;
+        double c = (double)entry->eviction_cost / (double)(entry->size_in_bytes() + 1);
+        if (victim == NULL || c < *cost_per_byte) {
+            victim = entry;
+            *cost_per_byte = c;
+        }
+    }
+    return victim;
+}
+
+// Evict entries of a shard until the cache fits in its budget, or the
+// next candidate of the shard costs more per byte than max_cost_per_byte.
+// Returns whether anything was evicted. Must be called with the shard
+// locked.
+WEAK bool prune_shard(void *user_context, CacheShard *shard, double max_cost_per_byte) {
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_cache(shard);
 #endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
+    bool evicted = false;
+    while (cache_over_budget()) {
+        double cost_per_byte = 0;
+        CacheEntry *victim = eviction_candidate(shard, &cost_per_byte);
+        if (victim == NULL || cost_per_byte > max_cost_per_byte) {
+            break;
+        }
+        evict_entry(user_context, shard, victim);
+        evicted = true;
+    }
+#if CACHE_DEBUGGING
+    validate_cache(shard);
+#endif
+    return evicted;
+}
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
+// Evict from the shard with the cheapest candidate, until the cache fits
+// in its budget. Only one shard is locked at a time, so candidates may
+// change between the survey and the eviction, which makes the order of
+// evictions approximate. Must be called with no shard locked.
+WEAK void prune_cache(void *user_context) {
+    while (cache_over_budget()) {
+        CacheShard *best_shard = NULL;
+        double best_cost = 0, second_best_cost = -1;
+        for (size_t i = 0; i < kNumShards; i++) {
+            CacheShard *shard = &cache_shards[i];
+            double cost_per_byte = 0;
+            CacheEntry *candidate;
+            {
+                ScopedMutexLock lock(&shard->lock);
+                candidate = eviction_candidate(shard, &cost_per_byte);
             }
-
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
+            if (candidate == NULL) {
+                continue;
             }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
+            if (best_shard == NULL || cost_per_byte < best_cost) {
+                second_best_cost = best_shard ? best_cost : -1;
+                best_shard = shard;
+                best_cost = cost_per_byte;
+            } else if (second_best_cost < 0 || cost_per_byte < second_best_cost) {
+                second_best_cost = cost_per_byte;
             }
+        }
+        if (best_shard == NULL) {
+            // Everything left is in use.
+            return;
+        }
+        // Keep evicting from this shard while it has the cheapest
+        // entries.
+        ScopedMutexLock lock(&best_shard->lock);
+        if (!prune_shard(user_context, best_shard,
+                         second_best_cost < 0 ? 1e300 : second_best_cost)) {
+            // The candidate was claimed by a lookup meanwhile. Leave the
+            // rest to the next store.
+            return;
+        }
+    }
+}
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
-            }
 
-            // Deallocate the entry.
-            prune_candidate->destroy(user_context);
-            halide_free(user_context, prune_candidate);
+// The optional backing store of the cache: a table of fixed-size slots
+// in a file mapped into the memory of every process that uses it, such
+// as the workers of a prefork server, so that they reuse each other's
+// results, and so that results survive restarts. Slots are found by
+// probing from the hash of the key. Each slot is guarded by a sequence
+// number, which is odd while the slot is being written, and a checksum
+// of its contents. Readers copy the contents out without taking any
+// lock, and discard the copy if the sequence number changed meanwhile
+// or the checksum doesn't match, in which case the lookup is a miss.
+// Writers claim a slot by making its sequence number odd, and skip the
+// store if another writer has it; a writer that dies while holding a
+// slot makes it unusable until the file is deleted.
+const uint64_t kSharedCacheMagic = 0x314d454d44494c48ULL;  // "HLIDMEM1"
+const uint32_t kSharedCacheProbes = 4;
+
+struct SharedCacheHeader {
+    uint64_t magic;
+    uint64_t slot_count;
+    uint64_t slot_bytes;
+};
+
+// Each slot is followed by its payload: the key, padded to 8 bytes, the
+// computed bounds, the shape of each tuple buffer, and the contents of
+// each tuple buffer.
+struct SharedCacheSlot {
+    uint64_t sequence;
+    uint64_t checksum;
+    uint64_t payload_bytes;
+    uint32_t hash;
+    uint32_t key_size;
+    uint32_t tuple_count;
+    int32_t dimensions;
+    int32_t eviction_cost;
+    uint32_t padding;
+};
+
+const size_t kSharedCacheAlignment = 64;
+
+// Set and cleared only when no pipeline is using the cache.
+WEAK SharedCacheHeader *shared_cache = NULL;
+WEAK size_t shared_cache_bytes = 0;
+
+WEAK __attribute((always_inline)) size_t shared_cache_round_up(size_t bytes) {
+    return (bytes + kSharedCacheAlignment - 1) & ~(kSharedCacheAlignment - 1);
+}
+
+WEAK SharedCacheSlot *shared_cache_slot(uint64_t index) {
+    uint8_t *base = (uint8_t *)shared_cache + shared_cache_round_up(sizeof(SharedCacheHeader));
+    return (SharedCacheSlot *)(base + index * shared_cache->slot_bytes);
+}
+
+WEAK uint8_t *shared_cache_payload(SharedCacheSlot *slot) {
+    return (uint8_t *)slot + shared_cache_round_up(sizeof(SharedCacheSlot));
+}
+
+// The bytes of the payload before the contents of the tuple buffers.
+WEAK size_t shared_cache_metadata_bytes(int32_t key_size, int32_t dimensions, int32_t tuple_count) {
+    return ((key_size + 7) & ~7) + sizeof(halide_dimension_t) * dimensions * (tuple_count + 1);
+}
+
+WEAK uint64_t shared_cache_payload_bytes(int32_t key_size, const halide_buffer_t *computed_bounds,
+                                         int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    uint64_t bytes = shared_cache_metadata_bytes(key_size, computed_bounds->dimensions, tuple_count);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        bytes += tuple_buffers[i]->size_in_bytes();
+    }
+    return bytes;
+}
+
+// Copy the result for the key into tuple_buffers, if the table has one
+// of the same shape.
+WEAK bool shared_cache_read(const uint8_t *cache_key, int32_t size, uint32_t h,
+                            const halide_buffer_t *computed_bounds,
+                            int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                            int32_t *eviction_cost) {
+    int32_t dimensions = computed_bounds->dimensions;
+    uint64_t payload_bytes = shared_cache_payload_bytes(size, computed_bounds, tuple_count, tuple_buffers);
+    size_t metadata_bytes = shared_cache_metadata_bytes(size, dimensions, tuple_count);
+    for (uint32_t p = 0; p < kSharedCacheProbes; p++) {
+        SharedCacheSlot *slot = shared_cache_slot((h + p) % shared_cache->slot_count);
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == 0 || (sequence & 1)) {
+            continue;
+        }
+        if (slot->hash != h || slot->key_size != (uint32_t)size ||
+            slot->tuple_count != (uint32_t)tuple_count || slot->dimensions != dimensions ||
+            slot->payload_bytes != payload_bytes) {
+            continue;
+        }
+        const uint8_t *payload = shared_cache_payload(slot);
+        if (!keys_equal(payload, cache_key, size)) {
+            continue;
+        }
+        const halide_dimension_t *shapes =
+            (const halide_dimension_t *)(payload + ((size + 7) & ~7));
+        bool all_bounds_equal = buffer_has_shape(computed_bounds, shapes);
+        for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+            all_bounds_equal = buffer_has_shape(tuple_buffers[i], shapes + (i + 1) * dimensions);
+        }
+        if (!all_bounds_equal) {
+            continue;
+        }
+        uint64_t checksum = slot->checksum;
+        const uint8_t *contents = payload + metadata_bytes;
+        for (int32_t i = 0; i < tuple_count; i++) {
+            size_t bytes = tuple_buffers[i]->size_in_bytes();
+            memcpy(tuple_buffers[i]->host, contents, bytes);
+            contents += bytes;
+        }
+        *eviction_cost = slot->eviction_cost;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence) {
+            // Overwritten while we were copying it.
+            return false;
+        }
+        // Check what we copied, rather than the slot, which may change.
+        uint64_t copied = hash_bytes(payload, metadata_bytes);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            copied = hash_bytes(tuple_buffers[i]->host, tuple_buffers[i]->size_in_bytes(), copied);
+        }
+        if (copied != checksum) {
+            return false;
+        }
+        for (int32_t i = 0; i < tuple_count; i++) {
+            tuple_buffers[i]->set_host_dirty(true);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Write the result for the key to the table, unless it is already
+// there, doesn't fit in a slot, or isn't on the host.
+WEAK void shared_cache_write(const uint8_t *cache_key, int32_t size, uint32_t h,
+                             const halide_buffer_t *computed_bounds,
+                             int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                             int32_t eviction_cost) {
+    for (int32_t i = 0; i < tuple_count; i++) {
+        if (tuple_buffers[i]->device_dirty()) {
+            return;
+        }
+    }
+    int32_t dimensions = computed_bounds->dimensions;
+    uint64_t payload_bytes = shared_cache_payload_bytes(size, computed_bounds, tuple_count, tuple_buffers);
+    size_t metadata_bytes = shared_cache_metadata_bytes(size, dimensions, tuple_count);
+    if (shared_cache_round_up(sizeof(SharedCacheSlot)) + payload_bytes > shared_cache->slot_bytes) {
+        return;
+    }
+
+    // Prefer an empty slot, then the one with the cheapest result.
+    SharedCacheSlot *slot = NULL;
+    for (uint32_t p = 0; p < kSharedCacheProbes; p++) {
+        SharedCacheSlot *s = shared_cache_slot((h + p) % shared_cache->slot_count);
+        uint64_t sequence = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            continue;
         }
+        if (sequence == 0) {
+            slot = s;
+            break;
+        }
+        if (s->hash == h && s->key_size == (uint32_t)size &&
+            s->payload_bytes == payload_bytes &&
+            keys_equal(shared_cache_payload(s), cache_key, size)) {
+            // Some process already stored it.
+            return;
+        }
+        if (slot == NULL || s->eviction_cost < slot->eviction_cost) {
+            slot = s;
+        }
+    }
+    if (slot == NULL) {
+        return;
+    }
+    uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if ((sequence & 1) ||
+        !__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return;
+    }
 
-        prune_candidate = more_recent;
+    slot->hash = h;
+    slot->key_size = size;
+    slot->tuple_count = tuple_count;
+    slot->dimensions = dimensions;
+    slot->eviction_cost = eviction_cost;
+    slot->payload_bytes = payload_bytes;
+    uint8_t *payload = shared_cache_payload(slot);
+    memset(payload, 0, metadata_bytes);
+    memcpy(payload, cache_key, size);
+    halide_dimension_t *shapes = (halide_dimension_t *)(payload + ((size + 7) & ~7));
+    for (int32_t i = 0; i < dimensions; i++) {
+        shapes[i] = computed_bounds->dim[i];
     }
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    for (int32_t i = 0; i < tuple_count; i++) {
+        for (int32_t j = 0; j < dimensions; j++) {
+            shapes[(i + 1) * dimensions + j] = tuple_buffers[i]->dim[j];
+        }
+    }
+    uint8_t *contents = payload + metadata_bytes;
+    for (int32_t i = 0; i < tuple_count; i++) {
+        size_t bytes = tuple_buffers[i]->size_in_bytes();
+        memcpy(contents, tuple_buffers[i]->host, bytes);
+        contents += bytes;
+    }
+    uint64_t checksum = hash_bytes(payload, metadata_bytes);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        checksum = hash_bytes(tuple_buffers[i]->host, tuple_buffers[i]->size_in_bytes(), checksum);
+    }
+    slot->checksum = checksum;
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
 }
 
 }}} // namespace Halide::Runtime::Internal
@@ -317,76 +693,81 @@ WEAK void halide_memoization_cache_set_size(void *user_context, int64_t size) {
         size = kDefaultCacheSize;
     }
 
-    ScopedMutexLock lock(&memoization_lock);
-
-    max_cache_size = size;
+    __atomic_store_n(&max_cache_size, size, __ATOMIC_RELAXED);
     prune_cache(user_context);
 }
 
 WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
                                          halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+    uint32_t h = hash_key(cache_key, size);
+    CacheShard &shard = shard_for_hash(h);
+    uint32_t index = bucket_for_hash(h);
 
-    ScopedMutexLock lock(&memoization_lock);
+    {
+        ScopedMutexLock lock(&shard.lock);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+        debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
 
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
+            }
         }
-    }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
+        CacheEntry *entry = shard.entries[index];
+        while (entry != NULL) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
 
-            // Check all the tuple buffers have the same bounds (they should).
-            bool all_bounds_equal = true;
-            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-            }
+                // Check all the tuple buffers have the same bounds (they should).
+                bool all_bounds_equal = true;
+                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
+                }
 
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
+                if (all_bounds_equal) {
+                    if (entry != shard.most_recently_used) {
+                        halide_assert(user_context, entry->more_recent != NULL);
+                        if (entry->less_recent != NULL) {
+                            entry->less_recent->more_recent = entry->more_recent;
+                        } else {
+                            halide_assert(user_context, shard.least_recently_used == entry);
+                            shard.least_recently_used = entry->more_recent;
+                        }
+                        halide_assert(user_context, entry->more_recent != NULL);
+                        entry->more_recent->less_recent = entry->less_recent;
+
+                        entry->more_recent = NULL;
+                        entry->less_recent = shard.most_recently_used;
+                        if (shard.most_recently_used != NULL) {
+                            shard.most_recently_used->more_recent = entry;
+                        }
+                        shard.most_recently_used = entry;
                     }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
 
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        *buf = entry->buf[i];
                     }
-                    most_recently_used = entry;
-                }
 
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buf[i];
-                }
-
-                entry->in_use_count += tuple_count;
+                    __atomic_fetch_add(&entry->in_use_count, tuple_count, __ATOMIC_ACQ_REL);
 
-                return 0;
+                    return 0;
+                }
             }
+            entry = entry->next;
         }
-        entry = entry->next;
+
+#if CACHE_DEBUGGING
+        validate_cache(&shard);
+#endif
     }
 
     for (int32_t i = 0; i < tuple_count; i++) {
@@ -406,23 +787,35 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
         header->entry = NULL;
     }
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    if (shared_cache != NULL) {
+        int32_t eviction_cost = 0;
+        if (shared_cache_read(cache_key, size, h, computed_bounds,
+                              tuple_count, tuple_buffers, &eviction_cost)) {
+            // Another process computed it. Keep it in the cache of this
+            // process too, and return it as a hit.
+            halide_memoization_cache_store(user_context, cache_key, size, computed_bounds,
+                                           tuple_count, tuple_buffers, eviction_cost);
+            return 0;
+        }
+    }
 
     return 1;
 }
 
 WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
                                         halide_buffer_t *computed_bounds,
-                                        int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+                                        int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                                        int32_t eviction_cost) {
     debug(user_context) << "halide_memoization_cache_store\n";
 
     uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
 
-    uint32_t index = h % kHashTableSize;
+    CacheShard &shard = shard_for_hash(h);
+    uint32_t index = bucket_for_hash(h);
 
-    ScopedMutexLock lock(&memoization_lock);
+    // Not a ScopedMutexLock: the shard is unlocked before the cache is
+    // pruned, which locks the shards one by one.
+    halide_mutex_lock(&shard.lock);
 
 #if CACHE_DEBUGGING
     debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
@@ -437,7 +830,7 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
+    CacheEntry *entry = shard.entries[index];
     while (entry != NULL) {
         if (entry->hash == h && entry->key_size == (size_t)size &&
             keys_equal(entry->key, cache_key, size) &&
@@ -463,6 +856,7 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
                     get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
 
                 }
+                halide_mutex_unlock(&shard.lock);
                 return 0;
             }
         }
@@ -476,16 +870,16 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
             added_size += buf->size_in_bytes();
         }
     }
-    current_cache_size += added_size;
-    prune_cache(user_context);
+    __atomic_fetch_add(&current_cache_size, (int64_t)added_size, __ATOMIC_RELAXED);
 
     CacheEntry *new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
     bool inited = false;
     if (new_entry) {
-        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
+        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers,
+                                 eviction_cost);
     }
     if (!inited) {
-        current_cache_size -= added_size;
+        __atomic_fetch_sub(&current_cache_size, (int64_t)added_size, __ATOMIC_RELAXED);
 
         // This entry is still in use by the caller. Mark it as having no cache entry
         // so halide_memoization_cache_release can free the buffer.
@@ -496,19 +890,20 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
         if (new_entry) {
             halide_free(user_context, new_entry);
         }
+        halide_mutex_unlock(&shard.lock);
         return 0;
     }
 
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
+    new_entry->next = shard.entries[index];
+    new_entry->less_recent = shard.most_recently_used;
+    if (shard.most_recently_used != NULL) {
+        shard.most_recently_used->more_recent = new_entry;
     }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
+    shard.most_recently_used = new_entry;
+    if (shard.least_recently_used == NULL) {
+        shard.least_recently_used = new_entry;
     }
-    cache_entries[index] = new_entry;
+    shard.entries[index] = new_entry;
 
     new_entry->in_use_count = tuple_count;
 
@@ -517,8 +912,19 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_cache(&shard);
 #endif
+    halide_mutex_unlock(&shard.lock);
+
+    if (shared_cache != NULL) {
+        shared_cache_write(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers,
+                           eviction_cost);
+    }
+
+    // The new entry is in use, so it won't be evicted to make room for
+    // itself.
+    prune_cache(user_context);
+
     debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
     return 0;
@@ -532,13 +938,11 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
-
-        halide_assert(user_context, entry->in_use_count > 0);
-        entry->in_use_count--;
-#if CACHE_DEBUGGING
-        validate_cache();
-#endif
+        // No lock is needed: entries are only evicted once their count
+        // drops to zero, and only lookups under the shard lock raise it.
+        uint32_t old_count = __atomic_fetch_sub(&entry->in_use_count, 1, __ATOMIC_ACQ_REL);
+        halide_assert(user_context, old_count > 0);
+        (void)old_count;
     }
 
     debug(user_context) << "Exited halide_memoization_cache_release.\n";
@@ -546,19 +950,67 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
 
 WEAK void halide_memoization_cache_cleanup(void *user_context) {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy(user_context);
-            halide_free(user_context, entry);
-            entry = next;
+    for (size_t s = 0; s < kNumShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        ScopedMutexLock lock(&shard.lock);
+        for (size_t i = 0; i < kHashTableSize; i++) {
+            CacheEntry *entry = shard.entries[i];
+            shard.entries[i] = NULL;
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy(user_context);
+                halide_free(user_context, entry);
+                entry = next;
+            }
         }
+        shard.most_recently_used = NULL;
+        shard.least_recently_used = NULL;
     }
-    current_cache_size = 0;
-    most_recently_used = NULL;
-    least_recently_used = NULL;
+    __atomic_store_n(&current_cache_size, 0, __ATOMIC_RELAXED);
+    halide_memoization_cache_set_backing_store(user_context, NULL, 0, 0);
+}
+
+WEAK int halide_memoization_cache_set_backing_store(void *user_context, const char *path,
+                                                    int64_t size, int32_t slot_count) {
+    if (shared_cache != NULL) {
+        unmap_shared_file(shared_cache, shared_cache_bytes);
+        shared_cache = NULL;
+        shared_cache_bytes = 0;
+    }
+    if (path == NULL) {
+        return 0;
+    }
+
+    size_t header_bytes = shared_cache_round_up(sizeof(SharedCacheHeader));
+    size_t slot_header_bytes = shared_cache_round_up(sizeof(SharedCacheSlot));
+    if (slot_count <= 0 || size < (int64_t)(header_bytes + slot_header_bytes * slot_count)) {
+        error(user_context) << "The memoization cache backing store " << path
+                            << " is too small for " << slot_count << " slots: " << size << " bytes\n";
+        return halide_error_code_generic_error;
+    }
+    size_t bytes = (size_t)size;
+    SharedCacheHeader *header = (SharedCacheHeader *)map_shared_file(path, &bytes);
+    if (header == NULL) {
+        error(user_context) << "Could not map the memoization cache backing store " << path << "\n";
+        return halide_error_code_generic_error;
+    }
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != kSharedCacheMagic) {
+        // A new file. The processes that open it before the magic number
+        // is written agree on the layout if they ask for the same one.
+        header->slot_count = slot_count;
+        header->slot_bytes = ((bytes - header_bytes) / slot_count) & ~(kSharedCacheAlignment - 1);
+        __atomic_store_n(&header->magic, kSharedCacheMagic, __ATOMIC_RELEASE);
+    }
+    // An existing file keeps its own layout.
+    if (header->slot_count == 0 || header->slot_bytes < slot_header_bytes ||
+        header->slot_count > (bytes - header_bytes) / header->slot_bytes) {
+        unmap_shared_file(header, bytes);
+        error(user_context) << "The memoization cache backing store " << path << " is corrupt\n";
+        return halide_error_code_generic_error;
+    }
+    shared_cache = header;
+    shared_cache_bytes = bytes;
+    return 0;
 }
 
 namespace {
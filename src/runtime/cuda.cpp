@@ -3,6 +3,8 @@
 #include "device_interface.h"
 #include "printer.h"
 #include "mini_cuda.h"
+#include "mini_cuda_libraries.h"
+#include "scoped_mutex_lock.h"
 #include "scoped_spin_lock.h"
 
 #define INLINE inline __attribute__((always_inline))
@@ -13,6 +15,7 @@ namespace Halide { namespace Runtime { namespace Internal { namespace Cuda {
 #define CUDA_FN(ret, fn, args) WEAK ret (CUDAAPI *fn)args;
 #define CUDA_FN_OPTIONAL(ret, fn, args) WEAK ret (CUDAAPI *fn)args;
 #define CUDA_FN_3020(ret, fn, fn_3020, args) WEAK ret (CUDAAPI *fn)args;
+#define CUDA_FN_OPTIONAL_3020(ret, fn, fn_3020, args) WEAK ret (CUDAAPI *fn)args;
 #define CUDA_FN_4000(ret, fn, fn_4000, args) WEAK ret (CUDAAPI *fn)args;
 #include "cuda_functions.h"
 
@@ -66,6 +69,7 @@ WEAK void load_libcuda(void *user_context) {
     #define CUDA_FN(ret, fn, args) fn = get_cuda_symbol<ret (CUDAAPI *)args>(user_context, #fn);
     #define CUDA_FN_OPTIONAL(ret, fn, args) fn = get_cuda_symbol<ret (CUDAAPI *)args>(user_context, #fn, true);
     #define CUDA_FN_3020(ret, fn, fn_3020, args) fn = get_cuda_symbol<ret (CUDAAPI *)args>(user_context, #fn_3020);
+    #define CUDA_FN_OPTIONAL_3020(ret, fn, fn_3020, args) fn = get_cuda_symbol<ret (CUDAAPI *)args>(user_context, #fn_3020, true);
     #define CUDA_FN_4000(ret, fn, fn_4000, args) fn = get_cuda_symbol<ret (CUDAAPI *)args>(user_context, #fn_4000);
     #include "cuda_functions.h"
 }
@@ -73,15 +77,28 @@ WEAK void load_libcuda(void *user_context) {
 extern WEAK halide_device_interface_t cuda_device_interface;
 
 WEAK const char *get_error_name(CUresult error);
-WEAK CUresult create_cuda_context(void *user_context, CUcontext *ctx);
+WEAK CUresult create_cuda_context(void *user_context, CUcontext *ctx, int rank, int num_ranks);
+WEAK void release_library_handles(void *user_context, CUcontext ctx);
 
 // A cuda context defined in this module with weak linkage
 CUcontext WEAK context = 0;
-// This spinlock protexts the above context variable.
+
+// When a pipeline is distributed across the ranks of a single process,
+// each rank gets its own context, on its own device if there are
+// enough of them.
+const int max_rank_contexts = 64;
+CUcontext WEAK rank_contexts[max_rank_contexts];
+
+// This spinlock protexts the above context variables.
 volatile int WEAK context_lock = 0;
 
 }}}} // namespace Halide::Runtime::Internal::Cuda
 
+namespace Halide { namespace Runtime { namespace Internal {
+// Defined in distributed.cpp.
+extern WEAK const halide_distributed_transport_t *distributed_transport;
+}}} // namespace Halide::Runtime::Internal
+
 using namespace Halide::Runtime::Internal;
 using namespace Halide::Runtime::Internal::Cuda;
 
@@ -104,6 +121,30 @@ WEAK int halide_cuda_acquire_context(void *user_context, CUcontext *ctx, bool cr
     // If the context has not been initialized, initialize it now.
     halide_assert(user_context, &context != NULL);
 
+    // The ranks of a distributed pipeline each use their own context.
+    const int num_ranks = distributed_transport->num_ranks(user_context);
+    if (num_ranks > 1) {
+        const int rank = distributed_transport->rank(user_context);
+        if (rank < 0 || rank >= max_rank_contexts) {
+            error(user_context) << "CUDA: Can't create a context for rank " << rank << "\n";
+            return CUDA_ERROR_INVALID_VALUE;
+        }
+        CUcontext local_val = rank_contexts[rank];
+        if (local_val == NULL && create) {
+            ScopedSpinLock spinlock(&context_lock);
+            local_val = rank_contexts[rank];
+            if (local_val == NULL) {
+                CUresult error = create_cuda_context(user_context, &local_val, rank, num_ranks);
+                if (error != CUDA_SUCCESS) {
+                    return error;
+                }
+            }
+            rank_contexts[rank] = local_val;
+        }
+        *ctx = local_val;
+        return 0;
+    }
+
     // Note that this null-check of the context is *not* locked with
     // respect to device_release, so we may get a non-null context
     // that's in the process of being destroyed. Things will go badly
@@ -120,7 +161,7 @@ WEAK int halide_cuda_acquire_context(void *user_context, CUcontext *ctx, bool cr
             ScopedSpinLock spinlock(&context_lock);
             local_val = context;
             if (local_val == NULL) {
-                CUresult error = create_cuda_context(user_context, &local_val);
+                CUresult error = create_cuda_context(user_context, &local_val, 0, 1);
                 if (error != CUDA_SUCCESS) {
                     return error;
                 }
@@ -234,7 +275,7 @@ WEAK module_state *find_module_for_context(const registered_filters *filters, CU
     return NULL;
 }
 
-WEAK CUresult create_cuda_context(void *user_context, CUcontext *ctx) {
+WEAK CUresult create_cuda_context(void *user_context, CUcontext *ctx, int rank, int num_ranks) {
     // Initialize CUDA
     CUresult err = cuInit(0);
     if (err != CUDA_SUCCESS) {
@@ -257,7 +298,12 @@ WEAK CUresult create_cuda_context(void *user_context, CUcontext *ctx) {
     }
 
     int device = halide_get_gpu_device(user_context);
-    if (device == -1 && deviceCount == 1) {
+    if (num_ranks > 1) {
+        // Deal the ranks out to the devices, starting from the selected
+        // one.
+        device = ((device < 0 ? 0 : device) + rank) % deviceCount;
+        debug(user_context) << "CUDA: Using device " << device << " for rank " << rank << "\n";
+    } else if (device == -1 && deviceCount == 1) {
         device = 0;
     } else if (device == -1) {
         debug(user_context) << "CUDA: Multiple CUDA devices detected. Selecting the one with the most cores.\n";
@@ -431,412 +477,1308 @@ WEAK bool validate_device_pointer(void *user_context, halide_buffer_t* buf, size
 #endif
 }
 
-}}}} // namespace Halide::Runtime::Internal
+// A block of device memory freed by Halide, kept for reuse. Frees are
+// stream-ordered: the block may still be in use by work queued on
+// 'stream', so it can only be handed to work on that stream right away.
+// Work on other streams first waits on 'event', recorded on 'stream' when
+// the block was freed (NULL if events are unavailable).
+struct cached_block {
+    CUcontext context;
+    CUstream stream;
+    CUevent event;
+    CUdeviceptr ptr;
+    size_t size;
+    bool managed;
+    cached_block *next;
+};
 
-extern "C" {
-WEAK int halide_cuda_initialize_kernels(void *user_context, void **state_ptr, const char* ptx_src, int size) {
-    debug(user_context) << "CUDA: halide_cuda_initialize_kernels (user_context: " << user_context
-                        << ", state_ptr: " << state_ptr
-                        << ", ptx_src: " << (void *)ptx_src
-                        << ", size: " << size << "\n";
+WEAK cached_block *cached_blocks = NULL;
+// This spinlock protects the above list.
+volatile int WEAK cached_blocks_lock = 0;
+WEAK halide_cuda_allocator_stats allocator_stats;
 
-    Context ctx(user_context);
-    if (ctx.error != 0) {
-        return ctx.error;
+// Whether device allocations are made in managed memory (see
+// halide_cuda_set_managed_memory), and whether any has been.
+WEAK bool managed_memory = false;
+WEAK bool managed_memory_allocated = false;
+
+WEAK bool is_managed(CUdeviceptr ptr) {
+    if (!managed_memory_allocated) {
+        return false;
     }
+    unsigned int managed = 0;
+    return (cuPointerGetAttribute(&managed, CU_POINTER_ATTRIBUTE_IS_MANAGED, ptr) == CUDA_SUCCESS &&
+            managed != 0);
+}
 
-    #ifdef DEBUG_RUNTIME
-    uint64_t t_before = halide_current_time_ns(user_context);
-    #endif
+// Whether the device of the current context can access managed memory
+// while the host does, so that the host may use it without synchronizing
+// with every kernel, and it can be prefetched.
+WEAK bool concurrent_managed_access() {
+    CUdevice dev;
+    int concurrent = 0;
+    return (cuCtxGetDevice(&dev) == CUDA_SUCCESS &&
+            cuDeviceGetAttribute(&concurrent, CU_DEVICE_ATTRIBUTE_CONCURRENT_MANAGED_ACCESS, dev) == CUDA_SUCCESS &&
+            concurrent != 0);
+}
 
+// Whether the host field of a buffer is its (managed) device allocation,
+// as made by halide_cuda_device_and_host_malloc in managed memory mode.
+WEAK bool is_unified(const halide_buffer_t *buf) {
+    return buf->host != NULL && (uint64_t)(uintptr_t)buf->host == buf->device;
+}
 
-    halide_assert(user_context, &filters_list_lock != NULL);
-    {
-        ScopedSpinLock spinlock(&filters_list_lock);
+// Start moving the managed buffers a kernel uses to the device, so that
+// they don't fault in a page at a time as the kernel touches them.
+WEAK void prefetch_buffers(void *user_context, CUstream stream, size_t num_args,
+                           void *args[], int8_t arg_is_buffer[]) {
+    CUdevice dev;
+    if (cuCtxGetDevice(&dev) != CUDA_SUCCESS) {
+        return;
+    }
+    for (size_t i = 0; i < num_args; i++) {
+        if (!arg_is_buffer[i]) {
+            continue;
+        }
+        const halide_buffer_t *buf = (const halide_buffer_t *)args[i];
+        if (buf->device && is_managed((CUdeviceptr)buf->device)) {
+            debug(user_context) << "    cuMemPrefetchAsync " << (void *)buf->device
+                                << " " << (uint64_t)buf->size_in_bytes() << "\n";
+            cuMemPrefetchAsync((CUdeviceptr)buf->device, buf->size_in_bytes(), dev, stream);
+        }
+    }
+}
 
-        // Create the state object if necessary. This only happens once, regardless
-        // of how many times halide_initialize_kernels/halide_release is called.
-        // halide_release traverses this list and releases the module objects, but
-        // it does not modify the list nodes created/inserted here.
-        registered_filters **filters = (registered_filters**)state_ptr;
-        if (!(*filters)) {
-            *filters = (registered_filters*)malloc(sizeof(registered_filters));
-            (*filters)->modules = NULL;
-            (*filters)->next = filters_list;
-            filters_list = *filters;
+// A global in constant memory that a buffer read by a kernel is copied
+// into before each of its launches. It is named after the kernel and the
+// index of the argument. Launches reading the same global can't overlap,
+// even on different streams, so each one waits for 'last_use', recorded
+// after the launch before it.
+struct constant_global {
+    CUcontext context;
+    CUmodule module;
+    char name[256];
+    CUdeviceptr ptr;
+    size_t size;
+    CUevent last_use;
+    constant_global *next;
+};
+
+WEAK constant_global *constant_globals = NULL;
+// This mutex protects the above list, and is held from the copies into
+// the globals of a launch until 'last_use' is recorded after it.
+WEAK halide_mutex constant_globals_lock = { { 0 } };
+
+// Find the global of the module named 'name', looking it up the first
+// time. The lock must be held.
+WEAK constant_global *find_constant_global(void *user_context, CUcontext ctx, CUmodule mod,
+                                           const char *name) {
+    for (constant_global *g = constant_globals; g; g = g->next) {
+        if (g->module == mod && g->context == ctx && strcmp(g->name, name) == 0) {
+            return g;
         }
+    }
 
-        // Create the module itself if necessary.
-        module_state *loaded_module = find_module_for_context(*filters, ctx.context);
-        if (loaded_module == NULL) {
-            loaded_module = (module_state *)malloc(sizeof(module_state));
-            debug(user_context) <<  "    cuModuleLoadData " << (void *)ptx_src << ", " << size << " -> ";
+    constant_global *g = (constant_global *)malloc(sizeof(constant_global));
+    if (g == NULL) {
+        error(user_context) << "CUDA: Out of memory allocating constant global " << name << "\n";
+        return NULL;
+    }
+    CUresult err = cuModuleGetGlobal(&g->ptr, &g->size, mod, name);
+    if (err != CUDA_SUCCESS) {
+        error(user_context) << "CUDA: cuModuleGetGlobal for " << name << " failed: "
+                            << get_error_name(err);
+        free(g);
+        return NULL;
+    }
+    g->last_use = NULL;
+    if (cuEventCreate && cuEventRecord && cuEventSynchronize && cuEventDestroy &&
+        cuEventCreate(&g->last_use, CU_EVENT_DISABLE_TIMING) != CUDA_SUCCESS) {
+        g->last_use = NULL;
+    }
+    g->context = ctx;
+    g->module = mod;
+    halide_string_to_string(g->name, g->name + sizeof(g->name), name);
+    g->next = constant_globals;
+    constant_globals = g;
+    return g;
+}
 
-            CUjit_option options[] = { CU_JIT_MAX_REGISTERS };
-            unsigned int max_regs_per_thread = 64;
+// Copy a buffer a kernel reads from constant memory into its global. The
+// copy is ordered after the last launch reading the global, and before
+// the launch on the stream. The lock must be held.
+WEAK CUresult upload_constant(void *user_context, CUcontext ctx, CUmodule mod, CUstream stream,
+                              const char *entry_name, size_t index, const halide_buffer_t *buf,
+                              constant_global **used) {
+    char name[256];
+    char *end = name + sizeof(name);
+    char *dst = halide_string_to_string(name, end, entry_name);
+    dst = halide_string_to_string(dst, end, "_constant_");
+    halide_int64_to_string(dst, end, index, 1);
+
+    constant_global *global = find_constant_global(user_context, ctx, mod, name);
+    if (global == NULL) {
+        return CUDA_ERROR_NOT_FOUND;
+    }
+    if (global->last_use) {
+        if (cuStreamWaitEvent) {
+            cuStreamWaitEvent(stream, global->last_use, 0);
+        } else {
+            cuEventSynchronize(global->last_use);
+        }
+    }
 
-            // A hack to enable control over max register count for
-            // testing. This should be surfaced in the schedule somehow
-            // instead.
-            char *regs = getenv("HL_CUDA_JIT_MAX_REGISTERS");
-            if (regs) {
-                max_regs_per_thread = atoi(regs);
+    size_t size = buf->size_in_bytes();
+    if (size > global->size) {
+        size = global->size;
+    }
+    debug(user_context) << "    copying " << (uint64_t)size << " bytes into constant memory "
+                        << name << "\n";
+    CUresult err;
+    if (cuMemcpyDtoDAsync) {
+        err = cuMemcpyDtoDAsync(global->ptr, (CUdeviceptr)buf->device, size, stream);
+    } else {
+        err = cuMemcpyDtoD(global->ptr, (CUdeviceptr)buf->device, size);
+    }
+    if (err != CUDA_SUCCESS) {
+        error(user_context) << "CUDA: copy into constant memory " << name << " failed: "
+                            << get_error_name(err);
+        return err;
+    }
+    *used = global;
+    return CUDA_SUCCESS;
+}
+
+// Forget the constant globals of the modules of a context, before they
+// are unloaded. The context must be current.
+WEAK void release_constant_globals(CUcontext ctx) {
+    ScopedMutexLock lock(&constant_globals_lock);
+    constant_global **prev = &constant_globals;
+    while (*prev) {
+        constant_global *g = *prev;
+        if (g->context == ctx) {
+            *prev = g->next;
+            if (g->last_use) {
+                cuEventSynchronize(g->last_use);
+                cuEventDestroy(g->last_use);
             }
-            void *optionValues[] = { (void*)(uintptr_t) max_regs_per_thread };
-            CUresult err = cuModuleLoadDataEx(&loaded_module->module, ptx_src, 1, options, optionValues);
+            free(g);
+        } else {
+            prev = &g->next;
+        }
+    }
+}
 
-            if (err != CUDA_SUCCESS) {
-                free(loaded_module);
-                error(user_context) << "CUDA: cuModuleLoadData failed: "
-                                    << get_error_name(err);
-                return err;
+// Round sizes up so that allocations of slightly different sizes can share
+// blocks: to 512 bytes below 1MB, and to 2MB above.
+WEAK size_t round_up_allocation_size(size_t size) {
+    const size_t quantum = size < (1 << 20) ? 512 : (2 << 20);
+    return (size + quantum - 1) / quantum * quantum;
+}
+
+// Free the cached blocks of a context, or of all contexts if ctx is
+// NULL. The context must be current.
+WEAK void release_cached_blocks(void *user_context, CUcontext ctx) {
+    cached_block *released = NULL;
+    {
+        ScopedSpinLock spinlock(&cached_blocks_lock);
+        cached_block **prev = &cached_blocks;
+        while (*prev) {
+            cached_block *block = *prev;
+            if (ctx == NULL || block->context == ctx) {
+                *prev = block->next;
+                block->next = released;
+                released = block;
             } else {
-                debug(user_context) << (void *)(loaded_module->module) << "\n";
+                prev = &block->next;
             }
-            loaded_module->context = ctx.context;
-            loaded_module->next = (*filters)->modules;
-            (*filters)->modules = loaded_module;
         }
     }  // spinlock
+    while (released) {
+        cached_block *next = released->next;
+        debug(user_context) << "    cuMemFree " << (void *)(released->ptr) << "\n";
+        if (released->event) {
+            cuEventDestroy(released->event);
+        }
+        cuMemFree(released->ptr);
+        __atomic_fetch_sub(&allocator_stats.bytes_cached, (uint64_t)released->size, __ATOMIC_RELAXED);
+        free(released);
+        released = next;
+    }
+}
 
-    #ifdef DEBUG_RUNTIME
-    uint64_t t_after = halide_current_time_ns(user_context);
-    debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
-    #endif
+// Whether copies are queued on the stream instead of blocking the host
+// (see halide_cuda_set_async_copies).
+WEAK bool async_copies = false;
 
-    return 0;
+WEAK bool async_copies_supported() {
+    return (cuStreamSynchronize && cuMemcpyHtoDAsync && cuMemcpyDtoHAsync &&
+            cuMemcpyDtoDAsync && cuMemHostAlloc && cuMemFreeHost &&
+            cuEventCreate && cuEventDestroy && cuEventRecord &&
+            cuEventQuery && cuEventSynchronize);
 }
 
-WEAK int halide_cuda_device_free(void *user_context, halide_buffer_t* buf) {
-    // halide_device_free, at present, can be exposed to clients and they
-    // should be allowed to call halide_device_free on any halide_buffer_t
-    // including ones that have never been used with a GPU.
-    if (buf->device == 0) {
-        return 0;
-    }
+// A block of pinned host memory that copies to the device are staged
+// through, so that they can be queued on a stream without the host buffer
+// having to stay unchanged until they complete. 'event' is recorded on the
+// stream after the last copy out of the block, which can be reused once it
+// has completed. The host only writes to these blocks, so they are
+// write-combined: the writes bypass the CPU caches, and the device reads
+// them faster over PCIe.
+struct staging_buffer {
+    CUcontext context;
+    CUevent event;
+    void *ptr;
+    size_t size;
+    staging_buffer *next;
+};
 
-    CUdeviceptr dev_ptr = (CUdeviceptr)buf->device;
+WEAK staging_buffer *staging_buffers = NULL;
+// This spinlock protects the above list.
+volatile int WEAK staging_buffers_lock = 0;
 
-    debug(user_context)
-        <<  "CUDA: halide_cuda_device_free (user_context: " << user_context
-        << ", buf: " << buf << ")\n";
+// Get a staging buffer of at least 'size' bytes that no queued copy reads
+// from, or NULL if pinned memory can't be allocated. The context must be
+// current.
+WEAK staging_buffer *acquire_staging_buffer(void *user_context, CUcontext ctx, size_t size) {
+    staging_buffer *found = NULL;
+    {
+        ScopedSpinLock spinlock(&staging_buffers_lock);
+        for (staging_buffer **prev = &staging_buffers; *prev; prev = &(*prev)->next) {
+            staging_buffer *buffer = *prev;
+            if (buffer->context == ctx && buffer->size >= size &&
+                cuEventQuery(buffer->event) == CUDA_SUCCESS) {
+                *prev = buffer->next;
+                found = buffer;
+                break;
+            }
+        }
+    }  // spinlock
+    if (found) {
+        return found;
+    }
 
-    Context ctx(user_context);
-    if (ctx.error != CUDA_SUCCESS)
-        return ctx.error;
+    found = (staging_buffer *)malloc(sizeof(staging_buffer));
+    if (found == NULL) {
+        return NULL;
+    }
+    found->context = ctx;
+    found->size = round_up_allocation_size(size);
+    if (cuEventCreate(&found->event, CU_EVENT_DISABLE_TIMING) != CUDA_SUCCESS) {
+        free(found);
+        return NULL;
+    }
+    debug(user_context) << "    cuMemHostAlloc " << (uint64_t)found->size << " -> ";
+    if (cuMemHostAlloc(&found->ptr, found->size, CU_MEMHOSTALLOC_WRITECOMBINED) != CUDA_SUCCESS) {
+        debug(user_context) << "failed\n";
+        cuEventDestroy(found->event);
+        free(found);
+        return NULL;
+    }
+    debug(user_context) << found->ptr << "\n";
+    return found;
+}
 
-    #ifdef DEBUG_RUNTIME
-    uint64_t t_before = halide_current_time_ns(user_context);
-    #endif
+// Give back a staging buffer once copies out of it are queued on 'stream'.
+WEAK void release_staging_buffer(staging_buffer *buffer, CUstream stream) {
+    cuEventRecord(buffer->event, stream);
+    ScopedSpinLock spinlock(&staging_buffers_lock);
+    buffer->next = staging_buffers;
+    staging_buffers = buffer;
+}
 
-    halide_assert(user_context, validate_device_pointer(user_context, buf));
+// Free the staging buffers of a context, or of all contexts if ctx is
+// NULL, waiting for the copies out of them. The context must be current.
+WEAK void release_staging_buffers(void *user_context, CUcontext ctx) {
+    staging_buffer *released = NULL;
+    {
+        ScopedSpinLock spinlock(&staging_buffers_lock);
+        staging_buffer **prev = &staging_buffers;
+        while (*prev) {
+            staging_buffer *buffer = *prev;
+            if (ctx == NULL || buffer->context == ctx) {
+                *prev = buffer->next;
+                buffer->next = released;
+                released = buffer;
+            } else {
+                prev = &buffer->next;
+            }
+        }
+    }  // spinlock
+    while (released) {
+        staging_buffer *next = released->next;
+        debug(user_context) << "    cuMemFreeHost " << released->ptr << "\n";
+        cuEventSynchronize(released->event);
+        cuEventDestroy(released->event);
+        cuMemFreeHost(released->ptr);
+        free(released);
+        released = next;
+    }
+}
 
-    debug(user_context) <<  "    cuMemFree " << (void *)(dev_ptr) << "\n";
-    CUresult err = cuMemFree(dev_ptr);
-    // If cuMemFree fails, it isn't likely to succeed later, so just drop
-    // the reference.
-    buf->device_interface->impl->release_module();
-    buf->device_interface = NULL;
-    buf->device = 0;
-    if (err != CUDA_SUCCESS) {
-        // We may be called as a destructor, so don't raise an error here.
-        return err;
+// The host memory of buffers allocated by halide_cuda_device_and_host_malloc
+// is pinned, so that copies between it and the device run at full
+// bandwidth instead of going through a pageable bounce buffer in the
+// driver. Pinned memory is slow to allocate, so freed blocks are kept for
+// reuse, but it also can't be paged out, so only up to a limit (see
+// halide_cuda_set_pinned_host_pool_size).
+struct pinned_block {
+    CUcontext context;
+    void *ptr;
+    size_t size;
+    pinned_block *next;
+};
+
+WEAK pinned_block *pinned_blocks_in_use = NULL;
+WEAK pinned_block *pinned_blocks_free = NULL;
+WEAK uint64_t pinned_bytes_free = 0;
+// This spinlock protects the above lists and counter.
+volatile int WEAK pinned_blocks_lock = 0;
+
+// The limit set by halide_cuda_set_pinned_host_pool_size, or -1 to size
+// the pool by the transfers seen by the profiler.
+WEAK int64_t pinned_pool_limit = -1;
+
+// The bytes copied between the host and a device per run of the profiled
+// pipeline that copies the most, or zero if none has been profiled.
+WEAK uint64_t profiled_transfer_volume() {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    uint64_t volume = 0;
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (p->runs == 0) {
+            continue;
+        }
+        uint64_t bytes = 0;
+        for (int i = 0; i < p->num_funcs; i++) {
+            bytes += p->funcs[i].bytes_copied_to_device + p->funcs[i].bytes_copied_to_host;
+        }
+        bytes /= p->runs;
+        if (bytes > volume) {
+            volume = bytes;
+        }
     }
+    return volume;
+}
 
-    #ifdef DEBUG_RUNTIME
-    uint64_t t_after = halide_current_time_ns(user_context);
-    debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
-    #endif
+WEAK uint64_t pinned_pool_size() {
+    if (pinned_pool_limit >= 0) {
+        return (uint64_t)pinned_pool_limit;
+    }
+    uint64_t volume = profiled_transfer_volume();
+    return volume ? volume : (32 << 20);
+}
 
-    return 0;
+// Free the unused pinned blocks of a context, or of all contexts if ctx
+// is NULL. The context must be current.
+WEAK void release_pinned_blocks(void *user_context, CUcontext ctx) {
+    pinned_block *released = NULL;
+    {
+        ScopedSpinLock spinlock(&pinned_blocks_lock);
+        pinned_block **prev = &pinned_blocks_free;
+        while (*prev) {
+            pinned_block *block = *prev;
+            if (ctx == NULL || block->context == ctx) {
+                *prev = block->next;
+                block->next = released;
+                released = block;
+                pinned_bytes_free -= block->size;
+            } else {
+                prev = &block->next;
+            }
+        }
+    }  // spinlock
+    while (released) {
+        pinned_block *next = released->next;
+        debug(user_context) << "    cuMemFreeHost " << released->ptr << "\n";
+        cuMemFreeHost(released->ptr);
+        free(released);
+        released = next;
+    }
 }
 
-WEAK int halide_cuda_device_release(void *user_context) {
-    debug(user_context)
-        << "CUDA: halide_cuda_device_release (user_context: " <<  user_context << ")\n";
+// Get pinned host memory of at least 'size' bytes, or NULL if it can't be
+// allocated. The context must be current.
+WEAK void *acquire_pinned_block(void *user_context, CUcontext ctx, size_t size) {
+    size = round_up_allocation_size(size);
+    pinned_block *found = NULL;
+    {
+        ScopedSpinLock spinlock(&pinned_blocks_lock);
+        // Best fit, among the blocks at most twice as large.
+        pinned_block **found_prev = NULL;
+        for (pinned_block **prev = &pinned_blocks_free; *prev; prev = &(*prev)->next) {
+            pinned_block *block = *prev;
+            if (block->context != ctx || block->size < size || block->size > 2 * size) {
+                continue;
+            }
+            if (found_prev == NULL || block->size < (*found_prev)->size) {
+                found_prev = prev;
+            }
+        }
+        if (found_prev) {
+            found = *found_prev;
+            *found_prev = found->next;
+            pinned_bytes_free -= found->size;
+            found->next = pinned_blocks_in_use;
+            pinned_blocks_in_use = found;
+        }
+    }  // spinlock
+    if (found) {
+        debug(user_context) << "    reusing pinned " << found->ptr << "\n";
+        return found->ptr;
+    }
 
-    int err;
-    CUcontext ctx;
-    err = halide_cuda_acquire_context(user_context, &ctx, false);
+    found = (pinned_block *)malloc(sizeof(pinned_block));
+    if (found == NULL) {
+        return NULL;
+    }
+    found->context = ctx;
+    found->size = size;
+    debug(user_context) << "    cuMemHostAlloc " << (uint64_t)size << " -> ";
+    CUresult err = cuMemHostAlloc(&found->ptr, size, CU_MEMHOSTALLOC_PORTABLE);
+    if (err == CUDA_ERROR_OUT_OF_MEMORY) {
+        debug(user_context) << "out of memory, releasing pinned blocks\n";
+        release_pinned_blocks(user_context, NULL);
+        err = cuMemHostAlloc(&found->ptr, size, CU_MEMHOSTALLOC_PORTABLE);
+    }
     if (err != CUDA_SUCCESS) {
-        return err;
+        debug(user_context) << "failed\n";
+        free(found);
+        return NULL;
     }
+    debug(user_context) << found->ptr << "\n";
+    ScopedSpinLock spinlock(&pinned_blocks_lock);
+    found->next = pinned_blocks_in_use;
+    pinned_blocks_in_use = found;
+    return found->ptr;
+}
 
-    if (ctx) {
-        // It's possible that this is being called from the destructor of
-        // a static variable, in which case the driver may already be
-        // shutting down.
-        err = cuCtxPushCurrent(ctx);
-        if (err != CUDA_SUCCESS) {
-            err = cuCtxSynchronize();
+// Give back host memory if it came from acquire_pinned_block, keeping it
+// in the pool if there is room. Returns false if it didn't. The context
+// must be current.
+WEAK bool release_pinned_block(void *user_context, void *ptr) {
+    uint64_t limit = pinned_pool_size();
+    pinned_block *released = NULL;
+    {
+        ScopedSpinLock spinlock(&pinned_blocks_lock);
+        for (pinned_block **prev = &pinned_blocks_in_use; *prev; prev = &(*prev)->next) {
+            pinned_block *block = *prev;
+            if (block->ptr == ptr) {
+                *prev = block->next;
+                released = block;
+                break;
+            }
         }
-        halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
+        if (released == NULL) {
+            return false;
+        }
+        if (pinned_bytes_free + released->size <= limit) {
+            released->next = pinned_blocks_free;
+            pinned_blocks_free = released;
+            pinned_bytes_free += released->size;
+            return true;
+        }
+    }  // spinlock
+    debug(user_context) << "    cuMemFreeHost " << released->ptr << "\n";
+    cuMemFreeHost(released->ptr);
+    free(released);
+    return true;
+}
 
-        {
-            ScopedSpinLock spinlock(&filters_list_lock);
+WEAK bool graphs_supported() {
+    return (cuGraphCreate && cuGraphAddKernelNode && cuGraphInstantiate &&
+            cuGraphLaunch && cuGraphExecDestroy && cuGraphDestroy);
+}
 
-            // Unload the modules attached to this context. Note that the list
-            // nodes themselves are not freed, only the module objects are
-            // released. Subsequent calls to halide_init_kernels might re-create
-            // the program object using the same list node to store the module
-            // object.
-            registered_filters *filters = filters_list;
-            while (filters) {
-                module_state **prev_ptr = &filters->modules;
-                module_state *loaded_module = filters->modules;
-                while (loaded_module != NULL) {
-                    if (loaded_module->context == ctx) {
-                        debug(user_context) << "    cuModuleUnload " << loaded_module->module << "\n";
-                        err = cuModuleUnload(loaded_module->module);
-                        halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
-                        *prev_ptr = loaded_module->next;
-                        free(loaded_module);
-                        loaded_module = *prev_ptr;
-                    } else {
-                        loaded_module = loaded_module->next;
-                        prev_ptr = &loaded_module->next;
-                    }
-                }
-                filters = filters->next;
-            }
-        }  // spinlock
+// A kernel launch recorded in a graph region. The block is followed by
+// the kernel parameter pointers, the argument sizes and the argument
+// values they point to.
+struct graph_launch {
+    CUfunction function;
+    unsigned int blocks[3];
+    unsigned int threads[3];
+    unsigned int shared_mem_bytes;
+    size_t num_args;
+    void **params;
+    size_t *arg_sizes;
+    graph_launch *next;
+};
 
-        CUcontext old_ctx;
-        cuCtxPopCurrent(&old_ctx);
+// The kernel launches of the graph regions with a given key (see
+// halide_cuda_graph_begin), and the graph instantiated from them.
+struct cuda_graph {
+    CUcontext context;
+    uint64_t key;
+    graph_launch *launches, *last_launch;
+    // NULL until the launches have been recorded.
+    CUgraphExec exec;
+    // Whether a region is using the graph, and for which user_context.
+    bool active;
+    void *active_user_context;
+    // Whether the active region records the launches, or replays them.
+    bool recording;
+    // Set once the launches of the active region differ from the recorded
+    // ones. The graph will be recorded again.
+    bool diverged;
+    // While replaying, the next launch expected. The launches before it
+    // have been deferred to the graph launch.
+    graph_launch *next_launch;
+    cuda_graph *next;
+};
 
-        // Only destroy the context if we own it
+WEAK cuda_graph *graphs = NULL;
+// This spinlock protects the above list.
+volatile int WEAK graphs_lock = 0;
 
-        {
-            ScopedSpinLock spinlock(&context_lock);
+WEAK cuda_graph *find_active_graph(void *user_context, CUcontext ctx) {
+    ScopedSpinLock spinlock(&graphs_lock);
+    for (cuda_graph *graph = graphs; graph; graph = graph->next) {
+        if (graph->active && graph->context == ctx &&
+            graph->active_user_context == user_context) {
+            return graph;
+        }
+    }
+    return NULL;
+}
 
-            if (ctx == context) {
-                debug(user_context) << "    cuCtxDestroy " << context << "\n";
-                err = cuProfilerStop();
-                err = cuCtxDestroy(context);
-                halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
-                context = NULL;
-            }
-        }  // spinlock
+WEAK void forget_graph_launches(cuda_graph *graph) {
+    if (graph->exec) {
+        cuGraphExecDestroy(graph->exec);
+        graph->exec = NULL;
+    }
+    while (graph->launches) {
+        graph_launch *next = graph->launches->next;
+        free(graph->launches);
+        graph->launches = next;
     }
+    graph->last_launch = NULL;
+    graph->next_launch = NULL;
+}
 
-    halide_cuda_release_context(user_context);
+WEAK graph_launch *make_graph_launch(CUfunction f,
+                                     int blocksX, int blocksY, int blocksZ,
+                                     int threadsX, int threadsY, int threadsZ,
+                                     int shared_mem_bytes, size_t num_args,
+                                     size_t arg_sizes[], void *args[]) {
+    size_t size = sizeof(graph_launch) + (num_args + 1) * sizeof(void *) + num_args * sizeof(size_t);
+    for (size_t i = 0; i < num_args; i++) {
+        size += (arg_sizes[i] + 7) & ~7;
+    }
+    graph_launch *launch = (graph_launch *)malloc(size);
+    if (launch == NULL) {
+        return NULL;
+    }
+    launch->function = f;
+    launch->blocks[0] = blocksX;
+    launch->blocks[1] = blocksY;
+    launch->blocks[2] = blocksZ;
+    launch->threads[0] = threadsX;
+    launch->threads[1] = threadsY;
+    launch->threads[2] = threadsZ;
+    launch->shared_mem_bytes = shared_mem_bytes;
+    launch->num_args = num_args;
+    launch->params = (void **)(launch + 1);
+    launch->arg_sizes = (size_t *)(launch->params + num_args + 1);
+    char *data = (char *)(launch->arg_sizes + num_args);
+    for (size_t i = 0; i < num_args; i++) {
+        launch->params[i] = data;
+        launch->arg_sizes[i] = arg_sizes[i];
+        memcpy(data, args[i], arg_sizes[i]);
+        data += (arg_sizes[i] + 7) & ~7;
+    }
+    launch->params[num_args] = NULL;
+    launch->next = NULL;
+    return launch;
+}
+
+WEAK bool graph_launch_matches(const graph_launch *launch, CUfunction f,
+                               int blocksX, int blocksY, int blocksZ,
+                               int threadsX, int threadsY, int threadsZ,
+                               int shared_mem_bytes, size_t num_args,
+                               size_t arg_sizes[], void *args[]) {
+    if (launch->function != f ||
+        launch->blocks[0] != (unsigned int)blocksX ||
+        launch->blocks[1] != (unsigned int)blocksY ||
+        launch->blocks[2] != (unsigned int)blocksZ ||
+        launch->threads[0] != (unsigned int)threadsX ||
+        launch->threads[1] != (unsigned int)threadsY ||
+        launch->threads[2] != (unsigned int)threadsZ ||
+        launch->shared_mem_bytes != (unsigned int)shared_mem_bytes ||
+        launch->num_args != num_args) {
+        return false;
+    }
+    for (size_t i = 0; i < num_args; i++) {
+        if (launch->arg_sizes[i] != arg_sizes[i] ||
+            memcmp(launch->params[i], args[i], arg_sizes[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stop replaying the active graph region of this user_context, if any:
+// launch the kernels deferred so far, so that the work the caller is
+// about to queue on the stream comes after them. The launches that
+// follow run individually. The context must be current.
+WEAK int flush_graph_replay(void *user_context, CUcontext ctx) {
+    cuda_graph *graph = find_active_graph(user_context, ctx);
+    if (graph == NULL || graph->recording || graph->diverged) {
+        return 0;
+    }
+    graph->diverged = true;
+    if (graph->next_launch == graph->launches) {
+        return 0;
+    }
 
+    CUstream stream = 0;
+    if (cuStreamSynchronize != NULL) {
+        int result = halide_cuda_get_stream(user_context, ctx, &stream);
+        if (result != 0) {
+            error(user_context) << "CUDA: In flush_graph_replay, halide_cuda_get_stream returned " << result << "\n";
+            return result;
+        }
+    }
+    debug(user_context) << "    graph " << graph->key << " diverged, launching the deferred kernels\n";
+    for (graph_launch *launch = graph->launches; launch != graph->next_launch; launch = launch->next) {
+        CUresult err = cuLaunchKernel(launch->function,
+                                      launch->blocks[0], launch->blocks[1], launch->blocks[2],
+                                      launch->threads[0], launch->threads[1], launch->threads[2],
+                                      launch->shared_mem_bytes, stream, launch->params, NULL);
+        if (err != CUDA_SUCCESS) {
+            error(user_context) << "CUDA: cuLaunchKernel failed: "
+                                << get_error_name(err);
+            return err;
+        }
+    }
     return 0;
 }
 
-WEAK int halide_cuda_device_malloc(void *user_context, halide_buffer_t *buf) {
-    debug(user_context)
-        << "CUDA: halide_cuda_device_malloc (user_context: " << user_context
-        << ", buf: " << buf << ")\n";
+// Instantiate a graph of the recorded launches, each depending on the
+// previous one.
+WEAK CUresult instantiate_graph(void *user_context, cuda_graph *graph) {
+    CUgraph g;
+    CUresult err = cuGraphCreate(&g, 0);
+    if (err != CUDA_SUCCESS) {
+        return err;
+    }
+    CUgraphNode prev = NULL;
+    for (graph_launch *launch = graph->launches; launch && err == CUDA_SUCCESS; launch = launch->next) {
+        CUDA_KERNEL_NODE_PARAMS params;
+        params.func = launch->function;
+        params.gridDimX = launch->blocks[0];
+        params.gridDimY = launch->blocks[1];
+        params.gridDimZ = launch->blocks[2];
+        params.blockDimX = launch->threads[0];
+        params.blockDimY = launch->threads[1];
+        params.blockDimZ = launch->threads[2];
+        params.sharedMemBytes = launch->shared_mem_bytes;
+        params.kernelParams = launch->params;
+        params.extra = NULL;
+        CUgraphNode node;
+        err = cuGraphAddKernelNode(&node, g, prev ? &prev : NULL, prev ? 1 : 0, &params);
+        prev = node;
+    }
+    if (err == CUDA_SUCCESS) {
+        err = cuGraphInstantiate(&graph->exec, g, NULL, NULL, 0);
+        if (err != CUDA_SUCCESS) {
+            graph->exec = NULL;
+        }
+    }
+    cuGraphDestroy(g);
+    return err;
+}
 
-    Context ctx(user_context);
-    if (ctx.error != CUDA_SUCCESS) {
-        return ctx.error;
+// Free the graphs of a context, or of all contexts if ctx is NULL. The
+// context must be current.
+WEAK void release_graphs(void *user_context, CUcontext ctx) {
+    cuda_graph *released = NULL;
+    {
+        ScopedSpinLock spinlock(&graphs_lock);
+        cuda_graph **prev = &graphs;
+        while (*prev) {
+            cuda_graph *graph = *prev;
+            if (ctx == NULL || graph->context == ctx) {
+                *prev = graph->next;
+                graph->next = released;
+                released = graph;
+            } else {
+                prev = &graph->next;
+            }
+        }
+    }  // spinlock
+    while (released) {
+        cuda_graph *next = released->next;
+        debug(user_context) << "    releasing graph " << released->key << "\n";
+        forget_graph_launches(released);
+        free(released);
+        released = next;
     }
+}
 
-    size_t size = buf->size_in_bytes();
-    halide_assert(user_context, size != 0);
-    if (buf->device) {
-        // This buffer already has a device allocation
-        halide_assert(user_context, validate_device_pointer(user_context, buf, size));
+// Whether profiled code is running, so that the device work should be
+// billed to the current Func (see halide_profiler_device_kernel). The
+// sampling thread only runs once a profiled pipeline has started.
+WEAK bool profiling_device() {
+    halide_profiler_state *s = halide_profiler_get_state();
+    return s->sampling_thread != NULL && s->current_func >= 0;
+}
+
+// The theoretical occupancy of a kernel launch, in thousandths: the
+// fraction of the threads the device can hold that the launch keeps
+// resident, limited both by the resources a block uses and by the number
+// of blocks.
+WEAK int theoretical_occupancy(CUfunction f, int blocks, int threads_per_block, int shared_mem_bytes) {
+    CUdevice dev;
+    int blocks_per_sm = 0, num_sms = 0, threads_per_sm = 0;
+    if (!cuOccupancyMaxActiveBlocksPerMultiprocessor ||
+        cuCtxGetDevice(&dev) != CUDA_SUCCESS ||
+        cuOccupancyMaxActiveBlocksPerMultiprocessor(&blocks_per_sm, f, threads_per_block,
+                                                    shared_mem_bytes) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&num_sms, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, dev) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&threads_per_sm, CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR, dev) != CUDA_SUCCESS ||
+        num_sms <= 0 || threads_per_sm <= 0) {
         return 0;
     }
-
-    // Check all strides positive.
-    for (int i = 0; i < buf->dimensions; i++) {
-        halide_assert(user_context, buf->dim[i].stride >= 0);
+    int64_t resident_blocks = (int64_t)blocks_per_sm * num_sms;
+    if (blocks < resident_blocks) {
+        resident_blocks = blocks;
     }
+    return (int)(1000 * resident_blocks * threads_per_block / ((int64_t)threads_per_sm * num_sms));
+}
 
-    debug(user_context) << "    allocating " << *buf << "\n";
+// The number of blocks of a kernel the device can keep resident at once,
+// or 0 if the driver can't tell.
+WEAK int max_resident_blocks(CUfunction f, int threads_per_block, int shared_mem_bytes) {
+    CUdevice dev;
+    int blocks_per_sm = 0, num_sms = 0;
+    if (!cuOccupancyMaxActiveBlocksPerMultiprocessor ||
+        cuCtxGetDevice(&dev) != CUDA_SUCCESS ||
+        cuOccupancyMaxActiveBlocksPerMultiprocessor(&blocks_per_sm, f, threads_per_block,
+                                                    shared_mem_bytes) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&num_sms, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, dev) != CUDA_SUCCESS) {
+        return 0;
+    }
+    return blocks_per_sm * num_sms;
+}
 
-    #ifdef DEBUG_RUNTIME
-    uint64_t t_before = halide_current_time_ns(user_context);
-    #endif
+// Whether the current device can launch cooperative kernels, whose blocks
+// the driver guarantees to be resident together.
+WEAK bool cooperative_launch_supported() {
+    CUdevice dev;
+    int supported = 0;
+    return (cuLaunchCooperativeKernel &&
+            cuCtxGetDevice(&dev) == CUDA_SUCCESS &&
+            cuDeviceGetAttribute(&supported, CU_DEVICE_ATTRIBUTE_COOPERATIVE_LAUNCH, dev) == CUDA_SUCCESS &&
+            supported);
+}
 
-    CUdeviceptr p;
-    debug(user_context) << "    cuMemAlloc " << (uint64_t)size << " -> ";
-    CUresult err = cuMemAlloc(&p, size);
+// The last kernel warned about by check_launch, so that a kernel launched
+// in a loop is only reported once.
+WEAK CUfunction last_low_occupancy_kernel = NULL;
+
+// Check a launch against the limits of the device before making it, so
+// that a schedule that doesn't fit fails with a message saying why,
+// rather than with a launch failure:
+// - The threads of a block can't use more registers than the device has
+//   for a block.
+// - The shared memory of the kernel is sized at launch (it's the
+//   allocation of the shared memory of all its Funcs, which may depend on
+//   the sizes of the inputs). Above the default limit of 48KB per block,
+//   the kernel opts into the larger limit of the device, if it has one.
+// If HL_CUDA_MIN_OCCUPANCY is set to a percentage, also print a warning
+// for the kernels launched with a lower theoretical occupancy (see
+// theoretical_occupancy), e.g. because their blocks use so much shared
+// memory that few of them fit on a multiprocessor at once.
+WEAK CUresult check_launch(void *user_context, CUfunction f, const char *entry_name,
+                           int blocks, int threads, int shared_mem_bytes) {
+    if (!cuFuncGetAttribute) {
+        return CUDA_SUCCESS;
+    }
+    CUdevice dev;
+    CUresult err = cuCtxGetDevice(&dev);
     if (err != CUDA_SUCCESS) {
-        debug(user_context) << get_error_name(err) << "\n";
-        error(user_context) << "CUDA: cuMemAlloc failed: "
-                            << get_error_name(err);
         return err;
-    } else {
-        debug(user_context) << (void *)p << "\n";
     }
-    halide_assert(user_context, p);
-    buf->device = p;
-    buf->device_interface = &cuda_device_interface;
-    buf->device_interface->impl->use_module();
 
-    #ifdef DEBUG_RUNTIME
-    uint64_t t_after = halide_current_time_ns(user_context);
-    debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
-    #endif
+    int max_threads = 0, regs = 0;
+    if (cuFuncGetAttribute(&max_threads, CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK, f) == CUDA_SUCCESS &&
+        cuFuncGetAttribute(&regs, CU_FUNC_ATTRIBUTE_NUM_REGS, f) == CUDA_SUCCESS &&
+        threads > max_threads) {
+        error(user_context) << "CUDA: kernel " << entry_name << " is launched with "
+                            << threads << " threads per block, but the device can only run "
+                            << max_threads << " of them at once, using " << regs
+                            << " registers each. Use smaller GPU tiles or fewer GPU threads.\n";
+        return CUDA_ERROR_INVALID_VALUE;
+    }
 
-    return 0;
+    int static_shared = 0, max_shared = 0, max_shared_optin = 0;
+    if (cuFuncGetAttribute(&static_shared, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, f) == CUDA_SUCCESS &&
+        cuDeviceGetAttribute(&max_shared, CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK, dev) == CUDA_SUCCESS &&
+        static_shared + shared_mem_bytes > max_shared) {
+        if (cuFuncSetAttribute &&
+            cuDeviceGetAttribute(&max_shared_optin, CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN, dev) == CUDA_SUCCESS &&
+            static_shared + shared_mem_bytes <= max_shared_optin &&
+            cuFuncSetAttribute(f, CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES, shared_mem_bytes) == CUDA_SUCCESS) {
+            debug(user_context) << "CUDA: kernel " << entry_name << " opted into "
+                                << shared_mem_bytes << " bytes of dynamic shared memory\n";
+        } else {
+            error(user_context) << "CUDA: kernel " << entry_name << " needs "
+                                << static_shared + shared_mem_bytes
+                                << " bytes of shared memory per block, but the device only has "
+                                << (max_shared_optin > max_shared ? max_shared_optin : max_shared)
+                                << ". Use smaller GPU tiles, or store fewer Funcs in shared memory.\n";
+            return CUDA_ERROR_INVALID_VALUE;
+        }
+    }
+
+    const char *min_occupancy = getenv("HL_CUDA_MIN_OCCUPANCY");
+    if (min_occupancy && f != last_low_occupancy_kernel) {
+        int occupancy = theoretical_occupancy(f, blocks, threads, shared_mem_bytes);
+        if (occupancy > 0 && occupancy < 10 * atoi(min_occupancy)) {
+            last_low_occupancy_kernel = f;
+            char buf[512];
+            Printer<StringStreamPrinter, sizeof(buf)> msg(user_context, buf);
+            msg << "Warning: CUDA kernel " << entry_name << " runs at "
+                << occupancy / 10 << "% theoretical occupancy (" << blocks << " blocks of "
+                << threads << " threads, " << regs << " registers per thread, "
+                << static_shared + shared_mem_bytes << " bytes of shared memory per block)\n";
+            halide_print(user_context, msg.str());
+        }
+    }
+    return CUDA_SUCCESS;
 }
 
-namespace {
-WEAK int do_multidimensional_copy(void *user_context, const device_copy &c,
-                                  uint64_t src, uint64_t dst, int d, bool from_host, bool to_host) {
-    if (d > MAX_COPY_DIMS) {
-        error(user_context) << "Buffer has too many dimensions to copy to/from GPU\n";
-        return -1;
-    } else if (d == 0) {
-        CUresult err = CUDA_SUCCESS;
-        const char *copy_name;
-        debug(user_context) << "    from " << (from_host ? "host" : "device")
-                            << " to " << (to_host ? "host" : "device") << ", "
-                            << (void *)src << " -> " << (void *)dst << ", " << c.chunk_size << " bytes\n";
-        if (!from_host && to_host) {
-            err = cuMemcpyDtoH((void *)dst, (CUdeviceptr)src, c.chunk_size);
-        } else if (from_host && !to_host) {
-            err = cuMemcpyHtoD((CUdeviceptr)dst, (void *)src, c.chunk_size);
-        } else if (!from_host && !to_host) {
-            err = cuMemcpyDtoD((CUdeviceptr)dst, (CUdeviceptr)src, c.chunk_size);
-        } else if (dst != src) {
-            // Could reach here if a user called directly into the
-            // cuda API for a device->host copy on a source buffer
-            // with device_dirty = false.
-            memcpy((void *)dst, (void *)src, c.chunk_size);
+// Kernels compiled with HL_CUDA_CUBIN_ARCHS set are embedded as a bundle
+// of cubins, with the PTX as a fallback (see CodeGen_PTX_Dev.cpp): the
+// magic below, the number of cubins padded to 8 bytes and, for each
+// cubin, its architecture (e.g. 61 for sm_61), its size and its bytes
+// padded to 8 bytes, followed by the null-terminated PTX. The counts and
+// sizes are 32 bit.
+const char cubin_bundle_magic[8] = {'H', 'L', 'C', 'U', 'B', 'I', 'N', 0};
+
+// The compute capability of the device of the current context, e.g. 61.
+WEAK CUresult get_device_architecture(int *arch) {
+    CUdevice dev;
+    CUresult err = cuCtxGetDevice(&dev);
+    int major = 0, minor = 0;
+    if (err == CUDA_SUCCESS) {
+        err = cuDeviceGetAttribute(&major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, dev);
+    }
+    if (err == CUDA_SUCCESS) {
+        err = cuDeviceGetAttribute(&minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, dev);
+    }
+    *arch = major * 10 + minor;
+    return err;
+}
+
+// Find the cubin of a bundle that runs on a device of architecture
+// 'arch': cubins run on devices of the same major version and a higher or
+// equal minor version. Also returns the PTX that follows the cubins.
+WEAK const char *find_cubin(const char *src, int size, int arch,
+                            uint32_t *cubin_size, const char **ptx) {
+    const char *end = src + size;
+    const char *p = src + sizeof(cubin_bundle_magic);
+    uint32_t num_cubins;
+    memcpy(&num_cubins, p, sizeof(num_cubins));
+    p += 8;
+    const char *best = NULL;
+    uint32_t best_arch = 0;
+    for (uint32_t i = 0; i < num_cubins && p + 8 <= end; i++) {
+        uint32_t header[2];
+        memcpy(header, p, sizeof(header));
+        p += sizeof(header);
+        if (header[0] / 10 == (uint32_t)arch / 10 && header[0] <= (uint32_t)arch &&
+            header[0] >= best_arch) {
+            best = p;
+            best_arch = header[0];
+            *cubin_size = header[1];
         }
-        if (err != CUDA_SUCCESS) {
-            error(user_context) << "CUDA: " << copy_name << " failed: " << get_error_name(err);
-            return (int)err;
+        p += (header[1] + 7) & ~7;
+    }
+    *ptx = p < end ? p : NULL;
+    return best;
+}
+
+// A 64-bit FNV-1a hash, to name the cached modules.
+WEAK uint64_t hash_bytes(uint64_t h, const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Load a module from PTX, JIT compiling it with at most 'max_regs'
+// registers per thread. If HL_CUDA_MODULE_CACHE names a directory, the
+// cubins compiled are written there, under a name derived from the PTX,
+// the architecture of the device and the register limit, and later loads
+// of the same PTX on the same kind of device read them back instead.
+WEAK CUresult load_ptx_module(void *user_context, const char *ptx, unsigned int max_regs,
+                              CUmodule *module) {
+    CUjit_option options[] = { CU_JIT_MAX_REGISTERS };
+    void *option_values[] = { (void*)(uintptr_t) max_regs };
+
+    const char *cache_dir = getenv("HL_CUDA_MODULE_CACHE");
+    int arch = 0;
+    if (cache_dir == NULL || *cache_dir == 0 ||
+        !(cuLinkCreate && cuLinkAddData && cuLinkComplete && cuLinkDestroy) ||
+        get_device_architecture(&arch) != CUDA_SUCCESS) {
+        debug(user_context) <<  "    cuModuleLoadDataEx " << (void *)ptx << " -> ";
+        return cuModuleLoadDataEx(module, ptx, 1, options, option_values);
+    }
+
+    size_t ptx_size = strlen(ptx);
+    uint64_t key = hash_bytes(0xcbf29ce484222325ULL, ptx, ptx_size);
+    key = hash_bytes(key, (const char *)&arch, sizeof(arch));
+    key = hash_bytes(key, (const char *)&max_regs, sizeof(max_regs));
+    stringstream path(user_context);
+    path << cache_dir << "/halide_cuda_" << key << ".cubin";
+
+    // Try the cache first. A truncated or stale file just fails to load.
+    void *file = fopen(path.str(), "rb");
+    if (file) {
+        size_t capacity = 1 << 16, size = 0;
+        char *cubin = (char *)malloc(capacity);
+        while (cubin) {
+            size += fread(cubin + size, 1, capacity - size, file);
+            if (size < capacity) {
+                break;
+            }
+            char *larger = (char *)malloc(capacity * 2);
+            if (larger) {
+                memcpy(larger, cubin, size);
+            }
+            free(cubin);
+            cubin = larger;
+            capacity *= 2;
         }
-    } else {
-        ssize_t src_off = 0, dst_off = 0;
-        for (int i = 0; i < (int)c.extent[d-1]; i++) {
-            int err = do_multidimensional_copy(user_context, c, src + src_off, dst + dst_off, d - 1, from_host, to_host);
-            dst_off += c.dst_stride_bytes[d-1];
-            src_off += c.src_stride_bytes[d-1];
-            if (err) {
+        fclose(file);
+        if (cubin) {
+            debug(user_context) << "    cuModuleLoadData " << path.str() << " -> ";
+            CUresult err = cuModuleLoadData(module, cubin);
+            free(cubin);
+            if (err == CUDA_SUCCESS) {
                 return err;
             }
+            debug(user_context) << "failed: " << get_error_name(err) << "\n";
         }
     }
-    return 0;
-}
-}
-
-WEAK int halide_cuda_buffer_copy(void *user_context, struct halide_buffer_t *src,
-                                 const struct halide_device_interface_t *dst_device_interface,
-                                 struct halide_buffer_t *dst) {
-    // We only handle copies to cuda or to host
-    halide_assert(user_context, dst_device_interface == NULL ||
-                  dst_device_interface == &cuda_device_interface);
 
-    if (src->device_dirty() &&
-        src->device_interface != &cuda_device_interface) {
-        halide_assert(user_context, dst_device_interface == &cuda_device_interface);
-        // If the source is not cuda or host memory, ask the source
-        // device interface to copy to dst host memory first.
-        int err = src->device_interface->impl->buffer_copy(user_context, src, NULL, dst);
-        if (err) return err;
-        // Now just copy from src to host
-        src = dst;
+    debug(user_context) <<  "    cuLinkAddData " << (void *)ptx << " -> ";
+    CUlinkState state;
+    CUresult err = cuLinkCreate(1, options, option_values, &state);
+    if (err != CUDA_SUCCESS) {
+        return err;
+    }
+    void *cubin = NULL;
+    size_t cubin_size = 0;
+    err = cuLinkAddData(state, CU_JIT_INPUT_PTX, (void *)ptx, ptx_size + 1, "halide", 0, NULL, NULL);
+    if (err == CUDA_SUCCESS) {
+        err = cuLinkComplete(state, &cubin, &cubin_size);
     }
+    if (err == CUDA_SUCCESS) {
+        err = cuModuleLoadData(module, cubin);
+    }
+    if (err == CUDA_SUCCESS) {
+        // Failing to write the cache only costs compiling again next time.
+        file = fopen(path.str(), "wb");
+        if (file) {
+            fwrite(cubin, 1, cubin_size, file);
+            fclose(file);
+        }
+    }
+    // The cubin belongs to the linker.
+    cuLinkDestroy(state);
+    return err;
+}
 
-    bool from_host = !src->device_dirty() && src->host;
-    bool to_host = !dst_device_interface;
+// Load the module of a kernel source: a cubin bundle or PTX.
+WEAK CUresult load_module(void *user_context, const char *src, int size,
+                          unsigned int max_regs, CUmodule *module) {
+    if (size >= 16 && memcmp(src, cubin_bundle_magic, sizeof(cubin_bundle_magic)) == 0) {
+        int arch = 0;
+        uint32_t cubin_size = 0;
+        const char *ptx = NULL;
+        CUresult err = get_device_architecture(&arch);
+        if (err != CUDA_SUCCESS) {
+            return err;
+        }
+        const char *cubin = find_cubin(src, size, arch, &cubin_size, &ptx);
+        if (cubin) {
+            debug(user_context) <<  "    cuModuleLoadData cubin for sm_" << arch << " -> ";
+            err = cuModuleLoadData(module, cubin);
+            if (err == CUDA_SUCCESS) {
+                return err;
+            }
+            debug(user_context) << "failed: " << get_error_name(err) << "\n";
+        }
+        if (ptx == NULL) {
+            return CUDA_ERROR_NO_BINARY_FOR_GPU;
+        }
+        src = ptx;
+    }
+    return load_ptx_module(user_context, src, max_regs, module);
+}
 
-    halide_assert(user_context, from_host || src->device);
-    halide_assert(user_context, to_host || dst->device);
+}}}} // namespace Halide::Runtime::Internal
 
-    device_copy c = make_buffer_copy(src, from_host, dst, to_host);
+extern "C" {
 
-    int err = 0;
+// The default implementations of halide_cuda_allocate and
+// halide_cuda_deallocate cache freed blocks (see cached_block). They are
+// called with the context current, and the stream the buffer is used on.
+// Overriding implementations can hand out memory from another allocator,
+// e.g. PyTorch's, so that Halide and the host framework share a pool.
+WEAK int halide_cuda_allocate(void *user_context, CUcontext ctx, CUstream stream,
+                              size_t size, CUdeviceptr *ptr) {
+    size = round_up_allocation_size(size);
+    const bool managed = managed_memory && cuMemAllocManaged;
+    cached_block *found = NULL;
     {
-        Context ctx(user_context);
-        if (ctx.error != CUDA_SUCCESS) {
-            return ctx.error;
+        ScopedSpinLock spinlock(&cached_blocks_lock);
+        // Best fit, among the blocks at most twice as large.
+        cached_block **found_prev = NULL;
+        for (cached_block **prev = &cached_blocks; *prev; prev = &(*prev)->next) {
+            cached_block *block = *prev;
+            if (block->context != ctx || block->size < size || block->size > 2 * size ||
+                block->managed != managed ||
+                (block->stream != stream && block->event == NULL)) {
+                continue;
+            }
+            if (found_prev == NULL || block->size < (*found_prev)->size) {
+                found_prev = prev;
+            }
         }
+        if (found_prev) {
+            found = *found_prev;
+            *found_prev = found->next;
+        }
+    }  // spinlock
 
-        debug(user_context)
-            << "CUDA: halide_cuda_buffer_copy (user_context: " << user_context
-            << ", src: " << src << ", dst: " << dst << ")\n";
-
-        #ifdef DEBUG_RUNTIME
-        uint64_t t_before = halide_current_time_ns(user_context);
-        if (!from_host) {
-            halide_assert(user_context, validate_device_pointer(user_context, src));
+    if (found) {
+        debug(user_context) << "    reusing " << (void *)found->ptr << "\n";
+        if (found->stream != stream) {
+            cuStreamWaitEvent(stream, found->event, 0);
         }
-        if (!to_host) {
-            halide_assert(user_context, validate_device_pointer(user_context, dst));
+        if (found->event) {
+            cuEventDestroy(found->event);
         }
-        #endif
-
-        err = do_multidimensional_copy(user_context, c, c.src + c.src_begin, c.dst, dst->dimensions, from_host, to_host);
-
-        #ifdef DEBUG_RUNTIME
-        uint64_t t_after = halide_current_time_ns(user_context);
-        debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
-        #endif
+        *ptr = found->ptr;
+        __atomic_fetch_add(&allocator_stats.num_hits, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&allocator_stats.bytes_cached, (uint64_t)found->size, __ATOMIC_RELAXED);
+        free(found);
+        return CUDA_SUCCESS;
     }
 
+    __atomic_fetch_add(&allocator_stats.num_misses, 1, __ATOMIC_RELAXED);
+    if (managed) {
+        // Managed memory can exceed the memory of the device, whose pages
+        // are then migrated on demand.
+        debug(user_context) << "    cuMemAllocManaged " << (uint64_t)size << " -> ";
+        CUresult err = cuMemAllocManaged(ptr, size, CU_MEM_ATTACH_GLOBAL);
+        if (err == CUDA_SUCCESS) {
+            debug(user_context) << (void *)*ptr << "\n";
+            managed_memory_allocated = true;
+        }
+        return err;
+    }
+    debug(user_context) << "    cuMemAlloc " << (uint64_t)size << " -> ";
+    CUresult err = cuMemAlloc(ptr, size);
+    if (err == CUDA_ERROR_OUT_OF_MEMORY) {
+        // Give the cached blocks back to the driver and try again.
+        debug(user_context) << "out of memory, releasing cached blocks\n";
+        release_cached_blocks(user_context, ctx);
+        err = cuMemAlloc(ptr, size);
+    }
+    if (err == CUDA_SUCCESS) {
+        debug(user_context) << (void *)*ptr << "\n";
+    }
     return err;
 }
 
-namespace {
+WEAK int halide_cuda_deallocate(void *user_context, CUcontext ctx, CUstream stream,
+                                CUdeviceptr ptr, size_t size) {
+    cached_block *block = (cached_block *)malloc(sizeof(cached_block));
+    if (block == NULL) {
+        debug(user_context) << "    cuMemFree " << (void *)ptr << "\n";
+        return cuMemFree(ptr);
+    }
+    block->context = ctx;
+    block->stream = stream;
+    block->event = NULL;
+    block->ptr = ptr;
+    block->size = round_up_allocation_size(size);
+    block->managed = is_managed(ptr);
+    if (cuEventCreate && cuEventRecord && cuEventDestroy && cuStreamWaitEvent) {
+        if (cuEventCreate(&block->event, CU_EVENT_DISABLE_TIMING) != CUDA_SUCCESS) {
+            block->event = NULL;
+        } else if (cuEventRecord(block->event, stream) != CUDA_SUCCESS) {
+            cuEventDestroy(block->event);
+            block->event = NULL;
+        }
+    }
+    debug(user_context) << "    caching " << (void *)ptr << "\n";
+    __atomic_fetch_add(&allocator_stats.bytes_cached, (uint64_t)block->size, __ATOMIC_RELAXED);
+    ScopedSpinLock spinlock(&cached_blocks_lock);
+    block->next = cached_blocks;
+    cached_blocks = block;
+    return CUDA_SUCCESS;
+}
 
-WEAK int cuda_device_crop_from_offset(const struct halide_buffer_t *src,
-                                      int64_t offset,
-                                      struct halide_buffer_t *dst) {
-    dst->device = src->device + offset;
-    dst->device_interface = src->device_interface;
-    dst->set_device_dirty(src->device_dirty());
+WEAK int halide_cuda_release_unused_device_allocations(void *user_context) {
+    debug(user_context)
+        << "CUDA: halide_cuda_release_unused_device_allocations (user_context: "
+        << user_context << ")\n";
+
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    release_cached_blocks(user_context, ctx.context);
+    release_staging_buffers(user_context, ctx.context);
+    release_pinned_blocks(user_context, ctx.context);
     return 0;
 }
 
-}  // namespace
+WEAK void halide_cuda_set_pinned_host_pool_size(int64_t bytes) {
+    pinned_pool_limit = bytes;
+}
 
-WEAK int halide_cuda_device_crop(void *user_context, const struct halide_buffer_t *src,
-                                 struct halide_buffer_t *dst) {
-    debug(user_context)
-        << "CUDA: halide_cuda_device_crop (user_context: " << user_context
-        << ", src: " << src << ", dst: " << dst << ")\n";
+WEAK void halide_cuda_set_managed_memory(bool managed) {
+    managed_memory = managed;
+}
 
-    // Pointer arithmetic works fine.
-    const int64_t offset = calc_device_crop_byte_offset(src, dst);
-    return cuda_device_crop_from_offset(src, offset, dst);
+WEAK int halide_cuda_get_allocator_stats(void *user_context, halide_cuda_allocator_stats *stats) {
+    stats->num_hits = __atomic_load_n(&allocator_stats.num_hits, __ATOMIC_RELAXED);
+    stats->num_misses = __atomic_load_n(&allocator_stats.num_misses, __ATOMIC_RELAXED);
+    stats->bytes_cached = __atomic_load_n(&allocator_stats.bytes_cached, __ATOMIC_RELAXED);
+    return 0;
 }
 
-WEAK int halide_cuda_device_slice(void *user_context, const struct halide_buffer_t *src,
-                                  int slice_dim, int slice_pos,
-                                  struct halide_buffer_t *dst) {
+WEAK void halide_cuda_set_async_copies(bool async) {
+    async_copies = async;
+}
+
+WEAK int halide_cuda_graph_begin(void *user_context, uint64_t key) {
     debug(user_context)
-        << "CUDA: halide_cuda_device_slice (user_context: " << user_context
-        << ", src: " << src << ", slice_dim " << slice_dim << ", slice_pos "
-        << slice_pos << ", dst: " << dst << ")\n";
+        << "CUDA: halide_cuda_graph_begin (user_context: " << user_context
+        << ", key: " << key << ")\n";
 
-    // Pointer arithmetic works fine.
-    const int64_t offset = calc_device_slice_byte_offset(src, slice_dim, slice_pos);
-    return cuda_device_crop_from_offset(src, offset, dst);
-}
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    if (!graphs_supported()) {
+        debug(user_context) << "    graphs are not supported by the driver\n";
+        return 0;
+    }
 
-WEAK int halide_cuda_device_release_crop(void *user_context, struct halide_buffer_t *dst) {
-    debug(user_context)
-        << "CUDA: halide_cuda_release_crop (user_context: " << user_context
-        << ", dst: " << dst << ")\n";
+    cuda_graph *new_graph = (cuda_graph *)malloc(sizeof(cuda_graph));
+    ScopedSpinLock spinlock(&graphs_lock);
+    cuda_graph *found = NULL;
+    for (cuda_graph *graph = graphs; graph; graph = graph->next) {
+        if (graph->context != ctx.context) {
+            continue;
+        }
+        if (graph->active && graph->active_user_context == user_context) {
+            free(new_graph);
+            error(user_context) << "CUDA: halide_cuda_graph_begin called in a graph region of the same user_context\n";
+            return -1;
+        }
+        if (graph->key == key) {
+            found = graph;
+        }
+    }
+    if (found && found->active) {
+        // Another user_context is using the graph; this region just runs
+        // its launches.
+        free(new_graph);
+        return 0;
+    }
+    if (found) {
+        free(new_graph);
+    } else {
+        if (new_graph == NULL) {
+            return 0;
+        }
+        found = new_graph;
+        found->context = ctx.context;
+        found->key = key;
+        found->launches = found->last_launch = NULL;
+        found->exec = NULL;
+        found->next = graphs;
+        graphs = found;
+    }
+    found->active = true;
+    found->active_user_context = user_context;
+    found->recording = (found->exec == NULL);
+    found->diverged = false;
+    found->next_launch = found->launches;
+    debug(user_context) << (found->recording ? "    recording\n" : "    replaying\n");
     return 0;
 }
 
-WEAK int halide_cuda_copy_to_device(void *user_context, halide_buffer_t* buf) {
-    return halide_cuda_buffer_copy(user_context, buf, &cuda_device_interface, buf);
-}
+WEAK int halide_cuda_graph_end(void *user_context) {
+    debug(user_context)
+        << "CUDA: halide_cuda_graph_end (user_context: " << user_context << ")\n";
 
-WEAK int halide_cuda_copy_to_host(void *user_context, halide_buffer_t* buf) {
-    return halide_cuda_buffer_copy(user_context, buf, NULL, buf);
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    cuda_graph *graph = find_active_graph(user_context, ctx.context);
+    if (graph == NULL) {
+        return 0;
+    }
+
+    int err = 0;
+    if (!graph->diverged) {
+        if (graph->recording) {
+            if (graph->launches) {
+                CUresult result = instantiate_graph(user_context, graph);
+                if (result != CUDA_SUCCESS) {
+                    // Not an error: the launches have already run.
+                    debug(user_context) << "    graph instantiation failed: " << get_error_name(result) << "\n";
+                    graph->diverged = true;
+                }
+            }
+        } else if (graph->next_launch != NULL) {
+            // The region launched fewer kernels than were recorded.
+            err = flush_graph_replay(user_context, ctx.context);
+        } else {
+            CUstream stream = 0;
+            if (cuStreamSynchronize != NULL) {
+                err = halide_cuda_get_stream(user_context, ctx.context, &stream);
+                if (err != 0) {
+                    error(user_context) << "CUDA: In halide_cuda_graph_end, halide_cuda_get_stream returned " << err << "\n";
+                }
+            }
+            if (err == 0) {
+                debug(user_context) << "    cuGraphLaunch " << graph->exec << "\n";
+                CUresult result = cuGraphLaunch(graph->exec, stream);
+                if (result != CUDA_SUCCESS) {
+                    error(user_context) << "CUDA: cuGraphLaunch failed: "
+                                        << get_error_name(result);
+                    err = result;
+                }
+            }
+        }
+    }
+    if (graph->diverged) {
+        forget_graph_launches(graph);
+    }
+    graph->active = false;
+    return err;
 }
 
-// Used to generate correct timings when tracing
-WEAK int halide_cuda_device_sync(void *user_context, struct halide_buffer_t *) {
-    debug(user_context)
-        << "CUDA: halide_cuda_device_sync (user_context: " << user_context << ")\n";
+WEAK int halide_cuda_initialize_kernels(void *user_context, void **state_ptr, const char* ptx_src, int size) {
+    debug(user_context) << "CUDA: halide_cuda_initialize_kernels (user_context: " << user_context
+                        << ", state_ptr: " << state_ptr
+                        << ", ptx_src: " << (void *)ptx_src
+                        << ", size: " << size << "\n";
 
     Context ctx(user_context);
-    if (ctx.error != CUDA_SUCCESS) {
+    if (ctx.error != 0) {
         return ctx.error;
     }
 
@@ -844,22 +1786,53 @@ WEAK int halide_cuda_device_sync(void *user_context, struct halide_buffer_t *) {
     uint64_t t_before = halide_current_time_ns(user_context);
     #endif
 
-    CUresult err;
-    if (cuStreamSynchronize != NULL) {
-        CUstream stream;
-        int result = halide_cuda_get_stream(user_context, ctx.context, &stream);
-        if (result != 0) {
-            error(user_context) << "CUDA: In halide_cuda_device_sync, halide_cuda_get_stream returned " << result << "\n";
+
+    halide_assert(user_context, &filters_list_lock != NULL);
+    {
+        ScopedSpinLock spinlock(&filters_list_lock);
+
+        // Create the state object if necessary. This only happens once, regardless
+        // of how many times halide_initialize_kernels/halide_release is called.
+        // halide_release traverses this list and releases the module objects, but
+        // it does not modify the list nodes created/inserted here.
+        registered_filters **filters = (registered_filters**)state_ptr;
+        if (!(*filters)) {
+            *filters = (registered_filters*)malloc(sizeof(registered_filters));
+            (*filters)->modules = NULL;
+            (*filters)->next = filters_list;
+            filters_list = *filters;
         }
-        err = cuStreamSynchronize(stream);
-    } else {
-       err = cuCtxSynchronize();
-    }
-    if (err != CUDA_SUCCESS) {
-        error(user_context) << "CUDA: cuCtxSynchronize failed: "
-                            << get_error_name(err);
-        return err;
-    }
+
+        // Create the module itself if necessary.
+        module_state *loaded_module = find_module_for_context(*filters, ctx.context);
+        if (loaded_module == NULL) {
+            loaded_module = (module_state *)malloc(sizeof(module_state));
+
+            unsigned int max_regs_per_thread = 64;
+
+            // A hack to enable control over max register count for
+            // testing. This should be surfaced in the schedule somehow
+            // instead.
+            char *regs = getenv("HL_CUDA_JIT_MAX_REGISTERS");
+            if (regs) {
+                max_regs_per_thread = atoi(regs);
+            }
+            CUresult err = load_module(user_context, ptx_src, size, max_regs_per_thread,
+                                       &loaded_module->module);
+
+            if (err != CUDA_SUCCESS) {
+                free(loaded_module);
+                error(user_context) << "CUDA: cuModuleLoadData failed: "
+                                    << get_error_name(err);
+                return err;
+            } else {
+                debug(user_context) << (void *)(loaded_module->module) << "\n";
+            }
+            loaded_module->context = ctx.context;
+            loaded_module->next = (*filters)->modules;
+            (*filters)->modules = loaded_module;
+        }
+    }  // spinlock
 
     #ifdef DEBUG_RUNTIME
     uint64_t t_after = halide_current_time_ns(user_context);
@@ -869,280 +1842,1833 @@ WEAK int halide_cuda_device_sync(void *user_context, struct halide_buffer_t *) {
     return 0;
 }
 
-WEAK int halide_cuda_run(void *user_context,
-                         void *state_ptr,
-                         const char* entry_name,
-                         int blocksX, int blocksY, int blocksZ,
-                         int threadsX, int threadsY, int threadsZ,
-                         int shared_mem_bytes,
-                         size_t arg_sizes[],
-                         void* args[],
-                         int8_t arg_is_buffer[],
-                         int num_attributes,
-                         float* vertex_buffer,
-                         int num_coords_dim0,
-                         int num_coords_dim1) {
+WEAK int halide_cuda_device_free(void *user_context, halide_buffer_t* buf) {
+    // halide_device_free, at present, can be exposed to clients and they
+    // should be allowed to call halide_device_free on any halide_buffer_t
+    // including ones that have never been used with a GPU.
+    if (buf->device == 0) {
+        return 0;
+    }
 
-    debug(user_context) << "CUDA: halide_cuda_run ("
-                        << "user_context: " << user_context << ", "
-                        << "entry: " << entry_name << ", "
-                        << "blocks: " << blocksX << "x" << blocksY << "x" << blocksZ << ", "
-                        << "threads: " << threadsX << "x" << threadsY << "x" << threadsZ << ", "
-                        << "shmem: " << shared_mem_bytes << "\n";
+    CUdeviceptr dev_ptr = (CUdeviceptr)buf->device;
+
+    debug(user_context)
+        <<  "CUDA: halide_cuda_device_free (user_context: " << user_context
+        << ", buf: " << buf << ")\n";
 
-    CUresult err;
     Context ctx(user_context);
-    if (ctx.error != CUDA_SUCCESS) {
+    if (ctx.error != CUDA_SUCCESS)
         return ctx.error;
-    }
-
-    debug(user_context) << "Got context.\n";
 
     #ifdef DEBUG_RUNTIME
     uint64_t t_before = halide_current_time_ns(user_context);
     #endif
 
-    halide_assert(user_context, state_ptr);
-    module_state *loaded_module = find_module_for_context((registered_filters *)state_ptr, ctx.context);
-    halide_assert(user_context, loaded_module != NULL);
-    CUmodule mod = loaded_module->module;
-    debug(user_context) << "Got module " << mod << "\n";
-    halide_assert(user_context, mod);
-    CUfunction f;
-    err = cuModuleGetFunction(&f, mod, entry_name);
-    debug(user_context) << "Got function " << f << "\n";
-    if (err != CUDA_SUCCESS) {
-        error(user_context) << "CUDA: cuModuleGetFunction failed: "
-                            << get_error_name(err);
-        return err;
-    }
-
-    size_t num_args = 0;
-    while (arg_sizes[num_args] != 0) {
-        debug(user_context) << "    halide_cuda_run " << (int)num_args
-                            << " " << (int)arg_sizes[num_args]
-                            << " [" << (*((void **)args[num_args])) << " ...] "
-                            << arg_is_buffer[num_args] << "\n";
-        num_args++;
-    }
+    halide_assert(user_context, validate_device_pointer(user_context, buf));
 
-    // We need storage for both the arg and the pointer to it if if
-    // has to be translated.
-    void** translated_args = (void **)malloc((num_args + 1) * sizeof(void *));
-    uint64_t *dev_handles = (uint64_t *)malloc(num_args * sizeof(uint64_t));
-    for (size_t i = 0; i <= num_args; i++) { // Get NULL at end.
-        if (arg_is_buffer[i]) {
-            halide_assert(user_context, arg_sizes[i] == sizeof(uint64_t));
-            dev_handles[i] = ((halide_buffer_t *)args[i])->device;
-            translated_args[i] = &(dev_handles[i]);
-            debug(user_context) << "    halide_cuda_run translated arg" << (int)i
-                                << " [" << (*((void **)translated_args[i])) << " ...]\n";
-        } else {
-            translated_args[i] = args[i];
-        }
-    }
+    // Kernels deferred in a graph region may use the buffer.
+    flush_graph_replay(user_context, ctx.context);
 
-    CUstream stream = NULL;
-    // We use whether this routine was defined in the cuda driver library
-    // as a test for streams support in the cuda implementation.
+    CUstream stream = 0;
     if (cuStreamSynchronize != NULL) {
-        int result = halide_cuda_get_stream(user_context, ctx.context, &stream);
-        if (result != 0) {
-            error(user_context) << "CUDA: In halide_cuda_run, halide_cuda_get_stream returned " << result << "\n";
-        }
+        halide_cuda_get_stream(user_context, ctx.context, &stream);
     }
-
-    err = cuLaunchKernel(f,
-                         blocksX,  blocksY,  blocksZ,
-                         threadsX, threadsY, threadsZ,
-                         shared_mem_bytes,
-                         stream,
-                         translated_args,
-                         NULL);
-    free(dev_handles);
-    free(translated_args);
+    CUresult err = (CUresult)halide_cuda_deallocate(user_context, ctx.context, stream,
+                                                    dev_ptr, buf->size_in_bytes());
+    // If freeing fails, it isn't likely to succeed later, so just drop
+    // the reference.
+    buf->device_interface->impl->release_module();
+    buf->device_interface = NULL;
+    buf->device = 0;
     if (err != CUDA_SUCCESS) {
-        error(user_context) << "CUDA: cuLaunchKernel failed: "
-                            << get_error_name(err);
+        // We may be called as a destructor, so don't raise an error here.
         return err;
     }
 
     #ifdef DEBUG_RUNTIME
-    err = cuCtxSynchronize();
-    if (err != CUDA_SUCCESS) {
-        error(user_context) << "CUDA: cuCtxSynchronize failed: "
-                            << get_error_name(err);
-        return err;
-    }
     uint64_t t_after = halide_current_time_ns(user_context);
     debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
     #endif
-    return 0;
-}
 
-WEAK int halide_cuda_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf) {
-    return halide_default_device_and_host_malloc(user_context, buf, &cuda_device_interface);
+    return 0;
 }
 
-WEAK int halide_cuda_device_and_host_free(void *user_context, struct halide_buffer_t *buf) {
-    return halide_default_device_and_host_free(user_context, buf, &cuda_device_interface);
-}
+WEAK int halide_cuda_device_release(void *user_context) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_release (user_context: " <<  user_context << ")\n";
 
-WEAK int halide_cuda_wrap_device_ptr(void *user_context, struct halide_buffer_t *buf, uint64_t device_ptr) {
-    halide_assert(user_context, buf->device == 0);
-    if (buf->device != 0) {
-        return -2;
-    }
-    buf->device = device_ptr;
-    buf->device_interface = &cuda_device_interface;
-    buf->device_interface->impl->use_module();
-#if DEBUG_RUNTIME
-    if (!validate_device_pointer(user_context, buf)) {
-        buf->device_interface->impl->release_module();
-        buf->device = 0;
-        buf->device_interface = NULL;
-        return -3;
+    int err;
+    CUcontext ctx;
+    err = halide_cuda_acquire_context(user_context, &ctx, false);
+    if (err != CUDA_SUCCESS) {
+        return err;
     }
-#endif
-    return 0;
-}
 
-WEAK int halide_cuda_detach_device_ptr(void *user_context, struct halide_buffer_t *buf) {
-    if (buf->device == NULL) {
-        return 0;
-    }
-    halide_assert(user_context, buf->device_interface == &cuda_device_interface);
-    buf->device_interface->impl->release_module();
+    if (ctx) {
+        // It's possible that this is being called from the destructor of
+        // a static variable, in which case the driver may already be
+        // shutting down.
+        err = cuCtxPushCurrent(ctx);
+        if (err != CUDA_SUCCESS) {
+            err = cuCtxSynchronize();
+        }
+        halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
+
+        // Return the cached device memory, the staging buffers and the
+        // unused pinned host memory of this context to the driver.
+        release_cached_blocks(user_context, ctx);
+        release_staging_buffers(user_context, ctx);
+        release_pinned_blocks(user_context, ctx);
+        release_library_handles(user_context, ctx);
+
+        // The graphs and the constant globals refer to the modules
+        // unloaded below.
+        release_graphs(user_context, ctx);
+        release_constant_globals(ctx);
+
+        {
+            ScopedSpinLock spinlock(&filters_list_lock);
+
+            // Unload the modules attached to this context. Note that the list
+            // nodes themselves are not freed, only the module objects are
+            // released. Subsequent calls to halide_init_kernels might re-create
+            // the program object using the same list node to store the module
+            // object.
+            registered_filters *filters = filters_list;
+            while (filters) {
+                module_state **prev_ptr = &filters->modules;
+                module_state *loaded_module = filters->modules;
+                while (loaded_module != NULL) {
+                    if (loaded_module->context == ctx) {
+                        debug(user_context) << "    cuModuleUnload " << loaded_module->module << "\n";
+                        err = cuModuleUnload(loaded_module->module);
+                        halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
+                        *prev_ptr = loaded_module->next;
+                        free(loaded_module);
+                        loaded_module = *prev_ptr;
+                    } else {
+                        loaded_module = loaded_module->next;
+                        prev_ptr = &loaded_module->next;
+                    }
+                }
+                filters = filters->next;
+            }
+        }  // spinlock
+
+        CUcontext old_ctx;
+        cuCtxPopCurrent(&old_ctx);
+
+        // Only destroy the context if we own it
+
+        {
+            ScopedSpinLock spinlock(&context_lock);
+
+            if (ctx == context) {
+                debug(user_context) << "    cuCtxDestroy " << context << "\n";
+                err = cuProfilerStop();
+                err = cuCtxDestroy(context);
+                halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
+                context = NULL;
+            }
+            for (int i = 0; i < max_rank_contexts; i++) {
+                if (ctx == rank_contexts[i]) {
+                    debug(user_context) << "    cuCtxDestroy " << ctx << " (rank " << i << ")\n";
+                    err = cuCtxDestroy(ctx);
+                    halide_assert(user_context, err == CUDA_SUCCESS || err == CUDA_ERROR_DEINITIALIZED);
+                    rank_contexts[i] = NULL;
+                }
+            }
+        }  // spinlock
+    }
+
+    halide_cuda_release_context(user_context);
+
+    return 0;
+}
+
+WEAK int halide_cuda_device_malloc(void *user_context, halide_buffer_t *buf) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_malloc (user_context: " << user_context
+        << ", buf: " << buf << ")\n";
+
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+
+    size_t size = buf->size_in_bytes();
+    halide_assert(user_context, size != 0);
+    if (buf->device) {
+        // This buffer already has a device allocation
+        halide_assert(user_context, validate_device_pointer(user_context, buf, size));
+        return 0;
+    }
+
+    // Check all strides positive.
+    for (int i = 0; i < buf->dimensions; i++) {
+        halide_assert(user_context, buf->dim[i].stride >= 0);
+    }
+
+    debug(user_context) << "    allocating " << *buf << "\n";
+
+    #ifdef DEBUG_RUNTIME
+    uint64_t t_before = halide_current_time_ns(user_context);
+    #endif
+
+    CUstream stream = 0;
+    if (cuStreamSynchronize != NULL) {
+        int result = halide_cuda_get_stream(user_context, ctx.context, &stream);
+        if (result != 0) {
+            error(user_context) << "CUDA: In halide_cuda_device_malloc, halide_cuda_get_stream returned " << result << "\n";
+            return result;
+        }
+    }
+
+    CUdeviceptr p;
+    CUresult err = (CUresult)halide_cuda_allocate(user_context, ctx.context, stream, size, &p);
+    if (err != CUDA_SUCCESS) {
+        debug(user_context) << get_error_name(err) << "\n";
+        error(user_context) << "CUDA: cuMemAlloc failed: "
+                            << get_error_name(err);
+        return err;
+    }
+    halide_assert(user_context, p);
+    buf->device = p;
+    buf->device_interface = &cuda_device_interface;
+    buf->device_interface->impl->use_module();
+
+    #ifdef DEBUG_RUNTIME
+    uint64_t t_after = halide_current_time_ns(user_context);
+    debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
+    #endif
+
+    return 0;
+}
+
+namespace {
+// Do the copies described by c. If 'async', the copies are queued on
+// 'stream', and copies from the host are first packed into 'staging', if
+// not NULL, which is advanced past them.
+WEAK int do_multidimensional_copy(void *user_context, const device_copy &c,
+                                  uint64_t src, uint64_t dst, int d, bool from_host, bool to_host,
+                                  bool async, CUstream stream, char **staging) {
+    if (d > MAX_COPY_DIMS) {
+        error(user_context) << "Buffer has too many dimensions to copy to/from GPU\n";
+        return -1;
+    } else if (d == 0) {
+        CUresult err = CUDA_SUCCESS;
+        const char *copy_name = "memcpy";
+        debug(user_context) << "    from " << (from_host ? "host" : "device")
+                            << " to " << (to_host ? "host" : "device") << ", "
+                            << (void *)src << " -> " << (void *)dst << ", " << c.chunk_size << " bytes"
+                            << (async ? " (async)\n" : "\n");
+        if (!from_host && to_host) {
+            if (async) {
+                copy_name = "cuMemcpyDtoHAsync";
+                err = cuMemcpyDtoHAsync((void *)dst, (CUdeviceptr)src, c.chunk_size, stream);
+            } else {
+                copy_name = "cuMemcpyDtoH";
+                err = cuMemcpyDtoH((void *)dst, (CUdeviceptr)src, c.chunk_size);
+            }
+        } else if (from_host && !to_host) {
+            if (async) {
+                const void *host = (const void *)src;
+                if (*staging) {
+                    memcpy(*staging, host, c.chunk_size);
+                    host = *staging;
+                    *staging += c.chunk_size;
+                }
+                copy_name = "cuMemcpyHtoDAsync";
+                err = cuMemcpyHtoDAsync((CUdeviceptr)dst, host, c.chunk_size, stream);
+            } else {
+                copy_name = "cuMemcpyHtoD";
+                err = cuMemcpyHtoD((CUdeviceptr)dst, (void *)src, c.chunk_size);
+            }
+        } else if (!from_host && !to_host) {
+            if (async) {
+                copy_name = "cuMemcpyDtoDAsync";
+                err = cuMemcpyDtoDAsync((CUdeviceptr)dst, (CUdeviceptr)src, c.chunk_size, stream);
+            } else {
+                copy_name = "cuMemcpyDtoD";
+                err = cuMemcpyDtoD((CUdeviceptr)dst, (CUdeviceptr)src, c.chunk_size);
+            }
+        } else if (dst != src) {
+            // Could reach here if a user called directly into the
+            // cuda API for a device->host copy on a source buffer
+            // with device_dirty = false.
+            memcpy((void *)dst, (void *)src, c.chunk_size);
+        }
+        if (err != CUDA_SUCCESS) {
+            error(user_context) << "CUDA: " << copy_name << " failed: " << get_error_name(err);
+            return (int)err;
+        }
+    } else {
+        ssize_t src_off = 0, dst_off = 0;
+        for (int i = 0; i < (int)c.extent[d-1]; i++) {
+            int err = do_multidimensional_copy(user_context, c, src + src_off, dst + dst_off, d - 1,
+                                               from_host, to_host, async, stream, staging);
+            dst_off += c.dst_stride_bytes[d-1];
+            src_off += c.src_stride_bytes[d-1];
+            if (err) {
+                return err;
+            }
+        }
+    }
+    return 0;
+}
+}
+
+WEAK int halide_cuda_buffer_copy(void *user_context, struct halide_buffer_t *src,
+                                 const struct halide_device_interface_t *dst_device_interface,
+                                 struct halide_buffer_t *dst) {
+    // We only handle copies to cuda or to host
+    halide_assert(user_context, dst_device_interface == NULL ||
+                  dst_device_interface == &cuda_device_interface);
+
+    if (src->device_dirty() &&
+        src->device_interface != &cuda_device_interface) {
+        halide_assert(user_context, dst_device_interface == &cuda_device_interface);
+        // If the source is not cuda or host memory, ask the source
+        // device interface to copy to dst host memory first.
+        int err = src->device_interface->impl->buffer_copy(user_context, src, NULL, dst);
+        if (err) return err;
+        // Now just copy from src to host
+        src = dst;
+    }
+
+    bool from_host = !src->device_dirty() && src->host;
+    bool to_host = !dst_device_interface;
+
+    // The host and device sides of a unified buffer are the same memory,
+    // so the host only has to wait for the kernels writing it.
+    if (src == dst && is_unified(src)) {
+        if (!to_host) {
+            return 0;
+        }
+        Context ctx(user_context);
+        if (ctx.error != CUDA_SUCCESS) {
+            return ctx.error;
+        }
+        debug(user_context)
+            << "CUDA: halide_cuda_buffer_copy of unified buffer (user_context: " << user_context
+            << ", buf: " << src << ")\n";
+        int err = flush_graph_replay(user_context, ctx.context);
+        if (err != 0) {
+            return err;
+        }
+        CUstream stream = 0;
+        if (cuStreamSynchronize != NULL) {
+            halide_cuda_get_stream(user_context, ctx.context, &stream);
+        }
+        if (cuMemPrefetchAsync) {
+            cuMemPrefetchAsync((CUdeviceptr)src->device, src->size_in_bytes(), CU_DEVICE_CPU, stream);
+        }
+        err = stream ? cuStreamSynchronize(stream) : cuCtxSynchronize();
+        if (err != CUDA_SUCCESS) {
+            error(user_context) << "CUDA: synchronizing for a unified buffer failed: "
+                                << get_error_name((CUresult)err);
+        }
+        return err;
+    }
+
+    halide_assert(user_context, from_host || src->device);
+    halide_assert(user_context, to_host || dst->device);
+
+    device_copy c = make_buffer_copy(src, from_host, dst, to_host);
+
+    int err = 0;
+    {
+        Context ctx(user_context);
+        if (ctx.error != CUDA_SUCCESS) {
+            return ctx.error;
+        }
+
+        debug(user_context)
+            << "CUDA: halide_cuda_buffer_copy (user_context: " << user_context
+            << ", src: " << src << ", dst: " << dst << ")\n";
+
+        #ifdef DEBUG_RUNTIME
+        uint64_t t_before = halide_current_time_ns(user_context);
+        if (!from_host) {
+            halide_assert(user_context, validate_device_pointer(user_context, src));
+        }
+        if (!to_host) {
+            halide_assert(user_context, validate_device_pointer(user_context, dst));
+        }
+        #endif
+
+        err = flush_graph_replay(user_context, ctx.context);
+        if (err != 0) {
+            return err;
+        }
+
+        bool async = async_copies && async_copies_supported() && !(from_host && to_host);
+        CUstream stream = 0;
+        if (async) {
+            int result = halide_cuda_get_stream(user_context, ctx.context, &stream);
+            if (result != 0) {
+                error(user_context) << "CUDA: In halide_cuda_buffer_copy, halide_cuda_get_stream returned " << result << "\n";
+                return result;
+            }
+        }
+
+        size_t size = c.chunk_size;
+        for (int i = 0; i < dst->dimensions; i++) {
+            size *= c.extent[i];
+        }
+        if (from_host != to_host && profiling_device()) {
+            halide_profiler_device_copy(user_context, size, to_host);
+        }
+
+        // Copies from the host are packed into a staging buffer, so that the
+        // host buffer is free to change once they are queued.
+        staging_buffer *staging = NULL;
+        char *staging_ptr = NULL;
+        if (async && from_host) {
+            staging = acquire_staging_buffer(user_context, ctx.context, size);
+            if (staging) {
+                staging_ptr = (char *)staging->ptr;
+            }
+        }
+
+        err = do_multidimensional_copy(user_context, c, c.src + c.src_begin, c.dst, dst->dimensions,
+                                       from_host, to_host, async, stream, &staging_ptr);
+
+        if (staging) {
+            release_staging_buffer(staging, stream);
+        }
+
+        // The host is about to use the data copied to it, so this is where
+        // the host waits for the device.
+        if (async && to_host && err == 0) {
+            CUresult sync_err = cuStreamSynchronize(stream);
+            if (sync_err != CUDA_SUCCESS) {
+                error(user_context) << "CUDA: cuStreamSynchronize failed: "
+                                    << get_error_name(sync_err);
+                err = sync_err;
+            }
+        }
+
+        #ifdef DEBUG_RUNTIME
+        uint64_t t_after = halide_current_time_ns(user_context);
+        debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
+        #endif
+    }
+
+    return err;
+}
+
+namespace {
+
+WEAK int cuda_device_crop_from_offset(const struct halide_buffer_t *src,
+                                      int64_t offset,
+                                      struct halide_buffer_t *dst) {
+    dst->device = src->device + offset;
+    dst->device_interface = src->device_interface;
+    dst->set_device_dirty(src->device_dirty());
+    return 0;
+}
+
+}  // namespace
+
+WEAK int halide_cuda_device_crop(void *user_context, const struct halide_buffer_t *src,
+                                 struct halide_buffer_t *dst) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_crop (user_context: " << user_context
+        << ", src: " << src << ", dst: " << dst << ")\n";
+
+    // Pointer arithmetic works fine.
+    const int64_t offset = calc_device_crop_byte_offset(src, dst);
+    return cuda_device_crop_from_offset(src, offset, dst);
+}
+
+WEAK int halide_cuda_device_slice(void *user_context, const struct halide_buffer_t *src,
+                                  int slice_dim, int slice_pos,
+                                  struct halide_buffer_t *dst) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_slice (user_context: " << user_context
+        << ", src: " << src << ", slice_dim " << slice_dim << ", slice_pos "
+        << slice_pos << ", dst: " << dst << ")\n";
+
+    // Pointer arithmetic works fine.
+    const int64_t offset = calc_device_slice_byte_offset(src, slice_dim, slice_pos);
+    return cuda_device_crop_from_offset(src, offset, dst);
+}
+
+WEAK int halide_cuda_device_release_crop(void *user_context, struct halide_buffer_t *dst) {
+    debug(user_context)
+        << "CUDA: halide_cuda_release_crop (user_context: " << user_context
+        << ", dst: " << dst << ")\n";
+    return 0;
+}
+
+WEAK int halide_cuda_copy_to_device(void *user_context, halide_buffer_t* buf) {
+    return halide_cuda_buffer_copy(user_context, buf, &cuda_device_interface, buf);
+}
+
+WEAK int halide_cuda_copy_to_host(void *user_context, halide_buffer_t* buf) {
+    return halide_cuda_buffer_copy(user_context, buf, NULL, buf);
+}
+
+// Used to generate correct timings when tracing
+WEAK int halide_cuda_device_sync(void *user_context, struct halide_buffer_t *) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_sync (user_context: " << user_context << ")\n";
+
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+
+    #ifdef DEBUG_RUNTIME
+    uint64_t t_before = halide_current_time_ns(user_context);
+    #endif
+
+    // Launch the kernels deferred in a graph region before waiting for them.
+    int flush_err = flush_graph_replay(user_context, ctx.context);
+    if (flush_err != 0) {
+        return flush_err;
+    }
+
+    CUresult err;
+    if (cuStreamSynchronize != NULL) {
+        CUstream stream;
+        int result = halide_cuda_get_stream(user_context, ctx.context, &stream);
+        if (result != 0) {
+            error(user_context) << "CUDA: In halide_cuda_device_sync, halide_cuda_get_stream returned " << result << "\n";
+        }
+        err = cuStreamSynchronize(stream);
+    } else {
+       err = cuCtxSynchronize();
+    }
+    if (err != CUDA_SUCCESS) {
+        error(user_context) << "CUDA: cuCtxSynchronize failed: "
+                            << get_error_name(err);
+        return err;
+    }
+
+    #ifdef DEBUG_RUNTIME
+    uint64_t t_after = halide_current_time_ns(user_context);
+    debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
+    #endif
+
+    return 0;
+}
+
+namespace {
+// Launch a kernel. A cooperative kernel is a persistent kernel, whose
+// blocks loop over the work and synchronize with each other: it is
+// launched with at most as many blocks as the device can keep resident
+// at once.
+WEAK int run_kernel(void *user_context,
+                    void *state_ptr,
+                    const char* entry_name,
+                    int blocksX, int blocksY, int blocksZ,
+                    int threadsX, int threadsY, int threadsZ,
+                    int shared_mem_bytes,
+                    size_t arg_sizes[],
+                    void* args[],
+                    int8_t arg_is_buffer[],
+                    bool cooperative) {
+
+    debug(user_context) << "CUDA: halide_cuda_run ("
+                        << "user_context: " << user_context << ", "
+                        << "entry: " << entry_name << ", "
+                        << "blocks: " << blocksX << "x" << blocksY << "x" << blocksZ << ", "
+                        << "threads: " << threadsX << "x" << threadsY << "x" << threadsZ << ", "
+                        << "shmem: " << shared_mem_bytes << ", "
+                        << "cooperative: " << cooperative << "\n";
+
+    CUresult err;
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+
+    debug(user_context) << "Got context.\n";
+
+    #ifdef DEBUG_RUNTIME
+    uint64_t t_before = halide_current_time_ns(user_context);
+    #endif
+
+    halide_assert(user_context, state_ptr);
+    module_state *loaded_module = find_module_for_context((registered_filters *)state_ptr, ctx.context);
+    halide_assert(user_context, loaded_module != NULL);
+    CUmodule mod = loaded_module->module;
+    debug(user_context) << "Got module " << mod << "\n";
+    halide_assert(user_context, mod);
+    CUfunction f;
+    err = cuModuleGetFunction(&f, mod, entry_name);
+    debug(user_context) << "Got function " << f << "\n";
+    if (err != CUDA_SUCCESS) {
+        error(user_context) << "CUDA: cuModuleGetFunction failed: "
+                            << get_error_name(err);
+        return err;
+    }
+
+    err = check_launch(user_context, f, entry_name, blocksX * blocksY * blocksZ,
+                       threadsX * threadsY * threadsZ, shared_mem_bytes);
+    if (err != CUDA_SUCCESS) {
+        return err;
+    }
+
+    // The blocks of a persistent kernel wait for each other, so they must
+    // all be resident. Cooperative launches fail rather than hang when
+    // they aren't; on devices without them the kernel is launched as
+    // usual, which only deadlocks if other kernels are resident forever.
+    bool cooperative_launch = false;
+    if (cooperative) {
+        int threads = threadsX * threadsY * threadsZ;
+        int resident = max_resident_blocks(f, threads, shared_mem_bytes);
+        if (resident <= 0) {
+            error(user_context) << "CUDA: the blocks of the persistent kernel " << entry_name
+                                << " can't be resident at once, with " << threads
+                                << " threads and " << shared_mem_bytes << " bytes of shared memory each.\n";
+            return CUDA_ERROR_INVALID_VALUE;
+        }
+        halide_assert(user_context, blocksY == 1 && blocksZ == 1);
+        if (blocksX > resident) {
+            blocksX = resident;
+        }
+        cooperative_launch = cooperative_launch_supported();
+        debug(user_context) << "    persistent kernel launched with " << blocksX << " blocks\n";
+    }
+
+    size_t num_args = 0;
+    while (arg_sizes[num_args] != 0) {
+        debug(user_context) << "    halide_cuda_run " << (int)num_args
+                            << " " << (int)arg_sizes[num_args]
+                            << " [" << (*((void **)args[num_args])) << " ...] "
+                            << arg_is_buffer[num_args] << "\n";
+        num_args++;
+    }
+
+    // We need storage for both the arg and the pointer to it if if
+    // has to be translated.
+    void** translated_args = (void **)malloc((num_args + 1) * sizeof(void *));
+    uint64_t *dev_handles = (uint64_t *)malloc(num_args * sizeof(uint64_t));
+    for (size_t i = 0; i <= num_args; i++) { // Get NULL at end.
+        if (arg_is_buffer[i]) {
+            halide_assert(user_context, arg_sizes[i] == sizeof(uint64_t));
+            dev_handles[i] = ((halide_buffer_t *)args[i])->device;
+            translated_args[i] = &(dev_handles[i]);
+            debug(user_context) << "    halide_cuda_run translated arg" << (int)i
+                                << " [" << (*((void **)translated_args[i])) << " ...]\n";
+        } else {
+            translated_args[i] = args[i];
+        }
+    }
+
+    CUstream stream = NULL;
+    // We use whether this routine was defined in the cuda driver library
+    // as a test for streams support in the cuda implementation.
+    if (cuStreamSynchronize != NULL) {
+        int result = halide_cuda_get_stream(user_context, ctx.context, &stream);
+        if (result != 0) {
+            error(user_context) << "CUDA: In halide_cuda_run, halide_cuda_get_stream returned " << result << "\n";
+        }
+    }
+
+    if (managed_memory_allocated && cuMemPrefetchAsync) {
+        prefetch_buffers(user_context, stream, num_args, args, arg_is_buffer);
+    }
+
+    // The buffers in constant memory are flagged with 2. The copies
+    // into constant memory aren't part of recorded graphs, so the
+    // kernels reading them aren't recorded either.
+    bool uses_constant_memory = false;
+    for (size_t i = 0; i < num_args; i++) {
+        uses_constant_memory |= (arg_is_buffer[i] == 2);
+    }
+
+    // Inside a graph region, record the launch, or defer it to the launch
+    // of the recorded graph if it matches.
+    cuda_graph *graph = find_active_graph(user_context, ctx.context);
+    if (graph && !graph->diverged) {
+        if (graph->recording) {
+            // Cooperative launches can't be recorded.
+            graph_launch *launch = (cooperative || uses_constant_memory) ? NULL :
+                make_graph_launch(f, blocksX, blocksY, blocksZ,
+                                  threadsX, threadsY, threadsZ,
+                                  shared_mem_bytes, num_args,
+                                  arg_sizes, translated_args);
+            if (launch == NULL) {
+                graph->diverged = true;
+            } else if (graph->last_launch) {
+                graph->last_launch->next = launch;
+                graph->last_launch = launch;
+            } else {
+                graph->launches = graph->last_launch = launch;
+            }
+        } else if (!cooperative && !uses_constant_memory && graph->next_launch &&
+                   graph_launch_matches(graph->next_launch, f, blocksX, blocksY, blocksZ,
+                                        threadsX, threadsY, threadsZ,
+                                        shared_mem_bytes, num_args,
+                                        arg_sizes, translated_args)) {
+            graph->next_launch = graph->next_launch->next;
+            free(dev_handles);
+            free(translated_args);
+            return 0;
+        } else {
+            int result = flush_graph_replay(user_context, ctx.context);
+            if (result != 0) {
+                free(dev_handles);
+                free(translated_args);
+                return result;
+            }
+        }
+    }
+
+    // The globals copied into for this launch, once it is queued.
+    constant_global **used_constants = NULL;
+    if (uses_constant_memory) {
+        used_constants = (constant_global **)malloc(num_args * sizeof(constant_global *));
+        if (used_constants == NULL) {
+            error(user_context) << "CUDA: Out of memory in halide_cuda_run\n";
+            free(dev_handles);
+            free(translated_args);
+            return CUDA_ERROR_OUT_OF_MEMORY;
+        }
+        halide_mutex_lock(&constant_globals_lock);
+        for (size_t i = 0; i < num_args; i++) {
+            used_constants[i] = NULL;
+            if (arg_is_buffer[i] == 2) {
+                err = upload_constant(user_context, ctx.context, mod, stream, entry_name, i,
+                                      (const halide_buffer_t *)args[i], &used_constants[i]);
+                if (err != CUDA_SUCCESS) {
+                    halide_mutex_unlock(&constant_globals_lock);
+                    free(used_constants);
+                    free(dev_handles);
+                    free(translated_args);
+                    return err;
+                }
+            }
+        }
+    }
+
+    // When profiling, time the kernel with events around it, and wait
+    // for it, so that the host time is billed to the right Func too.
+    CUevent start_event = NULL, end_event = NULL;
+    if (profiling_device() && cuEventCreate && cuEventRecord &&
+        cuEventSynchronize && cuEventElapsedTime && cuEventDestroy) {
+        if (cuEventCreate(&start_event, 0) != CUDA_SUCCESS) {
+            start_event = NULL;
+        } else if (cuEventCreate(&end_event, 0) != CUDA_SUCCESS) {
+            cuEventDestroy(start_event);
+            start_event = NULL;
+        } else {
+            cuEventRecord(start_event, stream);
+        }
+    }
+
+    if (cooperative_launch) {
+        err = cuLaunchCooperativeKernel(f,
+                                        blocksX,  blocksY,  blocksZ,
+                                        threadsX, threadsY, threadsZ,
+                                        shared_mem_bytes,
+                                        stream,
+                                        translated_args);
+    } else {
+        err = cuLaunchKernel(f,
+                             blocksX,  blocksY,  blocksZ,
+                             threadsX, threadsY, threadsZ,
+                             shared_mem_bytes,
+                             stream,
+                             translated_args,
+                             NULL);
+    }
+    free(dev_handles);
+    free(translated_args);
+
+    if (used_constants) {
+        for (size_t i = 0; err == CUDA_SUCCESS && i < num_args; i++) {
+            if (used_constants[i] && used_constants[i]->last_use) {
+                cuEventRecord(used_constants[i]->last_use, stream);
+            }
+        }
+        halide_mutex_unlock(&constant_globals_lock);
+        free(used_constants);
+    }
+
+    if (start_event) {
+        float ms = 0;
+        if (err == CUDA_SUCCESS &&
+            cuEventRecord(end_event, stream) == CUDA_SUCCESS &&
+            cuEventSynchronize(end_event) == CUDA_SUCCESS &&
+            cuEventElapsedTime(&ms, start_event, end_event) == CUDA_SUCCESS) {
+            int occupancy = theoretical_occupancy(f, blocksX * blocksY * blocksZ,
+                                                  threadsX * threadsY * threadsZ,
+                                                  shared_mem_bytes);
+            halide_profiler_device_kernel(user_context, (uint64_t)(ms * 1000000.0f), occupancy);
+        }
+        cuEventDestroy(start_event);
+        cuEventDestroy(end_event);
+    }
+
+    if (err != CUDA_SUCCESS) {
+        error(user_context) << "CUDA: "
+                            << (cooperative_launch ? "cuLaunchCooperativeKernel" : "cuLaunchKernel")
+                            << " failed: " << get_error_name(err);
+        return err;
+    }
+
+    #ifdef DEBUG_RUNTIME
+    err = cuCtxSynchronize();
+    if (err != CUDA_SUCCESS) {
+        error(user_context) << "CUDA: cuCtxSynchronize failed: "
+                            << get_error_name(err);
+        return err;
+    }
+    uint64_t t_after = halide_current_time_ns(user_context);
+    debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
+    #endif
+    return 0;
+}
+}  // namespace
+
+WEAK int halide_cuda_run(void *user_context,
+                         void *state_ptr,
+                         const char* entry_name,
+                         int blocksX, int blocksY, int blocksZ,
+                         int threadsX, int threadsY, int threadsZ,
+                         int shared_mem_bytes,
+                         size_t arg_sizes[],
+                         void* args[],
+                         int8_t arg_is_buffer[],
+                         int num_attributes,
+                         float* vertex_buffer,
+                         int num_coords_dim0,
+                         int num_coords_dim1) {
+    return run_kernel(user_context, state_ptr, entry_name,
+                      blocksX, blocksY, blocksZ,
+                      threadsX, threadsY, threadsZ,
+                      shared_mem_bytes, arg_sizes, args, arg_is_buffer, false);
+}
+
+WEAK int halide_cuda_run_cooperative(void *user_context,
+                                     void *state_ptr,
+                                     const char* entry_name,
+                                     int blocksX, int blocksY, int blocksZ,
+                                     int threadsX, int threadsY, int threadsZ,
+                                     int shared_mem_bytes,
+                                     size_t arg_sizes[],
+                                     void* args[],
+                                     int8_t arg_is_buffer[],
+                                     int num_attributes,
+                                     float* vertex_buffer,
+                                     int num_coords_dim0,
+                                     int num_coords_dim1) {
+    return run_kernel(user_context, state_ptr, entry_name,
+                      blocksX, blocksY, blocksZ,
+                      threadsX, threadsY, threadsZ,
+                      shared_mem_bytes, arg_sizes, args, arg_is_buffer, true);
+}
+
+WEAK int halide_cuda_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_and_host_malloc (user_context: " << user_context
+        << ", buf: " << buf << ")\n";
+
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+
+    // In managed memory mode, the host can use the device allocation
+    // itself, if the device allows concurrent access.
+    if (managed_memory && cuMemAllocManaged && concurrent_managed_access()) {
+        int result = halide_device_malloc(user_context, buf, &cuda_device_interface);
+        if (result != 0) {
+            return result;
+        }
+        if (is_managed((CUdeviceptr)buf->device)) {
+            buf->host = (uint8_t *)(uintptr_t)buf->device;
+            return 0;
+        }
+    }
+
+    // Fall back to pageable memory if the host memory can't be pinned.
+    void *host = NULL;
+    if (cuMemHostAlloc && cuMemFreeHost) {
+        host = acquire_pinned_block(user_context, ctx.context, buf->size_in_bytes());
+    }
+    if (host == NULL) {
+        return halide_default_device_and_host_malloc(user_context, buf, &cuda_device_interface);
+    }
+    buf->host = (uint8_t *)host;
+    int result = halide_device_malloc(user_context, buf, &cuda_device_interface);
+    if (result != 0) {
+        release_pinned_block(user_context, host);
+        buf->host = NULL;
+    }
+    return result;
+}
+
+WEAK int halide_cuda_device_and_host_free(void *user_context, struct halide_buffer_t *buf) {
+    debug(user_context)
+        << "CUDA: halide_cuda_device_and_host_free (user_context: " << user_context
+        << ", buf: " << buf << ")\n";
+
+    bool unified = is_unified(buf);
+    int result = halide_device_free(user_context, buf);
+    if (unified) {
+        buf->host = NULL;
+    } else if (buf->host) {
+        Context ctx(user_context);
+        if (!release_pinned_block(user_context, buf->host)) {
+            halide_free(user_context, buf->host);
+        }
+        buf->host = NULL;
+    }
+    buf->set_host_dirty(false);
+    buf->set_device_dirty(false);
+    return result;
+}
+
+WEAK int halide_cuda_wrap_device_ptr(void *user_context, struct halide_buffer_t *buf, uint64_t device_ptr) {
+    halide_assert(user_context, buf->device == 0);
+    if (buf->device != 0) {
+        return -2;
+    }
+    buf->device = device_ptr;
+    buf->device_interface = &cuda_device_interface;
+    buf->device_interface->impl->use_module();
+#if DEBUG_RUNTIME
+    if (!validate_device_pointer(user_context, buf)) {
+        buf->device_interface->impl->release_module();
+        buf->device = 0;
+        buf->device_interface = NULL;
+        return -3;
+    }
+#endif
+    return 0;
+}
+
+WEAK int halide_cuda_detach_device_ptr(void *user_context, struct halide_buffer_t *buf) {
+    if (buf->device == NULL) {
+        return 0;
+    }
+    halide_assert(user_context, buf->device_interface == &cuda_device_interface);
+    buf->device_interface->impl->release_module();
     buf->device = 0;
     buf->device_interface = NULL;
     return 0;
 }
 
-WEAK uintptr_t halide_cuda_get_device_ptr(void *user_context, struct halide_buffer_t *buf) {
-    if (buf->device == NULL) {
+WEAK uintptr_t halide_cuda_get_device_ptr(void *user_context, struct halide_buffer_t *buf) {
+    if (buf->device == NULL) {
+        return 0;
+    }
+    halide_assert(user_context, buf->device_interface == &cuda_device_interface);
+    return (uintptr_t)buf->device;
+}
+
+WEAK const halide_device_interface_t *halide_cuda_device_interface() {
+    return &cuda_device_interface;
+}
+
+namespace {
+__attribute__((destructor))
+WEAK void halide_cuda_cleanup() {
+    halide_cuda_device_release(NULL);
+}
+}
+
+} // extern "C" linkage
+
+namespace Halide { namespace Runtime { namespace Internal { namespace Cuda {
+
+WEAK const char *get_error_name(CUresult err) {
+    switch(err) {
+    case CUDA_SUCCESS: return "CUDA_SUCCESS";
+    case CUDA_ERROR_INVALID_VALUE: return "CUDA_ERROR_INVALID_VALUE";
+    case CUDA_ERROR_OUT_OF_MEMORY: return "CUDA_ERROR_OUT_OF_MEMORY";
+    case CUDA_ERROR_NOT_INITIALIZED: return "CUDA_ERROR_NOT_INITIALIZED";
+    case CUDA_ERROR_DEINITIALIZED: return "CUDA_ERROR_DEINITIALIZED";
+    case CUDA_ERROR_PROFILER_DISABLED: return "CUDA_ERROR_PROFILER_DISABLED";
+    case CUDA_ERROR_PROFILER_NOT_INITIALIZED: return "CUDA_ERROR_PROFILER_NOT_INITIALIZED";
+    case CUDA_ERROR_PROFILER_ALREADY_STARTED: return "CUDA_ERROR_PROFILER_ALREADY_STARTED";
+    case CUDA_ERROR_PROFILER_ALREADY_STOPPED: return "CUDA_ERROR_PROFILER_ALREADY_STOPPED";
+    case CUDA_ERROR_NO_DEVICE: return "CUDA_ERROR_NO_DEVICE";
+    case CUDA_ERROR_INVALID_DEVICE: return "CUDA_ERROR_INVALID_DEVICE";
+    case CUDA_ERROR_INVALID_IMAGE: return "CUDA_ERROR_INVALID_IMAGE";
+    case CUDA_ERROR_INVALID_CONTEXT: return "CUDA_ERROR_INVALID_CONTEXT";
+    case CUDA_ERROR_CONTEXT_ALREADY_CURRENT: return "CUDA_ERROR_CONTEXT_ALREADY_CURRENT";
+    case CUDA_ERROR_MAP_FAILED: return "CUDA_ERROR_MAP_FAILED";
+    case CUDA_ERROR_UNMAP_FAILED: return "CUDA_ERROR_UNMAP_FAILED";
+    case CUDA_ERROR_ARRAY_IS_MAPPED: return "CUDA_ERROR_ARRAY_IS_MAPPED";
+    case CUDA_ERROR_ALREADY_MAPPED: return "CUDA_ERROR_ALREADY_MAPPED";
+    case CUDA_ERROR_NO_BINARY_FOR_GPU: return "CUDA_ERROR_NO_BINARY_FOR_GPU";
+    case CUDA_ERROR_ALREADY_ACQUIRED: return "CUDA_ERROR_ALREADY_ACQUIRED";
+    case CUDA_ERROR_NOT_MAPPED: return "CUDA_ERROR_NOT_MAPPED";
+    case CUDA_ERROR_NOT_MAPPED_AS_ARRAY: return "CUDA_ERROR_NOT_MAPPED_AS_ARRAY";
+    case CUDA_ERROR_NOT_MAPPED_AS_POINTER: return "CUDA_ERROR_NOT_MAPPED_AS_POINTER";
+    case CUDA_ERROR_ECC_UNCORRECTABLE: return "CUDA_ERROR_ECC_UNCORRECTABLE";
+    case CUDA_ERROR_UNSUPPORTED_LIMIT: return "CUDA_ERROR_UNSUPPORTED_LIMIT";
+    case CUDA_ERROR_CONTEXT_ALREADY_IN_USE: return "CUDA_ERROR_CONTEXT_ALREADY_IN_USE";
+    case CUDA_ERROR_PEER_ACCESS_UNSUPPORTED: return "CUDA_ERROR_PEER_ACCESS_UNSUPPORTED";
+    case CUDA_ERROR_INVALID_PTX: return "CUDA_ERROR_INVALID_PTX";
+    case CUDA_ERROR_INVALID_GRAPHICS_CONTEXT: return "CUDA_ERROR_INVALID_GRAPHICS_CONTEXT";
+    case CUDA_ERROR_NVLINK_UNCORRECTABLE: return "CUDA_ERROR_NVLINK_UNCORRECTABLE";
+    case CUDA_ERROR_JIT_COMPILER_NOT_FOUND: return "CUDA_ERROR_JIT_COMPILER_NOT_FOUND";
+    case CUDA_ERROR_INVALID_SOURCE: return "CUDA_ERROR_INVALID_SOURCE";
+    case CUDA_ERROR_FILE_NOT_FOUND: return "CUDA_ERROR_FILE_NOT_FOUND";
+    case CUDA_ERROR_SHARED_OBJECT_SYMBOL_NOT_FOUND: return "CUDA_ERROR_SHARED_OBJECT_SYMBOL_NOT_FOUND";
+    case CUDA_ERROR_SHARED_OBJECT_INIT_FAILED: return "CUDA_ERROR_SHARED_OBJECT_INIT_FAILED";
+    case CUDA_ERROR_OPERATING_SYSTEM: return "CUDA_ERROR_OPERATING_SYSTEM";
+    case CUDA_ERROR_INVALID_HANDLE: return "CUDA_ERROR_INVALID_HANDLE";
+    case CUDA_ERROR_NOT_FOUND: return "CUDA_ERROR_NOT_FOUND";
+    case CUDA_ERROR_NOT_READY: return "CUDA_ERROR_NOT_READY";
+    case CUDA_ERROR_ILLEGAL_ADDRESS: return "CUDA_ERROR_ILLEGAL_ADDRESS";
+    case CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES: return "CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES";
+    case CUDA_ERROR_LAUNCH_TIMEOUT: return "CUDA_ERROR_LAUNCH_TIMEOUT";
+    case CUDA_ERROR_LAUNCH_INCOMPATIBLE_TEXTURING: return "CUDA_ERROR_LAUNCH_INCOMPATIBLE_TEXTURING";
+    case CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED: return "CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED";
+    case CUDA_ERROR_PEER_ACCESS_NOT_ENABLED: return "CUDA_ERROR_PEER_ACCESS_NOT_ENABLED";
+    case CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE: return "CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE";
+    case CUDA_ERROR_CONTEXT_IS_DESTROYED: return "CUDA_ERROR_CONTEXT_IS_DESTROYED";
+    // A trap instruction produces the below error, which is how we codegen asserts on GPU
+    case CUDA_ERROR_ILLEGAL_INSTRUCTION:
+        return "Illegal instruction or Halide assertion failure inside kernel";
+    case CUDA_ERROR_MISALIGNED_ADDRESS: return "CUDA_ERROR_MISALIGNED_ADDRESS";
+    case CUDA_ERROR_INVALID_ADDRESS_SPACE: return "CUDA_ERROR_INVALID_ADDRESS_SPACE";
+    case CUDA_ERROR_INVALID_PC: return "CUDA_ERROR_INVALID_PC";
+    case CUDA_ERROR_LAUNCH_FAILED: return "CUDA_ERROR_LAUNCH_FAILED";
+    case CUDA_ERROR_NOT_PERMITTED: return "CUDA_ERROR_NOT_PERMITTED";
+    case CUDA_ERROR_NOT_SUPPORTED: return "CUDA_ERROR_NOT_SUPPORTED";
+    case CUDA_ERROR_UNKNOWN: return "CUDA_ERROR_UNKNOWN";
+    default:
+        // This is unfortunate as usually get_cuda_error is called in the middle of
+        // an error print, but dropping the number on the floor is worse.
+        error(NULL) << "Unknown cuda error " << err << "\n";
+        return "<Unknown error>";
+    }
+}
+
+WEAK halide_device_interface_impl_t cuda_device_interface_impl = {
+    halide_use_jit_module,
+    halide_release_jit_module,
+    halide_cuda_device_malloc,
+    halide_cuda_device_free,
+    halide_cuda_device_sync,
+    halide_cuda_device_release,
+    halide_cuda_copy_to_host,
+    halide_cuda_copy_to_device,
+    halide_cuda_device_and_host_malloc,
+    halide_cuda_device_and_host_free,
+    halide_cuda_buffer_copy,
+    halide_cuda_device_crop,
+    halide_cuda_device_slice,
+    halide_cuda_device_release_crop,
+    halide_cuda_wrap_device_ptr,
+    halide_cuda_detach_device_ptr,
+};
+
+WEAK halide_device_interface_t cuda_device_interface = {
+    halide_device_malloc,
+    halide_device_free,
+    halide_device_sync,
+    halide_device_release,
+    halide_copy_to_host,
+    halide_copy_to_device,
+    halide_device_and_host_malloc,
+    halide_device_and_host_free,
+    halide_buffer_copy,
+    halide_device_crop,
+    halide_device_slice,
+    halide_device_release_crop,
+    halide_device_wrap_native,
+    halide_device_detach_native,
+    &cuda_device_interface_impl
+};
+
+}}}} // namespace Halide::Runtime::Internal::Cuda
+
+namespace Halide { namespace Runtime { namespace Internal { namespace Cuda {
+
+// The cuBLAS and cuDNN libraries the library stages call (see
+// halide_cublas_gemm), loaded the first time one runs.
+WEAK void *lib_cublas = NULL;
+WEAK void *lib_cudnn = NULL;
+WEAK bool cublas_loaded = false;
+WEAK bool cudnn_loaded = false;
+// This spinlock protects the above, and the library_handles below.
+volatile int WEAK cuda_libraries_lock = 0;
+
+WEAK void *load_first_library(void *user_context, const char *const *names, int count) {
+    for (int i = 0; i < count; i++) {
+        void *lib = halide_load_library(names[i]);
+        if (lib) {
+            debug(user_context) << "    Loaded " << names[i] << "\n";
+            return lib;
+        }
+    }
+    return NULL;
+}
+
+template <typename T>
+INLINE bool get_library_function(void *user_context, void *lib, const char *name, T *fn) {
+    *fn = (T)halide_get_library_symbol(lib, name);
+    if (!*fn) {
+        error(user_context) << "CUDA: " << name << " not found\n";
+        return false;
+    }
+    return true;
+}
+
+#define GET_LIBRARY_FUNCTION(lib, fn) get_library_function(user_context, lib, #fn, &fn)
+
+WEAK bool load_libcublas(void *user_context) {
+    ScopedSpinLock spinlock(&cuda_libraries_lock);
+    if (cublas_loaded) {
+        return true;
+    }
+    const char *names[] = {
+#ifdef WINDOWS
+        "cublas64_11.dll",
+        "cublas64_10.dll",
+#else
+        "libcublas.so",
+        "libcublas.so.11",
+        "libcublas.so.10",
+        "libcublas.dylib",
+#endif
+    };
+    if (!lib_cublas) {
+        lib_cublas = load_first_library(user_context, names, sizeof(names) / sizeof(names[0]));
+    }
+    if (!lib_cublas) {
+        error(user_context) << "CUDA: Could not load cuBLAS\n";
+        return false;
+    }
+    cublas_loaded = (GET_LIBRARY_FUNCTION(lib_cublas, cublasCreate_v2) &&
+                     GET_LIBRARY_FUNCTION(lib_cublas, cublasDestroy_v2) &&
+                     GET_LIBRARY_FUNCTION(lib_cublas, cublasSetStream_v2) &&
+                     GET_LIBRARY_FUNCTION(lib_cublas, cublasSgemm_v2) &&
+                     GET_LIBRARY_FUNCTION(lib_cublas, cublasDgemm_v2));
+    return cublas_loaded;
+}
+
+WEAK bool load_libcudnn(void *user_context) {
+    ScopedSpinLock spinlock(&cuda_libraries_lock);
+    if (cudnn_loaded) {
+        return true;
+    }
+    const char *names[] = {
+#ifdef WINDOWS
+        "cudnn64_8.dll",
+        "cudnn64_7.dll",
+#else
+        "libcudnn.so",
+        "libcudnn.so.8",
+        "libcudnn.so.7",
+        "libcudnn.dylib",
+#endif
+    };
+    if (!lib_cudnn) {
+        lib_cudnn = load_first_library(user_context, names, sizeof(names) / sizeof(names[0]));
+    }
+    if (!lib_cudnn) {
+        error(user_context) << "CUDA: Could not load cuDNN\n";
+        return false;
+    }
+    cudnn_loaded = (GET_LIBRARY_FUNCTION(lib_cudnn, cudnnCreate) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnDestroy) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnSetStream) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnGetErrorString) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnCreateTensorDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnDestroyTensorDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnSetTensor4dDescriptorEx) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnCreateFilterDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnDestroyFilterDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnSetFilter4dDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnCreateConvolutionDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnDestroyConvolutionDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnSetConvolution2dDescriptor) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnGetConvolutionForwardWorkspaceSize) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnConvolutionForward) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnGetConvolutionBackwardDataWorkspaceSize) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnConvolutionBackwardData) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnGetConvolutionBackwardFilterWorkspaceSize) &&
+                    GET_LIBRARY_FUNCTION(lib_cudnn, cudnnConvolutionBackwardFilter));
+    return cudnn_loaded;
+}
+
+#undef GET_LIBRARY_FUNCTION
+
+// The cuBLAS and cuDNN handles of a context, made when a library stage
+// first runs on it, and destroyed by halide_cuda_device_release.
+struct library_handles {
+    CUcontext context;
+    cublasHandle_t cublas;
+    cudnnHandle_t cudnn;
+};
+
+const int max_library_contexts = 16;
+WEAK library_handles library_handles_table[max_library_contexts];
+
+WEAK library_handles *find_library_handles(void *user_context, CUcontext ctx) {
+    library_handles *empty = NULL;
+    for (int i = 0; i < max_library_contexts; i++) {
+        library_handles *h = &library_handles_table[i];
+        if (h->context == ctx) {
+            return h;
+        } else if (h->context == NULL && empty == NULL) {
+            empty = h;
+        }
+    }
+    if (empty == NULL) {
+        error(user_context) << "CUDA: Library stages can't run on more than "
+                            << max_library_contexts << " contexts\n";
+        return NULL;
+    }
+    empty->context = ctx;
+    return empty;
+}
+
+// The cuBLAS handle of a context, which must be current, set to queue
+// work on 'stream'.
+WEAK int get_cublas_handle(void *user_context, CUcontext ctx, CUstream stream, cublasHandle_t *handle) {
+    if (!load_libcublas(user_context)) {
+        return halide_error_code_generic_error;
+    }
+    {
+        ScopedSpinLock spinlock(&cuda_libraries_lock);
+        library_handles *h = find_library_handles(user_context, ctx);
+        if (h == NULL) {
+            return halide_error_code_generic_error;
+        }
+        if (h->cublas == NULL) {
+            cublasStatus_t status = cublasCreate_v2(&h->cublas);
+            if (status != CUBLAS_STATUS_SUCCESS) {
+                h->cublas = NULL;
+                error(user_context) << "CUDA: cublasCreate failed: " << status << "\n";
+                return status;
+            }
+        }
+        *handle = h->cublas;
+    }
+    cublasStatus_t status = cublasSetStream_v2(*handle, stream);
+    if (status != CUBLAS_STATUS_SUCCESS) {
+        error(user_context) << "CUDA: cublasSetStream failed: " << status << "\n";
+        return status;
+    }
+    return 0;
+}
+
+// The cuDNN handle of a context, which must be current, set to queue
+// work on 'stream'.
+WEAK int get_cudnn_handle(void *user_context, CUcontext ctx, CUstream stream, cudnnHandle_t *handle) {
+    if (!load_libcudnn(user_context)) {
+        return halide_error_code_generic_error;
+    }
+    {
+        ScopedSpinLock spinlock(&cuda_libraries_lock);
+        library_handles *h = find_library_handles(user_context, ctx);
+        if (h == NULL) {
+            return halide_error_code_generic_error;
+        }
+        if (h->cudnn == NULL) {
+            cudnnStatus_t status = cudnnCreate(&h->cudnn);
+            if (status != CUDNN_STATUS_SUCCESS) {
+                h->cudnn = NULL;
+                error(user_context) << "CUDA: cudnnCreate failed: " << cudnnGetErrorString(status) << "\n";
+                return status;
+            }
+        }
+        *handle = h->cudnn;
+    }
+    cudnnStatus_t status = cudnnSetStream(*handle, stream);
+    if (status != CUDNN_STATUS_SUCCESS) {
+        error(user_context) << "CUDA: cudnnSetStream failed: " << cudnnGetErrorString(status) << "\n";
+        return status;
+    }
+    return 0;
+}
+
+// Destroy the library handles of a context, or of all contexts if ctx is
+// NULL. The context must be current.
+WEAK void release_library_handles(void *user_context, CUcontext ctx) {
+    ScopedSpinLock spinlock(&cuda_libraries_lock);
+    for (int i = 0; i < max_library_contexts; i++) {
+        library_handles *h = &library_handles_table[i];
+        if (h->context == NULL || (ctx != NULL && h->context != ctx)) {
+            continue;
+        }
+        if (h->cublas) {
+            debug(user_context) << "    cublasDestroy " << h->cublas << "\n";
+            cublasDestroy_v2(h->cublas);
+        }
+        if (h->cudnn) {
+            debug(user_context) << "    cudnnDestroy " << h->cudnn << "\n";
+            cudnnDestroy(h->cudnn);
+        }
+        h->context = NULL;
+        h->cublas = NULL;
+        h->cudnn = NULL;
+    }
+}
+
+// The stream a library stage queues its work on, after the kernels
+// deferred by a graph region, which can't capture the library calls.
+// The context must be current.
+WEAK int get_library_stream(void *user_context, CUcontext ctx, CUstream *stream) {
+    int err = flush_graph_replay(user_context, ctx);
+    if (err != 0) {
+        return err;
+    }
+    *stream = 0;
+    if (cuStreamSynchronize != NULL) {
+        err = halide_cuda_get_stream(user_context, ctx, stream);
+        if (err != 0) {
+            error(user_context) << "CUDA: In a library stage, halide_cuda_get_stream returned " << err << "\n";
+        }
+    }
+    return err;
+}
+
+// Set the region of a buffer queried by the bounds inference of a
+// library stage.
+WEAK void set_library_bounds(halide_buffer_t *buf, const int *mins, const int *extents) {
+    for (int i = 0; i < buf->dimensions; i++) {
+        buf->dim[i].min = mins[i];
+        buf->dim[i].extent = extents[i];
+    }
+}
+
+// Check that a buffer passed to a library stage is on the device, and
+// that its innermost dimension is dense, which the libraries require.
+WEAK bool check_library_buffer(void *user_context, const char *stage, const char *name,
+                               const halide_buffer_t *buf, int dimensions) {
+    if (buf->dimensions != dimensions) {
+        error(user_context) << stage << ": " << name << " has " << buf->dimensions
+                            << " dimensions instead of " << dimensions << "\n";
+        return false;
+    }
+    if (buf->device == 0 || buf->device_interface != &cuda_device_interface) {
+        error(user_context) << stage << ": " << name << " is not on the CUDA device\n";
+        return false;
+    }
+    if (buf->dim[0].stride != 1) {
+        error(user_context) << stage << ": " << name << " is not dense in its innermost dimension\n";
+        return false;
+    }
+    return true;
+}
+
+// Check that a filter passed to a cuDNN stage is dense, with the given
+// extents in all but its outermost dimension, as cuDNN requires.
+WEAK bool check_library_filter(void *user_context, const char *stage, const char *name,
+                               const halide_buffer_t *buf, const int *extents) {
+    int stride = 1;
+    for (int i = 0; i < buf->dimensions; i++) {
+        if (buf->dim[i].stride != stride) {
+            error(user_context) << stage << ": " << name << " is not dense\n";
+            return false;
+        }
+        stride *= extents[i];
+    }
+    return true;
+}
+
+// The device address of the element of a buffer at the given coordinates.
+WEAK CUdeviceptr library_buffer_address(const halide_buffer_t *buf, const int *coords) {
+    int64_t offset = 0;
+    for (int i = 0; i < buf->dimensions; i++) {
+        offset += (int64_t)(coords[i] - buf->dim[i].min) * buf->dim[i].stride;
+    }
+    return (CUdeviceptr)(buf->device + offset * buf->type.bytes());
+}
+
+// The cuDNN type of the elements of a buffer, and the type of the alpha
+// and beta scale factors, which are float for float16 data.
+WEAK bool get_cudnn_type(void *user_context, const char *stage, const halide_buffer_t *buf,
+                         cudnnDataType_t *type, cudnnDataType_t *compute_type) {
+    if (buf->type == halide_type_t(halide_type_float, 32)) {
+        *type = *compute_type = CUDNN_DATA_FLOAT;
+    } else if (buf->type == halide_type_t(halide_type_float, 64)) {
+        *type = *compute_type = CUDNN_DATA_DOUBLE;
+    } else if (buf->type == halide_type_t(halide_type_float, 16)) {
+        *type = CUDNN_DATA_HALF;
+        *compute_type = CUDNN_DATA_FLOAT;
+    } else {
+        error(user_context) << stage << ": Unsupported type " << buf->type << "\n";
+        return false;
+    }
+    return true;
+}
+
+// The cuDNN descriptors of a convolution, and the workspace it needs,
+// which is allocated on the stream the convolution runs on.
+class ConvolutionDescriptors {
+    void *user_context;
+    CUcontext ctx;
+    CUstream stream;
+    CUdeviceptr workspace_ptr;
+
+public:
+    cudnnTensorDescriptor_t input, output;
+    cudnnFilterDescriptor_t filter;
+    cudnnConvolutionDescriptor_t convolution;
+    void *workspace;
+    size_t workspace_size;
+    cudnnStatus_t status;
+
+    INLINE ConvolutionDescriptors(void *user_context, CUcontext ctx)
+        : user_context(user_context), ctx(ctx), stream(0), workspace_ptr(0),
+          input(NULL), output(NULL), filter(NULL), convolution(NULL),
+          workspace(NULL), workspace_size(0), status(CUDNN_STATUS_SUCCESS) {
+        status = cudnnCreateTensorDescriptor(&input);
+        if (status == CUDNN_STATUS_SUCCESS) {
+            status = cudnnCreateTensorDescriptor(&output);
+        }
+        if (status == CUDNN_STATUS_SUCCESS) {
+            status = cudnnCreateFilterDescriptor(&filter);
+        }
+        if (status == CUDNN_STATUS_SUCCESS) {
+            status = cudnnCreateConvolutionDescriptor(&convolution);
+        }
+    }
+
+    // Describe a convolution of the region of 'x' with the given extents
+    // by the filter 'w' into the region of 'y', laid out as Halide
+    // buffers of dimensions (x, y, c, n) and (x, y, c_in, c_out). The
+    // filter is dense.
+    INLINE cudnnStatus_t set(const halide_buffer_t *x, const int *x_extents,
+                             const int *w_extents,
+                             const halide_buffer_t *y, const int *y_extents,
+                             int stride, cudnnDataType_t type, cudnnDataType_t compute_type) {
+        status = cudnnSetTensor4dDescriptorEx(input, type,
+                                              x_extents[3], x_extents[2], x_extents[1], x_extents[0],
+                                              x->dim[3].stride, x->dim[2].stride, x->dim[1].stride, 1);
+        if (status == CUDNN_STATUS_SUCCESS) {
+            status = cudnnSetTensor4dDescriptorEx(output, type,
+                                                  y_extents[3], y_extents[2], y_extents[1], y_extents[0],
+                                                  y->dim[3].stride, y->dim[2].stride, y->dim[1].stride, 1);
+        }
+        if (status == CUDNN_STATUS_SUCCESS) {
+            status = cudnnSetFilter4dDescriptor(filter, type, CUDNN_TENSOR_NCHW,
+                                                w_extents[3], w_extents[2], w_extents[1], w_extents[0]);
+        }
+        if (status == CUDNN_STATUS_SUCCESS) {
+            status = cudnnSetConvolution2dDescriptor(convolution, 0, 0, stride, stride, 1, 1,
+                                                     CUDNN_CROSS_CORRELATION, compute_type);
+        }
+        return status;
+    }
+
+    INLINE int allocate_workspace(CUstream s) {
+        stream = s;
+        if (workspace_size == 0) {
+            return 0;
+        }
+        int err = halide_cuda_allocate(user_context, ctx, stream, workspace_size, &workspace_ptr);
+        if (err != 0) {
+            error(user_context) << "CUDA: Could not allocate " << (uint64_t)workspace_size
+                                << " bytes of cuDNN workspace\n";
+            return err;
+        }
+        workspace = (void *)workspace_ptr;
         return 0;
     }
-    halide_assert(user_context, buf->device_interface == &cuda_device_interface);
-    return (uintptr_t)buf->device;
+
+    INLINE ~ConvolutionDescriptors() {
+        if (workspace_ptr) {
+            halide_cuda_deallocate(user_context, ctx, stream, workspace_ptr, workspace_size);
+        }
+        if (convolution) {
+            cudnnDestroyConvolutionDescriptor(convolution);
+        }
+        if (filter) {
+            cudnnDestroyFilterDescriptor(filter);
+        }
+        if (output) {
+            cudnnDestroyTensorDescriptor(output);
+        }
+        if (input) {
+            cudnnDestroyTensorDescriptor(input);
+        }
+    }
+};
+
+// The region of a buffer of a convolution, as (x, y, c, n) coordinates
+// and extents.
+struct conv_region {
+    int mins[4], extents[4];
+
+    INLINE conv_region(int x, int y, int c, int n, int w, int h, int channels, int batch) {
+        mins[0] = x;
+        mins[1] = y;
+        mins[2] = c;
+        mins[3] = n;
+        extents[0] = w;
+        extents[1] = h;
+        extents[2] = channels;
+        extents[3] = batch;
+    }
+
+    INLINE conv_region(const halide_buffer_t *buf) {
+        for (int i = 0; i < 4; i++) {
+            mins[i] = buf->dim[i].min;
+            extents[i] = buf->dim[i].extent;
+        }
+    }
+};
+
+// Set up the common parts of the cuDNN stages: check the buffers and get
+// the descriptors of the convolution of 'x' into 'y' by 'w', which take
+// the given regions of them. The context must be current.
+WEAK int begin_convolution(void *user_context, const char *stage, CUcontext ctx,
+                           const halide_buffer_t *x, const conv_region &x_region,
+                           const halide_buffer_t *w, const conv_region &w_region,
+                           const halide_buffer_t *y, const conv_region &y_region,
+                           int stride, CUstream *stream, cudnnHandle_t *handle,
+                           ConvolutionDescriptors *desc, cudnnDataType_t *compute_type) {
+    if (!check_library_buffer(user_context, stage, "the input", x, 4) ||
+        !check_library_buffer(user_context, stage, "the filter", w, 4) ||
+        !check_library_buffer(user_context, stage, "the output", y, 4) ||
+        !check_library_filter(user_context, stage, "the filter", w, w_region.extents)) {
+        return halide_error_code_generic_error;
+    }
+    if (x->type != y->type || w->type != y->type) {
+        error(user_context) << stage << ": The buffers must all have the same type\n";
+        return halide_error_code_generic_error;
+    }
+    cudnnDataType_t type;
+    if (!get_cudnn_type(user_context, stage, y, &type, compute_type)) {
+        return halide_error_code_generic_error;
+    }
+    int err = get_library_stream(user_context, ctx, stream);
+    if (err == 0) {
+        err = get_cudnn_handle(user_context, ctx, *stream, handle);
+    }
+    if (err != 0) {
+        return err;
+    }
+    if (desc->status == CUDNN_STATUS_SUCCESS) {
+        desc->set(x, x_region.extents, w_region.extents, y, y_region.extents, stride, type, *compute_type);
+    }
+    if (desc->status != CUDNN_STATUS_SUCCESS) {
+        error(user_context) << stage << ": Could not describe the convolution: "
+                            << cudnnGetErrorString(desc->status) << "\n";
+        return desc->status;
+    }
+    return 0;
 }
 
-WEAK const halide_device_interface_t *halide_cuda_device_interface() {
-    return &cuda_device_interface;
+WEAK int end_convolution(void *user_context, const char *stage, cudnnStatus_t status) {
+    if (status != CUDNN_STATUS_SUCCESS) {
+        error(user_context) << stage << ": " << cudnnGetErrorString(status) << "\n";
+        return status;
+    }
+    return 0;
 }
 
-namespace {
-__attribute__((destructor))
-WEAK void halide_cuda_cleanup() {
-    halide_cuda_device_release(NULL);
+// The scale factors of the result and of the previous contents of the
+// output, which has none.
+struct conv_scale {
+    float alpha_f, beta_f;
+    double alpha_d, beta_d;
+    const void *alpha, *beta;
+
+    INLINE conv_scale(cudnnDataType_t compute_type) : alpha_f(1.0f), beta_f(0.0f), alpha_d(1.0), beta_d(0.0) {
+        alpha = compute_type == CUDNN_DATA_DOUBLE ? (const void *)&alpha_d : (const void *)&alpha_f;
+        beta = compute_type == CUDNN_DATA_DOUBLE ? (const void *)&beta_d : (const void *)&beta_f;
+    }
+};
+
+}}}} // namespace Halide::Runtime::Internal::Cuda
+
+extern "C" {
+
+WEAK int halide_cublas_gemm(void *user_context, int transpose_a, int transpose_b, int k,
+                            halide_buffer_t *a, halide_buffer_t *b, halide_buffer_t *c) {
+    debug(user_context)
+        << "CUDA: halide_cublas_gemm (user_context: " << user_context
+        << ", a: " << a << ", b: " << b << ", c: " << c << ")\n";
+
+    const char *stage = "halide_cublas_gemm";
+    if (c->dimensions != 2) {
+        error(user_context) << stage << ": c has " << c->dimensions << " dimensions instead of 2\n";
+        return halide_error_code_generic_error;
+    }
+    // C is indexed (column, row), and so are A and B unless transposed.
+    const int j0 = c->dim[0].min, n = c->dim[0].extent;
+    const int i0 = c->dim[1].min, m = c->dim[1].extent;
+    int a_coords[2] = {0, i0}, a_extents[2] = {k, m};
+    int b_coords[2] = {j0, 0}, b_extents[2] = {n, k};
+    if (transpose_a) {
+        a_coords[0] = i0;
+        a_coords[1] = 0;
+        a_extents[0] = m;
+        a_extents[1] = k;
+    }
+    if (transpose_b) {
+        b_coords[0] = 0;
+        b_coords[1] = j0;
+        b_extents[0] = k;
+        b_extents[1] = n;
+    }
+    if (a->is_bounds_query() || b->is_bounds_query()) {
+        if (a->is_bounds_query()) {
+            set_library_bounds(a, a_coords, a_extents);
+        }
+        if (b->is_bounds_query()) {
+            set_library_bounds(b, b_coords, b_extents);
+        }
+        return 0;
+    }
+
+    if (!check_library_buffer(user_context, stage, "a", a, 2) ||
+        !check_library_buffer(user_context, stage, "b", b, 2) ||
+        !check_library_buffer(user_context, stage, "c", c, 2)) {
+        return halide_error_code_generic_error;
+    }
+    const bool is_double = c->type == halide_type_t(halide_type_float, 64);
+    if ((!is_double && c->type != halide_type_t(halide_type_float, 32)) ||
+        a->type != c->type || b->type != c->type) {
+        error(user_context) << stage << ": The matrices must all be float or all be double\n";
+        return halide_error_code_generic_error;
+    }
+
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    CUstream stream;
+    cublasHandle_t handle;
+    int err = get_library_stream(user_context, ctx.context, &stream);
+    if (err == 0) {
+        err = get_cublas_handle(user_context, ctx.context, stream, &handle);
+    }
+    if (err != 0) {
+        return err;
+    }
+
+    // cuBLAS matrices are column major, so the row major C = A * B is
+    // computed as the column major C^T = B^T * A^T, and the matrices are
+    // passed as they are. The leading dimension of a matrix of a single
+    // column isn't used, but must be at least its number of rows.
+    const int c_coords[2] = {j0, i0};
+    const int lda = a->dim[1].extent > 1 ? a->dim[1].stride : a_extents[0];
+    const int ldb = b->dim[1].extent > 1 ? b->dim[1].stride : b_extents[0];
+    const int ldc = m > 1 ? c->dim[1].stride : n;
+    const cublasOperation_t op_a = transpose_a ? CUBLAS_OP_T : CUBLAS_OP_N;
+    const cublasOperation_t op_b = transpose_b ? CUBLAS_OP_T : CUBLAS_OP_N;
+    cublasStatus_t status;
+    if (is_double) {
+        const double alpha = 1.0, beta = 0.0;
+        status = cublasDgemm_v2(handle, op_b, op_a, n, m, k, &alpha,
+                                (const double *)library_buffer_address(b, b_coords), ldb,
+                                (const double *)library_buffer_address(a, a_coords), lda,
+                                &beta, (double *)library_buffer_address(c, c_coords), ldc);
+    } else {
+        const float alpha = 1.0f, beta = 0.0f;
+        status = cublasSgemm_v2(handle, op_b, op_a, n, m, k, &alpha,
+                                (const float *)library_buffer_address(b, b_coords), ldb,
+                                (const float *)library_buffer_address(a, a_coords), lda,
+                                &beta, (float *)library_buffer_address(c, c_coords), ldc);
+    }
+    if (status != CUBLAS_STATUS_SUCCESS) {
+        error(user_context) << stage << ": cublasGemm failed: " << status << "\n";
+        return status;
+    }
+    return 0;
 }
+
+WEAK int halide_cudnn_conv_forward(void *user_context, int channels, int filter_width, int filter_height,
+                                   int stride, halide_buffer_t *input, halide_buffer_t *filter,
+                                   halide_buffer_t *output) {
+    debug(user_context)
+        << "CUDA: halide_cudnn_conv_forward (user_context: " << user_context
+        << ", input: " << input << ", filter: " << filter << ", output: " << output << ")\n";
+
+    const char *stage = "halide_cudnn_conv_forward";
+    if (output->dimensions != 4) {
+        error(user_context) << stage << ": The output has " << output->dimensions << " dimensions instead of 4\n";
+        return halide_error_code_generic_error;
+    }
+    conv_region y_region(output);
+    conv_region x_region(y_region.mins[0] * stride, y_region.mins[1] * stride, 0, y_region.mins[3],
+                         (y_region.extents[0] - 1) * stride + filter_width,
+                         (y_region.extents[1] - 1) * stride + filter_height,
+                         channels, y_region.extents[3]);
+    conv_region w_region(0, 0, 0, y_region.mins[2],
+                         filter_width, filter_height, channels, y_region.extents[2]);
+    if (input->is_bounds_query() || filter->is_bounds_query()) {
+        if (input->is_bounds_query()) {
+            set_library_bounds(input, x_region.mins, x_region.extents);
+        }
+        if (filter->is_bounds_query()) {
+            set_library_bounds(filter, w_region.mins, w_region.extents);
+        }
+        return 0;
+    }
+
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    CUstream stream;
+    cudnnHandle_t handle;
+    cudnnDataType_t compute_type;
+    ConvolutionDescriptors desc(user_context, ctx.context);
+    int err = begin_convolution(user_context, stage, ctx.context, input, x_region, filter, w_region,
+                                output, y_region, stride, &stream, &handle, &desc, &compute_type);
+    if (err != 0) {
+        return err;
+    }
+    const int algo = CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_GEMM;
+    cudnnStatus_t status = cudnnGetConvolutionForwardWorkspaceSize(handle, desc.input, desc.filter,
+                                                                   desc.convolution, desc.output,
+                                                                   algo, &desc.workspace_size);
+    if (status == CUDNN_STATUS_SUCCESS) {
+        err = desc.allocate_workspace(stream);
+        if (err != 0) {
+            return err;
+        }
+        conv_scale scale(compute_type);
+        status = cudnnConvolutionForward(handle, scale.alpha,
+                                         desc.input, (const void *)library_buffer_address(input, x_region.mins),
+                                         desc.filter, (const void *)library_buffer_address(filter, w_region.mins),
+                                         desc.convolution, algo, desc.workspace, desc.workspace_size,
+                                         scale.beta,
+                                         desc.output, (void *)library_buffer_address(output, y_region.mins));
+    }
+    return end_convolution(user_context, stage, status);
 }
 
-} // extern "C" linkage
+WEAK int halide_cudnn_conv_backward_data(void *user_context, int output_channels, int filter_width,
+                                         int filter_height, int stride, halide_buffer_t *filter,
+                                         halide_buffer_t *d_output, halide_buffer_t *d_input) {
+    debug(user_context)
+        << "CUDA: halide_cudnn_conv_backward_data (user_context: " << user_context
+        << ", filter: " << filter << ", d_output: " << d_output << ", d_input: " << d_input << ")\n";
 
-namespace Halide { namespace Runtime { namespace Internal { namespace Cuda {
+    const char *stage = "halide_cudnn_conv_backward_data";
+    if (d_input->dimensions != 4) {
+        error(user_context) << stage << ": d_input has " << d_input->dimensions << " dimensions instead of 4\n";
+        return halide_error_code_generic_error;
+    }
+    // cuDNN computes the whole adjoint of the input the convolution read
+    // over its width and height, of all the channels.
+    conv_region dx_region(d_input);
+    const int width = dx_region.extents[0], height = dx_region.extents[1];
+    if (dx_region.mins[0] != 0 || dx_region.mins[1] != 0 || dx_region.mins[2] != 0 ||
+        width < filter_width || (width - filter_width) % stride != 0 ||
+        height < filter_height || (height - filter_height) % stride != 0) {
+        error(user_context) << stage << ": d_input must be computed over all the input of the "
+                            << "convolution, from zero, instead of over " << *d_input << "\n";
+        return halide_error_code_generic_error;
+    }
+    conv_region dy_region(0, 0, 0, dx_region.mins[3],
+                          (width - filter_width) / stride + 1, (height - filter_height) / stride + 1,
+                          output_channels, dx_region.extents[3]);
+    conv_region w_region(0, 0, 0, 0, filter_width, filter_height, dx_region.extents[2], output_channels);
+    if (filter->is_bounds_query() || d_output->is_bounds_query()) {
+        if (filter->is_bounds_query()) {
+            set_library_bounds(filter, w_region.mins, w_region.extents);
+        }
+        if (d_output->is_bounds_query()) {
+            set_library_bounds(d_output, dy_region.mins, dy_region.extents);
+        }
+        return 0;
+    }
 
-WEAK const char *get_error_name(CUresult err) {
-    switch(err) {
-    case CUDA_SUCCESS: return "CUDA_SUCCESS";
-    case CUDA_ERROR_INVALID_VALUE: return "CUDA_ERROR_INVALID_VALUE";
-    case CUDA_ERROR_OUT_OF_MEMORY: return "CUDA_ERROR_OUT_OF_MEMORY";
-    case CUDA_ERROR_NOT_INITIALIZED: return "CUDA_ERROR_NOT_INITIALIZED";
-    case CUDA_ERROR_DEINITIALIZED: return "CUDA_ERROR_DEINITIALIZED";
-    case CUDA_ERROR_PROFILER_DISABLED: return "CUDA_ERROR_PROFILER_DISABLED";
-    case CUDA_ERROR_PROFILER_NOT_INITIALIZED: return "CUDA_ERROR_PROFILER_NOT_INITIALIZED";
-    case CUDA_ERROR_PROFILER_ALREADY_STARTED: return "CUDA_ERROR_PROFILER_ALREADY_STARTED";
-    case CUDA_ERROR_PROFILER_ALREADY_STOPPED: return "CUDA_ERROR_PROFILER_ALREADY_STOPPED";
-    case CUDA_ERROR_NO_DEVICE: return "CUDA_ERROR_NO_DEVICE";
-    case CUDA_ERROR_INVALID_DEVICE: return "CUDA_ERROR_INVALID_DEVICE";
-    case CUDA_ERROR_INVALID_IMAGE: return "CUDA_ERROR_INVALID_IMAGE";
-    case CUDA_ERROR_INVALID_CONTEXT: return "CUDA_ERROR_INVALID_CONTEXT";
-    case CUDA_ERROR_CONTEXT_ALREADY_CURRENT: return "CUDA_ERROR_CONTEXT_ALREADY_CURRENT";
-    case CUDA_ERROR_MAP_FAILED: return "CUDA_ERROR_MAP_FAILED";
-    case CUDA_ERROR_UNMAP_FAILED: return "CUDA_ERROR_UNMAP_FAILED";
-    case CUDA_ERROR_ARRAY_IS_MAPPED: return "CUDA_ERROR_ARRAY_IS_MAPPED";
-    case CUDA_ERROR_ALREADY_MAPPED: return "CUDA_ERROR_ALREADY_MAPPED";
-    case CUDA_ERROR_NO_BINARY_FOR_GPU: return "CUDA_ERROR_NO_BINARY_FOR_GPU";
-    case CUDA_ERROR_ALREADY_ACQUIRED: return "CUDA_ERROR_ALREADY_ACQUIRED";
-    case CUDA_ERROR_NOT_MAPPED: return "CUDA_ERROR_NOT_MAPPED";
-    case CUDA_ERROR_NOT_MAPPED_AS_ARRAY: return "CUDA_ERROR_NOT_MAPPED_AS_ARRAY";
-    case CUDA_ERROR_NOT_MAPPED_AS_POINTER: return "CUDA_ERROR_NOT_MAPPED_AS_POINTER";
-    case CUDA_ERROR_ECC_UNCORRECTABLE: return "CUDA_ERROR_ECC_UNCORRECTABLE";
-    case CUDA_ERROR_UNSUPPORTED_LIMIT: return "CUDA_ERROR_UNSUPPORTED_LIMIT";
-    case CUDA_ERROR_CONTEXT_ALREADY_IN_USE: return "CUDA_ERROR_CONTEXT_ALREADY_IN_USE";
-    case CUDA_ERROR_PEER_ACCESS_UNSUPPORTED: return "CUDA_ERROR_PEER_ACCESS_UNSUPPORTED";
-    case CUDA_ERROR_INVALID_PTX: return "CUDA_ERROR_INVALID_PTX";
-    case CUDA_ERROR_INVALID_GRAPHICS_CONTEXT: return "CUDA_ERROR_INVALID_GRAPHICS_CONTEXT";
-    case CUDA_ERROR_NVLINK_UNCORRECTABLE: return "CUDA_ERROR_NVLINK_UNCORRECTABLE";
-    case CUDA_ERROR_JIT_COMPILER_NOT_FOUND: return "CUDA_ERROR_JIT_COMPILER_NOT_FOUND";
-    case CUDA_ERROR_INVALID_SOURCE: return "CUDA_ERROR_INVALID_SOURCE";
-    case CUDA_ERROR_FILE_NOT_FOUND: return "CUDA_ERROR_FILE_NOT_FOUND";
-    case CUDA_ERROR_SHARED_OBJECT_SYMBOL_NOT_FOUND: return "CUDA_ERROR_SHARED_OBJECT_SYMBOL_NOT_FOUND";
-    case CUDA_ERROR_SHARED_OBJECT_INIT_FAILED: return "CUDA_ERROR_SHARED_OBJECT_INIT_FAILED";
-    case CUDA_ERROR_OPERATING_SYSTEM: return "CUDA_ERROR_OPERATING_SYSTEM";
-    case CUDA_ERROR_INVALID_HANDLE: return "CUDA_ERROR_INVALID_HANDLE";
-    case CUDA_ERROR_NOT_FOUND: return "CUDA_ERROR_NOT_FOUND";
-    case CUDA_ERROR_NOT_READY: return "CUDA_ERROR_NOT_READY";
-    case CUDA_ERROR_ILLEGAL_ADDRESS: return "CUDA_ERROR_ILLEGAL_ADDRESS";
-    case CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES: return "CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES";
-    case CUDA_ERROR_LAUNCH_TIMEOUT: return "CUDA_ERROR_LAUNCH_TIMEOUT";
-    case CUDA_ERROR_LAUNCH_INCOMPATIBLE_TEXTURING: return "CUDA_ERROR_LAUNCH_INCOMPATIBLE_TEXTURING";
-    case CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED: return "CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED";
-    case CUDA_ERROR_PEER_ACCESS_NOT_ENABLED: return "CUDA_ERROR_PEER_ACCESS_NOT_ENABLED";
-    case CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE: return "CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE";
-    case CUDA_ERROR_CONTEXT_IS_DESTROYED: return "CUDA_ERROR_CONTEXT_IS_DESTROYED";
-    // A trap instruction produces the below error, which is how we codegen asserts on GPU
-    case CUDA_ERROR_ILLEGAL_INSTRUCTION:
-        return "Illegal instruction or Halide assertion failure inside kernel";
-    case CUDA_ERROR_MISALIGNED_ADDRESS: return "CUDA_ERROR_MISALIGNED_ADDRESS";
-    case CUDA_ERROR_INVALID_ADDRESS_SPACE: return "CUDA_ERROR_INVALID_ADDRESS_SPACE";
-    case CUDA_ERROR_INVALID_PC: return "CUDA_ERROR_INVALID_PC";
-    case CUDA_ERROR_LAUNCH_FAILED: return "CUDA_ERROR_LAUNCH_FAILED";
-    case CUDA_ERROR_NOT_PERMITTED: return "CUDA_ERROR_NOT_PERMITTED";
-    case CUDA_ERROR_NOT_SUPPORTED: return "CUDA_ERROR_NOT_SUPPORTED";
-    case CUDA_ERROR_UNKNOWN: return "CUDA_ERROR_UNKNOWN";
-    default:
-        // This is unfortunate as usually get_cuda_error is called in the middle of
-        // an error print, but dropping the number on the floor is worse.
-        error(NULL) << "Unknown cuda error " << err << "\n";
-        return "<Unknown error>";
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    CUstream stream;
+    cudnnHandle_t handle;
+    cudnnDataType_t compute_type;
+    ConvolutionDescriptors desc(user_context, ctx.context);
+    int err = begin_convolution(user_context, stage, ctx.context, d_input, dx_region, filter, w_region,
+                                d_output, dy_region, stride, &stream, &handle, &desc, &compute_type);
+    if (err != 0) {
+        return err;
     }
+    const int algo = CUDNN_CONVOLUTION_BWD_DATA_ALGO_1;
+    cudnnStatus_t status = cudnnGetConvolutionBackwardDataWorkspaceSize(handle, desc.filter, desc.output,
+                                                                        desc.convolution, desc.input,
+                                                                        algo, &desc.workspace_size);
+    if (status == CUDNN_STATUS_SUCCESS) {
+        err = desc.allocate_workspace(stream);
+        if (err != 0) {
+            return err;
+        }
+        conv_scale scale(compute_type);
+        status = cudnnConvolutionBackwardData(handle, scale.alpha,
+                                              desc.filter, (const void *)library_buffer_address(filter, w_region.mins),
+                                              desc.output, (const void *)library_buffer_address(d_output, dy_region.mins),
+                                              desc.convolution, algo, desc.workspace, desc.workspace_size,
+                                              scale.beta,
+                                              desc.input, (void *)library_buffer_address(d_input, dx_region.mins));
+    }
+    return end_convolution(user_context, stage, status);
 }
 
-WEAK halide_device_interface_impl_t cuda_device_interface_impl = {
-    halide_use_jit_module,
-    halide_release_jit_module,
-    halide_cuda_device_malloc,
-    halide_cuda_device_free,
-    halide_cuda_device_sync,
-    halide_cuda_device_release,
-    halide_cuda_copy_to_host,
-    halide_cuda_copy_to_device,
-    halide_cuda_device_and_host_malloc,
-    halide_cuda_device_and_host_free,
-    halide_cuda_buffer_copy,
-    halide_cuda_device_crop,
-    halide_cuda_device_slice,
-    halide_cuda_device_release_crop,
-    halide_cuda_wrap_device_ptr,
-    halide_cuda_detach_device_ptr,
-};
+WEAK int halide_cudnn_conv_backward_filter(void *user_context, int width, int height, int batch,
+                                           int stride, halide_buffer_t *input, halide_buffer_t *d_output,
+                                           halide_buffer_t *d_filter) {
+    debug(user_context)
+        << "CUDA: halide_cudnn_conv_backward_filter (user_context: " << user_context
+        << ", input: " << input << ", d_output: " << d_output << ", d_filter: " << d_filter << ")\n";
 
-WEAK halide_device_interface_t cuda_device_interface = {
-    halide_device_malloc,
-    halide_device_free,
-    halide_device_sync,
-    halide_device_release,
-    halide_copy_to_host,
-    halide_copy_to_device,
-    halide_device_and_host_malloc,
-    halide_device_and_host_free,
-    halide_buffer_copy,
-    halide_device_crop,
-    halide_device_slice,
-    halide_device_release_crop,
-    halide_device_wrap_native,
-    halide_device_detach_native,
-    &cuda_device_interface_impl
-};
+    const char *stage = "halide_cudnn_conv_backward_filter";
+    if (d_filter->dimensions != 4) {
+        error(user_context) << stage << ": d_filter has " << d_filter->dimensions << " dimensions instead of 4\n";
+        return halide_error_code_generic_error;
+    }
+    // The adjoint of a region of the filter reads the input from its
+    // offset, and the adjoint of the whole output.
+    conv_region dw_region(d_filter);
+    conv_region x_region(dw_region.mins[0], dw_region.mins[1], dw_region.mins[2], 0,
+                         (width - 1) * stride + dw_region.extents[0],
+                         (height - 1) * stride + dw_region.extents[1],
+                         dw_region.extents[2], batch);
+    conv_region dy_region(0, 0, dw_region.mins[3], 0, width, height, dw_region.extents[3], batch);
+    if (input->is_bounds_query() || d_output->is_bounds_query()) {
+        if (input->is_bounds_query()) {
+            set_library_bounds(input, x_region.mins, x_region.extents);
+        }
+        if (d_output->is_bounds_query()) {
+            set_library_bounds(d_output, dy_region.mins, dy_region.extents);
+        }
+        return 0;
+    }
 
-}}}} // namespace Halide::Runtime::Internal::Cuda
+    Context ctx(user_context);
+    if (ctx.error != CUDA_SUCCESS) {
+        return ctx.error;
+    }
+    CUstream stream;
+    cudnnHandle_t handle;
+    cudnnDataType_t compute_type;
+    ConvolutionDescriptors desc(user_context, ctx.context);
+    int err = begin_convolution(user_context, stage, ctx.context, input, x_region, d_filter, dw_region,
+                                d_output, dy_region, stride, &stream, &handle, &desc, &compute_type);
+    if (err != 0) {
+        return err;
+    }
+    const int algo = CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1;
+    cudnnStatus_t status = cudnnGetConvolutionBackwardFilterWorkspaceSize(handle, desc.input, desc.output,
+                                                                          desc.convolution, desc.filter,
+                                                                          algo, &desc.workspace_size);
+    if (status == CUDNN_STATUS_SUCCESS) {
+        err = desc.allocate_workspace(stream);
+        if (err != 0) {
+            return err;
+        }
+        conv_scale scale(compute_type);
+        status = cudnnConvolutionBackwardFilter(handle, scale.alpha,
+                                                desc.input, (const void *)library_buffer_address(input, x_region.mins),
+                                                desc.output, (const void *)library_buffer_address(d_output, dy_region.mins),
+                                                desc.convolution, algo, desc.workspace, desc.workspace_size,
+                                                scale.beta,
+                                                desc.filter, (void *)library_buffer_address(d_filter, dw_region.mins));
+    }
+    return end_convolution(user_context, stage, status);
+}
+
+}  // extern "C"
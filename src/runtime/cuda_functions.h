@@ -12,6 +12,9 @@
 #ifndef CUDA_FN_3020
 #define CUDA_FN_3020(ret, fn, fn_3020, args) CUDA_FN(ret, fn, args)
 #endif
+#ifndef CUDA_FN_OPTIONAL_3020
+#define CUDA_FN_OPTIONAL_3020(ret, fn, fn_3020, args) CUDA_FN_OPTIONAL(ret, fn, args)
+#endif
 #ifndef CUDA_FN_4000
 #define CUDA_FN_4000(ret, fn, fn_4000, args) CUDA_FN(ret, fn, args)
 #endif
@@ -28,8 +31,13 @@ CUDA_FN(CUresult, cuProfilerStop, ());
 CUDA_FN(CUresult, cuCtxGetApiVersion, (CUcontext ctx, unsigned int *version));
 CUDA_FN(CUresult, cuModuleLoadData, (CUmodule *module, const void *image));
 CUDA_FN(CUresult, cuModuleLoadDataEx, (CUmodule *module, const void *image, unsigned int numOptions, CUjit_option* options, void** optionValues));
+CUDA_FN_OPTIONAL_3020(CUresult, cuLinkCreate, cuLinkCreate_v2, (unsigned int numOptions, CUjit_option *options, void **optionValues, CUlinkState *stateOut));
+CUDA_FN_OPTIONAL_3020(CUresult, cuLinkAddData, cuLinkAddData_v2, (CUlinkState state, CUjitInputType type, void *data, size_t size, const char *name, unsigned int numOptions, CUjit_option *options, void **optionValues));
+CUDA_FN_OPTIONAL(CUresult, cuLinkComplete, (CUlinkState state, void **cubinOut, size_t *sizeOut));
+CUDA_FN_OPTIONAL(CUresult, cuLinkDestroy, (CUlinkState state));
 CUDA_FN(CUresult, cuModuleUnload, (CUmodule module));
 CUDA_FN(CUresult, cuModuleGetFunction, (CUfunction *hfunc, CUmodule hmod, const char *name));
+CUDA_FN_3020(CUresult, cuModuleGetGlobal, cuModuleGetGlobal_v2, (CUdeviceptr *dptr, size_t *bytes, CUmodule hmod, const char *name));
 CUDA_FN_3020(CUresult, cuMemAlloc, cuMemAlloc_v2, (CUdeviceptr *dptr, size_t bytesize));
 CUDA_FN_3020(CUresult, cuMemFree, cuMemFree_v2, (CUdeviceptr dptr));
 CUDA_FN_3020(CUresult, cuMemcpyHtoD, cuMemcpyHtoD_v2, (CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount));
@@ -48,6 +56,7 @@ CUDA_FN(CUresult, cuLaunchKernel, (CUfunction f,
                                    void **kernelParams,
                                    void **extra));
 CUDA_FN(CUresult, cuCtxSynchronize, ());
+CUDA_FN(CUresult, cuCtxGetDevice, (CUdevice *device));
 
 CUDA_FN_4000(CUresult, cuCtxPushCurrent, cuCtxPushCurrent_v2, (CUcontext ctx));
 CUDA_FN_4000(CUresult, cuCtxPopCurrent, cuCtxPopCurrent_v2, (CUcontext *pctx));
@@ -55,8 +64,41 @@ CUDA_FN_4000(CUresult, cuCtxPopCurrent, cuCtxPopCurrent_v2, (CUcontext *pctx));
 CUDA_FN(CUresult, cuPointerGetAttribute, (void *result, int query, CUdeviceptr ptr));
 
 CUDA_FN_OPTIONAL(CUresult, cuStreamSynchronize, (CUstream hStream));
+CUDA_FN_OPTIONAL(CUresult, cuStreamWaitEvent, (CUstream hStream, CUevent hEvent, unsigned int Flags));
+
+CUDA_FN_OPTIONAL(CUresult, cuEventCreate, (CUevent *phEvent, unsigned int Flags));
+CUDA_FN_OPTIONAL(CUresult, cuEventDestroy, (CUevent hEvent));
+CUDA_FN_OPTIONAL(CUresult, cuEventRecord, (CUevent hEvent, CUstream hStream));
+CUDA_FN_OPTIONAL(CUresult, cuEventQuery, (CUevent hEvent));
+CUDA_FN_OPTIONAL(CUresult, cuEventSynchronize, (CUevent hEvent));
+CUDA_FN_OPTIONAL(CUresult, cuEventElapsedTime, (float *pMilliseconds, CUevent hStart, CUevent hEnd));
+
+CUDA_FN_OPTIONAL(CUresult, cuLaunchCooperativeKernel, (CUfunction f,
+                                                       unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
+                                                       unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+                                                       unsigned int sharedMemBytes, CUstream hStream, void **kernelParams));
+CUDA_FN_OPTIONAL(CUresult, cuOccupancyMaxActiveBlocksPerMultiprocessor, (int *numBlocks, CUfunction func, int blockSize, size_t dynamicSMemSize));
+CUDA_FN_OPTIONAL(CUresult, cuFuncGetAttribute, (int *pi, CUfunction_attribute attrib, CUfunction hfunc));
+CUDA_FN_OPTIONAL(CUresult, cuFuncSetAttribute, (CUfunction hfunc, CUfunction_attribute attrib, int value));
+
+CUDA_FN_OPTIONAL(CUresult, cuGraphCreate, (CUgraph *phGraph, unsigned int flags));
+CUDA_FN_OPTIONAL(CUresult, cuGraphAddKernelNode, (CUgraphNode *phGraphNode, CUgraph hGraph, const CUgraphNode *dependencies, size_t numDependencies, const CUDA_KERNEL_NODE_PARAMS *nodeParams));
+CUDA_FN_OPTIONAL(CUresult, cuGraphInstantiate, (CUgraphExec *phGraphExec, CUgraph hGraph, CUgraphNode *phErrorNode, char *logBuffer, size_t bufferSize));
+CUDA_FN_OPTIONAL(CUresult, cuGraphLaunch, (CUgraphExec hGraphExec, CUstream hStream));
+CUDA_FN_OPTIONAL(CUresult, cuGraphExecDestroy, (CUgraphExec hGraphExec));
+CUDA_FN_OPTIONAL(CUresult, cuGraphDestroy, (CUgraph hGraph));
+
+CUDA_FN_OPTIONAL(CUresult, cuMemAllocManaged, (CUdeviceptr *dptr, size_t bytesize, unsigned int flags));
+CUDA_FN_OPTIONAL(CUresult, cuMemPrefetchAsync, (CUdeviceptr devPtr, size_t count, CUdevice dstDevice, CUstream hStream));
+
+CUDA_FN_OPTIONAL(CUresult, cuMemHostAlloc, (void **pp, size_t bytesize, unsigned int Flags));
+CUDA_FN_OPTIONAL(CUresult, cuMemFreeHost, (void *p));
+CUDA_FN_OPTIONAL_3020(CUresult, cuMemcpyHtoDAsync, cuMemcpyHtoDAsync_v2, (CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount, CUstream hStream));
+CUDA_FN_OPTIONAL_3020(CUresult, cuMemcpyDtoHAsync, cuMemcpyDtoHAsync_v2, (void *dstHost, CUdeviceptr srcDevice, size_t ByteCount, CUstream hStream));
+CUDA_FN_OPTIONAL_3020(CUresult, cuMemcpyDtoDAsync, cuMemcpyDtoDAsync_v2, (CUdeviceptr dstDevice, CUdeviceptr srcDevice, size_t ByteCount, CUstream hStream));
 
 #undef CUDA_FN
 #undef CUDA_FN_OPTIONAL
 #undef CUDA_FN_3020
+#undef CUDA_FN_OPTIONAL_3020
 #undef CUDA_FN_4000
@@ -496,6 +496,8 @@ struct d3d12_library {
 struct d3d12_function {
     ID3DBlob *shaderBlob;
     ID3D12RootSignature *rootSignature;
+    // created on the first dispatch of the function, and kept for the next ones:
+    d3d12_pipeline_state *pipelineState;
 };
 
 enum ResourceBindingSlots {
@@ -642,11 +644,15 @@ void release_d3d12_object<d3d12_library>(d3d12_library *library) {
     d3d12_free(library);
 }
 
+template<>
+void release_d3d12_object<d3d12_compute_pipeline_state>(d3d12_compute_pipeline_state *pso);
+
 template<>
 void release_d3d12_object<d3d12_function>(d3d12_function *function) {
     TRACELOG;
     Release_ID3D12Object(function->shaderBlob);
     Release_ID3D12Object(function->rootSignature);
+    release_object(function->pipelineState);
     d3d12_free(function);
 }
 
@@ -1734,6 +1740,7 @@ static d3d12_function *new_function_with_name(d3d12_device *device, d3d12_librar
     function = malloct<d3d12_function>();
     function->shaderBlob = shaderBlob;
     function->rootSignature = rootSignature;
+    function->pipelineState = NULL;
     rootSignature->AddRef();
 
     // cache the compiled function for future use:
@@ -1910,6 +1917,251 @@ static void *buffer_contents(d3d12_buffer *buffer) {
     return pData;
 }
 
+// Kernel dispatches are recorded into a single open command list, which is
+// only submitted when the host needs their results: before a transfer, a
+// device sync, a free or a device release. Instead of a UAV barrier on
+// every buffer after every dispatch, a dispatch is preceded by UAV
+// barriers on the resources it shares with the dispatches recorded since
+// their last barrier. (Halide doesn't tell the runtime which buffers a
+// kernel writes, so any shared resource is taken to be a dependency.)
+static const int MaxPendingResources = 64;
+
+struct d3d12_batch {
+    d3d12_command_allocator *allocator;
+    d3d12_compute_command_list *cmdList;
+    ID3D12Resource *pending [MaxPendingResources];
+    int num_pending;
+};
+WEAK d3d12_batch batch = { };
+
+// The descriptor heap and the constant buffer of a dispatch, cached by the
+// views of the buffers and the values of the scalar arguments bound to it,
+// so that dispatching a kernel again on the same buffers (as multi-stage
+// pipelines do at every run) creates neither. Entries are never modified,
+// so dispatches recorded in the same batch can share them; they hold a
+// reference to the resources they view, and are evicted (least recently
+// used first) once the batch is submitted.
+static const int MaxCachedBindings = 64;
+
+struct d3d12_binding_key {
+    ID3D12Resource *resource;
+    UINT offset;
+    UINT elements;
+    DXGI_FORMAT format;
+};
+
+struct d3d12_binding {
+    d3d12_binder *binder;
+    d3d12_buffer args_buffer;
+    uint64_t last_used;
+    int num_buffers;
+    d3d12_binding_key buffers [16];     // ResourceBindingLimits[UAV]
+    size_t args_size;
+    uint8_t *args;                      // stored right after the structure
+    d3d12_binding *next;
+};
+WEAK d3d12_binding *bindings = NULL;
+WEAK int num_bindings = 0;
+WEAK uint64_t binding_clock = 0;
+
+WEAK d3d12_binding *find_binding(const d3d12_binding_key *buffers, int num_buffers,
+                                 const uint8_t *args, size_t args_size) {
+    TRACELOG;
+    for (d3d12_binding *b = bindings; b != NULL; b = b->next) {
+        if (b->num_buffers != num_buffers || b->args_size != args_size) {
+            continue;
+        }
+        bool same = (memcmp(b->args, args, args_size) == 0);
+        for (int i = 0; same && (i < num_buffers); ++i) {
+            same = (b->buffers[i].resource == buffers[i].resource) &&
+                   (b->buffers[i].offset   == buffers[i].offset)   &&
+                   (b->buffers[i].elements == buffers[i].elements) &&
+                   (b->buffers[i].format   == buffers[i].format);
+        }
+        if (same) {
+            b->last_used = ++binding_clock;
+            return b;
+        }
+    }
+    return NULL;
+}
+
+WEAK d3d12_binding *new_binding(d3d12_device *device, d3d12_buffer **buffers, int num_buffers,
+                                const uint8_t *args, size_t args_size) {
+    TRACELOG;
+    halide_assert(user_context, (num_buffers <= 16));
+    d3d12_binding *b = (d3d12_binding*)d3d12_malloc(sizeof(d3d12_binding) + args_size);
+    if (b == NULL) {
+        return NULL;
+    }
+    *b = zero_struct<d3d12_binding>();
+    b->binder = new_descriptor_binder(device);
+    if (b->binder == NULL) {
+        d3d12_free(b);
+        return NULL;
+    }
+    b->args = (uint8_t*)(b + 1);
+    b->args_size = args_size;
+    memcpy(b->args, args, args_size);
+
+    if (args_size > 0) {
+        // Direct3D 12 expects constant buffers to have sizes multiple of 256:
+        size_t constant_buffer_size = (args_size + 255) & ~255;
+        b->args_buffer = new_constant_buffer(device, constant_buffer_size);
+        if (!b->args_buffer) {
+            release_object(b->binder);
+            d3d12_free(b);
+            return NULL;
+        }
+        memcpy(buffer_contents(&b->args_buffer), args, args_size);
+        // always bind argument buffer at constant buffer binding 0
+        int32_t cb_index = 0;   // a.k.a. register(c0)
+        set_input_buffer(b->binder, &b->args_buffer, cb_index);
+    }
+
+    b->num_buffers = num_buffers;
+    for (int i = 0; i < num_buffers; ++i) {
+        set_input_buffer(b->binder, buffers[i], i);    // register(u#)
+        b->buffers[i].resource = buffers[i]->resource;
+        b->buffers[i].offset   = buffers[i]->offset;
+        b->buffers[i].elements = buffers[i]->elements;
+        b->buffers[i].format   = buffers[i]->format;
+        buffers[i]->resource->AddRef();
+    }
+
+    b->last_used = ++binding_clock;
+    b->next = bindings;
+    bindings = b;
+    ++num_bindings;
+    return b;
+}
+
+WEAK void release_binding(d3d12_binding *b) {
+    TRACELOG;
+    for (int i = 0; i < b->num_buffers; ++i) {
+        Release_ID3D12Object(b->buffers[i].resource);
+    }
+    release_object(&b->args_buffer);
+    release_object(b->binder);
+    d3d12_free(b);
+    --num_bindings;
+}
+
+// Release the least recently used bindings beyond 'capacity'. No recorded
+// dispatch may use them.
+WEAK void trim_bindings(int capacity) {
+    TRACELOG;
+    while (num_bindings > capacity) {
+        d3d12_binding **oldest = &bindings;
+        for (d3d12_binding **b = &bindings; *b != NULL; b = &(*b)->next) {
+            if ((*b)->last_used < (*oldest)->last_used) {
+                oldest = b;
+            }
+        }
+        d3d12_binding *evicted = *oldest;
+        *oldest = evicted->next;
+        release_binding(evicted);
+    }
+}
+
+// Release the bindings of a resource, if they hold its last references,
+// so that freeing a buffer frees its memory. No recorded dispatch may use
+// them.
+WEAK void forget_bindings(ID3D12Resource *resource) {
+    TRACELOG;
+    ULONG cached_refs = 0;
+    for (d3d12_binding *b = bindings; b != NULL; b = b->next) {
+        for (int i = 0; i < b->num_buffers; ++i) {
+            cached_refs += (b->buffers[i].resource == resource) ? 1 : 0;
+        }
+    }
+    if (cached_refs == 0) {
+        return;
+    }
+    resource->AddRef();
+    ULONG refs = resource->Release();
+    if (refs > cached_refs) {
+        return;     // e.g. the buffer was a crop
+    }
+    d3d12_binding **b = &bindings;
+    while (*b != NULL) {
+        bool uses = false;
+        for (int i = 0; i < (*b)->num_buffers; ++i) {
+            uses = uses || ((*b)->buffers[i].resource == resource);
+        }
+        if (uses) {
+            d3d12_binding *released = *b;
+            *b = released->next;
+            release_binding(released);
+        } else {
+            b = &(*b)->next;
+        }
+    }
+}
+
+WEAK d3d12_compute_command_list *begin_batch(d3d12_device *device) {
+    TRACELOG;
+    if (batch.cmdList != NULL) {
+        return batch.cmdList;
+    }
+    batch.allocator = new_command_allocator<HALIDE_D3D12_COMMAND_LIST_TYPE>(device);
+    if (batch.allocator == NULL) {
+        return NULL;
+    }
+    batch.cmdList = new_compute_command_list(device, batch.allocator);
+    if (batch.cmdList == NULL) {
+        release_object(batch.allocator);
+        batch.allocator = NULL;
+    }
+    batch.num_pending = 0;
+    return batch.cmdList;
+}
+
+// Place UAV barriers between the dispatches recorded so far and a dispatch
+// on the given buffers, where they share resources, and record that the
+// latter uses them.
+WEAK void order_dispatch(d3d12_compute_command_list *cmdList, d3d12_buffer **buffers, int num_buffers) {
+    TRACELOG;
+    for (int i = 0; i < num_buffers; ++i) {
+        ID3D12Resource *resource = buffers[i]->resource;
+        for (int j = 0; j < batch.num_pending; ++j) {
+            if (batch.pending[j] == resource) {
+                compute_barrier(cmdList, buffers[i]);
+                batch.pending[j] = batch.pending[--batch.num_pending];
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < num_buffers; ++i) {
+        if (batch.num_pending == MaxPendingResources) {
+            // too many resources in flight to track: wait for all of them
+            D3D12_RESOURCE_BARRIER barrier = { };
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            barrier.UAV.pResource = NULL;
+            (*cmdList)->ResourceBarrier(1, &barrier);
+            batch.num_pending = 0;
+        }
+        batch.pending[batch.num_pending++] = buffers[i]->resource;
+    }
+}
+
+// Submit the recorded dispatches and wait for them to complete.
+WEAK void flush_batch() {
+    TRACELOG;
+    if (batch.cmdList == NULL) {
+        return;
+    }
+    commit_command_list(batch.cmdList);
+    wait_until_completed(batch.cmdList);
+    release_object(batch.cmdList);
+    release_object(batch.allocator);
+    batch.cmdList = NULL;
+    batch.allocator = NULL;
+    batch.num_pending = 0;
+    trim_bindings(MaxCachedBindings);
+}
+
 volatile int WEAK thread_lock = 0;
 
 // Structure to hold the state of a module attached to the context.
@@ -2201,6 +2453,9 @@ inline void halide_d3d12compute_device_sync_internal(d3d12_device *device, struc
     // use the main compute queue and issue copies via compute command lists.
     //static const D3D12_COMMAND_LIST_TYPE Type = D3D12_COMMAND_LIST_TYPE_COPY;
 
+    // the transfer must see the results of the dispatches recorded so far:
+    flush_batch();
+
     static const D3D12_COMMAND_LIST_TYPE Type = HALIDE_D3D12_COMMAND_LIST_TYPE;
     d3d12_command_allocator *sync_command_allocator = new_command_allocator<Type>(device);
     d3d12_compute_command_list *blitCmdList = new_command_list<Type>(device, sync_command_allocator);
@@ -2267,6 +2522,7 @@ WEAK int halide_d3d12compute_device_release(void *user_context) {
 
     if (device) {
         halide_d3d12compute_device_sync_internal(device, NULL);
+        trim_bindings(0);
 
         // Unload the modules attached to this device. Note that the list
         // nodes themselves are not freed, only the program objects are
@@ -2438,18 +2694,6 @@ WEAK int halide_d3d12compute_run(void *user_context,
     StartCapturingGPUActivity();
     #endif
 
-    d3d12_command_allocator *command_allocator = new_command_allocator<HALIDE_D3D12_COMMAND_LIST_TYPE>(device);
-    if (command_allocator == 0) {
-        d3d12_halt("D3D12Compute: Could not create compute command allocator.");
-        return -1;
-    }
-
-    d3d12_compute_command_list *cmdList = new_compute_command_list(device, command_allocator);
-    if (cmdList == 0) {
-        d3d12_halt("D3D12Compute: Could not create compute command list.");
-        return -1;
-    }
-
     halide_assert(user_context, state_ptr);
     module_state *state = (module_state*)state_ptr;
 
@@ -2457,15 +2701,13 @@ WEAK int halide_d3d12compute_run(void *user_context,
                                                       shared_mem_bytes, threadsX, threadsY, threadsZ);
     halide_assert(user_context, function);
 
-    // prepare buffer resource binding:
-    d3d12_binder *binder = new_descriptor_binder(device);
-    d3d12_compute_pipeline_state *pipeline_state = new_compute_pipeline_state_with_function(d3d12_context.device, function);
-    if (pipeline_state == 0) {
-        d3d12_halt("D3D12Compute: Could not allocate pipeline state.");
-        release_object(function);
-        return -1;
+    if (function->pipelineState == NULL) {
+        function->pipelineState = new_compute_pipeline_state_with_function(device, function);
+        if (function->pipelineState == NULL) {
+            d3d12_halt("D3D12Compute: Could not allocate pipeline state.");
+            return -1;
+        }
     }
-    set_compute_pipeline_state(cmdList, pipeline_state, function, binder);
 
     // pack all non-buffer arguments into a single "constant" allocation block:
     size_t total_args_size = 0;
@@ -2486,73 +2728,82 @@ WEAK int halide_d3d12compute_run(void *user_context,
         total_args_size = (total_args_size + argsize - 1) & ~(argsize - 1);
         total_args_size += argsize;
     }
-    d3d12_buffer args_buffer = { };
-    if (total_args_size > 0) {
-        // Direct3D 12 expects constant buffers to have sizes multiple of 256:
-        size_t constant_buffer_size = (total_args_size + 255) & ~255;
-        args_buffer = new_constant_buffer(d3d12_context.device, constant_buffer_size);
-        if (!args_buffer) {
-            d3d12_halt("D3D12Compute: Could not allocate arguments buffer.");
-            release_object(function);
-            return -1;
+    uint8_t *args_ptr = (uint8_t*)__builtin_alloca(total_args_size);
+    size_t offset = 0;
+    for (size_t i = 0; arg_sizes[i] != 0; i++) {
+        if (arg_is_buffer[i]) {
+            continue;
         }
-        uint8_t *args_ptr = (uint8_t*)buffer_contents(&args_buffer);
-        size_t offset = 0;
-        for (size_t i = 0; arg_sizes[i] != 0; i++) {
-            if (arg_is_buffer[i]) {
-                continue;
-            }
-            halide_assert(user_context, arg_sizes[i] <= 4);
-            union {
-                void     *p;
-                float    *f;
-                uint8_t  *b;
-                uint16_t *s;
-                uint32_t *i;
-            } arg;
-            arg.p = args[i];
-            size_t argsize = 4;
-            uint32_t val = 0;
-            switch (arg_sizes[i]) {
-                case 1 : val = *arg.b; break;
-                case 2 : val = *arg.s; break;
-                case 4 : val = *arg.i; break;
-                default: halide_assert(user_context, false); break;
-            }
-            memcpy(&args_ptr[offset], &val, argsize);
-            offset = (offset + argsize - 1) & ~(argsize - 1);
-            offset += argsize;
-            TRACEPRINT(
-                ">>> arg " << (int)i << " has size " << (int)arg_sizes[i] << " : "
-                "float("  << *arg.f << ") or "
-                "uint32(" << *arg.i << ") or "
-                "int32("  << (int32_t&)*arg.i << ")\n"
-            );
+        halide_assert(user_context, arg_sizes[i] <= 4);
+        union {
+            void     *p;
+            float    *f;
+            uint8_t  *b;
+            uint16_t *s;
+            uint32_t *i;
+        } arg;
+        arg.p = args[i];
+        size_t argsize = 4;
+        uint32_t val = 0;
+        switch (arg_sizes[i]) {
+            case 1 : val = *arg.b; break;
+            case 2 : val = *arg.s; break;
+            case 4 : val = *arg.i; break;
+            default: halide_assert(user_context, false); break;
         }
-        halide_assert(user_context, offset == total_args_size);
-    }
-
-    // setup/bind the argument buffer:
-    if (args_buffer) {
-        // always bind argument buffer at constant buffer binding 0
-        int32_t cb_index = 0;   // a.k.a. register(c0)
-        set_input_buffer(binder, &args_buffer, cb_index);
+        memcpy(&args_ptr[offset], &val, argsize);
+        offset = (offset + argsize - 1) & ~(argsize - 1);
+        offset += argsize;
+        TRACEPRINT(
+            ">>> arg " << (int)i << " has size " << (int)arg_sizes[i] << " : "
+            "float("  << *arg.f << ") or "
+            "uint32(" << *arg.i << ") or "
+            "int32("  << (int32_t&)*arg.i << ")\n"
+        );
     }
+    halide_assert(user_context, offset == total_args_size);
 
-    // setup/bind actual buffers:
-    int32_t uav_index = 0;
+    // gather the actual buffers, in binding order:
+    d3d12_buffer *buffers [16];
+    d3d12_binding_key keys [16];
+    int num_buffers = 0;
     for (size_t i = 0; arg_sizes[i] != 0; i++) {
         if (!arg_is_buffer[i]) {
             continue;
         }
         halide_assert(user_context, arg_sizes[i] == sizeof(uint64_t));
+        halide_assert(user_context, num_buffers < 16);
         halide_buffer_t *hbuffer = (halide_buffer_t*)args[i];
         uint64_t handle = hbuffer->device;
         d3d12_buffer *buffer = reinterpret_cast<d3d12_buffer*>(handle);
-        set_input_buffer(binder, buffer, uav_index);    // register(u#)
-        uav_index++;
+        buffers[num_buffers] = buffer;
+        keys[num_buffers].resource = buffer->resource;
+        keys[num_buffers].offset   = buffer->offset;
+        keys[num_buffers].elements = buffer->elements;
+        keys[num_buffers].format   = buffer->format;
+        num_buffers++;
+    }
+
+    // setup/bind the argument buffer and the actual buffers, or reuse the
+    // descriptors of an earlier dispatch on the same ones:
+    d3d12_binding *binding = find_binding(keys, num_buffers, args_ptr, total_args_size);
+    if (binding == NULL) {
+        binding = new_binding(device, buffers, num_buffers, args_ptr, total_args_size);
+        if (binding == NULL) {
+            d3d12_halt("D3D12Compute: Could not allocate resource bindings.");
+            return -1;
+        }
+    }
+
+    d3d12_compute_command_list *cmdList = begin_batch(device);
+    if (cmdList == 0) {
+        d3d12_halt("D3D12Compute: Could not create compute command list.");
+        return -1;
     }
 
+    order_dispatch(cmdList, buffers, num_buffers);
+    set_compute_pipeline_state(cmdList, function->pipelineState, function, binding->binder);
+
     #if HALIDE_D3D12_PROFILING
     d3d12_profiler *profiler = new_profiler(device, 8);
     begin_profiling(cmdList, profiler);
@@ -2567,27 +2818,13 @@ WEAK int halide_d3d12compute_run(void *user_context,
     #if HALIDE_D3D12_PROFILING
     size_t end = request_timestamp_checkpoint(cmdList, profiler);
     end_profiling(cmdList, profiler);
+    // the timestamps are only available once the dispatch has completed:
+    flush_batch();
     #endif
 
-    // TODO(marcos): avoid placing UAV barriers all the time after a dispatch...
-    // in fact, only buffers written to by the dispatch will need barriers, and
-    // only when later bound for read. For now, Halide does not provide enough
-    // context for chosing the right time to place transition barriers.
-    for (size_t i = 0; arg_sizes[i] != 0; i++) {
-        if (!arg_is_buffer[i]) {
-            continue;
-        }
-        halide_buffer_t *hbuffer = (halide_buffer_t*)args[i];
-        uint64_t handle = hbuffer->device;
-        d3d12_buffer *buffer = reinterpret_cast<d3d12_buffer*>(handle);
-        compute_barrier(cmdList, buffer);
-    }
-
-    commit_command_list(cmdList);
-
-    wait_until_completed(cmdList);
-
     #if HALIDE_D3D12_RENDERDOC
+    // the capture has to contain the dispatch:
+    flush_batch();
     FinishCapturingGPUActivity();
     TRACEPRINT("<<< RenderDoc Capture Ended\n");
     #endif
@@ -2600,12 +2837,6 @@ WEAK int halide_d3d12compute_run(void *user_context,
     release_object(profiler);
     #endif
 
-    release_object(cmdList);
-    release_object(command_allocator);
-    release_object(&args_buffer);
-    release_object(pipeline_state);
-    release_object(binder);
-
     #ifdef DEBUG_RUNTIME
     uint64_t t_after = halide_current_time_ns(user_context);
     debug(user_context) << TRACEINDENT << "Time for halide_d3d12compute_device_run: " << (t_after - t_before) / 1.0e6 << " ms\n";
@@ -2766,7 +2997,16 @@ WEAK int halide_d3d12compute_detach_buffer(void *user_context, struct halide_buf
         return 0;
     }
 
+    D3D12ContextHolder d3d12_context(user_context, true);
+    if (d3d12_context.error != 0) {
+        return d3d12_context.error;
+    }
+
+    // recorded dispatches may still use the buffer:
+    flush_batch();
+
     d3d12_buffer *dbuffer = reinterpret_cast<d3d12_buffer*>(buf->device);
+    ID3D12Resource *pResource = dbuffer->resource;
     unwrap_buffer(buf);
 
     // it is safe to simply call release_d3d12_object() here:
@@ -2776,6 +3016,8 @@ WEAK int halide_d3d12compute_detach_buffer(void *user_context, struct halide_buf
     // if 'buf' holds an internally managed resource, it will either be freed
     // or have its reference count decreased (when 'buf' is a device_crop).
     release_d3d12_object(dbuffer);
+    // the cached bindings may hold the last references to the resource:
+    forget_bindings(pResource);
 
     return 0;
 }
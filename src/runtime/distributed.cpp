@@ -0,0 +1,221 @@
+#include "HalideRuntime.h"
+#include "printer.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK int single_rank(void *user_context) {
+    return 0;
+}
+
+WEAK int single_rank_count(void *user_context) {
+    return 1;
+}
+
+WEAK int no_send(void *user_context, int dst_rank, const void *data, size_t size) {
+    halide_error(user_context, "The default distributed transport can't send anything\n");
+    return halide_error_code_generic_error;
+}
+
+WEAK int no_recv(void *user_context, int src_rank, void *data, size_t size) {
+    halide_error(user_context, "The default distributed transport can't receive anything\n");
+    return halide_error_code_generic_error;
+}
+
+WEAK halide_distributed_transport_t default_distributed_transport = {
+    single_rank, single_rank_count, no_send, no_recv
+};
+
+WEAK const halide_distributed_transport_t *distributed_transport = &default_distributed_transport;
+
+const int max_exchange_dimensions = 16;
+
+// What each rank tells the others about a buffer before exchanging it:
+// the owned and required ranges along the distributed dimension, and
+// the bounds of the buffer.
+struct exchange_header {
+    int32_t owned_min, owned_extent;
+    int32_t required_min, required_extent;
+    int32_t dimensions;
+    int32_t min[max_exchange_dimensions];
+    int32_t extent[max_exchange_dimensions];
+};
+
+// The part of the buffer of the sender that the receiver needs: what
+// the sender owns along dim, and has in the other dimensions,
+// intersected with what the receiver requires along dim, and has in the
+// other dimensions. Returns the number of elements.
+WEAK int64_t transfer_box(const exchange_header &sender, const exchange_header &receiver,
+                          int dim, int32_t *box_min, int32_t *box_extent) {
+    int64_t elements = 1;
+    for (int i = 0; i < sender.dimensions; i++) {
+        int32_t s_min = sender.min[i], s_max = sender.min[i] + sender.extent[i];
+        int32_t r_min = receiver.min[i], r_max = receiver.min[i] + receiver.extent[i];
+        if (i == dim) {
+            s_min = max(s_min, sender.owned_min);
+            s_max = min(s_max, sender.owned_min + sender.owned_extent);
+            r_min = max(r_min, receiver.required_min);
+            r_max = min(r_max, receiver.required_min + receiver.required_extent);
+        }
+        box_min[i] = max(s_min, r_min);
+        box_extent[i] = max(min(s_max, r_max) - box_min[i], 0);
+        elements *= box_extent[i];
+    }
+    return elements;
+}
+
+// Copy a box of a buffer to or from a packed array, in the order of the
+// dimensions of the buffer.
+WEAK void copy_box(halide_buffer_t *buf, const int32_t *box_min, const int32_t *box_extent,
+                   int64_t elements, uint8_t *packed, bool pack) {
+    const size_t elem_size = buf->type.bytes();
+    int32_t pos[max_exchange_dimensions];
+    for (int i = 0; i < buf->dimensions; i++) {
+        pos[i] = box_min[i];
+    }
+    for (int64_t n = 0; n < elements; n++) {
+        int64_t offset = 0;
+        for (int i = 0; i < buf->dimensions; i++) {
+            offset += (int64_t)(pos[i] - buf->dim[i].min) * buf->dim[i].stride;
+        }
+        uint8_t *elem = buf->host + offset * elem_size;
+        if (pack) {
+            memcpy(packed + n * elem_size, elem, elem_size);
+        } else {
+            memcpy(elem, packed + n * elem_size, elem_size);
+        }
+        for (int i = 0; i < buf->dimensions; i++) {
+            if (++pos[i] < box_min[i] + box_extent[i]) {
+                break;
+            }
+            pos[i] = box_min[i];
+        }
+    }
+}
+
+// Send the part of buf that the peer requires, or receive the part of
+// buf that the peer owns.
+WEAK int transfer(void *user_context, halide_buffer_t *buf, int dim, int peer,
+                  const exchange_header &sender, const exchange_header &receiver, bool send) {
+    int32_t box_min[max_exchange_dimensions], box_extent[max_exchange_dimensions];
+    int64_t elements = transfer_box(sender, receiver, dim, box_min, box_extent);
+    if (elements == 0) {
+        return 0;
+    }
+    size_t size = elements * buf->type.bytes();
+    uint8_t *packed = (uint8_t *)halide_malloc(user_context, size);
+    if (packed == NULL) {
+        return halide_error_code_out_of_memory;
+    }
+    int result;
+    if (send) {
+        copy_box(buf, box_min, box_extent, elements, packed, true);
+        result = distributed_transport->send(user_context, peer, packed, size);
+    } else {
+        result = distributed_transport->recv(user_context, peer, packed, size);
+        if (result == 0) {
+            copy_box(buf, box_min, box_extent, elements, packed, false);
+        }
+    }
+    halide_free(user_context, packed);
+    return result;
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK const halide_distributed_transport_t *
+halide_set_distributed_transport(const halide_distributed_transport_t *transport) {
+    const halide_distributed_transport_t *result = distributed_transport;
+    distributed_transport = transport ? transport : &default_distributed_transport;
+    return result;
+}
+
+WEAK int halide_distributed_exchange(void *user_context, halide_buffer_t *buf, int dim,
+                                     int required_min, int required_extent,
+                                     int owned_min, int owned_extent) {
+    const int rank = distributed_transport->rank(user_context);
+    const int num_ranks = distributed_transport->num_ranks(user_context);
+    if (num_ranks <= 1) {
+        return 0;
+    }
+    if (buf->dimensions > max_exchange_dimensions) {
+        error(user_context) << "Can't exchange the halos of a buffer with "
+                            << buf->dimensions << " dimensions\n";
+        return halide_error_code_generic_error;
+    }
+    if (buf->device_dirty()) {
+        int result = halide_copy_to_host(user_context, buf);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    exchange_header mine;
+    memset(&mine, 0, sizeof(mine));
+    mine.owned_min = owned_min;
+    mine.owned_extent = owned_extent;
+    mine.required_min = required_min;
+    mine.required_extent = required_extent;
+    mine.dimensions = buf->dimensions;
+    for (int i = 0; i < buf->dimensions; i++) {
+        mine.min[i] = buf->dim[i].min;
+        mine.extent[i] = buf->dim[i].extent;
+    }
+
+    // Every rank goes through its peers in increasing order, and the
+    // lower rank of each pair sends first, so the pairs are visited in
+    // the same order by both of their ranks, and blocking sends don't
+    // deadlock.
+    bool received = false;
+    for (int peer = 0; peer < num_ranks; peer++) {
+        if (peer == rank) {
+            continue;
+        }
+        exchange_header theirs;
+        int result;
+        if (rank < peer) {
+            result = distributed_transport->send(user_context, peer, &mine, sizeof(mine));
+            if (result == 0) {
+                result = distributed_transport->recv(user_context, peer, &theirs, sizeof(theirs));
+            }
+        } else {
+            result = distributed_transport->recv(user_context, peer, &theirs, sizeof(theirs));
+            if (result == 0) {
+                result = distributed_transport->send(user_context, peer, &mine, sizeof(mine));
+            }
+        }
+        if (result == 0 && theirs.dimensions != mine.dimensions) {
+            error(user_context) << "Rank " << peer << " has a buffer with " << theirs.dimensions
+                                << " dimensions instead of " << mine.dimensions << "\n";
+            result = halide_error_code_generic_error;
+        }
+        if (result != 0) {
+            return result;
+        }
+
+        if (rank < peer) {
+            result = transfer(user_context, buf, dim, peer, mine, theirs, true);
+            if (result == 0) {
+                result = transfer(user_context, buf, dim, peer, theirs, mine, false);
+            }
+        } else {
+            result = transfer(user_context, buf, dim, peer, theirs, mine, false);
+            if (result == 0) {
+                result = transfer(user_context, buf, dim, peer, mine, theirs, true);
+            }
+        }
+        if (result != 0) {
+            return result;
+        }
+        received = true;
+    }
+    if (received) {
+        buf->set_host_dirty(true);
+    }
+    return 0;
+}
+
+}  // extern "C"
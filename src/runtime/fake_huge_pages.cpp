@@ -0,0 +1,13 @@
+#include "HalideRuntime.h"
+#include "huge_pages.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK void *map_huge_pages(size_t bytes, bool use_reserved) {
+    return NULL;
+}
+
+WEAK void unmap_huge_pages(void *ptr, size_t bytes) {
+}
+
+}}}  // namespace Halide::Runtime::Internal
@@ -0,0 +1,19 @@
+#include "HalideRuntime.h"
+#include "hardware_counters.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK bool start_hardware_counters() {
+    return false;
+}
+
+WEAK void read_hardware_counters(uint64_t *counts) {
+    for (int i = 0; i < num_hardware_counters; i++) {
+        counts[i] = 0;
+    }
+}
+
+WEAK void stop_hardware_counters() {
+}
+
+}}}  // namespace Halide::Runtime::Internal
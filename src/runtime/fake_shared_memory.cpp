@@ -0,0 +1,13 @@
+#include "HalideRuntime.h"
+#include "shared_memory.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK void *map_shared_file(const char *path, size_t *bytes) {
+    return NULL;
+}
+
+WEAK void unmap_shared_file(void *ptr, size_t bytes) {
+}
+
+}}}  // namespace Halide::Runtime::Internal
@@ -51,6 +51,20 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+WEAK halide_thread_pool *halide_create_thread_pool(void *user_context, int num_threads,
+                                                   int priority) {
+    // Tasks always run on the calling thread.
+    halide_error(user_context, "halide_create_thread_pool not implemented on this platform.");
+    return NULL;
+}
+
+WEAK void halide_destroy_thread_pool(void *user_context, halide_thread_pool *pool) {
+}
+
+WEAK halide_thread_pool *halide_get_thread_pool(void *user_context) {
+    return NULL;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -73,4 +87,61 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
   return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+WEAK int halide_do_par_for_chunked(void *user_context, halide_task_t f,
+                                   int min, int size, uint8_t *closure,
+                                   int policy, int chunk) {
+    return halide_do_par_for(user_context, f, min, size, closure);
+}
+
+WEAK int halide_do_concurrent_tasks(void *user_context, halide_task_t f,
+                                    int min, int size, uint8_t *closure) {
+    // Running the tasks one after the other could deadlock.
+    halide_error(user_context, "halide_do_concurrent_tasks not implemented on this platform.");
+    return halide_error_code_generic_error;
+}
+
+WEAK int halide_do_async_call(void *user_context, int (*f)(void **), void **args,
+                              halide_async_callback_t callback, void *callback_context) {
+    // There are no workers to run it later.
+    callback(callback_context, f(args));
+    return 0;
+}
+
+// There is no thread pool to record.
+WEAK int halide_thread_pool_timeline_start(void *user_context, int events_per_thread) {
+    halide_error(user_context, "halide_thread_pool_timeline_start not implemented on this platform.");
+    return halide_error_code_generic_error;
+}
+
+WEAK void halide_thread_pool_timeline_stop() {
+}
+
+WEAK int halide_thread_pool_timeline_save(void *user_context, const char *filename) {
+    halide_error(user_context, "halide_thread_pool_timeline_save not implemented on this platform.");
+    return halide_error_code_generic_error;
+}
+
+// Without threads, nothing else can release a semaphore while we
+// wait, so acquiring fails if the count is too low.
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    s->_private[0] = n;
+    return n;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    s->_private[0] += n;
+    return (int)s->_private[0];
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    if ((int)s->_private[0] < n) {
+        return halide_error_code_generic_error;
+    }
+    s->_private[0] -= n;
+    return 0;
+}
+
+WEAK void halide_semaphore_poison(void *user_context, void *s) {
+}
+
 }  // extern "C"
@@ -0,0 +1,32 @@
+#ifndef HALIDE_RUNTIME_HARDWARE_COUNTERS_H
+#define HALIDE_RUNTIME_HARDWARE_COUNTERS_H
+
+#include "HalideRuntime.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Hardware performance counters sampled by the profiler, counted over
+// all the threads of the process. They are implemented on x86 Linux with
+// perf_event (linux_perf_counters.cpp), and stubbed out elsewhere
+// (fake_perf_counters.cpp).
+enum {
+    hardware_counter_cycles,
+    hardware_counter_instructions,
+    hardware_counter_llc_misses,
+    hardware_counter_vector_instructions,
+    num_hardware_counters
+};
+
+// Start counting if HL_PROFILER_COUNTERS is set. Returns whether any
+// thread is being counted.
+WEAK bool start_hardware_counters();
+
+// Get the totals of the counters since they were started. Counters that
+// couldn't be opened stay at zero.
+WEAK void read_hardware_counters(uint64_t *counts);
+
+WEAK void stop_hardware_counters();
+
+}}}  // namespace Halide::Runtime::Internal
+
+#endif
@@ -4,6 +4,7 @@
 #include "HalideRuntimeHexagonHost.h"
 #include "printer.h"
 #include "scoped_mutex_lock.h"
+#include "scoped_spin_lock.h"
 
 namespace Halide { namespace Runtime { namespace Internal { namespace Hexagon {
 
@@ -165,6 +166,96 @@ struct module_state {
 WEAK module_state *state_list = NULL;
 WEAK halide_hexagon_handle_t shared_runtime = 0;
 
+// An ION buffer freed by Halide, kept for reuse. Allocating ION
+// buffers and mapping them for the DSP is expensive, and pipelines
+// run once per frame tend to allocate the same sizes each time.
+struct cached_ion_buffer {
+    void *ion;
+    size_t size;
+    cached_ion_buffer *next;
+};
+
+WEAK cached_ion_buffer *cached_ion_buffers = NULL;
+// This spinlock protects the above list.
+volatile int WEAK cached_ion_buffers_lock = 0;
+
+// Take the smallest cached buffer of at least size bytes, and at most
+// twice that, out of the cache. Returns NULL if there isn't one.
+WEAK void *take_cached_ion_buffer(size_t size, size_t *cached_size) {
+    ScopedSpinLock spinlock(&cached_ion_buffers_lock);
+    cached_ion_buffer **found_prev = NULL;
+    for (cached_ion_buffer **prev = &cached_ion_buffers; *prev; prev = &(*prev)->next) {
+        cached_ion_buffer *b = *prev;
+        if (b->size < size || b->size > 2 * size) {
+            continue;
+        }
+        if (found_prev == NULL || b->size < (*found_prev)->size) {
+            found_prev = prev;
+        }
+    }
+    if (found_prev == NULL) {
+        return NULL;
+    }
+    cached_ion_buffer *found = *found_prev;
+    *found_prev = found->next;
+    void *ion = found->ion;
+    *cached_size = found->size;
+    free(found);
+    return ion;
+}
+
+WEAK void cache_ion_buffer(void *user_context, void *ion, size_t size) {
+    cached_ion_buffer *b = (cached_ion_buffer *)malloc(sizeof(cached_ion_buffer));
+    if (b == NULL) {
+        debug(user_context) << "    host_free ion=" << ion << "\n";
+        host_free(ion);
+        return;
+    }
+    debug(user_context) << "    caching ion=" << ion << "\n";
+    b->ion = ion;
+    b->size = size;
+    ScopedSpinLock spinlock(&cached_ion_buffers_lock);
+    b->next = cached_ion_buffers;
+    cached_ion_buffers = b;
+}
+
+WEAK void release_cached_ion_buffers(void *user_context) {
+    cached_ion_buffer *released;
+    {
+        ScopedSpinLock spinlock(&cached_ion_buffers_lock);
+        released = cached_ion_buffers;
+        cached_ion_buffers = NULL;
+    }
+    while (released) {
+        cached_ion_buffer *next = released->next;
+        debug(user_context) << "    host_free ion=" << released->ion << "\n";
+        host_free(released->ion);
+        free(released);
+        released = next;
+    }
+}
+
+// The host keeps its own count of the requests to power HVX on, so
+// that only the first power on and the last power off make a remote
+// call. It also remembers the last performance vote, so that voting
+// again for the same settings (e.g. once per frame) is free.
+WEAK halide_mutex power_lock = { { 0 } };
+WEAK int power_ref_count = 0;
+WEAK int current_performance_mode = -1;
+WEAK bool has_current_performance = false;
+WEAK halide_hexagon_power_t current_performance;
+
+WEAK bool same_performance(const halide_hexagon_power_t &a, const halide_hexagon_power_t &b) {
+    return (a.set_mips == b.set_mips &&
+            a.mipsPerThread == b.mipsPerThread &&
+            a.mipsTotal == b.mipsTotal &&
+            a.set_bus_bw == b.set_bus_bw &&
+            a.bwMegabytesPerSec == b.bwMegabytesPerSec &&
+            a.busbwUsagePercentage == b.busbwUsagePercentage &&
+            a.set_latency == b.set_latency &&
+            a.latency == b.latency);
+}
+
 }}}}  // namespace Halide::Runtime::Internal::Hexagon
 
 using namespace Halide::Runtime::Internal;
@@ -419,6 +510,16 @@ WEAK int halide_hexagon_device_release(void *user_context) {
         shared_runtime = 0;
     }
 
+    release_cached_ion_buffers(user_context);
+
+    return 0;
+}
+
+WEAK int halide_hexagon_release_unused_device_allocations(void *user_context) {
+    debug(user_context)
+        << "Hexagon: halide_hexagon_release_unused_device_allocations (user_context: "
+        << user_context << ")\n";
+    release_cached_ion_buffers(user_context);
     return 0;
 }
 
@@ -464,12 +565,24 @@ WEAK int halide_hexagon_device_malloc(void *user_context, halide_buffer_t *buf)
 
     void *ion;
     if (size >= min_ion_allocation_size) {
-        debug(user_context) << "    host_malloc len=" << (uint64_t)size << " -> ";
-        ion = host_malloc(size);
-        debug(user_context) << "        " << ion << "\n";
-        if (!ion) {
-            error(user_context) << "host_malloc failed\n";
-            return -1;
+        size_t cached_size = 0;
+        ion = take_cached_ion_buffer(size, &cached_size);
+        if (ion) {
+            debug(user_context) << "    reusing ion=" << ion << "\n";
+            size = cached_size;
+        } else {
+            debug(user_context) << "    host_malloc len=" << (uint64_t)size << " -> ";
+            ion = host_malloc(size);
+            if (!ion) {
+                // Give the cached buffers back and try again.
+                release_cached_ion_buffers(user_context);
+                ion = host_malloc(size);
+            }
+            debug(user_context) << "        " << ion << "\n";
+            if (!ion) {
+                error(user_context) << "host_malloc failed\n";
+                return -1;
+            }
         }
     } else {
         debug(user_context) << "    halide_malloc size=" << (uint64_t)size << " -> ";
@@ -484,7 +597,7 @@ WEAK int halide_hexagon_device_malloc(void *user_context, halide_buffer_t *buf)
     int err = halide_hexagon_wrap_device_handle(user_context, buf, ion, size);
     if (err != 0) {
         if (size >= min_ion_allocation_size) {
-            host_free(ion);
+            cache_ion_buffer(user_context, ion, size);
         } else {
             halide_free(user_context, ion);
         }
@@ -519,8 +632,7 @@ WEAK int halide_hexagon_device_free(void *user_context, halide_buffer_t* buf) {
     void *ion = halide_hexagon_get_device_handle(user_context, buf);
     halide_hexagon_detach_device_handle(user_context, buf);
     if (size >= min_ion_allocation_size) {
-        debug(user_context) << "    host_free ion=" << ion << "\n";
-        host_free(ion);
+        cache_ion_buffer(user_context, ion, size);
     } else {
         debug(user_context) << "    halide_free ion=" << ion << "\n";
         halide_free(user_context, ion);
@@ -721,6 +833,13 @@ WEAK int halide_hexagon_power_hvx_on(void *user_context) {
         return 0;
     }
 
+    ScopedMutexLock lock(&power_lock);
+    if (power_ref_count > 0) {
+        // HVX is already powered on.
+        power_ref_count++;
+        return 0;
+    }
+
     #ifdef DEBUG_RUNTIME
     uint64_t t_before = halide_current_time_ns(user_context);
     #endif
@@ -732,6 +851,7 @@ WEAK int halide_hexagon_power_hvx_on(void *user_context) {
         error(user_context) << "remote_power_hvx_on failed.\n";
         return result;
     }
+    power_ref_count++;
 
     #ifdef DEBUG_RUNTIME
     uint64_t t_after = halide_current_time_ns(user_context);
@@ -752,6 +872,16 @@ WEAK int halide_hexagon_power_hvx_off(void *user_context) {
         return 0;
     }
 
+    ScopedMutexLock lock(&power_lock);
+    if (power_ref_count == 0) {
+        // Unbalanced; HVX isn't powered on by us.
+        return 0;
+    } else if (power_ref_count > 1) {
+        // Someone else still wants HVX on.
+        power_ref_count--;
+        return 0;
+    }
+
     #ifdef DEBUG_RUNTIME
     uint64_t t_before = halide_current_time_ns(user_context);
     #endif
@@ -763,6 +893,7 @@ WEAK int halide_hexagon_power_hvx_off(void *user_context) {
         error(user_context) << "remote_power_hvx_off failed.\n";
         return result;
     }
+    power_ref_count--;
 
     #ifdef DEBUG_RUNTIME
     uint64_t t_after = halide_current_time_ns(user_context);
@@ -786,6 +917,12 @@ WEAK int halide_hexagon_set_performance_mode(void *user_context, halide_hexagon_
         return 0;
     }
 
+    ScopedMutexLock lock(&power_lock);
+    if (current_performance_mode == (int)mode) {
+        debug(user_context) << "    already voted for mode " << (int)mode << "\n";
+        return 0;
+    }
+
     debug(user_context) << "    remote_set_performance_mode -> ";
     result = remote_set_performance_mode(mode);
     debug(user_context) << "        " << result << "\n";
@@ -793,6 +930,8 @@ WEAK int halide_hexagon_set_performance_mode(void *user_context, halide_hexagon_
         error(user_context) << "remote_set_performance_mode failed.\n";
         return result;
     }
+    current_performance_mode = mode;
+    has_current_performance = false;
 
     return 0;
 }
@@ -807,6 +946,12 @@ WEAK int halide_hexagon_set_performance(void *user_context, halide_hexagon_power
         return 0;
     }
 
+    ScopedMutexLock lock(&power_lock);
+    if (has_current_performance && same_performance(current_performance, *perf)) {
+        debug(user_context) << "    already voted for these settings\n";
+        return 0;
+    }
+
     debug(user_context) << "    remote_set_performance -> ";
     result = remote_set_performance(perf->set_mips,
                                     perf->mipsPerThread,
@@ -822,6 +967,9 @@ WEAK int halide_hexagon_set_performance(void *user_context, halide_hexagon_power
         error(user_context) << "remote_set_performance failed.\n";
         return result;
     }
+    current_performance = *perf;
+    has_current_performance = true;
+    current_performance_mode = -1;
 
     return 0;
 }
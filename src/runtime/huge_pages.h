@@ -0,0 +1,25 @@
+#ifndef HALIDE_RUNTIME_HUGE_PAGES_H
+#define HALIDE_RUNTIME_HUGE_PAGES_H
+
+#include "HalideRuntime.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Mappings of memory backed by huge pages, for the huge page mode of
+// the posix allocator. They are implemented on Linux with mmap and
+// madvise (linux_huge_pages.cpp), and stubbed out elsewhere
+// (fake_huge_pages.cpp), in which case the allocator falls back to
+// malloc.
+const size_t huge_page_bytes = 2 * 1024 * 1024;
+
+// Map bytes (a multiple of huge_page_bytes) of memory aligned to a huge
+// page. If use_reserved is set, try the reserved huge page pool
+// first, then fall back to transparent huge pages. Returns NULL on
+// failure.
+WEAK void *map_huge_pages(size_t bytes, bool use_reserved);
+
+WEAK void unmap_huge_pages(void *ptr, size_t bytes);
+
+}}}  // namespace Halide::Runtime::Internal
+
+#endif
@@ -0,0 +1,59 @@
+#include "HalideRuntime.h"
+#include "huge_pages.h"
+
+// These are the values for the generic Linux ABI (x86, ARM and
+// PowerPC), which is why this module isn't used on MIPS.
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define MAP_PRIVATE 0x02
+#define MAP_ANONYMOUS 0x20
+#define MAP_HUGETLB 0x40000
+#define MAP_FAILED ((void *)-1)
+#define MADV_HUGEPAGE 14
+
+extern "C" {
+
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+extern int madvise(void *addr, size_t length, int advice);
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK void *map_huge_pages(size_t bytes, bool use_reserved) {
+    const int prot = PROT_READ | PROT_WRITE;
+    if (use_reserved) {
+        void *ptr = mmap(NULL, bytes, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+        // The reserved pool is empty or not configured.
+    }
+
+    // Transparent huge pages can only back the huge-page-aligned parts
+    // of a mapping, so over-allocate, and trim the mapping to an
+    // aligned region.
+    uint8_t *ptr = (uint8_t *)mmap(NULL, bytes + huge_page_bytes, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *)ptr == MAP_FAILED) {
+        return NULL;
+    }
+    uint8_t *aligned = (uint8_t *)(((size_t)ptr + huge_page_bytes - 1) & ~(huge_page_bytes - 1));
+    if (aligned > ptr) {
+        munmap(ptr, aligned - ptr);
+    }
+    size_t tail = (ptr + bytes + huge_page_bytes) - (aligned + bytes);
+    if (tail > 0) {
+        munmap(aligned + bytes, tail);
+    }
+    // Only advice: the kernel may be configured to never use huge
+    // pages, in which case this is ordinary memory.
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+    return aligned;
+}
+
+WEAK void unmap_huge_pages(void *ptr, size_t bytes) {
+    munmap(ptr, bytes);
+}
+
+}}}  // namespace Halide::Runtime::Internal
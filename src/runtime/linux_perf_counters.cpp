@@ -0,0 +1,206 @@
+#include "HalideRuntime.h"
+#include "hardware_counters.h"
+
+// The syscall numbers used below, on x86.
+#ifdef BITS_64
+#define SYS_GETDENTS64 217
+#define SYS_GETTID 186
+#define SYS_PERF_EVENT_OPEN 298
+#else
+#define SYS_GETDENTS64 220
+#define SYS_GETTID 224
+#define SYS_PERF_EVENT_OPEN 336
+#endif
+
+#define O_RDONLY 0
+#define O_DIRECTORY 0200000
+
+extern "C" {
+extern int syscall(int num, ...);
+extern int open(const char *pathname, int flags, ...);
+extern ssize_t read(int fd, void *buf, size_t count);
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The first version of struct perf_event_attr, which all kernels with
+// perf_event accept.
+struct perf_event_attr_t {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+#define PERF_TYPE_HARDWARE 0
+#define PERF_TYPE_RAW 4
+#define PERF_COUNT_HW_CPU_CYCLES 0
+#define PERF_COUNT_HW_INSTRUCTIONS 1
+#define PERF_COUNT_HW_CACHE_MISSES 3
+#define PERF_FORMAT_GROUP (1 << 3)
+#define PERF_FLAG_EXCLUDE_KERNEL (1 << 5)
+#define PERF_FLAG_EXCLUDE_HV (1 << 6)
+
+// FP_ARITH_INST_RETIRED, counting the packed single and double precision
+// instructions of 128 and 256 bits, on Intel Broadwell and later. Other
+// CPUs need HL_PROFILER_VECTOR_EVENT to give the raw event in hex.
+#define DEFAULT_VECTOR_EVENT 0x3cc7
+
+// The counters of a thread, opened as a group so that they are scheduled
+// together. They stay readable once the thread has exited.
+struct counted_thread {
+    int tid;
+    int num_counters;
+    int fds[num_hardware_counters];
+};
+
+#define MAX_COUNTED_THREADS 256
+WEAK counted_thread counted_threads[MAX_COUNTED_THREADS];
+WEAK int num_counted_threads = 0;
+
+// The profiler's own thread, which isn't counted.
+WEAK int sampling_tid = 0;
+WEAK uint64_t vector_event = DEFAULT_VECTOR_EVENT;
+// New threads are looked for every so many reads.
+WEAK int reads_until_scan = 0;
+
+WEAK void open_thread_counters(int tid) {
+    for (int i = 0; i < num_counted_threads; i++) {
+        if (counted_threads[i].tid == tid) {
+            return;
+        }
+    }
+    if (num_counted_threads == MAX_COUNTED_THREADS) {
+        return;
+    }
+
+    const uint32_t types[num_hardware_counters] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_RAW
+    };
+    const uint64_t configs[num_hardware_counters] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, vector_event
+    };
+    counted_thread *t = counted_threads + num_counted_threads;
+    t->tid = tid;
+    t->num_counters = 0;
+    for (int i = 0; i < num_hardware_counters; i++) {
+        perf_event_attr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = types[i];
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        // Only count user space, which unprivileged processes may do.
+        attr.flags = PERF_FLAG_EXCLUDE_KERNEL | PERF_FLAG_EXCLUDE_HV;
+        int group_fd = i == 0 ? -1 : t->fds[0];
+        int fd = syscall(SYS_PERF_EVENT_OPEN, &attr, tid, -1, group_fd, 0);
+        if (fd < 0) {
+            // The values of a group are read in order, so the counters
+            // after one that is missing are dropped too.
+            break;
+        }
+        t->fds[t->num_counters++] = fd;
+    }
+    if (t->num_counters > 0) {
+        num_counted_threads++;
+    }
+}
+
+// Start counting the threads of the process not counted yet.
+WEAK void scan_threads() {
+    int dir = open("/proc/self/task", O_RDONLY | O_DIRECTORY);
+    if (dir < 0) {
+        return;
+    }
+    char buf[4096];
+    while (true) {
+        int size = syscall(SYS_GETDENTS64, dir, buf, sizeof(buf));
+        if (size <= 0) {
+            break;
+        }
+        // Each entry is a struct linux_dirent64: a 64-bit inode and
+        // offset, a 16-bit entry size, an 8-bit type and the name.
+        for (int offset = 0; offset < size;) {
+            uint16_t entry_size;
+            memcpy(&entry_size, buf + offset + 16, sizeof(entry_size));
+            const char *name = buf + offset + 19;
+            if (name[0] >= '0' && name[0] <= '9') {
+                int tid = atoi(name);
+                if (tid != sampling_tid) {
+                    open_thread_counters(tid);
+                }
+            }
+            offset += entry_size;
+        }
+    }
+    close(dir);
+}
+
+WEAK bool start_hardware_counters() {
+    const char *enabled = getenv("HL_PROFILER_COUNTERS");
+    if (!enabled || atoi(enabled) == 0) {
+        return false;
+    }
+    const char *event = getenv("HL_PROFILER_VECTOR_EVENT");
+    if (event) {
+        vector_event = 0;
+        if (event[0] == '0' && (event[1] == 'x' || event[1] == 'X')) {
+            event += 2;
+        }
+        for (; *event; event++) {
+            char c = *event;
+            int digit = (c >= '0' && c <= '9') ? c - '0' :
+                        (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                        (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (digit < 0) {
+                break;
+            }
+            vector_event = vector_event * 16 + digit;
+        }
+    }
+    num_counted_threads = 0;
+    sampling_tid = syscall(SYS_GETTID);
+    reads_until_scan = 0;
+    scan_threads();
+    return num_counted_threads > 0;
+}
+
+WEAK void read_hardware_counters(uint64_t *counts) {
+    // Thread pools are started by the pipelines, after the profiler.
+    if (reads_until_scan-- <= 0) {
+        scan_threads();
+        reads_until_scan = 100;
+    }
+    for (int i = 0; i < num_hardware_counters; i++) {
+        counts[i] = 0;
+    }
+    for (int i = 0; i < num_counted_threads; i++) {
+        const counted_thread &t = counted_threads[i];
+        // The number of values, followed by the values.
+        uint64_t values[1 + num_hardware_counters];
+        if (read(t.fds[0], values, sizeof(values)) < (ssize_t)sizeof(uint64_t)) {
+            continue;
+        }
+        for (uint64_t j = 0; j < values[0] && j < (uint64_t)t.num_counters; j++) {
+            counts[j] += values[1 + j];
+        }
+    }
+}
+
+WEAK void stop_hardware_counters() {
+    for (int i = 0; i < num_counted_threads; i++) {
+        const counted_thread &t = counted_threads[i];
+        for (int j = t.num_counters - 1; j >= 0; j--) {
+            close(t.fds[j]);
+        }
+    }
+    num_counted_threads = 0;
+}
+
+}}}  // namespace Halide::Runtime::Internal
@@ -0,0 +1,62 @@
+#include "HalideRuntime.h"
+#include "shared_memory.h"
+
+// These are the values for the generic Linux ABI (x86, ARM and
+// PowerPC), which is why this module isn't used on MIPS.
+#define O_RDWR 02
+#define O_CREAT 0100
+#define O_CLOEXEC 02000000
+#define SEEK_END 2
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define MAP_SHARED 0x01
+#define MAP_FAILED ((void *)-1)
+
+extern "C" {
+
+extern int open(const char *pathname, int flags, ...);
+extern int close(int fd);
+extern long lseek(int fd, long offset, int whence);
+extern int ftruncate(int fd, long length);
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK void *map_shared_file(const char *path, size_t *bytes) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    long size = lseek(fd, 0, SEEK_END);
+    if (size == 0) {
+        // New files read as zeros once extended, which the cache takes
+        // to be an empty table. If another process extends it at the
+        // same time, both agree on the contents.
+        if (ftruncate(fd, (long)*bytes) != 0) {
+            close(fd);
+            return NULL;
+        }
+        size = (long)*bytes;
+    }
+    if (size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    // The mapping keeps the file open.
+    void *ptr = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    *bytes = (size_t)size;
+    return ptr;
+}
+
+WEAK void unmap_shared_file(void *ptr, size_t bytes) {
+    munmap(ptr, bytes);
+}
+
+}}}  // namespace Halide::Runtime::Internal
@@ -0,0 +1,48 @@
+#include "HalideRuntime.h"
+#include "scoped_spin_lock.h"
+
+// The memory budget checked by Func::specialize_low_memory
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK int64_t halide_memory_budget = 0;
+WEAK int halide_memory_budget_lock = 0;
+WEAK bool halide_memory_budget_initialized = false;
+
+}}} // namespace Halide::Runtime::Internal
+
+extern char *getenv(const char *);
+
+extern "C" {
+
+WEAK void halide_set_memory_budget(int64_t bytes) {
+    ScopedSpinLock lock(&halide_memory_budget_lock);
+    halide_memory_budget = bytes;
+    halide_memory_budget_initialized = true;
+}
+
+WEAK int64_t halide_get_memory_budget(void *user_context) {
+    ScopedSpinLock lock(&halide_memory_budget_lock);
+    if (!halide_memory_budget_initialized) {
+        // HL_MEMORY_BUDGET is a number of bytes, optionally followed
+        // by k, m or g.
+        int64_t bytes = 0;
+        const char *var = getenv("HL_MEMORY_BUDGET");
+        if (var) {
+            for (; *var >= '0' && *var <= '9'; var++) {
+                bytes = bytes * 10 + (*var - '0');
+            }
+            if (*var == 'k' || *var == 'K') {
+                bytes <<= 10;
+            } else if (*var == 'm' || *var == 'M') {
+                bytes <<= 20;
+            } else if (*var == 'g' || *var == 'G') {
+                bytes <<= 30;
+            }
+        }
+        halide_memory_budget = bytes;
+        halide_memory_budget_initialized = true;
+    }
+    return halide_memory_budget;
+}
+
+}
@@ -209,12 +209,34 @@ struct device_handle {
 // Also used as a linked-list to keep track of all the different
 // modules that are attached to a context in order to release them all
 // when then context is released.
+struct kernel_state;
 struct module_state {
     mtl_library *library;
+    kernel_state *kernels;
     module_state *next;
 };
 WEAK module_state *state_list = NULL;
 
+// The functions of a module that have been run, with their compute
+// pipeline states. Building a pipeline state compiles the function for
+// the device, so it is only done the first time a kernel is run.
+struct kernel_state {
+    char *name;
+    mtl_function *function;
+    mtl_compute_pipeline_state *pipeline_state;
+    kernel_state *next;
+};
+
+// Kernels are encoded into a single command buffer, which is committed
+// when the host next needs the results of the device (or after
+// max_pending_dispatches kernels, so that the device doesn't sit idle
+// while a long pipeline is encoded). Only accessed between the acquire
+// and release of the context.
+WEAK mtl_command_buffer *pending_command_buffer = NULL;
+WEAK mtl_command_queue *pending_queue = NULL;
+WEAK int pending_dispatches = 0;
+const int max_pending_dispatches = 16;
+
 // API Capabilities.  If more capabilities need to be checked,
 // this can be refactored to something more robust/general.
 WEAK bool metal_api_supports_set_bytes;
@@ -342,6 +364,44 @@ WEAK command_buffer_completed_handler_block_literal command_buffer_completed_han
     &command_buffer_completed_handler_descriptor
 };
 
+// Commit the pending command buffer, if any, and optionally wait for
+// it to complete.
+WEAK void commit_pending_command_buffer(bool wait) {
+    if (pending_command_buffer == NULL) {
+        return;
+    }
+    commit_command_buffer(pending_command_buffer);
+    if (wait) {
+        wait_until_completed(pending_command_buffer);
+    }
+    release_ns_object(pending_command_buffer);
+    pending_command_buffer = NULL;
+    pending_queue = NULL;
+    pending_dispatches = 0;
+}
+
+// Get the command buffer to encode into, creating it if necessary.
+WEAK mtl_command_buffer *get_pending_command_buffer(mtl_command_queue *queue) {
+    if (pending_command_buffer != NULL && pending_queue != queue) {
+        // A different context was acquired. Its queue can't run the
+        // work encoded so far.
+        commit_pending_command_buffer(false);
+    }
+    if (pending_command_buffer == NULL) {
+        mtl_command_buffer *command_buffer = new_command_buffer(queue);
+        if (command_buffer == NULL) {
+            return NULL;
+        }
+        // The command buffer is autoreleased, and outlives the
+        // autorelease pool of the MetalContextHolder that created it.
+        retain_ns_object(command_buffer);
+        add_command_buffer_completed_handler(command_buffer, &command_buffer_completed_handler_block);
+        pending_command_buffer = command_buffer;
+        pending_queue = queue;
+    }
+    return pending_command_buffer;
+}
+
 }}}} // namespace Halide::Runtime::Internal::Metal
 
 using namespace Halide::Runtime::Internal::Metal;
@@ -441,6 +501,7 @@ WEAK int halide_metal_initialize_kernels(void *user_context, void **state_ptr, c
     if (!(*state)) {
         *state = (module_state*)malloc(sizeof(module_state));
         (*state)->library = NULL;
+        (*state)->kernels = NULL;
         (*state)->next = state_list;
         state_list = *state;
     }
@@ -483,7 +544,12 @@ WEAK int halide_metal_initialize_kernels(void *user_context, void **state_ptr, c
 namespace {
 
 inline void halide_metal_device_sync_internal(mtl_command_queue *queue, struct halide_buffer_t *buffer) {
-    mtl_command_buffer *sync_command_buffer = new_command_buffer(queue);
+    // The synchronization goes at the end of the kernels that are
+    // pending, so that waiting for it also waits for them.
+    mtl_command_buffer *sync_command_buffer = get_pending_command_buffer(queue);
+    if (sync_command_buffer == NULL) {
+        return;
+    }
     if (buffer != NULL) {
         mtl_buffer *metal_buffer = ((device_handle *)buffer->device)->buf;
         if (is_buffer_managed(metal_buffer)) {
@@ -492,8 +558,19 @@ inline void halide_metal_device_sync_internal(mtl_command_queue *queue, struct h
             end_encoding(blit_encoder);
         }
     }
-    commit_command_buffer(sync_command_buffer);
-    wait_until_completed(sync_command_buffer);
+    commit_pending_command_buffer(true);
+}
+
+WEAK void release_kernels(void *user_context, module_state *state) {
+    while (state->kernels) {
+        kernel_state *kernel = state->kernels;
+        debug(user_context) << "Metal - Releasing: pipeline state for " << kernel->name << "\n";
+        release_ns_object(kernel->pipeline_state);
+        release_ns_object(kernel->function);
+        state->kernels = kernel->next;
+        free(kernel->name);
+        free(kernel);
+    }
 }
 
 }
@@ -529,6 +606,9 @@ WEAK int halide_metal_device_release(void *user_context) {
         return error;
     }
 
+    // Run the kernels that are pending, whichever queue they are for.
+    commit_pending_command_buffer(true);
+
     if (device) {
         halide_metal_device_sync_internal(queue, NULL);
 
@@ -539,7 +619,8 @@ WEAK int halide_metal_device_release(void *user_context) {
         // object.
         module_state *state = state_list;
         while (state) {
-          if (state->library) {
+            release_kernels(user_context, state);
+            if (state->library) {
                 debug(user_context) << "Metal - Releasing: new_library_with_source " << state->library << "\n";
                 release_ns_object(state->library);
                 state->library = NULL;
@@ -576,6 +657,9 @@ WEAK int halide_metal_copy_to_device(void *user_context, halide_buffer_t* buffer
 
     halide_assert(user_context, buffer->host && buffer->device);
 
+    // Kernels that are pending may still read the old contents.
+    commit_pending_command_buffer(true);
+
     device_copy c = make_host_to_device_copy(buffer);
     mtl_buffer *metal_buffer = ((device_handle *)c.dst)->buf;
     c.dst = (uint64_t)buffer_contents(metal_buffer) + ((device_handle *)c.dst)->offset;
@@ -658,7 +742,48 @@ WEAK int halide_metal_run(void *user_context,
         return metal_context.error;
     }
 
-    mtl_command_buffer *command_buffer = new_command_buffer(metal_context.queue);
+    halide_assert(user_context, state_ptr);
+    module_state *state = (module_state*)state_ptr;
+
+    kernel_state *kernel = state->kernels;
+    while (kernel && strcmp(kernel->name, entry_name) != 0) {
+        kernel = kernel->next;
+    }
+    if (kernel == NULL) {
+        mtl_function *function = new_function_with_name(state->library, entry_name, strlen(entry_name));
+        if (function == 0) {
+            error(user_context) << "Metal: Could not get function " << entry_name << "from Metal library.\n";
+            return -1;
+        }
+
+        mtl_compute_pipeline_state *pipeline_state = new_compute_pipeline_state_with_function(metal_context.device, function);
+        if (pipeline_state == 0) {
+            error(user_context) << "Metal: Could not allocate pipeline state.\n";
+            release_ns_object(function);
+            return -1;
+        }
+
+        size_t name_len = strlen(entry_name);
+        kernel = (kernel_state *)malloc(sizeof(kernel_state));
+        char *name = (char *)malloc(name_len + 1);
+        if (kernel == NULL || name == NULL) {
+            error(user_context) << "Metal: malloc failed caching pipeline state.\n";
+            free(kernel);
+            free(name);
+            release_ns_object(pipeline_state);
+            release_ns_object(function);
+            return halide_error_code_out_of_memory;
+        }
+        memcpy(name, entry_name, name_len + 1);
+        debug(user_context) << "Metal - Allocating: pipeline state for " << entry_name << "\n";
+        kernel->name = name;
+        kernel->function = function;
+        kernel->pipeline_state = pipeline_state;
+        kernel->next = state->kernels;
+        state->kernels = kernel;
+    }
+
+    mtl_command_buffer *command_buffer = get_pending_command_buffer(metal_context.queue);
     if (command_buffer == 0) {
         error(user_context) << "Metal: Could not allocate command buffer.\n";
         return -1;
@@ -669,23 +794,7 @@ WEAK int halide_metal_run(void *user_context,
         error(user_context) << "Metal: Could not allocate compute command encoder.\n";
         return -1;
     }
-
-    halide_assert(user_context, state_ptr);
-    module_state *state = (module_state*)state_ptr;
-
-    mtl_function *function = new_function_with_name(state->library, entry_name, strlen(entry_name));
-    if (function == 0) {
-        error(user_context) << "Metal: Could not get function " << entry_name << "from Metal library.\n";
-        return -1;
-    }
-
-    mtl_compute_pipeline_state *pipeline_state = new_compute_pipeline_state_with_function(metal_context.device, function);
-    if (pipeline_state == 0) {
-        error(user_context) << "Metal: Could not allocate pipeline state.\n";
-        release_ns_object(function);
-        return -1;
-    }
-    set_compute_pipeline_state(encoder, pipeline_state);
+    set_compute_pipeline_state(encoder, kernel->pipeline_state);
 
     size_t total_args_size = 0;
     for (size_t i = 0; arg_sizes[i] != 0; i++) {
@@ -731,8 +840,7 @@ WEAK int halide_metal_run(void *user_context,
             args_buffer = new_buffer(metal_context.device, padded_args_size);
             if (args_buffer == 0) {
                 error(user_context) << "Metal: Could not allocate arguments buffer.\n";
-                release_ns_object(pipeline_state);
-                release_ns_object(function);
+                end_encoding(encoder);
                 return -1;
             }
             args_ptr = (char *)buffer_contents(args_buffer);
@@ -780,12 +888,9 @@ WEAK int halide_metal_run(void *user_context,
                           threadsX, threadsY, threadsZ);
     end_encoding(encoder);
 
-    add_command_buffer_completed_handler(command_buffer, &command_buffer_completed_handler_block);
-
-    commit_command_buffer(command_buffer);
-
-    release_ns_object(pipeline_state);
-    release_ns_object(function);
+    if (++pending_dispatches >= max_pending_dispatches) {
+        commit_pending_command_buffer(false);
+    }
 
     #ifdef DEBUG_RUNTIME
     uint64_t t_after = halide_current_time_ns(user_context);
@@ -922,6 +1027,14 @@ WEAK uintptr_t halide_metal_get_buffer(void *user_context, struct halide_buffer_
         return 0;
     }
     halide_assert(user_context, buf->device_interface == &metal_device_interface);
+
+    // Commit the kernels that are pending, so that work the caller
+    // submits to the same queue is ordered after them.
+    MetalContextHolder metal_context(user_context, false);
+    if (metal_context.error == 0) {
+        commit_pending_command_buffer(false);
+    }
+
     return (uintptr_t)(((device_handle *)buf->device)->buf);
 }
 
@@ -22,6 +22,10 @@ typedef struct CUfunc_st *CUfunction;                     /**< CUDA function */
 typedef struct CUstream_st *CUstream;                     /**< CUDA stream */
 typedef struct CUevent_st *CUevent;                       /**< CUDA event */
 typedef struct CUarray_st* CUarray;
+typedef struct CUlinkState_st *CUlinkState;               /**< CUDA JIT linker state */
+typedef struct CUgraph_st *CUgraph;                       /**< CUDA graph */
+typedef struct CUgraphNode_st *CUgraphNode;               /**< CUDA graph node */
+typedef struct CUgraphExec_st *CUgraphExec;               /**< CUDA executable graph */
 
 typedef enum CUjit_option_enum {
     CU_JIT_MAX_REGISTERS = 0,
@@ -37,6 +41,14 @@ typedef enum CUjit_option_enum {
     CU_JIT_FALLBACK_STRATEGY = 10
 } CUjit_option;
 
+typedef enum CUjitInputType_enum {
+    CU_JIT_INPUT_CUBIN = 0,
+    CU_JIT_INPUT_PTX = 1,
+    CU_JIT_INPUT_FATBINARY = 2,
+    CU_JIT_INPUT_OBJECT = 3,
+    CU_JIT_INPUT_LIBRARY = 4
+} CUjitInputType;
+
 typedef enum {
     CUDA_SUCCESS                              = 0,
     CUDA_ERROR_INVALID_VALUE                  = 1,
@@ -186,9 +198,19 @@ typedef enum {
     CU_DEVICE_ATTRIBUTE_MANAGED_MEMORY = 83,                    /**< Device can allocate managed memory on this system */
     CU_DEVICE_ATTRIBUTE_MULTI_GPU_BOARD = 84,                    /**< Device is on a multi-GPU board */
     CU_DEVICE_ATTRIBUTE_MULTI_GPU_BOARD_GROUP_ID = 85,           /**< Unique id for a group of devices on the same multi-GPU board */
+    CU_DEVICE_ATTRIBUTE_CONCURRENT_MANAGED_ACCESS = 89,          /**< Device can coherently access managed memory concurrently with the CPU */
+    CU_DEVICE_ATTRIBUTE_COOPERATIVE_LAUNCH = 95,                 /**< Device supports launching cooperative kernels via cuLaunchCooperativeKernel */
+    CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN = 97,  /**< Maximum shared memory per block a kernel can opt into with cuFuncSetAttribute */
     CU_DEVICE_ATTRIBUTE_MAX
 } CUdevice_attribute;
 
+typedef enum {
+    CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK = 0,          /**< Maximum number of threads per block the function can be launched with */
+    CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES = 1,              /**< Statically allocated shared memory of the function */
+    CU_FUNC_ATTRIBUTE_NUM_REGS = 4,                       /**< Number of registers used by each thread of the function */
+    CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES = 8   /**< Maximum dynamic shared memory the function can be launched with */
+} CUfunction_attribute;
+
 typedef enum CUmemorytype_enum {
     CU_MEMORYTYPE_HOST = 0x01,
     CU_MEMORYTYPE_DEVICE = 0x02,
@@ -226,7 +248,26 @@ typedef struct CUDA_MEMCPY3D_st {
     size_t Depth;               /**< Depth of 3D memory copy */
 } CUDA_MEMCPY3D;
 
+typedef struct CUDA_KERNEL_NODE_PARAMS_st {
+    CUfunction func;            /**< Kernel to launch */
+    unsigned int gridDimX;      /**< Width of grid in blocks */
+    unsigned int gridDimY;      /**< Height of grid in blocks */
+    unsigned int gridDimZ;      /**< Depth of grid in blocks */
+    unsigned int blockDimX;     /**< X dimension of each thread block */
+    unsigned int blockDimY;     /**< Y dimension of each thread block */
+    unsigned int blockDimZ;     /**< Z dimension of each thread block */
+    unsigned int sharedMemBytes;/**< Dynamic shared-memory size per thread block in bytes */
+    void **kernelParams;        /**< Array of pointers to kernel parameters */
+    void **extra;               /**< Extra options */
+} CUDA_KERNEL_NODE_PARAMS;
+
 #define CU_POINTER_ATTRIBUTE_CONTEXT 1
+#define CU_POINTER_ATTRIBUTE_IS_MANAGED 8
+#define CU_MEM_ATTACH_GLOBAL 1
+#define CU_DEVICE_CPU ((CUdevice)-1)
+#define CU_EVENT_DISABLE_TIMING 2
+#define CU_MEMHOSTALLOC_PORTABLE 1
+#define CU_MEMHOSTALLOC_WRITECOMBINED 4
 
 }}}}
 
@@ -0,0 +1,126 @@
+#ifndef HALIDE_MINI_CUDA_LIBRARIES_H
+#define HALIDE_MINI_CUDA_LIBRARIES_H
+
+// The parts of the cuBLAS and cuDNN APIs the CUDA runtime calls. Both
+// libraries are loaded when first used, so they aren't needed to run
+// pipelines that don't call them.
+
+#include "mini_cuda.h"
+
+namespace Halide { namespace Runtime { namespace Internal { namespace Cuda {
+
+typedef struct cublasContext *cublasHandle_t;
+typedef int cublasStatus_t;
+#define CUBLAS_STATUS_SUCCESS 0
+
+typedef enum {
+    CUBLAS_OP_N = 0,
+    CUBLAS_OP_T = 1
+} cublasOperation_t;
+
+typedef struct cudnnContext *cudnnHandle_t;
+typedef struct cudnnTensorStruct *cudnnTensorDescriptor_t;
+typedef struct cudnnFilterStruct *cudnnFilterDescriptor_t;
+typedef struct cudnnConvolutionStruct *cudnnConvolutionDescriptor_t;
+typedef int cudnnStatus_t;
+#define CUDNN_STATUS_SUCCESS 0
+
+typedef enum {
+    CUDNN_DATA_FLOAT = 0,
+    CUDNN_DATA_DOUBLE = 1,
+    CUDNN_DATA_HALF = 2
+} cudnnDataType_t;
+
+typedef enum {
+    CUDNN_TENSOR_NCHW = 0
+} cudnnTensorFormat_t;
+
+typedef enum {
+    CUDNN_CONVOLUTION = 0,
+    CUDNN_CROSS_CORRELATION = 1
+} cudnnConvolutionMode_t;
+
+// The algorithms used, which support all the data types and strides,
+// and are deterministic.
+#define CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_GEMM 0
+#define CUDNN_CONVOLUTION_BWD_DATA_ALGO_1 1
+#define CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1 1
+
+#define CUDA_LIBRARY_FN(ret, fn, args) WEAK ret (CUDAAPI *fn)args = NULL;
+
+CUDA_LIBRARY_FN(cublasStatus_t, cublasCreate_v2, (cublasHandle_t *handle));
+CUDA_LIBRARY_FN(cublasStatus_t, cublasDestroy_v2, (cublasHandle_t handle));
+CUDA_LIBRARY_FN(cublasStatus_t, cublasSetStream_v2, (cublasHandle_t handle, CUstream stream));
+CUDA_LIBRARY_FN(cublasStatus_t, cublasSgemm_v2, (cublasHandle_t handle,
+                                                 cublasOperation_t transa, cublasOperation_t transb,
+                                                 int m, int n, int k,
+                                                 const float *alpha, const float *A, int lda,
+                                                 const float *B, int ldb,
+                                                 const float *beta, float *C, int ldc));
+CUDA_LIBRARY_FN(cublasStatus_t, cublasDgemm_v2, (cublasHandle_t handle,
+                                                 cublasOperation_t transa, cublasOperation_t transb,
+                                                 int m, int n, int k,
+                                                 const double *alpha, const double *A, int lda,
+                                                 const double *B, int ldb,
+                                                 const double *beta, double *C, int ldc));
+
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnCreate, (cudnnHandle_t *handle));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnDestroy, (cudnnHandle_t handle));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnSetStream, (cudnnHandle_t handle, CUstream stream));
+CUDA_LIBRARY_FN(const char *, cudnnGetErrorString, (cudnnStatus_t status));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnCreateTensorDescriptor, (cudnnTensorDescriptor_t *desc));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnDestroyTensorDescriptor, (cudnnTensorDescriptor_t desc));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnSetTensor4dDescriptorEx, (cudnnTensorDescriptor_t desc, cudnnDataType_t type,
+                                                              int n, int c, int h, int w,
+                                                              int n_stride, int c_stride, int h_stride, int w_stride));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnCreateFilterDescriptor, (cudnnFilterDescriptor_t *desc));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnDestroyFilterDescriptor, (cudnnFilterDescriptor_t desc));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnSetFilter4dDescriptor, (cudnnFilterDescriptor_t desc, cudnnDataType_t type,
+                                                            cudnnTensorFormat_t format,
+                                                            int k, int c, int h, int w));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnCreateConvolutionDescriptor, (cudnnConvolutionDescriptor_t *desc));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnDestroyConvolutionDescriptor, (cudnnConvolutionDescriptor_t desc));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnSetConvolution2dDescriptor, (cudnnConvolutionDescriptor_t desc,
+                                                                 int pad_h, int pad_w, int u, int v,
+                                                                 int dilation_h, int dilation_w,
+                                                                 cudnnConvolutionMode_t mode,
+                                                                 cudnnDataType_t compute_type));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnGetConvolutionForwardWorkspaceSize,
+                (cudnnHandle_t handle, cudnnTensorDescriptor_t x_desc, cudnnFilterDescriptor_t w_desc,
+                 cudnnConvolutionDescriptor_t conv_desc, cudnnTensorDescriptor_t y_desc,
+                 int algo, size_t *size));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnConvolutionForward,
+                (cudnnHandle_t handle, const void *alpha,
+                 cudnnTensorDescriptor_t x_desc, const void *x,
+                 cudnnFilterDescriptor_t w_desc, const void *w,
+                 cudnnConvolutionDescriptor_t conv_desc, int algo,
+                 void *workspace, size_t workspace_size, const void *beta,
+                 cudnnTensorDescriptor_t y_desc, void *y));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnGetConvolutionBackwardDataWorkspaceSize,
+                (cudnnHandle_t handle, cudnnFilterDescriptor_t w_desc, cudnnTensorDescriptor_t dy_desc,
+                 cudnnConvolutionDescriptor_t conv_desc, cudnnTensorDescriptor_t dx_desc,
+                 int algo, size_t *size));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnConvolutionBackwardData,
+                (cudnnHandle_t handle, const void *alpha,
+                 cudnnFilterDescriptor_t w_desc, const void *w,
+                 cudnnTensorDescriptor_t dy_desc, const void *dy,
+                 cudnnConvolutionDescriptor_t conv_desc, int algo,
+                 void *workspace, size_t workspace_size, const void *beta,
+                 cudnnTensorDescriptor_t dx_desc, void *dx));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnGetConvolutionBackwardFilterWorkspaceSize,
+                (cudnnHandle_t handle, cudnnTensorDescriptor_t x_desc, cudnnTensorDescriptor_t dy_desc,
+                 cudnnConvolutionDescriptor_t conv_desc, cudnnFilterDescriptor_t dw_desc,
+                 int algo, size_t *size));
+CUDA_LIBRARY_FN(cudnnStatus_t, cudnnConvolutionBackwardFilter,
+                (cudnnHandle_t handle, const void *alpha,
+                 cudnnTensorDescriptor_t x_desc, const void *x,
+                 cudnnTensorDescriptor_t dy_desc, const void *dy,
+                 cudnnConvolutionDescriptor_t conv_desc, int algo,
+                 void *workspace, size_t workspace_size, const void *beta,
+                 cudnnFilterDescriptor_t dw_desc, void *dw));
+
+#undef CUDA_LIBRARY_FN
+
+}}}}  // namespace Halide::Runtime::Internal::Cuda
+
+#endif
@@ -226,6 +226,205 @@ struct module_state {
 };
 WEAK module_state *state_list = NULL;
 
+// The host memory of buffers allocated by halide_opencl_device_and_host_malloc
+// is the mapping of a buffer created with CL_MEM_ALLOC_HOST_PTR, which the
+// drivers pin, so that copies between it and the device buffer run at full
+// bandwidth. The pinned buffer stays mapped, and is only used through its
+// mapping.
+struct pinned_mapping {
+    cl_mem mem;
+    void *ptr;
+    pinned_mapping *next;
+};
+WEAK pinned_mapping *pinned_mappings = NULL;
+// This spinlock protects the above list.
+volatile int WEAK pinned_mappings_lock = 0;
+
+// Whether the device of a context shares its memory with the host, as
+// integrated GPUs (and CPUs) do. Device allocations of buffers with host
+// memory then wrap it with CL_MEM_USE_HOST_PTR instead of copying it.
+WEAK bool host_unified_memory(ClContext &ctx) {
+    cl_device_id dev;
+    cl_bool unified = CL_FALSE;
+    return (clGetContextInfo(ctx.context, CL_CONTEXT_DEVICES, sizeof(dev), &dev, NULL) == CL_SUCCESS &&
+            clGetDeviceInfo(dev, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, NULL) == CL_SUCCESS &&
+            unified == CL_TRUE);
+}
+
+// Whether the device allocation of a buffer wraps its host memory, so that
+// the two are synchronized by mapping the buffer instead of copied.
+WEAK bool wraps_host(const halide_buffer_t *buf) {
+    if (buf->host == NULL || buf->device == 0) {
+        return false;
+    }
+    const device_handle *handle = (const device_handle *)buf->device;
+    void *host_ptr = NULL;
+    return (clGetMemObjectInfo(handle->mem, CL_MEM_HOST_PTR, sizeof(host_ptr), &host_ptr, NULL) == CL_SUCCESS &&
+            host_ptr != NULL &&
+            (uint8_t *)host_ptr + handle->offset == buf->host);
+}
+
+// Map a new pinned buffer of 'size' bytes, or return NULL if it can't be.
+WEAK void *map_pinned_buffer(void *user_context, ClContext &ctx, size_t size) {
+    pinned_mapping *mapping = (pinned_mapping *)malloc(sizeof(pinned_mapping));
+    if (mapping == NULL) {
+        return NULL;
+    }
+    cl_int err;
+    debug(user_context) << "    clCreateBuffer (CL_MEM_ALLOC_HOST_PTR) -> " << (uint64_t)size << " ";
+    mapping->mem = clCreateBuffer(ctx.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+    if (err != CL_SUCCESS || mapping->mem == 0) {
+        debug(user_context) << get_opencl_error_name(err) << "\n";
+        free(mapping);
+        return NULL;
+    }
+    mapping->ptr = clEnqueueMapBuffer(ctx.cmd_queue, mapping->mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                      0, size, 0, NULL, NULL, &err);
+    if (err != CL_SUCCESS || mapping->ptr == NULL) {
+        debug(user_context) << "clEnqueueMapBuffer failed: " << get_opencl_error_name(err) << "\n";
+        clReleaseMemObject(mapping->mem);
+        free(mapping);
+        return NULL;
+    }
+    debug(user_context) << mapping->ptr << "\n";
+    ScopedSpinLock spinlock(&pinned_mappings_lock);
+    mapping->next = pinned_mappings;
+    pinned_mappings = mapping;
+    return mapping->ptr;
+}
+
+// Unmap and release the pinned buffer mapped at ptr. Returns false if
+// ptr isn't the mapping of a pinned buffer.
+WEAK bool unmap_pinned_buffer(void *user_context, ClContext &ctx, void *ptr) {
+    pinned_mapping *found = NULL;
+    {
+        ScopedSpinLock spinlock(&pinned_mappings_lock);
+        for (pinned_mapping **prev = &pinned_mappings; *prev; prev = &(*prev)->next) {
+            if ((*prev)->ptr == ptr) {
+                found = *prev;
+                *prev = found->next;
+                break;
+            }
+        }
+    }  // spinlock
+    if (found == NULL) {
+        return false;
+    }
+    debug(user_context) << "    clEnqueueUnmapMemObject " << ptr << "\n";
+    clEnqueueUnmapMemObject(ctx.cmd_queue, found->mem, found->ptr, 0, NULL, NULL);
+    clReleaseMemObject(found->mem);
+    free(found);
+    return true;
+}
+
+// A 64-bit FNV-1a hash, to name the cached programs.
+WEAK uint64_t hash_bytes(uint64_t h, const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// If HL_OCL_PROGRAM_CACHE names a directory, the binaries of the
+// programs built are written there, and later builds of the same source
+// with the same options read them back instead of compiling. Binaries
+// are specific to a device and driver, so their names include the
+// device name and driver version. Returns false if there is no cache.
+WEAK bool get_program_cache_path(void *user_context, cl_device_id dev,
+                                 const char *src, int size, const char *options,
+                                 stringstream &path) {
+    const char *cache_dir = getenv("HL_OCL_PROGRAM_CACHE");
+    if (cache_dir == NULL || *cache_dir == 0) {
+        return false;
+    }
+    char device_name[256], driver_version[256];
+    if (clGetDeviceInfo(dev, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL) != CL_SUCCESS ||
+        clGetDeviceInfo(dev, CL_DRIVER_VERSION, sizeof(driver_version), driver_version, NULL) != CL_SUCCESS) {
+        return false;
+    }
+    uint64_t key = hash_bytes(0xcbf29ce484222325ULL, src, size);
+    key = hash_bytes(key, device_name, strlen(device_name));
+    key = hash_bytes(key, driver_version, strlen(driver_version));
+    key = hash_bytes(key, options, strlen(options));
+    path << cache_dir << "/halide_opencl_" << key << ".bin";
+    return true;
+}
+
+// Create and build a program from a cached binary. Returns NULL if the
+// binary is missing, or the driver rejects it.
+WEAK cl_program load_cached_program(void *user_context, cl_context context, cl_device_id dev,
+                                    const char *path, const char *options) {
+    void *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    size_t capacity = 1 << 16, size = 0;
+    char *binary = (char *)malloc(capacity);
+    while (binary) {
+        size += fread(binary + size, 1, capacity - size, file);
+        if (size < capacity) {
+            break;
+        }
+        char *larger = (char *)malloc(capacity * 2);
+        if (larger) {
+            memcpy(larger, binary, size);
+        }
+        free(binary);
+        binary = larger;
+        capacity *= 2;
+    }
+    fclose(file);
+    if (!binary || size == 0) {
+        free(binary);
+        return NULL;
+    }
+
+    debug(user_context) << "    clCreateProgramWithBinary " << path << " -> ";
+    const unsigned char *binaries[] = { (const unsigned char *)binary };
+    cl_int binary_status = CL_SUCCESS, err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithBinary(context, 1, &dev, &size, binaries, &binary_status, &err);
+    free(binary);
+    if (err == CL_SUCCESS && binary_status == CL_SUCCESS) {
+        // Building a program from a binary only links it.
+        err = clBuildProgram(program, 1, &dev, options, NULL, NULL);
+    } else if (err == CL_SUCCESS) {
+        err = binary_status;
+    }
+    if (err != CL_SUCCESS) {
+        debug(user_context) << "failed: " << get_opencl_error_name(err) << "\n";
+        if (program) {
+            clReleaseProgram(program);
+        }
+        return NULL;
+    }
+    debug(user_context) << (void *)program << "\n";
+    return program;
+}
+
+// Write the binary of a built program to the cache. Failing to write
+// it only costs compiling again next time.
+WEAK void save_cached_program(void *user_context, cl_program program, const char *path) {
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS ||
+        size == 0) {
+        return;
+    }
+    unsigned char *binary = (unsigned char *)malloc(size);
+    if (!binary) {
+        return;
+    }
+    unsigned char *binaries[] = { binary };
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL) == CL_SUCCESS) {
+        void *file = fopen(path, "wb");
+        if (file) {
+            debug(user_context) << "    Caching program binary in " << path << "\n";
+            fwrite(binary, 1, size, file);
+            fclose(file);
+        }
+    }
+    free(binary);
+}
+
 WEAK bool validate_device_pointer(void *user_context, halide_buffer_t* buf, size_t size=0) {
     if (buf->device == 0) {
         return true;
@@ -587,6 +786,23 @@ WEAK int halide_opencl_initialize_kernels(void *user_context, void **state_ptr,
         options << "-D MAX_CONSTANT_BUFFER_SIZE=" << max_constant_buffer_size
                 << " -D MAX_CONSTANT_ARGS=" << max_constant_args;
 
+        stringstream cache_path(user_context);
+        bool use_cache = get_program_cache_path(user_context, dev, src, size, options.str(), cache_path);
+        if (use_cache) {
+            cl_program program = load_cached_program(user_context, ctx.context, dev,
+                                                     cache_path.str(), options.str());
+            if (program) {
+                (*state)->program = program;
+
+                #ifdef DEBUG_RUNTIME
+                uint64_t t_after = halide_current_time_ns(user_context);
+                debug(user_context) << "    Time: " << (t_after - t_before) / 1.0e6 << " ms\n";
+                #endif
+
+                return 0;
+            }
+        }
+
         const char * sources[] = { src };
         debug(user_context) << "    clCreateProgramWithSource -> ";
         cl_program program = clCreateProgramWithSource(ctx.context, 1, &sources[0], NULL, &err );
@@ -623,6 +839,10 @@ WEAK int halide_opencl_initialize_kernels(void *user_context, void **state_ptr,
 
             return err;
         }
+
+        if (use_cache) {
+            save_cached_program(user_context, program, cache_path.str());
+        }
     }
 
     #ifdef DEBUG_RUNTIME
@@ -745,9 +965,18 @@ WEAK int halide_opencl_device_malloc(void *user_context, halide_buffer_t* buf) {
         return CL_OUT_OF_HOST_MEMORY;
     }
 
+    // On devices that share memory with the host, the device can use the
+    // host memory in place.
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+    void *host_ptr = NULL;
+    if (buf->host && host_unified_memory(ctx)) {
+        flags |= CL_MEM_USE_HOST_PTR;
+        host_ptr = buf->host;
+    }
+
     cl_int err;
-    debug(user_context) << "    clCreateBuffer -> " << (int)size << " ";
-    cl_mem dev_ptr = clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, size, NULL, &err);
+    debug(user_context) << "    clCreateBuffer -> " << (int)size << (host_ptr ? " (wrapping host) " : " ");
+    cl_mem dev_ptr = clCreateBuffer(ctx.context, flags, size, host_ptr, &err);
     if (err != CL_SUCCESS || dev_ptr == 0) {
         debug(user_context) << get_opencl_error_name(err) << "\n";
         error(user_context) << "CL: clCreateBuffer failed: "
@@ -881,7 +1110,26 @@ WEAK int halide_opencl_buffer_copy(void *user_context, struct halide_buffer_t *s
         }
         #endif
 
-        err = do_multidimensional_copy(user_context, ctx, c, c.src_begin, 0, dst->dimensions, from_host, to_host);
+        if (src == dst && from_host != to_host && wraps_host(src)) {
+            // Mapping the region of a buffer that wraps host memory makes
+            // the host memory current, and unmapping it after a map for
+            // writing makes the device see the host's writes, without
+            // copying on devices that share memory with the host.
+            const device_handle *handle = (const device_handle *)src->device;
+            cl_map_flags flags = to_host ? CL_MAP_READ : CL_MAP_WRITE;
+            debug(user_context) << "    clEnqueueMapBuffer " << (void *)handle->mem << "\n";
+            void *mapped = clEnqueueMapBuffer(ctx.cmd_queue, handle->mem, CL_TRUE, flags,
+                                              handle->offset, src->size_in_bytes(), 0, NULL, NULL, &err);
+            if (err == CL_SUCCESS) {
+                err = clEnqueueUnmapMemObject(ctx.cmd_queue, handle->mem, mapped, 0, NULL, NULL);
+            }
+            if (err != CL_SUCCESS) {
+                error(user_context) << "CL: mapping a buffer wrapping host memory failed: "
+                                    << get_opencl_error_name(err);
+            }
+        } else {
+            err = do_multidimensional_copy(user_context, ctx, c, c.src_begin, 0, dst->dimensions, from_host, to_host);
+        }
 
         // The reads/writes above are all non-blocking, so empty the command
         // queue before we proceed so that other host code won't write
@@ -1074,11 +1322,50 @@ WEAK int halide_opencl_run(void *user_context,
 }
 
 WEAK int halide_opencl_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf) {
-    return halide_default_device_and_host_malloc(user_context, buf, &opencl_device_interface);
+    debug(user_context)
+        << "CL: halide_opencl_device_and_host_malloc (user_context: " << user_context
+        << ", buf: " << buf << ")\n";
+
+    ClContext ctx(user_context);
+    if (ctx.error != CL_SUCCESS) {
+        return ctx.error;
+    }
+
+    // Fall back to pageable memory if the host memory can't be pinned. On
+    // devices that share memory with the host, the device allocation wraps
+    // the host memory anyway.
+    void *host = NULL;
+    if (!host_unified_memory(ctx)) {
+        host = map_pinned_buffer(user_context, ctx, buf->size_in_bytes());
+    }
+    if (host == NULL) {
+        return halide_default_device_and_host_malloc(user_context, buf, &opencl_device_interface);
+    }
+    buf->host = (uint8_t *)host;
+    int result = halide_device_malloc(user_context, buf, &opencl_device_interface);
+    if (result != 0) {
+        unmap_pinned_buffer(user_context, ctx, host);
+        buf->host = NULL;
+    }
+    return result;
 }
 
 WEAK int halide_opencl_device_and_host_free(void *user_context, struct halide_buffer_t *buf) {
-    return halide_default_device_and_host_free(user_context, buf, &opencl_device_interface);
+    debug(user_context)
+        << "CL: halide_opencl_device_and_host_free (user_context: " << user_context
+        << ", buf: " << buf << ")\n";
+
+    int result = halide_device_free(user_context, buf);
+    if (buf->host) {
+        ClContext ctx(user_context);
+        if (!unmap_pinned_buffer(user_context, ctx, buf->host)) {
+            halide_free(user_context, buf->host);
+        }
+        buf->host = NULL;
+    }
+    buf->set_host_dirty(false);
+    buf->set_device_dirty(false);
+    return result;
 }
 
 WEAK int halide_opencl_wrap_cl_mem(void *user_context, struct halide_buffer_t *buf, uint64_t mem) {
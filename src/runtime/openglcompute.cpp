@@ -124,6 +124,19 @@ WEAK bool GlobalState::CheckAndReportError(void *user_context, const char *locat
 
 WEAK GlobalState global_state;
 
+// glGetError() makes many drivers synchronize with the GPU, which
+// dominates the cost of a dispatch, so the steps of
+// halide_openglcompute_run are only checked individually in debug
+// runtimes. Otherwise the program and argument bindings are checked
+// together, before the dispatch, and the dispatch is checked after it.
+WEAK bool check_run_step(void *user_context, const char *location) {
+#ifdef DEBUG_RUNTIME
+    return global_state.CheckAndReportError(user_context, location);
+#else
+    return false;
+#endif
+}
+
 // A list of module-specific state. Each module corresponds to a single Halide filter
 WEAK ModuleState *state_list;
 
@@ -464,7 +477,7 @@ WEAK int halide_openglcompute_run(void *user_context, void *state_ptr,
     }
 
     global_state.UseProgram(kernel->program_id);
-    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run UseProgram")) {
+    if (check_run_step(user_context, "halide_openglcompute_run UseProgram")) {
         return -1;
     }
 
@@ -492,12 +505,12 @@ WEAK int halide_openglcompute_run(void *user_context, void *state_ptr,
                 if (arg_types[i].bits <= 16) {
                     float fp_val = value;
                     global_state.Uniform1f(i, fp_val);
-                    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run Uniform1f (int case)")) {
+                    if (check_run_step(user_context, "halide_openglcompute_run Uniform1f (int case)")) {
                         return -1;
                     }
                 } else {
                     global_state.Uniform1i(i, value);
-                    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run Uniform1i")) {
+                    if (check_run_step(user_context, "halide_openglcompute_run Uniform1i")) {
                         return -1;
                     }
                 }
@@ -516,12 +529,12 @@ WEAK int halide_openglcompute_run(void *user_context, void *state_ptr,
                 if (arg_types[i].bits <= 16) {
                     float fp_val = value;
                     global_state.Uniform1f(i, fp_val);
-                    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run Uniform1f (uint case)")) {
+                    if (check_run_step(user_context, "halide_openglcompute_run Uniform1f (uint case)")) {
                         return -1;
                     }
                 } else {
                     global_state.Uniform1ui(i, value);
-                    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run Uniform1ui")) {
+                    if (check_run_step(user_context, "halide_openglcompute_run Uniform1ui")) {
                         return -1;
                     }
                 }
@@ -534,7 +547,7 @@ WEAK int halide_openglcompute_run(void *user_context, void *state_ptr,
                   return -1;
                 }
                 global_state.Uniform1f(i, value);
-                if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run Uniform1f")) {
+                if (check_run_step(user_context, "halide_openglcompute_run Uniform1f")) {
                     return -1;
                 }
             } else {
@@ -546,17 +559,23 @@ WEAK int halide_openglcompute_run(void *user_context, void *state_ptr,
 
             GLuint the_buffer = (GLuint)arg_value;
             global_state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, i, the_buffer);
-            if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run BindBufferBase")) {
+            if (check_run_step(user_context, "halide_openglcompute_run BindBufferBase")) {
                 return -1;
             }
         }
         i++;
     }
+    // GL errors are sticky, so this catches a failure in any of the
+    // bindings above, and the kernel isn't dispatched with them.
+    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run bindings")) {
+        return -1;
+    }
     global_state.DispatchCompute(blocksX, blocksY, blocksZ);
-    if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run DispatchCompute")) {
+    if (check_run_step(user_context, "halide_openglcompute_run DispatchCompute")) {
         return -1;
     }
     global_state.MemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    // In release runtimes, this is also the check of the dispatch.
     if (global_state.CheckAndReportError(user_context, "halide_openglcompute_run MemoryBarrier")) {
         return -1;
     }
@@ -0,0 +1,155 @@
+#include "HalideRuntime.h"
+#include "printer.h"
+#include "scoped_mutex_lock.h"
+
+// The storage of the Funcs scheduled with Func::persist, which keeps
+// the last frames they computed across calls of the pipeline.
+namespace Halide { namespace Runtime { namespace Internal {
+
+struct PersistentStorage {
+    PersistentStorage *next;
+    char *name;
+    uint8_t *host;
+    uint64_t size;
+    int32_t *shape;
+    int32_t shape_size;
+    // The frames holding the values of the last calls, or an empty
+    // range if none do.
+    int32_t first_frame, last_frame;
+};
+
+WEAK PersistentStorage *persistent_storage = NULL;
+WEAK halide_mutex persistent_storage_lock = { { 0 } };
+
+WEAK void free_if_allocated(void *user_context, void *ptr) {
+    if (ptr != NULL) {
+        halide_free(user_context, ptr);
+    }
+}
+
+WEAK PersistentStorage *find_persistent_storage(const char *name) {
+    for (PersistentStorage *s = persistent_storage; s != NULL; s = s->next) {
+        if (strcmp(s->name, name) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK void *halide_persistent_storage_acquire(void *user_context, const char *name, uint64_t size,
+                                             const int32_t *shape, int32_t shape_size) {
+    debug(user_context) << "halide_persistent_storage_acquire " << name << " " << size << "\n";
+    ScopedMutexLock lock(&persistent_storage_lock);
+
+    PersistentStorage *s = find_persistent_storage(name);
+    if (s == NULL) {
+        s = (PersistentStorage *)halide_malloc(user_context, sizeof(PersistentStorage));
+        if (s == NULL) {
+            return NULL;
+        }
+        size_t name_size = strlen(name) + 1;
+        s->name = (char *)halide_malloc(user_context, name_size);
+        if (s->name == NULL) {
+            halide_free(user_context, s);
+            return NULL;
+        }
+        memcpy(s->name, name, name_size);
+        s->host = NULL;
+        s->size = 0;
+        s->shape = NULL;
+        s->shape_size = 0;
+        s->next = persistent_storage;
+        persistent_storage = s;
+    }
+
+    // A realization of another shape holds none of the frames of the
+    // last one.
+    bool same_shape = (s->host != NULL && s->size == size && s->shape_size == shape_size);
+    for (int32_t i = 0; same_shape && i < shape_size; i++) {
+        same_shape = (s->shape[i] == shape[i]);
+    }
+    if (!same_shape) {
+        free_if_allocated(user_context, s->host);
+        free_if_allocated(user_context, s->shape);
+        s->host = (uint8_t *)halide_malloc(user_context, size);
+        s->shape = (int32_t *)halide_malloc(user_context, shape_size * sizeof(int32_t));
+        if (s->host == NULL || s->shape == NULL) {
+            free_if_allocated(user_context, s->host);
+            free_if_allocated(user_context, s->shape);
+            s->host = NULL;
+            s->shape = NULL;
+            s->size = 0;
+            s->shape_size = 0;
+            return NULL;
+        }
+        memcpy(s->shape, shape, shape_size * sizeof(int32_t));
+        s->size = size;
+        s->shape_size = shape_size;
+        s->first_frame = 1;
+        s->last_frame = 0;
+    }
+    return s->host;
+}
+
+WEAK int32_t halide_persistent_storage_first_frame(void *user_context, const char *name) {
+    ScopedMutexLock lock(&persistent_storage_lock);
+    PersistentStorage *s = find_persistent_storage(name);
+    return s ? s->first_frame : 1;
+}
+
+WEAK int32_t halide_persistent_storage_last_frame(void *user_context, const char *name) {
+    ScopedMutexLock lock(&persistent_storage_lock);
+    PersistentStorage *s = find_persistent_storage(name);
+    return s ? s->last_frame : 0;
+}
+
+WEAK int halide_persistent_storage_set_frames(void *user_context, const char *name,
+                                              int32_t first_frame, int32_t last_frame) {
+    debug(user_context) << "halide_persistent_storage_set_frames " << name << " "
+                        << first_frame << " " << last_frame << "\n";
+    ScopedMutexLock lock(&persistent_storage_lock);
+    PersistentStorage *s = find_persistent_storage(name);
+    if (s == NULL) {
+        error(user_context) << "No persistent storage named " << name << "\n";
+        return halide_error_code_internal_error;
+    }
+    s->first_frame = first_frame;
+    s->last_frame = last_frame;
+    return 0;
+}
+
+WEAK void halide_persistent_storage_release(void *user_context, void *host) {
+    // The storage outlives the call of the pipeline.
+}
+
+WEAK void halide_persistent_storage_cleanup(void *user_context) {
+    debug(NULL) << "halide_persistent_storage_cleanup\n";
+    ScopedMutexLock lock(&persistent_storage_lock);
+    PersistentStorage *s = persistent_storage;
+    persistent_storage = NULL;
+    while (s != NULL) {
+        PersistentStorage *next = s->next;
+        free_if_allocated(user_context, s->host);
+        free_if_allocated(user_context, s->shape);
+        halide_free(user_context, s->name);
+        halide_free(user_context, s);
+        s = next;
+    }
+}
+
+namespace {
+
+__attribute__((destructor))
+WEAK void halide_persistent_storage_destructor() {
+    halide_persistent_storage_cleanup(NULL);
+}
+
+}
+
+}
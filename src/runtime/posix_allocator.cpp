@@ -1,5 +1,7 @@
 #include "HalideRuntime.h"
+#include "huge_pages.h"
 #include "runtime_internal.h"
+#include "scoped_mutex_lock.h"
 
 extern "C" {
 
@@ -56,3 +58,268 @@ WEAK void halide_free(void *user_context, void *ptr) {
 }
 
 }
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The pool allocator keeps freed blocks in caches of size classes (powers
+// of two from 64 bytes to 16 MB) and hands them out again, so that
+// pipelines that allocate the same scratch buffers on every invocation,
+// or in every iteration of a parallel loop, stop going through malloc.
+// There is no portable thread-local storage in the runtime, so threads
+// pick one of kPoolNumCaches caches by the address of their stack; each
+// cache has its own lock, which is then rarely contended.
+const int kPoolMinClassBits = 6;
+const int kPoolNumClasses = 19;
+const int kPoolNumCaches = 32;
+// Blocks kept per size class and cache. Blocks beyond this are freed.
+const int kPoolMaxCachedBlocks = 16;
+
+struct pool_header {
+    void *orig;
+    // -1 for allocations too large to be pooled.
+    int size_class;
+};
+
+struct pool_cache {
+    halide_mutex lock;
+    void *blocks[kPoolNumClasses];
+    int num_blocks[kPoolNumClasses];
+};
+
+WEAK pool_cache pool_caches[kPoolNumCaches];
+WEAK halide_pool_allocator_stats pool_stats;
+
+WEAK __attribute__((always_inline)) pool_header *get_pool_header(void *ptr) {
+    return ((pool_header *)ptr) - 1;
+}
+
+WEAK __attribute__((always_inline)) size_t pool_class_bytes(int size_class) {
+    return (size_t)1 << (size_class + kPoolMinClassBits);
+}
+
+WEAK int pool_size_class(size_t x) {
+    int c = 0;
+    while (c < kPoolNumClasses && pool_class_bytes(c) < x) {
+        c++;
+    }
+    return c < kPoolNumClasses ? c : -1;
+}
+
+WEAK pool_cache *current_pool_cache() {
+    // Stacks of different threads are far apart; hash the 64k region of
+    // the stack the caller is running in.
+    int marker;
+    uint64_t h = ((uint64_t)(size_t)&marker >> 16) * 0x9e3779b97f4a7c15ULL;
+    return &pool_caches[(h >> 32) % kPoolNumCaches];
+}
+
+// The huge page allocator gives allocations of at least
+// huge_page_min_bytes their own mapping backed by huge pages, and hands
+// everything smaller to the pool allocator. Mapping and unmapping
+// memory costs far more than malloc, so freed mappings are kept in a
+// small cache and reused by requests that fit them without wasting
+// more than half.
+const int kHugeNumCachedMappings = 8;
+
+// The size class in the pool_header of allocations made by the huge
+// page allocator. The header is preceded by the size of the mapping.
+const int kPoolHugeClass = -2;
+
+struct huge_header {
+    size_t bytes;
+    pool_header pool;
+};
+
+struct huge_mapping {
+    void *base;
+    size_t bytes;
+};
+
+WEAK size_t huge_page_min_bytes = huge_page_bytes;
+WEAK bool huge_page_use_reserved = false;
+WEAK halide_mutex huge_cache_lock;
+WEAK huge_mapping huge_cache[kHugeNumCachedMappings];
+
+WEAK void *pool_new_block(size_t bytes, int size_class) {
+    const size_t alignment = halide_malloc_alignment();
+    void *orig = malloc(bytes + alignment + sizeof(pool_header));
+    if (orig == NULL) {
+        return NULL;
+    }
+    void *ptr = (void *)(((size_t)orig + sizeof(pool_header) + alignment - 1) & ~(alignment - 1));
+    get_pool_header(ptr)->orig = orig;
+    get_pool_header(ptr)->size_class = size_class;
+    return ptr;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void *halide_pool_malloc(void *user_context, size_t x) {
+    int size_class = pool_size_class(x);
+    if (size_class < 0) {
+        __atomic_fetch_add(&pool_stats.num_unpooled, 1, __ATOMIC_RELAXED);
+        return pool_new_block(x, -1);
+    }
+    void *ptr = NULL;
+    pool_cache *cache = current_pool_cache();
+    {
+        ScopedMutexLock lock(&cache->lock);
+        ptr = cache->blocks[size_class];
+        if (ptr) {
+            cache->blocks[size_class] = *(void **)ptr;
+            cache->num_blocks[size_class]--;
+        }
+    }
+    if (ptr) {
+        __atomic_fetch_add(&pool_stats.num_hits, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&pool_stats.bytes_cached, (uint64_t)pool_class_bytes(size_class), __ATOMIC_RELAXED);
+        return ptr;
+    }
+    __atomic_fetch_add(&pool_stats.num_misses, 1, __ATOMIC_RELAXED);
+    return pool_new_block(pool_class_bytes(size_class), size_class);
+}
+
+WEAK void halide_pool_free(void *user_context, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    pool_header *header = get_pool_header(ptr);
+    int size_class = header->size_class;
+    if (size_class >= 0) {
+        pool_cache *cache = current_pool_cache();
+        ScopedMutexLock lock(&cache->lock);
+        if (cache->num_blocks[size_class] < kPoolMaxCachedBlocks) {
+            *(void **)ptr = cache->blocks[size_class];
+            cache->blocks[size_class] = ptr;
+            cache->num_blocks[size_class]++;
+            __atomic_fetch_add(&pool_stats.bytes_cached, (uint64_t)pool_class_bytes(size_class), __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    free(header->orig);
+}
+
+WEAK void halide_pool_allocator_trim(void *user_context) {
+    for (int i = 0; i < kPoolNumCaches; i++) {
+        pool_cache *cache = &pool_caches[i];
+        ScopedMutexLock lock(&cache->lock);
+        for (int c = 0; c < kPoolNumClasses; c++) {
+            void *ptr = cache->blocks[c];
+            while (ptr) {
+                void *next = *(void **)ptr;
+                __atomic_fetch_sub(&pool_stats.bytes_cached, (uint64_t)pool_class_bytes(c), __ATOMIC_RELAXED);
+                free(get_pool_header(ptr)->orig);
+                ptr = next;
+            }
+            cache->blocks[c] = NULL;
+            cache->num_blocks[c] = 0;
+        }
+    }
+
+    ScopedMutexLock lock(&huge_cache_lock);
+    for (int i = 0; i < kHugeNumCachedMappings; i++) {
+        if (huge_cache[i].base) {
+            __atomic_fetch_sub(&pool_stats.bytes_cached, (uint64_t)huge_cache[i].bytes, __ATOMIC_RELAXED);
+            unmap_huge_pages(huge_cache[i].base, huge_cache[i].bytes);
+            huge_cache[i].base = NULL;
+        }
+    }
+}
+
+WEAK void halide_huge_page_allocator_configure(size_t min_bytes, bool use_reserved) {
+    huge_page_min_bytes = min_bytes;
+    huge_page_use_reserved = use_reserved;
+}
+
+WEAK void *halide_huge_page_malloc(void *user_context, size_t x) {
+    if (x < huge_page_min_bytes) {
+        return halide_pool_malloc(user_context, x);
+    }
+
+    // Leave room for the header in front of the aligned pointer.
+    const size_t alignment = halide_malloc_alignment();
+    size_t bytes = (x + alignment + huge_page_bytes - 1) & ~(huge_page_bytes - 1);
+    void *base = NULL;
+    {
+        ScopedMutexLock lock(&huge_cache_lock);
+        int best = -1;
+        for (int i = 0; i < kHugeNumCachedMappings; i++) {
+            size_t b = huge_cache[i].bytes;
+            if (huge_cache[i].base && b >= bytes && b / 2 <= bytes &&
+                (best < 0 || b < huge_cache[best].bytes)) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            base = huge_cache[best].base;
+            bytes = huge_cache[best].bytes;
+            huge_cache[best].base = NULL;
+        }
+    }
+    if (base) {
+        __atomic_fetch_add(&pool_stats.num_hits, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&pool_stats.bytes_cached, (uint64_t)bytes, __ATOMIC_RELAXED);
+    } else {
+        base = map_huge_pages(bytes, huge_page_use_reserved);
+        if (base == NULL) {
+            // No huge pages to be had on this platform, or out of
+            // address space. Fall back to malloc.
+            __atomic_fetch_add(&pool_stats.num_unpooled, 1, __ATOMIC_RELAXED);
+            return pool_new_block(x, -1);
+        }
+        __atomic_fetch_add(&pool_stats.num_misses, 1, __ATOMIC_RELAXED);
+    }
+
+    void *ptr = (uint8_t *)base + alignment;
+    huge_header *header = ((huge_header *)ptr) - 1;
+    header->bytes = bytes;
+    header->pool.orig = base;
+    header->pool.size_class = kPoolHugeClass;
+    return ptr;
+}
+
+WEAK void halide_huge_page_free(void *user_context, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (get_pool_header(ptr)->size_class != kPoolHugeClass) {
+        halide_pool_free(user_context, ptr);
+        return;
+    }
+
+    huge_header *header = ((huge_header *)ptr) - 1;
+    void *base = header->pool.orig;
+    size_t bytes = header->bytes;
+    {
+        ScopedMutexLock lock(&huge_cache_lock);
+        for (int i = 0; i < kHugeNumCachedMappings; i++) {
+            if (huge_cache[i].base == NULL) {
+                huge_cache[i].base = base;
+                huge_cache[i].bytes = bytes;
+                __atomic_fetch_add(&pool_stats.bytes_cached, (uint64_t)bytes, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+    }
+    unmap_huge_pages(base, bytes);
+}
+
+WEAK void halide_pool_allocator_get_stats(void *user_context, halide_pool_allocator_stats *stats) {
+    stats->num_hits = __atomic_load_n(&pool_stats.num_hits, __ATOMIC_RELAXED);
+    stats->num_misses = __atomic_load_n(&pool_stats.num_misses, __ATOMIC_RELAXED);
+    stats->num_unpooled = __atomic_load_n(&pool_stats.num_unpooled, __ATOMIC_RELAXED);
+    stats->bytes_cached = __atomic_load_n(&pool_stats.bytes_cached, __ATOMIC_RELAXED);
+}
+
+namespace {
+
+__attribute__((destructor))
+WEAK void halide_pool_allocator_cleanup() {
+    halide_pool_allocator_trim(NULL);
+}
+
+}
+
+}
@@ -1,5 +1,6 @@
 #include "HalideRuntime.h"
 #include "runtime_internal.h"
+#include "scoped_mutex_lock.h"
 
 // TODO: consider getting rid of this
 #define MAX_THREADS 256
@@ -29,6 +30,14 @@ extern int pthread_mutex_init(pthread_mutex_t *mutex, const void *attr);
 extern int pthread_mutex_lock(pthread_mutex_t *mutex);
 extern int pthread_mutex_unlock(pthread_mutex_t *mutex);
 extern int pthread_mutex_destroy(pthread_mutex_t *mutex);
+// Large enough for any platform's struct sched_param, which begins with
+// the priority.
+struct sched_param_t {
+    int sched_priority;
+    char padding[60];
+};
+extern void *pthread_self();
+extern int pthread_setschedparam(pthread_t thread, int policy, const sched_param_t *param);
 
 } // extern "C"
 
@@ -127,4 +136,111 @@ struct thread_parker {
 
 #include "synchronization_common.h"
 
+namespace Halide { namespace Runtime { namespace Internal {
+
+// With HL_NUMA=1 on Linux, the workers of the thread pool are pinned to the
+// CPUs of the NUMA nodes, filling one node before moving to the next. A
+// worker then keeps running on the node where the pages it first touched
+// (e.g. those of the buffers allocated in its tasks) live. Otherwise
+// threads are placed by the OS.
+WEAK int numa_cpus[MAX_THREADS];
+WEAK int numa_num_cpus = 0;
+
+typedef int (*sched_setaffinity_t)(int, size_t, const void *);
+WEAK sched_setaffinity_t numa_set_affinity = NULL;
+
+// Append the CPUs of a Linux cpu list (e.g. "0-7,16-23") to numa_cpus.
+WEAK void numa_add_cpu_list(const char *list) {
+    const char *p = list;
+    while (*p >= '0' && *p <= '9') {
+        int first = atoi(p), last = first;
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (*p == '-') {
+            p++;
+            last = atoi(p);
+            while (*p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+        for (int cpu = first; cpu <= last && numa_num_cpus < MAX_THREADS; cpu++) {
+            numa_cpus[numa_num_cpus++] = cpu;
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+}
+
+WEAK halide_mutex numa_mutex = { { 0 } };
+WEAK bool numa_initialized = false;
+
+// Called when a work queue is initialized, before its workers are
+// spawned. Each thread pool calls it, so the CPUs are only read once.
+WEAK void init_worker_binding() {
+    ScopedMutexLock lock(&numa_mutex);
+    if (numa_initialized) {
+        return;
+    }
+    numa_initialized = true;
+    const char *numa = getenv("HL_NUMA");
+    if (!numa || atoi(numa) == 0) {
+        return;
+    }
+    // Only Linux has sched_setaffinity.
+    numa_set_affinity = (sched_setaffinity_t)halide_get_symbol("sched_setaffinity");
+    if (!numa_set_affinity) {
+        return;
+    }
+    for (int node = 0; node < 64; node++) {
+        char path[64];
+        char *end = path + sizeof(path);
+        char *dst = halide_string_to_string(path, end, "/sys/devices/system/node/node");
+        dst = halide_int64_to_string(dst, end, node, 1);
+        halide_string_to_string(dst, end, "/cpulist");
+        void *file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        char list[1024];
+        size_t size = fread(list, 1, sizeof(list) - 1, file);
+        fclose(file);
+        list[size] = 0;
+        numa_add_cpu_list(list);
+    }
+}
+
+WEAK void bind_worker_thread(int index) {
+    if (numa_num_cpus == 0) {
+        return;
+    }
+    int cpu = numa_cpus[index % numa_num_cpus];
+    uint64_t mask[16] = {0};
+    if (cpu >= (int)(sizeof(mask) * 8)) {
+        return;
+    }
+    mask[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+    // A pid of 0 is the calling thread.
+    numa_set_affinity(0, sizeof(mask), mask);
+}
+
+// Positive priorities are real-time priorities. SCHED_FIFO is 1 on Linux,
+// where this usually needs CAP_SYS_NICE; the worker keeps its priority if
+// the call fails.
+WEAK void set_worker_priority(int priority) {
+    if (priority > 0) {
+        sched_param_t param = {};
+        param.sched_priority = priority;
+        pthread_setschedparam((pthread_t)pthread_self(), 1, &param);
+    }
+}
+
+// The thread of the events of the thread pool timeline.
+WEAK uint64_t current_thread_id() {
+    return (uint64_t)(uintptr_t)pthread_self();
+}
+
+}}} // namespace Halide::Runtime::Internal
+
 #include "thread_pool_common.h"
@@ -1,4 +1,5 @@
 #include "HalideRuntime.h"
+#include "hardware_counters.h"
 #include "printer.h"
 #include "scoped_mutex_lock.h"
 
@@ -9,7 +10,7 @@
 extern "C" {
 // Returns the address of the global halide_profiler state
 WEAK halide_profiler_state *halide_profiler_get_state() {
-    static halide_profiler_state s = {{{0}}, 1, 0, 0, 0, 0, NULL, NULL};
+    static halide_profiler_state s = {{{0}}, 1, 0, halide_profiler_outside_of_halide, 0, NULL, NULL, NULL};
     return &s;
 }
 }
@@ -45,6 +46,8 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     p->num_allocs = 0;
     p->active_threads_numerator = 0;
     p->active_threads_denominator = 0;
+    memset(&p->latency, 0, sizeof(p->latency));
+    memset(&p->memory, 0, sizeof(p->memory));
     p->funcs = (halide_profiler_func_stats *)malloc(num_funcs * sizeof(halide_profiler_func_stats));
     if (!p->funcs) {
         free(p);
@@ -60,13 +63,25 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        p->funcs[i].device_time = 0;
+        p->funcs[i].device_kernels = 0;
+        p->funcs[i].device_occupancy = 0;
+        p->funcs[i].bytes_copied_to_device = 0;
+        p->funcs[i].bytes_copied_to_host = 0;
+        p->funcs[i].cycles = 0;
+        p->funcs[i].instructions = 0;
+        p->funcs[i].llc_misses = 0;
+        p->funcs[i].vector_instructions = 0;
+        memset(&p->funcs[i].latency, 0, sizeof(p->funcs[i].latency));
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+// Find the stats of a func id, and its pipeline. The state must be locked.
+WEAK halide_profiler_func_stats *find_func(halide_profiler_state *s, int func_id,
+                                           halide_profiler_pipeline_stats **pipeline) {
     halide_profiler_pipeline_stats *p_prev = NULL;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -77,19 +92,35 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
                 p->next = s->pipelines;
                 s->pipelines = p;
             }
-            halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
-            f->time += time;
-            f->active_threads_numerator += active_threads;
-            f->active_threads_denominator += 1;
-            p->time += time;
-            p->samples++;
-            p->active_threads_numerator += active_threads;
-            p->active_threads_denominator += 1;
-            return;
+            *pipeline = p;
+            return p->funcs + func_id - p->first_func_id;
         }
         p_prev = p;
     }
-    // Someone must have called reset_state while a kernel was running. Do nothing.
+    return NULL;
+}
+
+WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads,
+                    const uint64_t *counters) {
+    halide_profiler_pipeline_stats *p = NULL;
+    halide_profiler_func_stats *f = find_func(s, func_id, &p);
+    if (f == NULL) {
+        // Someone must have called reset_state while a kernel was running. Do nothing.
+        return;
+    }
+    if (counters) {
+        f->cycles += counters[hardware_counter_cycles];
+        f->instructions += counters[hardware_counter_instructions];
+        f->llc_misses += counters[hardware_counter_llc_misses];
+        f->vector_instructions += counters[hardware_counter_vector_instructions];
+    }
+    f->time += time;
+    f->active_threads_numerator += active_threads;
+    f->active_threads_denominator += 1;
+    p->time += time;
+    p->samples++;
+    p->active_threads_numerator += active_threads;
+    p->active_threads_denominator += 1;
 }
 
 WEAK void sampling_profiler_thread(void *) {
@@ -98,13 +129,22 @@ WEAK void sampling_profiler_thread(void *) {
     // grab the lock
     halide_mutex_lock(&s->lock);
 
+    // The counters are read at each sample, and their increments billed
+    // like the time.
+    bool counting = start_hardware_counters();
+    uint64_t counters[num_hardware_counters], counters_now[num_hardware_counters];
+    if (counting) {
+        read_hardware_counters(counters);
+    }
+
     while (s->current_func != halide_profiler_please_stop) {
 
         uint64_t t1 = halide_current_time_ns(NULL);
         uint64_t t = t1;
         while (1) {
             int func, active_threads;
-            if (s->get_remote_profiler_state) {
+            bool remote = s->get_remote_profiler_state != NULL;
+            if (remote) {
                 // Execution has disappeared into remote code running
                 // on an accelerator (e.g. Hexagon DSP)
                 s->get_remote_profiler_state(&func, &active_threads);
@@ -115,10 +155,21 @@ WEAK void sampling_profiler_thread(void *) {
             uint64_t t_now = halide_current_time_ns(NULL);
             if (func == halide_profiler_please_stop) {
                 break;
-            } else if (func >= 0) {
+            }
+            const uint64_t *counter_increments = NULL;
+            if (counting && !remote) {
+                read_hardware_counters(counters_now);
+                for (int i = 0; i < num_hardware_counters; i++) {
+                    uint64_t increment = counters_now[i] - counters[i];
+                    counters[i] = counters_now[i];
+                    counters_now[i] = increment;
+                }
+                counter_increments = counters_now;
+            }
+            if (func >= 0) {
                 // Assume all time since I was last awake is due to
                 // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                bill_func(s, func, t_now - t, active_threads, counter_increments);
             }
             t = t_now;
 
@@ -130,6 +181,10 @@ WEAK void sampling_profiler_thread(void *) {
         }
     }
 
+    if (counting) {
+        stop_hardware_counters();
+    }
+
     halide_mutex_unlock(&s->lock);
 }
 
@@ -149,6 +204,42 @@ void sync_compare_max_and_swap(T *ptr, T val) {
     }
 }
 
+// The histogram bucket for a value: the values below four get a
+// bucket each, and each power of two above that is split in four.
+int histogram_bucket(uint64_t value) {
+    if (value < 4) {
+        return (int)value;
+    }
+    int log2 = 63 - __builtin_clzll(value);
+    return 4 * (log2 - 1) + (int)((value >> (log2 - 2)) & 3);
+}
+
+// The largest value that falls in a histogram bucket.
+uint64_t histogram_bucket_max(int bucket) {
+    if (bucket < 4) {
+        return (uint64_t)bucket;
+    }
+    int log2 = bucket / 4 + 1;
+    uint64_t min = (uint64_t)(4 + bucket % 4) << (log2 - 2);
+    return min + ((uint64_t)1 << (log2 - 2)) - 1;
+}
+
+void histogram_record(halide_profiler_histogram *h, uint64_t value) {
+    __sync_add_and_fetch(&h->count, 1);
+    __sync_add_and_fetch(&h->sum, value);
+    sync_compare_max_and_swap(&h->max, value);
+    __sync_add_and_fetch(&h->buckets[histogram_bucket(value)], 1);
+}
+
+// The per-run state of a pipeline compiled with profile_metrics,
+// allocated on the pipeline's stack.
+struct metrics_instance {
+    halide_profiler_pipeline_stats *pipeline;
+    uint64_t start_time;
+    uint64_t memory_current;
+    uint64_t memory_peak;
+};
+
 }
 
 extern "C" {
@@ -166,9 +257,112 @@ WEAK halide_profiler_pipeline_stats *halide_profiler_get_pipeline_state(const ch
             return p;
         }
     }
+    // Callers outside the pipeline (e.g. something scraping the
+    // metrics) will have a different copy of the name.
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (strcmp(p->name, pipeline_name) == 0) {
+            return p;
+        }
+    }
     return NULL;
 }
 
+WEAK uint64_t halide_profiler_histogram_percentile(const halide_profiler_histogram *histogram,
+                                                   float percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    // The rank of the value we want, counting from one.
+    uint64_t rank = (uint64_t)(percentile * 0.01f * histogram->count + 0.5f);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HALIDE_PROFILER_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t result = histogram_bucket_max(i);
+            return result < histogram->max ? result : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+WEAK void halide_profiler_reset_metrics() {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        memset(&p->latency, 0, sizeof(p->latency));
+        memset(&p->memory, 0, sizeof(p->memory));
+        for (int i = 0; i < p->num_funcs; i++) {
+            memset(&p->funcs[i].latency, 0, sizeof(p->funcs[i].latency));
+        }
+    }
+}
+
+// Called at the start of each run of a pipeline compiled with
+// profile_metrics. The instance is scratch space of four uint64_t on
+// the pipeline's stack, which the other metrics calls update.
+WEAK int halide_profiler_metrics_start(void *user_context,
+                                       const char *pipeline_name,
+                                       int num_funcs,
+                                       const uint64_t *func_names,
+                                       void *instance) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    metrics_instance *m = (metrics_instance *)instance;
+
+    halide_profiler_pipeline_stats *p;
+    {
+        ScopedMutexLock lock(&s->lock);
+        p = find_or_create_pipeline(pipeline_name, num_funcs, func_names);
+    }
+    if (!p) {
+        return halide_error_out_of_memory(user_context);
+    }
+
+    halide_start_clock(user_context);
+    m->pipeline = p;
+    m->memory_current = 0;
+    m->memory_peak = 0;
+    m->start_time = halide_current_time_ns(user_context);
+    return 0;
+}
+
+WEAK int halide_profiler_metrics_end(void *user_context, void *instance) {
+    metrics_instance *m = (metrics_instance *)instance;
+    uint64_t t = halide_current_time_ns(user_context);
+    histogram_record(&m->pipeline->latency, t - m->start_time);
+    histogram_record(&m->pipeline->memory, m->memory_peak);
+    return 0;
+}
+
+// Record the time taken by one realization of a Func, which started
+// computing at start_time.
+WEAK int halide_profiler_metrics_func_end(void *user_context, void *instance,
+                                          int func_id, uint64_t start_time) {
+    metrics_instance *m = (metrics_instance *)instance;
+    uint64_t t = halide_current_time_ns(user_context);
+    halide_assert(user_context, func_id >= 0 && func_id < m->pipeline->num_funcs);
+    histogram_record(&m->pipeline->funcs[func_id].latency, t - start_time);
+    return 0;
+}
+
+WEAK int halide_profiler_metrics_memory_allocate(void *user_context, void *instance, uint64_t incr) {
+    metrics_instance *m = (metrics_instance *)instance;
+    // Allocations may be made by several threads at once.
+    uint64_t current = __sync_add_and_fetch(&m->memory_current, incr);
+    sync_compare_max_and_swap(&m->memory_peak, current);
+    return 0;
+}
+
+WEAK int halide_profiler_metrics_memory_free(void *user_context, void *instance, uint64_t decr) {
+    metrics_instance *m = (metrics_instance *)instance;
+    __sync_sub_and_fetch(&m->memory_current, decr);
+    return 0;
+}
+
 // Returns a token identifying this pipeline instance.
 WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const char *pipeline_name,
@@ -280,6 +474,32 @@ WEAK void halide_profiler_memory_free(void *user_context,
     __sync_sub_and_fetch(&f_stats->memory_current, decr);
 }
 
+WEAK void halide_profiler_device_kernel(void *user_context, uint64_t time, int occupancy) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    halide_profiler_pipeline_stats *p = NULL;
+    halide_profiler_func_stats *f = find_func(s, s->current_func, &p);
+    if (f) {
+        f->device_time += time;
+        f->device_kernels++;
+        f->device_occupancy += occupancy;
+    }
+}
+
+WEAK void halide_profiler_device_copy(void *user_context, uint64_t bytes, bool to_host) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    halide_profiler_pipeline_stats *p = NULL;
+    halide_profiler_func_stats *f = find_func(s, s->current_func, &p);
+    if (f) {
+        if (to_host) {
+            f->bytes_copied_to_host += bytes;
+        } else {
+            f->bytes_copied_to_device += bytes;
+        }
+    }
+}
+
 WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_state *s) {
 
     char line_buf[1024];
@@ -312,7 +532,8 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
         if (!print_f_states) {
             for (int i = 0; i < p->num_funcs; i++) {
                 halide_profiler_func_stats *fs = p->funcs + i;
-                if (fs->stack_peak) {
+                if (fs->stack_peak || fs->device_kernels || fs->cycles ||
+                    fs->bytes_copied_to_device || fs->bytes_copied_to_host) {
                     print_f_states = true;
                     break;
                 }
@@ -374,6 +595,27 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (fs->device_kernels) {
+                    float dt = fs->device_time / (p->runs * 1000000.0f);
+                    sstr << " device: " << dt;
+                    sstr.erase(3);
+                    sstr << "ms kernels: " << (int)(fs->device_kernels / p->runs)
+                         << " occupancy: " << (int)(fs->device_occupancy / (10 * fs->device_kernels)) << "%";
+                }
+                if (fs->cycles) {
+                    float ipc = fs->instructions / (float)fs->cycles;
+                    sstr << " cycles: " << fs->cycles / p->runs
+                         << " ipc: " << ipc;
+                    sstr.erase(4);
+                    sstr << " llc misses: " << fs->llc_misses / p->runs;
+                    if (fs->vector_instructions) {
+                        sstr << " vector: " << fs->vector_instructions / p->runs;
+                    }
+                }
+                if (fs->bytes_copied_to_device || fs->bytes_copied_to_host) {
+                    sstr << " copied in: " << fs->bytes_copied_to_device / p->runs
+                         << " out: " << fs->bytes_copied_to_host / p->runs;
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
@@ -389,6 +631,41 @@ WEAK void halide_profiler_report(void *user_context) {
 }
 
 
+WEAK int halide_profiler_save_unlocked(void *user_context, halide_profiler_state *s, const char *filename) {
+    void *file = fopen(filename, "w");
+    if (!file) {
+        error(user_context) << "Failed to open profile file " << filename << "\n";
+        return -1;
+    }
+
+    char line_buf[1024];
+    Printer<StringStreamPrinter, sizeof(line_buf)> sstr(user_context, line_buf);
+    sstr << "# pipeline func ms_per_run average_threads\n";
+    fwrite(sstr.str(), 1, sstr.size(), file);
+
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (!p->runs) continue;
+        // The first func is the overhead slot.
+        for (int i = 1; i < p->num_funcs; i++) {
+            halide_profiler_func_stats *fs = p->funcs + i;
+            double threads = fs->active_threads_numerator / (fs->active_threads_denominator + 1e-10);
+            sstr.clear();
+            sstr << p->name << " " << fs->name << " "
+                 << fs->time / (p->runs * 1000000.0) << " " << threads << "\n";
+            fwrite(sstr.str(), 1, sstr.size(), file);
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+WEAK int halide_profiler_save(void *user_context, const char *filename) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    return halide_profiler_save_unlocked(user_context, s, filename);
+}
+
 WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
     while (s->pipelines) {
         halide_profiler_pipeline_stats *p = s->pipelines;
@@ -426,6 +703,9 @@ WEAK void halide_profiler_shutdown() {
     // Print results. No need to lock anything because we just shut
     // down the thread.
     halide_profiler_report_unlocked(NULL, s);
+    if (const char *filename = getenv("HL_PROFILER_FILE")) {
+        halide_profiler_save_unlocked(NULL, s, filename);
+    }
 
     halide_profiler_reset_unlocked(s);
 }
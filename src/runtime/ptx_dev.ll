@@ -341,6 +341,66 @@ define weak_odr i32 @halide_gpu_thread_barrier() nounwind uwtable alwaysinline {
        ret i32 0
 }
 
+; The barrier across the grid of a persistent kernel, whose blocks must
+; all be resident. The first thread of each block counts its arrival,
+; and the last block to arrive resets the count and starts the next
+; generation, which the other blocks wait for. The count returns to zero
+; at every barrier, so the state is shared by all the kernels of the
+; module, which run one at a time on a stream.
+@halide_gpu_grid_barrier_count = weak addrspace(1) global i32 0
+@halide_gpu_grid_barrier_generation = weak addrspace(1) global i32 0
+
+declare void @llvm.nvvm.membar.gl()
+
+define weak_odr i32 @halide_gpu_grid_blocks() nounwind uwtable readnone alwaysinline {
+       %x = tail call i32 @llvm.nvvm.read.ptx.sreg.nctaid.x()
+       %y = tail call i32 @llvm.nvvm.read.ptx.sreg.nctaid.y()
+       %z = tail call i32 @llvm.nvvm.read.ptx.sreg.nctaid.z()
+       %xy = mul i32 %x, %y
+       %xyz = mul i32 %xy, %z
+       ret i32 %xyz
+}
+
+define weak_odr i32 @halide_gpu_grid_barrier() nounwind uwtable alwaysinline {
+entry:
+       call void @llvm.nvvm.barrier0() nounwind
+       %tx = tail call i32 @llvm.nvvm.read.ptx.sreg.tid.x()
+       %ty = tail call i32 @llvm.nvvm.read.ptx.sreg.tid.y()
+       %tz = tail call i32 @llvm.nvvm.read.ptx.sreg.tid.z()
+       %txy = or i32 %tx, %ty
+       %txyz = or i32 %txy, %tz
+       %first_thread = icmp eq i32 %txyz, 0
+       br i1 %first_thread, label %arrive, label %done
+
+arrive:
+       %generation = load volatile i32, i32 addrspace(1)* @halide_gpu_grid_barrier_generation, align 4
+       call void @llvm.nvvm.membar.gl()
+       %arrived = atomicrmw add i32 addrspace(1)* @halide_gpu_grid_barrier_count, i32 1 seq_cst
+       %blocks = call i32 @halide_gpu_grid_blocks()
+       %last_block = sub i32 %blocks, 1
+       %is_last = icmp eq i32 %arrived, %last_block
+       br i1 %is_last, label %release, label %wait
+
+release:
+       store volatile i32 0, i32 addrspace(1)* @halide_gpu_grid_barrier_count, align 4
+       call void @llvm.nvvm.membar.gl()
+       %ignored = atomicrmw add i32 addrspace(1)* @halide_gpu_grid_barrier_generation, i32 1 seq_cst
+       br label %leave
+
+wait:
+       %current = load volatile i32, i32 addrspace(1)* @halide_gpu_grid_barrier_generation, align 4
+       %waiting = icmp eq i32 %current, %generation
+       br i1 %waiting, label %wait, label %leave
+
+leave:
+       call void @llvm.nvvm.membar.gl()
+       br label %done
+
+done:
+       call void @llvm.nvvm.barrier0() nounwind
+       ret i32 0
+}
+
 define weak_odr i32 @halide_ptx_trap() nounwind uwtable alwaysinline {
        tail call void asm sideeffect "
        trap;
@@ -2,11 +2,36 @@
 #include "HalideRuntimeQurt.h"
 #include "printer.h"
 #include "mini_qurt.h"
+#include "scoped_spin_lock.h"
 
 using namespace Halide::Runtime::Internal::Qurt;
 
 extern "C" {
 
+// The VTCM manager lives in the HAP libraries, which aren't present
+// on every device or on the simulator, so we only link to it weakly.
+extern void *HAP_request_VTCM(unsigned int size, unsigned int single_page_flag) __attribute__((weak));
+extern int HAP_release_VTCM(void *ptr) __attribute__((weak));
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal { namespace Qurt {
+
+// The live allocations made in VTCM, so that we can tell them apart
+// from allocations that fell back to DDR.
+struct vtcm_block {
+    uint8_t *ptr;
+    int size;
+};
+
+const int max_vtcm_blocks = 16;
+WEAK vtcm_block vtcm_blocks[max_vtcm_blocks];
+WEAK volatile int vtcm_lock = 0;
+
+}}}}  // namespace Halide::Runtime::Internal::Qurt
+
+extern "C" {
+
 WEAK int halide_qurt_hvx_lock(void *user_context, int size) {
     qurt_hvx_mode_t mode;
     switch (size) {
@@ -43,6 +68,67 @@ WEAK void halide_qurt_hvx_unlock_as_destructor(void *user_context, void * /*obj*
     halide_qurt_hvx_unlock(user_context);
 }
 
+WEAK void *halide_vtcm_malloc(void *user_context, int size) {
+    if (size <= 0) {
+        return NULL;
+    }
+
+    if (HAP_request_VTCM) {
+        ScopedSpinLock lock(&vtcm_lock);
+        for (int i = 0; i < max_vtcm_blocks; i++) {
+            if (vtcm_blocks[i].ptr == NULL) {
+                // Ask for a single page, so the allocation is
+                // contiguous and can be addressed by vgather.
+                void *ptr = HAP_request_VTCM(size, 1);
+                debug(user_context) << "QuRT: HAP_request_VTCM(" << size << ") -> " << ptr << "\n";
+                if (ptr) {
+                    vtcm_blocks[i].ptr = (uint8_t *)ptr;
+                    vtcm_blocks[i].size = size;
+                    return ptr;
+                }
+                break;
+            }
+        }
+    }
+
+    // No VTCM available, fall back to DDR.
+    debug(user_context) << "QuRT: VTCM allocation of " << size << " bytes falling back to halide_malloc\n";
+    return halide_malloc(user_context, size);
+}
+
+WEAK void halide_vtcm_free(void *user_context, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    {
+        ScopedSpinLock lock(&vtcm_lock);
+        for (int i = 0; i < max_vtcm_blocks; i++) {
+            if (vtcm_blocks[i].ptr == ptr) {
+                debug(user_context) << "QuRT: HAP_release_VTCM(" << ptr << ")\n";
+                HAP_release_VTCM(ptr);
+                vtcm_blocks[i].ptr = NULL;
+                vtcm_blocks[i].size = 0;
+                return;
+            }
+        }
+    }
+
+    halide_free(user_context, ptr);
+}
+
+WEAK int halide_vtcm_contains(const void *ptr) {
+    const uint8_t *p = (const uint8_t *)ptr;
+    ScopedSpinLock lock(&vtcm_lock);
+    for (int i = 0; i < max_vtcm_blocks; i++) {
+        const vtcm_block &b = vtcm_blocks[i];
+        if (b.ptr && b.ptr <= p && p < b.ptr + b.size) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 // These need to inline, otherwise the extern call with the ptr
 // parameter breaks a lot of optimizations.
 __attribute__((always_inline))
@@ -70,6 +156,47 @@ WEAK int _halide_prefetch(const void *ptr, int size) {
     return 0;
 }
 
+WEAK int halide_hexagon_dma_copy_2d(void *dst, int dst_stride_bytes,
+                                    const void *src, int src_stride_bytes,
+                                    int width_bytes, int height) {
+    if (width_bytes <= 0 || height <= 0) {
+        return 0;
+    }
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    if (height == 1) {
+        src_stride_bytes = width_bytes;
+    }
+
+    // The fields of an l2fetch descriptor are 16 bits wide, so rows
+    // that are wider or further apart are copied without prefetching.
+    const int max_field = 0xffff;
+    bool prefetch = (width_bytes <= max_field &&
+                     src_stride_bytes > 0 && src_stride_bytes <= max_field);
+
+    // Prefetch the next block of rows (about 32KB) while copying the
+    // current one.
+    int block_rows = width_bytes < (32 * 1024) ? (32 * 1024) / width_bytes : 1;
+    if (block_rows > max_field) {
+        block_rows = max_field;
+    }
+    if (prefetch) {
+        int rows = height < block_rows ? height : block_rows;
+        _halide_prefetch_2d(s, width_bytes, rows, src_stride_bytes);
+    }
+    for (int y = 0; y < height; y += block_rows) {
+        int rows = height - y < block_rows ? height - y : block_rows;
+        if (prefetch && y + rows < height) {
+            int next_rows = height - y - rows < block_rows ? height - y - rows : block_rows;
+            _halide_prefetch_2d(s + (y + rows) * src_stride_bytes, width_bytes, next_rows, src_stride_bytes);
+        }
+        for (int r = y; r < y + rows; r++) {
+            memcpy(d + r * dst_stride_bytes, s + r * src_stride_bytes, width_bytes);
+        }
+    }
+    return 0;
+}
+
 struct hexagon_buffer_t_arg {
     uint64_t device;
     uint8_t* host;
@@ -113,4 +113,19 @@ struct thread_parker {
 
 #include "synchronization_common.h"
 
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Threads are placed by the OS.
+WEAK void init_worker_binding() {}
+WEAK void bind_worker_thread(int index) {}
+
+// Workers keep the priority they are spawned with.
+WEAK void set_worker_priority(int priority) {}
+
+WEAK uint64_t current_thread_id() {
+    return qurt_thread_get_id();
+}
+
+}}} // namespace Halide::Runtime::Internal
+
 #include "thread_pool_common.h"
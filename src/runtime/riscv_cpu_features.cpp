@@ -0,0 +1,25 @@
+#include "HalideRuntime.h"
+#include "cpu_features.h"
+
+#define AT_HWCAP    16
+
+// The single-letter extensions, one bit per letter.
+#define COMPAT_HWCAP_ISA_V  (1 << ('V' - 'A'))
+
+extern "C" unsigned long int getauxval(unsigned long int);
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK CpuFeatures halide_get_cpu_features() {
+    CpuFeatures features;
+    features.set_known(halide_target_feature_rvv);
+
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+
+    if (hwcap & COMPAT_HWCAP_ISA_V) {
+        features.set_available(halide_target_feature_rvv);
+    }
+    return features;
+}
+
+}}} // namespace Halide::Runtime::Internal
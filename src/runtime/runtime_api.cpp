@@ -28,15 +28,29 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_copy_to_host,
     (void *)&halide_copy_to_host_legacy,
     (void *)&halide_create_temp_file,
+    (void *)&halide_create_thread_pool,
+    (void *)&halide_cublas_gemm,
     (void *)&halide_cuda_detach_device_ptr,
     (void *)&halide_cuda_device_interface,
+    (void *)&halide_cuda_get_allocator_stats,
     (void *)&halide_cuda_get_device_ptr,
+    (void *)&halide_cuda_graph_begin,
+    (void *)&halide_cuda_graph_end,
     (void *)&halide_cuda_initialize_kernels,
+    (void *)&halide_cuda_release_unused_device_allocations,
     (void *)&halide_cuda_run,
+    (void *)&halide_cuda_run_cooperative,
+    (void *)&halide_cuda_set_async_copies,
+    (void *)&halide_cuda_set_managed_memory,
+    (void *)&halide_cuda_set_pinned_host_pool_size,
     (void *)&halide_cuda_wrap_device_ptr,
+    (void *)&halide_cudnn_conv_backward_data,
+    (void *)&halide_cudnn_conv_backward_filter,
+    (void *)&halide_cudnn_conv_forward,
     (void *)&halide_current_time_ns,
     (void *)&halide_debug_to_file,
     (void *)&halide_default_can_use_target_features,
+    (void *)&halide_destroy_thread_pool,
     (void *)&halide_device_and_host_free,
     (void *)&halide_device_and_host_free_as_destructor,
     (void *)&halide_device_and_host_malloc,
@@ -49,7 +63,11 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_device_release,
     (void *)&halide_device_sync,
     (void *)&halide_device_sync_legacy,
+    (void *)&halide_distributed_exchange,
+    (void *)&halide_do_async_call,
+    (void *)&halide_do_concurrent_tasks,
     (void *)&halide_do_par_for,
+    (void *)&halide_do_par_for_chunked,
     (void *)&halide_do_task,
     (void *)&halide_double_to_string,
     (void *)&halide_downgrade_buffer_t,
@@ -88,21 +106,28 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_get_cpu_features,
     (void *)&halide_get_gpu_device,
     (void *)&halide_get_library_symbol,
+    (void *)&halide_get_memory_budget,
     (void *)&halide_get_symbol,
     (void *)&halide_get_trace_file,
+    (void *)&halide_get_thread_pool,
     (void *)&halide_hexagon_detach_device_handle,
     (void *)&halide_hexagon_device_interface,
     (void *)&halide_hexagon_device_release,
+    (void *)&halide_hexagon_dma_copy_2d,
     (void *)&halide_hexagon_get_device_handle,
     (void *)&halide_hexagon_get_device_size,
     (void *)&halide_hexagon_initialize_kernels,
     (void *)&halide_hexagon_power_hvx_off,
     (void *)&halide_hexagon_power_hvx_off_as_destructor,
     (void *)&halide_hexagon_power_hvx_on,
+    (void *)&halide_hexagon_release_unused_device_allocations,
     (void *)&halide_hexagon_run,
     (void *)&halide_hexagon_set_performance,
     (void *)&halide_hexagon_set_performance_mode,
     (void *)&halide_hexagon_wrap_device_handle,
+    (void *)&halide_huge_page_allocator_configure,
+    (void *)&halide_huge_page_free,
+    (void *)&halide_huge_page_malloc,
     (void *)&halide_int64_to_string,
     (void *)&halide_join_thread,
     (void *)&halide_load_library,
@@ -111,6 +136,7 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_memoization_cache_cleanup,
     (void *)&halide_memoization_cache_lookup,
     (void *)&halide_memoization_cache_release,
+    (void *)&halide_memoization_cache_set_backing_store,
     (void *)&halide_memoization_cache_set_size,
     (void *)&halide_memoization_cache_store,
     (void *)&halide_metal_acquire_context,
@@ -151,20 +177,37 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_openglcompute_device_interface,
     (void *)&halide_openglcompute_initialize_kernels,
     (void *)&halide_openglcompute_run,
+    (void *)&halide_persistent_storage_acquire,
+    (void *)&halide_persistent_storage_cleanup,
+    (void *)&halide_persistent_storage_first_frame,
+    (void *)&halide_persistent_storage_last_frame,
+    (void *)&halide_persistent_storage_release,
+    (void *)&halide_persistent_storage_set_frames,
     (void *)&halide_pointer_to_string,
+    (void *)&halide_pool_allocator_get_stats,
+    (void *)&halide_pool_allocator_trim,
+    (void *)&halide_pool_free,
+    (void *)&halide_pool_malloc,
     (void *)&halide_print,
+    (void *)&halide_profiler_device_copy,
+    (void *)&halide_profiler_device_kernel,
     (void *)&halide_profiler_get_pipeline_state,
     (void *)&halide_profiler_get_state,
     (void *)&halide_profiler_memory_allocate,
     (void *)&halide_profiler_memory_free,
     (void *)&halide_profiler_pipeline_start,
     (void *)&halide_profiler_report,
+    (void *)&halide_profiler_save,
     (void *)&halide_profiler_reset,
     (void *)&halide_profiler_stack_peak_update,
     (void *)&halide_qurt_hvx_lock,
     (void *)&halide_qurt_hvx_unlock,
     (void *)&halide_qurt_hvx_unlock_as_destructor,
     (void *)&halide_release_jit_module,
+    (void *)&halide_semaphore_acquire,
+    (void *)&halide_semaphore_init,
+    (void *)&halide_semaphore_poison,
+    (void *)&halide_semaphore_release,
     (void *)&halide_set_custom_can_use_target_features,
     (void *)&halide_set_custom_do_par_for,
     (void *)&halide_set_custom_do_task,
@@ -175,8 +218,10 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_set_custom_malloc,
     (void *)&halide_set_custom_print,
     (void *)&halide_set_custom_trace,
+    (void *)&halide_set_distributed_transport,
     (void *)&halide_set_error_handler,
     (void *)&halide_set_gpu_device,
+    (void *)&halide_set_memory_budget,
     (void *)&halide_set_num_threads,
     (void *)&halide_set_trace_file,
     (void *)&halide_shutdown_thread_pool,
@@ -185,11 +230,17 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_spawn_thread,
     (void *)&halide_start_clock,
     (void *)&halide_string_to_string,
+    (void *)&halide_thread_pool_timeline_save,
+    (void *)&halide_thread_pool_timeline_start,
+    (void *)&halide_thread_pool_timeline_stop,
     (void *)&halide_trace,
     (void *)&halide_trace_helper,
     (void *)&halide_uint64_to_string,
     (void *)&halide_upgrade_buffer_t,
     (void *)&halide_use_jit_module,
+    (void *)&halide_vtcm_contains,
+    (void *)&halide_vtcm_free,
+    (void *)&halide_vtcm_malloc,
     (void *)&halide_d3d12compute_acquire_context,
     (void *)&halide_d3d12compute_device_interface,
     (void *)&halide_d3d12compute_initialize_kernels,
@@ -0,0 +1,23 @@
+#ifndef HALIDE_RUNTIME_SHARED_MEMORY_H
+#define HALIDE_RUNTIME_SHARED_MEMORY_H
+
+#include "HalideRuntime.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Mappings of files shared with the other processes that map them, for
+// the backing store of the memoization cache. They are implemented on
+// Linux with mmap (linux_shared_memory.cpp), and stubbed out elsewhere
+// (fake_shared_memory.cpp), in which case the cache has no backing
+// store.
+
+// Map the file at path, creating it if needed. An empty file is first
+// extended to *bytes zero bytes; otherwise *bytes is set to the size of
+// the file. Returns NULL on failure.
+WEAK void *map_shared_file(const char *path, size_t *bytes);
+
+WEAK void unmap_shared_file(void *ptr, size_t bytes);
+
+}}}  // namespace Halide::Runtime::Internal
+
+#endif
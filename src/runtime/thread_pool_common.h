@@ -1,19 +1,46 @@
+#include "printer.h"
+#include "scoped_mutex_lock.h"
+
 extern "C" void * pthread_self();
 
+// Only linked in on the platforms with the profiler; the timeline tags
+// tasks with its func ids when it is there.
+extern "C" halide_profiler_state *halide_profiler_get_state() __attribute__((weak));
+
 namespace Halide { namespace Runtime { namespace Internal {
 
 struct work {
     work *next_job;
     int (*f)(void *, int, uint8_t *);
     void *user_context;
+    // The next task to claim. Tasks are claimed with an atomic increment,
+    // without holding the work queue lock, so 'next' may overshoot 'max'.
     int next, max;
     uint8_t *closure;
+    // The threads working on the job. Only changed while the work queue is
+    // locked.
     int active_workers;
     int exit_status;
-    bool running() { return next < max || active_workers > 0; }
+    // Queued by halide_do_async_call: nobody owns it, and the last
+    // worker to leave it frees it.
+    bool async;
+    // The profiler's id of the Func of the loop, for the timeline, or -1.
+    int func_id;
+    bool running() { return __atomic_load_n(&next, __ATOMIC_ACQUIRE) < max || active_workers > 0; }
 };
 
-// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
+struct work_queue_t;
+
+// The argument of a worker thread.
+struct worker_t {
+    work_queue_t *queue;
+    // Worker 0 is the thread calling do_par_for.
+    int index;
+};
+
+// A work queue and the threads serving it. The default one is weak, so one
+// big work queue is shared by all halide functions. Others are created with
+// halide_create_thread_pool and picked through halide_get_thread_pool.
 struct work_queue_t {
     // all fields are protected by this mutex.
     halide_mutex mutex;
@@ -21,6 +48,9 @@ struct work_queue_t {
     // The desired number threads doing work.
     int desired_num_threads;
 
+    // The priority of the worker threads. See set_worker_priority.
+    int priority;
+
     // All fields after this must be zero in the initial state. See assert_zeroed
     // Field serves both to mark the offset in struct and as layout padding.
     int zero_marker;
@@ -48,6 +78,7 @@ struct work_queue_t {
 
     // Keep track of threads so they can be joined at shutdown
     halide_thread *threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
 
     // The number threads created
     int threads_created;
@@ -62,7 +93,8 @@ struct work_queue_t {
 
     // Used to check initial state is correct.
     void assert_zeroed() const {
-        // Assert that all fields except the mutex and desired hreads count are zeroed.
+        // Assert that all fields except the mutex, desired threads count and
+        // priority are zeroed.
         const char *bytes = ((const char *)&this->zero_marker);
         const char *limit = ((const char *)this) + sizeof(work_queue_t);
         while (bytes < limit && *bytes == 0) {
@@ -74,7 +106,8 @@ struct work_queue_t {
     // Return the work queue to initial state. Must be called while locked
     // and queue will remain locked.
     void reset() {
-        // Ensure all fields except the mutex and desired hreads count are zeroed.
+        // Ensure all fields except the mutex, desired threads count and
+        // priority are zeroed.
         char *bytes = ((char *)&this->zero_marker);
         char *limit = ((char *)this) + sizeof(work_queue_t);
         memset(bytes, 0, limit - bytes);
@@ -83,6 +116,105 @@ struct work_queue_t {
 };
  WEAK work_queue_t work_queue = {};
 
+// The timeline of halide_thread_pool_timeline_start. Each event is
+// recorded once it ends, in a slot of the ring buffer of its worker
+// index claimed with an atomic increment, so recording takes no lock.
+enum timeline_event_kind {
+    timeline_task,  // Running a task of a job
+    timeline_wait,  // Sleeping on a condition variable of the queue
+    timeline_lock   // Taking the lock of the queue
+};
+
+struct timeline_event {
+    uint64_t thread;
+    int64_t begin, end;
+    int32_t kind;
+    int32_t func_id;
+    // The index of the task, for tasks.
+    int32_t task;
+};
+
+struct timeline_buffer {
+    // The number of events recorded. It wraps around, so the size of
+    // the buffer is a power of two.
+    uint32_t next;
+    timeline_event *events;
+};
+
+struct timeline_state {
+    bool recording;
+    // Buffer 0 is for the threads calling in, and buffer i for worker
+    // index i, modulo num_buffers.
+    int num_buffers;
+    uint32_t events_per_buffer;
+    timeline_buffer *buffers;
+};
+WEAK timeline_state timeline = {};
+
+// The start of an event, or -1 if the timeline isn't recording.
+WEAK int64_t timeline_begin() {
+    if (!__atomic_load_n(&timeline.recording, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    return halide_current_time_ns(NULL);
+}
+
+WEAK void timeline_end(int worker, int kind, int64_t begin, int func_id = -1, int task = 0) {
+    if (begin < 0 || !__atomic_load_n(&timeline.recording, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    timeline_buffer *buffer = timeline.buffers + worker % timeline.num_buffers;
+    uint32_t idx = __atomic_fetch_add(&buffer->next, 1, __ATOMIC_RELAXED);
+    timeline_event *event = buffer->events + (idx & (timeline.events_per_buffer - 1));
+    event->thread = current_thread_id();
+    event->begin = begin;
+    event->end = halide_current_time_ns(NULL);
+    event->kind = kind;
+    event->func_id = func_id;
+    event->task = task;
+}
+
+// The Func the calling thread is computing, for the jobs it queues.
+WEAK int timeline_func_id() {
+    if (!__atomic_load_n(&timeline.recording, __ATOMIC_RELAXED) ||
+        !halide_profiler_get_state) {
+        return -1;
+    }
+    int func_id = halide_profiler_get_state()->current_func;
+    return func_id >= 0 ? func_id : -1;
+}
+
+WEAK void timeline_release(void *user_context) {
+    if (timeline.buffers) {
+        for (int i = 0; i < timeline.num_buffers; i++) {
+            halide_free(user_context, timeline.buffers[i].events);
+        }
+        halide_free(user_context, timeline.buffers);
+    }
+    timeline.buffers = NULL;
+    timeline.num_buffers = 0;
+}
+
+// The name of a func id of the profiler, or NULL. The profiler state
+// must be locked.
+WEAK const char *profiler_func_name(halide_profiler_state *s, int func_id) {
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (func_id >= p->first_func_id && func_id < p->first_func_id + p->num_funcs) {
+            return p->funcs[func_id - p->first_func_id].name;
+        }
+    }
+    return NULL;
+}
+
+// A time in the microseconds of the trace event format.
+WEAK const char *timeline_microseconds(char *buf, char *end, int64_t ns) {
+    char *dst = halide_int64_to_string(buf, end, ns / 1000, 1);
+    dst = halide_string_to_string(dst, end, ".");
+    halide_int64_to_string(dst, end, ns % 1000, 3);
+    return buf;
+}
+
 WEAK int clamp_num_threads(int desired_num_threads) {
     if (desired_num_threads > MAX_THREADS) {
         desired_num_threads = MAX_THREADS;
@@ -107,83 +239,283 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
-WEAK void worker_thread_already_locked(work *owned_job) {
+// Remove a job from the stack. Must be called while locked.
+WEAK void remove_job(work_queue_t *queue, work *job) {
+    for (work **prev = &queue->jobs; *prev != NULL; prev = &(*prev)->next_job) {
+        if (*prev == job) {
+            *prev = job->next_job;
+            return;
+        }
+    }
+}
+
+// Return the topmost job with tasks left to claim, removing the exhausted
+// jobs above it from the stack. Must be called while locked.
+WEAK work *top_pending_job(work_queue_t *queue) {
+    while (queue->jobs != NULL &&
+           __atomic_load_n(&queue->jobs->next, __ATOMIC_ACQUIRE) >= queue->jobs->max) {
+        queue->jobs = queue->jobs->next_job;
+    }
+    return queue->jobs;
+}
+
+WEAK void worker_thread_already_locked(work_queue_t *queue, work *owned_job, int worker) {
     // If I'm a job owner, then I was the thread that called
     // do_par_for, and I should only stay in this function until my
     // job is complete. If I'm a lowly worker thread, I should stay in
     // this function as long as the work queue is running.
     while (owned_job != NULL ? owned_job->running()
-           : work_queue.running()) {
-
-        if (work_queue.jobs == NULL) {
+           : queue->running()) {
+
+        work *job = top_pending_job(queue);
+        if (job != NULL && owned_job != NULL && job->async) {
+            // Async calls are at the bottom of the stack, so there's
+            // nothing else to do. Don't hold up the owner running a
+            // whole pipeline.
+            job = NULL;
+        }
+        if (job == NULL) {
+            int64_t wait_begin = timeline_begin();
             if (owned_job) {
                 // There are no jobs pending. Wait for the last worker
                 // to signal that the job is finished.
-                halide_cond_wait(&work_queue.wakeup_owners, &work_queue.mutex);
-            } else if (work_queue.a_team_size <= work_queue.target_a_team_size) {
+                halide_cond_wait(&queue->wakeup_owners, &queue->mutex);
+            } else if (queue->a_team_size <= queue->target_a_team_size) {
                 // There are no jobs pending. Wait until more jobs are enqueued.
-                halide_cond_wait(&work_queue.wakeup_a_team, &work_queue.mutex);
+                halide_cond_wait(&queue->wakeup_a_team, &queue->mutex);
             } else {
                 // There are no jobs pending, and there are too many
                 // threads in the A team. Transition to the B team
                 // until the wakeup_b_team condition is fired.
-                work_queue.a_team_size--;
-                halide_cond_wait(&work_queue.wakeup_b_team, &work_queue.mutex);
-                work_queue.a_team_size++;
+                queue->a_team_size--;
+                halide_cond_wait(&queue->wakeup_b_team, &queue->mutex);
+                queue->a_team_size++;
             }
+            timeline_end(worker, timeline_wait, wait_begin);
         } else {
-            // Grab the next job.
-            work *job = work_queue.jobs;
-
-            // Claim a task from it.
-            work myjob = *job;
-            job->next++;
-
-            // If there were no more tasks pending for this job,
-            // remove it from the stack.
-            if (job->next == job->max) {
-                work_queue.jobs = job->next_job;
-            }
-
             // Increment the active_worker count so that other threads
             // are aware that this job is still in progress even
-            // though there are no outstanding tasks for it.
+            // though there may be no outstanding tasks for it.
             job->active_workers++;
 
-            // Release the lock and do the task.
-            halide_mutex_unlock(&work_queue.mutex);
-            int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
-                                        myjob.closure);
-            halide_mutex_lock(&work_queue.mutex);
+            // Release the lock, and claim and do tasks from the job
+            // until it runs out of them. The lock is only taken again
+            // when a job is pushed on top of this one (e.g. by a nested
+            // parallel loop), so that the innermost jobs are still
+            // served first, and when this job runs out of tasks.
+            halide_mutex_unlock(&queue->mutex);
+            int result = 0;
+            bool exhausted = false;
+            while (true) {
+                int idx = __atomic_fetch_add(&job->next, 1, __ATOMIC_ACQ_REL);
+                if (idx >= job->max) {
+                    exhausted = true;
+                    break;
+                }
+                int64_t task_begin = timeline_begin();
+                int task_result = halide_do_task(job->user_context, job->f, idx,
+                                                 job->closure);
+                timeline_end(worker, timeline_task, task_begin, job->func_id, idx);
+                if (task_result) {
+                    result = task_result;
+                }
+                if (__atomic_load_n(&queue->jobs, __ATOMIC_RELAXED) != job) {
+                    break;
+                }
+            }
+            int64_t lock_begin = timeline_begin();
+            halide_mutex_lock(&queue->mutex);
+            timeline_end(worker, timeline_lock, lock_begin);
 
-            // If this task failed, set the exit status on the job.
+            // If a task failed, set the exit status on the job.
             if (result) {
                 job->exit_status = result;
             }
 
+            // If there are no more tasks pending for this job, remove
+            // it from the stack.
+            if (exhausted) {
+                remove_job(queue, job);
+            }
+
             // We are no longer active on this job
             job->active_workers--;
 
             // If the job is done and I'm not the owner of it, wake up
-            // the owner.
-            if (!job->running() && job != owned_job) {
-                halide_cond_broadcast(&work_queue.wakeup_owners);
+            // the owner, or free it if it has none.
+            if (!job->running() && job->async) {
+                remove_job(queue, job);
+                halide_free(job->user_context, job);
+            } else if (!job->running() && job != owned_job) {
+                halide_cond_broadcast(&queue->wakeup_owners);
             }
         }
     }
 }
 
-WEAK void worker_thread(void *) {
-    halide_mutex_lock(&work_queue.mutex);
-    worker_thread_already_locked(NULL);
-    halide_mutex_unlock(&work_queue.mutex);
+WEAK void worker_thread(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    work_queue_t *queue = worker->queue;
+    bind_worker_thread(worker->index);
+    if (queue->priority) {
+        set_worker_priority(queue->priority);
+    }
+    halide_mutex_lock(&queue->mutex);
+    worker_thread_already_locked(queue, NULL, worker->index);
+    halide_mutex_unlock(&queue->mutex);
+}
+
+// Wake up the workers of a queue, wait until they leave, and return the
+// queue to its initial state.
+WEAK void shutdown_work_queue(work_queue_t *queue) {
+    // Wake everyone up and tell them the party's over and it's time
+    // to go home
+    halide_mutex_lock(&queue->mutex);
+    queue->shutdown = true;
+    halide_cond_broadcast(&queue->wakeup_owners);
+    halide_cond_broadcast(&queue->wakeup_a_team);
+    halide_cond_broadcast(&queue->wakeup_b_team);
+    halide_mutex_unlock(&queue->mutex);
+
+    // Wait until they leave
+    for (int i = 0; i < queue->threads_created; i++) {
+        halide_join_thread(queue->threads[i]);
+    }
+
+    // Tidy up
+    queue->reset();
+}
+
+// Initialize the queue if needed, and make sure it has enough worker
+// threads for the desired number of threads, besides the given
+// number of threads calling in. Must be called while locked.
+WEAK void start_workers(work_queue_t *queue, int calling_threads) {
+    if (!queue->initialized) {
+        queue->assert_zeroed();
+
+        // Compute the desired number of threads to use. Other code
+        // can also mess with this value, but only when the work queue
+        // is locked.
+        if (!queue->desired_num_threads) {
+            queue->desired_num_threads = default_desired_num_threads();
+        }
+        queue->desired_num_threads = clamp_num_threads(queue->desired_num_threads);
+        queue->threads_created = 0;
+
+        // Everyone starts on the a team.
+        queue->a_team_size = queue->desired_num_threads;
+
+        init_worker_binding();
+
+        queue->initialized = true;
+    }
+
+    while (queue->threads_created < queue->desired_num_threads - calling_threads &&
+           queue->threads_created < MAX_THREADS) {
+        // We might need to make some new threads, if queue->desired_num_threads has
+        // increased.
+        worker_t *worker = &queue->workers[queue->threads_created];
+        worker->queue = queue;
+        worker->index = ++queue->threads_created;
+        queue->threads[worker->index - 1] =
+            halide_spawn_thread(worker_thread, worker);
+    }
+}
+
+// The closure of the job of halide_do_async_call, allocated along with it.
+struct async_call {
+    int (*f)(void **);
+    void **args;
+    halide_async_callback_t callback;
+    void *callback_context;
+};
+
+WEAK int async_call_task(void *user_context, int idx, uint8_t *closure) {
+    async_call *call = (async_call *)closure;
+    call->callback(call->callback_context, call->f(call->args));
+    return 0;
 }
 
 WEAK halide_do_task_t custom_do_task = halide_default_do_task;
 WEAK halide_do_par_for_t custom_do_par_for = halide_default_do_par_for;
 
+// The layout of a halide_semaphore_t.
+struct semaphore_impl {
+    halide_mutex mutex;
+    halide_cond cond;
+    int value;
+    bool poisoned;
+};
+
+// A task of halide_do_concurrent_tasks, and the thread running it.
+struct concurrent_task {
+    void *user_context;
+    halide_task_t f;
+    int idx;
+    uint8_t *closure;
+    int result;
+    halide_thread *thread;
+};
+
+WEAK void concurrent_task_helper(void *arg) {
+    concurrent_task *task = (concurrent_task *)arg;
+    task->result = halide_do_task(task->user_context, task->f, task->idx, task->closure);
+}
+
+// A loop of halide_do_par_for_chunked. Its tasks are handed out by a
+// loop over chunks run by halide_do_par_for, so custom do_par_for
+// handlers run them too.
+struct chunked_loop {
+    halide_task_t f;
+    uint8_t *closure;
+    // The next task to claim, and one past the last one.
+    int next, max;
+    // The number of tasks claimed at once. For a guided loop, this is
+    // the least number, and each claim takes a share of the tasks left
+    // among 'threads' threads.
+    int chunk;
+    bool guided;
+    int threads;
+};
+
+// Do the tasks of chunk idx of a dynamic or static loop. The chunks of a
+// guided loop instead claim shrinking runs of tasks until there are none
+// left.
+WEAK int do_chunk(void *user_context, int idx, uint8_t *closure) {
+    chunked_loop *loop = (chunked_loop *)closure;
+    int result = 0;
+    while (true) {
+        int start, count;
+        if (loop->guided) {
+            int left = loop->max - __atomic_load_n(&loop->next, __ATOMIC_RELAXED);
+            count = max(loop->chunk, left / (2 * loop->threads));
+            start = __atomic_fetch_add(&loop->next, count, __ATOMIC_ACQ_REL);
+        } else {
+            count = loop->chunk;
+            start = loop->next + idx * count;
+        }
+        if (start >= loop->max) {
+            break;
+        }
+        int end = min(start + count, loop->max);
+        for (int i = start; i < end; i++) {
+            int task_result = halide_do_task(user_context, loop->f, i, loop->closure);
+            if (task_result) {
+                result = task_result;
+            }
+        }
+        if (!loop->guided || result) {
+            break;
+        }
+    }
+    return result;
+}
+
 }}}  // namespace Halide::Runtime::Internal
 
+// Pools created with halide_create_thread_pool are work queues.
+struct halide_thread_pool : public Halide::Runtime::Internal::work_queue_t {};
+
 using namespace Halide::Runtime::Internal;
 
 extern "C" {
@@ -192,6 +524,8 @@ namespace {
 __attribute__((destructor))
 WEAK void halide_thread_pool_cleanup() {
     halide_shutdown_thread_pool();
+    timeline.recording = false;
+    timeline_release(NULL);
 }
 }
 
@@ -207,34 +541,21 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
         return 0;
     }
 
-    // Grab the lock. If it hasn't been initialized yet, then the
-    // field will be zero-initialized because it's a static global.
-    halide_mutex_lock(&work_queue.mutex);
-
-    if (!work_queue.initialized) {
-        work_queue.assert_zeroed();
-
-        // Compute the desired number of threads to use. Other code
-        // can also mess with this value, but only when the work queue
-        // is locked.
-        if (!work_queue.desired_num_threads) {
-            work_queue.desired_num_threads = default_desired_num_threads();
-        }
-        work_queue.desired_num_threads = clamp_num_threads(work_queue.desired_num_threads);
-        work_queue.threads_created = 0;
-
-        // Everyone starts on the a team.
-        work_queue.a_team_size = work_queue.desired_num_threads;
-
-        work_queue.initialized = true;
+    // The pool bound to this user_context, or the global one.
+    work_queue_t *queue = halide_get_thread_pool(user_context);
+    if (queue == NULL) {
+        queue = &work_queue;
     }
 
-    while (work_queue.threads_created < work_queue.desired_num_threads - 1) {
-        // We might need to make some new threads, if work_queue.desired_num_threads has
-        // increased.
-        work_queue.threads[work_queue.threads_created++] =
-            halide_spawn_thread(worker_thread, NULL);
-    }
+    // Grab the lock. If it hasn't been initialized yet, then the
+    // field will be zero-initialized because it's a static global, or
+    // was zeroed by halide_create_thread_pool.
+    int64_t lock_begin = timeline_begin();
+    halide_mutex_lock(&queue->mutex);
+    timeline_end(0, timeline_lock, lock_begin);
+
+    // Worker 0 is the calling thread.
+    start_workers(queue, 1);
 
     // Make the job.
     work job;
@@ -245,44 +566,102 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     job.closure = closure;   // Use this closure.
     job.exit_status = 0;     // The job hasn't failed yet
     job.active_workers = 0;  // Nobody is working on this yet
+    job.async = false;
+    job.func_id = timeline_func_id();
 
-    if (!work_queue.jobs && size < work_queue.desired_num_threads) {
+    if (!queue->jobs && size < queue->desired_num_threads) {
         // If there's no nested parallelism happening and there are
         // fewer tasks to do than threads, then set the target A team
         // size so that some threads will put themselves to sleep
         // until a larger job arrives.
-        work_queue.target_a_team_size = size;
+        queue->target_a_team_size = size;
     } else {
         // Otherwise the target A team size is
         // desired_num_threads. This may still be less than
         // threads_created if desired_num_threads has been reduced by
         // other code.
-        work_queue.target_a_team_size = work_queue.desired_num_threads;
+        queue->target_a_team_size = queue->desired_num_threads;
     }
 
     // Push the job onto the stack.
-    job.next_job = work_queue.jobs;
-    work_queue.jobs = &job;
+    job.next_job = queue->jobs;
+    queue->jobs = &job;
 
     // Wake up our A team.
-    halide_cond_broadcast(&work_queue.wakeup_a_team);
+    halide_cond_broadcast(&queue->wakeup_a_team);
 
     // If there are fewer threads than we would like on the a team,
     // wake up the b team too.
-    if (work_queue.target_a_team_size > work_queue.a_team_size) {
-        halide_cond_broadcast(&work_queue.wakeup_b_team);
+    if (queue->target_a_team_size > queue->a_team_size) {
+        halide_cond_broadcast(&queue->wakeup_b_team);
     }
 
     // Do some work myself.
-    worker_thread_already_locked(&job);
+    worker_thread_already_locked(queue, &job, 0);
 
-    halide_mutex_unlock(&work_queue.mutex);
+    // The job is about to go out of scope. It has normally been removed
+    // from the stack by the thread that claimed past its last task.
+    remove_job(queue, &job);
+
+    halide_mutex_unlock(&queue->mutex);
 
     // Return zero if the job succeeded, otherwise return the exit
     // status of one of the failing jobs (whichever one failed last).
     return job.exit_status;
 }
 
+WEAK int halide_do_async_call(void *user_context, int (*f)(void **), void **args,
+                              halide_async_callback_t callback, void *callback_context) {
+    work_queue_t *queue = halide_get_thread_pool(user_context);
+    if (queue == NULL) {
+        queue = &work_queue;
+    }
+
+    // The job outlives this call, so it lives on the heap, with its
+    // closure just after it.
+    work *job = (work *)halide_malloc(user_context, sizeof(work) + sizeof(async_call));
+    if (job == NULL) {
+        return halide_error_code_out_of_memory;
+    }
+    async_call *call = (async_call *)(job + 1);
+    call->f = f;
+    call->args = args;
+    call->callback = callback;
+    call->callback_context = callback_context;
+    job->f = async_call_task;
+    job->user_context = user_context;
+    job->next = 0;
+    job->max = 1;
+    job->closure = (uint8_t *)call;
+    job->exit_status = 0;
+    job->active_workers = 0;
+    job->async = true;
+    job->func_id = -1;
+    job->next_job = NULL;
+
+    halide_mutex_lock(&queue->mutex);
+
+    // Nobody calling in will run it.
+    start_workers(queue, 0);
+
+    // Queue it below the jobs of the parallel loops running now, so
+    // their owners return first.
+    work **bottom = &queue->jobs;
+    while (*bottom != NULL) {
+        bottom = &(*bottom)->next_job;
+    }
+    *bottom = job;
+
+    queue->target_a_team_size = queue->desired_num_threads;
+    halide_cond_broadcast(&queue->wakeup_a_team);
+    if (queue->target_a_team_size > queue->a_team_size) {
+        halide_cond_broadcast(&queue->wakeup_b_team);
+    }
+
+    halide_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
 WEAK int halide_set_num_threads(int n) {
     if (n < 0) {
         halide_error(NULL, "halide_set_num_threads: must be >= 0.");
@@ -302,23 +681,140 @@ WEAK int halide_set_num_threads(int n) {
 
 WEAK void halide_shutdown_thread_pool() {
     if (work_queue.initialized) {
-        // Wake everyone up and tell them the party's over and it's time
-        // to go home
-        halide_mutex_lock(&work_queue.mutex);
-        work_queue.shutdown = true;
-        halide_cond_broadcast(&work_queue.wakeup_owners);
-        halide_cond_broadcast(&work_queue.wakeup_a_team);
-        halide_cond_broadcast(&work_queue.wakeup_b_team);
-        halide_mutex_unlock(&work_queue.mutex);
-
-        // Wait until they leave
-        for (int i = 0; i < work_queue.threads_created; i++) {
-            halide_join_thread(work_queue.threads[i]);
+        shutdown_work_queue(&work_queue);
+    }
+}
+
+WEAK halide_thread_pool *halide_create_thread_pool(void *user_context, int num_threads,
+                                                   int priority) {
+    if (num_threads < 0) {
+        halide_error(user_context, "halide_create_thread_pool: num_threads must be >= 0.");
+        return NULL;
+    }
+    halide_thread_pool *pool = (halide_thread_pool *)halide_malloc(user_context, sizeof(halide_thread_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(halide_thread_pool));
+    pool->desired_num_threads = clamp_num_threads(num_threads ? num_threads : default_desired_num_threads());
+    pool->priority = priority;
+    return pool;
+}
+
+WEAK void halide_destroy_thread_pool(void *user_context, halide_thread_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    if (pool->initialized) {
+        shutdown_work_queue(pool);
+    }
+    halide_free(user_context, pool);
+}
+
+WEAK halide_thread_pool *halide_get_thread_pool(void *user_context) {
+    return NULL;
+}
+
+WEAK int halide_thread_pool_timeline_start(void *user_context, int events_per_thread) {
+    if (events_per_thread <= 0) {
+        halide_error(user_context, "halide_thread_pool_timeline_start: events_per_thread must be > 0.");
+        return halide_error_code_generic_error;
+    }
+    __atomic_store_n(&timeline.recording, false, __ATOMIC_RELEASE);
+    timeline_release(user_context);
+
+    uint32_t events = 1;
+    while (events < (uint32_t)events_per_thread && events < (1U << 30)) {
+        events *= 2;
+    }
+    // A buffer for the threads calling in, and one per worker of the
+    // global pool. The workers of larger pools share them.
+    halide_mutex_lock(&work_queue.mutex);
+    int threads = work_queue.desired_num_threads;
+    halide_mutex_unlock(&work_queue.mutex);
+    int num_buffers = clamp_num_threads(threads ? threads : default_desired_num_threads()) + 1;
+
+    timeline.buffers = (timeline_buffer *)halide_malloc(user_context, num_buffers * sizeof(timeline_buffer));
+    if (timeline.buffers == NULL) {
+        return halide_error_code_out_of_memory;
+    }
+    memset(timeline.buffers, 0, num_buffers * sizeof(timeline_buffer));
+    timeline.num_buffers = num_buffers;
+    timeline.events_per_buffer = events;
+    for (int i = 0; i < num_buffers; i++) {
+        timeline.buffers[i].events =
+            (timeline_event *)halide_malloc(user_context, events * sizeof(timeline_event));
+        if (timeline.buffers[i].events == NULL) {
+            timeline_release(user_context);
+            return halide_error_code_out_of_memory;
+        }
+    }
+
+    halide_start_clock(user_context);
+    __atomic_store_n(&timeline.recording, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+WEAK void halide_thread_pool_timeline_stop() {
+    __atomic_store_n(&timeline.recording, false, __ATOMIC_RELEASE);
+}
+
+WEAK int halide_thread_pool_timeline_save(void *user_context, const char *filename) {
+    void *file = fopen(filename, "w");
+    if (!file) {
+        error(user_context) << "Failed to open timeline file " << filename << "\n";
+        return halide_error_code_generic_error;
+    }
+
+    // Name the tasks after their Funcs if the profiler knows them.
+    halide_profiler_state *s = halide_profiler_get_state ? halide_profiler_get_state() : NULL;
+    if (s) {
+        halide_mutex_lock(&s->lock);
+    }
+
+    char line_buf[1024];
+    Printer<StringStreamPrinter, sizeof(line_buf)> sstr(user_context, line_buf);
+    sstr << "{\"traceEvents\":[";
+    fwrite(sstr.str(), 1, sstr.size(), file);
+
+    const char *kind_names[] = {"task", "wait", "lock"};
+    bool first = true;
+    for (int i = 0; i < timeline.num_buffers; i++) {
+        timeline_buffer *buffer = timeline.buffers + i;
+        uint32_t count = buffer->next < timeline.events_per_buffer ? buffer->next : timeline.events_per_buffer;
+        for (uint32_t j = buffer->next - count; j != buffer->next; j++) {
+            timeline_event *event = buffer->events + (j & (timeline.events_per_buffer - 1));
+            const char *name = kind_names[event->kind];
+            if (s && event->func_id >= 0) {
+                const char *func_name = profiler_func_name(s, event->func_id);
+                if (func_name) {
+                    name = func_name;
+                }
+            }
+            char ts[32], dur[32];
+            sstr.clear();
+            sstr << (first ? "\n" : ",\n")
+                 << "{\"name\":\"" << name << "\",\"cat\":\"" << kind_names[event->kind]
+                 << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event->thread
+                 << ",\"ts\":" << timeline_microseconds(ts, ts + sizeof(ts), event->begin)
+                 << ",\"dur\":" << timeline_microseconds(dur, dur + sizeof(dur), event->end - event->begin);
+            if (event->kind == timeline_task) {
+                sstr << ",\"args\":{\"func\":" << event->func_id << ",\"task\":" << event->task << "}";
+            }
+            sstr << "}";
+            fwrite(sstr.str(), 1, sstr.size(), file);
+            first = false;
         }
+    }
 
-        // Tidy up
-        work_queue.reset();
+    if (s) {
+        halide_mutex_unlock(&s->lock);
     }
+    sstr.clear();
+    sstr << "\n]}\n";
+    fwrite(sstr.str(), 1, sstr.size(), file);
+    fclose(file);
+    return 0;
 }
 
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
@@ -343,4 +839,125 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
   return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+WEAK int halide_do_par_for_chunked(void *user_context, halide_task_t f,
+                                   int min, int size, uint8_t *closure,
+                                   int policy, int chunk) {
+    if (size <= 0) {
+        return 0;
+    }
+
+    work_queue_t *queue = halide_get_thread_pool(user_context);
+    if (queue == NULL) {
+        queue = &work_queue;
+    }
+    // Not locked: this is only a hint for the sizes of the chunks.
+    int threads = queue->desired_num_threads;
+    if (threads <= 0) {
+        threads = default_desired_num_threads();
+    }
+
+    chunked_loop loop;
+    loop.f = f;
+    loop.closure = closure;
+    loop.next = min;
+    loop.max = min + size;
+    loop.guided = policy == halide_par_for_guided;
+    loop.threads = threads;
+    int chunks;
+    if (policy == halide_par_for_static) {
+        chunks = threads < size ? threads : size;
+        loop.chunk = (size + chunks - 1) / chunks;
+    } else {
+        loop.chunk = chunk > 1 ? chunk : 1;
+        chunks = (size + loop.chunk - 1) / loop.chunk;
+    }
+    if (loop.guided) {
+        // Each chunk claims tasks until there are none left, so one per
+        // thread is enough.
+        chunks = threads < chunks ? threads : chunks;
+    }
+    return halide_do_par_for(user_context, do_chunk, 0, chunks, (uint8_t *)&loop);
+}
+
+WEAK int halide_do_concurrent_tasks(void *user_context, halide_task_t f,
+                                    int min, int size, uint8_t *closure) {
+    if (size <= 0) {
+        return 0;
+    }
+
+    // The tasks may wait for each other, so they can't be queued on
+    // the thread pool, where they would wait for each other's
+    // workers. Every task but the last gets a thread of its own.
+    const int max_stack_tasks = 4;
+    concurrent_task stack_tasks[max_stack_tasks];
+    concurrent_task *tasks = stack_tasks;
+    if (size - 1 > max_stack_tasks) {
+        tasks = (concurrent_task *)halide_malloc(user_context, (size - 1) * sizeof(concurrent_task));
+        if (tasks == NULL) {
+            return halide_error_code_out_of_memory;
+        }
+    }
+    for (int i = 0; i < size - 1; i++) {
+        tasks[i].user_context = user_context;
+        tasks[i].f = f;
+        tasks[i].idx = min + i;
+        tasks[i].closure = closure;
+        tasks[i].result = 0;
+        tasks[i].thread = halide_spawn_thread(concurrent_task_helper, &tasks[i]);
+    }
+
+    int result = halide_do_task(user_context, f, min + size - 1, closure);
+
+    for (int i = 0; i < size - 1; i++) {
+        halide_join_thread(tasks[i].thread);
+        if (tasks[i].result) {
+            result = tasks[i].result;
+        }
+    }
+    if (tasks != stack_tasks) {
+        halide_free(user_context, tasks);
+    }
+    return result;
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    memset(sem, 0, sizeof(semaphore_impl));
+    sem->value = n;
+    return n;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&sem->mutex);
+    sem->value += n;
+    int value = sem->value;
+    halide_cond_broadcast(&sem->cond);
+    halide_mutex_unlock(&sem->mutex);
+    return value;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *s, int n) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&sem->mutex);
+    while (sem->value < n && !sem->poisoned) {
+        halide_cond_wait(&sem->cond, &sem->mutex);
+    }
+    int result = halide_error_code_generic_error;
+    if (sem->value >= n) {
+        sem->value -= n;
+        result = 0;
+    }
+    halide_mutex_unlock(&sem->mutex);
+    return result;
+}
+
+WEAK void halide_semaphore_poison(void *user_context, void *s) {
+    semaphore_impl *sem = (semaphore_impl *)s;
+    halide_mutex_lock(&sem->mutex);
+    sem->poisoned = true;
+    halide_cond_broadcast(&sem->cond);
+    halide_mutex_unlock(&sem->mutex);
+}
+
 }
@@ -141,6 +141,49 @@ WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK void *halide_trace_file_internally_opened = NULL;
 
+// Loads and stores can be sampled by setting HL_TRACE_SAMPLE=N, which
+// keeps one in N of the loads and one in N of the stores of each
+// Func. Other events are always kept so that the structure of the
+// trace stays intact. -1 indicates uninitialized.
+WEAK int halide_trace_sample_rate = -1;
+
+// The number of loads and stores seen per Func, in a hash table keyed
+// by the address of the Func name, which is a constant string in the
+// pipeline.
+struct sampled_func {
+    const char *func;
+    uint32_t count[2];
+};
+
+const static int max_sampled_funcs = 256;
+WEAK sampled_func halide_trace_sampled_funcs[max_sampled_funcs];
+
+WEAK bool keep_sampled_event(const halide_trace_event_t *e) {
+    if (halide_trace_sample_rate < 0) {
+        // Racing threads all read the same value.
+        const char *rate = getenv("HL_TRACE_SAMPLE");
+        halide_trace_sample_rate = rate ? atoi(rate) : 0;
+    }
+    if (halide_trace_sample_rate <= 1 ||
+        (e->event != halide_trace_load && e->event != halide_trace_store)) {
+        return true;
+    }
+    uintptr_t h = (uintptr_t)e->func;
+    h ^= h >> 16;
+    for (int i = 0; i < max_sampled_funcs; i++) {
+        sampled_func *f = halide_trace_sampled_funcs + ((h + i) % max_sampled_funcs);
+        if (f->func != e->func &&
+            !__sync_bool_compare_and_swap(&f->func, (const char *)NULL, e->func) &&
+            f->func != e->func) {
+            continue;
+        }
+        uint32_t n = __sync_fetch_and_add(&f->count[e->event], 1);
+        return (n % (uint32_t)halide_trace_sample_rate) == 0;
+    }
+    // Too many Funcs to keep count of: keep everything.
+    return true;
+}
+
 }}}
 
 extern "C" {
@@ -150,6 +193,10 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
 
     int32_t my_id = __sync_fetch_and_add(&ids, 1);
 
+    if (!keep_sampled_event(e)) {
+        return my_id;
+    }
+
     // If we're dumping to a file, use a binary format
     int fd = halide_get_trace_file(user_context);
     if (fd > 0) {
@@ -281,6 +328,14 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
                     }
                 } else if (e->type.code == 3) {
                     ss << ((void **)(e->value))[i];
+                } else if (e->type.code == 4) {
+                    // A bfloat is the upper half of a float
+                    union {
+                        uint32_t bits;
+                        float f;
+                    } u;
+                    u.bits = (uint32_t)((uint16_t *)(e->value))[i] << 16;
+                    ss << u.f;
                 }
             }
             if (e->type.lanes > 1) {
@@ -0,0 +1,12 @@
+#include "HalideRuntime.h"
+#include "cpu_features.h"
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK CpuFeatures halide_get_cpu_features() {
+    // A module using SIMD128 or threads fails to validate on a host
+    // without them, so there is nothing left to check when it runs.
+    return CpuFeatures();
+}
+
+}}} // namespace Halide::Runtime::Internal
@@ -29,6 +29,9 @@ extern WIN32API void DeleteCriticalSection(CriticalSection *);
 extern WIN32API void EnterCriticalSection(CriticalSection *);
 extern WIN32API void LeaveCriticalSection(CriticalSection *);
 extern WIN32API int32_t WaitForSingleObject(Thread, int32_t timeout);
+extern WIN32API Thread GetCurrentThread();
+extern WIN32API int32_t GetCurrentThreadId();
+extern WIN32API int SetThreadPriority(Thread, int priority);
 
 } // extern "C"
 
@@ -129,4 +132,24 @@ struct thread_parker {
 
 #include "synchronization_common.h"
 
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Threads are placed by the OS.
+WEAK void init_worker_binding() {}
+WEAK void bind_worker_thread(int index) {}
+
+// Positive priorities ask for the highest priority Windows gives to
+// normal threads.
+WEAK void set_worker_priority(int priority) {
+    if (priority > 0) {
+        SetThreadPriority(GetCurrentThread(), 2 /* THREAD_PRIORITY_HIGHEST */);
+    }
+}
+
+WEAK uint64_t current_thread_id() {
+    return (uint32_t)GetCurrentThreadId();
+}
+
+}}} // namespace Halide::Runtime::Internal
+
 #include "thread_pool_common.h"
@@ -21,6 +21,7 @@ WEAK CpuFeatures halide_get_cpu_features() {
     features.set_known(halide_target_feature_avx512_knl);
     features.set_known(halide_target_feature_avx512_skylake);
     features.set_known(halide_target_feature_avx512_cannonlake);
+    features.set_known(halide_target_feature_avx512_vnni);
 
     int32_t info[4];
     cpuid(1, info);
@@ -56,6 +57,7 @@ WEAK CpuFeatures halide_get_cpu_features() {
         const uint32_t avx512bw = 1U << 30;
         const uint32_t avx512vl = 1U << 31;
         const uint32_t avx512ifma = 1U << 21;
+        const uint32_t avx512vnni = 1U << 11; // In ecx
         const uint32_t avx512 = avx512f | avx512cd;
         const uint32_t avx512_knl = avx512 | avx512pf | avx512er;
         const uint32_t avx512_skylake = avx512 | avx512vl | avx512bw | avx512dq;
@@ -74,6 +76,10 @@ WEAK CpuFeatures halide_get_cpu_features() {
             if ((info2[1] & avx512_cannonlake) == avx512_cannonlake) {
                 features.set_available(halide_target_feature_avx512_cannonlake);
             }
+            if ((info2[1] & avx512_skylake) == avx512_skylake &&
+                (info2[2] & avx512vnni) == avx512vnni) {
+                features.set_available(halide_target_feature_avx512_vnni);
+            }
         }
     }
     return features;
@@ -0,0 +1,68 @@
+#include "Halide.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 1024, H = 1024;
+
+    Buffer<float> input(W + 2, H + 2);
+    input.set_min(-1, -1);
+    for (int y = input.top(); y <= input.bottom(); y++) {
+        for (int x = input.left(); x <= input.right(); x++) {
+            input(x, y) = rand() % 256;
+        }
+    }
+
+    Var x("x"), y("y");
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = (input(x - 1, y) + input(x, y) + input(x + 1, y)) / 3.f;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3.f;
+
+    // Provide estimates on the pipeline output
+    blur_y.estimate(x, 0, W).estimate(y, 0, H);
+
+    // Without a GPU to run on, only check that a GPU schedule is generated
+    // and lowers.
+    Target target = get_jit_target_from_environment();
+    bool run = target.has_gpu_feature();
+    if (!run) {
+        target = target.with_feature(Target::CUDA);
+    }
+
+    Pipeline p(blur_y);
+    std::string schedule = p.auto_schedule(target, MachineParams(16, 16 * 1024 * 1024, 40));
+    printf("%s\n", schedule.c_str());
+
+    if (schedule.find("gpu_blocks") == std::string::npos ||
+        schedule.find("gpu_threads") == std::string::npos) {
+        printf("The schedule of blur_y does not use the GPU\n");
+        return -1;
+    }
+
+    if (!run) {
+        p.compile_to_module({}, "blur", target);
+        printf("Success!\n");
+        return 0;
+    }
+
+    Buffer<float> out = p.realize(W, H, target);
+    for (int yi = 0; yi < H; yi++) {
+        for (int xi = 0; xi < W; xi++) {
+            float correct = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                correct += (input(xi - 1, yi + dy) + input(xi, yi + dy) + input(xi + 1, yi + dy)) / 3.f;
+            }
+            correct /= 3.f;
+            if (std::abs(out(xi, yi) - correct) > 1e-3f) {
+                printf("out(%d, %d) = %f instead of %f\n", xi, yi, out(xi, yi), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
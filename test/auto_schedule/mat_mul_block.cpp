@@ -0,0 +1,59 @@
+#include "Halide.h"
+
+#include <cstdio>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    if (get_jit_target_from_environment().has_gpu_feature()) {
+        printf("Not running test on a GPU target\n");
+        return 0;
+    }
+
+    const int size = 256;
+    Buffer<float> A(size, size), B(size, size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            A(x, y) = rand() % 16;
+            B(x, y) = rand() % 16;
+        }
+    }
+
+    Var x("x"), y("y");
+    RDom r(0, size);
+    Func prod("prod");
+    prod(x, y) = 0.0f;
+    prod(x, y) += A(x, r) * B(r, y);
+
+    // Provide estimates on the pipeline output
+    prod.estimate(x, 0, size).estimate(y, 0, size);
+
+    // The update is recognized as a matrix multiply and blocked without a
+    // hand-written schedule.
+    Pipeline p(prod);
+    std::string schedule = p.auto_schedule(get_jit_target_from_environment());
+    printf("%s\n", schedule.c_str());
+
+    if (schedule.find("vectorize(x_vi)") == std::string::npos ||
+        schedule.find("unroll(y_ui)") == std::string::npos) {
+        printf("The update of prod is not blocked\n");
+        return -1;
+    }
+
+    Buffer<float> out = p.realize(size, size);
+    for (int yi = 0; yi < size; yi++) {
+        for (int xi = 0; xi < size; xi++) {
+            float correct = 0.0f;
+            for (int k = 0; k < size; k++) {
+                correct += A(xi, k) * B(k, yi);
+            }
+            if (out(xi, yi) != correct) {
+                printf("out(%d, %d) = %f instead of %f\n", xi, yi, out(xi, yi), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "Halide.h"
+#include "halide_simple_autotune.h"
+
+#include <cstdio>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    Buffer<float> in(256, 256);
+    for (int y = 0; y < in.height(); y++) {
+        for (int x = 0; x < in.width(); x++) {
+            in(x, y) = rand() % 256;
+        }
+    }
+
+    int num_builds = 0;
+    auto build = [&]() {
+        num_builds++;
+        Var x("x"), y("y");
+        Func blur_x("blur_x"), blur_y("blur_y");
+        Func clamped = BoundaryConditions::repeat_edge(in);
+        blur_x(x, y) = (clamped(x - 1, y) + clamped(x, y) + clamped(x + 1, y)) / 3.f;
+        blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3.f;
+        return std::vector<Func>{blur_y};
+    };
+
+    std::string database = Halide::Internal::get_test_tmp_dir() + "simple_autotune.db";
+    Halide::Internal::ensure_no_file_exists(database);
+
+    SimpleAutotuneConfig config;
+    config.database = database;
+    config.tile_sizes = {8, 16};
+    config.unroll_rvar_sizes = {0};
+    config.benchmark.min_time = 0.01;
+    config.benchmark.max_time = 0.04;
+    std::vector<std::vector<std::pair<int, int>>> bounds{{{0, 255}, {0, 255}}};
+
+    SimpleAutoscheduleOptions tuned = simple_autotune(build, {}, bounds, {}, config);
+    if (tuned.cpu_tile_width != 8 && tuned.cpu_tile_width != 16) {
+        printf("Unexpected tuned tile width %d\n", tuned.cpu_tile_width);
+        return -1;
+    }
+    // One build for the key and one per candidate
+    if (num_builds != 3) {
+        printf("Expected 3 builds while tuning instead of %d\n", num_builds);
+        return -1;
+    }
+
+    // The second run should find the tuned options in the database
+    num_builds = 0;
+    SimpleAutoscheduleOptions looked_up = simple_autotune(build, {}, bounds, {}, config);
+    if (num_builds != 1) {
+        printf("Expected the database to be used, but the pipeline was built %d times\n",
+               num_builds);
+        return -1;
+    }
+    if (looked_up.cpu_tile_width != tuned.cpu_tile_width ||
+            looked_up.cpu_tile_height != tuned.cpu_tile_height) {
+        printf("Looked up tile %dx%d instead of %dx%d\n",
+               looked_up.cpu_tile_width, looked_up.cpu_tile_height,
+               tuned.cpu_tile_width, tuned.cpu_tile_height);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
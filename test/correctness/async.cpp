@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+size_t custom_malloc_size = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    custom_malloc_size = x;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int check(const Buffer<int> &out, int offset) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int correct = 2 * (x * 3 + y) + 1 + offset;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+
+    {
+        // A producer in a sliding window, running one scanline ahead
+        // of its consumer.
+        Func f("f"), g("g");
+        f(x, y) = x * 3 + y;
+        g(x, y) = f(x, y) + f(x, y + 1);
+
+        f.store_root().compute_at(g, y).async();
+
+        g.set_custom_allocator(my_malloc, my_free);
+        Buffer<int> out = g.realize(16, 64);
+        if (check(out, 0) != 0) {
+            return -1;
+        }
+
+        // Each scanline of g needs two scanlines of f, and the
+        // producer may be working on the next ones, so the fold has to
+        // cover three scanlines of f.
+        size_t expected_size = 16 * 4 * sizeof(int);
+        if (custom_malloc_size != expected_size) {
+            printf("Scratch space allocated was %d instead of %d\n",
+                   (int)custom_malloc_size, (int)expected_size);
+            return -1;
+        }
+    }
+
+    {
+        // A compute_root producer, consumed by a parallel loop.
+        Func f("f"), g("g");
+        f(x, y) = x * 3 + y;
+        g(x, y) = f(x, y) + f(x, y + 1) + 5;
+
+        f.compute_root().async();
+        g.parallel(y);
+
+        Buffer<int> out = g.realize(16, 64);
+        if (check(out, 5) != 0) {
+            return -1;
+        }
+    }
+
+    {
+        // A producer computed per tile, running one tile ahead.
+        Func f("f"), g("g");
+        f(x, y) = x * 3 + y;
+        g(x, y) = f(x, y) + f(x, y + 1) - 7;
+
+        g.tile(x, y, xo, yo, xi, yi, 8, 8);
+        f.compute_at(g, xo).store_root().async();
+
+        Buffer<int> out = g.realize(32, 32);
+        if (check(out, -7) != 0) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
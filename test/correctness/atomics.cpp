@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    int W = 128, H = 128;
+
+    // Integer histogram, parallelized over the reduction domain
+    {
+        int reference_hist[256];
+        for (int i = 0; i < 256; i++) {
+            reference_hist[i] = 0;
+        }
+
+        Buffer<uint8_t> in(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                in(x, y) = uint8_t(rand() & 0x000000ff);
+                reference_hist[in(x, y)] += 1;
+            }
+        }
+
+        Func hist("hist");
+        Var x;
+        RDom r(in);
+        hist(x) = 0;
+        hist(cast<int>(in(r.x, r.y))) += 1;
+        hist.update().atomic().parallel(r.y);
+
+        Buffer<int32_t> histogram = hist.realize(256);
+        for (int i = 0; i < 256; i++) {
+            if (histogram(i) != reference_hist[i]) {
+                printf("Error: bucket %d is %d instead of %d\n",
+                       i, histogram(i), reference_hist[i]);
+                return -1;
+            }
+        }
+    }
+
+    // Floating point scatter with vectorization, as produced by the
+    // adjoint of a gather
+    {
+        const int N = 64;
+        Buffer<float> weights(W, H);
+        Buffer<int> index(W, H);
+        float reference[N];
+        for (int i = 0; i < N; i++) {
+            reference[i] = 0.f;
+        }
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                // Use small integers so that summation order doesn't matter
+                weights(x, y) = float(rand() % 8);
+                index(x, y) = rand() % N;
+                reference[index(x, y)] += weights(x, y);
+            }
+        }
+
+        Func splat("splat");
+        Var x;
+        RDom r(weights);
+        splat(x) = 0.f;
+        splat(index(r.x, r.y)) += weights(r.x, r.y);
+        RVar rxo, rxi;
+        splat.update().atomic().split(r.x, rxo, rxi, 8).vectorize(rxi).parallel(r.y);
+
+        Buffer<float> result = splat.realize(N);
+        for (int i = 0; i < N; i++) {
+            if (result(i) != reference[i]) {
+                printf("Error: splat(%d) is %f instead of %f\n",
+                       i, result(i), reference[i]);
+                return -1;
+            }
+        }
+    }
+
+    // A scatter written as e + f(args) is parallelized with atomics by
+    // simple_autoschedule too
+    {
+        const int N = 64, M = 1 << 16;
+        Buffer<float> weights(M);
+        Buffer<int> index(M);
+        float reference[N];
+        for (int i = 0; i < N; i++) {
+            reference[i] = 0.f;
+        }
+        for (int i = 0; i < M; i++) {
+            weights(i) = float(rand() % 8);
+            index(i) = rand() % N;
+            reference[index(i)] += weights(i);
+        }
+
+        Func splat("splat_reversed");
+        Var x;
+        RDom r(0, M);
+        splat(x) = 0.f;
+        splat(index(r)) = weights(r) + splat(index(r));
+        simple_autoschedule(splat, {}, {{0, N - 1}});
+        if (!splat.function().update(0).schedule().atomic()) {
+            printf("Error: simple_autoschedule didn't make the scatter atomic\n");
+            return -1;
+        }
+
+        Buffer<float> result = splat.realize(N);
+        for (int i = 0; i < N; i++) {
+            if (result(i) != reference[i]) {
+                printf("Error: splat_reversed(%d) is %f instead of %f\n",
+                       i, result(i), reference[i]);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,10 +1,32 @@
 #include <cmath>
+#include <limits>
 
 #include "Halide.h"
 
 using namespace Halide;
 using namespace Halide::Internal;
 
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+// out(x) = 2 * in(x), as a stand-in for a hand-written kernel
+extern "C" DLLEXPORT int autodiff_extern_double(halide_buffer_t *in, halide_buffer_t *out) {
+    if (in->is_bounds_query()) {
+        in->dim[0].min = out->dim[0].min;
+        in->dim[0].extent = out->dim[0].extent;
+        return 0;
+    }
+    const float *src = (const float *)in->host - in->dim[0].min;
+    float *dst = (float *)out->host - out->dim[0].min;
+    for (int x = out->dim[0].min; x < out->dim[0].min + out->dim[0].extent; x++) {
+        dst[x] = 2.f * src[x];
+    }
+    return 0;
+}
+
 template<typename T>
 inline void check(int line_number, T x, T target, T threshold = T(1e-6)) {
     _halide_user_assert(std::fabs((x) - (target)) < threshold)
@@ -758,6 +780,57 @@ void test_repeat_edge() {
     check(__LINE__, d_input_buf(1), 5.f);
 }
 
+void test_repeat_edge_2d() {
+    Var x("x"), y("y");
+    Buffer<float> input(3, 2, "input");
+    input.fill(1.f);
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    RDom r(0, 5, 0, 4);
+    Func loss("loss");
+    loss() += clamped(r.x - 1, r.y - 1) * cast<float>(r.x + 1);
+    Derivative d = propagate_adjoints(loss);
+
+    Buffer<float> d_input = d(input).realize(3, 2);
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 3; i++) {
+            float correct = 0.f;
+            for (int ry = 0; ry < 4; ry++) {
+                for (int rx = 0; rx < 5; rx++) {
+                    if (std::min(std::max(rx - 1, 0), 2) == i &&
+                        std::min(std::max(ry - 1, 0), 1) == j) {
+                        correct += rx + 1;
+                    }
+                }
+            }
+            check(__LINE__, d_input(i, j), correct);
+        }
+    }
+}
+
+void test_max_pool() {
+    Var x("x");
+    Buffer<float> input(8, "input");
+    float values[] = {1.f, 3.f, 2.f, 0.f, 5.f, 4.f, 6.f, 7.f};
+    for (int i = 0; i < 8; i++) {
+        input(i) = values[i];
+    }
+    RDom r(0, 2);
+    Func pooled("pooled");
+    pooled(x) = -1e10f;
+    pooled(x) = max(pooled(x), input(2 * x + r.x));
+    RDom rp(0, 4);
+    Func loss("loss");
+    loss() += pooled(rp.x) * cast<float>(rp.x + 1);
+    Derivative d = propagate_adjoints(loss);
+
+    Buffer<float> d_input = d(input).realize(8);
+    // Only the max of each window gets a gradient.
+    float expected[] = {0.f, 1.f, 2.f, 0.f, 3.f, 0.f, 0.f, 4.f};
+    for (int i = 0; i < 8; i++) {
+        check(__LINE__, d_input(i), expected[i]);
+    }
+}
+
 void test_constant_exterior() {
     Var x("x");
     Buffer<float> input(2);
@@ -992,6 +1065,46 @@ void test_tuple() {
     check(__LINE__, d_input_buf(2), 1.f);
 }
 
+void test_tuple_scatter() {
+    Var x("x");
+    Buffer<float> input(4, "input");
+    Buffer<int> index(4, "index");
+    float values[] = {1.f, 2.f, 3.f, 4.f};
+    int indices[] = {2, 0, 3, 2};
+    for (int i = 0; i < 4; i++) {
+        input(i) = values[i];
+        index(i) = indices[i];
+    }
+    Func tuple("tuple");
+    tuple(x) = Tuple(2.f * input(x), input(x) * input(x));
+    RDom r(0, 4);
+    Expr i = clamp(index(r), 0, 3);
+    Expr condition = input(r) > 1.5f;
+    Func loss("loss");
+    loss() += select(condition, tuple(i)[0], 0.f) + select(condition, tuple(i)[1], 0.f);
+    Derivative d = propagate_adjoints(loss);
+
+    // Both components are scattered to by the same update
+    Func d_tuple = d(tuple);
+    _halide_user_assert(d_tuple.num_update_definitions() == 1)
+        << "The adjoint of tuple has " << d_tuple.num_update_definitions()
+        << " updates instead of 1\n";
+    Realization d_tuple_buf = d_tuple.realize(4);
+    Buffer<float> d_tuple_buf_0 = d_tuple_buf[0];
+    Buffer<float> d_tuple_buf_1 = d_tuple_buf[1];
+    // r = 1, 2, 3 pass the condition and scatter to 0, 3 and 2
+    float expected_d_tuple[] = {1.f, 0.f, 1.f, 1.f};
+    for (int i = 0; i < 4; i++) {
+        check(__LINE__, d_tuple_buf_0(i), expected_d_tuple[i]);
+        check(__LINE__, d_tuple_buf_1(i), expected_d_tuple[i]);
+    }
+
+    Buffer<float> d_input = d(input).realize(4);
+    for (int i = 0; i < 4; i++) {
+        check(__LINE__, d_input(i), expected_d_tuple[i] * (2.f + 2.f * values[i]));
+    }
+}
+
 void test_floor_ceil() {
     Var x("x");
     Buffer<float> input(3);
@@ -1236,6 +1349,669 @@ void test_reverse_forward() {
     check(__LINE__, d2_input_buf(9), d2_output_buf(8));
 }
 
+void test_scatter_to_gather() {
+    Var x("x"), y("y");
+    Buffer<float> input(10);
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i);
+    }
+    Func g("g");
+    g(x, y) = input(x + 2 * y);
+    RDom r(0, 4, 0, 3);
+    Func f_loss("f_loss");
+    f_loss() += g(r.x, r.y);
+    Derivative d = propagate_adjoints(f_loss);
+    Func d_input = d(input);
+    // x + 2 * y is inverted for x, so the adjoint should be a gather
+    _halide_user_assert(!has_non_pure_update(d_input)) << "Function has non pure update\n";
+    Buffer<float> d_input_buf = d_input.realize(10);
+    // d_input(i) is the number of (x, y) with x + 2 * y == i
+    for (int i = 0; i < 10; i++) {
+        int count = 0;
+        for (int yy = 0; yy < 3; yy++) {
+            int xx = i - 2 * yy;
+            if (xx >= 0 && xx < 4) {
+                count++;
+            }
+        }
+        check(__LINE__, d_input_buf(i), float(count));
+    }
+}
+
+void test_checkpointing() {
+    Var x("x");
+    Buffer<float> input(10);
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    Func f1("f1");
+    f1(x) = sin(input(x));
+    Func f2("f2");
+    f2(x) = f1(x) * f1(x + 1);
+    RDom r(0, 8);
+    Func f_loss("f_loss");
+    f_loss() += f2(r.x) * f2(r.x);
+    Derivative d_stored = propagate_adjoints(f_loss);
+    Buffer<float> d_input_stored = d_stored(input).realize(10);
+
+    PropagateAdjointsOptions options;
+    options.checkpoint_policy = CheckpointPolicy::RecomputeMarked;
+    options.recompute = { f1.name(), f2.name() };
+    Derivative d = propagate_adjoints(f_loss, options);
+    _halide_user_assert(d.recomputed.count(f1.name()) == 1 &&
+                        d.recomputed.count(f2.name()) == 1)
+        << "f1 and f2 should be recomputed\n";
+    // The adjoint of the input should no longer read the forward Funcs
+    std::map<std::string, Function> env = find_transitive_calls(d(input).function());
+    _halide_user_assert(env.find(f1.name()) == env.end() &&
+                        env.find(f2.name()) == env.end())
+        << "Adjoint still depends on a recomputed Func\n";
+    Buffer<float> d_input = d(input).realize(10);
+    for (int i = 0; i < 10; i++) {
+        check(__LINE__, d_input(i), d_input_stored(i));
+    }
+
+    // A zero budget recomputes every intermediate that can be recomputed
+    options.checkpoint_policy = CheckpointPolicy::MemoryBudget;
+    options.memory_budget = 0;
+    d = propagate_adjoints(f_loss, options);
+    _halide_user_assert(d.recomputed.count(f1.name()) == 1)
+        << "f1 should be recomputed with a zero memory budget\n";
+    d_input = d(input).realize(10);
+    for (int i = 0; i < 10; i++) {
+        check(__LINE__, d_input(i), d_input_stored(i));
+    }
+}
+
+void test_fuse_adjoints() {
+    Var x("x");
+    Buffer<float> input(10);
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    Func f("f");
+    f(x) = input(x) * input(x);
+    f(2) = sin(f(3));
+    f(5) = f(4) * f(6);
+    RDom r(0, 8);
+    Func f_loss("f_loss");
+    f_loss() += f(r.x) * f(r.x);
+    Derivative d_unfused = propagate_adjoints(f_loss);
+    Buffer<float> d_input_unfused = d_unfused(input).realize(10);
+
+    PropagateAdjointsOptions options;
+    options.fuse_adjoints = true;
+    Derivative d = propagate_adjoints(f_loss, options);
+    std::map<std::string, Function> env_unfused =
+        find_transitive_calls(d_unfused(input).function());
+    std::map<std::string, Function> env = find_transitive_calls(d(input).function());
+    _halide_user_assert(env.size() < env_unfused.size())
+        << "Fusion should remove adjoint stages\n";
+    for (const auto &it : env) {
+        _halide_user_assert(it.first.find("_ce") == std::string::npos)
+            << "Boundary condition " << it.first << " was not fused\n";
+    }
+    Buffer<float> d_input = d(input).realize(10);
+    for (int i = 0; i < 10; i++) {
+        check(__LINE__, d_input(i), d_input_unfused(i));
+    }
+}
+
+void test_tiled_reductions() {
+    Var x("x"), y("y");
+    Buffer<float> input(100, 30);
+    for (int j = 0; j < 30; j++) {
+        for (int i = 0; i < 100; i++) {
+            input(i, j) = float(i - j) / 50.f;
+        }
+    }
+    Buffer<float> weights(2);
+    weights(0) = 0.5f;
+    weights(1) = -2.f;
+    Func f("f");
+    f(x, y) = weights(0) * input(x, y) + weights(1) * input(x, y) * input(x, y);
+    RDom r(0, 100, 0, 30);
+    Func f_loss("f_loss");
+    f_loss() += f(r.x, r.y);
+
+    PropagateAdjointsOptions options;
+    options.reduction_tile_size = 8;
+    Derivative d = propagate_adjoints(f_loss, options);
+    Derivative d_serial = propagate_adjoints(f_loss);
+    Func partial = d.partial_sums(weights.name(), 0);
+    _halide_user_assert(partial.defined())
+        << "The adjoint of the weights should be split into partial sums\n";
+    // The adjoint of f scatters, and isn't tiled.
+    _halide_user_assert(!d.partial_sums(f.name(), 0).defined())
+        << "The adjoint of f shouldn't be split into partial sums\n";
+
+    Buffer<float> d_weights = d(weights).realize(2);
+    Buffer<float> d_weights_serial = d_serial(weights).realize(2);
+    for (int i = 0; i < 2; i++) {
+        // The sums are reassociated.
+        float threshold = 1e-5f * std::max(1.f, std::fabs(d_weights_serial(i)));
+        check(__LINE__, d_weights(i), d_weights_serial(i), threshold);
+    }
+}
+
+void test_accumulate_into() {
+    Var x("x");
+    Buffer<float> input(10);
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    Func weights("weights");
+    weights(x) = input(x) * 2.f;
+    Func f("f");
+    f(x) = weights(x) * weights(9 - x);
+    RDom r(0, 10);
+    Func f_loss("f_loss");
+    f_loss() += f(r.x);
+    Derivative d = propagate_adjoints(f_loss);
+    Buffer<float> d_input = d(input).realize(10);
+    Buffer<float> d_weights = d(weights).realize(10);
+
+    // Accumulate the gradients into the previous ones, in place
+    Buffer<float> acc_input(10), acc_weights(10);
+    for (int i = 0; i < 10; i++) {
+        acc_input(i) = float(i);
+        acc_weights(i) = float(10 - i);
+    }
+    Func prev_input("prev_input"), prev_weights("prev_weights");
+    prev_input(x) = acc_input(x);
+    prev_weights(x) = acc_weights(x);
+    PropagateAdjointsOptions options;
+    options.accumulate_into[input.name()] = prev_input;
+    options.accumulate_into[weights.name()] = prev_weights;
+    Derivative d_acc = propagate_adjoints(f_loss, options);
+    d_acc(input).realize(acc_input);
+    d_acc(weights).realize(acc_weights);
+    for (int i = 0; i < 10; i++) {
+        check(__LINE__, acc_input(i), float(i) + d_input(i));
+        check(__LINE__, acc_weights(i), float(10 - i) + d_weights(i));
+    }
+}
+
+void test_batched_adjoints() {
+    Var x("x");
+    Buffer<float> input(10);
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    Func f1("f1");
+    f1(x) = sin(input(x));
+    Func f2("f2");
+    f2(x) = f1(x) * f1(x + 1);
+    f2(3) = f2(3) * input(5);
+    const int batch_size = 3;
+    Buffer<float> seeds(batch_size, 8);
+    for (int k = 0; k < batch_size; k++) {
+        for (int i = 0; i < 8; i++) {
+            seeds(k, i) = float(k + 1) * float(i - 4);
+        }
+    }
+    Derivative d = propagate_batched_adjoints(f2, seeds);
+    Buffer<float> d_input = d(input).realize(batch_size, 10);
+    for (int k = 0; k < batch_size; k++) {
+        Buffer<float> seed(8);
+        for (int i = 0; i < 8; i++) {
+            seed(i) = seeds(k, i);
+        }
+        Derivative d_single = propagate_adjoints(f2, seed);
+        Buffer<float> d_input_single = d_single(input).realize(10);
+        for (int i = 0; i < 10; i++) {
+            check(__LINE__, d_input(k, i), d_input_single(i));
+        }
+    }
+}
+
+void test_batched_tangents() {
+    Var x("x"), k("k");
+    Buffer<float> input(10);
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    Func output("output");
+    RDom r(0, 2);
+    output(x) = 0.f;
+    output(x) += sin(input(x + r)) * input(x);
+    const int batch_size = 4;
+    Func d_input("d_input");
+    d_input(k, x) = cast<float>(k + 1) * cast<float>(x % 3);
+    Func d_output = propagate_batched_tangents(output, { { input.name(), d_input } });
+    Buffer<float> d_output_buf = d_output.realize(batch_size, 5);
+
+    for (int b = 0; b < batch_size; b++) {
+        Func d_input_single("d_input_single");
+        d_input_single(x) = float(b + 1) * cast<float>(x % 3);
+        Func d_output_single =
+            propagate_tangents(output, { { input.name(), d_input_single } });
+        Buffer<float> d_output_single_buf = d_output_single.realize(5);
+        for (int i = 0; i < 5; i++) {
+            check(__LINE__, d_output_buf(b, i), d_output_single_buf(i));
+        }
+    }
+}
+
+void test_hessian_vector_product() {
+    Var x("x");
+    Buffer<float> input(10, "input");
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    Func f("f");
+    f(x) = input(x) * input(x);
+    RDom r(0, 10);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += f(r.x) * input(r.x);
+    Func direction("direction");
+    direction(x) = cast<float>(x % 2 + 1);
+    Derivative d = propagate_hessian_vector_products(loss, { { input.name(), direction } });
+    // loss = \sum x^3, so Hv = 6 x v
+    Buffer<float> hv = d(input).realize(10);
+    for (int i = 0; i < 10; i++) {
+        check(__LINE__, hv(i), 6.f * input(i) * float(i % 2 + 1), 1e-5f);
+    }
+}
+
+void test_custom_gradient() {
+    Var x("x");
+    Buffer<float> input(10, "input");
+    for (int i = 0; i < 10; i++) {
+        input(i) = float(i) / 10.f;
+    }
+    RDom r(0, 8);
+    {
+        Func f("f");
+        f(x) = input(x) * input(x);
+        Func f_loss("f_loss");
+        f_loss() += f(r.x);
+        // Deliberately not the true gradient, to make sure it's the one used
+        PropagateAdjointsOptions options;
+        options.custom_gradients[f.name()] = [&](const Func &adjoint) {
+            Func d_input("d_input_custom");
+            d_input(x) = 3.f * adjoint(x);
+            return std::map<std::string, Func>{ { input.name(), d_input } };
+        };
+        Derivative d = propagate_adjoints(f_loss, options);
+        Buffer<float> d_input = d(input).realize(10);
+        for (int i = 0; i < 10; i++) {
+            check(__LINE__, d_input(i), i < 8 ? 3.f : 0.f);
+        }
+    }
+    {
+        Func in_f("in_f");
+        in_f(x) = input(x);
+        Func f("f_extern");
+        f.define_extern("autodiff_extern_double", { in_f }, Float(32), 1);
+        Func f_loss("f_loss");
+        f_loss() += f(r.x) * f(r.x);
+        PropagateAdjointsOptions options;
+        options.custom_gradients[f.name()] = [&](const Func &adjoint) {
+            Func d_in("d_in_extern");
+            d_in(x) = 2.f * adjoint(x);
+            return std::map<std::string, Func>{ { in_f.name(), d_in } };
+        };
+        Derivative d = propagate_adjoints(f_loss, options);
+        // d/dx (2x)^2 = 8x
+        Buffer<float> d_input = d(input).realize(10);
+        for (int i = 0; i < 10; i++) {
+            check(__LINE__, d_input(i), i < 8 ? 8.f * input(i) : 0.f);
+        }
+    }
+}
+
+void test_optimizer_step() {
+    Var x("x");
+    Buffer<float> w_buf(10, "w_buf"), m_buf(10, "m_buf"), v_buf(10, "v_buf");
+    w_buf.fill(1.f);
+    m_buf.fill(0.f);
+    v_buf.fill(0.f);
+    Func w("w"), m("m"), v("v");
+    w(x) = w_buf(x);
+    m(x) = m_buf(x);
+    v(x) = v_buf(x);
+    // loss = \sum (w - x)^2, so the gradient is 2 (w - x)
+    RDom r(0, 10);
+    Func loss("loss");
+    loss() += pow(w(r.x) - cast<float>(r.x), 2);
+    Derivative d = propagate_adjoints(loss);
+    for (Func f : d.funcs(loss)) {
+        f.compute_root();
+    }
+    d(w).compute_root();
+
+    {
+        OptimizerOptions options;
+        options.learning_rate = 0.25f;
+        Func step = optimizer_step(d, w, {}, options);
+        // Update the weights in place. Each step halves the distance
+        // to the minimum.
+        step.realize(w_buf);
+        for (int i = 0; i < 10; i++) {
+            check(__LINE__, w_buf(i), (1.f + i) / 2.f);
+        }
+    }
+
+    {
+        Param<int> t;
+        OptimizerOptions options;
+        options.optimizer = Optimizer::Adam;
+        options.learning_rate = 0.1f;
+        options.step = t;
+        Func step = optimizer_step(d, w, { m, v }, options);
+        Buffer<float> expected_w(10), expected_m(10), expected_v(10);
+        expected_w.copy_from(w_buf);
+        expected_m.fill(0.f);
+        expected_v.fill(0.f);
+        for (int k = 1; k <= 3; k++) {
+            for (int i = 0; i < 10; i++) {
+                float g = 2.f * (expected_w(i) - i);
+                expected_m(i) = 0.9f * expected_m(i) + 0.1f * g;
+                expected_v(i) = 0.999f * expected_v(i) + 0.001f * g * g;
+                float m_hat = expected_m(i) / (1.f - std::pow(0.9f, (float)k));
+                float v_hat = expected_v(i) / (1.f - std::pow(0.999f, (float)k));
+                expected_w(i) -= 0.1f * m_hat / (std::sqrt(v_hat) + 1e-8f);
+            }
+            t.set(k);
+            step.realize({ w_buf, m_buf, v_buf });
+        }
+        for (int i = 0; i < 10; i++) {
+            check(__LINE__, w_buf(i), expected_w(i), 1e-5f);
+            check(__LINE__, m_buf(i), expected_m(i), 1e-5f);
+            check(__LINE__, v_buf(i), expected_v(i), 1e-5f);
+        }
+    }
+}
+
+void test_mixed_precision() {
+    Var x("x");
+    const int n = 4096;
+    Buffer<float16_t> input(n, "input");
+    for (int i = 0; i < n; i++) {
+        input(i) = float16_t(1.f);
+    }
+    Func f("f");
+    f(x) = input(x) * float16_t(0.5f);
+    RDom r(0, n);
+    Func loss("loss");
+    loss() = float16_t(0.f);
+    loss() += f(r.x) * cast<float16_t>(r.x % 3);
+
+    PropagateAdjointsOptions options;
+    options.accumulation_type = Float(32);
+    Param<float> scale;
+    options.loss_scale = scale;
+    scale.set(1024.f);
+    Derivative d = propagate_adjoints(loss, options);
+    Func d_input = d(input);
+    if (d_input.value().type() != Float(32)) {
+        _halide_user_assert(false) << "Adjoint has type " << d_input.value().type() << " instead of float32\n";
+    }
+    // The forward Funcs keep their type
+    if (f.value().type() != Float(16)) {
+        _halide_user_assert(false) << "Forward Func has type " << f.value().type() << " instead of float16\n";
+    }
+    // The adjoints are computed for the scaled loss.
+    Buffer<float> d_input_buf = d_input.realize(n);
+    for (int i = 0; i < n; i++) {
+        check(__LINE__, d_input_buf(i) / 1024.f, 0.5f * (i % 3));
+    }
+
+    Buffer<bool> finite = all_finite(d_input, { { 0, n } }).realize();
+    if (!finite()) {
+        _halide_user_assert(false) << "Gradients should be finite\n";
+    }
+    scale.set(std::numeric_limits<float>::infinity());
+    finite = all_finite(d_input, { { 0, n } }).realize();
+    if (finite()) {
+        _halide_user_assert(false) << "Gradients should not be finite\n";
+    }
+}
+
+void test_invert_scans() {
+    Var x("x"), t("t");
+    const int steps = 8;
+    Buffer<float> input(4, steps, "input");
+    for (int j = 0; j < steps; j++) {
+        for (int i = 0; i < 4; i++) {
+            input(i, j) = 0.25f * i - 0.125f * j;
+        }
+    }
+    Func f("f");
+    f(x, t) = input(x, t);
+    RDom r(0, steps - 1);
+    // An IIR filter, which can be replayed backwards from its last state
+    f(x, r + 1) = 0.5f * f(x, r) + input(x, r + 1);
+    RDom s(0, 4, 0, steps);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += f(s.x, s.y) * f(s.x, s.y);
+
+    Derivative stored = propagate_adjoints(loss);
+    PropagateAdjointsOptions options;
+    options.invert_scans = true;
+    Derivative inverted = propagate_adjoints(loss, options);
+    if (!inverted.reconstructed(f).defined() || stored.reconstructed(f).defined()) {
+        _halide_user_assert(false) << "The scan should only be inverted when asked to\n";
+    }
+    Buffer<float> d_stored = stored(input).realize(4, steps);
+    Buffer<float> d_inverted = inverted(input).realize(4, steps);
+    for (int j = 0; j < steps; j++) {
+        for (int i = 0; i < 4; i++) {
+            // Replaying the scan rounds differently
+            check(__LINE__, d_inverted(i, j), d_stored(i, j), 1e-4f);
+        }
+    }
+}
+
+void test_pruned_inputs() {
+    Var x("x");
+    Buffer<float> input(8, "input");
+    Buffer<float> weights(3, "weights");
+    for (int i = 0; i < 8; i++) {
+        input(i) = i * 0.5f;
+    }
+    for (int i = 0; i < 3; i++) {
+        weights(i) = 1.f + i;
+    }
+    Func clamped("clamped");
+    clamped(x) = input(clamp(x, 0, 7));
+    Func squared("squared");
+    squared(x) = clamped(x) * clamped(x);
+    RDom k(0, 3);
+    Func conv("conv");
+    conv(x) = 0.f;
+    conv(x) += squared(x + k) * weights(k);
+    RDom r(0, 6);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += conv(r.x);
+
+    Derivative full = propagate_adjoints(loss);
+    Derivative pruned = propagate_adjoints(loss, { weights.name() });
+    // Only the Funcs between the loss and the weights are differentiated
+    if (pruned.adjoints.count(FuncKey{ clamped.name(), -1 }) ||
+        pruned.adjoints.count(FuncKey{ squared.name(), -1 }) ||
+        pruned.adjoints.count(FuncKey{ input.name(), -1 })) {
+        _halide_user_assert(false) << "The adjoints of the input should have been pruned\n";
+    }
+    Buffer<float> d_full = full(weights).realize(3);
+    Buffer<float> d_pruned = pruned(weights).realize(3);
+    for (int i = 0; i < 3; i++) {
+        check(__LINE__, d_pruned(i), d_full(i));
+    }
+}
+
+void test_primal_reuse() {
+    Var x("x");
+    Buffer<float> input(8, "input");
+    for (int i = 0; i < 8; i++) {
+        input(i) = (i - 4) * 0.25f;
+    }
+    Func e("e");
+    e(x) = exp(input(x));
+    Func sigmoid("sigmoid");
+    sigmoid(x) = 1.f / (1.f + e(x));
+    Func t("t");
+    t(x) = tanh(sigmoid(x));
+    RDom r(0, 8);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += t(r.x);
+
+    Derivative d = propagate_adjoints(loss);
+    // The adjoints read the stored values of e, sigmoid and t instead
+    // of recomputing them
+    std::map<std::string, Function> calls = find_transitive_calls(d(input).function());
+    for (const Func &f : {e, sigmoid, t}) {
+        if (!calls.count(f.name())) {
+            _halide_user_assert(false) << "The adjoints don't read " << f.name() << "\n";
+        }
+    }
+    Buffer<float> d_input = d(input).realize(8);
+    for (int i = 0; i < 8; i++) {
+        float ev = std::exp(input(i));
+        float s = 1.f / (1.f + ev);
+        float tv = std::tanh(s);
+        // d/dx tanh(1 / (1 + exp(x)))
+        float expected = (1.f - tv * tv) * (-s * s) * ev;
+        check(__LINE__, d_input(i), expected, 1e-5f);
+    }
+}
+
+void test_compressed_activations() {
+    Var x("x");
+    Buffer<float> input(64, "input");
+    Buffer<float> weights(64, "weights");
+    for (int i = 0; i < 64; i++) {
+        input(i) = (i % 17 - 8) * 0.25f;
+        weights(i) = (i % 5) - 2.f;
+    }
+    Func e("e");
+    e(x) = exp(input(x));
+    Func h("h");
+    h(x) = input(x) * 2.f + 0.1f;
+    Func relu("relu");
+    relu(x) = max(h(x), 0.f);
+    RDom r(0, 64);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += e(r.x) * weights(r.x) + relu(r.x) * weights(r.x);
+
+    for (ActivationCompression format : {ActivationCompression::Float16,
+                                         ActivationCompression::BFloat16,
+                                         ActivationCompression::Int8Block}) {
+        PropagateAdjointsOptions options;
+        options.compressed_activations[e.name()] = format;
+        options.compressed_activations[h.name()] = ActivationCompression::SignMask;
+        options.activation_block_size = 8;
+        Derivative d = propagate_adjoints(loss, options);
+        if (!d.compressed(e).defined() || !d.compressed(h).defined() ||
+            d.compressed_scales(e).defined() != (format == ActivationCompression::Int8Block)) {
+            _halide_user_assert(false) << "Missing compressed activations\n";
+        }
+        d.compressed(e).compute_root();
+        d.compressed(h).compute_root();
+        if (format == ActivationCompression::Int8Block) {
+            d.compressed_scales(e).compute_root();
+        }
+        Buffer<float> d_input = d(input).realize(64);
+        // The largest relative error of each format
+        float tolerance = format == ActivationCompression::Float16 ? 1e-3f : 1e-2f;
+        for (int i = 0; i < 64; i++) {
+            float ev = std::exp(input(i));
+            float relu_grad = input(i) * 2.f + 0.1f > 0.f ? 2.f : 0.f;
+            float expected = weights(i) * (ev + relu_grad);
+            // The block of 8 values of e sharing a scale with this one
+            float block_max = 0.f;
+            for (int j = i / 8 * 8; j < i / 8 * 8 + 8; j++) {
+                block_max = std::max(block_max, std::exp(input(j)));
+            }
+            check(__LINE__, d_input(i), expected,
+                  std::fabs(weights(i)) * tolerance * block_max + 1e-5f);
+        }
+    }
+}
+
+void test_specializations() {
+    Var x("x");
+    Buffer<float> input(16, "input");
+    for (int i = 0; i < 16; i++) {
+        input(i) = float(i);
+    }
+    Param<int> stride("stride");
+    Func f("f");
+    f(x) = input(x * stride) * 2.f;
+    f.specialize(stride == 1);
+    RDom r(0, 8);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += f(r.x);
+
+    Derivative d = propagate_adjoints(loss);
+    // The adjoint of input scatters through the strided read, in an
+    // update that gets the specialization of f.
+    std::vector<Stage> stages = d.specialize();
+    _halide_user_assert(stages.size() == 1)
+        << "Got " << stages.size() << " specializations of the adjoints instead of 1\n";
+    Func d_input = d(input);
+    _halide_user_assert(d_input.num_update_definitions() > 0 &&
+                        d_input.function().update(0).specializations().size() == 1)
+        << "The update of the adjoint of input should be specialized\n";
+    const Expr &condition = d_input.function().update(0).specializations()[0].condition;
+    _halide_user_assert(equal(condition, stride == 1))
+        << "The adjoint was specialized on " << condition << " instead of stride == 1\n";
+
+    for (int s = 1; s <= 2; s++) {
+        stride.set(s);
+        Buffer<float> result = d_input.realize(16);
+        for (int i = 0; i < 16; i++) {
+            float expected = (i % s == 0 && i / s < 8) ? 2.f : 0.f;
+            check(__LINE__, result(i), expected);
+        }
+    }
+}
+
+void test_transfer_schedules() {
+    Var x("x"), y("y"), xo("xo"), xi("xi");
+    Buffer<float> input(16, 8, "input");
+    for (int j = 0; j < 8; j++) {
+        for (int i = 0; i < 16; i++) {
+            input(i, j) = float(i + j);
+        }
+    }
+    Func f("f");
+    f(x, y) = input(x, y) * input(x, y);
+    f.split(x, xo, xi, 4).vectorize(xi).parallel(y);
+    RDom r(0, 16, 0, 8);
+    Func loss("loss");
+    loss() = 0.f;
+    loss() += f(r.x, r.y);
+
+    PropagateAdjointsOptions options;
+    options.transfer_schedules = true;
+    Derivative d = propagate_adjoints(loss, options);
+    // The adjoint of f is defined over the vars of f, and gets its
+    // schedule.
+    Func d_f = d(f);
+    bool vectorized = false, parallel = false;
+    for (const Internal::Dim &dim : d_f.function().definition().schedule().dims()) {
+        vectorized |= dim.for_type == Internal::ForType::Vectorized;
+        parallel |= dim.for_type == Internal::ForType::Parallel;
+    }
+    _halide_user_assert(vectorized && parallel)
+        << "The adjoint of f should be vectorized and parallel like f\n";
+
+    Buffer<float> result = d(input).realize(16, 8);
+    for (int j = 0; j < 8; j++) {
+        for (int i = 0; i < 16; i++) {
+            check(__LINE__, result(i, j), 2.f * input(i, j));
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     test_scalar<float>();
     test_scalar<double>();
@@ -1254,6 +2030,8 @@ int main(int argc, char **argv) {
     test_histogram();
     test_rdom_update();
     test_repeat_edge();
+    test_repeat_edge_2d();
+    test_max_pool();
     test_constant_exterior();
     test_repeat_image();
     test_mirror_image();
@@ -1262,6 +2040,7 @@ int main(int argc, char **argv) {
     test_second_order_conv();
     test_implicit_vars();
     test_tuple();
+    test_tuple_scatter();
     test_floor_ceil();
     test_downsampling();
     test_upsampling();
@@ -1270,5 +2049,22 @@ int main(int argc, char **argv) {
     test_rdom_predicate();
     test_forward();
     test_reverse_forward();
+    test_checkpointing();
+    test_scatter_to_gather();
+    test_fuse_adjoints();
+    test_tiled_reductions();
+    test_accumulate_into();
+    test_batched_adjoints();
+    test_batched_tangents();
+    test_hessian_vector_product();
+    test_custom_gradient();
+    test_optimizer_step();
+    test_mixed_precision();
+    test_invert_scans();
+    test_pruned_inputs();
+    test_primal_reuse();
+    test_compressed_activations();
+    test_specializations();
+    test_transfer_schedules();
     printf("Success!\n");
 }
\ No newline at end of file
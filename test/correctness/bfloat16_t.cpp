@@ -0,0 +1,53 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <cmath>
+
+using namespace Halide;
+
+int main() {
+    // Check the rounding of the host type.
+    if (bfloat16_t(1.0f + 1.0f / 256).to_bits() != bfloat16_t(1.0f).to_bits() ||
+        bfloat16_t(1.0f + 3.0f / 256).to_bits() != bfloat16_t(1.0f + 4.0f / 256).to_bits() ||
+        !bfloat16_t(std::nanf("")).is_nan() ||
+        !bfloat16_t(1e39).is_infinity()) {
+        printf("bfloat16_t rounds incorrectly\n");
+        return -1;
+    }
+
+    const int W = 100;
+    Buffer<bfloat16_t> a(W), b(W);
+    for (int x = 0; x < W; x++) {
+        a(x) = bfloat16_t((x - 50) / 7.0f);
+        b(x) = bfloat16_t(x * 3.1f + 0.5f);
+    }
+
+    if (a.size_in_bytes() != W * 2) {
+        printf("Incorrect amount of memory allocated\n");
+        return -1;
+    }
+
+    Var x;
+    Func f, g;
+    // Arithmetic on bfloats is done in float and rounded.
+    f(x) = a(x) * b(x) + a(x);
+    // The result of the float math functions is a float, which is
+    // rounded when stored.
+    g(x) = cast<bfloat16_t>(sqrt(abs(f(x)))) + select(a(x) < b(x), a(x), b(x));
+    f.compute_root().vectorize(x, 8);
+    g.vectorize(x, 16);
+
+    Buffer<bfloat16_t> out = g.realize(W);
+
+    for (int i = 0; i < W; i++) {
+        bfloat16_t fi = a(i) * b(i) + a(i);
+        bfloat16_t s = bfloat16_t(std::sqrt(std::abs((float)fi)));
+        bfloat16_t correct = s + (a(i) < b(i) ? a(i) : b(i));
+        if (out(i).to_bits() != correct.to_bits()) {
+            printf("out(%d) = %f instead of %f\n", i, (float)out(i), (float)correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+    if (t.arch != Target::X86 || t.has_gpu_feature()) {
+        printf("Skipping test: requires a cpu-only x86 target\n");
+        return 0;
+    }
+
+    // Compile the pipeline for a baseline x86 target, with only the
+    // hot loop nest also compiled for AVX2.
+    for (Target::Feature f : {Target::AVX, Target::AVX2, Target::FMA, Target::F16C,
+                              Target::AVX512, Target::AVX512_KNL, Target::AVX512_Skylake,
+                              Target::AVX512_Cannonlake, Target::AVX512_VNNI}) {
+        t = t.without_feature(f);
+    }
+
+    const int W = 1000, H = 32;
+    Buffer<float> input(W, H);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = (float)((x * 7 + y * 13) % 17);
+    });
+
+    Var x, y;
+    Func f, g;
+    f(x, y) = input(x, y) * 3.0f + 1.0f;
+    g(x, y) = f(x, y) * f(x, y) - input(x, y);
+    f.compute_at(g, y).vectorize(x, 4);
+    g.specialize(cpu_has_features({Target::AVX2, Target::FMA})).vectorize(x, 8);
+    g.vectorize(x, 4);
+
+    Buffer<float> out = g.realize(W, H, t);
+    for (int yi = 0; yi < H; yi++) {
+        for (int xi = 0; xi < W; xi++) {
+            float fv = input(xi, yi) * 3.0f + 1.0f;
+            float correct = fv * fv - input(xi, yi);
+            if (out(xi, yi) != correct) {
+                printf("out(%d, %d) = %f instead of %f\n", xi, yi, out(xi, yi), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Ahead-of-time, the check happens at runtime, and the
+    // specialized loop nest uses AVX registers.
+    std::string assembly_file = Internal::get_test_tmp_dir() + "cpu_features_specialization.s";
+    Internal::ensure_no_file_exists(assembly_file);
+    g.compile_to_assembly(assembly_file, {}, "g", t);
+    Internal::assert_file_exists(assembly_file);
+
+    std::ifstream asm_stream(assembly_file);
+    std::stringstream contents;
+    contents << asm_stream.rdbuf();
+    if (contents.str().find("halide_can_use_target_features") == std::string::npos) {
+        printf("No cpu feature check in %s\n", assembly_file.c_str());
+        return -1;
+    }
+    if (contents.str().find("ymm") == std::string::npos) {
+        printf("No AVX code in %s\n", assembly_file.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "Halide.h"
+#include <math.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+bool approx_equal(float a, float b) {
+    return fabs(a - b) <= 1e-3f * std::max(1.0f, fabs(b));
+}
+
+int test_gemm(const Target &t, bool transpose_a, bool transpose_b) {
+    const int M = 37, N = 45, K = 21;
+    Buffer<float> a_buf = transpose_a ? Buffer<float>(M, K) : Buffer<float>(K, M);
+    Buffer<float> b_buf = transpose_b ? Buffer<float>(K, N) : Buffer<float>(N, K);
+    Buffer<float> weights(N, M);
+    a_buf.for_each_element([&](int x, int y) { a_buf(x, y) = (float)((x * 3 + y * 5) % 7) - 3.0f; });
+    b_buf.for_each_element([&](int x, int y) { b_buf(x, y) = (float)((x * 2 + y) % 5) - 2.0f; });
+    weights.for_each_element([&](int x, int y) { weights(x, y) = (float)((x + y) % 3); });
+    auto a_at = [&](int r, int i) { return transpose_a ? a_buf(i, r) : a_buf(r, i); };
+    auto b_at = [&](int j, int r) { return transpose_b ? b_buf(r, j) : b_buf(j, r); };
+
+    // The matrices are computed on the device, and so is the consumer
+    // of the product.
+    Var x, y, xi, yi;
+    Func a("a"), b("b"), w("w");
+    a(x, y) = a_buf(x, y);
+    b(x, y) = b_buf(x, y);
+    w(x, y) = weights(x, y);
+    a.compute_root().gpu_tile(x, y, xi, yi, 8, 8);
+    b.compute_root().gpu_tile(x, y, xi, yi, 8, 8);
+
+    CudaLibraryStage mm = cublas_gemm(a, b, M, N, K, transpose_a, transpose_b);
+    mm.output.compute_root();
+    Func relu("relu");
+    relu(x, y) = max(mm.output(x, y), 0.0f);
+    relu.gpu_tile(x, y, xi, yi, 8, 8);
+
+    Buffer<float> out = relu.realize(N, M, t);
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+            float correct = 0.0f;
+            for (int r = 0; r < K; r++) {
+                correct += a_at(r, i) * b_at(j, r);
+            }
+            correct = std::max(correct, 0.0f);
+            if (!approx_equal(out(j, i), correct)) {
+                printf("gemm(%d, %d) = %f instead of %f (transpose_a: %d, transpose_b: %d)\n",
+                       j, i, out(j, i), correct, transpose_a, transpose_b);
+                return -1;
+            }
+        }
+    }
+
+    // The loss is the sum of the product weighted by w, whose adjoint is w.
+    RDom r(0, N, 0, M);
+    Func loss("loss");
+    loss() = 0.0f;
+    loss() += mm.output(r.x, r.y) * w(r.x, r.y);
+    PropagateAdjointsOptions options;
+    mm.register_gradient(options);
+    Derivative d = propagate_adjoints(loss, options);
+    d(mm.output).compute_root();
+    Buffer<float> da = d(a).realize(a_buf.width(), a_buf.height(), t);
+    Buffer<float> db = d(b).realize(b_buf.width(), b_buf.height(), t);
+    for (int i = 0; i < M; i++) {
+        for (int k = 0; k < K; k++) {
+            float correct = 0.0f;
+            for (int j = 0; j < N; j++) {
+                correct += weights(j, i) * b_at(j, k);
+            }
+            float actual = transpose_a ? da(i, k) : da(k, i);
+            if (!approx_equal(actual, correct)) {
+                printf("d(a)(%d, %d) = %f instead of %f (transpose_a: %d, transpose_b: %d)\n",
+                       k, i, actual, correct, transpose_a, transpose_b);
+                return -1;
+            }
+        }
+    }
+    for (int k = 0; k < K; k++) {
+        for (int j = 0; j < N; j++) {
+            float correct = 0.0f;
+            for (int i = 0; i < M; i++) {
+                correct += a_at(k, i) * weights(j, i);
+            }
+            float actual = transpose_b ? db(k, j) : db(j, k);
+            if (!approx_equal(actual, correct)) {
+                printf("d(b)(%d, %d) = %f instead of %f (transpose_a: %d, transpose_b: %d)\n",
+                       j, k, actual, correct, transpose_a, transpose_b);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int test_conv(const Target &t) {
+    const int W = 6, H = 5, C = 3, K = 4, B = 2, FW = 3, FH = 2, S = 2;
+    const int W_in = (W - 1) * S + FW, H_in = (H - 1) * S + FH;
+    Buffer<float> in_buf(W_in, H_in, C, B), filter_buf(FW, FH, C, K), weights(W, H, K, B);
+    in_buf.for_each_element([&](int x, int y, int c, int n) {
+        in_buf(x, y, c, n) = (float)((x * 3 + y * 7 + c * 5 + n) % 11) / 4.0f - 1.0f;
+    });
+    filter_buf.for_each_element([&](int x, int y, int c, int k) {
+        filter_buf(x, y, c, k) = (float)((x + y * 3 + c * 2 + k * 5) % 7) / 3.0f - 1.0f;
+    });
+    weights.for_each_element([&](int x, int y, int k, int n) {
+        weights(x, y, k, n) = (float)((x * 2 + y + k + n * 3) % 5) - 2.0f;
+    });
+
+    Var x, y, c, n, xi, yi;
+    Func input("input"), filter("filter"), w("w");
+    input(x, y, c, n) = in_buf(x, y, c, n);
+    filter(x, y, c, n) = filter_buf(x, y, c, n);
+    w(x, y, c, n) = weights(x, y, c, n);
+    input.compute_root().gpu_tile(x, y, xi, yi, 8, 8);
+    filter.compute_root().gpu_tile(x, y, xi, yi, 8, 8);
+
+    CudaLibraryStage conv = cudnn_conv(input, filter, W, H, C, K, B, FW, FH, S);
+    Buffer<float> out = conv.output.realize(W, H, K, B, t);
+    Buffer<float> correct_out(W, H, K, B);
+    correct_out.for_each_element([&](int x, int y, int k, int n) {
+        float sum = 0.0f;
+        for (int rc = 0; rc < C; rc++) {
+            for (int ry = 0; ry < FH; ry++) {
+                for (int rx = 0; rx < FW; rx++) {
+                    sum += in_buf(x * S + rx, y * S + ry, rc, n) * filter_buf(rx, ry, rc, k);
+                }
+            }
+        }
+        correct_out(x, y, k, n) = sum;
+    });
+    for (int i = 0; i < (int)out.number_of_elements(); i++) {
+        if (!approx_equal(out.data()[i], correct_out.data()[i])) {
+            printf("conv = %f instead of %f at element %d\n", out.data()[i], correct_out.data()[i], i);
+            return -1;
+        }
+    }
+
+    RDom r(0, W, 0, H, 0, K, 0, B);
+    Func loss("loss");
+    loss() = 0.0f;
+    loss() += conv.output(r.x, r.y, r.z, r.w) * w(r.x, r.y, r.z, r.w);
+    PropagateAdjointsOptions options;
+    conv.register_gradient(options);
+    Derivative d = propagate_adjoints(loss, options);
+    d(conv.output).compute_root();
+    Buffer<float> d_input = d(input).realize(W_in, H_in, C, B, t);
+    Buffer<float> d_filter = d(filter).realize(FW, FH, C, K, t);
+
+    Buffer<float> correct_d_input(W_in, H_in, C, B), correct_d_filter(FW, FH, C, K);
+    correct_d_input.fill(0.0f);
+    correct_d_filter.fill(0.0f);
+    weights.for_each_element([&](int x, int y, int k, int n) {
+        for (int rc = 0; rc < C; rc++) {
+            for (int ry = 0; ry < FH; ry++) {
+                for (int rx = 0; rx < FW; rx++) {
+                    correct_d_input(x * S + rx, y * S + ry, rc, n) += weights(x, y, k, n) * filter_buf(rx, ry, rc, k);
+                    correct_d_filter(rx, ry, rc, k) += weights(x, y, k, n) * in_buf(x * S + rx, y * S + ry, rc, n);
+                }
+            }
+        }
+    });
+    for (int i = 0; i < (int)d_input.number_of_elements(); i++) {
+        if (!approx_equal(d_input.data()[i], correct_d_input.data()[i])) {
+            printf("d(input) = %f instead of %f at element %d\n",
+                   d_input.data()[i], correct_d_input.data()[i], i);
+            return -1;
+        }
+    }
+    for (int i = 0; i < (int)d_filter.number_of_elements(); i++) {
+        if (!approx_equal(d_filter.data()[i], correct_d_filter.data()[i])) {
+            printf("d(filter) = %f instead of %f at element %d\n",
+                   d_filter.data()[i], correct_d_filter.data()[i], i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+    if (!t.has_feature(Target::CUDA)) {
+        printf("Not running test because cuda is not enabled\n");
+        return 0;
+    }
+
+    for (int transpose_a = 0; transpose_a < 2; transpose_a++) {
+        for (int transpose_b = 0; transpose_b < 2; transpose_b++) {
+            if (test_gemm(t, transpose_a, transpose_b) != 0) {
+                return -1;
+            }
+        }
+    }
+    if (test_conv(t) != 0) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
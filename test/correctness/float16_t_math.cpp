@@ -0,0 +1,71 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+std::string lowered(Func f, const Target &t) {
+    std::string filename = Internal::get_test_tmp_dir() + "float16_t_math_" + f.name() + ".stmt";
+    Internal::ensure_no_file_exists(filename);
+    f.compile_to_lowered_stmt(filename, {}, Text, t);
+    std::ifstream stmt(filename);
+    std::stringstream contents;
+    contents << stmt.rdbuf();
+    return contents.str();
+}
+
+int main() {
+    const int W = 100;
+    Buffer<float16_t> a(W), big(W), big2(W);
+    for (int x = 0; x < W; x++) {
+        a(x) = float16_t(x / 8.0f);
+        big(x) = float16_t(2048.0f);
+        big2(x) = float16_t(2048.0f);
+    }
+
+    Var x;
+    Func f("f"), g("g");
+    // Without native float16 math, the chain is computed in float and
+    // rounded once. In float16, a + 2048 would round to an even number.
+    f(x) = (a(x) + big(x)) - big2(x);
+    // The math functions have no float16 versions on the cpu.
+    g(x) = sqrt(f(x)) + select(a(x) < f(x) * 2, a(x), big(x));
+    f.compute_root().vectorize(x, 8);
+    g.vectorize(x, 8);
+
+    Buffer<float16_t> out = g.realize(W);
+    for (int i = 0; i < W; i++) {
+        float16_t correct = float16_t(std::sqrt((float)a(i)) + (float)(i > 0 ? a(i) : big(i)));
+        if (out(i).to_bits() != correct.to_bits()) {
+            printf("out(%d) = %f instead of %f\n", i, (float)out(i), (float)correct);
+            return -1;
+        }
+    }
+
+    // With native float16 math, the arithmetic stays in float16,
+    // unless the Func asks for float.
+    Target arm("arm-64-linux-native_float16");
+    Func h("h"), h_wide("h_wide");
+    h(x) = a(x) * big(x) + a(x);
+    h_wide(x) = a(x) * big(x) + a(x);
+    h_wide.widen_float16_math();
+    if (lowered(h, arm).find("float32") != std::string::npos) {
+        printf("Native float16 math was widened\n");
+        return -1;
+    }
+    if (lowered(h_wide, arm).find("float32") == std::string::npos) {
+        printf("widen_float16_math() was ignored\n");
+        return -1;
+    }
+    if (lowered(h, arm.without_feature(Target::NativeFloat16)).find("float32") == std::string::npos) {
+        printf("Float16 math was not widened without native_float16\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// Compile a kernel to assembly for a CUDA target, and return the source,
+// which embeds the PTX of the kernel.
+std::string compile_kernel(Func f, const std::vector<Argument> &args, Target t) {
+    const char *filename = "gpu_constant_memory.s";
+    f.compile_to_assembly(filename, args, "gpu_constant_memory", t);
+    std::string source;
+    FILE *file = fopen(filename, "r");
+    if (file) {
+        char buf[1024];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+            source.append(buf, n);
+        }
+        fclose(file);
+        remove(filename);
+    }
+    return source;
+}
+
+int main(int argc, char **argv) {
+    Target cuda = get_host_target().with_feature(Target::CUDA);
+    Var x, y, c, xo, yo, xi, yi;
+
+    // A lookup table scheduled in constant memory is read from there,
+    // even though the threads of a block read different entries.
+    {
+        ImageParam input(Float(32), 2);
+        Func lut("lut"), f("f");
+        lut(x) = cast<float>(x * x);
+        f(x, y) = input(x, y) * lut(y % 16);
+        lut.compute_root().store_in(MemoryType::GPUConstant);
+        f.gpu_tile(x, y, xo, yo, xi, yi, 16, 16);
+
+        std::string source = compile_kernel(f, {input}, cuda);
+        if (source.find("ld.const") == std::string::npos) {
+            printf("The lookup table scheduled in constant memory isn't read from there\n");
+            return -1;
+        }
+    }
+
+    // Small read-only buffers read at coordinates uniform across each
+    // block stay in global memory unless scheduled in constant memory.
+    {
+        ImageParam input(Float(32), 1);
+        Func taps("taps"), f("f");
+        taps(x) = cast<float>(x) + 1.0f;
+        f(x, c) = input(x) * taps(clamp(c, 0, 7));
+        taps.compute_root();
+        f.gpu_blocks(c).split(x, xo, xi, 32).gpu_blocks(xo).gpu_threads(xi);
+
+        std::string source = compile_kernel(f, {input}, cuda);
+        if (source.find("ld.const") != std::string::npos) {
+            printf("Taps not scheduled in constant memory were put there\n");
+            return -1;
+        }
+
+        taps.store_in(MemoryType::GPUConstant);
+        source = compile_kernel(f, {input}, cuda);
+        if (source.find("ld.const") == std::string::npos) {
+            printf("The taps scheduled in constant memory aren't read from there\n");
+            return -1;
+        }
+    }
+
+    // Neither are the ones the threads read at different coordinates.
+    {
+        ImageParam input(Float(32), 1);
+        Func taps("taps"), f("f");
+        taps(x) = cast<float>(x) + 1.0f;
+        f(x) = input(x) * taps(x % 8);
+        taps.compute_root();
+        f.gpu_tile(x, xo, xi, 32);
+
+        std::string source = compile_kernel(f, {input}, cuda);
+        if (source.find("ld.const") != std::string::npos) {
+            printf("Taps read at coordinates varying across the threads were put in constant memory\n");
+            return -1;
+        }
+    }
+
+    // Check the results where a GPU is available.
+    Target t = get_jit_target_from_environment();
+    if (t.has_gpu_feature()) {
+        Buffer<float> in(64, 32);
+        in.for_each_element([&](int x, int y) { in(x, y) = (float)(x + y); });
+        Func lut("lut"), f("f");
+        lut(x) = cast<float>(x * x);
+        f(x, y) = in(x, y) * lut(y % 16) + lut(x % 16);
+        lut.compute_root().store_in(MemoryType::GPUConstant);
+        f.gpu_tile(x, y, xo, yo, xi, yi, 16, 16);
+
+        Buffer<float> out = f.realize(64, 32, t);
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                float correct = in(x, y) * (float)((y % 16) * (y % 16)) + (float)((x % 16) * (x % 16));
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the loops over GPU blocks.
+class CountBlockLoops : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Stmt visit(const For *op) override {
+        if (op->for_type == ForType::GPUBlock) {
+            count++;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    int count = 0;
+};
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+    if (!t.has_feature(Target::CUDA)) {
+        printf("Not running test because cuda is not enabled\n");
+        return 0;
+    }
+
+    const int W = 37, H = 23;
+    Buffer<int> in(W + 1, H + 1);
+    in.for_each_element([&](int x, int y) { in(x, y) = (x * 7 + y * 13) % 17; });
+
+    // A chain of small stages, one of which has an update, computed in a
+    // single persistent kernel.
+    Var x, y, xi, yi;
+    Func f("f"), g("g"), h("h");
+    f(x, y) = in(x, y) * 2;
+    g(x, y) = f(x + 1, y) + f(x, y + 1);
+    h(x, y) = g(x, y) * 3;
+    h(x, y) += g(x, y);
+    f.compute_root().gpu_tile(x, y, xi, yi, 8, 8).gpu_persistent();
+    g.compute_root().gpu_tile(x, y, xi, yi, 16, 4).gpu_persistent();
+    h.gpu_tile(x, y, xi, yi, 8, 8).gpu_persistent();
+    h.update().gpu_tile(x, y, xi, yi, 8, 8);
+
+    CountBlockLoops *counter = new CountBlockLoops;
+    h.add_custom_lowering_pass(counter);
+    Buffer<int> out = h.realize(W, H, t);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int correct = (in(x + 1, y) + in(x, y + 1)) * 2 * 4;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    if (counter->count != 1) {
+        printf("The stages were computed by %d loops over blocks instead of a single one\n", counter->count);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+    if (!t.has_feature(Target::CUDA) && !t.has_feature(Target::OpenCL)) {
+        printf("Not running test because no gpu target enabled\n");
+        return 0;
+    }
+
+    Var x, y, xi, yi;
+    Func f;
+    ImageParam input(Float(32), 2);
+    f(x, y) = input(x, y) * 2.0f + 1.0f;
+    f.gpu_tile(x, y, xi, yi, 16, 16);
+
+    // Buffers allocated on both sides bounce between them on every run.
+    // Allocate them a few times, so that the pinned host memory gets
+    // reused.
+    for (int i = 0; i < 4; i++) {
+        Buffer<float> in(nullptr, 512, 256 + i);
+        if (in.device_and_host_malloc(DeviceAPI::Default_GPU, t) != 0) {
+            printf("device_and_host_malloc failed\n");
+            return -1;
+        }
+        in.for_each_element([&](int x, int y) {
+            in(x, y) = (float)(x + y * i);
+        });
+        in.set_host_dirty();
+
+        Buffer<float> out(nullptr, 512, 256 + i);
+        if (out.device_and_host_malloc(DeviceAPI::Default_GPU, t) != 0) {
+            printf("device_and_host_malloc failed\n");
+            return -1;
+        }
+
+        input.set(in);
+        f.realize(out, t);
+        out.copy_to_host();
+
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                float correct = (x + y * i) * 2.0f + 1.0f;
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// Compile a kernel to assembly for a CUDA target, and return the source,
+// which embeds the PTX of the kernel.
+std::string compile_kernel(Func f, const std::vector<Argument> &args, Target t) {
+    const char *filename = "gpu_read_only_loads.s";
+    f.compile_to_assembly(filename, args, "gpu_read_only_loads", t);
+    std::string source;
+    FILE *file = fopen(filename, "r");
+    if (file) {
+        char buf[1024];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+            source.append(buf, n);
+        }
+        fclose(file);
+        remove(filename);
+    }
+    return source;
+}
+
+int main(int argc, char **argv) {
+    Target t = get_host_target().with_feature(Target::CUDA).with_feature(Target::CUDACapability35);
+
+    // The kernel only reads the input, so its loads go through the
+    // read-only data cache.
+    {
+        ImageParam input(Float(32), 2);
+        Func blur;
+        Var x, y, xo, yo, xi, yi;
+        blur(x, y) = (input(x - 1, y) + input(x, y) + input(x + 1, y)) / 3.0f;
+        blur.gpu_tile(x, y, xo, yo, xi, yi, 16, 16);
+
+        std::string source = compile_kernel(blur, {input}, t);
+        if (source.find("ld.global.nc") == std::string::npos) {
+            printf("The loads of the input don't use the read-only data cache\n");
+            return -1;
+        }
+    }
+
+    // An update reads the buffer it writes, so its loads can't.
+    {
+        Func f;
+        Var x, xo, xi;
+        f(x) = x;
+        f(x) = f(x) * 2;
+        f.gpu_tile(x, xo, xi, 16);
+        f.update().gpu_tile(x, xo, xi, 16);
+
+        std::string source = compile_kernel(f, {}, t);
+        if (source.find("ld.global.nc") != std::string::npos) {
+            printf("A buffer written by the kernel was loaded through the read-only data cache\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
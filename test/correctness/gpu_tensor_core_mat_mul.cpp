@@ -0,0 +1,84 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+
+    if (!t.has_feature(Target::CUDACapability70)) {
+        printf("This test requires cuda enabled with cuda capability 7.0 or greater\n");
+        return 0;
+    }
+
+    const int size = 256;
+
+    ImageParam A(Float(16), 2), B(Float(16), 2);
+
+    // Each thread accumulates the product of 16x16 tiles into its own
+    // 16x16 tile of the output, which is done with the tensor cores.
+    Var x, y, xi, yi, xo, yo, xt, yt;
+    RVar rxo, rxi;
+    RDom r(0, size);
+    Func out;
+    out(x, y) = 0.0f;
+    out(x, y) += cast<float>(A(x, r)) * cast<float>(B(r, y));
+
+    out.bound(x, 0, size)
+        .bound(y, 0, size)
+        .gpu_tile(x, y, xi, yi, 32, 8);
+    out.update()
+        .split(x, xo, xi, 16)
+        .split(y, yo, yi, 16)
+        .split(r.x, rxo, rxi, 16)
+        .split(xo, xo, xt, 8)
+        .split(yo, yo, yt, 4)
+        .reorder(rxi, xi, yi, rxo, xt, yt, xo, yo)
+        .gpu_blocks(xo, yo)
+        .gpu_threads(xt, yt);
+
+    // Small integers are exact in float16, and so are their sums in
+    // float32, whatever order they are added in.
+    Buffer<float> a_float(size, size), b_float(size, size);
+    Buffer<float16_t> b(size, size);
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            a_float(i, j) = (float)((rand() & 3) - 1);
+            b_float(i, j) = (float)((rand() & 3) - 1);
+            b(i, j) = float16_t(b_float(i, j));
+        }
+    }
+
+    // Padding the rows of A by one element leaves them misaligned for
+    // wmma, so then each lane does its own tile instead.
+    for (int pad = 0; pad < 2; pad++) {
+        Buffer<float16_t> a(size + pad, size);
+        for (int j = 0; j < size; j++) {
+            for (int i = 0; i < size; i++) {
+                a(i, j) = float16_t(a_float(i, j));
+            }
+        }
+        a.crop(0, 0, size);
+        A.set(a);
+        B.set(b);
+        Buffer<float> output = out.realize(size, size, t);
+        output.copy_to_host();
+
+        for (int j = 0; j < size; j++) {
+            for (int i = 0; i < size; i++) {
+                float correct = 0.0f;
+                for (int k = 0; k < size; k++) {
+                    correct += a_float(i, k) * b_float(k, j);
+                }
+                if (output(i, j) != correct) {
+                    printf("out(%d, %d) = %f instead of %f (pad %d)\n",
+                           i, j, output(i, j), correct, pad);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+class CountWarpShuffles : public IRMutator2 {
+    class Count : public IRVisitor {
+        using IRVisitor::visit;
+        void visit(const Call *op) override {
+            if (starts_with(op->name, "llvm.nvvm.shfl.down")) {
+                count++;
+            }
+            IRVisitor::visit(op);
+        }
+    public:
+        int count = 0;
+    };
+
+public:
+    int count = 0;
+
+    using IRMutator2::mutate;
+    Stmt mutate(const Stmt &s) override {
+        Count c;
+        s.accept(&c);
+        count = c.count;
+        return s;
+    }
+};
+
+int test(int width, int height, bool atomic) {
+    const int W = 256, H = 16, C = 8;
+    Buffer<int> in(W, H, C);
+    in.for_each_element([&](int x, int y, int c) {
+        in(x, y, c) = (x * 3 + y * 5 + c) % 17 - 8;
+    });
+
+    Var c("c");
+    RDom r(0, W, 0, H);
+    Func f("f");
+    f(c) = 0;
+    f(c) += in(r.x, r.y, c);
+
+    // Every thread adds into f(c), as in the weight gradients that
+    // simple_autoschedule parallelizes over the reduction domain.
+    RVar rxo, rxi, ryo, ryi;
+    Stage update = f.update();
+    if (atomic) {
+        update.atomic();
+    } else {
+        update.allow_race_conditions();
+    }
+    update.split(r.x, rxo, rxi, width)
+        .split(r.y, ryo, ryi, height)
+        .reorder(rxi, ryi, rxo, ryo, c)
+        .gpu_blocks(rxo, ryo, c)
+        .gpu_threads(rxi, ryi);
+
+    CountWarpShuffles *counter = new CountWarpShuffles;
+    f.add_custom_lowering_pass(counter);
+
+    Buffer<int> out = f.realize(C);
+
+    // log2(warp width) shuffles reduce each warp
+    int expected_shuffles = 0;
+    for (int lanes = std::min(width, 32); lanes > 1; lanes /= 2) {
+        expected_shuffles++;
+    }
+    if (counter->count != expected_shuffles) {
+        printf("There were %d warp shuffles instead of %d\n", counter->count, expected_shuffles);
+        return -1;
+    }
+
+    for (int ci = 0; ci < C; ci++) {
+        int correct = 0;
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                correct += in(x, y, ci);
+            }
+        }
+        if (out(ci) != correct) {
+            printf("out(%d) = %d instead of %d\n", ci, out(ci), correct);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (!target.has_feature(Target::CUDA)) {
+        printf("Not running test because no cuda target enabled\n");
+        return 0;
+    }
+
+    // Whole warps along x
+    if (test(32, 1, false) != 0 || test(64, 2, true) != 0) {
+        return -1;
+    }
+
+    // Rows of 8 threads share each warp
+    if (test(8, 4, false) != 0 || test(8, 8, true) != 0) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
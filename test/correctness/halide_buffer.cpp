@@ -1,10 +1,29 @@
 // Don't include Halide.h: it is not necessary for this test.
 #include "HalideBuffer.h"
+#include "test/common/halide_test_dirs.h"
 
 #include <stdio.h>
+#include <thread>
+#include <vector>
 
 using namespace Halide::Runtime;
 
+// This test doesn't link a Halide runtime, so provide the executor for
+// the par_ methods of Buffer: run each task on its own thread.
+int par_for_calls = 0;
+extern "C" int halide_do_par_for(void *user_context, halide_task_t f,
+                                 int min, int size, uint8_t *closure) {
+    par_for_calls++;
+    std::vector<std::thread> threads;
+    for (int i = min; i < min + size; i++) {
+        threads.emplace_back([=]() { f(user_context, i, closure); });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    return 0;
+}
+
 template<typename T1, typename T2>
 void check_equal_shape(const Buffer<T1> &a, const Buffer<T2> &b) {
     if (a.dimensions() != b.dimensions()) abort();
@@ -72,6 +91,44 @@ void test_copy(Buffer<float> a, Buffer<float> b) {
     a.fill(1.0f);
     a_void.copy_from(b_void_window);
     check_equal(a_window, b_window);
+
+    // Filling with a value whose bytes are all the same uses memset.
+    a.fill(0.0f);
+    assert(a.all_equal(0.0f));
+    a_window.fill(1.0f);
+    a.for_each_element([&](int x, int y, int c) {
+        bool in_window = x >= 20 && x < 40 && y >= 50 && y < 60;
+        assert(a(x, y, c) == (in_window ? 1.0f : 0.0f));
+    });
+    a_window.fill(0.0f);
+    assert(a.all_equal(0.0f));
+}
+
+void test_parallel(Buffer<float> a, Buffer<float> b) {
+    a.transpose(0, 1);
+    b.fill([&](int x, int y, int c) {
+        return x + 100.0f * y + 100000.0f * c;
+    });
+
+    par_for_calls = 0;
+    a.par_fill(3.0f);
+    assert(a.all_equal(3.0f));
+    a.par_copy_from(b);
+    check_equal(a, b);
+    b.par_for_each_value([&](float &b_value, float a_value) {
+        b_value = a_value * 2;
+    }, a);
+    b.for_each_element([&](int x, int y, int c) {
+        assert(b(x, y, c) == 2 * a(x, y, c));
+    });
+    assert(par_for_calls == 3);
+
+    // Small buffers are traversed serially.
+    par_for_calls = 0;
+    Buffer<float> small = a.cropped(0, 0, 8).cropped(1, 0, 8);
+    small.par_fill(0.0f);
+    assert(small.all_equal(0.0f));
+    assert(par_for_calls == 0);
 }
 
 int main(int argc, char **argv) {
@@ -81,6 +138,12 @@ int main(int argc, char **argv) {
         test_copy(a, b);
     }
 
+    {
+        // Check the parallel versions of fill, copy_from and for_each_value
+        Buffer<float> a(400, 300, 3), b(300, 400, 3);
+        test_parallel(a, b);
+    }
+
 
     {
         // Check copying a buffer, using the halide_dimension_t pointer ctors
@@ -336,6 +399,42 @@ int main(int argc, char **argv) {
         // c.for_each_value([&](int c_value, int a_value, int &b_value) { }, a_const, b_const);
     }
 
+#ifdef HALIDE_BUFFER_HAS_MMAP
+    {
+        // Check Buffers made over memory-mapped files.
+        std::string path = Halide::Internal::get_test_tmp_dir() + "halide_buffer_map_file.raw";
+        const size_t header = 12;
+        {
+            Buffer<int> out = Buffer<int>::map_file(path.c_str(), halide_type_of<int>(), {40, 30, 3},
+                                                    MapFileMode::Create, MapFileHint::Sequential, header);
+            assert(out.data() != nullptr);
+            assert(out.all_equal(0));
+            out.for_each_element([&](int x, int y, int c) {
+                out(x, y, c) = x + y * 100 + c * 10000;
+            });
+            // Copies share the mapping, which outlives out.
+            Buffer<int> alias = out;
+        }
+
+        Buffer<const int> in = Buffer<const int>::map_file(path.c_str(), halide_type_of<int>(), {40, 30, 3},
+                                                           MapFileMode::Read, MapFileHint::Random, header);
+        assert(in.data() != nullptr);
+        in.for_each_element([&](int x, int y, int c) {
+            if (in(x, y, c) != x + y * 100 + c * 10000) {
+                printf("map_file: in(%d, %d, %d) = %d\n", x, y, c, in(x, y, c));
+                abort();
+            }
+        });
+
+        // A file too small for the requested shape fails to map.
+        Buffer<const int> too_big = Buffer<const int>::map_file(path.c_str(), halide_type_of<int>(), {40, 30, 4},
+                                                                MapFileMode::Read, MapFileHint::None, header);
+        assert(too_big.data() == nullptr);
+
+        remove(path.c_str());
+    }
+#endif
+
     printf("Success!\n");
     return 0;
 }
@@ -0,0 +1,65 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// Lower a pipeline for Hexagon, and return the text of the lowered
+// statement.
+std::string lower_for_hexagon(Func f, const std::vector<Argument> &args) {
+    const char *filename = "hexagon_dma.stmt";
+    f.compile_to_lowered_stmt(filename, args, Text, Target("hexagon-32-noos-hvx_128"));
+    std::string stmt;
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Can't read %s\n", filename);
+        return stmt;
+    }
+    char buf[1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        stmt.append(buf, n);
+    }
+    fclose(file);
+    remove(filename);
+    return stmt;
+}
+
+int main(int argc, char **argv) {
+    Var x, y, xo, yo, xi, yi;
+
+    // The tiles of the input are copied into VTCM with a single call
+    // each.
+    {
+        ImageParam input(UInt(8), 2);
+        Func f;
+        f(x, y) = input(x, y) + 1;
+        f.tile(x, y, xo, yo, xi, yi, 128, 16).vectorize(xi);
+        input.in(f).compute_at(f, xo).store_in(MemoryType::VTCM).dma();
+
+        std::string stmt = lower_for_hexagon(f, {input});
+        if (stmt.find("halide_hexagon_dma_copy_2d") == std::string::npos) {
+            printf("The tiles of the input aren't copied with halide_hexagon_dma_copy_2d\n");
+            return -1;
+        }
+    }
+
+    // A copy transposing its input isn't dense along the rows, so it is
+    // copied as usual.
+    {
+        ImageParam input(UInt(8), 2);
+        Func transposed, f;
+        transposed(x, y) = input(y, x);
+        f(x, y) = transposed(x, y) + 1;
+        f.tile(x, y, xo, yo, xi, yi, 128, 16);
+        transposed.compute_at(f, xo).dma();
+
+        std::string stmt = lower_for_hexagon(f, {input});
+        if (stmt.empty() || stmt.find("halide_hexagon_dma_copy_2d") != std::string::npos) {
+            printf("A transposing copy was lowered to halide_hexagon_dma_copy_2d\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
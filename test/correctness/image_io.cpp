@@ -152,6 +152,72 @@ Func make_noise(int depth) {
     return f;
 }
 
+#ifndef HALIDE_NO_MMAP
+void check_same(const Buffer<uint8_t> &a, const Buffer<uint8_t> &b, const std::string &what) {
+    for (int c = 0; c < a.channels(); c++) {
+        for (int y = 0; y < a.height(); y++) {
+            for (int x = 0; x < a.width(); x++) {
+                if (a(x, y, c) != b(x, y, c)) {
+                    printf("%s: (%d, %d, %d) = %d instead of %d\n", what.c_str(), x, y, c, b(x, y, c), a(x, y, c));
+                    abort();
+                }
+            }
+        }
+    }
+}
+
+void test_mapped(Buffer<uint8_t> color_buf) {
+    Buffer<uint8_t> src(color_buf.width(), color_buf.height(), 3);
+    src.for_each_element([&](int x, int y, int c) {
+        src(x, y, c) = color_buf(x + color_buf.dim(0).min(), y + color_buf.dim(1).min(), c);
+    });
+
+    for (std::string format : {"ppm", "tmp"}) {
+        std::cout << "Testing mapped format: " << format << "\n";
+        std::string filename = Internal::get_test_tmp_dir() + "test_mapped." + format;
+
+        // Write the image through a mapping, a band of scanlines at a time.
+        {
+            Tools::MappedImage mapped;
+            Buffer<uint8_t> out;
+            if (!mapped.create(filename, halide_type_of<uint8_t>(), {src.width(), src.height(), 3}, &out)) {
+                printf("Could not create mapped %s\n", format.c_str());
+                abort();
+            }
+            for (int y0 = 0; y0 < src.height(); y0 += 64) {
+                for (int c = 0; c < 3; c++) {
+                    for (int y = y0; y < std::min(y0 + 64, src.height()); y++) {
+                        for (int x = 0; x < src.width(); x++) {
+                            out(x, y, c) = src(x, y, c);
+                        }
+                    }
+                }
+            }
+            if (!mapped.unmap()) {
+                printf("Could not unmap %s\n", format.c_str());
+                abort();
+            }
+        }
+
+        // Read it back the ordinary way.
+        Buffer<uint8_t> reloaded = Tools::load_image(filename);
+        if (format == "tmp") {
+            reloaded.slice(3, 0);
+        }
+        check_same(src, reloaded, "reloaded mapped " + format);
+
+        // And through a read-only mapping.
+        Tools::MappedImage mapped;
+        Buffer<uint8_t> in;
+        if (!mapped.map(filename, &in)) {
+            printf("Could not map %s\n", format.c_str());
+            abort();
+        }
+        check_same(src, in, "mapped " + format);
+    }
+}
+#endif
+
 template<typename T>
 void do_test() {
     const int width = 1600;
@@ -175,6 +241,12 @@ void do_test() {
     test_convert_image_d2s<T>(color_buf);
     test_convert_image_d2d<T>(color_buf);
 
+#ifndef HALIDE_NO_MMAP
+    if (halide_type_of<T>() == halide_type_of<uint8_t>()) {
+        test_mapped(Buffer<uint8_t>(Buffer<>(color_buf)));
+    }
+#endif
+
     Buffer<T> luma_buf(width, height, 1);
     luma_buf.copy_from(color_buf);
     luma_buf.slice(2);
@@ -49,11 +49,63 @@ bool test_interleave() {
     return true;
 }
 
+// Load from interleaved channels into planar ones. The loads are
+// strided by the number of channels, from both an input buffer and
+// an intermediate Func stored interleaved.
+template <typename T>
+bool test_deinterleave(int channels) {
+    Var x("x"), y("y"), c("c");
+
+    Buffer<T> input = Buffer<T>::make_interleaved(256, 128, channels);
+    input.for_each_element([&](int x, int y, int c) {
+        input(x, y, c) = (T)(x * 3 + y * 5 + c);
+    });
+
+    Func interleaved("interleaved");
+    interleaved(x, y, c) = input(x, y, c) + 1;
+
+    Func planar("planar");
+    planar(x, y, c) = input(x, y, c) + interleaved(x, y, c);
+
+    Target target = get_jit_target_from_environment();
+    interleaved.compute_root().reorder_storage(c, x, y).bound(c, 0, channels);
+    planar.bound(c, 0, channels).reorder(c, x, y);
+    if (target.has_gpu_feature()) {
+        Var xi("xi"), yi("yi");
+        interleaved.gpu_tile(x, y, xi, yi, 16, 16);
+        planar.gpu_tile(x, y, xi, yi, 16, 16);
+    } else {
+        interleaved.vectorize(x, target.natural_vector_size<T>());
+        planar.vectorize(x, target.natural_vector_size<T>()).unroll(c);
+    }
+    Buffer<T> buff = planar.realize(256, 128, channels, target);
+    buff.copy_to_host();
+    for (int y = 0; y < buff.height(); y++) {
+        for (int x = 0; x < buff.width(); x++) {
+            for (int c = 0; c < channels; c++) {
+                T correct = (T)(2 * (x * 3 + y * 5 + c) + 1);
+                if (buff(x, y, c) != correct) {
+                    printf("planar(%d, %d, %d) = %d instead of %d\n", x, y, c, (int)buff(x, y, c), (int)correct);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 int main(int argc, char **argv) {
     if (!test_interleave<uint8_t>()) return -1;
     if (!test_interleave<uint16_t>()) return -1;
     if (!test_interleave<uint32_t>()) return -1;
 
+    for (int channels : {3, 4}) {
+        if (!test_deinterleave<uint8_t>(channels)) return -1;
+        if (!test_deinterleave<uint16_t>(channels)) return -1;
+        if (!test_deinterleave<uint32_t>(channels)) return -1;
+        if (!test_deinterleave<float>(channels)) return -1;
+    }
+
     printf("Success!\n");
     return 0;
 }
@@ -0,0 +1,100 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the divisions and modulos inside loops in the lowered code.
+class CountDivisionsInLoops : public IRMutator2 {
+    using IRMutator2::visit;
+
+    int loop_depth = 0;
+
+    Stmt visit(const For *op) override {
+        loop_depth++;
+        Stmt s = IRMutator2::visit(op);
+        loop_depth--;
+        return s;
+    }
+
+    Expr visit(const Div *op) override {
+        count += loop_depth > 0;
+        return IRMutator2::visit(op);
+    }
+
+    Expr visit(const Mod *op) override {
+        count += loop_depth > 0;
+        return IRMutator2::visit(op);
+    }
+
+public:
+    int count = 0;
+};
+
+template<typename T>
+T euclidean_div(T a, T b) {
+    T q = a / b;
+    T r = a - q * b;
+    if (r < 0) {
+        q += (b < 0) ? 1 : -1;
+    }
+    return q;
+}
+
+template<typename T>
+int test(const std::vector<T> &divisors) {
+    Buffer<T> input(1024);
+    for (int i = 0; i < input.width(); i++) {
+        input(i) = (T)(i * 2654435761u);
+    }
+    input(0) = std::numeric_limits<T>::min();
+    input(1) = std::numeric_limits<T>::max();
+
+    Param<T> d;
+    Var x;
+    Func f;
+    f(x) = Tuple(input(x) / d, input(x) % d);
+    f.vectorize(x, 16);
+
+    CountDivisionsInLoops *counter = new CountDivisionsInLoops;
+    f.add_custom_lowering_pass(counter);
+    f.compile_jit();
+    if (counter->count != 0) {
+        printf("There were %d divisions in loops instead of none\n", counter->count);
+        return -1;
+    }
+
+    for (T b : divisors) {
+        d.set(b);
+        Realization r = f.realize(input.width());
+        Buffer<T> q = r[0], m = r[1];
+        for (int i = 0; i < input.width(); i++) {
+            T a = input(i);
+            T correct_q = euclidean_div(a, b);
+            T correct_m = (T)(a - correct_q * b);
+            if (q(i) != correct_q || m(i) != correct_m) {
+                printf("%lld / %lld = %lld, %lld %% %lld = %lld instead of %lld, %lld\n",
+                       (long long)a, (long long)b, (long long)q(i),
+                       (long long)a, (long long)b, (long long)m(i),
+                       (long long)correct_q, (long long)correct_m);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // (INT_MIN / -1 overflows int32 in C++, so it can't be checked here.)
+    if (test<uint8_t>({1, 2, 3, 7, 128, 255}) ||
+        test<int8_t>({1, -1, 3, -7, 127, -128}) ||
+        test<uint16_t>({1, 10, 641, 32768, 65535}) ||
+        test<int16_t>({1, -3, 100, -32768, 32767}) ||
+        test<uint32_t>({1, 3, 7, 1000, 65537, 0x80000000u, 0xffffffffu}) ||
+        test<int32_t>({1, 2, -5, 1000, -65537, 0x7fffffff, (int32_t)0x80000000})) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Param<int> mode;
+
+    Func f("f");
+    f(x, y) = x * mode + y;
+    f.specialize(mode == 1).vectorize(x, 4);
+
+    Pipeline p(f);
+
+    auto check = [&](int m) {
+        mode.set(m);
+        Buffer<int> result = p.realize(32, 8);
+        for (int j = 0; j < 8; j++) {
+            for (int i = 0; i < 32; i++) {
+                if (result(i, j) != i * m + j) {
+                    printf("f(%d, %d) = %d instead of %d\n", i, j, result(i, j), i * m + j);
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    void *first = p.compile_jit();
+    if (!check(1) || !check(2)) {
+        return -1;
+    }
+
+    // Compiling again code that lowers the same reuses the code
+    // compiled for it. The code compiled before stays alive in the
+    // pipeline, so the entry points of different code differ.
+    p.invalidate_cache();
+    void *again = p.compile_jit();
+    if (again != first) {
+        printf("The same lowered code was compiled again\n");
+        return -1;
+    }
+    if (!check(1) || !check(2)) {
+        return -1;
+    }
+
+    // A schedule change of the main branch compiles again.
+    f.unroll(y, 2);
+    p.invalidate_cache();
+    void *changed = p.compile_jit();
+    if (changed == first) {
+        printf("The code compiled before the schedule change was reused\n");
+        return -1;
+    }
+    if (!check(1) || !check(2)) {
+        return -1;
+    }
+
+    // So does a schedule change of a specialization.
+    f.specialize(mode == 1).unroll(y, 2);
+    p.invalidate_cache();
+    void *specialized = p.compile_jit();
+    if (specialized == changed || specialized == first) {
+        printf("The code compiled before the specialization changed was reused\n");
+        return -1;
+    }
+    if (!check(1) || !check(2)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the times a Func is lowered.
+class CountLowerings : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Stmt visit(const ProducerConsumer *op) override {
+        if (op->is_producer && op->name == func) {
+            count++;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    std::string func;
+    int count = 0;
+
+    CountLowerings(const std::string &f) : func(f) {}
+};
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Param<int> mode;
+
+    Func f("f");
+    f(x, y) = x * mode + y;
+    f.specialize(mode == 1).vectorize(x, 4);
+    f.specialize(mode == 2).vectorize(x, 8);
+    f.specialize(f.output_buffer().width() >= 64).parallel(y);
+
+    Pipeline p(f);
+    p.set_lazy_specializations(true);
+    CountLowerings *counter = new CountLowerings(f.name());
+    p.add_custom_lowering_pass(counter);
+
+    auto check = [&](int m, int width, int lowerings) {
+        mode.set(m);
+        Buffer<int> result(width, 8);
+        p.realize(result);
+        for (int j = 0; j < 8; j++) {
+            for (int i = 0; i < width; i++) {
+                if (result(i, j) != i * m + j) {
+                    printf("f(%d, %d) = %d instead of %d\n", i, j, result(i, j), i * m + j);
+                    return false;
+                }
+            }
+        }
+        if (counter->count != lowerings) {
+            printf("The pipeline was lowered %d times instead of %d\n", counter->count, lowerings);
+            return false;
+        }
+        return true;
+    };
+
+    // Each new set of branches compiles once.
+    if (!check(1, 16, 1) ||
+        !check(1, 32, 1) ||
+        !check(2, 16, 2) ||
+        !check(1, 16, 2) ||
+        !check(3, 128, 3) ||
+        !check(2, 16, 3)) {
+        return -1;
+    }
+
+    // Changing the schedule of a branch not taken still lowers the one
+    // taken to the code compiled for it before. That code only covers
+    // the branch taken, so the other one compiles again with its new
+    // schedule.
+    f.specialize(mode == 2).unroll(y, 2);
+    p.invalidate_cache();
+    if (!check(1, 16, 4) ||
+        !check(2, 16, 5) ||
+        !check(1, 16, 5)) {
+        return -1;
+    }
+
+    // Compiling all the branches covers every call.
+    p.set_lazy_specializations(false);
+    p.invalidate_cache();
+    if (!check(2, 16, 6) ||
+        !check(3, 128, 6)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
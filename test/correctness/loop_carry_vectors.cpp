@@ -0,0 +1,129 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the loads of a buffer inside of serial loops.
+class CountLoadsInLoops : public IRMutator2 {
+    using IRMutator2::visit;
+
+    int loop_depth = 0;
+
+    Stmt visit(const For *op) override {
+        loop_depth++;
+        Stmt s = IRMutator2::visit(op);
+        loop_depth--;
+        return s;
+    }
+
+    Expr visit(const Load *op) override {
+        if (loop_depth > 0 && op->name == name) {
+            count++;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    std::string name;
+    int count = 0;
+    CountLoadsInLoops(const std::string &name) : name(name) {}
+};
+
+int main(int argc, char **argv) {
+    const int W = 256;
+    Buffer<int16_t> in(W + 64);
+    for (int i = 0; i < in.width(); i++) {
+        in(i) = (int16_t)((i * 37) % 101 - 50);
+    }
+
+    // A vectorized 1-D stencil loads one vector of the input per
+    // iteration; the other taps are slices of the vectors loaded on
+    // previous iterations.
+    for (int taps : {3, 7, 17}) {
+        Var x;
+        Func f("f");
+        Expr e = cast<int16_t>(0);
+        for (int i = 0; i < taps; i++) {
+            e += in(x + i) * cast<int16_t>(i + 1);
+        }
+        f(x) = e;
+        f.vectorize(x, 8);
+        CountLoadsInLoops *counter = new CountLoadsInLoops(in.name());
+        f.add_custom_lowering_pass(counter);
+        Buffer<int16_t> out = f.realize(W);
+        for (int x = 0; x < W; x++) {
+            int16_t correct = 0;
+            for (int i = 0; i < taps; i++) {
+                correct += in(x + i) * (int16_t)(i + 1);
+            }
+            if (out(x) != correct) {
+                printf("out(%d) = %d instead of %d with %d taps\n", x, out(x), correct, taps);
+                return -1;
+            }
+        }
+        if (counter->count != 1) {
+            printf("%d loads of the input in the loop instead of 1 with %d taps\n", counter->count, taps);
+            return -1;
+        }
+    }
+
+    // Taps further apart than a vector aren't carried, as the vectors
+    // in between aren't known to be in bounds.
+    {
+        Var x;
+        Func f("f");
+        f(x) = in(x) + in(x + 20);
+        f.vectorize(x, 8);
+        CountLoadsInLoops *counter = new CountLoadsInLoops(in.name());
+        f.add_custom_lowering_pass(counter);
+        Buffer<int16_t> out = f.realize(W);
+        for (int x = 0; x < W; x++) {
+            int16_t correct = in(x) + in(x + 20);
+            if (out(x) != correct) {
+                printf("out(%d) = %d instead of %d\n", x, out(x), correct);
+                return -1;
+            }
+        }
+        if (counter->count != 2) {
+            printf("%d loads of the input in the loop instead of 2\n", counter->count);
+            return -1;
+        }
+    }
+
+    // Loads of a buffer stored to in the loop aren't carried.
+    {
+        Var x;
+        RDom r(0, 8, 0, W / 8);
+        Func f("f");
+        f(x) = in(x);
+        f(r.y * 8 + r.x) = f(r.y * 8 + r.x + 1) + f(r.y * 8 + r.x + 2);
+        f.compute_root();
+        f.update().allow_race_conditions().vectorize(r.x);
+        Func g("g");
+        g(x) = f(x);
+        Buffer<int16_t> out = g.realize(W);
+        Buffer<int16_t> correct(W + 64);
+        for (int i = 0; i < correct.width(); i++) {
+            correct(i) = in(i);
+        }
+        for (int i = 0; i < W / 8; i++) {
+            int16_t v[8];
+            for (int j = 0; j < 8; j++) {
+                v[j] = correct(i * 8 + j + 1) + correct(i * 8 + j + 2);
+            }
+            for (int j = 0; j < 8; j++) {
+                correct(i * 8 + j) = v[j];
+            }
+        }
+        for (int x = 0; x < W; x++) {
+            if (out(x) != correct(x)) {
+                printf("in-place out(%d) = %d instead of %d\n", x, out(x), correct(x));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -397,6 +397,45 @@ int main(int argc, char **argv) {
         Internal::JITSharedRuntime::memoization_cache_set_size(0);
     }
 
+    {
+        // Test that results which are expensive to recompute survive the
+        // eviction of cheap ones.
+        Param<float> val;
+        Var x, y;
+
+        Func cheap_calls;
+        cheap_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+        Func cheap;
+        cheap(x, y) = cheap_calls(x, y);
+        cheap_calls.compute_root().memoize();
+
+        Func expensive_calls;
+        expensive_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val) + 1}, UInt(8), 2);
+        Func expensive;
+        expensive(x, y) = expensive_calls(x, y);
+        expensive_calls.compute_root().memoize(100);
+
+        // Room for two and a half 100x100 results.
+        Internal::JITSharedRuntime::memoization_cache_set_size(25000);
+
+        val.set(1.0f);
+        Buffer<uint8_t> out = expensive.realize(100, 100);
+        for (int v = 0; v < 10; v++) {
+            val.set((float)(v + 2));
+            out = cheap.realize(100, 100);
+            assert(out(0, 0) == v + 2);
+        }
+
+        call_count_with_arg = 0;
+        val.set(1.0f);
+        out = expensive.realize(100, 100);
+        assert(out(0, 0) == 2);
+        assert(call_count_with_arg == 0);
+
+        // Return cache size to default.
+        Internal::JITSharedRuntime::memoization_cache_set_size(0);
+    }
+
     {
         // Test flushing entire cache with a single element larger than the cache
         Param<float> val;
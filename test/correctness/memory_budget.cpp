@@ -0,0 +1,63 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// The largest heap allocation of the last realization.
+size_t largest_allocation = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    largest_allocation = std::max(largest_allocation, x);
+    void *orig = malloc(x + 32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void **)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    Func g("g"), f("f");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Param<int64_t> budget;
+
+    g(x, y) = x * 3 + y;
+    f(x, y) = g(x, y) + g(x + 1, y + 1);
+
+    // The producer takes 65x65 ints per tile by default, and 9x9 ints
+    // in the low-memory schedule.
+    f.specialize_low_memory(budget).tile(x, y, xo, yo, xi, yi, 8, 8);
+    f.tile(x, y, xo, yo, xi, yi, 64, 64);
+    g.compute_at(f, xo).store_in(MemoryType::Heap);
+    f.set_custom_allocator(my_malloc, my_free);
+
+    const int64_t budgets[] = {0, 1 << 30, 1024};
+    const size_t smallest_default = 65 * 65 * sizeof(int);
+    for (int64_t b : budgets) {
+        budget.set(b);
+        largest_allocation = 0;
+        Buffer<int> out = f.realize(256, 256);
+        for (int j = 0; j < out.height(); j++) {
+            for (int i = 0; i < out.width(); i++) {
+                int correct = (i * 3 + j) + ((i + 1) * 3 + j + 1);
+                if (out(i, j) != correct) {
+                    printf("out(%d, %d) = %d instead of %d with a budget of %lld\n",
+                           i, j, out(i, j), correct, (long long)b);
+                    return -1;
+                }
+            }
+        }
+
+        bool low_memory = b == 1024;
+        if (low_memory != (largest_allocation < smallest_default)) {
+            printf("With a budget of %lld, the largest allocation was %d bytes\n",
+                   (long long)b, (int)largest_allocation);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
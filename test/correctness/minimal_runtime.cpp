@@ -0,0 +1,51 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+std::string compile_to_assembly(Func f, const std::string &name, const Target &t) {
+    std::string assembly_file = Internal::get_test_tmp_dir() + name + ".s";
+    Internal::ensure_no_file_exists(assembly_file);
+    f.compile_to_assembly(assembly_file, {}, name, t);
+    Internal::assert_file_exists(assembly_file);
+
+    std::ifstream asm_stream(assembly_file);
+    std::stringstream contents;
+    contents << asm_stream.rdbuf();
+    return contents.str();
+}
+
+int main(int argc, char **argv) {
+    Func f, g;
+    Var x;
+    f(x) = x * 2;
+    g(x) = f(x) + f(x + 1);
+    f.compute_root();
+
+    Target t = get_host_target();
+    std::string full = compile_to_assembly(g, "full_runtime", t);
+    std::string minimal = compile_to_assembly(g, "minimal_runtime", t.with_feature(Target::MinimalRuntime));
+
+    // The public functions of the runtime are all there by default...
+    if (full.find("halide_set_error_handler") == std::string::npos) {
+        printf("The full runtime is missing halide_set_error_handler\n");
+        return -1;
+    }
+
+    // ...but only the ones the pipeline calls are there with MinimalRuntime.
+    if (minimal.find("halide_set_error_handler") != std::string::npos) {
+        printf("The minimal runtime contains halide_set_error_handler\n");
+        return -1;
+    }
+    if (minimal.size() >= full.size()) {
+        printf("The minimal runtime is no smaller than the full runtime\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+
+    const int W = 1024, H = 64;
+    Var x, y;
+
+    // A streamed intermediate, whose stores are known to be aligned
+    Func f, g;
+    f(x, y) = cast<float>(x + y);
+    g(x, y) = f(x, y) * 2.0f;
+    f.compute_root().bound(x, 0, W).bound(y, 0, H).vectorize(x, 8).store_nontemporal();
+    g.vectorize(x, 8);
+
+    Buffer<float> out = g.realize(W, H);
+    for (int yi = 0; yi < H; yi++) {
+        for (int xi = 0; xi < W; xi++) {
+            float correct = (xi + yi) * 2.0f;
+            if (out(xi, yi) != correct) {
+                printf("out(%d, %d) = %f instead of %f\n", xi, yi, out(xi, yi), correct);
+                return -1;
+            }
+        }
+    }
+
+    if (t.arch == Target::X86 && !t.has_gpu_feature()) {
+        std::string assembly_file = Internal::get_test_tmp_dir() + "nontemporal_store.s";
+        Internal::ensure_no_file_exists(assembly_file);
+        g.compile_to_assembly(assembly_file, {}, "g", t);
+        Internal::assert_file_exists(assembly_file);
+
+        std::ifstream asm_stream(assembly_file);
+        std::stringstream contents;
+        contents << asm_stream.rdbuf();
+        if (contents.str().find("movnt") == std::string::npos) {
+            printf("No non-temporal stores in %s\n", assembly_file.c_str());
+            return -1;
+        }
+    }
+
+    // A streamed output, with a tuple and an unaligned extent
+    Func h;
+    h(x, y) = Tuple(x * y, cast<uint8_t>(x + y));
+    h.vectorize(x, 16).store_nontemporal();
+    Realization r = h.realize(W - 3, H);
+    Buffer<int> h0 = r[0];
+    Buffer<uint8_t> h1 = r[1];
+    for (int yi = 0; yi < H; yi++) {
+        for (int xi = 0; xi < W - 3; xi++) {
+            if (h0(xi, yi) != xi * yi || h1(xi, yi) != (uint8_t)(xi + yi)) {
+                printf("h(%d, %d) = {%d, %d} instead of {%d, %d}\n",
+                       xi, yi, h0(xi, yi), h1(xi, yi), xi * yi, (uint8_t)(xi + yi));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
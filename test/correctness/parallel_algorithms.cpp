@@ -0,0 +1,135 @@
+#include "Halide.h"
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+using namespace Halide;
+
+int test_sort(const Target &t) {
+    const int N = 100, rows = 5;
+    Buffer<float> in(N, rows);
+    in.for_each_element([&](int x, int y) { in(x, y) = (float)((x * 37 + y * 11) % 53) - 20.0f; });
+
+    Var x, y;
+    Func f("f");
+    f(x, y) = in(x, y);
+    ParallelAlgorithm s = sort(f, 0, N);
+    s.schedule(t);
+    Buffer<float> out = s.output.realize(N, rows, t);
+    for (int j = 0; j < rows; j++) {
+        std::vector<float> correct;
+        for (int i = 0; i < N; i++) {
+            correct.push_back(in(i, j));
+        }
+        std::sort(correct.begin(), correct.end());
+        for (int i = 0; i < N; i++) {
+            if (out(i, j) != correct[i]) {
+                printf("sort(%d, %d) = %f instead of %f\n", i, j, out(i, j), correct[i]);
+                return -1;
+            }
+        }
+    }
+
+    // Sort along the outer dimension of a 1-D Func of integers.
+    const int M = 1000;
+    Func g("g");
+    g(x) = (x * 7919) % 601 - 300;
+    ParallelAlgorithm s1 = sort(g, 0, M, "sort_1d");
+    s1.schedule(t);
+    Buffer<int> out1 = s1.output.realize(M, t);
+    std::vector<int> correct1;
+    for (int i = 0; i < M; i++) {
+        correct1.push_back((i * 7919) % 601 - 300);
+    }
+    std::sort(correct1.begin(), correct1.end());
+    for (int i = 0; i < M; i++) {
+        if (out1(i) != correct1[i]) {
+            printf("sort_1d(%d) = %d instead of %d\n", i, out1(i), correct1[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int test_top_k(const Target &t, int k) {
+    const int N = 300, rows = 3;
+    Buffer<int> in(rows, N);
+    in.for_each_element([&](int y, int x) { in(y, x) = (x * 13 + y * 5) % 41; });
+
+    // The values are along the outer dimension, and repeat, so the order
+    // of the indices matters.
+    Var x, y;
+    Func f("f");
+    f(y, x) = in(y, x);
+    ParallelAlgorithm top = top_k(f, 1, N, k);
+    top.schedule(t);
+    Realization r = top.output.realize(rows, k, t);
+    Buffer<int> values = r[0], indices = r[1];
+    for (int j = 0; j < rows; j++) {
+        std::vector<std::pair<int, int>> correct;
+        for (int i = 0; i < N; i++) {
+            correct.push_back({-in(j, i), i});
+        }
+        std::sort(correct.begin(), correct.end());
+        for (int i = 0; i < k; i++) {
+            if (values(j, i) != -correct[i].first || indices(j, i) != correct[i].second) {
+                printf("top_k(%d, %d) = (%d, %d) instead of (%d, %d) with k = %d\n",
+                       j, i, values(j, i), indices(j, i), -correct[i].first, correct[i].second, k);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int test_histogram(const Target &t) {
+    const int W = 67, H = 45, bins = 20;
+    Buffer<uint8_t> in(W, H);
+    in.for_each_element([&](int x, int y) { in(x, y) = (uint8_t)((x * x + y * 3) % 23); });
+
+    // The histogram of a region which isn't a multiple of the chunks.
+    Var x, y;
+    Func f("f");
+    f(x, y) = in(x, y);
+    ParallelAlgorithm h = histogram(f, {{3, W - 5}, {2, H - 3}}, bins, 8);
+    h.schedule(t);
+    Buffer<int> out = h.output.realize(bins, t);
+    std::vector<int> correct(bins, 0);
+    for (int j = 2; j < H - 1; j++) {
+        for (int i = 3; i < W - 2; i++) {
+            correct[std::min((int)in(i, j), bins - 1)]++;
+        }
+    }
+    for (int b = 0; b < bins; b++) {
+        if (out(b) != correct[b]) {
+            printf("histogram(%d) = %d instead of %d\n", b, out(b), correct[b]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::vector<Target> targets = {get_host_target()};
+    Target jit = get_jit_target_from_environment();
+    if (jit.has_gpu_feature()) {
+        targets.push_back(jit);
+    }
+
+    for (const Target &t : targets) {
+        if (test_sort(t) != 0) {
+            return -1;
+        }
+        for (int k : {1, 5, 16, 300}) {
+            if (test_top_k(t, k) != 0) {
+                return -1;
+            }
+        }
+        if (test_histogram(t) != 0) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Halide;
+
+// The extents of the loops passed to do_par_for
+std::vector<int> extents;
+
+int record_par_for(void *ctx, int (*f)(void *, int, uint8_t *), int min, int extent, uint8_t *closure) {
+    extents.push_back(extent);
+    for (int i = min; i < min + extent; i++) {
+        int result = f(ctx, i, closure);
+        if (result) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+int check_rows(const Buffer<int> &result) {
+    for (int y = 0; y < result.height(); y++) {
+        for (int x = 0; x < result.width(); x++) {
+            // The sum of r over [0, y]
+            int correct = x + y * (y + 1) / 2;
+            if (result(x, y) != correct) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // Rows of very uneven cost, with each policy.
+    ParallelPolicy policies[] = {ParallelPolicy::Dynamic, ParallelPolicy::Guided, ParallelPolicy::Static};
+    for (ParallelPolicy policy : policies) {
+        for (int chunk : {1, 3}) {
+            Func f;
+            RDom r(0, 100);
+            r.where(r <= y);
+            f(x, y) = x;
+            f(x, y) += r;
+            f.parallel(y, policy, chunk);
+            f.update().parallel(y, policy, chunk);
+
+            Buffer<int> result = f.realize(8, 100);
+            if (check_rows(result)) {
+                return -1;
+            }
+        }
+    }
+
+    // The iterations are handed out in chunks, through do_par_for.
+    {
+        Func f;
+        f(x, y) = x + y * (y + 1) / 2;
+        f.parallel(y, ParallelPolicy::Dynamic, 4);
+        f.set_custom_do_par_for(&record_par_for);
+
+        extents.clear();
+        Buffer<int> result = f.realize(8, 64);
+        if (check_rows(result)) {
+            return -1;
+        }
+        if (extents.size() != 1 || extents[0] != 16) {
+            printf("The loop over 64 rows in chunks of 4 was run as %d tasks\n",
+                   extents.empty() ? 0 : extents[0]);
+            return -1;
+        }
+    }
+
+    // The C backend passes the policy to OpenMP.
+    {
+        Func f;
+        f(x, y) = x + y;
+        f.parallel(y, ParallelPolicy::Guided, 2);
+
+        const char *filename = "parallel_policy.c";
+        f.compile_to_c(filename, {}, "parallel_policy");
+        FILE *file = fopen(filename, "r");
+        if (!file) {
+            printf("Can't read %s\n", filename);
+            return -1;
+        }
+        std::string source;
+        char buf[1024];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+            source.append(buf, n);
+        }
+        fclose(file);
+        remove(filename);
+
+        if (source.find("#pragma omp parallel for schedule(guided, 2)") == std::string::npos) {
+            printf("The C source has no guided OpenMP loop\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int size = 1000;
+    Buffer<int> input(size, 8);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = (x * 37 + y * 11) % 29 - 10;
+    });
+
+    // A cumulative sum, with a block size that doesn't divide the scan.
+    {
+        Func f;
+        Var x, u;
+        RDom r(0, size);
+        f(x) = 5;
+        f(r) = f(r - 1) + input(r, 0);
+
+        f.update(0).parallel_scan(r, u, 64).update(0).parallel(u);
+        f.update(0).parallel(r, 64);
+
+        Buffer<int> result = f.realize(size);
+        int correct = 5;
+        for (int i = 0; i < size; i++) {
+            correct += input(i, 0);
+            if (result(i) != correct) {
+                printf("f(%d) = %d instead of %d\n", i, result(i), correct);
+                return -1;
+            }
+        }
+    }
+
+    // A running max down the columns, which doesn't start at zero.
+    {
+        Func g;
+        Var x, y, u;
+        RDom r(1, 7);
+        g(x, y) = input(x, y);
+        g(x, r) = max(g(x, r - 1), input(x, r));
+
+        g.update(0).parallel_scan(r, u, 3);
+        g.update(0).parallel(x);
+
+        Buffer<int> result = g.realize(size, 8);
+        for (int x = 0; x < size; x++) {
+            int correct = input(x, 0);
+            for (int y = 0; y < 8; y++) {
+                correct = std::max(correct, input(x, y));
+                if (result(x, y) != correct) {
+                    printf("g(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
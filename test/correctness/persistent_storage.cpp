@@ -0,0 +1,95 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_counter = 0;
+extern "C" DLLEXPORT int count(int x) {
+    call_counter++;
+    return x;
+}
+HalideExtern_1(int, count, int);
+
+int main(int argc, char **argv) {
+    Var x, t;
+    Param<int> frame;
+
+    // A filter over the last three frames of f only computes the
+    // frames of f it didn't compute in the last calls.
+    Func f("f"), g("g");
+    f(x, t) = count(x) + t * 100;
+    g(x) = f(x, frame) + f(x, frame - 1) + f(x, frame - 2);
+    f.compute_root().persist(t, 3);
+
+    // The frames to set, the width of the output, and the number of
+    // values of f computed for them.
+    struct {
+        int frame, width, calls;
+    } tests[] = {
+        {0, 10, 30},
+        {1, 10, 10},
+        {2, 10, 10},
+        // The same frame again needs no new ones.
+        {2, 10, 0},
+        // The frame after the ones held.
+        {5, 10, 30},
+        // None of the frames held.
+        {10, 10, 30},
+        // The frames held start after the first one needed.
+        {9, 10, 30},
+        // Another shape holds none of the frames.
+        {10, 20, 60},
+        {11, 20, 20},
+    };
+
+    for (const auto &test : tests) {
+        call_counter = 0;
+        frame.set(test.frame);
+        Buffer<int> out = g.realize(test.width);
+        for (int i = 0; i < test.width; i++) {
+            int correct = 3 * i + 100 * (3 * test.frame - 3);
+            if (out(i) != correct) {
+                printf("At frame %d: out(%d) = %d instead of %d\n", test.frame, i, out(i), correct);
+                return -1;
+            }
+        }
+        if (call_counter != test.calls) {
+            printf("At frame %d: computed %d values of f instead of %d\n",
+                   test.frame, call_counter, test.calls);
+            return -1;
+        }
+    }
+
+    // A pipeline of the same name, with another definition of f, holds
+    // none of the frames computed by the one above.
+    {
+        Func f("f"), g("g");
+        f(x, t) = count(x) + t * 100 + 1;
+        g(x) = f(x, frame) + f(x, frame - 1) + f(x, frame - 2);
+        f.compute_root().persist(t, 3);
+
+        call_counter = 0;
+        frame.set(12);
+        Buffer<int> out = g.realize(20);
+        for (int i = 0; i < 20; i++) {
+            int correct = 3 * i + 100 * (3 * 12 - 3) + 3;
+            if (out(i) != correct) {
+                printf("With the new definition: out(%d) = %d instead of %d\n", i, out(i), correct);
+                return -1;
+            }
+        }
+        if (call_counter != 60) {
+            printf("With the new definition: computed %d values of f instead of 60\n", call_counter);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
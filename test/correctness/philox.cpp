@@ -0,0 +1,98 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// A reference Philox-4x32-10, returning the first word.
+uint32_t philox_reference(const uint32_t counter[4], uint32_t k0, uint32_t k1) {
+    uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+    for (int round = 0; round < 10; round++) {
+        if (round > 0) {
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        uint64_t p0 = (uint64_t)c[0] * 0xD2511F53;
+        uint64_t p1 = (uint64_t)c[2] * 0xCD9E8D57;
+        uint32_t c1 = c[1], c3 = c[3];
+        c[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c[1] = (uint32_t)p1;
+        c[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c[3] = (uint32_t)p0;
+    }
+    return c[0];
+}
+
+int main(int argc, char **argv) {
+    Var x, y, c;
+
+    // Check the reference against a known answer from the paper's
+    // test vectors.
+    {
+        uint32_t zero[4] = {0, 0, 0, 0};
+        if (philox_reference(zero, 0, 0) != 0x6627e8d5) {
+            printf("The reference Philox is wrong\n");
+            return -1;
+        }
+    }
+
+    // The values only depend on the coordinates and the seed, with or
+    // without vectorization.
+    Param<int> seed;
+    seed.set(17);
+    {
+        Func f, g;
+        f(x, y, c) = philox_uint({x, y, c}, seed);
+        g(x, y, c) = philox_uint({x, y, c}, seed);
+        f.vectorize(x, 8);
+        Buffer<uint32_t> scalar = g.realize(64, 16, 3);
+        Buffer<uint32_t> vector = f.realize(64, 16, 3);
+        for (int k = 0; k < 3; k++) {
+            for (int j = 0; j < 16; j++) {
+                for (int i = 0; i < 64; i++) {
+                    uint32_t counter[4] = {(uint32_t)i, (uint32_t)j, (uint32_t)k, 0};
+                    uint32_t correct = philox_reference(counter, 17, 0);
+                    if (scalar(i, j, k) != correct || vector(i, j, k) != correct) {
+                        printf("philox_uint(%d, %d, %d) = %u and %u instead of %u\n",
+                               i, j, k, scalar(i, j, k), vector(i, j, k), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    // A dropout mask has the expected density.
+    {
+        Func mask;
+        mask(x, y) = select(philox_float({x, y}, seed) < 0.25f, 1, 0);
+        mask.vectorize(x, 8);
+        Buffer<int> result = mask.realize(512, 512);
+        int count = 0;
+        for (int j = 0; j < 512; j++) {
+            for (int i = 0; i < 512; i++) {
+                count += result(i, j);
+            }
+        }
+        double density = count / (512.0 * 512.0);
+        if (fabs(density - 0.25) > 0.01) {
+            printf("Bad dropout density: %f\n", density);
+            return -1;
+        }
+    }
+
+    // Floats are in [0, 1).
+    {
+        Func f;
+        f(x) = philox_float({x});
+        Buffer<float> result = f.realize(10000);
+        for (int i = 0; i < 10000; i++) {
+            if (result(i) < 0.0f || result(i) >= 1.0f) {
+                printf("philox_float(%d) = %f\n", i, result(i));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the dense (forwards or backwards) vector loads from a buffer in the lowered code.
+class CountDenseLoads : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr visit(const Load *op) override {
+        const Ramp *r = op->index.as<Ramp>();
+        if (op->name == buffer && r && (is_one(r->stride) || is_const(r->stride, -1))) {
+            count++;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    std::string buffer;
+    int count = 0;
+
+    CountDenseLoads(const std::string &b) : buffer(b) {}
+};
+
+int main(int argc, char **argv) {
+    Var x, y, c;
+
+    Buffer<int> input(32, 16, 4);
+    input.for_each_element([&](int x, int y, int c) {
+        input(x, y, c) = x * 3 + y * 5 + c;
+    });
+
+    for (bool plan : {false, true}) {
+        // The consumer vectorizes across the channels of f, so f should
+        // be stored channel-interleaved.
+        Func f("f"), out("out");
+        f(x, y, c) = input(x, y, c) * 2;
+        out(x, y, c) = f(x, y, c) + f(x, y, 3 - c);
+        f.compute_root();
+        out.bound(c, 0, 4).reorder(c, x, y).vectorize(c);
+
+        Target t = get_jit_target_from_environment();
+        if (plan) {
+            t = t.with_feature(Target::PlanLayouts);
+        }
+        CountDenseLoads *counter = new CountDenseLoads(f.name());
+        out.add_custom_lowering_pass(counter);
+        Buffer<int> result = out.realize(32, 16, 4, t);
+
+        for (int c = 0; c < 4; c++) {
+            for (int y = 0; y < 16; y++) {
+                for (int x = 0; x < 32; x++) {
+                    int correct = input(x, y, c) * 2 + input(x, y, 3 - c) * 2;
+                    if (result(x, y, c) != correct) {
+                        printf("out(%d, %d, %d) = %d instead of %d\n", x, y, c, result(x, y, c), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+
+        // f(x, y, 3 - c) is a dense load backwards.
+        if (plan && counter->count != 2) {
+            printf("There were %d dense loads of f instead of 2\n", counter->count);
+            return -1;
+        }
+        if (!plan && counter->count != 0) {
+            printf("There were %d dense loads of f without planned layouts\n", counter->count);
+            return -1;
+        }
+    }
+
+    // An explicit storage order is kept.
+    {
+        Func f("f"), out("out");
+        f(x, y, c) = input(x, y, c) + 1;
+        out(x, y, c) = f(x, y, c);
+        f.compute_root().reorder_storage(y, x, c);
+        out.bound(c, 0, 4).reorder(c, x, y).vectorize(c);
+
+        CountDenseLoads *counter = new CountDenseLoads(f.name());
+        out.add_custom_lowering_pass(counter);
+        Buffer<int> result = out.realize(32, 16, 4, get_jit_target_from_environment().with_feature(Target::PlanLayouts));
+        if (counter->count != 0) {
+            printf("The storage order of f was changed\n");
+            return -1;
+        }
+        for (int c = 0; c < 4; c++) {
+            for (int y = 0; y < 16; y++) {
+                for (int x = 0; x < 32; x++) {
+                    if (result(x, y, c) != input(x, y, c) + 1) {
+                        printf("out(%d, %d, %d) = %d instead of %d\n", x, y, c, result(x, y, c), input(x, y, c) + 1);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int mallocs = 0;
+size_t malloc_bytes = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    malloc_bytes += x;
+    void *orig = malloc(x+128);
+    void *ptr = (void *)((((size_t)orig + 128) >> 7) << 7);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    const int W = 256, H = 64;
+    const size_t bytes = W * H * sizeof(int);
+
+    for (bool plan : {false, true}) {
+        Var x, y;
+        Func f, g, h, out;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) * 2 + f(W - 1 - x, y);
+        h(x, y) = g(x, y) + g(W - 1 - x, y);
+        out(x, y) = h(x, y) + h(W - 1 - x, y);
+        f.compute_root().vectorize(x, 8);
+        g.compute_root().vectorize(x, 8);
+        h.compute_root().vectorize(x, 8);
+        // Only allocations of a constant size can be planned.
+        out.bound(x, 0, W).bound(y, 0, H);
+
+        Target t = get_jit_target_from_environment();
+        if (plan) {
+            t = t.with_feature(Target::PlanMemory);
+        }
+        out.set_custom_allocator(my_malloc, my_free);
+        mallocs = 0;
+        malloc_bytes = 0;
+        Buffer<int> result = out.realize(W, H, t);
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                auto f_ = [&](int x) { return x + y; };
+                auto g_ = [&](int x) { return f_(x) * 2 + f_(W - 1 - x); };
+                auto h_ = [&](int x) { return g_(x) + g_(W - 1 - x); };
+                int correct = h_(x) + h_(W - 1 - x);
+                if (result(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        if (plan) {
+            // f is dead once g is computed, so h can use its bytes.
+            if (mallocs != 1) {
+                printf("There were %d mallocs instead of 1\n", mallocs);
+                return -1;
+            }
+            if (malloc_bytes >= 3 * bytes) {
+                printf("The arena has %d bytes, which is not less than the %d bytes of f, g and h\n",
+                       (int)malloc_bytes, (int)(3 * bytes));
+                return -1;
+            }
+        } else if (mallocs != 3) {
+            printf("There were %d mallocs instead of 3\n", mallocs);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
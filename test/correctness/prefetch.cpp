@@ -159,6 +159,44 @@ int test4(const Target &t) {
     return 0;
 }
 
+// Prefetch the rows of 64 ints of 'f' read by 'g' 'offset' rows ahead.
+vector<vector<Expr>> row_prefetches(Expr offset) {
+    Func f("f"), g("g");
+    Var x("x"), y("y");
+
+    f(x, y) = x + y;
+    g(x, y) = f(x, y);
+
+    f.compute_root();
+    g.bound(x, 0, 64);
+    g.prefetch(f, y, offset);
+
+    Module m = g.compile_to_module({});
+    CollectPrefetches collect;
+    m.functions()[0].body.accept(&collect);
+    return collect.prefetches;
+}
+
+int test5(const Target &t) {
+    // Without an offset, the prefetch runs enough rows ahead to have the
+    // bytes the target needs in flight (see prefetch_bytes_in_flight).
+    int offset;
+    if (t.features_any_of({Target::HVX_64, Target::HVX_128})) {
+        offset = 1;
+    } else if (t.arch == Target::X86) {
+        offset = 2048 / (64 * 4);
+    } else {
+        offset = 1024 / (64 * 4);
+    }
+
+    vector<vector<Expr>> expected = row_prefetches(offset);
+    vector<vector<Expr>> result = row_prefetches(Expr());
+    if (expected.empty() || !check(expected, result)) {
+        return -1;
+    }
+    return 0;
+}
+
 }  // anonymous namespace
 
 int main(int argc, char **argv) {
@@ -180,6 +218,10 @@ int main(int argc, char **argv) {
     if (test4(t) != 0) {
         return -1;
     }
+    printf("Running prefetch test5\n");
+    if (test5(t) != 0) {
+        return -1;
+    }
 
     printf("Success!\n");
     return 0;
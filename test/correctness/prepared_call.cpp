@@ -0,0 +1,70 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int check(const Buffer<int> &out, const Buffer<int> &in, int offset) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int correct = in(x, y) * 2 + offset;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    ImageParam in(Int(32), 2);
+    Param<int> offset;
+    Var x, y;
+
+    Func f;
+    f(x, y) = in(x, y) * 2 + offset;
+
+    Pipeline p(f);
+
+    Buffer<int> in1(16, 16), in2(16, 16);
+    in1.for_each_element([&](int x, int y) { in1(x, y) = x + y; });
+    in2.for_each_element([&](int x, int y) { in2(x, y) = x * y; });
+    Buffer<int> out1(16, 16), out2(16, 16);
+
+    in.set(in1);
+    offset.set(3);
+    Pipeline::PreparedCall call = p.prepare_call(out1);
+
+    // Changing the Param after the call is prepared has no effect on it.
+    offset.set(100);
+    call.realize();
+    if (check(out1, in1, 3) != 0) {
+        return -1;
+    }
+
+    call.set(offset, 7);
+    call.realize();
+    if (check(out1, in1, 7) != 0) {
+        return -1;
+    }
+
+    call.set(in, in2);
+    call.set_output(0, out2);
+    call.realize();
+    if (check(out2, in2, 7) != 0) {
+        return -1;
+    }
+
+    // A call can also be prepared from a ParamMap.
+    ParamMap pm;
+    pm.set(in, in2);
+    pm.set(offset, -4);
+    Pipeline::PreparedCall call2 = p.prepare_call(out1, Target(), pm);
+    call2.realize();
+    if (check(out1, in2, -4) != 0) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// The factor of the first split of a Func's initial definition, i.e. the
+// width of its tiles.
+int tile_width(const Func &f) {
+    for (const auto &split : f.function().definition().schedule().splits()) {
+        if (split.is_split()) {
+            const int64_t *factor = Internal::as_const_int(split.factor);
+            return factor ? (int)*factor : -1;
+        }
+    }
+    return 0;
+}
+
+int schedule_with_profile(const char *profile_text) {
+    const char *filename = "profile_guided_schedule.txt";
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Can't write %s\n", filename);
+        return -1;
+    }
+    fputs(profile_text, file);
+    fclose(file);
+
+    std::map<std::string, MeasuredCost> profile = load_profile(filename);
+    remove(filename);
+    if (profile.count("f") == 0) {
+        printf("The profile has no entry for f\n");
+        return -1;
+    }
+
+    Var x("x"), y("y");
+    Func f("f");
+    f(x, y) = sin(x * 0.1f) * cos(y * 0.1f);
+
+    SimpleAutoscheduleOptions options;
+    options.profile = profile;
+    simple_autoschedule(f, {}, {{0, 1023}, {0, 1023}}, options);
+
+    Buffer<float> result = f.realize(1024, 1024);
+    for (int y = 0; y < 1024; y += 17) {
+        for (int x = 0; x < 1024; x += 13) {
+            float correct = std::sin(x * 0.1f) * std::cos(y * 0.1f);
+            if (std::abs(result(x, y) - correct) > 1e-5f) {
+                printf("f(%d, %d) = %f instead of %f\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return tile_width(f);
+}
+
+int main(int argc, char **argv) {
+    // A Func that kept a single thread busy on average is split into
+    // more tiles than one that kept all the cores of the (generic)
+    // machine busy.
+    int imbalanced = schedule_with_profile(
+        "# pipeline func ms_per_run average_threads\n"
+        "pipeline f 10.0 1.0\n");
+    int balanced = schedule_with_profile(
+        "# pipeline func ms_per_run average_threads\n"
+        "pipeline f 10.0 16.0\n");
+    if (imbalanced <= 0 || balanced <= 0) {
+        return -1;
+    }
+    if (imbalanced >= balanced) {
+        printf("Tiles of width %d for an imbalanced Func, and %d for a balanced one\n",
+               imbalanced, balanced);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
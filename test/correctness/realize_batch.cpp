@@ -0,0 +1,67 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int batch = 16;
+
+    ImageParam in(Int(32), 2);
+    Param<int> offset;
+    Var x, y;
+
+    Func f;
+    f(x, y) = in(x, y) * 2 + offset;
+    f.parallel(y);
+
+    Pipeline p(f);
+
+    std::vector<Buffer<int>> inputs;
+    std::vector<Realization> outputs;
+    std::vector<ParamMap> param_maps(batch);
+    for (int i = 0; i < batch; i++) {
+        Buffer<int> input(16, 8);
+        input.for_each_element([&](int x, int y) {
+            input(x, y) = i * 100 + y * 16 + x;
+        });
+        inputs.push_back(input);
+        Buffer<int> output(16, 8);
+        outputs.push_back(Realization(output));
+    }
+    for (int i = 0; i < batch; i++) {
+        param_maps[i].set(in, inputs[i]);
+        param_maps[i].set(offset, i);
+    }
+
+    p.realize_batch(outputs, param_maps);
+
+    for (int i = 0; i < batch; i++) {
+        Buffer<int> out = outputs[i][0];
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = (i * 100 + y * 16 + x) * 2 + i;
+                if (out(x, y) != correct) {
+                    printf("outputs[%d](%d, %d) = %d instead of %d\n",
+                           i, x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Without ParamMaps, every invocation uses the bound values.
+    in.set(inputs[0]);
+    offset.set(3);
+    p.realize_batch(outputs);
+    for (int i = 0; i < batch; i++) {
+        Buffer<int> out = outputs[i][0];
+        int correct = inputs[0](5, 5) * 2 + 3;
+        if (out(5, 5) != correct) {
+            printf("outputs[%d](5, 5) = %d instead of %d\n", i, out(5, 5), correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
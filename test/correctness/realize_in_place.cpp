@@ -0,0 +1,101 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the allocations in the lowered code.
+class CountAllocations : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Stmt visit(const Allocate *op) override {
+        count++;
+        return IRMutator2::visit(op);
+    }
+
+public:
+    int count = 0;
+};
+
+int check(const Buffer<int> &result, std::function<int(int, int)> correct) {
+    for (int y = 0; y < result.height(); y++) {
+        for (int x = 0; x < result.width(); x++) {
+            if (result(x, y) != correct(x, y)) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct(x, y));
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    Buffer<int> input(64, 16);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = x * 3 + y;
+    });
+
+    // An elementwise chain of root Funcs needs a single buffer.
+    {
+        Func f, g, h, out;
+        f(x, y) = input(x, y) + 1;
+        g(x, y) = f(x, y) * 2;
+        h(x, y) = g(x, y) - 3;
+        out(x, y) = h(x, y) + h(x, y);
+        f.compute_root().vectorize(x, 8);
+        g.compute_root().vectorize(x, 8, TailStrategy::GuardWithIf);
+        h.compute_root().parallel(y);
+
+        CountAllocations *counter = new CountAllocations;
+        out.add_custom_lowering_pass(counter);
+        Buffer<int> result = out.realize(64, 16);
+
+        if (check(result, [&](int x, int y) { return ((input(x, y) + 1) * 2 - 3) * 2; })) {
+            return -1;
+        }
+        if (counter->count != 1) {
+            printf("There were %d allocations instead of 1\n", counter->count);
+            return -1;
+        }
+    }
+
+    // A ShiftInwards tail recomputes points of g, so g can't overwrite f.
+    {
+        Func f, g, out;
+        f(x, y) = input(x, y) + 1;
+        g(x, y) = f(x, y) * 2;
+        out(x, y) = g(x, y);
+        f.compute_root();
+        g.compute_root().vectorize(x, 8, TailStrategy::ShiftInwards);
+
+        Buffer<int> result = out.realize(61, 16);
+        if (check(result, [&](int x, int y) { return (input(x, y) + 1) * 2; })) {
+            return -1;
+        }
+    }
+
+    // f is read after g, and by g at other points, so they need separate
+    // buffers.
+    {
+        Func f, g, h, out;
+        f(x, y) = input(x, y) + 1;
+        g(x, y) = f(x, y) * 2;
+        h(x, y) = f(63 - x, y) + 5;
+        out(x, y) = g(x, y) + f(x, y) + h(x, y);
+        f.compute_root();
+        g.compute_root();
+        h.compute_root();
+
+        Buffer<int> result = out.realize(64, 16);
+        if (check(result, [&](int x, int y) {
+                    return (input(x, y) + 1) * 3 + input(63 - x, y) + 6;
+                })) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
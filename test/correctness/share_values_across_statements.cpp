@@ -0,0 +1,86 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the loads from a buffer in the lowered code.
+class CountLoads : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr visit(const Load *op) override {
+        if (op->name == buffer) {
+            count++;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    std::string buffer;
+    int count = 0;
+
+    CountLoads(const std::string &b) : buffer(b) {}
+};
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    Buffer<int> input(64, 8);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = x * 3 + y;
+    });
+
+    // The values of a Tuple are stored by separate statements, which
+    // should load the input once between them. (The outputs might alias
+    // the input, so this only applies to the internal Funcs.)
+    {
+        Func f, out;
+        f(x, y) = Tuple(input(x, y) * 3, input(x, y) + 7);
+        out(x, y) = f(x, y)[0] - f(x, y)[1];
+        f.compute_root();
+
+        CountLoads *counter = new CountLoads(input.name());
+        out.add_custom_lowering_pass(counter);
+        Buffer<int> result = out.realize(64, 8);
+
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 64; x++) {
+                int correct = input(x, y) * 3 - (input(x, y) + 7);
+                if (result(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        if (counter->count != 1) {
+            printf("There were %d loads of the input instead of 1\n", counter->count);
+            return -1;
+        }
+    }
+
+    // A load of a buffer stored to by one of the statements must not be
+    // shared: the stages computed at the same loop level here read and
+    // write g.
+    {
+        Func g, h;
+        g(x, y) = input(x, y);
+        g(x, y) += 1;
+        h(x, y) = g(x, y) * 2 + input(x, y);
+        g.compute_at(h, y);
+
+        Buffer<int> out = h.realize(64, 8);
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 64; x++) {
+                int correct = (input(x, y) + 1) * 2 + input(x, y);
+                if (out(x, y) != correct) {
+                    printf("h(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
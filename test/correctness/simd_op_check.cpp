@@ -51,12 +51,15 @@ struct Test {
     bool use_avx512_cannonlake{false};
     bool use_avx512_knl{false};
     bool use_avx512_skylake{false};
+    bool use_avx512_vnni{false};
     bool use_avx{false};
     bool use_power_arch_2_07{false};
     bool use_sse41{false};
     bool use_sse42{false};
     bool use_ssse3{false};
     bool use_vsx{false};
+    bool use_wasm_simd128{false};
+    bool use_rvv{false};
 
     string filter{"*"};
     string output_directory{Internal::get_test_tmp_dir()};
@@ -85,7 +88,8 @@ struct Test {
             .with_feature(Target::NoRuntime);
         use_avx512_knl = target.has_feature(Target::AVX512_KNL);
         use_avx512_cannonlake = target.has_feature(Target::AVX512_Cannonlake);
-        use_avx512_skylake = use_avx512_cannonlake || target.has_feature(Target::AVX512_Skylake);
+        use_avx512_vnni = target.has_feature(Target::AVX512_VNNI);
+        use_avx512_skylake = use_avx512_cannonlake || use_avx512_vnni || target.has_feature(Target::AVX512_Skylake);
         use_avx512 = use_avx512_knl || use_avx512_skylake || use_avx512_cannonlake || target.has_feature(Target::AVX512);
         use_avx2 = use_avx512 || target.has_feature(Target::AVX2);
         use_avx = use_avx2 || target.has_feature(Target::AVX);
@@ -100,6 +104,8 @@ struct Test {
 
         use_vsx = target.has_feature(Target::VSX);
         use_power_arch_2_07 = target.has_feature(Target::POWER_ARCH_2_07);
+        use_wasm_simd128 = target.has_feature(Target::WasmSimd128);
+        use_rvv = target.has_feature(Target::RVV);
 
         // We are going to call realize, i.e. we are going to JIT code.
         // Not all platforms support JITting. One indirect yet quick
@@ -577,6 +583,10 @@ struct Test {
             check("vpmulhw*ymm", 16, i16((i32(i16_1) * i32(i16_2)) >> 16));
             check("vpmullw*ymm", 16, i16_1 * i16_2);
 
+            // Data-dependent loads use gathers
+            check("vgatherdps*ymm", 8, in_f32(clamp(i32_1, 0, 15)));
+            check("vpgatherdd*ymm", 8, in_i32(clamp(i32_1, 0, 15)));
+
             check("vpcmp*b*ymm", 32, select(u8_1 == u8_2, u8(1), u8(2)));
             check("vpcmp*b*ymm", 32, select(u8_1 > u8_2, u8(1), u8(2)));
             check("vpcmp*w*ymm", 16, select(u16_1 == u16_2, u16(1), u16(2)));
@@ -646,6 +656,20 @@ struct Test {
             check("vpmaxsq", 8, max(i64_1, i64_2));
             check("vpminsq", 8, min(i64_1, i64_2));
         }
+        if (use_avx512_vnni) {
+            Expr u8_4 = in_u8(x+48), i8_4 = in_i8(x+48);
+            Expr i16_4 = in_i16(x+48);
+            for (int w = 4; w <= 16; w *= 2) {
+                const char *check_vpdpbusd = w == 16 ? "vpdpbusd*zmm" : w == 8 ? "vpdpbusd*ymm" : "vpdpbusd";
+                const char *check_vpdpwssd = w == 16 ? "vpdpwssd*zmm" : w == 8 ? "vpdpwssd*ymm" : "vpdpwssd";
+                check(check_vpdpbusd, w, i32_1 + i32(u8_1) * i32(i8_1) + i32(u8_2) * i32(i8_2) +
+                                             i32(u8_3) * i32(i8_3) + i32(u8_4) * i32(i8_4));
+                check(check_vpdpbusd, w, i32(u8_1) * i32(i8_1) + i32(i8_2) * i32(u8_2) +
+                                             i32(u8_3) * i32(i8_3) + i32(i8_4) * i32(u8_4));
+                check(check_vpdpwssd, w, i32_1 + i32(i16_1) * i32(i16_2) + i32(i16_3) * i32(i16_4));
+                check(check_vpdpwssd, w, i32_1 + i32(u8_1) * i32(i16_2) + i32(i16_3) * 3);
+            }
+        }
     }
 
     void check_neon_all() {
@@ -1416,6 +1440,19 @@ struct Test {
         // Interleave or deinterleave two vectors. Given that we use
         // interleaving loads and stores, it's hard to hit this op with
         // halide.
+
+        // UDOT/SDOT    -       Dot product of groups of four bytes (ARMv8.2)
+        if (target.has_feature(Target::ARMDotProd)) {
+            Expr u8_4 = in_u8(x+48), i8_4 = in_i8(x+48);
+            for (int w = 2; w <= 4; w += 2) {
+                check(arm32 ? "vudot.u8" : "udot", w, u32_1 + u32(u8_1) * u8_2 + u32(u8_2) * u8_3 +
+                                                          u32(u8_3) * u8_4 + u32(u8_4) * u8_1);
+                check(arm32 ? "vsdot.s8" : "sdot", w, i32_1 + i32(i8_1) * i8_2 + i32(i8_2) * i8_3 +
+                                                          i32(i8_3) * i8_4 + i32(i8_4) * i8_1);
+                check(arm32 ? "vudot.u8" : "udot", 2*w, i32(u8_1) * i32(u8_2) + i32(u8_3) * i32(u8_4) +
+                                                            i32(u8_2) * 3 + i32(u8_4) * 5);
+            }
+        }
     }
 
     void check_hvx_all() {
@@ -2098,6 +2135,69 @@ check("v*.w += vrmpy(v*.b,v*.b)", hvx_width, i32_1 + i32(i8_1)*i8_1 + i32(i8_2)*
         }
     }
 
+    void check_wasm_all() {
+        Expr f32_1 = in_f32(x), f32_2 = in_f32(x+16);
+        Expr f64_1 = in_f64(x);
+        Expr i8_1  = in_i8(x),  i8_2  = in_i8(x+16);
+        Expr u8_1  = in_u8(x),  u8_2  = in_u8(x+16);
+        Expr i16_1 = in_i16(x), i16_2 = in_i16(x+16);
+        Expr u16_1 = in_u16(x), u16_2 = in_u16(x+16);
+        Expr i32_1 = in_i32(x), i32_2 = in_i32(x+16);
+
+        if (!use_wasm_simd128) {
+            return;
+        }
+
+        for (int w = 1; w <= 4; w++) {
+            check("i8x16.add", 16*w, i8_1 + i8_2);
+            check("i16x8.sub", 8*w, i16_1 - i16_2);
+            check("i32x4.mul", 4*w, i32_1 * i32_2);
+            check("f32x4.add", 4*w, f32_1 + f32_2);
+            check("f32x4.mul", 4*w, f32_1 * f32_2);
+            check("f32x4.sqrt", 4*w, sqrt(f32_1));
+            check("f64x2.sqrt", 2*w, sqrt(f64_1));
+
+            // The saturating adds and subtracts.
+            check("i8x16.add_saturate_s", 16*w, i8_sat(i16(i8_1) + i16(i8_2)));
+            check("i8x16.add_saturate_u", 16*w, u8_sat(u16(u8_1) + u16(u8_2)));
+            check("i8x16.sub_saturate_s", 16*w, i8_sat(i16(i8_1) - i16(i8_2)));
+            check("i8x16.sub_saturate_u", 16*w, u8(max(i16(u8_1) - i16(u8_2), 0)));
+            check("i16x8.add_saturate_s", 8*w, i16_sat(i32(i16_1) + i32(i16_2)));
+            check("i16x8.add_saturate_u", 8*w, u16_sat(u32(u16_1) + u32(u16_2)));
+            check("i16x8.sub_saturate_s", 8*w, i16_sat(i32(i16_1) - i32(i16_2)));
+            check("i16x8.sub_saturate_u", 8*w, u16(max(i32(u16_1) - i32(u16_2), 0)));
+        }
+    }
+
+    void check_riscv_all() {
+        Expr f32_1 = in_f32(x), f32_2 = in_f32(x+16);
+        Expr f64_1 = in_f64(x);
+        Expr i8_1  = in_i8(x),  i8_2  = in_i8(x+16);
+        Expr u8_1  = in_u8(x),  u8_2  = in_u8(x+16);
+        Expr i16_1 = in_i16(x), i16_2 = in_i16(x+16);
+        Expr u16_1 = in_u16(x), u16_2 = in_u16(x+16);
+        Expr i32_1 = in_i32(x), i32_2 = in_i32(x+16);
+
+        if (!use_rvv) {
+            return;
+        }
+
+        // Vectors wider than the 128 bits RVV guarantees are computed
+        // in register groups, by the same instructions.
+        for (int w = 1; w <= 4; w++) {
+            check("vadd.vv", 16*w, i8_1 + i8_2);
+            check("vsub.vv", 8*w, i16_1 - i16_2);
+            check("vmul.vv", 4*w, i32_1 * i32_2);
+            check("vmaxu.vv", 16*w, max(u8_1, u8_2));
+            check("vmin.vv", 8*w, min(i16_1, i16_2));
+            check("vminu.vv", 8*w, min(u16_1, u16_2));
+            check("vfadd.vv", 4*w, f32_1 + f32_2);
+            check("vfmul.vv", 4*w, f32_1 * f32_2);
+            check("vfsqrt.v", 4*w, sqrt(f32_1));
+            check("vfsqrt.v", 2*w, sqrt(f64_1));
+        }
+    }
+
     bool test_all() {
         // Queue up a bunch of tasks representing each test to run.
         if (target.arch == Target::X86) {
@@ -2108,6 +2208,10 @@ check("v*.w += vrmpy(v*.b,v*.b)", hvx_width, i32_1 + i32(i8_1)*i8_1 + i32(i8_2)*
             check_hvx_all();
         } else if (target.arch == Target::POWERPC) {
             check_altivec_all();
+        } else if (target.arch == Target::WebAssembly) {
+            check_wasm_all();
+        } else if (target.arch == Target::RISCV) {
+            check_riscv_all();
         }
 
         Halide::Internal::ThreadPool<TestResult> pool(num_threads);
@@ -0,0 +1,139 @@
+#include "Halide.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+using namespace Halide;
+
+// This test is built twice. Built without HAS_SCHEDULE_SOURCE, it writes
+// the source of the schedule simple_autoschedule generates for the
+// pipeline below to the file given; the build then compiles that source
+// into the test, which checks it schedules the pipeline the same way.
+
+Func build_pipeline(Buffer<float> in) {
+    Var x("x"), y("y");
+    Func blur_x("blur_x"), blur_y("blur_y"), sum("sum");
+    blur_x(x, y) = in(x, y) + in(x + 1, y) + in(x + 2, y);
+    blur_y(x, y) = blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2);
+    RDom r(0, 8, "r");
+    sum(x, y) = 0.f;
+    sum(x, y) += blur_y(x + r, y);
+    return sum;
+}
+
+const std::vector<std::pair<int, int>> output_bounds = {{0, 1013}, {0, 1013}};
+
+std::string schedule(Func f, const std::vector<std::pair<int, int>> &bounds) {
+    SimpleAutoscheduleOptions options;
+    return simple_autoschedule(f, {}, bounds, options);
+}
+
+#ifdef HAS_SCHEDULE_SOURCE
+
+void apply_schedule(Pipeline p) {
+    auto get_pipeline = [&]() { return p; };
+#include "simple_autoschedule_source.schedule.h"
+}
+
+// The schedules of the Funcs computing an output, as text
+std::string describe_schedule(Func output) {
+    std::ostringstream s;
+    for (const auto &it : Internal::find_transitive_calls(output.function())) {
+        const Internal::Function &f = it.second;
+        s << it.first
+          << " compute_at " << f.schedule().compute_level().to_string()
+          << " store_at " << f.schedule().store_level().to_string()
+          << " memory_type " << (int)f.schedule().memory_type() << "\n";
+        for (const auto &d : f.schedule().storage_dims()) {
+            s << " storage " << d.var << "\n";
+        }
+        for (int i = 0; i <= (int)f.updates().size(); i++) {
+            const Internal::StageSchedule &stage =
+                i == 0 ? f.definition().schedule() : f.update(i - 1).schedule();
+            s << " stage " << i << "\n";
+            for (const auto &split : stage.splits()) {
+                s << "  split " << (int)split.split_type << " " << split.old_var
+                  << " " << split.outer << " " << split.inner << " " << split.factor
+                  << " " << (int)split.tail << "\n";
+            }
+            for (const auto &d : stage.dims()) {
+                s << "  dim " << d.var << " " << (int)d.for_type << " " << (int)d.device_api << "\n";
+            }
+        }
+    }
+    return s.str();
+}
+
+// The line of the header of a schedule starting with the prefix given
+std::string header_line(const std::string &source, const std::string &prefix) {
+    size_t begin = source.find(prefix);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return source.substr(begin, source.find('\n', begin) - begin);
+}
+
+int main(int argc, char **argv) {
+    Buffer<float> in(1024, 1024);
+    in.for_each_element([&](int x, int y) {
+        in(x, y) = (float)((x * 17 + y * 31) % 101);
+    });
+
+    Func scheduled = build_pipeline(in);
+    std::string source = schedule(scheduled, output_bounds);
+
+    Func applied = build_pipeline(in);
+    apply_schedule(Pipeline(applied));
+
+    std::string scheduled_schedule = describe_schedule(scheduled);
+    std::string applied_schedule = describe_schedule(applied);
+    if (scheduled_schedule != applied_schedule) {
+        printf("The schedule source applied:\n%s\nschedules the pipeline as:\n%s\ninstead of:\n%s\n",
+               source.c_str(), applied_schedule.c_str(), scheduled_schedule.c_str());
+        return -1;
+    }
+
+    Buffer<float> scheduled_out = scheduled.realize(1014, 1014);
+    Buffer<float> applied_out = applied.realize(1014, 1014);
+    for (int y = 0; y < 1014; y++) {
+        for (int x = 0; x < 1014; x++) {
+            if (applied_out(x, y) != scheduled_out(x, y)) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, applied_out(x, y), scheduled_out(x, y));
+                return -1;
+            }
+        }
+    }
+
+    // The same algorithm scheduled for other output bounds keeps the
+    // hash of the algorithm, but not the hash of the inputs.
+    std::string other = schedule(build_pipeline(in), {{0, 511}, {0, 511}});
+    if (header_line(other, "// Algorithm: ") != header_line(source, "// Algorithm: ")) {
+        printf("The hash of the algorithm depends on the output bounds:\n%s\n%s\n",
+               source.c_str(), other.c_str());
+        return -1;
+    }
+    if (header_line(source, "// Inputs: ").empty() ||
+        header_line(other, "// Inputs: ") == header_line(source, "// Inputs: ")) {
+        printf("The hash of the inputs doesn't depend on the output bounds:\n%s\n%s\n",
+               source.c_str(), other.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("Usage: %s schedule.h\n", argv[0]);
+        return -1;
+    }
+    Buffer<float> in(1024, 1024);
+    std::ofstream file(argv[1]);
+    file << schedule(build_pipeline(in), output_bounds);
+    return file.good() ? 0 : -1;
+}
+
+#endif
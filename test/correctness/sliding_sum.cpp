@@ -0,0 +1,85 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Buffer<int> input(64, 32);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = (x * 17 + y * 31) % 23;
+    });
+    Func clamped = BoundaryConditions::repeat_edge(input);
+
+    Var x, y, xo, yo, xi, yi;
+
+    // Separable box filters, along y and then x, with tiles that do and
+    // don't line up with the tiles of the consumer.
+    for (int tile_size : {1, 5, 8}) {
+        RDom r(-2, 5);
+        Func blur_y, blur;
+        SlidingSum sum_y = sliding_sum(clamped(x, y + r), tile_size);
+        blur_y(x, y) = sum_y;
+        SlidingSum sum_x = sliding_sum(blur_y(x + r, y), tile_size);
+        blur(x, y) = sum_x;
+
+        if (!sum_y.scan.defined() || !sum_x.scan.defined()) {
+            printf("A box filter wasn't recognized as a sliding sum\n");
+            return -1;
+        }
+
+        blur.tile(x, y, xo, yo, xi, yi, 8, 8);
+        sum_y.scan.compute_at(blur, xo);
+        sum_x.scan.compute_at(blur, xo);
+        if (tile_size > 1) {
+            sum_x.scan.update(1).vectorize(y, 4);
+        }
+
+        Buffer<int> result = blur.realize(64, 32);
+        for (int y = 0; y < result.height(); y++) {
+            for (int x = 0; x < result.width(); x++) {
+                int correct = 0;
+                for (int dy = -2; dy <= 2; dy++) {
+                    for (int dx = -2; dx <= 2; dx++) {
+                        int cx = std::min(std::max(x + dx, 0), 63);
+                        int cy = std::min(std::max(y + dy, 0), 31);
+                        correct += input(cx, cy);
+                    }
+                }
+                if (result(x, y) != correct) {
+                    printf("blur(%d, %d) = %d instead of %d (tile size %d)\n",
+                           x, y, result(x, y), correct, tile_size);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // A sum that doesn't slide along a variable is computed as a sum.
+    {
+        RDom r(0, 4);
+        Func f;
+        SlidingSum s = sliding_sum(clamped(x * r, y));
+        f(x, y) = s;
+        if (s.scan.defined()) {
+            printf("A sum that isn't a box filter was computed as a sliding sum\n");
+            return -1;
+        }
+
+        Buffer<int> result = f.realize(16, 16);
+        for (int y = 0; y < result.height(); y++) {
+            for (int x = 0; x < result.width(); x++) {
+                int correct = 0;
+                for (int i = 0; i < 4; i++) {
+                    correct += input(std::min(x * i, 63), y);
+                }
+                if (result(x, y) != correct) {
+                    printf("f(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "Halide.h"
+#include <math.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+const int C = 10, B = 4;
+
+bool approx_equal(float a, float b) {
+    return a == b || fabs(a - b) <= 1e-4f * std::max(1.0f, fabs(b));
+}
+
+int main(int argc, char **argv) {
+    // Logits large enough to overflow exp() if the maximum isn't subtracted
+    Buffer<float> input(C, B), weights(C, B);
+    input.for_each_element([&](int c, int b) {
+        input(c, b) = 100.0f * b + (float)((c * 7 + b * 3) % 11) / 3.0f;
+        weights(c, b) = (float)((c * 5 + b) % 7) - 3.0f;
+    });
+    // A masked logit, first in its batch
+    input(0, 1) = -INFINITY;
+    Buffer<int> labels(B);
+    labels.for_each_element([&](int b) {
+        labels(b) = (b * 3) % C;
+    });
+
+    // The reference softmax of each batch
+    Buffer<float> p_ref(C, B);
+    for (int b = 0; b < B; b++) {
+        float m = input(0, b);
+        for (int c = 0; c < C; c++) {
+            m = std::max(m, input(c, b));
+        }
+        float s = 0.0f;
+        for (int c = 0; c < C; c++) {
+            s += expf(input(c, b) - m);
+        }
+        for (int c = 0; c < C; c++) {
+            p_ref(c, b) = expf(input(c, b) - m) / s;
+        }
+    }
+
+    Var c, b;
+    Func logits("logits"), labels_f("labels_f"), weights_f("weights_f");
+    logits(c, b) = input(c, b);
+    labels_f(b) = labels(b);
+    weights_f(c, b) = weights(c, b);
+    RDom r(0, C, 0, B);
+
+    for (int fn = 0; fn < 2; fn++) {
+        // A weighted sum of the softmax or the log softmax to differentiate
+        FusedSoftmax p = fn == 0 ? softmax(logits, 0, C) : log_softmax(logits, 0, C);
+        Func loss("loss");
+        loss() = 0.0f;
+        loss() += p.output(r.x, r.y) * weights_f(r.x, r.y);
+
+        PropagateAdjointsOptions options;
+        p.register_gradient(options);
+        Derivative d = propagate_adjoints(loss, options);
+        Buffer<float> out = p.output.realize(C, B);
+        Buffer<float> grad = d(logits).realize(C, B);
+
+        for (int bi = 0; bi < B; bi++) {
+            float dot = 0.0f, weight_sum = 0.0f;
+            for (int ci = 0; ci < C; ci++) {
+                dot += weights(ci, bi) * p_ref(ci, bi);
+                weight_sum += weights(ci, bi);
+            }
+            for (int ci = 0; ci < C; ci++) {
+                float correct = fn == 0 ? p_ref(ci, bi) : logf(p_ref(ci, bi));
+                float correct_grad = fn == 0 ?
+                    p_ref(ci, bi) * (weights(ci, bi) - dot) :
+                    weights(ci, bi) - p_ref(ci, bi) * weight_sum;
+                if (!approx_equal(out(ci, bi), correct)) {
+                    printf("%s(%d, %d) = %f instead of %f\n",
+                           p.output.name().c_str(), ci, bi, out(ci, bi), correct);
+                    return -1;
+                }
+                if (!approx_equal(grad(ci, bi), correct_grad)) {
+                    printf("d(logits)(%d, %d) = %f instead of %f for %s\n",
+                           ci, bi, grad(ci, bi), correct_grad, p.output.name().c_str());
+                    return -1;
+                }
+            }
+        }
+    }
+
+    {
+        FusedSoftmax ce = log_softmax_cross_entropy(logits, labels_f, 0, C);
+        RDom rb(0, B);
+        Func loss("loss");
+        loss() = 0.0f;
+        loss() += ce.output(rb) * (rb + 1.0f);
+
+        PropagateAdjointsOptions options;
+        ce.register_gradient(options);
+        Derivative d = propagate_adjoints(loss, options);
+        Buffer<float> out = ce.output.realize(B);
+        Buffer<float> grad = d(logits).realize(C, B);
+
+        for (int bi = 0; bi < B; bi++) {
+            float correct = -logf(p_ref(labels(bi), bi));
+            if (!approx_equal(out(bi), correct)) {
+                printf("cross_entropy(%d) = %f instead of %f\n", bi, out(bi), correct);
+                return -1;
+            }
+            for (int ci = 0; ci < C; ci++) {
+                float onehot = ci == labels(bi) ? 1.0f : 0.0f;
+                float correct_grad = (bi + 1.0f) * (p_ref(ci, bi) - onehot);
+                if (!approx_equal(grad(ci, bi), correct_grad)) {
+                    printf("d(logits)(%d, %d) = %f instead of %f for the cross entropy\n",
+                           ci, bi, grad(ci, bi), correct_grad);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
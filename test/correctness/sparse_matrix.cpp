@@ -0,0 +1,92 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int rows = 37, cols = 29, dense_cols = 16;
+
+    // A random sparse matrix, with some empty rows.
+    std::vector<int> row_ptr_data = {0}, row_idx_data, col_idx_data;
+    std::vector<float> values_data;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (i % 5 != 3 && (rand() % 4) == 0) {
+                row_idx_data.push_back(i);
+                col_idx_data.push_back(j);
+                values_data.push_back((rand() % 100) / 10.0f);
+            }
+        }
+        row_ptr_data.push_back((int)values_data.size());
+    }
+    const int nonzeros = (int)values_data.size();
+
+    Buffer<int> row_ptr(row_ptr_data.data(), rows + 1);
+    Buffer<int> row_idx(row_idx_data.data(), nonzeros);
+    Buffer<int> col_idx(col_idx_data.data(), nonzeros);
+    Buffer<float> values(values_data.data(), nonzeros);
+
+    Buffer<float> dense(dense_cols, cols);
+    dense.for_each_element([&](int x, int y) {
+        dense(x, y) = (x * 3 + y * 7) % 11 - 5.0f;
+    });
+
+    // The product, as a dense matrix.
+    Buffer<float> correct(dense_cols, rows);
+    correct.fill(0.0f);
+    for (int i = 0; i < rows; i++) {
+        for (int k = row_ptr_data[i]; k < row_ptr_data[i + 1]; k++) {
+            for (int x = 0; x < dense_cols; x++) {
+                correct(x, i) += values_data[k] * dense(x, col_idx_data[k]);
+            }
+        }
+    }
+
+    Var x, y;
+    for (int coo = 0; coo < 2; coo++) {
+        SparseMatrix A = coo ?
+            SparseMatrix::from_coo(Func(row_idx), Func(col_idx), Func(values), rows, cols, nonzeros) :
+            SparseMatrix(Func(row_ptr), Func(col_idx), Func(values), rows, cols, nonzeros);
+
+        // A sparse-dense matrix product, vectorized across the dense
+        // matrix and parallel over the rows.
+        {
+            Func f;
+            RDom k = A.row_nonzeros(y);
+            f(x, y) = 0.0f;
+            f(x, y) += A.value(k) * dense(x, A.column(k));
+            f.update().parallel(y).vectorize(x, 8);
+
+            Buffer<float> result = f.realize(dense_cols, rows);
+            for (int i = 0; i < rows; i++) {
+                for (int j = 0; j < dense_cols; j++) {
+                    if (std::abs(result(j, i) - correct(j, i)) > 1e-3f) {
+                        printf("f(%d, %d) = %f instead of %f (coo = %d)\n",
+                               j, i, result(j, i), correct(j, i), coo);
+                        return -1;
+                    }
+                }
+            }
+        }
+
+        // A sparse matrix-vector product, with an inline reduction.
+        {
+            Func g;
+            RDom k = A.row_nonzeros(y);
+            g(y) = sum(A.value(k) * dense(0, A.column(k)));
+            g.parallel(y);
+
+            Buffer<float> result = g.realize(rows);
+            for (int i = 0; i < rows; i++) {
+                if (std::abs(result(i) - correct(0, i)) > 1e-3f) {
+                    printf("g(%d) = %f instead of %f (coo = %d)\n",
+                           i, result(i), correct(0, i), coo);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int check(Func f, int w, int h) {
+    Buffer<int> out = f.realize(w, h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int correct = x * 2 + y + w;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d for a %dx%d output\n",
+                       x, y, out(x, y), correct, w, h);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    Func f;
+    f(x, y) = x * 2 + y;
+    Func g;
+    g(x, y) = f(x, y) + g.output_buffer().dim(0).extent();
+    f.compute_at(g, y);
+    g.vectorize(x, 4, TailStrategy::GuardWithIf);
+
+    std::vector<ExpectedShape> shapes = {
+        {{3, 0}, 1.0f},
+        {{16, 16}, 5.0f},
+        {{3}, 4.0f},       // The same as the first one
+        {{0, 0}, 100.0f},  // Doesn't constrain anything
+        {{8, 1}, 2.0f},
+        {{5, 5}, 0.5f},    // Over the budget
+    };
+    std::vector<Stage> stages = g.specialize_for_shapes(shapes, 3);
+    if (stages.size() != 3) {
+        printf("Got %d specializations instead of 3\n", (int)stages.size());
+        return -1;
+    }
+
+    const std::vector<Internal::Specialization> &specializations =
+        g.function().definition().specializations();
+    if (specializations.size() != 3) {
+        printf("Func has %d specializations instead of 3\n", (int)specializations.size());
+        return -1;
+    }
+
+    // The merged shape {3} has the largest weight, so it should come first.
+    Expr first = (g.output_buffer().dim(0).extent() == 3);
+    if (!Internal::equal(specializations[0].condition, first)) {
+        std::cout << "First specialization was " << specializations[0].condition
+                  << " instead of " << first << "\n";
+        return -1;
+    }
+
+    // Check the hot shapes, and some that use the generic fallback.
+    int sizes[][2] = {{3, 7}, {16, 16}, {8, 1}, {5, 5}, {17, 3}};
+    for (auto &s : sizes) {
+        if (check(g, s[0], s[1]) != 0) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
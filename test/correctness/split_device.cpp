@@ -0,0 +1,83 @@
+#include "Halide.h"
+#include "halide_split_device.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Stand in for the GPU with a second CPU build of the same pipeline,
+    // made slower, so that the split moves towards the CPU side.
+    ImageParam input(Int(32), 2);
+    Var x, y;
+    // The two sides run at the same time, so they get separate
+    // pipelines.
+    Func f, g;
+    f(x, y) = input(x, y) * 2 + input(x, y + 1);
+    g(x, y) = input(x, y) * 2 + input(x, y + 1);
+    f.compile_jit();
+    g.compile_jit();
+
+    Buffer<int> in(64, 129);
+    in.for_each_element([&](int x, int y) {
+        in(x, y) = x + y * 3;
+    });
+    input.set(in);
+
+    auto compute = [&](Runtime::Buffer<int> part) {
+        Buffer<int> out(std::move(part));
+        f.realize(out);
+        return 0;
+    };
+    auto slow_compute = [&](Runtime::Buffer<int> part) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        Buffer<int> out(std::move(part));
+        g.realize(out);
+        return 0;
+    };
+
+    Tools::SplitDevice split(0.5, 0.5, 4);
+    for (int i = 0; i < 3; i++) {
+        Runtime::Buffer<int> out(64, 128);
+        out.fill(-1);
+        int result = split.run(out, 1, slow_compute, compute);
+        if (result != 0) {
+            printf("run returned %d\n", result);
+            return -1;
+        }
+        for (int y = 0; y < 128; y++) {
+            for (int x = 0; x < 64; x++) {
+                int correct = in(x, y) * 2 + in(x, y + 1);
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+        if (split.gpu_extent(128) % 4 != 0) {
+            printf("The GPU part has %d rows, which isn't a multiple of 4\n", split.gpu_extent(128));
+            return -1;
+        }
+    }
+
+    if (split.gpu_fraction() >= 0.5) {
+        printf("The fraction computed by the slower side is %f\n", split.gpu_fraction());
+        return -1;
+    }
+    if (split.gpu_extent(128) < 4) {
+        printf("The slower side should keep some of the rows\n");
+        return -1;
+    }
+
+    // A failure on either side is returned.
+    {
+        Runtime::Buffer<int> out(64, 128);
+        int result = split.run(out, 1, slow_compute, [](Runtime::Buffer<int> part) { return -7; });
+        if (result != -7) {
+            printf("run returned %d instead of -7\n", result);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -386,6 +386,39 @@ int main(int argc, char **argv) {
         }
     }
 
+    {
+        Func f, g;
+        Var yo, yi;
+
+        f(x, y) = x;
+        g(x, y) = f(x-1, y+1) + f(x, y-1);
+        g.split(y, yo, yi, 100).parallel(yo);
+        f.store_root().compute_at(g, yi);
+
+        // f slides down each strip, so each thread should get its
+        // own folded storage instead of sharing a full-size buffer.
+
+        g.set_custom_allocator(my_malloc, my_free);
+
+        Buffer<int> im = g.realize(100, 1000);
+
+        size_t expected_size = 101*4*sizeof(int) + sizeof(int);
+        if (custom_malloc_size == 0 || custom_malloc_size != expected_size) {
+            printf("Scratch space allocated was %d instead of %d\n", (int)custom_malloc_size, (int)expected_size);
+            return -1;
+        }
+
+        for (int y = 0; y < im.height(); y++) {
+            for (int x = 0; x < im.width(); x++) {
+                int correct = 2*x - 1;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
     {
         // Fold the storage of the output of an extern stage
         Func f, g, h;
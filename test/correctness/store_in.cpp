@@ -34,9 +34,13 @@ void check(MemoryType t1, MemoryType t2, MemoryType t3) {
 
     p.set(true);
 
-    int expected_mallocs = ((t1 == MemoryType::Heap ? 1 : 0) +
-                            (t2 == MemoryType::Heap ? 1 : 0) +
-                            ((t3 == MemoryType::Heap || t3 == MemoryType::Auto) ? 1 : 0));
+    // Off Hexagon, VTCM allocations fall back to the heap.
+    auto on_heap = [](MemoryType t) {
+        return t == MemoryType::Heap || t == MemoryType::VTCM;
+    };
+    int expected_mallocs = ((on_heap(t1) ? 1 : 0) +
+                            (on_heap(t2) ? 1 : 0) +
+                            ((on_heap(t3) || t3 == MemoryType::Auto) ? 1 : 0));
 
     mallocs = 0;
     f.set_custom_allocator(my_malloc, my_free);
@@ -51,7 +55,7 @@ void check(MemoryType t1, MemoryType t2, MemoryType t3) {
 
 int main(int argc, char **argv) {
 
-    MemoryType types[] = {MemoryType::Auto, MemoryType::Stack, MemoryType::Heap};
+    MemoryType types[] = {MemoryType::Auto, MemoryType::Stack, MemoryType::Heap, MemoryType::VTCM};
 
     for (MemoryType t1 : types) {
         for (MemoryType t2 : types) {
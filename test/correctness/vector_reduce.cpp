@@ -0,0 +1,217 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the VectorReduce nodes in the lowered code.
+class CountVectorReduces : public IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr visit(const VectorReduce *op) override {
+        count++;
+        return IRMutator2::visit(op);
+    }
+
+public:
+    int count = 0;
+};
+
+template<typename T>
+int check(Func f, T correct, int expected_reduces) {
+    CountVectorReduces *counter = new CountVectorReduces;
+    f.add_custom_lowering_pass(counter);
+    Buffer<T> result = f.realize();
+    if (result() != correct) {
+        printf("%s computed %f instead of %f\n", f.name().c_str(), (double)result(), (double)correct);
+        return -1;
+    }
+    if (counter->count < expected_reduces) {
+        printf("%s had %d VectorReduce nodes instead of at least %d\n",
+               f.name().c_str(), counter->count, expected_reduces);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const int size = 256;
+    Buffer<int> ints(size);
+    Buffer<float> floats(size);
+    Buffer<int16_t> a(size), b(size);
+    Buffer<uint8_t> p(size), q(size);
+    for (int i = 0; i < size; i++) {
+        ints(i) = (i * 37) % 101 - 50;
+        floats(i) = ((i * 17) % 23) * 0.25f;
+        a(i) = (int16_t)((i * 1237) % 60000 - 30000);
+        b(i) = (int16_t)((i * 317) % 2000 - 1000);
+        p(i) = (uint8_t)(i * 13);
+        q(i) = (uint8_t)(i * 7 + 100);
+    }
+
+    RDom r(0, size);
+
+    // Vectorizing the RVar of a reduction into one point doesn't need
+    // allow_race_conditions: the lanes are reduced.
+    {
+        Func sum("sum");
+        sum() = 0;
+        sum() += ints(r);
+        sum.update().vectorize(r, 16);
+
+        int correct = 0;
+        for (int i = 0; i < size; i++) {
+            correct += ints(i);
+        }
+        if (check(sum, correct, 1)) {
+            return -1;
+        }
+    }
+
+    {
+        Func lowest("lowest"), highest("highest");
+        lowest() = std::numeric_limits<float>::infinity();
+        lowest() = min(lowest(), floats(r));
+        highest() = -std::numeric_limits<float>::infinity();
+        highest() = max(floats(r), highest());
+        lowest.update().vectorize(r, 8);
+        highest.update().vectorize(r, 8);
+
+        float correct_min = floats(0), correct_max = floats(0);
+        for (int i = 0; i < size; i++) {
+            correct_min = std::min(correct_min, floats(i));
+            correct_max = std::max(correct_max, floats(i));
+        }
+        if (check(lowest, correct_min, 1) || check(highest, correct_max, 1)) {
+            return -1;
+        }
+    }
+
+    // A dot product of int16s, which is pmaddwd on x86.
+    {
+        Func dot("dot");
+        dot() = 0;
+        dot() += cast<int>(a(r)) * b(r);
+        dot.update().vectorize(r, 16);
+
+        int correct = 0;
+        for (int i = 0; i < size; i++) {
+            correct += (int)a(i) * b(i);
+        }
+        if (check(dot, correct, 1)) {
+            return -1;
+        }
+    }
+
+    // A sum of absolute differences of uint8s, which is psadbw on x86.
+    {
+        Func sad("sad");
+        sad() = cast<uint16_t>(0);
+        sad() += cast<uint16_t>(absd(p(r), q(r)));
+        sad.update().vectorize(r, 32);
+
+        uint16_t correct = 0;
+        for (int i = 0; i < size; i++) {
+            correct += (uint16_t)std::abs((int)p(i) - (int)q(i));
+        }
+        if (check(sad, correct, 1)) {
+            return -1;
+        }
+    }
+
+    // A sum the simplifier rewrites as a subtraction.
+    {
+        Func negated("negated");
+        negated() = 0;
+        negated() += ints(r) * -1;
+        negated.update().vectorize(r, 16);
+
+        int correct = 0;
+        for (int i = 0; i < size; i++) {
+            correct -= ints(i);
+        }
+        if (check(negated, correct, 1)) {
+            return -1;
+        }
+    }
+
+    // A sum the simplifier reassociates, to (sum() + ints(r)) + 3.
+    {
+        Func offset("offset");
+        offset() = 0;
+        offset() += ints(r) + 3;
+        offset.update().vectorize(r, 16);
+
+        int correct = 0;
+        for (int i = 0; i < size; i++) {
+            correct += ints(i) + 3;
+        }
+        if (check(offset, correct, 1)) {
+            return -1;
+        }
+    }
+
+    // A reduction over a 2-D RDom, vectorized over its inner dimension.
+    {
+        Var x;
+        Buffer<int> grid(16, 8, 4);
+        for (int z = 0; z < 4; z++) {
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 16; x++) {
+                    grid(x, y, z) = (x * 7 + y * 13 + z * 29) % 31 - 15;
+                }
+            }
+        }
+        RDom s(0, 16, 0, 8);
+        Func planes("planes");
+        planes(x) = 0;
+        planes(x) += grid(s.x, s.y, x);
+        planes.update().vectorize(s.x);
+
+        CountVectorReduces *counter = new CountVectorReduces;
+        planes.add_custom_lowering_pass(counter);
+        Buffer<int> result = planes.realize(4);
+        for (int z = 0; z < 4; z++) {
+            int correct = 0;
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 16; x++) {
+                    correct += grid(x, y, z);
+                }
+            }
+            if (result(z) != correct) {
+                printf("planes(%d) = %d instead of %d\n", z, result(z), correct);
+                return -1;
+            }
+        }
+        if (counter->count < 1) {
+            printf("planes had no VectorReduce nodes\n");
+            return -1;
+        }
+    }
+
+    // A reduction into each point of a Func, with a vector width that
+    // doesn't divide the RDom, so the last vector is only partly used.
+    {
+        Var x;
+        RDom s(0, 100);
+        Func rows("rows");
+        rows(x) = 0;
+        rows(x) += ints(s + x) * 3;
+        rows.update().vectorize(s, 16);
+
+        Buffer<int> result = rows.realize(8);
+        for (int x = 0; x < 8; x++) {
+            int correct = 0;
+            for (int i = 0; i < 100; i++) {
+                correct += ints(i + x) * 3;
+            }
+            if (result(x) != correct) {
+                printf("rows(%d) = %d instead of %d\n", x, result(x), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include "Halide.h"
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x;
+
+    f(x) = x;
+    g(x) = f(x) + f(x - 1);
+    f.compute_root().async();
+
+    // The C backend can't run the producer and the consumer of an
+    // async Func concurrently.
+    std::string test_c = Internal::get_test_tmp_dir() + "async_c_backend.c";
+    g.compile_to_c(test_c, {}, "async_c_backend");
+
+    // We shouldn't reach here, because there should have been a compile error.
+    printf("There should have been an error\n");
+
+    return 0;
+}
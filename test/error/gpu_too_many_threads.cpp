@@ -0,0 +1,19 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f;
+    Var x, y, xo, yo, xi, yi;
+    f(x, y) = x + y;
+
+    // 64x32 threads per block is more than any CUDA device can launch.
+    f.gpu_tile(x, y, xo, yo, xi, yi, 64, 32);
+
+    Target t = get_host_target().with_feature(Target::CUDA);
+    f.compile_to_assembly("gpu_too_many_threads.s", {}, "f", t);
+
+    printf("Success!\n");
+    return 0;
+}
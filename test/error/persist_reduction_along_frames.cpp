@@ -0,0 +1,22 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f("f");
+    Var x, t;
+    RDom r(1, 9);
+
+    f(x, t) = x;
+    f(x, r) = f(x, r - 1) + 1;
+
+    // Only the new frames of a persistent Func are computed, so the
+    // update along t would apply twice to the frames held.
+    f.compute_root().persist(t, 3);
+
+    // We shouldn't reach here, because there should have been an error.
+    printf("There should have been an error\n");
+
+    return 0;
+}
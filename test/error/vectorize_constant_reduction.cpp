@@ -0,0 +1,24 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+
+    Func f;
+    Var x;
+
+    f(x) = 0;
+
+    RDom r(0, 16);
+    f(x) += 1;
+
+    // This schedule should be forbidden, because every lane would store
+    // the same value to f(x) instead of the lanes being reduced.
+    f.update().vectorize(r);
+
+    // We shouldn't reach here, because there should have been a compile error.
+    printf("There should have been an error\n");
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+
+    Func f, g;
+    Var x;
+
+    g(x) = x;
+    f(x) = 0;
+
+    RDom r(0, 16, 0, 16);
+    f(x) += g(r.y);
+
+    // This schedule should be forbidden, because the value added doesn't
+    // depend on r.x, so the lanes of the vectorized loop over it would
+    // race to store the same value to f(x).
+    f.update().vectorize(r.x);
+
+    // We shouldn't reach here, because there should have been a compile error.
+    printf("There should have been an error\n");
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "async_entry.h"
+
+using namespace Halide::Runtime;
+
+const int W = 64, H = 32, N = 16;
+
+struct Request {
+    Buffer<float> input, output;
+    float offset;
+    void *args[3];
+    int result;
+};
+
+std::mutex mutex;
+std::condition_variable all_done;
+int done = 0;
+
+void finished(void *context, int result) {
+    Request *request = (Request *)context;
+    std::lock_guard<std::mutex> lock(mutex);
+    request->result = result;
+    done++;
+    all_done.notify_all();
+}
+
+int main(int argc, char **argv) {
+    // Fewer threads than calls in flight
+    halide_set_num_threads(2);
+
+    std::vector<Request> requests(N);
+    for (int i = 0; i < N; i++) {
+        Request &r = requests[i];
+        r.input = Buffer<float>(W, H);
+        r.output = Buffer<float>(W, H);
+        r.input.for_each_element([&](int x, int y) { r.input(x, y) = (float)(x + y * W + i); });
+        r.offset = (float)i;
+        r.result = -1;
+        r.args[0] = r.input.raw_buffer();
+        r.args[1] = &r.offset;
+        r.args[2] = r.output.raw_buffer();
+    }
+
+    for (int i = 0; i < N; i++) {
+        int result = async_entry_async(requests[i].args, finished, &requests[i]);
+        if (result != 0) {
+            printf("async_entry_async failed to queue call %d: %d\n", i, result);
+            return -1;
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [] { return done == N; });
+    }
+
+    for (int i = 0; i < N; i++) {
+        Request &r = requests[i];
+        if (r.result != 0) {
+            printf("Call %d returned %d\n", i, r.result);
+            return -1;
+        }
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                float correct = (float)(x + y * W + i) * 2.0f + i;
+                if (r.output(x, y) != correct) {
+                    printf("Call %d: output(%d, %d) = %f instead of %f\n",
+                           i, x, y, r.output(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
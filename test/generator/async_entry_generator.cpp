@@ -0,0 +1,20 @@
+#include "Halide.h"
+
+namespace {
+
+class AsyncEntry : public Halide::Generator<AsyncEntry> {
+public:
+    Input<Buffer<float>> input{"input", 2};
+    Input<float> offset{"offset"};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        Var x, y;
+        output(x, y) = input(x, y) * 2.0f + offset;
+        output.parallel(y).vectorize(x, natural_vector_size<float>());
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(AsyncEntry, async_entry)
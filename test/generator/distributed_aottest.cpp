@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "distributed.h"
+
+using namespace Halide::Runtime;
+
+// Run each rank on its own thread, and pass the messages between them
+// through in-process mailboxes. The user context of each call is the
+// rank making it.
+const int num_ranks = 3;
+const int rows_per_rank = 8;
+const int width = 16;
+
+std::mutex mutex;
+std::condition_variable cond;
+std::deque<std::vector<char>> mailbox[num_ranks][num_ranks];
+
+int get_rank(void *user_context) {
+    return *(int *)user_context;
+}
+
+int get_num_ranks(void *user_context) {
+    return num_ranks;
+}
+
+int send(void *user_context, int dst_rank, const void *data, size_t size) {
+    const char *bytes = (const char *)data;
+    std::lock_guard<std::mutex> lock(mutex);
+    mailbox[get_rank(user_context)][dst_rank].emplace_back(bytes, bytes + size);
+    cond.notify_all();
+    return 0;
+}
+
+int recv(void *user_context, int src_rank, void *data, size_t size) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto &box = mailbox[src_rank][get_rank(user_context)];
+    cond.wait(lock, [&]() { return !box.empty(); });
+    if (box.front().size() != size) {
+        return -1;
+    }
+    memcpy(data, box.front().data(), size);
+    box.pop_front();
+    return 0;
+}
+
+float input_value(int x, int y) {
+    return (float)(x * 3 + y * 5 % 7);
+}
+
+int main(int argc, char **argv) {
+    halide_distributed_transport_t transport = {get_rank, get_num_ranks, send, recv};
+    halide_set_distributed_transport(&transport);
+
+    int ranks[num_ranks];
+    int results[num_ranks];
+    std::vector<Buffer<float>> outputs;
+    std::vector<std::thread> threads;
+    for (int r = 0; r < num_ranks; r++) {
+        ranks[r] = r;
+        // This rank's rows of the output.
+        Buffer<float> output(width, rows_per_rank);
+        output.set_min(0, r * rows_per_rank);
+        outputs.push_back(output);
+    }
+
+    for (int r = 0; r < num_ranks; r++) {
+        threads.emplace_back([&, r]() {
+            Buffer<float> &output = outputs[r];
+            // The input covers the rows this rank requires, but only
+            // the rows it owns are filled in. The rest, including the
+            // rows outside of the image at the top and bottom, are
+            // received from the other ranks, or stay zero.
+            Buffer<float> input(width + 2, rows_per_rank + 2);
+            input.set_min(-1, output.dim(1).min() - 1);
+            input.fill(0.0f);
+            for (int y = output.dim(1).min(); y <= output.dim(1).max(); y++) {
+                for (int x = input.dim(0).min(); x <= input.dim(0).max(); x++) {
+                    input(x, y) = input_value(x, y);
+                }
+            }
+            results[r] = distributed(&ranks[r], input, output);
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    const int height = num_ranks * rows_per_rank;
+    for (int r = 0; r < num_ranks; r++) {
+        if (results[r] != 0) {
+            printf("Rank %d failed with %d\n", r, results[r]);
+            return -1;
+        }
+        const Buffer<float> &output = outputs[r];
+        for (int y = output.dim(1).min(); y <= output.dim(1).max(); y++) {
+            for (int x = 0; x < width; x++) {
+                float correct = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        if (y + dy >= 0 && y + dy < height) {
+                            correct += input_value(x + dx, y + dy);
+                        }
+                    }
+                }
+                if (output(x, y) != correct) {
+                    printf("output(%d, %d) = %f instead of %f\n", x, y, output(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
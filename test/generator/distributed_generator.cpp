@@ -0,0 +1,26 @@
+#include "Halide.h"
+
+namespace {
+
+class Distributed : public Halide::Generator<Distributed> {
+public:
+    Input<Buffer<float>>  input{"input", 2};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        Var x, y;
+
+        Func blur_y;
+        blur_y(x, y) = input(x, y - 1) + input(x, y) + input(x, y + 1);
+
+        output(x, y) = blur_y(x - 1, y) + blur_y(x, y) + blur_y(x + 1, y);
+
+        // Each rank computes its own rows of the output, and receives
+        // the rows of the input above and below them from its neighbors.
+        output.distribute(y);
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(Distributed, distributed)
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "memoize_backing_store.h"
+
+using namespace Halide::Runtime;
+
+const int W = 256;
+const char *path = "memoize_backing_store.cache";
+
+bool check(const Buffer<float> &out, float value, float scale) {
+    for (int x = 0; x < W; x++) {
+        float correct = (value + x) * scale + 1.0f;
+        if (out(x) != correct) {
+            printf("out(%d) = %f instead of %f\n", x, out(x), correct);
+            return false;
+        }
+    }
+    return true;
+}
+
+Buffer<float> run(float value, float scale) {
+    Buffer<float> input(W), out(W);
+    input.for_each_element([&](int x) { input(x) = value + x; });
+    int result = memoize_backing_store(input, scale, out);
+    if (result != 0) {
+        printf("memoize_backing_store failed: %d\n", result);
+        exit(-1);
+    }
+    return out;
+}
+
+int main(int argc, char **argv) {
+    unlink(path);
+    if (halide_memoization_cache_set_backing_store(NULL, path, 1 << 20, 16) != 0) {
+        printf("Skipping test: no memoization cache backing store on this platform\n");
+        return 0;
+    }
+
+    // Compute the table, which is also written to the file.
+    if (!check(run(1.0f, 2.0f), 1.0f, 2.0f)) {
+        return -1;
+    }
+
+    // As if in a new process: the cache of this one is gone, but the
+    // table is read back from the file, even though the input has
+    // changed since.
+    halide_memoization_cache_cleanup(NULL);
+    if (halide_memoization_cache_set_backing_store(NULL, path, 1 << 20, 16) != 0) {
+        printf("Could not reopen %s\n", path);
+        return -1;
+    }
+    if (!check(run(5.0f, 2.0f), 1.0f, 2.0f)) {
+        return -1;
+    }
+
+    // A different key misses.
+    if (!check(run(5.0f, 3.0f), 5.0f, 3.0f)) {
+        return -1;
+    }
+
+    // Without the file, the table is recomputed.
+    halide_memoization_cache_cleanup(NULL);
+    if (!check(run(7.0f, 2.0f), 7.0f, 2.0f)) {
+        return -1;
+    }
+
+    // A corrupted file is a miss rather than a stale result.
+    FILE *f = fopen(path, "r+b");
+    if (f == NULL) {
+        printf("Could not open %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    // Flip a byte of every 256, past the header of the file.
+    for (long offset = 256; offset < size; offset += 256) {
+        fseek(f, offset, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, offset, SEEK_SET);
+        fputc(c ^ 0xff, f);
+    }
+    fclose(f);
+    halide_memoization_cache_cleanup(NULL);
+    if (halide_memoization_cache_set_backing_store(NULL, path, 1 << 20, 16) != 0) {
+        printf("Could not reopen %s\n", path);
+        return -1;
+    }
+    if (!check(run(9.0f, 2.0f), 9.0f, 2.0f)) {
+        return -1;
+    }
+
+    halide_memoization_cache_cleanup(NULL);
+    unlink(path);
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,29 @@
+#include "Halide.h"
+
+namespace {
+
+class MemoizeBackingStore : public Halide::Generator<MemoizeBackingStore> {
+public:
+    Input<Buffer<float>> input{"input", 1};
+    Input<float> scale{"scale"};
+    Output<Buffer<float>> output{"output", 1};
+
+    void generate() {
+        Var x;
+        // The key of table is scale alone, so a stale result shows
+        // when the input changes.
+        table(x) = input(x) * scale;
+        output(x) = table(x) + 1.0f;
+    }
+
+    void schedule() {
+        table.compute_root().memoize();
+    }
+
+private:
+    Func table{"table"};
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(MemoizeBackingStore, memoize_backing_store)
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "pool_allocator.h"
+
+using namespace Halide::Runtime;
+
+// The pool allocator keeps up to this many freed blocks of each size.
+const int kMaxCachedBlocks = 16;
+
+bool run(int width) {
+    Buffer<float> input(width + 1), out(width);
+    input.for_each_element([&](int x) { input(x) = (float)(x % 7); });
+    int result = pool_allocator(input, out);
+    if (result != 0) {
+        printf("pool_allocator failed: %d\n", result);
+        return false;
+    }
+    for (int x = 0; x < width; x++) {
+        float correct = 2.0f * (input(x) + input(x + 1));
+        if (out(x) != correct) {
+            printf("out(%d) = %f instead of %f\n", x, out(x), correct);
+            return false;
+        }
+    }
+    return true;
+}
+
+halide_pool_allocator_stats stats() {
+    halide_pool_allocator_stats s;
+    halide_pool_allocator_get_stats(NULL, &s);
+    return s;
+}
+
+int main(int argc, char **argv) {
+    halide_set_custom_malloc(halide_pool_malloc);
+    halide_set_custom_free(halide_pool_free);
+
+    // The first call allocates tmp from the system, and the second
+    // reuses the block the first one freed.
+    halide_pool_allocator_stats before = stats();
+    if (!run(1000)) {
+        return -1;
+    }
+    halide_pool_allocator_stats first = stats();
+    if (first.num_misses <= before.num_misses || first.bytes_cached <= before.bytes_cached) {
+        printf("The first call didn't allocate and cache tmp\n");
+        return -1;
+    }
+    if (!run(1000)) {
+        return -1;
+    }
+    halide_pool_allocator_stats second = stats();
+    if (second.num_hits <= first.num_hits || second.num_misses != first.num_misses) {
+        printf("The second call didn't reuse tmp\n");
+        return -1;
+    }
+
+    // Allocations beyond the largest size class bypass the pool.
+    if (!run(5 << 20)) {
+        return -1;
+    }
+    halide_pool_allocator_stats large = stats();
+    if (large.num_unpooled <= second.num_unpooled || large.bytes_cached != second.bytes_cached) {
+        printf("The allocation of 20 MB was pooled\n");
+        return -1;
+    }
+
+    // More blocks than the pool keeps: the ones beyond it go back to
+    // the system when freed, and are allocated anew afterwards.
+    const int n = kMaxCachedBlocks + 4;
+    void *blocks[n];
+    for (int i = 0; i < n; i++) {
+        blocks[i] = halide_pool_malloc(NULL, 1000);
+        if (blocks[i] == NULL) {
+            printf("halide_pool_malloc failed\n");
+            return -1;
+        }
+        // The blocks are usable and don't overlap.
+        for (int j = 0; j < 1000; j++) {
+            ((unsigned char *)blocks[i])[j] = (unsigned char)i;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < 1000; j++) {
+            if (((unsigned char *)blocks[i])[j] != (unsigned char)i) {
+                printf("Block %d was overwritten\n", i);
+                return -1;
+            }
+        }
+    }
+    halide_pool_allocator_stats allocated = stats();
+    for (int i = 0; i < n; i++) {
+        halide_pool_free(NULL, blocks[i]);
+    }
+    halide_pool_allocator_stats freed = stats();
+    if (freed.bytes_cached - allocated.bytes_cached != kMaxCachedBlocks * 1024) {
+        printf("Freeing %d blocks of 1 KB cached %llu bytes instead of %d\n", n,
+               (unsigned long long)(freed.bytes_cached - allocated.bytes_cached),
+               kMaxCachedBlocks * 1024);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        blocks[i] = halide_pool_malloc(NULL, 1000);
+    }
+    halide_pool_allocator_stats reused = stats();
+    if (reused.num_hits - freed.num_hits != (uint64_t)kMaxCachedBlocks ||
+        reused.num_misses - freed.num_misses != (uint64_t)(n - kMaxCachedBlocks)) {
+        printf("Allocating %d blocks again had %llu hits and %llu misses instead of %d and %d\n", n,
+               (unsigned long long)(reused.num_hits - freed.num_hits),
+               (unsigned long long)(reused.num_misses - freed.num_misses),
+               kMaxCachedBlocks, n - kMaxCachedBlocks);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        halide_pool_free(NULL, blocks[i]);
+    }
+
+    // Trimming the pool, as is done at exit, frees all the blocks it
+    // holds, after which allocations miss again.
+    halide_pool_allocator_trim(NULL);
+    halide_pool_allocator_stats trimmed = stats();
+    if (trimmed.bytes_cached != 0) {
+        printf("%llu bytes are still cached after trimming the pool\n",
+               (unsigned long long)trimmed.bytes_cached);
+        return -1;
+    }
+    void *block = halide_pool_malloc(NULL, 1000);
+    if (stats().num_misses != trimmed.num_misses + 1) {
+        printf("An allocation after trimming the pool didn't miss\n");
+        return -1;
+    }
+    halide_pool_free(NULL, block);
+    halide_pool_allocator_trim(NULL);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include "Halide.h"
+
+namespace {
+
+class PoolAllocator : public Halide::Generator<PoolAllocator> {
+public:
+    Input<Buffer<float>> input{"input", 1};
+    Output<Buffer<float>> output{"output", 1};
+
+    void generate() {
+        Var x;
+        // The size of tmp is only known at runtime, so it is allocated
+        // on the heap with halide_malloc on every call.
+        tmp(x) = input(x) * 2.0f;
+        output(x) = tmp(x) + tmp(x + 1);
+    }
+
+    void schedule() {
+        tmp.compute_root();
+    }
+
+private:
+    Func tmp{"tmp"};
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(PoolAllocator, pool_allocator)
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "profiler_metrics.h"
+
+using namespace Halide::Runtime;
+
+const int width = 256, height = 64, runs = 50;
+
+int main(int argc, char **argv) {
+    Buffer<float> input(width, height), output(width, height);
+    input.fill(1.0f);
+
+    for (int i = 0; i < runs; i++) {
+        if (profiler_metrics(input, output) != 0) {
+            printf("Pipeline failed\n");
+            return -1;
+        }
+    }
+
+    // The name doesn't need to be the pipeline's own copy of the string.
+    char name[] = "profiler_metrics";
+    halide_profiler_pipeline_stats *p = halide_profiler_get_pipeline_state(name);
+    if (!p) {
+        printf("No pipeline state for %s\n", name);
+        return -1;
+    }
+
+    if (p->latency.count != runs || p->memory.count != runs) {
+        printf("Recorded %d latencies and %d peak heap sizes instead of %d\n",
+               (int)p->latency.count, (int)p->memory.count, runs);
+        return -1;
+    }
+
+    uint64_t p50 = halide_profiler_histogram_percentile(&p->latency, 50);
+    uint64_t p99 = halide_profiler_histogram_percentile(&p->latency, 99);
+    printf("latency p50: %llu ns p99: %llu ns\n", (unsigned long long)p50, (unsigned long long)p99);
+    if (p50 == 0 || p50 > p99 || p99 > p->latency.max) {
+        printf("Bad latency percentiles\n");
+        return -1;
+    }
+
+    // blur_x is allocated on the heap, with a row of padding on either side.
+    const uint64_t blur_x_size = width * (height + 2) * sizeof(float);
+    uint64_t memory_p50 = halide_profiler_histogram_percentile(&p->memory, 50);
+    if (p->memory.max < blur_x_size || memory_p50 > p->memory.max ||
+        memory_p50 < blur_x_size * 3 / 4) {
+        printf("Bad peak heap usage: p50 %llu max %llu, expected about %llu\n",
+               (unsigned long long)memory_p50, (unsigned long long)p->memory.max,
+               (unsigned long long)blur_x_size);
+        return -1;
+    }
+
+    for (int i = 0; i < p->num_funcs; i++) {
+        halide_profiler_func_stats *fs = p->funcs + i;
+        uint64_t expected = 0;
+        if (strcmp(fs->name, "blur_x") == 0) {
+            expected = runs;
+        } else if (strcmp(fs->name, "blur_y") == 0) {
+            expected = runs * height;
+        } else {
+            continue;
+        }
+        if (fs->latency.count != expected) {
+            printf("%s was timed %d times instead of %d\n",
+                   fs->name, (int)fs->latency.count, (int)expected);
+            return -1;
+        }
+    }
+
+    halide_profiler_reset_metrics();
+    if (p->latency.count != 0) {
+        printf("halide_profiler_reset_metrics didn't clear the histograms\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
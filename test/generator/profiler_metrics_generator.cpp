@@ -0,0 +1,30 @@
+#include "Halide.h"
+
+namespace {
+
+class ProfilerMetrics : public Halide::Generator<ProfilerMetrics> {
+public:
+    Input<Buffer<float>> input{"input", 2};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        assert(get_target().has_feature(Target::ProfileMetrics));
+
+        Var x, y;
+
+        Func blur_x("blur_x"), blur_y("blur_y");
+        Func clamped = BoundaryConditions::repeat_edge(input);
+        blur_x(x, y) = (clamped(x - 1, y) + clamped(x, y) + clamped(x + 1, y)) / 3;
+        blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+        output(x, y) = blur_y(x, y);
+
+        // blur_x is on the heap, and realized once per run; blur_y is
+        // realized once per scanline of the output.
+        blur_x.compute_root();
+        blur_y.compute_at(output, y);
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(ProfilerMetrics, profiler_metrics)
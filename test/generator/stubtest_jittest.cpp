@@ -89,6 +89,20 @@ int main(int argc, char **argv) {
     verify(array_input[0], 1.25f, 0, f0);
     verify(array_input[0], 1.25f, 33, f1);
 
+    // The Funcs inside the Generator can be scheduled by the caller,
+    // across the boundary of the Generator.
+    if (!gen.funcs.count("intermediate")) {
+        fprintf(stderr, "intermediate not found in the Funcs of the stub\n");
+        exit(-1);
+    }
+    Func intermediate = gen.funcs.at("intermediate");
+    intermediate.compute_at(gen.tuple_output, gen.tuple_output.args().at(0));
+    tuple_output_realized = gen.tuple_output.realize(kSize, kSize, 3);
+    f0 = tuple_output_realized[0];
+    f1 = tuple_output_realized[1];
+    verify(array_input[0], 1.25f, 0, f0);
+    verify(array_input[0], 1.25f, 33, f1);
+
     for (int i = 0; i < kArrayCount; ++i) {
         Realization array_output_realized = gen.array_output[i].realize(kSize, kSize, gen.target);
         Buffer<int16_t> g0 = array_output_realized;
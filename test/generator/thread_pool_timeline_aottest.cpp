@@ -0,0 +1,101 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "thread_pool_timeline.h"
+
+using namespace Halide::Runtime;
+
+const int W = 64, H = 64;
+
+int count(const std::string &s, const std::string &pattern) {
+    int result = 0;
+    for (size_t i = s.find(pattern); i != std::string::npos; i = s.find(pattern, i + 1)) {
+        result++;
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    halide_set_num_threads(4);
+
+    Buffer<float> input(W + 2, H);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = (float)(x + y);
+    });
+    Buffer<float> output(W, H);
+
+    if (halide_thread_pool_timeline_start(nullptr, 1024) != 0) {
+        printf("halide_thread_pool_timeline_start failed\n");
+        return -1;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (thread_pool_timeline(input, output) != 0) {
+            printf("thread_pool_timeline failed\n");
+            return -1;
+        }
+    }
+    halide_thread_pool_timeline_stop();
+
+    const char *filename = "thread_pool_timeline.json";
+    if (halide_thread_pool_timeline_save(nullptr, filename) != 0) {
+        printf("halide_thread_pool_timeline_save failed\n");
+        return -1;
+    }
+
+    std::ifstream file(filename);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string trace = contents.str();
+    if (trace.compare(0, 15, "{\"traceEvents\":") != 0 ||
+        trace.find("]}") == std::string::npos) {
+        printf("Not a trace event file:\n%s\n", trace.c_str());
+        return -1;
+    }
+
+    // Every row of both Funcs ran as a task, named after its Func.
+    int tasks = count(trace, "\"cat\":\"task\"");
+    if (tasks != 3 * 2 * H) {
+        printf("%d tasks recorded instead of %d\n", tasks, 3 * 2 * H);
+        return -1;
+    }
+    int blurred_tasks = count(trace, "\"name\":\"blurred\"");
+    if (blurred_tasks != 3 * H) {
+        printf("%d tasks of blurred recorded instead of %d\n", blurred_tasks, 3 * H);
+        return -1;
+    }
+
+    // Nothing is recorded once stopped.
+    if (thread_pool_timeline(input, output) != 0) {
+        printf("thread_pool_timeline failed\n");
+        return -1;
+    }
+    if (halide_thread_pool_timeline_save(nullptr, filename) != 0) {
+        printf("halide_thread_pool_timeline_save failed\n");
+        return -1;
+    }
+    std::ifstream file2(filename);
+    std::stringstream contents2;
+    contents2 << file2.rdbuf();
+    if (count(contents2.str(), "\"cat\":\"task\"") != tasks) {
+        printf("Tasks were recorded after halide_thread_pool_timeline_stop\n");
+        return -1;
+    }
+
+    output.for_each_element([&](int x, int y) {
+        float correct = (input(x, y) + input(x + 1, y) + input(x + 2, y)) / 3.0f * 2.0f;
+        if (fabs(output(x, y) - correct) > 1e-4f * correct) {
+            printf("output(%d, %d) = %f instead of %f\n", x, y, output(x, y), correct);
+            exit(-1);
+        }
+    });
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "Halide.h"
+
+namespace {
+
+class ThreadPoolTimeline : public Halide::Generator<ThreadPoolTimeline> {
+public:
+    Input<Buffer<float>> input{"input", 2};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        assert(get_target().has_feature(Target::Profile));
+        Var x, y;
+        Func blurred("blurred");
+        blurred(x, y) = (input(x, y) + input(x + 1, y) + input(x + 2, y)) / 3.0f;
+        output(x, y) = blurred(x, y) * 2.0f;
+        blurred.compute_root().parallel(y);
+        output.parallel(y);
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(ThreadPoolTimeline, thread_pool_timeline)
@@ -0,0 +1,273 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Track the Halide heap usage of a pipeline. Each allocation is
+// prefixed with its size, so that frees can be accounted for.
+std::mutex memory_mutex;
+size_t memory_in_use = 0;
+size_t memory_peak = 0;
+
+void *tracking_malloc(void *user_context, size_t x) {
+    const size_t header = 64;
+    char *orig = (char *)malloc(x + header);
+    if (!orig) {
+        return nullptr;
+    }
+    *(size_t *)orig = x;
+    std::lock_guard<std::mutex> lock(memory_mutex);
+    memory_in_use += x;
+    memory_peak = std::max(memory_peak, memory_in_use);
+    return orig + header;
+}
+
+void tracking_free(void *user_context, void *ptr) {
+    const size_t header = 64;
+    char *orig = (char *)ptr - header;
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex);
+        memory_in_use -= *(size_t *)orig;
+    }
+    free(orig);
+}
+
+size_t measure_peak(std::function<void()> op) {
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex);
+        memory_in_use = 0;
+        memory_peak = 0;
+    }
+    op();
+    std::lock_guard<std::mutex> lock(memory_mutex);
+    return memory_peak;
+}
+
+Buffer<float> random_buffer(const std::string &name, const std::vector<int> &extents) {
+    Buffer<float> b(extents, name);
+    b.for_each_value([](float &v) { v = (rand() % 1024) / 1024.0f; });
+    return b;
+}
+
+Var x("x"), y("y"), z("z"), c("c");
+
+Func conv_layer(const std::vector<Buffer<float>> &in) {
+    const Buffer<float> &input = in[0], &weights = in[1];
+    RDom r(0, weights.dim(0).extent(), 0, weights.dim(1).extent(), 0, weights.dim(2).extent());
+    Func f("conv");
+    f(x, y, z) = 0.f;
+    f(x, y, z) += weights(r.x, r.y, r.z, z) * input(x + r.x, y + r.y, r.z);
+    Func relu("relu");
+    relu(x, y, z) = max(f(x, y, z), 0.f);
+    return relu;
+}
+
+Func bilateral_grid(const std::vector<Buffer<float>> &in) {
+    const Buffer<float> &input = in[0];
+    const int s_sigma = 8;
+    const float r_sigma = 0.1f;
+
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    RDom r(0, s_sigma, 0, s_sigma);
+    Expr val = clamp(clamped(x * s_sigma + r.x - s_sigma / 2, y * s_sigma + r.y - s_sigma / 2), 0.f, 1.f);
+    Expr zi = cast<int>(val * (1.0f / r_sigma) + 0.5f);
+    Func histogram("histogram");
+    histogram(x, y, z, c) = 0.f;
+    histogram(x, y, zi, c) += select(c == 0, val, 1.0f);
+
+    Func blurz("blurz"), blurx("blurx"), blury("blury");
+    blurz(x, y, z, c) = (histogram(x, y, z - 2, c) + histogram(x, y, z - 1, c) * 4 + histogram(x, y, z, c) * 6 +
+                         histogram(x, y, z + 1, c) * 4 + histogram(x, y, z + 2, c));
+    blurx(x, y, z, c) = (blurz(x - 2, y, z, c) + blurz(x - 1, y, z, c) * 4 + blurz(x, y, z, c) * 6 +
+                         blurz(x + 1, y, z, c) * 4 + blurz(x + 2, y, z, c));
+    blury(x, y, z, c) = (blurx(x, y - 2, z, c) + blurx(x, y - 1, z, c) * 4 + blurx(x, y, z, c) * 6 +
+                         blurx(x, y + 1, z, c) * 4 + blurx(x, y + 2, z, c));
+
+    val = clamp(input(x, y), 0.f, 1.f);
+    Expr zv = val * (1.0f / r_sigma);
+    zi = cast<int>(floor(zv));
+    Expr zf = zv - zi;
+    Expr xf = cast<float>(x % s_sigma) / s_sigma;
+    Expr yf = cast<float>(y % s_sigma) / s_sigma;
+    Expr xi = x / s_sigma;
+    Expr yi = y / s_sigma;
+    Func interpolated("interpolated");
+    interpolated(x, y, c) =
+        lerp(lerp(lerp(blury(xi, yi, zi, c), blury(xi + 1, yi, zi, c), xf),
+                  lerp(blury(xi, yi + 1, zi, c), blury(xi + 1, yi + 1, zi, c), xf), yf),
+             lerp(lerp(blury(xi, yi, zi + 1, c), blury(xi + 1, yi, zi + 1, c), xf),
+                  lerp(blury(xi, yi + 1, zi + 1, c), blury(xi + 1, yi + 1, zi + 1, c), xf), yf), zf);
+
+    Func f("bilateral_grid");
+    f(x, y) = interpolated(x, y, 0) / interpolated(x, y, 1);
+    return f;
+}
+
+// A defocus blur whose circle of confusion grows with the distance of
+// the depth from the focal plane.
+Func lens_blur(const std::vector<Buffer<float>> &in) {
+    const Buffer<float> &input = in[0], &depth = in[1];
+    const int radius = 4;
+
+    Func clamped_input = BoundaryConditions::repeat_edge(input);
+    Func clamped_depth = BoundaryConditions::repeat_edge(depth);
+    Func coc("coc");
+    coc(x, y) = abs(clamped_depth(x, y) - 0.5f) * (2 * radius);
+
+    RDom r(-radius, 2 * radius + 1, -radius, 2 * radius + 1);
+    Expr dist = sqrt(cast<float>(r.x * r.x + r.y * r.y));
+    Expr weight = clamp(coc(x + r.x, y + r.y) - dist + 1.f, 0.f, 1.f);
+    Func blurred("blurred");
+    blurred(x, y, c) = 0.f;
+    blurred(x, y, c) += select(c == 0, weight * clamped_input(x + r.x, y + r.y), weight);
+
+    Func f("lens_blur");
+    f(x, y) = blurred(x, y, 0) / (blurred(x, y, 1) + 1e-3f);
+    return f;
+}
+
+Func softmax(const std::vector<Buffer<float>> &in) {
+    const Buffer<float> &input = in[0];
+    RDom r(0, input.dim(0).extent());
+    Func m("m");
+    m(y) = maximum(input(r, y));
+    Func e("e");
+    e(x, y) = exp(input(x, y) - m(y));
+    Func s("s");
+    s(y) = sum(e(r, y));
+    Func f("softmax");
+    f(x, y) = e(x, y) / s(y);
+    return f;
+}
+
+struct Case {
+    const char *name;
+    std::function<Func(const std::vector<Buffer<float>> &)> build;
+    std::vector<Buffer<float>> inputs;
+    std::vector<int> output_extents;
+    // The baseline: the largest acceptable ratio of the backward time to
+    // the forward time, and the largest acceptable backward peak heap
+    // usage, in multiples of the bytes of the inputs and the output.
+    double max_time_ratio;
+    double max_memory_ratio;
+};
+
+std::vector<std::pair<int, int>> bounds_of(const std::vector<int> &extents) {
+    std::vector<std::pair<int, int>> bounds;
+    for (int e : extents) {
+        bounds.push_back({0, e - 1});
+    }
+    return bounds;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_feature(Target::Debug)) {
+        printf("Skipping test because runtime debug is active\n");
+        return 0;
+    }
+
+    SimpleAutoscheduleOptions options;
+    options.target = target;
+    options.gpu = target.has_gpu_feature();
+
+    std::vector<Case> cases = {
+        {"conv", conv_layer,
+         {random_buffer("conv_input", {130, 130, 16}), random_buffer("conv_weights", {3, 3, 16, 16})},
+         {128, 128, 16}, 6.0, 8.0},
+        {"bilateral_grid", bilateral_grid,
+         {random_buffer("bilateral_grid_input", {1024, 1024})},
+         {1024, 1024}, 12.0, 8.0},
+        {"lens_blur", lens_blur,
+         {random_buffer("lens_blur_input", {512, 512}), random_buffer("lens_blur_depth", {512, 512})},
+         {512, 512}, 8.0, 8.0},
+        {"softmax", softmax,
+         {random_buffer("softmax_input", {1000, 256})},
+         {1000, 256}, 6.0, 8.0},
+    };
+
+    bool regressed = false;
+    for (Case &k : cases) {
+        size_t io_bytes = 0;
+        for (const Buffer<float> &b : k.inputs) {
+            io_bytes += b.size_in_bytes();
+        }
+        Buffer<float> output(k.output_extents);
+        io_bytes += output.size_in_bytes();
+
+        // The forward pipeline is built twice, so that scheduling it
+        // doesn't change the forward Funcs the adjoints read.
+        Func forward = k.build(k.inputs);
+        simple_autoschedule(forward, {}, bounds_of(k.output_extents), options);
+        Pipeline forward_pipeline(forward);
+        forward_pipeline.set_custom_allocator(tracking_malloc, tracking_free);
+        forward_pipeline.compile_jit(target);
+        auto run_forward = [&]() {
+            forward_pipeline.realize(output, target);
+            output.device_sync();
+        };
+
+        Buffer<float> adjoint = random_buffer(std::string(k.name) + "_adjoint", k.output_extents);
+        Derivative d = propagate_adjoints(k.build(k.inputs), adjoint);
+        std::vector<Func> gradients;
+        std::vector<std::vector<std::pair<int, int>>> gradient_bounds;
+        std::vector<Buffer<>> gradient_buffers;
+        for (const Buffer<float> &b : k.inputs) {
+            gradients.push_back(d(b));
+            std::vector<int> extents;
+            for (int i = 0; i < b.dimensions(); i++) {
+                extents.push_back(b.dim(i).extent());
+            }
+            gradient_bounds.push_back(bounds_of(extents));
+            gradient_buffers.push_back(Buffer<float>(extents));
+        }
+        simple_autoschedule(gradients, {}, gradient_bounds, options);
+        Pipeline backward_pipeline(gradients);
+        backward_pipeline.set_custom_allocator(tracking_malloc, tracking_free);
+        backward_pipeline.compile_jit(target);
+        Realization gradient_realization(gradient_buffers);
+        auto run_backward = [&]() {
+            backward_pipeline.realize(gradient_realization, target);
+            for (Buffer<> &b : gradient_buffers) {
+                b.device_sync();
+            }
+        };
+
+        // Device allocations don't go through the custom allocator, so on
+        // GPU this only measures the host heap.
+        size_t forward_memory = measure_peak(run_forward);
+        size_t backward_memory = measure_peak(run_backward);
+        double forward_time = benchmark(run_forward);
+        double backward_time = benchmark(run_backward);
+
+        double time_ratio = backward_time / forward_time;
+        double memory_ratio = (double)backward_memory / io_bytes;
+        printf("%s: forward %f ms, backward %f ms (ratio %.2f, baseline %.2f), "
+               "peak memory forward %zu bytes, backward %zu bytes (%.2fx inputs and output, baseline %.2fx)\n",
+               k.name, forward_time * 1e3, backward_time * 1e3, time_ratio, k.max_time_ratio,
+               forward_memory, backward_memory, memory_ratio, k.max_memory_ratio);
+
+        if (time_ratio > k.max_time_ratio) {
+            printf("The backward pipeline of %s is too slow compared to its forward pipeline\n", k.name);
+            regressed = true;
+        }
+        if (memory_ratio > k.max_memory_ratio) {
+            printf("The backward pipeline of %s uses too much memory\n", k.name);
+            regressed = true;
+        }
+    }
+
+    if (regressed) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
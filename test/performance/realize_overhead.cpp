@@ -129,6 +129,53 @@ int main(int argc, char **argv) {
         std::cout << "One argument Pipeline realize reusing Realization/Target/ParamMap time " << t * 1e6 << "us.\n";
     }
 
+    {
+        Func f;
+        f() = 42;
+
+        Pipeline p(f);
+        p.compile_jit();
+
+        const int batch = 64;
+        std::vector<Realization> outputs;
+        for (int i = 0; i < batch; i++) {
+            auto buf = Buffer<int32_t>::make_scalar();
+            outputs.push_back(Realization(buf));
+        }
+        Target target;
+        ParamMap pm;
+        double t_loop = benchmark([&]() {
+            for (Realization &r : outputs) {
+                p.realize(r, target, pm);
+            }
+        });
+        std::cout << "No argument Pipeline realize in a loop over a batch of " << batch
+                  << " time per invocation " << t_loop * 1e6 / batch << "us.\n";
+
+        double t_batch = benchmark([&]() { p.realize_batch(outputs, {}, target); });
+        std::cout << "No argument Pipeline realize_batch over a batch of " << batch
+                  << " time per invocation " << t_batch * 1e6 / batch << "us.\n";
+    }
+
+    {
+        Func f;
+        Param<int> in;
+
+        f() = in + 42;
+
+        in.set(0);
+
+        Pipeline p(f);
+        auto buf = Buffer<int32_t>::make_scalar();
+        Pipeline::PreparedCall call = p.prepare_call(buf, Target("host-no_asserts-no_bounds_query"));
+        double t = benchmark([&]() { call.realize(); });
+        std::cout << "One argument PreparedCall realize with no_asserts and no_bounds_query time " << t * 1e6 << "us.\n";
+
+        int i = 0;
+        t = benchmark([&]() { call.set(in, i++); call.realize(); });
+        std::cout << "One argument PreparedCall set and realize with no_asserts and no_bounds_query time " << t * 1e6 << "us.\n";
+    }
+
     for (int i = 10; i < 100; i += 10) {
         Func f;
         std::vector<Param<int>> params(i);
@@ -13,6 +13,9 @@ const char *string_of_type();
     const char *string_of_type<name>() {return #name;}
 
 DECL_SOT(float);
+DECL_SOT(double);
+DECL_SOT(uint8_t);
+DECL_SOT(uint16_t);
 
 template<typename A>
 bool test(int vec_width) {
@@ -84,10 +87,22 @@ bool test(int vec_width) {
 
 int main(int argc, char **argv) {
     // As for now, we would only vectorize predicated store/load on Hexagon or
-    // if it is of type 32-bit value and has lanes no less than 4 on x86
+    // x86. On x86, 32-bit values with lanes no less than 4 are always
+    // predicated, 64-bit values need AVX, and 8 and 16-bit values need
+    // AVX512BW.
     test<float>(4);
     test<float>(8);
 
+    Target t = get_jit_target_from_environment();
+    if (t.arch == Target::X86 && t.has_feature(Target::AVX)) {
+        test<double>(4);
+    }
+    if (t.arch == Target::X86 &&
+        t.features_any_of({Target::AVX512_Skylake, Target::AVX512_Cannonlake})) {
+        test<uint8_t>(32);
+        test<uint16_t>(16);
+    }
+
     printf("Success!\n");
     return 0;
 }
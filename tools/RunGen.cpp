@@ -3,8 +3,10 @@
 #include "halide_benchmark.h"
 #include "halide_image_io.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -48,6 +50,9 @@ std::ostream &operator<<(std::ostream &stream, const halide_type_t &type) {
         case halide_type_handle:
             stream << "handle";
             break;
+        case halide_type_bfloat:
+            stream << "bfloat";
+            break;
         default:
             stream << "#unknown";
             break;
@@ -280,6 +285,11 @@ std::string replace_all(const std::string &str,
     return result;
 }
 
+bool ends_with(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() &&
+           str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
 // Must be constexpr to allow use in case clauses.
 inline constexpr int halide_type_code(halide_type_code_t code, int bits) {
     return (((int) code) << 8) | bits;
@@ -813,6 +823,31 @@ Flags:
         allocation during run; note that this may slow down execution, so
         benchmarks may be inaccurate if you combine --benchmark with this.
 
+    --num_threads=NUM:
+        Set the number of threads in Halide's thread pool (as with
+        halide_set_num_threads()); zero means the default.
+
+    --sweep[=FILE]:
+        Benchmark the filter over a grid of argument values, and write the
+        results as JSON (if FILE ends in .json) or CSV (otherwise, or to stdout
+        if FILE is omitted). Any input argument, and --num_threads, may list
+        several values separated by '|'; every combination is run:
+
+        --sweep=out.json input=zero:[640,480]|zero:[1920,1080] \
+            radius=1|3|5 --num_threads=1|4
+
+        Each row reports the swept values, the best and median time per
+        iteration, and the throughput in mpix/sec (as for --benchmarks) and in
+        bytes/sec (counting each input and output buffer once). With
+        --track_memory, the row also has the Halide memory high-water mark,
+        measured on a separate run that isn't timed. Inputs are loaded once and
+        outputs are reused whenever their shape doesn't change; outputs are
+        never saved. The --benchmark_* flags apply to each point.
+
+    --sweep_samples=NUM [default = 10]:
+        The number of samples from which each point's median time is taken;
+        ignored if --sweep is not also specified.
+
 Known Issues:
 
     * Filters running on GPU (vs CPU) have not been tested.
@@ -868,6 +903,296 @@ FormatInfo best_save_format(const Buffer<> &b, const std::set<FormatInfo> &info)
     return best;
 }
 
+// Parse the scalar inputs and load the buffer inputs, then run a bounds query
+// to adapt the layout of the inputs and to allocate the outputs. If input_cache
+// is non-null, loaded inputs are kept there (keyed by name and value) and
+// outputs that already have the required shape are reused, so that a sweep
+// only pays for the allocations that actually change between points.
+void prepare_args(std::map<std::string, ArgData> &args,
+                  Shape default_output_shape,
+                  std::map<std::string, Buffer<>> *input_cache) {
+    // Parse all the input arguments, loading images as necessary.
+    // (Don't handle outputs yet.)
+    for (auto &arg_pair : args) {
+        auto &arg_name = arg_pair.first;
+        auto &arg = arg_pair.second;
+        switch (arg.metadata->kind) {
+        case halide_argument_kind_input_scalar: {
+            if (!parse_scalar(arg.metadata->type, arg.raw_string, &arg.scalar_value)) {
+                fail() << "Argument value for: " << arg_name << " could not be parsed as type "
+                     << arg.metadata->type << ": "
+                     << arg.raw_string;
+            }
+            break;
+        }
+        case halide_argument_kind_input_buffer: {
+            if (input_cache) {
+                const std::string key = arg_name + "=" + arg.raw_string;
+                auto it = input_cache->find(key);
+                if (it == input_cache->end()) {
+                    it = input_cache->emplace(key, load_input(arg.raw_string, *arg.metadata)).first;
+                }
+                arg.buffer_value = it->second;
+            } else {
+                arg.buffer_value = load_input(arg.raw_string, *arg.metadata);
+            }
+            info() << "Input " << arg_name << ": Shape is " << get_shape(arg.buffer_value);
+            // If there was no default_output_shape specified, use the shape of
+            // the first input buffer (if any).
+            // TODO: this is often a better-than-nothing guess, but not always. Add a way to defeat it?
+            if (default_output_shape.empty()) {
+                default_output_shape = get_shape(arg.buffer_value);
+            }
+            break;
+        }
+        case halide_argument_kind_output_buffer:
+            // Nothing yet
+            break;
+        }
+    }
+
+    // Run a bounds query: we need to figure out how to allocate the output buffers,
+    // and the input buffers might need reshaping to satisfy constraints (e.g. a chunky/interleaved layout).
+    std::vector<Shape> constrained_shapes = run_bounds_query(args, default_output_shape);
+
+    for (auto &arg_pair : args) {
+        auto &arg_name = arg_pair.first;
+        auto &arg = arg_pair.second;
+        const Shape &constrained_shape = constrained_shapes[arg.index];
+        switch (arg.metadata->kind) {
+            case halide_argument_kind_input_buffer: {
+                info() << "Input " << arg_name << ": Shape is " << get_shape(arg.buffer_value);
+                bool updated = adapt_input_buffer_layout(constrained_shape, &arg.buffer_value);
+                info() << "Input " << arg_name << ": BoundsQuery result is " << constrained_shape;
+                if (updated) {
+                    info() << "Input " << arg_name << ": Updated Shape is " << get_shape(arg.buffer_value);
+                }
+                break;
+            }
+            case halide_argument_kind_output_buffer: {
+                Shape shape = make_legal_output_buffer_shape(constrained_shape);
+                if (!input_cache || !arg.buffer_value.data() || get_shape(arg.buffer_value) != shape) {
+                    arg.buffer_value = allocate_buffer(arg.metadata->type, shape);
+                }
+                info() << "Output " << arg_name << ": BoundsQuery result is " << constrained_shape;
+                info() << "Output " << arg_name << ": Shape is " << get_shape(arg.buffer_value);
+                break;
+            }
+        }
+    }
+}
+
+std::vector<void*> make_filter_argv(std::map<std::string, ArgData> &args) {
+    std::vector<void*> filter_argv(args.size(), nullptr);
+    for (auto &arg_pair : args) {
+        auto &arg = arg_pair.second;
+        switch (arg.metadata->kind) {
+            case halide_argument_kind_input_scalar:
+                filter_argv[arg.index] = &arg.scalar_value;
+                break;
+            case halide_argument_kind_input_buffer:
+            case halide_argument_kind_output_buffer:
+                filter_argv[arg.index] = arg.buffer_value.raw_buffer();
+                break;
+        }
+    }
+    return filter_argv;
+}
+
+// Run the filter once, and wait for all of its outputs to be finished;
+// otherwise we may just be measuring how long it takes to do a kernel
+// launch for GPU code.
+void run_and_sync(std::vector<void*> &filter_argv, std::map<std::string, ArgData> &args) {
+    // Ignore result since our halide_error() should catch everything.
+    (void) halide_rungen_redirect_argv(&filter_argv[0]);
+    for (auto &arg_pair : args) {
+        auto &arg = arg_pair.second;
+        if (arg.metadata->kind == halide_argument_kind_output_buffer) {
+            Buffer<> &b = arg.buffer_value;
+            b.device_sync();
+        }
+    }
+}
+
+// The bytes read and written by one run of the filter, assuming each
+// input and output element is touched exactly once.
+uint64_t calc_bytes_moved(const std::map<std::string, ArgData> &args) {
+    uint64_t bytes = 0;
+    for (auto &arg_pair : args) {
+        auto &arg = arg_pair.second;
+        if (arg.metadata->kind != halide_argument_kind_input_scalar) {
+            bytes += arg.buffer_value.size_in_bytes();
+        }
+    }
+    return bytes;
+}
+
+// An argument (or the thread count) that takes several values in a sweep.
+struct SweepAxis {
+    std::string name;
+    std::vector<std::string> values;
+    bool is_num_threads;
+};
+
+struct SweepPoint {
+    std::vector<std::string> values;  // one per SweepAxis
+    double min_time{0};
+    double median_time{0};
+    uint64_t pixels_out{0};
+    uint64_t bytes_moved{0};
+    uint64_t peak_memory{0};
+};
+
+bool is_number(const std::string &s) {
+    if (s.empty()) {
+        return false;
+    }
+    char *end = nullptr;
+    (void) strtod(s.c_str(), &end);
+    return *end == '\0';
+}
+
+std::string csv_quote(const std::string &s) {
+    if (s.find_first_of(",\"\n") == std::string::npos) {
+        return s;
+    }
+    return "\"" + replace_all(s, "\"", "\"\"") + "\"";
+}
+
+std::string json_value(const std::string &s) {
+    if (is_number(s)) {
+        return s;
+    }
+    return "\"" + replace_all(replace_all(s, "\\", "\\\\"), "\"", "\\\"") + "\"";
+}
+
+void write_sweep_csv(std::ostream &o,
+                     const std::vector<SweepAxis> &axes,
+                     const std::vector<SweepPoint> &points,
+                     bool track_memory) {
+    for (auto &axis : axes) {
+        o << csv_quote(axis.name) << ",";
+    }
+    o << "min_sec,median_sec,mpix_per_sec,bytes_per_sec";
+    if (track_memory) {
+        o << ",peak_memory_bytes";
+    }
+    o << "\n";
+    for (auto &p : points) {
+        for (auto &v : p.values) {
+            o << csv_quote(v) << ",";
+        }
+        o << p.min_time << "," << p.median_time << ","
+          << (p.pixels_out / (1024.0 * 1024.0)) / p.min_time << ","
+          << p.bytes_moved / p.min_time;
+        if (track_memory) {
+            o << "," << p.peak_memory;
+        }
+        o << "\n";
+    }
+}
+
+void write_sweep_json(std::ostream &o,
+                      const char *filter_name,
+                      const std::vector<SweepAxis> &axes,
+                      const std::vector<SweepPoint> &points,
+                      bool track_memory) {
+    o << "{\n  \"filter\": " << json_value(filter_name) << ",\n  \"results\": [";
+    for (size_t i = 0; i < points.size(); ++i) {
+        auto &p = points[i];
+        o << (i ? ",\n" : "\n") << "    {";
+        for (size_t j = 0; j < axes.size(); ++j) {
+            o << json_value(axes[j].name) << ": " << json_value(p.values[j]) << ", ";
+        }
+        o << "\"min_sec\": " << p.min_time
+          << ", \"median_sec\": " << p.median_time
+          << ", \"mpix_per_sec\": " << (p.pixels_out / (1024.0 * 1024.0)) / p.min_time
+          << ", \"bytes_per_sec\": " << p.bytes_moved / p.min_time;
+        if (track_memory) {
+            o << ", \"peak_memory_bytes\": " << p.peak_memory;
+        }
+        o << "}";
+    }
+    o << "\n  ]\n}\n";
+}
+
+// Benchmark the filter at every point of the cartesian product of the
+// sweep axes. Input buffers and output allocations are reused between
+// points wherever the shapes allow it. Each point is timed with the
+// adaptive benchmark (to choose an iteration count), then with
+// 'samples' further samples of that many iterations, from which the
+// median is taken.
+std::vector<SweepPoint> run_sweep(std::map<std::string, ArgData> &args,
+                                  const std::vector<SweepAxis> &axes,
+                                  const Shape &default_output_shape,
+                                  const BenchmarkConfig &config,
+                                  uint64_t samples,
+                                  bool track_memory) {
+    std::map<std::string, Buffer<>> input_cache;
+    std::vector<SweepPoint> points;
+
+    HalideMemoryTracker tracker;
+    if (track_memory) {
+        tracker.install();
+    }
+
+    std::vector<size_t> which(axes.size(), 0);
+    while (true) {
+        SweepPoint point;
+        for (size_t i = 0; i < axes.size(); ++i) {
+            const std::string &value = axes[i].values[which[i]];
+            point.values.push_back(value);
+            if (axes[i].is_num_threads) {
+                int n = 0;
+                if (!parse_scalar(value, &n) || n < 0) {
+                    fail() << "Invalid value for flag: num_threads";
+                }
+                halide_set_num_threads(n);
+            } else {
+                args[axes[i].name].raw_string = value;
+            }
+        }
+
+        prepare_args(args, default_output_shape, &input_cache);
+        std::vector<void*> filter_argv = make_filter_argv(args);
+        const auto op = [&filter_argv, &args]() {
+            run_and_sync(filter_argv, args);
+        };
+
+        info() << "Benchmarking filter at sweep point " << points.size() << "...";
+
+        if (track_memory) {
+            tracker.highwater_reset();
+            op();
+            point.peak_memory = tracker.highwater();
+        }
+
+        auto result = Halide::Tools::benchmark(op, config);
+        uint64_t iterations = std::max<uint64_t>(1, result.iterations / std::max<uint64_t>(1, result.samples));
+        std::vector<double> times;
+        for (uint64_t i = 0; i < samples; ++i) {
+            times.push_back(Halide::Tools::benchmark(1, iterations, op));
+        }
+        std::sort(times.begin(), times.end());
+        point.min_time = std::min(result.wall_time, times.empty() ? result.wall_time : times[0]);
+        point.median_time = times.empty() ? result.wall_time : times[times.size() / 2];
+        point.pixels_out = calc_pixels_out(args);
+        point.bytes_moved = calc_bytes_moved(args);
+        points.push_back(point);
+
+        // Advance to the next point, with the last axis varying fastest.
+        int i = (int) axes.size() - 1;
+        while (i >= 0 && ++which[i] == axes[i].values.size()) {
+            which[i] = 0;
+            i--;
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+    return points;
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
@@ -909,6 +1234,10 @@ int main(int argc, char **argv) {
     double benchmark_min_time = BenchmarkConfig().min_time;
     uint64_t benchmark_min_iters = BenchmarkConfig().min_iters;
     uint64_t benchmark_max_iters = BenchmarkConfig().max_iters;
+    bool sweep = false;
+    std::string sweep_output;
+    uint64_t sweep_samples = 10;
+    std::string num_threads;
     for (int i = 1; i < argc; ++i) {
         if (argv[i][0] == '-') {
             const char *p = argv[i] + 1; // skip -
@@ -968,6 +1297,18 @@ int main(int argc, char **argv) {
                 }
             } else if (flag_name == "output_extents") {
                 default_output_shape = parse_extents(flag_value);
+            } else if (flag_name == "sweep") {
+                sweep = true;
+                sweep_output = flag_value;
+            } else if (flag_name == "sweep_samples") {
+                if (!parse_scalar(flag_value, &sweep_samples)) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+            } else if (flag_name == "num_threads") {
+                if (flag_value.empty()) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+                num_threads = flag_value;
             } else {
                 usage(argv[0]);
                 fail() << "Unknown flag: " << flag_name;
@@ -1006,10 +1347,10 @@ int main(int argc, char **argv) {
     }
 
     // It's OK to omit output arguments when we are benchmarking or tracking memory.
-    bool ok_to_omit_outputs = (benchmark || track_memory);
+    bool ok_to_omit_outputs = (benchmark || track_memory || sweep);
 
-    if (benchmark && track_memory) {
-        warn() << "Using --track_memory with --benchmarks will produce inaccurate benchmark results.";
+    if ((benchmark || sweep) && track_memory) {
+        warn() << "Using --track_memory with --benchmarks or --sweep will produce inaccurate benchmark results.";
     }
 
     // Check to be sure that all required arguments are specified.
@@ -1032,64 +1373,68 @@ int main(int argc, char **argv) {
         }
     }
 
-    // Parse all the input arguments, loading images as necessary.
-    // (Don't handle outputs yet.)
-    for (auto &arg_pair : args) {
-        auto &arg_name = arg_pair.first;
-        auto &arg = arg_pair.second;
-        switch (arg.metadata->kind) {
-        case halide_argument_kind_input_scalar: {
-            if (!parse_scalar(arg.metadata->type, arg.raw_string, &arg.scalar_value)) {
-                fail() << "Argument value for: " << arg_name << " could not be parsed as type "
-                     << arg.metadata->type << ": "
-                     << arg.raw_string;
+    BenchmarkConfig config;
+    config.min_time = benchmark_min_time;
+    config.max_time = benchmark_min_time * 4;
+    config.min_iters = benchmark_min_iters;
+    config.max_iters = benchmark_max_iters;
+
+    if (sweep) {
+        // Every argument (and the thread count) may list several values,
+        // separated by '|'; the ones that do are the axes of the sweep.
+        std::vector<SweepAxis> axes;
+        for (auto &arg_pair : args) {
+            auto &arg = arg_pair.second;
+            if (arg.metadata->kind == halide_argument_kind_output_buffer) {
+                // Outputs are not saved in a sweep.
+                continue;
             }
-            break;
-        }
-        case halide_argument_kind_input_buffer: {
-            arg.buffer_value = load_input(arg.raw_string, *arg.metadata);
-            info() << "Input " << arg_name << ": Shape is " << get_shape(arg.buffer_value);
-            // If there was no default_output_shape specified, use the shape of
-            // the first input buffer (if any).
-            // TODO: this is often a better-than-nothing guess, but not always. Add a way to defeat it?
-            if (default_output_shape.empty()) {
-                default_output_shape = get_shape(arg.buffer_value);
+            std::vector<std::string> values = split_string(arg.raw_string, "|");
+            if (values.size() > 1) {
+                axes.push_back({arg_pair.first, values, false});
             }
-            break;
         }
-        case halide_argument_kind_output_buffer:
-            // Nothing yet
-            break;
+        if (!num_threads.empty()) {
+            axes.push_back({"num_threads", split_string(num_threads, "|"), true});
         }
-    }
-
-    // Run a bounds query: we need to figure out how to allocate the output buffers,
-    // and the input buffers might need reshaping to satisfy constraints (e.g. a chunky/interleaved layout).
-    std::vector<Shape> constrained_shapes = run_bounds_query(args, default_output_shape);
-
-    for (auto &arg_pair : args) {
-        auto &arg_name = arg_pair.first;
-        auto &arg = arg_pair.second;
-        const Shape &constrained_shape = constrained_shapes[arg.index];
-        switch (arg.metadata->kind) {
-            case halide_argument_kind_input_buffer: {
-                info() << "Input " << arg_name << ": Shape is " << get_shape(arg.buffer_value);
-                bool updated = adapt_input_buffer_layout(constrained_shape, &arg.buffer_value);
-                info() << "Input " << arg_name << ": BoundsQuery result is " << constrained_shape;
-                if (updated) {
-                    info() << "Input " << arg_name << ": Updated Shape is " << get_shape(arg.buffer_value);
+        for (auto &axis : axes) {
+            for (auto &v : axis.values) {
+                if (v.empty()) {
+                    fail() << "Empty value in sweep of: " << axis.name;
                 }
-                break;
             }
-            case halide_argument_kind_output_buffer: {
-                arg.buffer_value = allocate_buffer(arg.metadata->type, make_legal_output_buffer_shape(constrained_shape));
-                info() << "Output " << arg_name << ": BoundsQuery result is " << constrained_shape;
-                info() << "Output " << arg_name << ": Shape is " << get_shape(arg.buffer_value);
-                break;
+        }
+
+        std::vector<SweepPoint> points = run_sweep(args, axes, default_output_shape,
+                                                   config, sweep_samples, track_memory);
+
+        std::ofstream file;
+        if (!sweep_output.empty()) {
+            file.open(sweep_output);
+            if (!file) {
+                fail() << "Unable to open sweep output: " << sweep_output;
             }
         }
+        std::ostream &o = sweep_output.empty() ? std::cout : file;
+        o << std::setprecision(9);
+        if (ends_with(sweep_output, ".json")) {
+            write_sweep_json(o, md->name, axes, points, track_memory);
+        } else {
+            write_sweep_csv(o, axes, points, track_memory);
+        }
+        return 0;
+    }
+
+    if (!num_threads.empty()) {
+        int n = 0;
+        if (!parse_scalar(num_threads, &n) || n < 0) {
+            fail() << "Invalid value for flag: num_threads (multiple values require --sweep)";
+        }
+        halide_set_num_threads(n);
     }
 
+    prepare_args(args, default_output_shape, nullptr);
+
     uint64_t pixels_out = calc_pixels_out(args);
     double megapixels = (double) pixels_out / (1024.0 * 1024.0);
 
@@ -1100,42 +1445,15 @@ int main(int argc, char **argv) {
     }
 
     {
-        std::vector<void*> filter_argv(args.size(), nullptr);
-        for (auto &arg_pair : args) {
-            auto &arg = arg_pair.second;
-            switch (arg.metadata->kind) {
-                case halide_argument_kind_input_scalar:
-                    filter_argv[arg.index] = &arg.scalar_value;
-                    break;
-                case halide_argument_kind_input_buffer:
-                case halide_argument_kind_output_buffer:
-                    filter_argv[arg.index] = arg.buffer_value.raw_buffer();
-                    break;
-            }
-        }
+        std::vector<void*> filter_argv = make_filter_argv(args);
 
         if (benchmark) {
             const auto benchmark_inner = [&filter_argv, &args]() {
-                // Ignore result since our halide_error() should catch everything.
-                (void) halide_rungen_redirect_argv(&filter_argv[0]);
-                // Ensure that all outputs are finished, otherwise we may just be
-                // measuring how long it takes to do a kernel launch for GPU code.
-                for (auto &arg_pair : args) {
-                    auto &arg = arg_pair.second;
-                    if (arg.metadata->kind == halide_argument_kind_output_buffer) {
-                        Buffer<> &b = arg.buffer_value;
-                        b.device_sync();
-                    }
-                }
+                run_and_sync(filter_argv, args);
             };
 
             info() << "Benchmarking filter...";
 
-            BenchmarkConfig config;
-            config.min_time = benchmark_min_time;
-            config.max_time = benchmark_min_time * 4;
-            config.min_iters = benchmark_min_iters;
-            config.max_iters = benchmark_max_iters;
             auto result = Halide::Tools::benchmark(benchmark_inner, config);
 
             std::cout << "Benchmark for " << md->name << " produces best case of " << result.wall_time << " sec/iter (over "
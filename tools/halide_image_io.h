@@ -23,6 +23,18 @@
 #include "jpeglib.h"
 #endif
 
+// Memory-mapped images require POSIX mmap.
+#if !defined(HALIDE_NO_MMAP) && defined(_WIN32)
+#define HALIDE_NO_MMAP
+#endif
+
+#ifndef HALIDE_NO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "HalideRuntime.h"  // for halide_type_t
 
 namespace Halide {
@@ -1187,6 +1199,7 @@ bool save_mat(ImageType &im, const std::string &filename) {
         };
         break;
     case halide_type_handle:
+    case halide_type_bfloat:
         check(false, "unreachable");
     }
 
@@ -1706,6 +1719,237 @@ void convert_and_save_image(ImageType &im, const std::string &filename) {
     }
 }
 
+#ifndef HALIDE_NO_MMAP
+
+// A memory-mapped image file, for images too large to load into
+// memory all at once. The pixels of a mapped image are never read up
+// front: the OS pages them in as a pipeline touches them, and writes
+// modified pages back to the file, so only the working set of the
+// pipeline needs to be resident. Only formats whose pixel data can be
+// used in place can be mapped: .tmp files, and 8-bit binary .pgm and
+// .ppm files. Mapped .ppm images are interleaved (the channel
+// dimension has stride 1).
+//
+// The MappedImage owns the mapping. Buffers it produces alias the
+// file, and must not be used after the MappedImage is unmapped or
+// destroyed. Use it like so:
+//
+//    MappedImage input, output;
+//    Buffer<uint8_t> in, out;
+//    input.map("in.ppm", &in);
+//    output.create("out.ppm", halide_type_of<uint8_t>(), {in.width(), in.height(), 3}, &out);
+//    // Realize the pipeline over out one tile at a time, e.g. by
+//    // calling realize() on crops of it.
+//    output.unmap();
+class MappedImage {
+public:
+    MappedImage() = default;
+    MappedImage(const MappedImage &) = delete;
+    MappedImage &operator=(const MappedImage &) = delete;
+
+    ~MappedImage() {
+        unmap();
+    }
+
+    // Map an existing image file. If writable is false, the image is
+    // mapped read-only, and writing to it will fault.
+    template<typename ImageType, Internal::CheckFunc check = Internal::CheckReturn>
+    bool map(const std::string &filename, ImageType *im, bool writable = false) {
+        unmap();
+
+        const std::string ext = Internal::get_lowercase_extension(filename);
+        halide_type_t type;
+        std::vector<int> sizes;
+        long offset;
+        {
+            Internal::FileOpener f(filename, "rb");
+            if (!check(f.f != nullptr, "File could not be opened for reading")) {
+                return false;
+            }
+            if (ext == "tmp") {
+                int32_t header[5];
+                if (!check(f.read_array(header), "Count not read .tmp header")) {
+                    return false;
+                }
+                if (!check(header[0] > 0 && header[1] > 0 && header[2] > 0 && header[3] > 0 &&
+                           header[4] >= 0 && header[4] < Internal::kNumTmpCodes, "Bad header on .tmp file")) {
+                    return false;
+                }
+                type = Internal::tmp_code_to_halide_type()[header[4]];
+                sizes = { header[0], header[1], header[2], header[3] };
+            } else if (ext == "pgm" || ext == "ppm") {
+                const int channels = ext == "ppm" ? 3 : 1;
+                int width, height, bit_depth;
+                if (!Internal::read_pnm_header<check>(f, channels == 3 ? "P6" : "P5", &width, &height, &bit_depth)) {
+                    return false;
+                }
+                // 16-bit samples are stored big-endian, so they can't be used in place.
+                if (!check(bit_depth == 8, "Only 8-bit .pgm and .ppm files can be mapped")) {
+                    return false;
+                }
+                type = halide_type_t(halide_type_uint, 8);
+                sizes = { width, height };
+                if (channels > 1) {
+                    sizes.push_back(channels);
+                }
+            } else {
+                return check(false, "Only .tmp, .pgm and .ppm files can be mapped");
+            }
+            offset = ftell(f.f);
+        }
+
+        return map_payload<ImageType, check>(filename, offset, type, sizes, ext == "ppm", writable, im);
+    }
+
+    // Create an image file of the given type and size, and map it
+    // writable. The pixels start out zero.
+    template<typename ImageType, Internal::CheckFunc check = Internal::CheckReturn>
+    bool create(const std::string &filename, halide_type_t type, const std::vector<int> &sizes, ImageType *im) {
+        unmap();
+
+        const std::string ext = Internal::get_lowercase_extension(filename);
+        size_t payload_bytes = type.bytes();
+        for (int s : sizes) {
+            if (!check(s > 0, "Mapped images must have positive size")) {
+                return false;
+            }
+            payload_bytes *= s;
+        }
+        long offset;
+        {
+            Internal::FileOpener f(filename, "wb");
+            if (!check(f.f != nullptr, "File could not be opened for writing")) {
+                return false;
+            }
+            if (ext == "tmp") {
+                if (!check(sizes.size() <= 4, ".tmp files can have at most 4 dimensions")) {
+                    return false;
+                }
+                int32_t header[5] = { 1, 1, 1, 1, -1 };
+                for (size_t i = 0; i < sizes.size(); i++) {
+                    header[i] = sizes[i];
+                }
+                auto *table = Internal::tmp_code_to_halide_type();
+                for (int i = 0; i < Internal::kNumTmpCodes; i++) {
+                    if (type == table[i]) {
+                        header[4] = i;
+                        break;
+                    }
+                }
+                if (!check(header[4] >= 0, "Unsupported type for .tmp file")) {
+                    return false;
+                }
+                if (!check(f.write_array(header), "Could not write .tmp header")) {
+                    return false;
+                }
+            } else if (ext == "pgm" || ext == "ppm") {
+                const int channels = ext == "ppm" ? 3 : 1;
+                if (!check(type == halide_type_t(halide_type_uint, 8), "Only 8-bit .pgm and .ppm files can be mapped")) {
+                    return false;
+                }
+                if (!check(sizes.size() == (channels == 3 ? 3 : 2) && (channels == 1 || sizes[2] == channels),
+                           "Wrong number of channels")) {
+                    return false;
+                }
+                fprintf(f.f, "%s\n%d %d\n%d\n", channels == 3 ? "P6" : "P5", sizes[0], sizes[1], 255);
+            } else {
+                return check(false, "Only .tmp, .pgm and .ppm files can be mapped");
+            }
+            offset = ftell(f.f);
+        }
+
+        // Extend the file to its full size without writing the
+        // pixels. On most filesystems this leaves a sparse file.
+        if (!check(truncate(filename.c_str(), offset + payload_bytes) == 0, "Could not resize file")) {
+            return false;
+        }
+
+        return map_payload<ImageType, check>(filename, offset, type, sizes, ext == "ppm", true, im);
+    }
+
+    // Write back any changes to the file and release the mapping.
+    // Returns false if the changes could not be written back.
+    bool unmap() {
+        bool result = true;
+        if (data != nullptr) {
+            if (writable) {
+                result = msync(data, mapped_bytes, MS_SYNC) == 0;
+            }
+            munmap(data, mapped_bytes);
+            data = nullptr;
+            mapped_bytes = 0;
+        }
+        return result;
+    }
+
+    bool is_mapped() const {
+        return data != nullptr;
+    }
+
+private:
+    void *data = nullptr;
+    size_t mapped_bytes = 0;
+    bool writable = false;
+
+    template<typename ImageType, Internal::CheckFunc check>
+    bool map_payload(const std::string &filename, long offset, halide_type_t type,
+                     const std::vector<int> &sizes, bool interleaved, bool read_write, ImageType *im) {
+        // Compute the shape. Interleaved images have (x, y, c) with c
+        // innermost in memory; everything else is planar.
+        std::vector<int> order;
+        if (interleaved) {
+            order = { 2, 0, 1 };
+        } else {
+            for (size_t i = 0; i < sizes.size(); i++) {
+                order.push_back((int)i);
+            }
+        }
+        std::vector<halide_dimension_t> shape(sizes.size());
+        int64_t stride = 1;
+        for (int i : order) {
+            if (!check(stride <= 0x7fffffff, "Image is too large to address with 32-bit strides")) {
+                return false;
+            }
+            shape[i] = halide_dimension_t(0, sizes[i], (int32_t)stride);
+            stride *= sizes[i];
+        }
+        const size_t bytes = offset + stride * type.bytes();
+
+        int fd = open(filename.c_str(), read_write ? O_RDWR : O_RDONLY);
+        if (!check(fd >= 0, "File could not be opened for mapping")) {
+            return false;
+        }
+        struct stat st;
+        if (!check(fstat(fd, &st) == 0 && (size_t)st.st_size >= bytes, "File is too small for the image it contains")) {
+            close(fd);
+            return false;
+        }
+        void *ptr = mmap(nullptr, bytes, PROT_READ | (read_write ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+        // The mapping holds its own reference to the file.
+        close(fd);
+        if (!check(ptr != MAP_FAILED, "Could not map file")) {
+            return false;
+        }
+        data = ptr;
+        mapped_bytes = bytes;
+        writable = read_write;
+
+        using DynamicImageType = typename Internal::ImageTypeWithElemType<ImageType, void>::type;
+        DynamicImageType im_d(type, (uint8_t *)ptr + offset, (int)shape.size(), shape.data());
+        if (ImageType::has_static_halide_type) {
+            const halide_type_t expected_type = ImageType::static_halide_type();
+            if (!check(im_d.type() == expected_type, "Image mapped did not match the expected type")) {
+                unmap();
+                return false;
+            }
+        }
+        *im = im_d.template as<typename ImageType::ElemType>();
+        return true;
+    }
+};
+
+#endif  // HALIDE_NO_MMAP
+
 }  // namespace Tools
 }  // namespace Halide
 
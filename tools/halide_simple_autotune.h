@@ -0,0 +1,280 @@
+#ifndef HALIDE_SIMPLE_AUTOTUNE_H
+#define HALIDE_SIMPLE_AUTOTUNE_H
+
+// An autotuner around simple_autoschedule. It enumerates candidate
+// SimpleAutoscheduleOptions, JIT-compiles and benchmarks the pipeline
+// scheduled with each of them, and records the fastest one in an on-disk
+// database keyed by the pipeline, the target and the input sizes. Later
+// runs with the same key (e.g. from a generator) look the options up in
+// the database instead of searching again.
+//
+// Usage:
+//
+//     auto build = [&]() {
+//         Func f = ...;  // Define the pipeline, with its inputs bound
+//         return std::vector<Func>{f};
+//     };
+//     SimpleAutoscheduleOptions options =
+//         simple_autotune(build, {}, {{{0, 1023}, {0, 1023}}}, {}, config);
+//     std::vector<Func> outputs = build();
+//     simple_autoschedule(outputs, {}, {{{0, 1023}, {0, 1023}}}, options);
+
+#include <fstream>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "halide_benchmark.h"
+
+namespace Halide {
+namespace Tools {
+
+struct SimpleAutotuneConfig {
+    // The file holding the tuned options. If empty, the results are not
+    // persisted.
+    std::string database;
+
+    // The candidate (square) CPU or GPU tile sizes. The rfactor split
+    // factors of simple_autoschedule are derived from the tile sizes.
+    std::vector<int> tile_sizes{8, 16, 32, 64};
+
+    // The candidate unroll_rvar_size values.
+    std::vector<int> unroll_rvar_sizes{0, 3, 5};
+
+    // How to benchmark each candidate.
+    BenchmarkConfig benchmark;
+};
+
+namespace Internal {
+
+// Rename the Funcs, the pure variables and the reduction variables of a
+// printed definition to names that don't depend on the order in which
+// unique names were generated.
+inline std::string canonicalize(const std::string &str,
+                                const std::map<std::string, std::string> &names) {
+    static const std::regex identifier("[A-Za-z_][A-Za-z0-9_.$]*");
+    std::string result;
+    auto last = str.cbegin();
+    for (std::sregex_iterator it(str.cbegin(), str.cend(), identifier), end; it != end; ++it) {
+        result.append(last, str.cbegin() + it->position());
+        auto name = names.find(it->str());
+        result += name != names.end() ? name->second : it->str();
+        last = str.cbegin() + it->position() + it->length();
+    }
+    result.append(last, str.cend());
+    return result;
+}
+
+// The 64-bit FNV-1a hash of a string. Unlike std::hash, it is the same
+// for every build, so the keys of a saved database stay valid.
+inline uint64_t simple_autotune_hash(const std::string &str) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : str) {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// The key of a pipeline in the tuning database: a hash of its definitions,
+// the target and the estimated parameters and output bounds.
+inline std::string simple_autotune_key(const std::vector<Func> &outputs,
+                                       const std::map<std::string, int> &parameters,
+                                       const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                                       const Target &target) {
+    std::vector<Halide::Internal::Function> output_functions;
+    std::map<std::string, Halide::Internal::Function> env;
+    for (const auto &f : outputs) {
+        output_functions.push_back(f.function());
+        std::map<std::string, Halide::Internal::Function> calls =
+            Halide::Internal::find_transitive_calls(f.function());
+        env.insert(calls.begin(), calls.end());
+    }
+    std::vector<std::string> order =
+        Halide::Internal::realization_order(output_functions, env).first;
+
+    std::map<std::string, std::string> names;
+    for (int i = 0; i < (int)order.size(); i++) {
+        names[order[i]] = "f" + std::to_string(i);
+    }
+    std::ostringstream definitions;
+    for (const auto &name : order) {
+        const Halide::Internal::Function &func = env.at(name);
+        std::map<std::string, std::string> local_names = names;
+        for (int i = 0; i < (int)func.args().size(); i++) {
+            local_names[func.args()[i]] = "x" + std::to_string(i);
+        }
+        definitions << names[name] << "(" << func.args().size() << ")";
+        if (func.has_extern_definition()) {
+            definitions << " = " << func.extern_function_name() << "\n";
+            continue;
+        }
+        std::vector<Halide::Internal::Definition> defs{func.definition()};
+        defs.insert(defs.end(), func.updates().begin(), func.updates().end());
+        for (const auto &def : defs) {
+            std::map<std::string, std::string> def_names = local_names;
+            const auto &rvars = def.schedule().rvars();
+            for (int i = 0; i < (int)rvars.size(); i++) {
+                def_names[rvars[i].var] = "r" + std::to_string(i);
+                definitions << " r" << i << "[" << rvars[i].min << ", " << rvars[i].extent << "]";
+            }
+            std::ostringstream def_str;
+            for (const auto &arg : def.args()) {
+                def_str << arg << ", ";
+            }
+            def_str << "= ";
+            for (const auto &value : def.values()) {
+                def_str << value << ", ";
+            }
+            definitions << " " << canonicalize(def_str.str(), def_names) << "\n";
+        }
+    }
+
+    std::ostringstream key;
+    key << std::hex << simple_autotune_hash(definitions.str()) << std::dec
+        << " " << target.to_string();
+    for (const auto &param : parameters) {
+        key << " " << param.first << "=" << param.second;
+    }
+    for (const auto &bounds : output_bounds) {
+        key << " [";
+        for (const auto &bound : bounds) {
+            key << bound.first << ":" << bound.second << ",";
+        }
+        key << "]";
+    }
+    return key.str();
+}
+
+inline std::string options_to_string(const SimpleAutoscheduleOptions &options) {
+    std::ostringstream str;
+    str << options.gpu << " "
+        << options.cpu_tile_width << " " << options.cpu_tile_height << " "
+        << options.cpu_vectorize_width << " "
+        << options.gpu_tile_width << " " << options.gpu_tile_height << " "
+        << options.gpu_tile_channel << " " << options.unroll_rvar_size;
+    return str.str();
+}
+
+inline bool options_from_string(const std::string &str, SimpleAutoscheduleOptions *options) {
+    std::istringstream in(str);
+    in >> options->gpu
+       >> options->cpu_tile_width >> options->cpu_tile_height
+       >> options->cpu_vectorize_width
+       >> options->gpu_tile_width >> options->gpu_tile_height
+       >> options->gpu_tile_channel >> options->unroll_rvar_size;
+    return !in.fail();
+}
+
+}  // namespace Internal
+
+// Look up the options tuned for a key in the database. Each line of the
+// database is "<key>\t<options>\t<seconds>". The last entry of a key wins.
+inline bool lookup_simple_autotune(const std::string &database,
+                                   const std::string &key,
+                                   SimpleAutoscheduleOptions *options) {
+    std::ifstream in(database);
+    bool found = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t key_end = line.find('\t');
+        if (key_end == std::string::npos || line.substr(0, key_end) != key) {
+            continue;
+        }
+        size_t options_end = line.find('\t', key_end + 1);
+        SimpleAutoscheduleOptions entry = *options;
+        if (Internal::options_from_string(
+                line.substr(key_end + 1, options_end - key_end - 1), &entry)) {
+            *options = entry;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Return the fastest SimpleAutoscheduleOptions for the pipeline created by
+// 'build', starting from 'base' and varying the tile sizes and
+// unroll_rvar_size. 'build' is called once per candidate and must return a
+// new, unscheduled and runnable (all inputs bound) copy of the pipeline.
+inline SimpleAutoscheduleOptions simple_autotune(
+        std::function<std::vector<Func>()> build,
+        const std::map<std::string, int> &parameters,
+        const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+        const SimpleAutoscheduleOptions &base = SimpleAutoscheduleOptions(),
+        const SimpleAutotuneConfig &config = SimpleAutotuneConfig()) {
+    Target target = get_jit_target_from_environment();
+    std::string key = Internal::simple_autotune_key(build(), parameters, output_bounds, target);
+
+    SimpleAutoscheduleOptions best = base;
+    if (!config.database.empty() &&
+            lookup_simple_autotune(config.database, key, &best)) {
+        return best;
+    }
+
+    std::vector<SimpleAutoscheduleOptions> candidates;
+    for (int tile_size : config.tile_sizes) {
+        for (int unroll_rvar_size : config.unroll_rvar_sizes) {
+            SimpleAutoscheduleOptions options = base;
+            if (options.gpu) {
+                options.gpu_tile_width = tile_size;
+                options.gpu_tile_height = tile_size;
+            } else {
+                options.cpu_tile_width = tile_size;
+                options.cpu_tile_height = tile_size;
+            }
+            options.unroll_rvar_size = unroll_rvar_size;
+            candidates.push_back(options);
+        }
+    }
+
+    double best_time = std::numeric_limits<double>::infinity();
+    for (const auto &options : candidates) {
+        std::vector<Func> outputs = build();
+        simple_autoschedule(outputs, parameters, output_bounds, options);
+
+        std::vector<Buffer<>> buffers;
+        for (int i = 0; i < (int)outputs.size(); i++) {
+            std::vector<int> sizes;
+            for (const auto &bound : output_bounds[i]) {
+                sizes.push_back(bound.second - bound.first + 1);
+            }
+            for (const auto &type : outputs[i].output_types()) {
+                Buffer<> buffer(type, sizes);
+                for (int d = 0; d < (int)sizes.size(); d++) {
+                    buffer.translate(d, output_bounds[i][d].first);
+                }
+                buffers.push_back(buffer);
+            }
+        }
+        Realization realization(buffers);
+        Pipeline pipeline(outputs);
+        pipeline.compile_jit(target);
+
+        double time = benchmark([&]() {
+            pipeline.realize(realization, target);
+            for (auto &buffer : buffers) {
+                buffer.device_sync();
+            }
+        }, config.benchmark);
+        if (time < best_time) {
+            best_time = time;
+            best = options;
+        }
+    }
+
+    if (!config.database.empty()) {
+        std::ofstream out(config.database, std::ios::app);
+        out << key << "\t" << Internal::options_to_string(best) << "\t" << best_time << "\n";
+    }
+    return best;
+}
+
+}  // namespace Tools
+}  // namespace Halide
+
+#endif
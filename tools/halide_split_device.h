@@ -0,0 +1,152 @@
+#ifndef HALIDE_SPLIT_DEVICE_H
+#define HALIDE_SPLIT_DEVICE_H
+
+// Compute one output on a GPU and on the CPU at the same time, by
+// splitting one of its dimensions between two builds of the same
+// pipeline: one compiled for a GPU target (e.g. host-cuda), and one for
+// the CPU. Each build is called on its own crop of the output, so each
+// crop carries its own dirty bits and device allocation. The GPU crop is
+// copied back to the host when it is done, and the CPU crop is written
+// in place, so the output ends up complete on the host.
+//
+// The fraction of the dimension given to the GPU adapts to the measured
+// throughput of the two sides after each run, so that both finish at
+// about the same time. It can also be set directly, e.g. to a value
+// tuned offline.
+//
+// Usage:
+//
+//     Halide::Tools::SplitDevice split(0.5);
+//     Halide::Runtime::Buffer<float> output(width, height);
+//     int result = split.run(output, 1,
+//         [&](Halide::Runtime::Buffer<float> rows) { return blur_cuda(input, rows); },
+//         [&](Halide::Runtime::Buffer<float> rows) { return blur_cpu(input, rows); });
+//
+// Both builds read the whole input, so the CPU build needs it on the
+// host; copy it there first if it may be dirty on a device.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "HalideBuffer.h"
+#include "halide_benchmark.h"
+
+namespace Halide {
+namespace Tools {
+
+class SplitDevice {
+    double fraction;
+    double rate;
+    int granularity;
+    double last_gpu_time = 0, last_cpu_time = 0;
+
+public:
+    // gpu_fraction is the initial fraction of the dimension given to the
+    // GPU. After each run, it moves adapt_rate of the way to the fraction
+    // at which both sides would have taken the same time (0 disables the
+    // adaptation). The GPU part is rounded to a multiple of granularity,
+    // e.g. the block size of the GPU schedule.
+    explicit SplitDevice(double gpu_fraction = 0.5, double adapt_rate = 0.5, int granularity = 1)
+        : fraction(gpu_fraction), rate(adapt_rate), granularity(std::max(granularity, 1)) {
+        assert(gpu_fraction >= 0 && gpu_fraction <= 1);
+        assert(adapt_rate >= 0 && adapt_rate <= 1);
+    }
+
+    double gpu_fraction() const {
+        return fraction;
+    }
+
+    void set_gpu_fraction(double f) {
+        assert(f >= 0 && f <= 1);
+        fraction = f;
+    }
+
+    // The times in seconds the two sides took in the last run, including
+    // the copy of the GPU part back to the host.
+    double gpu_time() const {
+        return last_gpu_time;
+    }
+
+    double cpu_time() const {
+        return last_cpu_time;
+    }
+
+    // The number of elements along a dimension of the given extent that
+    // go to the GPU.
+    int gpu_extent(int extent) const {
+        int e = (int)std::lround(fraction * extent / granularity) * granularity;
+        return std::min(std::max(e, 0), extent);
+    }
+
+    // Compute output, splitting dimension dim: the first part is computed
+    // by gpu and the rest by cpu, concurrently. Each is called with its
+    // crop of the output and returns zero on success (like an AOT
+    // pipeline), and is not called if its part is empty. Returns the
+    // first nonzero result, or zero.
+    template<typename T, int D, typename GPUFunc, typename CPUFunc>
+    int run(Runtime::Buffer<T, D> &output, int dim, GPUFunc gpu, CPUFunc cpu) {
+        using Clock = SteadyClock<>::type;
+        const int min = output.dim(dim).min();
+        const int extent = output.dim(dim).extent();
+        const int gpu_rows = gpu_extent(extent);
+        const int cpu_rows = extent - gpu_rows;
+
+        int cpu_result = 0;
+        std::thread cpu_thread;
+        if (cpu_rows > 0) {
+            Runtime::Buffer<T, D> cpu_part = output.cropped(dim, min + gpu_rows, cpu_rows);
+            cpu_thread = std::thread([&, cpu_part]() mutable {
+                auto start = Clock::now();
+                cpu_result = cpu(cpu_part);
+                last_cpu_time = std::chrono::duration<double>(Clock::now() - start).count();
+            });
+        } else {
+            last_cpu_time = 0;
+        }
+
+        int gpu_result = 0;
+        if (gpu_rows > 0) {
+            Runtime::Buffer<T, D> gpu_part = output.cropped(dim, min, gpu_rows);
+            auto start = Clock::now();
+            gpu_result = gpu(gpu_part);
+            if (gpu_result == 0) {
+                gpu_result = gpu_part.copy_to_host();
+            }
+            last_gpu_time = std::chrono::duration<double>(Clock::now() - start).count();
+        } else {
+            last_gpu_time = 0;
+        }
+
+        if (cpu_thread.joinable()) {
+            cpu_thread.join();
+        }
+        if (gpu_result != 0) {
+            return gpu_result;
+        }
+        if (cpu_result != 0) {
+            return cpu_result;
+        }
+
+        // Both sides need to have done some work to measure their
+        // throughput.
+        if (rate > 0 && gpu_rows > 0 && cpu_rows > 0 &&
+            last_gpu_time > 0 && last_cpu_time > 0) {
+            double gpu_throughput = gpu_rows / last_gpu_time;
+            double cpu_throughput = cpu_rows / last_cpu_time;
+            double balanced = gpu_throughput / (gpu_throughput + cpu_throughput);
+            fraction += rate * (balanced - fraction);
+            // Keep a part on each side, so that the next run can still
+            // measure both of them.
+            double least = std::min((double)granularity / extent, 0.5);
+            fraction = std::min(std::max(fraction, least), 1 - least);
+        }
+        return 0;
+    }
+};
+
+}  // namespace Tools
+}  // namespace Halide
+
+#endif  // HALIDE_SPLIT_DEVICE_H
@@ -0,0 +1,217 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** \file
+ *
+ * A tool which measures the machine that code is auto-scheduled for, with
+ * microbenchmarks JIT-compiled by Halide for the given target (the host by
+ * default), and prints MachineParams for it. The last line printed is the
+ * MachineParams string, which can be passed to a Generator as
+ * machine_params=<string>. The lines before it are comments with the
+ * measurements the MachineParams were derived from.
+ *
+ * The parallelism is the number of hardware threads. The last level
+ * cache size is the largest working set that is read much faster than
+ * memory, and the balance is the number of arithmetic operations the
+ * machine can do in the time it takes to load a value from that cache. On
+ * GPU targets, the shared memory size and the threads per block are the
+ * largest that a kernel can use without failing.
+ */
+
+using namespace Halide;
+
+namespace {
+
+// Set by the error handler of the pipelines that probe the limits of a
+// GPU, which fail by design.
+bool pipeline_failed = false;
+
+void record_failure(void *, const char *) {
+    pipeline_failed = true;
+}
+
+// The read bandwidth, in bytes per second, for the given working set,
+// split among the given number of threads. The working set is read
+// repeatedly inside the pipeline, so the overhead of running the
+// pipeline doesn't count for small working sets.
+double read_bandwidth(const Target &target, int64_t bytes, int threads) {
+    const int vec = target.natural_vector_size<float>();
+    // Several vectors of accumulators, so that the adds don't serialize.
+    const int lanes = 4 * vec;
+    const int width = std::max<int64_t>(lanes, bytes / sizeof(float) / threads / lanes * lanes);
+    const int reps = std::max<int64_t>(1, (int64_t(256) << 20) / ((int64_t)width * threads * sizeof(float)));
+
+    Buffer<float> in(width, threads);
+    in.fill(1.0f);
+
+    Var v("v"), t("t"), vo("vo"), vi("vi");
+    RDom r(0, width / lanes, 0, reps);
+    Func total("total");
+    total(v, t) = 0.0f;
+    total(v, t) += in(r.x * lanes + v, t);
+
+    total.bound(v, 0, lanes)
+        .split(v, vo, vi, vec).vectorize(vi).unroll(vo).parallel(t);
+    total.update()
+        .split(v, vo, vi, vec).vectorize(vi).unroll(vo)
+        .reorder(vi, vo, r.x, r.y, t).parallel(t);
+    total.compile_jit(target);
+
+    Buffer<float> out(lanes, threads);
+    double time = Tools::benchmark(5, 1, [&]() { total.realize(out); });
+    return (double)width * threads * reps * sizeof(float) / time;
+}
+
+// The arithmetic throughput, in floating point operations per second,
+// of independent chains of multiply-adds.
+double compute_throughput(const Target &target, int threads) {
+    const int vec = target.natural_vector_size<float>();
+    const int chains = 8, steps = 64;
+    const int width = vec * 64, height = threads * 64;
+
+    Var x("x"), y("y");
+    std::vector<Expr> acc;
+    for (int j = 0; j < chains; j++) {
+        acc.push_back(cast<float>(x + y + j));
+    }
+    for (int i = 0; i < steps; i++) {
+        for (int j = 0; j < chains; j++) {
+            acc[j] = acc[j] * 0.999f + 0.001f;
+        }
+    }
+    Expr result = acc[0];
+    for (int j = 1; j < chains; j++) {
+        result += acc[j];
+    }
+
+    Func f("f");
+    f(x, y) = result;
+    f.vectorize(x, vec).parallel(y);
+    f.compile_jit(target);
+
+    Buffer<float> out(width, height);
+    double time = Tools::benchmark(5, 1, [&]() { f.realize(out); });
+    return 2.0 * chains * steps * width * height / time;
+}
+
+// The largest power of two number of threads in a GPU block at which a
+// trivial kernel runs.
+int gpu_max_threads_per_block(const Target &target) {
+    int best = 0;
+    for (int threads = 32; threads <= 4096; threads *= 2) {
+        Var x("x"), xo("xo"), xi("xi");
+        Func f("f");
+        f(x) = x;
+        f.gpu_tile(x, xo, xi, threads);
+        f.set_error_handler(record_failure);
+        f.compile_jit(target);
+        pipeline_failed = false;
+        Buffer<int> out(threads * 4);
+        f.realize(out, target);
+        if (pipeline_failed) {
+            break;
+        }
+        best = threads;
+    }
+    return best;
+}
+
+// The largest power of two size, in bytes, of a Func stored in the
+// shared memory of a GPU block at which the kernel runs.
+int gpu_shared_memory_size(const Target &target) {
+    int best = 0;
+    const int block = 64;
+    for (int bytes = 1024; bytes <= 1024 * 1024; bytes *= 2) {
+        const int elements = bytes / sizeof(float) - block;
+        Var x("x"), xo("xo"), xi("xi"), so("so"), si("si");
+        Func staged("staged"), f("f");
+        staged(x) = cast<float>(x);
+        f(x) = staged(x) + staged(x + elements);
+        f.gpu_tile(x, xo, xi, block);
+        staged.compute_at(f, xo).split(x, so, si, block).gpu_threads(si);
+        f.set_error_handler(record_failure);
+        f.compile_jit(target);
+        pipeline_failed = false;
+        Buffer<float> out(block * 4);
+        f.realize(out, target);
+        if (pipeline_failed) {
+            break;
+        }
+        best = bytes;
+    }
+    return best;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [target]\n", argv[0]);
+        return 1;
+    }
+    const Target target = argc > 1 ? Target(argv[1]) : get_jit_target_from_environment();
+    const Target host = target.without_feature(Target::CUDA)
+                            .without_feature(Target::OpenCL)
+                            .without_feature(Target::Metal)
+                            .without_feature(Target::D3D12Compute)
+                            .without_feature(Target::OpenGLCompute);
+
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    printf("# target: %s\n", target.to_string().c_str());
+    printf("# hardware_threads: %d\n", threads);
+    printf("# vector_width: %d\n", host.natural_vector_size<float>());
+
+    // Read bandwidth over working sets from 32KB to 256MB. The bandwidth
+    // of the largest working set is the bandwidth of memory.
+    std::vector<std::pair<int64_t, double>> bandwidths;
+    for (int64_t bytes = 32 * 1024; bytes <= (int64_t(256) << 20); bytes *= 2) {
+        double bw = read_bandwidth(host, bytes, threads);
+        printf("# read_bandwidth_gbps[%lld]: %.2f\n", (long long)bytes, bw / 1e9);
+        bandwidths.emplace_back(bytes, bw);
+    }
+    const double memory_bandwidth = bandwidths.back().second;
+    printf("# memory_bandwidth_gbps: %.2f\n", memory_bandwidth / 1e9);
+
+    // The last level cache is the largest working set that is read at
+    // least 1.5x faster than memory.
+    int64_t llc = bandwidths.front().first;
+    double llc_bandwidth = bandwidths.front().second;
+    for (const auto &b : bandwidths) {
+        if (b.second >= 1.5 * memory_bandwidth) {
+            llc = b.first;
+            llc_bandwidth = b.second;
+        }
+    }
+    printf("# last_level_cache_bandwidth_gbps: %.2f\n", llc_bandwidth / 1e9);
+
+    const double flops = compute_throughput(host, threads);
+    printf("# compute_gflops: %.2f\n", flops / 1e9);
+
+    // How many arithmetic operations are done in the time of one load of
+    // a float from the last level cache.
+    const int balance = std::max(1, (int)std::lround(flops / (llc_bandwidth / sizeof(float))));
+
+    MachineParams params(threads, (int32_t)llc, balance);
+    if (target.has_gpu_feature()) {
+        const int max_threads = gpu_max_threads_per_block(target);
+        const int shared_memory = gpu_shared_memory_size(target);
+        printf("# gpu_max_threads_per_block: %d\n", max_threads);
+        printf("# gpu_shared_memory_size: %d\n", shared_memory);
+        if (max_threads > 0) {
+            params.gpu_max_threads_per_block = max_threads;
+        }
+        if (shared_memory > 0) {
+            params.gpu_shared_memory_size = shared_memory;
+        }
+    }
+
+    printf("%s\n", params.to_string().c_str());
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "Halide.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** \file
+ *
+ * A tool which retrains the linear cost model of the auto scheduler from
+ * benchmarks of auto-scheduled pipelines. Each pipeline is given by the
+ * features dumped by the auto scheduler while compiling it (with
+ * HL_AUTOSCHEDULE_FEATURES=<file>) and the log of a RunGen benchmark of
+ * it. The weights written can be used by setting
+ * HL_AUTOSCHEDULE_COST_MODEL=<file>, or loaded with LinearCostModel::load.
+ */
+
+using namespace Halide;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// The features of the last pipeline in a features file
+bool read_features(const string &filename, vector<double> *features) {
+    std::ifstream in(filename);
+    string line, last;
+    while (std::getline(in, line)) {
+        if (line.find(':') != string::npos) {
+            last = line;
+        }
+    }
+    if (last.empty()) {
+        return false;
+    }
+    std::istringstream values(last.substr(last.rfind(':') + 1));
+    features->clear();
+    double f;
+    while (values >> f) {
+        features->push_back(f);
+    }
+    return (int)features->size() == LinearCostModel::num_features;
+}
+
+// The best runtime in a RunGen log, from its line
+// "Benchmark for <name> produces best case of <seconds> sec/iter ..."
+bool read_runtime(const string &filename, double *runtime) {
+    std::ifstream in(filename);
+    const string marker = "produces best case of ";
+    string line;
+    bool found = false;
+    while (std::getline(in, line)) {
+        size_t pos = line.find(marker);
+        if (pos != string::npos) {
+            *runtime = std::stod(line.substr(pos + marker.size()));
+            found = true;
+        }
+    }
+    return found;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 4 || argc % 2 != 0) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <model> <features> <rungen log> [<features> <rungen log> ...]\n";
+        return 1;
+    }
+
+    vector<vector<double>> samples;
+    vector<double> runtimes;
+    for (int i = 2; i < argc; i += 2) {
+        vector<double> features;
+        double runtime;
+        if (!read_features(argv[i], &features)) {
+            std::cerr << "No features found in " << argv[i] << "\n";
+            return 1;
+        }
+        if (!read_runtime(argv[i + 1], &runtime)) {
+            std::cerr << "No benchmark result found in " << argv[i + 1] << "\n";
+            return 1;
+        }
+        samples.push_back(features);
+        runtimes.push_back(runtime);
+    }
+
+    LinearCostModel model = LinearCostModel::train(samples, runtimes);
+    model.save(argv[1]);
+
+    std::cout << "Trained on " << samples.size() << " pipelines. Weights:";
+    for (double w : model.get_weights()) {
+        std::cout << " " << w;
+    }
+    std::cout << "\n";
+    return 0;
+}
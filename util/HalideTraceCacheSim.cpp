@@ -0,0 +1,493 @@
+#include "HalideTraceUtils.h"
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** \file
+ *
+ * A tool which reads a binary Halide trace and replays its loads and
+ * stores through a simulated cache hierarchy, to report the miss rates,
+ * reuse distances and working sets of each Func.
+ *
+ * The trace only records the coordinates of each access, so each
+ * realization of a Func is given a dense buffer, innermost dimension
+ * first, from the bounds in its begin_realization event. Buffers freed
+ * by end_realization are reused by later realizations of the same
+ * size, as an allocator would. Funcs and input buffers accessed outside
+ * of a traced realization get a buffer with a fixed stride of
+ * fallback_row elements between rows, so that rows never share cache
+ * lines. The accesses of parallel loops are simulated in the order they
+ * appear in the trace, through a single cache hierarchy.
+ */
+
+using namespace Halide;
+using namespace Internal;
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+const int64_t fallback_row = 1 << 16;
+
+// A set-associative cache with LRU replacement.
+class Cache {
+    int64_t line_bytes, sets, ways;
+    vector<uint64_t> tags, last_use;
+    uint64_t clock = 0;
+
+public:
+    string name;
+    int64_t size;
+
+    Cache(const string &name, int64_t size, int64_t ways, int64_t line_bytes)
+        : line_bytes(line_bytes), ways(ways), name(name), size(size) {
+        sets = std::max<int64_t>(1, size / (line_bytes * ways));
+        tags.resize(sets * ways, (uint64_t)-1);
+        last_use.resize(sets * ways, 0);
+    }
+
+    // Access a cache line, and return whether it was already cached.
+    bool access(uint64_t line) {
+        clock++;
+        int64_t set = line % sets;
+        uint64_t *set_tags = &tags[set * ways];
+        uint64_t *set_last_use = &last_use[set * ways];
+        int64_t victim = 0;
+        for (int64_t w = 0; w < ways; w++) {
+            if (set_tags[w] == line) {
+                set_last_use[w] = clock;
+                return true;
+            }
+            if (set_last_use[w] < set_last_use[victim]) {
+                victim = w;
+            }
+        }
+        set_tags[victim] = line;
+        set_last_use[victim] = clock;
+        return false;
+    }
+};
+
+// The number of distinct cache lines accessed since the last access to
+// each line (its LRU stack distance), computed by marking the time of
+// the last access to each line in a Fenwick tree. The times are
+// renumbered once the tree is full.
+class ReuseDistance {
+    std::unordered_map<uint64_t, int64_t> last_access;
+    vector<int64_t> tree;
+    int64_t now = 0;
+
+    void add(int64_t t, int64_t delta) {
+        for (t++; t < (int64_t)tree.size(); t += t & -t) {
+            tree[t] += delta;
+        }
+    }
+
+    // The number of lines last accessed at times [0, t]
+    int64_t prefix(int64_t t) const {
+        int64_t result = 0;
+        for (t++; t > 0; t -= t & -t) {
+            result += tree[t];
+        }
+        return result;
+    }
+
+    void compact() {
+        vector<std::pair<int64_t, uint64_t>> order;
+        order.reserve(last_access.size());
+        for (const auto &it : last_access) {
+            order.emplace_back(it.second, it.first);
+        }
+        std::sort(order.begin(), order.end());
+        tree.assign(std::max<int64_t>(2 * order.size(), 1 << 20) + 1, 0);
+        for (now = 0; now < (int64_t)order.size(); now++) {
+            last_access[order[now].second] = now;
+            add(now, 1);
+        }
+    }
+
+public:
+    ReuseDistance() {
+        tree.assign((1 << 20) + 1, 0);
+    }
+
+    // Access a line, and return its stack distance, or -1 if it was
+    // never accessed before.
+    int64_t access(uint64_t line) {
+        if (now + 1 >= (int64_t)tree.size()) {
+            compact();
+        }
+        int64_t distance = -1;
+        auto it = last_access.find(line);
+        if (it != last_access.end()) {
+            distance = prefix(now - 1) - prefix(it->second);
+            add(it->second, -1);
+            it->second = now;
+        } else {
+            last_access[line] = now;
+        }
+        add(now, 1);
+        now++;
+        return distance;
+    }
+};
+
+const int histogram_buckets = 48;
+
+struct FuncStats {
+    int64_t loads = 0, stores = 0;
+    // The line accesses, and the misses at each level of the hierarchy
+    int64_t accesses = 0;
+    vector<int64_t> misses;
+    // The first accesses to a line, and the stack distances of the
+    // others in buckets of powers of two
+    int64_t cold = 0;
+    int64_t reuse[histogram_buckets] = {0};
+
+    // The smallest stack distance, in lines, at or above that of the
+    // given fraction of the reuses
+    int64_t reuse_percentile(double fraction) const {
+        int64_t total = 0;
+        for (int64_t count : reuse) {
+            total += count;
+        }
+        int64_t seen = 0;
+        for (int b = 0; b < histogram_buckets; b++) {
+            seen += reuse[b];
+            if (total > 0 && seen >= fraction * total) {
+                return (int64_t)1 << b;
+            }
+        }
+        return 0;
+    }
+};
+
+// A dense buffer for a realization of a Func
+struct Region {
+    uint64_t base = 0;
+    vector<int> min, extent;
+    int64_t bytes = 0;
+};
+
+class Simulator {
+    int64_t line_bytes;
+    vector<Cache> levels;
+    ReuseDistance reuse;
+
+    uint64_t next_base = 4096;
+    // The bounds of the realizations in flight, by trace id, and the
+    // buffers of their values, by trace id and value index
+    map<int, std::pair<vector<int>, vector<int>>> realizations;
+    map<std::pair<int, int>, Region> regions;
+    // Buffers freed by end_realization, by size
+    map<int64_t, vector<uint64_t>> free_list;
+    // Buffers for the accesses outside of traced realizations
+    map<std::pair<string, int>, Region> fallback_regions;
+
+    uint64_t allocate(int64_t bytes) {
+        bytes = (bytes + 4095) & ~(int64_t)4095;
+        auto it = free_list.find(bytes);
+        if (it != free_list.end() && !it->second.empty()) {
+            uint64_t base = it->second.back();
+            it->second.pop_back();
+            return base;
+        }
+        uint64_t base = next_base;
+        next_base += bytes;
+        return base;
+    }
+
+    Region &region_for(const Packet &p, int dims, int elem_bytes) {
+        std::pair<int, int> key(p.parent_id, p.value_index);
+        auto it = regions.find(key);
+        if (it != regions.end()) {
+            return it->second;
+        }
+        auto realization = realizations.find(p.parent_id);
+        if (realization != realizations.end() &&
+            (int)realization->second.first.size() == dims) {
+            Region &r = regions[key];
+            r.min = realization->second.first;
+            r.extent = realization->second.second;
+            r.bytes = elem_bytes;
+            for (int e : r.extent) {
+                r.bytes *= e;
+            }
+            r.base = allocate(r.bytes);
+            return r;
+        }
+        std::pair<string, int> fallback_key(p.func(), p.value_index);
+        auto fallback = fallback_regions.find(fallback_key);
+        if (fallback != fallback_regions.end()) {
+            return fallback->second;
+        }
+        Region &r = fallback_regions[fallback_key];
+        r.min.assign(dims, 0);
+        r.extent.assign(dims, -1);
+        r.bytes = (1LL << 40);
+        r.base = next_base;
+        next_base += r.bytes;
+        return r;
+    }
+
+    uint64_t address(const Region &r, const Packet &p, int lane, int lanes, int elem_bytes) {
+        int64_t offset = 0, stride = 1;
+        for (int i = 0; i < (int)r.min.size(); i++) {
+            int64_t c = p.get_coord(lanes * i + lane) - r.min[i];
+            offset += c * stride;
+            stride *= r.extent[i] > 0 ? r.extent[i] : fallback_row;
+        }
+        if (r.extent.empty() || r.extent[0] < 0) {
+            // Wrap the fallback addresses around their space
+            offset &= ((1LL << 40) - 1) / elem_bytes;
+        }
+        return r.base + offset * elem_bytes;
+    }
+
+public:
+    map<string, FuncStats> stats;
+    int64_t packets = 0;
+
+    Simulator(const vector<Cache> &levels, int64_t line_bytes)
+        : line_bytes(line_bytes), levels(levels) {}
+
+    const vector<Cache> &cache_levels() const {
+        return levels;
+    }
+
+    int64_t line_size() const {
+        return line_bytes;
+    }
+
+    void process(const Packet &p) {
+        packets++;
+        if (p.event == halide_trace_begin_realization) {
+            vector<int> min, extent;
+            for (int i = 0; i + 1 < p.dimensions; i += 2) {
+                min.push_back(p.get_coord(i));
+                extent.push_back(p.get_coord(i + 1));
+            }
+            realizations[p.id] = {min, extent};
+        } else if (p.event == halide_trace_end_realization) {
+            realizations.erase(p.parent_id);
+            auto begin = regions.lower_bound({p.parent_id, INT32_MIN});
+            auto end = begin;
+            while (end != regions.end() && end->first.first == p.parent_id) {
+                int64_t bytes = (end->second.bytes + 4095) & ~(int64_t)4095;
+                free_list[bytes].push_back(end->second.base);
+                end++;
+            }
+            regions.erase(begin, end);
+        } else if (p.event == halide_trace_load || p.event == halide_trace_store) {
+            int lanes = p.type.lanes;
+            int elem_bytes = p.type.bytes();
+            int dims = p.dimensions / lanes;
+            FuncStats &s = stats[p.func()];
+            if (s.misses.empty()) {
+                s.misses.resize(levels.size(), 0);
+            }
+            (p.event == halide_trace_load ? s.loads : s.stores) += lanes;
+            Region &r = region_for(p, dims, elem_bytes);
+            uint64_t previous_line = (uint64_t)-1;
+            for (int lane = 0; lane < lanes; lane++) {
+                uint64_t line = address(r, p, lane, lanes, elem_bytes) / line_bytes;
+                if (line == previous_line) {
+                    // The lanes of a vector in the same line are one access
+                    continue;
+                }
+                previous_line = line;
+                s.accesses++;
+                int64_t distance = reuse.access(line);
+                if (distance < 0) {
+                    s.cold++;
+                } else {
+                    int b = 0;
+                    while (b + 1 < histogram_buckets && ((int64_t)1 << b) < distance) {
+                        b++;
+                    }
+                    s.reuse[b]++;
+                }
+                for (size_t l = 0; l < levels.size(); l++) {
+                    if (levels[l].access(line)) {
+                        break;
+                    }
+                    s.misses[l]++;
+                }
+            }
+        }
+    }
+};
+
+string format_bytes(int64_t bytes) {
+    char buf[32];
+    if (bytes >= 1024 * 1024) {
+        snprintf(buf, sizeof(buf), "%.1fMB", bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 1024) {
+        snprintf(buf, sizeof(buf), "%.1fKB", bytes / 1024.0);
+    } else {
+        snprintf(buf, sizeof(buf), "%dB", (int)bytes);
+    }
+    return buf;
+}
+
+void report(const Simulator &sim) {
+    const vector<Cache> &levels = sim.cache_levels();
+    int64_t line_bytes = sim.line_size();
+    printf("Simulated %lld packets with %lld byte lines through", (long long)sim.packets, (long long)line_bytes);
+    for (const Cache &c : levels) {
+        printf(" %s %s", c.name.c_str(), format_bytes(c.size).c_str());
+    }
+    printf("\n\n");
+
+    // The Funcs missing the last level the most first
+    vector<std::pair<string, const FuncStats *>> funcs;
+    for (const auto &it : sim.stats) {
+        funcs.emplace_back(it.first, &it.second);
+    }
+    std::sort(funcs.begin(), funcs.end(), [&](const std::pair<string, const FuncStats *> &a,
+                                              const std::pair<string, const FuncStats *> &b) {
+        return a.second->misses.back() > b.second->misses.back();
+    });
+
+    size_t name_width = 4;
+    for (const auto &f : funcs) {
+        name_width = std::max(name_width, f.first.size());
+    }
+    printf("%-*s %12s %12s %12s", (int)name_width, "Func", "loads", "stores", "lines");
+    for (const Cache &c : levels) {
+        printf(" %9s", (c.name + " miss").c_str());
+    }
+    printf(" %10s %10s %10s\n", "footprint", "reuse p50", "ws p90");
+    for (const auto &f : funcs) {
+        const FuncStats &s = *f.second;
+        printf("%-*s %12lld %12lld %12lld", (int)name_width, f.first.c_str(),
+               (long long)s.loads, (long long)s.stores, (long long)s.accesses);
+        for (size_t l = 0; l < levels.size(); l++) {
+            // Each level only sees the misses of the level above it
+            int64_t seen = l == 0 ? s.accesses : s.misses[l - 1];
+            double rate = seen > 0 ? 100.0 * s.misses[l] / seen : 0.0;
+            printf(" %8.2f%%", rate);
+        }
+        printf(" %10s %10s %10s\n",
+               format_bytes(s.cold * line_bytes).c_str(),
+               format_bytes(s.reuse_percentile(0.5) * line_bytes).c_str(),
+               format_bytes(s.reuse_percentile(0.9) * line_bytes).c_str());
+    }
+}
+
+// Parse "size,ways", with an optional K or M suffix on the size.
+bool parse_cache(const char *arg, int64_t *size, int64_t *ways) {
+    char *end = nullptr;
+    double s = strtod(arg, &end);
+    if (end == arg) {
+        return false;
+    }
+    if (*end == 'K' || *end == 'k') {
+        s *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        s *= 1024 * 1024;
+        end++;
+    }
+    *size = (int64_t)s;
+    if (*end == ',') {
+        *ways = strtoll(end + 1, &end, 10);
+    }
+    return *end == 0 && *size > 0 && *ways > 0;
+}
+
+void usage(char * const *argv) {
+    const string usage =
+        "Usage: " + string(argv[0]) + " [-i trace_file] [--line bytes] [--l1 size,ways]\n"
+        "       [--l2 size,ways] [--llc size,ways] [--machine_params params]\n"
+        "\n"
+        "This tool reads a binary trace produced by Halide, from stdin by default,\n"
+        "and simulates its loads and stores through an L1/L2/LLC cache hierarchy.\n"
+        "For each traced Func it reports the miss rate of each level, the bytes of\n"
+        "its buffers touched, and the median and 90th percentile of the LRU stack\n"
+        "distances of its accesses, in bytes: a fully associative cache of the\n"
+        "latter size hits 90% of the reuses. --machine_params takes the string\n"
+        "given to the auto-schedulers, whose last level cache size sets the LLC.\n"
+        "The sizes of the levels default to 32K,8, 256K,8 and 16M,16 with 64 byte\n"
+        "lines. To generate a suitable binary trace, use Func::trace_loads() and\n"
+        "Func::trace_stores() with trace_realizations(), or the target features\n"
+        "trace_loads, trace_stores and trace_realizations, and run with\n"
+        "HL_TRACE_FILE=<filename>.\n";
+    fprintf(stderr, "%s\n", usage.c_str());
+    exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char * const *argv) {
+    const char *trace_filename = nullptr;
+    int64_t line_bytes = 64;
+    int64_t sizes[3] = {32 * 1024, 256 * 1024, 16 * 1024 * 1024};
+    int64_t ways[3] = {8, 8, 16};
+    const char *level_names[3] = {"L1", "L2", "LLC"};
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv);
+        }
+        const char *value = argv[++i];
+        if (arg == "-i") {
+            trace_filename = value;
+        } else if (arg == "--line") {
+            line_bytes = atoi(value);
+            if (line_bytes <= 0 || (line_bytes & (line_bytes - 1))) {
+                usage(argv);
+            }
+        } else if (arg == "--l1" || arg == "--l2" || arg == "--llc") {
+            int l = arg == "--l1" ? 0 : arg == "--l2" ? 1 : 2;
+            if (!parse_cache(value, &sizes[l], &ways[l])) {
+                usage(argv);
+            }
+        } else if (arg == "--machine_params") {
+            // parallelism,last_level_cache_size,balance
+            const char *comma = strchr(value, ',');
+            if (!comma || atoll(comma + 1) <= 0) {
+                usage(argv);
+            }
+            sizes[2] = atoll(comma + 1);
+        } else {
+            usage(argv);
+        }
+    }
+
+    FILE *file_desc = stdin;
+    if (trace_filename) {
+        file_desc = fopen(trace_filename, "rb");
+        if (file_desc == nullptr) {
+            fprintf(stderr, "Error opening file: %s. Exiting.\n", trace_filename);
+            exit(1);
+        }
+    }
+
+    vector<Cache> levels;
+    for (int l = 0; l < 3; l++) {
+        levels.emplace_back(level_names[l], sizes[l], ways[l], line_bytes);
+    }
+    Simulator sim(levels, line_bytes);
+    for (;;) {
+        Packet p;
+        if (!p.read_from_filedesc(file_desc)) {
+            break;
+        }
+        sim.process(p);
+    }
+    if (file_desc != stdin) {
+        fclose(file_desc);
+    }
+
+    report(sim);
+    return 0;
+}